@@ -72,8 +72,7 @@ static void release(struct fsal_export *export_pub)
 	fsal_detach_export(export->export.fsal, &export->export.exports);
 	free_export_ops(&export->export);
 
-	ceph_shutdown(export->cmount);
-	export->cmount = NULL;
+	ceph_shutdown_mounts(export);
 	gsh_free(export);
 	export = NULL;
 }
@@ -156,7 +155,7 @@ static fsal_status_t lookup_path(struct fsal_export *export_pub,
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
-	construct_handle(&stx, i, export, &handle);
+	construct_handle(&stx, i, export->cmount, export, &handle);
 
 	if (attrs_out != NULL)
 		ceph2fsal_attributes(&stx, attrs_out);
@@ -225,7 +224,10 @@ static fsal_status_t create_handle(struct fsal_export *export_pub,
 	/* Handle to be created */
 	struct handle *handle = NULL;
 	/* Inode pointer */
-	struct Inode *i;
+	struct Inode *i = NULL;
+	/* Mount the inode was found in */
+	struct ceph_mount_info *cmount = NULL;
+	uint32_t n;
 
 	*pub_handle = NULL;
 
@@ -234,19 +236,25 @@ static fsal_status_t create_handle(struct fsal_export *export_pub,
 		return status;
 	}
 
-	i = ceph_ll_get_inode(export->cmount, *vi);
+	/* The object may be cached in any of the mounts */
+	for (n = 0; n < export->nr_cmounts && i == NULL; n++) {
+		cmount = export->cmounts[n];
+		i = ceph_ll_get_inode(cmount, *vi);
+	}
 	if (!i)
 		return ceph2fsal_error(-ESTALE);
 
 	/* The ceph_ll_connectable_m should have populated libceph's
 	   cache with all this anyway */
-	rc = fsal_ceph_ll_getattr(export->cmount, i, &stx,
+	rc = fsal_ceph_ll_getattr(cmount, i, &stx,
 		attrs_out ? CEPH_STATX_ATTR_MASK : CEPH_STATX_HANDLE_MASK,
 		op_ctx->creds);
-	if (rc < 0)
+	if (rc < 0) {
+		ceph_ll_put(cmount, i);
 		return ceph2fsal_error(rc);
+	}
 
-	construct_handle(&stx, i, export, &handle);
+	construct_handle(&stx, i, cmount, export, &handle);
 
 	if (attrs_out != NULL)
 		ceph2fsal_attributes(&stx, attrs_out);
@@ -279,7 +287,7 @@ static fsal_status_t get_fs_dynamic_info(struct fsal_export *export_pub,
 	/* Filesystem stat */
 	struct statvfs vfs_st;
 
-	rc = ceph_ll_statfs(export->cmount, export->root->i, &vfs_st);
+	rc = ceph_ll_statfs(export->root->cmount, export->root->i, &vfs_st);
 
 	if (rc < 0)
 		return ceph2fsal_error(rc);
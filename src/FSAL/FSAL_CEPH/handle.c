@@ -36,6 +36,7 @@
 #include <sys/sysmacros.h> /* for makedev(3) */
 #endif
 #include <fcntl.h>
+#include <sys/uio.h>
 #include <cephfs/libcephfs.h>
 #include "fsal.h"
 #include "fsal_types.h"
@@ -93,12 +94,12 @@ static fsal_status_t lookup(struct fsal_obj_handle *dir_pub,
 
 	LogFullDebug(COMPONENT_FSAL, "Lookup %s", path);
 
-	rc = fsal_ceph_ll_lookup(export->cmount, dir->i, path, &i, &stx,
+	rc = fsal_ceph_ll_lookup(dir->cmount, dir->i, path, &i, &stx,
 					!!attrs_out, op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
-	construct_handle(&stx, i, export, &obj);
+	construct_handle(&stx, i, dir->cmount, export, &obj);
 
 	if (attrs_out != NULL)
 		ceph2fsal_attributes(&stx, attrs_out);
@@ -143,10 +144,12 @@ static fsal_status_t ceph_fsal_readdir(struct fsal_obj_handle *dir_pub,
 	uint64_t start = 0;
 	/* ceph_statx want mask */
 	unsigned int want = attrmask2ceph_want(attrmask);
+	/* readdirplus flags */
+	unsigned int flags = 0;
 	/* Return status */
 	fsal_status_t fsal_status = { ERR_FSAL_NO_ERROR, 0 };
 
-	rc = fsal_ceph_ll_opendir(export->cmount, dir->i, &dir_desc,
+	rc = fsal_ceph_ll_opendir(dir->cmount, dir->i, &dir_desc,
 				  op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
@@ -154,15 +157,23 @@ static fsal_status_t ceph_fsal_readdir(struct fsal_obj_handle *dir_pub,
 	if (whence != NULL)
 		start = *whence;
 
-	ceph_seekdir(export->cmount, dir_desc, start);
+	ceph_seekdir(dir->cmount, dir_desc, start);
+
+	/* The readdir reply carries each entry's attributes as the MDS
+	 * knows them.  Syncing them costs an MDS round trip for every
+	 * entry whose caps we lack, so only do it when attributes are
+	 * wanted and Readdir_Attr_Sync is set.
+	 */
+	if (want == 0 || !CephFSM.readdir_attr_sync)
+		flags |= AT_NO_ATTR_SYNC;
 
 	while (!(*eof)) {
 		struct ceph_statx stx;
 		struct dirent de;
 		struct Inode *i = NULL;
 
-		rc = fsal_ceph_readdirplus(export->cmount, dir_desc, dir->i,
-					   &de, &stx, want, 0, &i,
+		rc = fsal_ceph_readdirplus(dir->cmount, dir_desc, dir->i,
+					   &de, &stx, want, flags, &i,
 					   op_ctx->creds);
 		if (rc < 0) {
 			fsal_status = ceph2fsal_error(rc);
@@ -178,7 +189,7 @@ static fsal_status_t ceph_fsal_readdir(struct fsal_obj_handle *dir_pub,
 				continue;
 			}
 
-			construct_handle(&stx, i, export, &obj);
+			construct_handle(&stx, i, dir->cmount, export, &obj);
 
 			fsal_prepare_attrs(&attrs, attrmask);
 			ceph2fsal_attributes(&stx, &attrs);
@@ -202,7 +213,7 @@ static fsal_status_t ceph_fsal_readdir(struct fsal_obj_handle *dir_pub,
 
  closedir:
 
-	rc = ceph_ll_releasedir(export->cmount, dir_desc);
+	rc = ceph_ll_releasedir(dir->cmount, dir_desc);
 
 	if (rc < 0)
 		fsal_status = ceph2fsal_error(rc);
@@ -257,12 +268,12 @@ static fsal_status_t ceph_fsal_mkdir(struct fsal_obj_handle *dir_hdl,
 	unix_mode = fsal2unix_mode(attrib->mode)
 		& ~op_ctx->fsal_export->exp_ops.fs_umask(op_ctx->fsal_export);
 
-	rc = fsal_ceph_ll_mkdir(export->cmount, dir->i, name, unix_mode, &i,
+	rc = fsal_ceph_ll_mkdir(dir->cmount, dir->i, name, unix_mode, &i,
 			&stx, !!attrs_out, op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
-	construct_handle(&stx, i, export, &obj);
+	construct_handle(&stx, i, dir->cmount, export, &obj);
 
 	*new_obj = &obj->handle;
 
@@ -370,12 +381,12 @@ static fsal_status_t ceph_fsal_mknode(struct fsal_obj_handle *dir_hdl,
 		return fsalstat(ERR_FSAL_INVAL, EINVAL);
 	}
 
-	rc = fsal_ceph_ll_mknod(export->cmount, dir->i, name, unix_mode,
+	rc = fsal_ceph_ll_mknod(dir->cmount, dir->i, name, unix_mode,
 			unix_dev, &i, &stx, !!attrs_out, op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
-	construct_handle(&stx, i, export, &obj);
+	construct_handle(&stx, i, dir->cmount, export, &obj);
 
 	*new_obj = &obj->handle;
 
@@ -456,12 +467,12 @@ static fsal_status_t ceph_fsal_symlink(struct fsal_obj_handle *dir_hdl,
 	struct handle *obj = NULL;
 	fsal_status_t status;
 
-	rc = fsal_ceph_ll_symlink(export->cmount, dir->i, name, link_path,
+	rc = fsal_ceph_ll_symlink(dir->cmount, dir->i, name, link_path,
 			      &i, &stx, !!attrs_out, op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
-	construct_handle(&stx, i, export, &obj);
+	construct_handle(&stx, i, dir->cmount, export, &obj);
 
 	*new_obj = &obj->handle;
 
@@ -519,15 +530,12 @@ static fsal_status_t ceph_fsal_readlink(struct fsal_obj_handle *link_pub,
 {
 	/* Generic status return */
 	int rc = 0;
-	/* The private 'full' export */
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* The private 'full' directory handle */
 	struct handle *link = container_of(link_pub, struct handle, handle);
 	/* Pointer to the Ceph link content */
 	char content[PATH_MAX];
 
-	rc = fsal_ceph_ll_readlink(export->cmount, link->i, content,
+	rc = fsal_ceph_ll_readlink(link->cmount, link->i, content,
 				   PATH_MAX, op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
@@ -557,15 +565,12 @@ static fsal_status_t getattrs(struct fsal_obj_handle *handle_pub,
 {
 	/* Generic status return */
 	int rc = 0;
-	/* The private 'full' export */
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* The private 'full' directory handle */
 	struct handle *handle = container_of(handle_pub, struct handle, handle);
 	/* Stat buffer */
 	struct ceph_statx stx;
 
-	rc = fsal_ceph_ll_getattr(export->cmount, handle->i, &stx,
+	rc = fsal_ceph_ll_getattr(handle->cmount, handle->i, &stx,
 				CEPH_STATX_ATTR_MASK, op_ctx->creds);
 	LogDebug(COMPONENT_FSAL, "getattr returned %d", rc);
 	if (rc < 0) {
@@ -600,17 +605,24 @@ static fsal_status_t ceph_fsal_link(struct fsal_obj_handle *handle_pub,
 {
 	/* Generic status return */
 	int rc = 0;
-	/* The private 'full' export */
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* The private 'full' object handle */
 	struct handle *handle = container_of(handle_pub, struct handle, handle);
 	/* The private 'full' destination directory handle */
 	struct handle *destdir =
 	    container_of(destdir_pub, struct handle, handle);
+	/* The destination directory in the mount of the object */
+	struct Inode *di;
 
-	rc = fsal_ceph_ll_link(export->cmount, handle->i, destdir->i, name,
+	rc = ceph_inode_in(destdir, handle->cmount, &di);
+	if (rc < 0)
+		return ceph2fsal_error(rc);
+
+	rc = fsal_ceph_ll_link(handle->cmount, handle->i, di, name,
 				op_ctx->creds);
+
+	if (di != destdir->i)
+		ceph_ll_put(handle->cmount, di);
+
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
@@ -639,16 +651,23 @@ static fsal_status_t ceph_fsal_rename(struct fsal_obj_handle *obj_hdl,
 {
 	/* Generic status return */
 	int rc = 0;
-	/* The private 'full' export */
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* The private 'full' object handle */
 	struct handle *olddir = container_of(olddir_pub, struct handle, handle);
 	/* The private 'full' destination directory handle */
 	struct handle *newdir = container_of(newdir_pub, struct handle, handle);
+	/* The destination directory in the mount of the source one */
+	struct Inode *ni;
+
+	rc = ceph_inode_in(newdir, olddir->cmount, &ni);
+	if (rc < 0)
+		return ceph2fsal_error(rc);
+
+	rc = fsal_ceph_ll_rename(olddir->cmount, olddir->i, old_name,
+					ni, new_name, op_ctx->creds);
+
+	if (ni != newdir->i)
+		ceph_ll_put(olddir->cmount, ni);
 
-	rc = fsal_ceph_ll_rename(export->cmount, olddir->i, old_name,
-					newdir->i, new_name, op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
@@ -674,9 +693,6 @@ static fsal_status_t ceph_fsal_unlink(struct fsal_obj_handle *dir_pub,
 {
 	/* Generic status return */
 	int rc = 0;
-	/* The private 'full' export */
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* The private 'full' object handle */
 	struct handle *dir = container_of(dir_pub, struct handle, handle);
 
@@ -685,10 +701,10 @@ static fsal_status_t ceph_fsal_unlink(struct fsal_obj_handle *dir_pub,
 		     name, object_file_type_to_str(obj_pub->type));
 
 	if (obj_pub->type != DIRECTORY) {
-		rc = fsal_ceph_ll_unlink(export->cmount, dir->i, name,
+		rc = fsal_ceph_ll_unlink(dir->cmount, dir->i, name,
 					op_ctx->creds);
 	} else {
-		rc = fsal_ceph_ll_rmdir(export->cmount, dir->i, name,
+		rc = fsal_ceph_ll_rmdir(dir->cmount, dir->i, name,
 					op_ctx->creds);
 	}
 
@@ -719,8 +735,6 @@ fsal_status_t ceph_open_my_fd(struct handle *myself,
 			      struct ceph_fd *my_fd)
 {
 	int rc;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 
 	LogFullDebug(COMPONENT_FSAL,
 		     "my_fd = %p my_fd->fd = %p openflags = %x, posix_flags = %x",
@@ -733,7 +747,7 @@ fsal_status_t ceph_open_my_fd(struct handle *myself,
 		     "openflags = %x, posix_flags = %x",
 		     openflags, posix_flags);
 
-	rc = fsal_ceph_ll_open(export->cmount, myself->i, posix_flags,
+	rc = fsal_ceph_ll_open(myself->cmount, myself->i, posix_flags,
 				&my_fd->fd, op_ctx->creds);
 
 	if (rc < 0) {
@@ -762,7 +776,7 @@ fsal_status_t ceph_close_my_fd(struct handle *handle, struct ceph_fd *my_fd)
 	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
 
 	if (my_fd->fd != NULL && my_fd->openflags != FSAL_O_CLOSED) {
-		rc = ceph_ll_close(handle->export->cmount, my_fd->fd);
+		rc = ceph_ll_close(handle->cmount, my_fd->fd);
 		if (rc < 0)
 			status = ceph2fsal_error(rc);
 		my_fd->fd = NULL;
@@ -1078,7 +1092,7 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 
 		if (createmode >= FSAL_EXCLUSIVE || truncated) {
 			/* Refresh the attributes */
-			retval = fsal_ceph_ll_getattr(export->cmount,
+			retval = fsal_ceph_ll_getattr(myself->cmount,
 					myself->i, &stx, !!attrs_out,
 					op_ctx->creds);
 
@@ -1215,7 +1229,7 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 		posix_flags |= O_EXCL;
 	}
 
-	retval = fsal_ceph_ll_create(export->cmount,  myself->i, name,
+	retval = fsal_ceph_ll_create(myself->cmount,  myself->i, name,
 				unix_mode, posix_flags, &i, &fd, &stx,
 				!!attrs_out, op_ctx->creds);
 
@@ -1237,7 +1251,7 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 		 * the condition of not wanting to set attributes.
 		 */
 		posix_flags &= ~O_EXCL;
-		retval = fsal_ceph_ll_create(export->cmount,  myself->i,
+		retval = fsal_ceph_ll_create(myself->cmount,  myself->i,
 				name, unix_mode, posix_flags, &i, &fd,
 				&stx, !!attrs_out, op_ctx->creds);
 		if (retval < 0) {
@@ -1273,7 +1287,7 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 	 */
 	*caller_perm_check = false;
 
-	construct_handle(&stx, i, export, &hdl);
+	construct_handle(&stx, i, myself->cmount, export, &hdl);
 
 	/* If we didn't have a state above, use the global fd. At this point,
 	 * since we just created the global fd, no one else can have a
@@ -1354,7 +1368,7 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 
 	if (created) {
 		/* Remove the file we just created */
-		fsal_ceph_ll_unlink(export->cmount, myself->i, name,
+		fsal_ceph_ll_unlink(myself->cmount, myself->i, name,
 					op_ctx->creds);
 	}
 
@@ -1488,8 +1502,54 @@ fsal_status_t ceph_find_fd(Fh **fd,
 	return status;
 }
 
+#ifdef USE_FSAL_CEPH_LL_READV
+#define fsal_ceph_ll_readv ceph_ll_readv
+#define fsal_ceph_ll_writev ceph_ll_writev
+#else
+/* Older libcephfs has no vectored I/O; do it a segment at a time */
+static int64_t fsal_ceph_ll_readv(struct ceph_mount_info *cmount, Fh *fh,
+				  const struct iovec *iov, int iovcnt,
+				  int64_t off)
+{
+	int64_t total = 0;
+	int rc, i;
+
+	for (i = 0; i < iovcnt; i++) {
+		rc = ceph_ll_read(cmount, fh, off + total, iov[i].iov_len,
+				  iov[i].iov_base);
+		if (rc < 0)
+			return total ? total : rc;
+		total += rc;
+		if ((size_t) rc < iov[i].iov_len)
+			break;
+	}
+
+	return total;
+}
+
+static int64_t fsal_ceph_ll_writev(struct ceph_mount_info *cmount, Fh *fh,
+				   const struct iovec *iov, int iovcnt,
+				   int64_t off)
+{
+	int64_t total = 0;
+	int rc, i;
+
+	for (i = 0; i < iovcnt; i++) {
+		rc = ceph_ll_write(cmount, fh, off + total, iov[i].iov_len,
+				   iov[i].iov_base);
+		if (rc < 0)
+			return total ? total : rc;
+		total += rc;
+		if ((size_t) rc < iov[i].iov_len)
+			break;
+	}
+
+	return total;
+}
+#endif
+
 /**
- * @brief Read data from a file
+ * @brief Read data from a file into an iovec
  *
  * This function reads data from the given file. The FSAL must be able to
  * perform the read whether a state is presented or not. This function also
@@ -1500,8 +1560,8 @@ fsal_status_t ceph_find_fd(Fh **fd,
  *                               bypass any deny read
  * @param[in]     state          state_t to use for this operation
  * @param[in]     offset         Position from which to read
- * @param[in]     buffer_size    Amount of data to read
- * @param[out]    buffer         Buffer to which data are to be copied
+ * @param[in]     iov            Segments to fill
+ * @param[in]     iovcnt         Number of segments
  * @param[out]    read_amount    Amount of data read
  * @param[out]    end_of_file    true if the end of file has been reached
  * @param[in,out] info           more information about the data
@@ -1509,24 +1569,22 @@ fsal_status_t ceph_find_fd(Fh **fd,
  * @return FSAL status.
  */
 
-fsal_status_t ceph_read2(struct fsal_obj_handle *obj_hdl,
-			bool bypass,
-			struct state_t *state,
-			uint64_t offset,
-			size_t buffer_size,
-			void *buffer,
-			size_t *read_amount,
-			bool *end_of_file,
-			struct io_info *info)
+static fsal_status_t ceph_readv2(struct fsal_obj_handle *obj_hdl,
+				 bool bypass,
+				 struct state_t *state,
+				 uint64_t offset,
+				 const struct iovec *iov,
+				 int iovcnt,
+				 size_t *read_amount,
+				 bool *end_of_file,
+				 struct io_info *info)
 {
 	struct handle *myself = container_of(obj_hdl, struct handle, handle);
 	Fh *my_fd = NULL;
-	ssize_t nb_read;
+	int64_t nb_read;
 	fsal_status_t status;
 	bool has_lock = false;
 	bool closefd = false;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 
 	if (info != NULL) {
 		/* Currently we don't support READ_PLUS */
@@ -1540,8 +1598,8 @@ fsal_status_t ceph_read2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
-	nb_read =
-	    ceph_ll_read(export->cmount, my_fd, offset, buffer_size, buffer);
+	nb_read = fsal_ceph_ll_readv(myself->cmount, my_fd, iov, iovcnt,
+				     offset);
 
 	if (offset == -1 || nb_read < 0) {
 		status = ceph2fsal_error(nb_read);
@@ -1552,26 +1610,10 @@ fsal_status_t ceph_read2(struct fsal_obj_handle *obj_hdl,
 
 	*end_of_file = nb_read == 0;
 
-#if 0
-	/** @todo
-	 *
-	 * Is this all we really need to do to support READ_PLUS? Will anyone
-	 * ever get upset that we don't return holes, even for blocks of all
-	 * zeroes?
-	 *
-	 */
-	if (info != NULL) {
-		info->io_content.what = NFS4_CONTENT_DATA;
-		info->io_content.data.d_offset = offset + nb_read;
-		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
-	}
-#endif
-
  out:
 
 	if (closefd)
-		(void) ceph_ll_close(myself->export->cmount, my_fd);
+		(void) ceph_ll_close(myself->cmount, my_fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -1580,7 +1622,32 @@ fsal_status_t ceph_read2(struct fsal_obj_handle *obj_hdl,
 }
 
 /**
- * @brief Write data to a file
+ * @brief Read data from a file
+ *
+ * Single buffer version of ceph_readv2.
+ */
+
+fsal_status_t ceph_read2(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			struct state_t *state,
+			uint64_t offset,
+			size_t buffer_size,
+			void *buffer,
+			size_t *read_amount,
+			bool *end_of_file,
+			struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return ceph_readv2(obj_hdl, bypass, state, offset, &iov, 1,
+			   read_amount, end_of_file, info);
+}
+
+/**
+ * @brief Write data to a file from an iovec
  *
  * This function writes data to a file. The FSAL must be able to
  * perform the write whether a state is presented or not. This function also
@@ -1595,7 +1662,9 @@ fsal_status_t ceph_read2(struct fsal_obj_handle *obj_hdl,
  *                               bypass any non-mandatory deny write
  * @param[in]     state          state_t to use for this operation
  * @param[in]     offset         Position at which to write
- * @param[in]     buffer         Data to be written
+ * @param[in]     iov            Segments to write
+ * @param[in]     iovcnt         Number of segments
+ * @param[out]    wrote_amount   Number of bytes written
  * @param[in,out] fsal_stable    In, if on, the fsal is requested to write data
  *                               to stable store. Out, the fsal reports what
  *                               it did.
@@ -1604,26 +1673,24 @@ fsal_status_t ceph_read2(struct fsal_obj_handle *obj_hdl,
  * @return FSAL status.
  */
 
-fsal_status_t ceph_write2(struct fsal_obj_handle *obj_hdl,
-			 bool bypass,
-			 struct state_t *state,
-			 uint64_t offset,
-			 size_t buffer_size,
-			 void *buffer,
-			 size_t *wrote_amount,
-			 bool *fsal_stable,
-			 struct io_info *info)
+static fsal_status_t ceph_writev2(struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  struct state_t *state,
+				  uint64_t offset,
+				  const struct iovec *iov,
+				  int iovcnt,
+				  size_t *wrote_amount,
+				  bool *fsal_stable,
+				  struct io_info *info)
 {
 	struct handle *myself = container_of(obj_hdl, struct handle, handle);
-	ssize_t nb_written;
+	int64_t nb_written;
 	fsal_status_t status;
 	int retval = 0;
 	Fh *my_fd = NULL;
 	bool has_lock = false;
 	bool closefd = false;
 	fsal_openflags_t openflags = FSAL_O_WRITE;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 
 	if (info != NULL) {
 		/* Currently we don't support WRITE_PLUS */
@@ -1642,8 +1709,8 @@ fsal_status_t ceph_write2(struct fsal_obj_handle *obj_hdl,
 
 	fsal_set_credentials(op_ctx->creds);
 
-	nb_written =
-	    ceph_ll_write(export->cmount, my_fd, offset, buffer_size, buffer);
+	nb_written = fsal_ceph_ll_writev(myself->cmount, my_fd, iov, iovcnt,
+					 offset);
 
 	if (nb_written < 0) {
 		status = ceph2fsal_error(nb_written);
@@ -1653,7 +1720,7 @@ fsal_status_t ceph_write2(struct fsal_obj_handle *obj_hdl,
 	*wrote_amount = nb_written;
 
 	if (*fsal_stable) {
-		retval = ceph_ll_fsync(export->cmount, my_fd, false);
+		retval = ceph_ll_fsync(myself->cmount, my_fd, false);
 
 		if (retval < 0)
 			status = ceph2fsal_error(retval);
@@ -1662,7 +1729,7 @@ fsal_status_t ceph_write2(struct fsal_obj_handle *obj_hdl,
  out:
 
 	if (closefd)
-		(void) ceph_ll_close(myself->export->cmount, my_fd);
+		(void) ceph_ll_close(myself->cmount, my_fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -1671,6 +1738,182 @@ fsal_status_t ceph_write2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Write data to a file
+ *
+ * Single buffer version of ceph_writev2.
+ */
+
+fsal_status_t ceph_write2(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct state_t *state,
+			 uint64_t offset,
+			 size_t buffer_size,
+			 void *buffer,
+			 size_t *wrote_amount,
+			 bool *fsal_stable,
+			 struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return ceph_writev2(obj_hdl, bypass, state, offset, &iov, 1,
+			    wrote_amount, fsal_stable, info);
+}
+
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_RW
+/**
+ * @brief A nonblocking read or write in flight in libcephfs
+ */
+struct ceph_async_io {
+	struct ceph_ll_io_info io_info;
+	struct fsal_obj_handle *obj_hdl;
+	fsal_async_cb done_cb;
+	struct fsal_io_arg *io_arg;
+	void *caller_arg;
+};
+
+static void ceph_async_io_done(struct ceph_ll_io_info *io_info)
+{
+	struct ceph_async_io *aio = io_info->priv;
+	struct fsal_io_arg *io_arg = aio->io_arg;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+
+	if (io_info->result < 0) {
+		status = ceph2fsal_error(io_info->result);
+	} else {
+		io_arg->io_amount = io_info->result;
+		if (!io_info->write)
+			io_arg->end_of_file = io_info->result == 0;
+	}
+
+	aio->done_cb(aio->obj_hdl, status, io_arg, aio->caller_arg);
+	gsh_free(aio);
+}
+
+/**
+ * @brief Try to start a nonblocking read or write
+ *
+ * Only I/O on a state's own Fh is done asynchronously; a locked global
+ * Fh or temporary Fh is only ours for the duration of the call.  A
+ * stable write asks libcephfs to fsync as part of the same I/O.
+ *
+ * @return true if submitted; done_cb will be called on completion.
+ */
+static bool ceph_async_submit(struct fsal_obj_handle *obj_hdl,
+			      bool bypass, bool write,
+			      fsal_async_cb done_cb,
+			      struct fsal_io_arg *io_arg,
+			      void *caller_arg)
+{
+	struct handle *myself = container_of(obj_hdl, struct handle, handle);
+	struct ceph_async_io *aio;
+	Fh *my_fd = NULL;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool closefd = false;
+	int64_t rc;
+
+	if (io_arg->info != NULL)
+		return false;
+
+	status = ceph_find_fd(&my_fd, obj_hdl, bypass, io_arg->state,
+			      write ? FSAL_O_WRITE : FSAL_O_READ,
+			      &has_lock, &closefd, false);
+
+	/* Let the synchronous path report any error */
+	if (FSAL_IS_ERROR(status))
+		return false;
+
+	if (has_lock || closefd) {
+		if (closefd)
+			(void) ceph_ll_close(myself->cmount, my_fd);
+		if (has_lock)
+			PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+		return false;
+	}
+
+	aio = gsh_calloc(1, sizeof(*aio));
+	aio->obj_hdl = obj_hdl;
+	aio->done_cb = done_cb;
+	aio->io_arg = io_arg;
+	aio->caller_arg = caller_arg;
+	aio->io_info.callback = ceph_async_io_done;
+	aio->io_info.priv = aio;
+	aio->io_info.fh = my_fd;
+	aio->io_info.iov = io_arg->iov;
+	aio->io_info.iovcnt = io_arg->iov_count;
+	aio->io_info.off = io_arg->offset;
+	aio->io_info.write = write;
+	aio->io_info.fsync = write && io_arg->fsal_stable;
+
+	if (write)
+		fsal_set_credentials(op_ctx->creds);
+
+	rc = ceph_ll_nonblocking_readv_writev(myself->cmount, &aio->io_info);
+
+	if (write)
+		fsal_restore_ganesha_credentials();
+
+	if (rc < 0) {
+		gsh_free(aio);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Read data from a file asynchronously
+ */
+
+static void ceph_read2_async(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     fsal_async_cb done_cb,
+			     struct fsal_io_arg *read_arg,
+			     void *caller_arg)
+{
+	fsal_status_t status;
+
+	if (ceph_async_submit(obj_hdl, bypass, false, done_cb, read_arg,
+			      caller_arg))
+		return;
+
+	status = ceph_readv2(obj_hdl, bypass, read_arg->state,
+			     read_arg->offset, read_arg->iov,
+			     read_arg->iov_count, &read_arg->io_amount,
+			     &read_arg->end_of_file, read_arg->info);
+
+	done_cb(obj_hdl, status, read_arg, caller_arg);
+}
+
+/**
+ * @brief Write data to a file asynchronously
+ */
+
+static void ceph_write2_async(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      fsal_async_cb done_cb,
+			      struct fsal_io_arg *write_arg,
+			      void *caller_arg)
+{
+	fsal_status_t status;
+
+	if (ceph_async_submit(obj_hdl, bypass, true, done_cb, write_arg,
+			      caller_arg))
+		return;
+
+	status = ceph_writev2(obj_hdl, bypass, write_arg->state,
+			      write_arg->offset, write_arg->iov,
+			      write_arg->iov_count, &write_arg->io_amount,
+			      &write_arg->fsal_stable, write_arg->info);
+
+	done_cb(obj_hdl, status, write_arg, caller_arg);
+}
+#endif
+
 /**
  * @brief Commit written data
  *
@@ -1698,8 +1941,6 @@ fsal_status_t ceph_commit2(struct fsal_obj_handle *obj_hdl,
 	struct ceph_fd temp_fd = {0, NULL}, *out_fd = &temp_fd;
 	bool has_lock = false;
 	bool closefd = false;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 
 	/* Make sure file is open in appropriate mode.
 	 * Do not check share reservation.
@@ -1711,14 +1952,14 @@ fsal_status_t ceph_commit2(struct fsal_obj_handle *obj_hdl,
 				 &closefd);
 
 	if (!FSAL_IS_ERROR(status)) {
-		retval = ceph_ll_fsync(export->cmount, out_fd->fd, false);
+		retval = ceph_ll_fsync(myself->cmount, out_fd->fd, false);
 
 		if (retval < 0)
 			status = ceph2fsal_error(retval);
 	}
 
 	if (closefd)
-		(void) ceph_ll_close(myself->export->cmount, out_fd->fd);
+		(void) ceph_ll_close(myself->cmount, out_fd->fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -1764,8 +2005,6 @@ fsal_status_t ceph_lock_op2(struct fsal_obj_handle *obj_hdl,
 	bool closefd = false;
 	bool bypass = false;
 	fsal_openflags_t openflags = FSAL_O_RDWR;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 
 	LogFullDebug(COMPONENT_FSAL,
 		     "Locking: op:%d type:%d start:%" PRIu64 " length:%"
@@ -1836,10 +2075,10 @@ fsal_status_t ceph_lock_op2(struct fsal_obj_handle *obj_hdl,
 	}
 
 	if (lock_op == FSAL_OP_LOCKT) {
-		retval = ceph_ll_getlk(export->cmount, my_fd, &lock_args,
+		retval = ceph_ll_getlk(myself->cmount, my_fd, &lock_args,
 				       (uint64_t) owner);
 	} else {
-		retval = ceph_ll_setlk(export->cmount, my_fd, &lock_args,
+		retval = ceph_ll_setlk(myself->cmount, my_fd, &lock_args,
 				       (uint64_t) owner, false);
 	}
 
@@ -1852,7 +2091,7 @@ fsal_status_t ceph_lock_op2(struct fsal_obj_handle *obj_hdl,
 
 		if (conflicting_lock != NULL) {
 			/* Get the conflicting lock */
-			retval = ceph_ll_getlk(export->cmount, my_fd,
+			retval = ceph_ll_getlk(myself->cmount, my_fd,
 					       &lock_args, (uint64_t) owner);
 
 			if (retval < 0) {
@@ -1891,7 +2130,7 @@ fsal_status_t ceph_lock_op2(struct fsal_obj_handle *obj_hdl,
  err:
 
 	if (closefd)
-		(void) ceph_ll_close(myself->export->cmount, my_fd);
+		(void) ceph_ll_close(myself->cmount, my_fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -1923,8 +2162,6 @@ fsal_status_t ceph_setattr2(struct fsal_obj_handle *obj_hdl,
 	int rc = 0;
 	bool has_lock = false;
 	bool closefd = false;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* Stat buffer */
 	struct ceph_statx stx;
 	/* Mask of attributes to set */
@@ -2047,7 +2284,7 @@ fsal_status_t ceph_setattr2(struct fsal_obj_handle *obj_hdl,
 	}
 #endif
 
-	rc = fsal_ceph_ll_setattr(export->cmount, myself->i, &stx, mask,
+	rc = fsal_ceph_ll_setattr(myself->cmount, myself->i, &stx, mask,
 					op_ctx->creds);
 	if (rc < 0) {
 		LogDebug(COMPONENT_FSAL,
@@ -2200,6 +2437,12 @@ void handle_ops_init(struct fsal_obj_ops *ops)
 	ops->reopen2 = ceph_reopen2;
 	ops->read2 = ceph_read2;
 	ops->write2 = ceph_write2;
+	ops->readv2 = ceph_readv2;
+	ops->writev2 = ceph_writev2;
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_RW
+	ops->read2_async = ceph_read2_async;
+	ops->write2_async = ceph_write2_async;
+#endif
 	ops->commit2 = ceph_commit2;
 #ifdef USE_FSAL_CEPH_SETLK
 	ops->lock_op2 = ceph_lock_op2;
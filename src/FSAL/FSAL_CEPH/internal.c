@@ -45,6 +45,41 @@
 #include "statx_compat.h"
 #include "internal.h"
 
+/**
+ * @brief Move a handle to the mount its inode number picks
+ *
+ * If the inode cannot be had in that mount, the handle stays where it
+ * is, which is as good if less spread.
+ *
+ * @param[in]     export Export on which the object lives
+ * @param[in,out] obj    The handle
+ */
+static void ceph_move_handle(struct export *export, struct handle *obj)
+{
+#ifdef USE_FSAL_CEPH_LL_LOOKUP_INODE
+	struct ceph_mount_info *home;
+	struct inodeno_t ino = { obj->vi.ino.val };
+	struct Inode *i;
+
+	if (export->nr_cmounts < 2)
+		return;
+
+#ifdef CEPH_NOSNAP
+	/* Snapshots are only reached through their directory */
+	if (obj->vi.snapid.val != CEPH_NOSNAP)
+		return;
+#endif /* CEPH_NOSNAP */
+
+	home = export->cmounts[ino.val % export->nr_cmounts];
+	if (home == obj->cmount || ceph_ll_lookup_inode(home, ino, &i) != 0)
+		return;
+
+	ceph_ll_put(obj->cmount, obj->i);
+	obj->i = i;
+	obj->cmount = home;
+#endif /* USE_FSAL_CEPH_LL_LOOKUP_INODE */
+}
+
 /**
  * @brief Construct a new filehandle
  *
@@ -52,7 +87,15 @@
  * it to the export.  After this call the attributes have been filled
  * in and the handdle is up-to-date and usable.
  *
+ * A directory is moved to the mount its inode number picks, so the
+ * lookups, creates and readdirs of different directories are spread
+ * over the export's mounts.  Other objects stay in the mount they were
+ * found in, that of their directory, so a file created with an open Fh
+ * need not move.
+ *
  * @param[in]  stx    ceph_statx data for the file
+ * @param[in]  i      The inode, whose reference the handle takes over
+ * @param[in]  cmount The mount i belongs to
  * @param[in]  export Export on which the object lives
  * @param[out] obj    Object created
  *
@@ -60,7 +103,8 @@
  */
 
 void construct_handle(const struct ceph_statx *stx, struct Inode *i,
-		      struct export *export, struct handle **obj)
+		      struct ceph_mount_info *cmount, struct export *export,
+		      struct handle **obj)
 {
 	/* Pointer to the handle under construction */
 	struct handle *constructing = NULL;
@@ -74,8 +118,12 @@ void construct_handle(const struct ceph_statx *stx, struct Inode *i,
 	constructing->vi.snapid.val = stx->stx_dev;
 #endif /* CEPH_NOSNAP */
 	constructing->i = i;
+	constructing->cmount = cmount;
 	constructing->up_ops = export->export.up_ops;
 
+	if (S_ISDIR(stx->stx_mode))
+		ceph_move_handle(export, constructing);
+
 	fsal_obj_handle_init(&constructing->handle, &export->export,
 			     posix2fsal_type(stx->stx_mode));
 	handle_ops_init(&constructing->handle.obj_ops);
@@ -95,11 +143,63 @@ void construct_handle(const struct ceph_statx *stx, struct Inode *i,
 
 void deconstruct_handle(struct handle *obj)
 {
-	ceph_ll_put(obj->export->cmount, obj->i);
+	ceph_ll_put(obj->cmount, obj->i);
 	fsal_obj_handle_fini(&obj->handle);
 	gsh_free(obj);
 }
 
+/**
+ * @brief Get an object's inode in a given mount
+ *
+ * For the calls, such as link and rename, that take the inodes of two
+ * objects, which may be in different mounts.  Unless it is obj->i, the
+ * inode returned is a reference the caller puts with ceph_ll_put.
+ *
+ * @param[in]  obj    The object
+ * @param[in]  cmount The mount
+ * @param[out] i      The object's inode in cmount
+ *
+ * @return 0 on success, negative error codes on failure.
+ */
+
+int ceph_inode_in(struct handle *obj, struct ceph_mount_info *cmount,
+		  struct Inode **i)
+{
+	if (obj->cmount == cmount) {
+		*i = obj->i;
+		return 0;
+	}
+
+#ifdef USE_FSAL_CEPH_LL_LOOKUP_INODE
+	{
+		struct inodeno_t ino = { obj->vi.ino.val };
+
+		return ceph_ll_lookup_inode(cmount, ino, i);
+	}
+#else
+	return -EXDEV;
+#endif /* USE_FSAL_CEPH_LL_LOOKUP_INODE */
+}
+
+/**
+ * @brief Unmount all the mounts of an export
+ *
+ * @param[in,out] export The export
+ */
+
+void ceph_shutdown_mounts(struct export *export)
+{
+	uint32_t n;
+
+	for (n = 0; n < CEPH_MAX_MOUNTS; n++) {
+		if (export->cmounts[n] == NULL)
+			continue;
+		ceph_shutdown(export->cmounts[n]);
+		export->cmounts[n] = NULL;
+	}
+	export->cmount = NULL;
+}
+
 unsigned int
 attrmask2ceph_want(attrmask_t mask)
 {
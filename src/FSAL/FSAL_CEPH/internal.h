@@ -62,18 +62,30 @@ struct ceph_fsal_module {
 	struct fsal_module fsal;
 	fsal_staticfsinfo_t fs_info;
 	char *conf_path;
+	bool readdir_attr_sync;	/*< Sync attributes of readdir entries */
 };
 extern struct ceph_fsal_module CephFSM;
 
+/* Most libcephfs mounts an export can spread its objects over */
+#define CEPH_MAX_MOUNTS 16
+
 /**
  * Ceph private export object
+ *
+ * Each mount is a libcephfs client of its own, with its own client
+ * lock.  Directories are spread over the mounts by inode number, see
+ * construct_handle, so the workers of a busy export do not all queue
+ * on one client.
  */
 
 struct export {
 	struct fsal_export export;	/*< The public export object */
-	struct ceph_mount_info *cmount;	/*< The mount object used to
-					   access all Ceph methods on
-					   this export. */
+	struct ceph_mount_info *cmount;	/*< The first mount, used for
+					   the export wide and pNFS
+					   calls. */
+	struct ceph_mount_info *cmounts[CEPH_MAX_MOUNTS];
+	uint32_t nr_cmounts;	/*< Mounts in cmounts.  Defaults to 1
+				   and settable by mount_count. */
 	struct handle *root;	/*< The root handle */
 	char *user_id;			/* cephx user_id for this mount */
 	char *secret_key;
@@ -99,6 +111,9 @@ struct handle {
 	struct fsal_obj_handle handle;	/*< The public handle */
 	struct ceph_fd fd;
 	struct Inode *i;	/*< The Ceph inode */
+	struct ceph_mount_info *cmount;	/*< The mount i belongs to, all
+					   calls on the object go
+					   through it. */
 	const struct fsal_up_vector *up_ops;	/*< Upcall operations */
 	struct export *export;	/*< The first export this handle belongs to */
 	vinodeno_t vi;		/*< The object identifier */
@@ -158,8 +173,12 @@ static inline fsal_staticfsinfo_t *ceph_staticinfo(struct fsal_module *hdl)
 /* Prototypes */
 
 void construct_handle(const struct ceph_statx *stx, struct Inode *i,
-		      struct export *export, struct handle **obj);
+		      struct ceph_mount_info *cmount, struct export *export,
+		      struct handle **obj);
 void deconstruct_handle(struct handle *obj);
+void ceph_shutdown_mounts(struct export *export);
+int ceph_inode_in(struct handle *obj, struct ceph_mount_info *cmount,
+		  struct Inode **i);
 
 /**
  * @brief FSAL status from Ceph error
@@ -87,6 +87,8 @@ static struct config_item ceph_items[] = {
 			ceph_fsal_module, fs_info.umask),
 	CONF_ITEM_MODE("xattr_access_rights", 0,
 			ceph_fsal_module, fs_info.xattr_access_rights),
+	CONF_ITEM_BOOL("Readdir_Attr_Sync", true,
+		       ceph_fsal_module, readdir_attr_sync),
 	CONFIG_EOL
 };
 
@@ -149,6 +151,8 @@ static struct config_item export_params[] = {
 	CONF_ITEM_STR("user_id", 0, MAXUIDLEN, NULL, export, user_id),
 	CONF_ITEM_STR("secret_access_key", 0, MAXSECRETLEN, NULL, export,
 			secret_key),
+	CONF_ITEM_UI32("mount_count", 1, CEPH_MAX_MOUNTS, 1, export,
+		       nr_cmounts),
 	CONFIG_EOL
 };
 
@@ -161,6 +165,77 @@ static struct config_block export_param_block = {
 	.blk_desc.u.blk.commit = noop_conf_commit
 };
 
+/**
+ * @brief Mount the cluster for an export
+ *
+ * On failure, whatever was created is left in @c cmount for the caller
+ * to shut down.
+ *
+ * @param[in]  export The export being created
+ * @param[out] cmount The new mount
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t ceph_mount_export(struct export *export,
+				       struct ceph_mount_info **cmount)
+{
+	/* Return code from Ceph calls */
+	int ceph_status;
+
+	/* allocates ceph_mount_info */
+	ceph_status = ceph_create(cmount, export->user_id);
+	if (ceph_status != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to create Ceph handle for %s.",
+			op_ctx->ctx_export->fullpath);
+		return fsalstat(ERR_FSAL_SERVERFAULT, 0);
+	}
+
+	ceph_status = ceph_conf_read_file(*cmount, CephFSM.conf_path);
+	if (ceph_status != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to read Ceph configuration for %s.",
+			op_ctx->ctx_export->fullpath);
+		return fsalstat(ERR_FSAL_SERVERFAULT, 0);
+	}
+
+	if (export->secret_key) {
+		ceph_status = ceph_conf_set(*cmount, "key",
+					    export->secret_key);
+		if (ceph_status) {
+			LogCrit(COMPONENT_FSAL,
+				"Unable to set Ceph secret key for %s: %d",
+				op_ctx->ctx_export->fullpath, ceph_status);
+			return fsalstat(ERR_FSAL_INVAL, 0);
+		}
+	}
+
+	/*
+	 * Workaround for broken libcephfs that doesn't handle the path
+	 * given in ceph_mount properly. Should be harmless for fixed
+	 * libcephfs as well (see http://tracker.ceph.com/issues/18254).
+	 */
+	ceph_status = ceph_conf_set(*cmount, "client_mountpoint",
+				    op_ctx->ctx_export->fullpath);
+	if (ceph_status) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to set Ceph client_mountpoint for %s: %d",
+			op_ctx->ctx_export->fullpath, ceph_status);
+		return fsalstat(ERR_FSAL_INVAL, 0);
+	}
+
+	ceph_status = ceph_mount(*cmount, op_ctx->ctx_export->fullpath);
+	if (ceph_status != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to mount Ceph cluster for %s.",
+			op_ctx->ctx_export->fullpath);
+		return fsalstat(ERR_FSAL_SERVERFAULT, 0);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /**
  * @brief Create a new export under this FSAL
  *
@@ -199,8 +274,8 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 	struct ceph_statx stx;
 	/* Return code */
 	int rc;
-	/* Return code from Ceph calls */
-	int ceph_status;
+	/* Mount index */
+	uint32_t n;
 	/* True if we have called fsal_export_init */
 	bool initialized = false;
 
@@ -222,60 +297,23 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 
 	initialized = true;
 
-	/* allocates ceph_mount_info */
-	ceph_status = ceph_create(&export->cmount, export->user_id);
-	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
-		LogCrit(COMPONENT_FSAL,
-			"Unable to create Ceph handle for %s.",
+#ifndef USE_FSAL_CEPH_LL_LOOKUP_INODE
+	if (export->nr_cmounts > 1) {
+		LogWarn(COMPONENT_FSAL,
+			"mount_count needs ceph_ll_lookup_inode, using one mount for %s",
 			op_ctx->ctx_export->fullpath);
-		goto error;
-	}
-
-	ceph_status = ceph_conf_read_file(export->cmount, CephFSM.conf_path);
-	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
-		LogCrit(COMPONENT_FSAL,
-			"Unable to read Ceph configuration for %s.",
-			op_ctx->ctx_export->fullpath);
-		goto error;
+		export->nr_cmounts = 1;
 	}
+#endif
+	if (export->nr_cmounts == 0)
+		export->nr_cmounts = 1;
 
-	if (export->secret_key) {
-		ceph_status = ceph_conf_set(export->cmount, "key",
-					    export->secret_key);
-		if (ceph_status) {
-			status.major = ERR_FSAL_INVAL;
-			LogCrit(COMPONENT_FSAL,
-				"Unable to set Ceph secret key for %s: %d",
-				op_ctx->ctx_export->fullpath, ceph_status);
+	for (n = 0; n < export->nr_cmounts; n++) {
+		status = ceph_mount_export(export, &export->cmounts[n]);
+		if (FSAL_IS_ERROR(status))
 			goto error;
-		}
-	}
-
-	/*
-	 * Workaround for broken libcephfs that doesn't handle the path
-	 * given in ceph_mount properly. Should be harmless for fixed
-	 * libcephfs as well (see http://tracker.ceph.com/issues/18254).
-	 */
-	ceph_status = ceph_conf_set(export->cmount, "client_mountpoint",
-				    op_ctx->ctx_export->fullpath);
-	if (ceph_status) {
-		status.major = ERR_FSAL_INVAL;
-		LogCrit(COMPONENT_FSAL,
-			"Unable to set Ceph client_mountpoint for %s: %d",
-			op_ctx->ctx_export->fullpath, ceph_status);
-		goto error;
-	}
-
-	ceph_status = ceph_mount(export->cmount, op_ctx->ctx_export->fullpath);
-	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
-		LogCrit(COMPONENT_FSAL,
-			"Unable to mount Ceph cluster for %s.",
-			op_ctx->ctx_export->fullpath);
-		goto error;
 	}
+	export->cmount = export->cmounts[0];
 
 	if (fsal_attach_export(module_in, &export->export.exports) != 0) {
 		status.major = ERR_FSAL_SERVERFAULT;
@@ -302,7 +340,7 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 		goto error;
 	}
 
-	construct_handle(&stx, i, export, &handle);
+	construct_handle(&stx, i, export->cmount, export, &handle);
 
 	export->root = handle;
 	op_ctx->fsal_export = &export->export;
@@ -314,8 +352,7 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 		ceph_ll_put(export->cmount, i);
 
 	if (export) {
-		if (export->cmount)
-			ceph_shutdown(export->cmount);
+		ceph_shutdown_mounts(export);
 		gsh_free(export);
 	}
 
@@ -191,7 +191,8 @@ int fsal_ceph_readdirplus(struct ceph_mount_info *cmount,
 	if (rc <= 0)
 		return rc;
 
-	if (flags & AT_NO_ATTR_SYNC) {
+	/* The old call returns no Inode, so a lookup is needed for one */
+	if ((flags & AT_NO_ATTR_SYNC) && out == NULL) {
 		posix2ceph_statx(&st, stx);
 	} else {
 		rc = fsal_ceph_ll_lookup(cmount, dir, de->d_name, out, stx,
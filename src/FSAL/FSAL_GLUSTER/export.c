@@ -574,6 +574,8 @@ struct glexport_params {
 	char *glhostname;
 	char *glvolpath;
 	char *glfs_log;
+	uint32_t fs_count;
+	uint32_t event_threads;
 };
 
 static struct config_item export_params[] = {
@@ -586,6 +588,10 @@ static struct config_item export_params[] = {
 		      glexport_params, glvolpath),
 	CONF_ITEM_PATH("glfs_log", 1, MAXPATHLEN, GFAPI_LOG_LOCATION,
 		       glexport_params, glfs_log),
+	CONF_ITEM_UI32("fs_count", 1, GLUSTER_MAX_FS, 1,
+		       glexport_params, fs_count),
+	CONF_ITEM_UI32("event_threads", 0, 32, 0,
+		       glexport_params, event_threads),
 	CONFIG_EOL
 };
 
@@ -609,6 +615,7 @@ glusterfs_free_fs(struct glusterfs_fs *gl_fs)
 	int64_t refcnt;
 	int *retval = NULL;
 	int err     = 0;
+	uint32_t i;
 
 	PTHREAD_MUTEX_lock(&GlusterFS.lock);
 
@@ -629,6 +636,13 @@ glusterfs_free_fs(struct glusterfs_fs *gl_fs)
 
 	atomic_inc_int8_t(&gl_fs->destroy_mode);
 
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+	if (gl_fs->up_registered) {
+		gluster_up_unregister(gl_fs);
+		goto drain;
+	}
+#endif
+
 	/* Wait for up_thread to exit */
 	err = pthread_join(gl_fs->up_thread, (void **)&retval);
 
@@ -643,15 +657,95 @@ glusterfs_free_fs(struct glusterfs_fs *gl_fs)
 		return;
 	}
 
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+drain:
+#endif
+	/* Let queued invalidates finish before the fs goes away */
+	upcall_drain_wait(gl_fs);
+
 	/* Gluster and memory cleanup */
-	glfs_fini(gl_fs->fs);
+	for (i = 0; i < gl_fs->fs_count; i++)
+		glfs_fini(gl_fs->fs_pool[i]);
+	PTHREAD_MUTEX_destroy(&gl_fs->up_lock);
+	PTHREAD_COND_destroy(&gl_fs->up_cond);
 	gsh_free(gl_fs->volname);
 	gsh_free(gl_fs);
 }
 
+/**
+ * @brief Create and initialize a glfs_t for a volume
+ *
+ * @param[in] params Gluster export params
+ *
+ * @return The new instance, or NULL on failure.
+ */
+static glfs_t *glusterfs_new_fs(struct glexport_params *params)
+{
+	int rc = 0;
+	glfs_t *fs = NULL;
+	char threads[16];
+
+	fs = glfs_new(params->glvolname);
+	if (!fs) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to create new glfs. Volume: %s",
+			params->glvolname);
+		return NULL;
+	}
+
+	rc = glfs_set_volfile_server(fs, "tcp", params->glhostname, 24007);
+	if (rc != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to set volume file. Volume: %s",
+			params->glvolname);
+		goto out;
+	}
+
+	rc = glfs_set_logging(fs, params->glfs_log, 7);
+	if (rc != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to set logging. Volume: %s",
+			params->glvolname);
+		goto out;
+	}
+
+	/* Sets the threads of the protocol/client translators, the same
+	 * as the volume's client.event-threads would.
+	 */
+	if (params->event_threads != 0) {
+		snprintf(threads, sizeof(threads), "%u",
+			 params->event_threads);
+		rc = glfs_set_xlator_option(fs, "*-client-*", "event-threads",
+					    threads);
+		if (rc != 0) {
+			LogCrit(COMPONENT_FSAL,
+				"Unable to set event threads. Volume: %s",
+				params->glvolname);
+			goto out;
+		}
+	}
+
+	rc = glfs_init(fs);
+	if (rc != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to initialize volume. Volume: %s",
+			params->glvolname);
+		goto out;
+	}
+
+	return fs;
+
+out:
+	glfs_fini(fs);
+	return NULL;
+}
+
 /**
  * @brief Given Gluster export params, find and return if there is
  * already existing export entry. If not create one.
+ *
+ * The instances and event threads of a volume are those asked by the
+ * first export of it.
  */
 struct glusterfs_fs*
 glusterfs_get_fs(struct glexport_params params,
@@ -659,8 +753,8 @@ glusterfs_get_fs(struct glexport_params params,
 {
 	int rc = 0;
 	struct glusterfs_fs *gl_fs = NULL;
-	glfs_t  *fs = NULL;
 	struct glist_head *glist, *glistn;
+	uint32_t i;
 
 	PTHREAD_MUTEX_lock(&GlusterFS.lock);
 
@@ -681,44 +775,28 @@ glusterfs_get_fs(struct glexport_params params,
 	}
 
 	glist_init(&gl_fs->fs_obj);
+	glist_init(&gl_fs->up_pending);
+	PTHREAD_MUTEX_init(&gl_fs->up_lock, NULL);
+	PTHREAD_COND_init(&gl_fs->up_cond, NULL);
 
-	fs = glfs_new(params.glvolname);
-	if (!fs) {
-		LogCrit(COMPONENT_FSAL,
-			"Unable to create new glfs. Volume: %s",
-			params.glvolname);
-		goto out;
-	}
-
-	rc = glfs_set_volfile_server(fs, "tcp", params.glhostname, 24007);
-	if (rc != 0) {
-		LogCrit(COMPONENT_FSAL,
-			"Unable to set volume file. Volume: %s",
-			params.glvolname);
-		goto out;
-	}
-
-	rc = glfs_set_logging(fs, params.glfs_log, 7);
-	if (rc != 0) {
-		LogCrit(COMPONENT_FSAL,
-			"Unable to set logging. Volume: %s",
-			params.glvolname);
-		goto out;
-	}
-
-	rc = glfs_init(fs);
-	if (rc != 0) {
-		LogCrit(COMPONENT_FSAL,
-			"Unable to initialize volume. Volume: %s",
-			params.glvolname);
-		goto out;
+	for (i = 0; i < params.fs_count; i++) {
+		gl_fs->fs_pool[i] = glusterfs_new_fs(&params);
+		if (!gl_fs->fs_pool[i])
+			goto out;
+		gl_fs->fs_count++;
 	}
 
-	gl_fs->fs = fs;
+	gl_fs->fs = gl_fs->fs_pool[0];
 	gl_fs->volname = strdup(params.glvolname);
 	gl_fs->destroy_mode = 0;
 
 	gl_fs->up_ops = up_ops;
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+	if (gluster_up_register(gl_fs) == 0) {
+		gl_fs->up_registered = true;
+		goto add;
+	}
+#endif
 	rc = initiate_up_thread(gl_fs);
 	if (rc != 0) {
 		LogCrit(COMPONENT_FSAL,
@@ -727,6 +805,9 @@ glusterfs_get_fs(struct glexport_params params,
 		goto out;
 	}
 
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+add:
+#endif
 	glist_add(&GlusterFS.fs_obj, &gl_fs->fs_obj);
 
 found:
@@ -736,11 +817,13 @@ found:
 
 out:
 	PTHREAD_MUTEX_unlock(&GlusterFS.lock);
-	if (fs)
-		glfs_fini(fs);
 
 	if (gl_fs) {
+		for (i = 0; i < gl_fs->fs_count; i++)
+			glfs_fini(gl_fs->fs_pool[i]);
 		glist_del(&gl_fs->fs_obj); /* not needed atm */
+		PTHREAD_MUTEX_destroy(&gl_fs->up_lock);
+		PTHREAD_COND_destroy(&gl_fs->up_cond);
 		gsh_free(gl_fs);
 	}
 
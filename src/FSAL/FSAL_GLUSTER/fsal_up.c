@@ -32,21 +32,82 @@
 #include "fsal_up.h"
 #include "gluster_internal.h"
 #include "fsal_convert.h"
+#include "fridgethr.h"
 #include <sys/types.h>
 #include <unistd.h>
 #include <utime.h>
 #include <sys/time.h>
 
+/* Polling backoff bounds (usecs) when no upcall is pending */
+#define UP_IDLE_MIN 10
+#define UP_IDLE_MAX 10000
+
+/* An invalidate waiting for the drain job */
+struct gl_up_key {
+	struct glist_head list;
+	unsigned char hdl[GLAPI_HANDLE_LENGTH];
+};
+
+/**
+ * @brief Deliver every queued invalidate in one pass
+ *
+ * Runs on the general fridge.  Keys queued while a pass is running are
+ * picked up by the same job, so there is at most one job per volume.
+ */
+static void upcall_drain(struct fridgethr_context *ctx)
+{
+	struct glusterfs_fs *gl_fs = ctx->arg;
+	const struct fsal_up_vector *event_func = gl_fs->up_ops;
+	struct glist_head batch;
+	struct gl_up_key *k;
+	struct gsh_buffdesc key;
+	fsal_status_t fsal_status;
+
+	PTHREAD_MUTEX_lock(&gl_fs->up_lock);
+	while (!glist_empty(&gl_fs->up_pending)) {
+		glist_init(&batch);
+		glist_splice_tail(&batch, &gl_fs->up_pending);
+		PTHREAD_MUTEX_unlock(&gl_fs->up_lock);
+
+		while ((k = glist_first_entry(&batch, struct gl_up_key,
+					      list)) != NULL) {
+			glist_del(&k->list);
+
+			key.addr = k->hdl;
+			key.len = GLAPI_HANDLE_LENGTH;
+			fsal_status = event_func->invalidate_close(
+						event_func->up_export,
+						&key,
+						FSAL_UP_INVALIDATE_CACHE);
+			if (FSAL_IS_ERROR(fsal_status) &&
+			    fsal_status.major != ERR_FSAL_NOENT) {
+				LogWarn(COMPONENT_FSAL_UP,
+					"Inode_Invalidate event could not be processed for fd %p, rc %d",
+					gl_fs->fs, fsal_status.major);
+			}
+			gsh_free(k);
+		}
+
+		PTHREAD_MUTEX_lock(&gl_fs->up_lock);
+	}
+	gl_fs->up_queued = false;
+	pthread_cond_broadcast(&gl_fs->up_cond);
+	PTHREAD_MUTEX_unlock(&gl_fs->up_lock);
+}
+
+/**
+ * @brief Queue an invalidate of the given object
+ *
+ * The key is built here, since the object belongs to the upcall, and
+ * the drain job is started if it is not already running.
+ */
 int upcall_inode_invalidate(struct glusterfs_fs *gl_fs,
 			     struct glfs_object *object)
 {
 	int	     rc                             = -1;
 	glfs_t          *fs                         = NULL;
-	char            vol_uuid[GLAPI_UUID_LENGTH] = {'\0'};
-	unsigned char   globjhdl[GLAPI_HANDLE_LENGTH];
-	struct gsh_buffdesc         key;
-	const struct fsal_up_vector *event_func;
-	fsal_status_t fsal_status = {0, 0};
+	struct gl_up_key *k;
+	bool		 submit;
 
 	fs = gl_fs->fs;
 	if (!fs) {
@@ -56,49 +117,150 @@ int upcall_inode_invalidate(struct glusterfs_fs *gl_fs,
 		goto out;
 	}
 
-	rc = glfs_h_extract_handle(object, globjhdl+GLAPI_UUID_LENGTH,
+	k = gsh_malloc(sizeof(*k));
+
+	rc = glfs_h_extract_handle(object, k->hdl + GLAPI_UUID_LENGTH,
 				   GFAPI_HANDLE_LENGTH);
 	if (rc < 0) {
 		LogDebug(COMPONENT_FSAL_UP,
 			 "glfs_h_extract_handle failed %p",
 			 fs);
+		gsh_free(k);
 		goto out;
 	}
 
-	rc = glfs_get_volumeid(fs, vol_uuid,
+	rc = glfs_get_volumeid(fs, (char *)k->hdl,
 			       GLAPI_UUID_LENGTH);
 	if (rc < 0) {
 		LogDebug(COMPONENT_FSAL_UP,
 			 "glfs_get_volumeid failed %p",
 			 fs);
+		gsh_free(k);
 		goto out;
 	}
 
-	memcpy(globjhdl, vol_uuid, GLAPI_UUID_LENGTH);
-	key.addr = &globjhdl;
-	key.len = GLAPI_HANDLE_LENGTH;
-
 	LogDebug(COMPONENT_FSAL_UP, "Received event to process for %p",
 		 fs);
 
-	event_func = gl_fs->up_ops;
-
-	fsal_status = event_func->invalidate_close(
-					event_func->up_export,
-					&key,
-					FSAL_UP_INVALIDATE_CACHE);
+	PTHREAD_MUTEX_lock(&gl_fs->up_lock);
+	glist_add_tail(&gl_fs->up_pending, &k->list);
+	submit = !gl_fs->up_queued;
+	gl_fs->up_queued = true;
+	PTHREAD_MUTEX_unlock(&gl_fs->up_lock);
 
-	rc = fsal_status.major;
-	if (FSAL_IS_ERROR(fsal_status) && fsal_status.major != ERR_FSAL_NOENT) {
-		LogWarn(COMPONENT_FSAL_UP,
-			"Inode_Invalidate event could not be processed for fd %p, rc %d",
-			gl_fs->fs, rc);
+	rc = 0;
+	if (submit) {
+		rc = fridgethr_submit(general_fridge, upcall_drain, gl_fs);
+		if (rc != 0) {
+			LogWarn(COMPONENT_FSAL_UP,
+				"Could not queue invalidates for %p, rc %d",
+				fs, rc);
+			/* Drop the batch, the entries will time out */
+			PTHREAD_MUTEX_lock(&gl_fs->up_lock);
+			while ((k = glist_first_entry(&gl_fs->up_pending,
+						      struct gl_up_key,
+						      list)) != NULL) {
+				glist_del(&k->list);
+				gsh_free(k);
+			}
+			gl_fs->up_queued = false;
+			pthread_cond_broadcast(&gl_fs->up_cond);
+			PTHREAD_MUTEX_unlock(&gl_fs->up_lock);
+		}
 	}
 
 out:
 	return rc;
 }
 
+/**
+ * @brief Wait until every queued invalidate has been delivered
+ */
+void upcall_drain_wait(struct glusterfs_fs *gl_fs)
+{
+	PTHREAD_MUTEX_lock(&gl_fs->up_lock);
+	while (gl_fs->up_queued)
+		pthread_cond_wait(&gl_fs->up_cond, &gl_fs->up_lock);
+	PTHREAD_MUTEX_unlock(&gl_fs->up_lock);
+}
+
+static void upcall_process(struct glusterfs_fs *gl_fs,
+			   struct glfs_upcall *cbk)
+{
+	struct glfs_upcall_inode    *in_arg             = NULL;
+	struct glfs_object          *object             = NULL;
+	struct glfs_object          *p_object           = NULL;
+	struct glfs_object          *oldp_object        = NULL;
+	enum glfs_upcall_reason     reason;
+
+	reason = glfs_upcall_get_reason(cbk);
+	/* Decide what type of event this is
+	 * inode update / invalidate? */
+	switch (reason) {
+	case GLFS_UPCALL_EVENT_NULL:
+		break;
+	case GLFS_UPCALL_INODE_INVALIDATE:
+		in_arg = glfs_upcall_get_event(cbk);
+
+		if (!in_arg) {
+			/* Could be ENOMEM issues. continue */
+			LogWarn(COMPONENT_FSAL_UP,
+				"Received NULL upcall event arg");
+			break;
+		}
+
+		object = glfs_upcall_inode_get_object(in_arg);
+		if (object)
+			upcall_inode_invalidate(gl_fs, object);
+		p_object = glfs_upcall_inode_get_pobject(in_arg);
+		if (p_object)
+			upcall_inode_invalidate(gl_fs, p_object);
+		oldp_object = glfs_upcall_inode_get_oldpobject(in_arg);
+		if (oldp_object)
+			upcall_inode_invalidate(gl_fs, oldp_object);
+		break;
+	default:
+		LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", reason);
+	}
+}
+
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+/**
+ * @brief Upcall callback, called by gfapi for every event
+ */
+static void gluster_up_cbk(struct glfs_upcall *cbk, void *data)
+{
+	struct glusterfs_fs *gl_fs = data;
+
+	if (!atomic_fetch_int8_t(&gl_fs->destroy_mode))
+		upcall_process(gl_fs, cbk);
+
+	glfs_free(cbk);
+}
+
+int gluster_up_register(struct glusterfs_fs *gl_fs)
+{
+	int rc;
+
+	rc = glfs_upcall_register(gl_fs->fs, GLFS_EVENT_INODE_INVALIDATE,
+				  gluster_up_cbk, gl_fs);
+	if (rc < 0 || !(rc & GLFS_EVENT_INODE_INVALIDATE)) {
+		LogEvent(COMPONENT_FSAL_UP,
+			 "Upcall registration failed for %p, errno %d, falling back to polling",
+			 gl_fs->fs, errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+void gluster_up_unregister(struct glusterfs_fs *gl_fs)
+{
+	(void) glfs_upcall_unregister(gl_fs->fs,
+				      GLFS_EVENT_INODE_INVALIDATE);
+}
+#endif
+
 void *GLUSTERFSAL_UP_Thread(void *Arg)
 {
 	struct glusterfs_fs         *gl_fs              = Arg;
@@ -106,13 +268,10 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 	char                        thr_name[16];
 	int                         rc                  = 0;
 	struct glfs_upcall          *cbk                = NULL;
-	struct glfs_upcall_inode    *in_arg             = NULL;
 	enum glfs_upcall_reason     reason              = 0;
 	int                         retry               = 0;
 	int                         errsv               = 0;
-	struct glfs_object          *object             = NULL;
-	struct glfs_object          *p_object           = NULL;
-	struct glfs_object          *oldp_object        = NULL;
+	useconds_t                  idle                = UP_IDLE_MIN;
 
 
 	snprintf(thr_name, sizeof(thr_name),
@@ -140,8 +299,9 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 		goto out;
 	}
 
-	/* Start querying for events and processing. */
-	/** @todo : Do batch processing instead */
+	/* Start querying for events and processing.  Invalidates are
+	 * batched by upcall_inode_invalidate; back off while idle.
+	 */
 	while (!atomic_fetch_int8_t(&gl_fs->destroy_mode)) {
 		LogFullDebug(COMPONENT_FSAL_UP,
 			     "Requesting event from FSAL Callback interface for %p.",
@@ -189,46 +349,22 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 			     "Received upcall event: reason(%d)",
 			     reason);
 
-		if (!cbk) {
-			usleep(10);
-			continue;
-		}
-
-		reason = glfs_upcall_get_reason(cbk);
-		/* Decide what type of event this is
-		 * inode update / invalidate? */
-		switch (reason) {
-		case GLFS_UPCALL_EVENT_NULL:
-			usleep(10);
-			continue;
-		case GLFS_UPCALL_INODE_INVALIDATE:
-			in_arg = glfs_upcall_get_event(cbk);
-
-			if (!in_arg) {
-				/* Could be ENOMEM issues. continue */
-				LogWarn(COMPONENT_FSAL_UP,
-					"Received NULL upcall event arg");
-				break;
+		if (!cbk || glfs_upcall_get_reason(cbk) ==
+		    GLFS_UPCALL_EVENT_NULL) {
+			if (cbk) {
+				glfs_free(cbk);
+				cbk = NULL;
 			}
-
-			object = glfs_upcall_inode_get_object(in_arg);
-			if (object)
-				upcall_inode_invalidate(gl_fs, object);
-			p_object = glfs_upcall_inode_get_pobject(in_arg);
-			if (p_object)
-				upcall_inode_invalidate(gl_fs, p_object);
-			oldp_object = glfs_upcall_inode_get_oldpobject(in_arg);
-			if (oldp_object)
-				upcall_inode_invalidate(gl_fs, oldp_object);
-			break;
-		default:
-			LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", reason);
+			usleep(idle);
+			if (idle < UP_IDLE_MAX)
+				idle *= 2;
 			continue;
 		}
-		if (cbk) {
-			glfs_free(cbk);
-			cbk = NULL;
-		}
+
+		idle = UP_IDLE_MIN;
+		upcall_process(gl_fs, cbk);
+		glfs_free(cbk);
+		cbk = NULL;
 	}
 
 out:
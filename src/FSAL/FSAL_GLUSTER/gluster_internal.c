@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <attr/xattr.h> /* ENOATTR */
 #include "gluster_internal.h"
+#include "abstract_atomic.h"
 #include "fsal_api.h"
 #include "fsal_convert.h"
 #include "nfs4_acls.h"
@@ -156,6 +157,13 @@ void construct_handle(struct glusterfs_export *glexport, const struct stat *st,
 	       GFAPI_HANDLE_LENGTH);
 	constructing->globalfd.glfd = NULL;
 
+	/* The gfid is random, its last byte picks the I/O instance */
+	constructing->io_fs = glexport->gl_fs->fs;
+	if (S_ISREG(st->st_mode) && glexport->gl_fs->fs_count > 1)
+		constructing->io_fs = glexport->gl_fs->fs_pool[
+			globjhdl[GFAPI_HANDLE_LENGTH - 1] %
+			glexport->gl_fs->fs_count];
+
 	fsal_obj_handle_init(&constructing->handle, &glexport->export,
 			     posix2fsal_type(st->st_mode));
 	constructing->handle.fsid = posix2fsal_fsid(st->st_dev);
@@ -165,6 +173,81 @@ void construct_handle(struct glusterfs_export *glexport, const struct stat *st,
 	*obj = constructing;
 }
 
+/**
+ * @brief Get the instance a file's fds are opened in
+ *
+ * With several instances for the volume, a file's fds are opened in the
+ * one picked for it by construct_handle(), and its object there is
+ * looked up when first needed.
+ *
+ * @param[in]  glfs_export The export
+ * @param[in]  objhandle   The file
+ * @param[out] glhandle    Its object in the returned instance
+ *
+ * @return The instance, or NULL with errno set.
+ */
+glfs_t *glusterfs_io_fs(struct glusterfs_export *glfs_export,
+			struct glusterfs_handle *objhandle,
+			struct glfs_object **glhandle)
+{
+	struct glfs_object *obj;
+	struct stat sb;
+
+	if (objhandle->io_fs == glfs_export->gl_fs->fs) {
+		*glhandle = objhandle->glhandle;
+		return objhandle->io_fs;
+	}
+
+	obj = atomic_fetch_voidptr((void **)&objhandle->io_glhandle);
+	if (obj == NULL) {
+		obj = glfs_h_create_from_handle(objhandle->io_fs,
+					objhandle->globjhdl + GLAPI_UUID_LENGTH,
+					GFAPI_HANDLE_LENGTH, &sb);
+		if (obj == NULL)
+			return NULL;
+
+		/* Lost a race with another open, use its object */
+		if (!atomic_cas_voidptr((void **)&objhandle->io_glhandle,
+					NULL, obj)) {
+			glfs_h_close(obj);
+			obj = atomic_fetch_voidptr(
+					(void **)&objhandle->io_glhandle);
+		}
+	}
+
+	*glhandle = obj;
+	return objhandle->io_fs;
+}
+
+/**
+ * @brief Get the instance a file's size and times are handled in
+ *
+ * Once a file was opened in an I/O instance, its writes may still be
+ * held there by write-behind, so its attributes are read and set in
+ * that instance to stay in order with them.
+ *
+ * @param[in]  glfs_export The export
+ * @param[in]  objhandle   The object
+ * @param[out] glhandle    Its object in the returned instance
+ *
+ * @return The instance.
+ */
+glfs_t *glusterfs_attr_fs(struct glusterfs_export *glfs_export,
+			  struct glusterfs_handle *objhandle,
+			  struct glfs_object **glhandle)
+{
+	struct glfs_object *obj =
+		atomic_fetch_voidptr((void **)&objhandle->io_glhandle);
+
+	if (obj == NULL) {
+		*glhandle = objhandle->glhandle;
+		return glfs_export->gl_fs->fs;
+	}
+
+	*glhandle = obj;
+	return objhandle->io_fs;
+}
+
 void gluster_cleanup_vars(struct glfs_object *glhandle)
 {
 	if (glhandle) {
@@ -129,14 +129,24 @@ struct glusterfs_fsal_module {
 };
 struct glusterfs_fsal_module GlusterFS;
 
+/* Most glfs_t instances a volume can be served through */
+#define GLUSTER_MAX_FS 16
+
 struct glusterfs_fs {
 	struct glist_head fs_obj; /* link to glusterfs_fs filesystem objects */
 	char      *volname;
 	glfs_t    *fs;
+	glfs_t    *fs_pool[GLUSTER_MAX_FS]; /* fs, then the I/O instances */
+	uint32_t   fs_count; /* instances in fs_pool */
 	const struct fsal_up_vector *up_ops;    /*< Upcall operations */
 	int64_t    refcnt;
 	pthread_t  up_thread; /* upcall thread */
+	bool       up_registered; /* upcalls delivered by callback */
 	int8_t destroy_mode;
+	pthread_mutex_t up_lock; /* protects the fields below */
+	pthread_cond_t up_cond; /* signalled when up_queued is cleared */
+	struct glist_head up_pending; /* invalidates not delivered yet */
+	bool       up_queued; /* a drain job is queued or running */
 };
 
 struct glusterfs_export {
@@ -174,6 +184,12 @@ struct glusterfs_handle {
 	uint64_t rw_issued;
 	uint64_t rw_serial;
 	uint64_t rw_max_len;
+
+	/* Instance the file's fds are opened in, and its object there
+	 * once first opened, if not fs.
+	 */
+	glfs_t *io_fs;
+	struct glfs_object *io_glhandle;
 };
 
 /* Structures defined for PNFS */
@@ -236,6 +252,14 @@ void construct_handle(struct glusterfs_export *glexport, const struct stat *st,
 		      int len, struct glusterfs_handle **obj,
 		      const char *vol_uuid);
 
+glfs_t *glusterfs_io_fs(struct glusterfs_export *glfs_export,
+			struct glusterfs_handle *objhandle,
+			struct glfs_object **glhandle);
+
+glfs_t *glusterfs_attr_fs(struct glusterfs_export *glfs_export,
+			  struct glusterfs_handle *objhandle,
+			  struct glfs_object **glhandle);
+
 fsal_status_t glusterfs_create_export(struct fsal_module *fsal_hdl,
 				      void *parse_node,
 				      struct config_error_type *err_type,
@@ -291,5 +315,10 @@ void *GLUSTERFSAL_UP_Thread(void *Arg);
 int initiate_up_thread(struct glusterfs_fs *gl_fs);
 int upcall_inode_invalidate(struct glusterfs_fs *gl_fs,
 			    struct glfs_object *object);
+void upcall_drain_wait(struct glusterfs_fs *gl_fs);
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+int gluster_up_register(struct glusterfs_fs *gl_fs);
+void gluster_up_unregister(struct glusterfs_fs *gl_fs);
+#endif
 
 #endif				/* GLUSTER_INTERNAL */
@@ -77,6 +77,16 @@ static void handle_release(struct fsal_obj_handle *obj_hdl)
 		objhandle->glhandle = NULL;
 	}
 
+	if (objhandle->io_glhandle) {
+		rc = glfs_h_close(objhandle->io_glhandle);
+		if (rc) {
+			LogCrit(COMPONENT_FSAL,
+				"glfs_h_close returned error %s(%d)",
+				strerror(errno), errno);
+		}
+		objhandle->io_glhandle = NULL;
+	}
+
 	gsh_free(objhandle);
 
 #ifdef GLTIMING
@@ -734,6 +744,8 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 			      struct attrlist *attrs)
 {
 	int rc = 0;
+	glfs_t *fs;
+	struct glfs_object *glhandle;
 	fsal_status_t status = { ERR_FSAL_NO_ERROR, 0 };
 	glusterfs_fsal_xstat_t buffxstat;
 	struct glusterfs_export *glfs_export =
@@ -762,8 +774,8 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 
 	/** @todo: With support_ex() above may no longer be valid.
 	 * This needs to be revisited */
-	rc = glfs_h_stat(glfs_export->gl_fs->fs,
-			 objhandle->glhandle, &buffxstat.buffstat);
+	fs = glusterfs_attr_fs(glfs_export, objhandle, &glhandle);
+	rc = glfs_h_stat(fs, glhandle, &buffxstat.buffstat);
 	if (rc != 0) {
 		if (errno == ENOENT)
 			status = gluster2fsal_error(ESTALE);
@@ -1010,6 +1022,8 @@ fsal_status_t glusterfs_open_my_fd(struct glusterfs_handle *objhandle,
 {
 	fsal_status_t status = { ERR_FSAL_NO_ERROR, 0 };
 	struct glfs_fd *glfd = NULL;
+	glfs_t *fs;
+	struct glfs_object *glhandle;
 	struct glusterfs_export *glfs_export =
 	    container_of(op_ctx->fsal_export, struct glusterfs_export, export);
 #ifdef GLTIMING
@@ -1029,8 +1043,13 @@ fsal_status_t glusterfs_open_my_fd(struct glusterfs_handle *objhandle,
 		     "openflags = %x, posix_flags = %x",
 		     openflags, posix_flags);
 
-	glfd = glfs_h_open(glfs_export->gl_fs->fs, objhandle->glhandle,
-			   posix_flags);
+	fs = glusterfs_io_fs(glfs_export, objhandle, &glhandle);
+	if (fs == NULL) {
+		status = gluster2fsal_error(errno);
+		goto out;
+	}
+
+	glfd = glfs_h_open(fs, glhandle, posix_flags);
 	if (glfd == NULL) {
 		status = gluster2fsal_error(errno);
 		goto out;
@@ -1770,17 +1789,18 @@ static fsal_status_t glusterfs_reopen2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
-/* read2
+/* readv2
  */
 
-static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
-				     bool bypass,
-				     struct state_t *state,
-				     uint64_t seek_descriptor,
-				     size_t buffer_size,
-				     void *buffer, size_t *read_amount,
-				     bool *end_of_file,
-				     struct io_info *info)
+static fsal_status_t glusterfs_readv2(struct fsal_obj_handle *obj_hdl,
+				      bool bypass,
+				      struct state_t *state,
+				      uint64_t seek_descriptor,
+				      const struct iovec *iov,
+				      int iovcnt,
+				      size_t *read_amount,
+				      bool *end_of_file,
+				      struct io_info *info)
 {
 	struct glusterfs_fd my_fd = {0};
 	ssize_t nb_read;
@@ -1788,6 +1808,8 @@ static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 	int retval = 0;
 	bool has_lock = false;
 	bool closefd = false;
+	size_t buffer_size = 0;
+	int i;
 
 	if (info != NULL) {
 		/* Currently we don't support READ_PLUS */
@@ -1811,8 +1833,10 @@ static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
-	nb_read = glfs_pread(my_fd.glfd, buffer, buffer_size,
-			     seek_descriptor, 0);
+	for (i = 0; i < iovcnt; i++)
+		buffer_size += iov[i].iov_len;
+
+	nb_read = glfs_preadv(my_fd.glfd, iov, iovcnt, seek_descriptor, 0);
 
 	if (seek_descriptor == -1 || nb_read == -1) {
 		retval = errno;
@@ -1852,18 +1876,40 @@ static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 
 }
 
-/* write2
+/* read2
+ * Single buffer version of glusterfs_readv2.
  */
 
-static fsal_status_t glusterfs_write2(struct fsal_obj_handle *obj_hdl,
-				      bool bypass,
-				      struct state_t *state,
-				      uint64_t seek_descriptor,
-				      size_t buffer_size,
-				      void *buffer,
-				      size_t *write_amount,
-				      bool *fsal_stable,
-				      struct io_info *info)
+static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
+				     bool bypass,
+				     struct state_t *state,
+				     uint64_t seek_descriptor,
+				     size_t buffer_size,
+				     void *buffer, size_t *read_amount,
+				     bool *end_of_file,
+				     struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return glusterfs_readv2(obj_hdl, bypass, state, seek_descriptor,
+				&iov, 1, read_amount, end_of_file, info);
+}
+
+/* writev2
+ */
+
+static fsal_status_t glusterfs_writev2(struct fsal_obj_handle *obj_hdl,
+				       bool bypass,
+				       struct state_t *state,
+				       uint64_t seek_descriptor,
+				       const struct iovec *iov,
+				       int iovcnt,
+				       size_t *write_amount,
+				       bool *fsal_stable,
+				       struct io_info *info)
 {
 	ssize_t nb_written;
 	fsal_status_t status;
@@ -1908,8 +1954,8 @@ static fsal_status_t glusterfs_write2(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
-	nb_written = glfs_pwrite(my_fd.glfd, buffer, buffer_size,
-			     seek_descriptor, ((*fsal_stable) ? O_SYNC : 0));
+	nb_written = glfs_pwritev(my_fd.glfd, iov, iovcnt, seek_descriptor,
+				  ((*fsal_stable) ? O_SYNC : 0));
 
 	if (nb_written == -1) {
 		retval = errno;
@@ -1938,6 +1984,334 @@ static fsal_status_t glusterfs_write2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/* write2
+ * Single buffer version of glusterfs_writev2.
+ */
+
+static fsal_status_t glusterfs_write2(struct fsal_obj_handle *obj_hdl,
+				      bool bypass,
+				      struct state_t *state,
+				      uint64_t seek_descriptor,
+				      size_t buffer_size,
+				      void *buffer,
+				      size_t *write_amount,
+				      bool *fsal_stable,
+				      struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return glusterfs_writev2(obj_hdl, bypass, state, seek_descriptor,
+				 &iov, 1, write_amount, fsal_stable, info);
+}
+
+#ifdef USE_GLUSTER_COPY_FILE_RANGE
+/**
+ * @brief Copy a range of one file into another
+ *
+ * glfs_copy_file_range lets the bricks copy the data, so nothing goes
+ * through Ganesha.
+ *
+ * @param[in]  src_hdl    File to copy from
+ * @param[in]  src_state  state_t to read with, or NULL
+ * @param[in]  src_offset Position from which to copy
+ * @param[in]  dst_hdl    File to copy to
+ * @param[in]  dst_state  state_t to write with, or NULL
+ * @param[in]  dst_offset Position at which to copy
+ * @param[in]  count      Amount of data to copy
+ * @param[out] copied     Amount of data copied
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t glusterfs_copy(struct fsal_obj_handle *src_hdl,
+				    struct state_t *src_state,
+				    uint64_t src_offset,
+				    struct fsal_obj_handle *dst_hdl,
+				    struct state_t *dst_state,
+				    uint64_t dst_offset,
+				    uint64_t count,
+				    uint64_t *copied)
+{
+	ssize_t nb_copied;
+	fsal_status_t status;
+	int retval = 0;
+	struct glusterfs_fd src_fd = {0}, dst_fd = {0};
+	bool src_lock = false, src_close = false;
+	bool dst_lock = false, dst_close = false;
+	off64_t src_off = src_offset, dst_off = dst_offset;
+	struct glusterfs_export *glfs_export =
+	     container_of(op_ctx->fsal_export, struct glusterfs_export, export);
+
+	*copied = 0;
+
+	/* Get usable file descriptors */
+	status = find_fd(&src_fd, src_hdl, false, src_state, FSAL_O_READ,
+			 &src_lock, &src_close, false);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	status = find_fd(&dst_fd, dst_hdl, false, dst_state, FSAL_O_WRITE,
+			 &dst_lock, &dst_close, false);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	retval = setglustercreds(glfs_export, &op_ctx->creds->caller_uid,
+			&op_ctx->creds->caller_gid,
+			op_ctx->creds->caller_glen,
+			op_ctx->creds->caller_garray);
+	if (retval != 0) {
+		status = gluster2fsal_error(EPERM);
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+		goto out;
+	}
+
+	nb_copied = glfs_copy_file_range(src_fd.glfd, &src_off, dst_fd.glfd,
+					 &dst_off, count, 0, NULL, NULL, NULL);
+	if (nb_copied == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+	} else {
+		*copied = nb_copied;
+	}
+
+	/* restore credentials */
+	retval = setglustercreds(glfs_export, NULL, NULL, 0, NULL);
+	if (retval != 0) {
+		status = gluster2fsal_error(EPERM);
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+		goto out;
+	}
+
+ out:
+
+	if (dst_close)
+		glusterfs_close_my_fd(&dst_fd);
+
+	if (dst_lock)
+		PTHREAD_RWLOCK_unlock(&dst_hdl->obj_lock);
+
+	if (src_close)
+		glusterfs_close_my_fd(&src_fd);
+
+	if (src_lock)
+		PTHREAD_RWLOCK_unlock(&src_hdl->obj_lock);
+
+	/* Older volumes without the fop still copy, through Ganesha */
+	if (status.major == ERR_FSAL_NOTSUPP)
+		return fsal_copy_rw(src_hdl, src_state, src_offset, dst_hdl,
+				    dst_state, dst_offset, count, copied);
+
+	return status;
+}
+#endif
+
+/**
+ * @brief An asynchronous read or write in flight in gfapi
+ */
+struct glusterfs_async_io {
+	struct fsal_obj_handle *obj_hdl;
+	fsal_async_cb done_cb;
+	struct fsal_io_arg *io_arg;
+	void *caller_arg;
+	bool write;
+	glfs_fd_t *own_glfd;	/*< fd to close on completion, if any */
+};
+
+/**
+ * @brief Get a glfd that stays valid until the async call completes
+ *
+ * A state's own glfd lives as long as the caller's state reference.  A
+ * temporary fd is handed over to the I/O.  The global fd is only ours
+ * while obj_lock is held, which cannot be released from the gfapi
+ * callback thread, so it is dup'ed and the lock dropped here.
+ *
+ * @return The glfd, or NULL if the I/O must be done synchronously.
+ */
+static glfs_fd_t *glusterfs_async_fd(struct fsal_obj_handle *obj_hdl,
+				     struct glusterfs_fd *my_fd,
+				     bool has_lock, bool closefd,
+				     glfs_fd_t **own_glfd)
+{
+	glfs_fd_t *glfd = my_fd->glfd;
+
+	*own_glfd = NULL;
+
+	if (closefd) {
+		*own_glfd = glfd;
+	} else if (has_lock) {
+		glfd = glfs_dup(my_fd->glfd);
+		*own_glfd = glfd;
+	}
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return glfd;
+}
+
+static void glusterfs_async_io_free(struct glusterfs_async_io *aio)
+{
+	if (aio->own_glfd != NULL && glfs_close(aio->own_glfd) != 0)
+		LogCrit(COMPONENT_FSAL,
+			"Error : close returns with %s", strerror(errno));
+
+	gsh_free(aio);
+}
+
+static void glusterfs_async_io_done(glfs_fd_t *glfd, ssize_t ret, void *data)
+{
+	struct glusterfs_async_io *aio = data;
+	struct fsal_io_arg *io_arg = aio->io_arg;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	size_t total = 0;
+	int i;
+
+	if (ret < 0) {
+		int err = errno ? errno : EIO;
+
+		status = fsalstat(posix2fsal_error(err), err);
+	} else if (io_arg != NULL) {
+		io_arg->io_amount = ret;
+		if (!aio->write) {
+			for (i = 0; i < io_arg->iov_count; i++)
+				total += io_arg->iov[i].iov_len;
+			io_arg->end_of_file = (ret < total);
+		}
+	}
+
+	aio->done_cb(aio->obj_hdl, status, io_arg, aio->caller_arg);
+	glusterfs_async_io_free(aio);
+}
+
+/**
+ * @brief Try to start a read or write with the gfapi async calls
+ *
+ * @return true if submitted; done_cb will be called on completion.
+ */
+static bool glusterfs_async_submit(struct fsal_obj_handle *obj_hdl,
+				   bool bypass, bool write,
+				   fsal_async_cb done_cb,
+				   struct fsal_io_arg *io_arg,
+				   void *caller_arg)
+{
+	struct glusterfs_fd my_fd = {0};
+	struct glusterfs_async_io *aio;
+	struct glusterfs_export *glfs_export =
+	     container_of(op_ctx->fsal_export, struct glusterfs_export, export);
+	fsal_status_t status;
+	bool has_lock = false;
+	bool closefd = false;
+	glfs_fd_t *glfd, *own_glfd;
+	int retval;
+
+	if (io_arg->info != NULL)
+		return false;
+
+	status = find_fd(&my_fd, obj_hdl, bypass, io_arg->state,
+			 write ? FSAL_O_WRITE : FSAL_O_READ,
+			 &has_lock, &closefd, false);
+
+	/* Let the synchronous path report any error */
+	if (FSAL_IS_ERROR(status))
+		return false;
+
+	glfd = glusterfs_async_fd(obj_hdl, &my_fd, has_lock, closefd,
+				  &own_glfd);
+	if (glfd == NULL)
+		return false;
+
+	aio = gsh_malloc(sizeof(*aio));
+	aio->obj_hdl = obj_hdl;
+	aio->done_cb = done_cb;
+	aio->io_arg = io_arg;
+	aio->caller_arg = caller_arg;
+	aio->write = write;
+	aio->own_glfd = own_glfd;
+
+	if (write) {
+		retval = setglustercreds(glfs_export,
+					 &op_ctx->creds->caller_uid,
+					 &op_ctx->creds->caller_gid,
+					 op_ctx->creds->caller_glen,
+					 op_ctx->creds->caller_garray);
+		if (retval != 0)
+			LogFatal(COMPONENT_FSAL,
+				 "Could not set Ganesha credentials");
+
+		retval = glfs_pwritev_async(glfd, io_arg->iov,
+					    io_arg->iov_count, io_arg->offset,
+					    io_arg->fsal_stable ? O_SYNC : 0,
+					    glusterfs_async_io_done, aio);
+		if (setglustercreds(glfs_export, NULL, NULL, 0, NULL) != 0)
+			LogFatal(COMPONENT_FSAL,
+				 "Could not set Ganesha credentials");
+	} else {
+		retval = glfs_preadv_async(glfd, io_arg->iov,
+					   io_arg->iov_count, io_arg->offset,
+					   0, glusterfs_async_io_done, aio);
+	}
+
+	if (retval != 0) {
+		glusterfs_async_io_free(aio);
+		return false;
+	}
+
+	return true;
+}
+
+/* read2_async
+ */
+
+static void glusterfs_read2_async(struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  fsal_async_cb done_cb,
+				  struct fsal_io_arg *read_arg,
+				  void *caller_arg)
+{
+	fsal_status_t status;
+
+	if (glusterfs_async_submit(obj_hdl, bypass, false, done_cb, read_arg,
+				   caller_arg))
+		return;
+
+	status = obj_hdl->obj_ops.readv2(obj_hdl, bypass, read_arg->state,
+					 read_arg->offset, read_arg->iov,
+					 read_arg->iov_count,
+					 &read_arg->io_amount,
+					 &read_arg->end_of_file,
+					 read_arg->info);
+
+	done_cb(obj_hdl, status, read_arg, caller_arg);
+}
+
+/* write2_async
+ */
+
+static void glusterfs_write2_async(struct fsal_obj_handle *obj_hdl,
+				   bool bypass,
+				   fsal_async_cb done_cb,
+				   struct fsal_io_arg *write_arg,
+				   void *caller_arg)
+{
+	fsal_status_t status;
+
+	if (glusterfs_async_submit(obj_hdl, bypass, true, done_cb, write_arg,
+				   caller_arg))
+		return;
+
+	status = obj_hdl->obj_ops.writev2(obj_hdl, bypass, write_arg->state,
+					  write_arg->offset, write_arg->iov,
+					  write_arg->iov_count,
+					  &write_arg->io_amount,
+					  &write_arg->fsal_stable,
+					  write_arg->info);
+
+	done_cb(obj_hdl, status, write_arg, caller_arg);
+}
+
 /* commit2
  */
 
@@ -2008,6 +2382,77 @@ out:
 	return status;
 }
 
+/* commit2_async
+ */
+
+static void glusterfs_commit2_async(struct fsal_obj_handle *obj_hdl,
+				    off_t offset,
+				    size_t len,
+				    fsal_async_cb done_cb,
+				    void *caller_arg)
+{
+	fsal_status_t status;
+	int retval;
+	struct glusterfs_fd tmp_fd = {0, NULL}, *out_fd = &tmp_fd;
+	struct glusterfs_handle *myself = NULL;
+	struct glusterfs_async_io *aio;
+	glfs_fd_t *glfd, *own_glfd;
+	bool has_lock = false;
+	bool closefd = false;
+	struct glusterfs_export *glfs_export =
+	    container_of(op_ctx->fsal_export,
+			 struct glusterfs_export, export);
+
+	myself = container_of(obj_hdl, struct glusterfs_handle, handle);
+
+	/* Make sure file is open in appropriate mode.
+	 * Do not check share reservation.
+	 */
+	status = fsal_reopen_obj(obj_hdl, false, false, FSAL_O_WRITE,
+				 (struct fsal_fd *)&myself->globalfd,
+				 &myself->share, glusterfs_open_func,
+				 glusterfs_close_func,
+				 (struct fsal_fd **)&out_fd,
+				 &has_lock, &closefd);
+	if (FSAL_IS_ERROR(status))
+		goto sync;
+
+	glfd = glusterfs_async_fd(obj_hdl, out_fd, has_lock, closefd,
+				  &own_glfd);
+	if (glfd == NULL)
+		goto sync;
+
+	aio = gsh_malloc(sizeof(*aio));
+	aio->obj_hdl = obj_hdl;
+	aio->done_cb = done_cb;
+	aio->io_arg = NULL;
+	aio->caller_arg = caller_arg;
+	aio->write = true;
+	aio->own_glfd = own_glfd;
+
+	retval = setglustercreds(glfs_export, &op_ctx->creds->caller_uid,
+				 &op_ctx->creds->caller_gid,
+				 op_ctx->creds->caller_glen,
+				 op_ctx->creds->caller_garray);
+	if (retval != 0)
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+
+	retval = glfs_fsync_async(glfd, glusterfs_async_io_done, aio);
+
+	if (setglustercreds(glfs_export, NULL, NULL, 0, NULL) != 0)
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+
+	if (retval == 0)
+		return;
+
+	glusterfs_async_io_free(aio);
+
+ sync:
+	/* Let the synchronous path report any error */
+	status = glusterfs_commit2(obj_hdl, offset, len);
+	done_cb(obj_hdl, status, NULL, caller_arg);
+}
+
 /* lock_op2
  */
 
@@ -2200,7 +2645,8 @@ static fsal_status_t glusterfs_setattr2(struct fsal_obj_handle *obj_hdl,
 	glusterfs_fsal_xstat_t buffxstat;
 	int attr_valid = 0;
 	int mask = 0;
-
+	glfs_t *fs;
+	struct glfs_object *glhandle;
 
 	/** @todo: Handle special file symblic links etc */
 	/* apply umask, if mode attribute is to be changed */
@@ -2336,8 +2782,8 @@ static fsal_status_t glusterfs_setattr2(struct fsal_obj_handle *obj_hdl,
 		 * fix needed in there..it doesn't convert the mask flags
 		 * to corresponding gluster flags.
 		 */
-		retval = glfs_h_setattrs(glfs_export->gl_fs->fs,
-				     myself->glhandle,
+		fs = glusterfs_attr_fs(glfs_export, myself, &glhandle);
+		retval = glfs_h_setattrs(fs, glhandle,
 				     &buffxstat.buffstat,
 				     mask);
 		if (retval != 0) {
@@ -2623,6 +3069,14 @@ void handle_ops_init(struct fsal_obj_ops *ops)
 	ops->reopen2 = glusterfs_reopen2;
 	ops->read2 = glusterfs_read2;
 	ops->write2 = glusterfs_write2;
+	ops->readv2 = glusterfs_readv2;
+	ops->writev2 = glusterfs_writev2;
+	ops->read2_async = glusterfs_read2_async;
+	ops->write2_async = glusterfs_write2_async;
+	ops->commit2_async = glusterfs_commit2_async;
+#ifdef USE_GLUSTER_COPY_FILE_RANGE
+	ops->copy = glusterfs_copy;
+#endif
 	ops->commit2 = glusterfs_commit2;
 	ops->lock_op2 = glusterfs_lock_op2;
 	ops->setattr2 = glusterfs_setattr2;
@@ -78,6 +78,9 @@ static struct config_item glfs_params[] = {
 		       fsal_staticfsinfo_t, pnfs_mds),
 	CONF_ITEM_BOOL("pnfs_ds", true,
 		       fsal_staticfsinfo_t, pnfs_ds),
+	/* Only true if the volume has features.cache-invalidation on */
+	CONF_ITEM_BOOL("Upcall_Invalidation", false,
+		       fsal_staticfsinfo_t, upcall_invalidation),
 	CONFIG_EOL
 };
 
@@ -40,11 +40,14 @@
 
 #define get16bits(d) (*((const uint16_t *) (d)))
 #define MAX_DS_COUNT 100
+/* READ and WRITE size advertised for flex files data servers */
+#define FF_DS_IO_SIZE 0x100000
 
 /**
  * @brief Get layout types supported by export
  *
- * We just return a pointer to the single type and set the count to 1.
+ * Files layouts come first, for clients that take the first type they
+ * know.
  *
  * @param[in]  export_pub Public export handle
  * @param[out] count      Number of layout types in array
@@ -56,10 +59,13 @@
 static void fs_layouttypes(struct fsal_export *export_pub, int32_t *count,
 			   const layouttype4 **types)
 {
-	/* Only supported layout type is file */
-	static const layouttype4 supported_layout_type = LAYOUT4_NFSV4_1_FILES;
-	*types = &supported_layout_type;
-	*count = 1;
+	static const layouttype4 supported_layout_types[] = {
+		LAYOUT4_NFSV4_1_FILES,
+		LAYOUT4_FLEX_FILES
+	};
+
+	*types = supported_layout_types;
+	*count = sizeof(supported_layout_types) / sizeof(layouttype4);
 }
 
 /**
@@ -128,7 +134,8 @@ int glfs_get_ds_addr(struct glfs *fs, struct glfs_object *object,
 /**
  * @brief Grant a layout segment.
  *
- * Grants whole layout of the file requested.
+ * Grants whole layout of the file requested, as a files layout or as a
+ * flex files layout of one mirror on one data server.
  *
  * @param[in]     obj_pub  Public object handle
  * @param[in]     req_ctx  Request context
@@ -168,8 +175,10 @@ static nfsstat4 pnfs_layout_get(struct fsal_obj_handle          *obj_pub,
 	/* DS wire handle send to client */
 	struct glfs_ds_wire     ds_wire;
 
-	/* Supports only LAYOUT4_NFSV4_1_FILES layouts */
-	if (arg->type != LAYOUT4_NFSV4_1_FILES) {
+	struct fsal_ff_ds       ff_ds;
+
+	if (arg->type != LAYOUT4_NFSV4_1_FILES &&
+	    arg->type != LAYOUT4_FLEX_FILES) {
 		LogMajor(COMPONENT_PNFS, "Unsupported layout type: %x",
 			 arg->type);
 
@@ -226,13 +235,29 @@ static nfsstat4 pnfs_layout_get(struct fsal_obj_handle          *obj_pub,
 	ds_wire.layout   = file_layout;
 	ds_desc.addr     = &ds_wire;
 	ds_desc.len      = sizeof(struct glfs_ds_wire);
-	nfs_status = FSAL_encode_file_layout(loc_body, &deviceid, util, 0, 0,
-					     &req_ctx->ctx_export->export_id, 1,
-					     &ds_desc);
-	if (nfs_status) {
-		LogMajor(COMPONENT_PNFS,
-			  "Failed to encode nfsv4_1_file_layout.");
-		goto out;
+
+	if (arg->type == LAYOUT4_FLEX_FILES) {
+		ff_ds.deviceid = deviceid;
+		ff_ds.ds_id = req_ctx->ctx_export->export_id;
+		ff_ds.fh = ds_desc;
+		nfs_status = FSAL_encode_flex_file_layout(
+				loc_body, 0, 1, 1, &ff_ds,
+				req_ctx->creds->caller_uid,
+				req_ctx->creds->caller_gid);
+		if (nfs_status) {
+			LogMajor(COMPONENT_PNFS,
+				 "Failed to encode ff_layout4.");
+			goto out;
+		}
+	} else {
+		nfs_status = FSAL_encode_file_layout(
+				loc_body, &deviceid, util, 0, 0,
+				&req_ctx->ctx_export->export_id, 1, &ds_desc);
+		if (nfs_status) {
+			LogMajor(COMPONENT_PNFS,
+				 "Failed to encode nfsv4_1_file_layout.");
+			goto out;
+		}
 	}
 
 	/* We grant only one segment, and we want it back
@@ -265,7 +290,8 @@ static nfsstat4 pnfs_layout_return(struct fsal_obj_handle *obj_pub,
 				   const struct fsal_layoutreturn_arg *arg)
 {
 
-	if (arg->lo_type != LAYOUT4_NFSV4_1_FILES) {
+	if (arg->lo_type != LAYOUT4_NFSV4_1_FILES &&
+	    arg->lo_type != LAYOUT4_FLEX_FILES) {
 		LogDebug(COMPONENT_PNFS, "Unsupported layout type: %x",
 				  arg->lo_type);
 		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
@@ -309,7 +335,8 @@ static nfsstat4 pnfs_layout_commit(struct fsal_obj_handle *obj_pub,
 	int   mask                           = 0;
 	int   rc                             = 0;
 
-	if (arg->type != LAYOUT4_NFSV4_1_FILES) {
+	if (arg->type != LAYOUT4_NFSV4_1_FILES &&
+	    arg->type != LAYOUT4_FLEX_FILES) {
 		LogMajor(COMPONENT_PNFS, "Unsupported layout type: %x",
 					   arg->type);
 		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
@@ -392,6 +419,22 @@ nfsstat4 getdeviceinfo(struct fsal_module *fsal_hdl,
 	uint32_t stripe_ind              = 0;
 
 
+	memset(&host, 0, sizeof(fsal_multipath_member_t));
+	host.addr = ntohl(deviceid->device_id4);
+	host.port = 2049;
+	host.proto = 6;
+
+	if (type == LAYOUT4_FLEX_FILES) {
+		nfs_status = FSAL_encode_flex_file_device(da_addr_body, 1,
+							  &host,
+							  FF_DS_IO_SIZE,
+							  FF_DS_IO_SIZE);
+		if (nfs_status != NFS4_OK)
+			LogMajor(COMPONENT_PNFS,
+				 "Failed to encode data server address");
+		return nfs_status;
+	}
+
 	if (type != LAYOUT4_NFSV4_1_FILES) {
 		LogMajor(COMPONENT_PNFS, "Unsupported layout type: %x", type);
 		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
@@ -417,10 +460,6 @@ nfsstat4 getdeviceinfo(struct fsal_module *fsal_hdl,
 			 num_ds);
 		return NFS4ERR_SERVERFAULT;
 	}
-	memset(&host, 0, sizeof(fsal_multipath_member_t));
-	host.addr = ntohl(deviceid->device_id4);
-	host.port = 2049;
-	host.proto = 6;
 	nfs_status = FSAL_encode_v4_multipath(da_addr_body, 1, &host);
 
 	if (nfs_status != NFS4_OK) {
@@ -26,43 +26,476 @@
 #include "fsal_internal.h"
 #include "fsal_convert.h"
 #include "gpfs_methods.h"
+#include "city.h"
 #include <sys/types.h>
 #include <unistd.h>
 #include <utime.h>
 #include <sys/time.h>
 
+/* Events queued per processing thread before the receiver waits */
+#define GPFS_UP_QUEUE_MAX 4096
+
+/** An upcall copied off the receiving thread */
+struct gpfs_up_event {
+	struct glist_head list;
+	int reason;
+	int flags;
+	uint32_t expire_time_attr;
+	struct stat buf;
+	struct glock fl;
+	struct pnfs_deviceid devid;
+	struct gpfs_file_handle handle;
+};
+
+/** Event queue of one upcall processing thread */
+struct gpfs_up_queue {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;	/* events queued or stop */
+	pthread_cond_t space;	/* queue drained below the limit */
+	struct glist_head events;
+	uint32_t depth;
+	bool stop;
+	pthread_t thr;
+	struct gpfs_filesystem *gpfs_fs;
+};
+
+/**
+ * @brief Process one upcall
+ *
+ * @param[in] gpfs_fs File system the event came from
+ * @param[in] ev      The event
+ */
+static void gpfs_up_process(struct gpfs_filesystem *gpfs_fs,
+			    struct gpfs_up_event *ev)
+{
+	const struct fsal_up_vector *event_func = gpfs_fs->up_ops;
+	struct gsh_buffdesc key;
+	uint32_t upflags = 0;
+	fsal_status_t fsal_status = {0,};
+
+	key.addr = &ev->handle;
+	key.len = ev->handle.handle_key_size;
+
+	LogDebug(COMPONENT_FSAL_UP, "Received event to process for %d",
+		 gpfs_fs->root_fd);
+
+	switch (ev->reason) {
+	case INODE_LOCK_GRANTED:	/* Lock Event */
+	case INODE_LOCK_AGAIN:	/* Lock Event */
+		{
+			LogMidDebug(COMPONENT_FSAL_UP,
+				    "%s: owner %p pid %d type %d start %lld len %lld",
+				    ev->reason ==
+				    INODE_LOCK_GRANTED ?
+				    "inode lock granted" :
+				    "inode lock again", ev->fl.lock_owner,
+				    ev->fl.flock.l_pid, ev->fl.flock.l_type,
+				    (long long)ev->fl.flock.l_start,
+				    (long long)ev->fl.flock.l_len);
+
+			fsal_lock_param_t lockdesc = {
+				.lock_sle_type = FSAL_POSIX_LOCK,
+				.lock_type = ev->fl.flock.l_type,
+				.lock_start = ev->fl.flock.l_start,
+				.lock_length = ev->fl.flock.l_len
+			};
+			if (ev->reason == INODE_LOCK_AGAIN)
+				fsal_status = up_async_lock_avail(
+						 general_fridge,
+						 event_func->up_export,
+						 &key,
+						 ev->fl.lock_owner,
+						 &lockdesc, NULL, NULL);
+			else
+				fsal_status = up_async_lock_grant(
+						 general_fridge,
+						 event_func->up_export,
+						 &key,
+						 ev->fl.lock_owner,
+						 &lockdesc, NULL, NULL);
+		}
+		break;
+
+	case BREAK_DELEGATION:	/* Delegation Event */
+		LogDebug(COMPONENT_FSAL_UP,
+			 "delegation recall: flags:%x ino %" PRId64,
+			 ev->flags, ev->buf.st_ino);
+		fsal_status = up_async_delegrecall(general_fridge,
+					  event_func->up_export,
+					  &key, NULL, NULL);
+		break;
+
+	case LAYOUT_FILE_RECALL:	/* Layout file recall Event */
+		{
+			struct pnfs_segment segment = {
+				.offset = 0,
+				.length = UINT64_MAX,
+				.io_mode = LAYOUTIOMODE4_ANY
+			};
+			LogDebug(COMPONENT_FSAL_UP,
+				 "layout file recall: flags:%x ino %"
+				 PRId64, ev->flags, ev->buf.st_ino);
+
+			fsal_status = up_async_layoutrecall(
+						general_fridge,
+						event_func->up_export,
+						&key,
+						LAYOUT4_NFSV4_1_FILES,
+						false, &segment,
+						NULL, NULL, NULL,
+						NULL);
+		}
+		break;
+
+	case LAYOUT_RECALL_ANY:	/* Recall all layouts Event */
+		LogDebug(COMPONENT_FSAL_UP,
+			 "layout recall any: flags:%x ino %" PRId64,
+			 ev->flags, ev->buf.st_ino);
+
+    /**
+     * @todo This functionality needs to be implemented as a
+     * bulk FSID CB_LAYOUTRECALL.  RECALL_ANY isn't suitable
+     * since it can't be restricted to just one FSAL.  Also
+     * an FSID LAYOUTRECALL lets you have multiplke
+     * filesystems exported from one FSAL and not yank layouts
+     * on all of them when you only need to recall them for one.
+     */
+		break;
+
+	case LAYOUT_NOTIFY_DEVICEID:	/* Device update Event */
+		LogDebug(COMPONENT_FSAL_UP,
+			 "layout dev update: flags:%x ino %"
+			 PRId64 " seq %d fd %d fsid 0x%" PRIx64,
+			 ev->flags,
+			ev->buf.st_ino,
+			ev->devid.device_id2,
+			ev->devid.device_id4,
+			ev->devid.devid);
+
+		memset(&ev->devid, 0, sizeof(ev->devid));
+		ev->devid.fsal_id = FSAL_ID_GPFS;
+
+		fsal_status = up_async_notify_device(general_fridge,
+					event_func->up_export,
+					NOTIFY_DEVICEID4_DELETE_MASK,
+					LAYOUT4_NFSV4_1_FILES,
+					&ev->devid,
+					true, NULL,
+					NULL);
+		break;
+
+	case INODE_UPDATE:	/* Update Event */
+		{
+			struct attrlist attr;
+
+			LogMidDebug(COMPONENT_FSAL_UP,
+				    "inode update: flags:%x update ino %"
+				    PRId64 " n_link:%d",
+				    ev->flags, ev->buf.st_ino,
+				    (int)ev->buf.st_nlink);
+
+			/** @todo: This notification is completely
+			 * asynchronous.  If we happen to change some
+			 * of the attributes later, we end up over
+			 * writing those with these possibly stale
+			 * values as we don't know when we get to
+			 * update with these up call values. We should
+			 * probably use time stamp or let the up call
+			 * always provide UP_TIMES flag in which case
+			 * we can compare the current ctime vs up call
+			 * provided ctime before updating the
+			 * attributes.
+			 *
+			 * For now, we think size attribute is more
+			 * important than others, so invalidate the
+			 * attributes and let ganesha fetch attributes
+			 * as needed if this update includes a size
+			 * change. We are careless for other attribute
+			 * changes, and we may end up with stale values
+			 * until this gets fixed!
+			 */
+			if (ev->flags & (UP_SIZE | UP_SIZE_BIG)) {
+				fsal_status = event_func->invalidate(
+					event_func->up_export, &key,
+					FSAL_UP_INVALIDATE_CACHE);
+				break;
+			}
+
+			/* Check for accepted flags, any other changes
+			   just invalidate. */
+			if (ev->flags &
+			    ~(UP_SIZE | UP_NLINK | UP_MODE | UP_OWN |
+			     UP_TIMES | UP_ATIME | UP_SIZE_BIG)) {
+				fsal_status = event_func->invalidate(
+					event_func->up_export, &key,
+					FSAL_UP_INVALIDATE_CACHE);
+			} else {
+				/* buf may not have all attributes set.
+				 * Since posix2fsal_attributes() copies
+				 * all attributes and also sets
+				 * attr.mask, correct attr.mask with
+				 * valid upcall flags only before
+				 * passing the attr to update() which
+				 * actually updates the cache_inode
+				 * object attributes.
+				 */
+				posix2fsal_attributes(&ev->buf, &attr);
+				/* Set the mask to what is changed */
+				attr.valid_mask = 0;
+				if (ev->flags & UP_SIZE)
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_SIZE | ATTR_SPACEUSED;
+				if (ev->flags & UP_SIZE_BIG) {
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_SIZE | ATTR_SPACEUSED;
+					upflags |=
+					   fsal_up_update_filesize_inc |
+					   fsal_up_update_spaceused_inc;
+				}
+				if (ev->flags & UP_MODE)
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_MODE;
+				if (ev->flags & UP_OWN)
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_OWNER;
+				if (ev->flags & UP_TIMES)
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_ATIME | ATTR_CTIME |
+					    ATTR_MTIME;
+				if (ev->flags & UP_ATIME)
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_ATIME;
+
+				attr.expire_time_attr =
+				    ev->expire_time_attr;
+
+				fsal_status = event_func->
+				    update(event_func->up_export,
+					   &key, &attr, upflags);
+
+				if ((ev->flags & UP_NLINK)
+				    && (attr.numlinks == 0)) {
+					upflags = fsal_up_nlink |
+						  fsal_up_close;
+					attr.valid_mask = 0;
+					fsal_status = up_async_update
+					    (general_fridge,
+					     event_func->up_export,
+					     &key, &attr,
+					     upflags, NULL, NULL);
+				}
+			}
+		}
+		break;
+
+	case INODE_INVALIDATE:
+		LogMidDebug(COMPONENT_FSAL_UP,
+			    "inode invalidate: flags:%x update ino %"
+			    PRId64, ev->flags, ev->buf.st_ino);
+
+		upflags = FSAL_UP_INVALIDATE_CACHE;
+		fsal_status = event_func->invalidate_close(
+					event_func->up_export,
+					&key,
+					upflags);
+		break;
+
+	default:
+		LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", ev->reason);
+		return;
+	}
+
+
+	if (FSAL_IS_ERROR(fsal_status) &&
+	    fsal_status.major != ERR_FSAL_NOENT) {
+		LogWarn(COMPONENT_FSAL_UP,
+			"Event %d could not be processed for fd %d rc %s",
+			ev->reason, gpfs_fs->root_fd,
+			fsal_err_txt(fsal_status));
+	}
+}
+
+/**
+ * @brief Upcall processing thread
+ *
+ * Takes everything queued at once and processes it as a batch, so the
+ * queue lock is taken once per batch rather than once per event.
+ *
+ * @param[in] arg The queue to serve
+ */
+static void *gpfs_up_worker(void *arg)
+{
+	struct gpfs_up_queue *q = arg;
+	struct gpfs_up_event *ev;
+	struct glist_head batch;
+	char thr_name[16];
+
+	snprintf(thr_name, sizeof(thr_name), "fsal_upw_%d",
+		 (int)(q - q->gpfs_fs->up_queues));
+	SetNameFunction(thr_name);
+
+	glist_init(&batch);
+
+	PTHREAD_MUTEX_lock(&q->mutex);
+	for (;;) {
+		while (glist_empty(&q->events) && !q->stop)
+			pthread_cond_wait(&q->cond, &q->mutex);
+
+		if (glist_empty(&q->events))
+			break;
+
+		glist_splice_tail(&batch, &q->events);
+		q->depth = 0;
+		pthread_cond_broadcast(&q->space);
+		PTHREAD_MUTEX_unlock(&q->mutex);
+
+		while ((ev = glist_first_entry(&batch, struct gpfs_up_event,
+					       list)) != NULL) {
+			glist_del(&ev->list);
+			gpfs_up_process(q->gpfs_fs, ev);
+			gsh_free(ev);
+		}
+
+		PTHREAD_MUTEX_lock(&q->mutex);
+	}
+	PTHREAD_MUTEX_unlock(&q->mutex);
+
+	return NULL;
+}
+
+/**
+ * @brief Start the upcall processing threads of a file system
+ *
+ * If none can be started, events are processed on the receiving thread.
+ */
+static void gpfs_up_start_workers(struct gpfs_filesystem *gpfs_fs)
+{
+	uint32_t i;
+
+	if (gpfs_fs->up_nqueues == 0)
+		return;
+
+	gpfs_fs->up_queues = gsh_calloc(gpfs_fs->up_nqueues,
+					sizeof(*gpfs_fs->up_queues));
+
+	for (i = 0; i < gpfs_fs->up_nqueues; i++) {
+		struct gpfs_up_queue *q = &gpfs_fs->up_queues[i];
+
+		PTHREAD_MUTEX_init(&q->mutex, NULL);
+		PTHREAD_COND_init(&q->cond, NULL);
+		PTHREAD_COND_init(&q->space, NULL);
+		glist_init(&q->events);
+		q->gpfs_fs = gpfs_fs;
+
+		if (pthread_create(&q->thr, NULL, gpfs_up_worker, q) != 0) {
+			LogCrit(COMPONENT_FSAL_UP,
+				"Could not start upcall thread %u for %d, using %u",
+				i, gpfs_fs->root_fd, i);
+			PTHREAD_MUTEX_destroy(&q->mutex);
+			PTHREAD_COND_destroy(&q->cond);
+			PTHREAD_COND_destroy(&q->space);
+			break;
+		}
+	}
+
+	gpfs_fs->up_nqueues = i;
+	if (i == 0) {
+		gsh_free(gpfs_fs->up_queues);
+		gpfs_fs->up_queues = NULL;
+	}
+}
+
+/**
+ * @brief Stop the upcall processing threads once their queues are empty
+ */
+static void gpfs_up_stop_workers(struct gpfs_filesystem *gpfs_fs)
+{
+	uint32_t i;
+
+	for (i = 0; i < gpfs_fs->up_nqueues; i++) {
+		struct gpfs_up_queue *q = &gpfs_fs->up_queues[i];
+
+		PTHREAD_MUTEX_lock(&q->mutex);
+		q->stop = true;
+		pthread_cond_signal(&q->cond);
+		PTHREAD_MUTEX_unlock(&q->mutex);
+	}
+
+	for (i = 0; i < gpfs_fs->up_nqueues; i++) {
+		struct gpfs_up_queue *q = &gpfs_fs->up_queues[i];
+
+		pthread_join(q->thr, NULL);
+		PTHREAD_MUTEX_destroy(&q->mutex);
+		PTHREAD_COND_destroy(&q->cond);
+		PTHREAD_COND_destroy(&q->space);
+	}
+
+	gsh_free(gpfs_fs->up_queues);
+	gpfs_fs->up_queues = NULL;
+	gpfs_fs->up_nqueues = 0;
+}
+
+/**
+ * @brief Hand an event to a processing thread
+ *
+ * Events are spread by file handle, so the events of one object are
+ * processed in the order GPFS sent them.
+ */
+static void gpfs_up_dispatch(struct gpfs_filesystem *gpfs_fs,
+			     struct gpfs_up_event *event)
+{
+	struct gpfs_up_queue *q;
+	struct gpfs_up_event *ev;
+	uint64_t hash;
+
+	if (gpfs_fs->up_nqueues == 0) {
+		gpfs_up_process(gpfs_fs, event);
+		return;
+	}
+
+	hash = CityHash64((char *)event->handle.f_handle,
+			  event->handle.handle_key_size);
+	q = &gpfs_fs->up_queues[hash % gpfs_fs->up_nqueues];
+
+	ev = gsh_malloc(sizeof(*ev));
+	*ev = *event;
+
+	PTHREAD_MUTEX_lock(&q->mutex);
+	while (q->depth >= GPFS_UP_QUEUE_MAX)
+		pthread_cond_wait(&q->space, &q->mutex);
+	glist_add_tail(&q->events, &ev->list);
+	if (q->depth++ == 0)
+		pthread_cond_signal(&q->cond);
+	PTHREAD_MUTEX_unlock(&q->mutex);
+}
+
 /**
  * @brief Up Thread
  *
+ * Receives upcalls from GPFS and hands them to the processing threads.
+ *
  * @param Arg reference to void
  *
  */
 void *GPFSFSAL_UP_Thread(void *Arg)
 {
 	struct gpfs_filesystem *gpfs_fs = Arg;
-	const struct fsal_up_vector *event_func;
 	char thr_name[16];
 	int rc = 0;
-	struct pnfs_deviceid devid;
-	struct stat buf;
-	struct glock fl;
+	struct gpfs_up_event ev;
 	struct callback_arg callback;
-	struct gpfs_file_handle handle;
-	int reason = 0;
-	int flags = 0;
 	unsigned int *fhP;
 	int retry = 0;
-	struct gsh_buffdesc key;
-	uint32_t expire_time_attr = 0;
-	uint32_t upflags = 0;
 	int errsv = 0;
-	fsal_status_t fsal_status = {0,};
 
 #ifdef _VALGRIND_MEMCHECK
-		memset(&handle, 0, sizeof(handle));
-		memset(&buf, 0, sizeof(buf));
-		memset(&fl, 0, sizeof(fl));
-		memset(&devid, 0, sizeof(devid));
+		memset(&ev, 0, sizeof(ev));
 #endif
 
 	snprintf(thr_name, sizeof(thr_name),
@@ -70,10 +503,7 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 		 gpfs_fs->fs->dev.major, gpfs_fs->fs->dev.minor);
 	SetNameFunction(thr_name);
 
-	/* Set the FSAL UP functions that will be used to process events. */
-	event_func = gpfs_fs->up_ops;
-
-	if (event_func == NULL) {
+	if (gpfs_fs->up_ops == NULL) {
 		LogFatal(COMPONENT_FSAL_UP,
 			 "FSAL up vector does not exist. Can not continue.");
 		gsh_free(Arg);
@@ -84,27 +514,30 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 		     "Initializing FSAL Callback context for %d.",
 		     gpfs_fs->root_fd);
 
+	gpfs_up_start_workers(gpfs_fs);
+
 	/* Start querying for events and processing. */
 	while (1) {
 		LogFullDebug(COMPONENT_FSAL_UP,
 			     "Requesting event from FSAL Callback interface for %d.",
 			     gpfs_fs->root_fd);
 
-		handle.handle_size = GPFS_MAX_FH_SIZE;
-		handle.handle_key_size = OPENHANDLE_KEY_LEN;
-		handle.handle_version = OPENHANDLE_VERSION;
+		ev.handle.handle_size = GPFS_MAX_FH_SIZE;
+		ev.handle.handle_key_size = OPENHANDLE_KEY_LEN;
+		ev.handle.handle_version = OPENHANDLE_VERSION;
+		ev.expire_time_attr = 0;
 
 		callback.interface_version =
 		    GPFS_INTERFACE_VERSION + GPFS_INTERFACE_SUB_VER;
 
 		callback.mountdirfd = gpfs_fs->root_fd;
-		callback.handle = &handle;
-		callback.reason = &reason;
-		callback.flags = &flags;
-		callback.buf = &buf;
-		callback.fl = &fl;
-		callback.dev_id = &devid;
-		callback.expire_attr = &expire_time_attr;
+		callback.handle = &ev.handle;
+		callback.reason = &ev.reason;
+		callback.flags = &ev.flags;
+		callback.buf = &ev.buf;
+		callback.fl = &ev.fl;
+		callback.dev_id = &ev.devid;
+		callback.expire_attr = &ev.expire_time_attr;
 
 		rc = gpfs_ganesha(OPENHANDLE_INODE_UPDATE, &callback);
 		errsv = errno;
@@ -115,6 +548,7 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 				LogFatal(COMPONENT_FSAL_UP,
 					 "Ganesha version %d mismatch GPFS version %d.",
 					 callback.interface_version, rc);
+				gpfs_up_stop_workers(gpfs_fs);
 				return NULL;
 			}
 
@@ -124,7 +558,7 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 			LogCrit(COMPONENT_FSAL_UP,
 				"OPENHANDLE_INODE_UPDATE failed for %d. rc %d, errno %d (%s) reason %d",
 				gpfs_fs->root_fd, rc, errsv,
-				strerror(errsv), reason);
+				strerror(errsv), ev.reason);
 
 			/* @todo 1000 retry logic will go away once the
 			 * OPENHANDLE_INODE_UPDATE ioctl separates EINTR
@@ -145,12 +579,12 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 		 * 2 bytes! Workaround this until the kernel module
 		 * gets fixed.
 		 */
-		flags = flags & 0xffff;
+		ev.flags = ev.flags & 0xffff;
 
 		LogDebug(COMPONENT_FSAL_UP,
 			 "inode update: rc %d reason %d update ino %"
 			 PRId64 " flags:%x",
-			 rc, reason, callback.buf->st_ino, flags);
+			 rc, ev.reason, callback.buf->st_ino, ev.flags);
 
 		LogFullDebug(COMPONENT_FSAL_UP,
 			     "inode update: flags:%x callback.handle:%p handle size = %u handle_type:%d handle_version:%d key_size = %u handle_fsid=%X.%X f_handle:%p expire: %d",
@@ -161,7 +595,7 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 			     callback.handle->handle_key_size,
 			     callback.handle->handle_fsid[0],
 			     callback.handle->handle_fsid[1],
-			     callback.handle->f_handle, expire_time_attr);
+			     callback.handle->f_handle, ev.expire_time_attr);
 
 		callback.handle->handle_version = OPENHANDLE_VERSION;
 
@@ -171,247 +605,14 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 			     fhP[0], fhP[1], fhP[2], fhP[3], fhP[4], fhP[5],
 			     fhP[6]);
 
-		/* Here is where we decide what type of event this is
-		 * ... open,close,read,...,invalidate? */
-		key.addr = &handle;
-		key.len = handle.handle_key_size;
-
-		LogDebug(COMPONENT_FSAL_UP, "Received event to process for %d",
-			 gpfs_fs->root_fd);
-
-		switch (reason) {
-		case INODE_LOCK_GRANTED:	/* Lock Event */
-		case INODE_LOCK_AGAIN:	/* Lock Event */
-			{
-				LogMidDebug(COMPONENT_FSAL_UP,
-					    "%s: owner %p pid %d type %d start %lld len %lld",
-					    reason ==
-					    INODE_LOCK_GRANTED ?
-					    "inode lock granted" :
-					    "inode lock again", fl.lock_owner,
-					    fl.flock.l_pid, fl.flock.l_type,
-					    (long long)fl.flock.l_start,
-					    (long long)fl.flock.l_len);
-
-				fsal_lock_param_t lockdesc = {
-					.lock_sle_type = FSAL_POSIX_LOCK,
-					.lock_type = fl.flock.l_type,
-					.lock_start = fl.flock.l_start,
-					.lock_length = fl.flock.l_len
-				};
-				if (reason == INODE_LOCK_AGAIN)
-					fsal_status = up_async_lock_avail(
-							 general_fridge,
-							 event_func->up_export,
-							 &key,
-							 fl.lock_owner,
-							 &lockdesc, NULL, NULL);
-				else
-					fsal_status = up_async_lock_grant(
-							 general_fridge,
-							 event_func->up_export,
-							 &key,
-							 fl.lock_owner,
-							 &lockdesc, NULL, NULL);
-			}
-			break;
-
-		case BREAK_DELEGATION:	/* Delegation Event */
-			LogDebug(COMPONENT_FSAL_UP,
-				 "delegation recall: flags:%x ino %" PRId64,
-				 flags, callback.buf->st_ino);
-			fsal_status = up_async_delegrecall(general_fridge,
-						  event_func->up_export,
-						  &key, NULL, NULL);
-			break;
-
-		case LAYOUT_FILE_RECALL:	/* Layout file recall Event */
-			{
-				struct pnfs_segment segment = {
-					.offset = 0,
-					.length = UINT64_MAX,
-					.io_mode = LAYOUTIOMODE4_ANY
-				};
-				LogDebug(COMPONENT_FSAL_UP,
-					 "layout file recall: flags:%x ino %"
-					 PRId64, flags, callback.buf->st_ino);
-
-				fsal_status = up_async_layoutrecall(
-							general_fridge,
-							event_func->up_export,
-							&key,
-							LAYOUT4_NFSV4_1_FILES,
-							false, &segment,
-							NULL, NULL, NULL,
-							NULL);
-			}
-			break;
-
-		case LAYOUT_RECALL_ANY:	/* Recall all layouts Event */
-			LogDebug(COMPONENT_FSAL_UP,
-				 "layout recall any: flags:%x ino %" PRId64,
-				 flags, callback.buf->st_ino);
-
-	    /**
-	     * @todo This functionality needs to be implemented as a
-	     * bulk FSID CB_LAYOUTRECALL.  RECALL_ANY isn't suitable
-	     * since it can't be restricted to just one FSAL.  Also
-	     * an FSID LAYOUTRECALL lets you have multiplke
-	     * filesystems exported from one FSAL and not yank layouts
-	     * on all of them when you only need to recall them for one.
-	     */
-			break;
-
-		case LAYOUT_NOTIFY_DEVICEID:	/* Device update Event */
-			LogDebug(COMPONENT_FSAL_UP,
-				 "layout dev update: flags:%x ino %"
-				 PRId64 " seq %d fd %d fsid 0x%" PRIx64,
-				 flags,
-				callback.buf->st_ino,
-				devid.device_id2,
-				devid.device_id4,
-				devid.devid);
-
-			memset(&devid, 0, sizeof(devid));
-			devid.fsal_id = FSAL_ID_GPFS;
-
-			fsal_status = up_async_notify_device(general_fridge,
-						event_func->up_export,
-						NOTIFY_DEVICEID4_DELETE_MASK,
-						LAYOUT4_NFSV4_1_FILES,
-						&devid,
-						true, NULL,
-						NULL);
-			break;
-
-		case INODE_UPDATE:	/* Update Event */
-			{
-				struct attrlist attr;
-
-				LogMidDebug(COMPONENT_FSAL_UP,
-					    "inode update: flags:%x update ino %"
-					    PRId64 " n_link:%d",
-					    flags, callback.buf->st_ino,
-					    (int)callback.buf->st_nlink);
-
-				/** @todo: This notification is completely
-				 * asynchronous.  If we happen to change some
-				 * of the attributes later, we end up over
-				 * writing those with these possibly stale
-				 * values as we don't know when we get to
-				 * update with these up call values. We should
-				 * probably use time stamp or let the up call
-				 * always provide UP_TIMES flag in which case
-				 * we can compare the current ctime vs up call
-				 * provided ctime before updating the
-				 * attributes.
-				 *
-				 * For now, we think size attribute is more
-				 * important than others, so invalidate the
-				 * attributes and let ganesha fetch attributes
-				 * as needed if this update includes a size
-				 * change. We are careless for other attribute
-				 * changes, and we may end up with stale values
-				 * until this gets fixed!
-				 */
-				if (flags & (UP_SIZE | UP_SIZE_BIG)) {
-					fsal_status = event_func->invalidate(
-						event_func->up_export, &key,
-						FSAL_UP_INVALIDATE_CACHE);
-					break;
-				}
-
-				/* Check for accepted flags, any other changes
-				   just invalidate. */
-				if (flags &
-				    ~(UP_SIZE | UP_NLINK | UP_MODE | UP_OWN |
-				     UP_TIMES | UP_ATIME | UP_SIZE_BIG)) {
-					fsal_status = event_func->invalidate(
-						event_func->up_export, &key,
-						FSAL_UP_INVALIDATE_CACHE);
-				} else {
-					/* buf may not have all attributes set.
-					 * Since posix2fsal_attributes() copies
-					 * all attributes and also sets
-					 * attr.mask, correct attr.mask with
-					 * valid upcall flags only before
-					 * passing the attr to update() which
-					 * actually updates the cache_inode
-					 * object attributes.
-					 */
-					posix2fsal_attributes(&buf, &attr);
-					/* Set the mask to what is changed */
-					attr.valid_mask = 0;
-					if (flags & UP_SIZE)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_SIZE | ATTR_SPACEUSED;
-					if (flags & UP_SIZE_BIG) {
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_SIZE | ATTR_SPACEUSED;
-						upflags |=
-						   fsal_up_update_filesize_inc |
-						   fsal_up_update_spaceused_inc;
-					}
-					if (flags & UP_MODE)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_MODE;
-					if (flags & UP_OWN)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_OWNER;
-					if (flags & UP_TIMES)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_ATIME | ATTR_CTIME |
-						    ATTR_MTIME;
-					if (flags & UP_ATIME)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_ATIME;
-
-					attr.expire_time_attr =
-					    expire_time_attr;
-
-					fsal_status = event_func->
-					    update(event_func->up_export,
-						   &key, &attr, upflags);
-
-					if ((flags & UP_NLINK)
-					    && (attr.numlinks == 0)) {
-						upflags = fsal_up_nlink |
-							  fsal_up_close;
-						attr.valid_mask = 0;
-						fsal_status = up_async_update
-						    (general_fridge,
-						     event_func->up_export,
-						     &key, &attr,
-						     upflags, NULL, NULL);
-					}
-				}
-			}
-			break;
-
+		switch (ev.reason) {
 		case THREAD_STOP:  /* We wanted to terminate this thread */
 			LogDebug(COMPONENT_FSAL_UP,
 				"Terminating the GPFS up call thread for %d",
 				gpfs_fs->root_fd);
+			gpfs_up_stop_workers(gpfs_fs);
 			return NULL;
 
-		case INODE_INVALIDATE:
-			LogMidDebug(COMPONENT_FSAL_UP,
-				    "inode invalidate: flags:%x update ino %"
-				    PRId64, flags, callback.buf->st_ino);
-
-			upflags = FSAL_UP_INVALIDATE_CACHE;
-			fsal_status = event_func->invalidate_close(
-						event_func->up_export,
-						&key,
-						upflags);
-			break;
-
 		case THREAD_PAUSE:
 			/* File system image is probably going away, but
 			 * we don't need to do anything here as we
@@ -421,16 +622,7 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 			continue; /* get next event */
 
 		default:
-			LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", reason);
-			continue;
-		}
-
-		if (FSAL_IS_ERROR(fsal_status) &&
-		    fsal_status.major != ERR_FSAL_NOENT) {
-			LogWarn(COMPONENT_FSAL_UP,
-				"Event %d could not be processed for fd %d rc %s",
-				reason, gpfs_fs->root_fd,
-				fsal_err_txt(fsal_status));
+			gpfs_up_dispatch(gpfs_fs, &ev);
 		}
 	}
 
@@ -11,6 +11,7 @@
  */
 
 struct fsal_staticfsinfo_t *gpfs_staticinfo(struct fsal_module *hdl);
+uint32_t gpfs_up_threads(struct fsal_module *hdl);
 
 /* method proto linkage to handle.c for export
  */
@@ -38,6 +39,8 @@ struct gpfs_fsal_export {
 	bool use_acl;
 };
 
+struct gpfs_up_queue;
+
 /*
  * GPFS internal filesystem
  */
@@ -48,6 +51,8 @@ struct gpfs_filesystem {
 	bool up_thread_started;
 	const struct fsal_up_vector *up_ops;
 	pthread_t up_thread; /* upcall thread */
+	uint32_t up_nqueues; /* upcall processing threads, 0 for inline */
+	struct gpfs_up_queue *up_queues; /* their event queues */
 };
 
 /*
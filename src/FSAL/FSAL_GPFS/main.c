@@ -42,7 +42,8 @@ static const char myname[] = "GPFS";
 struct gpfs_fsal_module {
 	struct fsal_module fsal;
 	struct fsal_staticfsinfo_t fs_info;
-	/** gpfsfs_specific_initinfo_t specific_info;  placeholder */
+	/** Threads processing upcalls, per file system */
+	uint32_t up_threads;
 };
 
 /** @struct default_gpfs_info
@@ -83,6 +84,7 @@ static struct fsal_staticfsinfo_t default_gpfs_info = {
 	.reopen_method = true,
 	.fsal_grace = false,
 	.link_supports_permission_checks = true,
+	.upcall_invalidation = true,
 };
 
 /** @struct gpfs_params
@@ -90,30 +92,34 @@ static struct fsal_staticfsinfo_t default_gpfs_info = {
  */
 static struct config_item gpfs_params[] = {
 	CONF_ITEM_BOOL("link_support", true,
-		       fsal_staticfsinfo_t, link_support),
+		       gpfs_fsal_module, fs_info.link_support),
 	CONF_ITEM_BOOL("symlink_support", true,
-		       fsal_staticfsinfo_t, symlink_support),
+		       gpfs_fsal_module, fs_info.symlink_support),
 	CONF_ITEM_BOOL("cansettime", true,
-		       fsal_staticfsinfo_t, cansettime),
+		       gpfs_fsal_module, fs_info.cansettime),
 	CONF_ITEM_MODE("umask", 0,
-		       fsal_staticfsinfo_t, umask),
+		       gpfs_fsal_module, fs_info.umask),
 	CONF_ITEM_BOOL("auth_xdev_export", false,
-		       fsal_staticfsinfo_t, auth_exportpath_xdev),
+		       gpfs_fsal_module, fs_info.auth_exportpath_xdev),
 	CONF_ITEM_MODE("xattr_access_rights", 0400,
-		       fsal_staticfsinfo_t, xattr_access_rights),
+		       gpfs_fsal_module, fs_info.xattr_access_rights),
 	/** At the moment GPFS doesn't support WRITE delegations */
 	CONF_ITEM_ENUM_BITS("Delegations",
 			    FSAL_OPTION_FILE_READ_DELEG,
 			    FSAL_OPTION_FILE_DELEGATIONS,
-			    deleg_types, fsal_staticfsinfo_t, delegations),
+			    deleg_types, gpfs_fsal_module, fs_info.delegations),
 	CONF_ITEM_BOOL("PNFS_MDS", true,
-		       fsal_staticfsinfo_t, pnfs_mds),
+		       gpfs_fsal_module, fs_info.pnfs_mds),
 	CONF_ITEM_BOOL("PNFS_DS", true,
-		       fsal_staticfsinfo_t, pnfs_ds),
+		       gpfs_fsal_module, fs_info.pnfs_ds),
 	CONF_ITEM_BOOL("fsal_trace", true,
-		       fsal_staticfsinfo_t, fsal_trace),
+		       gpfs_fsal_module, fs_info.fsal_trace),
 	CONF_ITEM_BOOL("fsal_grace", false,
-		       fsal_staticfsinfo_t, fsal_grace),
+		       gpfs_fsal_module, fs_info.fsal_grace),
+	CONF_ITEM_BOOL("Upcall_Invalidation", true,
+		       gpfs_fsal_module, fs_info.upcall_invalidation),
+	CONF_ITEM_UI32("Upcall_Threads", 0, 64, 4,
+		       gpfs_fsal_module, up_threads),
 	CONFIG_EOL
 };
 
@@ -147,6 +153,18 @@ struct fsal_staticfsinfo_t *gpfs_staticinfo(struct fsal_module *hdl)
 	return &gpfs_me->fs_info;
 }
 
+/** @fn uint32_t gpfs_up_threads(struct fsal_module *hdl)
+ *  @brief number of upcall processing threads per file system
+ *  @param hdl handle to fsal_module
+ */
+uint32_t gpfs_up_threads(struct fsal_module *hdl)
+{
+	struct gpfs_fsal_module *gpfs_me =
+		container_of(hdl, struct gpfs_fsal_module, fsal);
+
+	return gpfs_me->up_threads;
+}
+
 /** @fn static int
  *      log_to_gpfs(log_header_t headers, void *private, log_levels_t level,
  *	struct display_buffer *buffer, char *compstr, char *message)
@@ -183,7 +201,7 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 	gpfs_me->fs_info = default_gpfs_info;  /** get a copy of the defaults */
 
 	(void) load_config_from_parse(config_struct, &gpfs_param,
-				      &gpfs_me->fs_info, true, err_type);
+				      gpfs_me, true, err_type);
 
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
@@ -0,0 +1,314 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* export.c
+ * MEM FSAL export object
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <pthread.h>
+#include <string.h>
+#include <sys/types.h>
+#include "fsal_convert.h"
+#include "FSAL/fsal_commonlib.h"
+#include "FSAL/fsal_config.h"
+#include "mem_methods.h"
+#include "nfs_exports.h"
+#include "export_mgr.h"
+#include "mdcache.h"
+
+/* helpers to/from other MEM objects
+ */
+
+struct fsal_staticfsinfo_t *mem_staticinfo(struct fsal_module *hdl);
+
+static int mem_k_cmpf(const struct avltree_node *lhs,
+		      const struct avltree_node *rhs)
+{
+	struct mem_fsal_obj_handle *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct mem_fsal_obj_handle, mh_node_k);
+	rk = avltree_container_of(rhs, struct mem_fsal_obj_handle, mh_node_k);
+
+	if (lk->obj_handle.fileid < rk->obj_handle.fileid)
+		return -1;
+
+	return lk->obj_handle.fileid > rk->obj_handle.fileid;
+}
+
+/* export object methods
+ */
+
+static void release(struct fsal_export *exp_hdl)
+{
+	struct mem_fsal_export *myself;
+
+	myself = container_of(exp_hdl, struct mem_fsal_export, export);
+
+	LogDebug(COMPONENT_FSAL, "Releasing exp %p - %s",
+		 myself, myself->export_path);
+
+	mem_release_objects(myself);
+
+	fsal_detach_export(exp_hdl->fsal, &exp_hdl->exports);
+	free_export_ops(exp_hdl);
+
+	PTHREAD_RWLOCK_destroy(&myself->mfe_lock);
+
+	if (myself->export_path != NULL)
+		gsh_free(myself->export_path);
+
+	gsh_free(myself);
+}
+
+static fsal_status_t get_dynamic_info(struct fsal_export *exp_hdl,
+				      struct fsal_obj_handle *obj_hdl,
+				      fsal_dynamicfsinfo_t *infop)
+{
+	struct mem_fsal_export *myself;
+	uint64_t files;
+
+	myself = container_of(exp_hdl, struct mem_fsal_export, export);
+
+	PTHREAD_RWLOCK_rdlock(&myself->mfe_lock);
+	files = avltree_size(&myself->mfe_objs);
+	PTHREAD_RWLOCK_unlock(&myself->mfe_lock);
+
+	/* There is no limit but memory, report a large free space */
+	infop->total_bytes = INT64_MAX;
+	infop->free_bytes = INT64_MAX;
+	infop->avail_bytes = INT64_MAX;
+	infop->total_files = UINT32_MAX;
+	infop->free_files = UINT32_MAX - files;
+	infop->avail_files = UINT32_MAX - files;
+	infop->time_delta.tv_sec = 0;
+	infop->time_delta.tv_nsec = 1;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static bool fs_supports(struct fsal_export *exp_hdl,
+			fsal_fsinfo_options_t option)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_supports(info, option);
+}
+
+static uint64_t fs_maxfilesize(struct fsal_export *exp_hdl)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_maxfilesize(info);
+}
+
+static uint32_t fs_maxread(struct fsal_export *exp_hdl)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_maxread(info);
+}
+
+static uint32_t fs_maxwrite(struct fsal_export *exp_hdl)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_maxwrite(info);
+}
+
+static uint32_t fs_maxlink(struct fsal_export *exp_hdl)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_maxlink(info);
+}
+
+static uint32_t fs_maxnamelen(struct fsal_export *exp_hdl)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_maxnamelen(info);
+}
+
+static uint32_t fs_maxpathlen(struct fsal_export *exp_hdl)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_maxpathlen(info);
+}
+
+static struct timespec fs_lease_time(struct fsal_export *exp_hdl)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_lease_time(info);
+}
+
+static fsal_aclsupp_t fs_acl_support(struct fsal_export *exp_hdl)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_acl_support(info);
+}
+
+static attrmask_t fs_supported_attrs(struct fsal_export *exp_hdl)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_supported_attrs(info);
+}
+
+static uint32_t fs_umask(struct fsal_export *exp_hdl)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_umask(info);
+}
+
+static uint32_t fs_xattr_access_rights(struct fsal_export *exp_hdl)
+{
+	struct fsal_staticfsinfo_t *info;
+
+	info = mem_staticinfo(exp_hdl->fsal);
+	return fsal_xattr_access_rights(info);
+}
+
+/* extract a file handle from a buffer.
+ * The handle is only ever compared as bytes against handles of this
+ * instance of the export, so there is nothing to convert.
+ */
+
+static fsal_status_t extract_handle(struct fsal_export *exp_hdl,
+				    fsal_digesttype_t in_type,
+				    struct gsh_buffdesc *fh_desc,
+				    int flags)
+{
+	if (fh_desc->len != MEM_HANDLE_SIZE) {
+		LogMajor(COMPONENT_FSAL,
+			 "Size mismatch for handle.  should be %zu, got %zu",
+			 MEM_HANDLE_SIZE, fh_desc->len);
+		return fsalstat(ERR_FSAL_SERVERFAULT, 0);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* mem_export_ops_init
+ * overwrite vector entries with the methods that we support
+ */
+
+static void mem_export_ops_init(struct export_ops *ops)
+{
+	ops->release = release;
+	ops->lookup_path = mem_lookup_path;
+	ops->extract_handle = extract_handle;
+	ops->create_handle = mem_create_handle;
+	ops->get_fs_dynamic_info = get_dynamic_info;
+	ops->fs_supports = fs_supports;
+	ops->fs_maxfilesize = fs_maxfilesize;
+	ops->fs_maxread = fs_maxread;
+	ops->fs_maxwrite = fs_maxwrite;
+	ops->fs_maxlink = fs_maxlink;
+	ops->fs_maxnamelen = fs_maxnamelen;
+	ops->fs_maxpathlen = fs_maxpathlen;
+	ops->fs_lease_time = fs_lease_time;
+	ops->fs_acl_support = fs_acl_support;
+	ops->fs_supported_attrs = fs_supported_attrs;
+	ops->fs_umask = fs_umask;
+	ops->fs_xattr_access_rights = fs_xattr_access_rights;
+	ops->alloc_state = mem_alloc_state;
+	ops->free_state = mem_free_state;
+}
+
+/* create_export
+ * Create an export point and return a handle to it to be kept
+ * in the export list.
+ * First lookup the fsal, then create the export and then put the fsal back.
+ * returns the export with one reference taken.
+ */
+
+fsal_status_t mem_create_export(struct fsal_module *fsal_hdl,
+				void *parse_node,
+				struct config_error_type *err_type,
+				const struct fsal_up_vector *up_ops)
+{
+	struct mem_fsal_export *myself;
+	struct timespec ts;
+	int retval = 0;
+	fsal_status_t status = {0, 0};
+
+	myself = gsh_calloc(1, sizeof(struct mem_fsal_export));
+
+	fsal_export_init(&myself->export);
+	mem_export_ops_init(&myself->export.exp_ops);
+
+	PTHREAD_RWLOCK_init(&myself->mfe_lock, NULL);
+	avltree_init(&myself->mfe_objs, mem_k_cmpf, 0 /* flags */);
+	myself->next_fileid = 1;
+
+	now(&ts);
+	myself->handle_tag = timespec_to_nsecs(&ts) ^ (uintptr_t) myself;
+
+	retval = fsal_attach_export(fsal_hdl, &myself->export.exports);
+
+	if (retval != 0) {
+		/* seriously bad */
+		LogMajor(COMPONENT_FSAL,
+			 "Could not attach export");
+		free_export_ops(&myself->export);
+		PTHREAD_RWLOCK_destroy(&myself->mfe_lock);
+		gsh_free(myself);	/* elvis has left the building */
+
+		return fsalstat(posix2fsal_error(retval), retval);
+	}
+
+	myself->export.fsal = fsal_hdl;
+
+	/* Save the export path. */
+	myself->export_path = gsh_strdup(op_ctx->ctx_export->fullpath);
+	op_ctx->fsal_export = &myself->export;
+
+	/* Stack MDCACHE on top */
+	status = mdcache_export_init(up_ops, &myself->export.up_ops);
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL, "MDCACHE creation failed for MEM");
+		return status;
+	}
+
+	LogDebug(COMPONENT_FSAL,
+		 "Created exp %p - %s",
+		 myself, myself->export_path);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
@@ -0,0 +1,614 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* file.c
+ * File I/O methods for MEM module
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "FSAL/fsal_commonlib.h"
+#include "mem_methods.h"
+#include "sal_data.h"
+
+/* Resize the contents of a file, with its mh_lock held for write.
+ * Bytes past the size are always zero, so a file that grows reads zeros
+ * and one that shrinks must clear what it cut.
+ */
+static fsal_errors_t mem_resize(struct mem_fsal_obj_handle *myself,
+				uint64_t size)
+{
+	uint64_t oldsize = myself->attributes.filesize;
+	char *data;
+
+	if (size > myself->mh.file.alloc) {
+		if (size > SIZE_MAX)
+			return ERR_FSAL_FBIG;
+
+		data = realloc(myself->mh.file.data, size);
+		if (data == NULL)
+			return ERR_FSAL_NOSPC;
+
+		memset(data + myself->mh.file.alloc, 0,
+		       size - myself->mh.file.alloc);
+		myself->mh.file.data = data;
+		myself->mh.file.alloc = size;
+	} else if (size < oldsize) {
+		memset(myself->mh.file.data + size, 0, oldsize - size);
+	}
+
+	myself->attributes.filesize = size;
+	myself->attributes.spaceused = size;
+
+	return ERR_FSAL_NO_ERROR;
+}
+
+static void mem_truncate(struct mem_fsal_obj_handle *myself)
+{
+	PTHREAD_RWLOCK_wrlock(&myself->mh_lock);
+	(void) mem_resize(myself, 0);
+	mem_touch(&myself->attributes, true);
+	PTHREAD_RWLOCK_unlock(&myself->mh_lock);
+}
+
+/**
+ * @brief Check the share of a stateless access
+ *
+ * I/O with a state was checked when the state was opened, I/O without
+ * one must not conflict with the shares of others.
+ */
+static fsal_status_t mem_check_share(struct fsal_obj_handle *obj_hdl,
+				     struct state_t *state,
+				     fsal_openflags_t openflags,
+				     bool bypass)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_status_t status = {0, 0};
+
+	if (state != NULL)
+		return status;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	PTHREAD_RWLOCK_rdlock(&obj_hdl->obj_lock);
+	status = check_share_conflict(&myself->mh.file.share, openflags,
+				      bypass);
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+static struct gsh_slab mem_state_slab =
+	GSH_SLAB_ARENA_INITIALIZER("MEM state_t", sizeof(struct mem_state_fd),
+				   MEM_ARENA_SAL);
+
+struct state_t *mem_alloc_state(struct fsal_export *exp_hdl,
+				enum state_type state_type,
+				struct state_t *related_state)
+{
+	return init_state(gsh_slab_alloc(&mem_state_slab),
+			  exp_hdl, state_type, related_state);
+}
+
+void mem_free_state(struct fsal_export *exp_hdl, struct state_t *state)
+{
+	struct mem_state_fd *state_fd = container_of(state,
+						     struct mem_state_fd,
+						     state);
+
+	gsh_slab_free(&mem_state_slab, state_fd);
+}
+
+/**
+ * @brief Open a file, with its obj_lock held for write
+ *
+ * Opening only records the openflags, there is nothing else to it.
+ */
+static fsal_status_t mem_open_hdl(struct mem_fsal_obj_handle *myself,
+				  struct state_t *state,
+				  fsal_openflags_t openflags)
+{
+	struct mem_fd *my_fd;
+	fsal_status_t status;
+
+	if (state != NULL) {
+		my_fd = &container_of(state, struct mem_state_fd,
+				      state)->mem_fd;
+
+		/* Check share reservation conflicts. */
+		status = check_share_conflict(&myself->mh.file.share,
+					      openflags, false);
+
+		if (FSAL_IS_ERROR(status))
+			return status;
+
+		/* Take the share reservation now by updating the
+		 * counters.
+		 */
+		update_share_counters(&myself->mh.file.share, FSAL_O_CLOSED,
+				      openflags);
+	} else {
+		/* The global fd, opened for NFS v3 and such */
+		my_fd = &myself->mh.file.fd;
+	}
+
+	my_fd->openflags = openflags;
+
+	if ((openflags & FSAL_O_TRUNC) != 0)
+		mem_truncate(myself);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* mem_open2
+ */
+
+fsal_status_t mem_open2(struct fsal_obj_handle *obj_hdl,
+			struct state_t *state,
+			fsal_openflags_t openflags,
+			enum fsal_create_mode createmode,
+			const char *name,
+			struct attrlist *attrs_in,
+			fsal_verifier_t verifier,
+			struct fsal_obj_handle **new_obj,
+			struct attrlist *attrs_out,
+			bool *caller_perm_check)
+{
+	struct mem_fsal_obj_handle *myself, *hdl = NULL;
+	fsal_status_t status;
+	bool created = false;
+
+	LogAttrlist(COMPONENT_FSAL, NIV_FULL_DEBUG,
+		    "attrs_in ", attrs_in, false);
+
+	if (createmode >= FSAL_EXCLUSIVE) {
+		/* Now fixup attrs for verifier if exclusive create */
+		set_common_verifier(attrs_in, verifier);
+	}
+
+	if (name == NULL) {
+		/* This is an open by handle */
+		myself = container_of(obj_hdl, struct mem_fsal_obj_handle,
+				      obj_handle);
+
+		PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+		status = mem_open_hdl(myself, state, openflags);
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+		if (!FSAL_IS_ERROR(status) && createmode >= FSAL_EXCLUSIVE &&
+		    createmode != FSAL_EXCLUSIVE_9P &&
+		    !mem_check_verifier(obj_hdl, verifier)) {
+			/* Verifier didn't match, undo the open */
+			if (state != NULL)
+				(void) mem_close2(obj_hdl, state);
+			status = fsalstat(ERR_FSAL_EXIST, EEXIST);
+		}
+
+		/* We haven't done any permission check so ask the caller
+		 * to do so.
+		 */
+		*caller_perm_check = !FSAL_IS_ERROR(status);
+
+		return status;
+	}
+
+	/* The file is opened before the directory is unlocked, so it
+	 * can't be unlinked and released under us.
+	 */
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+
+	status = mem_open_by_name(obj_hdl, name, createmode, attrs_in,
+				  &hdl, &created);
+
+	if (!FSAL_IS_ERROR(status)) {
+		PTHREAD_RWLOCK_wrlock(&hdl->obj_handle.obj_lock);
+		status = mem_open_hdl(hdl, state, openflags);
+		PTHREAD_RWLOCK_unlock(&hdl->obj_handle.obj_lock);
+	}
+
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	*new_obj = &hdl->obj_handle;
+
+	if (attrs_out != NULL)
+		(void) hdl->obj_handle.obj_ops.getattrs(&hdl->obj_handle,
+							attrs_out);
+
+	/* A file we created had its permissions set by us, one that
+	 * existed must be checked by the caller.
+	 */
+	*caller_perm_check = !created;
+
+	return status;
+}
+
+/**
+ * @brief Return open status of a state.
+ *
+ * @param[in] obj_hdl     File owning state
+ * @param[in] state       File state to interrogate
+ *
+ * @retval Flags representing current open status
+ */
+
+fsal_openflags_t mem_status2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state)
+{
+	struct mem_fd *my_fd = &container_of(state, struct mem_state_fd,
+					     state)->mem_fd;
+
+	return my_fd->openflags;
+}
+
+bool mem_check_verifier(struct fsal_obj_handle *obj_hdl,
+			fsal_verifier_t verifier)
+{
+	struct mem_fsal_obj_handle *myself;
+	bool result;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	PTHREAD_RWLOCK_rdlock(&myself->mh_lock);
+	result = check_verifier_attrlist(&myself->attributes, verifier);
+	PTHREAD_RWLOCK_unlock(&myself->mh_lock);
+
+	return result;
+}
+
+/* mem_reopen2
+ */
+
+fsal_status_t mem_reopen2(struct fsal_obj_handle *obj_hdl,
+			  struct state_t *state,
+			  fsal_openflags_t openflags)
+{
+	struct mem_fsal_obj_handle *myself;
+	struct mem_fd *my_fd = &container_of(state, struct mem_state_fd,
+					     state)->mem_fd;
+	fsal_openflags_t old_openflags;
+	fsal_status_t status;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+
+	old_openflags = my_fd->openflags;
+
+	/* We can update the share counters before the check as long as we
+	 * put them back on a conflict.
+	 */
+	update_share_counters(&myself->mh.file.share, old_openflags,
+			      openflags);
+
+	status = check_share_conflict(&myself->mh.file.share, openflags,
+				      false);
+
+	if (FSAL_IS_ERROR(status)) {
+		update_share_counters(&myself->mh.file.share, openflags,
+				      old_openflags);
+	} else {
+		my_fd->openflags = openflags;
+
+		if ((openflags & FSAL_O_TRUNC) != 0)
+			mem_truncate(myself);
+	}
+
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+/* mem_read2
+ * concurrency (locks) is managed in SAL
+ */
+
+fsal_status_t mem_read2(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			struct state_t *state,
+			uint64_t offset,
+			size_t buffer_size,
+			void *buffer,
+			size_t *read_amount,
+			bool *end_of_file,
+			struct io_info *info)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_status_t status;
+	uint64_t filesize;
+
+	if (info != NULL) {
+		/* Currently we don't support READ_PLUS */
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+	}
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+
+	status = mem_check_share(obj_hdl, state, FSAL_O_READ, bypass);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	PTHREAD_RWLOCK_rdlock(&myself->mh_lock);
+
+	filesize = myself->attributes.filesize;
+
+	if (offset >= filesize) {
+		*read_amount = 0;
+	} else {
+		*read_amount = filesize - offset < buffer_size
+				? filesize - offset : buffer_size;
+		memcpy(buffer, myself->mh.file.data + offset, *read_amount);
+	}
+
+	*end_of_file = offset + *read_amount >= filesize;
+
+	PTHREAD_RWLOCK_unlock(&myself->mh_lock);
+
+	return status;
+}
+
+/* mem_write2
+ * concurrency (locks) is managed in SAL
+ */
+
+fsal_status_t mem_write2(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct state_t *state,
+			 uint64_t offset,
+			 size_t buffer_size,
+			 void *buffer,
+			 size_t *wrote_amount,
+			 bool *fsal_stable,
+			 struct io_info *info)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_status_t status;
+	fsal_errors_t error = ERR_FSAL_NO_ERROR;
+
+	if (info != NULL) {
+		/* Currently we don't support WRITE_PLUS */
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+	}
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+
+	status = mem_check_share(obj_hdl, state, FSAL_O_WRITE, bypass);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	if (offset > UINT64_MAX - buffer_size)
+		return fsalstat(ERR_FSAL_FBIG, EFBIG);
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	PTHREAD_RWLOCK_wrlock(&myself->mh_lock);
+
+	if (offset + buffer_size > myself->attributes.filesize)
+		error = mem_resize(myself, offset + buffer_size);
+
+	if (error == ERR_FSAL_NO_ERROR) {
+		memcpy(myself->mh.file.data + offset, buffer, buffer_size);
+		mem_touch(&myself->attributes, true);
+		*wrote_amount = buffer_size;
+	} else {
+		*wrote_amount = 0;
+	}
+
+	PTHREAD_RWLOCK_unlock(&myself->mh_lock);
+
+	/* Nothing to flush, data is as stable as it gets */
+	*fsal_stable = true;
+
+	return fsalstat(error, 0);
+}
+
+/* mem_commit2
+ * Nothing is cached between the write and the memory.
+ */
+
+fsal_status_t mem_commit2(struct fsal_obj_handle *obj_hdl,
+			  off_t offset,
+			  size_t len)
+{
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* mem_lock_op2
+ * SAL keeps the locks of each file and checks conflicts before calling
+ * us, and as nothing but ganesha gets to the files, its list is all
+ * there is.  So all that is left here is to validate the request.
+ */
+
+fsal_status_t mem_lock_op2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   void *owner,
+			   fsal_lock_op_t lock_op,
+			   fsal_lock_param_t *request_lock,
+			   fsal_lock_param_t *conflicting_lock)
+{
+	LogFullDebug(COMPONENT_FSAL,
+		     "Locking: op:%d type:%d start:%" PRIu64 " length:%"
+		     PRIu64 " ",
+		     lock_op, request_lock->lock_type, request_lock->lock_start,
+		     request_lock->lock_length);
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+
+	if (request_lock->lock_type != FSAL_LOCK_R &&
+	    request_lock->lock_type != FSAL_LOCK_W) {
+		LogDebug(COMPONENT_FSAL,
+			 "ERROR: The requested lock type was not read or write.");
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+	}
+
+	switch (lock_op) {
+	case FSAL_OP_LOCKT:
+		/* SAL found no conflict in its list, so there is none */
+		if (conflicting_lock != NULL)
+			conflicting_lock->lock_type = FSAL_NO_LOCK;
+		break;
+	case FSAL_OP_LOCK:
+	case FSAL_OP_UNLOCK:
+		break;
+	default:
+		LogDebug(COMPONENT_FSAL,
+			 "ERROR: Lock operation requested was not TEST, LOCK, or UNLOCK.");
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* mem_setattr2
+ */
+
+fsal_status_t mem_setattr2(struct fsal_obj_handle *obj_hdl,
+			   bool bypass,
+			   struct state_t *state,
+			   struct attrlist *attrib_set)
+{
+	struct mem_fsal_obj_handle *myself;
+	struct attrlist *attrs;
+	fsal_status_t status = {0, 0};
+	fsal_errors_t error = ERR_FSAL_NO_ERROR;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+	attrs = &myself->attributes;
+
+	/* apply umask, if mode attribute is to be changed */
+	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_MODE))
+		attrib_set->mode &=
+		    ~op_ctx->fsal_export->exp_ops.fs_umask(op_ctx->fsal_export);
+
+	/** TRUNCATE **/
+	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_SIZE)) {
+		if (obj_hdl->type != REGULAR_FILE) {
+			LogFullDebug(COMPONENT_FSAL,
+				     "Setting size on non-regular file");
+			return fsalstat(ERR_FSAL_INVAL, EINVAL);
+		}
+
+		status = mem_check_share(obj_hdl, state, FSAL_O_WRITE, bypass);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	PTHREAD_RWLOCK_wrlock(&myself->mh_lock);
+
+	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_SIZE)) {
+		error = mem_resize(myself, attrib_set->filesize);
+		if (error != ERR_FSAL_NO_ERROR)
+			goto out;
+		mem_touch(attrs, true);
+	}
+
+	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_MODE))
+		attrs->mode = attrib_set->mode & (~S_IFMT & 0xFFFF);
+
+	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_OWNER))
+		attrs->owner = attrib_set->owner;
+
+	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_GROUP))
+		attrs->group = attrib_set->group;
+
+	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_ATIME))
+		attrs->atime = attrib_set->atime;
+	else if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_ATIME_SERVER))
+		now(&attrs->atime);
+
+	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_MTIME))
+		attrs->mtime = attrib_set->mtime;
+	else if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_MTIME_SERVER))
+		now(&attrs->mtime);
+
+	mem_touch(attrs, false);
+
+out:
+	PTHREAD_RWLOCK_unlock(&myself->mh_lock);
+
+	return fsalstat(error, 0);
+}
+
+/* mem_close2
+ */
+
+fsal_status_t mem_close2(struct fsal_obj_handle *obj_hdl,
+			 struct state_t *state)
+{
+	struct mem_fsal_obj_handle *myself;
+	struct mem_fd *my_fd = &container_of(state, struct mem_state_fd,
+					     state)->mem_fd;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	if (state->state_type == STATE_TYPE_SHARE ||
+	    state->state_type == STATE_TYPE_NLM_SHARE ||
+	    state->state_type == STATE_TYPE_9P_FID) {
+		/* This is a share state, we must update the share counters */
+		PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+
+		update_share_counters(&myself->mh.file.share,
+				      my_fd->openflags,
+				      FSAL_O_CLOSED);
+
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+	}
+
+	my_fd->openflags = FSAL_O_CLOSED;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* mem_close
+ * Close the global fd
+ */
+
+fsal_status_t mem_close(struct fsal_obj_handle *obj_hdl)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_errors_t error = ERR_FSAL_NO_ERROR;
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return fsalstat(ERR_FSAL_NOT_OPENED, 0);
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	/* Take write lock on object to protect file descriptor. */
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+
+	if (myself->mh.file.fd.openflags == FSAL_O_CLOSED)
+		error = ERR_FSAL_NOT_OPENED;
+	else
+		myself->mh.file.fd.openflags = FSAL_O_CLOSED;
+
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return fsalstat(error, 0);
+}
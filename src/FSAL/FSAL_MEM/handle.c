@@ -0,0 +1,1058 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* handle.c
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "FSAL/fsal_commonlib.h"
+#include "mem_methods.h"
+
+/* Serializes renames to another directory, so that the parents of
+ * directories can be walked to check a directory isn't moved under
+ * itself, and to lock an ancestor before its descendant.
+ */
+static pthread_mutex_t mem_rename_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* helpers
+ */
+
+static inline int mem_n_cmpf(const struct avltree_node *lhs,
+			     const struct avltree_node *rhs)
+{
+	struct mem_dirent *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct mem_dirent, d_node_n);
+	rk = avltree_container_of(rhs, struct mem_dirent, d_node_n);
+
+	return strcmp(lk->d_name, rk->d_name);
+}
+
+static inline int mem_i_cmpf(const struct avltree_node *lhs,
+			     const struct avltree_node *rhs)
+{
+	struct mem_dirent *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct mem_dirent, d_node_i);
+	rk = avltree_container_of(rhs, struct mem_dirent, d_node_i);
+
+	if (lk->d_index < rk->d_index)
+		return -1;
+
+	return lk->d_index > rk->d_index;
+}
+
+/**
+ * @brief Update ctime and the change attribute, and mtime if asked
+ *
+ * Called with the object's mh_lock held for write.
+ */
+void mem_touch(struct attrlist *attrs, bool mtime)
+{
+	now(&attrs->ctime);
+	attrs->chgtime = attrs->ctime;
+	if (mtime)
+		attrs->mtime = attrs->ctime;
+	attrs->change = timespec_to_nsecs(&attrs->chgtime);
+}
+
+static void mem_copy_attrs(struct mem_fsal_obj_handle *hdl,
+			   struct attrlist *attrs_out)
+{
+	PTHREAD_RWLOCK_rdlock(&hdl->mh_lock);
+	fsal_copy_attrs(attrs_out, &hdl->attributes, false);
+	PTHREAD_RWLOCK_unlock(&hdl->mh_lock);
+}
+
+/**
+ * @brief Allocate an object and index it in its export
+ *
+ * The object has no links, the caller gives it a name with
+ * mem_dirent_insert.
+ */
+static struct mem_fsal_obj_handle *
+mem_alloc_handle(struct mem_fsal_export *mfe,
+		 object_file_type_t type,
+		 struct attrlist *attrs)
+{
+	struct mem_fsal_obj_handle *hdl;
+	uint64_t fileid;
+
+	hdl = gsh_calloc(1, sizeof(struct mem_fsal_obj_handle));
+
+	hdl->mh_export = mfe;
+	fsal_obj_handle_init(&hdl->obj_handle, &mfe->export, type);
+	mem_handle_ops_init(&hdl->obj_handle.obj_ops);
+	PTHREAD_RWLOCK_init(&hdl->mh_lock, NULL);
+
+	PTHREAD_RWLOCK_wrlock(&mfe->mfe_lock);
+	fileid = mfe->next_fileid++;
+	hdl->obj_handle.fileid = fileid;
+	avltree_insert(&hdl->mh_node_k, &mfe->mfe_objs);
+	hdl->indexed = true;
+	PTHREAD_RWLOCK_unlock(&mfe->mfe_lock);
+
+	memcpy(hdl->handle, &fileid, sizeof(fileid));
+	memcpy(hdl->handle + sizeof(fileid), &mfe->handle_tag,
+	       sizeof(mfe->handle_tag));
+
+	hdl->attributes.type = type;
+	hdl->attributes.fileid = fileid;
+	hdl->attributes.numlinks = type == DIRECTORY ? 2 : 1;
+
+	if ((attrs->valid_mask & ATTR_MODE) != 0)
+		hdl->attributes.mode = attrs->mode & (~S_IFMT & 0xFFFF) &
+			~mfe->export.exp_ops.fs_umask(&mfe->export);
+
+	if ((attrs->valid_mask & ATTR_OWNER) != 0)
+		hdl->attributes.owner = attrs->owner;
+	else
+		hdl->attributes.owner = op_ctx->creds->caller_uid;
+
+	if ((attrs->valid_mask & ATTR_GROUP) != 0)
+		hdl->attributes.group = attrs->group;
+	else
+		hdl->attributes.group = op_ctx->creds->caller_gid;
+
+	if (type == CHARACTER_FILE || type == BLOCK_FILE)
+		hdl->attributes.rawdev = attrs->rawdev;
+
+	/* Use full timer resolution */
+	mem_touch(&hdl->attributes, true);
+
+	if ((attrs->valid_mask & ATTR_ATIME) != 0)
+		hdl->attributes.atime = attrs->atime;
+	else
+		hdl->attributes.atime = hdl->attributes.ctime;
+
+	if ((attrs->valid_mask & ATTR_MTIME) != 0)
+		hdl->attributes.mtime = attrs->mtime;
+
+	/* Set the mask at the end. */
+	hdl->attributes.valid_mask = MEM_SUPPORTED_ATTRS;
+	hdl->attributes.supported = MEM_SUPPORTED_ATTRS;
+
+	if (type == DIRECTORY) {
+		avltree_init(&hdl->mh.dir.avl_name, mem_n_cmpf, 0 /* flags */);
+		avltree_init(&hdl->mh.dir.avl_index, mem_i_cmpf,
+			     0 /* flags */);
+		hdl->mh.dir.next_i = 2;
+	}
+
+	return hdl;
+}
+
+static void mem_free_handle(struct mem_fsal_obj_handle *hdl)
+{
+	LogFullDebug(COMPONENT_FSAL, "Freeing hdl=%p fileid=%" PRIu64,
+		     hdl, hdl->obj_handle.fileid);
+
+	fsal_obj_handle_fini(&hdl->obj_handle);
+	PTHREAD_RWLOCK_destroy(&hdl->mh_lock);
+
+	if (hdl->obj_handle.type == REGULAR_FILE)
+		free(hdl->mh.file.data);
+	else if (hdl->obj_handle.type == SYMBOLIC_LINK)
+		gsh_free(hdl->mh.symlink.link_contents);
+
+	gsh_free(hdl);
+}
+
+/* Called when the last link of an object went, it is freed on release */
+static void mem_unindex(struct mem_fsal_obj_handle *hdl)
+{
+	struct mem_fsal_export *mfe = hdl->mh_export;
+
+	PTHREAD_RWLOCK_wrlock(&mfe->mfe_lock);
+	if (hdl->indexed) {
+		avltree_remove(&hdl->mh_node_k, &mfe->mfe_objs);
+		hdl->indexed = false;
+	}
+	PTHREAD_RWLOCK_unlock(&mfe->mfe_lock);
+}
+
+/* The directory's obj_lock is held for the dirent helpers
+ */
+
+static struct mem_dirent *mem_dirent_lookup(struct mem_fsal_obj_handle *dir,
+					    const char *name)
+{
+	struct mem_dirent key;
+	struct avltree_node *node;
+
+	key.d_name = (char *) name;
+	node = avltree_inline_lookup(&key.d_node_n, &dir->mh.dir.avl_name,
+				     mem_n_cmpf);
+
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, struct mem_dirent, d_node_n);
+}
+
+static void mem_dirent_insert(struct mem_fsal_obj_handle *dir,
+			      struct mem_dirent *dirent)
+{
+	dirent->d_index = dir->mh.dir.next_i++;
+	avltree_insert(&dirent->d_node_n, &dir->mh.dir.avl_name);
+	avltree_insert(&dirent->d_node_i, &dir->mh.dir.avl_index);
+
+	PTHREAD_RWLOCK_wrlock(&dir->mh_lock);
+	if (dirent->d_obj->obj_handle.type == DIRECTORY)
+		dir->attributes.numlinks++;
+	mem_touch(&dir->attributes, true);
+	PTHREAD_RWLOCK_unlock(&dir->mh_lock);
+}
+
+static void mem_dirent_detach(struct mem_fsal_obj_handle *dir,
+			      struct mem_dirent *dirent)
+{
+	avltree_remove(&dirent->d_node_n, &dir->mh.dir.avl_name);
+	avltree_remove(&dirent->d_node_i, &dir->mh.dir.avl_index);
+
+	PTHREAD_RWLOCK_wrlock(&dir->mh_lock);
+	if (dirent->d_obj->obj_handle.type == DIRECTORY)
+		dir->attributes.numlinks--;
+	mem_touch(&dir->attributes, true);
+	PTHREAD_RWLOCK_unlock(&dir->mh_lock);
+}
+
+static struct mem_dirent *mem_dirent_alloc(struct mem_fsal_obj_handle *obj,
+					   const char *name)
+{
+	struct mem_dirent *dirent = gsh_calloc(1, sizeof(*dirent));
+
+	dirent->d_obj = obj;
+	dirent->d_name = gsh_strdup(name);
+
+	return dirent;
+}
+
+static void mem_dirent_free(struct mem_dirent *dirent)
+{
+	gsh_free(dirent->d_name);
+	gsh_free(dirent);
+}
+
+/**
+ * @brief Drop the link of a detached dirent and free it
+ */
+static void mem_dirent_drop(struct mem_dirent *dirent)
+{
+	struct mem_fsal_obj_handle *obj = dirent->d_obj;
+	uint32_t numlinks;
+
+	PTHREAD_RWLOCK_wrlock(&obj->mh_lock);
+	if (obj->obj_handle.type == DIRECTORY) {
+		/* The parent may go before this one is released */
+		obj->mh.dir.parent = NULL;
+		obj->attributes.numlinks = 0;
+	} else
+		obj->attributes.numlinks--;
+	numlinks = obj->attributes.numlinks;
+	mem_touch(&obj->attributes, false);
+	PTHREAD_RWLOCK_unlock(&obj->mh_lock);
+
+	if (numlinks == 0)
+		mem_unindex(obj);
+
+	mem_dirent_free(dirent);
+}
+
+/**
+ * @brief Create an object in a directory
+ *
+ * Called with the directory's obj_lock held for write.
+ */
+static fsal_status_t mem_create_obj(struct mem_fsal_obj_handle *dir,
+				    const char *name,
+				    object_file_type_t type,
+				    struct attrlist *attrs_in,
+				    const char *link_path,
+				    struct mem_fsal_obj_handle **new_hdl)
+{
+	struct mem_fsal_obj_handle *hdl;
+
+	if (mem_dirent_lookup(dir, name) != NULL)
+		return fsalstat(ERR_FSAL_EXIST, EEXIST);
+
+	hdl = mem_alloc_handle(dir->mh_export, type, attrs_in);
+
+	if (type == SYMBOLIC_LINK) {
+		hdl->mh.symlink.link_contents = gsh_strdup(link_path);
+		hdl->attributes.filesize = strlen(link_path);
+		hdl->attributes.spaceused = hdl->attributes.filesize;
+	} else if (type == DIRECTORY) {
+		hdl->mh.dir.parent = dir;
+	}
+
+	mem_dirent_insert(dir, mem_dirent_alloc(hdl, name));
+
+	*new_hdl = hdl;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* handle methods
+ */
+
+/* lookup
+ */
+
+static fsal_status_t lookup(struct fsal_obj_handle *parent,
+			    const char *path,
+			    struct fsal_obj_handle **handle,
+			    struct attrlist *attrs_out)
+{
+	struct mem_fsal_obj_handle *myself, *hdl = NULL;
+	struct mem_dirent *dirent;
+	fsal_errors_t error = ERR_FSAL_NOENT;
+
+	if (parent->type != DIRECTORY)
+		return fsalstat(ERR_FSAL_NOTDIR, 0);
+
+	myself = container_of(parent, struct mem_fsal_obj_handle, obj_handle);
+
+	/* Check if this context already holds the lock on
+	 * this directory.
+	 */
+	if (op_ctx->fsal_private != parent)
+		PTHREAD_RWLOCK_rdlock(&parent->obj_lock);
+
+	if (strcmp(path, "..") == 0) {
+		/* lookup parent - lookupp */
+		hdl = myself->mh.dir.parent;
+	} else if (strcmp(path, ".") == 0) {
+		hdl = myself;
+	} else {
+		dirent = mem_dirent_lookup(myself, path);
+		if (dirent != NULL)
+			hdl = dirent->d_obj;
+	}
+
+	if (hdl != NULL) {
+		*handle = &hdl->obj_handle;
+		error = ERR_FSAL_NO_ERROR;
+		LogFullDebug(COMPONENT_FSAL,
+			     "Found %s hdl=%p", path, hdl);
+	}
+
+	if (op_ctx->fsal_private != parent)
+		PTHREAD_RWLOCK_unlock(&parent->obj_lock);
+
+	if (error == ERR_FSAL_NO_ERROR && attrs_out != NULL)
+		mem_copy_attrs(hdl, attrs_out);
+
+	return fsalstat(error, 0);
+}
+
+static fsal_status_t mem_make(struct fsal_obj_handle *dir_hdl,
+			      const char *name,
+			      object_file_type_t type,
+			      struct attrlist *attrs_in,
+			      const char *link_path,
+			      struct fsal_obj_handle **handle,
+			      struct attrlist *attrs_out)
+{
+	struct mem_fsal_obj_handle *myself, *hdl = NULL;
+	fsal_status_t status;
+
+	LogDebug(COMPONENT_FSAL, "create %s", name);
+
+	*handle = NULL;		/* poison it */
+
+	if (dir_hdl->type != DIRECTORY) {
+		LogCrit(COMPONENT_FSAL,
+			"Parent handle is not a directory. hdl = 0x%p",
+			dir_hdl);
+		return fsalstat(ERR_FSAL_NOTDIR, 0);
+	}
+
+	myself = container_of(dir_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	PTHREAD_RWLOCK_wrlock(&dir_hdl->obj_lock);
+	status = mem_create_obj(myself, name, type, attrs_in, link_path, &hdl);
+	PTHREAD_RWLOCK_unlock(&dir_hdl->obj_lock);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	*handle = &hdl->obj_handle;
+
+	if (attrs_out != NULL)
+		mem_copy_attrs(hdl, attrs_out);
+
+	return status;
+}
+
+/**
+ * @brief Create a directory
+ *
+ * @param[in]     dir_hdl   Directory in which to create the directory
+ * @param[in]     name      Name of directory to create
+ * @param[in]     attrs_in  Attributes to set on newly created object
+ * @param[out]    handle    Newly created object
+ * @param[in,out] attrs_out Optional attributes for newly created object
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
+			     const char *name,
+			     struct attrlist *attrs_in,
+			     struct fsal_obj_handle **handle,
+			     struct attrlist *attrs_out)
+{
+	return mem_make(dir_hdl, name, DIRECTORY, attrs_in, NULL, handle,
+			attrs_out);
+}
+
+static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
+			      const char *name,
+			      object_file_type_t nodetype,
+			      struct attrlist *attrs_in,
+			      struct fsal_obj_handle **handle,
+			      struct attrlist *attrs_out)
+{
+	switch (nodetype) {
+	case CHARACTER_FILE:
+	case BLOCK_FILE:
+	case SOCKET_FILE:
+	case FIFO_FILE:
+		break;
+	default:
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+	}
+
+	return mem_make(dir_hdl, name, nodetype, attrs_in, NULL, handle,
+			attrs_out);
+}
+
+static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
+				 const char *name,
+				 const char *link_path,
+				 struct attrlist *attrs_in,
+				 struct fsal_obj_handle **handle,
+				 struct attrlist *attrs_out)
+{
+	return mem_make(dir_hdl, name, SYMBOLIC_LINK, attrs_in, link_path,
+			handle, attrs_out);
+}
+
+static fsal_status_t readsymlink(struct fsal_obj_handle *obj_hdl,
+				 struct gsh_buffdesc *link_content,
+				 bool refresh)
+{
+	struct mem_fsal_obj_handle *myself;
+
+	if (obj_hdl->type != SYMBOLIC_LINK)
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	/* The contents of a symlink never change */
+	link_content->len = strlen(myself->mh.symlink.link_contents) + 1;
+	link_content->addr = gsh_malloc(link_content->len);
+	memcpy(link_content->addr, myself->mh.symlink.link_contents,
+	       link_content->len);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * read_dirents
+ * read the directory and call through the callback function for
+ * each entry.
+ * @param dir_hdl [IN] the directory to read
+ * @param whence [IN] where to start (next)
+ * @param dir_state [IN] pass thru of state to callback
+ * @param cb [IN] callback function
+ * @param eof [OUT] eof marker true == end of dir
+ */
+
+static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
+				  fsal_cookie_t *whence,
+				  void *dir_state,
+				  fsal_readdir_cb cb,
+				  attrmask_t attrmask,
+				  bool *eof)
+{
+	struct mem_fsal_obj_handle *myself;
+	struct mem_dirent *dirent, key;
+	struct avltree_node *node;
+	struct attrlist attrs;
+	enum fsal_dir_result cb_rc;
+
+	if (whence != NULL)
+		key.d_index = *whence;
+	else
+		key.d_index = 2;    /* start from index 2, if no cookie */
+
+	*eof = true;
+
+	myself = container_of(dir_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	PTHREAD_RWLOCK_rdlock(&dir_hdl->obj_lock);
+
+	/* Use fsal_private to signal to lookup that we hold
+	 * the lock.
+	 */
+	op_ctx->fsal_private = dir_hdl;
+
+	/* Seek to the cookie rather than walk the entries before it */
+	for (node = avltree_sup(&key.d_node_i, &myself->mh.dir.avl_index);
+	     node != NULL;
+	     node = avltree_next(node)) {
+		dirent = avltree_container_of(node, struct mem_dirent,
+					      d_node_i);
+		if (dirent->d_index < key.d_index)
+			continue;
+
+		fsal_prepare_attrs(&attrs, attrmask);
+		mem_copy_attrs(dirent->d_obj, &attrs);
+
+		cb_rc = cb(dirent->d_name, &dirent->d_obj->obj_handle, &attrs,
+			   dir_state, dirent->d_index + 1, NULL);
+
+		fsal_release_attrs(&attrs);
+
+		/* Read ahead not supported by this FSAL. */
+		if (cb_rc >= DIR_READAHEAD) {
+			*eof = false;
+			break;
+		}
+	}
+
+	op_ctx->fsal_private = NULL;
+
+	PTHREAD_RWLOCK_unlock(&dir_hdl->obj_lock);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
+			      struct attrlist *outattrs)
+{
+	struct mem_fsal_obj_handle *myself;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_copy_attrs(myself, outattrs);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
+			      struct fsal_obj_handle *destdir_hdl,
+			      const char *name)
+{
+	struct mem_fsal_obj_handle *myself, *destdir;
+	fsal_errors_t error = ERR_FSAL_NO_ERROR;
+
+	if (obj_hdl->type == DIRECTORY)
+		return fsalstat(ERR_FSAL_ISDIR, EISDIR);
+
+	if (destdir_hdl->type != DIRECTORY)
+		return fsalstat(ERR_FSAL_NOTDIR, ENOTDIR);
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+	destdir = container_of(destdir_hdl, struct mem_fsal_obj_handle,
+			       obj_handle);
+
+	PTHREAD_RWLOCK_wrlock(&destdir_hdl->obj_lock);
+
+	if (mem_dirent_lookup(destdir, name) != NULL) {
+		error = ERR_FSAL_EXIST;
+		goto unlock;
+	}
+
+	PTHREAD_RWLOCK_wrlock(&myself->mh_lock);
+	if (myself->attributes.numlinks == 0) {
+		/* Can't bring an unlinked file back */
+		error = ERR_FSAL_STALE;
+	} else {
+		myself->attributes.numlinks++;
+		mem_touch(&myself->attributes, false);
+	}
+	PTHREAD_RWLOCK_unlock(&myself->mh_lock);
+
+	if (error == ERR_FSAL_NO_ERROR)
+		mem_dirent_insert(destdir, mem_dirent_alloc(myself, name));
+
+unlock:
+	PTHREAD_RWLOCK_unlock(&destdir_hdl->obj_lock);
+
+	return fsalstat(error, 0);
+}
+
+/* Is dir the same as or under ancestor, with mem_rename_lock held */
+static bool mem_is_under(struct mem_fsal_obj_handle *dir,
+			 struct mem_fsal_obj_handle *ancestor)
+{
+	for (; dir != NULL; dir = dir->mh.dir.parent)
+		if (dir == ancestor)
+			return true;
+
+	return false;
+}
+
+static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
+				struct fsal_obj_handle *olddir_hdl,
+				const char *old_name,
+				struct fsal_obj_handle *newdir_hdl,
+				const char *new_name)
+{
+	struct mem_fsal_obj_handle *olddir, *newdir, *obj;
+	struct mem_dirent *od, *nd;
+	fsal_errors_t error = ERR_FSAL_NO_ERROR;
+	bool moving_dir;
+
+	olddir = container_of(olddir_hdl, struct mem_fsal_obj_handle,
+			      obj_handle);
+	newdir = container_of(newdir_hdl, struct mem_fsal_obj_handle,
+			      obj_handle);
+	obj = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	moving_dir = obj_hdl->type == DIRECTORY && olddir != newdir;
+
+	if (olddir != newdir)
+		PTHREAD_MUTEX_lock(&mem_rename_lock);
+
+	if (moving_dir && mem_is_under(newdir, obj)) {
+		PTHREAD_MUTEX_unlock(&mem_rename_lock);
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+	}
+
+	/* An ancestor is locked before its descendant as unlink does */
+	if (olddir == newdir) {
+		PTHREAD_RWLOCK_wrlock(&olddir_hdl->obj_lock);
+	} else if (!mem_is_under(olddir, newdir)) {
+		PTHREAD_RWLOCK_wrlock(&olddir_hdl->obj_lock);
+		PTHREAD_RWLOCK_wrlock(&newdir_hdl->obj_lock);
+	} else {
+		PTHREAD_RWLOCK_wrlock(&newdir_hdl->obj_lock);
+		PTHREAD_RWLOCK_wrlock(&olddir_hdl->obj_lock);
+	}
+
+	od = mem_dirent_lookup(olddir, old_name);
+	if (od == NULL || od->d_obj != obj) {
+		error = ERR_FSAL_NOENT;
+		goto unlock;
+	}
+
+	nd = mem_dirent_lookup(newdir, new_name);
+	if (nd != NULL) {
+		struct mem_fsal_obj_handle *dst = nd->d_obj;
+
+		if (dst == obj) {
+			/* Both names link the same object, nothing to do */
+			goto unlock;
+		}
+
+		if (dst->obj_handle.type == DIRECTORY) {
+			if (obj_hdl->type != DIRECTORY) {
+				error = ERR_FSAL_ISDIR;
+				goto unlock;
+			}
+			if (avltree_size(&dst->mh.dir.avl_name) != 0) {
+				error = ERR_FSAL_NOTEMPTY;
+				goto unlock;
+			}
+		} else if (obj_hdl->type == DIRECTORY) {
+			error = ERR_FSAL_NOTDIR;
+			goto unlock;
+		}
+
+		mem_dirent_detach(newdir, nd);
+		mem_dirent_drop(nd);
+	}
+
+	mem_dirent_detach(olddir, od);
+	gsh_free(od->d_name);
+	od->d_name = gsh_strdup(new_name);
+	mem_dirent_insert(newdir, od);
+
+	PTHREAD_RWLOCK_wrlock(&obj->mh_lock);
+	if (moving_dir)
+		obj->mh.dir.parent = newdir;
+	mem_touch(&obj->attributes, false);
+	PTHREAD_RWLOCK_unlock(&obj->mh_lock);
+
+unlock:
+	PTHREAD_RWLOCK_unlock(&olddir_hdl->obj_lock);
+	if (olddir != newdir) {
+		PTHREAD_RWLOCK_unlock(&newdir_hdl->obj_lock);
+		PTHREAD_MUTEX_unlock(&mem_rename_lock);
+	}
+
+	return fsalstat(error, 0);
+}
+
+/* file_unlink
+ * unlink the named file in the directory
+ */
+
+static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
+				 struct fsal_obj_handle *obj_hdl,
+				 const char *name)
+{
+	struct mem_fsal_obj_handle *myself, *hdl;
+	struct mem_dirent *dirent;
+	fsal_errors_t error = ERR_FSAL_NO_ERROR;
+
+	myself = container_of(dir_hdl, struct mem_fsal_obj_handle, obj_handle);
+	hdl = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	PTHREAD_RWLOCK_wrlock(&dir_hdl->obj_lock);
+
+	dirent = mem_dirent_lookup(myself, name);
+	if (dirent == NULL || dirent->d_obj != hdl) {
+		error = ERR_FSAL_NOENT;
+		goto unlock;
+	}
+
+	/* Check if directory is empty, its entries are under its lock but
+	 * nothing can be added while we hold the parent's.
+	 */
+	if (obj_hdl->type == DIRECTORY) {
+		PTHREAD_RWLOCK_rdlock(&obj_hdl->obj_lock);
+		if (avltree_size(&hdl->mh.dir.avl_name) != 0)
+			error = ERR_FSAL_NOTEMPTY;
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+		if (error != ERR_FSAL_NO_ERROR)
+			goto unlock;
+	}
+
+	mem_dirent_detach(myself, dirent);
+	mem_dirent_drop(dirent);
+
+unlock:
+	PTHREAD_RWLOCK_unlock(&dir_hdl->obj_lock);
+
+	return fsalstat(error, 0);
+}
+
+/* handle_digest
+ * fill in the opaque f/s file handle part.
+ */
+
+static fsal_status_t handle_digest(const struct fsal_obj_handle *obj_hdl,
+				   fsal_digesttype_t output_type,
+				   struct gsh_buffdesc *fh_desc)
+{
+	const struct mem_fsal_obj_handle *myself;
+
+	myself = container_of(obj_hdl, const struct mem_fsal_obj_handle,
+			      obj_handle);
+
+	switch (output_type) {
+	case FSAL_DIGEST_NFSV3:
+	case FSAL_DIGEST_NFSV4:
+		if (fh_desc->len < MEM_HANDLE_SIZE) {
+			LogMajor(COMPONENT_FSAL,
+				 "Space too small for handle.  need %zu, have %zu",
+				 MEM_HANDLE_SIZE, fh_desc->len);
+			return fsalstat(ERR_FSAL_TOOSMALL, 0);
+		}
+
+		memcpy(fh_desc->addr, myself->handle, MEM_HANDLE_SIZE);
+		fh_desc->len = MEM_HANDLE_SIZE;
+		break;
+
+	default:
+		return fsalstat(ERR_FSAL_SERVERFAULT, 0);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * handle_to_key
+ * return a handle descriptor into the handle in this object handle
+ */
+
+static void handle_to_key(struct fsal_obj_handle *obj_hdl,
+			  struct gsh_buffdesc *fh_desc)
+{
+	struct mem_fsal_obj_handle *myself;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	fh_desc->addr = myself->handle;
+	fh_desc->len = MEM_HANDLE_SIZE;
+}
+
+/*
+ * release
+ * Objects that still have a name stay, they are found again by lookup
+ * or create_handle.  Unlinked ones go with their last user.
+ */
+
+static void release(struct fsal_obj_handle *obj_hdl)
+{
+	struct mem_fsal_obj_handle *myself;
+	bool live;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	PTHREAD_RWLOCK_rdlock(&myself->mh_export->mfe_lock);
+	live = myself->indexed;
+	PTHREAD_RWLOCK_unlock(&myself->mh_export->mfe_lock);
+
+	if (live) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "Releasing live hdl=%p, don't deconstruct it",
+			     myself);
+		return;
+	}
+
+	mem_free_handle(myself);
+}
+
+void mem_handle_ops_init(struct fsal_obj_ops *ops)
+{
+	ops->release = release;
+	ops->lookup = lookup;
+	ops->readdir = read_dirents;
+	ops->mkdir = makedir;
+	ops->mknode = makenode;
+	ops->symlink = makesymlink;
+	ops->readlink = readsymlink;
+	ops->getattrs = getattrs;
+	ops->link = linkfile;
+	ops->rename = renamefile;
+	ops->unlink = file_unlink;
+	ops->close = mem_close;
+	ops->handle_digest = handle_digest;
+	ops->handle_to_key = handle_to_key;
+	ops->open2 = mem_open2;
+	ops->check_verifier = mem_check_verifier;
+	ops->status2 = mem_status2;
+	ops->reopen2 = mem_reopen2;
+	ops->read2 = mem_read2;
+	ops->write2 = mem_write2;
+	ops->commit2 = mem_commit2;
+	ops->lock_op2 = mem_lock_op2;
+	ops->setattr2 = mem_setattr2;
+	ops->close2 = mem_close2;
+}
+
+/**
+ * @brief Open or create a regular file by name
+ *
+ * The open2 half that deals with the directory, the directory's
+ * obj_lock is held for write.
+ *
+ * @param[out] created Whether the file was created
+ */
+fsal_status_t mem_open_by_name(struct fsal_obj_handle *dir_hdl,
+			       const char *name,
+			       enum fsal_create_mode createmode,
+			       struct attrlist *attrs_in,
+			       struct mem_fsal_obj_handle **hdl,
+			       bool *created)
+{
+	struct mem_fsal_obj_handle *dir;
+	struct mem_dirent *dirent;
+	struct mem_fsal_obj_handle *obj;
+
+	*created = false;
+
+	if (dir_hdl->type != DIRECTORY)
+		return fsalstat(ERR_FSAL_NOTDIR, ENOTDIR);
+
+	dir = container_of(dir_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	dirent = mem_dirent_lookup(dir, name);
+
+	if (dirent == NULL) {
+		if (createmode == FSAL_NO_CREATE)
+			return fsalstat(ERR_FSAL_NOENT, ENOENT);
+
+		*created = true;
+		return mem_create_obj(dir, name, REGULAR_FILE, attrs_in, NULL,
+				      hdl);
+	}
+
+	obj = dirent->d_obj;
+
+	switch (obj->obj_handle.type) {
+	case REGULAR_FILE:
+		break;
+	case DIRECTORY:
+		return fsalstat(ERR_FSAL_ISDIR, EISDIR);
+	case SYMBOLIC_LINK:
+		return fsalstat(ERR_FSAL_SYMLINK, ELOOP);
+	default:
+		return fsalstat(ERR_FSAL_BADTYPE, 0);
+	}
+
+	/* MDCACHE dealt with an exclusive create retransmit before calling
+	 * us, so the file was created by a racing open, as O_EXCL would see.
+	 */
+	if (createmode >= FSAL_GUARDED)
+		return fsalstat(ERR_FSAL_EXIST, EEXIST);
+
+	*hdl = obj;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* export methods that create object handles
+ */
+
+/**
+ * @brief Free every object of an export
+ *
+ * Called when the export is released, after MDCACHE let go of all the
+ * handles.
+ */
+
+void mem_release_objects(struct mem_fsal_export *mfe)
+{
+	struct avltree_node *node, *dnode;
+	struct mem_fsal_obj_handle *hdl;
+	struct mem_dirent *dirent;
+
+	PTHREAD_RWLOCK_wrlock(&mfe->mfe_lock);
+
+	while ((node = avltree_first(&mfe->mfe_objs)) != NULL) {
+		hdl = avltree_container_of(node, struct mem_fsal_obj_handle,
+					   mh_node_k);
+		avltree_remove(node, &mfe->mfe_objs);
+
+		if (hdl->obj_handle.type == DIRECTORY) {
+			while ((dnode = avltree_first(&hdl->mh.dir.avl_index))
+			       != NULL) {
+				dirent = avltree_container_of(dnode,
+							      struct mem_dirent,
+							      d_node_i);
+				avltree_remove(dnode, &hdl->mh.dir.avl_index);
+				mem_dirent_free(dirent);
+			}
+		}
+
+		mem_free_handle(hdl);
+	}
+
+	mfe->root_handle = NULL;
+
+	PTHREAD_RWLOCK_unlock(&mfe->mfe_lock);
+}
+
+/* lookup_path
+ * Only the root of the export, as in FSAL_PSEUDO.
+ */
+
+fsal_status_t mem_lookup_path(struct fsal_export *exp_hdl,
+			      const char *path,
+			      struct fsal_obj_handle **handle,
+			      struct attrlist *attrs_out)
+{
+	struct mem_fsal_export *myself;
+	struct attrlist attrs;
+
+	myself = container_of(exp_hdl, struct mem_fsal_export, export);
+
+	if (strcmp(path, myself->export_path) != 0) {
+		/* Lookup of a path other than the export's root. */
+		LogCrit(COMPONENT_FSAL,
+			"Attempt to lookup non-root path %s",
+			path);
+		return fsalstat(ERR_FSAL_NOENT, ENOENT);
+	}
+
+	if (myself->root_handle == NULL) {
+		memset(&attrs, 0, sizeof(attrs));
+		attrs.valid_mask = ATTR_MODE | ATTR_OWNER | ATTR_GROUP;
+		attrs.mode = 0777;
+
+		myself->root_handle = mem_alloc_handle(myself, DIRECTORY,
+						       &attrs);
+	}
+
+	*handle = &myself->root_handle->obj_handle;
+
+	if (attrs_out != NULL)
+		mem_copy_attrs(myself->root_handle, attrs_out);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* create_handle
+ * Find an object from the handle a client sent
+ */
+
+fsal_status_t mem_create_handle(struct fsal_export *exp_hdl,
+				struct gsh_buffdesc *hdl_desc,
+				struct fsal_obj_handle **handle,
+				struct attrlist *attrs_out)
+{
+	struct mem_fsal_export *myself;
+	struct mem_fsal_obj_handle key, *hdl = NULL;
+	struct avltree_node *node;
+	uint64_t tag;
+
+	myself = container_of(exp_hdl, struct mem_fsal_export, export);
+
+	*handle = NULL;
+
+	if (hdl_desc->len != MEM_HANDLE_SIZE) {
+		LogCrit(COMPONENT_FSAL,
+			"Invalid handle size %zu expected %zu",
+			hdl_desc->len, MEM_HANDLE_SIZE);
+
+		return fsalstat(ERR_FSAL_BADHANDLE, 0);
+	}
+
+	memcpy(&key.obj_handle.fileid, hdl_desc->addr, sizeof(uint64_t));
+	memcpy(&tag, (char *) hdl_desc->addr + sizeof(uint64_t),
+	       sizeof(tag));
+
+	if (tag != myself->handle_tag) {
+		LogDebug(COMPONENT_FSAL,
+			 "Handle from another instance of the export");
+		return fsalstat(ERR_FSAL_STALE, ESTALE);
+	}
+
+	PTHREAD_RWLOCK_rdlock(&myself->mfe_lock);
+	node = avltree_lookup(&key.mh_node_k, &myself->mfe_objs);
+	if (node != NULL)
+		hdl = avltree_container_of(node, struct mem_fsal_obj_handle,
+					   mh_node_k);
+	PTHREAD_RWLOCK_unlock(&myself->mfe_lock);
+
+	if (hdl == NULL) {
+		LogDebug(COMPONENT_FSAL,
+			 "Could not find handle");
+		return fsalstat(ERR_FSAL_STALE, ESTALE);
+	}
+
+	*handle = &hdl->obj_handle;
+
+	if (attrs_out != NULL)
+		mem_copy_attrs(hdl, attrs_out);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
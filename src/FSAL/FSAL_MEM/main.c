@@ -0,0 +1,137 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* main.c
+ * Module core functions
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <pthread.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+#include "FSAL/fsal_init.h"
+#include "mem_methods.h"
+#include "../fsal_private.h"
+
+/* MEM FSAL module private storage
+ */
+
+struct mem_fsal_module {
+	struct fsal_module fsal;
+	struct fsal_staticfsinfo_t fs_info;
+};
+
+const char memname[] = "MEM";
+
+/* filesystem info for MEM */
+static struct fsal_staticfsinfo_t default_mem_info = {
+	.maxfilesize = INT64_MAX,
+	.maxlink = UINT32_MAX,
+	.maxnamelen = MAXNAMLEN,
+	.maxpathlen = MAXPATHLEN,
+	.no_trunc = true,
+	.chown_restricted = true,
+	.case_insensitive = false,
+	.case_preserving = true,
+	.link_support = true,
+	.symlink_support = true,
+	.lock_support = true,
+	.lock_support_owner = true,
+	.lock_support_async_block = false,
+	.named_attr = false,
+	.unique_handles = true,
+	.lease_time = {10, 0},
+	.acl_support = 0,
+	.cansettime = true,
+	.homogenous = true,
+	.supported_attrs = MEM_SUPPORTED_ATTRS,
+	.maxread = FSAL_MAXIOSIZE,
+	.maxwrite = FSAL_MAXIOSIZE,
+	.umask = 0,
+	.auth_exportpath_xdev = false,
+	.xattr_access_rights = 0400,	/* root=RW, owner=R */
+	.link_supports_permission_checks = false,
+};
+
+/* private helper for export object
+ */
+
+struct fsal_staticfsinfo_t *mem_staticinfo(struct fsal_module *hdl)
+{
+	struct mem_fsal_module *myself;
+
+	myself = container_of(hdl, struct mem_fsal_module, fsal);
+	return &myself->fs_info;
+}
+
+/**
+ * @brief Indicate support for extended operations.
+ *
+ * @retval true if extended operations are supported.
+ */
+
+static bool mem_support_ex(struct fsal_obj_handle *obj)
+{
+	return true;
+}
+
+/* Module initialization.
+ * Called by dlopen() to register the module
+ * keep a private pointer to me in myself
+ */
+
+/* my module private storage
+ */
+
+static struct mem_fsal_module MEM;
+
+MODULE_INIT void mem_init(void)
+{
+	int retval;
+	struct fsal_module *myself = &MEM.fsal;
+
+	retval = register_fsal(myself, memname, FSAL_MAJOR_VERSION,
+			       FSAL_MINOR_VERSION, FSAL_ID_NO_PNFS);
+	if (retval != 0) {
+		fprintf(stderr, "MEM module failed to register");
+		return;
+	}
+	myself->m_ops.create_export = mem_create_export;
+	myself->m_ops.support_ex = mem_support_ex;
+
+	/* get a copy of the defaults */
+	MEM.fs_info = default_mem_info;
+	display_fsinfo(&MEM.fs_info);
+}
+
+MODULE_FINI void mem_unload(void)
+{
+	int retval;
+
+	retval = unregister_fsal(&MEM.fsal);
+	if (retval != 0) {
+		fprintf(stderr, "MEM module failed to unregister");
+		return;
+	}
+}
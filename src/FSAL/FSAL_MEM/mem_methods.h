@@ -0,0 +1,200 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* MEM methods for handles
+ *
+ * Everything lives in memory and is lost when the export is released.
+ * Directories index their entries by name and by readdir cookie like
+ * FSAL_PSEUDO, files keep their contents in one buffer.
+ *
+ * Locking: a directory's obj_lock protects its entries, and the link
+ * count and parent of the objects they name.  Shares and the global
+ * openflags of a file are under its obj_lock as in FSAL_VFS.  The
+ * contents and the other attributes of an object are under its
+ * mh_lock, so I/O to a file doesn't serialize against opens and reads
+ * of it run in parallel.  Lock order is directory obj_lock, then the
+ * obj_lock of an entry, then the export's mfe_lock, then mh_lock.
+ */
+
+#include "avltree.h"
+#include "gsh_list.h"
+
+#define MEM_SUPPORTED_ATTRS ((const attrmask_t) (ATTRS_POSIX))
+
+struct mem_fsal_obj_handle;
+
+/*
+ * MEM internal export
+ */
+struct mem_fsal_export {
+	struct fsal_export export;
+	char *export_path;
+	struct mem_fsal_obj_handle *root_handle;
+	/** Changes with each instance, so old handles are stale */
+	uint64_t handle_tag;
+	/** Protects mfe_objs and next_fileid */
+	pthread_rwlock_t mfe_lock;
+	/** Linked objects by fileid, for create_handle */
+	struct avltree mfe_objs;
+	uint64_t next_fileid;
+};
+
+fsal_status_t mem_lookup_path(struct fsal_export *exp_hdl,
+			      const char *path,
+			      struct fsal_obj_handle **handle,
+			      struct attrlist *attrs_out);
+
+fsal_status_t mem_create_handle(struct fsal_export *exp_hdl,
+				struct gsh_buffdesc *hdl_desc,
+				struct fsal_obj_handle **handle,
+				struct attrlist *attrs_out);
+
+void mem_release_objects(struct mem_fsal_export *mfe);
+
+/*
+ * The wire handle, fileid then handle_tag
+ */
+#define MEM_HANDLE_SIZE (2 * sizeof(uint64_t))
+
+/* What a state_t or the global fd of a file has open */
+struct mem_fd {
+	fsal_openflags_t openflags;
+};
+
+struct mem_state_fd {
+	struct state_t state;
+	struct mem_fd mem_fd;
+};
+
+/* A name in a directory, objects have one per link */
+struct mem_dirent {
+	struct avltree_node d_node_n;	/*< In the directory by name */
+	struct avltree_node d_node_i;	/*< In the directory by index */
+	struct mem_fsal_obj_handle *d_obj;
+	uint64_t d_index;
+	char *d_name;
+};
+
+/*
+ * MEM internal object handle
+ */
+struct mem_fsal_obj_handle {
+	struct fsal_obj_handle obj_handle;
+	struct mem_fsal_export *mh_export;
+	struct avltree_node mh_node_k;	/*< In mfe_objs while linked */
+	pthread_rwlock_t mh_lock;
+	struct attrlist attributes;
+	char handle[MEM_HANDLE_SIZE];
+	bool indexed;			/*< In mfe_objs */
+	union {
+		struct {
+			struct mem_fsal_obj_handle *parent;
+			struct avltree avl_name;
+			struct avltree avl_index;
+			uint64_t next_i;	/*< Next entry index */
+		} dir;
+		struct {
+			struct fsal_share share;
+			struct mem_fd fd;	/*< The global fd */
+			char *data;
+			size_t alloc;		/*< Size of data */
+		} file;
+		struct {
+			char *link_contents;
+		} symlink;
+	} mh;
+};
+
+void mem_handle_ops_init(struct fsal_obj_ops *ops);
+void mem_touch(struct attrlist *attrs, bool mtime);
+fsal_status_t mem_open_by_name(struct fsal_obj_handle *dir_hdl,
+			       const char *name,
+			       enum fsal_create_mode createmode,
+			       struct attrlist *attrs_in,
+			       struct mem_fsal_obj_handle **hdl,
+			       bool *created);
+
+/* Internal MEM method linkage to export object
+ */
+
+fsal_status_t mem_create_export(struct fsal_module *fsal_hdl,
+				void *parse_node,
+				struct config_error_type *err_type,
+				const struct fsal_up_vector *up_ops);
+
+struct state_t *mem_alloc_state(struct fsal_export *exp_hdl,
+				enum state_type state_type,
+				struct state_t *related_state);
+
+void mem_free_state(struct fsal_export *exp_hdl, struct state_t *state);
+
+/* I/O management */
+fsal_status_t mem_open2(struct fsal_obj_handle *obj_hdl,
+			struct state_t *state,
+			fsal_openflags_t openflags,
+			enum fsal_create_mode createmode,
+			const char *name,
+			struct attrlist *attrs_in,
+			fsal_verifier_t verifier,
+			struct fsal_obj_handle **new_obj,
+			struct attrlist *attrs_out,
+			bool *caller_perm_check);
+bool mem_check_verifier(struct fsal_obj_handle *obj_hdl,
+			fsal_verifier_t verifier);
+fsal_openflags_t mem_status2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state);
+fsal_status_t mem_reopen2(struct fsal_obj_handle *obj_hdl,
+			  struct state_t *state,
+			  fsal_openflags_t openflags);
+fsal_status_t mem_read2(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			struct state_t *state,
+			uint64_t offset,
+			size_t buffer_size,
+			void *buffer,
+			size_t *read_amount,
+			bool *end_of_file,
+			struct io_info *info);
+fsal_status_t mem_write2(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct state_t *state,
+			 uint64_t offset,
+			 size_t buffer_size,
+			 void *buffer,
+			 size_t *wrote_amount,
+			 bool *fsal_stable,
+			 struct io_info *info);
+fsal_status_t mem_commit2(struct fsal_obj_handle *obj_hdl,
+			  off_t offset,
+			  size_t len);
+fsal_status_t mem_lock_op2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   void *owner,
+			   fsal_lock_op_t lock_op,
+			   fsal_lock_param_t *request_lock,
+			   fsal_lock_param_t *conflicting_lock);
+fsal_status_t mem_setattr2(struct fsal_obj_handle *obj_hdl,
+			   bool bypass,
+			   struct state_t *state,
+			   struct attrlist *attrib_set);
+fsal_status_t mem_close2(struct fsal_obj_handle *obj_hdl,
+			 struct state_t *state);
+fsal_status_t mem_close(struct fsal_obj_handle *obj_hdl);
@@ -50,20 +50,50 @@
 static clientid4 pxy_clientid;
 static pthread_mutex_t pxy_clientid_mutex = PTHREAD_MUTEX_INITIALIZER;
 static char pxy_hostname[MAXNAMLEN + 1];
-static pthread_t pxy_recv_thread;
 static pthread_t pxy_renewer_thread;
-static struct glist_head rpc_calls;
 static struct glist_head free_contexts;
-static int rpc_sock = -1;
 static uint32_t rpc_xid;
 static pthread_mutex_t listlock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t sockless = PTHREAD_COND_INITIALIZER;
 static pthread_cond_t need_context = PTHREAD_COND_INITIALIZER;
 
+/* Calls awaiting a reply are hashed by XID on their connection */
+#define PXY_XID_BUCKETS 64
+
+/*
+ * One TCP connection to the remote server, with its own receiver
+ * thread.  Calls are spread over the connections round robin.
+ */
+struct pxy_rpc_conn {
+	/* Serializes sends, taken before lock */
+	pthread_mutex_t send_lock;
+	/* Protects calls */
+	pthread_mutex_t lock;
+	struct glist_head calls[PXY_XID_BUCKETS];
+	/* -1 while disconnected, only the receiver thread changes it,
+	 * holding both locks */
+	int sock;
+	int index;
+	pthread_t recv_thread;
+	struct pxy_client_params *info;
+};
+
+static struct pxy_rpc_conn *pxy_conns;
+static uint32_t pxy_nconns;
+/* Protected by listlock */
+static uint32_t pxy_conns_up;
+static uint32_t pxy_next_conn;
+
 /*
- * Protects the "free_contexts" list and the "need_context" condition.
+ * Protects the "free_contexts" list, the "need_context" condition and
+ * the count of contexts.
  */
 static pthread_mutex_t context_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t pxy_ctx_count;
+static const struct pxy_client_params *pxy_rpc_params;
+
+/* Contexts allocated up front, more are added up to RPC_Max_Contexts */
+#define PXY_MIN_CONTEXTS 16
 
 /* NB! nfs_prog is just an easy way to get this info into the call
  *     It should really be fetched via export pointer */
@@ -71,6 +101,8 @@ struct pxy_rpc_io_context {
 	pthread_mutex_t iolock;
 	pthread_cond_t iowait;
 	struct glist_head calls;
+	/* On its connection's calls, protected by the connection lock */
+	bool queued;
 	uint32_t rpc_xid;
 	int iodone;
 	int ioresult;
@@ -81,6 +113,9 @@ struct pxy_rpc_io_context {
 	char *recvbuf;
 };
 
+static struct pxy_rpc_io_context *
+pxy_alloc_io_context(const struct pxy_client_params *info);
+
 /* Use this to estimate storage requirements for fattr4 blob */
 struct pxy_fattr_storage {
 	fattr4_type type;
@@ -259,6 +294,22 @@ static struct bitmap4 pxy_bitmap_getattr = {
 	.bitmap4_len = 2
 };
 
+/* Same as getattr, plus the handle so READDIR needs no LOOKUP per entry */
+static struct bitmap4 pxy_bitmap_readdir = {
+	.map[0] =
+	    (PXY_ATTR_BIT(FATTR4_TYPE) | PXY_ATTR_BIT(FATTR4_CHANGE) |
+	     PXY_ATTR_BIT(FATTR4_SIZE) | PXY_ATTR_BIT(FATTR4_FSID) |
+	     PXY_ATTR_BIT(FATTR4_FILEHANDLE) | PXY_ATTR_BIT(FATTR4_FILEID)),
+	.map[1] =
+	    (PXY_ATTR_BIT2(FATTR4_MODE) | PXY_ATTR_BIT2(FATTR4_NUMLINKS) |
+	     PXY_ATTR_BIT2(FATTR4_OWNER) | PXY_ATTR_BIT2(FATTR4_OWNER_GROUP) |
+	     PXY_ATTR_BIT2(FATTR4_SPACE_USED) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_ACCESS) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_METADATA) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_MODIFY) | PXY_ATTR_BIT2(FATTR4_RAWDEV)),
+	.bitmap4_len = 2
+};
+
 static struct bitmap4 pxy_bitmap_fsinfo = {
 	.map[0] =
 	    (PXY_ATTR_BIT(FATTR4_FILES_AVAIL) | PXY_ATTR_BIT(FATTR4_FILES_FREE)
@@ -270,6 +321,11 @@ static struct bitmap4 pxy_bitmap_fsinfo = {
 	.bitmap4_len = 2
 };
 
+static struct bitmap4 change_bits = {
+	.map[0] = PXY_ATTR_BIT(FATTR4_CHANGE),
+	.bitmap4_len = 1
+};
+
 static struct bitmap4 lease_bits = {
 	.map[0] = PXY_ATTR_BIT(FATTR4_LEASE_TIME),
 	.bitmap4_len = 1
@@ -383,7 +439,13 @@ static int pxy_got_rpc_reply(struct pxy_rpc_io_context *ctx, int sock, int sz,
 	return size;
 }
 
-static int pxy_rpc_read_reply(int sock)
+static inline struct glist_head *pxy_xid_bucket(struct pxy_rpc_conn *conn,
+						 uint32_t xid)
+{
+	return &conn->calls[xid % PXY_XID_BUCKETS];
+}
+
+static int pxy_rpc_read_reply(struct pxy_rpc_conn *conn, int sock)
 {
 	struct {
 		uint recmark;
@@ -397,8 +459,8 @@ static int pxy_rpc_read_reply(int sock)
 	while (cnt < 8) {
 		int bc = read(sock, buf + cnt, 8 - cnt);
 
-		if (bc < 0)
-			return -errno;
+		if (bc <= 0)
+			return bc < 0 ? -errno : -ECONNRESET;
 		cnt += bc;
 	}
 
@@ -409,18 +471,19 @@ static int pxy_rpc_read_reply(int sock)
 	LogDebug(COMPONENT_FSAL, "Recmark %x, xid %u\n", h.recmark, h.xid);
 	h.recmark &= ~(1U << 31);
 
-	PTHREAD_MUTEX_lock(&listlock);
-	glist_for_each(c, &rpc_calls) {
+	PTHREAD_MUTEX_lock(&conn->lock);
+	glist_for_each(c, pxy_xid_bucket(conn, h.xid)) {
 		struct pxy_rpc_io_context *ctx =
 		    container_of(c, struct pxy_rpc_io_context, calls);
 
 		if (ctx->rpc_xid == h.xid) {
 			glist_del(c);
-			PTHREAD_MUTEX_unlock(&listlock);
+			ctx->queued = false;
+			PTHREAD_MUTEX_unlock(&conn->lock);
 			return pxy_got_rpc_reply(ctx, sock, h.recmark, h.xid);
 		}
 	}
-	PTHREAD_MUTEX_unlock(&listlock);
+	PTHREAD_MUTEX_unlock(&conn->lock);
 
 	cnt = h.recmark - 4;
 	LogDebug(COMPONENT_FSAL, "xid %u is not on the list, skip %d bytes\n",
@@ -437,28 +500,56 @@ static int pxy_rpc_read_reply(int sock)
 	return 0;
 }
 
-static void pxy_new_socket_ready(void)
+/*
+ * Tell the calls outstanding on a connection that went away to resend,
+ * they will pick another connection if there is one.
+ *
+ * Called with conn->lock held.
+ */
+static void pxy_conn_fail_calls(struct pxy_rpc_conn *conn)
 {
 	struct glist_head *nxt;
 	struct glist_head *c;
+	int i;
 
-	/* If there is anyone waiting for the socket then tell them
-	 * it's ready */
-	pthread_cond_broadcast(&sockless);
+	for (i = 0; i < PXY_XID_BUCKETS; i++) {
+		glist_for_each_safe(c, nxt, &conn->calls[i]) {
+			struct pxy_rpc_io_context *ctx =
+			    container_of(c, struct pxy_rpc_io_context, calls);
 
-	/* If there are any outstanding calls then tell them to resend */
-	glist_for_each_safe(c, nxt, &rpc_calls) {
-		struct pxy_rpc_io_context *ctx =
-		    container_of(c, struct pxy_rpc_io_context, calls);
+			glist_del(c);
+			ctx->queued = false;
+
+			PTHREAD_MUTEX_lock(&ctx->iolock);
+			ctx->iodone = 1;
+			ctx->ioresult = -EAGAIN;
+			pthread_cond_signal(&ctx->iowait);
+			PTHREAD_MUTEX_unlock(&ctx->iolock);
+		}
+	}
+}
 
-		glist_del(c);
+static void pxy_conn_set_sock(struct pxy_rpc_conn *conn, int sock)
+{
+	PTHREAD_MUTEX_lock(&conn->send_lock);
+	PTHREAD_MUTEX_lock(&conn->lock);
+	if (sock < 0)
+		close(conn->sock);
+	conn->sock = sock;
+	pxy_conn_fail_calls(conn);
+	PTHREAD_MUTEX_unlock(&conn->lock);
+	PTHREAD_MUTEX_unlock(&conn->send_lock);
 
-		PTHREAD_MUTEX_lock(&ctx->iolock);
-		ctx->iodone = 1;
-		ctx->ioresult = -EAGAIN;
-		pthread_cond_signal(&ctx->iowait);
-		PTHREAD_MUTEX_unlock(&ctx->iolock);
+	PTHREAD_MUTEX_lock(&listlock);
+	if (sock >= 0) {
+		pxy_conns_up++;
+		/* If there is anyone waiting for a socket then tell them
+		 * it's ready */
+		pthread_cond_broadcast(&sockless);
+	} else {
+		pxy_conns_up--;
 	}
+	PTHREAD_MUTEX_unlock(&listlock);
 }
 
 static int pxy_connect(struct pxy_client_params *info,
@@ -484,21 +575,20 @@ static int pxy_connect(struct pxy_client_params *info,
 		if (connect(sock, (struct sockaddr *)dest, sizeof(*dest)) < 0) {
 			close(sock);
 			sock = -1;
-		} else {
-			pxy_new_socket_ready();
 		}
 	}
 	return sock;
 }
 
 /*
- * NB! rpc_sock can be closed by the sending thread but it will not be
- *     changing its value. Only this function will change rpc_sock which
- *     means that it can look at the value without holding the lock.
+ * NB! A sending thread that fails to write shuts the socket down but
+ *     does not close it.  Only this function changes conn->sock, which
+ *     means that it can look at the value without holding the locks.
  */
 static void *pxy_rpc_recv(void *arg)
 {
-	struct pxy_client_params *info = arg;
+	struct pxy_rpc_conn *conn = arg;
+	struct pxy_client_params *info = conn->info;
 	struct sockaddr_in addr_rpc;
 	struct sockaddr_in *info_sock = (struct sockaddr_in *)&info->srv_addr;
 	char addr[INET_ADDRSTRLEN];
@@ -513,11 +603,11 @@ static void *pxy_rpc_recv(void *arg)
 
 	for (;;) {
 		int nsleeps = 0;
+		int sock;
 
-		PTHREAD_MUTEX_lock(&listlock);
 		do {
-			rpc_sock = pxy_connect(info, &addr_rpc);
-			if (rpc_sock < 0) {
+			sock = pxy_connect(info, &addr_rpc);
+			if (sock < 0) {
 				if (nsleeps == 0)
 					LogCrit(COMPONENT_FSAL,
 						"Cannot connect to server %s:%u",
@@ -526,22 +616,21 @@ static void *pxy_rpc_recv(void *arg)
 							  addr,
 							  sizeof(addr)),
 						info->srv_port);
-				PTHREAD_MUTEX_unlock(&listlock);
 				sleep(info->retry_sleeptime);
 				nsleeps++;
-				PTHREAD_MUTEX_lock(&listlock);
 			} else {
 				LogDebug(COMPONENT_FSAL,
-					 "Connected after %d sleeps, resending outstanding calls",
-					 nsleeps);
+					 "Connection %d up after %d sleeps",
+					 conn->index, nsleeps);
 			}
-		} while (rpc_sock < 0);
-		PTHREAD_MUTEX_unlock(&listlock);
+		} while (sock < 0);
 
-		pfd.fd = rpc_sock;
+		pxy_conn_set_sock(conn, sock);
+
+		pfd.fd = sock;
 		pfd.events = POLLIN | POLLRDHUP;
 
-		while (rpc_sock >= 0) {
+		for (;;) {
 			switch (poll(&pfd, 1, millisec)) {
 			case 0:
 				LogDebug(COMPONENT_FSAL,
@@ -559,17 +648,16 @@ static void *pxy_rpc_recv(void *arg)
 					LogEvent(COMPONENT_FSAL,
 						 "Socket is closed");
 				} else {
-					if (pxy_rpc_read_reply(rpc_sock) >= 0)
+					if (pxy_rpc_read_reply(conn, sock) >= 0)
 						continue;
 				}
 				break;
 			}
 
-			PTHREAD_MUTEX_lock(&listlock);
-			close(rpc_sock);
-			rpc_sock = -1;
-			PTHREAD_MUTEX_unlock(&listlock);
+			break;
 		}
+
+		pxy_conn_set_sock(conn, -1);
 	}
 
 	return NULL;
@@ -663,11 +751,30 @@ static enum clnt_stat pxy_process_reply(struct pxy_rpc_io_context *ctx,
 static void pxy_rpc_need_sock(void)
 {
 	PTHREAD_MUTEX_lock(&listlock);
-	while (rpc_sock < 0)
+	while (pxy_conns_up == 0)
 		pthread_cond_wait(&sockless, &listlock);
 	PTHREAD_MUTEX_unlock(&listlock);
 }
 
+/*
+ * Pick the next connected connection, round robin.
+ */
+static struct pxy_rpc_conn *pxy_rpc_pick_conn(void)
+{
+	uint32_t start = atomic_inc_uint32_t(&pxy_next_conn);
+	uint32_t i;
+
+	for (i = 0; i < pxy_nconns; i++) {
+		struct pxy_rpc_conn *conn =
+			&pxy_conns[(start + i) % pxy_nconns];
+
+		if (conn->sock >= 0)
+			return conn;
+	}
+
+	return NULL;
+}
+
 static int pxy_rpc_renewer_wait(int timeout)
 {
 	struct timespec ts;
@@ -690,10 +797,12 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 	struct rpc_msg rmsg;
 	AUTH *au;
 	enum clnt_stat rc;
+	struct pxy_rpc_conn *conn = pxy_rpc_pick_conn();
 
-	PTHREAD_MUTEX_lock(&listlock);
-	rmsg.rm_xid = rpc_xid++;
-	PTHREAD_MUTEX_unlock(&listlock);
+	if (conn == NULL)
+		return RPC_CANTSEND;
+
+	rmsg.rm_xid = atomic_inc_uint32_t(&rpc_xid);
 	rmsg.rm_direction = CALL;
 
 	rmsg.rm_call.cb_rpcvers = RPC_MSG_VERSION;
@@ -731,32 +840,55 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 			int bc = 0;
 			char *buf = pcontext->sendbuf;
 
-			LogDebug(COMPONENT_FSAL, "%ssend XID %u with %d bytes",
+			LogDebug(COMPONENT_FSAL,
+				 "%ssend XID %u with %d bytes on connection %d",
 				 (first_try ? "First attempt to " : "Re"),
-				 rmsg.rm_xid, pos);
-			PTHREAD_MUTEX_lock(&listlock);
-			while (bc < pos) {
-				int wc = write(rpc_sock, buf, pos - bc);
-
-				if (wc <= 0) {
-					close(rpc_sock);
-					break;
+				 rmsg.rm_xid, pos, conn->index);
+			/* Queue the call before sending it so the reply
+			 * can not overtake it, without holding the calls
+			 * lock while writing so the receiver is not held up.
+			 */
+			PTHREAD_MUTEX_lock(&conn->lock);
+			if (first_try) {
+				PTHREAD_MUTEX_lock(&pcontext->iolock);
+				pcontext->iodone = 0;
+				PTHREAD_MUTEX_unlock(&pcontext->iolock);
+				glist_add_tail(pxy_xid_bucket(conn,
+							      rmsg.rm_xid),
+					       &pcontext->calls);
+				pcontext->queued = true;
+				first_try = 0;
+			} else if (!pcontext->queued) {
+				/* Answered or failed while we timed out */
+				bc = pos;
+			}
+			PTHREAD_MUTEX_unlock(&conn->lock);
+
+			if (bc < pos) {
+				PTHREAD_MUTEX_lock(&conn->send_lock);
+				while (conn->sock >= 0 && bc < pos) {
+					int wc = write(conn->sock, buf,
+						       pos - bc);
+
+					if (wc <= 0) {
+						/* Let the receiver close it */
+						shutdown(conn->sock, SHUT_RDWR);
+						break;
+					}
+					bc += wc;
+					buf += wc;
 				}
-				bc += wc;
-				buf += wc;
+				PTHREAD_MUTEX_unlock(&conn->send_lock);
 			}
 
-			if (bc == pos) {
-				if (first_try) {
-					glist_add_tail(&rpc_calls,
-						       &pcontext->calls);
-					first_try = 0;
-				}
-			} else {
-				if (!first_try)
+			if (bc != pos) {
+				PTHREAD_MUTEX_lock(&conn->lock);
+				if (pcontext->queued) {
 					glist_del(&pcontext->calls);
+					pcontext->queued = false;
+				}
+				PTHREAD_MUTEX_unlock(&conn->lock);
 			}
-			PTHREAD_MUTEX_unlock(&listlock);
 
 			if (bc == pos)
 				rc = pxy_process_reply(pcontext, res);
@@ -771,13 +903,19 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 	return rc;
 }
 
-int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
-			   uint32_t cnt, nfs_argop4 *argoparray,
-			   nfs_resop4 *resoparray)
+/*
+ * Send one COMPOUND as is and wait for its reply.  *rescnt, if not
+ * NULL, is set to the number of results the server returned.
+ */
+static int pxy_compound_send(const char *caller, const struct user_cred *creds,
+			     uint32_t minorversion, uint32_t cnt,
+			     nfs_argop4 *argoparray, nfs_resop4 *resoparray,
+			     uint32_t *rescnt)
 {
 	enum clnt_stat rc;
 	struct pxy_rpc_io_context *ctx;
 	COMPOUND4args arg = {
+		.minorversion = minorversion,
 		.argarray.argarray_val = argoparray,
 		.argarray.argarray_len = cnt
 	};
@@ -787,12 +925,20 @@ int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
 	};
 
 	PTHREAD_MUTEX_lock(&context_lock);
-	while (glist_empty(&free_contexts))
+	while (glist_empty(&free_contexts) &&
+	       pxy_ctx_count >= pxy_rpc_params->max_contexts)
 		pthread_cond_wait(&need_context, &context_lock);
-	ctx =
-	    glist_first_entry(&free_contexts, struct pxy_rpc_io_context, calls);
-	glist_del(&ctx->calls);
-	PTHREAD_MUTEX_unlock(&context_lock);
+	if (glist_empty(&free_contexts)) {
+		/* Grow the pool rather than wait for a context */
+		pxy_ctx_count++;
+		PTHREAD_MUTEX_unlock(&context_lock);
+		ctx = pxy_alloc_io_context(pxy_rpc_params);
+	} else {
+		ctx = glist_first_entry(&free_contexts,
+					struct pxy_rpc_io_context, calls);
+		glist_del(&ctx->calls);
+		PTHREAD_MUTEX_unlock(&context_lock);
+	}
 
 	do {
 		rc = pxy_compoundv4_call(ctx, creds, &arg, &res);
@@ -809,11 +955,224 @@ int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
 	glist_add(&free_contexts, &ctx->calls);
 	PTHREAD_MUTEX_unlock(&context_lock);
 
+	if (rescnt != NULL)
+		*rescnt = rc == RPC_SUCCESS ? res.resarray.resarray_len : 0;
+
 	if (rc == RPC_SUCCESS)
 		return res.status;
 	return rc;
 }
 
+/*
+ * NFSv4.1 session with the remote server.  Every COMPOUND takes a slot
+ * and starts with a SEQUENCE for it.  The renewer thread creates the
+ * session and creates a new one when the server reports it gone.
+ */
+static pthread_mutex_t pxy_session_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pxy_session_cond = PTHREAD_COND_INITIALIZER;
+
+static struct {
+	bool valid;
+	/* Bumped for each new session, slots of an older one are
+	 * ignored when released */
+	uint32_t gen;
+	sessionid4 id;
+	uint32_t nslots;
+	uint32_t maxops;
+	sequenceid4 *seqids;
+	bool *busy;
+} pxy_session;
+
+/* Operations we ask to be allowed per COMPOUND */
+#define PXY_SESSION_MAXOPS 64
+
+/*
+ * Take a free slot and fill in the SEQUENCE for it.  Waits for a slot
+ * and for a session, unless nowait, in which case false is returned
+ * when there is no session.
+ */
+static bool pxy_slot_get(nfs_argop4 *op, uint32_t *slotid, uint32_t *gen,
+			 bool nowait)
+{
+	SEQUENCE4args *sa = &op->nfs_argop4_u.opsequence;
+	uint32_t i = 0;
+
+	PTHREAD_MUTEX_lock(&pxy_session_lock);
+	for (;;) {
+		if (pxy_session.valid) {
+			for (i = 0; i < pxy_session.nslots; i++)
+				if (!pxy_session.busy[i])
+					break;
+			if (i < pxy_session.nslots)
+				break;
+		} else if (nowait) {
+			PTHREAD_MUTEX_unlock(&pxy_session_lock);
+			return false;
+		}
+		pthread_cond_wait(&pxy_session_cond, &pxy_session_lock);
+	}
+
+	pxy_session.busy[i] = true;
+
+	op->argop = NFS4_OP_SEQUENCE;
+	memcpy(sa->sa_sessionid, pxy_session.id, NFS4_SESSIONID_SIZE);
+	sa->sa_sequenceid = pxy_session.seqids[i];
+	sa->sa_slotid = i;
+	sa->sa_highest_slotid = pxy_session.nslots - 1;
+	sa->sa_cachethis = false;
+
+	*slotid = i;
+	*gen = pxy_session.gen;
+	PTHREAD_MUTEX_unlock(&pxy_session_lock);
+	return true;
+}
+
+/*
+ * Release a slot.  advance is set once the server has seen the
+ * SEQUENCE, or may have.  invalidate marks the session gone and wakes
+ * the renewer to create a new one.
+ */
+static void pxy_slot_put(uint32_t slotid, uint32_t gen, bool advance,
+			 bool invalidate)
+{
+	PTHREAD_MUTEX_lock(&pxy_session_lock);
+	if (gen != pxy_session.gen) {
+		/* Slot of a session already replaced */
+		invalidate = false;
+	} else {
+		if (advance)
+			pxy_session.seqids[slotid]++;
+		pxy_session.busy[slotid] = false;
+		/* Only the first to notice reports it */
+		invalidate = invalidate && pxy_session.valid;
+		if (invalidate)
+			pxy_session.valid = false;
+	}
+	pthread_cond_broadcast(&pxy_session_cond);
+	PTHREAD_MUTEX_unlock(&pxy_session_lock);
+
+	if (invalidate) {
+		LogEvent(COMPONENT_FSAL,
+			 "Session with the remote server lost, creating a new one");
+		PTHREAD_MUTEX_lock(&listlock);
+		pthread_cond_broadcast(&sockless);
+		PTHREAD_MUTEX_unlock(&listlock);
+	}
+}
+
+static void pxy_session_install(const sessionid4 id, uint32_t nslots,
+				uint32_t maxops)
+{
+	uint32_t i;
+
+	PTHREAD_MUTEX_lock(&pxy_session_lock);
+	gsh_free(pxy_session.seqids);
+	gsh_free(pxy_session.busy);
+	pxy_session.seqids = gsh_malloc(nslots * sizeof(sequenceid4));
+	pxy_session.busy = gsh_calloc(nslots, sizeof(bool));
+	for (i = 0; i < nslots; i++)
+		pxy_session.seqids[i] = 1;
+	memcpy(pxy_session.id, id, NFS4_SESSIONID_SIZE);
+	pxy_session.nslots = nslots;
+	pxy_session.maxops = maxops;
+	pxy_session.gen++;
+	pxy_session.valid = true;
+	pthread_cond_broadcast(&pxy_session_cond);
+	PTHREAD_MUTEX_unlock(&pxy_session_lock);
+}
+
+/*
+ * Send a COMPOUND, inside the session if the remote server is spoken
+ * to in NFSv4.1.  *rescnt, if not NULL, is set to the number of the
+ * caller's operations the server returned results for.
+ */
+static int pxy_compound_execute(const char *caller,
+				const struct user_cred *creds,
+				uint32_t cnt, nfs_argop4 *argoparray,
+				nfs_resop4 *resoparray, uint32_t *rescnt,
+				bool nowait)
+{
+	nfs_argop4 *args;
+	nfs_resop4 *res;
+	uint32_t n = 0;
+	int rc;
+
+	if (pxy_rpc_params->minorversion == 0)
+		return pxy_compound_send(caller, creds, 0, cnt, argoparray,
+					 resoparray, rescnt);
+
+	args = gsh_malloc((cnt + 1) * sizeof(*args));
+	res = gsh_malloc((cnt + 1) * sizeof(*res));
+	memcpy(args + 1, argoparray, cnt * sizeof(*args));
+
+	for (;;) {
+		SEQUENCE4res *seq = &res[0].nfs_resop4_u.opsequence;
+		uint32_t slotid, gen;
+
+		if (!pxy_slot_get(&args[0], &slotid, &gen, nowait)) {
+			rc = NFS4ERR_BADSESSION;
+			break;
+		}
+
+		/* The caller may have pointed results at its buffers */
+		memcpy(res + 1, resoparray, cnt * sizeof(*res));
+		res[0].resop = NFS4_OP_SEQUENCE;
+		seq->sr_status = NFS4ERR_SERVERFAULT;
+
+		n = 0;
+		rc = pxy_compound_send(caller, creds, 1, cnt + 1, args, res,
+				       &n);
+
+		if (n == 0) {
+			/* No telling whether the server saw the SEQUENCE,
+			 * advance so the slot is not reused for a replay.
+			 * Should it not have, the session gets recreated.
+			 */
+			pxy_slot_put(slotid, gen, true, false);
+			break;
+		}
+
+		if (seq->sr_status == NFS4_OK) {
+			pxy_slot_put(slotid, gen, true, false);
+			memcpy(resoparray, res + 1, cnt * sizeof(*res));
+			n--;
+			break;
+		}
+
+		switch (seq->sr_status) {
+		case NFS4ERR_BADSESSION:
+		case NFS4ERR_DEADSESSION:
+		case NFS4ERR_SEQ_MISORDERED:
+		case NFS4ERR_STALE_CLIENTID:
+		case NFS4ERR_EXPIRED:
+			/* Retry once there is a new session */
+			pxy_slot_put(slotid, gen, false, true);
+			if (!nowait)
+				continue;
+			break;
+		default:
+			pxy_slot_put(slotid, gen, false, false);
+			break;
+		}
+		n = 0;
+		break;
+	}
+
+	if (rescnt != NULL)
+		*rescnt = n;
+	gsh_free(args);
+	gsh_free(res);
+	return rc;
+}
+
+int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
+			   uint32_t cnt, nfs_argop4 *argoparray,
+			   nfs_resop4 *resoparray)
+{
+	return pxy_compound_execute(caller, creds, cnt, argoparray,
+				    resoparray, NULL, false);
+}
+
 #define pxy_nfsv4_call(exp, creds, cnt, args, resp) \
 	pxy_compoundv4_execute(__func__, creds, cnt, args, resp)
 
@@ -824,31 +1183,62 @@ void pxy_get_clientid(clientid4 *ret)
 	PTHREAD_MUTEX_unlock(&pxy_clientid_mutex);
 }
 
-static int pxy_setclientid(clientid4 *resultclientid, uint32_t *lease_time)
+static void pxy_get_lease_time(uint32_t *lease_time)
 {
 	int rc;
 	int opcnt = 0;
-#define FSAL_CLIENTID_NB_OP_ALLOC 2
-	nfs_argop4 arg[FSAL_CLIENTID_NB_OP_ALLOC];
-	nfs_resop4 res[FSAL_CLIENTID_NB_OP_ALLOC];
+	nfs_argop4 arg[2];
+	nfs_resop4 res[2];
+
+	COMPOUNDV4_ARG_ADD_OP_PUTROOTFH(opcnt, arg);
+	pxy_fill_getattr_reply(res + opcnt, (char *)lease_time,
+			       sizeof(*lease_time));
+	COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, arg, lease_bits);
+
+	rc = pxy_compoundv4_execute(__func__, NULL, opcnt, arg, res);
+	if (rc != NFS4_OK)
+		*lease_time = 60;
+	else
+		*lease_time = ntohl(*lease_time);
+}
+
+static int pxy_owner_name(char *name, size_t len)
+{
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	char addrbuf[sizeof("255.255.255.255")];
+	struct pxy_rpc_conn *conn = pxy_rpc_pick_conn();
+
+	if (conn == NULL)
+		return -ENOTCONN;
+
+	if (getsockname(conn->sock, &sin, &slen))
+		return -errno;
+
+	snprintf(name, len, "%s(%d) - GANESHA NFSv4 Proxy",
+		 inet_ntop(AF_INET, &sin.sin_addr, addrbuf, sizeof(addrbuf)),
+		 getpid());
+	return 0;
+}
+
+static int pxy_setclientid(clientid4 *resultclientid, uint32_t *lease_time)
+{
+	int rc;
+	nfs_argop4 arg[1];
+	nfs_resop4 res[1];
 	nfs_client_id4 nfsclientid;
 	uint64_t temp_verifier;
 	cb_client4 cbproxy;
 	char clientid_name[MAXNAMLEN + 1];
 	SETCLIENTID4resok *sok;
-	struct sockaddr_in sin;
-	socklen_t slen = sizeof(sin);
-	char addrbuf[sizeof("255.255.255.255")];
 
 	LogEvent(COMPONENT_FSAL,
 		 "Negotiating a new ClientId with the remote server");
 
-	if (getsockname(rpc_sock, &sin, &slen))
-		return -errno;
+	rc = pxy_owner_name(clientid_name, MAXNAMLEN);
+	if (rc)
+		return rc;
 
-	snprintf(clientid_name, MAXNAMLEN, "%s(%d) - GANESHA NFSv4 Proxy",
-		 inet_ntop(AF_INET, &sin.sin_addr, addrbuf, sizeof(addrbuf)),
-		 getpid());
 	nfsclientid.id.id_len = strlen(clientid_name);
 	nfsclientid.id.id_val = clientid_name;
 
@@ -883,22 +1273,131 @@ static int pxy_setclientid(clientid4 *resultclientid, uint32_t *lease_time)
 	/* Keep the confirmed client id */
 	*resultclientid = arg[0].nfs_argop4_u.opsetclientid_confirm.clientid;
 
-	/* Get the lease time */
-	opcnt = 0;
-	COMPOUNDV4_ARG_ADD_OP_PUTROOTFH(opcnt, arg);
-	pxy_fill_getattr_reply(res + opcnt, (char *)lease_time,
-			       sizeof(*lease_time));
-	COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, arg, lease_bits);
+	pxy_get_lease_time(lease_time);
+	return 0;
+}
 
-	rc = pxy_compoundv4_execute(__func__, NULL, opcnt, arg, res);
+/*
+ * NFSv4.1 counterpart of pxy_setclientid: EXCHANGE_ID, CREATE_SESSION
+ * and RECLAIM_COMPLETE, leaving the new session in use.
+ */
+static int pxy_create_session(clientid4 *resultclientid, uint32_t *lease_time)
+{
+	int rc;
+	nfs_argop4 arg;
+	nfs_resop4 res;
+	EXCHANGE_ID4args *eia = &arg.nfs_argop4_u.opexchange_id;
+	CREATE_SESSION4args *csa = &arg.nfs_argop4_u.opcreate_session;
+	CREATE_SESSION4resok *csr;
+	callback_sec_parms4 cbsec;
+	char owner[MAXNAMLEN + 1];
+	uint64_t temp_verifier;
+	clientid4 clientid = 0;
+	sequenceid4 sequence = 0;
+	uint32_t nslots = 0, maxops;
+
+	LogEvent(COMPONENT_FSAL,
+		 "Negotiating a new session with the remote server");
+
+	rc = pxy_owner_name(owner, MAXNAMLEN);
+	if (rc)
+		return rc;
+
+	memset(&arg, 0, sizeof(arg));
+	memset(&res, 0, sizeof(res));
+	arg.argop = NFS4_OP_EXCHANGE_ID;
+	eia->eia_clientowner.co_ownerid.co_ownerid_len = strlen(owner);
+	eia->eia_clientowner.co_ownerid.co_ownerid_val = owner;
+	temp_verifier = (uint64_t)ServerBootTime.tv_sec;
+	BUILD_BUG_ON(sizeof(eia->eia_clientowner.co_verifier) !=
+		     sizeof(uint64_t));
+	memcpy(&eia->eia_clientowner.co_verifier, &temp_verifier,
+	       sizeof(uint64_t));
+	eia->eia_flags = EXCHGID4_FLAG_USE_NON_PNFS;
+	eia->eia_state_protect.spa_how = SP4_NONE;
+
+	rc = pxy_compound_send(__func__, NULL, 1, 1, &arg, &res, NULL);
+	if (rc == NFS4_OK) {
+		clientid = res.nfs_resop4_u.opexchange_id.EXCHANGE_ID4res_u.
+				eir_resok4.eir_clientid;
+		sequence = res.nfs_resop4_u.opexchange_id.EXCHANGE_ID4res_u.
+				eir_resok4.eir_sequenceid;
+	}
+	xdr_free((xdrproc_t) xdr_EXCHANGE_ID4res,
+		 &res.nfs_resop4_u.opexchange_id);
 	if (rc != NFS4_OK)
-		*lease_time = 60;
-	else
-		*lease_time = ntohl(*lease_time);
+		return -1;
+
+	memset(&arg, 0, sizeof(arg));
+	memset(&res, 0, sizeof(res));
+	memset(&cbsec, 0, sizeof(cbsec));
+	cbsec.cb_secflavor = AUTH_NONE;
+
+	arg.argop = NFS4_OP_CREATE_SESSION;
+	csa->csa_clientid = clientid;
+	csa->csa_sequence = sequence;
+	csa->csa_fore_chan_attrs.ca_maxrequestsize =
+		pxy_rpc_params->srv_sendsize;
+	csa->csa_fore_chan_attrs.ca_maxresponsesize =
+		pxy_rpc_params->srv_recvsize;
+	csa->csa_fore_chan_attrs.ca_maxresponsesize_cached = 4096;
+	csa->csa_fore_chan_attrs.ca_maxoperations = PXY_SESSION_MAXOPS;
+	csa->csa_fore_chan_attrs.ca_maxrequests =
+		pxy_rpc_params->session_slots;
+	csa->csa_back_chan_attrs.ca_maxrequestsize = 4096;
+	csa->csa_back_chan_attrs.ca_maxresponsesize = 4096;
+	csa->csa_back_chan_attrs.ca_maxoperations = 2;
+	csa->csa_back_chan_attrs.ca_maxrequests = 1;
+	csa->csa_cb_program = 0;
+	csa->csa_sec_parms.csa_sec_parms_len = 1;
+	csa->csa_sec_parms.csa_sec_parms_val = &cbsec;
+
+	rc = pxy_compound_send(__func__, NULL, 1, 1, &arg, &res, NULL);
+	csr = &res.nfs_resop4_u.opcreate_session.CREATE_SESSION4res_u.
+			csr_resok4;
+	if (rc == NFS4_OK) {
+		nslots = MIN(pxy_rpc_params->session_slots,
+			     csr->csr_fore_chan_attrs.ca_maxrequests);
+		maxops = MIN(PXY_SESSION_MAXOPS,
+			     csr->csr_fore_chan_attrs.ca_maxoperations);
+		if (nslots == 0)
+			nslots = 1;
+		pxy_session_install(csr->csr_sessionid, nslots, maxops);
+	}
+	xdr_free((xdrproc_t) xdr_CREATE_SESSION4res,
+		 &res.nfs_resop4_u.opcreate_session);
+	if (rc != NFS4_OK)
+		return -1;
+
+	*resultclientid = clientid;
+
+	arg.argop = NFS4_OP_RECLAIM_COMPLETE;
+	arg.nfs_argop4_u.opreclaim_complete.rca_one_fs = false;
+	rc = pxy_compoundv4_execute(__func__, NULL, 1, &arg, &res);
+	if (rc != NFS4_OK && rc != NFS4ERR_COMPLETE_ALREADY)
+		LogDebug(COMPONENT_FSAL, "RECLAIM_COMPLETE failed with %d",
+			 rc);
 
+	LogDebug(COMPONENT_FSAL, "Created session with %" PRIu32 " slots",
+		 nslots);
+
+	pxy_get_lease_time(lease_time);
 	return 0;
 }
 
+/*
+ * A SEQUENCE on its own renews the lease of a session.  Returns
+ * NFS4_OK if the session is still good.
+ */
+static int pxy_session_ping(void)
+{
+	nfs_argop4 arg;
+	nfs_resop4 res;
+
+	return pxy_compound_execute(__func__, NULL, 0, &arg, &res, NULL,
+				    true);
+}
+
 static void *pxy_clientid_renewer(void *Arg)
 {
 	int rc;
@@ -910,7 +1409,18 @@ static void *pxy_clientid_renewer(void *Arg)
 	while (1) {
 		clientid4 newcid = 0;
 
-		if (!needed && pxy_rpc_renewer_wait(lease_time - 5)) {
+		if (!needed && pxy_rpc_params->minorversion != 0) {
+			/* Renew with a bare SEQUENCE.  After a reconnect
+			 * the session usually survives, so try it before
+			 * creating a new one.
+			 */
+			pxy_rpc_renewer_wait(lease_time - 5);
+			rc = pxy_session_ping();
+			if (rc == NFS4_OK) {
+				LogDebug(COMPONENT_FSAL, "Renewed session");
+				continue;
+			}
+		} else if (!needed && pxy_rpc_renewer_wait(lease_time - 5)) {
 			/* Simply renew the client id you've got */
 			LogDebug(COMPONENT_FSAL, "Renewing client id %" PRIx64,
 				 pxy_clientid);
@@ -930,7 +1440,10 @@ static void *pxy_clientid_renewer(void *Arg)
 		 * reconnected and we need new client id */
 		LogDebug(COMPONENT_FSAL, "Need %d new client id", needed);
 		pxy_rpc_need_sock();
-		needed = pxy_setclientid(&newcid, &lease_time);
+		if (pxy_rpc_params->minorversion != 0)
+			needed = pxy_create_session(&newcid, &lease_time);
+		else
+			needed = pxy_setclientid(&newcid, &lease_time);
 		if (!needed) {
 			PTHREAD_MUTEX_lock(&pxy_clientid_mutex);
 			pxy_clientid = newcid;
@@ -940,6 +1453,25 @@ static void *pxy_clientid_renewer(void *Arg)
 	return NULL;
 }
 
+static struct pxy_rpc_io_context *
+pxy_alloc_io_context(const struct pxy_client_params *info)
+{
+	struct pxy_rpc_io_context *c =
+	    gsh_malloc(sizeof(*c) + info->srv_sendsize + info->srv_recvsize);
+
+	PTHREAD_MUTEX_init(&c->iolock, NULL);
+	PTHREAD_COND_init(&c->iowait, NULL);
+	c->queued = false;
+	c->iodone = 0;
+	c->nfs_prog = info->srv_prognum;
+	c->sendbuf_sz = info->srv_sendsize;
+	c->recvbuf_sz = info->srv_recvsize;
+	c->sendbuf = (char *)(c + 1);
+	c->recvbuf = c->sendbuf + c->sendbuf_sz;
+
+	return c;
+}
+
 static void free_io_contexts(void)
 {
 	struct glist_head *cur, *n;
@@ -956,10 +1488,11 @@ static void free_io_contexts(void)
 int pxy_init_rpc(const struct pxy_fsal_module *pm)
 {
 	int rc;
-	int i = 16;
+	int i;
+	uint32_t n;
 
-	glist_init(&rpc_calls);
 	glist_init(&free_contexts);
+	pxy_rpc_params = &pm->special;
 
 /**
  * @todo this lock is not really necessary so long as we can
@@ -975,33 +1508,42 @@ int pxy_init_rpc(const struct pxy_fsal_module *pm)
 		strncpy(pxy_hostname, "NFS-GANESHA/Proxy",
 			sizeof(pxy_hostname));
 
-	for (i = 16; i > 0; i--) {
+	for (i = PXY_MIN_CONTEXTS; i > 0; i--) {
 		struct pxy_rpc_io_context *c =
-		    gsh_malloc(sizeof(*c) + pm->special.srv_sendsize +
-			       pm->special.srv_recvsize);
-		if (!c) {
-			free_io_contexts();
-			return ENOMEM;
-		}
-		PTHREAD_MUTEX_init(&c->iolock, NULL);
-		PTHREAD_COND_init(&c->iowait, NULL);
-		c->nfs_prog = pm->special.srv_prognum;
-		c->sendbuf_sz = pm->special.srv_sendsize;
-		c->recvbuf_sz = pm->special.srv_recvsize;
-		c->sendbuf = (char *)(c + 1);
-		c->recvbuf = c->sendbuf + c->sendbuf_sz;
+			pxy_alloc_io_context(&pm->special);
 
 		glist_add(&free_contexts, &c->calls);
+		pxy_ctx_count++;
 	}
 
-	rc = pthread_create(&pxy_recv_thread, NULL, pxy_rpc_recv,
-			    (void *)&pm->special);
-	if (rc) {
-		LogCrit(COMPONENT_FSAL,
-			"Cannot create proxy rpc receiver thread - %s",
-			strerror(rc));
-		free_io_contexts();
-		return rc;
+	pxy_nconns = pm->special.num_connections;
+	pxy_conns = gsh_calloc(pxy_nconns, sizeof(*pxy_conns));
+
+	for (n = 0; n < pxy_nconns; n++) {
+		struct pxy_rpc_conn *conn = &pxy_conns[n];
+
+		PTHREAD_MUTEX_init(&conn->send_lock, NULL);
+		PTHREAD_MUTEX_init(&conn->lock, NULL);
+		for (i = 0; i < PXY_XID_BUCKETS; i++)
+			glist_init(&conn->calls[i]);
+		conn->sock = -1;
+		conn->index = n;
+		conn->info = (struct pxy_client_params *)&pm->special;
+
+		rc = pthread_create(&conn->recv_thread, NULL, pxy_rpc_recv,
+				    conn);
+		if (rc) {
+			LogCrit(COMPONENT_FSAL,
+				"Cannot create proxy rpc receiver thread - %s",
+				strerror(rc));
+			/* Receivers already started keep their slots */
+			if (n == 0) {
+				free_io_contexts();
+				return rc;
+			}
+			pxy_nconns = n;
+			break;
+		}
 	}
 
 	rc = pthread_create(&pxy_renewer_thread, NULL, pxy_clientid_renewer,
@@ -1591,6 +2133,42 @@ static bool xdr_readdirres(XDR *x, nfs_resop4 *rdres)
 	return xdr_nfs_resop4(x, rdres) && xdr_nfs_resop4(x, rdres + 1);
 }
 
+/*
+ * Build the name, handle and attributes of a READDIR entry.  The handle
+ * comes from the entry's attributes; a server that does not return
+ * FATTR4_FILEHANDLE costs a LOOKUP.
+ */
+static fsal_status_t pxy_readdir_entry(struct pxy_obj_handle *ph, entry4 *e4,
+				       char *name,
+				       struct fsal_obj_handle **handle,
+				       struct attrlist *attrs)
+{
+	char fhbuf[NFS4_FHSIZE];
+	nfs_fh4 fh = { .nfs_fh4_len = 0, .nfs_fh4_val = fhbuf };
+	fsal_status_t st;
+
+	/* UTF8 name does not include trailing 0 */
+	if (e4->name.utf8string_len > MAXNAMLEN)
+		return fsalstat(ERR_FSAL_SERVERFAULT, E2BIG);
+	memcpy(name, e4->name.utf8string_val, e4->name.utf8string_len);
+	name[e4->name.utf8string_len] = '\0';
+
+	if (nfs4_Fattr_To_FSAL_attr_fh(attrs, &e4->attrs, &fh))
+		return fsalstat(ERR_FSAL_FAULT, 0);
+
+	if (fh.nfs_fh4_len != 0)
+		st = pxy_make_object(op_ctx->fsal_export, &e4->attrs, &fh,
+				     handle, NULL);
+	else
+		st = pxy_lookup_impl(&ph->obj, op_ctx->fsal_export,
+				     op_ctx->creds, name, handle, NULL);
+
+	if (FSAL_IS_ERROR(st))
+		fsal_release_attrs(attrs);
+
+	return st;
+}
+
 /*
  * Trying to guess how many entries can fit into a readdir buffer
  * is complicated and usually results in either gross over-allocation
@@ -1616,7 +2194,7 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 	rdok = &resoparray[opcnt].nfs_resop4_u.opreaddir.READDIR4res_u.resok4;
 	rdok->reply.entries = NULL;
 	COMPOUNDV4_ARG_ADD_OP_READDIR(opcnt, argoparray, *cookie,
-				      pxy_bitmap_getattr);
+				      pxy_bitmap_readdir);
 
 	rc = pxy_nfsv4_call(ph->obj.export, op_ctx->creds, opcnt, argoparray,
 			    resoparray);
@@ -1631,27 +2209,12 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 		struct fsal_obj_handle *handle;
 		enum fsal_dir_result cb_rc;
 
-		/* UTF8 name does not include trailing 0 */
-		if (e4->name.utf8string_len > sizeof(name) - 1)
-			return fsalstat(ERR_FSAL_SERVERFAULT, E2BIG);
-		memcpy(name, e4->name.utf8string_val, e4->name.utf8string_len);
-		name[e4->name.utf8string_len] = '\0';
-
-		if (nfs4_Fattr_To_FSAL_attr(&attrs, &e4->attrs, NULL))
-			return fsalstat(ERR_FSAL_FAULT, 0);
-
-		*cookie = e4->cookie;
-
-		/** @todo FSF: this could be handled by getting handle as part
-		 *             of readdir attributes. However, if acl is
-		 *             requested, we might get it separately to
-		 *             avoid over large READDIR response.
-		 */
-		st = pxy_lookup_impl(&ph->obj, op_ctx->fsal_export,
-				     op_ctx->creds, name, &handle, NULL);
+		st = pxy_readdir_entry(ph, e4, name, &handle, &attrs);
 		if (FSAL_IS_ERROR(st))
 			break;
 
+		*cookie = e4->cookie;
+
 		cb_rc = cb(name, handle, &attrs, cbarg, e4->cookie, NULL);
 
 		fsal_release_attrs(&attrs);
@@ -1664,6 +2227,80 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 	return st;
 }
 
+/*
+ * Bulk readdir: one READDIR with handles and attributes fills up to
+ * *nents entries.  Entries the server sent past that are dropped and
+ * read again from the last returned cookie on the next call.
+ */
+static fsal_status_t pxy_readdir_plus(struct fsal_obj_handle *dir_hdl,
+				      fsal_cookie_t *whence,
+				      attrmask_t attrmask,
+				      struct fsal_readdir_ent *ents,
+				      uint32_t *nents, bool *eof)
+{
+	uint32_t opcnt = 0;
+	uint32_t max = *nents, n = 0;
+	int rc;
+	entry4 *e4;
+	nfs_argop4 argoparray[FSAL_READDIR_NB_OP_ALLOC];
+	nfs_resop4 resoparray[FSAL_READDIR_NB_OP_ALLOC];
+	READDIR4resok *rdok;
+	struct pxy_obj_handle *ph;
+	nfs_cookie4 cookie = 0;
+	fsal_status_t st = { ERR_FSAL_NO_ERROR, 0 };
+
+	*nents = 0;
+
+	if (whence)
+		cookie = (nfs_cookie4) *whence;
+
+	ph = container_of(dir_hdl, struct pxy_obj_handle, obj);
+
+	COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, ph->fh4);
+	rdok = &resoparray[opcnt].nfs_resop4_u.opreaddir.READDIR4res_u.resok4;
+	rdok->reply.entries = NULL;
+	COMPOUNDV4_ARG_ADD_OP_READDIR(opcnt, argoparray, cookie,
+				      pxy_bitmap_readdir);
+
+	rc = pxy_nfsv4_call(ph->obj.export, op_ctx->creds, opcnt, argoparray,
+			    resoparray);
+	if (rc != NFS4_OK)
+		return nfsstat4_to_fsal(rc);
+
+	*eof = rdok->reply.eof;
+
+	for (e4 = rdok->reply.entries; e4; e4 = e4->nextentry) {
+		char name[MAXNAMLEN + 1];
+
+		if (n == max) {
+			*eof = false;
+			break;
+		}
+
+		st = pxy_readdir_entry(ph, e4, name, &ents[n].obj,
+				       &ents[n].attrs);
+		if (FSAL_IS_ERROR(st))
+			break;
+
+		ents[n].name = gsh_strdup(name);
+		ents[n].cookie = e4->cookie;
+		n++;
+	}
+	xdr_free((xdrproc_t) xdr_readdirres, resoparray);
+
+	if (FSAL_IS_ERROR(st)) {
+		while (n-- > 0) {
+			ents[n].obj->obj_ops.release(ents[n].obj);
+			fsal_release_attrs(&ents[n].attrs);
+			gsh_free(ents[n].name);
+		}
+		return st;
+	}
+
+	*nents = n;
+	return st;
+}
+
 /* What to do about verifier if server needs one? */
 static fsal_status_t pxy_readdir(struct fsal_obj_handle *dir_hdl,
 				 fsal_cookie_t *whence, void *cbarg,
@@ -1716,6 +2353,179 @@ static fsal_status_t pxy_rename(struct fsal_obj_handle *obj_hdl,
 	return nfsstat4_to_fsal(rc);
 }
 
+/*
+ * GETATTRs issued close together are sent as one COMPOUND of PUTFH and
+ * GETATTR pairs.  The first caller to queue leads: it waits for up to
+ * Getattr_Batch_Window for others, takes those with the same
+ * credentials and hands the rest to the next leader.
+ */
+struct pxy_getattr_req {
+	struct glist_head list;
+	const struct user_cred *creds;
+	nfs_fh4 *fh4;
+	char *blob;
+	nfs_resop4 *res;
+	int status;
+	bool lead;
+	bool done;
+	/* The COMPOUND stopped before reaching this request */
+	bool retry;
+};
+
+static pthread_mutex_t pxy_getattr_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pxy_getattr_cond = PTHREAD_COND_INITIALIZER;
+static struct glist_head pxy_getattr_queue = {
+	&pxy_getattr_queue, &pxy_getattr_queue
+};
+static uint32_t pxy_getattr_queued;
+static bool pxy_getattr_leading;
+
+static bool pxy_same_creds(const struct user_cred *a,
+			   const struct user_cred *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	return a->caller_uid == b->caller_uid &&
+	       a->caller_gid == b->caller_gid &&
+	       a->caller_glen == b->caller_glen &&
+	       (a->caller_glen == 0 ||
+		memcmp(a->caller_garray, b->caller_garray,
+		       a->caller_glen * sizeof(gid_t)) == 0);
+}
+
+static void pxy_getattr_lead(struct pxy_getattr_req *req)
+{
+	struct pxy_getattr_req **batch;
+	struct glist_head *glist, *glistn;
+	nfs_argop4 *args;
+	nfs_resop4 *res;
+	struct timespec deadline;
+	uint32_t max = pxy_rpc_params->getattr_batch_max;
+	uint32_t n = 0, opcnt = 0, cnt = 0, i;
+	int rc;
+
+	if (pxy_rpc_params->minorversion != 0) {
+		/* Leave room for the SEQUENCE */
+		PTHREAD_MUTEX_lock(&pxy_session_lock);
+		if (pxy_session.maxops > 1)
+			max = MIN(max, (pxy_session.maxops - 1) / 2);
+		PTHREAD_MUTEX_unlock(&pxy_session_lock);
+		if (max == 0)
+			max = 1;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += pxy_rpc_params->getattr_batch_window * 1000;
+	deadline.tv_sec += deadline.tv_nsec / 1000000000;
+	deadline.tv_nsec %= 1000000000;
+
+	while (pxy_getattr_queued < max &&
+	       pthread_cond_timedwait(&pxy_getattr_cond, &pxy_getattr_lock,
+				      &deadline) != ETIMEDOUT)
+		;
+
+	batch = gsh_malloc(max * sizeof(*batch));
+	glist_del(&req->list);
+	pxy_getattr_queued--;
+	batch[n++] = req;
+
+	glist_for_each_safe(glist, glistn, &pxy_getattr_queue) {
+		struct pxy_getattr_req *r =
+			glist_entry(glist, struct pxy_getattr_req, list);
+
+		if (n == max)
+			break;
+		if (!pxy_same_creds(r->creds, req->creds))
+			continue;
+		glist_del(&r->list);
+		pxy_getattr_queued--;
+		batch[n++] = r;
+	}
+
+	if (glist_empty(&pxy_getattr_queue)) {
+		pxy_getattr_leading = false;
+	} else {
+		glist_first_entry(&pxy_getattr_queue, struct pxy_getattr_req,
+				  list)->lead = true;
+		pthread_cond_broadcast(&pxy_getattr_cond);
+	}
+	PTHREAD_MUTEX_unlock(&pxy_getattr_lock);
+
+	args = gsh_malloc(2 * n * sizeof(*args));
+	res = gsh_malloc(2 * n * sizeof(*res));
+	for (i = 0; i < n; i++) {
+		COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, args, *batch[i]->fh4);
+		pxy_fill_getattr_reply(res + opcnt, batch[i]->blob,
+				       FATTR_BLOB_SZ);
+		COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, args, pxy_bitmap_getattr);
+	}
+
+	rc = pxy_compound_execute(__func__, req->creds, opcnt, args, res,
+				  &cnt, false);
+
+	PTHREAD_MUTEX_lock(&pxy_getattr_lock);
+	for (i = 0; i < n; i++) {
+		struct pxy_getattr_req *r = batch[i];
+
+		if (cnt >= 2 * i + 2) {
+			*r->res = res[2 * i + 1];
+			r->status = r->res->nfs_resop4_u.opgetattr.status;
+		} else if (cnt == 2 * i + 1) {
+			r->status = res[2 * i].nfs_resop4_u.opputfh.status;
+		} else if (cnt > 0) {
+			r->retry = true;
+		} else {
+			r->status = rc;
+		}
+		r->done = true;
+	}
+	pthread_cond_broadcast(&pxy_getattr_cond);
+	PTHREAD_MUTEX_unlock(&pxy_getattr_lock);
+
+	gsh_free(batch);
+	gsh_free(args);
+	gsh_free(res);
+}
+
+/*
+ * Queue a GETATTR for batching.  Returns false if it has to be sent on
+ * its own, otherwise *rc holds its status and *res its reply.
+ */
+static bool pxy_getattr_batched(struct pxy_obj_handle *ph, char *blob,
+				nfs_resop4 *res, int *rc)
+{
+	struct pxy_getattr_req req = {
+		.creds = op_ctx->creds,
+		.fh4 = &ph->fh4,
+		.blob = blob,
+		.res = res,
+	};
+
+	PTHREAD_MUTEX_lock(&pxy_getattr_lock);
+	glist_add_tail(&pxy_getattr_queue, &req.list);
+	if (++pxy_getattr_queued >= pxy_rpc_params->getattr_batch_max)
+		pthread_cond_broadcast(&pxy_getattr_cond);
+	if (!pxy_getattr_leading) {
+		pxy_getattr_leading = true;
+		req.lead = true;
+	}
+
+	while (!req.done && !req.lead)
+		pthread_cond_wait(&pxy_getattr_cond, &pxy_getattr_lock);
+
+	if (req.done)
+		PTHREAD_MUTEX_unlock(&pxy_getattr_lock);
+	else
+		pxy_getattr_lead(&req);
+
+	if (req.retry)
+		return false;
+
+	*rc = req.status;
+	return true;
+}
+
 static fsal_status_t pxy_getattrs(struct fsal_obj_handle *obj_hdl,
 				  struct attrlist *attrs)
 {
@@ -1730,14 +2540,20 @@ static fsal_status_t pxy_getattrs(struct fsal_obj_handle *obj_hdl,
 
 	ph = container_of(obj_hdl, struct pxy_obj_handle, obj);
 
-	COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, ph->fh4);
+	atok = &resoparray[1].nfs_resop4_u.opgetattr.GETATTR4res_u.resok4;
 
-	atok = pxy_fill_getattr_reply(resoparray + opcnt, fattr_blob,
-				      sizeof(fattr_blob));
-	COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray, pxy_bitmap_getattr);
+	if (pxy_rpc_params->getattr_batch_window == 0 ||
+	    !pxy_getattr_batched(ph, fattr_blob, &resoparray[1], &rc)) {
+		COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, ph->fh4);
 
-	rc = pxy_nfsv4_call(op_ctx->fsal_export, op_ctx->creds, opcnt,
-			    argoparray, resoparray);
+		pxy_fill_getattr_reply(resoparray + opcnt, fattr_blob,
+				       sizeof(fattr_blob));
+		COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray,
+					      pxy_bitmap_getattr);
+
+		rc = pxy_nfsv4_call(op_ctx->fsal_export, op_ctx->creds, opcnt,
+				    argoparray, resoparray);
+	}
 
 	if (rc != NFS4_OK) {
 		if (attrs->request_mask & ATTR_RDATTR_ERR) {
@@ -1811,6 +2627,8 @@ static fsal_status_t pxy_setattrs(struct fsal_obj_handle *obj_hdl,
 	rc = pxy_nfsv4_call(op_ctx->fsal_export, op_ctx->creds,
 			    opcnt, argoparray, resoparray);
 	nfs4_Fattr_Free(&input_attr);
+	if (FSAL_TEST_MASK(attrs->valid_mask, ATTR_SIZE))
+		pxy_dc_invalidate(&ph->fh4);
 	if (rc != NFS4_OK)
 		return nfsstat4_to_fsal(rc);
 
@@ -1958,6 +2776,108 @@ static fsal_openflags_t pxy_status(struct fsal_obj_handle *obj_hdl)
 	return ph->openflags;
 }
 
+static int pxy_change_from_reply(GETATTR4resok *atok, uint64_t *change)
+{
+	struct attrlist attrs;
+	int rc;
+
+	fsal_prepare_attrs(&attrs, ATTR_CHANGE);
+	rc = nfs4_Fattr_To_FSAL_attr(&attrs, &atok->obj_attributes, NULL);
+	*change = attrs.change;
+	fsal_release_attrs(&attrs);
+
+	return rc;
+}
+
+/* Fetch the change attribute of a file for the data cache */
+int pxy_fetch_change(const nfs_fh4 *fh, uint64_t *change)
+{
+	int rc;
+	int opcnt = 0;
+	nfs_argop4 argoparray[2];
+	nfs_resop4 resoparray[2];
+	GETATTR4resok *atok;
+	char fattr_blob[FATTR_BLOB_SZ];
+
+	COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, *fh);
+	atok = pxy_fill_getattr_reply(resoparray + opcnt, fattr_blob,
+				      sizeof(fattr_blob));
+	COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray, change_bits);
+
+	rc = pxy_nfsv4_call(op_ctx->fsal_export, op_ctx->creds,
+			    opcnt, argoparray, resoparray);
+	if (rc != NFS4_OK)
+		return rc;
+
+	return pxy_change_from_reply(atok, change);
+}
+
+/* Only the change attribute, for MDCACHE to revalidate with */
+static fsal_status_t pxy_getchange(struct fsal_obj_handle *obj_hdl,
+				   uint64_t *change)
+{
+	struct pxy_obj_handle *ph =
+		container_of(obj_hdl, struct pxy_obj_handle, obj);
+
+	return nfsstat4_to_fsal(pxy_fetch_change(&ph->fh4, change));
+}
+
+/*
+ * Fill a data cache block from the server, along with the change
+ * attribute the data belongs to.  *got is short of size only at end of
+ * file.
+ */
+int pxy_fetch_data(const nfs_fh4 *fh, uint64_t offset, size_t size,
+		   char *buffer, size_t *got, uint64_t *change)
+{
+	size_t mr = op_ctx->fsal_export->exp_ops.fs_maxread(
+							op_ctx->fsal_export);
+	int rc;
+
+	*got = 0;
+	while (*got < size) {
+		int opcnt = 0;
+		nfs_argop4 argoparray[3];
+		nfs_resop4 resoparray[3];
+		GETATTR4resok *atok;
+		READ4resok *rok;
+		char fattr_blob[FATTR_BLOB_SZ];
+		size_t count = MIN(size - *got, mr);
+		uint64_t c;
+
+		COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, *fh);
+		rok = &resoparray[opcnt].nfs_resop4_u.opread.READ4res_u.resok4;
+		rok->data.data_val = buffer + *got;
+		rok->data.data_len = count;
+		COMPOUNDV4_ARG_ADD_OP_READ(opcnt, argoparray, offset + *got,
+					   count);
+		atok = pxy_fill_getattr_reply(resoparray + opcnt, fattr_blob,
+					      sizeof(fattr_blob));
+		COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray, change_bits);
+
+		rc = pxy_nfsv4_call(op_ctx->fsal_export, op_ctx->creds,
+				    opcnt, argoparray, resoparray);
+		if (rc != NFS4_OK)
+			return rc;
+
+		rc = pxy_change_from_reply(atok, &c);
+		if (rc != NFS4_OK)
+			return rc;
+
+		/* A block spread over several READs is only good if they
+		 * all saw the same change, report one that differs.
+		 */
+		if (*got == 0 || c != *change)
+			*change = c;
+
+		*got += rok->data.data_len;
+		if (rok->eof || rok->data.data_len == 0)
+			break;
+	}
+
+	return NFS4_OK;
+}
+
 static fsal_status_t pxy_read(struct fsal_obj_handle *obj_hdl,
 			      uint64_t offset, size_t buffer_size, void *buffer,
 			      size_t *read_amount, bool *end_of_file)
@@ -1987,6 +2907,14 @@ static fsal_status_t pxy_read(struct fsal_obj_handle *obj_hdl,
 	if (buffer_size > mr)
 		buffer_size = mr;
 
+	rc = pxy_dc_read(&ph->fh4, obj_hdl->fileid, offset, buffer_size,
+			 buffer, read_amount, end_of_file);
+	if (rc >= 0) {
+		if (rc != NFS4_OK)
+			return nfsstat4_to_fsal(rc);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
 	COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, ph->fh4);
 	rok = &resoparray[opcnt].nfs_resop4_u.opread.READ4res_u.resok4;
 	rok->data.data_val = buffer;
@@ -2044,6 +2972,7 @@ static fsal_status_t pxy_write(struct fsal_obj_handle *obj_hdl,
 
 	rc = pxy_nfsv4_call(op_ctx->fsal_export, op_ctx->creds,
 			    opcnt, argoparray, resoparray);
+	pxy_dc_invalidate(&ph->fh4);
 	if (rc != NFS4_OK)
 		return nfsstat4_to_fsal(rc);
 
@@ -2420,6 +3349,15 @@ static fsal_status_t pxy_read2(struct fsal_obj_handle *obj_hdl,
 	if (buffer_size > maxReadSize)
 		buffer_size = maxReadSize;
 
+	/* try the data cache */
+	rc = pxy_dc_read(&ph->fh4, obj_hdl->fileid, offset, buffer_size,
+			 buffer, read_amount, end_of_file);
+	if (rc >= 0) {
+		if (rc != NFS4_OK)
+			return nfsstat4_to_fsal(rc);
+		goto out;
+	}
+
 	/* prepare PUTFH */
 	COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, ph->fh4);
 	/* prepare READ */
@@ -2441,6 +3379,7 @@ static fsal_status_t pxy_read2(struct fsal_obj_handle *obj_hdl,
 
 	*end_of_file = rok->eof;
 	*read_amount = rok->data.data_len;
+out:
 	if (info) {
 		info->io_content.what = NFS4_CONTENT_DATA;
 		info->io_content.data.d_offset = offset + *read_amount;
@@ -2496,6 +3435,7 @@ static fsal_status_t pxy_write2(struct fsal_obj_handle *obj_hdl,
 	/* nfs call */
 	rc = pxy_nfsv4_call(op_ctx->fsal_export, op_ctx->creds,
 			    opcnt, argoparray, resoparray);
+	pxy_dc_invalidate(&ph->fh4);
 	if (rc != NFS4_OK)
 		return nfsstat4_to_fsal(rc);
 
@@ -2567,6 +3507,8 @@ static fsal_status_t pxy_setattr2(struct fsal_obj_handle *obj_hdl,
 	rc = pxy_nfsv4_call(op_ctx->fsal_export, op_ctx->creds,
 			    opcnt, argoparray, resoparray);
 	nfs4_Fattr_Free(&input_attr);
+	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_SIZE))
+		pxy_dc_invalidate(&ph->fh4);
 	if (rc != NFS4_OK)
 		return nfsstat4_to_fsal(rc);
 
@@ -2626,12 +3568,14 @@ void pxy_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->release = pxy_hdl_release;
 	ops->lookup = pxy_lookup;
 	ops->readdir = pxy_readdir;
+	ops->readdir_plus = pxy_readdir_plus;
 	ops->create = pxy_create;
 	ops->mkdir = pxy_mkdir;
 	ops->mknode = pxy_mknod;
 	ops->symlink = pxy_symlink;
 	ops->readlink = pxy_readlink;
 	ops->getattrs = pxy_getattrs;
+	ops->getchange = pxy_getchange;
 	ops->setattrs = pxy_setattrs;
 	ops->link = pxy_link;
 	ops->rename = pxy_rename;
@@ -37,9 +37,11 @@
 #include "nfs4.h"
 #include "handle_mapping.h"
 #include "handle_mapping_db.h"
+#include "handle_mapping_log.h"
 #include "handle_mapping_internal.h"
 
 static hash_table_t *handle_map_hash;
+static int handle_map_store;
 
 /* memory pool definitions */
 
@@ -220,6 +222,58 @@ int handle_mapping_hash_add(hash_table_t *p_hash, uint64_t object_id,
 	return HANDLEMAP_SUCCESS;
 }
 
+int handle_mapping_hash_del(hash_table_t *p_hash, uint64_t object_id,
+			    unsigned int handle_hash)
+{
+	int rc;
+	struct gsh_buffdesc buffkey, stored_buffkey;
+	struct gsh_buffdesc stored_buffval;
+	digest_pool_entry_t digest;
+
+	memset(&digest, 0, sizeof(digest));
+	digest.nfs23_digest.object_id = object_id;
+	digest.nfs23_digest.handle_hash = handle_hash;
+
+	buffkey.addr = (caddr_t) &digest;
+	buffkey.len = sizeof(digest_pool_entry_t);
+
+	rc = HashTable_Del(p_hash, &buffkey, &stored_buffkey,
+			   &stored_buffval);
+
+	if (rc != HASHTABLE_SUCCESS)
+		return HANDLEMAP_STALE;
+
+	digest_free((digest_pool_entry_t *) stored_buffkey.addr);
+	handle_free((handle_pool_entry_t *) stored_buffval.addr);
+
+	return HANDLEMAP_SUCCESS;
+}
+
+struct hash_walk_arg {
+	handle_mapping_walk_cb cb;
+	void *arg;
+};
+
+static void hash_walk_one(struct gsh_buffdesc *key, struct gsh_buffdesc *val,
+			  void *arg)
+{
+	struct hash_walk_arg *wa = arg;
+	digest_pool_entry_t *p_digest = (digest_pool_entry_t *) key->addr;
+	handle_pool_entry_t *p_handle = (handle_pool_entry_t *) val->addr;
+
+	wa->cb(p_digest->nfs23_digest.object_id,
+	       p_digest->nfs23_digest.handle_hash,
+	       p_handle->fh_data, p_handle->fh_len, wa->arg);
+}
+
+void handle_mapping_hash_walk(hash_table_t *p_hash, handle_mapping_walk_cb cb,
+			      void *arg)
+{
+	struct hash_walk_arg wa = { .cb = cb, .arg = arg };
+
+	hashtable_for_each(p_hash, hash_walk_one, &wa);
+}
+
 /* DEFAULT PARAMETERS for hash table */
 static hash_parameter_t handle_hash_config = {
 	.index_size = 67,
@@ -240,6 +294,19 @@ int HandleMap_Init(const handle_map_param_t *p_param)
 {
 	int rc;
 
+	handle_map_store = p_param->store;
+
+	if (handle_map_store == HANDLEMAP_STORE_LOG) {
+		rc = handlemap_log_init(p_param->databases_directory,
+					p_param->synchronous_insert);
+		if (rc) {
+			LogCrit(COMPONENT_FSAL,
+				"ERROR %d initializing handle mapping log", rc);
+			return rc;
+		}
+		goto init_hash;
+	}
+
 	/* first check database count */
 
 	rc = handlemap_db_count(p_param->databases_directory);
@@ -265,6 +332,7 @@ int HandleMap_Init(const handle_map_param_t *p_param)
 		return rc;
 	}
 
+init_hash:
 	/* initialize memory pool of digests and handles */
 
 	digest_pool =
@@ -287,7 +355,10 @@ int HandleMap_Init(const handle_map_param_t *p_param)
 
 	/* reload previous data */
 
-	rc = handlemap_db_reaload_all(handle_map_hash);
+	if (handle_map_store == HANDLEMAP_STORE_LOG)
+		rc = handlemap_log_reload(handle_map_hash);
+	else
+		rc = handlemap_db_reaload_all(handle_map_hash);
 
 	if (rc) {
 		LogCrit(COMPONENT_FSAL,
@@ -365,6 +436,8 @@ int HandleMap_SetFH(nfs23_map_handle_t *p_in_nfs23_digest, const void *data,
 	else if (rc == HANDLEMAP_EXISTS)
 		/* already in database */
 		return HANDLEMAP_EXISTS;
+	else if (handle_map_store == HANDLEMAP_STORE_LOG)
+		return handlemap_log_insert(p_in_nfs23_digest, data, len);
 	else {
 		/* insert it to DB */
 		return handlemap_db_insert(p_in_nfs23_digest, data, len);
@@ -379,35 +452,21 @@ int HandleMap_SetFH(nfs23_map_handle_t *p_in_nfs23_digest, const void *data,
 int HandleMap_DelFH(nfs23_map_handle_t *p_in_nfs23_digest)
 {
 	int rc;
-	struct gsh_buffdesc buffkey, stored_buffkey;
-	struct gsh_buffdesc stored_buffval;
-
-	digest_pool_entry_t digest;
-
-	digest_pool_entry_t *p_stored_digest;
-	handle_pool_entry_t *p_stored_handle;
 
 	/* first, delete it from hash table */
 
-	digest.nfs23_digest = *p_in_nfs23_digest;
-
-	buffkey.addr = (caddr_t) &digest;
-	buffkey.len = sizeof(digest_pool_entry_t);
-
-	rc = HashTable_Del(handle_map_hash, &buffkey, &stored_buffkey,
-			   &stored_buffval);
-
-	if (rc != HASHTABLE_SUCCESS)
-		return HANDLEMAP_STALE;
-
-	p_stored_digest = (digest_pool_entry_t *) stored_buffkey.addr;
-	p_stored_handle = (handle_pool_entry_t *) stored_buffval.addr;
+	rc = handle_mapping_hash_del(handle_map_hash,
+				     p_in_nfs23_digest->object_id,
+				     p_in_nfs23_digest->handle_hash);
 
-	digest_free(p_stored_digest);
-	handle_free(p_stored_handle);
+	if (rc != HANDLEMAP_SUCCESS)
+		return rc;
 
 	/* then, submit the request to the database */
 
+	if (handle_map_store == HANDLEMAP_STORE_LOG)
+		return handlemap_log_delete(p_in_nfs23_digest);
+
 	return handlemap_db_delete(p_in_nfs23_digest);
 
 }
@@ -417,5 +476,8 @@ int HandleMap_DelFH(nfs23_map_handle_t *p_in_nfs23_digest)
  */
 int HandleMap_Flush(void)
 {
+	if (handle_map_store == HANDLEMAP_STORE_LOG)
+		return handlemap_log_flush();
+
 	return handlemap_db_flush();
 }
@@ -54,8 +54,15 @@ typedef struct handle_map_param__ {
 	/* synchronous insert mode */
 	int synchronous_insert;
 
+	/* where mappings are kept, HANDLEMAP_STORE_* */
+	int store;
+
 } handle_map_param_t;
 
+/* mapping stores */
+#define HANDLEMAP_STORE_SQLITE   0
+#define HANDLEMAP_STORE_LOG      1
+
 /* this describes a handle digest for nfsv3 */
 
 #define PXY_HANDLE_MAPPED 0x23
@@ -7,6 +7,15 @@
 int handle_mapping_hash_add(hash_table_t *p_hash, uint64_t object_id,
 			    unsigned int handle_hash, const void *data,
 			    uint32_t datalen);
+int handle_mapping_hash_del(hash_table_t *p_hash, uint64_t object_id,
+			    unsigned int handle_hash);
+
+typedef void (*handle_mapping_walk_cb)(uint64_t object_id,
+				       unsigned int handle_hash,
+				       const void *data, uint32_t datalen,
+				       void *arg);
+void handle_mapping_hash_walk(hash_table_t *p_hash, handle_mapping_walk_cb cb,
+			      void *arg);
 int snprintmem(char *target, size_t tgt_size, const void *source,
 	       size_t mem_size);
 int sscanmem(void *target, size_t tgt_size, const char *str_source);
@@ -0,0 +1,335 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ */
+
+/**
+ * \file handle_mapping_log.c
+ *
+ * \brief  Append-only log store for the handle mapping.
+ *
+ * The mapping lives in the hash table of handle_mapping.c.  Every
+ * insert and delete is appended to a log file through a stdio buffer,
+ * which a thread writes out every second.  At startup the log is read
+ * back in order.  When deleted mappings make up most of the log, it is
+ * rewritten from the hash table.
+ */
+#include "config.h"
+#include "handle_mapping.h"
+#include "handle_mapping_log.h"
+#include "handle_mapping_internal.h"
+#include "city.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define LOG_MAGIC       0x484d4c47
+#define LOG_OP_INSERT   1
+#define LOG_OP_DELETE   2
+
+/* compact when there are this many records and most are dead */
+#define LOG_COMPACT_MIN 4096
+
+/* log record, followed by fh_len bytes of handle */
+struct log_record {
+	uint32_t magic;
+	uint8_t op;
+	uint8_t fh_len;
+	uint16_t pad;
+	uint32_t handle_hash;
+	uint32_t pad2;
+	uint64_t object_id;
+	/* CityHash64 of the record and handle, with csum set to 0 */
+	uint64_t csum;
+};
+
+static char log_path[MAXPATHLEN + 1];
+static char log_tmp_path[MAXPATHLEN + 1];
+static int synchronous;
+
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+static FILE *log_file;
+static hash_table_t *log_hash;
+static pthread_t log_thr;
+
+/* records in the log, and how many of them are live mappings */
+static uint64_t log_records;
+static uint64_t log_live;
+
+static void log_fill_record(struct log_record *rec, char *buf, uint8_t op,
+			    uint64_t object_id, unsigned int handle_hash,
+			    const void *data, uint32_t len)
+{
+	memset(rec, 0, sizeof(*rec));
+	rec->magic = LOG_MAGIC;
+	rec->op = op;
+	rec->fh_len = len;
+	rec->handle_hash = handle_hash;
+	rec->object_id = object_id;
+
+	memcpy(buf, rec, sizeof(*rec));
+	if (len != 0)
+		memcpy(buf + sizeof(*rec), data, len);
+	rec->csum = CityHash64(buf, sizeof(*rec) + len);
+	memcpy(buf, rec, sizeof(*rec));
+}
+
+static int log_write_record(FILE *f, uint8_t op, uint64_t object_id,
+			    unsigned int handle_hash, const void *data,
+			    uint32_t len)
+{
+	struct log_record rec;
+	char buf[sizeof(rec) + NFS4_FHSIZE];
+
+	if (len > NFS4_FHSIZE || len > UINT8_MAX)
+		return HANDLEMAP_INVALID_PARAM;
+
+	log_fill_record(&rec, buf, op, object_id, handle_hash, data, len);
+
+	if (fwrite(buf, sizeof(rec) + len, 1, f) != 1)
+		return HANDLEMAP_SYSTEM_ERROR;
+
+	return HANDLEMAP_SUCCESS;
+}
+
+/* called with log_mutex held */
+static int log_sync(void)
+{
+	if (fflush(log_file) != 0 || fdatasync(fileno(log_file)) != 0) {
+		LogCrit(COMPONENT_FSAL, "Cannot write handle mapping log %s: %s",
+			log_path, strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	return HANDLEMAP_SUCCESS;
+}
+
+static void log_compact_one(uint64_t object_id, unsigned int handle_hash,
+			    const void *data, uint32_t datalen, void *arg)
+{
+	FILE *f = arg;
+
+	if (log_write_record(f, LOG_OP_INSERT, object_id, handle_hash, data,
+			     datalen) == HANDLEMAP_SUCCESS)
+		log_records++;
+}
+
+/*
+ * Rewrite the log with the live mappings only.  Called with log_mutex
+ * held, so every change to the hash table made during the walk is
+ * appended to the new log afterwards.
+ */
+static int log_compact(void)
+{
+	FILE *f, *nf;
+	uint64_t old_records = log_records;
+
+	f = fopen(log_tmp_path, "w");
+	if (f == NULL) {
+		LogCrit(COMPONENT_FSAL, "Cannot create %s: %s", log_tmp_path,
+			strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	log_records = 0;
+	handle_mapping_hash_walk(log_hash, log_compact_one, f);
+
+	if (fflush(f) != 0 || fdatasync(fileno(f)) != 0 ||
+	    rename(log_tmp_path, log_path) != 0) {
+		LogCrit(COMPONENT_FSAL, "Cannot compact %s: %s", log_path,
+			strerror(errno));
+		fclose(f);
+		unlink(log_tmp_path);
+		log_records = old_records;
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+	fclose(f);
+
+	nf = fopen(log_path, "a");
+	if (nf == NULL) {
+		LogCrit(COMPONENT_FSAL, "Cannot reopen %s: %s", log_path,
+			strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	fclose(log_file);
+	log_file = nf;
+	log_live = log_records;
+
+	LogEvent(COMPONENT_FSAL,
+		 "Compacted handle mapping log from %" PRIu64 " to %" PRIu64
+		 " records", old_records, log_records);
+
+	return HANDLEMAP_SUCCESS;
+}
+
+static bool log_should_compact(void)
+{
+	return log_records >= LOG_COMPACT_MIN && log_records > 2 * log_live;
+}
+
+static void *log_flusher_thread(void *arg)
+{
+	SetNameFunction("hdlmap_log");
+
+	PTHREAD_MUTEX_lock(&log_mutex);
+	for (;;) {
+		struct timespec ts;
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += 1;
+		(void) pthread_cond_timedwait(&log_cond, &log_mutex, &ts);
+
+		(void) log_sync();
+		if (log_should_compact())
+			(void) log_compact();
+	}
+	PTHREAD_MUTEX_unlock(&log_mutex);
+
+	return NULL;
+}
+
+int handlemap_log_init(const char *log_dir, int synchronous_insert)
+{
+	int rc;
+
+	if (snprintf(log_path, sizeof(log_path), "%s/%s", log_dir,
+		     LOG_FILE_NAME) >= sizeof(log_path) ||
+	    snprintf(log_tmp_path, sizeof(log_tmp_path), "%s/%s.tmp", log_dir,
+		     LOG_FILE_NAME) >= sizeof(log_tmp_path))
+		return HANDLEMAP_INVALID_PARAM;
+
+	synchronous = synchronous_insert;
+
+	log_file = fopen(log_path, "a+");
+	if (log_file == NULL) {
+		LogCrit(COMPONENT_FSAL, "Cannot open %s: %s", log_path,
+			strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	rc = pthread_create(&log_thr, NULL, log_flusher_thread, NULL);
+	if (rc) {
+		LogCrit(COMPONENT_FSAL,
+			"Error %d launching handle mapping log thread", rc);
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	return HANDLEMAP_SUCCESS;
+}
+
+int handlemap_log_reload(hash_table_t *target_hash)
+{
+	struct log_record rec;
+	char buf[sizeof(rec) + NFS4_FHSIZE];
+	off_t good = 0;
+	uint64_t csum;
+	int rc = HANDLEMAP_SUCCESS;
+
+	PTHREAD_MUTEX_lock(&log_mutex);
+	log_hash = target_hash;
+	rewind(log_file);
+
+	while (fread(&rec, sizeof(rec), 1, log_file) == 1) {
+		if (rec.magic != LOG_MAGIC || rec.fh_len > NFS4_FHSIZE ||
+		    fread(buf + sizeof(rec), rec.fh_len, 1, log_file) !=
+		    (rec.fh_len != 0))
+			break;
+
+		csum = rec.csum;
+		rec.csum = 0;
+		memcpy(buf, &rec, sizeof(rec));
+		if (CityHash64(buf, sizeof(rec) + rec.fh_len) != csum)
+			break;
+
+		if (rec.op == LOG_OP_INSERT) {
+			if (handle_mapping_hash_add(target_hash, rec.object_id,
+						    rec.handle_hash,
+						    buf + sizeof(rec),
+						    rec.fh_len) ==
+			    HANDLEMAP_SUCCESS)
+				log_live++;
+		} else if (rec.op == LOG_OP_DELETE) {
+			if (handle_mapping_hash_del(target_hash, rec.object_id,
+						    rec.handle_hash) ==
+			    HANDLEMAP_SUCCESS)
+				log_live--;
+		}
+
+		log_records++;
+		good = ftello(log_file);
+	}
+
+	if (!feof(log_file) || ftello(log_file) != good) {
+		LogEvent(COMPONENT_FSAL,
+			 "Cutting handle mapping log %s at offset %lld",
+			 log_path, (long long)good);
+		if (ftruncate(fileno(log_file), good) != 0)
+			rc = HANDLEMAP_SYSTEM_ERROR;
+	}
+	clearerr(log_file);
+	(void) fseeko(log_file, 0, SEEK_END);
+
+	LogEvent(COMPONENT_FSAL,
+		 "Reloaded %" PRIu64 " handle mappings from %" PRIu64
+		 " log records", log_live, log_records);
+
+	if (rc == HANDLEMAP_SUCCESS && log_should_compact())
+		rc = log_compact();
+	PTHREAD_MUTEX_unlock(&log_mutex);
+
+	return rc;
+}
+
+int handlemap_log_insert(nfs23_map_handle_t *p_in_nfs23_digest,
+			 const void *data, uint32_t len)
+{
+	int rc;
+
+	PTHREAD_MUTEX_lock(&log_mutex);
+	rc = log_write_record(log_file, LOG_OP_INSERT,
+			      p_in_nfs23_digest->object_id,
+			      p_in_nfs23_digest->handle_hash, data, len);
+	if (rc == HANDLEMAP_SUCCESS) {
+		log_records++;
+		log_live++;
+		if (synchronous)
+			rc = log_sync();
+	}
+	PTHREAD_MUTEX_unlock(&log_mutex);
+
+	return rc;
+}
+
+int handlemap_log_delete(nfs23_map_handle_t *p_in_nfs23_digest)
+{
+	int rc;
+
+	PTHREAD_MUTEX_lock(&log_mutex);
+	rc = log_write_record(log_file, LOG_OP_DELETE,
+			      p_in_nfs23_digest->object_id,
+			      p_in_nfs23_digest->handle_hash, NULL, 0);
+	if (rc == HANDLEMAP_SUCCESS) {
+		log_records++;
+		if (log_live > 0)
+			log_live--;
+	}
+	PTHREAD_MUTEX_unlock(&log_mutex);
+
+	return rc;
+}
+
+int handlemap_log_flush(void)
+{
+	int rc;
+
+	PTHREAD_MUTEX_lock(&log_mutex);
+	rc = log_sync();
+	PTHREAD_MUTEX_unlock(&log_mutex);
+
+	return rc;
+}
@@ -0,0 +1,40 @@
+#ifndef _HANDLE_MAPPING_LOG_H
+#define _HANDLE_MAPPING_LOG_H
+
+#include "handle_mapping.h"
+#include "hashtable.h"
+
+#define LOG_FILE_NAME "handlemap.log"
+
+/**
+ * Open (or create) the mapping log in the given directory
+ * and start the thread that flushes and compacts it.
+ */
+int handlemap_log_init(const char *log_dir, int synchronous_insert);
+
+/**
+ * Replay the log into the hash table.
+ * A torn record at the end of the log is cut off.
+ */
+int handlemap_log_reload(hash_table_t *target_hash);
+
+/**
+ * Append an 'insert' record.
+ * It reaches the disk at the next flush,
+ * or before returning in synchronous insert mode.
+ */
+int handlemap_log_insert(nfs23_map_handle_t *p_in_nfs23_digest,
+			 const void *data, uint32_t len);
+
+/**
+ * Append a 'delete' record.
+ * (always asynchronous)
+ */
+int handlemap_log_delete(nfs23_map_handle_t *p_in_nfs23_digest);
+
+/**
+ * Write all appended records to disk.
+ */
+int handlemap_log_flush(void);
+
+#endif
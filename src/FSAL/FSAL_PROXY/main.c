@@ -67,6 +67,14 @@ static struct config_item_list sec_types[] = {
 };
 #endif
 
+#ifdef PROXY_HANDLE_MAPPING
+static struct config_item_list hdlmap_stores[] = {
+	CONFIG_LIST_TOK("sqlite", HANDLEMAP_STORE_SQLITE),
+	CONFIG_LIST_TOK("log", HANDLEMAP_STORE_LOG),
+	CONFIG_LIST_EOL
+};
+#endif
+
 /*512 bytes to store header*/
 #define SEND_RECV_HEADER_SPACE 512
 /*1MB of default maxsize*/
@@ -93,6 +101,30 @@ static struct config_item proxy_remote_params[] = {
 		       pxy_client_params, use_privileged_client_port),
 	CONF_ITEM_UI32("RPC_Client_Timeout", 1, 60*4, 60,
 		       pxy_client_params, srv_timeout),
+	CONF_ITEM_UI32("RPC_Connections", 1, 64, 1,
+		       pxy_client_params, num_connections),
+	CONF_ITEM_UI32("RPC_Max_Contexts", 16, 4096, 64,
+		       pxy_client_params, max_contexts),
+	CONF_ITEM_UI32("NFS_MinorVersion", 0, 1, 0,
+		       pxy_client_params, minorversion),
+	CONF_ITEM_UI32("Session_Slots", 1, 1024, 64,
+		       pxy_client_params, session_slots),
+	CONF_ITEM_UI32("Getattr_Batch_Window", 0, 100000, 0,
+		       pxy_client_params, getattr_batch_window),
+	CONF_ITEM_UI32("Getattr_Batch_Max", 2, 64, 16,
+		       pxy_client_params, getattr_batch_max),
+	CONF_ITEM_PATH("Data_Cache_Dir", 1, MAXPATHLEN, NULL,
+		       pxy_client_params, data_cache_dir),
+	CONF_ITEM_UI64("Data_Cache_Size", 1024 * 1024, UINT64_MAX,
+		       10LL * 1024 * 1024 * 1024,
+		       pxy_client_params, data_cache_size),
+	CONF_ITEM_UI32("Data_Cache_Block_Size", 4096, 16 * 1024 * 1024,
+		       1024 * 1024,
+		       pxy_client_params, data_cache_block_size),
+	CONF_ITEM_UI32("Data_Cache_Revalidate", 0, 86400, 30,
+		       pxy_client_params, data_cache_revalidate),
+	CONF_ITEM_PATH("Data_Cache_Pin_File", 1, MAXPATHLEN, NULL,
+		       pxy_client_params, data_cache_pin_file),
 #ifdef _USE_GSSRPC
 	CONF_ITEM_STR("Remote_PrincipalName", 0, MAXNAMLEN, NULL,
 		      pxy_client_params, remote_principal),
@@ -118,6 +150,9 @@ static struct config_item proxy_remote_params[] = {
 		       pxy_client_params, hdlmap.database_count),
 	CONF_ITEM_UI32("HandleMap_HashTable_Size", 1, 127, 103,
 		       pxy_client_params, hdlmap.hashtable_size),
+	CONF_ITEM_TOKEN("HandleMap_Store", HANDLEMAP_STORE_SQLITE,
+			hdlmap_stores,
+			pxy_client_params, hdlmap.store),
 #endif
 	CONFIG_EOL
 };
@@ -214,6 +249,10 @@ static fsal_status_t pxy_init_config(struct fsal_module *fsal_hdl,
 		return fsalstat(ERR_FSAL_INVAL, -rc);
 #endif
 
+	rc = pxy_dc_init(&pxy->special);
+	if (rc)
+		return fsalstat(ERR_FSAL_FAULT, rc);
+
 	rc = pxy_init_rpc(pxy);
 	if (rc)
 		return fsalstat(ERR_FSAL_FAULT, rc);
@@ -0,0 +1,617 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* On-disk cache of remote file data
+ *
+ * Every cached file gets a directory under Data_Cache_Dir named after a
+ * hash of its remote handle.  The directory holds a meta file, with the
+ * handle and the change attribute the data belongs to, and one file per
+ * Data_Cache_Block_Size block.  A block file shorter than the block
+ * size ends at end of file.
+ *
+ * The change attribute is checked with the remote server at most once
+ * every Data_Cache_Revalidate seconds.  If it moved, the blocks are
+ * dropped.  Writes and size changes through the proxy drop them too.
+ *
+ * The cache is kept across restarts.  Once it outgrows Data_Cache_Size,
+ * whole files are evicted, least recently used first.  Files whose
+ * fileid is listed in Data_Cache_Pin_File are never evicted.
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "gsh_list.h"
+#include "abstract_atomic.h"
+#include "city.h"
+#include "pxy_fsal_methods.h"
+
+#define PXY_DC_MAGIC 0x50584443
+#define PXY_DC_BUCKETS 1024
+#define PXY_DC_META "meta"
+#define PXY_DC_NAMELEN 64
+
+struct pxy_dc_meta {
+	uint32_t magic;
+	uint32_t fh_len;
+	uint64_t change;
+	uint64_t fileid;
+	char fh[NFS4_FHSIZE];
+};
+
+struct pxy_dc_file {
+	struct glist_head hash;
+	struct glist_head lru;
+	uint64_t key;
+	uint32_t refcnt;
+	bool pinned;
+	/* The blocks on disk belong to meta.change */
+	bool valid;
+	/* Bumped whenever the blocks are dropped, a block read from the
+	 * server before that is not stored */
+	uint32_t gen;
+	time_t validated;
+	uint64_t bytes;
+	struct pxy_dc_meta meta;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	const struct pxy_client_params *params;
+	int dirfd;
+	struct glist_head buckets[PXY_DC_BUCKETS];
+	/* Unpinned files, least recently used first */
+	struct glist_head lru;
+	uint64_t bytes;
+	uint64_t *pins;
+	uint32_t npins;
+	uint32_t tmpseq;
+} pxy_dc = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.dirfd = -1,
+};
+
+static void pxy_dc_path(uint64_t key, const char *file, char *path)
+{
+	if (file == NULL)
+		snprintf(path, PXY_DC_NAMELEN, "%016" PRIx64, key);
+	else
+		snprintf(path, PXY_DC_NAMELEN, "%016" PRIx64 "/%s", key, file);
+}
+
+static void pxy_dc_block_path(uint64_t key, uint64_t blk, char *path)
+{
+	snprintf(path, PXY_DC_NAMELEN, "%016" PRIx64 "/%" PRIu64, key, blk);
+}
+
+static int pxy_dc_cmp_fileid(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static bool pxy_dc_is_pinned(uint64_t fileid)
+{
+	return pxy_dc.npins != 0 &&
+	       bsearch(&fileid, pxy_dc.pins, pxy_dc.npins, sizeof(uint64_t),
+		       pxy_dc_cmp_fileid) != NULL;
+}
+
+static void pxy_dc_load_pins(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	uint32_t alloc = 0;
+	unsigned long long fileid;
+
+	if (fp == NULL) {
+		LogCrit(COMPONENT_FSAL, "Cannot open %s: %s", path,
+			strerror(errno));
+		return;
+	}
+
+	while (fscanf(fp, "%llu", &fileid) == 1) {
+		if (pxy_dc.npins == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			pxy_dc.pins = gsh_realloc(pxy_dc.pins,
+						  alloc * sizeof(uint64_t));
+		}
+		pxy_dc.pins[pxy_dc.npins++] = fileid;
+	}
+	fclose(fp);
+
+	qsort(pxy_dc.pins, pxy_dc.npins, sizeof(uint64_t), pxy_dc_cmp_fileid);
+	LogEvent(COMPONENT_FSAL, "Pinned %" PRIu32 " files in the data cache",
+		 pxy_dc.npins);
+}
+
+/*
+ * Walk the block files of a cached file, adding up their size.  They
+ * are removed if drop is set, and the meta file and the directory as
+ * well if all is set.
+ */
+static uint64_t pxy_dc_walk(uint64_t key, bool drop, bool all)
+{
+	char path[PXY_DC_NAMELEN];
+	struct dirent *de;
+	struct stat st;
+	uint64_t bytes = 0;
+	DIR *dir;
+	int fd;
+
+	pxy_dc_path(key, NULL, path);
+	fd = openat(pxy_dc.dirfd, path, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return 0;
+
+	dir = fdopendir(fd);
+	if (dir == NULL) {
+		close(fd);
+		return 0;
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		bool meta = strcmp(de->d_name, PXY_DC_META) == 0;
+
+		if (strcmp(de->d_name, ".") == 0 ||
+		    strcmp(de->d_name, "..") == 0)
+			continue;
+		/* Block files are named by number, the rest are the meta
+		 * file and blocks being written
+		 */
+		if (isdigit((unsigned char)de->d_name[0]) &&
+		    fstatat(fd, de->d_name, &st, 0) == 0)
+			bytes += st.st_size;
+		if (drop && (all || !meta))
+			(void) unlinkat(fd, de->d_name, 0);
+	}
+	closedir(dir);
+
+	if (all)
+		(void) unlinkat(pxy_dc.dirfd, path, AT_REMOVEDIR);
+
+	return bytes;
+}
+
+static void pxy_dc_insert(struct pxy_dc_file *f)
+{
+	glist_add_tail(&pxy_dc.buckets[f->key % PXY_DC_BUCKETS], &f->hash);
+	if (!f->pinned)
+		glist_add_tail(&pxy_dc.lru, &f->lru);
+	pxy_dc.bytes += f->bytes;
+}
+
+static struct pxy_dc_file *pxy_dc_lookup(uint64_t key)
+{
+	struct glist_head *glist;
+
+	glist_for_each(glist, &pxy_dc.buckets[key % PXY_DC_BUCKETS]) {
+		struct pxy_dc_file *f =
+			glist_entry(glist, struct pxy_dc_file, hash);
+
+		if (f->key == key)
+			return f;
+	}
+	return NULL;
+}
+
+static bool pxy_dc_same_fh(const struct pxy_dc_file *f, const nfs_fh4 *fh)
+{
+	return f->meta.fh_len == fh->nfs_fh4_len &&
+	       memcmp(f->meta.fh, fh->nfs_fh4_val, fh->nfs_fh4_len) == 0;
+}
+
+/*
+ * Evict unused files until need more bytes fit.  Called with the lock
+ * held.
+ */
+static void pxy_dc_evict(uint64_t need)
+{
+	struct glist_head *glist, *glistn;
+
+	glist_for_each_safe(glist, glistn, &pxy_dc.lru) {
+		struct pxy_dc_file *f =
+			glist_entry(glist, struct pxy_dc_file, lru);
+
+		if (pxy_dc.bytes + need <= pxy_dc.params->data_cache_size)
+			return;
+		if (f->refcnt != 0)
+			continue;
+
+		(void) pxy_dc_walk(f->key, true, true);
+		glist_del(&f->hash);
+		glist_del(&f->lru);
+		pxy_dc.bytes -= f->bytes;
+		gsh_free(f);
+	}
+}
+
+/* Drop the blocks of a file.  Called with the lock held. */
+static void pxy_dc_drop(struct pxy_dc_file *f)
+{
+	(void) pxy_dc_walk(f->key, true, false);
+	pxy_dc.bytes -= f->bytes;
+	f->bytes = 0;
+	f->gen++;
+}
+
+static bool pxy_dc_write_meta(struct pxy_dc_file *f)
+{
+	char path[PXY_DC_NAMELEN];
+	ssize_t n;
+	int fd;
+
+	pxy_dc_path(f->key, NULL, path);
+	(void) mkdirat(pxy_dc.dirfd, path, 0700);
+
+	pxy_dc_path(f->key, PXY_DC_META, path);
+	fd = openat(pxy_dc.dirfd, path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return false;
+	n = write(fd, &f->meta, sizeof(f->meta));
+	close(fd);
+
+	return n == sizeof(f->meta);
+}
+
+/* Rebuild the index from what a previous run left on disk */
+static void pxy_dc_scan(void)
+{
+	struct dirent *de;
+	DIR *dir;
+	int fd = dup(pxy_dc.dirfd);
+
+	if (fd < 0)
+		return;
+	dir = fdopendir(fd);
+	if (dir == NULL) {
+		close(fd);
+		return;
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		char path[PXY_DC_NAMELEN];
+		struct pxy_dc_meta meta;
+		struct pxy_dc_file *f;
+		uint64_t key;
+		ssize_t n = -1;
+		char *end;
+		int mfd;
+
+		if (de->d_name[0] == '.')
+			continue;
+		key = strtoull(de->d_name, &end, 16);
+		if (*end != '\0')
+			continue;
+
+		pxy_dc_path(key, PXY_DC_META, path);
+		mfd = openat(pxy_dc.dirfd, path, O_RDONLY);
+		if (mfd >= 0) {
+			n = read(mfd, &meta, sizeof(meta));
+			close(mfd);
+		}
+
+		if (n != sizeof(meta) || meta.magic != PXY_DC_MAGIC ||
+		    meta.fh_len > NFS4_FHSIZE || pxy_dc_lookup(key) != NULL) {
+			(void) pxy_dc_walk(key, true, true);
+			continue;
+		}
+
+		/* Checked against the server on first use */
+		f = gsh_calloc(1, sizeof(*f));
+		f->key = key;
+		f->meta = meta;
+		f->valid = true;
+		f->pinned = pxy_dc_is_pinned(meta.fileid);
+		f->bytes = pxy_dc_walk(key, false, false);
+		pxy_dc_insert(f);
+	}
+	closedir(dir);
+}
+
+/*
+ * Find or add the entry of a file and take a reference on it.  Returns
+ * NULL if its hash is taken by another file, which is then not cached.
+ */
+static struct pxy_dc_file *pxy_dc_get(const nfs_fh4 *fh, uint64_t fileid)
+{
+	uint64_t key = CityHash64(fh->nfs_fh4_val, fh->nfs_fh4_len);
+	struct pxy_dc_file *f;
+
+	if (fh->nfs_fh4_len > NFS4_FHSIZE)
+		return NULL;
+
+	PTHREAD_MUTEX_lock(&pxy_dc.lock);
+	f = pxy_dc_lookup(key);
+	if (f == NULL) {
+		f = gsh_calloc(1, sizeof(*f));
+		f->key = key;
+		f->meta.magic = PXY_DC_MAGIC;
+		f->meta.fh_len = fh->nfs_fh4_len;
+		memcpy(f->meta.fh, fh->nfs_fh4_val, fh->nfs_fh4_len);
+		f->meta.fileid = fileid;
+		f->pinned = pxy_dc_is_pinned(fileid);
+		pxy_dc_insert(f);
+	} else if (!pxy_dc_same_fh(f, fh)) {
+		PTHREAD_MUTEX_unlock(&pxy_dc.lock);
+		return NULL;
+	}
+
+	f->refcnt++;
+	if (!f->pinned) {
+		glist_del(&f->lru);
+		glist_add_tail(&pxy_dc.lru, &f->lru);
+	}
+	PTHREAD_MUTEX_unlock(&pxy_dc.lock);
+
+	return f;
+}
+
+static void pxy_dc_put(struct pxy_dc_file *f)
+{
+	PTHREAD_MUTEX_lock(&pxy_dc.lock);
+	f->refcnt--;
+	PTHREAD_MUTEX_unlock(&pxy_dc.lock);
+}
+
+/*
+ * Check the change attribute with the server if it is time to, and
+ * drop the blocks if it moved.
+ */
+static int pxy_dc_revalidate(struct pxy_dc_file *f, const nfs_fh4 *fh)
+{
+	time_t now = time(NULL);
+	uint64_t change;
+	bool check;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&pxy_dc.lock);
+	check = !f->valid ||
+		now - f->validated >= pxy_dc.params->data_cache_revalidate;
+	PTHREAD_MUTEX_unlock(&pxy_dc.lock);
+
+	if (!check)
+		return NFS4_OK;
+
+	rc = pxy_fetch_change(fh, &change);
+	if (rc != NFS4_OK)
+		return rc;
+
+	PTHREAD_MUTEX_lock(&pxy_dc.lock);
+	if (!f->valid || f->meta.change != change) {
+		pxy_dc_drop(f);
+		f->meta.change = change;
+		f->valid = pxy_dc_write_meta(f);
+	}
+	f->validated = now;
+	PTHREAD_MUTEX_unlock(&pxy_dc.lock);
+
+	return NFS4_OK;
+}
+
+static ssize_t pxy_dc_load(struct pxy_dc_file *f, uint64_t blk, char *buf,
+			   size_t bs)
+{
+	char path[PXY_DC_NAMELEN];
+	ssize_t n;
+	int fd;
+
+	pxy_dc_block_path(f->key, blk, path);
+	fd = openat(pxy_dc.dirfd, path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	n = pread(fd, buf, bs, 0);
+	close(fd);
+
+	return n;
+}
+
+/*
+ * Store a block read from the server, unless the blocks were dropped
+ * since or there is no room for it.
+ */
+static void pxy_dc_store(struct pxy_dc_file *f, uint64_t blk, uint32_t gen,
+			 const char *buf, size_t len)
+{
+	char tmp[PXY_DC_NAMELEN], path[PXY_DC_NAMELEN];
+	struct stat st;
+	bool stored = false;
+	ssize_t n;
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%016" PRIx64 "/tmp%" PRIu32, f->key,
+		 atomic_inc_uint32_t(&pxy_dc.tmpseq));
+	fd = openat(pxy_dc.dirfd, tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return;
+	n = write(fd, buf, len);
+	close(fd);
+
+	pxy_dc_block_path(f->key, blk, path);
+
+	PTHREAD_MUTEX_lock(&pxy_dc.lock);
+	if (n == (ssize_t)len && f->valid && gen == f->gen) {
+		uint64_t old = 0;
+
+		if (fstatat(pxy_dc.dirfd, path, &st, 0) == 0)
+			old = st.st_size;
+
+		pxy_dc_evict(len);
+		if (pxy_dc.bytes + len <= pxy_dc.params->data_cache_size + old &&
+		    renameat(pxy_dc.dirfd, tmp, pxy_dc.dirfd, path) == 0) {
+			f->bytes += len - old;
+			pxy_dc.bytes += len - old;
+			stored = true;
+		}
+	}
+	PTHREAD_MUTEX_unlock(&pxy_dc.lock);
+
+	if (!stored)
+		(void) unlinkat(pxy_dc.dirfd, tmp, 0);
+}
+
+int pxy_dc_read(const nfs_fh4 *fh, uint64_t fileid, uint64_t offset,
+		size_t size, char *buffer, size_t *read_amount,
+		bool *end_of_file)
+{
+	size_t bs = pxy_dc.params ? pxy_dc.params->data_cache_block_size : 0;
+	struct pxy_dc_file *f;
+	char *blkbuf;
+	int rc;
+
+	if (pxy_dc.dirfd < 0)
+		return -1;
+
+	f = pxy_dc_get(fh, fileid);
+	if (f == NULL)
+		return -1;
+
+	rc = pxy_dc_revalidate(f, fh);
+	if (rc != NFS4_OK) {
+		pxy_dc_put(f);
+		return rc;
+	}
+
+	blkbuf = gsh_malloc(bs);
+	*read_amount = 0;
+	*end_of_file = false;
+
+	while (*read_amount < size) {
+		uint64_t pos = offset + *read_amount;
+		uint64_t blk = pos / bs;
+		size_t boff = pos % bs;
+		ssize_t len = pxy_dc_load(f, blk, blkbuf, bs);
+		size_t n;
+
+		if (len < 0) {
+			uint64_t change, want;
+			uint32_t gen;
+			size_t got;
+
+			PTHREAD_MUTEX_lock(&pxy_dc.lock);
+			gen = f->gen;
+			want = f->meta.change;
+			PTHREAD_MUTEX_unlock(&pxy_dc.lock);
+
+			rc = pxy_fetch_data(fh, blk * bs, bs, blkbuf, &got,
+					    &change);
+			if (rc != NFS4_OK)
+				break;
+
+			if (change == want) {
+				pxy_dc_store(f, blk, gen, blkbuf, got);
+			} else {
+				/* Changed under us, check again next time */
+				PTHREAD_MUTEX_lock(&pxy_dc.lock);
+				if (gen == f->gen) {
+					pxy_dc_drop(f);
+					f->valid = false;
+				}
+				PTHREAD_MUTEX_unlock(&pxy_dc.lock);
+			}
+			len = got;
+		}
+
+		if (boff >= (size_t)len) {
+			*end_of_file = true;
+			break;
+		}
+
+		n = MIN(len - boff, size - *read_amount);
+		memcpy(buffer + *read_amount, blkbuf + boff, n);
+		*read_amount += n;
+
+		if ((size_t)len < bs && boff + n == (size_t)len) {
+			*end_of_file = true;
+			break;
+		}
+	}
+
+	gsh_free(blkbuf);
+	pxy_dc_put(f);
+
+	/* Hand back what was read before an error */
+	if (rc != NFS4_OK && *read_amount != 0)
+		rc = NFS4_OK;
+	return rc;
+}
+
+void pxy_dc_invalidate(const nfs_fh4 *fh)
+{
+	uint64_t key;
+	struct pxy_dc_file *f;
+
+	if (pxy_dc.dirfd < 0)
+		return;
+
+	key = CityHash64(fh->nfs_fh4_val, fh->nfs_fh4_len);
+
+	PTHREAD_MUTEX_lock(&pxy_dc.lock);
+	f = pxy_dc_lookup(key);
+	if (f != NULL && pxy_dc_same_fh(f, fh) && f->valid) {
+		pxy_dc_drop(f);
+		f->valid = false;
+	}
+	PTHREAD_MUTEX_unlock(&pxy_dc.lock);
+}
+
+int pxy_dc_init(const struct pxy_client_params *params)
+{
+	int i;
+
+	if (params->data_cache_dir == NULL)
+		return 0;
+
+	if (mkdir(params->data_cache_dir, 0700) != 0 && errno != EEXIST) {
+		LogCrit(COMPONENT_FSAL, "Cannot create %s: %s",
+			params->data_cache_dir, strerror(errno));
+		return errno;
+	}
+
+	pxy_dc.dirfd = open(params->data_cache_dir, O_RDONLY | O_DIRECTORY);
+	if (pxy_dc.dirfd < 0) {
+		LogCrit(COMPONENT_FSAL, "Cannot open %s: %s",
+			params->data_cache_dir, strerror(errno));
+		return errno;
+	}
+
+	pxy_dc.params = params;
+	for (i = 0; i < PXY_DC_BUCKETS; i++)
+		glist_init(&pxy_dc.buckets[i]);
+	glist_init(&pxy_dc.lru);
+
+	if (params->data_cache_pin_file != NULL)
+		pxy_dc_load_pins(params->data_cache_pin_file);
+
+	PTHREAD_MUTEX_lock(&pxy_dc.lock);
+	pxy_dc_scan();
+	pxy_dc_evict(0);
+	PTHREAD_MUTEX_unlock(&pxy_dc.lock);
+
+	LogEvent(COMPONENT_FSAL, "Data cache in %s holds %" PRIu64 " bytes",
+		 params->data_cache_dir, pxy_dc.bytes);
+	return 0;
+}
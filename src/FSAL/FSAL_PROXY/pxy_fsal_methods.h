@@ -14,6 +14,17 @@ struct pxy_client_params {
 	unsigned int srv_timeout;
 	uint16_t srv_port;
 	unsigned int use_privileged_client_port;
+	unsigned int num_connections;
+	unsigned int max_contexts;
+	unsigned int minorversion;
+	unsigned int session_slots;
+	unsigned int getattr_batch_window;
+	unsigned int getattr_batch_max;
+	char *data_cache_dir;
+	uint64_t data_cache_size;
+	unsigned int data_cache_block_size;
+	unsigned int data_cache_revalidate;
+	char *data_cache_pin_file;
 	char *remote_principal;
 	char *keytab;
 	unsigned int cred_lifetime;
@@ -43,6 +54,16 @@ void pxy_handle_ops_init(struct fsal_obj_ops *ops);
 
 int pxy_init_rpc(const struct pxy_fsal_module *);
 
+int pxy_fetch_change(const nfs_fh4 *fh, uint64_t *change);
+int pxy_fetch_data(const nfs_fh4 *fh, uint64_t offset, size_t size,
+		   char *buffer, size_t *got, uint64_t *change);
+
+int pxy_dc_init(const struct pxy_client_params *);
+int pxy_dc_read(const nfs_fh4 *fh, uint64_t fileid, uint64_t offset,
+		size_t size, char *buffer, size_t *read_amount,
+		bool *end_of_file);
+void pxy_dc_invalidate(const nfs_fh4 *fh);
+
 fsal_status_t pxy_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
 				 const struct req_op_context *opctx,
 				 unsigned int cookie,
@@ -51,6 +51,10 @@ static void release(struct fsal_obj_handle *obj_hdl)
 		container_of(obj_hdl, struct rgw_handle, handle);
 	struct rgw_export *export = obj->export;
 
+	if (rgw_stage_release(obj) < 0)
+		LogCrit(COMPONENT_FSAL,
+			"Lost staged writes of obj_hdl %p", obj_hdl);
+
 	if (obj->rgw_fh != export->rgw_fs->root_fh) {
 		/* release RGW ref */
 		(void) rgw_fh_rele(export->rgw_fs, obj->rgw_fh,
@@ -378,6 +382,13 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 		return rgw2fsal_error(rc);
 	}
 
+	/* RGW doesn't know about staged writes yet */
+	PTHREAD_MUTEX_lock(&handle->stage.lock);
+	if (handle->stage.wlen != 0 &&
+	    handle->stage.woff + handle->stage.wlen > st.st_size)
+		st.st_size = handle->stage.woff + handle->stage.wlen;
+	PTHREAD_MUTEX_unlock(&handle->stage.lock);
+
 	posix2fsal_attributes(&st, attrs);
 
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -463,8 +474,12 @@ fsal_status_t rgw_fsal_setattr2(struct fsal_obj_handle *obj_hdl,
 	memset(&st, 0, sizeof(struct stat));
 
 	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_SIZE)) {
-		rc = rgw_truncate(export->rgw_fs, handle->rgw_fh,
-				attrib_set->filesize, RGW_TRUNCATE_FLAG_NONE);
+		/* staged writes go first, read ahead data is stale */
+		rc = rgw_stage_release(handle);
+		if (rc == 0)
+			rc = rgw_truncate(export->rgw_fs, handle->rgw_fh,
+					  attrib_set->filesize,
+					  RGW_TRUNCATE_FLAG_NONE);
 
 		if (rc < 0) {
 			status = rgw2fsal_error(rc);
@@ -1265,9 +1280,6 @@ fsal_status_t rgw_fsal_read2(struct fsal_obj_handle *obj_hdl,
 			bool *end_of_file,
 			struct io_info *info)
 {
-	struct rgw_export *export =
-	    container_of(op_ctx->fsal_export, struct rgw_export, export);
-
 	struct rgw_handle *handle = container_of(obj_hdl, struct rgw_handle,
 						 handle);
 
@@ -1282,14 +1294,13 @@ fsal_status_t rgw_fsal_read2(struct fsal_obj_handle *obj_hdl,
 	/* RGW does not support a file descriptor abstraction--so
 	 * reads are handle based */
 
-	int rc = rgw_read(export->rgw_fs, handle->rgw_fh, offset,
-			buffer_size, read_amount, buffer,
-			RGW_READ_FLAG_NONE);
+	int rc = rgw_stage_read(handle, offset, buffer_size, read_amount,
+				buffer);
 
 	if (rc < 0)
 		return rgw2fsal_error(rc);
 
-	*end_of_file = (read_amount == 0);
+	*end_of_file = (*read_amount == 0);
 
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
@@ -1344,9 +1355,8 @@ fsal_status_t rgw_fsal_write2(struct fsal_obj_handle *obj_hdl,
 
 	/* XXX note no call to fsal_find_fd (or wrapper) */
 
-	int rc = rgw_write(export->rgw_fs, handle->rgw_fh, offset,
-			buffer_size, wrote_amount, buffer,
-			RGW_WRITE_FLAG_NONE);
+	int rc = rgw_stage_write(handle, offset, buffer_size, wrote_amount,
+				 buffer, *fsal_stable);
 
 	LogFullDebug(COMPONENT_FSAL,
 		"%s post obj_hdl %p state %p returned %d", __func__, obj_hdl,
@@ -1397,6 +1407,10 @@ fsal_status_t rgw_fsal_commit2(struct fsal_obj_handle *obj_hdl,
 		"%s enter obj_hdl %p offset %"PRIx64" length %zx",
 		__func__, obj_hdl, (uint64_t) offset, length);
 
+	rc = rgw_stage_flush(handle);
+	if (rc < 0)
+		return rgw2fsal_error(rc);
+
 	rc = rgw_commit(export->rgw_fs, handle->rgw_fh, offset, length,
 			RGW_FSYNC_FLAG_NONE);
 	if (rc < 0)
@@ -1477,6 +1491,14 @@ fsal_status_t rgw_fsal_close2(struct fsal_obj_handle *obj_hdl,
 		}
 	}
 
+	/* staged writes must reach RGW before the object is closed */
+	rc = rgw_stage_release(handle);
+	if (rc < 0) {
+		(void) rgw_close(export->rgw_fs, handle->rgw_fh,
+				 RGW_CLOSE_FLAG_NONE);
+		return rgw2fsal_error(rc);
+	}
+
 	rc = rgw_close(export->rgw_fs, handle->rgw_fh, RGW_CLOSE_FLAG_NONE);
 	if (rc < 0)
 		return rgw2fsal_error(rc);
@@ -212,6 +212,7 @@ int construct_handle(struct rgw_export *export,
 	constructing->handle.fileid = st->st_ino;
 
 	constructing->export = export;
+	PTHREAD_MUTEX_init(&constructing->stage.lock, NULL);
 
 	*obj = constructing;
 
@@ -220,6 +221,7 @@ int construct_handle(struct rgw_export *export,
 
 void deconstruct_handle(struct rgw_handle *obj)
 {
+	PTHREAD_MUTEX_destroy(&obj->stage.lock);
 	fsal_obj_handle_fini(&obj->handle);
 	gsh_free(obj);
 }
@@ -82,6 +82,26 @@ struct rgw_export {
 	char *rgw_user_id;
 	char *rgw_access_key_id;
 	char *rgw_secret_access_key;
+	uint32_t write_stage_size;	/*< Sequential writes are gathered
+					 *< into chunks of this size */
+	uint32_t readahead_size;	/*< Sequential reads fetch this much */
+	uint64_t stage_mem_max;		/*< Limit on staging buffers */
+	uint64_t stage_mem;		/*< Staging buffers allocated */
+};
+
+/**
+ * Write and readahead buffers of an open file
+ */
+
+struct rgw_stage {
+	pthread_mutex_t lock;
+	char *wbuf;		/*< Writes not yet passed to RGW */
+	uint64_t woff;
+	size_t wlen;
+	char *rbuf;		/*< Data read ahead */
+	uint64_t roff;
+	size_t rlen;
+	uint64_t rnext;		/*< Where a sequential read would start */
 };
 
 /**
@@ -97,6 +117,7 @@ struct rgw_handle {
 					 *< belongs to */
 	struct fsal_share share;
 	fsal_openflags_t openflags;
+	struct rgw_stage stage;
 };
 
 /**
@@ -151,4 +172,11 @@ struct state_t *alloc_state(struct fsal_export *exp_hdl,
 			enum state_type state_type,
 			struct state_t *related_state);
 void rgw_fs_invalidate(void *handle, struct rgw_fh_hk fh_hk);
+
+int rgw_stage_read(struct rgw_handle *handle, uint64_t offset, size_t len,
+		   size_t *read_amount, void *buffer);
+int rgw_stage_write(struct rgw_handle *handle, uint64_t offset, size_t len,
+		    size_t *wrote_amount, void *buffer, bool stable);
+int rgw_stage_flush(struct rgw_handle *handle);
+int rgw_stage_release(struct rgw_handle *handle);
 #endif				/* !FSAL_RGW_INTERNAL_INTERNAL */
@@ -165,6 +165,12 @@ static struct config_item export_params[] = {
 		      rgw_export, rgw_access_key_id),
 	CONF_MAND_STR("secret_access_key", 0, MAXSECRETLEN, NULL,
 		      rgw_export, rgw_secret_access_key),
+	CONF_ITEM_UI32("Write_Stage_Size", 0, 64 * 1024 * 1024,
+		       4 * 1024 * 1024, rgw_export, write_stage_size),
+	CONF_ITEM_UI32("Readahead_Size", 0, 64 * 1024 * 1024,
+		       4 * 1024 * 1024, rgw_export, readahead_size),
+	CONF_ITEM_UI64("Stage_Mem_Max", 0, UINT64_MAX,
+		       256 * 1024 * 1024, rgw_export, stage_mem_max),
 	CONFIG_EOL
 };
 
@@ -0,0 +1,288 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file   FSAL_RGW/stage.c
+ *
+ * @brief Write staging and readahead
+ *
+ * NFS clients write in chunks of at most fs_maxwrite, and each
+ * rgw_write of such a chunk becomes RADOS operations of its own.
+ * Sequential writes are gathered here into Write_Stage_Size chunks,
+ * which RGW stores as whole stripes of the object.  In the same way,
+ * a read that continues where the previous one ended fetches
+ * Readahead_Size bytes at once and the following reads are served
+ * from that buffer.
+ *
+ * Buffers are charged to the export and given up when the file is
+ * closed.  Once an export has Stage_Mem_Max bytes of buffers, I/O on
+ * further files goes straight to RGW.
+ */
+
+#include "fsal.h"
+#include "fsal_types.h"
+#include "abstract_atomic.h"
+#include "internal.h"
+
+/**
+ * @brief Get a staging buffer charged to an export
+ *
+ * @return false if the export has no staging memory left.
+ */
+
+static bool stage_alloc(struct rgw_export *export, char **buf, size_t size)
+{
+	if (atomic_add_uint64_t(&export->stage_mem, size) >
+	    export->stage_mem_max) {
+		atomic_sub_uint64_t(&export->stage_mem, size);
+		return false;
+	}
+
+	*buf = gsh_malloc(size);
+	return true;
+}
+
+static void stage_free(struct rgw_export *export, char **buf, size_t size)
+{
+	if (*buf == NULL)
+		return;
+
+	gsh_free(*buf);
+	*buf = NULL;
+	atomic_sub_uint64_t(&export->stage_mem, size);
+}
+
+/**
+ * @brief Forget what was read ahead
+ */
+
+static void stage_drop_read(struct rgw_handle *handle)
+{
+	struct rgw_stage *st = &handle->stage;
+
+	stage_free(handle->export, &st->rbuf, handle->export->readahead_size);
+	st->rlen = 0;
+}
+
+/**
+ * @brief Pass staged writes to RGW
+ *
+ * Called with the stage lock held.  Staged data is dropped even if
+ * the write fails, the error is returned to the caller instead.
+ *
+ * @return 0 or a negative error code.
+ */
+
+static int stage_flush_locked(struct rgw_handle *handle)
+{
+	struct rgw_stage *st = &handle->stage;
+	size_t written = 0;
+	int rc;
+
+	if (st->wlen == 0)
+		return 0;
+
+	rc = rgw_write(handle->export->rgw_fs, handle->rgw_fh, st->woff,
+		       st->wlen, &written, st->wbuf, RGW_WRITE_FLAG_NONE);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "%s obj_hdl %p offset %"PRIu64" length %zu returned %d",
+		     __func__, &handle->handle, st->woff, st->wlen, rc);
+
+	if (rc == 0 && written != st->wlen)
+		rc = -EIO;
+
+	st->woff += st->wlen;
+	st->wlen = 0;
+
+	return rc;
+}
+
+/**
+ * @brief Read from a file through its readahead buffer
+ *
+ * A read starting where the previous one ended fetches Readahead_Size
+ * bytes.  A read that hits the buffer gets what the buffer holds,
+ * which may be less than asked for.
+ *
+ * @return 0 or a negative error code.
+ */
+
+int rgw_stage_read(struct rgw_handle *handle, uint64_t offset, size_t len,
+		   size_t *read_amount, void *buffer)
+{
+	struct rgw_export *export = handle->export;
+	struct rgw_stage *st = &handle->stage;
+	size_t ra = export->readahead_size;
+	size_t n;
+	int rc = 0;
+
+	PTHREAD_MUTEX_lock(&st->lock);
+
+	/* RGW must see staged writes before reading past their start */
+	if (st->wlen != 0 && offset + len > st->woff) {
+		rc = stage_flush_locked(handle);
+		if (rc < 0)
+			goto out;
+	}
+
+	if (st->rlen != 0 && offset >= st->roff &&
+	    offset < st->roff + st->rlen) {
+		n = MIN(len, st->roff + st->rlen - offset);
+		memcpy(buffer, st->rbuf + (offset - st->roff), n);
+		*read_amount = n;
+		st->rnext = offset + n;
+		goto out;
+	}
+
+	if (offset == st->rnext && len < ra &&
+	    (st->rbuf != NULL || stage_alloc(export, &st->rbuf, ra))) {
+		st->rlen = 0;
+		rc = rgw_read(export->rgw_fs, handle->rgw_fh, offset, ra,
+			      &st->rlen, st->rbuf, RGW_READ_FLAG_NONE);
+		if (rc < 0) {
+			st->rlen = 0;
+			goto out;
+		}
+		st->roff = offset;
+		n = MIN(len, st->rlen);
+		memcpy(buffer, st->rbuf, n);
+		*read_amount = n;
+	} else {
+		rc = rgw_read(export->rgw_fs, handle->rgw_fh, offset, len,
+			      read_amount, buffer, RGW_READ_FLAG_NONE);
+		if (rc < 0)
+			goto out;
+	}
+
+	st->rnext = offset + *read_amount;
+
+ out:
+	PTHREAD_MUTEX_unlock(&st->lock);
+
+	return rc;
+}
+
+/**
+ * @brief Write to a file through its staging buffer
+ *
+ * A write continuing the staged data is appended to it, and the
+ * buffer goes to RGW each time it fills.  Other writes first send what
+ * is staged.  Stable writes and writes of a whole stage or more go
+ * straight to RGW.
+ *
+ * @return 0 or a negative error code.
+ */
+
+int rgw_stage_write(struct rgw_handle *handle, uint64_t offset, size_t len,
+		    size_t *wrote_amount, void *buffer, bool stable)
+{
+	struct rgw_export *export = handle->export;
+	struct rgw_stage *st = &handle->stage;
+	size_t size = export->write_stage_size;
+	size_t n;
+	int rc = 0;
+
+	PTHREAD_MUTEX_lock(&st->lock);
+
+	stage_drop_read(handle);
+
+	if (st->wlen != 0 && (stable || offset != st->woff + st->wlen)) {
+		rc = stage_flush_locked(handle);
+		if (rc < 0)
+			goto out;
+	}
+
+	if (stable || len >= size ||
+	    (st->wbuf == NULL && !stage_alloc(export, &st->wbuf, size))) {
+		rc = stage_flush_locked(handle);
+		if (rc < 0)
+			goto out;
+		rc = rgw_write(export->rgw_fs, handle->rgw_fh, offset, len,
+			       wrote_amount, buffer, RGW_WRITE_FLAG_NONE);
+		goto out;
+	}
+
+	if (st->wlen == 0)
+		st->woff = offset;
+
+	n = MIN(len, size - st->wlen);
+	memcpy(st->wbuf + st->wlen, buffer, n);
+	st->wlen += n;
+
+	if (st->wlen == size) {
+		rc = stage_flush_locked(handle);
+		if (rc < 0)
+			goto out;
+	}
+
+	if (n < len) {
+		memcpy(st->wbuf, (char *)buffer + n, len - n);
+		st->wlen = len - n;
+	}
+
+	*wrote_amount = len;
+
+ out:
+	PTHREAD_MUTEX_unlock(&st->lock);
+
+	return rc;
+}
+
+/**
+ * @brief Pass staged writes to RGW
+ *
+ * @return 0 or a negative error code.
+ */
+
+int rgw_stage_flush(struct rgw_handle *handle)
+{
+	int rc;
+
+	PTHREAD_MUTEX_lock(&handle->stage.lock);
+	rc = stage_flush_locked(handle);
+	PTHREAD_MUTEX_unlock(&handle->stage.lock);
+
+	return rc;
+}
+
+/**
+ * @brief Give up the buffers of a file
+ *
+ * Staged writes are passed to RGW first.
+ *
+ * @return 0 or a negative error code from writing staged data.
+ */
+
+int rgw_stage_release(struct rgw_handle *handle)
+{
+	struct rgw_stage *st = &handle->stage;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&st->lock);
+	rc = stage_flush_locked(handle);
+	stage_drop_read(handle);
+	stage_free(handle->export, &st->wbuf, handle->export->write_stage_size);
+	st->rnext = 0;
+	PTHREAD_MUTEX_unlock(&st->lock);
+
+	return rc;
+}
@@ -67,6 +67,8 @@ int vfs_get_root_fd(struct fsal_export *exp_hdl)
 	return my_root_fs->root_fd;
 }
 
+bool vfs_direct_io_used;
+
 /* export object methods
  */
 
@@ -611,6 +613,9 @@ fsal_status_t vfs_create_export(struct fsal_module *fsal_hdl,
 
 	myself->export.up_ops = up_ops;
 
+	if (myself->direct_io)
+		vfs_direct_io_used = true;
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 
 err_cleanup:
@@ -38,7 +38,15 @@
 #include "fsal_convert.h"
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#ifdef LINUX
+#include <linux/fs.h>		/* for FICLONERANGE */
+#endif
 #include "vfs_methods.h"
+#include "vfs_uring.h"
 #include "os/subr.h"
 #include "sal_data.h"
 
@@ -58,12 +66,23 @@ fsal_status_t vfs_open_my_fd(struct vfs_fsal_obj_handle *myself,
 	assert(my_fd->fd == -1
 	       && my_fd->openflags == FSAL_O_CLOSED && openflags != 0);
 
+	if (myself->obj_handle.type == REGULAR_FILE &&
+	    EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->direct_io)
+		posix_flags |= O_DIRECT;
+
 	LogFullDebug(COMPONENT_FSAL,
 		     "openflags = %x, posix_flags = %x",
 		     openflags, posix_flags);
 
 	fd = vfs_fsal_open(myself, posix_flags, &fsal_error);
 
+	if (fd == -EINVAL && (posix_flags & O_DIRECT)) {
+		/* The filesystem does not do O_DIRECT */
+		fsal_error = ERR_FSAL_NO_ERROR;
+		fd = vfs_fsal_open(myself, posix_flags & ~O_DIRECT,
+				   &fsal_error);
+	}
+
 	if (fd < 0) {
 		retval = -fd;
 	} else {
@@ -173,6 +192,11 @@ fsal_status_t vfs_close(struct fsal_obj_handle *obj_hdl)
 	return status;
 }
 
+/* Slab cache for state_t */
+static struct gsh_slab vfs_state_slab =
+	GSH_SLAB_ARENA_INITIALIZER("VFS state_t", sizeof(struct vfs_state_fd),
+				   MEM_ARENA_SAL);
+
 /**
  * @brief Allocate a state_t structure
  *
@@ -193,7 +217,7 @@ struct state_t *vfs_alloc_state(struct fsal_export *exp_hdl,
 	struct state_t *state;
 	struct vfs_fd *my_fd;
 
-	state = init_state(gsh_calloc(1, sizeof(struct vfs_state_fd)),
+	state = init_state(gsh_slab_alloc(&vfs_state_slab),
 			   exp_hdl, state_type, related_state);
 
 	my_fd = &container_of(state, struct vfs_state_fd, state)->vfs_fd;
@@ -215,7 +239,7 @@ void vfs_free_state(struct fsal_export *exp_hdl, struct state_t *state)
 	struct vfs_state_fd *state_fd = container_of(state, struct vfs_state_fd,
 						     state);
 
-	gsh_free(state_fd);
+	gsh_slab_free(&vfs_state_slab, state_fd);
 }
 
 /**
@@ -568,7 +592,7 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 		posix_flags |= O_EXCL;
 	}
 
-	dir_fd = vfs_fsal_open(myself, O_PATH | O_NOACCESS, &status.major);
+	dir_fd = vfs_dirfd_get(myself, &status.major);
 
 	if (dir_fd < 0)
 		return fsalstat(status.major, -dir_fd);
@@ -587,11 +611,20 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 	if (createmode != FSAL_NO_CREATE)
 		fsal_set_credentials(op_ctx->creds);
 
+	if (EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->direct_io)
+		posix_flags |= O_DIRECT;
+
 	if ((posix_flags & O_CREAT) != 0)
 		fd = openat(dir_fd, name, posix_flags, unix_mode);
 	else
 		fd = openat(dir_fd, name, posix_flags);
 
+	if (fd == -1 && errno == EINVAL && (posix_flags & O_DIRECT)) {
+		/* The filesystem does not do O_DIRECT */
+		posix_flags &= ~O_DIRECT;
+		fd = openat(dir_fd, name, posix_flags, unix_mode);
+	}
+
 	if (fd == -1 && errno == EEXIST && createmode == FSAL_UNCHECKED) {
 		/* We tried to create O_EXCL to set attributes and failed.
 		 * Remove O_EXCL and retry. We still try O_CREAT again just in
@@ -745,7 +778,7 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 		posix2fsal_attributes(&stat, attrs_out);
 	}
 
-	close(dir_fd);
+	vfs_dirfd_put(myself, dir_fd);
 
 	if (state != NULL) {
 		/* Prepare to take the share reservation, but only if we are
@@ -776,7 +809,7 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 
  direrr:
 
-	close(dir_fd);
+	vfs_dirfd_put(myself, dir_fd);
 	return fsalstat(posix2fsal_error(retval), retval);
 }
 
@@ -959,8 +992,296 @@ fsal_status_t find_fd(int *fd,
 	return status;
 }
 
+#ifdef RWF_DSYNC
+/* Cleared the first time the kernel rejects pwritev2 with RWF_DSYNC,
+ * after which stable writes fall back to pwritev + fsync. */
+static bool vfs_rwf_dsync = true;
+#endif
+
 /**
- * @brief Read data from a file
+ * @brief Vectored positional read
+ *
+ * Goes through the io_uring engine when it is enabled.
+ *
+ * @return Bytes read or -1 with errno set.
+ */
+static ssize_t vfs_preadv(int fd, const struct iovec *iov, int iovcnt,
+			  uint64_t offset)
+{
+#ifdef USE_IO_URING
+	ssize_t res;
+
+	if (vfs_uring_enabled() &&
+	    vfs_uring_rw(fd, false, iov, iovcnt, offset, 0, &res) == 0) {
+		if (res >= 0)
+			return res;
+		errno = -res;
+		return -1;
+	}
+#endif
+
+	if (iovcnt == 1)
+		return pread(fd, iov[0].iov_base, iov[0].iov_len, offset);
+
+	return preadv(fd, iov, iovcnt, offset);
+}
+
+/**
+ * @brief Vectored positional write with RWF_* flags
+ *
+ * Goes through the io_uring engine when it is enabled.
+ *
+ * @return Bytes written or -1 with errno set.
+ */
+static ssize_t vfs_pwritev_flags(int fd, const struct iovec *iov, int iovcnt,
+				 uint64_t offset, int rw_flags)
+{
+#ifdef USE_IO_URING
+	ssize_t res;
+
+	if (vfs_uring_enabled() &&
+	    vfs_uring_rw(fd, true, iov, iovcnt, offset, rw_flags, &res) == 0) {
+		if (res >= 0)
+			return res;
+		errno = -res;
+		return -1;
+	}
+#endif
+
+#ifdef RWF_DSYNC
+	if (rw_flags != 0)
+		return pwritev2(fd, iov, iovcnt, offset, rw_flags);
+#endif
+
+	if (iovcnt == 1)
+		return pwrite(fd, iov[0].iov_base, iov[0].iov_len, offset);
+
+	return pwritev(fd, iov, iovcnt, offset);
+}
+
+/**
+ * @brief Vectored positional write, optionally data-synchronous
+ *
+ * @param[in]     fd      File descriptor
+ * @param[in]     iov     Segments to write
+ * @param[in]     iovcnt  Number of segments
+ * @param[in]     offset  Position at which to write
+ * @param[in,out] stable  In, whether the data must be stable.  Out,
+ *                        whether it was made stable by the write itself.
+ *
+ * @return Bytes written or -1 with errno set.
+ */
+static ssize_t vfs_pwritev(int fd, const struct iovec *iov, int iovcnt,
+			   uint64_t offset, bool *stable)
+{
+#ifdef RWF_DSYNC
+	if (*stable && vfs_rwf_dsync) {
+		ssize_t nb_written;
+
+		nb_written = vfs_pwritev_flags(fd, iov, iovcnt, offset,
+					       RWF_DSYNC);
+		if (nb_written != -1 ||
+		    (errno != EOPNOTSUPP && errno != ENOSYS))
+			return nb_written;
+
+		LogInfo(COMPONENT_FSAL,
+			"pwritev2 with RWF_DSYNC not supported, using fsync for stable writes");
+		vfs_rwf_dsync = false;
+	}
+#endif
+
+	*stable = false;
+
+	return vfs_pwritev_flags(fd, iov, iovcnt, offset, 0);
+}
+
+/* Alignment O_DIRECT I/O is held to, in the file and in memory */
+#define VFS_DIO_ALIGN 4096
+
+/**
+ * @brief The part of an I/O an O_DIRECT fd can take
+ *
+ * The I/O is taken from its start for as long as the file position and
+ * the memory stay VFS_DIO_ALIGN aligned: n whole segments, then the
+ * first head bytes of the next one.
+ */
+struct vfs_dio_split {
+	int n;
+	size_t head;
+	size_t aligned;		/*< Bytes in the n segments and head */
+	size_t total;		/*< Bytes in the I/O */
+};
+
+/**
+ * @brief Whether a file descriptor was opened with O_DIRECT
+ *
+ * A global fd is shared by the exports of a file, so this is asked of
+ * the fd rather than of the export.
+ */
+static bool vfs_fd_direct(int fd)
+{
+	int flags;
+
+	if (!vfs_direct_io_used)
+		return false;
+
+	flags = fcntl(fd, F_GETFL);
+
+	return flags != -1 && (flags & O_DIRECT) != 0;
+}
+
+static void vfs_dio_split(const struct iovec *iov, int iovcnt,
+			  uint64_t offset, struct vfs_dio_split *split)
+{
+	int i;
+
+	split->n = iovcnt;
+	split->head = 0;
+	split->aligned = 0;
+	split->total = 0;
+
+	for (i = 0; i < iovcnt; i++)
+		split->total += iov[i].iov_len;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (((offset + split->aligned) |
+		     (uintptr_t) iov[i].iov_base) & (VFS_DIO_ALIGN - 1)) {
+			split->n = i;
+			return;
+		}
+		if (iov[i].iov_len & (VFS_DIO_ALIGN - 1)) {
+			split->n = i;
+			split->head = iov[i].iov_len & ~(VFS_DIO_ALIGN - 1UL);
+			split->aligned += split->head;
+			return;
+		}
+		split->aligned += iov[i].iov_len;
+	}
+}
+
+/**
+ * @brief Open a buffered fd for the unaligned part of an O_DIRECT I/O
+ *
+ * This is done with the server's credentials, before those of the
+ * request are set.
+ *
+ * @param[in]  obj_hdl     File on which to operate
+ * @param[in]  write       Whether the I/O is a write
+ * @param[in]  split       The I/O's split
+ * @param[out] buffered_fd The fd, -1 if the I/O is all aligned
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t vfs_dio_open_buffered(struct fsal_obj_handle *obj_hdl,
+					   bool write,
+					   const struct vfs_dio_split *split,
+					   int *buffered_fd)
+{
+	struct vfs_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	int rc;
+
+	*buffered_fd = -1;
+
+	if (split->aligned == split->total)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	rc = vfs_fsal_open(myself, write ? O_WRONLY : O_RDONLY, &fsal_error);
+	if (rc < 0)
+		return fsalstat(posix2fsal_error(-rc), -rc);
+
+	*buffered_fd = rc;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief One piece of a split I/O
+ *
+ * @return false when the I/O is over, on an error or a short count.
+ */
+static bool vfs_dio_step(int fd, bool write, const struct iovec *iov,
+			 int iovcnt, uint64_t offset, size_t len,
+			 bool *stable, ssize_t *done)
+{
+	bool synced = write && *stable;
+	ssize_t res;
+
+	if (len == 0)
+		return true;
+
+	if (write) {
+		res = vfs_pwritev(fd, iov, iovcnt, offset + *done, &synced);
+		if (!synced)
+			*stable = false;
+	} else {
+		res = vfs_preadv(fd, iov, iovcnt, offset + *done);
+	}
+
+	if (res == -1) {
+		/* What was moved before the error is a short count */
+		if (*done == 0)
+			*done = -1;
+		return false;
+	}
+
+	*done += res;
+	return (size_t) res == len;
+}
+
+/**
+ * @brief Read or write through an O_DIRECT file descriptor
+ *
+ * The aligned start of the I/O, which for the page aligned payloads of
+ * a stream is all of it but the last bytes of a file, goes through the
+ * O_DIRECT fd.  The rest goes through the buffered one.
+ *
+ * @param[in]     fd          O_DIRECT file descriptor
+ * @param[in]     buffered_fd Buffered fd on the same file, if needed
+ * @param[in]     write       Whether to write
+ * @param[in]     iov         Segments
+ * @param[in]     iovcnt      Number of segments
+ * @param[in]     offset      Position of the I/O
+ * @param[in]     split       The I/O's split
+ * @param[in,out] stable      For writes, as for vfs_pwritev
+ *
+ * @return Bytes moved or -1 with errno set.
+ */
+static ssize_t vfs_dio_rw(int fd, int buffered_fd, bool write,
+			  const struct iovec *iov, int iovcnt,
+			  uint64_t offset, const struct vfs_dio_split *split,
+			  bool *stable)
+{
+	const struct iovec *rest = iov + split->n;
+	struct iovec piece;
+	ssize_t done = 0;
+
+	if (!vfs_dio_step(fd, write, iov, split->n, offset,
+			  split->aligned - split->head, stable, &done) ||
+	    split->n == iovcnt)
+		return done;
+
+	piece.iov_base = rest->iov_base;
+	piece.iov_len = split->head;
+	if (!vfs_dio_step(fd, write, &piece, 1, offset, piece.iov_len,
+			  stable, &done))
+		return done;
+
+	piece.iov_base = (char *) rest->iov_base + split->head;
+	piece.iov_len = rest->iov_len - split->head;
+	if (!vfs_dio_step(buffered_fd, write, &piece, 1, offset,
+			  piece.iov_len, stable, &done))
+		return done;
+
+	(void) vfs_dio_step(buffered_fd, write, rest + 1,
+			    iovcnt - split->n - 1, offset,
+			    split->total - done, stable, &done);
+
+	return done;
+}
+
+/**
+ * @brief Read data from a file into an iovec
  *
  * This function reads data from the given file. The FSAL must be able to
  * perform the read whether a state is presented or not. This function also
@@ -971,8 +1292,8 @@ fsal_status_t find_fd(int *fd,
  *                               bypass any deny read
  * @param[in]     state          state_t to use for this operation
  * @param[in]     offset         Position from which to read
- * @param[in]     buffer_size    Amount of data to read
- * @param[out]    buffer         Buffer to which data are to be copied
+ * @param[in]     iov            Segments to which data are to be copied
+ * @param[in]     iovcnt         Number of segments
  * @param[out]    read_amount    Amount of data read
  * @param[out]    end_of_file    true if the end of file has been reached
  * @param[in,out] info           more information about the data
@@ -980,17 +1301,19 @@ fsal_status_t find_fd(int *fd,
  * @return FSAL status.
  */
 
-fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
-			bool bypass,
-			struct state_t *state,
-			uint64_t offset,
-			size_t buffer_size,
-			void *buffer,
-			size_t *read_amount,
-			bool *end_of_file,
-			struct io_info *info)
+fsal_status_t vfs_readv2(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct state_t *state,
+			 uint64_t offset,
+			 const struct iovec *iov,
+			 int iovcnt,
+			 size_t *read_amount,
+			 bool *end_of_file,
+			 struct io_info *info)
 {
-	int my_fd = -1;
+	int my_fd = -1, buffered_fd = -1;
+	struct vfs_dio_split split = {0};
+	bool direct;
 	ssize_t nb_read;
 	fsal_status_t status;
 	int retval = 0;
@@ -1016,7 +1339,18 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
-	nb_read = pread(my_fd, buffer, buffer_size, offset);
+	direct = vfs_fd_direct(my_fd);
+	if (direct) {
+		vfs_dio_split(iov, iovcnt, offset, &split);
+		status = vfs_dio_open_buffered(obj_hdl, false, &split,
+					       &buffered_fd);
+		if (FSAL_IS_ERROR(status))
+			goto out;
+		nb_read = vfs_dio_rw(my_fd, buffered_fd, false, iov, iovcnt,
+				     offset, &split, NULL);
+	} else {
+		nb_read = vfs_preadv(my_fd, iov, iovcnt, offset);
+	}
 
 	if (offset == -1 || nb_read == -1) {
 		retval = errno;
@@ -1040,12 +1374,15 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 		info->io_content.what = NFS4_CONTENT_DATA;
 		info->io_content.data.d_offset = offset + nb_read;
 		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
+		info->io_content.data.d_data.data_val = iov[0].iov_base;
 	}
 #endif
 
  out:
 
+	if (buffered_fd >= 0)
+		close(buffered_fd);
+
 	if (closefd)
 		close(my_fd);
 
@@ -1056,7 +1393,45 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 }
 
 /**
- * @brief Write data to a file
+ * @brief Read data from a file
+ *
+ * Single buffer version of vfs_readv2.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position from which to read
+ * @param[in]     buffer_size    Amount of data to read
+ * @param[out]    buffer         Buffer to which data are to be copied
+ * @param[out]    read_amount    Amount of data read
+ * @param[out]    end_of_file    true if the end of file has been reached
+ * @param[in,out] info           more information about the data
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			struct state_t *state,
+			uint64_t offset,
+			size_t buffer_size,
+			void *buffer,
+			size_t *read_amount,
+			bool *end_of_file,
+			struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return vfs_readv2(obj_hdl, bypass, state, offset, &iov, 1,
+			  read_amount, end_of_file, info);
+}
+
+/**
+ * @brief Write data to a file from an iovec
  *
  * This function writes data to a file. The FSAL must be able to
  * perform the write whether a state is presented or not. This function also
@@ -1064,14 +1439,18 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
  * with bypass == true, it will enforce a mandatory (NFSv4) deny_write if
  * an appropriate state is not passed).
  *
- * The FSAL is expected to enforce sync if necessary.
+ * The FSAL is expected to enforce sync if necessary.  Stable writes use
+ * pwritev2 with RWF_DSYNC where the kernel supports it, avoiding a
+ * separate fsync.
  *
  * @param[in]     obj_hdl        File on which to operate
  * @param[in]     bypass         If state doesn't indicate a share reservation,
  *                               bypass any non-mandatory deny write
  * @param[in]     state          state_t to use for this operation
  * @param[in]     offset         Position at which to write
- * @param[in]     buffer         Data to be written
+ * @param[in]     iov            Data to be written
+ * @param[in]     iovcnt         Number of segments
+ * @param[out]    wrote_amount   Number of bytes written
  * @param[in,out] fsal_stable    In, if on, the fsal is requested to write data
  *                               to stable store. Out, the fsal reports what
  *                               it did.
@@ -1080,20 +1459,23 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
  * @return FSAL status.
  */
 
-fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
-			 bool bypass,
-			 struct state_t *state,
-			 uint64_t offset,
-			 size_t buffer_size,
-			 void *buffer,
-			 size_t *wrote_amount,
-			 bool *fsal_stable,
-			 struct io_info *info)
+fsal_status_t vfs_writev2(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct state_t *state,
+			  uint64_t offset,
+			  const struct iovec *iov,
+			  int iovcnt,
+			  size_t *wrote_amount,
+			  bool *fsal_stable,
+			  struct io_info *info)
 {
 	ssize_t nb_written;
+	bool synced = *fsal_stable;
 	fsal_status_t status;
 	int retval = 0;
-	int my_fd = -1;
+	int my_fd = -1, buffered_fd = -1;
+	struct vfs_dio_split split = {0};
+	bool direct;
 	bool has_lock = false;
 	bool closefd = false;
 	fsal_openflags_t openflags = FSAL_O_WRITE;
@@ -1120,9 +1502,22 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
+	direct = vfs_fd_direct(my_fd);
+	if (direct) {
+		vfs_dio_split(iov, iovcnt, offset, &split);
+		status = vfs_dio_open_buffered(obj_hdl, true, &split,
+					       &buffered_fd);
+		if (FSAL_IS_ERROR(status))
+			goto out;
+	}
+
 	fsal_set_credentials(op_ctx->creds);
 
-	nb_written = pwrite(my_fd, buffer, buffer_size, offset);
+	if (direct)
+		nb_written = vfs_dio_rw(my_fd, buffered_fd, true, iov, iovcnt,
+					offset, &split, &synced);
+	else
+		nb_written = vfs_pwritev(my_fd, iov, iovcnt, offset, &synced);
 
 	if (nb_written == -1) {
 		retval = errno;
@@ -1132,7 +1527,7 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 
 	*wrote_amount = nb_written;
 
-	if (*fsal_stable) {
+	if (*fsal_stable && !synced) {
 		retval = fsync(my_fd);
 		if (retval == -1) {
 			retval = errno;
@@ -1142,6 +1537,9 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 
  out:
 
+	if (buffered_fd >= 0)
+		close(buffered_fd);
+
 	if (closefd)
 		close(my_fd);
 
@@ -1152,6 +1550,618 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Write data to a file
+ *
+ * Single buffer version of vfs_writev2.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position at which to write
+ * @param[in]     buffer_size    Amount of data to be written
+ * @param[in]     buffer         Data to be written
+ * @param[out]    wrote_amount   Number of bytes written
+ * @param[in,out] fsal_stable    In, if on, the fsal is requested to write data
+ *                               to stable store. Out, the fsal reports what
+ *                               it did.
+ * @param[in,out] info           more information about the data
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct state_t *state,
+			 uint64_t offset,
+			 size_t buffer_size,
+			 void *buffer,
+			 size_t *wrote_amount,
+			 bool *fsal_stable,
+			 struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return vfs_writev2(obj_hdl, bypass, state, offset, &iov, 1,
+			   wrote_amount, fsal_stable, info);
+}
+
+#ifdef USE_IO_URING
+/**
+ * @brief An asynchronous read or write in flight on the io_uring engine
+ */
+struct vfs_async_io {
+	struct fsal_obj_handle *obj_hdl;
+	fsal_async_cb done_cb;
+	struct fsal_io_arg *io_arg;
+	void *caller_arg;
+	bool write;
+};
+
+static void vfs_async_io_done(void *arg, ssize_t res)
+{
+	struct vfs_async_io *aio = arg;
+	struct fsal_io_arg *io_arg = aio->io_arg;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+
+	if (res < 0) {
+		status = fsalstat(posix2fsal_error(-res), -res);
+	} else {
+		io_arg->io_amount = res;
+		if (!aio->write)
+			io_arg->end_of_file = (res == 0);
+	}
+
+	aio->done_cb(aio->obj_hdl, status, io_arg, aio->caller_arg);
+	gsh_free(aio);
+}
+
+/**
+ * @brief Try to start a read or write on the io_uring engine
+ *
+ * Only I/O on a state's own file descriptor is done asynchronously; when
+ * find_fd has to lock the global fd or open a temporary one, the fd is
+ * only ours for the duration of the call and the caller must do the I/O
+ * synchronously.
+ *
+ * @return true if submitted; done_cb will be called on completion.
+ */
+static bool vfs_async_submit(struct fsal_obj_handle *obj_hdl, bool bypass,
+			     bool write, fsal_async_cb done_cb,
+			     struct fsal_io_arg *io_arg, void *caller_arg)
+{
+	struct vfs_async_io *aio;
+	fsal_status_t status;
+	int my_fd = -1;
+	bool has_lock = false;
+	bool closefd = false;
+	struct vfs_dio_split split;
+	int rw_flags = 0;
+	int rc;
+
+	if (!vfs_uring_enabled() || io_arg->info != NULL ||
+	    obj_hdl->fsal != obj_hdl->fs->fsal)
+		return false;
+
+	if (write && io_arg->fsal_stable) {
+#ifdef RWF_DSYNC
+		if (!vfs_rwf_dsync)
+			return false;
+		rw_flags = RWF_DSYNC;
+#else
+		return false;
+#endif
+	}
+
+	status = find_fd(&my_fd, obj_hdl, bypass, io_arg->state,
+			 write ? FSAL_O_WRITE : FSAL_O_READ,
+			 &has_lock, &closefd, false);
+
+	/* Let the synchronous path report any error */
+	if (FSAL_IS_ERROR(status))
+		return false;
+
+	if (has_lock || closefd) {
+		if (closefd)
+			close(my_fd);
+		if (has_lock)
+			PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+		return false;
+	}
+
+	if (vfs_fd_direct(my_fd)) {
+		vfs_dio_split(io_arg->iov, io_arg->iov_count, io_arg->offset,
+			      &split);
+		/* An unaligned part needs a buffered fd, go synchronous */
+		if (split.aligned != split.total)
+			return false;
+	}
+
+	aio = gsh_malloc(sizeof(*aio));
+	aio->obj_hdl = obj_hdl;
+	aio->done_cb = done_cb;
+	aio->io_arg = io_arg;
+	aio->caller_arg = caller_arg;
+	aio->write = write;
+
+	if (write)
+		fsal_set_credentials(op_ctx->creds);
+
+	rc = vfs_uring_submit(my_fd, write, io_arg->iov, io_arg->iov_count,
+			      io_arg->offset, rw_flags, vfs_async_io_done,
+			      aio);
+
+	if (write)
+		fsal_restore_ganesha_credentials();
+
+	if (rc != 0) {
+		gsh_free(aio);
+		return false;
+	}
+
+	return true;
+}
+#endif				/* USE_IO_URING */
+
+/**
+ * @brief Read data from a file asynchronously
+ *
+ * When the io_uring engine is enabled the read completes from its
+ * completion thread, otherwise this is vfs_readv2 completed inline.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     done_cb        Callback to call when I/O is done
+ * @param[in,out] read_arg       Info about read, passed back in callback
+ * @param[in]     caller_arg     Opaque arg from the caller for callback
+ */
+
+void vfs_read2_async(struct fsal_obj_handle *obj_hdl,
+		     bool bypass,
+		     fsal_async_cb done_cb,
+		     struct fsal_io_arg *read_arg,
+		     void *caller_arg)
+{
+	fsal_status_t status;
+
+#ifdef USE_IO_URING
+	if (vfs_async_submit(obj_hdl, bypass, false, done_cb, read_arg,
+			     caller_arg))
+		return;
+#endif
+
+	status = vfs_readv2(obj_hdl, bypass, read_arg->state, read_arg->offset,
+			    read_arg->iov, read_arg->iov_count,
+			    &read_arg->io_amount, &read_arg->end_of_file,
+			    read_arg->info);
+
+	done_cb(obj_hdl, status, read_arg, caller_arg);
+}
+
+/**
+ * @brief Write data to a file asynchronously
+ *
+ * When the io_uring engine is enabled the write completes from its
+ * completion thread, otherwise this is vfs_writev2 completed inline.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in]     done_cb        Callback to call when I/O is done
+ * @param[in,out] write_arg      Info about write, passed back in callback
+ * @param[in]     caller_arg     Opaque arg from the caller for callback
+ */
+
+void vfs_write2_async(struct fsal_obj_handle *obj_hdl,
+		      bool bypass,
+		      fsal_async_cb done_cb,
+		      struct fsal_io_arg *write_arg,
+		      void *caller_arg)
+{
+	fsal_status_t status;
+
+#ifdef USE_IO_URING
+	if (vfs_async_submit(obj_hdl, bypass, true, done_cb, write_arg,
+			     caller_arg))
+		return;
+#endif
+
+	status = vfs_writev2(obj_hdl, bypass, write_arg->state,
+			     write_arg->offset, write_arg->iov,
+			     write_arg->iov_count, &write_arg->io_amount,
+			     &write_arg->fsal_stable, write_arg->info);
+
+	done_cb(obj_hdl, status, write_arg, caller_arg);
+}
+
+#ifdef __NR_copy_file_range
+/* Cleared the first time the kernel lacks copy_file_range, after which
+ * copies are read and written through the server. */
+static bool vfs_copy_file_range = true;
+#endif
+
+/**
+ * @brief Copy a range of one file into another
+ *
+ * Uses copy_file_range so the kernel, or the filesystem beneath it, moves
+ * the data.  Files on different filesystems, or kernels without the
+ * system call, are copied with fsal_copy_rw instead.
+ *
+ * @param[in]  src_hdl    File to copy from
+ * @param[in]  src_state  state_t to read with, or NULL
+ * @param[in]  src_offset Position from which to copy
+ * @param[in]  dst_hdl    File to copy to
+ * @param[in]  dst_state  state_t to write with, or NULL
+ * @param[in]  dst_offset Position at which to copy
+ * @param[in]  count      Amount of data to copy
+ * @param[out] copied     Amount of data copied
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_copy(struct fsal_obj_handle *src_hdl,
+		       struct state_t *src_state,
+		       uint64_t src_offset,
+		       struct fsal_obj_handle *dst_hdl,
+		       struct state_t *dst_state,
+		       uint64_t dst_offset,
+		       uint64_t count,
+		       uint64_t *copied)
+{
+#ifdef __NR_copy_file_range
+	fsal_status_t status;
+	int src_fd = -1, dst_fd = -1;
+	bool src_lock = false, src_close = false;
+	bool dst_lock = false, dst_close = false;
+	bool fallback = false;
+	int64_t src_off = src_offset, dst_off = dst_offset;
+	ssize_t nb_copied;
+	int retval = 0;
+
+	*copied = 0;
+
+	if (!vfs_copy_file_range || src_hdl->fs != dst_hdl->fs)
+		goto rw;
+
+	if (src_hdl->fsal != src_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 src_hdl->fsal->name, src_hdl->fs->fsal->name);
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	/* Get usable file descriptors */
+	status = find_fd(&src_fd, src_hdl, false, src_state, FSAL_O_READ,
+			 &src_lock, &src_close, false);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	status = find_fd(&dst_fd, dst_hdl, false, dst_state, FSAL_O_WRITE,
+			 &dst_lock, &dst_close, false);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	/* Copy through read2 and write2, which align O_DIRECT I/O */
+	if (vfs_fd_direct(src_fd) || vfs_fd_direct(dst_fd)) {
+		fallback = true;
+		goto out;
+	}
+
+	if (count > SSIZE_MAX)
+		count = SSIZE_MAX;
+
+	fsal_set_credentials(op_ctx->creds);
+
+	nb_copied = syscall(__NR_copy_file_range, src_fd, &src_off, dst_fd,
+			    &dst_off, (size_t) count, 0);
+	if (nb_copied == -1)
+		retval = errno;
+
+	fsal_restore_ganesha_credentials();
+
+	if (nb_copied != -1) {
+		*copied = nb_copied;
+	} else if (retval == ENOSYS || retval == EOPNOTSUPP) {
+		LogInfo(COMPONENT_FSAL,
+			"copy_file_range not supported, copying through the server");
+		vfs_copy_file_range = false;
+		fallback = true;
+	} else if (retval == EXDEV) {
+		fallback = true;
+	} else {
+		status = fsalstat(posix2fsal_error(retval), retval);
+	}
+
+ out:
+
+	if (dst_close)
+		close(dst_fd);
+
+	if (dst_lock)
+		PTHREAD_RWLOCK_unlock(&dst_hdl->obj_lock);
+
+	if (src_close)
+		close(src_fd);
+
+	if (src_lock)
+		PTHREAD_RWLOCK_unlock(&src_hdl->obj_lock);
+
+	if (!fallback)
+		return status;
+
+ rw:
+#endif
+	return fsal_copy_rw(src_hdl, src_state, src_offset, dst_hdl,
+			    dst_state, dst_offset, count, copied);
+}
+
+/**
+ * @brief Share a range of one file with another
+ *
+ * Uses the FICLONERANGE ioctl, so only filesystems that can reflink,
+ * such as XFS and btrfs, support it.
+ *
+ * @param[in] src_hdl    File to clone from
+ * @param[in] src_state  state_t to read with, or NULL
+ * @param[in] src_offset Position from which to clone
+ * @param[in] dst_hdl    File to clone to
+ * @param[in] dst_state  state_t to write with, or NULL
+ * @param[in] dst_offset Position at which to clone
+ * @param[in] count      Amount to clone, 0 for up to the end of the source
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_clone(struct fsal_obj_handle *src_hdl,
+			struct state_t *src_state,
+			uint64_t src_offset,
+			struct fsal_obj_handle *dst_hdl,
+			struct state_t *dst_state,
+			uint64_t dst_offset,
+			uint64_t count)
+{
+#ifdef FICLONERANGE
+	fsal_status_t status;
+	int src_fd = -1, dst_fd = -1;
+	bool src_lock = false, src_close = false;
+	bool dst_lock = false, dst_close = false;
+	struct file_clone_range range;
+	int retval;
+
+	if (src_hdl->fs != dst_hdl->fs)
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+
+	if (src_hdl->fsal != src_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 src_hdl->fsal->name, src_hdl->fs->fsal->name);
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	/* Get usable file descriptors */
+	status = find_fd(&src_fd, src_hdl, false, src_state, FSAL_O_READ,
+			 &src_lock, &src_close, false);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	status = find_fd(&dst_fd, dst_hdl, false, dst_state, FSAL_O_WRITE,
+			 &dst_lock, &dst_close, false);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	range.src_fd = src_fd;
+	range.src_offset = src_offset;
+	range.src_length = count;
+	range.dest_offset = dst_offset;
+
+	fsal_set_credentials(op_ctx->creds);
+
+	retval = ioctl(dst_fd, FICLONERANGE, &range);
+	if (retval == -1)
+		retval = errno;
+
+	fsal_restore_ganesha_credentials();
+
+	if (retval != 0) {
+		LogDebug(COMPONENT_FSAL, "FICLONERANGE returned %s",
+			 strerror(retval));
+		/* Filesystems that can't reflink fail with either */
+		if (retval == EOPNOTSUPP || retval == ENOTTY)
+			status = fsalstat(ERR_FSAL_NOTSUPP, retval);
+		else
+			status = fsalstat(posix2fsal_error(retval), retval);
+	}
+
+ out:
+
+	if (dst_close)
+		close(dst_fd);
+
+	if (dst_lock)
+		PTHREAD_RWLOCK_unlock(&dst_hdl->obj_lock);
+
+	if (src_close)
+		close(src_fd);
+
+	if (src_lock)
+		PTHREAD_RWLOCK_unlock(&src_hdl->obj_lock);
+
+	return status;
+#else
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+#endif
+}
+
+/**
+ * @brief Seek to data or hole
+ *
+ * Uses lseek with SEEK_DATA or SEEK_HOLE.  Filesystems that don't track
+ * holes report the whole file as data, with the implicit hole at its
+ * end.
+ *
+ * @param[in]     obj_hdl File on which to operate
+ * @param[in]     state   state_t to use for this operation
+ * @param[in,out] info    What to seek and from where, and what was found
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_seek2(struct fsal_obj_handle *obj_hdl,
+			struct state_t *state,
+			struct io_info *info)
+{
+#ifdef SEEK_DATA
+	fsal_status_t status;
+	int my_fd = -1;
+	bool has_lock = false;
+	bool closefd = false;
+	off_t offset = info->io_content.hole.di_offset;
+	off_t found;
+	int whence, retval;
+
+	switch (info->io_content.what) {
+	case NFS4_CONTENT_DATA:
+		whence = SEEK_DATA;
+		break;
+	case NFS4_CONTENT_HOLE:
+		whence = SEEK_HOLE;
+		break;
+	default:
+		return fsalstat(ERR_FSAL_UNION_NOTSUPP, 0);
+	}
+
+	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 obj_hdl->fsal->name, obj_hdl->fs->fsal->name);
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	/* Get a usable file descriptor */
+	status = find_fd(&my_fd, obj_hdl, false, state, FSAL_O_READ,
+			 &has_lock, &closefd, false);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	found = lseek(my_fd, offset, whence);
+
+	if (found == -1) {
+		retval = errno;
+		if (retval == ENXIO) {
+			/* No data from offset on, or offset is past EOF */
+			info->io_eof = true;
+			info->io_content.hole.di_offset = offset;
+			info->io_content.hole.di_length = 0;
+		} else {
+			status = fsalstat(posix2fsal_error(retval), retval);
+		}
+	} else {
+		info->io_eof = false;
+		info->io_content.hole.di_offset = found;
+		info->io_content.hole.di_length = 0;
+	}
+
+ out:
+
+	if (closefd)
+		close(my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+#else
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+#endif
+}
+
+/**
+ * @brief Pass access pattern hints on to the kernel
+ *
+ * Each hint the kernel has an equivalent for is handed to posix_fadvise
+ * over [offset, offset + count), count 0 meaning to the end of the file.
+ * SEQUENTIAL enlarges the readahead window, WILLNEED starts reading the
+ * range in, RANDOM turns readahead off and NORMAL restores it.  The
+ * hints that were applied are returned.
+ *
+ * @param[in]     obj_hdl File on which to operate
+ * @param[in]     state   state_t to use for this operation
+ * @param[in,out] hints   Hints to apply, and the hints applied
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_io_advise2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     struct io_hints *hints)
+{
+	static const struct {
+		uint32_t hint;
+		int advice;
+	} advices[] = {
+		{ IO_ADVISE4_NORMAL, POSIX_FADV_NORMAL },
+		{ IO_ADVISE4_SEQUENTIAL, POSIX_FADV_SEQUENTIAL },
+		{ IO_ADVISE4_RANDOM, POSIX_FADV_RANDOM },
+		{ IO_ADVISE4_WILLNEED, POSIX_FADV_WILLNEED },
+		{ IO_ADVISE4_DONTNEED, POSIX_FADV_DONTNEED },
+		{ IO_ADVISE4_NOREUSE, POSIX_FADV_NOREUSE },
+	};
+	fsal_status_t status;
+	int my_fd = -1;
+	bool has_lock = false;
+	bool closefd = false;
+	uint32_t applied = 0;
+	size_t i;
+	int retval;
+
+	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 obj_hdl->fsal->name, obj_hdl->fs->fsal->name);
+		hints->hints = 0;
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	/* Get a usable file descriptor */
+	status = find_fd(&my_fd, obj_hdl, false, state, FSAL_O_ANY,
+			 &has_lock, &closefd, false);
+	if (FSAL_IS_ERROR(status)) {
+		hints->hints = 0;
+		goto out;
+	}
+
+	for (i = 0; i < sizeof(advices) / sizeof(advices[0]); i++) {
+		if (!(hints->hints & (1 << advices[i].hint)))
+			continue;
+
+		retval = posix_fadvise(my_fd, hints->offset, hints->count,
+				       advices[i].advice);
+		if (retval == 0)
+			applied |= 1 << advices[i].hint;
+		else
+			LogFullDebug(COMPONENT_FSAL,
+				     "posix_fadvise %d failed: %s",
+				     advices[i].advice, strerror(retval));
+	}
+
+	hints->hints = applied;
+
+ out:
+
+	if (closefd)
+		close(my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
 /**
  * @brief Commit written data
  *
@@ -1396,6 +2406,7 @@ fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
 			  int my_fd, struct attrlist *attrs)
 {
 	struct stat stat;
+	attrmask_t valid = ATTRS_POSIX;
 	int retval = 0;
 	fsal_status_t status = {0, 0};
 	const char *func = "unknown";
@@ -1405,21 +2416,19 @@ fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
 	case SOCKET_FILE:
 	case CHARACTER_FILE:
 	case BLOCK_FILE:
-		retval = fstatat(my_fd, myself->u.unopenable.name, &stat,
-				 AT_SYMLINK_NOFOLLOW);
-		func = "fstatat";
+		retval = vfs_stat_mask(my_fd, myself->u.unopenable.name,
+				       AT_SYMLINK_NOFOLLOW, attrs->request_mask,
+				       &stat, &valid);
+		func = "vfs_stat_mask";
 		break;
 
 	case REGULAR_FILE:
-		retval = fstat(my_fd, &stat);
-		func = "fstat";
-		break;
-
 	case SYMBOLIC_LINK:
 	case FIFO_FILE:
 	case DIRECTORY:
-		retval = vfs_stat_by_handle(my_fd, &stat);
-		func = "vfs_stat_by_handle";
+		retval = vfs_stat_mask(my_fd, NULL, 0, attrs->request_mask,
+				       &stat, &valid);
+		func = "vfs_stat_mask";
 		break;
 
 	case NO_FILE_TYPE:
@@ -1446,6 +2455,7 @@ fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
 	}
 
 	posix2fsal_attributes(&stat, attrs);
+	attrs->valid_mask &= ~(ATTRS_POSIX & ~valid);
 	attrs->fsid = myself->obj_handle.fs->fsid;
 
 	if (myself->sub_ops && myself->sub_ops->getattrs) {
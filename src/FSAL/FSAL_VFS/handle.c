@@ -63,6 +63,166 @@ int vfs_fsal_open(struct vfs_fsal_obj_handle *hdl,
 	return vfs_open_by_handle(vfs_fs, hdl->handle, openflags, fsal_error);
 }
 
+static bool statx_dont_sync;
+
+/**
+ * @brief Set how vfs_stat_mask fetches attributes
+ *
+ * @param[in] dont_sync Accept attributes the kernel has cached instead
+ *                      of having a network filesystem fetch them
+ */
+
+void vfs_stat_init(bool dont_sync)
+{
+	statx_dont_sync = dont_sync;
+}
+
+#ifdef HAVE_STATX
+static bool statx_missing;
+
+static unsigned int attrmask_to_statx(attrmask_t mask)
+{
+	/* type and fileid are needed to make a handle */
+	unsigned int stx_mask = STATX_TYPE | STATX_MODE | STATX_INO;
+
+	if (mask & ATTR_NUMLINKS)
+		stx_mask |= STATX_NLINK;
+	if (mask & ATTR_OWNER)
+		stx_mask |= STATX_UID;
+	if (mask & ATTR_GROUP)
+		stx_mask |= STATX_GID;
+	if (mask & ATTR_SIZE)
+		stx_mask |= STATX_SIZE;
+	if (mask & ATTR_SPACEUSED)
+		stx_mask |= STATX_BLOCKS;
+	if (mask & ATTR_ATIME)
+		stx_mask |= STATX_ATIME;
+	if (mask & ATTR_MTIME)
+		stx_mask |= STATX_MTIME;
+	if (mask & ATTR_CTIME)
+		stx_mask |= STATX_CTIME;
+	if (mask & (ATTR_CHGTIME | ATTR_CHANGE))
+		stx_mask |= STATX_MTIME | STATX_CTIME;
+
+	return stx_mask;
+}
+
+static attrmask_t statx_to_attrmask(unsigned int stx_mask)
+{
+	/* the device numbers always come back */
+	attrmask_t mask = ATTR_FSID | ATTR_RAWDEV;
+
+	if (stx_mask & STATX_TYPE)
+		mask |= ATTR_TYPE;
+	if (stx_mask & STATX_MODE)
+		mask |= ATTR_MODE;
+	if (stx_mask & STATX_INO)
+		mask |= ATTR_FILEID;
+	if (stx_mask & STATX_NLINK)
+		mask |= ATTR_NUMLINKS;
+	if (stx_mask & STATX_UID)
+		mask |= ATTR_OWNER;
+	if (stx_mask & STATX_GID)
+		mask |= ATTR_GROUP;
+	if (stx_mask & STATX_SIZE)
+		mask |= ATTR_SIZE;
+	if (stx_mask & STATX_BLOCKS)
+		mask |= ATTR_SPACEUSED;
+	if (stx_mask & STATX_ATIME)
+		mask |= ATTR_ATIME;
+	if (stx_mask & STATX_MTIME)
+		mask |= ATTR_MTIME;
+	if (stx_mask & STATX_CTIME)
+		mask |= ATTR_CTIME;
+	if ((stx_mask & (STATX_MTIME | STATX_CTIME)) ==
+	    (STATX_MTIME | STATX_CTIME))
+		mask |= ATTR_CHGTIME | ATTR_CHANGE;
+
+	return mask;
+}
+
+static void statx_to_stat(const struct statx *stx, struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_size = stx->stx_size;
+	st->st_blksize = stx->stx_blksize;
+	st->st_blocks = stx->stx_blocks;
+	st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+#endif
+
+/**
+ * @brief stat an object, fetching only the requested attributes
+ *
+ * With statx(2) only the attributes in @a request (plus type, mode
+ * and fileid) are asked for, which spares network filesystems from
+ * syncing e.g. the size when nobody wants it.  Without statx this is
+ * fstatat.
+ *
+ * @param[in]  dirfd   As for fstatat
+ * @param[in]  path    As for fstatat, or NULL to stat @a dirfd itself
+ * @param[in]  flags   As for fstatat
+ * @param[in]  request Attributes the caller needs
+ * @param[out] st      The attributes
+ * @param[out] valid   Attributes actually filled in @a st
+ *
+ * @return 0, or -1 with errno set.
+ */
+
+int vfs_stat_mask(int dirfd, const char *path, int flags, attrmask_t request,
+		  struct stat *st, attrmask_t *valid)
+{
+#ifdef HAVE_STATX
+	struct statx stx;
+	unsigned int stx_mask = attrmask_to_statx(request);
+
+	if (statx_missing)
+		goto fallback;
+
+	if (statx_dont_sync)
+		flags |= AT_STATX_DONT_SYNC;
+
+	if (path == NULL) {
+		path = "";
+		flags |= AT_EMPTY_PATH;
+	}
+
+	if (statx(dirfd, path, flags, stx_mask, &stx) < 0) {
+		if (errno != ENOSYS)
+			return -1;
+		statx_missing = true;
+		goto fallback;
+	}
+
+	/* reading a symlink needs its size */
+	if (S_ISLNK(stx.stx_mode) && !(stx.stx_mask & STATX_SIZE) &&
+	    statx(dirfd, path, flags, stx_mask | STATX_SIZE, &stx) < 0)
+		return -1;
+
+	statx_to_stat(&stx, st);
+	*valid = statx_to_attrmask(stx.stx_mask);
+	return 0;
+
+ fallback:
+#endif
+	*valid = ATTRS_POSIX;
+	if (path == NULL)
+		return vfs_stat_by_handle(dirfd, st);
+	return fstatat(dirfd, path, st, flags);
+}
+
 /**
  * @brief Create a VFS OBJ handle
  *
@@ -101,6 +261,8 @@ struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 	} else if (hdl->obj_handle.type == DIRECTORY) {
 		hdl->u.directory.path = NULL;
 		hdl->u.directory.fs_location = NULL;
+		hdl->u.directory.pathfd = -1;
+		glist_init(&hdl->u.directory.pathfd_lru);
 	} else if (hdl->obj_handle.type == SYMBOLIC_LINK) {
 		ssize_t retlink;
 		size_t len = stat->st_size + 1;
@@ -168,6 +330,7 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 	struct vfs_fsal_obj_handle *hdl;
 	int retval, fd;
 	struct stat stat;
+	attrmask_t valid;
 	vfs_file_handle_t *fh = NULL;
 	fsal_dev_t dev;
 	struct fsal_filesystem *fs;
@@ -177,7 +340,9 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 
 	vfs_alloc_handle(fh);
 
-	retval = fstatat(dirfd, path, &stat, AT_SYMLINK_NOFOLLOW);
+	retval = vfs_stat_mask(dirfd, path, AT_SYMLINK_NOFOLLOW,
+			       attrs_out != NULL ? attrs_out->request_mask : 0,
+			       &stat, &valid);
 
 	if (retval < 0) {
 		retval = errno;
@@ -268,6 +433,7 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 
 	if (attrs_out != NULL) {
 		posix2fsal_attributes(&stat, attrs_out);
+		attrs_out->valid_mask &= ~(ATTRS_POSIX & ~valid);
 	}
 
 	/* if it is a directory and the sticky bit is set
@@ -416,7 +582,7 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 		return fsalstat(ERR_FSAL_XDEV, EXDEV);
 	}
 
-	dirfd = vfs_fsal_open(parent_hdl, O_PATH | O_NOACCESS, &fsal_error);
+	dirfd = vfs_dirfd_get(parent_hdl, &fsal_error);
 
 	if (dirfd < 0) {
 		LogDebug(COMPONENT_FSAL, "Failed to open parent: %s",
@@ -428,7 +594,7 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 	status = lookup_with_fd(parent_hdl, dirfd, path, handle, attrs_out);
 
 
-	close(dirfd);
+	vfs_dirfd_put(parent_hdl, dirfd);
 	return status;
 }
 
@@ -443,7 +609,6 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 	mode_t unix_mode;
 	fsal_status_t status = {0, 0};
 	int retval = 0;
-	int flags = O_PATH | O_NOACCESS;
 #ifdef ENABLE_VFS_DEBUG_ACL
 	struct attrlist attrs;
 	fsal_accessflags_t access_type;
@@ -501,10 +666,10 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 
 	unix_mode = fsal2unix_mode(attrib->mode)
 	    & ~op_ctx->fsal_export->exp_ops.fs_umask(op_ctx->fsal_export);
-	dir_fd = vfs_fsal_open(myself, flags, &status.major);
+	dir_fd = vfs_dirfd_get(myself, &status.major);
 	if (dir_fd < 0) {
 		LogFullDebug(COMPONENT_FSAL,
-			     "vfs_fsal_open returned %s",
+			     "vfs_dirfd_get returned %s",
 			     strerror(-dir_fd));
 		return fsalstat(status.major, -dir_fd);
 	}
@@ -602,14 +767,14 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 		}
 	}
 
-	close(dir_fd);
+	vfs_dirfd_put(myself, dir_fd);
 
 	return status;
 
  fileerr:
 	unlinkat(dir_fd, name, 0);
  direrr:
-	close(dir_fd);
+	vfs_dirfd_put(myself, dir_fd);
  hdlerr:
 	status.major = posix2fsal_error(retval);
 	return fsalstat(status.major, retval);
@@ -1155,7 +1320,45 @@ static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(fsal_error, retval);
 }
 
+/**
+ * @brief Make the handle of a directory entry fetched by vfs_bulkstat
+ *
+ * The handle and attributes came with the batch, so unlike
+ * lookup_with_fd() nothing more is asked of the filesystem, but the
+ * target of a symlink.  Directories are not fetched this way, they may
+ * be mount points.
+ */
+
+static fsal_status_t lookup_bulk(struct vfs_fsal_obj_handle *parent_hdl,
+				 int dirfd, const char *path,
+				 struct vfs_bulk_entry *be,
+				 struct fsal_obj_handle **handle,
+				 struct attrlist *attrs_out)
+{
+	struct vfs_fsal_obj_handle *hdl;
+
+	hdl = alloc_handle(dirfd, &be->fh, parent_hdl->obj_handle.fs,
+			   &be->stat, parent_hdl->handle, path,
+			   op_ctx->fsal_export);
+	if (hdl == NULL)
+		return fsalstat(ERR_FSAL_NOMEM, ENOMEM);
+
+	if (attrs_out != NULL)
+		posix2fsal_attributes(&be->stat, attrs_out);
+
+	*handle = &hdl->obj_handle;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static inline bool dot_entry(struct vfs_dirent *dentryp)
+{
+	return strcmp(dentryp->vd_name, ".") == 0 ||
+	       strcmp(dentryp->vd_name, "..") == 0;
+}
+
 #define BUF_SIZE 1024
+/* A dirent takes at least 24 bytes of the buffer */
+#define BULK_MAX (BUF_SIZE / 16)
 /**
  * read_dirents
  * read the directory and call through the callback function for
@@ -1182,6 +1385,8 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	int nread;
 	struct vfs_dirent dentry, *dentryp = &dentry;
 	char buf[BUF_SIZE];
+	struct vfs_bulk_entry *bulk = NULL;
+	int nbulk, k;
 
 	if (whence != NULL)
 		seekloc = (off_t) *whence;
@@ -1210,6 +1415,8 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 		goto done;
 	}
 
+	bulk = gsh_malloc(BULK_MAX * sizeof(*bulk));
+
 	do {
 		baseloc = seekloc;
 		nread = vfs_readents(dirfd, buf, BUF_SIZE, &seekloc);
@@ -1220,20 +1427,46 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 		}
 		if (nread == 0)
 			break;
+
+		/* Fetch the attributes of the batch at once, where the
+		 * filesystem can.  Whatever is not found is looked up.
+		 */
+		nbulk = 0;
+		for (bpos = 0; bpos < nread; bpos += dentryp->vd_reclen) {
+			if (to_vfs_dirent(buf, bpos, dentryp, baseloc) &&
+			    !dot_entry(dentryp) && nbulk < BULK_MAX)
+				bulk[nbulk++].ino = dentryp->vd_ino;
+		}
+		if (vfs_bulkstat(dirfd, bulk, nbulk) < 0)
+			nbulk = 0;
+		k = 0;
+
 		for (bpos = 0; bpos < nread;) {
 			struct fsal_obj_handle *hdl;
 			struct attrlist attrs;
 			enum fsal_dir_result cb_rc;
+			struct vfs_bulk_entry *be = NULL;
 
 			if (!to_vfs_dirent(buf, bpos, dentryp, baseloc)
-			    || strcmp(dentryp->vd_name, ".") == 0
-			    || strcmp(dentryp->vd_name, "..") == 0)
+			    || dot_entry(dentryp))
 				goto skip;	/* must skip '.' and '..' */
 
+			if (k < nbulk) {
+				be = &bulk[k++];
+				if (!be->found || S_ISDIR(be->stat.st_mode))
+					be = NULL;
+			}
+
 			fsal_prepare_attrs(&attrs, attrmask);
 
-			status = lookup_with_fd(myself, dirfd, dentryp->vd_name,
-					&hdl, &attrs);
+			if (be != NULL)
+				status = lookup_bulk(myself, dirfd,
+						     dentryp->vd_name, be,
+						     &hdl, &attrs);
+			else
+				status = lookup_with_fd(myself, dirfd,
+							dentryp->vd_name,
+							&hdl, &attrs);
 
 			if (FSAL_IS_ERROR(status)) {
 				goto done;
@@ -1256,6 +1489,7 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 
 	*eof = true;
  done:
+	gsh_free(bulk);
 	close(dirfd);
 
  out:
@@ -1488,7 +1722,7 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 		fsal_error = posix2fsal_error(retval);
 		goto out;
 	}
-	fd = vfs_fsal_open(myself, O_PATH | O_NOACCESS, &fsal_error);
+	fd = vfs_dirfd_get(myself, &fsal_error);
 	if (fd < 0) {
 		retval = -fd;
 		goto out;
@@ -1516,7 +1750,7 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 	fsal_restore_ganesha_credentials();
 
  errout:
-	close(fd);
+	vfs_dirfd_put(myself, fd);
  out:
 	return fsalstat(fsal_error, retval);
 }
@@ -1628,6 +1862,7 @@ static void release(struct fsal_obj_handle *obj_hdl)
 		handle_to_key(obj_hdl, &key);
 		vfs_state_release(&key);
 	} else if (type == DIRECTORY) {
+		vfs_dirfd_release(myself);
 		if (myself->u.directory.path != NULL)
 			gsh_free(myself->u.directory.path);
 		if (myself->u.directory.fs_location != NULL)
@@ -1727,6 +1962,14 @@ void vfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->reopen2 = vfs_reopen2;
 	ops->read2 = vfs_read2;
 	ops->write2 = vfs_write2;
+	ops->readv2 = vfs_readv2;
+	ops->writev2 = vfs_writev2;
+	ops->copy = vfs_copy;
+	ops->clone = vfs_clone;
+	ops->seek2 = vfs_seek2;
+	ops->io_advise2 = vfs_io_advise2;
+	ops->read2_async = vfs_read2_async;
+	ops->write2_async = vfs_write2_async;
 	ops->commit2 = vfs_commit2;
 	ops->lock_op2 = vfs_lock_op2;
 	ops->setattr2 = vfs_setattr2;
@@ -131,3 +131,16 @@ int vfs_get_root_handle(struct vfs_filesystem *vfs_fs,
 	return vfs_re_index(vfs_fs, exp);
 }
 
+/**
+ * @brief Fetch handles and attributes of directory entries in one go
+ *
+ * Not something a plain VFS filesystem offers, its entries are looked
+ * up one at a time.
+ *
+ * @return -1 with errno ENOTSUP.
+ */
+int vfs_bulkstat(int dirfd, struct vfs_bulk_entry *ents, int count)
+{
+	errno = ENOTSUP;
+	return -1;
+}
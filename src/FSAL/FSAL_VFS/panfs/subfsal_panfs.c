@@ -55,6 +55,8 @@ struct config_item export_params[] = {
 	CONF_ITEM_TOKEN("fsid_type", FSID_NO_TYPE,
 			fsid_types,
 			panfs_fsal_export, vfs_export.fsid_type),
+	CONF_ITEM_BOOL("direct_io", false,
+		       panfs_fsal_export, vfs_export.direct_io),
 	CONFIG_EOL
 };
 
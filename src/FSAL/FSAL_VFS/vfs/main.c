@@ -40,6 +40,7 @@
 #include "fsal.h"
 #include "FSAL/fsal_init.h"
 #include "fsal_handle_syscalls.h"
+#include "../vfs_uring.h"
 
 /* VFS FSAL module private storage
  */
@@ -54,7 +55,12 @@
 struct vfs_fsal_module {
 	struct fsal_module fsal;
 	struct fsal_staticfsinfo_t fs_info;
-	/* vfsfs_specific_initinfo_t specific_info;  placeholder */
+	/** Submission queue depth of the io_uring engine, 0 disables it */
+	uint32_t io_uring_depth;
+	/** Directories keeping an O_PATH fd open */
+	uint32_t dir_fd_cache_size;
+	/** Let statx return attributes the kernel has cached */
+	bool statx_dont_sync;
 };
 
 const char myname[] = "VFS";
@@ -85,21 +91,27 @@ static struct fsal_staticfsinfo_t default_posix_info = {
 
 static struct config_item vfs_params[] = {
 	CONF_ITEM_BOOL("link_support", true,
-		       fsal_staticfsinfo_t, link_support),
+		       vfs_fsal_module, fs_info.link_support),
 	CONF_ITEM_BOOL("symlink_support", true,
-		       fsal_staticfsinfo_t, symlink_support),
+		       vfs_fsal_module, fs_info.symlink_support),
 	CONF_ITEM_BOOL("cansettime", true,
-		       fsal_staticfsinfo_t, cansettime),
+		       vfs_fsal_module, fs_info.cansettime),
 	CONF_ITEM_UI64("maxread", 512, FSAL_MAXIOSIZE, FSAL_MAXIOSIZE,
-		       fsal_staticfsinfo_t, maxread),
+		       vfs_fsal_module, fs_info.maxread),
 	CONF_ITEM_UI64("maxwrite", 512, FSAL_MAXIOSIZE, FSAL_MAXIOSIZE,
-		       fsal_staticfsinfo_t, maxwrite),
+		       vfs_fsal_module, fs_info.maxwrite),
 	CONF_ITEM_MODE("umask", 0,
-		       fsal_staticfsinfo_t, umask),
+		       vfs_fsal_module, fs_info.umask),
 	CONF_ITEM_BOOL("auth_xdev_export", false,
-		       fsal_staticfsinfo_t, auth_exportpath_xdev),
+		       vfs_fsal_module, fs_info.auth_exportpath_xdev),
 	CONF_ITEM_MODE("xattr_access_rights", 0400,
-		       fsal_staticfsinfo_t, xattr_access_rights),
+		       vfs_fsal_module, fs_info.xattr_access_rights),
+	CONF_ITEM_UI32("IO_Uring_Depth", 0, 4096, 0,
+		       vfs_fsal_module, io_uring_depth),
+	CONF_ITEM_UI32("Dir_Fd_Cache_Size", 0, 65536, 1024,
+		       vfs_fsal_module, dir_fd_cache_size),
+	CONF_ITEM_BOOL("Statx_Dont_Sync", false,
+		       vfs_fsal_module, statx_dont_sync),
 	CONFIG_EOL
 };
 
@@ -182,12 +194,15 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 
 	(void) load_config_from_parse(config_struct,
 				      &vfs_param,
-				      &vfs_me->fs_info,
+				      vfs_me,
 				      true,
 				      err_type);
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
 	display_fsinfo(&vfs_me->fs_info);
+	(void) vfs_uring_init(vfs_me->io_uring_depth);
+	vfs_dirfd_init(vfs_me->dir_fd_cache_size);
+	vfs_stat_init(vfs_me->statx_dont_sync);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
 		     VFS_SUPPORTED_ATTRIBUTES);
@@ -253,6 +268,8 @@ MODULE_FINI void vfs_unload(void)
 {
 	int retval;
 
+	vfs_uring_shutdown();
+
 	retval = unregister_fsal(&VFS.fsal);
 	if (retval != 0) {
 		fprintf(stderr, "VFS module failed to unregister");
@@ -55,6 +55,8 @@ static struct config_item export_params[] = {
 	CONF_ITEM_TOKEN("fsid_type", FSID_NO_TYPE,
 			fsid_types,
 			vfs_fsal_export, fsid_type),
+	CONF_ITEM_BOOL("direct_io", false,
+		       vfs_fsal_export, direct_io),
 	CONFIG_EOL
 };
 
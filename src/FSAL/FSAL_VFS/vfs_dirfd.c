@@ -0,0 +1,167 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file vfs_dirfd.c
+ * @brief Cache of O_PATH descriptors for directories
+ *
+ * Lookup, create, mkdir and unlink all need a descriptor for the parent
+ * directory, and opening one is an open_by_handle_at.  The most recently
+ * used directories keep theirs open, up to Dir_Fd_Cache_Size of them.
+ * Cached descriptors are counted in open_fd_count, so the MDCACHE fd LRU
+ * sees them when deciding how hard to reap file descriptors.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "gsh_list.h"
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "vfs_methods.h"
+
+static pthread_mutex_t dirfd_mtx = PTHREAD_MUTEX_INITIALIZER;
+/* Directories with a cached descriptor, most recently used first */
+static struct glist_head dirfd_lru = GLIST_HEAD_INIT(dirfd_lru);
+static uint32_t dirfd_count;
+static uint32_t dirfd_max;
+
+/**
+ * @brief Set the size of the cache
+ *
+ * @param[in] size Directories to keep a descriptor for, 0 disables
+ */
+
+void vfs_dirfd_init(uint32_t size)
+{
+	PTHREAD_MUTEX_lock(&dirfd_mtx);
+	dirfd_max = size;
+	PTHREAD_MUTEX_unlock(&dirfd_mtx);
+}
+
+/* Called with dirfd_mtx held */
+static void dirfd_drop(struct vfs_fsal_obj_handle *hdl)
+{
+	glist_del(&hdl->u.directory.pathfd_lru);
+	close(hdl->u.directory.pathfd);
+	hdl->u.directory.pathfd = -1;
+	dirfd_count--;
+	(void) atomic_dec_size_t(&open_fd_count);
+}
+
+/* Called with dirfd_mtx held, drops the least recently used idle entry */
+static bool dirfd_evict_one(void)
+{
+	struct glist_head *glist;
+	struct vfs_fsal_obj_handle *hdl;
+
+	for (glist = dirfd_lru.prev; glist != &dirfd_lru;
+	     glist = glist->prev) {
+		hdl = glist_entry(glist, struct vfs_fsal_obj_handle,
+				  u.directory.pathfd_lru);
+		if (hdl->u.directory.pathfd_refs == 0) {
+			dirfd_drop(hdl);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief Get an O_PATH descriptor for a directory
+ *
+ * The descriptor must be given back with vfs_dirfd_put.
+ *
+ * @param[in]  hdl        The directory
+ * @param[out] fsal_error Error if the directory can't be opened
+ *
+ * @return The descriptor, or a negative error code.
+ */
+
+int vfs_dirfd_get(struct vfs_fsal_obj_handle *hdl, fsal_errors_t *fsal_error)
+{
+	int fd;
+
+	PTHREAD_MUTEX_lock(&dirfd_mtx);
+	if (hdl->u.directory.pathfd >= 0) {
+		hdl->u.directory.pathfd_refs++;
+		glist_del(&hdl->u.directory.pathfd_lru);
+		glist_add(&dirfd_lru, &hdl->u.directory.pathfd_lru);
+		fd = hdl->u.directory.pathfd;
+		PTHREAD_MUTEX_unlock(&dirfd_mtx);
+		return fd;
+	}
+	PTHREAD_MUTEX_unlock(&dirfd_mtx);
+
+	fd = vfs_fsal_open(hdl, O_PATH | O_NOACCESS, fsal_error);
+	if (fd < 0)
+		return fd;
+
+	PTHREAD_MUTEX_lock(&dirfd_mtx);
+	if (hdl->u.directory.pathfd < 0 &&
+	    (dirfd_count < dirfd_max ||
+	     (dirfd_max > 0 && dirfd_evict_one()))) {
+		hdl->u.directory.pathfd = fd;
+		hdl->u.directory.pathfd_refs = 1;
+		glist_add(&dirfd_lru, &hdl->u.directory.pathfd_lru);
+		dirfd_count++;
+		(void) atomic_inc_size_t(&open_fd_count);
+	}
+	PTHREAD_MUTEX_unlock(&dirfd_mtx);
+
+	return fd;
+}
+
+/**
+ * @brief Give back a descriptor from vfs_dirfd_get
+ *
+ * @param[in] hdl The directory
+ * @param[in] fd  The descriptor
+ */
+
+void vfs_dirfd_put(struct vfs_fsal_obj_handle *hdl, int fd)
+{
+	PTHREAD_MUTEX_lock(&dirfd_mtx);
+	if (fd == hdl->u.directory.pathfd) {
+		hdl->u.directory.pathfd_refs--;
+		PTHREAD_MUTEX_unlock(&dirfd_mtx);
+		return;
+	}
+	PTHREAD_MUTEX_unlock(&dirfd_mtx);
+
+	close(fd);
+}
+
+/**
+ * @brief Close the cached descriptor of a directory being released
+ *
+ * @param[in] hdl The directory
+ */
+
+void vfs_dirfd_release(struct vfs_fsal_obj_handle *hdl)
+{
+	PTHREAD_MUTEX_lock(&dirfd_mtx);
+	if (hdl->u.directory.pathfd >= 0)
+		dirfd_drop(hdl);
+	PTHREAD_MUTEX_unlock(&dirfd_mtx);
+}
@@ -44,11 +44,17 @@ struct vfs_fsal_export {
 	struct fsal_filesystem *root_fs;
 	struct glist_head filesystems;
 	int fsid_type;
+	bool direct_io;		/*< Open data fds with O_DIRECT */
 };
 
 #define EXPORT_VFS_FROM_FSAL(fsal) \
 	container_of((fsal), struct vfs_fsal_export, export)
 
+/* Set for good once an export has direct_io, its O_DIRECT fds may be
+ * shared with other exports of the same files and outlive it.
+ */
+extern bool vfs_direct_io_used;
+
 /*
  * VFS internal filesystem
  */
@@ -160,6 +166,9 @@ struct vfs_fsal_obj_handle {
 		struct {
 			char *path;
 			char *fs_location;
+			int pathfd;	/*< cached O_PATH fd, or -1 */
+			int32_t pathfd_refs;
+			struct glist_head pathfd_lru;
 		} directory;
 		struct {
 			unsigned char *link_content;
@@ -208,6 +217,18 @@ int vfs_extract_fsid(vfs_file_handle_t *fh,
 		     enum fsid_type *fsid_type,
 		     struct fsal_fsid__ *fsid);
 
+/**
+ * @brief Handle and attributes of a directory entry, from vfs_bulkstat
+ */
+struct vfs_bulk_entry {
+	uint64_t ino;		/*< Inode number from the directory entry */
+	bool found;		/*< fh and stat were filled in */
+	vfs_file_handle_t fh;
+	struct stat stat;
+};
+
+int vfs_bulkstat(int dirfd, struct vfs_bulk_entry *ents, int count);
+
 int vfs_get_root_handle(struct vfs_filesystem *vfs_fs,
 			struct vfs_fsal_export *exp);
 
@@ -227,6 +248,15 @@ int vfs_fsal_open(struct vfs_fsal_obj_handle *hdl,
 		  int openflags,
 		  fsal_errors_t *fsal_error);
 
+void vfs_stat_init(bool dont_sync);
+int vfs_stat_mask(int dirfd, const char *path, int flags, attrmask_t request,
+		  struct stat *st, attrmask_t *valid);
+
+void vfs_dirfd_init(uint32_t size);
+int vfs_dirfd_get(struct vfs_fsal_obj_handle *hdl, fsal_errors_t *fsal_error);
+void vfs_dirfd_put(struct vfs_fsal_obj_handle *hdl, int fd);
+void vfs_dirfd_release(struct vfs_fsal_obj_handle *hdl);
+
 struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 					 vfs_file_handle_t *fh,
 					 struct fsal_filesystem *fs,
@@ -305,6 +335,63 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 			 bool *fsal_stable,
 			 struct io_info *info);
 
+fsal_status_t vfs_readv2(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct state_t *state,
+			 uint64_t offset,
+			 const struct iovec *iov,
+			 int iovcnt,
+			 size_t *read_amount,
+			 bool *end_of_file,
+			 struct io_info *info);
+
+fsal_status_t vfs_writev2(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct state_t *state,
+			  uint64_t offset,
+			  const struct iovec *iov,
+			  int iovcnt,
+			  size_t *wrote_amount,
+			  bool *fsal_stable,
+			  struct io_info *info);
+
+void vfs_read2_async(struct fsal_obj_handle *obj_hdl,
+		     bool bypass,
+		     fsal_async_cb done_cb,
+		     struct fsal_io_arg *read_arg,
+		     void *caller_arg);
+
+void vfs_write2_async(struct fsal_obj_handle *obj_hdl,
+		      bool bypass,
+		      fsal_async_cb done_cb,
+		      struct fsal_io_arg *write_arg,
+		      void *caller_arg);
+
+fsal_status_t vfs_copy(struct fsal_obj_handle *src_hdl,
+		       struct state_t *src_state,
+		       uint64_t src_offset,
+		       struct fsal_obj_handle *dst_hdl,
+		       struct state_t *dst_state,
+		       uint64_t dst_offset,
+		       uint64_t count,
+		       uint64_t *copied);
+
+fsal_status_t vfs_clone(struct fsal_obj_handle *src_hdl,
+			struct state_t *src_state,
+			uint64_t src_offset,
+			struct fsal_obj_handle *dst_hdl,
+			struct state_t *dst_state,
+			uint64_t dst_offset,
+			uint64_t count);
+
+fsal_status_t vfs_seek2(struct fsal_obj_handle *obj_hdl,
+			struct state_t *state,
+			struct io_info *info);
+
+fsal_status_t vfs_io_advise2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     struct io_hints *hints);
+
 fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 			  off_t offset,
 			  size_t len);
@@ -0,0 +1,291 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file vfs_uring.c
+ * @brief io_uring submission engine for FSAL_VFS
+ */
+
+#include "config.h"
+
+#ifdef USE_IO_URING
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <liburing.h>
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "log.h"
+#include "vfs_uring.h"
+
+struct vfs_uring_req {
+	vfs_uring_cb cb;
+	void *arg;
+};
+
+/* Synchronous waiter for vfs_uring_rw */
+struct vfs_uring_wait {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	bool done;
+	ssize_t res;
+};
+
+static struct io_uring vfs_ring;
+static pthread_mutex_t vfs_ring_sq_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t vfs_ring_reaper;
+static bool vfs_ring_running;
+
+/**
+ * @brief Reap completions and run callbacks
+ *
+ * A NOP with no user data is the shutdown signal.
+ */
+static void *vfs_uring_reap(void *unused)
+{
+	struct io_uring_cqe *cqe;
+	struct vfs_uring_req *req;
+	ssize_t res;
+	int rc;
+
+	SetNameFunction("vfs_uring");
+
+	for (;;) {
+		rc = io_uring_wait_cqe(&vfs_ring, &cqe);
+		if (rc == -EINTR)
+			continue;
+		if (rc < 0) {
+			LogCrit(COMPONENT_FSAL,
+				"io_uring_wait_cqe failed: %s", strerror(-rc));
+			break;
+		}
+
+		req = io_uring_cqe_get_data(cqe);
+		res = cqe->res;
+		io_uring_cqe_seen(&vfs_ring, cqe);
+
+		if (req == NULL)
+			break;
+
+		req->cb(req->arg, res);
+		gsh_free(req);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Set up the ring and completion thread
+ *
+ * @param[in] depth Submission queue depth, 0 leaves the engine disabled
+ *
+ * @return 0 or -errno.
+ */
+int vfs_uring_init(uint32_t depth)
+{
+	int rc;
+
+	if (depth == 0 || vfs_ring_running)
+		return 0;
+
+	rc = io_uring_queue_init(depth, &vfs_ring, 0);
+	if (rc < 0) {
+		LogWarn(COMPONENT_FSAL,
+			"io_uring setup with depth %u failed: %s, using synchronous I/O",
+			depth, strerror(-rc));
+		return rc;
+	}
+
+	rc = pthread_create(&vfs_ring_reaper, NULL, vfs_uring_reap, NULL);
+	if (rc != 0) {
+		LogWarn(COMPONENT_FSAL,
+			"Could not start io_uring completion thread: %s",
+			strerror(rc));
+		io_uring_queue_exit(&vfs_ring);
+		return -rc;
+	}
+
+	vfs_ring_running = true;
+	LogInfo(COMPONENT_FSAL, "FSAL_VFS io_uring enabled, depth %u", depth);
+
+	return 0;
+}
+
+/**
+ * @brief Stop the completion thread and tear down the ring
+ *
+ * All I/O must have completed.
+ */
+void vfs_uring_shutdown(void)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!vfs_ring_running)
+		return;
+
+	PTHREAD_MUTEX_lock(&vfs_ring_sq_mtx);
+	vfs_ring_running = false;
+	sqe = io_uring_get_sqe(&vfs_ring);
+	if (sqe == NULL) {
+		(void) io_uring_submit(&vfs_ring);
+		sqe = io_uring_get_sqe(&vfs_ring);
+	}
+	if (sqe != NULL) {
+		io_uring_prep_nop(sqe);
+		io_uring_sqe_set_data(sqe, NULL);
+		(void) io_uring_submit(&vfs_ring);
+	} else {
+		(void) pthread_cancel(vfs_ring_reaper);
+	}
+	PTHREAD_MUTEX_unlock(&vfs_ring_sq_mtx);
+
+	(void) pthread_join(vfs_ring_reaper, NULL);
+	io_uring_queue_exit(&vfs_ring);
+}
+
+bool vfs_uring_enabled(void)
+{
+	return vfs_ring_running;
+}
+
+/**
+ * @brief Submit a vectored read or write
+ *
+ * The iovec and buffers must remain valid until cb is called.
+ *
+ * @param[in] fd       File descriptor, must stay open until completion
+ * @param[in] write    true for a write, false for a read
+ * @param[in] iov      Segments
+ * @param[in] iovcnt   Number of segments
+ * @param[in] offset   File offset
+ * @param[in] rw_flags RWF_* flags (e.g. RWF_DSYNC)
+ * @param[in] cb       Completion callback
+ * @param[in] arg      Argument for cb
+ *
+ * @return 0 if submitted (cb will be called), -errno otherwise.
+ */
+int vfs_uring_submit(int fd, bool write, const struct iovec *iov, int iovcnt,
+		     uint64_t offset, int rw_flags, vfs_uring_cb cb, void *arg)
+{
+	struct io_uring_sqe *sqe;
+	struct vfs_uring_req *req;
+	int rc;
+
+	req = gsh_malloc(sizeof(*req));
+	req->cb = cb;
+	req->arg = arg;
+
+	PTHREAD_MUTEX_lock(&vfs_ring_sq_mtx);
+
+	if (!vfs_ring_running) {
+		rc = -ESHUTDOWN;
+		goto fail;
+	}
+
+	sqe = io_uring_get_sqe(&vfs_ring);
+	if (sqe == NULL) {
+		/* Ring full, push what we have and try once more */
+		(void) io_uring_submit(&vfs_ring);
+		sqe = io_uring_get_sqe(&vfs_ring);
+		if (sqe == NULL) {
+			rc = -EAGAIN;
+			goto fail;
+		}
+	}
+
+	if (write)
+		io_uring_prep_writev(sqe, fd, iov, iovcnt, offset);
+	else
+		io_uring_prep_readv(sqe, fd, iov, iovcnt, offset);
+	sqe->rw_flags = rw_flags;
+	io_uring_sqe_set_data(sqe, req);
+
+	do {
+		rc = io_uring_submit(&vfs_ring);
+	} while (rc == -EINTR || rc == -EAGAIN || rc == -EBUSY);
+
+	PTHREAD_MUTEX_unlock(&vfs_ring_sq_mtx);
+
+	/* Once prepared the sqe is in the ring and will be picked up by
+	 * the next successful submit, so cb is still going to be called.
+	 */
+	if (rc < 0)
+		LogCrit(COMPONENT_FSAL,
+			"io_uring_submit failed: %s", strerror(-rc));
+
+	return 0;
+
+ fail:
+	PTHREAD_MUTEX_unlock(&vfs_ring_sq_mtx);
+	gsh_free(req);
+	return rc;
+}
+
+static void vfs_uring_wake(void *arg, ssize_t res)
+{
+	struct vfs_uring_wait *w = arg;
+
+	PTHREAD_MUTEX_lock(&w->mtx);
+	w->res = res;
+	w->done = true;
+	pthread_cond_signal(&w->cv);
+	PTHREAD_MUTEX_unlock(&w->mtx);
+}
+
+/**
+ * @brief Submit a vectored read or write and wait for it
+ *
+ * @param[out] res Bytes transferred, or -errno
+ *
+ * @return 0 if the I/O went through the ring (result in *res), -errno
+ *         if it could not be submitted and the caller should fall back
+ *         to a plain syscall.
+ */
+int vfs_uring_rw(int fd, bool write, const struct iovec *iov, int iovcnt,
+		 uint64_t offset, int rw_flags, ssize_t *res)
+{
+	struct vfs_uring_wait w = {
+		.done = false,
+	};
+	int rc;
+
+	PTHREAD_MUTEX_init(&w.mtx, NULL);
+	PTHREAD_COND_init(&w.cv, NULL);
+
+	rc = vfs_uring_submit(fd, write, iov, iovcnt, offset, rw_flags,
+			      vfs_uring_wake, &w);
+
+	if (rc == 0) {
+		PTHREAD_MUTEX_lock(&w.mtx);
+		while (!w.done)
+			pthread_cond_wait(&w.cv, &w.mtx);
+		PTHREAD_MUTEX_unlock(&w.mtx);
+		*res = w.res;
+	}
+
+	PTHREAD_COND_destroy(&w.cv);
+	PTHREAD_MUTEX_destroy(&w.mtx);
+
+	return rc;
+}
+
+#endif				/* USE_IO_URING */
@@ -0,0 +1,80 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file vfs_uring.h
+ * @brief io_uring submission engine for FSAL_VFS
+ *
+ * A single ring per module is shared by all workers.  Submission is
+ * serialized by a mutex; completions are reaped by a dedicated thread
+ * which runs each request's callback.  When the engine is not built in
+ * or not enabled, callers use the plain syscalls.
+ */
+
+#ifndef VFS_URING_H
+#define VFS_URING_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * @brief Completion callback
+ *
+ * Called from the completion thread.
+ *
+ * @param[in] arg Caller's argument
+ * @param[in] res Bytes transferred, or -errno
+ */
+typedef void (*vfs_uring_cb)(void *arg, ssize_t res);
+
+#ifdef USE_IO_URING
+
+int vfs_uring_init(uint32_t depth);
+void vfs_uring_shutdown(void);
+bool vfs_uring_enabled(void);
+
+int vfs_uring_submit(int fd, bool write, const struct iovec *iov, int iovcnt,
+		     uint64_t offset, int rw_flags, vfs_uring_cb cb, void *arg);
+int vfs_uring_rw(int fd, bool write, const struct iovec *iov, int iovcnt,
+		 uint64_t offset, int rw_flags, ssize_t *res);
+
+#else				/* USE_IO_URING */
+
+static inline int vfs_uring_init(uint32_t depth)
+{
+	return depth ? -ENOTSUP : 0;
+}
+
+static inline void vfs_uring_shutdown(void)
+{
+}
+
+static inline bool vfs_uring_enabled(void)
+{
+	return false;
+}
+
+#endif				/* USE_IO_URING */
+
+#endif				/* VFS_URING_H */
@@ -87,6 +87,30 @@ static int xfs_fsal_bulkstat_inode(int fd, xfs_ino_t ino, xfs_bstat_t *bstat)
 	return ioctl(fd, XFS_IOC_FSBULKSTAT_SINGLE, &bulkreq);
 }
 
+/* Make the handle of an inode from the handle data of a file in the
+ * same filesystem.
+ */
+static void xfs_fsal_bstat2handle(const void *data, const xfs_bstat_t *bstat,
+				  vfs_file_handle_t *fh)
+{
+	xfs_handle_t *hdl = (xfs_handle_t *) fh->handle_data;
+
+	/* Copy the fsid from the reference fd */
+	memcpy(&hdl->ha_fsid, data, sizeof(xfs_fsid_t));
+
+	/* Fill in the rest of the handle with the information
+	 * pertinent to this inode.
+	 */
+	hdl->ha_fid.fid_len = sizeof(xfs_handle_t) -
+			      sizeof(xfs_fsid_t) -
+			      sizeof(hdl->ha_fid.fid_len);
+	hdl->ha_fid.fid_pad = 0;
+	hdl->ha_fid.fid_gen = bstat->bs_gen;
+	hdl->ha_fid.fid_ino = bstat->bs_ino;
+
+	fh->handle_len = sizeof(*hdl);
+}
+
 static int xfs_fsal_inode2handle(int fd, ino_t ino, vfs_file_handle_t *fh)
 {
 	xfs_bstat_t bstat;
@@ -106,25 +130,133 @@ static int xfs_fsal_inode2handle(int fd, ino_t ino, vfs_file_handle_t *fh)
 	    (fd_to_handle(fd, &data, &sz) < 0))
 		return -1;
 
-	/* Copy the fsid from the reference fd */
-	memcpy(&hdl->ha_fsid, data, sizeof(xfs_fsid_t));
+	xfs_fsal_bstat2handle(data, &bstat, fh);
 
-	/* Fill in the rest of the handle with the information
-	 * pertinent to this inode.
-	 */
-	hdl->ha_fid.fid_len = sizeof(xfs_handle_t) -
-			      sizeof(xfs_fsid_t) -
-			      sizeof(hdl->ha_fid.fid_len);
-	hdl->ha_fid.fid_pad = 0;
-	hdl->ha_fid.fid_gen = bstat.bs_gen;
-	hdl->ha_fid.fid_ino = bstat.bs_ino;
+	free_handle(data, sz);
+	return 0;
+}
 
-	fh->handle_len = sizeof(*hdl);
+/* Inodes asked of XFS_IOC_FSBULKSTAT at once */
+#define XFS_BULK_BATCH 64
 
-	free_handle(data, sz);
+static int xfs_bulk_cmp(const void *a, const void *b)
+{
+	const struct vfs_bulk_entry *ea = *(const struct vfs_bulk_entry **)a;
+	const struct vfs_bulk_entry *eb = *(const struct vfs_bulk_entry **)b;
+
+	if (ea->ino != eb->ino)
+		return ea->ino < eb->ino ? -1 : 1;
 	return 0;
 }
 
+static void xfs_bstat2stat(const xfs_bstat_t *bstat, dev_t dev,
+			   struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_dev = dev;
+	st->st_ino = bstat->bs_ino;
+	st->st_mode = bstat->bs_mode;
+	st->st_nlink = bstat->bs_nlink;
+	st->st_uid = bstat->bs_uid;
+	st->st_gid = bstat->bs_gid;
+	/* bs_rdev is in the old sysv encoding */
+	st->st_rdev = makedev(bstat->bs_rdev >> 18,
+			      bstat->bs_rdev & 0x3ffff);
+	st->st_size = bstat->bs_size;
+	st->st_blksize = bstat->bs_blksize;
+	/* bs_blocks counts filesystem blocks, st_blocks 512 byte ones */
+	st->st_blocks = bstat->bs_blocks * (bstat->bs_blksize / 512);
+	st->st_atim.tv_sec = bstat->bs_atime.tv_sec;
+	st->st_atim.tv_nsec = bstat->bs_atime.tv_nsec;
+	st->st_mtim.tv_sec = bstat->bs_mtime.tv_sec;
+	st->st_mtim.tv_nsec = bstat->bs_mtime.tv_nsec;
+	st->st_ctim.tv_sec = bstat->bs_ctime.tv_sec;
+	st->st_ctim.tv_nsec = bstat->bs_ctime.tv_nsec;
+}
+
+/**
+ * @brief Fetch handles and attributes of directory entries in one go
+ *
+ * The entries are walked in inode order with XFS_IOC_FSBULKSTAT, which
+ * returns the next allocated inodes from a starting point.  The inodes
+ * of a directory tend to be allocated close together, so a batch of
+ * entries takes a few ioctls where looking each one up would take an
+ * fstatat, an open and an fd_to_handle apiece.
+ *
+ * Entries whose inode is gone by now are left not found, for the
+ * caller to look up by name.
+ *
+ * @param[in]     dirfd The directory the entries are in
+ * @param[in,out] ents  The entries, with their inode numbers set
+ * @param[in]     count Number of entries
+ *
+ * @return 0 or -1 with errno set.
+ */
+int vfs_bulkstat(int dirfd, struct vfs_bulk_entry *ents, int count)
+{
+	struct vfs_bulk_entry **sorted;
+	xfs_bstat_t *bstat;
+	xfs_fsop_bulkreq_t bulkreq;
+	struct stat dst;
+	void *data;
+	size_t sz;
+	__u64 last;
+	__s32 ocount;
+	int i, j, rc = 0;
+
+	if (count == 0)
+		return 0;
+
+	if (fstat(dirfd, &dst) < 0 || fd_to_handle(dirfd, &data, &sz) < 0)
+		return -1;
+
+	sorted = gsh_malloc(count * sizeof(*sorted));
+	bstat = gsh_malloc(XFS_BULK_BATCH * sizeof(*bstat));
+
+	for (i = 0; i < count; i++) {
+		ents[i].found = false;
+		sorted[i] = &ents[i];
+	}
+	qsort(sorted, count, sizeof(*sorted), xfs_bulk_cmp);
+
+	i = 0;
+	while (i < count) {
+		/* Returns the inodes after lastip */
+		last = sorted[i]->ino - 1;
+		bulkreq.lastip = &last;
+		bulkreq.icount = XFS_BULK_BATCH;
+		bulkreq.ubuffer = bstat;
+		bulkreq.ocount = &ocount;
+
+		rc = ioctl(dirfd, XFS_IOC_FSBULKSTAT, &bulkreq);
+		if (rc < 0 || ocount == 0)
+			break;
+
+		/* Each round settles at least sorted[i], hard links to
+		 * the same inode all match the same bstat.
+		 */
+		for (j = 0; i < count && j < ocount;) {
+			if (bstat[j].bs_ino < sorted[i]->ino) {
+				j++;
+				continue;
+			}
+			if (bstat[j].bs_ino == sorted[i]->ino) {
+				xfs_fsal_bstat2handle(data, &bstat[j],
+						      &sorted[i]->fh);
+				xfs_bstat2stat(&bstat[j], dst.st_dev,
+					       &sorted[i]->stat);
+				sorted[i]->found = true;
+			}
+			i++;
+		}
+	}
+
+	gsh_free(bstat);
+	gsh_free(sorted);
+	free_handle(data, sz);
+	return rc < 0 ? -1 : 0;
+}
+
 int vfs_open_by_handle(struct vfs_filesystem *fs,
 		       vfs_file_handle_t *fh, int openflags,
 		       fsal_errors_t *fsal_error)
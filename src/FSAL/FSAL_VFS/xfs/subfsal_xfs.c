@@ -37,6 +37,8 @@
 
 static struct config_item export_params[] = {
 	CONF_ITEM_NOOP("name"),
+	CONF_ITEM_BOOL("direct_io", false,
+		       vfs_fsal_export, direct_io),
 	CONFIG_EOL
 };
 
@@ -570,6 +570,34 @@ static fsal_status_t tank_linkfile(struct fsal_obj_handle *obj_hdl,
 }
 
 #define MAX_ENTRIES 256
+
+/* tank_dirent_handle
+ * Make the handle of a directory entry from the object and attributes
+ * libzfswrap_readdir returned with it, instead of looking it up again.
+ */
+
+static struct zfs_fsal_obj_handle *
+tank_dirent_handle(struct zfs_fsal_obj_handle *dir,
+		   libzfswrap_vfs_t *p_vfs, creden_t *cred,
+		   libzfswrap_entry_t *dirent)
+{
+	struct zfs_file_handle fh;
+	char link_buff[PATH_MAX];
+	char *link_content = NULL;
+
+	memset(&fh, 0, sizeof(struct zfs_file_handle));
+	fh.zfs_handle = dirent->object;
+	fh.i_snap = dir->handle->i_snap;
+
+	if (S_ISLNK(dirent->stats.st_mode) &&
+	    libzfswrap_readlink(p_vfs, cred, dirent->object,
+				link_buff, PATH_MAX) == 0)
+		link_content = link_buff;
+
+	return alloc_handle(&fh, &dirent->stats, link_content,
+			    op_ctx->fsal_export);
+}
+
 /**
  * read_dirents
  * read the directory and call through the callback function for
@@ -616,8 +644,7 @@ static fsal_status_t tank_readdir(struct fsal_obj_handle *dir_hdl,
 		goto out;
 	*eof = false;
 	do {
-		struct fsal_obj_handle *obj;
-		fsal_status_t fsal_status;
+		struct zfs_fsal_obj_handle *hdl;
 
 		retval = libzfswrap_readdir(p_vfs, &cred, pvnode, dirents,
 					    MAX_ENTRIES, &seekloc);
@@ -639,16 +666,16 @@ static fsal_status_t tank_readdir(struct fsal_obj_handle *dir_hdl,
 			    || !strcmp(dirents[index].psz_filename, ".."))
 				continue;
 
-			fsal_prepare_attrs(&attrs, attrmask);
+			/* The entries come with their attributes */
+			hdl = tank_dirent_handle(myself, p_vfs, &cred,
+						 &dirents[index]);
 
-			fsal_status = tank_lookup(dir_hdl,
-						  dirents[index].psz_filename,
-						  &obj, &attrs);
-			if (FSAL_IS_ERROR(fsal_status))
-				goto done;
+			fsal_prepare_attrs(&attrs, attrmask);
+			posix2fsal_attributes(&dirents[index].stats, &attrs);
 
 			/* callback to cache inode */
-			cb_rc = cb(dirents[index].psz_filename, obj, &attrs,
+			cb_rc = cb(dirents[index].psz_filename,
+				   &hdl->obj_handle, &attrs,
 				   dir_state, (fsal_cookie_t) index, NULL);
 
 			fsal_release_attrs(&attrs);
@@ -42,6 +42,7 @@
 #include "log.h"
 #include "fsal.h"
 #include "mdcache_int.h"
+#include "mdcache_lru.h"
 #include "mdcache_avl.h"
 #include "murmur3.h"
 #include "city.h"
@@ -64,6 +65,162 @@ mdcache_avl_init(mdcache_entry_t *entry)
 		     0 /* flags */);
 	avltree_init(&entry->fsobj.fsdir.avl.sorted, avl_dirent_sorted_cmpf,
 		     0 /* flags */);
+	entry->fsobj.fsdir.neg = NULL;
+	entry->fsobj.fsdir.avl.idx = NULL;
+	entry->fsobj.fsdir.avl.idx_size = 0;
+}
+
+/*
+ * Negative lookup cache
+ *
+ * A direct mapped table of name hashes per directory, each with an
+ * expiry time.  It answers LOOKUP for names the FSAL recently said do
+ * not exist when the dirent cache is not complete enough to do so
+ * (see trust_negative_cache()).  A colliding name simply replaces the
+ * slot.  Every insert into the name tree forgets the name, and
+ * invalidating the directory drops the table, so only changes made
+ * behind our back without an upcall can be missed, for at most
+ * Negative_Lookup_TTL seconds.
+ *
+ * All of these need the content lock, for write except lookup.
+ */
+
+static inline uint64_t mdcache_neg_hash(const char *name)
+{
+	uint64_t hash = CityHash64WithSeed(name, strlen(name), 0x6e6567);
+
+	return hash != 0 ? hash : 1;
+}
+
+static inline struct mdcache_neg_slot *
+mdcache_neg_slot(mdcache_entry_t *entry, uint64_t hash)
+{
+	return &entry->fsobj.fsdir.neg[hash % mdcache_param.dir.neg_slots];
+}
+
+/**
+ * @brief Remember that a name does not exist in a directory.
+ *
+ * @param[in] entry The directory
+ * @param[in] name  The missing name
+ */
+void mdcache_neg_add(mdcache_entry_t *entry, const char *name)
+{
+	uint64_t hash;
+	struct mdcache_neg_slot *slot;
+
+	if (mdcache_param.dir.neg_ttl == 0)
+		return;
+
+	if (entry->fsobj.fsdir.neg == NULL)
+		entry->fsobj.fsdir.neg =
+		    gsh_calloc(mdcache_param.dir.neg_slots,
+			       sizeof(struct mdcache_neg_slot));
+
+	hash = mdcache_neg_hash(name);
+	slot = mdcache_neg_slot(entry, hash);
+	slot->hash = hash;
+	slot->expire = time(NULL) + mdcache_param.dir.neg_ttl;
+}
+
+/**
+ * @brief Check whether a name is known not to exist in a directory.
+ *
+ * @param[in] entry The directory
+ * @param[in] name  The name
+ *
+ * @return true if the name was recently found missing.
+ */
+bool mdcache_neg_lookup(mdcache_entry_t *entry, const char *name)
+{
+	uint64_t hash;
+	struct mdcache_neg_slot *slot;
+
+	if (entry->fsobj.fsdir.neg == NULL)
+		return false;
+
+	hash = mdcache_neg_hash(name);
+	slot = mdcache_neg_slot(entry, hash);
+
+	return slot->hash == hash && slot->expire > time(NULL);
+}
+
+/**
+ * @brief Forget a name that now exists in a directory.
+ *
+ * @param[in] entry The directory
+ * @param[in] name  The name
+ */
+void mdcache_neg_forget(mdcache_entry_t *entry, const char *name)
+{
+	uint64_t hash;
+	struct mdcache_neg_slot *slot;
+
+	if (entry->fsobj.fsdir.neg == NULL)
+		return;
+
+	hash = mdcache_neg_hash(name);
+	slot = mdcache_neg_slot(entry, hash);
+	if (slot->hash == hash)
+		slot->hash = 0;
+}
+
+/**
+ * @brief Drop a directory's negative lookup cache.
+ *
+ * @param[in] entry The directory
+ */
+void mdcache_neg_clean(mdcache_entry_t *entry)
+{
+	gsh_free(entry->fsobj.fsdir.neg);
+	entry->fsobj.fsdir.neg = NULL;
+}
+
+/*
+ * Name generations
+ *
+ * A counter per hash of directory and name, bumped whenever the name
+ * is inserted into or deleted from the directory's name tree.  A
+ * LOOKUP that goes to the FSAL without the content lock compares them
+ * before caching what it found, see mdc_lookup_unlocked().  Unrelated
+ * names sharing a counter only cost a locked lookup.
+ */
+
+#define MDCACHE_NAME_GENS 4096
+
+static uint32_t mdcache_name_gens[MDCACHE_NAME_GENS];
+
+static inline uint32_t *mdcache_name_gen_slot(mdcache_entry_t *entry,
+					      const char *name)
+{
+	uint64_t hash = CityHash64WithSeed(name, strlen(name),
+					   (uint64_t) (uintptr_t) entry);
+
+	return &mdcache_name_gens[hash % MDCACHE_NAME_GENS];
+}
+
+/**
+ * @brief Get the generation of a name in a directory.
+ *
+ * @param[in] entry The directory
+ * @param[in] name  The name
+ *
+ * @return The generation, changed by any insert or delete of the name.
+ */
+uint32_t mdcache_name_gen(mdcache_entry_t *entry, const char *name)
+{
+	return atomic_fetch_uint32_t(mdcache_name_gen_slot(entry, name));
+}
+
+/**
+ * @brief Note that a name of a directory has changed.
+ *
+ * @param[in] entry The directory
+ * @param[in] name  The name
+ */
+void mdcache_name_changed(mdcache_entry_t *entry, const char *name)
+{
+	(void) atomic_inc_uint32_t(mdcache_name_gen_slot(entry, name));
 }
 
 static inline struct avltree_node *
@@ -73,6 +230,170 @@ avltree_inline_lookup_hk(const struct avltree_node *key,
 	return avltree_inline_lookup(key, tree, avl_dirent_hk_cmpf);
 }
 
+/*
+ * Name index
+ *
+ * Once a directory caches Dir_Index_Min active dirents, they are also
+ * chained in a hash table by hk.k, so finding a name or resuming a
+ * readdir at a cookie takes no tree search.  The name tree stays, as
+ * readdir walks it in cookie order, so inserts remain logarithmic.
+ * The table doubles whenever it averages two dirents a bucket.
+ *
+ * All of it is protected by the content lock of the directory.
+ */
+
+static inline uint32_t mdcache_index_slot(uint64_t k, uint32_t size)
+{
+	return (k ^ (k >> 32)) & (size - 1);
+}
+
+static inline void mdcache_index_link(mdcache_dir_entry_t **idx,
+				      uint32_t size, mdcache_dir_entry_t *v)
+{
+	mdcache_dir_entry_t **head = &idx[mdcache_index_slot(v->hk.k, size)];
+
+	v->idx_next = *head;
+	*head = v;
+}
+
+/**
+ * @brief Drop the name index of a directory
+ *
+ * @param[in] entry The directory
+ */
+void mdcache_index_free(mdcache_entry_t *entry)
+{
+	uint32_t size = entry->fsobj.fsdir.avl.idx_size;
+
+	if (entry->fsobj.fsdir.avl.idx == NULL)
+		return;
+
+	gsh_free(entry->fsobj.fsdir.avl.idx);
+	mdcache_lru_mem(entry, -(int64_t) (size * sizeof(void *)));
+	entry->fsobj.fsdir.avl.idx = NULL;
+	entry->fsobj.fsdir.avl.idx_size = 0;
+}
+
+/**
+ * @brief (Re)build the name index of a directory from its name tree
+ *
+ * @param[in] entry The directory
+ * @param[in] size  Buckets, a power of two
+ */
+static void mdcache_index_build(mdcache_entry_t *entry, uint32_t size)
+{
+	struct avltree_node *node;
+	mdcache_dir_entry_t **idx;
+
+	idx = mem_arena_calloc(MEM_ARENA_MDCACHE, size, sizeof(*idx));
+
+	for (node = avltree_first(&entry->fsobj.fsdir.avl.t); node != NULL;
+	     node = avltree_next(node))
+		mdcache_index_link(idx, size,
+				   avltree_container_of(node,
+							mdcache_dir_entry_t,
+							node_hk));
+
+	mdcache_index_free(entry);
+	entry->fsobj.fsdir.avl.idx = idx;
+	entry->fsobj.fsdir.avl.idx_size = size;
+	mdcache_lru_mem(entry, size * sizeof(*idx));
+
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Indexed %"PRIu64" dirents of %p in %"PRIu32" buckets",
+		     avltree_size(&entry->fsobj.fsdir.avl.t), entry, size);
+}
+
+/**
+ * @brief Index a dirent just inserted into the name tree
+ *
+ * Builds the index when the tree reaches Dir_Index_Min, and grows it.
+ *
+ * @param[in] entry The directory
+ * @param[in] v     The dirent
+ */
+static void mdcache_index_add(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
+{
+	uint64_t count = avltree_size(&entry->fsobj.fsdir.avl.t);
+	uint32_t size = entry->fsobj.fsdir.avl.idx_size;
+
+	if (entry->fsobj.fsdir.avl.idx == NULL) {
+		if (mdcache_param.dir.index_min == 0 ||
+		    count < mdcache_param.dir.index_min)
+			return;
+
+		for (size = 64; size < count && size < (1U << 31); size <<= 1)
+			;
+		mdcache_index_build(entry, size);
+		return;
+	}
+
+	if (count > 2 * (uint64_t) size && size < (1U << 31)) {
+		mdcache_index_build(entry, size << 1);
+		return;
+	}
+
+	mdcache_index_link(entry->fsobj.fsdir.avl.idx, size, v);
+}
+
+/**
+ * @brief Unindex a dirent leaving the name tree
+ *
+ * @param[in] entry The directory
+ * @param[in] v     The dirent
+ */
+void mdcache_index_del(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
+{
+	mdcache_dir_entry_t **pp;
+
+	if (entry->fsobj.fsdir.avl.idx == NULL)
+		return;
+
+	pp = &entry->fsobj.fsdir.avl.idx[
+		mdcache_index_slot(v->hk.k, entry->fsobj.fsdir.avl.idx_size)];
+
+	for (; *pp != NULL; pp = &(*pp)->idx_next) {
+		if (*pp == v) {
+			*pp = v->idx_next;
+			v->idx_next = NULL;
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Find an active dirent by name hash
+ *
+ * @param[in] entry The directory
+ * @param[in] k     The hash (cookie) to find
+ *
+ * @return The dirent, or NULL.
+ */
+static mdcache_dir_entry_t *mdcache_index_find(mdcache_entry_t *entry,
+					       uint64_t k)
+{
+	mdcache_dir_entry_t *v, key;
+	struct avltree_node *node;
+
+	if (entry->fsobj.fsdir.avl.idx == NULL) {
+		key.hk.k = k;
+		node = avltree_inline_lookup_hk(&key.node_hk,
+						&entry->fsobj.fsdir.avl.t);
+		if (node == NULL)
+			return NULL;
+		return avltree_container_of(node, mdcache_dir_entry_t,
+					    node_hk);
+	}
+
+	v = entry->fsobj.fsdir.avl.idx[
+		mdcache_index_slot(k, entry->fsobj.fsdir.avl.idx_size)];
+
+	while (v != NULL && v->hk.k != k)
+		v = v->idx_next;
+
+	return v;
+}
+
 void
 avl_dirent_set_deleted(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
 {
@@ -85,12 +406,14 @@ avl_dirent_set_deleted(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
 
 	assert(!(v->flags & DIR_ENTRY_FLAG_DELETED));
 
-	node = avltree_inline_lookup_hk(&v->node_hk, &entry->fsobj.fsdir.avl.t);
-	assert(node);
+	mdcache_name_changed(entry, v->name);
+
+	assert(mdcache_index_find(entry, v->hk.k) == v);
+	mdcache_index_del(entry, v);
 	avltree_remove(&v->node_hk, &entry->fsobj.fsdir.avl.t);
 
 	v->flags |= DIR_ENTRY_FLAG_DELETED;
-	mdcache_key_delete(&v->ckey);
+	mdcache_dirent_key_delete(v);
 
 	/* save cookie in deleted avl */
 	node = avltree_insert(&v->node_hk, &entry->fsobj.fsdir.avl.c);
@@ -196,10 +519,122 @@ void unchunk_dirent(mdcache_dir_entry_t *dirent)
 			       &parent->fsobj.fsdir.avl.sorted);
 	}
 
+	/* What was encoded for the chunk goes with it */
+	gsh_free(dirent->encoded);
+	dirent->encoded = NULL;
+
 	/* Just make sure... */
 	dirent->chunk = NULL;
 }
 
+/* Name bytes budgeted per dirent when sizing a chunk arena */
+#define MDCACHE_ARENA_NAME_LEN 32
+/* Largest arena, so a huge Dir_Chunk doesn't preallocate megabytes */
+#define MDCACHE_ARENA_MAX (1024 * 1024)
+
+static inline size_t mdcache_arena_dirent_size(size_t namesize, size_t keylen)
+{
+	size_t size = sizeof(mdcache_dir_entry_t) + namesize + keylen;
+
+	return (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+/**
+ * @brief Allocate a dirent, with its name and key, from a chunk's arena.
+ *
+ * Dirents that readdir adds to a chunk are laid out back to back in a
+ * single block sized for a full chunk, with the name and key bytes
+ * inline after each dirent.  This saves two heap allocations and their
+ * overhead per dirent, keeps a chunk's dirents on adjacent cache lines,
+ * and makes freeing a chunk's memory a single gsh_free.
+ *
+ * The arena is sized on first use from the key length, which is fixed
+ * for a given FSAL, and a typical name length.  When it is full the
+ * caller falls back to a heap dirent.
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] chunk The chunk the dirent will be added to
+ * @param[in] name  The name
+ * @param[in] key   Key of the entry, copied into the arena
+ *
+ * @return The zeroed dirent with name, ckey and chunk set, or NULL.
+ */
+mdcache_dir_entry_t *mdcache_chunk_alloc_dirent(struct dir_chunk *chunk,
+						const char *name,
+						mdcache_key_t *key)
+{
+	size_t namesize = strlen(name) + 1;
+	size_t size = mdcache_arena_dirent_size(namesize, key->kv.len);
+	mdcache_dir_entry_t *dirent;
+
+	if (chunk->arena == NULL) {
+		uint64_t arena_size;
+
+		arena_size = (uint64_t) mdcache_param.dir.avl_chunk *
+		    mdcache_arena_dirent_size(MDCACHE_ARENA_NAME_LEN,
+					      key->kv.len);
+		if (arena_size > MDCACHE_ARENA_MAX)
+			arena_size = MDCACHE_ARENA_MAX;
+
+		chunk->arena = mem_arena_malloc(MEM_ARENA_MDCACHE,
+						arena_size);
+		chunk->arena_size = arena_size;
+		chunk->arena_used = 0;
+		mdcache_chunk_mem(chunk, arena_size);
+	}
+
+	if (chunk->arena_size - chunk->arena_used < size)
+		return NULL;
+
+	dirent = (mdcache_dir_entry_t *) (chunk->arena + chunk->arena_used);
+	chunk->arena_used += size;
+
+	memset(dirent, 0, sizeof(*dirent));
+	memcpy(dirent->name, name, namesize);
+	dirent->flags = DIR_ENTRY_ARENA | DIR_ENTRY_ARENA_KEY;
+	dirent->chunk = chunk;
+	dirent->ckey.hk = key->hk;
+	dirent->ckey.fsal = key->fsal;
+	dirent->ckey.kv.len = key->kv.len;
+	dirent->ckey.kv.addr = dirent->name + namesize;
+	memcpy(dirent->ckey.kv.addr, key->kv.addr, key->kv.len);
+
+	return dirent;
+}
+
+/**
+ * @brief Free a dirent that is in no tree or chunk list.
+ *
+ * An arena dirent stays allocated until its chunk is freed, except
+ * that the last one handed out is given back, which is the common case
+ * of a freshly allocated dirent losing an insert race.
+ *
+ * @param[in] dirent The dirent
+ */
+void mdcache_dirent_free(mdcache_dir_entry_t *dirent)
+{
+	struct dir_chunk *chunk = dirent->chunk;
+	size_t size;
+
+	if (!(dirent->flags & DIR_ENTRY_ARENA)) {
+		mdcache_lru_mem(NULL, -(int64_t) (sizeof(*dirent) +
+						  strlen(dirent->name) + 1));
+		mdcache_dirent_key_delete(dirent);
+		gsh_free(dirent);
+		return;
+	}
+
+	if (chunk == NULL || !(dirent->flags & DIR_ENTRY_ARENA_KEY))
+		return;
+
+	size = mdcache_arena_dirent_size(strlen(dirent->name) + 1,
+					 dirent->ckey.kv.len);
+
+	if ((char *) dirent + size == chunk->arena + chunk->arena_used)
+		chunk->arena_used -= size;
+}
+
 /**
  * @brief Remove and free a dirent.
  *
@@ -214,10 +649,7 @@ void mdcache_avl_remove(mdcache_dir_entry_t *dirent, struct avltree *t)
 	if (dirent->chunk != NULL)
 		unchunk_dirent(dirent);
 
-	if (dirent->ckey.kv.len)
-		mdcache_key_delete(&dirent->ckey);
-
-	gsh_free(dirent);
+	mdcache_dirent_free(dirent);
 }
 
 /**
@@ -276,6 +708,8 @@ mdcache_avl_insert_impl(mdcache_entry_t *entry, mdcache_dir_entry_t *v,
 	node = avltree_insert(&v->node_hk, t);
 
 	if (!node) {
+		mdcache_index_add(entry, v);
+
 		/* success, note iterations */
 		v->hk.p = j + j2;
 		if (entry->fsobj.fsdir.avl.collisions < v->hk.p)
@@ -389,6 +823,10 @@ mdcache_avl_qp_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent)
 		     "Insert dir entry %p %s",
 		     v, v->name);
 
+	/* The name exists now */
+	mdcache_neg_forget(entry, v->name);
+	mdcache_name_changed(entry, v->name);
+
 	/* don't permit illegal cookies */
 #if AVL_HASH_MURMUR3
 	MurmurHash3_x64_128(v->name, strlen(v->name), 67, hk);
@@ -429,6 +867,7 @@ again:
 					 * AVL tree, remove from lookup by name
 					 * AVL tree.
 					 */
+					mdcache_index_del(entry, v);
 					avltree_remove(&v->node_hk,
 						       &entry
 							   ->fsobj.fsdir.avl.t);
@@ -481,6 +920,7 @@ again:
 			}
 
 			/* Remove the found dirent. */
+			mdcache_index_del(entry, v2);
 			mdcache_avl_remove(v2, &entry->fsobj.fsdir.avl.t);
 			v2 = NULL;
 			goto again;
@@ -592,8 +1032,7 @@ again:
 
 out:
 
-	mdcache_key_delete(&v->ckey);
-	gsh_free(v);
+	mdcache_dirent_free(v);
 	*dirent = v2;
 
 	return code;
@@ -622,13 +1061,14 @@ mdcache_avl_lookup_k(mdcache_entry_t *entry, uint64_t k, uint32_t flags,
 {
 	struct avltree *t = &entry->fsobj.fsdir.avl.t;
 	struct avltree *c = &entry->fsobj.fsdir.avl.c;
-	mdcache_dir_entry_t dirent_key[1];
+	mdcache_dir_entry_t dirent_key[1], *v;
 	struct avltree_node *node, *node2;
 
 	*dirent = NULL;
 	dirent_key->hk.k = k;
 
-	node = avltree_inline_lookup_hk(&dirent_key->node_hk, t);
+	v = mdcache_index_find(entry, k);
+	node = v != NULL ? &v->node_hk : NULL;
 	if (node) {
 		if (flags & MDCACHE_FLAG_NEXT_ACTIVE)
 			/* client wants the cookie -after- the last we sent, and
@@ -721,8 +1161,6 @@ bool mdcache_avl_lookup_ck(mdcache_entry_t *entry, uint64_t ck,
 mdcache_dir_entry_t *
 mdcache_avl_qp_lookup_s(mdcache_entry_t *entry, const char *name, int maxj)
 {
-	struct avltree *t = &entry->fsobj.fsdir.avl.t;
-	struct avltree_node *node;
 	mdcache_dir_entry_t *v2;
 #if AVL_HASH_MURMUR3
 	uint32_t hashbuff[4];
@@ -751,11 +1189,9 @@ mdcache_avl_qp_lookup_s(mdcache_entry_t *entry, const char *name, int maxj)
 
 	for (j = 0; j < maxj; j++) {
 		v.hk.k = (v.hk.k + (j * 2));
-		node = avltree_lookup(&v.node_hk, t);
-		if (node) {
-			/* ensure that node is related to v */
-			v2 = avltree_container_of(node, mdcache_dir_entry_t,
-						  node_hk);
+		v2 = mdcache_index_find(entry, v.hk.k);
+		if (v2) {
+			/* ensure that v2 is related to v */
 			if (strcmp(name, v2->name) == 0) {
 				assert(!(v2->flags & DIR_ENTRY_FLAG_DELETED));
 				return v2;
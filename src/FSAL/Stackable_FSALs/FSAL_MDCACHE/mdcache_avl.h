@@ -142,8 +142,21 @@ bool mdcache_avl_lookup_ck(mdcache_entry_t *entry, uint64_t ck,
 mdcache_dir_entry_t *mdcache_avl_qp_lookup_s(mdcache_entry_t *entry,
 					     const char *name, int maxj);
 void mdcache_avl_clean_tree(struct avltree *tree);
+void mdcache_index_free(mdcache_entry_t *entry);
+void mdcache_index_del(mdcache_entry_t *entry, mdcache_dir_entry_t *v);
 
 void unchunk_dirent(mdcache_dir_entry_t *dirent);
+mdcache_dir_entry_t *mdcache_chunk_alloc_dirent(struct dir_chunk *chunk,
+						const char *name,
+						mdcache_key_t *key);
+void mdcache_dirent_free(mdcache_dir_entry_t *dirent);
+
+void mdcache_neg_add(mdcache_entry_t *entry, const char *name);
+bool mdcache_neg_lookup(mdcache_entry_t *entry, const char *name);
+void mdcache_neg_forget(mdcache_entry_t *entry, const char *name);
+void mdcache_neg_clean(mdcache_entry_t *entry);
+uint32_t mdcache_name_gen(mdcache_entry_t *entry, const char *name);
+void mdcache_name_changed(mdcache_entry_t *entry, const char *name);
 #endif				/* MDCACHE_AVL_H */
 
 /** @} */
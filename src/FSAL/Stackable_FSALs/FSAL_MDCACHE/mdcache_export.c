@@ -49,8 +49,11 @@
 #include "FSAL/fsal_config.h"
 #include "mdcache_lru.h"
 #include "mdcache_hash.h"
+#include "mdcache.h"
 #include "nfs_exports.h"
 #include "export_mgr.h"
+#include "abstract_atomic.h"
+#include "city.h"
 
 /*
  * helpers to/from other NULL objects
@@ -77,6 +80,30 @@ static const char *mdcache_get_name(struct fsal_export *exp_hdl)
 	return exp->name;
 }
 
+/**
+ * @brief Drop what is cached of an export's objects
+ *
+ * Their attributes, ACLs, dirents and symlink contents are fetched
+ * again on next use, as after an invalidate up-call on each of them.
+ *
+ * @param[in] exp_hdl	MDCACHE export
+ */
+void mdcache_invalidate_export(struct fsal_export *exp_hdl)
+{
+	struct mdcache_fsal_export *exp = mdc_export(exp_hdl);
+	struct entry_export_map *expmap;
+	struct glist_head *glist;
+
+	PTHREAD_RWLOCK_rdlock(&exp->mdc_exp_lock);
+	glist_for_each(glist, &exp->entry_list) {
+		expmap = glist_entry(glist, struct entry_export_map,
+				     entry_per_export);
+		atomic_clear_uint32_t_bits(&expmap->entry->mde_flags,
+					   FSAL_UP_INVALIDATE_CACHE);
+	}
+	PTHREAD_RWLOCK_unlock(&exp->mdc_exp_lock);
+}
+
 /**
  * @brief Un-export an MDCACHE export
  *
@@ -126,7 +153,7 @@ static void mdcache_unexport(struct fsal_export *exp_hdl,
 
 
 		/* Must get attr_lock before mdc_exp_lock */
-		PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+		MDC_ATTR_WRLOCK(entry);
 		PTHREAD_RWLOCK_wrlock(&exp->mdc_exp_lock);
 
 		mdc_remove_export_map(expmap);
@@ -140,7 +167,7 @@ static void mdcache_unexport(struct fsal_export *exp_hdl,
 			/* We must not hold entry->attr_lock across
 			 * try_cleanup_push (LRU lane lock order) */
 			PTHREAD_RWLOCK_unlock(&exp->mdc_exp_lock);
-			PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+			MDC_ATTR_UNLOCK(entry);
 
 			/* There are no exports referencing this entry, attempt
 			 * to push it to cleanup queue.  */
@@ -151,7 +178,7 @@ static void mdcache_unexport(struct fsal_export *exp_hdl,
 					     expmap->export);
 
 			PTHREAD_RWLOCK_unlock(&exp->mdc_exp_lock);
-			PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+			MDC_ATTR_UNLOCK(entry);
 		}
 
 		/* Release above ref */
@@ -174,6 +201,8 @@ static void mdcache_exp_release(struct fsal_export *exp_hdl)
 	struct fsal_export *sub_export = exp->export.sub_export;
 	struct fsal_module *fsal_hdl;
 
+	mdcache_lru_export_del(exp);
+
 	fsal_hdl = sub_export->fsal;
 
 	/* Release the sub_export */
@@ -186,6 +215,8 @@ static void mdcache_exp_release(struct fsal_export *exp_hdl)
 	fsal_detach_export(exp_hdl->fsal, &exp_hdl->exports);
 	free_export_ops(exp_hdl);
 
+	gsh_free(exp->quota_cache);
+	PTHREAD_MUTEX_destroy(&exp->quota_lock);
 	gsh_free(exp->name);
 
 	gsh_free(exp);	/* elvis has left the building */
@@ -476,10 +507,94 @@ static uint32_t mdcache_fs_xattr_access_rights(struct fsal_export *exp_hdl)
 	return result;
 }
 
+/*
+ * Quota cache
+ *
+ * Every create and write checks quota, and RQUOTA clients ask for the
+ * same users over and over, each time a quotactl or the like in the
+ * sub-FSAL.  Successful answers are kept for Quota_Cache_TTL seconds
+ * in a small direct mapped table per export.  A check_quota is keyed
+ * by the path, the type and the caller's uid, a get_quota by the path,
+ * the type and the id asked for.  Errors are not cached.
+ *
+ * set_quota drops the answers of the id it set and all checks, a check
+ * may depend on a group quota.
+ */
+
+#define MDC_QUOTA_SLOTS 256
+
+static uint64_t mdc_quota_hash(const char *filepath, int quota_type,
+			       int quota_id)
+{
+	uint64_t seed = ((uint64_t)(uint32_t)quota_type << 32) |
+			(uint32_t)quota_id;
+	uint64_t hash = CityHash64WithSeed(filepath, strlen(filepath), seed);
+
+	return hash != 0 ? hash : 1;
+}
+
+static bool mdc_quota_lookup(struct mdcache_fsal_export *exp, uint64_t hash,
+			     fsal_quota_t *pquota)
+{
+	struct mdc_quota_slot *slot;
+	bool found = false;
+
+	PTHREAD_MUTEX_lock(&exp->quota_lock);
+	if (exp->quota_cache != NULL) {
+		slot = &exp->quota_cache[hash % MDC_QUOTA_SLOTS];
+		if (slot->hash == hash && slot->expire > time(NULL)) {
+			if (pquota != NULL)
+				*pquota = slot->quota;
+			found = true;
+		}
+	}
+	PTHREAD_MUTEX_unlock(&exp->quota_lock);
+
+	(void)atomic_inc_uint64_t(found ? &exp->quota_hits
+					: &exp->quota_misses);
+	return found;
+}
+
+static void mdc_quota_add(struct mdcache_fsal_export *exp, uint64_t hash,
+			  int quota_type, int quota_id, fsal_quota_t *pquota)
+{
+	struct mdc_quota_slot *slot;
+
+	PTHREAD_MUTEX_lock(&exp->quota_lock);
+	if (exp->quota_cache == NULL)
+		exp->quota_cache = gsh_calloc(MDC_QUOTA_SLOTS,
+					      sizeof(struct mdc_quota_slot));
+	slot = &exp->quota_cache[hash % MDC_QUOTA_SLOTS];
+	slot->hash = hash;
+	slot->expire = time(NULL) + mdcache_param.quota_ttl;
+	slot->quota_type = quota_type;
+	slot->quota_id = quota_id;
+	if (pquota != NULL)
+		slot->quota = *pquota;
+	PTHREAD_MUTEX_unlock(&exp->quota_lock);
+}
+
+static void mdc_quota_forget(struct mdcache_fsal_export *exp, int quota_type,
+			     int quota_id)
+{
+	struct mdc_quota_slot *slot;
+	int i;
+
+	PTHREAD_MUTEX_lock(&exp->quota_lock);
+	for (i = 0; exp->quota_cache != NULL && i < MDC_QUOTA_SLOTS; i++) {
+		slot = &exp->quota_cache[i];
+		if (slot->quota_type == -1 ||
+		    (slot->quota_type == quota_type &&
+		     slot->quota_id == quota_id))
+			slot->hash = 0;
+	}
+	PTHREAD_MUTEX_unlock(&exp->quota_lock);
+}
+
 /**
  * @brief Check quota on a file
  *
- * MDCACHE only caches metadata, so it imposes no restrictions itself.
+ * A recent successful check for the same caller is reused.
  *
  * @param[in] exp_hdl	Export to query
  * @param[in] filepath	Path to file to query
@@ -492,19 +607,31 @@ static fsal_status_t mdcache_check_quota(struct fsal_export *exp_hdl,
 	struct mdcache_fsal_export *exp = mdc_export(exp_hdl);
 	struct fsal_export *sub_export = exp->export.sub_export;
 	fsal_status_t status;
+	bool cache = mdcache_param.quota_ttl != 0 && op_ctx->creds != NULL;
+	uint64_t hash = 0;
+
+	if (cache) {
+		hash = mdc_quota_hash(filepath, -quota_type,
+				      op_ctx->creds->caller_uid);
+		if (mdc_quota_lookup(exp, hash, NULL))
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
 
 	subcall_raw(exp,
 		status = sub_export->exp_ops.check_quota(sub_export, filepath,
 							 quota_type)
 	       );
 
+	if (cache && !FSAL_IS_ERROR(status))
+		mdc_quota_add(exp, hash, -1, 0, NULL);
+
 	return status;
 }
 
 /**
  * @brief Get quota information for a file
  *
- * MDCACHE only caches metadata, so it imposes no restrictions itself.
+ * A recent successful lookup of the same id is reused.
  *
  * @param[in] exp_hdl	Export to query
  * @param[in] filepath	Path to file to query
@@ -521,19 +648,29 @@ static fsal_status_t mdcache_get_quota(struct fsal_export *exp_hdl,
 	struct mdcache_fsal_export *exp = mdc_export(exp_hdl);
 	struct fsal_export *sub_export = exp->export.sub_export;
 	fsal_status_t status;
+	uint64_t hash = 0;
+
+	if (mdcache_param.quota_ttl != 0) {
+		hash = mdc_quota_hash(filepath, quota_type, quota_id);
+		if (mdc_quota_lookup(exp, hash, pquota))
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
 
 	subcall_raw(exp,
 		status = sub_export->exp_ops.get_quota(sub_export, filepath,
 						       quota_type, quota_id,
 						       pquota));
 
+	if (mdcache_param.quota_ttl != 0 && !FSAL_IS_ERROR(status))
+		mdc_quota_add(exp, hash, quota_type, quota_id, pquota);
+
 	return status;
 }
 
 /**
  * @brief Set a quota for a file
  *
- * MDCACHE only caches metadata, so it imposes no restrictions itself.
+ * Cached answers the new quota may change are dropped.
  *
  * @param[in] exp_hdl	Export to query
  * @param[in] filepath	Path to file to query
@@ -558,6 +695,8 @@ static fsal_status_t mdcache_set_quota(struct fsal_export *exp_hdl,
 			filepath, quota_type, quota_id, pquota, presquota)
 	       );
 
+	mdc_quota_forget(exp, quota_type, quota_id);
+
 	return status;
 }
 
@@ -801,6 +940,7 @@ void mdcache_export_ops_init(struct export_ops *ops)
 	/* lookup_junction unimplemented because deprecated */
 	ops->extract_handle = mdcache_extract_handle;
 	ops->create_handle = mdcache_create_handle;
+	ops->create_handle_hint = mdcache_create_handle_hint;
 	ops->get_fs_dynamic_info = mdcache_get_dynamic_info;
 	ops->fs_supports = mdcache_fs_supports;
 	ops->fs_maxfilesize = mdcache_fs_maxfilesize;
@@ -906,6 +1046,10 @@ mdc_init_export(struct fsal_module *fsal_hdl,
 		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 #endif
 	PTHREAD_RWLOCK_init(&myself->mdc_exp_lock, &attrs);
+	PTHREAD_MUTEX_init(&myself->quota_lock, NULL);
+
+	myself->owner = op_ctx->ctx_export;
+	mdcache_lru_export_add(myself);
 
 	op_ctx->fsal_export = &myself->export;
 	op_ctx->fsal_module = fsal_hdl;
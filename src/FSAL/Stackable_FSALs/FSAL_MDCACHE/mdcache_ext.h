@@ -38,6 +38,30 @@
  * @{
  */
 
+/**
+ * @brief Handle index used by each hash partition
+ */
+enum cih_backend {
+	CIH_BACKEND_AVL,	/*< AVL tree plus direct-mapped cache */
+	CIH_BACKEND_OAHASH,	/*< open-addressing hash, gsh_oahash.h */
+};
+
+/**
+ * @brief Hash of the handle keys
+ */
+enum cih_key_hash {
+	CIH_KEY_HASH_CITY,	/*< CityHash64 */
+	CIH_KEY_HASH_CRC32C,	/*< hardware CRC32C, where supported */
+};
+
+/**
+ * @brief Entry replacement policy
+ */
+enum lru_policy {
+	LRU_POLICY_LRU,		/*< two level LRU */
+	LRU_POLICY_2Q,		/*< 2Q with a ghost list */
+};
+
 /**
  * @brief Structure to hold MDCACHE paramaters
  */
@@ -52,6 +76,19 @@ struct mdcache_parameter {
 	/** Use getattr for directory invalidation.  Defaults to
 	    false.  Settable with Use_Getattr_Directory_Invalidation. */
 	bool getattr_dir_invalidation;
+	/** Look up handles without taking the hash partition lock.
+	    Defaults to false, settable with Lockless_Lookup. */
+	bool lockless_lookup;
+	/** Put the cache hash of an object in its file handles, so
+	    they are looked up without hashing.  Defaults to false,
+	    settable with Handle_Cache_Hint. */
+	bool handle_cache_hint;
+	/** Partition index, an enum cih_backend.  Defaults to AVL,
+	    settable with Hash_Backend. */
+	uint32_t hash_backend;
+	/** Hash of the handle keys, an enum cih_key_hash.  Defaults
+	    to City, settable with Handle_Hash. */
+	uint32_t key_hash;
 	struct {
 		/** Max size of per-directory cache of removed
 		    entries */
@@ -62,10 +99,63 @@ struct mdcache_parameter {
 		 *  directory chunking is not enabled.
 		 */
 		uint32_t avl_chunk;
+		/** Number of chunks to populate in the background ahead
+		 *  of a sequential readdir, 0 disables readahead.
+		 *  Defaults to 0, settable with Dir_Readahead.
+		 */
+		uint32_t readahead;
+		/** Threads fetching the attributes of a READDIR reply's
+		 *  entries in parallel, 0 disables the prefetch.
+		 *  Defaults to 0, settable with Dir_Attr_Prefetch.
+		 */
+		uint32_t attr_prefetch;
+		/** Seconds a name the FSAL reported missing is remembered
+		 *  per directory, 0 disables the negative lookup cache.
+		 *  Defaults to 0, settable with Negative_Lookup_TTL.
+		 */
+		uint32_t neg_ttl;
+		/** Slots in each directory's negative lookup cache.
+		 *  Defaults to 256, settable with Negative_Lookup_Slots.
+		 */
+		uint32_t neg_slots;
+		/** Whether a LOOKUP miss drops the directory's content
+		 *  lock while the sub-FSAL looks the name up.  Defaults
+		 *  to false, settable with Unlocked_Lookup.
+		 */
+		bool unlocked_lookup;
+		/** Active dirents from which a directory indexes its
+		 *  names in a hash table besides the name tree, 0 never.
+		 *  Defaults to 0, settable with Dir_Index_Min.
+		 */
+		uint32_t index_min;
+		/** Active dirents from which an invalidated directory
+		 *  has them freed in the background, 0 never.  Defaults
+		 *  to 0, settable with Dir_Lazy_Free_Min.
+		 */
+		uint32_t lazy_free_min;
 	} dir;
 	/** High water mark for cache entries.  Defaults to 100000,
 	    settable by Entries_HWMark. */
 	uint32_t entries_hwmark;
+	/** High water mark for the bytes held by the cache, 0 for none.
+	    Defaults to 0, settable by Memory_HWMark_Bytes. */
+	uint64_t memory_hwmark_bytes;
+	/** Keep attributes and dirents of FSALs that report every
+	    change through FSAL_UP until an upcall invalidates them,
+	    instead of expiring them.  Defaults to false, settable with
+	    Upcall_Lease. */
+	bool upcall_lease;
+	/** Refresh attributes in the background when a GETATTR finds
+	    them in the last this percent of Attr_Expiration_Time, 0
+	    disables.  Defaults to 0, settable with Attr_Refresh_Ahead. */
+	uint32_t attr_refresh_ahead;
+	/** GETATTRs served from cache since the last refresh before an
+	    entry is refreshed ahead.  Defaults to 4, settable with
+	    Attr_Refresh_Hits. */
+	uint32_t attr_refresh_hits;
+	/** Background refreshes started per second, 0 for no limit.
+	    Defaults to 1000, settable with Attr_Refresh_Rate. */
+	uint32_t attr_refresh_rate;
 	/** Base interval in seconds between runs of the LRU cleaner
 	    thread. Defaults to 60, settable with LRU_Run_Interval. */
 	time_t lru_run_interval;
@@ -103,11 +193,81 @@ struct mdcache_parameter {
 	    we disable caching, when in extremis.  Defaults to 8,
 	    settable with Futility_Count */
 	uint32_t futility_count;
+	/** Replacement policy, an enum lru_policy.  Defaults to LRU,
+	    settable with LRU_Policy. */
+	uint32_t lru_policy;
+	/** With the 2Q policy, the share of Entries_HWMark that
+	    entries seen only once may hold before they are reclaimed
+	    first.  Defaults to 25, settable with LRU_2Q_In_Percent. */
+	uint32_t lru_2q_in_percent;
+	/** With the 2Q policy, the number of reclaimed entries to
+	    remember, as a percentage of Entries_HWMark.  Defaults to
+	    50, settable with LRU_2Q_Ghost_Percent. */
+	uint32_t lru_2q_ghost_percent;
 	/** Behavior for when readdir fails for some reason:
 	    true will ask the client to retry later, false will give the
 	    client a partial reply based on what we have.
 	    Defaults to false, settable with Retry_Readdir */
 	bool retry_readdir;
+	/** Largest run of adjacent unstable writes to one file that
+	    is gathered into a single sub-FSAL write while another
+	    write to the file is in flight.  0 disables gathering.
+	    Defaults to 0, settable with Write_Gather_Max. */
+	uint32_t write_gather_max;
+	/** Largest file read whole in the background when opened
+	    read only, for the READ that follows.  0 disables.
+	    Defaults to 0, settable with Open_Preread_Max. */
+	uint32_t open_preread_max;
+	/** Let COMMITs of a file that arrive while a flush of it is in
+	    flight share the next flush.  Defaults to false, settable
+	    with Commit_Coalesce. */
+	bool commit_coalesce;
+	/** Seconds for which a successful quota check or lookup of the
+	    sub-FSAL is reused, 0 disables.  Defaults to 5, settable
+	    with Quota_Cache_TTL. */
+	uint32_t quota_ttl;
+	/** File the keys of the hottest entries are saved to, and
+	    warmed up from at startup.  NULL (the default) disables
+	    snapshots.  Settable with Snapshot_File. */
+	char *snapshot_file;
+	/** Seconds between snapshots, 0 for only at shutdown.
+	    Defaults to 300, settable with Snapshot_Interval. */
+	uint32_t snapshot_interval;
+	/** Most entries a snapshot keeps.  Defaults to 100000,
+	    settable with Snapshot_Entries. */
+	uint32_t snapshot_entries;
+	/** Entries per second brought back from a snapshot at
+	    startup.  Defaults to 1000, settable with
+	    Snapshot_Prefetch_Rate. */
+	uint32_t snapshot_rate;
+	/** Comma separated xattr name prefixes (e.g. "security.")
+	    whose values are cached per entry.  NULL (the default)
+	    caches none.  NFSv4.2 xattrs are in "user.".  Settable
+	    with Xattr_Cache_Namespaces. */
+	char *xattr_namespaces;
+	/** Largest xattr value cached.  Defaults to 256, settable
+	    with Xattr_Cache_Value_Max. */
+	uint32_t xattr_value_max;
+	/** Bytes of xattrs cached per entry, the oldest are dropped
+	    beyond.  Defaults to 4096, settable with
+	    Xattr_Cache_Entry_Bytes. */
+	uint32_t xattr_entry_bytes;
+	/** ACCESS results remembered per entry, for as many
+	    credentials.  Defaults to 0, which remembers none, settable
+	    with Access_Cache_Slots up to MDC_ACCESS_SLOTS. */
+	uint32_t access_slots;
+	/** Serve GETATTRs that do not ask for the ACL from the cached
+	    attributes without taking attr_lock.  Defaults to false,
+	    settable with Lockless_Getattr. */
+	bool lockless_getattr;
+	/** Revalidate expired attributes by asking the FSAL for the
+	    change attribute alone, and fetch them all only if it
+	    moved.  Defaults to false, settable with Change_Probe. */
+	bool change_probe;
+	/** Time the calls into the sub-FSAL, into per-FSAL latency
+	    histograms.  Defaults to false, settable with
+	    FSAL_Latency_Histograms. */
+	bool fsal_call_hists;
 };
 
 extern struct mdcache_parameter mdcache_param;
@@ -35,6 +35,9 @@
 #include "FSAL/fsal_commonlib.h"
 #include "mdcache_int.h"
 #include "mdcache_lru.h"
+#include "sal_functions.h"
+#include "export_mgr.h"
+#include "fridgethr.h"
 
 /**
  *
@@ -441,9 +444,395 @@ fsal_status_t mdcache_close(struct fsal_obj_handle *obj_hdl)
 		status = entry->sub_handle->obj_ops.close(entry->sub_handle)
 	       );
 
+	mdcache_lru_fd_closed(entry);
+
 	return status;
 }
 
+/* Threads reading small files whole after an OPEN */
+#define MDC_PREREAD_THREADS 8
+/* Seconds a preread file is served for */
+#define MDC_PREREAD_TTL 2
+/* Bytes all preread files may hold */
+#define MDC_PREREAD_MAX_BYTES (64 * 1024 * 1024)
+
+static struct fridgethr *mdc_preread_fridge;
+
+/* Bytes held or being read by prereads */
+static uint64_t mdc_preread_bytes;
+
+struct mdc_preread_job {
+	mdcache_entry_t *entry;
+	struct gsh_export *export;
+	/** Bytes reserved in mdc_preread_bytes */
+	size_t charge;
+};
+
+/**
+ * @brief Free a preread file and give back its bytes
+ *
+ * @param[in] pr	Preread file, may be NULL
+ */
+static void mdc_preread_free(struct mdc_preread *pr)
+{
+	if (pr == NULL)
+		return;
+
+	(void) atomic_sub_uint64_t(&mdc_preread_bytes, pr->charge);
+	gsh_iobuf_put(pr->buf);
+	gsh_free(pr);
+}
+
+/**
+ * @brief Drop the preread content of a file
+ *
+ * A preread being done is not installed when it is done.
+ *
+ * @note The attr_lock MUST be held for write
+ *
+ * @param[in] entry	File
+ */
+void mdc_preread_drop_locked(mdcache_entry_t *entry)
+{
+	struct mdc_preread *pr = entry->preread;
+
+	entry->preread = NULL;
+	entry->preread_gen++;
+	mdc_preread_free(pr);
+}
+
+/**
+ * @brief Drop the preread content of a file before it changes
+ *
+ * Cheap when there is none and none is being read.
+ *
+ * @param[in] entry	File
+ */
+void mdc_preread_drop(mdcache_entry_t *entry)
+{
+	if (atomic_fetch_voidptr((void **)&entry->preread) == NULL &&
+	    !(atomic_fetch_uint32_t(&entry->mde_flags) & MDCACHE_PREREAD))
+		return;
+
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	mdc_preread_drop_locked(entry);
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+}
+
+/**
+ * @brief Read a small file whole
+ *
+ * Runs on the preread fridge with root credentials, the OPEN that
+ * queued it has checked access.  The file is read through the global
+ * fd.  The content is kept only if nothing has dropped it meanwhile
+ * and the change attribute is the one it was read at.
+ *
+ * @param[in] ctx Thread context, arg is the job
+ */
+
+static void mdc_preread_run(struct fridgethr_context *ctx)
+{
+	struct mdc_preread_job *job = ctx->arg;
+	mdcache_entry_t *entry = job->entry;
+	struct root_op_context root_op_context;
+	struct mdc_preread *pr = NULL, *old = NULL;
+	fsal_status_t status;
+	uint64_t change, size;
+	uint32_t gen;
+	bool trusted;
+
+	init_root_op_context(&root_op_context, job->export,
+			     job->export->fsal_export, 0, 0, UNKNOWN_REQUEST);
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+	trusted = atomic_fetch_uint32_t(&entry->mde_flags) &
+		  MDCACHE_TRUST_ATTRS;
+	change = entry->attrs.change;
+	size = entry->attrs.filesize;
+	gen = entry->preread_gen;
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	if (!trusted || size + 1 > job->charge) {
+		(void) atomic_sub_uint64_t(&mdc_preread_bytes, job->charge);
+		goto out;
+	}
+
+	/* Ask for a byte more, a short read tells the end of file */
+	pr = gsh_malloc(sizeof(*pr));
+	pr->buf = gsh_iobuf_get(size + 1);
+	pr->charge = job->charge;
+	pr->change = change;
+
+	subcall_timed(FSAL_CALL_READ, entry, status,
+		status = entry->sub_handle->obj_ops.read2(
+			entry->sub_handle, false, NULL, 0, size + 1,
+			pr->buf, &pr->len, &pr->eof, NULL)
+	       );
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Preread of %p failed status=%s",
+			 entry, fsal_err_txt(status));
+		goto out;
+	}
+
+	mdcache_lru_fd_used(entry);
+	pr->eof = pr->eof || pr->len <= size;
+	pr->expire = time(NULL) + MDC_PREREAD_TTL;
+
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Preread %zu bytes of %p", pr->len, entry);
+
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	if (entry->preread_gen == gen &&
+	    (atomic_fetch_uint32_t(&entry->mde_flags) & MDCACHE_TRUST_ATTRS) &&
+	    entry->attrs.change == change) {
+		old = entry->preread;
+		entry->preread = pr;
+		pr = NULL;
+	}
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+out:
+	mdc_preread_free(old);
+	mdc_preread_free(pr);
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_PREREAD);
+	mdcache_put(entry);
+	release_root_op_context();
+	put_gsh_export(job->export);
+	gsh_free(job);
+}
+
+/**
+ * @brief Queue the read of a small file just opened for reading
+ *
+ * Clients reading a small file send the READ right after the OPEN.
+ * Reading the file whole in the background as soon as it is open
+ * overlaps the two round trips to the FSAL.  At most one preread is
+ * queued per file at a time, and files already preread are left be.
+ *
+ * @param[in] entry	File opened
+ * @param[in] openflags	Flags it was opened with
+ */
+
+static void mdc_preread_start(mdcache_entry_t *entry,
+			      fsal_openflags_t openflags)
+{
+	struct mdc_preread_job *job;
+	uint64_t size = entry->attrs.filesize;
+	size_t charge;
+	int rc;
+
+	if (mdc_preread_fridge == NULL || op_ctx->ctx_export == NULL ||
+	    entry->obj_handle.type != REGULAR_FILE ||
+	    !entry->obj_handle.fsal->m_ops.support_ex(&entry->obj_handle) ||
+	    (openflags & (FSAL_O_RDWR | FSAL_O_TRUNC)) != FSAL_O_READ ||
+	    !(atomic_fetch_uint32_t(&entry->mde_flags) & MDCACHE_TRUST_ATTRS) ||
+	    size == 0 || size > mdcache_param.open_preread_max ||
+	    atomic_fetch_voidptr((void **)&entry->preread) != NULL)
+		return;
+
+	if (atomic_postset_uint32_t_bits(&entry->mde_flags, MDCACHE_PREREAD) &
+	    MDCACHE_PREREAD)
+		return;
+
+	charge = size + 1;
+	if (atomic_add_uint64_t(&mdc_preread_bytes, charge) >
+	    MDC_PREREAD_MAX_BYTES) {
+		(void) atomic_sub_uint64_t(&mdc_preread_bytes, charge);
+		goto clear;
+	}
+
+	if (FSAL_IS_ERROR(mdcache_get(entry))) {
+		(void) atomic_sub_uint64_t(&mdc_preread_bytes, charge);
+		goto clear;
+	}
+
+	job = gsh_malloc(sizeof(*job));
+	job->entry = entry;
+	job->export = op_ctx->ctx_export;
+	job->charge = charge;
+	get_gsh_export_ref(job->export);
+
+	rc = fridgethr_submit(mdc_preread_fridge, mdc_preread_run, job);
+	if (rc == 0)
+		return;
+
+	LogDebug(COMPONENT_CACHE_INODE,
+		 "Could not queue preread of %p: %d", entry, rc);
+	(void) atomic_sub_uint64_t(&mdc_preread_bytes, charge);
+	put_gsh_export(job->export);
+	gsh_free(job);
+	mdcache_put(entry);
+clear:
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_PREREAD);
+}
+
+/**
+ * @brief Find a read in the preread content of a file
+ *
+ * Content that is stale is dropped.  So is content that has been
+ * read to the end of file, clients read a small file once.
+ *
+ * @param[in] entry	File to read
+ * @param[in] offset	Offset of the read
+ * @param[in] size	Size of the read
+ * @param[out] read_amount	Bytes found, from @a offset
+ * @param[out] eof	true if the read reaches end of file
+ *
+ * @return A reference to the buffer holding the whole file, for the
+ *	   caller to gsh_iobuf_put, or NULL to read from the FSAL.
+ */
+
+static void *mdc_preread_get(mdcache_entry_t *entry, uint64_t offset,
+			     size_t size, size_t *read_amount, bool *eof)
+{
+	struct mdc_preread *pr;
+	void *buf = NULL;
+	bool drop = false;
+
+	if (atomic_fetch_voidptr((void **)&entry->preread) == NULL)
+		return NULL;
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+
+	pr = entry->preread;
+	if (pr == NULL)
+		goto out;
+
+	if (!(atomic_fetch_uint32_t(&entry->mde_flags) & MDCACHE_TRUST_ATTRS) ||
+	    entry->attrs.change != pr->change || time(NULL) >= pr->expire) {
+		drop = true;
+		goto out;
+	}
+
+	if (offset >= pr->len) {
+		if (!pr->eof)
+			goto out;
+		*read_amount = 0;
+	} else if (offset + size <= pr->len || pr->eof) {
+		*read_amount = MIN(size, pr->len - offset);
+	} else {
+		goto out;
+	}
+
+	*eof = pr->eof && offset + *read_amount >= pr->len;
+	drop = *eof;
+	buf = pr->buf;
+	gsh_iobuf_ref(buf);
+
+out:
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	if (drop)
+		mdc_preread_drop(entry);
+
+	if (buf != NULL) {
+		mdc_set_time_current(&entry->attrs.atime);
+		LogFullDebug(COMPONENT_CACHE_INODE,
+			     "Read %zu bytes at %"PRIu64" of %p from preread",
+			     *read_amount, offset, entry);
+	}
+
+	return buf;
+}
+
+/* Bytes segments hold */
+static size_t mdc_iov_len(const struct iovec *iov, int iovcnt)
+{
+	size_t total = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		total += iov[i].iov_len;
+
+	return total;
+}
+
+/**
+ * @brief Copy a read found in preread content into segments
+ *
+ * @param[in] buf	Buffer holding the whole file
+ * @param[in] offset	Offset of the read
+ * @param[in] iov	Segments to fill
+ * @param[in] iovcnt	Number of segments
+ * @param[in,out] read_amount	Bytes found, in, and copied, out
+ */
+
+static void mdc_preread_copy(void *buf, uint64_t offset,
+			     const struct iovec *iov, int iovcnt,
+			     size_t *read_amount)
+{
+	const char *src = (const char *)buf + offset;
+	size_t left = *read_amount;
+	int i;
+
+	for (i = 0; i < iovcnt && left > 0; i++) {
+		size_t n = MIN(left, iov[i].iov_len);
+
+		memcpy(iov[i].iov_base, src, n);
+		src += n;
+		left -= n;
+	}
+
+	*read_amount -= left;
+}
+
+/**
+ * @brief Start the small file preread threads, if configured
+ *
+ * @return 0 or an error from fridgethr_init.
+ */
+
+int mdcache_preread_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (mdcache_param.open_preread_max == 0 ||
+	    mdc_preread_fridge != NULL)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = MDC_PREREAD_THREADS;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&mdc_preread_fridge, "MDC_Preread", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize preread fridge, error code %d.",
+			 rc);
+		mdc_preread_fridge = NULL;
+	}
+
+	return rc;
+}
+
+void mdcache_preread_pkgshutdown(void)
+{
+	int rc;
+
+	if (mdc_preread_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(mdc_preread_fridge,
+				    fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Preread shutdown timed out, cancelling threads.");
+		fridgethr_cancel(mdc_preread_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down preread threads: %d", rc);
+	}
+
+	fridgethr_destroy(mdc_preread_fridge);
+	mdc_preread_fridge = NULL;
+}
+
 static fsal_status_t mdc_open2_by_name(mdcache_entry_t *mdc_parent,
 				       struct state_t *state,
 				       fsal_openflags_t openflags,
@@ -455,8 +844,12 @@ static fsal_status_t mdc_open2_by_name(mdcache_entry_t *mdc_parent,
 				       bool *caller_perm_check)
 {
 	fsal_status_t status;
-	bool uncached = createmode >= FSAL_GUARDED;
 	mdcache_entry_t *entry;
+	/* Holders of directory delegations are told of what is created,
+	 * which a stale negative or positive answer would hide.
+	 */
+	bool uncached = createmode >= FSAL_GUARDED ||
+			state_dir_deleg_held(&mdc_parent->obj_handle);
 	struct fsal_obj_handle *sub_handle;
 
 	*new_entry = NULL;
@@ -493,7 +886,7 @@ static fsal_status_t mdc_open2_by_name(mdcache_entry_t *mdc_parent,
 
 	} /* else UNGUARDED, go ahead and open the file. */
 
-	subcall(
+	subcall_timed(FSAL_CALL_OPEN, entry, status,
 		status = entry->sub_handle->obj_ops.open2(
 			entry->sub_handle, state, openflags, createmode,
 			NULL, attrib_set, verifier, &sub_handle,
@@ -633,6 +1026,8 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 				    &new_entry->mde_flags, MDCACHE_TRUST_ATTRS);
 			}
 
+			mdc_preread_start(new_entry, openflags);
+
 			return status;
 		}
 
@@ -654,7 +1049,7 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 				   fs_supported_attrs(op_ctx->fsal_export)
 				& ~ATTR_ACL) | ATTR_RDATTR_ERR);
 
-	subcall(
+	subcall_timed(FSAL_CALL_OPEN, mdc_parent, status,
 		status = mdc_parent->sub_handle->obj_ops.open2(
 			mdc_parent->sub_handle, state, openflags, createmode,
 			name, attrs_in, verifier, &sub_handle, &attrs,
@@ -689,6 +1084,7 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 		LogFullDebug(COMPONENT_CACHE_INODE,
 			     "Open2 of object succeeded.");
 		*new_obj = obj_hdl;
+		mdc_preread_start(mdc_parent, openflags);
 		/* We didn't actually get any attributes, but release anyway
 		 * for code consistency.
 		 */
@@ -698,20 +1094,24 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 
 	invalidate = createmode != FSAL_NO_CREATE;
 
-	PTHREAD_RWLOCK_wrlock(&mdc_parent->content_lock);
+	if (createmode != FSAL_NO_CREATE)
+		state_dir_deleg_notify(obj_hdl, NOTIFY4_ADD_ENTRY, name, NULL);
 
 	/* We will invalidate parent attrs if we did any form of create. */
 	status = mdcache_alloc_and_check_handle(export, sub_handle,
 						new_obj, false,
 						&attrs, attrs_out,
 						"open2 ", mdc_parent, name,
-						&invalidate,
+						&invalidate, false,
 						state);
 
-	PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
-
 	fsal_release_attrs(&attrs);
 
+	if (!FSAL_IS_ERROR(status) && createmode == FSAL_NO_CREATE)
+		mdc_preread_start(container_of(*new_obj, mdcache_entry_t,
+					       obj_handle),
+				  openflags);
+
 	if (createmode != FSAL_NO_CREATE && !invalidate) {
 		/* Refresh destination directory attributes without
 		 * invalidating dirents.
@@ -789,7 +1189,7 @@ fsal_status_t mdcache_reopen2(struct fsal_obj_handle *obj_hdl,
 	fsal_status_t status;
 	bool truncated = openflags & FSAL_O_TRUNC;
 
-	subcall(
+	subcall_timed(FSAL_CALL_OPEN, entry, status,
 		status = entry->sub_handle->obj_ops.reopen2(
 			entry->sub_handle, state, openflags)
 	       );
@@ -834,21 +1234,343 @@ fsal_status_t mdcache_read2(struct fsal_obj_handle *obj_hdl,
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
+	void *preread;
+
+	if (info == NULL) {
+		preread = mdc_preread_get(entry, offset, buf_size, read_amount,
+					  eof);
+		if (preread != NULL) {
+			memcpy(buffer, (char *)preread + offset, *read_amount);
+			gsh_iobuf_put(preread);
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+	}
 
-	subcall(
+	subcall_timed(FSAL_CALL_READ, entry, status,
 		status = entry->sub_handle->obj_ops.read2(
 			entry->sub_handle, bypass, state, offset, buf_size,
 			buffer, read_amount, eof, info)
 	       );
 
-	if (!FSAL_IS_ERROR(status))
+	if (!FSAL_IS_ERROR(status)) {
 		mdc_set_time_current(&entry->attrs.atime);
-	else if (status.major == ERR_FSAL_DELAY)
+		if (state == NULL)
+			mdcache_lru_fd_used(entry);
+	} else if (status.major == ERR_FSAL_DELAY) {
 		mdcache_kill_entry(entry);
+	}
 
 	return status;
 }
 
+/**
+ * @brief Read from a file by reference (new style)
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl	Object owning state
+ * @param[in] bypass	Bypass deny read
+ * @param[in] state	Open file state to read
+ * @param[in] offset	Offset into file
+ * @param[in] buf_size	Amount to read
+ * @param[out] buffer	Referenced buffer holding the data
+ * @param[out] read_amount	Amount read in bytes
+ * @param[out] eof	true if End of File was hit
+ * @param[in] info	io_info for READ_PLUS
+ * @return FSAL status
+ */
+fsal_status_t mdcache_read_ref2(struct fsal_obj_handle *obj_hdl,
+				bool bypass,
+				struct state_t *state,
+				uint64_t offset,
+				size_t buf_size,
+				void **buffer,
+				size_t *read_amount,
+				bool *eof,
+				struct io_info *info)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+	void *preread;
+
+	if (info == NULL) {
+		preread = mdc_preread_get(entry, offset, buf_size, read_amount,
+					  eof);
+		if (preread != NULL && offset == 0) {
+			/* The file is the data, hand it over */
+			*buffer = preread;
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		} else if (preread != NULL) {
+			*buffer = gsh_iobuf_get(buf_size);
+			memcpy(*buffer, (char *)preread + offset,
+			       *read_amount);
+			gsh_iobuf_put(preread);
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+	}
+
+	subcall(
+		status = entry->sub_handle->obj_ops.read_ref2(
+			entry->sub_handle, bypass, state, offset, buf_size,
+			buffer, read_amount, eof, info)
+	       );
+
+	if (!FSAL_IS_ERROR(status)) {
+		mdc_set_time_current(&entry->attrs.atime);
+		if (state == NULL)
+			mdcache_lru_fd_used(entry);
+	} else if (status.major == ERR_FSAL_DELAY) {
+		mdcache_kill_entry(entry);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Get the write gathering state of a file
+ *
+ * The state is allocated on first use, racing allocators settle it
+ * with a compare and swap.
+ *
+ * @param[in] entry	Regular file
+ * @return The write gathering state of @a entry
+ */
+static struct mdc_wgather *mdc_wgather_get(mdcache_entry_t *entry)
+{
+	struct mdc_wgather *wg;
+
+	wg = atomic_fetch_voidptr((void **)&entry->wgather);
+	if (likely(wg != NULL))
+		return wg;
+
+	wg = gsh_calloc(1, sizeof(*wg));
+	PTHREAD_MUTEX_init(&wg->mtx, NULL);
+	PTHREAD_COND_init(&wg->cv, NULL);
+	glist_init(&wg->pending);
+
+	if (!atomic_cas_voidptr((void **)&entry->wgather, NULL, wg)) {
+		/* Someone else got there first */
+		PTHREAD_COND_destroy(&wg->cv);
+		PTHREAD_MUTEX_destroy(&wg->mtx);
+		gsh_free(wg);
+		wg = atomic_fetch_voidptr((void **)&entry->wgather);
+	}
+
+	return wg;
+}
+
+/**
+ * @brief Free the write gathering state of a file
+ *
+ * Called when the entry is cleaned, no I/O can be in flight.
+ *
+ * @param[in] entry	Entry being cleaned
+ */
+void mdc_wgather_free(mdcache_entry_t *entry)
+{
+	struct mdc_wgather *wg = entry->wgather;
+
+	if (wg == NULL)
+		return;
+
+	entry->wgather = NULL;
+	PTHREAD_COND_destroy(&wg->cv);
+	PTHREAD_MUTEX_destroy(&wg->mtx);
+	gsh_free(wg);
+}
+
+/**
+ * @brief Write a batch of gathered writes with one sub-FSAL call
+ *
+ * The writes are adjacent and in offset order.  A short write is
+ * charged to the writes in order, the status and stability of the
+ * batch are handed to all of them.
+ *
+ * @param[in] entry	File to write
+ * @param[in] bypass	Bypass any non-mandatory deny write
+ * @param[in] state	Open file state shared by the batch
+ * @param[in] batch	List of struct mdc_wg_write
+ * @param[in] cnt	Number of writes in @a batch
+ */
+static void mdc_wgather_write(mdcache_entry_t *entry, bool bypass,
+			      struct state_t *state, struct glist_head *batch,
+			      uint32_t cnt)
+{
+	struct mdc_wg_write *first =
+		glist_first_entry(batch, struct mdc_wg_write, list);
+	struct glist_head *glist;
+	struct iovec *iov;
+	size_t written = 0;
+	bool stable = false;
+	fsal_status_t status;
+	uint32_t i = 0;
+
+	if (cnt == 1) {
+		subcall_timed(FSAL_CALL_WRITE, entry, status,
+			status = entry->sub_handle->obj_ops.write2(
+				entry->sub_handle, bypass, state,
+				first->offset, first->iov.iov_len,
+				first->iov.iov_base, &written, &stable, NULL)
+		       );
+	} else {
+		iov = gsh_malloc(cnt * sizeof(*iov));
+
+		glist_for_each(glist, batch) {
+			iov[i++] = glist_entry(glist, struct mdc_wg_write,
+					       list)->iov;
+		}
+
+		subcall_timed(FSAL_CALL_WRITE, entry, status,
+			status = entry->sub_handle->obj_ops.writev2(
+				entry->sub_handle, bypass, state,
+				first->offset, iov, cnt, &written, &stable,
+				NULL)
+		       );
+
+		gsh_free(iov);
+	}
+
+	glist_for_each(glist, batch) {
+		struct mdc_wg_write *w =
+			glist_entry(glist, struct mdc_wg_write, list);
+
+		w->status = status;
+		w->stable = stable;
+		w->written = written < w->iov.iov_len
+					? written : w->iov.iov_len;
+		written -= w->written;
+	}
+}
+
+/**
+ * @brief Write an unstable write, gathering it with its neighbours
+ *
+ * If no write to the file is in flight, the caller becomes the leader
+ * and writes at once.  Otherwise, when the write starts where the
+ * queued writes end and shares their state, export and credentials, it
+ * is queued and the caller sleeps until a leader has written it.  A
+ * leader finishing its batch promotes the first queued write to lead
+ * the next one.  Writes that cannot join go straight to the sub-FSAL.
+ *
+ * @param[in]  entry		File to write
+ * @param[in]  bypass		Bypass any non-mandatory deny write
+ * @param[in]  state		Open file state to write
+ * @param[in]  offset		Offset into file
+ * @param[in]  buf_size		Size of write buffer
+ * @param[in]  buffer		Buffer to write from
+ * @param[out] write_amount	Amount written in bytes
+ * @param[out] fsal_stable	true if write was to stable storage
+ * @return FSAL status
+ */
+static fsal_status_t mdc_wgather_write2(mdcache_entry_t *entry,
+					bool bypass,
+					struct state_t *state,
+					uint64_t offset,
+					size_t buf_size,
+					void *buffer,
+					size_t *write_amount,
+					bool *fsal_stable)
+{
+	struct mdc_wgather *wg = mdc_wgather_get(entry);
+	struct mdc_wg_write me = {
+		.offset = offset,
+		.iov.iov_base = buffer,
+		.iov.iov_len = buf_size,
+	};
+	struct glist_head batch;
+	uint32_t cnt;
+	fsal_status_t status;
+
+	PTHREAD_MUTEX_lock(&wg->mtx);
+
+	if (!wg->writing) {
+		/* Nothing in flight, lead */
+		wg->writing = true;
+		wg->state = state;
+		wg->bypass = bypass;
+		wg->export = op_ctx->fsal_export;
+		wg->uid = op_ctx->creds->caller_uid;
+		wg->gid = op_ctx->creds->caller_gid;
+		wg->next_off = offset + buf_size;
+		glist_add_tail(&wg->pending, &me.list);
+		wg->pending_len = buf_size;
+		wg->pending_cnt = 1;
+	} else if (offset == wg->next_off &&
+		   state == wg->state &&
+		   bypass == wg->bypass &&
+		   op_ctx->fsal_export == wg->export &&
+		   op_ctx->creds->caller_uid == wg->uid &&
+		   op_ctx->creds->caller_gid == wg->gid &&
+		   wg->pending_len + buf_size <=
+				mdcache_param.write_gather_max &&
+		   wg->pending_cnt < MDC_WGATHER_MAX_IOV) {
+		/* Queue behind the leader */
+		wg->next_off += buf_size;
+		glist_add_tail(&wg->pending, &me.list);
+		wg->pending_len += buf_size;
+		wg->pending_cnt++;
+
+		while (!me.done && !me.lead)
+			pthread_cond_wait(&wg->cv, &wg->mtx);
+
+		if (me.done) {
+			PTHREAD_MUTEX_unlock(&wg->mtx);
+			goto out;
+		}
+		/* Promoted, lead the pending writes */
+	} else {
+		/* Cannot join, don't wait for the leader */
+		PTHREAD_MUTEX_unlock(&wg->mtx);
+
+		subcall_timed(FSAL_CALL_WRITE, entry, status,
+			status = entry->sub_handle->obj_ops.write2(
+				entry->sub_handle, bypass, state, offset,
+				buf_size, buffer, write_amount, fsal_stable,
+				NULL)
+		       );
+
+		return status;
+	}
+
+	/* Leading, take everything queued so far as our batch */
+	glist_init(&batch);
+	glist_splice_tail(&batch, &wg->pending);
+	cnt = wg->pending_cnt;
+	wg->pending_len = 0;
+	wg->pending_cnt = 0;
+
+	PTHREAD_MUTEX_unlock(&wg->mtx);
+
+	mdc_wgather_write(entry, bypass, state, &batch, cnt);
+
+	PTHREAD_MUTEX_lock(&wg->mtx);
+
+	while (!glist_empty(&batch)) {
+		struct mdc_wg_write *w =
+			glist_first_entry(&batch, struct mdc_wg_write, list);
+
+		glist_del(&w->list);
+		w->done = true;
+	}
+
+	if (glist_empty(&wg->pending)) {
+		wg->writing = false;
+	} else {
+		/* Hand the writes queued meanwhile to the first of them */
+		glist_first_entry(&wg->pending, struct mdc_wg_write,
+				  list)->lead = true;
+	}
+
+	pthread_cond_broadcast(&wg->cv);
+	PTHREAD_MUTEX_unlock(&wg->mtx);
+
+ out:
+	*write_amount = me.written;
+	*fsal_stable = me.stable;
+	return me.status;
+}
+
 /**
  * @brief Write to a file (new style)
  *
@@ -879,10 +1601,130 @@ fsal_status_t mdcache_write2(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
+	mdc_preread_drop(entry);
+
+	if (mdcache_param.write_gather_max != 0 && !*fsal_stable &&
+	    info == NULL && buf_size < mdcache_param.write_gather_max) {
+		status = mdc_wgather_write2(entry, bypass, state, offset,
+					    buf_size, buffer, write_amount,
+					    fsal_stable);
+	} else {
+		subcall_timed(FSAL_CALL_WRITE, entry, status,
+			status = entry->sub_handle->obj_ops.write2(
+				entry->sub_handle, bypass, state, offset,
+				buf_size, buffer, write_amount, fsal_stable,
+				info)
+		       );
+	}
+
+	if (status.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(entry);
+	else
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+
+	if (!FSAL_IS_ERROR(status) && state == NULL)
+		mdcache_lru_fd_used(entry);
+
+	return status;
+}
+
+/**
+ * @brief Read from a file into an iovec (new style)
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl	Object owning state
+ * @param[in] bypass	Bypass deny read
+ * @param[in] state	Open file state to read
+ * @param[in] offset	Offset into file
+ * @param[in] iov	Segments to fill
+ * @param[in] iovcnt	Number of segments
+ * @param[out] read_amount	Amount read in bytes
+ * @param[out] eof	true if End of File was hit
+ * @param[in] info	io_info for READ_PLUS
+ * @return FSAL status
+ */
+fsal_status_t mdcache_readv2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     const struct iovec *iov,
+			     int iovcnt,
+			     size_t *read_amount,
+			     bool *eof,
+			     struct io_info *info)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+	void *preread;
+
+	if (info == NULL) {
+		preread = mdc_preread_get(entry, offset,
+					  mdc_iov_len(iov, iovcnt),
+					  read_amount, eof);
+		if (preread != NULL) {
+			mdc_preread_copy(preread, offset, iov, iovcnt,
+					 read_amount);
+			gsh_iobuf_put(preread);
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+	}
+
 	subcall(
-		status = entry->sub_handle->obj_ops.write2(
-			entry->sub_handle, bypass, state, offset, buf_size,
-			buffer, write_amount, fsal_stable, info)
+		status = entry->sub_handle->obj_ops.readv2(
+			entry->sub_handle, bypass, state, offset, iov, iovcnt,
+			read_amount, eof, info)
+	       );
+
+	if (!FSAL_IS_ERROR(status)) {
+		mdc_set_time_current(&entry->attrs.atime);
+		if (state == NULL)
+			mdcache_lru_fd_used(entry);
+	} else if (status.major == ERR_FSAL_DELAY) {
+		mdcache_kill_entry(entry);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Write to a file from an iovec (new style)
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl	Object owning state
+ * @param[in] bypass	Bypass any non-mandatory deny write
+ * @param[in] state	Open file state to write
+ * @param[in] offset	Offset into file
+ * @param[in] iov	Segments to write
+ * @param[in] iovcnt	Number of segments
+ * @param[out] write_amount	Amount written in bytes
+ * @param[in,out] fsal_stable	In, whether to write stably; out, what was done
+ * @param[in] info	io_info for WRITE_PLUS
+ * @return FSAL status
+ */
+fsal_status_t mdcache_writev2(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct state_t *state,
+			      uint64_t offset,
+			      const struct iovec *iov,
+			      int iovcnt,
+			      size_t *write_amount,
+			      bool *fsal_stable,
+			      struct io_info *info)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	mdc_preread_drop(entry);
+
+	subcall(
+		status = entry->sub_handle->obj_ops.writev2(
+			entry->sub_handle, bypass, state, offset, iov, iovcnt,
+			write_amount, fsal_stable, info)
 	       );
 
 	if (status.major == ERR_FSAL_STALE)
@@ -891,9 +1733,248 @@ fsal_status_t mdcache_write2(struct fsal_obj_handle *obj_hdl,
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
 
+	if (!FSAL_IS_ERROR(status) && state == NULL)
+		mdcache_lru_fd_used(entry);
+
 	return status;
 }
 
+/**
+ * @brief Copy a range of one file into another
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] src_hdl	File to copy from
+ * @param[in] src_state	State to read with
+ * @param[in] src_offset	Offset to copy from
+ * @param[in] dst_hdl	File to copy to
+ * @param[in] dst_state	State to write with
+ * @param[in] dst_offset	Offset to copy to
+ * @param[in] count	Bytes to copy
+ * @param[out] copied	Bytes copied
+ * @return FSAL status
+ */
+fsal_status_t mdcache_copy(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count,
+			   uint64_t *copied)
+{
+	mdcache_entry_t *src =
+		container_of(src_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *dst =
+		container_of(dst_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	mdc_preread_drop(dst);
+
+	subcall(
+		status = src->sub_handle->obj_ops.copy(
+			src->sub_handle, src_state, src_offset,
+			dst->sub_handle, dst_state, dst_offset, count, copied)
+	       );
+
+	if (status.major == ERR_FSAL_STALE) {
+		mdcache_kill_entry(src);
+		mdcache_kill_entry(dst);
+	} else {
+		atomic_clear_uint32_t_bits(&dst->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Share a range of one file with another
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] src_hdl	File to clone from
+ * @param[in] src_state	State to read with
+ * @param[in] src_offset	Offset to clone from
+ * @param[in] dst_hdl	File to clone to
+ * @param[in] dst_state	State to write with
+ * @param[in] dst_offset	Offset to clone to
+ * @param[in] count	Bytes to clone
+ * @return FSAL status
+ */
+fsal_status_t mdcache_clone(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count)
+{
+	mdcache_entry_t *src =
+		container_of(src_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *dst =
+		container_of(dst_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	subcall(
+		status = src->sub_handle->obj_ops.clone(
+			src->sub_handle, src_state, src_offset,
+			dst->sub_handle, dst_state, dst_offset, count)
+	       );
+
+	if (status.major == ERR_FSAL_STALE) {
+		mdcache_kill_entry(src);
+		mdcache_kill_entry(dst);
+	} else {
+		atomic_clear_uint32_t_bits(&dst->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Completion context for asynchronous sub-FSAL I/O
+ */
+struct mdc_async_arg {
+	struct fsal_obj_handle *obj_hdl;	/*< MDCACHE handle */
+	fsal_async_cb done_cb;			/*< Caller's callback */
+	void *caller_arg;			/*< Caller's argument */
+};
+
+/**
+ * @brief Completion of an asynchronous read
+ *
+ * Update the cached atime and pass the result on to the caller.
+ */
+static void mdc_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			void *obj_data, void *caller_data)
+{
+	struct mdc_async_arg *arg = caller_data;
+	struct fsal_io_arg *read_arg = obj_data;
+	mdcache_entry_t *entry =
+		container_of(arg->obj_hdl, mdcache_entry_t, obj_handle);
+
+	if (!FSAL_IS_ERROR(ret)) {
+		mdc_set_time_current(&entry->attrs.atime);
+		if (read_arg->state == NULL)
+			mdcache_lru_fd_used(entry);
+	} else if (ret.major == ERR_FSAL_DELAY) {
+		mdcache_kill_entry(entry);
+	}
+
+	arg->done_cb(arg->obj_hdl, ret, obj_data, arg->caller_arg);
+	gsh_free(arg);
+}
+
+/**
+ * @brief Read from a file asynchronously
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl	Object to read from
+ * @param[in] bypass	Bypass deny read
+ * @param[in] done_cb	Callback to call when I/O is done
+ * @param[in,out] read_arg	Info about read, passed back in callback
+ * @param[in] caller_arg	Opaque arg from the caller for callback
+ */
+void mdcache_read2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 fsal_async_cb done_cb,
+			 struct fsal_io_arg *read_arg,
+			 void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg;
+	void *preread = NULL;
+
+	if (read_arg->info == NULL)
+		preread = mdc_preread_get(entry, read_arg->offset,
+					  mdc_iov_len(read_arg->iov,
+						     read_arg->iov_count),
+					  &read_arg->io_amount,
+					  &read_arg->end_of_file);
+	if (preread != NULL) {
+		/* Complete in line, as FSALs without async I/O do */
+		mdc_preread_copy(preread, read_arg->offset, read_arg->iov,
+				 read_arg->iov_count, &read_arg->io_amount);
+		gsh_iobuf_put(preread);
+		done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), read_arg,
+			caller_arg);
+		return;
+	}
+
+	arg = gsh_malloc(sizeof(*arg));
+	arg->obj_hdl = obj_hdl;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+
+	subcall(
+		entry->sub_handle->obj_ops.read2_async(
+			entry->sub_handle, bypass, mdc_read_cb, read_arg, arg)
+	       );
+}
+
+/**
+ * @brief Completion of an asynchronous write
+ *
+ * Invalidate the cached attributes and pass the result on to the caller.
+ */
+static void mdc_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			 void *obj_data, void *caller_data)
+{
+	struct mdc_async_arg *arg = caller_data;
+	struct fsal_io_arg *write_arg = obj_data;
+	mdcache_entry_t *entry =
+		container_of(arg->obj_hdl, mdcache_entry_t, obj_handle);
+
+	if (ret.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(entry);
+	else
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+
+	if (!FSAL_IS_ERROR(ret) && write_arg->state == NULL)
+		mdcache_lru_fd_used(entry);
+
+	arg->done_cb(arg->obj_hdl, ret, obj_data, arg->caller_arg);
+	gsh_free(arg);
+}
+
+/**
+ * @brief Write to a file asynchronously
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl	Object to write to
+ * @param[in] bypass	Bypass any non-mandatory deny write
+ * @param[in] done_cb	Callback to call when I/O is done
+ * @param[in,out] write_arg	Info about write, passed back in callback
+ * @param[in] caller_arg	Opaque arg from the caller for callback
+ */
+void mdcache_write2_async(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  fsal_async_cb done_cb,
+			  struct fsal_io_arg *write_arg,
+			  void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg = gsh_malloc(sizeof(*arg));
+
+	mdc_preread_drop(entry);
+
+	arg->obj_hdl = obj_hdl;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+
+	subcall(
+		entry->sub_handle->obj_ops.write2_async(
+			entry->sub_handle, bypass, mdc_write_cb, write_arg, arg)
+	       );
+}
+
 /**
  * @brief Seek within a file (new style)
  *
@@ -952,6 +2033,63 @@ fsal_status_t mdcache_io_advise2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Commit a file, sharing the flush with concurrent COMMITs
+ *
+ * A COMMIT is covered by any flush that starts after it arrives.  If
+ * no flush is in flight the caller runs one, otherwise it waits for the
+ * one in flight to finish and then either runs the next one or takes
+ * the status of the flush another waiter ran.  Flushes cover the whole
+ * file, since they stand in for COMMITs of different ranges.  The
+ * write verifier is untouched: gathered or not, a write is only
+ * acknowledged once the sub-FSAL has it.
+ *
+ * @param[in] entry	File to commit
+ * @return FSAL status
+ */
+static fsal_status_t mdc_commit_coalesced(mdcache_entry_t *entry)
+{
+	struct mdc_wgather *wg = mdc_wgather_get(entry);
+	uint64_t need;
+	uint64_t mine;
+	fsal_status_t status;
+
+	PTHREAD_MUTEX_lock(&wg->mtx);
+
+	need = wg->flush_started + 1;
+
+	while (wg->committing && wg->flush_done < need)
+		pthread_cond_wait(&wg->cv, &wg->mtx);
+
+	if (wg->flush_done >= need) {
+		/* Another waiter ran a flush that covers us */
+		status = wg->flush_status;
+		PTHREAD_MUTEX_unlock(&wg->mtx);
+		return status;
+	}
+
+	wg->committing = true;
+	mine = ++wg->flush_started;
+
+	PTHREAD_MUTEX_unlock(&wg->mtx);
+
+	subcall_timed(FSAL_CALL_COMMIT, entry, status,
+		status = entry->sub_handle->obj_ops.commit2(
+			entry->sub_handle, 0, 0)
+	       );
+
+	PTHREAD_MUTEX_lock(&wg->mtx);
+
+	wg->committing = false;
+	wg->flush_done = mine;
+	wg->flush_status = status;
+
+	pthread_cond_broadcast(&wg->cv);
+	PTHREAD_MUTEX_unlock(&wg->mtx);
+
+	return status;
+}
+
 /**
  * @brief Commit to a file (new style)
  *
@@ -969,10 +2107,14 @@ fsal_status_t mdcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
-	subcall(
-		status = entry->sub_handle->obj_ops.commit2(
-			entry->sub_handle, offset, len)
-	       );
+	if (mdcache_param.commit_coalesce) {
+		status = mdc_commit_coalesced(entry);
+	} else {
+		subcall_timed(FSAL_CALL_COMMIT, entry, status,
+			status = entry->sub_handle->obj_ops.commit2(
+				entry->sub_handle, offset, len)
+		       );
+	}
 
 	if (status.major == ERR_FSAL_STALE)
 		mdcache_kill_entry(entry);
@@ -980,9 +2122,49 @@ fsal_status_t mdcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
 
+	if (!FSAL_IS_ERROR(status))
+		mdcache_lru_fd_used(entry);
+
 	return status;
 }
 
+/**
+ * @brief Commit to a file asynchronously
+ *
+ * Delegate to sub-FSAL.  Coalesced commits wait for each other, so they
+ * are done synchronously.
+ *
+ * @param[in] obj_hdl	Object to commit
+ * @param[in] offset	Offset into file
+ * @param[in] len	Length of commit
+ * @param[in] done_cb	Callback to call when the commit is done
+ * @param[in] caller_arg	Opaque arg from the caller for callback
+ */
+void mdcache_commit2_async(struct fsal_obj_handle *obj_hdl, off_t offset,
+			   size_t len, fsal_async_cb done_cb,
+			   void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg;
+
+	if (mdcache_param.commit_coalesce) {
+		done_cb(obj_hdl, mdcache_commit2(obj_hdl, offset, len), NULL,
+			caller_arg);
+		return;
+	}
+
+	arg = gsh_malloc(sizeof(*arg));
+	arg->obj_hdl = obj_hdl;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+
+	subcall(
+		entry->sub_handle->obj_ops.commit2_async(
+			entry->sub_handle, offset, len, mdc_write_cb, arg)
+	       );
+}
+
 /**
  * @brief Lock/unlock a range in a file (new style)
  *
@@ -1007,7 +2189,7 @@ fsal_status_t mdcache_lock_op2(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
-	subcall(
+	subcall_timed(FSAL_CALL_LOCK, entry, status,
 		status = entry->sub_handle->obj_ops.lock_op2(
 			entry->sub_handle, state, p_owner, lock_op, req_lock,
 			conflicting_lock)
@@ -1030,7 +2212,7 @@ fsal_status_t mdcache_close2(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
-	subcall(
+	subcall_timed(FSAL_CALL_CLOSE, entry, status,
 		status = entry->sub_handle->obj_ops.close2(
 			  entry->sub_handle, state)
 	       );
@@ -37,6 +37,10 @@
 #include "FSAL/fsal_commonlib.h"
 #include "nfs4_acls.h"
 #include "nfs_exports.h"
+#include "export_mgr.h"
+#include "fridgethr.h"
+#include "city.h"
+#include "sal_functions.h"
 #include <os/subr.h>
 
 #include "mdcache_lru.h"
@@ -53,7 +57,9 @@
  * This function is a wrapper of mdcache_alloc_handle. It adds error checking
  * and logging. It also cleans objects allocated in the subfsal if it fails.
  *
- * @note the caller must hold the content lock on the parent.
+ * Unless parent_locked is set, the parent's content lock is taken here, and
+ * only over the insertion of the dirent: the new cache entry and the dirent
+ * are set up before, so creates in one directory hold its lock only briefly.
  *
  * This does not cause an ABBA lock conflict with the potential getattrs
  * if we lose a race to create the cache entry since our caller CAN NOT hold
@@ -74,6 +80,8 @@
  * @param[in]     parent         Parent directory to add dirent to.
  * @param[in]     name           Name of the dirent to add.
  * @param[in,out] invalidate     Invalidate parent attr (and chunk cache)
+ * @param[in]     parent_locked  Caller holds the parent's content lock for
+ *                               writing.
  * @param[in]     state          Optional state_t representing open file.
  *
  * @note This returns an INITIAL ref'd entry on success
@@ -91,10 +99,12 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		mdcache_entry_t *parent,
 		const char *name,
 		bool *invalidate,
+		bool parent_locked,
 		struct state_t *state)
 {
 	fsal_status_t status;
 	mdcache_entry_t *new_entry;
+	mdcache_dir_entry_t *dirent;
 
 	status = mdcache_new_entry(export, sub_handle, attrs_in, attrs_out,
 				   new_directory, &new_entry, state);
@@ -111,7 +121,16 @@ fsal_status_t mdcache_alloc_and_check_handle(
 
 	/* Add this entry to the directory (also takes an internal ref)
 	 */
-	status = mdcache_dirent_add(parent, name, new_entry, invalidate);
+	if (parent_locked) {
+		status = mdcache_dirent_add(parent, name, new_entry,
+					    invalidate);
+	} else {
+		dirent = mdcache_dirent_alloc(name, new_entry);
+
+		PTHREAD_RWLOCK_wrlock(&parent->content_lock);
+		status = mdcache_dirent_insert(parent, dirent, invalidate);
+		PTHREAD_RWLOCK_unlock(&parent->content_lock);
+	}
 
 	if (FSAL_IS_ERROR(status)) {
 		LogDebug(COMPONENT_CACHE_INODE,
@@ -235,14 +254,10 @@ static fsal_status_t mdcache_create(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
-
 	status = mdcache_alloc_and_check_handle(export, sub_handle, new_obj,
 						false, &attrs, attrs_out,
 						"create ", parent, name,
-						&invalidate, NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						&invalidate, false, NULL);
 
 	fsal_release_attrs(&attrs);
 
@@ -291,7 +306,7 @@ static fsal_status_t mdcache_mkdir(struct fsal_obj_handle *dir_hdl,
 				   fs_supported_attrs(op_ctx->fsal_export)
 				   & ~ATTR_ACL);
 
-	subcall_raw(export,
+	subcall_raw_timed(export, FSAL_CALL_CREATE, parent, status,
 		status = parent->sub_handle->obj_ops.mkdir(
 			parent->sub_handle, name, attrib, &sub_handle, &attrs)
 	       );
@@ -313,14 +328,12 @@ static fsal_status_t mdcache_mkdir(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
+	state_dir_deleg_notify(dir_hdl, NOTIFY4_ADD_ENTRY, name, NULL);
 
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						true, &attrs, attrs_out,
 						"mkdir ",  parent, name,
-						&invalidate, NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						&invalidate, false, NULL);
 
 	fsal_release_attrs(&attrs);
 
@@ -371,7 +384,7 @@ static fsal_status_t mdcache_mknode(struct fsal_obj_handle *dir_hdl,
 				   fs_supported_attrs(op_ctx->fsal_export)
 				   & ~ATTR_ACL);
 
-	subcall_raw(export,
+	subcall_raw_timed(export, FSAL_CALL_CREATE, parent, status,
 		status = parent->sub_handle->obj_ops.mknode(
 			parent->sub_handle, name, nodetype, attrib,
 			&sub_handle, &attrs)
@@ -394,14 +407,12 @@ static fsal_status_t mdcache_mknode(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
+	state_dir_deleg_notify(dir_hdl, NOTIFY4_ADD_ENTRY, name, NULL);
 
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						false, &attrs, attrs_out,
 						"mknode ",  parent, name,
-						&invalidate, NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						&invalidate, false, NULL);
 
 	fsal_release_attrs(&attrs);
 
@@ -452,7 +463,7 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
 				   fs_supported_attrs(op_ctx->fsal_export)
 				   & ~ATTR_ACL);
 
-	subcall_raw(export,
+	subcall_raw_timed(export, FSAL_CALL_CREATE, parent, status,
 		status = parent->sub_handle->obj_ops.symlink(
 			parent->sub_handle, name, link_path, attrib,
 			&sub_handle, &attrs)
@@ -475,14 +486,12 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
+	state_dir_deleg_notify(dir_hdl, NOTIFY4_ADD_ENTRY, name, NULL);
 
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						false, &attrs, attrs_out,
 						"symlink ",  parent, name,
-						&invalidate, NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						&invalidate, false, NULL);
 
 	fsal_release_attrs(&attrs);
 
@@ -496,9 +505,43 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
 	return status;
 }
 
+/**
+ * @brief Copy out the cached target of a symlink
+ *
+ * The target of a symlink never changes, so once read it is kept until
+ * the entry is invalidated by an upcall or freed.
+ *
+ * @note The content lock MUST be held
+ *
+ * @param[in]  entry        The symlink
+ * @param[out] link_content Copy of the target, if cached
+ *
+ * @return true if the target was cached.
+ */
+static bool mdcache_readlink_cached(mdcache_entry_t *entry,
+				    struct gsh_buffdesc *link_content)
+{
+	struct gsh_buffdesc *target = &entry->fsobj.fslink.target;
+
+	if (!(entry->mde_flags & MDCACHE_TRUST_CONTENT) ||
+	    target->addr == NULL)
+		return false;
+
+	link_content->addr = gsh_malloc(target->len);
+	memcpy(link_content->addr, target->addr, target->len);
+	link_content->len = target->len;
+
+	(void) atomic_inc_uint64_t(&cache_stp->readlink_hit);
+
+	return true;
+}
+
 /**
  * @brief Read a symlink
  *
+ * The target is answered from the cache unless a refresh is asked for
+ * or the content is no longer trusted.
+ *
  * @param[in] obj_hdl	Handle for symlink
  * @param[out] link_content	Buffer to fill with link contents
  * @param[in] refresh	If true, refresh attributes on symlink
@@ -510,25 +553,42 @@ static fsal_status_t mdcache_readlink(struct fsal_obj_handle *obj_hdl,
 {
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct gsh_buffdesc *target = &entry->fsobj.fslink.target;
 	fsal_status_t status;
 
 	PTHREAD_RWLOCK_rdlock(&entry->content_lock);
-	if (!refresh && !(entry->mde_flags & MDCACHE_TRUST_CONTENT)) {
-		/* Our data are stale.  Drop the lock, get a
-		   write-lock, load in new data, and copy it out to
-		   the caller. */
+	if (!refresh && mdcache_readlink_cached(entry, link_content)) {
 		PTHREAD_RWLOCK_unlock(&entry->content_lock);
-		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
-		/* Make sure nobody updated the content while we were
-		   waiting. */
-		refresh = !(entry->mde_flags & MDCACHE_TRUST_CONTENT);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 	}
 
-	subcall(
+	/* Drop the lock, get a write-lock, load in new data, keep it
+	   and copy it out to the caller. */
+	PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+
+	/* Make sure nobody loaded the content while we were waiting. */
+	if (!refresh && mdcache_readlink_cached(entry, link_content)) {
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+	refresh = refresh || !(entry->mde_flags & MDCACHE_TRUST_CONTENT);
+
+	(void) atomic_inc_uint64_t(&cache_stp->readlink_miss);
+
+	subcall_timed(FSAL_CALL_READLINK, entry, status,
 		status = entry->sub_handle->obj_ops.readlink(
 			entry->sub_handle, link_content, refresh)
 	       );
 
+	if (!FSAL_IS_ERROR(status)) {
+		mdcache_readlink_clean(entry);
+		target->addr = gsh_malloc(link_content->len);
+		memcpy(target->addr, link_content->addr, link_content->len);
+		target->len = link_content->len;
+		mdcache_lru_mem(entry, target->len);
+	}
+
 	if (refresh && !(FSAL_IS_ERROR(status)))
 		atomic_set_uint32_t_bits(&entry->mde_flags,
 					 MDCACHE_TRUST_CONTENT);
@@ -554,10 +614,11 @@ static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	mdcache_entry_t *dest =
 		container_of(destdir_hdl, mdcache_entry_t, obj_handle);
+	mdcache_dir_entry_t *dirent;
 	fsal_status_t status;
 	bool invalidate = true;
 
-	subcall(
+	subcall_timed(FSAL_CALL_LINK, entry, status,
 		status = entry->sub_handle->obj_ops.link(
 			entry->sub_handle, dest->sub_handle, name)
 	       );
@@ -569,11 +630,15 @@ static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
 		return status;
 	}
 
+	state_dir_deleg_notify(destdir_hdl, NOTIFY4_ADD_ENTRY, name, NULL);
+
+	dirent = mdcache_dirent_alloc(name, entry);
+
 	PTHREAD_RWLOCK_wrlock(&dest->content_lock);
 
 	/* Add this entry to the directory (also takes an internal ref)
 	 */
-	status = mdcache_dirent_add(dest, name, entry, &invalidate);
+	status = mdcache_dirent_insert(dest, dirent, &invalidate);
 
 	PTHREAD_RWLOCK_unlock(&dest->content_lock);
 
@@ -819,12 +884,87 @@ static fsal_status_t mdcache_test_access(struct fsal_obj_handle *obj_hdl,
 {
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	const struct user_cred *creds = op_ctx->creds;
+	uint32_t nslots = mdcache_param.access_slots;
+	struct mdc_access_slot *slot;
+	fsal_accessflags_t al = 0, de = 0;
+	uint64_t groups_hash;
+	fsal_status_t status;
+	attrmask_t mask;
+	uint32_t gen, i;
 
-	if (owner_skip && entry->attrs.owner == op_ctx->creds->caller_uid)
+	if (owner_skip && entry->attrs.owner == creds->caller_uid)
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 
-	return fsal_test_access(obj_hdl, access_type, allowed, denied,
-				owner_skip);
+	if (nslots == 0)
+		return fsal_test_access(obj_hdl, access_type, allowed, denied,
+					owner_skip);
+
+	/* The attributes fsal_test_access() looks at */
+	mask = op_ctx->fsal_export->exp_ops.fs_supported_attrs(
+					op_ctx->fsal_export)
+	       & (ATTRS_CREDS | ATTR_MODE | ATTR_ACL);
+	groups_hash = creds->caller_glen == 0 ? 0 :
+	    CityHash64((char *)creds->caller_garray,
+		       creds->caller_glen * sizeof(gid_t));
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+
+	gen = entry->access_gen;
+
+	if (mdcache_is_attrs_valid(entry, mask)) {
+		for (i = 0; i < nslots; i++) {
+			slot = &entry->access_slots[i];
+			if (slot->gen != gen || slot->access_type != access_type
+			    || slot->uid != creds->caller_uid
+			    || slot->gid != creds->caller_gid
+			    || slot->glen != creds->caller_glen
+			    || slot->groups_hash != groups_hash)
+				continue;
+
+			if (allowed)
+				*allowed = slot->allowed;
+			if (denied)
+				*denied = slot->denied;
+			status = fsalstat(slot->major, 0);
+			MDC_ATTR_UNLOCK(entry);
+			return status;
+		}
+	}
+
+	MDC_ATTR_UNLOCK(entry);
+
+	status = fsal_test_access(obj_hdl, access_type, &al, &de, owner_skip);
+
+	if (allowed)
+		*allowed = al;
+	if (denied)
+		*denied = de;
+
+	/* Only a verdict on the attributes is worth remembering */
+	if (status.major != ERR_FSAL_NO_ERROR &&
+	    status.major != ERR_FSAL_ACCESS)
+		return status;
+
+	/* Remembered under the generation from before the check, if the
+	 * check refreshed the attributes the next one looks again.
+	 */
+	MDC_ATTR_WRLOCK(entry);
+
+	slot = &entry->access_slots[entry->access_next++ % nslots];
+	slot->uid = creds->caller_uid;
+	slot->gid = creds->caller_gid;
+	slot->glen = creds->caller_glen;
+	slot->groups_hash = groups_hash;
+	slot->gen = gen;
+	slot->access_type = access_type;
+	slot->allowed = al;
+	slot->denied = de;
+	slot->major = status.major;
+
+	MDC_ATTR_UNLOCK(entry);
+
+	return status;
 }
 
 /**
@@ -864,7 +1004,7 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
-	subcall(
+	subcall_timed(FSAL_CALL_RENAME, mdc_olddir, status,
 		status = mdc_olddir->sub_handle->obj_ops.rename(
 			mdc_obj->sub_handle, mdc_olddir->sub_handle,
 			old_name, mdc_newdir->sub_handle, new_name)
@@ -873,6 +1013,16 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
+	if (mdc_olddir == mdc_newdir) {
+		state_dir_deleg_notify(olddir_hdl, NOTIFY4_RENAME_ENTRY,
+				       new_name, old_name);
+	} else {
+		state_dir_deleg_notify(olddir_hdl, NOTIFY4_REMOVE_ENTRY,
+				       old_name, NULL);
+		state_dir_deleg_notify(newdir_hdl, NOTIFY4_ADD_ENTRY,
+				       new_name, NULL);
+	}
+
 	/* Now update cached dirents.  Must take locks in the correct order */
 	mdcache_src_dest_lock(mdc_olddir, mdc_newdir);
 
@@ -1063,6 +1213,7 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 	struct attrlist attrs;
 	fsal_status_t status = {0, 0};
 	struct timespec oldmtime;
+	int64_t acl_mem = mdcache_acl_mem(entry->attrs.acl);
 
 	/* Use this to detect if we should invalidate a directory. */
 	oldmtime = entry->attrs.mtime;
@@ -1081,7 +1232,7 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 	/* We will want all the requested attributes in the entry */
 	entry->attrs.request_mask = attrs.request_mask;
 
-	subcall(
+	subcall_timed(FSAL_CALL_GETATTRS, entry, status,
 		status = entry->sub_handle->obj_ops.getattrs(
 			entry->sub_handle, &attrs)
 	       );
@@ -1122,6 +1273,7 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 
 	/* Now move the new attributes into the entry. */
 	fsal_copy_attrs(&entry->attrs, &attrs, true);
+	mdcache_lru_mem(entry, mdcache_acl_mem(entry->attrs.acl) - acl_mem);
 
 	/* Done with the attrs (we didn't need to call this since the
 	 * fsal_copy_attrs preceding consumed all the references, but we
@@ -1131,6 +1283,10 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 
 	mdc_fixup_md(entry, &attrs);
 
+	entry->attr_refreshes++;
+	entry->attr_refresh_acl = need_acl;
+	atomic_store_uint32_t(&entry->attr_hits, 0);
+
 	LogAttrlist(COMPONENT_CACHE_INODE, NIV_FULL_DEBUG,
 		    "attrs ", &entry->attrs, true);
 
@@ -1145,12 +1301,313 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 	return status;
 }
 
+/**
+ * @brief Revalidate attributes with the change attribute
+ *
+ * With Change_Probe, attributes that are only out of date are checked
+ * against the change attribute from the FSAL's getchange, which is
+ * cheaper than fetching them all.  If it did not move, the cached
+ * attributes are good for another Attr_Expiration_Time.  The ACL is
+ * not revalidated.
+ *
+ * @note The caller MUST hold the attr_lock for write
+ *
+ * @param[in] entry The entry to revalidate
+ *
+ * @return true if the attributes are current, false if they must be
+ *         refreshed.
+ */
+static bool mdc_probe_change(mdcache_entry_t *entry)
+{
+	fsal_status_t status = {0, 0};
+	uint64_t change;
+
+	if (!mdcache_param.change_probe ||
+	    entry->attrs.expire_time_attr <= 0 ||
+	    entry->attrs.valid_mask == ATTR_RDATTR_ERR ||
+	    !(entry->attrs.valid_mask & ATTR_CHANGE) ||
+	    !(atomic_fetch_uint32_t(&entry->mde_flags) & MDCACHE_TRUST_ATTRS))
+		return false;
+
+	/* Directories are always refreshed in this mode */
+	if (entry->obj_handle.type == DIRECTORY &&
+	    mdcache_param.getattr_dir_invalidation)
+		return false;
+
+	subcall_timed(FSAL_CALL_GETCHANGE, entry, status,
+		status = entry->sub_handle->obj_ops.getchange(
+			entry->sub_handle, &change)
+	       );
+
+	if (FSAL_IS_ERROR(status) || change != entry->attrs.change)
+		return false;
+
+	entry->attr_time = time(NULL);
+
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Change of %p unchanged at %" PRIu64 ", attrs revalidated",
+		     entry, change);
+
+	return true;
+}
+
+/* Threads refreshing attributes ahead of expiry */
+#define MDC_REFRESH_THREADS 4
+
+static struct fridgethr *mdc_refresh_fridge;
+
+/* Second of the current refresh budget, and refreshes started in it */
+static time_t mdc_refresh_sec;
+static uint32_t mdc_refresh_count;
+
+struct mdc_refresh_job {
+	mdcache_entry_t *entry;
+	struct gsh_export *export;
+};
+
+/**
+ * @brief Refresh the attributes of an entry in the background
+ *
+ * Runs on the refresh fridge with root credentials, like the readahead
+ * of directories.
+ *
+ * @param[in] ctx Thread context, arg is the job
+ */
+static void mdc_refresh_run(struct fridgethr_context *ctx)
+{
+	struct mdc_refresh_job *job = ctx->arg;
+	mdcache_entry_t *entry = job->entry;
+	struct root_op_context root_op_context;
+	fsal_status_t status = {0, 0};
+
+	init_root_op_context(&root_op_context, job->export,
+			     job->export->fsal_export, 0, 0, UNKNOWN_REQUEST);
+
+	MDC_ATTR_WRLOCK(entry);
+	if (!mdc_probe_change(entry))
+		status = mdcache_refresh_attrs(entry, false, true);
+	MDC_ATTR_UNLOCK(entry);
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Background refresh of %p failed status=%s",
+			 entry, fsal_err_txt(status));
+		if (status.major == ERR_FSAL_STALE)
+			mdcache_kill_entry(entry);
+	}
+
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_ATTR_REFRESH);
+	mdcache_put(entry);
+	release_root_op_context();
+	put_gsh_export(job->export);
+	gsh_free(job);
+}
+
+/**
+ * @brief Take one refresh from the per second budget
+ *
+ * The budget is reset by whoever first sees a new second, so a few
+ * refreshes more than Attr_Refresh_Rate may start around the change.
+ *
+ * @return true if the refresh may go ahead.
+ */
+static bool mdc_refresh_budget(void)
+{
+	time_t now;
+
+	if (mdcache_param.attr_refresh_rate == 0)
+		return true;
+
+	now = time(NULL);
+	if (atomic_fetch_time_t(&mdc_refresh_sec) != now) {
+		atomic_store_time_t(&mdc_refresh_sec, now);
+		atomic_store_uint32_t(&mdc_refresh_count, 0);
+	}
+
+	return atomic_inc_uint32_t(&mdc_refresh_count) <=
+	       mdcache_param.attr_refresh_rate;
+}
+
+/**
+ * @brief Queue a refresh of attributes that will soon expire
+ *
+ * Called for every GETATTR served from the cache.  Entries that were hit
+ * Attr_Refresh_Hits times since their last refresh are refreshed once
+ * they reach the last Attr_Refresh_Ahead percent of their lifetime,
+ * within the Attr_Refresh_Rate budget.  At most one refresh is queued
+ * per entry at a time.
+ *
+ * @note The attr_lock MUST be held, or the attributes read under
+ *       attr_seq
+ *
+ * @param[in] entry The entry, with valid attributes
+ */
+static void mdc_refresh_ahead(mdcache_entry_t *entry)
+{
+	struct mdc_refresh_job *job;
+	int32_t expire = entry->attrs.expire_time_attr;
+	int rc;
+
+	if (mdc_refresh_fridge == NULL || op_ctx->ctx_export == NULL ||
+	    expire <= 0)
+		return;
+
+	/* Cold entries are left to expire */
+	if (atomic_inc_uint32_t(&entry->attr_hits) <
+	    mdcache_param.attr_refresh_hits)
+		return;
+
+	/* Not yet in the last Attr_Refresh_Ahead percent */
+	if ((time(NULL) - entry->attr_time) * 100 <
+	    (int64_t) expire * (100 - mdcache_param.attr_refresh_ahead))
+		return;
+
+	if (atomic_postset_uint32_t_bits(&entry->mde_flags,
+					 MDCACHE_ATTR_REFRESH) &
+	    MDCACHE_ATTR_REFRESH)
+		return;
+
+	if (!mdc_refresh_budget()) {
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_ATTR_REFRESH);
+		return;
+	}
+
+	if (FSAL_IS_ERROR(mdcache_get(entry))) {
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_ATTR_REFRESH);
+		return;
+	}
+
+	job = gsh_malloc(sizeof(*job));
+	job->entry = entry;
+	job->export = op_ctx->ctx_export;
+	get_gsh_export_ref(job->export);
+
+	rc = fridgethr_submit(mdc_refresh_fridge, mdc_refresh_run, job);
+	if (rc != 0) {
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Could not queue refresh of %p: %d", entry, rc);
+		put_gsh_export(job->export);
+		gsh_free(job);
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_ATTR_REFRESH);
+		mdcache_put(entry);
+	}
+}
+
+/**
+ * @brief Start the background refresh threads, if configured
+ *
+ * @return 0 or an error from fridgethr_init.
+ */
+int mdcache_refresh_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (mdcache_param.attr_refresh_ahead == 0 ||
+	    mdc_refresh_fridge != NULL)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = MDC_REFRESH_THREADS;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&mdc_refresh_fridge, "MDC_Refresh", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize refresh fridge, error code %d.",
+			 rc);
+		mdc_refresh_fridge = NULL;
+	}
+
+	return rc;
+}
+
+void mdcache_refresh_pkgshutdown(void)
+{
+	int rc;
+
+	if (mdc_refresh_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(mdc_refresh_fridge,
+				    fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Refresh shutdown timed out, cancelling threads.");
+		fridgethr_cancel(mdc_refresh_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down refresh threads: %d", rc);
+	}
+
+	fridgethr_destroy(mdc_refresh_fridge);
+	mdc_refresh_fridge = NULL;
+}
+
+/**
+ * @brief Copy valid cached attributes without taking attr_lock
+ *
+ * A seqlock read: the copy is good if attr_seq was even before it and
+ * unchanged after it, no writer held attr_lock meanwhile.  Only for
+ * requests without the ACL, whose reference could not be taken safely.
+ *
+ * @param[in]     entry     The entry
+ * @param[in,out] attrs_out Attributes, filled in on success
+ *
+ * @return true if attrs_out was filled in, false to take the lock.
+ */
+static bool mdc_getattrs_seq(mdcache_entry_t *entry,
+			     struct attrlist *attrs_out)
+{
+	attrmask_t request_mask = attrs_out->request_mask;
+	struct attrlist attrs;
+	uint32_t seq;
+
+	if (!mdcache_param.lockless_getattr || (request_mask & ATTR_ACL))
+		return false;
+
+	seq = atomic_fetch_uint32_t(&entry->attr_seq);
+	if (seq & 1)
+		return false;
+
+	if (!mdcache_is_attrs_valid(entry, request_mask))
+		return false;
+
+	memcpy(&attrs, &entry->attrs, sizeof(attrs));
+
+	/* Order the copy before checking nothing changed under it */
+	__sync_synchronize();
+
+	if (atomic_fetch_uint32_t(&entry->attr_seq) != seq)
+		return false;
+
+	*attrs_out = attrs;
+	attrs_out->request_mask = request_mask;
+	attrs_out->acl = NULL;
+	attrs_out->valid_mask &= ~ATTR_ACL;
+
+	mdc_refresh_ahead(entry);
+
+	return true;
+}
+
 /**
  * @brief Get the attributes for an object
  *
  * If the attribute cache is valid, just return them.  Otherwise, resfresh the
  * cache.
  *
+ * Callers that find the attributes expired queue on the attr_lock behind
+ * the one refreshing them.  A refresh that completed while a caller was
+ * queued serves it as well, so a burst of GETATTRs on an expired entry
+ * costs one call to the FSAL.
+ *
  * @param[in]     obj_hdl   Object to get attributes from
  * @param[in,out] attrs_out Attributes fetched
  * @return FSAL status
@@ -1161,23 +1618,42 @@ static fsal_status_t mdcache_getattrs(struct fsal_obj_handle *obj_hdl,
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status = {0, 0};
+	uint32_t refreshes;
+
+	if (mdc_getattrs_seq(entry, attrs_out))
+		goto out;
 
 	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
 
 	if (mdcache_is_attrs_valid(entry, attrs_out->request_mask)) {
 		/* Up-to-date */
+		mdc_refresh_ahead(entry);
 		goto unlock;
 	}
 
+	refreshes = entry->attr_refreshes;
+
 	/* Promote to write lock */
-	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
-	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	MDC_ATTR_UNLOCK(entry);
+	MDC_ATTR_WRLOCK(entry);
 
 	if (mdcache_is_attrs_valid(entry, attrs_out->request_mask)) {
 		/* Someone beat us to it */
 		goto unlock;
 	}
 
+	if (entry->attr_refreshes != refreshes &&
+	    (entry->attr_refresh_acl ||
+	     !(attrs_out->request_mask & ATTR_ACL))) {
+		/* Someone refreshed while we waited, even if the result
+		 * is not cacheable (Attr_Expiration_Time of 0).
+		 */
+		goto unlock;
+	}
+
+	if (!(attrs_out->request_mask & ATTR_ACL) && mdc_probe_change(entry))
+		goto unlock;
+
 	status = mdcache_refresh_attrs(
 			entry, (attrs_out->request_mask & ATTR_ACL) != 0, true);
 
@@ -1198,17 +1674,43 @@ unlock:
 
 unlock_no_attrs:
 
-	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	MDC_ATTR_UNLOCK(entry);
 
 	if (FSAL_IS_ERROR(status) && (status.major == ERR_FSAL_STALE))
 		mdcache_kill_entry(entry);
 
+out:
+
 	LogAttrlist(COMPONENT_CACHE_INODE, NIV_FULL_DEBUG,
 		    "attrs ", attrs_out, true);
 
 	return status;
 }
 
+/**
+ * @brief Get the change attribute of an object
+ *
+ * Passed through to the FSAL, for a stacked FSAL above MDCACHE.
+ *
+ * @param[in]  obj_hdl Object to query
+ * @param[out] change  The change attribute
+ * @return FSAL status
+ */
+static fsal_status_t mdcache_getchange(struct fsal_obj_handle *obj_hdl,
+				       uint64_t *change)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	subcall(
+		status = entry->sub_handle->obj_ops.getchange(
+			entry->sub_handle, change)
+	       );
+
+	return status;
+}
+
 /**
  * @brief Set attributes on an object
  *
@@ -1224,7 +1726,7 @@ static fsal_status_t mdcache_setattrs(struct fsal_obj_handle *obj_hdl,
 	fsal_status_t status;
 	uint64_t change;
 
-	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	MDC_ATTR_WRLOCK(entry);
 
 	change = entry->attrs.change;
 
@@ -1259,7 +1761,7 @@ static fsal_status_t mdcache_setattrs(struct fsal_obj_handle *obj_hdl,
 
 unlock:
 
-	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	MDC_ATTR_UNLOCK(entry);
 
 	if (FSAL_IS_ERROR(status) && (status.major == ERR_FSAL_STALE))
 		mdcache_kill_entry(entry);
@@ -1286,11 +1788,14 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 	uint64_t change;
 	bool need_acl = false;
 
-	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	MDC_ATTR_WRLOCK(entry);
 
 	change = entry->attrs.change;
 
-	subcall(
+	if (FSAL_TEST_MASK(attrs->valid_mask, ATTR_SIZE))
+		mdc_preread_drop_locked(entry);
+
+	subcall_timed(FSAL_CALL_SETATTRS, entry, status,
 		status = entry->sub_handle->obj_ops.setattr2(
 			entry->sub_handle, bypass, state, attrs)
 	       );
@@ -1319,7 +1824,7 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 
 unlock:
 
-	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	MDC_ATTR_UNLOCK(entry);
 
 	if (FSAL_IS_ERROR(status) && (status.major == ERR_FSAL_STALE))
 		mdcache_kill_entry(entry);
@@ -1351,7 +1856,7 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 		     "Unlink %p/%s (%p)",
 		     parent, name, entry);
 
-	subcall(
+	subcall_timed(FSAL_CALL_UNLINK, parent, status,
 		status = parent->sub_handle->obj_ops.unlink(
 			parent->sub_handle, entry->sub_handle, name)
 	       );
@@ -1369,6 +1874,9 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 			PTHREAD_RWLOCK_unlock(&entry->content_lock);
 		}
 	} else {
+		state_dir_deleg_notify(dir_hdl, NOTIFY4_REMOVE_ENTRY, name,
+				       NULL);
+
 		PTHREAD_RWLOCK_wrlock(&parent->content_lock);
 		(void)mdcache_dirent_remove(parent, name);
 		PTHREAD_RWLOCK_unlock(&parent->content_lock);
@@ -1471,6 +1979,27 @@ static fsal_status_t mdcache_handle_digest(
 	return status;
 }
 
+/**
+ * @brief Get the cache hint for a handle
+ *
+ * The hint is the hash of the entry's key, which is the same for as
+ * long as the object exists.  It is only given when lookups are
+ * lockless, as that is when skipping the hashing pays.
+ *
+ * @param[in] obj_hdl	Handle to get the hint of
+ * @return The hint, or 0
+ */
+static uint64_t mdcache_handle_cache_hint(const struct fsal_obj_handle *obj_hdl)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+
+	if (!mdcache_param.handle_cache_hint || !cih_fhcache.lockless)
+		return 0;
+
+	return entry->fh_hk.key.hk;
+}
+
 /**
  * @brief Get the unique key for a handle
  *
@@ -1709,6 +2238,7 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->readlink = mdcache_readlink;
 	ops->test_access = mdcache_test_access;
 	ops->getattrs = mdcache_getattrs;
+	ops->getchange = mdcache_getchange;
 	ops->setattrs = mdcache_setattrs;
 	ops->link = mdcache_link;
 	ops->rename = mdcache_rename;
@@ -1730,6 +2260,7 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->handle_is = mdcache_handle_is;
 	ops->handle_digest = mdcache_handle_digest;
 	ops->handle_to_key = mdcache_handle_to_key;
+	ops->handle_cache_hint = mdcache_handle_cache_hint;
 	ops->handle_cmp = mdcache_handle_cmp;
 
 	/* pNFS */
@@ -1745,8 +2276,16 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->read2 = mdcache_read2;
 	ops->write2 = mdcache_write2;
 	ops->seek2 = mdcache_seek2;
+	ops->read_ref2 = mdcache_read_ref2;
+	ops->readv2 = mdcache_readv2;
+	ops->writev2 = mdcache_writev2;
+	ops->copy = mdcache_copy;
+	ops->clone = mdcache_clone;
+	ops->read2_async = mdcache_read2_async;
+	ops->write2_async = mdcache_write2_async;
 	ops->io_advise2 = mdcache_io_advise2;
 	ops->commit2 = mdcache_commit2;
+	ops->commit2_async = mdcache_commit2_async;
 	ops->lock_op2 = mdcache_lock_op2;
 	ops->setattr2 = mdcache_setattr2;
 	ops->close2 = mdcache_close2;
@@ -1889,3 +2428,47 @@ fsal_status_t mdcache_create_handle(struct fsal_export *exp_hdl,
 	*handle = &entry->obj_handle;
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
+
+/**
+ * @brief Find or create a cache entry from a key and its hash
+ *
+ * The hint from the wire handle is taken as the hash of the key, so a
+ * cached entry is found without hashing.  The lookup still compares the
+ * whole key, so a wrong hint only misses, and then the key is hashed
+ * as by mdcache_create_handle().
+ *
+ * @param[in]  exp_hdl   The export in which to create the handle
+ * @param[in]  hdl_desc  Buffer descriptor for the "wire" handle
+ * @param[in]  hint      Hint from the wire handle
+ * @param[out] handle    FSAL object handle
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_create_handle_hint(struct fsal_export *exp_hdl,
+					 struct gsh_buffdesc *hdl_desc,
+					 uint64_t hint,
+					 struct fsal_obj_handle **handle)
+{
+	struct mdcache_fsal_export *export =
+		container_of(exp_hdl, struct mdcache_fsal_export, export);
+	mdcache_key_t key;
+	mdcache_entry_t *entry;
+	fsal_status_t status;
+
+	if (!cih_fhcache.lockless)
+		return mdcache_create_handle(exp_hdl, hdl_desc, handle, NULL);
+
+	key.fsal = export->export.sub_export->fsal;
+	key.kv = *hdl_desc;
+	key.hk = hint;
+
+	status = mdcache_find_keyed(&key, &entry);
+	if (FSAL_IS_ERROR(status))
+		return mdcache_create_handle(exp_hdl, hdl_desc, handle, NULL);
+
+	/* Make sure this entry has a parent pointer */
+	mdc_get_parent(export, entry);
+
+	*handle = &entry->obj_handle;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
@@ -36,6 +36,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include "fsal.h"
 #include "nfs_core.h"
 #include "log.h"
@@ -63,6 +64,81 @@
 struct cih_lookup_table cih_fhcache;
 static bool initialized;
 
+/**
+ * @brief Final mix of a 64 bit hash, from MurmurHash3
+ */
+static inline uint64_t cih_fmix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief Hash a handle key with the CRC32C instruction
+ *
+ * Alternate words feed two CRCs, so both halves of the hash depend
+ * on the whole key, and a final mix spreads them over all 64 bits.
+ * Only called once cih_pkginit found SSE 4.2 on the CPU.
+ *
+ * @param addr [in] Key bytes
+ * @param len  [in] Key length
+ *
+ * @return The hash.
+ */
+__attribute__((target("sse4.2")))
+uint64_t cih_crc_hash64(const void *addr, size_t len)
+{
+	const uint8_t *p = addr;
+	const uint64_t n = len;
+	uint64_t a = 557, b = ~(uint64_t) 557;
+	uint64_t w;
+
+	while (len >= 16) {
+		memcpy(&w, p, sizeof(w));
+		a = __builtin_ia32_crc32di(a, w);
+		memcpy(&w, p + 8, sizeof(w));
+		b = __builtin_ia32_crc32di(b, w);
+		p += 16;
+		len -= 16;
+	}
+
+	if (len >= 8) {
+		memcpy(&w, p, sizeof(w));
+		a = __builtin_ia32_crc32di(a, w);
+		p += 8;
+		len -= 8;
+	}
+
+	/* The tail, padded with zeroes, then the key length */
+	w = 0;
+	memcpy(&w, p, len);
+	b = __builtin_ia32_crc32di(b, w);
+	a = __builtin_ia32_crc32di(a, n);
+
+	return cih_fmix64((a << 32) | (uint32_t) b);
+}
+
+static bool cih_crc_supported(void)
+{
+	return __builtin_cpu_supports("sse4.2");
+}
+#else
+uint64_t cih_crc_hash64(const void *addr, size_t len)
+{
+	return cih_fmix64(CityHash64WithSeed(addr, len, 557));
+}
+
+static bool cih_crc_supported(void)
+{
+	return false;
+}
+#endif
+
 /**
  * @brief Initialize the package.
  */
@@ -84,6 +160,20 @@ cih_pkginit(void)
 	cih_fhcache.partition =
 		gsh_calloc(cih_fhcache.npart, sizeof(cih_partition_t));
 	cih_fhcache.cache_sz = mdcache_param.cache_size;
+	cih_fhcache.lockless = mdcache_param.lockless_lookup;
+	cih_fhcache.backend = mdcache_param.hash_backend;
+	if (cih_fhcache.lockless &&
+	    cih_fhcache.backend != CIH_BACKEND_AVL) {
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Lockless_Lookup requires Hash_Backend = AVL, disabled");
+		cih_fhcache.lockless = false;
+	}
+	if (mdcache_param.key_hash == CIH_KEY_HASH_CRC32C) {
+		cih_fhcache.crc_hash = cih_crc_supported();
+		if (!cih_fhcache.crc_hash)
+			LogWarn(COMPONENT_CACHE_INODE,
+				"Handle_Hash = CRC32C is not supported by this CPU, using City");
+	}
 	for (ix = 0; ix < cih_fhcache.npart; ++ix) {
 		cp = &cih_fhcache.partition[ix];
 		cp->part_ix = ix;
@@ -92,6 +182,9 @@ cih_pkginit(void)
 		cp->cache =
 			gsh_calloc(cih_fhcache.cache_sz,
 				sizeof(struct avltree_node *));
+		if (cih_fhcache.backend == CIH_BACKEND_OAHASH)
+			oahash_init(&cp->index, cih_fhcache.cache_sz,
+				    cih_oahash_hash);
 	}
 	initialized = true;
 }
@@ -110,6 +203,12 @@ cih_pkgdestroy(void)
 		if (avltree_first(&cih_fhcache.partition[ix].t) != NULL)
 			LogMajor(COMPONENT_CACHE_INODE,
 				 "Cache inode AVL tree not empty");
+		if (cih_fhcache.backend == CIH_BACKEND_OAHASH) {
+			if (oahash_count(&cih_fhcache.partition[ix].index))
+				LogMajor(COMPONENT_CACHE_INODE,
+					 "Cache inode hash index not empty");
+			oahash_destroy(&cih_fhcache.partition[ix].index);
+		}
 		PTHREAD_RWLOCK_destroy(&cih_fhcache.partition[ix].lock);
 		gsh_free(cih_fhcache.partition[ix].cache);
 	}
@@ -51,6 +51,7 @@
 #include "gsh_intrinsic.h"
 #include "mdcache_lru.h"
 #include "city.h"
+#include "gsh_oahash.h"
 #include <libgen.h>
 #ifdef USE_LTTNG
 #include "gsh_lttng/mdcache.h"
@@ -61,12 +62,18 @@
  *
  * Each tree is independent, having its own lock, thus reducing thread
  * contention.
+ *
+ * seq is odd while a writer holds the partition lock and is bumped
+ * again when it drops it.  Lockless readers use it to validate what
+ * they saw; see cih_get_by_key_lockless().
  */
 typedef struct cih_partition {
 	uint32_t part_ix;
+	uint32_t seq;
 	pthread_rwlock_t lock;
 	struct avltree t;
 	struct avltree_node **cache;
+	struct oahash index;	/*< used instead of t with CIH_BACKEND_OAHASH */
 #ifdef ENABLE_LOCKTRACE
 	struct {
 		char *func;
@@ -86,6 +93,9 @@ struct cih_lookup_table {
 	cih_partition_t *partition;
 	uint32_t npart;
 	uint32_t cache_sz;
+	bool lockless;		/*< Lockless_Lookup */
+	uint32_t backend;	/*< enum cih_backend */
+	bool crc_hash;		/*< Handle_Hash = CRC32C, and supported */
 };
 
 /* Support inline lookups */
@@ -101,6 +111,8 @@ void cih_pkginit(void);
  */
 void cih_pkgdestroy(void);
 
+uint64_t cih_crc_hash64(const void *addr, size_t len);
+
 /**
  * @brief Find the correct partition for a pointer
  *
@@ -178,9 +190,48 @@ cih_fhcache_inline_lookup(const struct avltree *tree,
 	return avltree_inline_lookup(key, tree, cih_fh_cmpf);
 }
 
+/**
+ * @brief Key comparison for the open-addressing index
+ */
+static inline bool cih_oahash_match(const void *item, const void *key)
+{
+	const mdcache_entry_t *entry = item;
+
+	return mdcache_key_cmp(&entry->fh_hk.key, key) == 0;
+}
+
+/**
+ * @brief Hash of an entry for the open-addressing index
+ */
+static inline uint64_t cih_oahash_hash(const void *item)
+{
+	const mdcache_entry_t *entry = item;
+
+	return entry->fh_hk.key.hk;
+}
+
 #define CIH_HASH_NONE           0x0000
 #define CIH_HASH_KEY_PROTOTYPE  0x0001
 
+/**
+ * @brief Hash the bytes of a handle key
+ *
+ * The hash is also the key's fingerprint: mdcache_key_cmp orders
+ * keys by it first, so keys that differ are told apart without
+ * reading their bytes but for a full 64 bit collision.
+ *
+ * @param fh_desc [in] Handle key
+ *
+ * @return The hash.
+ */
+static inline uint64_t cih_key_hash(const struct gsh_buffdesc *fh_desc)
+{
+	if (cih_fhcache.crc_hash)
+		return cih_crc_hash64(fh_desc->addr, fh_desc->len);
+
+	return CityHash64WithSeed(fh_desc->addr, fh_desc->len, 557);
+}
+
 /**
  * @brief Convenience function to compute hash for mdcache_entry_t
  *
@@ -211,8 +262,7 @@ cih_hash_key(mdcache_key_t *key,
 	}
 
 	/* hash it */
-	key->hk =
-	    CityHash64WithSeed(fh_desc->addr, fh_desc->len, 557);
+	key->hk = cih_key_hash(fh_desc);
 
 	return true;
 }
@@ -230,11 +280,37 @@ cih_hash_key(mdcache_key_t *key,
  */
 typedef struct cih_latch {
 	cih_partition_t *cp;
+	bool wlocked;
 } cih_latch_t;
 
+/**
+ * @brief Start a write section on a partition
+ *
+ * Called with the partition write locked.  This must come before the
+ * writer looks at any entry refcount: lockless readers take their
+ * reference before re-checking seq, so one of the two always sees
+ * the other.
+ */
+static inline void cih_write_begin(cih_partition_t *cp)
+{
+	(void) atomic_inc_uint32_t(&cp->seq);
+}
+
+/**
+ * @brief End a write section on a partition, before unlocking it
+ */
+static inline void cih_write_end(cih_partition_t *cp)
+{
+	(void) atomic_inc_uint32_t(&cp->seq);
+}
+
 static inline void
 cih_hash_release(cih_latch_t *latch)
 {
+	if (latch->wlocked) {
+		latch->wlocked = false;
+		cih_write_end(latch->cp);
+	}
 	PTHREAD_RWLOCK_unlock(&(latch->cp->lock));
 }
 
@@ -256,10 +332,14 @@ cih_latch_entry(mdcache_key_t *key, cih_latch_t *latch, uint32_t flags,
 	latch->cp = cp =
 	    cih_partition_of_scalar(&cih_fhcache, key->hk);
 
-	if (flags & CIH_GET_WLOCK)
+	if (flags & CIH_GET_WLOCK) {
 		PTHREAD_RWLOCK_wrlock(&cp->lock);	/* SUBTREE_WLOCK */
-	else
+		cih_write_begin(cp);
+		latch->wlocked = true;
+	} else {
 		PTHREAD_RWLOCK_rdlock(&cp->lock);	/* SUBTREE_RLOCK */
+		latch->wlocked = false;
+	}
 
 #ifdef ENABLE_LOCKTRACE
 	cp->locktrace.func = (char *)func;
@@ -270,28 +350,26 @@ cih_latch_entry(mdcache_key_t *key, cih_latch_t *latch, uint32_t flags,
 }
 
 /**
- * @brief Lookup cache entry by key
+ * @brief Lookup cache entry by key in an already latched partition
  *
- * Lookup cache entry by fh, optionally return with hash partition shared
- * or exclusive locked.  Differs from the fh variant in using the precomputed
- * hash stored with key.
+ * The latch must hold the partition of key, as batches of lookups in
+ * one partition do to take its lock once.
  *
  * @param key [in] Key being searched
- * @param latch [out] Pointer to partition
- * @param flags [in] Flags
+ * @param latch [in] Latch on the key's partition
  *
  * @return Pointer to cache entry if found, else NULL
  */
 static inline mdcache_entry_t *
-cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
-		       uint32_t flags, const char *func, int line)
+cih_get_by_key_latched(mdcache_key_t *key, cih_latch_t *latch)
 {
 	mdcache_entry_t k_entry, *entry = NULL;
 	struct avltree_node *node;
 	void **cache_slot;
 
-	if (!cih_latch_entry(key, latch, flags, func, line))
-		return NULL;
+	if (cih_fhcache.backend == CIH_BACKEND_OAHASH)
+		return oahash_lookup(&latch->cp->index, key->hk,
+				     cih_oahash_match, key);
 
 	k_entry.fh_hk.key = *key;
 
@@ -312,8 +390,6 @@ cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
 	/* check AVL */
 	node = cih_fhcache_inline_lookup(&latch->cp->t, &k_entry.fh_hk.node_k);
 	if (!node) {
-		if (flags & CIH_GET_UNLOCK_ON_MISS)
-			cih_hash_release(latch);
 		LogDebug(COMPONENT_HASHTABLE_CACHE, "fdcache MISS");
 		goto out;
 	}
@@ -330,6 +406,163 @@ cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
 	return entry;
 }
 
+/**
+ * @brief Lookup cache entry by key
+ *
+ * Lookup cache entry by fh, optionally return with hash partition shared
+ * or exclusive locked.  Differs from the fh variant in using the precomputed
+ * hash stored with key.
+ *
+ * @param key [in] Key being searched
+ * @param latch [out] Pointer to partition
+ * @param flags [in] Flags
+ *
+ * @return Pointer to cache entry if found, else NULL
+ */
+static inline mdcache_entry_t *
+cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
+		       uint32_t flags, const char *func, int line)
+{
+	mdcache_entry_t *entry;
+
+	if (!cih_latch_entry(key, latch, flags, func, line))
+		return NULL;
+
+	entry = cih_get_by_key_latched(key, latch);
+	if (!entry && (flags & CIH_GET_UNLOCK_ON_MISS))
+		cih_hash_release(latch);
+
+	return entry;
+}
+
+/* Bound on the lockless tree walk, a concurrent rebalance can
+ * briefly make the walk revisit nodes. */
+#define CIH_LOCKLESS_MAX_DEPTH 64
+
+/**
+ * @brief Compare a key against a node that may be changing under us
+ *
+ * The entry's key is read without the partition lock, so the result
+ * is only meaningful if the partition sequence is unchanged
+ * afterwards.  Entries are never returned to the allocator while
+ * lockless lookups are enabled, so the entry memory itself is
+ * always an mdcache entry; a key being torn down has a NULL address.
+ *
+ * @return as mdcache_key_cmp, with 2 meaning "no usable key"
+ */
+static inline int
+cih_key_cmp_lockless(const mdcache_key_t *key, mdcache_entry_t *entry)
+{
+	mdcache_key_t *ek = &entry->fh_hk.key;
+	uint64_t hk = atomic_fetch_uint64_t(&ek->hk);
+	size_t len;
+	void *fsal, *addr;
+
+	if (key->hk < hk)
+		return -1;
+	if (key->hk > hk)
+		return 1;
+
+	len = atomic_fetch_size_t(&ek->kv.len);
+	if (key->kv.len < len)
+		return -1;
+	if (key->kv.len > len)
+		return 1;
+
+	fsal = atomic_fetch_voidptr(&ek->fsal);
+	if (key->fsal < fsal)
+		return -1;
+	if (key->fsal > fsal)
+		return 1;
+
+	addr = atomic_fetch_voidptr(&ek->kv.addr);
+	if (addr == NULL)
+		return 2;
+
+	return memcmp(key->kv.addr, addr, len);
+}
+
+/**
+ * @brief Lookup cache entry by key without taking the partition lock
+ *
+ * This is a seqlock read section over the partition: the tree is walked
+ * with atomic loads, and the outcome is trusted only if no writer
+ * held the partition at any point during the walk.  A hit takes a
+ * reference (unless the entry is already dead) before the final
+ * sequence check, so a reaper that latched the partition either sees
+ * our reference or we see its sequence bump.  Nothing shared is
+ * written on a miss, and only the entry refcount on a hit.
+ *
+ * Only usable with cih_fhcache.lockless set.
+ *
+ * @param key   [in]  Key being searched
+ * @param retry [out] Set when the result could not be trusted and the
+ *                    caller should use the locked lookup
+ *
+ * @return Referenced entry if found, else NULL
+ */
+static inline mdcache_entry_t *
+cih_get_by_key_lockless(mdcache_key_t *key, bool *retry)
+{
+	cih_partition_t *cp = cih_partition_of_scalar(&cih_fhcache, key->hk);
+	struct avltree_node *node;
+	mdcache_entry_t *entry = NULL;
+	uint32_t seq = atomic_fetch_uint32_t(&cp->seq);
+	int depth, rc;
+
+	*retry = true;
+
+	if (seq & 1)
+		return NULL;
+
+	node = atomic_fetch_voidptr((void **)
+		&cp->cache[cih_cache_offsetof(&cih_fhcache, key->hk)]);
+	if (node != NULL) {
+		entry = avltree_container_of(node, mdcache_entry_t,
+					     fh_hk.node_k);
+		if (cih_key_cmp_lockless(key, entry) == 0)
+			goto found;
+	}
+
+	node = atomic_fetch_voidptr((void **)&cp->t.root);
+	for (depth = 0; node != NULL; ++depth) {
+		if (depth == CIH_LOCKLESS_MAX_DEPTH)
+			return NULL;
+
+		entry = avltree_container_of(node, mdcache_entry_t,
+					     fh_hk.node_k);
+		rc = cih_key_cmp_lockless(key, entry);
+		if (rc == 0)
+			goto found;
+		if (rc == 2)
+			return NULL;
+
+		node = atomic_fetch_voidptr(rc < 0 ? (void **)&node->left
+						   : (void **)&node->right);
+	}
+
+	/* A miss counts only if the tree did not change meanwhile */
+	if (atomic_fetch_uint32_t(&cp->seq) == seq)
+		*retry = false;
+
+	return NULL;
+
+ found:
+	if (!atomic_inc_not_zero_int32_t(&entry->lru.refcnt))
+		return NULL;
+
+	if (atomic_fetch_uint32_t(&cp->seq) != seq) {
+		/* The reference is real, give it back */
+		mdcache_lru_unref(entry, LRU_FLAG_NONE);
+		return NULL;
+	}
+
+	*retry = false;
+	LogDebug(COMPONENT_HASHTABLE_CACHE, "cih lockless hit");
+
+	return entry;
+}
+
 #define CIH_SET_NONE     0x0000
 #define CIH_SET_HASHED   0x0001	/* previously hashed entry */
 #define CIH_SET_UNLOCK   0x0002
@@ -360,8 +593,17 @@ cih_set_latched(mdcache_entry_t *entry, cih_latch_t *latch,
 				  fh_desc, CIH_HASH_NONE))
 			return 1;
 
-	(void)avltree_insert(&entry->fh_hk.node_k, &cp->t);
+	if (cih_fhcache.backend == CIH_BACKEND_OAHASH)
+		oahash_insert(&cp->index, entry->fh_hk.key.hk, entry);
+	else
+		(void)avltree_insert(&entry->fh_hk.node_k, &cp->t);
 	entry->fh_hk.inavl = true;
+
+	/* Lockless readers never fill the cache, so do it here */
+	if (cih_fhcache.lockless)
+		atomic_store_voidptr((void **)&cp->cache[cih_cache_offsetof(
+			&cih_fhcache, entry->fh_hk.key.hk)],
+			&entry->fh_hk.node_k);
 #ifdef USE_LTTNG
 	tracepoint(mdcache, mdc_lru_insert, __func__, __LINE__, entry,
 		   entry->lru.refcnt);
@@ -392,6 +634,16 @@ cih_remove_checked(mdcache_entry_t *entry)
 	bool freed = false;
 
 	PTHREAD_RWLOCK_wrlock(&cp->lock);
+	cih_write_begin(cp);
+	if (cih_fhcache.backend == CIH_BACKEND_OAHASH) {
+		if (entry->fh_hk.inavl &&
+		    oahash_remove(&cp->index, entry->fh_hk.key.hk, entry)) {
+			entry->fh_hk.inavl = false;
+			/* return sentinel ref */
+			freed = mdcache_lru_unref(entry, LRU_FLAG_NONE);
+		}
+		goto out;
+	}
 	node = cih_fhcache_inline_lookup(&cp->t, &entry->fh_hk.node_k);
 	if (entry->fh_hk.inavl && node) {
 #ifdef USE_LTTNG
@@ -405,6 +657,8 @@ cih_remove_checked(mdcache_entry_t *entry)
 		/* return sentinel ref */
 		freed = mdcache_lru_unref(entry, LRU_FLAG_NONE);
 	}
+ out:
+	cih_write_end(cp);
 	PTHREAD_RWLOCK_unlock(&cp->lock);
 
 	return freed;
@@ -435,9 +689,15 @@ cih_remove_latched(mdcache_entry_t *entry, cih_latch_t *latch, uint32_t flags)
 		tracepoint(mdcache, mdc_lru_remove, __func__, __LINE__, entry,
 			   entry->lru.refcnt);
 #endif
-		avltree_remove(&entry->fh_hk.node_k, &cp->t);
-		cp->cache[cih_cache_offsetof(&cih_fhcache,
-					     entry->fh_hk.key.hk)] = NULL;
+		if (cih_fhcache.backend == CIH_BACKEND_OAHASH) {
+			(void)oahash_remove(&cp->index, entry->fh_hk.key.hk,
+					    entry);
+		} else {
+			avltree_remove(&entry->fh_hk.node_k, &cp->t);
+			cp->cache[cih_cache_offsetof(&cih_fhcache,
+						     entry->fh_hk.key.hk)] =
+				NULL;
+		}
 		entry->fh_hk.inavl = false;
 		if (flags & CIH_REMOVE_QLOCKED)
 			lflags |= LRU_UNREF_QLOCKED;
@@ -45,15 +45,74 @@
 #include <stdbool.h>
 
 #include "nfs_exports.h"
+#include "export_mgr.h"
+#include "fridgethr.h"
 
 #include "mdcache_lru.h"
 #include "mdcache_hash.h"
 #include "mdcache_avl.h"
+#include "nfs_core.h"
+#include "server_stats.h"
+
+#ifdef USE_LTTNG
+#include "gsh_lttng/mdcache.h"
+#endif
+
+/**
+ * @brief Start a call into the sub-FSAL
+ *
+ * @param[in] fop	Kind of call
+ * @param[in] entry	Entry called on
+ *
+ * @return Start time if the call is timed, 0 otherwise.
+ */
+nsecs_elapsed_t mdc_call_enter(enum fsal_call fop, mdcache_entry_t *entry)
+{
+	struct timespec ts;
+
+#ifdef USE_LTTNG
+	tracepoint(mdcache, fsal_call_enter, fop, entry);
+#endif
+
+	if (!mdcache_param.fsal_call_hists)
+		return 0;
+
+	now(&ts);
+	return timespec_diff(&ServerBootTime, &ts);
+}
+
+/**
+ * @brief Finish a call into the sub-FSAL
+ *
+ * @param[in] fop	Kind of call
+ * @param[in] entry	Entry called on
+ * @param[in] start	Value returned by mdc_call_enter
+ * @param[in] major	Status of the call
+ */
+void mdc_call_exit(enum fsal_call fop, mdcache_entry_t *entry,
+		   nsecs_elapsed_t start, fsal_errors_t major)
+{
+	struct timespec ts;
+	nsecs_elapsed_t elapsed;
+
+#ifdef USE_LTTNG
+	tracepoint(mdcache, fsal_call_exit, fop, entry, major);
+#endif
+
+	if (start == 0)
+		return;
+
+	now(&ts);
+	elapsed = timespec_diff(&ServerBootTime, &ts) - start;
+	server_stats_fsal_call_done(entry->sub_handle->fsal->name, fop,
+				    elapsed);
+}
 
 static inline bool trust_negative_cache(mdcache_entry_t *parent)
 {
 	return op_ctx_export_has_option(
-				  EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE) &&
+				  EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE |
+				  EXPORT_OPTION_IMMUTABLE) &&
 		parent->icreate_refcnt == 0 &&
 		(parent->mde_flags & MDCACHE_DIR_POPULATED) != 0;
 }
@@ -140,6 +199,9 @@ static mdcache_entry_t *mdcache_alloc_handle(
 	result->mde_flags = 0;
 	result->icreate_refcnt = 0;
 	glist_init(&result->export_list);
+	result->wgather = NULL;
+	result->preread = NULL;
+	result->preread_gen = 0;
 
 	return result;
 }
@@ -156,7 +218,7 @@ void mdc_clean_entry(mdcache_entry_t *entry)
 	struct glist_head *glistn;
 
 	/* Must get attr_lock before mdc_exp_lock */
-	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	MDC_ATTR_WRLOCK(entry);
 
 	glist_for_each_safe(glist, glistn, &entry->export_list) {
 		struct entry_export_map *expmap;
@@ -174,7 +236,7 @@ void mdc_clean_entry(mdcache_entry_t *entry)
 		PTHREAD_RWLOCK_unlock(&export->mdc_exp_lock);
 	}
 
-	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	MDC_ATTR_UNLOCK(entry);
 
 	/* Clear out first_export */
 	atomic_store_voidptr(&entry->first_export, NULL);
@@ -187,6 +249,10 @@ void mdc_clean_entry(mdcache_entry_t *entry)
 		/* Clean up parent key */
 		mdcache_key_delete(&entry->fsobj.fsdir.parent);
 
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	} else if (entry->obj_handle.type == SYMBOLIC_LINK) {
+		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+		mdcache_readlink_clean(entry);
 		PTHREAD_RWLOCK_unlock(&entry->content_lock);
 	}
 	cih_remove_checked(entry);
@@ -229,7 +295,7 @@ again:
 
 		/* Found active export on list */
 		if (expmap->export == export) {
-			PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+			MDC_ATTR_UNLOCK(entry);
 			return;
 		}
 	}
@@ -238,8 +304,8 @@ again:
 		/* Now take write lock and try again in
 		 * case another thread has raced with us.
 		 */
-		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
-		PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+		MDC_ATTR_UNLOCK(entry);
+		MDC_ATTR_WRLOCK(entry);
 		try_write = true;
 		goto again;
 	}
@@ -260,9 +326,10 @@ again:
 
 	glist_add_tail(&entry->export_list, &expmap->export_per_entry);
 	glist_add_tail(&export->entry_list, &expmap->entry_per_export);
+	(void) atomic_inc_int64_t(&export->entries);
 
 	PTHREAD_RWLOCK_unlock(&export->mdc_exp_lock);
-	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	MDC_ATTR_UNLOCK(entry);
 }
 
 fsal_status_t
@@ -320,7 +387,7 @@ mdc_get_parent(struct mdcache_fsal_export *export, mdcache_entry_t *entry)
 		return;
 	}
 
-	subcall_raw(export,
+	subcall_raw_timed(export, FSAL_CALL_LOOKUP, entry, status,
 		status = entry->sub_handle->obj_ops.lookup(
 			    entry->sub_handle, "..", &sub_handle, NULL)
 	       );
@@ -365,13 +432,13 @@ void mdcache_clean_dirent_chunk(struct dir_chunk *chunk)
 				       &parent->fsobj.fsdir.avl.c);
 		} else {
 			/* Remove from active names tree */
+			mdcache_index_del(parent, dirent);
 			avltree_remove(&dirent->node_hk,
 				       &parent->fsobj.fsdir.avl.t);
 		}
 
-		if (dirent->ckey.kv.len)
-			mdcache_key_delete(&dirent->ckey);
-		gsh_free(dirent);
+		/* Arena dirents go with the arena below */
+		mdcache_dirent_free(dirent);
 
 		/* Don't count this dirent anymore. */
 		parent->fsobj.fsdir.nbactive--;
@@ -379,9 +446,28 @@ void mdcache_clean_dirent_chunk(struct dir_chunk *chunk)
 
 	/* Remove chunk from directory and free it */
 	glist_del(&chunk->chunks);
+	PTHREAD_MUTEX_destroy(&chunk->enc_mutex);
+	mdcache_chunk_mem(chunk, -(int64_t) (sizeof(*chunk) +
+					     chunk->arena_size));
+	gsh_free(chunk->arena);
 	gsh_free(chunk);
 }
 
+/**
+ * @brief Discard a chunk that was not added to its directory.
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] chunk  The chunk being discarded.
+ *
+ */
+
+static void mdc_discard_dirent_chunk(struct dir_chunk *chunk)
+{
+	glist_add_tail(&chunk->parent->fsobj.fsdir.chunks, &chunk->chunks);
+	mdcache_clean_dirent_chunk(chunk);
+}
+
 /**
  * @brief Cleans all the dirent chunks belonging to a directory.
  *
@@ -402,10 +488,252 @@ void mdcache_clean_dirent_chunks(mdcache_entry_t *entry)
 	}
 }
 
+/**
+ * @brief Drop the cached target of a symlink
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in,out] entry  The symlink
+ */
+void mdcache_readlink_clean(mdcache_entry_t *entry)
+{
+	struct gsh_buffdesc *target = &entry->fsobj.fslink.target;
+
+	if (target->addr == NULL)
+		return;
+
+	mdcache_lru_mem(entry, -(int64_t) target->len);
+	gsh_free(target->addr);
+	target->addr = NULL;
+	target->len = 0;
+}
+
+/** Dirents of an invalidated directory, waiting to be freed */
+struct mdc_dirgc {
+	struct glist_head link;
+	struct glist_head chunks;	/*< The directory's chunks */
+	struct avltree t;		/*< Its active names */
+	struct avltree c;		/*< Its deleted names */
+};
+
+static struct fridgethr *mdc_dirgc_fridge;
+static pthread_mutex_t mdc_dirgc_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head mdc_dirgc_list = GLIST_HEAD_INIT(mdc_dirgc_list);
+static bool mdc_dirgc_queued;	/*< A drain is submitted */
+
+/**
+ * @brief Empty a detached name tree, freeing the unchunked dirents
+ *
+ * @param[in] tree The tree
+ */
+static void mdc_dirgc_free_tree(struct avltree *tree)
+{
+	struct avltree_node *node;
+	mdcache_dir_entry_t *dirent;
+
+	while ((node = avltree_first(tree)) != NULL) {
+		dirent = avltree_container_of(node, mdcache_dir_entry_t,
+					      node_hk);
+		avltree_remove(node, tree);
+		if (dirent->chunk == NULL)
+			mdcache_dirent_free(dirent);
+	}
+}
+
+/**
+ * @brief Free the dirents of an invalidated directory
+ *
+ * Nothing here refers to the directory, which may be gone.  The
+ * chunked dirents are in the trees and the chunks, they are freed
+ * with their chunk.  The marked cookies of chunked dirents are not
+ * released, MDCACHE's release_readdir_cookie does nothing.
+ *
+ * @param[in] gc What was detached from the directory, freed here
+ */
+static void mdc_dirgc_free(struct mdc_dirgc *gc)
+{
+	struct glist_head *glist, *glistn;
+	mdcache_dir_entry_t *dirent;
+	struct dir_chunk *chunk;
+
+	mdc_dirgc_free_tree(&gc->t);
+	mdc_dirgc_free_tree(&gc->c);
+
+	while ((chunk = glist_first_entry(&gc->chunks, struct dir_chunk,
+					  chunks)) != NULL) {
+		glist_for_each_safe(glist, glistn, &chunk->dirents) {
+			dirent = glist_entry(glist, mdcache_dir_entry_t,
+					     chunk_list);
+			gsh_free(dirent->encoded);
+			mdcache_dirent_free(dirent);
+		}
+
+		glist_del(&chunk->chunks);
+		PTHREAD_MUTEX_destroy(&chunk->enc_mutex);
+		mdcache_lru_mem(NULL, -(int64_t) (sizeof(*chunk) +
+						  chunk->arena_size));
+		gsh_free(chunk->arena);
+		gsh_free(chunk);
+	}
+
+	gsh_free(gc);
+}
+
+/**
+ * @brief Free the invalidated directories queued so far
+ */
+static void mdc_dirgc_drain(void)
+{
+	struct mdc_dirgc *gc;
+
+	for (;;) {
+		PTHREAD_MUTEX_lock(&mdc_dirgc_mtx);
+		gc = glist_first_entry(&mdc_dirgc_list, struct mdc_dirgc,
+				       link);
+		if (gc == NULL) {
+			mdc_dirgc_queued = false;
+			PTHREAD_MUTEX_unlock(&mdc_dirgc_mtx);
+			return;
+		}
+		glist_del(&gc->link);
+		PTHREAD_MUTEX_unlock(&mdc_dirgc_mtx);
+
+		mdc_dirgc_free(gc);
+	}
+}
+
+static void mdc_dirgc_run(struct fridgethr_context *ctx)
+{
+	mdc_dirgc_drain();
+}
+
+/**
+ * @brief Invalidate a large directory without freeing its dirents
+ *
+ * The chunks and name trees are moved aside in O(1), leaving the
+ * directory empty, and freed on the dirgc thread.
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in,out] entry  The directory
+ *
+ * @return false if the dirents must be freed by the caller.
+ */
+static bool mdc_dirgc_queue(mdcache_entry_t *entry)
+{
+	struct mdc_dirgc *gc;
+	uint64_t chunk_mem = entry->fsobj.fsdir.chunk_mem;
+	bool submit;
+
+	if (mdc_dirgc_fridge == NULL ||
+	    entry->fsobj.fsdir.nbactive < mdcache_param.dir.lazy_free_min)
+		return false;
+
+	gc = gsh_malloc(sizeof(*gc));
+	glist_init(&gc->chunks);
+	glist_splice_tail(&gc->chunks, &entry->fsobj.fsdir.chunks);
+	gc->t = entry->fsobj.fsdir.avl.t;
+	gc->c = entry->fsobj.fsdir.avl.c;
+
+	/* The index and negative cache are small, they go now */
+	mdcache_index_free(entry);
+	mdcache_neg_clean(entry);
+	mdcache_avl_init(entry);
+	entry->fsobj.fsdir.first_ck = 0;
+
+	/* The chunk bytes are no longer the directory's, but are still
+	 * in use until freed.
+	 */
+	entry->fsobj.fsdir.chunk_mem = 0;
+	mdcache_lru_mem(entry, -(int64_t) chunk_mem);
+	mdcache_lru_mem(NULL, chunk_mem);
+
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Freeing %" PRIu32 " dirents of %p in the background",
+		     entry->fsobj.fsdir.nbactive, entry);
+
+	PTHREAD_MUTEX_lock(&mdc_dirgc_mtx);
+	glist_add_tail(&mdc_dirgc_list, &gc->link);
+	submit = !mdc_dirgc_queued;
+	mdc_dirgc_queued = true;
+	PTHREAD_MUTEX_unlock(&mdc_dirgc_mtx);
+
+	if (submit &&
+	    fridgethr_submit(mdc_dirgc_fridge, mdc_dirgc_run, NULL) != 0) {
+		/* Nobody will drain, do it here */
+		mdc_dirgc_drain();
+	}
+
+	return true;
+}
+
+/**
+ * @brief Start the thread freeing invalidated directories, if configured
+ *
+ * @return 0 or an error from fridgethr_init.
+ */
+
+int mdcache_dirgc_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (mdcache_param.dir.lazy_free_min == 0 ||
+	    mdc_dirgc_fridge != NULL)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&mdc_dirgc_fridge, "MDC_Dirgc", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize dirgc fridge, error code %d.",
+			 rc);
+		mdc_dirgc_fridge = NULL;
+	}
+
+	return rc;
+}
+
+void mdcache_dirgc_pkgshutdown(void)
+{
+	struct fridgethr *fridge = mdc_dirgc_fridge;
+	int rc;
+
+	if (fridge == NULL)
+		return;
+
+	/* Directories invalidated from now on are freed in place */
+	mdc_dirgc_fridge = NULL;
+
+	rc = fridgethr_sync_command(fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Dirgc shutdown timed out, cancelling threads.");
+		fridgethr_cancel(fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down dirgc threads: %d", rc);
+	}
+
+	fridgethr_destroy(fridge);
+
+	/* Whatever the thread did not get to */
+	mdc_dirgc_drain();
+}
+
 /**
  * @brief Invalidates and releases all cached entries for a directory
  *
- * Invalidates all the entries for a cached directory.
+ * Invalidates all the entries for a cached directory.  With
+ * Dir_Lazy_Free_Min, a directory with that many dirents is emptied at
+ * once and its dirents are freed in the background, so a large
+ * directory is not held locked while they are.
  *
  * @note The content lock MUST be held for write
  *
@@ -418,12 +746,20 @@ void mdcache_dirent_invalidate_all(mdcache_entry_t *entry)
 	LogFullDebug(COMPONENT_CACHE_INODE, "Invalidating directory for %p",
 		     entry);
 
+	if (mdc_dirgc_queue(entry)) {
+		entry->fsobj.fsdir.nbactive = 0;
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_DIR_POPULATED);
+		goto out;
+	}
+
 	/* Clean the chunks first, that will clean most of the active
 	 * entries also.
 	 */
 	mdcache_clean_dirent_chunks(entry);
 
 	/* First the active tree */
+	mdcache_index_free(entry);
 	mdcache_avl_clean_tree(&entry->fsobj.fsdir.avl.t);
 	entry->fsobj.fsdir.nbactive = 0;
 	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_DIR_POPULATED);
@@ -431,6 +767,13 @@ void mdcache_dirent_invalidate_all(mdcache_entry_t *entry)
 	/* Next the inactive tree */
 	mdcache_avl_clean_tree(&entry->fsobj.fsdir.avl.c);
 
+	/* And names known to be missing */
+	mdcache_neg_clean(entry);
+
+ out:
+	/* Lookups in flight must not cache what they found */
+	entry->fsobj.fsdir.dirent_gen++;
+
 	/* Now we can trust the content */
 	atomic_set_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_CONTENT);
 }
@@ -622,6 +965,18 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 	 */
 	nentry->attrs.request_mask = attrs_in->request_mask;
 	fsal_copy_attrs(&nentry->attrs, attrs_in, true);
+	mdcache_lru_mem(nentry, nentry->fh_hk.key.kv.len +
+			mdcache_acl_mem(nentry->attrs.acl));
+
+	if (nentry->attrs.expire_time_attr == 0 &&
+	    mdcache_param.upcall_lease &&
+	    op_ctx->fsal_export->exp_ops.fs_supports(
+			op_ctx->fsal_export, fso_upcall_invalidation)) {
+		/* The FSAL tells us about every change, hold attributes
+		 * (and so dirents) until it does.
+		 */
+		nentry->attrs.expire_time_attr = -1;
+	}
 
 	if (nentry->attrs.expire_time_attr == 0) {
 		nentry->attrs.expire_time_attr =
@@ -649,6 +1004,9 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 		goto out;
 	}
 
+	/* Skip probation if we reclaimed this one recently */
+	mdcache_lru_admit(nentry);
+
 	/* Map this new entry and the active export */
 	mdc_check_mapping(nentry);
 
@@ -666,6 +1024,7 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 	}
 	*entry = nentry;
 	(void)atomic_inc_uint64_t(&cache_stp->inode_added);
+	(void)atomic_inc_uint64_t(&mdc_cur_export()->misses);
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 
  out:
@@ -799,6 +1158,26 @@ mdcache_find_keyed(mdcache_key_t *key, mdcache_entry_t **entry)
 			     "Looking for %s", str);
 	}
 
+	if (cih_fhcache.lockless) {
+		bool retry;
+
+		*entry = cih_get_by_key_lockless(key, &retry);
+		if (likely(*entry)) {
+			/* Already referenced, just do the LRU side */
+			mdcache_lru_promote(*entry);
+			LogFullDebug(COMPONENT_CACHE_INODE,
+				     "Found entry %p",
+				     entry);
+			mdc_check_mapping(*entry);
+			(void)atomic_inc_uint64_t(&cache_stp->inode_hit);
+			(void)atomic_inc_uint64_t(&mdc_cur_export()->hits);
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+		if (!retry)
+			return fsalstat(ERR_FSAL_NOENT, 0);
+		/* Raced with a writer, take the lock */
+	}
+
 	*entry = cih_get_by_key_latch(key, &latch,
 					CIH_GET_RLOCK | CIH_GET_UNLOCK_ON_MISS,
 					__func__, __LINE__);
@@ -825,6 +1204,7 @@ mdcache_find_keyed(mdcache_key_t *key, mdcache_entry_t **entry)
 
 		mdc_check_mapping(*entry);
 		(void)atomic_inc_uint64_t(&cache_stp->inode_hit);
+		(void)atomic_inc_uint64_t(&mdc_cur_export()->hits);
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 	}
 
@@ -1027,10 +1407,152 @@ fsal_status_t mdc_try_get_cached(mdcache_entry_t *mdc_parent,
 			 * valid, it can serve negative lookups. */
 			return fsalstat(ERR_FSAL_NOENT, 0);
 		}
+		if (mdcache_neg_lookup(mdc_parent, name)) {
+			/* The FSAL said recently this name doesn't exist */
+			LogFullDebug(COMPONENT_CACHE_INODE,
+				     "Negative lookup cache hit %s", name);
+			return fsalstat(ERR_FSAL_NOENT, 0);
+		}
 	}
 	return fsalstat(ERR_FSAL_STALE, 0);
 }
 
+static inline void mdc_lookup_prepare_attrs(struct attrlist *attrs)
+{
+	/* Ask for all supported attributes except ACL (we defer fetching ACL
+	 * until asked for it (including a permission check).
+	 */
+	fsal_prepare_attrs(attrs,
+			   op_ctx->fsal_export->exp_ops.
+				   fs_supported_attrs(op_ctx->fsal_export)
+				   & ~ATTR_ACL);
+}
+
+/**
+ * @brief Cache what a sub-FSAL lookup found
+ *
+ * @note mdc_parent MUST have it's content_lock held for writing
+ *
+ * @param[in]     mdc_parent	Parent entry
+ * @param[in]     name		Name looked up
+ * @param[in]     sub_handle	Sub-FSAL handle found
+ * @param[in]     attrs		Its attributes, released here
+ * @param[out]    new_entry	New entry to return;
+ * @param[in,out] attrs_out     Optional attributes for entry
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_lookup_cache(mdcache_entry_t *mdc_parent,
+				      const char *name,
+				      struct fsal_obj_handle *sub_handle,
+				      struct attrlist *attrs,
+				      mdcache_entry_t **new_entry,
+				      struct attrlist *attrs_out)
+{
+	struct fsal_obj_handle *new_obj = NULL;
+	struct mdcache_fsal_export *export = mdc_cur_export();
+	fsal_status_t status;
+	bool invalidate = false;
+
+	/* We are only called to fill cache, we should not need to invalidate
+	 * parents attributes (or dirents if chunked).
+	 *
+	 * NOTE: This does mean that a pure lookup of a file that had been added
+	 *       external to this Ganesha instance could cause us to not dump
+	 *       the dirent cache, however, that should still result in an
+	 *       attribute change which should dump the cache.
+	 */
+	status = mdcache_alloc_and_check_handle(export, sub_handle, &new_obj,
+						false, attrs, attrs_out,
+						"lookup ", mdc_parent, name,
+						&invalidate, true, NULL);
+
+	fsal_release_attrs(attrs);
+
+	if (FSAL_IS_ERROR(status)) {
+		*new_entry = NULL;
+	} else {
+		*new_entry = container_of(new_obj, mdcache_entry_t, obj_handle);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Lookup an uncached entry without holding the content lock
+ *
+ * Like mdc_lookup_uncached(), but the content lock is dropped while the
+ * sub-FSAL looks the name up, so creates, removes and renames of other
+ * names in the directory go on meanwhile.  If the name or the directory
+ * changed in the meantime, the result may be stale and the lookup is
+ * done again under the lock.
+ *
+ * @note mdc_parent MUST have it's content_lock held for writing, it is
+ *       held again on return.
+ *
+ * @param[in]     mdc_parent	Parent entry
+ * @param[in]     name		Name of entry to find
+ * @param[out]    new_entry	New entry to return;
+ * @param[in,out] attrs_out     Optional attributes for entry
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_lookup_unlocked(mdcache_entry_t *mdc_parent,
+					 const char *name,
+					 mdcache_entry_t **new_entry,
+					 struct attrlist *attrs_out)
+{
+	struct fsal_obj_handle *sub_handle = NULL;
+	struct attrlist attrs;
+	uint32_t dir_gen = mdc_parent->fsobj.fsdir.dirent_gen;
+	uint32_t name_gen = mdcache_name_gen(mdc_parent, name);
+	fsal_status_t status;
+
+	mdc_lookup_prepare_attrs(&attrs);
+
+	PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
+
+	subcall_timed(FSAL_CALL_LOOKUP, mdc_parent, status,
+		status = mdc_parent->sub_handle->obj_ops.lookup(
+			    mdc_parent->sub_handle, name, &sub_handle, &attrs)
+	       );
+
+	PTHREAD_RWLOCK_wrlock(&mdc_parent->content_lock);
+
+	if (dir_gen != mdc_parent->fsobj.fsdir.dirent_gen ||
+	    name_gen != mdcache_name_gen(mdc_parent, name) ||
+	    !(mdc_parent->mde_flags & MDCACHE_TRUST_CONTENT)) {
+		LogFullDebug(COMPONENT_CACHE_INODE,
+			     "%s changed during lookup, again under lock",
+			     name);
+
+		if (!FSAL_IS_ERROR(status)) {
+			subcall(
+				sub_handle->obj_ops.release(sub_handle)
+			       );
+		}
+		fsal_release_attrs(&attrs);
+
+		if (!(mdc_parent->mde_flags & MDCACHE_TRUST_CONTENT))
+			mdcache_dirent_invalidate_all(mdc_parent);
+
+		return mdc_lookup_uncached(mdc_parent, name, new_entry,
+					   attrs_out);
+	}
+
+	if (unlikely(FSAL_IS_ERROR(status))) {
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "lookup %s failed with %s",
+			 name, fsal_err_txt(status));
+		*new_entry = NULL;
+		fsal_release_attrs(&attrs);
+		return status;
+	}
+
+	return mdc_lookup_cache(mdc_parent, name, sub_handle, &attrs,
+				new_entry, attrs_out);
+}
+
 /**
  * @brief Lookup a name (helper)
  *
@@ -1142,6 +1664,19 @@ fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 
 	LogDebug(COMPONENT_CACHE_INODE, "Cache Miss detected for %s", name);
 
+	if (mdcache_param.dir.unlocked_lookup)
+		status = mdc_lookup_unlocked(mdc_parent, name, new_entry,
+					     attrs_out);
+	else
+		status = mdc_lookup_uncached(mdc_parent, name, new_entry,
+					     attrs_out);
+
+	/* We hold the write lock, remember the miss */
+	if (status.major == ERR_FSAL_NOENT)
+		mdcache_neg_add(mdc_parent, name);
+
+	goto out;
+
 uncached:
 	status = mdc_lookup_uncached(mdc_parent, name, new_entry, attrs_out);
 
@@ -1172,58 +1707,34 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 				  mdcache_entry_t **new_entry,
 				  struct attrlist *attrs_out)
 {
-	struct fsal_obj_handle *sub_handle = NULL, *new_obj = NULL;
+	struct fsal_obj_handle *sub_handle = NULL;
 	fsal_status_t status;
-	struct mdcache_fsal_export *export = mdc_cur_export();
 	struct attrlist attrs;
-	bool invalidate = false;
 
-	/* Ask for all supported attributes except ACL (we defer fetching ACL
-	 * until asked for it (including a permission check).
-	 */
-	fsal_prepare_attrs(&attrs,
-			   op_ctx->fsal_export->exp_ops.
-				   fs_supported_attrs(op_ctx->fsal_export)
-				   & ~ATTR_ACL);
+	mdc_lookup_prepare_attrs(&attrs);
 
-	subcall(
+	subcall_timed(FSAL_CALL_LOOKUP, mdc_parent, status,
 		status = mdc_parent->sub_handle->obj_ops.lookup(
 			    mdc_parent->sub_handle, name, &sub_handle, &attrs)
 	       );
 
-	if (unlikely(FSAL_IS_ERROR(status))) {
-		LogDebug(COMPONENT_CACHE_INODE,
-			 "lookup %s failed with %s",
-			 name, fsal_err_txt(status));
-		*new_entry = NULL;
-		fsal_release_attrs(&attrs);
-		return status;
-	}
-
-	/* We are only called to fill cache, we should not need to invalidate
-	 * parents attributes (or dirents if chunked).
-	 *
-	 * NOTE: This does mean that a pure lookup of a file that had been added
-	 *       external to this Ganesha instance could cause us to not dump
-	 *       the dirent cache, however, that should still result in an
-	 *       attribute change which should dump the cache.
-	 */
-	status = mdcache_alloc_and_check_handle(export, sub_handle, &new_obj,
-						false, &attrs, attrs_out,
-						"lookup ", mdc_parent, name,
-						&invalidate, NULL);
-
-	fsal_release_attrs(&attrs);
-
-	if (FSAL_IS_ERROR(status)) {
+	if (unlikely(FSAL_IS_ERROR(status))) {
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "lookup %s failed with %s",
+			 name, fsal_err_txt(status));
 		*new_entry = NULL;
-	} else {
-		*new_entry = container_of(new_obj, mdcache_entry_t, obj_handle);
+		fsal_release_attrs(&attrs);
+		return status;
 	}
 
-	return status;
+	return mdc_lookup_cache(mdc_parent, name, sub_handle, &attrs,
+				new_entry, attrs_out);
 }
 
+/* Retry pauses of mdcache_src_dest_lock, in microseconds */
+#define MDC_SRC_DEST_BACKOFF_MIN 10
+#define MDC_SRC_DEST_BACKOFF_MAX 10000
+
 /**
  * @brief Lock two directories in order
  *
@@ -1231,6 +1742,11 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
  * the same, it takes only one lock.  Locks are acquired with lowest
  * cache_entry first to avoid deadlocks.
  *
+ * When the second lock is busy the first is dropped and both are tried
+ * again after a pause, starting at MDC_SRC_DEST_BACKOFF_MIN and doubling
+ * up to MDC_SRC_DEST_BACKOFF_MAX microseconds, so renames between busy
+ * directories retry quickly instead of stalling for a second.
+ *
  * @param[in] src  Source directory to lock
  * @param[in] dest Destination directory to lock
  */
@@ -1238,6 +1754,7 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 void
 mdcache_src_dest_lock(mdcache_entry_t *src, mdcache_entry_t *dest)
 {
+	useconds_t backoff = MDC_SRC_DEST_BACKOFF_MIN;
 	int rc;
 
 	/*
@@ -1262,8 +1779,7 @@ retry_lock:
 				 "retry dest %p lock, src %p",
 				 dest, src);
 			PTHREAD_RWLOCK_unlock(&src->content_lock);
-			sleep(1);
-			goto retry_lock;
+			goto backoff;
 		}
 	} else {
 		PTHREAD_RWLOCK_wrlock(&dest->content_lock);
@@ -1273,10 +1789,16 @@ retry_lock:
 				 "retry src %p lock, dest %p",
 				 src, dest);
 			PTHREAD_RWLOCK_unlock(&dest->content_lock);
-			sleep(1);
-			goto retry_lock;
+			goto backoff;
 		}
 	}
+	return;
+
+backoff:
+	usleep(backoff);
+	if (backoff < MDC_SRC_DEST_BACKOFF_MAX)
+		backoff *= 2;
+	goto retry_lock;
 }
 
 /**
@@ -1350,6 +1872,34 @@ fsal_status_t mdcache_dirent_find(mdcache_entry_t *dir, const char *name,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Allocate a directory entry to add to a directory
+ *
+ * This needs no lock, so creates can allocate the dirent before taking
+ * the parent's content_lock and hold it only for mdcache_dirent_insert.
+ *
+ * @param[in] name  The name of the entry
+ * @param[in] entry The cache entry associated with name
+ *
+ * @return The dirent, to be given to mdcache_dirent_insert.
+ */
+mdcache_dir_entry_t *
+mdcache_dirent_alloc(const char *name, mdcache_entry_t *entry)
+{
+	mdcache_dir_entry_t *dirent;
+	size_t namesize = strlen(name) + 1;
+
+	dirent = mem_arena_calloc(MEM_ARENA_MDCACHE, 1,
+				  sizeof(mdcache_dir_entry_t) + namesize);
+	mdcache_lru_mem(NULL, sizeof(mdcache_dir_entry_t) + namesize);
+	dirent->flags = DIR_ENTRY_FLAG_NONE;
+
+	memcpy(&dirent->name, name, namesize);
+	mdcache_key_dup(&dirent->ckey, &entry->fh_hk.key);
+
+	return dirent;
+}
+
 /**
  *
  * @brief Adds a directory entry to a cached directory.
@@ -1378,42 +1928,61 @@ fsal_status_t
 mdcache_dirent_add(mdcache_entry_t *parent, const char *name,
 		   mdcache_entry_t *entry, bool *invalidate)
 {
-	mdcache_dir_entry_t *new_dir_entry, *allocated_dir_entry;
-	size_t namesize = strlen(name) + 1;
-	int code = 0;
-
 	LogFullDebug(COMPONENT_CACHE_INODE, "Add dir entry %s", name);
 
+	return mdcache_dirent_insert(parent, mdcache_dirent_alloc(name, entry),
+				     invalidate);
+}
+
+/**
+ * @brief Insert a directory entry from mdcache_dirent_alloc
+ *
+ * Like mdcache_dirent_add(), which see, for a dirent allocated ahead.
+ * The dirent is consumed whatever the result.
+ *
+ * @note Caller MUST hold the content_lock for write
+ *
+ * @param[in,out] parent      Cache entry of the directory being updated
+ * @param[in]     dirent      The dirent to add
+ * @param[in,out] invalidate  As for mdcache_dirent_add()
+ *
+ * @return FSAL status
+ */
+
+fsal_status_t
+mdcache_dirent_insert(mdcache_entry_t *parent, mdcache_dir_entry_t *dirent,
+		      bool *invalidate)
+{
+	mdcache_dir_entry_t *new_dir_entry = dirent;
+	int code = 0;
+
 	/* Sanity check */
-	if (parent->obj_handle.type != DIRECTORY)
+	if (parent->obj_handle.type != DIRECTORY) {
+		mdcache_dirent_free(dirent);
 		return fsalstat(ERR_FSAL_NOTDIR, 0);
+	}
 
 	/* Don't cache if parent is not being cached */
-	if (parent->mde_flags & MDCACHE_BYPASS_DIRCACHE)
+	if (parent->mde_flags & MDCACHE_BYPASS_DIRCACHE) {
+		mdcache_dirent_free(dirent);
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
-
-	/* in cache avl, we always insert on pentry_parent */
-	new_dir_entry = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + namesize);
-	new_dir_entry->flags = DIR_ENTRY_FLAG_NONE;
-	allocated_dir_entry = new_dir_entry;
-
-	memcpy(&new_dir_entry->name, name, namesize);
-	mdcache_key_dup(&new_dir_entry->ckey, &entry->fh_hk.key);
+	}
 
 	/* add to avl */
 	code = mdcache_avl_qp_insert(parent, &new_dir_entry);
 	if (code < 0) {
 		/* Technically only a -2 is a name collision, however, we will
 		 * treat a hash collision (which per current code we should
-		 * never actually see) the same.
+		 * never actually see) the same.  The dirent is gone now.
 		 */
 		LogDebug(COMPONENT_CACHE_INODE,
-			 "Returning EEXIST for %s code %d", name, code);
+			 "Returning EEXIST for dirent in %p code %d",
+			 parent, code);
 		return fsalstat(ERR_FSAL_EXIST, 0);
 	}
 
 	/* we're going to succeed */
-	if (new_dir_entry == allocated_dir_entry) {
+	if (new_dir_entry == dirent) {
 		/* We only want to count this entry if we did indeed add a new
 		 * one.
 		 */
@@ -1532,8 +2101,9 @@ mdcache_dirent_rename(mdcache_entry_t *parent, const char *oldname,
 			(void)mdcache_find_keyed(&dirent2->ckey, &oldentry);
 
 			/* dirent2 (newname) will now point to renamed entry */
-			mdcache_key_delete(&dirent2->ckey);
+			mdcache_dirent_key_delete(dirent2);
 			mdcache_key_dup(&dirent2->ckey, &dirent->ckey);
+			mdcache_name_changed(parent, newname);
 
 			/* Delete dirent for oldname */
 			avl_dirent_set_deleted(parent, dirent);
@@ -1559,7 +2129,9 @@ mdcache_dirent_rename(mdcache_entry_t *parent, const char *oldname,
 	size_t newnamesize = strlen(newname) + 1;
 
 	/* try to rename--no longer in-place */
-	dirent2 = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + newnamesize);
+	dirent2 = mem_arena_calloc(MEM_ARENA_MDCACHE, 1,
+				   sizeof(mdcache_dir_entry_t) + newnamesize);
+	mdcache_lru_mem(NULL, sizeof(mdcache_dir_entry_t) + newnamesize);
 	memcpy(dirent2->name, newname, newnamesize);
 	dirent2->flags = DIR_ENTRY_FLAG_NONE;
 	mdcache_key_dup(&dirent2->ckey, &dirent->ckey);
@@ -1687,7 +2259,7 @@ mdcache_readdir_uncached(mdcache_entry_t *directory, fsal_cookie_t *whence,
 	state.cb = cb;
 	state.dir_state = dir_state;
 
-	subcall(
+	subcall_timed(FSAL_CALL_READDIR, directory, readdir_status,
 		readdir_status = directory->sub_handle->obj_ops.readdir(
 			directory->sub_handle, whence, &state,
 			mdc_readdir_uncached_cb, attrmask, eod_met)
@@ -2027,8 +2599,10 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
 
 		/* Setup new chunk. */
 		glist_init(&new_chunk->dirents);
+		PTHREAD_MUTEX_init(&new_chunk->enc_mutex, NULL);
 		new_chunk->parent = chunk->parent;
 		new_chunk->prev_chunk = chunk;
+		mdcache_chunk_mem(new_chunk, sizeof(*new_chunk));
 
 		/* And switch over to new chunk. */
 		state->dir_state = new_chunk;
@@ -2061,9 +2635,19 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
 		     new_entry, name, new_entry->sub_handle->fsal->name);
 
 	/* in cache avl, we always insert on mdc_parent */
-	new_dir_entry = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + namesize);
-	new_dir_entry->flags = DIR_ENTRY_FLAG_NONE;
-	new_dir_entry->chunk = chunk;
+	new_dir_entry = mdcache_chunk_alloc_dirent(chunk, name,
+						   &new_entry->fh_hk.key);
+	if (new_dir_entry == NULL) {
+		/* The chunk's arena is full */
+		new_dir_entry = mem_arena_calloc(MEM_ARENA_MDCACHE, 1,
+						 sizeof(mdcache_dir_entry_t) +
+						 namesize);
+		mdcache_lru_mem(NULL, sizeof(mdcache_dir_entry_t) + namesize);
+		new_dir_entry->flags = DIR_ENTRY_FLAG_NONE;
+		new_dir_entry->chunk = chunk;
+		memcpy(&new_dir_entry->name, name, namesize);
+		mdcache_key_dup(&new_dir_entry->ckey, &new_entry->fh_hk.key);
+	}
 	new_dir_entry->ck = cookie;
 	allocated_dir_entry = new_dir_entry;
 
@@ -2075,9 +2659,6 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
 	 *              chunk, posssibly making the chunk larger than normal.
 	 */
 
-	memcpy(&new_dir_entry->name, name, namesize);
-	mdcache_key_dup(&new_dir_entry->ckey, &new_entry->fh_hk.key);
-
 	/* add to avl */
 	code = mdcache_avl_qp_insert(mdc_parent, &new_dir_entry);
 
@@ -2262,6 +2843,87 @@ mdc_readdir_chunked_cb(const char *name, struct fsal_obj_handle *sub_handle,
 	return result;
 }
 
+/**
+ * @brief Fill a dirent chunk with the sub-FSAL's readdir_plus
+ *
+ * Entries are fetched in batches of at most a chunk, each batch coming
+ * back with names, handles and attributes from a single sub-FSAL call,
+ * and are added without going back through a per entry callback.  This
+ * stops when the chunk is full, the directory ends, or an entry
+ * collides with an existing chunk.
+ *
+ * @param[in]     directory The directory being read
+ * @param[in]     whence    Where to start (next)
+ * @param[in,out] state     Chunk population state
+ * @param[in]     attrmask  Attributes to fetch
+ * @param[out]    eod       true if the end of directory was reached
+ *
+ * @return FSAL status of the sub-FSAL, ERR_FSAL_NOTSUPP if it has no
+ *         readdir_plus and nothing was read.
+ */
+
+static fsal_status_t
+mdc_populate_dir_chunk_plus(mdcache_entry_t *directory, fsal_cookie_t whence,
+			    struct mdcache_populate_cb_state *state,
+			    attrmask_t attrmask, bool *eod)
+{
+	struct mdcache_fsal_export *export = state->export;
+	uint32_t max = mdcache_param.dir.avl_chunk;
+	struct fsal_readdir_ent *ents = gsh_calloc(max, sizeof(*ents));
+	fsal_status_t status = {0, 0};
+	enum fsal_dir_result result = DIR_CONTINUE;
+	uint32_t nents, i;
+	int batches = 0;
+
+	while (result == DIR_CONTINUE && !*eod) {
+		struct dir_chunk *chunk = state->dir_state;
+
+		nents = max - chunk->num_entries;
+		if (nents == 0)
+			break;
+
+		subcall_raw_timed(export, FSAL_CALL_READDIR, directory, status,
+			status = directory->sub_handle->obj_ops.readdir_plus(
+				directory->sub_handle, &whence, attrmask,
+				ents, &nents, eod)
+		       );
+
+		if (FSAL_IS_ERROR(status) || nents == 0)
+			break;
+
+		batches++;
+
+		for (i = 0; i < nents; i++) {
+			struct fsal_readdir_ent *ent = &ents[i];
+
+			if (result == DIR_CONTINUE) {
+				/* Consumes the reference on ent->obj */
+				result = mdc_readdir_chunk_object(
+					ent->name, ent->obj, &ent->attrs,
+					state, ent->cookie, NULL);
+				whence = ent->cookie;
+			} else {
+				/* Stopped part way through the batch */
+				subcall_raw(export,
+					ent->obj->obj_ops.release(ent->obj)
+				       );
+				*eod = false;
+			}
+
+			fsal_release_attrs(&ent->attrs);
+			gsh_free(ent->name);
+		}
+	}
+
+	gsh_free(ents);
+
+	LogFullDebug(COMPONENT_NFS_READDIR,
+		     "readdir_plus status=%s in %d batches",
+		     fsal_err_txt(status), batches);
+
+	return status;
+}
+
 /**
  * @brief Read the next chunk of a directory
  *
@@ -2295,22 +2957,40 @@ fsal_status_t mdcache_populate_dir_chunk(mdcache_entry_t *directory,
 	state.dir_state = chunk; /* Pass the chunk to the callback */
 
 	glist_init(&chunk->dirents);
+	PTHREAD_MUTEX_init(&chunk->enc_mutex, NULL);
 	chunk->parent = directory;
 	chunk->prev_chunk = prev_chunk;
+	mdcache_chunk_mem(chunk, sizeof(*chunk));
 
-	LogFullDebug(COMPONENT_NFS_READDIR, "Calling FSAL readdir");
+	readdir_status = fsalstat(ERR_FSAL_NOTSUPP, 0);
 
-	subcall(
-		readdir_status = directory->sub_handle->obj_ops.readdir(
-			directory->sub_handle, &whence, &state,
-			mdc_readdir_chunked_cb, attrmask, &eod)
-	       );
+	if (!state.export->no_readdir_plus) {
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "Calling FSAL readdir_plus");
+
+		readdir_status = mdc_populate_dir_chunk_plus(directory, whence,
+							     &state, attrmask,
+							     &eod);
+
+		if (readdir_status.major == ERR_FSAL_NOTSUPP)
+			state.export->no_readdir_plus = true;
+	}
+
+	if (readdir_status.major == ERR_FSAL_NOTSUPP) {
+		LogFullDebug(COMPONENT_NFS_READDIR, "Calling FSAL readdir");
+
+		subcall_timed(FSAL_CALL_READDIR, directory, readdir_status,
+			readdir_status = directory->sub_handle->obj_ops.readdir(
+				directory->sub_handle, &whence, &state,
+				mdc_readdir_chunked_cb, attrmask, &eod)
+		       );
+	}
 
 	if (FSAL_IS_ERROR(readdir_status)) {
 		LogDebug(COMPONENT_NFS_READDIR, "FSAL readdir status=%s",
 			 fsal_err_txt(readdir_status));
 		*dirent = NULL;
-		gsh_free(chunk);
+		mdc_discard_dirent_chunk(state.dir_state);
 		return readdir_status;
 	}
 
@@ -2318,7 +2998,7 @@ fsal_status_t mdcache_populate_dir_chunk(mdcache_entry_t *directory,
 		LogDebug(COMPONENT_NFS_READDIR, "status=%s",
 			 fsal_err_txt(status));
 		*dirent = NULL;
-		gsh_free(chunk);
+		mdc_discard_dirent_chunk(state.dir_state);
 		return status;
 	}
 
@@ -2335,7 +3015,7 @@ fsal_status_t mdcache_populate_dir_chunk(mdcache_entry_t *directory,
 		 */
 		LogFullDebug(COMPONENT_NFS_READDIR, "Empty chunk");
 
-		gsh_free(chunk);
+		mdc_discard_dirent_chunk(chunk);
 
 		if (chunk == first_chunk) {
 			/* We really got nothing on this readdir, so don't
@@ -2377,6 +3057,445 @@ fsal_status_t mdcache_populate_dir_chunk(mdcache_entry_t *directory,
 	return status;
 }
 
+/* Threads populating readahead chunks */
+#define MDC_READAHEAD_THREADS 4
+
+static struct fridgethr *mdc_readahead_fridge;
+
+struct mdc_readahead_job {
+	mdcache_entry_t *directory;
+	struct gsh_export *export;
+	/** Cookie of the last dirent of the chunk the client is reading */
+	fsal_cookie_t whence;
+};
+
+/**
+ * @brief Populate the chunks following a chunk being read
+ *
+ * Runs on the readahead fridge with root credentials, since the
+ * content of a directory does not depend on who reads it.  Up to
+ * Dir_Readahead chunks past the one the client is reading are made
+ * resident, skipping any already cached.  Stops early on end of
+ * directory, an error, or if the directory content is invalidated.
+ *
+ * @param[in] ctx Thread context, arg is the job
+ */
+
+static void mdc_readahead_run(struct fridgethr_context *ctx)
+{
+	struct mdc_readahead_job *job = ctx->arg;
+	mdcache_entry_t *directory = job->directory;
+	fsal_cookie_t whence = job->whence;
+	struct root_op_context root_op_context;
+	uint32_t n, populated = 0;
+
+	init_root_op_context(&root_op_context, job->export,
+			     job->export->fsal_export, 0, 0, UNKNOWN_REQUEST);
+
+	PTHREAD_RWLOCK_wrlock(&directory->content_lock);
+
+	for (n = 0; n < mdcache_param.dir.readahead; n++) {
+		mdcache_dir_entry_t *last, *dirent = NULL;
+		struct dir_chunk *chunk;
+		fsal_status_t status;
+
+		/* An invalidated directory is re-read from the start */
+		if (!(directory->mde_flags & MDCACHE_TRUST_CONTENT))
+			break;
+
+		/* The chunk may have been reclaimed since we were queued */
+		if (!mdcache_avl_lookup_ck(directory, whence, &last) ||
+		    last->chunk == NULL)
+			break;
+
+		chunk = last->chunk;
+		last = glist_last_entry(&chunk->dirents, mdcache_dir_entry_t,
+					chunk_list);
+		if (last->eod)
+			break;
+
+		if (chunk->next_ck == 0 ||
+		    !mdcache_avl_lookup_ck(directory, chunk->next_ck,
+					   &dirent)) {
+			status = mdcache_populate_dir_chunk(directory, last->ck,
+							    &dirent, chunk);
+			if (FSAL_IS_ERROR(status)) {
+				LogDebug(COMPONENT_NFS_READDIR,
+					 "Readahead of %p failed status=%s",
+					 directory, fsal_err_txt(status));
+				break;
+			}
+			if (dirent == NULL)
+				break;
+			populated++;
+		}
+
+		/* Carry on from the end of the next chunk */
+		last = glist_last_entry(&dirent->chunk->dirents,
+					mdcache_dir_entry_t, chunk_list);
+		whence = last->ck;
+	}
+
+	PTHREAD_RWLOCK_unlock(&directory->content_lock);
+
+	LogFullDebug(COMPONENT_NFS_READDIR,
+		     "Readahead of %p populated %"PRIu32" chunks",
+		     directory, populated);
+
+	atomic_clear_uint32_t_bits(&directory->mde_flags,
+				   MDCACHE_DIR_READAHEAD);
+	mdcache_put(directory);
+	release_root_op_context();
+	put_gsh_export(job->export);
+	gsh_free(job);
+}
+
+/**
+ * @brief Queue readahead past a chunk a client has started reading
+ *
+ * At most one readahead is queued per directory at a time.
+ *
+ * @note The content lock MUST be held
+ *
+ * @param[in] directory The directory
+ * @param[in] chunk     The chunk being read
+ */
+
+static void mdc_readdir_readahead(mdcache_entry_t *directory,
+				  struct dir_chunk *chunk)
+{
+	struct mdc_readahead_job *job;
+	mdcache_dir_entry_t *last;
+	int rc;
+
+	if (mdc_readahead_fridge == NULL || op_ctx->ctx_export == NULL)
+		return;
+
+	last = glist_last_entry(&chunk->dirents, mdcache_dir_entry_t,
+				chunk_list);
+	if (last == NULL || last->eod)
+		return;
+
+	if (atomic_postset_uint32_t_bits(&directory->mde_flags,
+					 MDCACHE_DIR_READAHEAD) &
+	    MDCACHE_DIR_READAHEAD)
+		return;
+
+	if (FSAL_IS_ERROR(mdcache_get(directory))) {
+		atomic_clear_uint32_t_bits(&directory->mde_flags,
+					   MDCACHE_DIR_READAHEAD);
+		return;
+	}
+
+	job = gsh_malloc(sizeof(*job));
+	job->directory = directory;
+	job->export = op_ctx->ctx_export;
+	job->whence = last->ck;
+	get_gsh_export_ref(job->export);
+
+	rc = fridgethr_submit(mdc_readahead_fridge, mdc_readahead_run, job);
+	if (rc != 0) {
+		LogDebug(COMPONENT_NFS_READDIR,
+			 "Could not queue readahead of %p: %d",
+			 directory, rc);
+		put_gsh_export(job->export);
+		gsh_free(job);
+		atomic_clear_uint32_t_bits(&directory->mde_flags,
+					   MDCACHE_DIR_READAHEAD);
+		mdcache_put(directory);
+	}
+}
+
+/**
+ * @brief Start the directory readahead threads, if configured
+ *
+ * @return 0 or an error from fridgethr_init.
+ */
+
+int mdcache_readahead_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (mdcache_param.dir.readahead == 0 ||
+	    mdcache_param.dir.avl_chunk == 0 ||
+	    mdc_readahead_fridge != NULL)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = MDC_READAHEAD_THREADS;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&mdc_readahead_fridge, "MDC_Readahead", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize readahead fridge, error code %d.",
+			 rc);
+		mdc_readahead_fridge = NULL;
+	}
+
+	return rc;
+}
+
+void mdcache_readahead_pkgshutdown(void)
+{
+	int rc;
+
+	if (mdc_readahead_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(mdc_readahead_fridge,
+				    fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Readahead shutdown timed out, cancelling threads.");
+		fridgethr_cancel(mdc_readahead_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down readahead threads: %d", rc);
+	}
+
+	fridgethr_destroy(mdc_readahead_fridge);
+	mdc_readahead_fridge = NULL;
+}
+
+static struct fridgethr *mdc_prefetch_fridge;
+
+/** One READDIR waiting for the attributes of its entries */
+struct mdc_prefetch_batch {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	/** Jobs not yet finished */
+	uint32_t pending;
+	/** Attributes the READDIR wants */
+	attrmask_t attrmask;
+	/** The caller's context, valid while it waits */
+	struct gsh_export *export;
+	struct user_cred *creds;
+	struct export_perms *export_perms;
+	uint32_t nfs_vers;
+	uint32_t nfs_minorvers;
+};
+
+struct mdc_prefetch_job {
+	struct mdc_prefetch_batch *batch;
+	/** Key of an entry not in the cache */
+	mdcache_key_t *key;
+	/** Or a ref'd entry whose attributes have expired */
+	mdcache_entry_t *entry;
+};
+
+/**
+ * @brief Bring one entry and its attributes into the cache
+ *
+ * Runs on the prefetch fridge on behalf of a READDIR, with the
+ * credentials of its caller.  Errors are ignored, the READDIR will
+ * run into them again and report them.
+ *
+ * @param[in] ctx Thread context, arg is the job
+ */
+
+static void mdc_prefetch_run(struct fridgethr_context *ctx)
+{
+	struct mdc_prefetch_job *job = ctx->arg;
+	struct mdc_prefetch_batch *batch = job->batch;
+	mdcache_entry_t *entry = job->entry;
+	struct root_op_context root_op_context;
+	fsal_status_t status = { 0, 0 };
+	struct attrlist attrs;
+
+	init_root_op_context(&root_op_context, batch->export,
+			     batch->export->fsal_export, batch->nfs_vers,
+			     batch->nfs_minorvers, NFS_REQUEST);
+	root_op_context.req_ctx.creds = batch->creds;
+	root_op_context.req_ctx.export_perms = batch->export_perms;
+
+	if (entry == NULL)
+		status = mdcache_locate_keyed(job->key, mdc_cur_export(),
+					      &entry, NULL);
+
+	if (!FSAL_IS_ERROR(status)) {
+		fsal_prepare_attrs(&attrs, batch->attrmask);
+		(void) entry->obj_handle.obj_ops.getattrs(&entry->obj_handle,
+							  &attrs);
+		fsal_release_attrs(&attrs);
+		mdcache_put(entry);
+	}
+
+	release_root_op_context();
+
+	PTHREAD_MUTEX_lock(&batch->mtx);
+	if (--batch->pending == 0)
+		pthread_cond_signal(&batch->cv);
+	PTHREAD_MUTEX_unlock(&batch->mtx);
+}
+
+/**
+ * @brief Fetch the attributes of a chunk's entries in parallel
+ *
+ * Every entry from first to the end of the chunk that is not cached,
+ * or whose attributes have expired, is handed to the prefetch fridge,
+ * and we wait for all of them.  The READDIR then finds them all in the
+ * cache, instead of making a round trip to the FSAL for each in turn.
+ *
+ * @note The content lock MUST be held
+ *
+ * @param[in] chunk    The chunk being read
+ * @param[in] first    First dirent to be returned
+ * @param[in] whence   Cookie the READDIR continues from
+ * @param[in] attrmask Attributes the READDIR wants
+ */
+
+static void mdc_readdir_prefetch(struct dir_chunk *chunk,
+				 mdcache_dir_entry_t *first,
+				 fsal_cookie_t whence,
+				 attrmask_t attrmask)
+{
+	struct mdc_prefetch_batch batch;
+	struct mdc_prefetch_job *jobs;
+	mdcache_dir_entry_t *dirent;
+	uint32_t n = 0, i;
+
+	if (mdc_prefetch_fridge == NULL || op_ctx->ctx_export == NULL ||
+	    chunk->num_entries <= 1)
+		return;
+
+	jobs = gsh_calloc(chunk->num_entries, sizeof(*jobs));
+
+	for (dirent = first;
+	     dirent != NULL && n < chunk->num_entries;
+	     dirent = glist_next_entry(&chunk->dirents, mdcache_dir_entry_t,
+				       chunk_list, &dirent->chunk_list)) {
+		mdcache_entry_t *entry = NULL;
+
+		if (dirent->ck == whence ||
+		    (dirent->flags & DIR_ENTRY_FLAG_DELETED) ||
+		    dirent->ckey.kv.addr == NULL)
+			continue;
+
+		if (!FSAL_IS_ERROR(mdcache_find_keyed(&dirent->ckey, &entry))) {
+			bool valid;
+
+			PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+			valid = mdcache_is_attrs_valid(entry, attrmask);
+			MDC_ATTR_UNLOCK(entry);
+
+			if (valid) {
+				mdcache_put(entry);
+				continue;
+			}
+		}
+
+		jobs[n].batch = &batch;
+		jobs[n].key = &dirent->ckey;
+		jobs[n].entry = entry;
+		n++;
+	}
+
+	if (n <= 1) {
+		/* Nothing to gain over fetching it inline */
+		if (n == 1 && jobs[0].entry != NULL)
+			mdcache_put(jobs[0].entry);
+		gsh_free(jobs);
+		return;
+	}
+
+	PTHREAD_MUTEX_init(&batch.mtx, NULL);
+	PTHREAD_COND_init(&batch.cv, NULL);
+	batch.pending = n;
+	batch.attrmask = attrmask;
+	batch.export = op_ctx->ctx_export;
+	batch.creds = op_ctx->creds;
+	batch.export_perms = op_ctx->export_perms;
+	batch.nfs_vers = op_ctx->nfs_vers;
+	batch.nfs_minorvers = op_ctx->nfs_minorvers;
+
+	for (i = 0; i < n; i++) {
+		if (fridgethr_submit(mdc_prefetch_fridge, mdc_prefetch_run,
+				     &jobs[i]) == 0)
+			continue;
+
+		/* Leave it to the READDIR */
+		if (jobs[i].entry != NULL)
+			mdcache_put(jobs[i].entry);
+
+		PTHREAD_MUTEX_lock(&batch.mtx);
+		batch.pending--;
+		PTHREAD_MUTEX_unlock(&batch.mtx);
+	}
+
+	PTHREAD_MUTEX_lock(&batch.mtx);
+	while (batch.pending != 0)
+		pthread_cond_wait(&batch.cv, &batch.mtx);
+	PTHREAD_MUTEX_unlock(&batch.mtx);
+
+	LogFullDebug(COMPONENT_NFS_READDIR,
+		     "Prefetched attributes of %"PRIu32" entries", n);
+
+	PTHREAD_COND_destroy(&batch.cv);
+	PTHREAD_MUTEX_destroy(&batch.mtx);
+	gsh_free(jobs);
+}
+
+/**
+ * @brief Start the READDIR attribute prefetch threads, if configured
+ *
+ * @return 0 or an error from fridgethr_init.
+ */
+
+int mdcache_prefetch_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (mdcache_param.dir.attr_prefetch == 0 ||
+	    mdcache_param.dir.avl_chunk == 0 ||
+	    mdc_prefetch_fridge != NULL)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = mdcache_param.dir.attr_prefetch;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&mdc_prefetch_fridge, "MDC_Prefetch", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize prefetch fridge, error code %d.",
+			 rc);
+		mdc_prefetch_fridge = NULL;
+	}
+
+	return rc;
+}
+
+void mdcache_prefetch_pkgshutdown(void)
+{
+	int rc;
+
+	if (mdc_prefetch_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(mdc_prefetch_fridge,
+				    fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Prefetch shutdown timed out, cancelling threads.");
+		fridgethr_cancel(mdc_prefetch_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down prefetch threads: %d", rc);
+	}
+
+	fridgethr_destroy(mdc_prefetch_fridge);
+	mdc_prefetch_fridge = NULL;
+}
+
 /**
  * @brief Read the contents of a directory
  *
@@ -2513,6 +3632,22 @@ again:
 	/* dirent WILL be non-NULL, emember the chunk we are in. */
 	chunk = dirent->chunk;
 
+	if (whence != 0 && chunk->next_ck == 0 &&
+	    mdcache_param.dir.readahead != 0) {
+		/* The client is continuing a directory read and the chunk
+		 * after this one is not resident, start fetching it so it is
+		 * ready by the time the client gets there.
+		 */
+		mdc_readdir_readahead(directory, chunk);
+	}
+
+	if (attrmask != 0 && mdcache_param.dir.attr_prefetch != 0) {
+		/* Fill the cache for this chunk in parallel rather than
+		 * one entry at a time below.
+		 */
+		mdc_readdir_prefetch(chunk, dirent, whence, attrmask);
+	}
+
 	LogFullDebug(COMPONENT_NFS_READDIR,
 		     "About to read directory=%p cookie=%" PRIx64,
 		     directory, next_ck);
@@ -2530,6 +3665,7 @@ again:
 		enum fsal_dir_result cb_result;
 		mdcache_entry_t *entry = NULL;
 		struct attrlist attrs;
+		struct fsal_dirent_enc enc;
 
 		if (dirent->ck == whence) {
 			/* When called with whence, the caller always wants the
@@ -2589,9 +3725,16 @@ again:
 			return status;
 		}
 
+		/* Let the caller keep its encoding of the entry with it */
+		enc.mutex = &chunk->enc_mutex;
+		enc.blob = &dirent->encoded;
+		op_ctx->dirent_enc = &enc;
+
 		cb_result = cb(dirent->name, &entry->obj_handle, &entry->attrs,
 			       dir_state, next_ck, NULL);
 
+		op_ctx->dirent_enc = NULL;
+
 		fsal_release_attrs(&attrs);
 
 		if (cb_result >= DIR_TERMINATE || dirent->eod) {
@@ -40,9 +40,21 @@
 #include "fsal_up.h"
 #include "fsal_convert.h"
 #include "display.h"
+#include "export_mgr.h"
 
 typedef struct mdcache_fsal_obj_handle mdcache_entry_t;
 
+/**
+ * @brief A quota answer of the sub-FSAL, see mdcache_export.c
+ */
+struct mdc_quota_slot {
+	uint64_t hash;		/*< Key hash, 0 if empty */
+	time_t expire;		/*< When the answer stops being trusted */
+	int quota_type;		/*< Of the get_quota, -1 for check_quota */
+	int quota_id;
+	fsal_quota_t quota;
+};
+
 /*
  * MDCACHE internal export
  */
@@ -57,6 +69,29 @@ struct mdcache_fsal_export {
 	struct glist_head entry_list;
 	/** Lock protecting entry_list */
 	pthread_rwlock_t mdc_exp_lock;
+	/** Sub-FSAL returned ERR_FSAL_NOTSUPP for readdir_plus */
+	bool no_readdir_plus;
+	/** The export this is the cache of, for its cache budgets */
+	struct gsh_export *owner;
+	/** Link in the exports the LRU thread enforces budgets of */
+	struct glist_head lru_exports;
+	/** Entries on entry_list */
+	int64_t entries;
+	/** Bytes of readdir chunks of the directories on entry_list, as
+	    last measured by the LRU thread */
+	uint64_t dirent_mem;
+	/** Lookups through this export that found, and that added, an
+	    entry */
+	uint64_t hits;
+	uint64_t misses;
+	/** Recent quota answers, allocated on first use */
+	struct mdc_quota_slot *quota_cache;
+	/** Lock protecting quota_cache */
+	pthread_mutex_t quota_lock;
+	/** Quota checks and lookups answered from, and added to,
+	    quota_cache */
+	uint64_t quota_hits;
+	uint64_t quota_misses;
 };
 
 /**
@@ -110,11 +145,13 @@ enum lru_q_id {
 	LRU_ENTRY_NONE = 0, /* entry not queued */
 	LRU_ENTRY_L1,
 	LRU_ENTRY_L2,
-	LRU_ENTRY_CLEANUP
+	LRU_ENTRY_CLEANUP,
+	LRU_ENTRY_PROBATION	/* 2Q policy: first time entries */
 };
 
 #define LRU_CLEANUP 0x00000001 /* Entry is on cleanup queue */
 #define LRU_CLEANED 0x00000002 /* Entry has been cleaned */
+#define LRU_REFERENCED 0x00000004 /* Initial ref since last queue move */
 
 typedef struct mdcache_lru__ {
 	struct glist_head q;	/*< Link in the physical deque
@@ -128,7 +165,6 @@ typedef struct mdcache_lru__ {
 				 *< resides, so we can lock the deque and
 				 *< decrement the correct counter when moving
 				 *< or deleting the entry. */
-	uint32_t cf;		/*< Confounder */
 } mdcache_lru_t;
 
 /**
@@ -141,6 +177,12 @@ struct mdcache_stats {
 	uint64_t inode_conf;
 	uint64_t inode_added;
 	uint64_t inode_mapping;
+	uint64_t lru_ghost_add;	/*< 2Q: reclaimed from probation */
+	uint64_t lru_ghost_hit;	/*< 2Q: re-created soon after reclaim */
+	uint64_t readlink_hit;	/*< READLINK answered from the cache */
+	uint64_t readlink_miss;	/*< READLINK sent to the sub-FSAL */
+	uint64_t xattr_hit;	/*< xattr reads answered from the cache */
+	uint64_t xattr_miss;	/*< cacheable xattr reads sent on */
 };
 
 extern struct mdcache_stats *cache_stp;
@@ -177,7 +219,114 @@ struct entry_export_map {
 static const uint32_t MDCACHE_UNREACHABLE = 0x100;
 /** The directory is too big; skip the dirent cache */
 static const uint32_t MDCACHE_BYPASS_DIRCACHE = 0x200;
+/** A background readahead of this directory's chunks is queued */
+static const uint32_t MDCACHE_DIR_READAHEAD = 0x400;
+/** A background refresh of the attributes is queued */
+static const uint32_t MDCACHE_ATTR_REFRESH = 0x800;
+/** A background read of this whole file is queued */
+static const uint32_t MDCACHE_PREREAD = 0x1000;
+
+
+/**
+ * @brief A slot in a directory's negative lookup cache
+ */
+struct mdcache_neg_slot {
+	uint64_t hash;		/*< Name hash, 0 if empty */
+	time_t expire;		/*< When the entry stops being trusted */
+};
+
+/**
+ * @brief An unstable write queued behind a gathering leader
+ *
+ * Lives on the stack of the writing thread.  See mdcache_write2().
+ */
+struct mdc_wg_write {
+	struct glist_head list;		/*< Link in mdc_wgather.pending */
+	uint64_t offset;		/*< Offset of the write */
+	struct iovec iov;		/*< Data of the write */
+	size_t written;			/*< Bytes of this write that landed */
+	bool stable;			/*< Batch went to stable storage */
+	bool done;			/*< Leader has written this */
+	bool lead;			/*< Promoted to write the next batch */
+	fsal_status_t status;		/*< Status of the batch */
+};
+
+/** Most writes gathered into one batch */
+#define MDC_WGATHER_MAX_IOV 64
+
+/** Most ACCESS results an entry remembers, see Access_Cache_Slots */
+#define MDC_ACCESS_SLOTS 8
+
+/**
+ * @brief An ACCESS result remembered for a credential
+ *
+ * Valid while gen matches the entry's access_gen, which every load of
+ * the attributes bumps.
+ */
+struct mdc_access_slot {
+	uid_t uid;
+	gid_t gid;
+	/** Hash of the group list, and its length */
+	uint64_t groups_hash;
+	unsigned int glen;
+	uint32_t gen;
+	fsal_accessflags_t access_type;
+	fsal_accessflags_t allowed;
+	fsal_accessflags_t denied;
+	fsal_errors_t major;
+};
 
+/**
+ * @brief Write gathering and COMMIT coalescing for a regular file
+ *
+ * While one thread (the leader) has a write in flight to the sub-FSAL,
+ * unstable writes that continue the file where the queued ones end are
+ * queued and then written as a single writev2.  COMMITs arriving while
+ * a flush is in flight wait and share the next one.
+ */
+struct mdc_wgather {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	/** Writes waiting for the next batch, in offset order */
+	struct glist_head pending;
+	/** Bytes on the pending list */
+	size_t pending_len;
+	/** Number of writes on the pending list */
+	uint32_t pending_cnt;
+	/** Offset the next write must start at to join */
+	uint64_t next_off;
+	/** State, bypass, export and credentials every write of the
+	    batch shares */
+	struct state_t *state;
+	bool bypass;
+	struct fsal_export *export;
+	uid_t uid;
+	gid_t gid;
+	/** A leader is writing */
+	bool writing;
+	/** A flush is in flight */
+	bool committing;
+	/** Flushes started and finished */
+	uint64_t flush_started;
+	uint64_t flush_done;
+	/** Status of the last finished flush */
+	fsal_status_t flush_status;
+};
+
+/**
+ * @brief A small file read whole after an OPEN
+ *
+ * Served to READs until it expires or the change attribute moves on.
+ * See mdc_preread_start().
+ */
+struct mdc_preread {
+	void *buf;		/*< gsh_iobuf holding the file from offset 0 */
+	size_t len;		/*< Bytes in buf */
+	bool eof;		/*< buf holds the file up to its end */
+	uint64_t change;	/*< Change attribute the file was read at */
+	time_t expire;		/*< When it stops being served */
+	size_t charge;		/*< Bytes counted against the preread limit */
+};
 
 /**
  * @brief Represents a cached inode
@@ -188,6 +337,9 @@ static const uint32_t MDCACHE_BYPASS_DIRCACHE = 0x200;
  *
  * Regarding the locking discipline:
  * (1) attr_lock protects the attrs field, the export_list, and attr_time
+ *     It is taken for write with MDC_ATTR_WRLOCK, and released with
+ *     MDC_ATTR_UNLOCK, so attr_seq lets GETATTR read the attrs without
+ *     it.  See mdc_getattrs_seq().
  *
  * (2) content_lock must be held for WRITE when modifying the AVL tree
  *     of a directory or any dirent contained therein.  It must be
@@ -244,6 +396,22 @@ struct mdcache_fsal_obj_handle {
 	time_t attr_time;
 	/** Time at which we last refreshed acl. */
 	time_t acl_time;
+	/** Successful refreshes of the attributes, and whether the last
+	    one fetched the ACL, protected by attr_lock.  See
+	    mdcache_getattrs(). */
+	uint32_t attr_refreshes;
+	bool attr_refresh_acl;
+	/** GETATTRs served from the cached attributes since they were
+	    fetched, updated atomically under the read lock. */
+	uint32_t attr_hits;
+	/** Odd while attr_lock is held for write, bumped by
+	    MDC_ATTR_WRLOCK and MDC_ATTR_UNLOCK. */
+	uint32_t attr_seq;
+	/** ACCESS results, their generation and the slot to replace
+	    next, protected by attr_lock.  See mdcache_test_access(). */
+	struct mdc_access_slot access_slots[MDC_ACCESS_SLOTS];
+	uint32_t access_gen;
+	uint32_t access_next;
 	/** New style LRU link */
 	mdcache_lru_t lru;
 	/** Exports per entry (protected by attr_lock) */
@@ -253,6 +421,27 @@ struct mdcache_fsal_obj_handle {
 	/** Lock on type-specific cached content.  See locking
 	    discipline for details. */
 	pthread_rwlock_t content_lock;
+	/** Write gathering and COMMIT coalescing, allocated on first
+	    use when enabled.  See mdc_wgather_get(). */
+	struct mdc_wgather *wgather;
+	/** Content of a small file read whole after an OPEN, and a
+	    count of its drops.  Protected by attr_lock, see
+	    mdc_preread_get(). */
+	struct mdc_preread *preread;
+	uint32_t preread_gen;
+	/** Cached extended attributes, allocated on first use when
+	    enabled, and a count of their invalidations.  Protected by
+	    attr_lock, see mdc_xattr_lookup(). */
+	struct mdc_xattrs *xattrs;
+	uint32_t xattr_gen;
+	/** Link in the fd pool, and when the global fd was last used.
+	    Protected by the fd pool lock, see mdcache_lru_fd_used(). */
+	struct glist_head fd_lru;
+	time_t fd_used;
+	bool fd_pooled;
+	/** Bytes held by the entry, its key, ACL and dirent chunks.  See
+	    mdcache_lru_mem(). */
+	int64_t mem;
 	/** Filetype specific data, discriminated by the type field.
 	    Note that data for special files is in
 	    attributes.rawdev */
@@ -284,9 +473,25 @@ struct mdcache_fsal_obj_handle {
 			 *  0 if not known.
 			 */
 			fsal_cookie_t first_ck;
+			/** Names recently found missing, NULL until the first
+			 *  miss.  See mdcache_neg_add().
+			 */
+			struct mdcache_neg_slot *neg;
+			/** Bytes of the chunks and their arenas */
+			uint64_t chunk_mem;
+			/** Bumped when the dirents are invalidated, see
+			 *  mdcache_name_gen().
+			 */
+			uint32_t dirent_gen;
 			struct {
 				/** Children by name hash */
 				struct avltree t;
+				/** Hash table of t, NULL until t reaches
+				 *  Dir_Index_Min, see mdcache_index_add().
+				 */
+				struct mdcache_dir_entry__ **idx;
+				/** Buckets of idx, a power of two */
+				uint32_t idx_size;
 				/** Persist cookies for deleted entries */
 				struct avltree c;
 				/** Table of dirents by FSAL cookie */
@@ -297,9 +502,40 @@ struct mdcache_fsal_obj_handle {
 				uint32_t collisions;
 			} avl;
 		} fsdir;		/**< DIRECTORY data */
+		struct {
+			/** Storage for state, overlays hdl */
+			struct state_hdl lhdl;
+			/** Link target, NULL until first read.  Valid
+			 *  while MDCACHE_TRUST_CONTENT is set.
+			 */
+			struct gsh_buffdesc target;
+		} fslink;		/**< SYMBOLIC_LINK data */
 	} fsobj;
 };
 
+/**
+ * @brief Take an entry's attr_lock for write
+ *
+ * attr_seq goes odd for as long as the attributes may change.
+ */
+#define MDC_ATTR_WRLOCK(entry) \
+	do { \
+		PTHREAD_RWLOCK_wrlock(&(entry)->attr_lock); \
+		(void) atomic_inc_uint32_t(&(entry)->attr_seq); \
+	} while (0)
+
+/**
+ * @brief Release an entry's attr_lock, held for read or write
+ *
+ * Only a writer can have made attr_seq odd, it makes it even again.
+ */
+#define MDC_ATTR_UNLOCK(entry) \
+	do { \
+		if ((entry)->attr_seq & 1) \
+			(void) atomic_inc_uint32_t(&(entry)->attr_seq); \
+		PTHREAD_RWLOCK_unlock(&(entry)->attr_lock); \
+	} while (0)
+
 struct dir_chunk {
 	/** This chunk is part of a directory */
 	struct glist_head chunks;
@@ -321,6 +557,16 @@ struct dir_chunk {
 	fsal_cookie_t next_ck;
 	/** Number of entries in chunk */
 	int num_entries;
+	/** Dirents added by readdir are carved out of this one block, which
+	 *  is freed with the chunk.  See mdcache_chunk_alloc_dirent().
+	 */
+	char *arena;
+	/** Size of the arena */
+	size_t arena_size;
+	/** Bytes of the arena handed out */
+	size_t arena_used;
+	/** Protects the encoded blobs of the chunk's dirents */
+	pthread_mutex_t enc_mutex;
 };
 
 /**
@@ -334,6 +580,8 @@ struct dir_chunk {
 #define DIR_ENTRY_FLAG_DELETED  0x0001
 #define DIR_ENTRY_COOKIE_MARKED 0x0002
 #define DIR_ENTRY_SORTED        0x0004
+#define DIR_ENTRY_ARENA         0x0008	/*< dirent is in its chunk's arena */
+#define DIR_ENTRY_ARENA_KEY     0x0010	/*< ckey bytes are in the arena */
 
 typedef struct mdcache_dir_entry__ {
 	/** This dirent is part of a chunk */
@@ -342,6 +590,8 @@ typedef struct mdcache_dir_entry__ {
 	struct dir_chunk *chunk;
 	/** node in tree by name */
 	struct avltree_node node_hk;
+	/** Next in the directory's name index bucket */
+	struct mdcache_dir_entry__ *idx_next;
 	/** AVL node in tree by cookie */
 	struct avltree_node node_ck;
 	/** AVL node in tree by sorted order */
@@ -364,6 +614,8 @@ typedef struct mdcache_dir_entry__ {
 	mdcache_key_t ckey;
 	/** Flags */
 	uint32_t flags;
+	/** The protocol's encoding of this entry, see fsal_dirent_enc */
+	void *encoded;
 	/** The NUL-terminated filename */
 	char name[];
 } mdcache_dir_entry_t;
@@ -380,6 +632,7 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		mdcache_entry_t *parent,
 		const char *name,
 		bool *invalidate,
+		bool parent_locked,
 		struct state_t *state);
 
 fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
@@ -390,11 +643,11 @@ void mdcache_refresh_attrs_no_invalidate(mdcache_entry_t *entry)
 {
 	fsal_status_t status;
 
-	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	MDC_ATTR_WRLOCK(entry);
 
 	status = mdcache_refresh_attrs(entry, false, false);
 
-	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	MDC_ATTR_UNLOCK(entry);
 
 	if (FSAL_IS_ERROR(status)) {
 		LogDebug(COMPONENT_CACHE_INODE, "Refresh attributes failed %s",
@@ -432,11 +685,17 @@ fsal_status_t mdcache_dirent_add(mdcache_entry_t *parent,
 				 const char *name,
 				 mdcache_entry_t *entry,
 				 bool *invalidate);
+mdcache_dir_entry_t *mdcache_dirent_alloc(const char *name,
+					  mdcache_entry_t *entry);
+fsal_status_t mdcache_dirent_insert(mdcache_entry_t *parent,
+				    mdcache_dir_entry_t *dirent,
+				    bool *invalidate);
 fsal_status_t mdcache_dirent_rename(mdcache_entry_t *parent,
 				    const char *oldname,
 				    const char *newname);
 
 void mdcache_dirent_invalidate_all(mdcache_entry_t *entry);
+void mdcache_readlink_clean(mdcache_entry_t *entry);
 
 fsal_status_t mdcache_dirent_populate(mdcache_entry_t *dir);
 fsal_status_t mdcache_readdir_uncached(mdcache_entry_t *directory, fsal_cookie_t
@@ -451,6 +710,16 @@ fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
 				      fsal_readdir_cb cb,
 				      attrmask_t attrmask,
 				      bool *eod_met);
+int mdcache_readahead_pkginit(void);
+void mdcache_readahead_pkgshutdown(void);
+int mdcache_preread_pkginit(void);
+void mdcache_preread_pkgshutdown(void);
+int mdcache_dirgc_pkginit(void);
+void mdcache_dirgc_pkgshutdown(void);
+int mdcache_refresh_pkginit(void);
+void mdcache_refresh_pkgshutdown(void);
+int mdcache_prefetch_pkginit(void);
+void mdcache_prefetch_pkgshutdown(void);
 
 void mdc_get_parent(struct mdcache_fsal_export *export,
 		    mdcache_entry_t *entry);
@@ -473,6 +742,11 @@ static inline struct mdcache_fsal_export *mdc_cur_export(void)
 }
 
 void mdc_clean_entry(mdcache_entry_t *entry);
+void mdc_wgather_free(mdcache_entry_t *entry);
+void mdc_preread_drop_locked(mdcache_entry_t *entry);
+void mdc_preread_drop(mdcache_entry_t *entry);
+void mdc_xattr_invalidate(mdcache_entry_t *entry);
+void mdc_xattr_free(mdcache_entry_t *entry);
 void _mdcache_kill_entry(mdcache_entry_t *entry,
 			 char *file, int line, char *function);
 
@@ -511,6 +785,25 @@ extern struct config_block mdcache_param_blk;
 	subcall_raw(__export, call); \
 } while (0)
 
+nsecs_elapsed_t mdc_call_enter(enum fsal_call fop, mdcache_entry_t *entry);
+void mdc_call_exit(enum fsal_call fop, mdcache_entry_t *entry,
+		   nsecs_elapsed_t start, fsal_errors_t major);
+
+/* Call a sub-FSAL object operation, tracing it and, with
+ * FSAL_Latency_Histograms, timing it.  status is what the call sets.
+ */
+#define subcall_raw_timed(myexp, fop, entry, status, call) do { \
+	nsecs_elapsed_t __start = mdc_call_enter(fop, entry); \
+	subcall_raw(myexp, call); \
+	mdc_call_exit(fop, entry, __start, (status).major); \
+} while (0)
+
+#define subcall_timed(fop, entry, status, call) do { \
+	nsecs_elapsed_t __start = mdc_call_enter(fop, entry); \
+	subcall(call); \
+	mdc_call_exit(fop, entry, __start, (status).major); \
+} while (0)
+
 /* During a callback from a sub-FSAL, call using MDCACHE's export */
 #define supercall_raw(myexp, call) do { \
 	LogFullDebug(COMPONENT_CACHE_INODE, "supercall %s", myexp->name); \
@@ -554,6 +847,8 @@ mdcache_key_dup(mdcache_key_t *tgt,
 	tgt->fsal = src->fsal;
 }
 
+extern const char mdcachename[];
+
 /**
  * @brief Set the parent key of an entry
  *
@@ -595,6 +890,25 @@ mdcache_key_delete(mdcache_key_t *key)
 	key->kv.addr = NULL;
 }
 
+/**
+ * @brief Delete a dirent's copy of its entry's key.
+ *
+ * A key stored in a chunk arena is just dropped; the arena owns it.
+ *
+ * @param dirent [in] The dirent
+ */
+static inline void
+mdcache_dirent_key_delete(mdcache_dir_entry_t *dirent)
+{
+	if (dirent->flags & DIR_ENTRY_ARENA_KEY) {
+		dirent->ckey.kv.len = 0;
+		dirent->ckey.kv.addr = NULL;
+		dirent->flags &= ~DIR_ENTRY_ARENA_KEY;
+	} else {
+		mdcache_key_delete(&dirent->ckey);
+	}
+}
+
 /**
  * @brief Update entry metadata from its attributes
  *
@@ -629,6 +943,11 @@ mdc_fixup_md(mdcache_entry_t *entry, struct attrlist *attrs)
 	if (attrs->request_mask & ~ATTR_ACL)
 		flags |= MDCACHE_TRUST_ATTRS;
 
+	/* Whatever ACCESS results were remembered came from the old
+	 * attributes.
+	 */
+	entry->access_gen++;
+
 	if (attrs->valid_mask == ATTR_RDATTR_ERR) {
 		/* The attribute fetch failed, mark the attributes and ACL as
 		 * untrusted.
@@ -686,7 +1005,9 @@ mdcache_is_attrs_valid(const mdcache_entry_t *entry, attrmask_t mask)
 		return false;
 
 	if (entry->obj_handle.type == DIRECTORY
-	    && mdcache_param.getattr_dir_invalidation)
+	    && mdcache_param.getattr_dir_invalidation
+	    && !(op_ctx->ctx_export != NULL &&
+		 op_ctx_export_has_option(EXPORT_OPTION_IMMUTABLE)))
 		return false;
 
 	if ((mask & ~ATTR_ACL) != 0 && entry->attrs.expire_time_attr == 0)
@@ -724,6 +1045,7 @@ mdcache_is_attrs_valid(const mdcache_entry_t *entry, attrmask_t mask)
 static inline void
 mdc_remove_export_map(struct entry_export_map *expmap)
 {
+	(void) atomic_dec_int64_t(&expmap->export->entries);
 	glist_del(&expmap->export_per_entry);
 	glist_del(&expmap->entry_per_export);
 	gsh_free(expmap);
@@ -825,6 +1147,11 @@ fsal_status_t mdcache_create_handle(struct fsal_export *exp_hdl,
 				   struct fsal_obj_handle **handle,
 				   struct attrlist *attrs_out);
 
+fsal_status_t mdcache_create_handle_hint(struct fsal_export *exp_hdl,
+					 struct gsh_buffdesc *hdl_desc,
+					 uint64_t hint,
+					 struct fsal_obj_handle **handle);
+
 int mdcache_fsal_open(struct mdcache_fsal_obj_handle *, int, fsal_errors_t *);
 int mdcache_fsal_readlink(struct mdcache_fsal_obj_handle *, fsal_errors_t *);
 
@@ -909,6 +1236,58 @@ fsal_status_t mdcache_write2(struct fsal_obj_handle *obj_hdl,
 			     size_t *write_amount,
 			     bool *fsal_stable,
 			     struct io_info *info);
+fsal_status_t mdcache_read_ref2(struct fsal_obj_handle *obj_hdl,
+				bool bypass,
+				struct state_t *state,
+				uint64_t offset,
+				size_t buf_size,
+				void **buffer,
+				size_t *read_amount,
+				bool *eof,
+				struct io_info *info);
+fsal_status_t mdcache_readv2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     const struct iovec *iov,
+			     int iovcnt,
+			     size_t *read_amount,
+			     bool *eof,
+			     struct io_info *info);
+fsal_status_t mdcache_writev2(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct state_t *state,
+			      uint64_t offset,
+			      const struct iovec *iov,
+			      int iovcnt,
+			      size_t *write_amount,
+			      bool *fsal_stable,
+			      struct io_info *info);
+fsal_status_t mdcache_copy(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count,
+			   uint64_t *copied);
+fsal_status_t mdcache_clone(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count);
+void mdcache_read2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 fsal_async_cb done_cb,
+			 struct fsal_io_arg *read_arg,
+			 void *caller_arg);
+void mdcache_write2_async(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  fsal_async_cb done_cb,
+			  struct fsal_io_arg *write_arg,
+			  void *caller_arg);
 fsal_status_t mdcache_seek2(struct fsal_obj_handle *obj_hdl,
 			    struct state_t *state,
 			    struct io_info *info);
@@ -917,6 +1296,9 @@ fsal_status_t mdcache_io_advise2(struct fsal_obj_handle *obj_hdl,
 				 struct io_hints *hints);
 fsal_status_t mdcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 			      size_t len);
+void mdcache_commit2_async(struct fsal_obj_handle *obj_hdl, off_t offset,
+			   size_t len, fsal_async_cb done_cb,
+			   void *caller_arg);
 fsal_status_t mdcache_lock_op2(struct fsal_obj_handle *obj_hdl,
 			      struct state_t *state,
 			      void *p_owner,
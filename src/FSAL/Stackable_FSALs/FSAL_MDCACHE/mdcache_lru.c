@@ -56,6 +56,9 @@
 #include "gsh_intrinsic.h"
 #include "sal_functions.h"
 #include "nfs_exports.h"
+#include "export_mgr.h"
+#include "gsh_oahash.h"
+#include "mem_pressure.h"
 #ifdef USE_LTTNG
 #include "gsh_lttng/mdcache.h"
 #endif
@@ -108,6 +111,7 @@ struct lru_q_lane {
 	struct lru_q L1;
 	struct lru_q L2;
 	struct lru_q cleanup;	/* deferred cleanup */
+	struct lru_q probation;	/* 2Q: seen once (A1in) */
 	pthread_mutex_t mtx;
 	/* LRU thread scan position */
 	struct {
@@ -148,6 +152,73 @@ struct lru_q_lane {
 
 static struct lru_q_lane LRU[LRU_N_Q_LANES];
 
+/**
+ * With the 2Q policy [Johnson and Shasha 1994], new entries go on the
+ * probation queue (A1in) rather than L1, and stay there however often
+ * they are referenced.  Probation is reclaimed first once it holds
+ * more than its share of the cache, so a scan only ever displaces
+ * other probation entries.  The hashes of entries reclaimed from
+ * probation are remembered on a ghost list (A1out); an entry
+ * re-created while its hash is still there is admitted straight to L1
+ * (Am), which L1/L2 then manage as before.
+ *
+ * The ghost list is a FIFO ring of hashes with an index over it.  It
+ * is only touched when an entry is created or reclaimed.
+ */
+static struct {
+	pthread_mutex_t mtx;
+	uint64_t *ring;
+	uint32_t size;
+	uint32_t next;
+	struct oahash set;
+} lru_ghost = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * The fd pool is an LRU of the regular files whose global fd is open,
+ * for FSALs supporting the extended API.  Stateless I/O (NFSv3, and
+ * NFSv4 with the anonymous stateids) goes through the global fd, which
+ * the FSAL reopens with the union of the modes asked for, so all such
+ * requests on a file share one fd.  A file is put at the head of the
+ * pool when its global fd is used, and the reaper closes fds from the
+ * tail, so the coldest fd is found without scanning the entry LRU.
+ *
+ * The fds in the pool are counted in open_fd_count, which is otherwise
+ * only kept up to date by FSALs without the extended API.
+ */
+static struct {
+	pthread_mutex_t mtx;
+	struct glist_head lru;	/*< most recently used first */
+	uint64_t size;
+} lru_fd_pool = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.lru = GLIST_HEAD_INIT(lru_fd_pool.lru),
+};
+
+/**
+ * An export may be given a budget of entries and of readdir chunk
+ * memory (Cache_Entries_Max and Cache_Dirent_Mem_Max), so that a scan
+ * of one export can't push the working set of the others out of the
+ * cache.  Entries of an export are those on its entry_list, oldest
+ * mapping first, and are counted in its entries field.
+ *
+ * A new entry for an export at its entry budget recycles the export's
+ * oldest idle entry rather than one from the global LRU.  The LRU thread
+ * frees what is still over budget, and drops the dirents of the
+ * export's oldest idle directories while over the memory budget.
+ */
+static struct {
+	pthread_mutex_t mtx;
+	struct glist_head list;
+} lru_exports = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.list = GLIST_HEAD_INIT(lru_exports.list),
+};
+
+/* Directories whose dirents are dropped at once */
+#define LRU_EXPORT_DIR_BATCH 32
+
 /**
  * The refcount mechanism distinguishes 3 key object states:
  *
@@ -173,6 +244,15 @@ static struct lru_q_lane LRU[LRU_N_Q_LANES];
 
 static struct fridgethr *lru_fridge;
 
+/**
+ * With Lockless_Lookup, a lookup may still be reading an entry that
+ * has just been released, so released entries are kept here and
+ * reused rather than handed back to the pool.  The list is linked
+ * through lru.q, which is unused once the entry is dead.
+ */
+static struct glist_head lru_entry_free = GLIST_HEAD_INIT(lru_entry_free);
+static pthread_mutex_t lru_entry_free_mtx = PTHREAD_MUTEX_INITIALIZER;
+
 enum lru_edge {
 	LRU_LRU,	/* LRU */
 	LRU_MRU		/* MRU */
@@ -189,7 +269,11 @@ static const uint32_t FD_FALLBACK_LIMIT = 0x400;
  * qlane its lane. */
 #define LRU_DQ_SAFE(lru, q) \
 	do { \
-		if ((lru)->qid == LRU_ENTRY_L1) { \
+		if ((lru)->qid == LRU_ENTRY_PROBATION) \
+			(void) atomic_dec_uint64_t( \
+				&lru_state.probation_used); \
+		if ((lru)->qid == LRU_ENTRY_L1 || \
+		    (lru)->qid == LRU_ENTRY_PROBATION) { \
 			struct lru_q_lane *qlane = &LRU[(lru)->lane]; \
 			if (unlikely((qlane->iter.active) && \
 				     ((&(lru)->q) == qlane->iter.glistn))) { \
@@ -202,7 +286,8 @@ static const uint32_t FD_FALLBACK_LIMIT = 0x400;
 
 #define LRU_ENTRY_L1_OR_L2(e) \
 	(((e)->lru.qid == LRU_ENTRY_L2) || \
-	 ((e)->lru.qid == LRU_ENTRY_L1))
+	 ((e)->lru.qid == LRU_ENTRY_L1) || \
+	 ((e)->lru.qid == LRU_ENTRY_PROBATION))
 
 #define LRU_ENTRY_RECLAIMABLE(e, n) \
 	(LRU_ENTRY_L1_OR_L2(e) && \
@@ -241,6 +326,7 @@ lru_init_queues(void)
 		lru_init_queue(&LRU[ix].L1, LRU_ENTRY_L1);
 		lru_init_queue(&LRU[ix].L2, LRU_ENTRY_L2);
 		lru_init_queue(&LRU[ix].cleanup, LRU_ENTRY_CLEANUP);
+		lru_init_queue(&LRU[ix].probation, LRU_ENTRY_PROBATION);
 	}
 }
 
@@ -271,6 +357,9 @@ lru_queue_of(mdcache_entry_t *entry)
 	case LRU_ENTRY_CLEANUP:
 		q = &LRU[(entry->lru.lane)].cleanup;
 		break;
+	case LRU_ENTRY_PROBATION:
+		q = &LRU[(entry->lru.lane)].probation;
+		break;
 	default:
 		/* LRU_NO_LANE */
 		q = NULL;
@@ -316,6 +405,8 @@ lru_insert(mdcache_lru_t *lru, struct lru_q *q, enum lru_edge edge)
 	lru->qid = q->id;	/* initial */
 	if (lru->qid == LRU_ENTRY_CLEANUP)
 		atomic_set_uint32_t_bits(&lru->flags, LRU_CLEANUP);
+	else if (lru->qid == LRU_ENTRY_PROBATION)
+		(void) atomic_inc_uint64_t(&lru_state.probation_used);
 
 	switch (edge) {
 	case LRU_LRU:
@@ -384,6 +475,13 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 		entry->sub_handle = NULL;
 	}
 
+	/* No I/O is in flight anymore */
+	mdc_wgather_free(entry);
+	mdc_preread_drop_locked(entry);
+
+	/* Drop the cached xattrs */
+	mdc_xattr_free(entry);
+
 	/* Done with the attrs */
 	fsal_release_attrs(&entry->attrs);
 
@@ -397,6 +495,150 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 	mdcache_key_delete(&entry->fh_hk.key);
 	PTHREAD_RWLOCK_destroy(&entry->content_lock);
 	PTHREAD_RWLOCK_destroy(&entry->attr_lock);
+
+	/* Whatever the entry still holds is gone now */
+	mdcache_lru_mem(entry, -atomic_fetch_int64_t(&entry->mem));
+}
+
+static uint64_t lru_ghost_hash(const void *item)
+{
+	return *(const uint64_t *)item;
+}
+
+static bool lru_ghost_match(const void *item, const void *key)
+{
+	return *(const uint64_t *)item == *(const uint64_t *)key;
+}
+
+static void lru_ghost_init(void)
+{
+	uint64_t size = (lru_state.entries_hiwat *
+			 mdcache_param.lru_2q_ghost_percent) / 100;
+
+	if (size == 0)
+		size = 1;
+	if (size > UINT32_MAX)
+		size = UINT32_MAX;
+
+	lru_ghost.size = size;
+	lru_ghost.next = 0;
+	lru_ghost.ring = gsh_calloc(size, sizeof(uint64_t));
+	oahash_init(&lru_ghost.set, size, lru_ghost_hash);
+}
+
+static void lru_ghost_destroy(void)
+{
+	if (lru_ghost.ring == NULL)
+		return;
+
+	oahash_destroy(&lru_ghost.set);
+	gsh_free(lru_ghost.ring);
+	lru_ghost.ring = NULL;
+}
+
+/**
+ * @brief Remember the hash of an entry reclaimed from probation
+ */
+static void lru_ghost_add(uint64_t hk)
+{
+	uint64_t *slot;
+
+	PTHREAD_MUTEX_lock(&lru_ghost.mtx);
+	slot = &lru_ghost.ring[lru_ghost.next];
+	/* Forget the oldest; it may already be gone after a hit */
+	(void) oahash_remove(&lru_ghost.set, *slot, slot);
+	*slot = hk;
+	oahash_insert(&lru_ghost.set, hk, slot);
+	lru_ghost.next = (lru_ghost.next + 1) % lru_ghost.size;
+	PTHREAD_MUTEX_unlock(&lru_ghost.mtx);
+
+	(void) atomic_inc_uint64_t(&cache_stp->lru_ghost_add);
+}
+
+/**
+ * @brief Check for, and forget, a remembered hash
+ *
+ * @return true on a ghost hit.
+ */
+static bool lru_ghost_take(uint64_t hk)
+{
+	uint64_t *slot;
+
+	PTHREAD_MUTEX_lock(&lru_ghost.mtx);
+	slot = oahash_lookup(&lru_ghost.set, hk, lru_ghost_match, &hk);
+	if (slot != NULL)
+		(void) oahash_remove(&lru_ghost.set, hk, slot);
+	PTHREAD_MUTEX_unlock(&lru_ghost.mtx);
+
+	return slot != NULL;
+}
+
+/**
+ * @brief Take a referenced entry out of the cache to recycle it
+ *
+ * The entry is removed from the hash and its queue if nobody else
+ * holds a reference, otherwise the caller's reference is dropped.
+ *
+ * @note The caller @a MUST @a NOT hold the lane lock
+ *
+ * @param[in] entry  Entry the caller holds one reference on
+ * @param[in] ghost  Remember the entry in the 2Q ghost list
+ *
+ * @return The entry's lru with just the sentinel ref, or NULL.
+ */
+static mdcache_lru_t *lru_reclaim(mdcache_entry_t *entry, bool ghost)
+{
+	struct lru_q_lane *qlane = &LRU[entry->lru.lane];
+	mdcache_lru_t *lru = &entry->lru;
+	uint32_t refcnt;
+	cih_latch_t latch;
+
+	/* entry must be unreachable from CIH when recycled */
+	if (!cih_latch_entry(&entry->fh_hk.key, &latch, CIH_GET_WLOCK,
+			     __func__, __LINE__)) {
+		/* ! QLOCKED but needs to be Unref'ed */
+		mdcache_lru_unref(entry, LRU_FLAG_NONE);
+		return NULL;
+	}
+
+	QLOCK(qlane);
+	refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
+	/* there are two cases which permit reclaim,
+	 * entry is:
+	 * 1. reachable but unref'd (refcnt==2)
+	 * 2. unreachable, being removed (plus refcnt==0)
+	 *  for safety, take only the former
+	 */
+	if (LRU_ENTRY_RECLAIMABLE(entry, refcnt)) {
+		/* it worked */
+		struct lru_q *q = lru_queue_of(entry);
+
+#ifdef USE_LTTNG
+		tracepoint(mdcache, mdc_lru_reap, __func__, __LINE__, entry,
+			   entry->lru.refcnt);
+#endif
+		if (ghost)
+			lru_ghost_add(entry->fh_hk.key.hk);
+		cih_remove_latched(entry, &latch, CIH_REMOVE_QLOCKED);
+		LRU_DQ_SAFE(lru, q);
+		entry->lru.qid = LRU_ENTRY_NONE;
+		QUNLOCK(qlane);
+		cih_hash_release(&latch);
+		/* Note, we're not releasing our ref here.
+		 * cih_remove_latched() called mdcache_lru_unref(), which
+		 * released the sentinal ref, leaving just the one ref we
+		 * took earlier.  Returning this as is leaves it with a ref
+		 * of 1 (ie, just the sentinal ref)
+		 */
+		return lru;
+	}
+	cih_hash_release(&latch);
+	/* return the ref we took above--unref deals
+	 * correctly with reclaim case */
+	mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
+	QUNLOCK(qlane);
+
+	return NULL;
 }
 
 /**
@@ -418,6 +660,9 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 
 static uint32_t reap_lane;
 
+/* Referenced entries skipped at the head of a queue before giving up */
+#define LRU_REAP_CHANCES 8
+
 static inline mdcache_lru_t *
 lru_reap_impl(enum lru_q_id qid)
 {
@@ -427,16 +672,29 @@ lru_reap_impl(enum lru_q_id qid)
 	mdcache_lru_t *lru;
 	mdcache_entry_t *entry;
 	uint32_t refcnt;
-	cih_latch_t latch;
-	int ix;
+	int ix, chances;
 
 	lane = LRU_NEXT(reap_lane);
 	for (ix = 0; ix < LRU_N_Q_LANES; ++ix, lane = LRU_NEXT(reap_lane)) {
 		qlane = &LRU[lane];
-		lq = (qid == LRU_ENTRY_L1) ? &qlane->L1 : &qlane->L2;
+		switch (qid) {
+		case LRU_ENTRY_L1:
+			lq = &qlane->L1;
+			break;
+		case LRU_ENTRY_PROBATION:
+			lq = &qlane->probation;
+			break;
+		default:
+			lq = &qlane->L2;
+			break;
+		}
 
 		QLOCK(qlane);
 		lru = glist_first_entry(&lq->q, mdcache_lru_t, q);
+		/* Referenced entries at the head get another round */
+		for (chances = 0; lru && chances < LRU_REAP_CHANCES &&
+		     lru_second_chance(lru); chances++)
+			lru = glist_first_entry(&lq->q, mdcache_lru_t, q);
 		if (!lru)
 			goto next_lane;
 		refcnt = atomic_inc_int32_t(&lru->refcnt);
@@ -448,50 +706,10 @@ lru_reap_impl(enum lru_q_id qid)
 		}
 		/* potentially reclaimable */
 		QUNLOCK(qlane);
-		/* entry must be unreachable from CIH when recycled */
-		if (cih_latch_entry(&entry->fh_hk.key, &latch, CIH_GET_WLOCK,
-				    __func__, __LINE__)) {
-			QLOCK(qlane);
-			refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
-			/* there are two cases which permit reclaim,
-			 * entry is:
-			 * 1. reachable but unref'd (refcnt==2)
-			 * 2. unreachable, being removed (plus refcnt==0)
-			 *  for safety, take only the former
-			 */
-			if (LRU_ENTRY_RECLAIMABLE(entry, refcnt)) {
-				/* it worked */
-				struct lru_q *q = lru_queue_of(entry);
-
-#ifdef USE_LTTNG
-				tracepoint(mdcache, mdc_lru_reap, __func__,
-					   __LINE__, entry,
-					   entry->lru.refcnt);
-#endif
-				cih_remove_latched(entry, &latch,
-						   CIH_REMOVE_QLOCKED);
-				LRU_DQ_SAFE(lru, q);
-				entry->lru.qid = LRU_ENTRY_NONE;
-				QUNLOCK(qlane);
-				cih_hash_release(&latch);
-				/* Note, we're not releasing our ref here.
-				 * cih_remove_latched() called
-				 * mdcache_lru_unref(), which released the
-				 * sentinal ref, leaving just the one ref we
-				 * took earlier.  Returning this as is leaves it
-				 * with a ref of 1 (ie, just the sentinal ref)
-				 * */
-				goto out;
-			}
-			cih_hash_release(&latch);
-			/* return the ref we took above--unref deals
-			 * correctly with reclaim case */
-			mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
-		} else {
-			/* ! QLOCKED but needs to be Unref'ed */
-			mdcache_lru_unref(entry, LRU_FLAG_NONE);
-			continue;
-		}
+		lru = lru_reclaim(entry, qid == LRU_ENTRY_PROBATION);
+		if (lru)
+			goto out;
+		continue;
  next_lane:
 		QUNLOCK(qlane);
 	}			/* foreach lane */
@@ -502,14 +720,82 @@ lru_reap_impl(enum lru_q_id qid)
 	return lru;
 }
 
+/* Percent of Entries_HWMark and Memory_HWMark_Bytes the cache keeps,
+ * and of their dirents directories keep each LRU run, at each memory
+ * pressure.
+ */
+static const uint32_t lru_pressure_entries[] = {
+	[MEM_PRESSURE_NONE] = 100,
+	[MEM_PRESSURE_LOW] = 100,
+	[MEM_PRESSURE_MEDIUM] = 100,
+	[MEM_PRESSURE_HIGH] = 50,
+};
+
+static const uint32_t lru_pressure_dirents[] = {
+	[MEM_PRESSURE_NONE] = 100,
+	[MEM_PRESSURE_LOW] = 100,
+	[MEM_PRESSURE_MEDIUM] = 50,
+	[MEM_PRESSURE_HIGH] = 50,
+};
+
+static uint32_t lru_pressure;
+
+static void lru_shrink(enum mem_pressure level)
+{
+	if (atomic_fetch_uint32_t(&lru_pressure) < level) {
+		atomic_store_uint32_t(&lru_pressure, level);
+		lru_wake_thread();
+	} else {
+		atomic_store_uint32_t(&lru_pressure, level);
+	}
+}
+
+static struct mem_pressure_shrinker lru_shrinker = {
+	.name = "MDCACHE",
+	.shrink = lru_shrink,
+};
+
+static inline bool lru_over_mem(void)
+{
+	uint32_t pct =
+		lru_pressure_entries[atomic_fetch_uint32_t(&lru_pressure)];
+
+	if (pct < 100 &&
+	    lru_state.entries_used > lru_state.entries_hiwat / 100 * pct)
+		return true;
+
+	return mdcache_param.memory_hwmark_bytes != 0 &&
+	       atomic_fetch_int64_t(&lru_state.mem_used) >
+	       (int64_t) (mdcache_param.memory_hwmark_bytes / 100 * pct);
+}
+
 static inline mdcache_lru_t *
 lru_try_reap_entry(void)
 {
 	mdcache_lru_t *lru;
 
-	if (lru_state.entries_used < lru_state.entries_hiwat)
+	if (lru_state.entries_used < lru_state.entries_hiwat &&
+	    !lru_over_mem())
 		return NULL;
 
+	if (lru_state.policy == LRU_POLICY_2Q) {
+		bool probation_first =
+			atomic_fetch_uint64_t(&lru_state.probation_used) >
+			lru_state.probation_target;
+
+		if (probation_first) {
+			lru = lru_reap_impl(LRU_ENTRY_PROBATION);
+			if (lru)
+				return lru;
+		}
+		lru = lru_reap_impl(LRU_ENTRY_L2);
+		if (!lru)
+			lru = lru_reap_impl(LRU_ENTRY_L1);
+		if (!lru && !probation_first)
+			lru = lru_reap_impl(LRU_ENTRY_PROBATION);
+		return lru;
+	}
+
 	/* XXX dang why not start with the cleanup list? */
 	lru = lru_reap_impl(LRU_ENTRY_L2);
 	if (!lru)
@@ -518,6 +804,308 @@ lru_try_reap_entry(void)
 	return lru;
 }
 
+/**
+ * @brief Reference the oldest idle entries of an export
+ *
+ * An entry is idle when only the sentinel reference is held.  The
+ * reference is taken with a compare and swap, as dropping one that
+ * turned out not to be wanted could free the entry, which takes
+ * mdc_exp_lock.
+ *
+ * @param[in]  exp      The export
+ * @param[in]  dirs     Only directories with cached dirents
+ * @param[out] entries  The referenced entries
+ * @param[in]  max      Size of @a entries
+ *
+ * @return The number of entries referenced.
+ */
+static int lru_export_idle(struct mdcache_fsal_export *exp, bool dirs,
+			   mdcache_entry_t **entries, int max)
+{
+	struct glist_head *glist;
+	struct entry_export_map *expmap;
+	mdcache_entry_t *entry;
+	int n = 0;
+
+	PTHREAD_RWLOCK_rdlock(&exp->mdc_exp_lock);
+	glist_for_each(glist, &exp->entry_list) {
+		if (n == max)
+			break;
+		expmap = glist_entry(glist, struct entry_export_map,
+				     entry_per_export);
+		entry = expmap->entry;
+		if (dirs && (entry->obj_handle.type != DIRECTORY ||
+			     entry->fsobj.fsdir.chunk_mem == 0))
+			continue;
+		if (atomic_cas_int32_t(&entry->lru.refcnt,
+				       LRU_SENTINEL_REFCOUNT,
+				       LRU_SENTINEL_REFCOUNT + 1))
+			entries[n++] = entry;
+	}
+	PTHREAD_RWLOCK_unlock(&exp->mdc_exp_lock);
+
+	return n;
+}
+
+static inline bool lru_export_over_entries(struct mdcache_fsal_export *exp)
+{
+	uint64_t max = atomic_fetch_uint64_t(&exp->owner->cache_entries_max);
+
+	return max != 0 && atomic_fetch_int64_t(&exp->entries) >= (int64_t) max;
+}
+
+/**
+ * @brief Take the oldest idle entry of an export out of the cache
+ *
+ * @param[in] exp  The export
+ *
+ * @return The entry's lru with just the sentinel ref, or NULL.
+ */
+static mdcache_lru_t *lru_reap_export(struct mdcache_fsal_export *exp)
+{
+	mdcache_entry_t *entry;
+
+	if (lru_export_idle(exp, false, &entry, 1) == 0)
+		return NULL;
+
+	return lru_reclaim(entry, false);
+}
+
+/**
+ * @brief Bring an export back within its cache budgets
+ *
+ * Called from the LRU thread.
+ *
+ * @param[in] exp  The export
+ */
+static void lru_run_export(struct mdcache_fsal_export *exp)
+{
+	mdcache_entry_t *dirs[LRU_EXPORT_DIR_BATCH];
+	struct glist_head *glist;
+	struct entry_export_map *expmap;
+	mdcache_entry_t *entry;
+	mdcache_lru_t *lru;
+	uint64_t max, mem = 0;
+	uint32_t pct;
+	int i, n, work;
+
+	op_ctx->fsal_export = &exp->export;
+
+	for (work = 0; work < mdcache_param.reaper_work; work++) {
+		max = atomic_fetch_uint64_t(&exp->owner->cache_entries_max);
+		if (max == 0 ||
+		    atomic_fetch_int64_t(&exp->entries) <= (int64_t) max)
+			break;
+		lru = lru_reap_export(exp);
+		if (lru == NULL)
+			break;
+		/* Release the sentinel ref, freeing the entry */
+		entry = container_of(lru, mdcache_entry_t, lru);
+		mdcache_lru_unref(entry, LRU_FLAG_NONE);
+	}
+
+	max = atomic_fetch_uint64_t(&exp->owner->cache_dirent_mem_max);
+	pct = lru_pressure_dirents[atomic_fetch_uint32_t(&lru_pressure)];
+	if (max == 0 && pct == 100) {
+		atomic_store_uint64_t(&exp->dirent_mem, 0);
+		return;
+	}
+
+	/* chunk_mem is read without the content lock, it is an estimate */
+	PTHREAD_RWLOCK_rdlock(&exp->mdc_exp_lock);
+	glist_for_each(glist, &exp->entry_list) {
+		expmap = glist_entry(glist, struct entry_export_map,
+				     entry_per_export);
+		if (expmap->entry->obj_handle.type == DIRECTORY)
+			mem += expmap->entry->fsobj.fsdir.chunk_mem;
+	}
+	PTHREAD_RWLOCK_unlock(&exp->mdc_exp_lock);
+
+	/* Under memory pressure, each run keeps a share of what is left */
+	if (pct < 100)
+		max = (max == 0 ? mem : MIN(max, mem)) / 100 * pct;
+
+	while (mem > max) {
+		n = lru_export_idle(exp, true, dirs, LRU_EXPORT_DIR_BATCH);
+		if (n == 0)
+			break;
+		for (i = 0; i < n; i++) {
+			PTHREAD_RWLOCK_wrlock(&dirs[i]->content_lock);
+			mem -= MIN(mem, dirs[i]->fsobj.fsdir.chunk_mem);
+			mdcache_dirent_invalidate_all(dirs[i]);
+			PTHREAD_RWLOCK_unlock(&dirs[i]->content_lock);
+			mdcache_lru_unref(dirs[i], LRU_FLAG_NONE);
+		}
+	}
+
+	atomic_store_uint64_t(&exp->dirent_mem, mem);
+}
+
+/**
+ * @brief Enforce the cache budgets of all exports
+ */
+static void lru_run_exports(void)
+{
+	struct req_op_context ctx = {0};
+	struct req_op_context *saved_ctx = op_ctx;
+	struct glist_head *glist;
+
+	op_ctx = &ctx;
+
+	PTHREAD_MUTEX_lock(&lru_exports.mtx);
+	glist_for_each(glist, &lru_exports.list) {
+		lru_run_export(glist_entry(glist, struct mdcache_fsal_export,
+					   lru_exports));
+	}
+	PTHREAD_MUTEX_unlock(&lru_exports.mtx);
+
+	op_ctx = saved_ctx;
+}
+
+/**
+ * @brief Free entries while the cache is over Memory_HWMark_Bytes
+ *
+ * Under memory pressure, while it is over its share of that and of
+ * Entries_HWMark.  Called from the LRU thread.
+ */
+static void lru_run_mem(void)
+{
+	struct req_op_context ctx = {0};
+	struct req_op_context *saved_ctx = op_ctx;
+	struct mdcache_fsal_export *exp;
+	mdcache_entry_t *entry;
+	mdcache_lru_t *lru;
+	uint32_t work;
+
+	if (!lru_over_mem())
+		return;
+
+	op_ctx = &ctx;
+
+	/* Hold off releasing the exports the entries are cleaned with */
+	PTHREAD_MUTEX_lock(&lru_exports.mtx);
+	for (work = 0; work < mdcache_param.reaper_work && lru_over_mem();
+	     work++) {
+		lru = lru_try_reap_entry();
+		if (lru == NULL)
+			break;
+		entry = container_of(lru, mdcache_entry_t, lru);
+		exp = atomic_fetch_voidptr(&entry->first_export);
+		if (exp == NULL)
+			exp = glist_first_entry(&lru_exports.list,
+						struct mdcache_fsal_export,
+						lru_exports);
+		op_ctx->fsal_export = exp != NULL ? &exp->export : NULL;
+		/* Release the sentinel ref, freeing the entry */
+		mdcache_lru_unref(entry, LRU_FLAG_NONE);
+	}
+	PTHREAD_MUTEX_unlock(&lru_exports.mtx);
+
+	op_ctx = saved_ctx;
+
+	LogDebug(COMPONENT_CACHE_INODE_LRU,
+		 "Freed %"PRIu32" entries, cache holds %"PRIi64" bytes",
+		 work, atomic_fetch_int64_t(&lru_state.mem_used));
+}
+
+/**
+ * @brief Add an export to those with cache budgets
+ *
+ * @param[in] exp  The export
+ */
+void mdcache_lru_export_add(struct mdcache_fsal_export *exp)
+{
+	PTHREAD_MUTEX_lock(&lru_exports.mtx);
+	glist_add_tail(&lru_exports.list, &exp->lru_exports);
+	PTHREAD_MUTEX_unlock(&lru_exports.mtx);
+}
+
+/**
+ * @brief Remove an export being released
+ *
+ * @param[in] exp  The export
+ */
+void mdcache_lru_export_del(struct mdcache_fsal_export *exp)
+{
+	PTHREAD_MUTEX_lock(&lru_exports.mtx);
+	glist_del(&exp->lru_exports);
+	PTHREAD_MUTEX_unlock(&lru_exports.mtx);
+}
+
+/**
+ * @brief Call a function for each export
+ *
+ * @param[in] cb   The function
+ * @param[in] arg  Passed to @a cb
+ */
+void mdcache_lru_export_foreach(void (*cb)(struct mdcache_fsal_export *,
+					   void *),
+				void *arg)
+{
+	struct glist_head *glist;
+
+	PTHREAD_MUTEX_lock(&lru_exports.mtx);
+	glist_for_each(glist, &lru_exports.list) {
+		cb(glist_entry(glist, struct mdcache_fsal_export, lru_exports),
+		   arg);
+	}
+	PTHREAD_MUTEX_unlock(&lru_exports.mtx);
+}
+
+/**
+ * @brief Call a function for the hottest entries of each lane
+ *
+ * Up to @a max entries of each lane are visited, L1 from its MRU end,
+ * then probation, then L2.  The callback runs with the lane lock held
+ * and the exports pinned, so it must not block, take entry locks other
+ * than by trying, or take references.
+ *
+ * @param[in] cb   The function, given the entry, its first export (or
+ *                 NULL) and the lane
+ * @param[in] arg  Passed to @a cb
+ * @param[in] max  Entries to visit per lane
+ */
+void mdcache_lru_walk_hot(void (*cb)(mdcache_entry_t *,
+				     struct mdcache_fsal_export *,
+				     size_t, void *),
+			  void *arg, uint32_t max)
+{
+	struct glist_head *glist;
+	size_t lane;
+	uint32_t n;
+	int i;
+
+	PTHREAD_MUTEX_lock(&lru_exports.mtx);
+	for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
+		struct lru_q_lane *qlane = &LRU[lane];
+		struct lru_q *qs[] = {
+			&qlane->L1, &qlane->probation, &qlane->L2
+		};
+
+		n = 0;
+		QLOCK(qlane);
+		for (i = 0; i < 3 && n < max; ++i) {
+			/* MRU is at the tail */
+			for (glist = qs[i]->q.prev; glist != &qs[i]->q;
+			     glist = glist->prev) {
+				mdcache_entry_t *entry =
+					container_of(glist, mdcache_entry_t,
+						     lru.q);
+
+				if (!entry->fh_hk.inavl)
+					continue;
+				cb(entry,
+				   atomic_fetch_voidptr(&entry->first_export),
+				   lane, arg);
+				if (++n == max)
+					break;
+			}
+		}
+		QUNLOCK(qlane);
+	}
+	PTHREAD_MUTEX_unlock(&lru_exports.mtx);
+}
+
 /**
  * @brief Push a killed entry to the cleanup queue for out-of-line cleanup
  *
@@ -618,6 +1206,192 @@ mdcache_lru_cleanup_try_push(mdcache_entry_t *entry)
  *
  */
 
+/**
+ * @brief Close the global file descriptor of an entry
+ *
+ * Called from the LRU thread, with op_ctx set up and the lane unlocked.
+ *
+ * @param[in] entry  The referenced entry
+ *
+ * @return true if the close succeeded.
+ */
+static bool lru_close_entry(mdcache_entry_t *entry)
+{
+	fsal_status_t status;
+	struct mdcache_fsal_export *exp;
+	bool not_support_ex;
+
+	/** @todo FSF: hmm, this looks hairy, we need a reference
+	 *             to the export somehow?
+	 */
+	exp = atomic_fetch_voidptr(&entry->first_export);
+	op_ctx->fsal_export = &exp->export;
+	op_ctx->ctx_export = NULL;
+
+	not_support_ex = !entry->obj_handle.fsal->m_ops.support_ex(
+						&entry->obj_handle);
+
+	if (not_support_ex) {
+		/* Acquire the content lock first; we may need to look
+		 * at fds and close it.
+		 */
+		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+	}
+
+	/* Make sure any FSAL global file descriptor is closed. */
+	status = fsal_close(&entry->obj_handle);
+
+	if (not_support_ex) {
+		/* Release the content lock. */
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	}
+
+	if (FSAL_IS_ERROR(status)) {
+		LogCrit(COMPONENT_CACHE_INODE_LRU,
+			"Error closing file in LRU thread.");
+		return false;
+	}
+
+	return true;
+}
+
+/* Called with the fd pool lock held */
+static void lru_fd_pool_del(mdcache_entry_t *entry)
+{
+	glist_del(&entry->fd_lru);
+	entry->fd_pooled = false;
+	lru_fd_pool.size--;
+	(void) atomic_dec_size_t(&open_fd_count);
+}
+
+/**
+ * @brief Note that the global fd of a file was used
+ *
+ * Moves the file to the head of the fd pool, adding it the first time.
+ * The move is made at most once a second per file.  When adding the fd
+ * reaches the hard limit, the coldest fds are closed in line.
+ *
+ * @param[in] entry  The file, referenced by the caller
+ */
+void mdcache_lru_fd_used(mdcache_entry_t *entry)
+{
+	time_t now = time(NULL);
+	bool added = false;
+	size_t open;
+
+	if (entry->obj_handle.type != REGULAR_FILE ||
+	    !entry->obj_handle.fsal->m_ops.support_ex(&entry->obj_handle))
+		return;
+
+	if (entry->fd_pooled && entry->fd_used == now)
+		return;
+
+	PTHREAD_MUTEX_lock(&lru_fd_pool.mtx);
+	if (entry->fd_pooled) {
+		glist_del(&entry->fd_lru);
+	} else {
+		entry->fd_pooled = true;
+		lru_fd_pool.size++;
+		added = true;
+	}
+	glist_add(&lru_fd_pool.lru, &entry->fd_lru);
+	entry->fd_used = now;
+	PTHREAD_MUTEX_unlock(&lru_fd_pool.mtx);
+
+	if (!added)
+		return;
+
+	open = atomic_inc_size_t(&open_fd_count);
+	if (open >= lru_state.fds_hard_limit)
+		(void) mdcache_lru_fd_reap(LRU_FD_REAP_BATCH);
+	else if (open >= lru_state.fds_hiwat)
+		lru_wake_thread();
+}
+
+/**
+ * @brief Note that the global fd of a file was closed
+ *
+ * @param[in] entry  The file
+ */
+void mdcache_lru_fd_closed(mdcache_entry_t *entry)
+{
+	if (!entry->fd_pooled)
+		return;
+
+	PTHREAD_MUTEX_lock(&lru_fd_pool.mtx);
+	if (entry->fd_pooled)
+		lru_fd_pool_del(entry);
+	PTHREAD_MUTEX_unlock(&lru_fd_pool.mtx);
+}
+
+/**
+ * @brief Close the coldest global fds of the fd pool
+ *
+ * Files in use by someone else are moved back to the head rather than
+ * closed, and each file in the pool is looked at most once.
+ *
+ * @param[in] count  Number of fds to close
+ *
+ * @return The number of fds closed.
+ */
+size_t mdcache_lru_fd_reap(size_t count)
+{
+	struct req_op_context ctx = {0};
+	struct req_op_context *saved_ctx = op_ctx;
+	mdcache_entry_t *entry;
+	uint64_t looked, limit;
+	size_t closed = 0;
+	bool busy;
+
+	op_ctx = &ctx;
+
+	PTHREAD_MUTEX_lock(&lru_fd_pool.mtx);
+	limit = lru_fd_pool.size;
+	PTHREAD_MUTEX_unlock(&lru_fd_pool.mtx);
+
+	for (looked = 0; looked < limit && closed < count; looked++) {
+		PTHREAD_MUTEX_lock(&lru_fd_pool.mtx);
+		entry = glist_last_entry(&lru_fd_pool.lru, mdcache_entry_t,
+					 fd_lru);
+		if (entry == NULL) {
+			PTHREAD_MUTEX_unlock(&lru_fd_pool.mtx);
+			break;
+		}
+
+		/* An entry with no reference left is being cleaned, which
+		 * closes its fd.  It can't go away while in the pool.
+		 */
+		if (!atomic_inc_not_zero_int32_t(&entry->lru.refcnt)) {
+			lru_fd_pool_del(entry);
+			PTHREAD_MUTEX_unlock(&lru_fd_pool.mtx);
+			continue;
+		}
+
+		busy = atomic_fetch_int32_t(&entry->lru.refcnt) >
+		       LRU_SENTINEL_REFCOUNT + 1;
+		if (busy) {
+			glist_del(&entry->fd_lru);
+			glist_add(&lru_fd_pool.lru, &entry->fd_lru);
+		} else {
+			lru_fd_pool_del(entry);
+		}
+		PTHREAD_MUTEX_unlock(&lru_fd_pool.mtx);
+
+		if (!busy && lru_close_entry(entry))
+			++closed;
+
+		mdcache_lru_unref(entry, LRU_FLAG_NONE);
+	}
+
+	op_ctx = saved_ctx;
+
+	LogDebug(COMPONENT_CACHE_INODE_LRU,
+		 "Closed %zd of %zd fds from the fd pool, looked at %" PRIu64,
+		 closed, count, looked);
+
+	return closed;
+}
+
 static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 {
 	struct lru_q *q;
@@ -627,7 +1401,6 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 	mdcache_lru_t *lru = NULL;
 	/* Number of entries closed in this run. */
 	size_t closed = 0;
-	fsal_status_t status;
 	/* a cache entry */
 	mdcache_entry_t *entry;
 	/* Current queue lane */
@@ -636,9 +1409,6 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 	uint32_t refcnt;
 	struct req_op_context ctx = {0};
 	struct req_op_context *saved_ctx = op_ctx;
-	struct mdcache_fsal_export *exp;
-	struct fsal_export *export;
-	bool not_support_ex;
 
 	op_ctx = &ctx;
 
@@ -663,6 +1433,13 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 			goto next_lane;
 
 		lru = glist_entry(qlane->iter.glist, mdcache_lru_t, q);
+
+		/* Referenced since last time, moves to MRU instead */
+		if (lru_second_chance(lru)) {
+			workdone++;
+			continue;
+		}
+
 		refcnt = atomic_inc_int32_t(&lru->refcnt);
 
 		/* get entry early */
@@ -689,36 +1466,44 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 		 * entry */
 		QUNLOCK(qlane);
 
-		/** @todo FSF: hmm, this looks hairy, we need a reference
-		 *             to the export somehow?
-		 */
-		exp = atomic_fetch_voidptr(&entry->first_export);
-		export = &exp->export;
-		op_ctx->fsal_export = export;
-		op_ctx->ctx_export = NULL;
-
-		not_support_ex = !entry->obj_handle.fsal->m_ops.support_ex(
-							&entry->obj_handle);
-
-		if (not_support_ex) {
-			/* Acquire the content lock first; we may need to look
-			 * at fds and close it.
-			 */
-			PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+		if (lru_close_entry(entry)) {
+			++(*totalclosed);
+			++closed;
 		}
 
-		/* Make sure any FSAL global file descriptor is closed. */
-		status = fsal_close(&entry->obj_handle);
+		QLOCK(qlane); /* QLOCKED */
+		mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
+		++workdone;
+	} /* for_each_safe lru */
+
+	if (lru_state.policy != LRU_POLICY_2Q)
+		goto next_lane;
+
+	/* Probation entries never reach L1, so close their files here.
+	 * They stay in probation, moved behind the ones not yet looked
+	 * at.
+	 */
+	q = &qlane->probation;
+	glist_for_each_safe(qlane->iter.glist, qlane->iter.glistn, &q->q) {
+		if (workdone >= lru_state.per_lane_work)
+			goto next_lane;
+
+		lru = glist_entry(qlane->iter.glist, mdcache_lru_t, q);
+		refcnt = atomic_inc_int32_t(&lru->refcnt);
+		entry = container_of(lru, mdcache_entry_t, lru);
 
-		if (not_support_ex) {
-			/* Release the content lock. */
-			PTHREAD_RWLOCK_unlock(&entry->content_lock);
+		if (unlikely(refcnt > 2)) {
+			mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
+			workdone++;
+			continue;
 		}
 
-		if (FSAL_IS_ERROR(status)) {
-			LogCrit(COMPONENT_CACHE_INODE_LRU,
-				"Error closing file in LRU thread.");
-		} else {
+		LRU_DQ_SAFE(lru, q);
+		lru_insert(lru, q, LRU_MRU);
+
+		QUNLOCK(qlane);
+
+		if (lru_close_entry(entry)) {
 			++(*totalclosed);
 			++closed;
 		}
@@ -726,7 +1511,7 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 		QLOCK(qlane); /* QLOCKED */
 		mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
 		++workdone;
-	} /* for_each_safe lru */
+	}
 
 next_lane:
 	qlane->iter.active = false; /* !ACTIVE */
@@ -859,6 +1644,8 @@ lru_run(struct fridgethr_context *ctx)
 		   don't spin through more passes. */
 		size_t workpass = 0;
 		time_t curr_time = time(NULL);
+		/* Global fds to close from the fd pool */
+		size_t target;
 
 		fdratepersec = (curr_time <= lru_state.prev_time)
 			? 1 : (formeropen - lru_state.prev_fd_count) /
@@ -874,8 +1661,30 @@ lru_run(struct fridgethr_context *ctx)
 				 "Open FDs over high water mark, reapring aggressively.");
 		}
 
+		/* The fd pool knows the coldest global fds, close those
+		 * first.  The lanes are scanned for FSALs without the
+		 * extended API, and for what is still over the low water
+		 * mark.
+		 */
+		if (!mdcache_param.use_fd_cache)
+			target = lru_fd_pool.size;
+		else if (formeropen > lru_state.fds_lowat)
+			target = MIN(formeropen - lru_state.fds_lowat,
+				     extremis ? lru_state.biggest_window
+					      : mdcache_param.reaper_work);
+		else
+			target = 0;
+
+		if (target != 0)
+			totalclosed += mdcache_lru_fd_reap(target);
+
 		/* Total fds closed between all lanes and all current runs. */
 		do {
+			if (mdcache_param.use_fd_cache &&
+			    atomic_fetch_size_t(&open_fd_count) <
+			    lru_state.fds_lowat)
+				break;
+
 			workpass = 0;
 			for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
 				LogDebug(COMPONENT_CACHE_INODE_LRU,
@@ -910,6 +1719,9 @@ lru_run(struct fridgethr_context *ctx)
 		}
 	}
 
+	lru_run_exports();
+	lru_run_mem();
+
 	/* The following calculation will progressively garbage collect
 	 * more frequently as these two factors increase:
 	 * 1. current number of open file descriptors
@@ -1071,6 +1883,13 @@ err_open:
 
 	lru_state.caching_fds = mdcache_param.use_fd_cache;
 
+	lru_state.policy = mdcache_param.lru_policy;
+	lru_state.probation_used = 0;
+	lru_state.probation_target =
+	    (lru_state.entries_hiwat * mdcache_param.lru_2q_in_percent) / 100;
+	if (lru_state.policy == LRU_POLICY_2Q)
+		lru_ghost_init();
+
 	/* init queue complex */
 	lru_init_queues();
 
@@ -1090,6 +1909,8 @@ err_open:
 		return fsalstat(posix2fsal_error(code), code);
 	}
 
+	mem_pressure_register(&lru_shrinker);
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -1101,9 +1922,11 @@ err_open:
 fsal_status_t
 mdcache_lru_pkgshutdown(void)
 {
-	int rc = fridgethr_sync_command(lru_fridge,
-					fridgethr_comm_stop,
-					120);
+	int rc;
+
+	mem_pressure_unregister(&lru_shrinker);
+
+	rc = fridgethr_sync_command(lru_fridge, fridgethr_comm_stop, 120);
 
 	if (rc == ETIMEDOUT) {
 		LogMajor(COMPONENT_CACHE_INODE_LRU,
@@ -1113,6 +1936,20 @@ mdcache_lru_pkgshutdown(void)
 		LogMajor(COMPONENT_CACHE_INODE_LRU,
 			 "Failed shutting down LRU thread: %d", rc);
 	}
+
+	PTHREAD_MUTEX_lock(&lru_entry_free_mtx);
+	while (!glist_empty(&lru_entry_free)) {
+		mdcache_entry_t *entry = glist_first_entry(&lru_entry_free,
+							   mdcache_entry_t,
+							   lru.q);
+
+		glist_del(&entry->lru.q);
+		pool_free(mdcache_entry_pool, entry);
+	}
+	PTHREAD_MUTEX_unlock(&lru_entry_free_mtx);
+
+	lru_ghost_destroy();
+
 	return fsalstat(posix2fsal_error(rc), rc);
 }
 
@@ -1125,9 +1962,23 @@ static inline void init_rw_locks(mdcache_entry_t *entry)
 
 mdcache_entry_t *alloc_cache_entry(void)
 {
-	mdcache_entry_t *nentry;
+	mdcache_entry_t *nentry = NULL;
 
-	nentry = pool_alloc(mdcache_entry_pool);
+	if (cih_fhcache.lockless) {
+		PTHREAD_MUTEX_lock(&lru_entry_free_mtx);
+		nentry = glist_first_entry(&lru_entry_free, mdcache_entry_t,
+					   lru.q);
+		if (nentry != NULL)
+			glist_del(&nentry->lru.q);
+		PTHREAD_MUTEX_unlock(&lru_entry_free_mtx);
+	}
+
+	if (nentry != NULL) {
+		/* refcnt is already 0, so lockless lookups leave it be */
+		memset(nentry, 0, sizeof(*nentry));
+	} else {
+		nentry = pool_alloc(mdcache_entry_pool);
+	}
 
 	/* Initialize the entry locks */
 	init_rw_locks(nentry);
@@ -1141,7 +1992,8 @@ mdcache_entry_t *alloc_cache_entry(void)
  * @brief Re-use or allocate an entry
  *
  * This function repurposes a resident entry in the LRU system if the system is
- * above the high-water mark, and allocates a new one otherwise.  On success,
+ * above the high-water mark, or one of the current export's if it is at its
+ * Cache_Entries_Max, and allocates a new one otherwise.  On success,
  * this function always returns an entry with two references (one for the
  * sentinel, one to allow the caller's use.)
  *
@@ -1149,10 +2001,14 @@ mdcache_entry_t *alloc_cache_entry(void)
  */
 mdcache_entry_t *mdcache_lru_get(void)
 {
-	mdcache_lru_t *lru;
+	mdcache_lru_t *lru = NULL;
 	mdcache_entry_t *nentry = NULL;
 
-	lru = lru_try_reap_entry();
+	/* An export at its budget makes room among its own entries */
+	if (lru_export_over_entries(mdc_cur_export()))
+		lru = lru_reap_export(mdc_cur_export());
+	if (!lru)
+		lru = lru_try_reap_entry();
 	if (lru) {
 		/* we uniquely hold entry */
 		nentry = container_of(lru, mdcache_entry_t, lru);
@@ -1160,15 +2016,26 @@ mdcache_entry_t *mdcache_lru_get(void)
 			     "Recycling entry at %p.", nentry);
 		mdcache_lru_clean(nentry);
 		memset(&nentry->attrs, 0, sizeof(nentry->attrs));
+		memset(nentry->access_slots, 0,
+		       sizeof(nentry->access_slots));
 		init_rw_locks(nentry);
+		/* A lockless lookup that lost the race against the reaper
+		 * may still be about to drop a reference, so add to the
+		 * sentinel ref rather than overwrite it. */
+		(void) atomic_inc_int32_t(&nentry->lru.refcnt);
 	} else {
 		/* alloc entry (if fails, aborts) */
 		nentry = alloc_cache_entry();
+		/* Since the entry isn't in a queue, nobody can bump
+		 * refcnt. */
+		nentry->lru.refcnt = 2;
 	}
 
-	/* Since the entry isn't in a queue, nobody can bump refcnt. */
-	nentry->lru.refcnt = 2;
-	nentry->lru.cf = 0;
+	mdcache_lru_mem(nentry, sizeof(*nentry));
+	if (lru_over_mem())
+		lru_wake_thread();
+
+	atomic_clear_uint32_t_bits(&nentry->lru.flags, LRU_REFERENCED);
 	nentry->lru.lane = lru_lane_of_entry(nentry);
 
 #ifdef USE_LTTNG
@@ -1176,11 +2043,101 @@ mdcache_entry_t *mdcache_lru_get(void)
 		   __func__, __LINE__, nentry, nentry->lru.refcnt);
 #endif
 	/* Enqueue. */
-	lru_insert_entry(nentry, &LRU[nentry->lru.lane].L1, LRU_LRU);
+	if (lru_state.policy == LRU_POLICY_2Q)
+		lru_insert_entry(nentry, &LRU[nentry->lru.lane].probation,
+				 LRU_MRU);
+	else
+		lru_insert_entry(nentry, &LRU[nentry->lru.lane].L1, LRU_LRU);
 
 	return nentry;
 }
 
+/**
+ * @brief Adjust LRU position for an initial reference
+ *
+ * This is the LRU side of an LRU_REQ_INITIAL reference, for callers
+ * that already hold the reference (the lockless lookup path).
+ *
+ * Only the entry's LRU_REFERENCED bit is set, so that hot entries such
+ * as the export root don't make their lane lock a point of contention.
+ * The entry is moved when the LRU thread or the reaper next looks at it,
+ * see lru_second_chance().
+ *
+ * @param[in] entry  The referenced entry
+ */
+void
+mdcache_lru_promote(mdcache_entry_t *entry)
+{
+	/* Read first, so hot entries don't keep dirtying the line */
+	if (!(atomic_fetch_uint32_t(&entry->lru.flags) & LRU_REFERENCED))
+		atomic_set_uint32_t_bits(&entry->lru.flags, LRU_REFERENCED);
+}
+
+/**
+ * @brief Move an entry referenced since it was queued
+ *
+ * The deferred half of mdcache_lru_promote().  An L1 entry advances to
+ * the MRU of L1, an L2 entry moves to the LRU of L1, as the promotion
+ * used to do in line.
+ *
+ * @note The caller MUST hold the lane lock
+ *
+ * @param[in] lru  The entry's lru
+ *
+ * @return true if the entry was referenced and has been moved.
+ */
+static inline bool
+lru_second_chance(mdcache_lru_t *lru)
+{
+	struct lru_q_lane *qlane = &LRU[lru->lane];
+
+	if (lru->qid != LRU_ENTRY_L1 && lru->qid != LRU_ENTRY_L2)
+		return false;
+
+	if (!(atomic_postclear_uint32_t_bits(&lru->flags, LRU_REFERENCED) &
+	      LRU_REFERENCED))
+		return false;
+
+	if (lru->qid == LRU_ENTRY_L1) {
+		LRU_DQ_SAFE(lru, &qlane->L1);
+		lru_insert(lru, &qlane->L1, LRU_MRU);
+	} else {
+		LRU_DQ_SAFE(lru, &qlane->L2);
+		lru_insert(lru, &qlane->L1, LRU_LRU);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Admit a newly hashed entry
+ *
+ * With the 2Q policy, an entry whose hash is on the ghost list was
+ * reclaimed from probation recently and is now wanted again, so it
+ * moves to L1.  Other entries stay in probation.
+ *
+ * @param[in] entry  The new entry
+ */
+void
+mdcache_lru_admit(mdcache_entry_t *entry)
+{
+	mdcache_lru_t *lru = &entry->lru;
+	struct lru_q_lane *qlane = &LRU[lru->lane];
+
+	if (lru_state.policy != LRU_POLICY_2Q ||
+	    !lru_ghost_take(entry->fh_hk.key.hk))
+		return;
+
+	(void) atomic_inc_uint64_t(&cache_stp->lru_ghost_hit);
+
+	QLOCK(qlane);
+	if (lru->qid == LRU_ENTRY_PROBATION) {
+		LRU_DQ_SAFE(lru, &qlane->probation);
+		lru_insert(lru, &qlane->L1, LRU_MRU);
+	}
+	QUNLOCK(qlane);
+}
+
 /**
  * @brief Get a reference
  *
@@ -1204,9 +2161,6 @@ fsal_status_t
 _mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags, const char *func,
 		 int line)
 {
-	mdcache_lru_t *lru = &entry->lru;
-	struct lru_q_lane *qlane = &LRU[lru->lane];
-	struct lru_q *q;
 #ifdef USE_LTTNG
 	int32_t refcnt =
 #endif
@@ -1218,38 +2172,9 @@ _mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags, const char *func,
 #endif
 
 	/* adjust LRU on initial refs */
-	if (flags & LRU_REQ_INITIAL) {
-
-		/* do it less */
-		if ((atomic_inc_int32_t(&entry->lru.cf) % 3) != 0)
-			goto out;
+	if (flags & LRU_REQ_INITIAL)
+		mdcache_lru_promote(entry);
 
-		QLOCK(qlane);
-
-		switch (lru->qid) {
-		case LRU_ENTRY_L1:
-			q = lru_queue_of(entry);
-			/* advance entry to MRU (of L1) */
-			LRU_DQ_SAFE(lru, q);
-			lru_insert(lru, q, LRU_MRU);
-			++(q->size);
-			break;
-		case LRU_ENTRY_L2:
-			q = lru_queue_of(entry);
-			/* move entry to LRU of L1 */
-			glist_del(&lru->q);	/* skip L1 fixups */
-			--(q->size);
-			q = &qlane->L1;
-			lru_insert(lru, q, LRU_LRU);
-			++(q->size);
-			break;
-		default:
-			/* do nothing */
-			break;
-		}		/* switch qid */
-		QUNLOCK(qlane);
-	}			/* initial ref */
- out:
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -1281,7 +2206,12 @@ _mdcache_lru_unref(mdcache_entry_t *entry, uint32_t flags, const char *func,
 	bool other_lock_held = entry->fsobj.hdl.no_cleanup;
 	bool freed = false;
 
-	if (!qlocked && !other_lock_held) {
+	/* LRU_CLEANUP is set whenever an entry goes on the cleanup queue,
+	 * so unrefs of other entries need not take the lane lock.
+	 */
+	if (!qlocked && !other_lock_held &&
+	    (atomic_fetch_uint32_t(&entry->lru.flags) &
+	     (LRU_CLEANUP | LRU_CLEANED)) == LRU_CLEANUP) {
 		QLOCK(qlane);
 		if (((entry->lru.flags & LRU_CLEANED) == 0) &&
 		    (entry->lru.qid == LRU_ENTRY_CLEANUP)) {
@@ -1334,7 +2264,13 @@ _mdcache_lru_unref(mdcache_entry_t *entry, uint32_t flags, const char *func,
 			QUNLOCK(qlane);
 
 		mdcache_lru_clean(entry);
-		pool_free(mdcache_entry_pool, entry);
+		if (cih_fhcache.lockless) {
+			PTHREAD_MUTEX_lock(&lru_entry_free_mtx);
+			glist_add(&lru_entry_free, &entry->lru.q);
+			PTHREAD_MUTEX_unlock(&lru_entry_free_mtx);
+		} else {
+			pool_free(mdcache_entry_pool, entry);
+		}
 		freed = true;
 
 		(void) atomic_dec_int64_t(&lru_state.entries_used);
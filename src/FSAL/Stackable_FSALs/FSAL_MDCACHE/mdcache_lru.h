@@ -80,6 +80,13 @@ struct lru_state {
 	uint64_t prev_fd_count;	/* previous # of open fds */
 	time_t prev_time;	/* previous time the gc thread was run. */
 	bool caching_fds;
+	uint32_t policy;	/*< enum lru_policy */
+	/** 2Q: entries in probation, and the level above which
+	    probation is reclaimed first */
+	uint64_t probation_used;
+	uint64_t probation_target;
+	/** Bytes held by the cache, see mdcache_lru_mem() */
+	int64_t mem_used;
 };
 
 extern struct lru_state lru_state;
@@ -142,6 +149,8 @@ mdcache_entry_t *mdcache_lru_get(void);
 #define mdcache_lru_ref(e, f) _mdcache_lru_ref(e, f, __func__, __LINE__)
 fsal_status_t _mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags,
 			       const char *func, int line);
+void mdcache_lru_promote(mdcache_entry_t *entry);
+void mdcache_lru_admit(mdcache_entry_t *entry);
 
 /* XXX */
 void mdcache_lru_kill(mdcache_entry_t *entry);
@@ -152,6 +161,21 @@ void mdcache_lru_cleanup_try_push(mdcache_entry_t *entry);
 bool _mdcache_lru_unref(mdcache_entry_t *entry, uint32_t flags,
 			const char *func, int line);
 void lru_wake_thread(void);
+void mdcache_lru_fd_used(mdcache_entry_t *entry);
+void mdcache_lru_fd_closed(mdcache_entry_t *entry);
+size_t mdcache_lru_fd_reap(size_t count);
+void mdcache_lru_export_add(struct mdcache_fsal_export *exp);
+void mdcache_lru_export_del(struct mdcache_fsal_export *exp);
+void mdcache_lru_export_foreach(void (*cb)(struct mdcache_fsal_export *,
+					   void *),
+				void *arg);
+void mdcache_lru_walk_hot(void (*cb)(mdcache_entry_t *,
+				     struct mdcache_fsal_export *,
+				     size_t, void *),
+			  void *arg, uint32_t max);
+
+/** Global fds closed in line when the hard limit is reached */
+#define LRU_FD_REAP_BATCH 32
 void mdcache_lru_kill_for_shutdown(mdcache_entry_t *entry);
 
 /**
@@ -188,12 +212,16 @@ static inline void mdcache_put(mdcache_entry_t *entry)
 
 /**
  * Return true if there are FDs available to serve open requests,
- * false otherwise.  This function also wakes the LRU thread if the
- * current FD count is above the high water mark.
+ * false otherwise.  At the hard limit, the coldest global fds of the
+ * fd pool are closed first.  This function also wakes the LRU thread
+ * if the current FD count is above the high water mark.
  */
 
 static inline bool mdcache_lru_fds_available(void)
 {
+	if (atomic_fetch_size_t(&open_fd_count) >= lru_state.fds_hard_limit)
+		(void) mdcache_lru_fd_reap(LRU_FD_REAP_BATCH);
+
 	if ((atomic_fetch_size_t(&open_fd_count) >= lru_state.fds_hard_limit)
 	    && lru_state.caching_fds) {
 		LogCrit(COMPONENT_CACHE_INODE_LRU,
@@ -215,6 +243,49 @@ static inline bool mdcache_lru_fds_available(void)
  * Return true if we are currently caching file descriptors.
  */
 
+/**
+ * @brief Account for memory held by the cache
+ *
+ * Memory of an entry is charged to it as well, so that all of it is
+ * given back when the entry is cleaned.  Memory that can't be tied to
+ * an entry until it is freed, such as a dirent outside of a chunk, is
+ * charged with a NULL entry.
+ *
+ * @param[in] entry  The entry holding the memory, or NULL
+ * @param[in] delta  Bytes allocated, negative for bytes freed
+ */
+static inline void mdcache_lru_mem(mdcache_entry_t *entry, int64_t delta)
+{
+	if (entry != NULL)
+		(void) atomic_add_int64_t(&entry->mem, delta);
+	(void) atomic_add_int64_t(&lru_state.mem_used, delta);
+}
+
+/**
+ * @brief Account for a dirent chunk growing or shrinking
+ *
+ * @note The content lock of the directory MUST be held for write
+ *
+ * @param[in] chunk  The chunk
+ * @param[in] delta  Bytes allocated, negative for bytes freed
+ */
+static inline void mdcache_chunk_mem(struct dir_chunk *chunk, int64_t delta)
+{
+	chunk->parent->fsobj.fsdir.chunk_mem += delta;
+	mdcache_lru_mem(chunk->parent, delta);
+}
+
+/**
+ * @brief Bytes of an ACL
+ */
+static inline int64_t mdcache_acl_mem(fsal_acl_t *acl)
+{
+	if (acl == NULL)
+		return 0;
+
+	return sizeof(*acl) + acl->naces * sizeof(fsal_ace_t);
+}
+
 static inline bool mdcache_lru_caching_fds(void)
 {
 	return lru_state.caching_fds;
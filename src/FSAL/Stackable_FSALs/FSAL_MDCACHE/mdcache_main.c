@@ -43,10 +43,12 @@
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
 #endif
+#include "export_mgr.h"
 #include "FSAL/fsal_init.h"
 #include "FSAL/fsal_commonlib.h"
 #include "mdcache_hash.h"
 #include "mdcache_lru.h"
+#include "nfs_metrics.h"
 
 pool_t *mdcache_entry_pool;
 
@@ -265,6 +267,7 @@ mdcache_fsal_create_export(struct fsal_module *sub_fsal, void *parse_node,
 		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 #endif
 	PTHREAD_RWLOCK_init(&myself->mdc_exp_lock, &attrs);
+	PTHREAD_MUTEX_init(&myself->quota_lock, NULL);
 
 	status = sub_fsal->m_ops.create_export(sub_fsal,
 						 parse_node,
@@ -274,6 +277,7 @@ mdcache_fsal_create_export(struct fsal_module *sub_fsal, void *parse_node,
 		LogMajor(COMPONENT_FSAL,
 			 "Failed to call create_export on underlying FSAL %s",
 			 sub_fsal->name);
+		PTHREAD_MUTEX_destroy(&myself->quota_lock);
 		gsh_free(myself->name);
 		gsh_free(myself);
 		return status;
@@ -306,6 +310,12 @@ mdcache_fsal_unload(struct fsal_module *fsal_hdl)
 	fsal_status_t status;
 	int retval;
 
+	mdcache_readahead_pkgshutdown();
+	mdcache_preread_pkgshutdown();
+	mdcache_dirgc_pkgshutdown();
+	mdcache_prefetch_pkgshutdown();
+	mdcache_refresh_pkgshutdown();
+
 	/* Destroy the cache inode AVL tree */
 	cih_pkgdestroy();
 
@@ -375,8 +385,9 @@ fsal_status_t mdcache_pkginit(void)
 	if (mdcache_entry_pool)
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 
-	mdcache_entry_pool = pool_basic_init("MDCACHE Entry Pool",
-					     sizeof(mdcache_entry_t));
+	mdcache_entry_pool = pool_arena_init("MDCACHE Entry Pool",
+					     sizeof(mdcache_entry_t),
+					     MEM_ARENA_MDCACHE);
 
 	status = mdcache_lru_pkginit();
 	if (FSAL_IS_ERROR(status)) {
@@ -387,15 +398,64 @@ fsal_status_t mdcache_pkginit(void)
 
 	cih_pkginit();
 
+	if (mdcache_readahead_pkginit() != 0)
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Directory readahead disabled");
+
+	if (mdcache_preread_pkginit() != 0)
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Small file preread disabled");
+
+	if (mdcache_dirgc_pkginit() != 0)
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Background freeing of directory caches disabled");
+
+	if (mdcache_prefetch_pkginit() != 0)
+		LogWarn(COMPONENT_CACHE_INODE,
+			"READDIR attribute prefetch disabled");
+
+	if (mdcache_refresh_pkginit() != 0)
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Background attribute refresh disabled");
+
 	return status;
 }
 
 #ifdef USE_DBUS
+/* Append the cache use and hit rates of an export */
+static void mdcache_dbus_show_export(struct mdcache_fsal_export *exp,
+				     void *arg)
+{
+	DBusMessageIter *array_iter = arg;
+	DBusMessageIter struct_iter;
+	int64_t entries = atomic_fetch_int64_t(&exp->entries);
+	uint64_t val;
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT16,
+				       &exp->owner->export_id);
+	val = entries > 0 ? entries : 0;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&exp->dirent_mem);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&exp->hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&exp->misses);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&exp->quota_hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&exp->quota_misses);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+
 void mdcache_dbus_show(DBusMessageIter *iter)
 {
 	struct timespec timestamp;
 	DBusMessageIter struct_iter;
 	char *type;
+	int64_t mem;
 
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
@@ -426,9 +486,149 @@ void mdcache_dbus_show(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 					&cache_st.inode_mapping);
+	type = "cache_ghost_added";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.lru_ghost_add);
+	type = "cache_ghost_hit";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.lru_ghost_hit);
+	type = "cache_mem_bytes";
+	mem = atomic_fetch_int64_t(&lru_state.mem_used);
+	mem = mem > 0 ? mem : 0;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &mem);
+	type = "cache_readlink_hit";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.readlink_hit);
+	type = "cache_readlink_miss";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.readlink_miss);
+	type = "cache_xattr_hit";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.xattr_hit);
+	type = "cache_xattr_miss";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.xattr_miss);
 
 	dbus_message_iter_close_container(iter, &struct_iter);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(qtttttt)",
+					 &struct_iter);
+	mdcache_lru_export_foreach(mdcache_dbus_show_export, &struct_iter);
+	dbus_message_iter_close_container(iter, &struct_iter);
 }
 #endif /* USE_DBUS */
 
+/* Counters of the cache as a whole */
+static const struct {
+	const char *name;
+	const char *help;
+	uint64_t *val;
+} mdcache_metrics_global[] = {
+	{ "ganesha_mdcache_requests", "Lookups of the cache",
+	  &cache_st.inode_req },
+	{ "ganesha_mdcache_hits", "Lookups that found an entry",
+	  &cache_st.inode_hit },
+	{ "ganesha_mdcache_misses", "Lookups that found none",
+	  &cache_st.inode_miss },
+	{ "ganesha_mdcache_conflicts", "Entries added by two threads at once",
+	  &cache_st.inode_conf },
+	{ "ganesha_mdcache_added", "Entries added",
+	  &cache_st.inode_added },
+	{ "ganesha_mdcache_mappings", "Entries mapped into another export",
+	  &cache_st.inode_mapping },
+	{ "ganesha_mdcache_ghost_added", "Keys remembered after reclaim",
+	  &cache_st.lru_ghost_add },
+	{ "ganesha_mdcache_ghost_hits", "Misses on a remembered key",
+	  &cache_st.lru_ghost_hit },
+	{ "ganesha_mdcache_readlink_hits", "Symlinks read from the cache",
+	  &cache_st.readlink_hit },
+	{ "ganesha_mdcache_readlink_misses", "Symlinks read from the FSAL",
+	  &cache_st.readlink_miss },
+	{ "ganesha_mdcache_xattr_hits", "Xattr reads answered from the cache",
+	  &cache_st.xattr_hit },
+	{ "ganesha_mdcache_xattr_misses", "Cacheable xattr reads sent on",
+	  &cache_st.xattr_miss },
+};
+
+static void mdcache_metrics_export(struct mdcache_fsal_export *exp,
+				   void *arg)
+{
+	FILE *out = arg;
+	int64_t entries = atomic_fetch_int64_t(&exp->entries);
+
+	fprintf(out, "ganesha_mdcache_export_entries{export_id=\"%u\"} %"
+		PRIi64 "\n", exp->owner->export_id,
+		entries > 0 ? entries : 0);
+}
+
+static void mdcache_metrics_hits(struct mdcache_fsal_export *exp,
+				 void *arg)
+{
+	FILE *out = arg;
+
+	fprintf(out, "ganesha_mdcache_export_hits_total{export_id=\"%u\"} %"
+		PRIu64 "\n", exp->owner->export_id,
+		atomic_fetch_uint64_t(&exp->hits));
+}
+
+static void mdcache_metrics_misses(struct mdcache_fsal_export *exp,
+				   void *arg)
+{
+	FILE *out = arg;
+
+	fprintf(out, "ganesha_mdcache_export_misses_total{export_id=\"%u\"} %"
+		PRIu64 "\n", exp->owner->export_id,
+		atomic_fetch_uint64_t(&exp->misses));
+}
+
+/**
+ * @brief Write the cache and LRU stats as OpenMetrics
+ *
+ * @param[in] out Stream being rendered
+ */
+void mdcache_metrics(FILE *out)
+{
+	int64_t mem = atomic_fetch_int64_t(&lru_state.mem_used);
+	size_t i;
+
+	for (i = 0; i < sizeof(mdcache_metrics_global) /
+			sizeof(mdcache_metrics_global[0]); i++) {
+		metrics_family(out, mdcache_metrics_global[i].name, "counter",
+			       mdcache_metrics_global[i].help);
+		fprintf(out, "%s_total %" PRIu64 "\n",
+			mdcache_metrics_global[i].name,
+			atomic_fetch_uint64_t(mdcache_metrics_global[i].val));
+	}
+
+	metrics_family(out, "ganesha_mdcache_entries", "gauge",
+		       "Entries in the cache");
+	fprintf(out, "ganesha_mdcache_entries %" PRIu64 "\n",
+		atomic_fetch_uint64_t(&lru_state.entries_used));
+	metrics_family(out, "ganesha_mdcache_entries_hiwat", "gauge",
+		       "Entries the cache reclaims down to");
+	fprintf(out, "ganesha_mdcache_entries_hiwat %" PRIu64 "\n",
+		lru_state.entries_hiwat);
+	metrics_family(out, "ganesha_mdcache_memory_bytes", "gauge",
+		       "Bytes held by the cache");
+	fprintf(out, "ganesha_mdcache_memory_bytes %" PRIi64 "\n",
+		mem > 0 ? mem : 0);
+
+	metrics_family(out, "ganesha_mdcache_export_entries", "gauge",
+		       "Entries of an export in the cache");
+	mdcache_lru_export_foreach(mdcache_metrics_export, out);
+	metrics_family(out, "ganesha_mdcache_export_hits", "counter",
+		       "Lookups of an export that found an entry");
+	mdcache_lru_export_foreach(mdcache_metrics_hits, out);
+	metrics_family(out, "ganesha_mdcache_export_misses", "counter",
+		       "Lookups of an export that found none");
+	mdcache_lru_export_foreach(mdcache_metrics_misses, out);
+}
+
 /** @} */
@@ -52,6 +52,24 @@
 
 struct mdcache_parameter mdcache_param;
 
+static struct config_item_list cih_backends[] = {
+	CONFIG_LIST_TOK("AVL", CIH_BACKEND_AVL),
+	CONFIG_LIST_TOK("Open_Addressing", CIH_BACKEND_OAHASH),
+	CONFIG_LIST_EOL
+};
+
+static struct config_item_list cih_key_hashes[] = {
+	CONFIG_LIST_TOK("City", CIH_KEY_HASH_CITY),
+	CONFIG_LIST_TOK("CRC32C", CIH_KEY_HASH_CRC32C),
+	CONFIG_LIST_EOL
+};
+
+static struct config_item_list lru_policies[] = {
+	CONFIG_LIST_TOK("LRU", LRU_POLICY_LRU),
+	CONFIG_LIST_TOK("TwoQ", LRU_POLICY_2Q),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item mdcache_params[] = {
 	CONF_ITEM_UI32("NParts", 1, 32633, 7,
 		       mdcache_parameter, nparts),
@@ -59,14 +77,46 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, cache_size),
 	CONF_ITEM_BOOL("Use_Getattr_Directory_Invalidation", false,
 		       mdcache_parameter, getattr_dir_invalidation),
+	CONF_ITEM_BOOL("Lockless_Lookup", false,
+		       mdcache_parameter, lockless_lookup),
+	CONF_ITEM_BOOL("Handle_Cache_Hint", false,
+		       mdcache_parameter, handle_cache_hint),
+	CONF_ITEM_TOKEN("Hash_Backend", CIH_BACKEND_AVL, cih_backends,
+			mdcache_parameter, hash_backend),
+	CONF_ITEM_TOKEN("Handle_Hash", CIH_KEY_HASH_CITY, cih_key_hashes,
+			mdcache_parameter, key_hash),
 	CONF_ITEM_UI32("Dir_Max_Deleted", 1, UINT32_MAX, 65536,
 		       mdcache_parameter, dir.avl_max_deleted),
 	CONF_ITEM_UI32("Dir_Max", 1, UINT32_MAX, 65536,
 		       mdcache_parameter, dir.avl_max),
 	CONF_ITEM_UI32("Dir_Chunk", 0, UINT32_MAX, 128,
 		       mdcache_parameter, dir.avl_chunk),
+	CONF_ITEM_UI32("Dir_Readahead", 0, 64, 0,
+		       mdcache_parameter, dir.readahead),
+	CONF_ITEM_UI32("Dir_Attr_Prefetch", 0, 64, 0,
+		       mdcache_parameter, dir.attr_prefetch),
+	CONF_ITEM_UI32("Negative_Lookup_TTL", 0, 3600, 0,
+		       mdcache_parameter, dir.neg_ttl),
+	CONF_ITEM_UI32("Negative_Lookup_Slots", 1, 65536, 256,
+		       mdcache_parameter, dir.neg_slots),
+	CONF_ITEM_BOOL("Unlocked_Lookup", false,
+		       mdcache_parameter, dir.unlocked_lookup),
+	CONF_ITEM_UI32("Dir_Index_Min", 0, UINT32_MAX, 0,
+		       mdcache_parameter, dir.index_min),
+	CONF_ITEM_UI32("Dir_Lazy_Free_Min", 0, UINT32_MAX, 0,
+		       mdcache_parameter, dir.lazy_free_min),
+	CONF_ITEM_BOOL("Upcall_Lease", false,
+		       mdcache_parameter, upcall_lease),
+	CONF_ITEM_UI32("Attr_Refresh_Ahead", 0, 99, 0,
+		       mdcache_parameter, attr_refresh_ahead),
+	CONF_ITEM_UI32("Attr_Refresh_Hits", 1, UINT32_MAX, 4,
+		       mdcache_parameter, attr_refresh_hits),
+	CONF_ITEM_UI32("Attr_Refresh_Rate", 0, UINT32_MAX, 1000,
+		       mdcache_parameter, attr_refresh_rate),
 	CONF_ITEM_UI32("Entries_HWMark", 1, UINT32_MAX, 100000,
 		       mdcache_parameter, entries_hwmark),
+	CONF_ITEM_UI64("Memory_HWMark_Bytes", 0, UINT64_MAX, 0,
+		       mdcache_parameter, memory_hwmark_bytes),
 	CONF_ITEM_UI32("LRU_Run_Interval", 1, 24 * 3600, 90,
 		       mdcache_parameter, lru_run_interval),
 	CONF_ITEM_BOOL("Cache_FDs", true,
@@ -85,8 +135,44 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, required_progress),
 	CONF_ITEM_UI32("Futility_Count", 1, 50, 8,
 		       mdcache_parameter, futility_count),
+	CONF_ITEM_TOKEN("LRU_Policy", LRU_POLICY_LRU, lru_policies,
+			mdcache_parameter, lru_policy),
+	CONF_ITEM_UI32("LRU_2Q_In_Percent", 1, 90, 25,
+		       mdcache_parameter, lru_2q_in_percent),
+	CONF_ITEM_UI32("LRU_2Q_Ghost_Percent", 1, 200, 50,
+		       mdcache_parameter, lru_2q_ghost_percent),
 	CONF_ITEM_BOOL("Retry_Readdir", false,
 		       mdcache_parameter, retry_readdir),
+	CONF_ITEM_UI32("Write_Gather_Max", 0, 16 * 1024 * 1024, 0,
+		       mdcache_parameter, write_gather_max),
+	CONF_ITEM_UI32("Open_Preread_Max", 0, 1024 * 1024, 0,
+		       mdcache_parameter, open_preread_max),
+	CONF_ITEM_BOOL("Commit_Coalesce", false,
+		       mdcache_parameter, commit_coalesce),
+	CONF_ITEM_UI32("Quota_Cache_TTL", 0, 3600, 5,
+		       mdcache_parameter, quota_ttl),
+	CONF_ITEM_PATH("Snapshot_File", 1, MAXPATHLEN, NULL,
+		       mdcache_parameter, snapshot_file),
+	CONF_ITEM_UI32("Snapshot_Interval", 0, 24 * 3600, 300,
+		       mdcache_parameter, snapshot_interval),
+	CONF_ITEM_UI32("Snapshot_Entries", 1, UINT32_MAX, 100000,
+		       mdcache_parameter, snapshot_entries),
+	CONF_ITEM_UI32("Snapshot_Prefetch_Rate", 1, 1000000, 1000,
+		       mdcache_parameter, snapshot_rate),
+	CONF_ITEM_STR("Xattr_Cache_Namespaces", 1, 1024, NULL,
+		      mdcache_parameter, xattr_namespaces),
+	CONF_ITEM_UI32("Xattr_Cache_Value_Max", 0, 65536, 256,
+		       mdcache_parameter, xattr_value_max),
+	CONF_ITEM_UI32("Xattr_Cache_Entry_Bytes", 0, 1024 * 1024, 4096,
+		       mdcache_parameter, xattr_entry_bytes),
+	CONF_ITEM_UI32("Access_Cache_Slots", 0, MDC_ACCESS_SLOTS, 0,
+		       mdcache_parameter, access_slots),
+	CONF_ITEM_BOOL("Lockless_Getattr", false,
+		       mdcache_parameter, lockless_getattr),
+	CONF_ITEM_BOOL("Change_Probe", false,
+		       mdcache_parameter, change_probe),
+	CONF_ITEM_BOOL("FSAL_Latency_Histograms", false,
+		       mdcache_parameter, fsal_call_hists),
 	CONFIG_EOL
 };
 
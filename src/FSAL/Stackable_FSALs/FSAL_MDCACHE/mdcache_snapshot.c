@@ -0,0 +1,565 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_snapshot.c
+ * @brief Warm start of the cache from a snapshot of its hottest keys
+ *
+ * With Snapshot_File set, the keys of the hottest entries of the
+ * cache, and the parent keys of directories, are written to the file
+ * every Snapshot_Interval seconds and at shutdown.  At startup a
+ * thread maps the file and looks the entries up again from the
+ * sub-FSAL, hottest first and at most Snapshot_Prefetch_Rate a second,
+ * so a restarted server does not answer its first requests from a cold
+ * cache.  Only keys are kept; attributes and dirents are fetched anew.
+ *
+ * The file is a header followed by records in the order they are
+ * restored, each a struct mdc_snap_rec, the key, and the parent key,
+ * padded to 8 bytes.  It is in host byte order and only meant to be
+ * read by the server that wrote it.  It is written to a temporary file
+ * renamed over the old one, so a crash leaves the last snapshot.
+ */
+
+#include "config.h"
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "fsal.h"
+#include "log.h"
+#include "fridgethr.h"
+#include "export_mgr.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+#include "mdcache_hash.h"
+#include "mdcache.h"
+
+#define MDC_SNAP_MAGIC 0x5343444d	/* "MDCS" */
+#define MDC_SNAP_VERSION 1
+
+struct mdc_snap_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t count;		/*< records that follow */
+};
+
+struct mdc_snap_rec {
+	uint16_t export_id;
+	uint16_t key_len;
+	uint16_t parent_len;	/*< 0 unless a directory with a parent */
+	uint16_t pad;
+};
+
+#define MDC_SNAP_REC_LEN(klen, plen) \
+	((sizeof(struct mdc_snap_rec) + (klen) + (plen) + 7) & ~(size_t) 7)
+
+/** Records of one LRU lane, hottest first */
+struct mdc_snap_lane {
+	char *buf;
+	size_t len;
+	size_t size;
+	size_t off;		/*< next record when merging */
+};
+
+static struct fridgethr *mdc_snap_fridge;
+
+static struct {
+	/** The snapshot being restored, while warming up */
+	char *map;
+	size_t map_len;
+	size_t off;
+	uint64_t left;
+	/** The export of the last record restored, NULL if unusable */
+	bool have_export;
+	uint16_t export_id;
+	struct gsh_export *export;
+	bool warming;
+	time_t next_save;
+	uint64_t restored;
+} mdc_snap;
+
+/**
+ * @brief Copy the keys of an entry into its lane's records
+ *
+ * Called from mdcache_lru_walk_hot() with the lane locked.
+ */
+static void mdc_snap_add(mdcache_entry_t *entry,
+			 struct mdcache_fsal_export *exp,
+			 size_t lane, void *arg)
+{
+	struct mdc_snap_lane *sl = (struct mdc_snap_lane *)arg + lane;
+	struct mdc_snap_rec rec;
+	char *p;
+	size_t len;
+	void *parent = NULL;
+
+	if (exp == NULL || exp->owner == NULL ||
+	    entry->fh_hk.key.kv.len > UINT16_MAX)
+		return;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.export_id = exp->owner->export_id;
+	rec.key_len = entry->fh_hk.key.kv.len;
+
+	/* The parent key is set under the content lock, which ranks
+	 * above the lane lock. */
+	if (entry->obj_handle.type == DIRECTORY &&
+	    pthread_rwlock_tryrdlock(&entry->content_lock) == 0) {
+		if (entry->fsobj.fsdir.parent.kv.len <= UINT16_MAX) {
+			rec.parent_len = entry->fsobj.fsdir.parent.kv.len;
+			parent = entry->fsobj.fsdir.parent.kv.addr;
+		}
+		len = MDC_SNAP_REC_LEN(rec.key_len, rec.parent_len);
+		if (sl->len + len > sl->size) {
+			sl->size = MAX(sl->size * 2, sl->len + len);
+			sl->buf = gsh_realloc(sl->buf, sl->size);
+		}
+		p = sl->buf + sl->len;
+		memset(p, 0, len);
+		if (parent != NULL)
+			memcpy(p + sizeof(rec) + rec.key_len, parent,
+			       rec.parent_len);
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	} else {
+		len = MDC_SNAP_REC_LEN(rec.key_len, 0);
+		if (sl->len + len > sl->size) {
+			sl->size = MAX(sl->size * 2, sl->len + len);
+			sl->buf = gsh_realloc(sl->buf, sl->size);
+		}
+		p = sl->buf + sl->len;
+		memset(p, 0, len);
+	}
+
+	memcpy(p, &rec, sizeof(rec));
+	memcpy(p + sizeof(rec), entry->fh_hk.key.kv.addr, rec.key_len);
+	sl->len += len;
+}
+
+/**
+ * @brief Write the hottest keys of the cache to Snapshot_File
+ *
+ * The lanes are walked one at a time, then merged taking one record
+ * from each lane in turn, so the file starts with the hottest entries
+ * of every lane.
+ */
+static void mdc_snapshot_save(void)
+{
+	struct mdc_snap_lane *lanes;
+	struct mdc_snap_hdr hdr;
+	char tmp[MAXPATHLEN + 8];
+	FILE *fp;
+	size_t lane, left, len;
+	uint32_t max;
+	int rc = 0;
+
+	max = (mdcache_param.snapshot_entries + LRU_N_Q_LANES - 1) /
+		LRU_N_Q_LANES;
+	lanes = gsh_calloc(LRU_N_Q_LANES, sizeof(*lanes));
+	mdcache_lru_walk_hot(mdc_snap_add, lanes, max);
+
+	(void) snprintf(tmp, sizeof(tmp), "%s.tmp",
+			mdcache_param.snapshot_file);
+	fp = fopen(tmp, "w");
+	if (fp == NULL) {
+		rc = errno;
+		goto out;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = MDC_SNAP_MAGIC;
+	hdr.version = MDC_SNAP_VERSION;
+	for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
+		struct mdc_snap_lane *sl = &lanes[lane];
+
+		for (len = 0; len < sl->len; ++hdr.count) {
+			struct mdc_snap_rec *rec =
+				(struct mdc_snap_rec *)(sl->buf + len);
+
+			len += MDC_SNAP_REC_LEN(rec->key_len,
+						rec->parent_len);
+		}
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+		rc = EIO;
+
+	for (left = hdr.count; left != 0 && rc == 0;) {
+		for (lane = 0; lane < LRU_N_Q_LANES && rc == 0; ++lane) {
+			struct mdc_snap_lane *sl = &lanes[lane];
+			struct mdc_snap_rec *rec;
+
+			if (sl->off == sl->len)
+				continue;
+			rec = (struct mdc_snap_rec *)(sl->buf + sl->off);
+			len = MDC_SNAP_REC_LEN(rec->key_len, rec->parent_len);
+			if (fwrite(rec, len, 1, fp) != 1)
+				rc = EIO;
+			sl->off += len;
+			--left;
+		}
+	}
+
+	if (fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+		rc = errno;
+	if (fclose(fp) != 0 && rc == 0)
+		rc = errno;
+	if (rc == 0 && rename(tmp, mdcache_param.snapshot_file) != 0)
+		rc = errno;
+	if (rc != 0)
+		(void) unlink(tmp);
+	else
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Saved %"PRIu64" entries to cache snapshot %s",
+			 hdr.count, mdcache_param.snapshot_file);
+
+out:
+	if (rc != 0)
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Could not write cache snapshot %s: %s",
+			tmp, strerror(rc));
+
+	for (lane = 0; lane < LRU_N_Q_LANES; ++lane)
+		gsh_free(lanes[lane].buf);
+	gsh_free(lanes);
+}
+
+/**
+ * @brief Map the snapshot left by the last run, if any
+ *
+ * @return true if there is something to restore.
+ */
+static bool mdc_snapshot_open(void)
+{
+	struct mdc_snap_hdr *hdr;
+	struct stat st;
+	int fd;
+
+	fd = open(mdcache_param.snapshot_file, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			LogWarn(COMPONENT_CACHE_INODE,
+				"Could not open cache snapshot %s: %s",
+				mdcache_param.snapshot_file, strerror(errno));
+		return false;
+	}
+
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(*hdr)) {
+		close(fd);
+		return false;
+	}
+
+	mdc_snap.map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mdc_snap.map == MAP_FAILED) {
+		mdc_snap.map = NULL;
+		return false;
+	}
+	mdc_snap.map_len = st.st_size;
+
+	hdr = (struct mdc_snap_hdr *)mdc_snap.map;
+	if (hdr->magic != MDC_SNAP_MAGIC || hdr->version != MDC_SNAP_VERSION) {
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Ignoring cache snapshot %s of another format",
+			mdcache_param.snapshot_file);
+		munmap(mdc_snap.map, mdc_snap.map_len);
+		mdc_snap.map = NULL;
+		return false;
+	}
+
+	(void) madvise(mdc_snap.map, mdc_snap.map_len, MADV_SEQUENTIAL);
+	mdc_snap.off = sizeof(*hdr);
+	mdc_snap.left = hdr->count;
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Warming up the cache with %"PRIu64" entries from %s",
+		 mdc_snap.left, mdcache_param.snapshot_file);
+
+	return true;
+}
+
+static void mdc_snapshot_close(void)
+{
+	if (mdc_snap.export != NULL)
+		put_gsh_export(mdc_snap.export);
+	mdc_snap.export = NULL;
+	mdc_snap.have_export = false;
+
+	if (mdc_snap.map != NULL)
+		munmap(mdc_snap.map, mdc_snap.map_len);
+	mdc_snap.map = NULL;
+	mdc_snap.warming = false;
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Cache warm up done, %"PRIu64" entries restored",
+		 mdc_snap.restored);
+}
+
+/**
+ * @brief Find the export of a record
+ *
+ * The last one is kept, since the records of an export tend to
+ * follow each other.  Exports gone since the snapshot, or not cached
+ * by MDCACHE, are skipped.
+ */
+static struct gsh_export *mdc_snap_export(uint16_t export_id)
+{
+	if (mdc_snap.have_export && mdc_snap.export_id == export_id)
+		return mdc_snap.export;
+
+	if (mdc_snap.export != NULL)
+		put_gsh_export(mdc_snap.export);
+
+	mdc_snap.have_export = true;
+	mdc_snap.export_id = export_id;
+	mdc_snap.export = get_gsh_export(export_id);
+	if (mdc_snap.export != NULL &&
+	    strcmp(mdc_snap.export->fsal_export->fsal->name,
+		   mdcachename) != 0) {
+		put_gsh_export(mdc_snap.export);
+		mdc_snap.export = NULL;
+	}
+
+	return mdc_snap.export;
+}
+
+/**
+ * @brief Bring the entry of one record back into the cache
+ */
+static void mdc_snap_restore(struct mdc_snap_rec *rec)
+{
+	struct gsh_export *export = mdc_snap_export(rec->export_id);
+	struct root_op_context root_op_context;
+	struct mdcache_fsal_export *myself;
+	struct gsh_buffdesc fh_desc;
+	mdcache_entry_t *entry;
+	mdcache_key_t key, parent;
+	fsal_status_t status;
+
+	if (export == NULL)
+		return;
+
+	init_root_op_context(&root_op_context, export, export->fsal_export,
+			     0, 0, UNKNOWN_REQUEST);
+	myself = mdc_cur_export();
+
+	fh_desc.addr = rec + 1;
+	fh_desc.len = rec->key_len;
+	(void) cih_hash_key(&key, myself->export.sub_export->fsal, &fh_desc,
+			    CIH_HASH_KEY_PROTOTYPE);
+
+	status = mdcache_locate_keyed(&key, myself, &entry, NULL);
+	if (FSAL_IS_ERROR(status)) {
+		/* Gone, or the FSAL's handles did not survive */
+		release_root_op_context();
+		return;
+	}
+
+	if (entry->obj_handle.type == DIRECTORY && rec->parent_len != 0) {
+		parent.kv.addr = (char *)(rec + 1) + rec->key_len;
+		parent.kv.len = rec->parent_len;
+		parent.hk = 0;
+		parent.fsal = myself->export.sub_export->fsal;
+
+		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+		if (entry->fsobj.fsdir.parent.kv.len == 0)
+			mdcache_key_dup(&entry->fsobj.fsdir.parent, &parent);
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	}
+
+	mdcache_put(entry);
+	release_root_op_context();
+	mdc_snap.restored++;
+}
+
+/**
+ * @brief Restore up to a second's worth of records
+ *
+ * Warming stops early once the cache is full, so that the snapshot
+ * does not push out what clients have used since startup.
+ */
+static void mdc_snapshot_warm(struct fridgethr_context *ctx)
+{
+	uint32_t n;
+
+	for (n = 0; n < mdcache_param.snapshot_rate && mdc_snap.left != 0;
+	     ++n) {
+		struct mdc_snap_rec *rec;
+		size_t len;
+
+		if (fridgethr_you_should_break(ctx))
+			return;
+
+		if (lru_state.entries_used >= lru_state.entries_hiwat) {
+			mdc_snap.left = 0;
+			break;
+		}
+
+		if (mdc_snap.map_len - mdc_snap.off < sizeof(*rec))
+			break;
+		rec = (struct mdc_snap_rec *)(mdc_snap.map + mdc_snap.off);
+		len = MDC_SNAP_REC_LEN(rec->key_len, rec->parent_len);
+		if (mdc_snap.map_len - mdc_snap.off < len) {
+			LogWarn(COMPONENT_CACHE_INODE,
+				"Cache snapshot %s is truncated",
+				mdcache_param.snapshot_file);
+			mdc_snap.left = 0;
+			break;
+		}
+
+		mdc_snap_restore(rec);
+		mdc_snap.off += len;
+		mdc_snap.left--;
+	}
+
+	if (mdc_snap.left == 0 ||
+	    mdc_snap.map_len - mdc_snap.off < sizeof(struct mdc_snap_rec))
+		mdc_snapshot_close();
+}
+
+/**
+ * @brief Snapshot thread
+ *
+ * Wakes every second while warming up, then every Snapshot_Interval
+ * to save the cache.
+ *
+ * @param[in] ctx Thread context
+ */
+static void mdc_snapshot_run(struct fridgethr_context *ctx)
+{
+	SetNameFunction("mdc_snapshot");
+
+	if (mdc_snap.warming) {
+		mdc_snapshot_warm(ctx);
+		if (!mdc_snap.warming) {
+			mdc_snap.next_save = time(NULL) +
+				mdcache_param.snapshot_interval;
+			fridgethr_setwait(ctx,
+					  mdcache_param.snapshot_interval != 0
+					  ? mdcache_param.snapshot_interval
+					  : 3600);
+		}
+		return;
+	}
+
+	if (mdcache_param.snapshot_interval != 0 &&
+	    time(NULL) >= mdc_snap.next_save) {
+		mdc_snapshot_save();
+		mdc_snap.next_save = time(NULL) +
+			mdcache_param.snapshot_interval;
+	}
+}
+
+/**
+ * @brief Start warming up the cache from the last snapshot
+ *
+ * Called once the exports are set up, so the records can be matched
+ * to them.  Does nothing unless Snapshot_File is set.
+ */
+void mdcache_snapshot_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (mdcache_param.snapshot_file == NULL || mdc_snap_fridge != NULL)
+		return;
+
+	mdc_snap.warming = mdc_snapshot_open();
+	mdc_snap.next_save = time(NULL) + mdcache_param.snapshot_interval;
+
+	memset(&frp, 0, sizeof(frp));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = mdc_snap.warming ? 1
+		: mdcache_param.snapshot_interval != 0
+		? mdcache_param.snapshot_interval : 3600;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&mdc_snap_fridge, "MDC_Snapshot", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize snapshot fridge, error code %d.",
+			 rc);
+		goto fail;
+	}
+
+	rc = fridgethr_submit(mdc_snap_fridge, mdc_snapshot_run, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to start snapshot thread, error code %d.", rc);
+		fridgethr_destroy(mdc_snap_fridge);
+		goto fail;
+	}
+
+	return;
+
+fail:
+	mdc_snap_fridge = NULL;
+	if (mdc_snap.warming)
+		mdc_snapshot_close();
+}
+
+/**
+ * @brief Stop the snapshot thread and save the cache
+ *
+ * Called at shutdown while the exports are still there.  A snapshot
+ * still being restored is left in place rather than replaced by the
+ * part of it restored so far.
+ */
+void mdcache_snapshot_pkgshutdown(void)
+{
+	int rc;
+
+	if (mdc_snap_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(mdc_snap_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Snapshot shutdown timed out, cancelling threads.");
+		fridgethr_cancel(mdc_snap_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down snapshot thread: %d", rc);
+	}
+
+	fridgethr_destroy(mdc_snap_fridge);
+	mdc_snap_fridge = NULL;
+
+	if (rc != 0)
+		return;
+
+	if (mdc_snap.warming)
+		mdc_snapshot_close();
+	else
+		mdc_snapshot_save();
+}
+
+/** @} */
@@ -37,6 +37,30 @@
 #include "nfs4_acls.h"
 #include "mdcache_hash.h"
 #include "mdcache_int.h"
+#include "mdcache_lru.h"
+
+/**
+ * @brief Invalidate what flags say of a cached entry
+ *
+ * @param[in] entry Referenced entry
+ * @param[in] flags FSAL_UP_INVALIDATE_*
+ *
+ * @return FSAL status
+ */
+static fsal_status_t
+mdc_up_invalidate_entry(mdcache_entry_t *entry, uint32_t flags)
+{
+	atomic_clear_uint32_t_bits(&entry->mde_flags,
+				   flags & FSAL_UP_INVALIDATE_CACHE);
+
+	if (flags & FSAL_UP_INVALIDATE_ATTRS)
+		mdc_xattr_invalidate(entry);
+
+	if (flags & FSAL_UP_INVALIDATE_CLOSE)
+		return fsal_close(&entry->obj_handle);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
 
 static fsal_status_t
 mdc_up_invalidate(struct fsal_export *export, struct gsh_buffdesc *handle,
@@ -65,17 +89,106 @@ mdc_up_invalidate(struct fsal_export *export, struct gsh_buffdesc *handle,
 		return status;
 	}
 
-	atomic_clear_uint32_t_bits(&entry->mde_flags,
-				   flags & FSAL_UP_INVALIDATE_CACHE);
-
-	if (flags & FSAL_UP_INVALIDATE_CLOSE)
-		status = fsal_close(&entry->obj_handle);
+	status = mdc_up_invalidate_entry(entry, flags);
 
 	mdcache_put(entry);
 	op_ctx = save_ctx;
 	return status;
 }
 
+struct mdc_up_inv {
+	mdcache_key_t key;
+	uint32_t flags;
+	mdcache_entry_t *entry;
+};
+
+static int mdc_up_inv_cmpf(const void *a, const void *b)
+{
+	const struct mdc_up_inv *l = a, *r = b;
+	uint64_t lp = l->key.hk % cih_fhcache.npart;
+	uint64_t rp = r->key.hk % cih_fhcache.npart;
+
+	if (lp != rp)
+		return lp < rp ? -1 : 1;
+	if (l->key.hk != r->key.hk)
+		return l->key.hk < r->key.hk ? -1 : 1;
+	return 0;
+}
+
+/**
+ * @brief Invalidate a batch of cached objects
+ *
+ * The keys are sorted by hash partition, so each partition's lock is
+ * taken once for all the keys falling in it.  The entries found are
+ * referenced under the lock and invalidated after it is dropped.
+ *
+ * @param[in] export FSAL export
+ * @param[in] inv    Objects and what to invalidate of each
+ * @param[in] count  Number of objects
+ */
+static void
+mdc_up_invalidate_batch(struct fsal_export *export,
+			struct fsal_up_invalidate *inv, uint32_t count)
+{
+	struct mdcache_fsal_export *myself = mdc_export(export);
+	struct req_op_context *save_ctx, req_ctx = {0};
+	struct mdc_up_inv *items;
+	cih_latch_t latch;
+	uint64_t part;
+	uint32_t i, j;
+	fsal_status_t status;
+
+	req_ctx.fsal_export = &myself->export;
+	save_ctx = op_ctx;
+	op_ctx = &req_ctx;
+
+	items = gsh_calloc(count, sizeof(*items));
+
+	for (i = 0; i < count; i++) {
+		items[i].key.fsal = export->sub_export->fsal;
+		(void) cih_hash_key(&items[i].key, export->sub_export->fsal,
+				    &inv[i].obj, CIH_HASH_KEY_PROTOTYPE);
+		items[i].flags = inv[i].flags;
+	}
+
+	qsort(items, count, sizeof(*items), mdc_up_inv_cmpf);
+
+	for (i = 0; i < count; i = j) {
+		part = items[i].key.hk % cih_fhcache.npart;
+		if (!cih_latch_entry(&items[i].key, &latch, CIH_GET_RLOCK,
+				     __func__, __LINE__)) {
+			for (j = i; j < count &&
+			     items[j].key.hk % cih_fhcache.npart == part; j++)
+				;
+			continue;
+		}
+
+		for (j = i; j < count &&
+		     items[j].key.hk % cih_fhcache.npart == part; j++) {
+			items[j].entry =
+			    cih_get_by_key_latched(&items[j].key, &latch);
+			if (items[j].entry == NULL)
+				continue;
+			status = mdcache_lru_ref(items[j].entry,
+						 LRU_REQ_INITIAL);
+			if (FSAL_IS_ERROR(status))
+				items[j].entry = NULL;
+		}
+
+		cih_hash_release(&latch);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (items[i].entry == NULL)
+			continue;
+		(void) mdc_up_invalidate_entry(items[i].entry, items[i].flags);
+		mdcache_put(items[i].entry);
+	}
+
+	gsh_free(items);
+	op_ctx = save_ctx;
+}
+
 /**
  * @brief Update cached attributes
  *
@@ -154,7 +267,7 @@ mdc_up_update(struct fsal_export *export, struct gsh_buffdesc *handle,
 		goto out;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	MDC_ATTR_WRLOCK(entry);
 
 	if (attr->expire_time_attr != 0)
 		entry->attrs.expire_time_attr = attr->expire_time_attr;
@@ -192,6 +305,8 @@ mdc_up_update(struct fsal_export *export, struct gsh_buffdesc *handle,
 		 * an asynchronous call.
 		 */
 
+		mdcache_lru_mem(entry, mdcache_acl_mem(attr->acl) -
+				mdcache_acl_mem(entry->attrs.acl));
 		nfs4_acl_release_entry(entry->attrs.acl);
 
 		entry->attrs.acl = attr->acl;
@@ -278,7 +393,7 @@ mdc_up_update(struct fsal_export *export, struct gsh_buffdesc *handle,
 		status = fsalstat(ERR_FSAL_INVAL, 0);
 	}
 
-	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	MDC_ATTR_UNLOCK(entry);
 
  out:
 	mdcache_put(entry);
@@ -446,6 +561,7 @@ mdcache_export_up_ops_init(struct fsal_up_vector *my_up_ops,
 
 	/* Replace cache-related calls */
 	my_up_ops->invalidate = mdc_up_invalidate;
+	my_up_ops->invalidate_batch = mdc_up_invalidate_batch;
 	my_up_ops->update = mdc_up_update;
 	my_up_ops->invalidate_close = mdc_up_invalidate_close;
 
@@ -39,6 +39,242 @@
 #include "fsal_convert.h"
 #include "FSAL/fsal_commonlib.h"
 #include "mdcache_int.h"
+#include "mdcache_lru.h"
+
+/* Longest name cached, with its namespace prefix */
+#define MDC_XATTR_NAME_MAX 255
+
+/* NFSv4.2 xattrs are the user namespace, without the prefix */
+#define MDC_XATTR_USER "user."
+
+/**
+ * @brief A cached xattr, or a name known to be missing
+ */
+struct mdc_xattr {
+	struct glist_head list;		/*< in mdc_xattrs, oldest first */
+	fsal_errors_t err;		/*< ERR_FSAL_NO_ERROR or the miss */
+	uint32_t name_len;
+	uint32_t len;			/*< value length */
+	char data[];			/*< name, then value */
+};
+
+struct mdc_xattrs {
+	struct glist_head list;
+	uint32_t bytes;			/*< of the mdc_xattr structs */
+};
+
+/**
+ * @brief Whether a full xattr name is in a cached namespace
+ */
+static bool mdc_xattr_cacheable(const char *name, size_t len)
+{
+	const char *ns = mdcache_param.xattr_namespaces;
+	const char *end;
+	size_t ns_len;
+
+	if (ns == NULL || len > MDC_XATTR_NAME_MAX)
+		return false;
+
+	while (*ns != '\0') {
+		end = strchr(ns, ',');
+		ns_len = end ? end - ns : strlen(ns);
+		if (ns_len > 0 && ns_len <= len && !memcmp(name, ns, ns_len))
+			return true;
+		if (end == NULL)
+			break;
+		ns = end + 1;
+	}
+
+	return false;
+}
+
+static size_t mdc_xattr_size(const struct mdc_xattr *xa)
+{
+	return sizeof(*xa) + xa->name_len + xa->len;
+}
+
+/**
+ * @brief Copy out a cached xattr
+ *
+ * The cached copy is only used while the attributes are valid and the
+ * change attribute is the one it was read with; a write to the file
+ * from elsewhere shows up as a new change attribute.
+ *
+ * @param[in]  entry    The entry
+ * @param[in]  name     Full name of the xattr
+ * @param[in]  name_len Length of @a name
+ * @param[out] buf      Buffer for the value, NULL to get the length
+ * @param[in]  buf_size Size of @a buf
+ * @param[out] len      Length of the value
+ * @param[out] err      ERR_FSAL_NO_ERROR or the cached miss
+ * @param[out] gen      xattr_gen, to pass to mdc_xattr_insert()
+ *
+ * @return true if the name is cached and the value fits.
+ */
+static bool mdc_xattr_lookup(mdcache_entry_t *entry, const char *name,
+			     size_t name_len, char *buf, size_t buf_size,
+			     uint32_t *len, fsal_errors_t *err,
+			     uint32_t *gen)
+{
+	struct glist_head *glist;
+	struct mdc_xattr *xa;
+	bool found = false;
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+
+	*gen = entry->xattr_gen;
+
+	if (entry->xattrs == NULL ||
+	    !mdcache_is_attrs_valid(entry, ATTR_CHANGE))
+		goto out;
+
+	glist_for_each(glist, &entry->xattrs->list) {
+		xa = glist_entry(glist, struct mdc_xattr, list);
+		if (xa->name_len != name_len ||
+		    memcmp(xa->data, name, name_len))
+			continue;
+
+		if (xa->err == ERR_FSAL_NO_ERROR && buf != NULL) {
+			if (xa->len > buf_size)
+				break;
+			memcpy(buf, xa->data + name_len, xa->len);
+		}
+		*len = xa->len;
+		*err = xa->err;
+		found = true;
+		break;
+	}
+
+out:
+	MDC_ATTR_UNLOCK(entry);
+
+	(void) atomic_inc_uint64_t(found ? &cache_stp->xattr_hit
+					 : &cache_stp->xattr_miss);
+
+	return found;
+}
+
+/**
+ * @brief Remember what the sub-FSAL answered for an xattr
+ *
+ * Nothing is kept if the xattrs were invalidated since @a gen was read,
+ * so a value read before a set is not cached after it.
+ *
+ * @param[in] entry    The entry
+ * @param[in] gen      xattr_gen before the sub-FSAL was asked
+ * @param[in] name     Full name of the xattr
+ * @param[in] name_len Length of @a name
+ * @param[in] value    The value, if @a err is ERR_FSAL_NO_ERROR
+ * @param[in] len      Length of @a value
+ * @param[in] err      What the sub-FSAL returned
+ */
+static void mdc_xattr_insert(mdcache_entry_t *entry, uint32_t gen,
+			     const char *name, size_t name_len,
+			     const char *value, size_t len,
+			     fsal_errors_t err)
+{
+	struct mdc_xattrs *xattrs;
+	struct mdc_xattr *xa, *old;
+	struct glist_head *glist, *glistn;
+
+	if (err != ERR_FSAL_NO_ERROR && err != ERR_FSAL_NOENT &&
+	    err != ERR_FSAL_NO_DATA)
+		return;
+	if (err != ERR_FSAL_NO_ERROR)
+		len = 0;
+	if (len > mdcache_param.xattr_value_max ||
+	    sizeof(*xa) + name_len + len > mdcache_param.xattr_entry_bytes)
+		return;
+
+	xa = gsh_malloc(sizeof(*xa) + name_len + len);
+	xa->err = err;
+	xa->name_len = name_len;
+	xa->len = len;
+	memcpy(xa->data, name, name_len);
+	if (len > 0)
+		memcpy(xa->data + name_len, value, len);
+
+	MDC_ATTR_WRLOCK(entry);
+
+	if (entry->xattr_gen != gen) {
+		MDC_ATTR_UNLOCK(entry);
+		gsh_free(xa);
+		return;
+	}
+
+	xattrs = entry->xattrs;
+	if (xattrs == NULL) {
+		xattrs = gsh_calloc(1, sizeof(*xattrs));
+		glist_init(&xattrs->list);
+		entry->xattrs = xattrs;
+		mdcache_lru_mem(entry, sizeof(*xattrs));
+	}
+
+	/* Replace an older answer for the name, and the oldest names
+	 * while over the cap */
+	glist_for_each_safe(glist, glistn, &xattrs->list) {
+		old = glist_entry(glist, struct mdc_xattr, list);
+		if (old->name_len != name_len ||
+		    memcmp(old->data, name, name_len))
+			continue;
+		glist_del(&old->list);
+		xattrs->bytes -= mdc_xattr_size(old);
+		mdcache_lru_mem(entry, -(int64_t) mdc_xattr_size(old));
+		gsh_free(old);
+	}
+
+	while (xattrs->bytes + mdc_xattr_size(xa) >
+	       mdcache_param.xattr_entry_bytes) {
+		old = glist_first_entry(&xattrs->list, struct mdc_xattr, list);
+		glist_del(&old->list);
+		xattrs->bytes -= mdc_xattr_size(old);
+		mdcache_lru_mem(entry, -(int64_t) mdc_xattr_size(old));
+		gsh_free(old);
+	}
+
+	glist_add_tail(&xattrs->list, &xa->list);
+	xattrs->bytes += mdc_xattr_size(xa);
+	mdcache_lru_mem(entry, mdc_xattr_size(xa));
+
+	MDC_ATTR_UNLOCK(entry);
+}
+
+/**
+ * @brief Free the cached xattrs of an entry
+ *
+ * @note The attr_lock MUST be held for write, or the entry be unused.
+ */
+void mdc_xattr_free(mdcache_entry_t *entry)
+{
+	struct mdc_xattrs *xattrs = entry->xattrs;
+	struct mdc_xattr *xa;
+
+	if (xattrs == NULL)
+		return;
+
+	while ((xa = glist_first_entry(&xattrs->list, struct mdc_xattr,
+				       list)) != NULL) {
+		glist_del(&xa->list);
+		gsh_free(xa);
+	}
+
+	mdcache_lru_mem(entry, -(int64_t) (xattrs->bytes + sizeof(*xattrs)));
+	gsh_free(xattrs);
+	entry->xattrs = NULL;
+}
+
+/**
+ * @brief Drop the cached xattrs after a change
+ *
+ * @param[in] entry The entry
+ */
+void mdc_xattr_invalidate(mdcache_entry_t *entry)
+{
+	MDC_ATTR_WRLOCK(entry);
+	entry->xattr_gen++;
+	mdc_xattr_free(entry);
+	MDC_ATTR_UNLOCK(entry);
+}
 
 /**
  * @brief List extended attributes on a file
@@ -136,7 +372,8 @@ fsal_status_t mdcache_getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
 /**
  * @brief Get contents of xattr by name
  *
- * Pass through to sub-FSAL
+ * Answered from the xattr cache for names in Xattr_Cache_Namespaces,
+ * otherwise passed through to sub-FSAL
  *
  * @param[in] obj_hdl	File to search
  * @param[in] name	Name of xattr to look up
@@ -154,21 +391,39 @@ fsal_status_t mdcache_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
 	struct mdcache_fsal_obj_handle *handle =
 		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
 			     obj_handle);
+	size_t name_len = strlen(name);
+	bool cacheable = buf_size > 0 && mdc_xattr_cacheable(name, name_len);
+	fsal_errors_t err;
+	uint32_t len, gen;
 	fsal_status_t status;
 
+	if (cacheable &&
+	    mdc_xattr_lookup(handle, name, name_len, buf, buf_size, &len,
+			     &err, &gen)) {
+		*p_output_size = len;
+		return fsalstat(err, 0);
+	}
+
 	subcall(
 		status = handle->sub_handle->obj_ops.getextattr_value_by_name(
 				handle->sub_handle, name, buf,
 				buf_size, p_output_size)
 	       );
 
+	/* Only a value that fit in buf is known */
+	if (cacheable &&
+	    (FSAL_IS_ERROR(status) || *p_output_size <= buf_size))
+		mdc_xattr_insert(handle, gen, name, name_len, buf,
+				 FSAL_IS_ERROR(status) ? 0 : *p_output_size,
+				 status.major);
+
 	return status;
 }
 
 /**
  * @brief Set contents of xattr by name
  *
- * Pass through to sub-FSAL
+ * Pass through to sub-FSAL, and drop the cached xattrs
  *
  * @param[in] obj_hdl	File to search
  * @param[in] name	Name of xattr to set
@@ -193,13 +448,15 @@ fsal_status_t mdcache_setextattr_value(struct fsal_obj_handle *obj_hdl,
 			buf_size, create)
 	       );
 
+	mdc_xattr_invalidate(handle);
+
 	return status;
 }
 
 /**
  * @brief Set contents of xattr by ID
  *
- * Pass through to sub-FSAL
+ * Pass through to sub-FSAL, and drop the cached xattrs
  *
  * @param[in] obj_hdl	File to search
  * @param[in] id	ID of xattr to set
@@ -223,13 +480,15 @@ fsal_status_t mdcache_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
 				buf_size)
 	       );
 
+	mdc_xattr_invalidate(handle);
+
 	return status;
 }
 
 /**
  * @brief Remove an xattr by ID
  *
- * Pass through to sub-FSAL
+ * Pass through to sub-FSAL, and drop the cached xattrs
  *
  * @param[in] obj_hdl	File to search
  * @param[in] id	ID of xattr to remove
@@ -248,13 +507,15 @@ fsal_status_t mdcache_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, id)
 	       );
 
+	mdc_xattr_invalidate(handle);
+
 	return status;
 }
 
 /**
  * @brief Remove an xattr by name
  *
- * Pass through to sub-FSAL
+ * Pass through to sub-FSAL, and drop the cached xattrs
  *
  * @param[in] obj_hdl	File to search
  * @param[in] name	Name of xattr to remove
@@ -273,13 +534,16 @@ fsal_status_t mdcache_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, name)
 	       );
 
+	mdc_xattr_invalidate(handle);
+
 	return status;
 }
 
 /**
  * @brief Get an Extended Attribute
  *
- * Pass through to sub-FSAL
+ * Answered from the xattr cache if "user." is in Xattr_Cache_Namespaces,
+ * otherwise passed through to sub-FSAL
  *
  * @param[in] obj_hdl	File to search
  * @param[in] name	Name of attribute
@@ -292,20 +556,50 @@ fsal_status_t mdcache_getxattrs(struct fsal_obj_handle *obj_hdl,
 	struct mdcache_fsal_obj_handle *handle =
 		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
 			     obj_handle);
+	char full[MDC_XATTR_NAME_MAX + 1];
+	size_t prefix = sizeof(MDC_XATTR_USER) - 1;
+	size_t full_len = prefix + name->utf8string_len;
+	bool cacheable = false;
+	fsal_errors_t err;
+	uint32_t len, gen;
 	fsal_status_t status;
 
+	if (full_len <= MDC_XATTR_NAME_MAX) {
+		memcpy(full, MDC_XATTR_USER, prefix);
+		memcpy(full + prefix, name->utf8string_val,
+		       name->utf8string_len);
+		cacheable = mdc_xattr_cacheable(full, full_len);
+	}
+
+	if (cacheable &&
+	    mdc_xattr_lookup(handle, full, full_len, value->utf8string_val,
+			     value->utf8string_len, &len, &err, &gen)) {
+		if (err == ERR_FSAL_NO_ERROR)
+			value->utf8string_len = len;
+		return fsalstat(err, 0);
+	}
+
 	subcall(
 		status = handle->sub_handle->obj_ops.getxattrs(
 			handle->sub_handle, name, value)
 	       );
 
+	/* Without a buffer only the length was asked for */
+	if (cacheable &&
+	    (FSAL_IS_ERROR(status) || value->utf8string_val != NULL))
+		mdc_xattr_insert(handle, gen, full, full_len,
+				 value->utf8string_val,
+				 FSAL_IS_ERROR(status)
+					? 0 : value->utf8string_len,
+				 status.major);
+
 	return status;
 }
 
 /**
  * @brief Set an Extended Attribute
  *
- * Pass through to sub-FSAL
+ * Pass through to sub-FSAL, and drop the cached xattrs
  *
  * @param[in] obj_hdl	File to search
  * @param[in] type	Type of attribute
@@ -327,13 +621,15 @@ fsal_status_t mdcache_setxattrs(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, type, name, value)
 	       );
 
+	mdc_xattr_invalidate(handle);
+
 	return status;
 }
 
 /**
  * @brief Remove an Extended Attribute
  *
- * Pass through to sub-FSAL
+ * Pass through to sub-FSAL, and drop the cached xattrs
  *
  * @param[in] obj_hdl	File to search
  * @param[in] name	Type of attribute
@@ -352,6 +648,8 @@ fsal_status_t mdcache_removexattrs(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, name)
 	       );
 
+	mdc_xattr_invalidate(handle);
+
 	return status;
 }
 
@@ -72,6 +72,7 @@ static void release(struct fsal_export *exp_hdl)
 	fsal_detach_export(exp_hdl->fsal, &exp_hdl->exports);
 	free_export_ops(exp_hdl);
 
+	nullfs_inject_fini(myself);
 	gsh_free(myself);	/* elvis has left the building */
 }
 
@@ -414,6 +415,7 @@ void nullfs_export_ops_init(struct export_ops *ops)
 
 struct nullfsal_args {
 	struct subfsal_args subfsal;
+	struct nullfs_inject_conf inject;
 };
 
 static struct config_item sub_fsal_params[] = {
@@ -427,6 +429,9 @@ static struct config_item export_params[] = {
 	CONF_RELAX_BLOCK("FSAL", sub_fsal_params,
 			 noop_conf_init, subfsal_commit,
 			 nullfsal_args, subfsal),
+	CONF_ITEM_BLOCK("Inject", nullfs_inject_blocks,
+			noop_conf_init, noop_conf_commit,
+			nullfsal_args, inject),
 	CONFIG_EOL
 };
 
@@ -458,8 +463,10 @@ fsal_status_t nullfs_create_export(struct fsal_module *fsal_hdl,
 	int retval;
 
 	/* process our FSAL block to get the name of the fsal
-	 * underneath us.
+	 * underneath us.  The inject blocks that are not given keep
+	 * their zeroes.
 	 */
+	memset(&nullfsal, 0, sizeof(nullfsal));
 	retval = load_config_from_node(parse_node,
 				       &export_param,
 				       &nullfsal,
@@ -476,6 +483,7 @@ fsal_status_t nullfs_create_export(struct fsal_module *fsal_hdl,
 	}
 
 	myself = gsh_calloc(1, sizeof(struct nullfs_fsal_export));
+	nullfs_inject_init(myself, &nullfsal.inject);
 	expres = fsal_stack->m_ops.create_export(fsal_stack,
 						 nullfsal.subfsal.fsal_node,
 						 err_type,
@@ -485,6 +493,7 @@ fsal_status_t nullfs_create_export(struct fsal_module *fsal_hdl,
 		LogMajor(COMPONENT_FSAL,
 			 "Failed to call create_export on underlying FSAL %s",
 			 nullfsal.subfsal.name);
+		nullfs_inject_fini(myself);
 		gsh_free(myself);
 		return expres;
 	}
@@ -55,11 +55,17 @@ fsal_status_t nullfs_open(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_OPEN);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.open(handle->sub_handle, openflags);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_OPEN);
 
 	return status;
 }
@@ -105,6 +111,11 @@ fsal_status_t nullfs_read(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_READ);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
@@ -112,6 +123,7 @@ fsal_status_t nullfs_read(struct fsal_obj_handle *obj_hdl,
 						 buffer_size, buffer,
 						 read_amount, end_of_file);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_READ);
 
 	return status;
 }
@@ -133,6 +145,11 @@ fsal_status_t nullfs_write(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_WRITE);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
@@ -143,6 +160,7 @@ fsal_status_t nullfs_write(struct fsal_obj_handle *obj_hdl,
 						  write_amount,
 						  fsal_stable);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_WRITE);
 
 	return status;
 }
@@ -163,12 +181,18 @@ fsal_status_t nullfs_commit(struct fsal_obj_handle *obj_hdl,	/* sync */
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_COMMIT);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.commit(handle->sub_handle,
 						   offset, len);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_COMMIT);
 
 	return status;
 }
@@ -193,6 +217,11 @@ fsal_status_t nullfs_lock_op(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_LOCK);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
@@ -202,6 +231,7 @@ fsal_status_t nullfs_lock_op(struct fsal_obj_handle *obj_hdl,
 						    request_lock,
 						    conflicting_lock);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_LOCK);
 
 	return status;
 }
@@ -222,11 +252,17 @@ fsal_status_t nullfs_close(struct fsal_obj_handle *obj_hdl)
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_CLOSE);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.close(handle->sub_handle);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_CLOSE);
 
 	return status;
 }
@@ -250,6 +286,11 @@ fsal_status_t nullfs_open2(struct fsal_obj_handle *obj_hdl,
 			     export);
 	struct fsal_obj_handle *sub_handle = NULL;
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_OPEN);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
@@ -259,6 +300,7 @@ fsal_status_t nullfs_open2(struct fsal_obj_handle *obj_hdl,
 						  &sub_handle, attrs_out,
 						  caller_perm_check);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_OPEN);
 
 	if (sub_handle) {
 		/* wrap the subfsal handle in a nullfs handle. */
@@ -324,12 +366,18 @@ fsal_status_t nullfs_reopen2(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_OPEN);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.reopen2(handle->sub_handle,
 						    state, openflags);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_OPEN);
 
 	return status;
 }
@@ -352,6 +400,11 @@ fsal_status_t nullfs_read2(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_READ);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
@@ -360,6 +413,7 @@ fsal_status_t nullfs_read2(struct fsal_obj_handle *obj_hdl,
 						  buffer, read_amount, eof,
 						  info);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_READ);
 
 	return status;
 }
@@ -382,6 +436,11 @@ fsal_status_t nullfs_write2(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_WRITE);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
@@ -390,10 +449,239 @@ fsal_status_t nullfs_write2(struct fsal_obj_handle *obj_hdl,
 						  buffer, write_amount,
 						  fsal_stable, info);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_WRITE);
+
+	return status;
+}
+
+fsal_status_t nullfs_read_ref2(struct fsal_obj_handle *obj_hdl,
+			       bool bypass,
+			       struct state_t *state,
+			       uint64_t offset,
+			       size_t buf_size,
+			       void **buffer,
+			       size_t *read_amount,
+			       bool *eof,
+			       struct io_info *info)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_READ);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops.read_ref2(handle->sub_handle,
+						      bypass, state, offset,
+						      buf_size, buffer,
+						      read_amount, eof, info);
+	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_READ);
+
+	return status;
+}
+
+fsal_status_t nullfs_readv2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    const struct iovec *iov,
+			    int iovcnt,
+			    size_t *read_amount,
+			    bool *eof,
+			    struct io_info *info)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_READ);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops.readv2(handle->sub_handle, bypass,
+						   state, offset, iov, iovcnt,
+						   read_amount, eof, info);
+	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_READ);
 
 	return status;
 }
 
+fsal_status_t nullfs_writev2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     const struct iovec *iov,
+			     int iovcnt,
+			     size_t *write_amount,
+			     bool *fsal_stable,
+			     struct io_info *info)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_WRITE);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops.writev2(handle->sub_handle, bypass,
+						    state, offset, iov, iovcnt,
+						    write_amount, fsal_stable,
+						    info);
+	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_WRITE);
+
+	return status;
+}
+
+fsal_status_t nullfs_copy(struct fsal_obj_handle *src_hdl,
+			  struct state_t *src_state,
+			  uint64_t src_offset,
+			  struct fsal_obj_handle *dst_hdl,
+			  struct state_t *dst_state,
+			  uint64_t dst_offset,
+			  uint64_t count,
+			  uint64_t *copied)
+{
+	struct nullfs_fsal_obj_handle *src =
+		container_of(src_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+	struct nullfs_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		src->sub_handle->obj_ops.copy(src->sub_handle, src_state,
+					      src_offset, dst->sub_handle,
+					      dst_state, dst_offset, count,
+					      copied);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t nullfs_clone(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count)
+{
+	struct nullfs_fsal_obj_handle *src =
+		container_of(src_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+	struct nullfs_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		src->sub_handle->obj_ops.clone(src->sub_handle, src_state,
+					       src_offset, dst->sub_handle,
+					       dst_state, dst_offset, count);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+void nullfs_read2_async(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			fsal_async_cb done_cb,
+			struct fsal_io_arg *read_arg,
+			void *caller_arg)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_READ);
+
+	if (FSAL_IS_ERROR(inj)) {
+		done_cb(obj_hdl, inj, read_arg, caller_arg);
+		return;
+	}
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops.read2_async(handle->sub_handle, bypass,
+						done_cb, read_arg, caller_arg);
+	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_READ);
+}
+
+void nullfs_write2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 fsal_async_cb done_cb,
+			 struct fsal_io_arg *write_arg,
+			 void *caller_arg)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_WRITE);
+
+	if (FSAL_IS_ERROR(inj)) {
+		done_cb(obj_hdl, inj, write_arg, caller_arg);
+		return;
+	}
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops.write2_async(handle->sub_handle, bypass,
+						 done_cb, write_arg,
+						 caller_arg);
+	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_WRITE);
+}
+
 fsal_status_t nullfs_seek2(struct fsal_obj_handle *obj_hdl,
 			   struct state_t *state,
 			   struct io_info *info)
@@ -449,16 +737,49 @@ fsal_status_t nullfs_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_COMMIT);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.commit2(handle->sub_handle, offset,
 						    len);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_COMMIT);
 
 	return status;
 }
 
+void nullfs_commit2_async(struct fsal_obj_handle *obj_hdl, off_t offset,
+			  size_t len, fsal_async_cb done_cb,
+			  void *caller_arg)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_COMMIT);
+
+	if (FSAL_IS_ERROR(inj)) {
+		done_cb(obj_hdl, inj, NULL, caller_arg);
+		return;
+	}
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops.commit2_async(handle->sub_handle, offset,
+						  len, done_cb, caller_arg);
+	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_COMMIT);
+}
+
 fsal_status_t nullfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 			      struct state_t *state,
 			      void *p_owner,
@@ -474,6 +795,11 @@ fsal_status_t nullfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_LOCK);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
@@ -481,6 +807,7 @@ fsal_status_t nullfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 						     p_owner, lock_op, req_lock,
 						     conflicting_lock);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_LOCK);
 
 	return status;
 }
@@ -496,11 +823,17 @@ fsal_status_t nullfs_close2(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_CLOSE);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.close2(handle->sub_handle, state);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_CLOSE);
 
 	return status;
 }
@@ -144,10 +144,16 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 	struct nullfs_fsal_export *export =
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_LOOKUP);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	op_ctx->fsal_export = export->export.sub_export;
 	status = null_parent->sub_handle->obj_ops.lookup(
 			null_parent->sub_handle, path, &sub_handle, attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_LOOKUP);
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	return nullfs_alloc_and_check_handle(export, sub_handle, parent->fs,
@@ -173,11 +179,17 @@ static fsal_status_t create(struct fsal_obj_handle *dir_hdl,
 
 	*new_obj = NULL;
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_CREATE);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* creating the file with a subfsal handle. */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.create(
 		nullfs_dir->sub_handle, name, attrs_in, &sub_handle, attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_CREATE);
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	return nullfs_alloc_and_check_handle(export, sub_handle, dir_hdl->fs,
@@ -202,11 +214,17 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 	/** Subfsal handle of the new directory.*/
 	struct fsal_obj_handle *sub_handle;
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_CREATE);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* Creating the directory with a subfsal handle. */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status = parent_hdl->sub_handle->obj_ops.mkdir(
 		parent_hdl->sub_handle, name, attrs_in, &sub_handle, attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_CREATE);
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	return nullfs_alloc_and_check_handle(export, sub_handle, dir_hdl->fs,
@@ -234,12 +252,18 @@ static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
 
 	*new_obj = NULL;
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_CREATE);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* Creating the node with a subfsal handle. */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.mknode(
 		nullfs_dir->sub_handle, name, nodetype, attrs_in,
 		&sub_handle, attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_CREATE);
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	return nullfs_alloc_and_check_handle(export, sub_handle, dir_hdl->fs,
@@ -273,12 +297,18 @@ static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
 
 	*new_obj = NULL;
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_CREATE);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* creating the file with a subfsal handle. */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.symlink(
 		nullfs_dir->sub_handle, name, link_path, attrs_in, &sub_handle,
 		attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_CREATE);
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	return nullfs_alloc_and_check_handle(export, sub_handle, dir_hdl->fs,
@@ -295,12 +325,18 @@ static fsal_status_t readsymlink(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_LOOKUP);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.readlink(handle->sub_handle,
 						     link_content, refresh);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_LOOKUP);
 
 	return status;
 }
@@ -317,11 +353,17 @@ static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_CREATE);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status = handle->sub_handle->obj_ops.link(
 		handle->sub_handle, nullfs_dir->sub_handle, name);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_CREATE);
 
 	return status;
 }
@@ -395,12 +437,18 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 		.exp = export
 	};
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_READDIR);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.readdir(handle->sub_handle,
 		whence, &cb_state, nullfs_readdir_cb, attrmask, eof);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_READDIR);
 
 	return status;
 }
@@ -536,12 +584,18 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_RENAME);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status = nullfs_olddir->sub_handle->obj_ops.rename(
 		nullfs_obj->sub_handle, nullfs_olddir->sub_handle,
 		old_name, nullfs_newdir->sub_handle, new_name);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_RENAME);
 
 	return status;
 }
@@ -557,12 +611,39 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_GETATTR);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.getattrs(handle->sub_handle,
 						     attrib_get);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_GETATTR);
+
+	return status;
+}
+
+static fsal_status_t getchange(struct fsal_obj_handle *obj_hdl,
+			       uint64_t *change)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops.getchange(handle->sub_handle,
+						      change);
+	op_ctx->fsal_export = &export->export;
 
 	return status;
 }
@@ -583,11 +664,17 @@ static fsal_status_t setattrs(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_SETATTR);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status = handle->sub_handle->obj_ops.setattrs(
 		handle->sub_handle, attrs);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_SETATTR);
 
 	return status;
 }
@@ -605,11 +692,17 @@ static fsal_status_t nullfs_setattr2(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_SETATTR);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status = handle->sub_handle->obj_ops.setattr2(
 		handle->sub_handle, bypass, state, attrs);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_SETATTR);
 
 	return status;
 }
@@ -632,11 +725,17 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	fsal_status_t inj = nullfs_inject_begin(export, NULLFS_INJ_REMOVE);
+
+	if (FSAL_IS_ERROR(inj))
+		return inj;
+
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.unlink(
 		nullfs_dir->sub_handle, nullfs_obj->sub_handle, name);
 	op_ctx->fsal_export = &export->export;
+	nullfs_inject_end(export, NULLFS_INJ_REMOVE);
 
 	return status;
 }
@@ -732,6 +831,7 @@ void nullfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->symlink = makesymlink;
 	ops->readlink = readsymlink;
 	ops->getattrs = getattrs;
+	ops->getchange = getchange;
 	ops->setattrs = setattrs;
 	ops->link = linkfile;
 	ops->rename = renamefile;
@@ -754,8 +854,16 @@ void nullfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->read2 = nullfs_read2;
 	ops->write2 = nullfs_write2;
 	ops->seek2 = nullfs_seek2;
+	ops->read_ref2 = nullfs_read_ref2;
+	ops->readv2 = nullfs_readv2;
+	ops->writev2 = nullfs_writev2;
+	ops->copy = nullfs_copy;
+	ops->clone = nullfs_clone;
+	ops->read2_async = nullfs_read2_async;
+	ops->write2_async = nullfs_write2_async;
 	ops->io_advise2 = nullfs_io_advise2;
 	ops->commit2 = nullfs_commit2;
+	ops->commit2_async = nullfs_commit2_async;
 	ops->lock_op2 = nullfs_lock_op2;
 	ops->setattr2 = nullfs_setattr2;
 	ops->close2 = nullfs_close2;
@@ -0,0 +1,689 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* inject.c
+ * Latency, stall, error and throttle injection for the NULL module
+ *
+ * An export stacked as
+ *
+ * FSAL {
+ *	Name = NULL;
+ *	Inject {
+ *		Getattr { Latency = 200; Jitter = 100; }
+ *		Read { Stall_Rate = 100; Stall_Time = 5000; }
+ *		Write { Error_Rate = 1000; Error = DELAY; Max_Inflight = 4; }
+ *	}
+ *	FSAL { Name = VFS; }
+ * }
+ *
+ * makes its sub FSAL look like a backend with those pathologies.  The
+ * knobs of an export are changed at run time with the SetInject DBus
+ * method of org.ganesha.nfsd.nullfs, and ShowInject reports them with
+ * the counters.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <time.h>
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "config_parsing.h"
+#include "nullfs_methods.h"
+#include "export_mgr.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+static const char * const nullfs_inject_names[NULLFS_INJ_COUNT] = {
+	[NULLFS_INJ_LOOKUP] = "Lookup",
+	[NULLFS_INJ_READDIR] = "Readdir",
+	[NULLFS_INJ_GETATTR] = "Getattr",
+	[NULLFS_INJ_SETATTR] = "Setattr",
+	[NULLFS_INJ_CREATE] = "Create",
+	[NULLFS_INJ_REMOVE] = "Remove",
+	[NULLFS_INJ_RENAME] = "Rename",
+	[NULLFS_INJ_OPEN] = "Open",
+	[NULLFS_INJ_CLOSE] = "Close",
+	[NULLFS_INJ_READ] = "Read",
+	[NULLFS_INJ_WRITE] = "Write",
+	[NULLFS_INJ_COMMIT] = "Commit",
+	[NULLFS_INJ_LOCK] = "Lock",
+};
+
+static struct config_item_list dist_tokens[] = {
+	CONFIG_LIST_TOK("Uniform", NULLFS_DIST_UNIFORM),
+	CONFIG_LIST_TOK("Exponential", NULLFS_DIST_EXPONENTIAL),
+	CONFIG_LIST_EOL
+};
+
+static struct config_item_list error_tokens[] = {
+	CONFIG_LIST_TOK("IO", ERR_FSAL_IO),
+	CONFIG_LIST_TOK("DELAY", ERR_FSAL_DELAY),
+	CONFIG_LIST_TOK("STALE", ERR_FSAL_STALE),
+	CONFIG_LIST_TOK("NOSPC", ERR_FSAL_NOSPC),
+	CONFIG_LIST_TOK("ACCESS", ERR_FSAL_ACCESS),
+	CONFIG_LIST_TOK("NOENT", ERR_FSAL_NOENT),
+	CONFIG_LIST_TOK("SERVERFAULT", ERR_FSAL_SERVERFAULT),
+	CONFIG_LIST_EOL
+};
+
+/* The knobs of a class, also what SetInject sets by name */
+static struct config_item inject_params[] = {
+	CONF_ITEM_UI32("Latency", 0, UINT32_MAX, 0,
+		       nullfs_inject, latency),
+	CONF_ITEM_UI32("Jitter", 0, UINT32_MAX, 0,
+		       nullfs_inject, jitter),
+	CONF_ITEM_TOKEN("Distribution", NULLFS_DIST_UNIFORM, dist_tokens,
+			nullfs_inject, distribution),
+	CONF_ITEM_UI32("Stall_Rate", 0, 1000000, 0,
+		       nullfs_inject, stall_rate),
+	CONF_ITEM_UI32("Stall_Time", 0, 3600000, 0,
+		       nullfs_inject, stall_time),
+	CONF_ITEM_UI32("Error_Rate", 0, 1000000, 0,
+		       nullfs_inject, error_rate),
+	CONF_ITEM_TOKEN("Error", ERR_FSAL_IO, error_tokens,
+			nullfs_inject, error),
+	CONF_ITEM_UI32("Max_Inflight", 0, UINT32_MAX, 0,
+		       nullfs_inject, max_inflight),
+	CONFIG_EOL
+};
+
+#define INJECT_BLOCK(_name_, _class_) \
+	CONF_ITEM_BLOCK(_name_, inject_params, noop_conf_init, \
+			noop_conf_commit, nullfs_inject_conf, op[_class_])
+
+struct config_item nullfs_inject_blocks[] = {
+	INJECT_BLOCK("Lookup", NULLFS_INJ_LOOKUP),
+	INJECT_BLOCK("Readdir", NULLFS_INJ_READDIR),
+	INJECT_BLOCK("Getattr", NULLFS_INJ_GETATTR),
+	INJECT_BLOCK("Setattr", NULLFS_INJ_SETATTR),
+	INJECT_BLOCK("Create", NULLFS_INJ_CREATE),
+	INJECT_BLOCK("Remove", NULLFS_INJ_REMOVE),
+	INJECT_BLOCK("Rename", NULLFS_INJ_RENAME),
+	INJECT_BLOCK("Open", NULLFS_INJ_OPEN),
+	INJECT_BLOCK("Close", NULLFS_INJ_CLOSE),
+	INJECT_BLOCK("Read", NULLFS_INJ_READ),
+	INJECT_BLOCK("Write", NULLFS_INJ_WRITE),
+	INJECT_BLOCK("Commit", NULLFS_INJ_COMMIT),
+	INJECT_BLOCK("Lock", NULLFS_INJ_LOCK),
+	CONFIG_EOL
+};
+
+/* xorshift64*, per thread so the dice don't bounce a cache line */
+static __thread uint64_t inject_rng;
+
+static uint64_t inject_random(void)
+{
+	uint64_t x = inject_rng;
+
+	if (x == 0) {
+		struct timespec ts;
+
+		now(&ts);
+		x = timespec_to_nsecs(&ts) ^ (uintptr_t) &inject_rng;
+		if (x == 0)
+			x = 1;
+	}
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	inject_rng = x;
+
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* True one time in a million / rate */
+static inline bool inject_roll(uint32_t rate)
+{
+	return rate != 0 && inject_random() % 1000000 < rate;
+}
+
+static void inject_sleep(uint64_t usecs)
+{
+	struct timespec ts = {
+		.tv_sec = usecs / 1000000,
+		.tv_nsec = (usecs % 1000000) * 1000,
+	};
+
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+		;
+}
+
+void nullfs_inject_init(struct nullfs_fsal_export *export,
+			struct nullfs_inject_conf *conf)
+{
+	int i;
+
+	for (i = 0; i < NULLFS_INJ_COUNT; i++) {
+		struct nullfs_inject_op *op = &export->inject[i];
+
+		op->cfg = conf->op[i];
+		/* Classes with no block in the config are all zero */
+		if (op->cfg.error == ERR_FSAL_NO_ERROR)
+			op->cfg.error = ERR_FSAL_IO;
+		PTHREAD_MUTEX_init(&op->mtx, NULL);
+		PTHREAD_COND_init(&op->cv, NULL);
+	}
+}
+
+void nullfs_inject_fini(struct nullfs_fsal_export *export)
+{
+	int i;
+
+	for (i = 0; i < NULLFS_INJ_COUNT; i++) {
+		PTHREAD_MUTEX_destroy(&export->inject[i].mtx);
+		PTHREAD_COND_destroy(&export->inject[i].cv);
+	}
+}
+
+/* Wait for room under max_inflight, the op was not counted in yet */
+static void inject_throttle(struct nullfs_inject_op *op)
+{
+	uint32_t max;
+
+	PTHREAD_MUTEX_lock(&op->mtx);
+
+	(void) atomic_inc_uint64_t(&op->throttled);
+
+	while ((max = atomic_fetch_uint32_t(&op->cfg.max_inflight)) != 0 &&
+	       atomic_fetch_uint32_t(&op->inflight) >= max)
+		pthread_cond_wait(&op->cv, &op->mtx);
+
+	(void) atomic_inc_uint32_t(&op->inflight);
+
+	PTHREAD_MUTEX_unlock(&op->mtx);
+}
+
+/**
+ * @brief Inject into an op before it goes to the sub FSAL
+ *
+ * Every call must be paired with nullfs_inject_end once the sub FSAL
+ * returned, unless it returns an error, in which case the op must fail
+ * with it without calling the sub FSAL.
+ *
+ * @param[in] export  The NULL export
+ * @param[in] class   What kind of op this is
+ *
+ * @return The injected error, or success.
+ */
+
+fsal_status_t nullfs_inject_begin(struct nullfs_fsal_export *export,
+				  enum nullfs_inject_class class)
+{
+	struct nullfs_inject_op *op = &export->inject[class];
+	uint32_t max, latency, jitter, stall_rate, error_rate;
+	uint64_t delay;
+
+	/* The gauge is kept even with nothing to inject, so turning a
+	 * throttle on under load sees the ops already in the sub FSAL.
+	 */
+	max = atomic_fetch_uint32_t(&op->cfg.max_inflight);
+	if (atomic_inc_uint32_t(&op->inflight) > max && max != 0) {
+		(void) atomic_dec_uint32_t(&op->inflight);
+		inject_throttle(op);
+	}
+
+	latency = atomic_fetch_uint32_t(&op->cfg.latency);
+	jitter = atomic_fetch_uint32_t(&op->cfg.jitter);
+	stall_rate = atomic_fetch_uint32_t(&op->cfg.stall_rate);
+	error_rate = atomic_fetch_uint32_t(&op->cfg.error_rate);
+
+	if ((latency | jitter | stall_rate | error_rate | max) == 0)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	(void) atomic_inc_uint64_t(&op->calls);
+
+	delay = latency;
+
+	if (jitter != 0) {
+		if (atomic_fetch_uint32_t(&op->cfg.distribution) ==
+		    NULLFS_DIST_EXPONENTIAL) {
+			/* A uniform (0, 1] inverted to an exponential of
+			 * mean jitter, capped so one op can't hang.
+			 */
+			double u = ((inject_random() >> 11) + 1) /
+				   9007199254740992.0;
+			double e = -log(u);
+
+			delay += (e < 20.0 ? e : 20.0) * jitter;
+		} else {
+			delay += inject_random() % ((uint64_t) jitter + 1);
+		}
+	}
+
+	if (inject_roll(stall_rate)) {
+		(void) atomic_inc_uint64_t(&op->stalls);
+		delay += (uint64_t) atomic_fetch_uint32_t(&op->cfg.stall_time) *
+			 1000;
+	}
+
+	if (delay != 0)
+		inject_sleep(delay);
+
+	if (inject_roll(error_rate)) {
+		(void) atomic_inc_uint64_t(&op->errors);
+		nullfs_inject_end(export, class);
+		return fsalstat(atomic_fetch_uint32_t(&op->cfg.error), 0);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+void nullfs_inject_end(struct nullfs_fsal_export *export,
+		       enum nullfs_inject_class class)
+{
+	struct nullfs_inject_op *op = &export->inject[class];
+
+	(void) atomic_dec_uint32_t(&op->inflight);
+
+	if (atomic_fetch_uint32_t(&op->cfg.max_inflight) != 0) {
+		PTHREAD_MUTEX_lock(&op->mtx);
+		pthread_cond_signal(&op->cv);
+		PTHREAD_MUTEX_unlock(&op->mtx);
+	}
+}
+
+#ifdef USE_DBUS
+
+/* Find the NULL export stacked in an export, with a reference on the
+ * gsh_export that the caller puts.
+ */
+static struct nullfs_fsal_export *inject_lookup(DBusMessageIter *args,
+						struct gsh_export **gsh_exp,
+						char **errormsg)
+{
+	struct fsal_export *exp_hdl;
+	uint16_t export_id;
+
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT16) {
+		*errormsg = "arg not a 16 bit export id";
+		return NULL;
+	}
+
+	dbus_message_iter_get_basic(args, &export_id);
+
+	*gsh_exp = get_gsh_export(export_id);
+	if (*gsh_exp == NULL) {
+		*errormsg = "Export id not found";
+		return NULL;
+	}
+
+	for (exp_hdl = (*gsh_exp)->fsal_export; exp_hdl != NULL;
+	     exp_hdl = exp_hdl->sub_export) {
+		if (exp_hdl->exp_ops.create_handle == nullfs_create_handle)
+			return container_of(exp_hdl, struct nullfs_fsal_export,
+					    export);
+	}
+
+	put_gsh_export(*gsh_exp);
+	*errormsg = "Export is not stacked over NULL";
+	return NULL;
+}
+
+static bool inject_next_string(DBusMessageIter *args, char **str)
+{
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING)
+		return false;
+
+	dbus_message_iter_get_basic(args, str);
+	return true;
+}
+
+/* Parse a knob value the way the config does */
+static bool inject_parse(struct config_item *item, const char *value,
+			 uint32_t *val)
+{
+	struct config_item_list *tok;
+	unsigned long num;
+	char *end;
+
+	if (item->type == CONFIG_TOKEN) {
+		for (tok = item->u.lst.tokens; tok->token != NULL; tok++) {
+			if (strcasecmp(value, tok->token) == 0) {
+				*val = tok->value;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	errno = 0;
+	num = strtoul(value, &end, 0);
+	if (errno != 0 || end == value || *end != '\0' ||
+	    num < item->u.ui32.minval || num > item->u.ui32.maxval)
+		return false;
+
+	*val = num;
+	return true;
+}
+
+static const char *inject_token(struct config_item_list *tokens,
+				uint32_t value)
+{
+	for (; tokens->token != NULL; tokens++)
+		if (tokens->value == value)
+			return tokens->token;
+
+	return "";
+}
+
+/**
+ * DBUS method to set a knob of one or all classes of an export
+ */
+
+static bool nullfs_set_inject(DBusMessageIter *args,
+			      DBusMessage *reply,
+			      DBusError *error)
+{
+	struct nullfs_fsal_export *export;
+	struct gsh_export *gsh_exp = NULL;
+	struct config_item *item;
+	char *class_name, *knob, *value;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	bool success = false;
+	uint32_t val;
+	int i, class = -1;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	export = inject_lookup(args, &gsh_exp, &errormsg);
+	if (export == NULL)
+		goto out;
+
+	if (!inject_next_string(args, &class_name) ||
+	    !inject_next_string(args, &knob) ||
+	    !inject_next_string(args, &value)) {
+		errormsg = "expected class, knob and value strings";
+		goto put;
+	}
+
+	if (strcasecmp(class_name, "All") != 0) {
+		for (i = 0; i < NULLFS_INJ_COUNT; i++)
+			if (strcasecmp(class_name, nullfs_inject_names[i]) == 0)
+				class = i;
+		if (class < 0) {
+			errormsg = "unknown op class";
+			goto put;
+		}
+	}
+
+	for (item = inject_params; item->name != NULL; item++)
+		if (strcasecmp(knob, item->name) == 0)
+			break;
+
+	if (item->name == NULL) {
+		errormsg = "unknown knob";
+		goto put;
+	}
+
+	if (!inject_parse(item, value, &val)) {
+		errormsg = "invalid value";
+		goto put;
+	}
+
+	for (i = 0; i < NULLFS_INJ_COUNT; i++) {
+		struct nullfs_inject_op *op = &export->inject[i];
+
+		if (class >= 0 && i != class)
+			continue;
+
+		atomic_store_uint32_t((uint32_t *)((char *)&op->cfg +
+						   item->off), val);
+
+		/* Let throttled ops re-check against the new limit */
+		PTHREAD_MUTEX_lock(&op->mtx);
+		pthread_cond_broadcast(&op->cv);
+		PTHREAD_MUTEX_unlock(&op->mtx);
+	}
+
+	LogEvent(COMPONENT_FSAL,
+		 "Export %d inject %s %s = %s",
+		 gsh_exp->export_id, class_name, item->name, value);
+
+	success = true;
+
+put:
+	put_gsh_export(gsh_exp);
+out:
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method nullfs_set_inject_method = {
+	.name = "SetInject",
+	.method = nullfs_set_inject,
+	.args = {ID_ARG,
+		 {
+		  .name = "class",
+		  .type = "s",
+		  .direction = "in"},
+		 {
+		  .name = "knob",
+		  .type = "s",
+		  .direction = "in"},
+		 {
+		  .name = "value",
+		  .type = "s",
+		  .direction = "in"},
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to turn off all injection of an export and reset its
+ * counters
+ */
+
+static bool nullfs_reset_inject(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	struct nullfs_fsal_export *export;
+	struct gsh_export *gsh_exp = NULL;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	int i;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	export = inject_lookup(args, &gsh_exp, &errormsg);
+	if (export == NULL) {
+		dbus_status_reply(&iter, false, errormsg);
+		return true;
+	}
+
+	for (i = 0; i < NULLFS_INJ_COUNT; i++) {
+		struct nullfs_inject_op *op = &export->inject[i];
+
+		atomic_store_uint32_t(&op->cfg.latency, 0);
+		atomic_store_uint32_t(&op->cfg.jitter, 0);
+		atomic_store_uint32_t(&op->cfg.stall_rate, 0);
+		atomic_store_uint32_t(&op->cfg.error_rate, 0);
+		atomic_store_uint32_t(&op->cfg.max_inflight, 0);
+		atomic_store_uint64_t(&op->calls, 0);
+		atomic_store_uint64_t(&op->errors, 0);
+		atomic_store_uint64_t(&op->stalls, 0);
+		atomic_store_uint64_t(&op->throttled, 0);
+
+		PTHREAD_MUTEX_lock(&op->mtx);
+		pthread_cond_broadcast(&op->cv);
+		PTHREAD_MUTEX_unlock(&op->mtx);
+	}
+
+	LogEvent(COMPONENT_FSAL, "Export %d inject reset",
+		 gsh_exp->export_id);
+
+	put_gsh_export(gsh_exp);
+	dbus_status_reply(&iter, true, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method nullfs_reset_inject_method = {
+	.name = "ResetInject",
+	.method = nullfs_reset_inject,
+	.args = {ID_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the knobs and counters of each class
+ */
+
+static bool nullfs_show_inject(DBusMessageIter *args,
+			       DBusMessage *reply,
+			       DBusError *error)
+{
+	struct nullfs_fsal_export *export;
+	struct gsh_export *gsh_exp = NULL;
+	char *errormsg = "OK";
+	DBusMessageIter iter, array_iter, struct_iter;
+	const char *str;
+	uint32_t val32;
+	uint64_t val64;
+	int i;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	export = inject_lookup(args, &gsh_exp, &errormsg);
+
+	dbus_status_reply(&iter, export != NULL, errormsg);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 "(suusuuusuutttt)", &array_iter);
+
+	for (i = 0; export != NULL && i < NULLFS_INJ_COUNT; i++) {
+		struct nullfs_inject_op *op = &export->inject[i];
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		str = nullfs_inject_names[i];
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &str);
+		val32 = atomic_fetch_uint32_t(&op->cfg.latency);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT32, &val32);
+		val32 = atomic_fetch_uint32_t(&op->cfg.jitter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT32, &val32);
+		str = inject_token(dist_tokens,
+				   atomic_fetch_uint32_t(
+					&op->cfg.distribution));
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &str);
+		val32 = atomic_fetch_uint32_t(&op->cfg.stall_rate);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT32, &val32);
+		val32 = atomic_fetch_uint32_t(&op->cfg.stall_time);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT32, &val32);
+		val32 = atomic_fetch_uint32_t(&op->cfg.error_rate);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT32, &val32);
+		str = inject_token(error_tokens,
+				   atomic_fetch_uint32_t(&op->cfg.error));
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &str);
+		val32 = atomic_fetch_uint32_t(&op->cfg.max_inflight);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT32, &val32);
+		val32 = atomic_fetch_uint32_t(&op->inflight);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT32, &val32);
+		val64 = atomic_fetch_uint64_t(&op->calls);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &val64);
+		val64 = atomic_fetch_uint64_t(&op->errors);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &val64);
+		val64 = atomic_fetch_uint64_t(&op->stalls);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &val64);
+		val64 = atomic_fetch_uint64_t(&op->throttled);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &val64);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	dbus_message_iter_close_container(&iter, &array_iter);
+
+	if (export != NULL)
+		put_gsh_export(gsh_exp);
+
+	return true;
+}
+
+static struct gsh_dbus_method nullfs_show_inject_method = {
+	.name = "ShowInject",
+	.method = nullfs_show_inject,
+	.args = {ID_ARG,
+		 STATUS_REPLY,
+		 {
+		  .name = "classes",
+		  .type = "a(suusuuusuutttt)",
+		  .direction = "out"},
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method *nullfs_inject_methods[] = {
+	&nullfs_set_inject_method,
+	&nullfs_reset_inject_method,
+	&nullfs_show_inject_method,
+	NULL
+};
+
+static struct gsh_dbus_interface nullfs_inject_interface = {
+	.name = "org.ganesha.nfsd.nullfs",
+	.props = NULL,
+	.methods = nullfs_inject_methods,
+	.signals = NULL
+};
+
+static struct gsh_dbus_interface *nullfs_inject_interfaces[] = {
+	&nullfs_inject_interface,
+	NULL
+};
+
+void nullfs_inject_dbus_init(void)
+{
+	gsh_dbus_register_path("nullfs", nullfs_inject_interfaces);
+}
+
+void nullfs_inject_dbus_fini(void)
+{
+	gsh_dbus_unregister_path("nullfs");
+}
+
+#else /* USE_DBUS */
+
+void nullfs_inject_dbus_init(void)
+{
+}
+
+void nullfs_inject_dbus_fini(void)
+{
+}
+
+#endif /* USE_DBUS */
@@ -178,12 +178,15 @@ MODULE_INIT void nullfs_init(void)
 	myself->m_ops.create_export = nullfs_create_export;
 	myself->m_ops.init_config = init_config;
 	myself->m_ops.support_ex = nullfs_support_ex;
+	nullfs_inject_dbus_init();
 }
 
 MODULE_FINI void nullfs_unload(void)
 {
 	int retval;
 
+	nullfs_inject_dbus_fini();
+
 	retval = unregister_fsal(&NULLFS.fsal);
 	if (retval != 0) {
 		fprintf(stderr, "NULLFS module failed to unregister");
@@ -27,14 +27,84 @@ extern struct next_ops next_ops;
 extern struct fsal_up_vector fsal_up_top;
 void nullfs_handle_ops_init(struct fsal_obj_ops *ops);
 
+/*
+ * Fault injection
+ *
+ * Each class of operations can be delayed, stalled now and then, failed
+ * at a rate and limited in how many run at once against the sub FSAL,
+ * to reproduce a slow or failing backend under the upper layers.  All
+ * of it is off by default, set from the Inject block of the export and
+ * changed at run time over DBus.
+ */
+enum nullfs_inject_class {
+	NULLFS_INJ_LOOKUP,	/*< lookup, readlink */
+	NULLFS_INJ_READDIR,
+	NULLFS_INJ_GETATTR,
+	NULLFS_INJ_SETATTR,
+	NULLFS_INJ_CREATE,	/*< create, mkdir, mknod, symlink, link */
+	NULLFS_INJ_REMOVE,
+	NULLFS_INJ_RENAME,
+	NULLFS_INJ_OPEN,
+	NULLFS_INJ_CLOSE,
+	NULLFS_INJ_READ,
+	NULLFS_INJ_WRITE,
+	NULLFS_INJ_COMMIT,
+	NULLFS_INJ_LOCK,
+	NULLFS_INJ_COUNT
+};
+
+enum nullfs_inject_dist {
+	NULLFS_DIST_UNIFORM,
+	NULLFS_DIST_EXPONENTIAL,
+};
+
+/* The knobs of a class, each is read and set atomically */
+struct nullfs_inject {
+	uint32_t latency;	/*< Fixed delay in us */
+	uint32_t jitter;	/*< Scale of the random delay in us */
+	uint32_t distribution;	/*< enum nullfs_inject_dist of the jitter */
+	uint32_t stall_rate;	/*< Stalls per million ops */
+	uint32_t stall_time;	/*< Length of a stall in ms */
+	uint32_t error_rate;	/*< Failures per million ops */
+	uint32_t error;		/*< fsal_errors_t of a failure */
+	uint32_t max_inflight;	/*< Ops let through at once, 0 for all */
+};
+
+struct nullfs_inject_conf {
+	struct nullfs_inject op[NULLFS_INJ_COUNT];
+};
+
+struct nullfs_inject_op {
+	struct nullfs_inject cfg;
+	pthread_mutex_t mtx;	/*< Protects inflight */
+	pthread_cond_t cv;	/*< Throttled ops wait here */
+	uint32_t inflight;
+	uint64_t calls;		/*< Ops that went through injection */
+	uint64_t errors;
+	uint64_t stalls;
+	uint64_t throttled;	/*< Ops that waited for max_inflight */
+};
+
+extern struct config_item nullfs_inject_blocks[];
+
 /*
  * NULLFS internal export
  */
 struct nullfs_fsal_export {
 	struct fsal_export export;
-	/* Other private export data goes here */
+	struct nullfs_inject_op inject[NULLFS_INJ_COUNT];
 };
 
+void nullfs_inject_init(struct nullfs_fsal_export *export,
+			struct nullfs_inject_conf *conf);
+void nullfs_inject_fini(struct nullfs_fsal_export *export);
+fsal_status_t nullfs_inject_begin(struct nullfs_fsal_export *export,
+				  enum nullfs_inject_class class);
+void nullfs_inject_end(struct nullfs_fsal_export *export,
+		       enum nullfs_inject_class class);
+void nullfs_inject_dbus_init(void);
+void nullfs_inject_dbus_fini(void);
+
 fsal_status_t nullfs_lookup_path(struct fsal_export *exp_hdl,
 				 const char *path,
 				 struct fsal_obj_handle **handle,
@@ -143,6 +213,58 @@ fsal_status_t nullfs_write2(struct fsal_obj_handle *obj_hdl,
 			    size_t *write_amount,
 			    bool *fsal_stable,
 			    struct io_info *info);
+fsal_status_t nullfs_read_ref2(struct fsal_obj_handle *obj_hdl,
+			       bool bypass,
+			       struct state_t *state,
+			       uint64_t offset,
+			       size_t buf_size,
+			       void **buffer,
+			       size_t *read_amount,
+			       bool *eof,
+			       struct io_info *info);
+fsal_status_t nullfs_readv2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    const struct iovec *iov,
+			    int iovcnt,
+			    size_t *read_amount,
+			    bool *eof,
+			    struct io_info *info);
+fsal_status_t nullfs_writev2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     const struct iovec *iov,
+			     int iovcnt,
+			     size_t *write_amount,
+			     bool *fsal_stable,
+			     struct io_info *info);
+fsal_status_t nullfs_copy(struct fsal_obj_handle *src_hdl,
+			  struct state_t *src_state,
+			  uint64_t src_offset,
+			  struct fsal_obj_handle *dst_hdl,
+			  struct state_t *dst_state,
+			  uint64_t dst_offset,
+			  uint64_t count,
+			  uint64_t *copied);
+fsal_status_t nullfs_clone(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count);
+void nullfs_read2_async(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			fsal_async_cb done_cb,
+			struct fsal_io_arg *read_arg,
+			void *caller_arg);
+void nullfs_write2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 fsal_async_cb done_cb,
+			 struct fsal_io_arg *write_arg,
+			 void *caller_arg);
 fsal_status_t nullfs_seek2(struct fsal_obj_handle *obj_hdl,
 			   struct state_t *state,
 			   struct io_info *info);
@@ -151,6 +273,9 @@ fsal_status_t nullfs_io_advise2(struct fsal_obj_handle *obj_hdl,
 				struct io_hints *hints);
 fsal_status_t nullfs_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 			     size_t len);
+void nullfs_commit2_async(struct fsal_obj_handle *obj_hdl, off_t offset,
+			  size_t len, fsal_async_cb done_cb,
+			  void *caller_arg);
 fsal_status_t nullfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 			      struct state_t *state,
 			      void *p_owner,
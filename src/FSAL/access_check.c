@@ -419,9 +419,342 @@ static void fsal_print_access_by_acl(int naces, int ace_number,
 	LogFullDebug(COMPONENT_NFS_V4_ACL, "%s", str);
 }
 
+/* What a decision depends on besides the ids held */
+#define ACL_KEY_DIR		0x01
+#define ACL_KEY_OWNER		0x02
+#define ACL_KEY_GROUP		0x04
+#define ACL_KEY_ROOT		0x08
+#define ACL_KEY_ALLOWED		0x10
+#define ACL_KEY_DENIED		0x20
+#define ACL_KEY_VALID		0x40
+
+static int fsal_acl_find_id(uint32_t *ids, uint32_t n, uint32_t id)
+{
+	uint32_t lo = 0, hi = n, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (ids[mid] == id)
+			return mid;
+		if (ids[mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return -1;
+}
+
+/**
+ * @brief Reduce a credential to the ids of a compiled ACL it holds
+ *
+ * @param[in]  cacl  The compiled ACL
+ * @param[in]  creds The credential
+ * @param[out] key   Gets uid and gids
+ *
+ * @return true if decisions for this ACL can be cached.
+ */
+
+static bool fsal_acl_key(struct fsal_acl_compiled *cacl,
+			 struct user_cred *creds,
+			 struct fsal_acl_decision *key)
+{
+	int i, idx;
+
+	key->uid = fsal_acl_find_id(cacl->uids, cacl->nuids,
+				    creds->caller_uid);
+	key->gids = 0;
+
+	if (cacl->ngids > FSAL_ACL_MAX_CACHED_GIDS)
+		return false;
+
+	idx = fsal_acl_find_id(cacl->gids, cacl->ngids, creds->caller_gid);
+	if (idx >= 0)
+		key->gids |= 1ULL << idx;
+
+	for (i = 0; i < creds->caller_glen; i++) {
+		idx = fsal_acl_find_id(cacl->gids, cacl->ngids,
+				       creds->caller_garray[i]);
+		if (idx >= 0)
+			key->gids |= 1ULL << idx;
+	}
+
+	return true;
+}
+
+static bool fsal_acl_lookup(struct fsal_acl_compiled *cacl,
+			    struct fsal_acl_decision *key)
+{
+	struct fsal_acl_decision *d;
+	bool found = false;
+
+	PTHREAD_MUTEX_lock(&cacl->mtx);
+
+	for (d = cacl->decisions; d < cacl->decisions + FSAL_ACL_DECISIONS;
+	     d++) {
+		if (d->flags == key->flags && d->v4mask == key->v4mask &&
+		    d->uid == key->uid && d->gids == key->gids) {
+			key->major = d->major;
+			key->allowed = d->allowed;
+			key->denied = d->denied;
+			found = true;
+			break;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&cacl->mtx);
+
+	return found;
+}
+
+static void fsal_acl_remember(struct fsal_acl_compiled *cacl,
+			      struct fsal_acl_decision *key)
+{
+	PTHREAD_MUTEX_lock(&cacl->mtx);
+	cacl->decisions[cacl->next++ % FSAL_ACL_DECISIONS] = *key;
+	PTHREAD_MUTEX_unlock(&cacl->mtx);
+}
+
+static bool fsal_check_cace_matches(struct fsal_acl_compiled *cacl,
+				    struct fsal_acl_cace *cace,
+				    struct fsal_acl_decision *key,
+				    struct user_cred *creds)
+{
+	switch (cace->who) {
+	case FSAL_ACL_WHO_OWNER:
+		return key->flags & ACL_KEY_OWNER;
+	case FSAL_ACL_WHO_GROUP:
+		return key->flags & ACL_KEY_GROUP;
+	case FSAL_ACL_WHO_EVERYONE:
+		return true;
+	case FSAL_ACL_WHO_UID:
+		return key->uid == (int32_t) cace->id;
+	case FSAL_ACL_WHO_GID:
+		if (cacl->ngids > FSAL_ACL_MAX_CACHED_GIDS)
+			return fsal_check_ace_group(cacl->gids[cace->id],
+						    creds);
+		return (key->gids >> cace->id) & 1;
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief Apply one applicable allow or deny ACE
+ *
+ * @return 0 to go on, 1 when no more ACEs need to be looked at, or -1
+ *         to fail with @a result.
+ */
+
+static int fsal_check_ace_perm(fsal_acl_t *pacl, fsal_ace_t *pace,
+			       int ace_number, struct user_cred *creds,
+			       fsal_aceperm_t v4mask,
+			       fsal_aceperm_t *missing_access,
+			       fsal_accessflags_t *allowed,
+			       fsal_accessflags_t *denied,
+			       bool is_dir, bool is_root,
+			       fsal_errors_t *result)
+{
+	fsal_aceperm_t tperm;
+
+	if (IS_FSAL_ACE_ALLOW(*pace)) {
+		/* Do not set bits which are already denied */
+		if (denied)
+			tperm = pace->perm & ~*denied;
+		else
+			tperm = pace->perm;
+
+		LogFullDebug(COMPONENT_NFS_V4_ACL,
+			     "allow perm 0x%X remainingPerms 0x%X",
+			     tperm, *missing_access);
+
+		if (allowed != NULL)
+			*allowed |= v4mask & tperm;
+
+		*missing_access &= ~(tperm & *missing_access);
+
+		if (!*missing_access) {
+			fsal_print_access_by_acl(pacl->naces, ace_number,
+						 pace, v4mask,
+						 ERR_FSAL_NO_ERROR,
+						 is_dir, creds);
+			return 1;
+		}
+	} else if ((pace->perm & *missing_access) && !is_root) {
+		fsal_print_access_by_acl(
+			pacl->naces,
+			ace_number,
+			pace,
+			v4mask,
+#ifndef ENABLE_RFC_ACL
+			(pace->perm & *missing_access &
+			 (FSAL_ACE_PERM_WRITE_ATTR |
+			  FSAL_ACE_PERM_WRITE_ACL |
+			  FSAL_ACE_PERM_WRITE_OWNER))
+			    != 0 ?
+			    ERR_FSAL_PERM :
+#endif /* ENABLE_RFC_ACL */
+			    ERR_FSAL_ACCESS,
+			is_dir,
+			creds);
+
+		if (denied != NULL)
+			*denied |= v4mask & pace->perm;
+		if (denied == NULL ||
+		    (v4mask & FSAL_ACE4_PERM_CONTINUE) == 0) {
+#ifndef ENABLE_RFC_ACL
+			if ((pace->perm & *missing_access &
+			    (FSAL_ACE_PERM_WRITE_ATTR |
+			     FSAL_ACE_PERM_WRITE_ACL |
+			     FSAL_ACE_PERM_WRITE_OWNER))
+			    != 0) {
+				LogDebug(COMPONENT_NFS_V4_ACL,
+					 "access denied (EPERM)");
+				*result = ERR_FSAL_PERM;
+			} else {
+				LogDebug(COMPONENT_NFS_V4_ACL,
+					 "access denied (EACCESS)");
+				*result = ERR_FSAL_ACCESS;
+			}
+#else /* ENABLE_RFC_ACL */
+			LogDebug(COMPONENT_NFS_V4_ACL,
+				 "access denied (EACCESS)");
+			*result = ERR_FSAL_ACCESS;
+#endif /* ENABLE_RFC_ACL */
+			return -1;
+		}
+
+		*missing_access &= ~(pace->perm & *missing_access);
+
+		/* If this DENY ACE blocked the last remaining requested
+		 * access bits, we're done and don't want to evaluate any
+		 * more ACEs.
+		 */
+		if (!*missing_access)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Walk the ACEs once the shortcuts are out of the way
+ *
+ * Uses the compiled form of the ACL when it has one, with @a key
+ * saying which of its ids the caller holds.
+ *
+ * @return ERR_FSAL_NO_ERROR, ERR_FSAL_ACCESS, ERR_FSAL_PERM, or
+ *         ERR_FSAL_NO_ACE
+ */
+
+static fsal_errors_t fsal_acl_evaluate(fsal_acl_t *pacl,
+				       struct fsal_acl_decision *key,
+				       struct user_cred *creds,
+				       fsal_aceperm_t v4mask,
+				       fsal_aceperm_t missing_access,
+				       fsal_accessflags_t *allowed,
+				       fsal_accessflags_t *denied,
+				       bool is_dir, bool is_owner,
+				       bool is_group, bool is_root)
+{
+	struct fsal_acl_compiled *cacl = pacl->compiled;
+	struct fsal_acl_cace *cace;
+	fsal_ace_t *pace = NULL;
+	fsal_errors_t result = ERR_FSAL_NO_ERROR;
+	int ace_number = 0;
+	int rc = 0;
+
+	if (cacl != NULL) {
+		for (cace = cacl->caces[is_dir];
+		     cace < cacl->caces[is_dir] + cacl->ncaces[is_dir];
+		     cace++) {
+			if (!is_root &&
+			    !fsal_check_cace_matches(cacl, cace, key, creds))
+				continue;
+
+			pace = &pacl->aces[cace->ace];
+			rc = fsal_check_ace_perm(pacl, pace, cace->ace + 1,
+						 creds, v4mask,
+						 &missing_access, allowed,
+						 denied, is_dir, is_root,
+						 &result);
+			if (rc != 0)
+				break;
+		}
+	} else {
+		for (pace = pacl->aces; pace < pacl->aces + pacl->naces;
+		     pace++) {
+			ace_number += 1;
+
+			LogFullDebug(COMPONENT_NFS_V4_ACL,
+				     "ace numnber: %d ace type 0x%X perm 0x%X flag 0x%X who %u",
+				     ace_number, pace->type, pace->perm,
+				     pace->flag, GET_FSAL_ACE_WHO(*pace));
+
+			/* Process Allow and Deny entries. */
+			if (!IS_FSAL_ACE_ALLOW(*pace) &&
+			    !IS_FSAL_ACE_DENY(*pace)) {
+				LogFullDebug(COMPONENT_NFS_V4_ACL,
+					     "not allow or deny");
+				continue;
+			}
+
+			LogFullDebug(COMPONENT_NFS_V4_ACL, "allow or deny");
+
+			/* Check if this ACE is applicable. */
+			if (!fsal_check_ace_applicable(pace, creds, is_dir,
+						       is_owner, is_group,
+						       is_root))
+				continue;
+
+			rc = fsal_check_ace_perm(pacl, pace, ace_number,
+						 creds, v4mask,
+						 &missing_access, allowed,
+						 denied, is_dir, is_root,
+						 &result);
+			if (rc != 0)
+				break;
+		}
+	}
+
+	if (rc < 0)
+		return result;
+
+	if (IS_FSAL_ACE4_REQ(v4mask) && missing_access) {
+		LogDebug(COMPONENT_NFS_V4_ACL, "final access unknown (NO_ACE)");
+		return ERR_FSAL_NO_ACE;
+	} else if (missing_access || (denied != NULL && *denied != 0)) {
+#ifndef ENABLE_RFC_ACL
+		if ((missing_access &
+		     (FSAL_ACE_PERM_WRITE_ATTR | FSAL_ACE_PERM_WRITE_ACL |
+		      FSAL_ACE_PERM_WRITE_OWNER)) != 0) {
+			LogDebug(COMPONENT_NFS_V4_ACL,
+				 "final access denied (EPERM)");
+			return ERR_FSAL_PERM;
+		} else {
+			LogDebug(COMPONENT_NFS_V4_ACL,
+				 "final access denied (EACCESS)");
+			return ERR_FSAL_ACCESS;
+		}
+#else /* ENABLE_RFC_ACL */
+		LogDebug(COMPONENT_NFS_V4_ACL, "final access denied (EACCESS)");
+		return ERR_FSAL_ACCESS;
+#endif /* ENABLE_RFC_ACL */
+	} else {
+		LogFullDebug(COMPONENT_NFS_V4_ACL, "access granted");
+		return ERR_FSAL_NO_ERROR;
+	}
+}
+
 /**
  * @brief Check access using v4 ACL list
  *
+ * Shared ACLs are evaluated in their compiled form, and the last few
+ * decisions for each are remembered.  A decision only depends on the
+ * request, the object type, which of the ACL's ids the caller holds,
+ * and whether the caller is root, owner, or in the owning group, so
+ * that is what they are looked up by.
+ *
  * @param[in] creds
  * @param[in] v4mask
  * @param[in] allowed
@@ -438,12 +771,11 @@ static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
 					   struct attrlist *p_object_attributes)
 {
 	fsal_aceperm_t missing_access;
-	fsal_aceperm_t tperm;
 	uid_t uid;
 	gid_t gid;
 	fsal_acl_t *pacl = NULL;
-	fsal_ace_t *pace = NULL;
-	int ace_number = 0;
+	struct fsal_acl_decision key;
+	bool cacheable = false;
 	bool is_dir = false;
 	bool is_owner = false;
 	bool is_group = false;
@@ -542,138 +874,41 @@ static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
 	}
 	/** @todo Even if user is admin, audit/alarm checks should be done. */
 
-	for (pace = pacl->aces; pace < pacl->aces + pacl->naces; pace++) {
-		ace_number += 1;
-
-		LogFullDebug(COMPONENT_NFS_V4_ACL,
-			     "ace numnber: %d ace type 0x%X perm 0x%X flag 0x%X who %u",
-			     ace_number, pace->type, pace->perm, pace->flag,
-			     GET_FSAL_ACE_WHO(*pace));
-
-		/* Process Allow and Deny entries. */
-		if (!IS_FSAL_ACE_ALLOW(*pace) && !IS_FSAL_ACE_DENY(*pace)) {
-			LogFullDebug(COMPONENT_NFS_V4_ACL, "not allow or deny");
-			continue;
+	if (pacl->compiled != NULL) {
+		memset(&key, 0, sizeof(key));
+		key.flags = ACL_KEY_VALID |
+			    (is_dir ? ACL_KEY_DIR : 0) |
+			    (is_owner ? ACL_KEY_OWNER : 0) |
+			    (is_group ? ACL_KEY_GROUP : 0) |
+			    (is_root ? ACL_KEY_ROOT : 0) |
+			    (allowed != NULL ? ACL_KEY_ALLOWED : 0) |
+			    (denied != NULL ? ACL_KEY_DENIED : 0);
+		key.v4mask = v4mask;
+		cacheable = fsal_acl_key(pacl->compiled, creds, &key);
+
+		if (cacheable && fsal_acl_lookup(pacl->compiled, &key)) {
+			LogFullDebug(COMPONENT_NFS_V4_ACL,
+				     "cached decision %s",
+				     msg_fsal_err(key.major));
+			if (allowed != NULL)
+				*allowed = key.allowed;
+			if (denied != NULL)
+				*denied = key.denied;
+			return fsalstat(key.major, 0);
 		}
+	}
 
-		LogFullDebug(COMPONENT_NFS_V4_ACL, "allow or deny");
-
-		/* Check if this ACE is applicable. */
-		if (fsal_check_ace_applicable(pace, creds, is_dir, is_owner,
-					      is_group, is_root)) {
-			if (IS_FSAL_ACE_ALLOW(*pace)) {
-				/* Do not set bits which are already denied */
-				if (denied)
-					tperm = pace->perm & ~*denied;
-				else
-					tperm = pace->perm;
-
-				LogFullDebug(COMPONENT_NFS_V4_ACL,
-					     "allow perm 0x%X remainingPerms 0x%X",
-					     tperm, missing_access);
-
-				if (allowed != NULL)
-					*allowed |= v4mask & tperm;
-
-				missing_access &=
-				    ~(tperm & missing_access);
-
-				if (!missing_access) {
-					fsal_print_access_by_acl(
-							pacl->naces,
-							ace_number,
-							pace,
-							v4mask,
-							ERR_FSAL_NO_ERROR,
-							is_dir,
-							creds);
-					break;
-				}
-			} else if ((pace->perm & missing_access) && !is_root) {
-				fsal_print_access_by_acl(
-					pacl->naces,
-					ace_number,
-					pace,
-					v4mask,
-#ifndef ENABLE_RFC_ACL
-					(pace->perm & missing_access &
-					 (FSAL_ACE_PERM_WRITE_ATTR |
-					  FSAL_ACE_PERM_WRITE_ACL |
-					  FSAL_ACE_PERM_WRITE_OWNER))
-					    != 0 ?
-					    ERR_FSAL_PERM :
-#endif /* ENABLE_RFC_ACL */
-					    ERR_FSAL_ACCESS,
-					is_dir,
-					creds);
-
-				if (denied != NULL)
-					*denied |= v4mask & pace->perm;
-				if (denied == NULL ||
-				    (v4mask &
-				     FSAL_ACE4_PERM_CONTINUE) == 0) {
-#ifndef ENABLE_RFC_ACL
-					if ((pace->perm & missing_access &
-					    (FSAL_ACE_PERM_WRITE_ATTR |
-					     FSAL_ACE_PERM_WRITE_ACL |
-					     FSAL_ACE_PERM_WRITE_OWNER))
-					    != 0) {
-						LogDebug(COMPONENT_NFS_V4_ACL,
-							 "access denied (EPERM)");
-						return fsalstat(ERR_FSAL_PERM,
-							0);
-					} else {
-						LogDebug(COMPONENT_NFS_V4_ACL,
-							 "access denied (EACCESS)");
-						return fsalstat(ERR_FSAL_ACCESS,
-							0);
-					}
-#else /* ENABLE_RFC_ACL */
-					LogDebug(COMPONENT_NFS_V4_ACL,
-						 "access denied (EACCESS)");
-					return fsalstat(ERR_FSAL_ACCESS, 0);
-#endif /* ENABLE_RFC_ACL */
-				}
-
-				missing_access &=
-				    ~(pace->perm & missing_access);
+	key.major = fsal_acl_evaluate(pacl, &key, creds, v4mask,
+				      missing_access, allowed, denied,
+				      is_dir, is_owner, is_group, is_root);
 
-				/* If this DENY ACE blocked the last
-				 * remaining requested access
-				 * bits, break out of the loop because
-				 * we're done and don't
-				 * want to evaluate any more ACEs.
-				 */
-				if (!missing_access)
-					break;
-			}
-		}
+	if (cacheable) {
+		key.allowed = allowed != NULL ? *allowed : 0;
+		key.denied = denied != NULL ? *denied : 0;
+		fsal_acl_remember(pacl->compiled, &key);
 	}
 
-	if (IS_FSAL_ACE4_REQ(v4mask) && missing_access) {
-		LogDebug(COMPONENT_NFS_V4_ACL, "final access unknown (NO_ACE)");
-		return fsalstat(ERR_FSAL_NO_ACE, 0);
-	} else if (missing_access || (denied != NULL && *denied != 0)) {
-#ifndef ENABLE_RFC_ACL
-		if ((missing_access &
-		     (FSAL_ACE_PERM_WRITE_ATTR | FSAL_ACE_PERM_WRITE_ACL |
-		      FSAL_ACE_PERM_WRITE_OWNER)) != 0) {
-			LogDebug(COMPONENT_NFS_V4_ACL,
-				 "final access denied (EPERM)");
-			return fsalstat(ERR_FSAL_PERM, 0);
-		} else {
-			LogDebug(COMPONENT_NFS_V4_ACL,
-				 "final access denied (EACCESS)");
-			return fsalstat(ERR_FSAL_ACCESS, 0);
-		}
-#else /* ENABLE_RFC_ACL */
-		LogDebug(COMPONENT_NFS_V4_ACL, "final access denied (EACCESS)");
-		return fsalstat(ERR_FSAL_ACCESS, 0);
-#endif /* ENABLE_RFC_ACL */
-	} else {
-		LogFullDebug(COMPONENT_NFS_V4_ACL, "access granted");
-		return fsalstat(ERR_FSAL_NO_ERROR, 0);
-	}
+	return fsalstat(key.major, 0);
 }
 
 /**
@@ -345,6 +345,152 @@ nfsstat4 FSAL_encode_v4_multipath(XDR *xdrs, const uint32_t num_hosts,
 	return NFS4_OK;
 }
 
+/*
+ * Functions specific to FLEX_FILES layouts
+ *
+ * Ganesha data servers are NFSv4.1 servers sharing the MDS's view of
+ * the file, so the layouts are tightly coupled: the client uses its
+ * own credentials and the anonymous stateid on the data servers, and
+ * data server handles are Ganesha DS handles as for files layouts.
+ */
+
+static bool xdr_ff_id(XDR *xdrs, unsigned long id)
+{
+	char buf[24];
+	utf8string name = {.utf8string_val = buf};
+
+	name.utf8string_len = snprintf(buf, sizeof(buf), "%lu", id);
+
+	return xdr_utf8str_mixed(xdrs, &name);
+}
+
+/**
+ * @brief Convenience function to encode a flex files loc_body
+ *
+ * This function encodes an ff_layout4 of @c num_mirrors mirrors, each
+ * striped over @c stripes data servers, without the FSAL having to
+ * build the structure.
+ *
+ * @param[out] xdrs        XDR stream
+ * @param[in]  stripe_unit Stripe unit, 0 if @c stripes is 1
+ * @param[in]  num_mirrors Number of mirrors
+ * @param[in]  stripes     Number of data servers in each mirror
+ * @param[in]  ds          Data servers, the stripes of the first
+ *                         mirror then those of the next
+ * @param[in]  uid         Owner of the file, informative only
+ * @param[in]  gid         Group of the file, informative only
+ *
+ * @return NFS status codes.
+ */
+nfsstat4 FSAL_encode_flex_file_layout(XDR *xdrs, const length4 stripe_unit,
+				      const uint32_t num_mirrors,
+				      const uint32_t stripes,
+				      const struct fsal_ff_ds *ds,
+				      const uid_t uid, const gid_t gid)
+{
+	length4 unit = stripe_unit;
+	stateid4 anonymous;
+	uint32_t one = 1;
+	uint32_t efficiency = 1;
+	uint32_t m, s;
+	nfsstat4 nfs_status;
+
+	memset(&anonymous, 0, sizeof(anonymous));
+
+	if (!xdr_length4(xdrs, &unit) ||
+	    !xdr_uint32_t(xdrs, (uint32_t *) &num_mirrors)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding ff_layout4.");
+		return NFS4ERR_SERVERFAULT;
+	}
+
+	for (m = 0; m < num_mirrors; m++) {
+		if (!xdr_uint32_t(xdrs, (uint32_t *) &stripes)) {
+			LogMajor(COMPONENT_PNFS,
+				 "Failed encoding mirror %"PRIu32".", m);
+			return NFS4ERR_SERVERFAULT;
+		}
+
+		for (s = 0; s < stripes; s++, ds++) {
+			nfs_fh4 handle;
+			char buffer[NFS4_FHSIZE];
+
+			handle.nfs_fh4_val = buffer;
+			handle.nfs_fh4_len = sizeof(buffer);
+			memset(buffer, 0, sizeof(buffer));
+
+			nfs_status = make_file_handle_ds(&ds->fh, ds->ds_id,
+							 &handle);
+			if (nfs_status != NFS4_OK) {
+				LogMajor(COMPONENT_PNFS,
+					 "Failed converting FH of mirror %"
+					 PRIu32" stripe %"PRIu32".", m, s);
+				return nfs_status;
+			}
+
+			if (!xdr_fsal_deviceid(xdrs,
+					       (struct pnfs_deviceid *)
+					       &ds->deviceid) ||
+			    !xdr_uint32_t(xdrs, &efficiency) ||
+			    !xdr_stateid4(xdrs, &anonymous) ||
+			    !xdr_uint32_t(xdrs, &one) ||
+			    !xdr_bytes(xdrs, (char **)&handle.nfs_fh4_val,
+				       &handle.nfs_fh4_len,
+				       handle.nfs_fh4_len) ||
+			    !xdr_ff_id(xdrs, uid) ||
+			    !xdr_ff_id(xdrs, gid)) {
+				LogMajor(COMPONENT_PNFS,
+					 "Failed encoding data server of mirror %"
+					 PRIu32" stripe %"PRIu32".", m, s);
+				return NFS4ERR_SERVERFAULT;
+			}
+		}
+	}
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Convenience function to encode a flex files device address
+ *
+ * This function encodes an ff_device_addr4 for a Ganesha data server
+ * reachable at @c hosts, speaking NFSv4.1 only.
+ *
+ * @param[out] xdrs      XDR stream
+ * @param[in]  num_hosts Number of addresses of the data server
+ * @param[in]  hosts     Addresses of the data server
+ * @param[in]  rsize     Largest READ the data server takes
+ * @param[in]  wsize     Largest WRITE the data server takes
+ *
+ * @return NFS status codes.
+ */
+nfsstat4 FSAL_encode_flex_file_device(XDR *xdrs, const uint32_t num_hosts,
+				      const fsal_multipath_member_t *hosts,
+				      const uint32_t rsize,
+				      const uint32_t wsize)
+{
+	ff_device_versions4 version = {
+		.ffdv_version = NFS_V4,
+		.ffdv_minorversion = 1,
+		.ffdv_rsize = rsize,
+		.ffdv_wsize = wsize,
+		.ffdv_tightly_coupled = true
+	};
+	uint32_t one = 1;
+	nfsstat4 nfs_status;
+
+	nfs_status = FSAL_encode_v4_multipath(xdrs, num_hosts, hosts);
+	if (nfs_status != NFS4_OK)
+		return nfs_status;
+
+	if (!xdr_uint32_t(xdrs, &one) ||
+	    !xdr_ff_device_versions4(xdrs, &version)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding ff_device_versions4.");
+		return NFS4ERR_SERVERFAULT;
+	}
+
+	return NFS4_OK;
+}
+
 /**
  * @brief Convert POSIX error codes to NFS 4 error codes
  *
@@ -213,6 +213,7 @@ void fsal_pnfs_ds_init(struct fsal_pnfs_ds *pds, struct fsal_module *fsal)
 		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 #endif
 	PTHREAD_RWLOCK_init(&pds->lock, &attrs);
+	PTHREAD_MUTEX_init(&pds->dsh_cache_lock, NULL);
 	glist_init(&pds->ds_handles);
 
 	PTHREAD_RWLOCK_wrlock(&fsal->lock);
@@ -226,6 +227,7 @@ void fsal_pnfs_ds_fini(struct fsal_pnfs_ds *pds)
 	glist_del(&pds->server);
 	PTHREAD_RWLOCK_unlock(&pds->fsal->lock);
 	PTHREAD_RWLOCK_destroy(&pds->lock);
+	PTHREAD_MUTEX_destroy(&pds->dsh_cache_lock);
 	memset(&pds->s_ops, 0, sizeof(pds->s_ops));	/* poison myself */
 	pds->fsal = NULL;
 }
@@ -2851,4 +2853,84 @@ bool check_verifier_attrlist(struct attrlist *attrs, fsal_verifier_t verifier)
 	       attrs->mtime.tv_sec == verf_lo;
 }
 
+/**
+ * @brief Copy a range of a file through the server
+ *
+ * The default copy method.  Data are read into a bounce buffer with
+ * read2 and written out with write2, which still saves moving them
+ * through the client.
+ *
+ * @param[in]  src_hdl    File to copy from
+ * @param[in]  src_state  state_t to read with, or NULL
+ * @param[in]  src_offset Position from which to copy
+ * @param[in]  dst_hdl    File to copy to
+ * @param[in]  dst_state  state_t to write with, or NULL
+ * @param[in]  dst_offset Position at which to copy
+ * @param[in]  count      Amount of data to copy
+ * @param[out] copied     Amount of data copied
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t fsal_copy_rw(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count,
+			   uint64_t *copied)
+{
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	size_t bufsize = count < FSAL_COPY_BUFSIZE ? count : FSAL_COPY_BUFSIZE;
+	char *buffer;
+
+	*copied = 0;
+
+	if (count == 0)
+		return status;
+
+	buffer = gsh_malloc(bufsize);
+
+	while (*copied < count) {
+		size_t len = count - *copied < bufsize ?
+			     count - *copied : bufsize;
+		size_t nb_read = 0, done = 0;
+		bool eof = false;
+
+		status = src_hdl->obj_ops.read2(src_hdl, false, src_state,
+						src_offset + *copied, len,
+						buffer, &nb_read, &eof, NULL);
+		if (FSAL_IS_ERROR(status) || nb_read == 0)
+			break;
+
+		while (done < nb_read) {
+			size_t nb_written = 0;
+			bool stable = false;
+
+			status = dst_hdl->obj_ops.write2(
+				dst_hdl, false, dst_state,
+				dst_offset + *copied + done, nb_read - done,
+				buffer + done, &nb_written, &stable, NULL);
+			if (FSAL_IS_ERROR(status) || nb_written == 0)
+				goto out;
+
+			done += nb_written;
+		}
+
+		*copied += nb_read;
+
+		if (eof)
+			break;
+	}
+
+ out:
+	/* Report what was copied as long as something was */
+	if (FSAL_IS_ERROR(status) && *copied != 0)
+		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	gsh_free(buffer);
+	return status;
+}
+
 /** @} */
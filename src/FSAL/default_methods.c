@@ -56,6 +56,7 @@
 #include "pnfs_utils.h"
 #include "nfs_creds.h"
 #include "sal_data.h"
+#include "gsh_iobuf.h"
 
 /** fsal module method defaults and common methods
  */
@@ -325,6 +326,19 @@ static fsal_status_t create_handle(struct fsal_export *exp_hdl,
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
+/* create_handle_hint
+ * default case ignores the hint
+ */
+
+static fsal_status_t create_handle_hint(struct fsal_export *exp_hdl,
+					struct gsh_buffdesc *hdl_desc,
+					uint64_t hint,
+					struct fsal_obj_handle **handle)
+{
+	return exp_hdl->exp_ops.create_handle(exp_hdl, hdl_desc, handle,
+					      NULL);
+}
+
 /* get_dynamic_info
  * default case is not supported
  */
@@ -553,6 +567,11 @@ static void global_verifier(struct fsal_export *exp_hdl,
 	memcpy(verf_desc->addr, &NFS4_write_verifier, verf_desc->len);
 }
 
+/* Slab cache for state_t */
+static struct gsh_slab state_slab =
+	GSH_SLAB_ARENA_INITIALIZER("state_t", sizeof(struct state_t),
+				   MEM_ARENA_SAL);
+
 /**
  * @brief Allocate a state_t structure
  *
@@ -570,7 +589,7 @@ struct state_t *alloc_state(struct fsal_export *exp_hdl,
 			    enum state_type state_type,
 			    struct state_t *related_state)
 {
-	return init_state(gsh_calloc(1, sizeof(struct state_t)),
+	return init_state(gsh_slab_alloc(&state_slab),
 			  exp_hdl, state_type, related_state);
 }
 
@@ -584,7 +603,7 @@ struct state_t *alloc_state(struct fsal_export *exp_hdl,
 
 void free_state(struct fsal_export *exp_hdl, struct state_t *state)
 {
-	gsh_free(state);
+	gsh_slab_free(&state_slab, state);
 }
 
 /**
@@ -613,6 +632,7 @@ struct export_ops def_export_ops = {
 	.lookup_junction = lookup_junction,
 	.extract_handle = extract_handle,
 	.create_handle = create_handle,
+	.create_handle_hint = create_handle_hint,
 	.get_fs_dynamic_info = get_dynamic_info,
 	.fs_supports = fs_supports,
 	.fs_maxfilesize = fs_maxfilesize,
@@ -735,6 +755,20 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
+/* read_dirents_plus
+ * default case not supported, callers fall back to readdir
+ */
+
+static fsal_status_t read_dirents_plus(struct fsal_obj_handle *dir_hdl,
+				       fsal_cookie_t *whence,
+				       attrmask_t attrmask,
+				       struct fsal_readdir_ent *ents,
+				       uint32_t *nents, bool *eof)
+{
+	*nents = 0;
+	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
+}
+
 /* release_readdir_cookie
  * default is NOOP
  */
@@ -1289,6 +1323,16 @@ static void handle_to_key(struct fsal_obj_handle *obj_hdl,
 	fh_desc->len = 0;
 }
 
+/**
+ * handle_cache_hint
+ * default case gives no hint
+ */
+
+static uint64_t handle_cache_hint(const struct fsal_obj_handle *obj_hdl)
+{
+	return 0;
+}
+
 /**
  * @brief Fail to grant a layout segment.
  *
@@ -1482,18 +1526,192 @@ static fsal_status_t write2(struct fsal_obj_handle *obj_hdl,
 }
 
 /* seek2
- * default case not supported
+ * default case not supported, quietly since READ_PLUS probes it
  */
 
 static fsal_status_t seek2(struct fsal_obj_handle *obj_hdl,
 			   struct state_t *fd,
 			   struct io_info *info)
 {
-	LogCrit(COMPONENT_FSAL,
-		"Invoking unsupported FSAL operation");
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
+/* read_ref2
+ * default case not supported, callers fall back to read2
+ */
+
+static fsal_status_t read_ref2(struct fsal_obj_handle *obj_hdl,
+			       bool bypass,
+			       struct state_t *state,
+			       uint64_t offset,
+			       size_t buffer_size,
+			       void **buffer,
+			       size_t *read_amount,
+			       bool *end_of_file,
+			       struct io_info *info)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
+}
+
+/* getchange
+ * default case not supported, callers fall back to getattrs
+ */
+
+static fsal_status_t getchange(struct fsal_obj_handle *obj_hdl,
+			       uint64_t *change)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
+}
+
+/* readv2
+ * default case reads into a bounce buffer with read2 and scatters it
+ */
+
+static fsal_status_t readv2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    const struct iovec *iov,
+			    int iovcnt,
+			    size_t *read_amount,
+			    bool *end_of_file,
+			    struct io_info *info)
+{
+	fsal_status_t status;
+	size_t total = 0, done = 0;
+	char *buffer;
+	int i;
+
+	if (iovcnt == 1)
+		return obj_hdl->obj_ops.read2(obj_hdl, bypass, state, offset,
+					      iov[0].iov_len, iov[0].iov_base,
+					      read_amount, end_of_file, info);
+
+	for (i = 0; i < iovcnt; i++)
+		total += iov[i].iov_len;
+
+	buffer = gsh_malloc(total);
+
+	status = obj_hdl->obj_ops.read2(obj_hdl, bypass, state, offset, total,
+					buffer, read_amount, end_of_file,
+					info);
+
+	for (i = 0; !FSAL_IS_ERROR(status) && done < *read_amount &&
+		    i < iovcnt; i++) {
+		size_t len = *read_amount - done;
+
+		if (len > iov[i].iov_len)
+			len = iov[i].iov_len;
+
+		memcpy(iov[i].iov_base, buffer + done, len);
+		done += len;
+	}
+
+	gsh_free(buffer);
+	return status;
+}
+
+/* writev2
+ * default case coalesces into a pooled bounce buffer and calls write2
+ */
+
+static fsal_status_t writev2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     const struct iovec *iov,
+			     int iovcnt,
+			     size_t *wrote_amount,
+			     bool *fsal_stable,
+			     struct io_info *info)
+{
+	fsal_status_t status;
+	size_t total = 0, done = 0;
+	char *buffer;
+	int i;
+
+	if (iovcnt == 1)
+		return obj_hdl->obj_ops.write2(obj_hdl, bypass, state, offset,
+					       iov[0].iov_len, iov[0].iov_base,
+					       wrote_amount, fsal_stable, info);
+
+	for (i = 0; i < iovcnt; i++)
+		total += iov[i].iov_len;
+
+	buffer = gsh_iobuf_get(total);
+
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(buffer + done, iov[i].iov_base, iov[i].iov_len);
+		done += iov[i].iov_len;
+	}
+
+	status = obj_hdl->obj_ops.write2(obj_hdl, bypass, state, offset, total,
+					 buffer, wrote_amount, fsal_stable,
+					 info);
+
+	gsh_iobuf_put(buffer);
+	return status;
+}
+
+/* read2_async
+ * default case does a synchronous readv2 and completes inline
+ */
+
+static void read2_async(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			fsal_async_cb done_cb,
+			struct fsal_io_arg *read_arg,
+			void *caller_arg)
+{
+	fsal_status_t status;
+
+	status = obj_hdl->obj_ops.readv2(obj_hdl, bypass, read_arg->state,
+					 read_arg->offset, read_arg->iov,
+					 read_arg->iov_count,
+					 &read_arg->io_amount,
+					 &read_arg->end_of_file,
+					 read_arg->info);
+
+	done_cb(obj_hdl, status, read_arg, caller_arg);
+}
+
+/* write2_async
+ * default case does a synchronous writev2 and completes inline
+ */
+
+static void write2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 fsal_async_cb done_cb,
+			 struct fsal_io_arg *write_arg,
+			 void *caller_arg)
+{
+	fsal_status_t status;
+
+	status = obj_hdl->obj_ops.writev2(obj_hdl, bypass, write_arg->state,
+					  write_arg->offset, write_arg->iov,
+					  write_arg->iov_count,
+					  &write_arg->io_amount,
+					  &write_arg->fsal_stable,
+					  write_arg->info);
+
+	done_cb(obj_hdl, status, write_arg, caller_arg);
+}
+
+/* clone
+ * default case not supported
+ */
+
+static fsal_status_t file_clone(struct fsal_obj_handle *src_hdl,
+				struct state_t *src_state,
+				uint64_t src_offset,
+				struct fsal_obj_handle *dst_hdl,
+				struct state_t *dst_state,
+				uint64_t dst_offset,
+				uint64_t count)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+}
+
 /* io io_advise2
  * default case not supported
  */
@@ -1520,6 +1738,23 @@ static fsal_status_t commit2(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
+/* commit2_async
+ * default case does a synchronous commit2 and completes inline
+ */
+
+static void commit2_async(struct fsal_obj_handle *obj_hdl,
+			  off_t offset,
+			  size_t len,
+			  fsal_async_cb done_cb,
+			  void *caller_arg)
+{
+	fsal_status_t status;
+
+	status = obj_hdl->obj_ops.commit2(obj_hdl, offset, len);
+
+	done_cb(obj_hdl, status, NULL, caller_arg);
+}
+
 /* lock_op2
  * default case not supported
  */
@@ -1573,6 +1808,7 @@ struct fsal_obj_ops def_handle_ops = {
 	.merge = handle_merge,
 	.lookup = lookup,
 	.readdir = read_dirents,
+	.readdir_plus = read_dirents_plus,
 	.release_readdir_cookie = release_readdir_cookie,
 	.compute_readdir_cookie = compute_readdir_cookie,
 	.dirent_cmp = dirent_cmp,
@@ -1613,6 +1849,7 @@ struct fsal_obj_ops def_handle_ops = {
 	.handle_digest = handle_digest,
 	.handle_cmp = handle_cmp,
 	.handle_to_key = handle_to_key,
+	.handle_cache_hint = handle_cache_hint,
 	.layoutget = layoutget,
 	.layoutreturn = layoutreturn,
 	.layoutcommit = layoutcommit,
@@ -1629,9 +1866,18 @@ struct fsal_obj_ops def_handle_ops = {
 	.seek2 = seek2,
 	.io_advise2 = io_advise2,
 	.commit2 = commit2,
+	.commit2_async = commit2_async,
 	.lock_op2 = lock_op2,
 	.setattr2 = setattr2,
 	.close2 = close2,
+	.read_ref2 = read_ref2,
+	.readv2 = readv2,
+	.writev2 = writev2,
+	.read2_async = read2_async,
+	.write2_async = write2_async,
+	.copy = fsal_copy_rw,
+	.clone = file_clone,
+	.getchange = getchange,
 };
 
 /* fsal_pnfs_ds common methods */
@@ -48,6 +48,7 @@
 #include "nfs4_acls.h"
 #include "sal_data.h"
 #include "FSAL/fsal_commonlib.h"
+#include "gsh_iobuf.h"
 
 /**
  * This is a global counter of files opened.
@@ -1041,6 +1042,74 @@ fsal_status_t fsal_read2(struct fsal_obj_handle *obj,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief New style reads into a buffer the FSAL may supply
+ *
+ * The FSAL's read_ref2 is tried first so that it can hand back a
+ * reference to data it already holds.  If the FSAL does not support
+ * that, a pooled buffer is allocated and read2 is used.  Either way,
+ * on success *buffer is a gsh_iobuf owned by the caller.
+ *
+ * @param[in]     obj          File to be read
+ * @param[in]     bypass       If state doesn't indicate a share reservation,
+ *                             bypass any deny read
+ * @param[in]     state        state_t associated with the operation
+ * @param[in]     offset       Absolute file position for I/O
+ * @param[in]     io_size      Amount of data to be read
+ * @param[out]    bytes_moved  The length of data successfuly read
+ * @param[out]    buffer       gsh_iobuf holding the data
+ * @param[out]    eof          Whether a READ encountered the end of file
+ * @param[in]     info         io_info for READ_PLUS
+ *
+ * @return FSAL status
+ */
+
+fsal_status_t fsal_read_ref2(struct fsal_obj_handle *obj,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     size_t io_size,
+			     size_t *bytes_moved,
+			     void **buffer,
+			     bool *eof,
+			     struct io_info *info)
+{
+	fsal_status_t status;
+
+	*buffer = NULL;
+
+	status = obj->obj_ops.read_ref2(obj, bypass, state, offset, io_size,
+					buffer, bytes_moved, eof, info);
+
+	if (status.major == ERR_FSAL_NOTSUPP && gsh_iobuf_segmented(io_size)) {
+		/* Too large for one segment, read straight into the
+		 * segments rather than into a bounce buffer.
+		 */
+		struct gsh_iobuf_vec *vec = gsh_iobuf_get_payload(io_size);
+
+		*buffer = vec;
+		status = obj->obj_ops.readv2(obj, bypass, state, offset,
+					     vec->iov, vec->cnt, bytes_moved,
+					     eof, info);
+		if (status.major == ERR_FSAL_SHARE_DENIED)
+			status = fsalstat(ERR_FSAL_LOCKED, 0);
+	} else if (status.major == ERR_FSAL_NOTSUPP) {
+		*buffer = gsh_iobuf_get(io_size);
+		status = fsal_read2(obj, bypass, state, offset, io_size,
+				    bytes_moved, *buffer, eof, info);
+	} else if (status.major == ERR_FSAL_SHARE_DENIED) {
+		status = fsalstat(ERR_FSAL_LOCKED, 0);
+	}
+
+	if (FSAL_IS_ERROR(status)) {
+		gsh_iobuf_put(*buffer);
+		*buffer = NULL;
+		*bytes_moved = 0;
+	}
+
+	return status;
+}
+
 /**
  * @brief New style writes
  *
@@ -1107,6 +1176,79 @@ fsal_status_t fsal_write2(struct fsal_obj_handle *obj,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/* Segments of a WRITE payload described on the stack, enough for
+ * 16 MiB in the default 1 MiB segments.
+ */
+#define WRITE_IOV_STACK 16
+
+/**
+ * @brief New style writes from a decoded WRITE payload
+ *
+ * A payload decoded by xdr_iobuf_bytes may be segmented, in which
+ * case its segments are handed to the FSAL's writev2 where they are,
+ * otherwise this is fsal_write2.  The segments of all but the largest
+ * payloads are described on the stack.
+ *
+ * @param[in]     obj          File to be written
+ * @param[in]     bypass       If state doesn't indicate a share reservation,
+ *                             bypass any non-mandatory deny write
+ * @param[in]     state        state_t associated with the operation
+ * @param[in]     offset       Absolute file position for I/O
+ * @param[in]     io_size      Amount of data to be written
+ * @param[out]    bytes_moved  The length of data successfuly written
+ * @param[in]     buffer       gsh_iobuf holding the data
+ * @param[in,out] sync         Whether the write is synchronous or not
+ *
+ * @return FSAL status
+ */
+
+fsal_status_t fsal_write_iobuf2(struct fsal_obj_handle *obj,
+				bool bypass,
+				struct state_t *state,
+				uint64_t offset,
+				size_t io_size,
+				size_t *bytes_moved,
+				void *buffer,
+				bool *sync)
+{
+	fsal_status_t status;
+	struct iovec iov_stack[WRITE_IOV_STACK];
+	struct iovec *iov = iov_stack;
+	int iovcnt;
+
+	if (!gsh_iobuf_is_vec(buffer))
+		return fsal_write2(obj, bypass, state, offset, io_size,
+				   bytes_moved, buffer, sync, NULL);
+
+	if (op_ctx->export_perms->options & EXPORT_OPTION_COMMIT) {
+		/* Force sync if export requires it */
+		*sync = true;
+	}
+
+	iovcnt = gsh_iobuf_iovcnt(buffer);
+	if (iovcnt > WRITE_IOV_STACK)
+		iov = gsh_malloc(iovcnt * sizeof(struct iovec));
+	iovcnt = gsh_iobuf_fill_iov(buffer, iov, io_size);
+
+	status = obj->obj_ops.writev2(obj, bypass, state, offset, iov, iovcnt,
+				      bytes_moved, sync, NULL);
+	if (iov != iov_stack)
+		gsh_free(iov);
+
+	/* Fixup ERR_FSAL_SHARE_DENIED status */
+	if (status.major == ERR_FSAL_SHARE_DENIED)
+		status = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "FSAL WRITEV operation returned %s, asked_size=%zu, effective_size=%zu, iovcnt=%d",
+		     fsal_err_txt(status), io_size, *bytes_moved, iovcnt);
+
+	if (FSAL_IS_ERROR(status))
+		*bytes_moved = 0;
+
+	return status;
+}
+
 /**
  * @brief Read/Write
  *
@@ -1873,6 +2015,34 @@ fsal_status_t fsal_open2(struct fsal_obj_handle *in_obj,
 	return status;
 }
 
+/**
+ * @brief Check an open that reuses one the FSAL still has
+ *
+ * Does the permission check fsal_open2 would, for an OPEN handed a
+ * state that is already open with @a openflags.
+ *
+ * @param[in] obj       File being opened
+ * @param[in] openflags Access asked for
+ *
+ * @return FSAL status
+ */
+
+fsal_status_t fsal_reuse_open2(struct fsal_obj_handle *obj,
+			       fsal_openflags_t openflags)
+{
+	fsal_status_t status;
+	char *reason;
+
+	status = check_open_permission(obj, openflags, false, &reason);
+
+	if (FSAL_IS_ERROR(status))
+		LogDebug(COMPONENT_FSAL,
+			 "Not reusing open file %s%s",
+			 reason, fsal_err_txt(status));
+
+	return status;
+}
+
 /**
  * @brief Re-Opens a file by handle.
  *
@@ -61,6 +61,9 @@
 #include "fsal_convert.h"
 #include "sal_functions.h"
 #include "pnfs_utils.h"
+#include "delayed_exec.h"
+#include "gsh_list.h"
+#include "city.h"
 
 /* Invalidate */
 
@@ -87,6 +90,180 @@ static void queue_invalidate(struct fridgethr_context *ctx)
 	gsh_free(args);
 }
 
+/*
+ * Invalidations without a callback are coalesced for
+ * Upcall_Coalesce_Window: those of one file are merged into one, and
+ * all are handed to the export's invalidate_batch when the window
+ * closes.  A backend invalidating one hot directory thousands of times
+ * a second then costs one cache lookup per window.
+ */
+
+#define UP_COALESCE_BUCKETS 1024
+
+struct up_coalesced {
+	struct glist_head hash_link;	/*< in its bucket */
+	struct glist_head list;		/*< on up_coalesce.pending */
+	struct fsal_export *export;
+	uint64_t hash;
+	struct fsal_up_invalidate inv;
+	char key[];
+};
+
+static struct {
+	pthread_mutex_t mtx;
+	struct glist_head pending;
+	uint32_t count;
+	bool scheduled;		/*< a flush is on its way */
+	struct glist_head buckets[UP_COALESCE_BUCKETS];
+} up_coalesce = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.pending = GLIST_HEAD_INIT(up_coalesce.pending),
+};
+
+static uint64_t up_coalesce_hash(struct fsal_export *export,
+				 struct gsh_buffdesc *obj)
+{
+	return CityHash64WithSeed(obj->addr, obj->len,
+				  (uint64_t) (uintptr_t) export);
+}
+
+static int up_coalesced_cmpf(const void *a, const void *b)
+{
+	const struct up_coalesced *l = *(const struct up_coalesced **) a;
+	const struct up_coalesced *r = *(const struct up_coalesced **) b;
+
+	if (l->export != r->export)
+		return (uintptr_t) l->export < (uintptr_t) r->export ? -1 : 1;
+
+	return 0;
+}
+
+/**
+ * @brief Hand the coalesced invalidations to their exports
+ */
+static void up_coalesce_run(struct fridgethr_context *ctx)
+{
+	struct glist_head pending;
+	struct up_coalesced **items;
+	struct fsal_up_invalidate *inv;
+	struct fsal_export *export;
+	uint32_t count, i, j, k;
+
+	glist_init(&pending);
+
+	PTHREAD_MUTEX_lock(&up_coalesce.mtx);
+	glist_splice_tail(&pending, &up_coalesce.pending);
+	count = up_coalesce.count;
+	up_coalesce.count = 0;
+	up_coalesce.scheduled = false;
+	for (i = 0; i < UP_COALESCE_BUCKETS; i++)
+		glist_init(&up_coalesce.buckets[i]);
+	PTHREAD_MUTEX_unlock(&up_coalesce.mtx);
+
+	if (count == 0)
+		return;
+
+	items = gsh_malloc(count * sizeof(*items));
+	inv = gsh_malloc(count * sizeof(*inv));
+	i = 0;
+	while (!glist_empty(&pending)) {
+		items[i] = glist_first_entry(&pending, struct up_coalesced,
+					     list);
+		glist_del(&items[i]->list);
+		i++;
+	}
+
+	/* One batch per export */
+	qsort(items, count, sizeof(*items), up_coalesced_cmpf);
+
+	for (i = 0; i < count; i = j) {
+		export = items[i]->export;
+		for (j = i; j < count && items[j]->export == export; j++)
+			inv[j - i] = items[j]->inv;
+
+		if (export->up_ops->invalidate_batch != NULL) {
+			export->up_ops->invalidate_batch(export, inv, j - i);
+			continue;
+		}
+
+		for (k = 0; k < j - i; k++)
+			(void) export->up_ops->invalidate(export, &inv[k].obj,
+							  inv[k].flags);
+	}
+
+	for (i = 0; i < count; i++)
+		gsh_free(items[i]);
+	gsh_free(items);
+	gsh_free(inv);
+}
+
+static void up_coalesce_fire(void *arg)
+{
+	int rc = fridgethr_submit(arg, up_coalesce_run, NULL);
+
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL_UP,
+			 "Unable to queue coalesced invalidations: %d", rc);
+		up_coalesce_run(NULL);
+	}
+}
+
+/**
+ * @brief Add an invalidation to the current window
+ */
+static int up_coalesce_add(struct fridgethr *fr, struct fsal_export *export,
+			   struct gsh_buffdesc *obj, uint32_t flags)
+{
+	uint64_t hash = up_coalesce_hash(export, obj);
+	struct glist_head *bucket;
+	struct glist_head *glist;
+	struct up_coalesced *item;
+	int rc = 0;
+
+	PTHREAD_MUTEX_lock(&up_coalesce.mtx);
+
+	bucket = &up_coalesce.buckets[hash % UP_COALESCE_BUCKETS];
+	if (bucket->next == NULL)
+		glist_init(bucket);
+
+	glist_for_each(glist, bucket) {
+		item = glist_entry(glist, struct up_coalesced, hash_link);
+		if (item->hash == hash && item->export == export &&
+		    item->inv.obj.len == obj->len &&
+		    !memcmp(item->key, obj->addr, obj->len)) {
+			item->inv.flags |= flags;
+			goto out;
+		}
+	}
+
+	item = gsh_malloc(sizeof(*item) + obj->len);
+	item->export = export;
+	item->hash = hash;
+	item->inv.flags = flags;
+	memcpy(item->key, obj->addr, obj->len);
+	item->inv.obj.addr = item->key;
+	item->inv.obj.len = obj->len;
+	glist_add_tail(bucket, &item->hash_link);
+	glist_add_tail(&up_coalesce.pending, &item->list);
+	up_coalesce.count++;
+
+	if (!up_coalesce.scheduled) {
+		rc = delayed_submit(up_coalesce_fire, fr,
+				    nfs_param.core_param.upcall_coalesce_window
+				    * NS_PER_MSEC);
+		up_coalesce.scheduled = rc == 0;
+	}
+
+out:
+	PTHREAD_MUTEX_unlock(&up_coalesce.mtx);
+
+	/* Without a timer, flush now rather than strand the window */
+	if (rc != 0)
+		up_coalesce_fire(fr);
+
+	return 0;
+}
+
 fsal_status_t up_async_invalidate(struct fridgethr *fr,
 				  struct fsal_export *export,
 			struct gsh_buffdesc *obj, uint32_t flags,
@@ -95,6 +272,11 @@ fsal_status_t up_async_invalidate(struct fridgethr *fr,
 	struct invalidate_args *args = NULL;
 	int rc = 0;
 
+	if (cb == NULL && nfs_param.core_param.upcall_coalesce_window != 0) {
+		rc = up_coalesce_add(fr, export, obj, flags);
+		return fsalstat(posix2fsal_error(rc), rc);
+	}
+
 	args = gsh_malloc(sizeof(struct invalidate_args) + obj->len);
 
 	args->export = export;
@@ -53,6 +53,8 @@ struct delegrecall_context {
 	stateid4 drc_stateid;
 	/* Hold a reference to the export during delegation recall */
 	struct gsh_export *drc_exp;
+	/* The queued CB_RECALL */
+	struct nfs_cb_batch_op drc_op;
 };
 
 enum recall_resp_action {
@@ -259,8 +261,8 @@ static state_status_t create_file_recall(struct fsal_obj_handle *obj,
 	glist_for_each(state_iter, &obj->state_hdl->file.list_of_states) {
 		/* Entry in the state list */
 		struct recall_state_list *list_entry = NULL;
-		/* Iterator over segments on this state */
-		struct glist_head *seg_iter = NULL;
+		/* Segment of this state under examination */
+		state_layout_segment_t *g;
 		/* The state under examination */
 		state_t *s = glist_entry(state_iter,
 					 state_t,
@@ -305,14 +307,12 @@ static state_status_t create_file_recall(struct fsal_obj_handle *obj,
 
 		dec_state_owner_ref(owner);
 
-		glist_for_each(seg_iter,
-			       &s->state_data.layout.state_segments) {
-			state_layout_segment_t *g = glist_entry(
-				seg_iter,
-				state_layout_segment_t,
-				sls_state_segments);
-			if (pnfs_segments_overlap(segment, &g->sls_segment))
+		for (g = state_layout_segment_first(s, segment); g != NULL;
+		     g = state_layout_segment_next(g, segment)) {
+			if (pnfs_segments_overlap(segment, &g->sls_segment)) {
 				match = true;
+				break;
+			}
 		}
 		if (match) {
 			/**
@@ -359,7 +359,7 @@ static void layoutrecall_one_call(void *arg);
 struct layoutrecall_cb_data {
 	char stateid_other[OTHERSIZE];	/*< "Other" part of state id */
 	struct pnfs_segment segment;	/*< Segment to recall */
-	nfs_cb_argop4 arg;	/*< So we don't free */
+	struct nfs_cb_batch_op op;	/*< The queued CB_LAYOUTRECALL */
 	nfs_client_id_t *client;	/*< The client we're calling. */
 	struct timespec first_recall;	/*< Time of first recall */
 	uint32_t attempts;	/*< Number of times we've recalled */
@@ -404,6 +404,9 @@ state_status_t layoutrecall(struct fsal_export *export,
 	struct glist_head *wi = NULL;
 	struct gsh_export *exp = NULL;
 	state_owner_t *owner = NULL;
+	/* The file handle, encoded once per export */
+	nfs_fh4 fh = { 0 };
+	int fh_export_id = -1;
 
 	rc = state_error_convert(export->exp_ops.create_handle(export, handle,
 							       &obj, NULL));
@@ -438,7 +441,7 @@ state_status_t layoutrecall(struct fsal_export *export,
 
 		cb_data = gsh_malloc(sizeof(struct layoutrecall_cb_data));
 
-		arg = &cb_data->arg;
+		arg = &cb_data->op.arg;
 		arg->argop = NFS4_OP_CB_LAYOUTRECALL;
 		cb_layoutrec = &arg->nfs_cb_argop4_u.opcblayoutrecall;
 		layout = &cb_layoutrec->clora_recall.layoutrecall4_u.lor_layout;
@@ -460,16 +463,28 @@ state_status_t layoutrecall(struct fsal_export *export,
 			continue;
 		}
 
-		if (!nfs4_FSALToFhandle(true, &layout->lor_fh, obj, exp)) {
-			gsh_free(cb_data);
-			put_gsh_export(exp);
-			dec_state_owner_ref(owner);
-			rc = STATE_MALLOC_ERROR;
-			goto out;
+		if (exp->export_id != fh_export_id) {
+			nfs4_freeFH(&fh);
+			fh_export_id = -1;
+
+			if (!nfs4_FSALToFhandle(true, &fh, obj, exp)) {
+				gsh_free(cb_data);
+				put_gsh_export(exp);
+				dec_state_owner_ref(owner);
+				rc = STATE_MALLOC_ERROR;
+				goto out;
+			}
+
+			fh_export_id = exp->export_id;
 		}
 
 		put_gsh_export(exp);
 
+		layout->lor_fh.nfs_fh4_len = fh.nfs_fh4_len;
+		layout->lor_fh.nfs_fh4_val = gsh_malloc(fh.nfs_fh4_len);
+		memcpy(layout->lor_fh.nfs_fh4_val, fh.nfs_fh4_val,
+		       fh.nfs_fh4_len);
+
 		update_stateid(s, &layout->lor_stateid, NULL, "LAYOUTRECALL");
 
 		memcpy(cb_data->stateid_other, s->stateid_other, OTHERSIZE);
@@ -484,6 +499,8 @@ state_status_t layoutrecall(struct fsal_export *export,
 
  out:
 
+	nfs4_freeFH(&fh);
+
 	/* Free the recall list resources */
 	destroy_recall(recall);
 	obj->obj_ops.put_ref(obj);
@@ -517,18 +534,16 @@ static void free_layoutrec(nfs_cb_argop4 *op)
  * For DELAY, it backs off in plateaus, then revokes the layout if the
  * period of delay has surpassed the lease period.
  *
- * @param[in] call  The RPC call being completed
- * @param[in] hook  The hook itself
- * @param[in] arg   Supplied argument (the callback data)
- * @param[in] flags There are no flags.
- *
- * @return 0, constantly.
+ * @param[in] op     The queued operation, in the callback data
+ * @param[in] hook   The hook itself
+ * @param[in] status The client's answer to the recall
  */
 
-static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
-				    void *arg, uint32_t flags)
+static void layoutrec_completion(struct nfs_cb_batch_op *op,
+				 rpc_call_hook hook, nfsstat4 status)
 {
-	struct layoutrecall_cb_data *cb_data = arg;
+	struct layoutrecall_cb_data *cb_data =
+		container_of(op, struct layoutrecall_cb_data, op);
 	bool deleted = false;
 	state_t *state = NULL;
 	struct root_op_context root_op_context;
@@ -542,13 +557,13 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 			     0, 0, UNKNOWN_REQUEST);
 
 	LogFullDebug(COMPONENT_NFS_CB, "status %d cb_data %p",
-		     call->cbt.v_u.v4.res.status, cb_data);
+		     status, cb_data);
 
 	/* Get this out of the way up front */
 	if (hook != RPC_CALL_COMPLETE)
 		goto revoke;
 
-	if (call->cbt.v_u.v4.res.status == NFS4_OK) {
+	if (status == NFS4_OK) {
 		/**
 		 * @todo This is where you would record that a
 		 * recall was acknowledged and that a layoutreturn
@@ -562,11 +577,10 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 		 * above this point in the function, or we could stash
 		 * the clientid in cb_data.
 		 */
-		free_layoutrec(&call->cbt.v_u.v4.args.argarray.argarray_val[1]);
-		nfs41_complete_single(call, hook, cb_data, flags);
+		free_layoutrec(&cb_data->op.arg);
 		gsh_free(cb_data);
 		goto out;
-	} else if (call->cbt.v_u.v4.res.status == NFS4ERR_DELAY) {
+	} else if (status == NFS4ERR_DELAY) {
 		struct timespec current;
 		nsecs_elapsed_t delay;
 
@@ -588,7 +602,6 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 
 		/* We don't free the argument here, because we'll be
 		   re-using that to make the queued call. */
-		nfs41_complete_single(call, hook, cb_data, flags);
 		delayed_submit(layoutrecall_one_call, cb_data, delay);
 		goto out;
 	}
@@ -608,8 +621,7 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 		enum fsal_layoutreturn_circumstance circumstance;
 
 		if (hook == RPC_CALL_COMPLETE &&
-		    call->cbt.v_u.v4.res.status ==
-		    NFS4ERR_NOMATCHING_LAYOUT)
+		    status == NFS4ERR_NOMATCHING_LAYOUT)
 			circumstance = circumstance_client;
 		else
 			circumstance = circumstance_revoke;
@@ -622,8 +634,7 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 		 * The number of times we retried the call is
 		 * specified in cb_data->attempts and the time we
 		 * specified the first call is in
-		 * cb_data->first_recall.  If
-		 * call->cbt.v_u.v4.res.status is
+		 * cb_data->first_recall.  If status is
 		 * NFS4ERR_NOMATCHING_LAYOUT it was a successful
 		 * return, otherwise we count it as an error.
 		 */
@@ -648,8 +659,7 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 		dec_state_t_ref(state);
 	}
 
-	free_layoutrec(&call->cbt.v_u.v4.args.argarray.argarray_val[1]);
-	nfs41_complete_single(call, hook, cb_data, flags);
+	free_layoutrec(&cb_data->op.arg);
 	gsh_free(cb_data);
 
 out:
@@ -665,74 +675,6 @@ out:
 		/* Release the owner */
 		dec_state_owner_ref(owner);
 	}
-
-	return 0;
-}
-
-/**
- * @brief Return one layout on error
- *
- * This is only invoked in the case of a send error on the first
- * attempt to issue a CB_LAYOUTRECALL, so that we don't call into the
- * FSAL's layoutreturn function while its layoutrecall function may be
- * holding locks.
- *
- * @param[in] arg Structure holding all arguments, so we can queue
- *                this function in delayed_exec.
- */
-
-static void return_one_async(void *arg)
-{
-	struct layoutrecall_cb_data *cb_data = arg;
-	state_t *state;
-	bool deleted = false;
-	struct root_op_context root_op_context;
-	struct fsal_obj_handle *obj = NULL;
-	struct gsh_export *export = NULL;
-	state_owner_t *owner = NULL;
-	bool ok = false;
-
-	/* Initialize req_ctx */
-	init_root_op_context(&root_op_context, NULL, NULL,
-			     0, 0, UNKNOWN_REQUEST);
-
-	state = nfs4_State_Get_Pointer(cb_data->stateid_other);
-
-	ok = get_state_obj_export_owner_refs(state, &obj, &export, &owner);
-
-	if (ok) {
-		PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
-
-		root_op_context.req_ctx.clientid =
-			&owner->so_owner.so_nfs4_owner.so_clientid;
-		root_op_context.req_ctx.ctx_export = export;
-		root_op_context.req_ctx.fsal_export = export->fsal_export;
-
-		nfs4_return_one_state(obj, LAYOUTRETURN4_FILE,
-				      circumstance_revoke, state,
-				      cb_data->segment, 0, NULL, &deleted);
-
-		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
-	}
-
-	release_root_op_context();
-	gsh_free(cb_data);
-
-	if (state != NULL) {
-		/* Release the reference taken above */
-		dec_state_t_ref(state);
-	}
-
-	if (ok) {
-		/* Release the export */
-		put_gsh_export(export);
-
-		/* Release object ref */
-		obj->obj_ops.put_ref(obj);
-
-		/* Release the owner */
-		dec_state_owner_ref(owner);
-	}
 }
 
 /**
@@ -746,7 +688,6 @@ static void layoutrecall_one_call(void *arg)
 {
 	struct layoutrecall_cb_data *cb_data = arg;
 	state_t *state;
-	int code;
 	struct root_op_context root_op_context;
 	struct fsal_obj_handle *obj = NULL;
 	struct gsh_export *export = NULL;
@@ -772,55 +713,16 @@ static void layoutrecall_one_call(void *arg)
 		root_op_context.req_ctx.ctx_export = export;
 		root_op_context.req_ctx.fsal_export = export->fsal_export;
 
-		code = nfs_rpc_v41_single(cb_data->client, &cb_data->arg,
-					  &state->state_refer,
-					  layoutrec_completion,
-					  cb_data, free_layoutrec);
-
-		if (code != 0) {
-			/**
-			 * @todo On failure to submit a callback, we
-			 * ought to give the client at least one lease
-			 * period to establish a back channel before
-			 * we start revoking state.  We don't have the
-			 * infrasturcture to properly handle layout
-			 * revocation, however.  Once we get the
-			 * capability to revoke layouts we should
-			 * queue requests on the clientid, obey the
-			 * retransmission rule, and provide a callback
-			 * to dispose of a call and revoke state after
-			 * some number of lease periods.
-			 *
-			 * At present we just assume the client has
-			 * gone completely out to lunch and fake a
-			 * return.
-			 */
-
-			/**
-			 * @todo This is where you would record that a
-			 * recall failed.  (It indicates a transport error.)
-			 * The clientid is specified in
-			 * s->state_owner->so_owner.so_nfs4_owner.so_clientid
-			 * The number of times we retried the call is
-			 * specified in cb_data->attempts and the time
-			 * we specified the first call is in
-			 * cb_data->first_recall.
-			 */
-			if (cb_data->attempts == 0) {
-				delayed_submit(return_one_async, cb_data, 0);
-			} else {
-				bool deleted = false;
-
-				nfs4_return_one_state(obj,
-						      LAYOUTRETURN4_FILE,
-						      circumstance_revoke,
-						      state, cb_data->segment,
-						      0, NULL, &deleted);
-				gsh_free(cb_data);
-			}
-		} else {
-			++cb_data->attempts;
-		}
+		/* A client with no back channel gets the recall
+		 * completed as aborted, which revokes the layout from a
+		 * callback thread rather than under the FSAL's
+		 * layoutrecall.
+		 */
+		cb_data->op.refer = state->state_refer;
+		cb_data->op.has_refer = true;
+		cb_data->op.completion = layoutrec_completion;
+		++cb_data->attempts;
+		nfs_rpc_cb_batch(cb_data->client, &cb_data->op);
 
 		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
 
@@ -1016,16 +918,16 @@ bool eval_deleg_revoke(struct state_t *deleg_state)
 /**
  * @brief Handle recall response
  *
- * @param[in] call  The RPC call being completed
- * @param[in] clfl_stats  client-file deleg heuristics
  * @param[in] p_cargs deleg recall context
+ * @param[in] state   The delegation
+ * @param[in] status  The client's answer to the recall
  *
  */
 
 static enum recall_resp_action handle_recall_response(
 				struct delegrecall_context *p_cargs,
 				struct state_t *state,
-				rpc_call_t *call)
+				nfsstat4 status)
 {
 	enum recall_resp_action resp_action;
 	char str[DISPLAY_STATEID_OTHER_SIZE];
@@ -1040,7 +942,7 @@ static enum recall_resp_action handle_recall_response(
 	struct cf_deleg_stats *clfl_stats =
 		&state->state_data.deleg.sd_clfile_stats;
 
-	switch (call->cbt.v_u.v4.res.status) {
+	switch (status) {
 	case NFS4_OK:
 		if (str_valid)
 			LogDebug(COMPONENT_NFS_CB,
@@ -1075,8 +977,7 @@ static enum recall_resp_action handle_recall_response(
 		if (str_valid)
 			LogDebug(COMPONENT_NFS_CB,
 				 "Client sent %d response, retrying recall for Delegation %s",
-				 call->cbt.v_u.v4.res.status,
-				 str);
+				 status, str);
 		resp_action = DELEG_RECALL_SCHED;
 		break;
 	}
@@ -1086,9 +987,7 @@ static enum recall_resp_action handle_recall_response(
 static inline void
 free_delegrecall_context(struct delegrecall_context *deleg_ctx)
 {
-	PTHREAD_MUTEX_lock(&deleg_ctx->drc_clid->cid_mutex);
 	update_lease(deleg_ctx->drc_clid);
-	PTHREAD_MUTEX_unlock(&deleg_ctx->drc_clid->cid_mutex);
 
 	put_gsh_export(deleg_ctx->drc_exp);
 
@@ -1100,28 +999,25 @@ free_delegrecall_context(struct delegrecall_context *deleg_ctx)
 /**
  * @brief Handle the reply to a CB_RECALL
  *
- * @param[in] call  The RPC call being completed
- * @param[in] hook  The hook itself
- * @param[in] arg   Supplied argument (the callback data)
- * @param[in] flags There are no flags.
- *
- * @return 0, constantly.
+ * @param[in] op     The queued operation, in the recall context
+ * @param[in] hook   The hook itself
+ * @param[in] status The client's answer to the recall
  */
 
-static int32_t delegrecall_completion_func(rpc_call_t *call,
-					   rpc_call_hook hook, void *arg,
-					   uint32_t flags)
+static void delegrecall_completion_func(struct nfs_cb_batch_op *op,
+					rpc_call_hook hook, nfsstat4 status)
 {
-	char *fh = NULL;
+	char *fh = op->arg.nfs_cb_argop4_u.opcbrecall.fh.nfs_fh4_val;
 	enum recall_resp_action resp_act;
 	nfsstat4 rc = NFS4_OK;
-	struct delegrecall_context *deleg_ctx = arg;
+	struct delegrecall_context *deleg_ctx =
+		container_of(op, struct delegrecall_context, drc_op);
 	struct state_t *state;
 	struct fsal_obj_handle *obj = NULL;
 	char str[LOG_BUFF_LEN];
 	struct display_buffer dspbuf = {sizeof(str), str, str};
 
-	LogDebug(COMPONENT_NFS_CB, "%p %s", call,
+	LogDebug(COMPONENT_NFS_CB, "%p %s", op,
 		 (hook == RPC_CALL_COMPLETE) ? "Success" : "Failed");
 
 	state = nfs4_State_Get_Pointer(deleg_ctx->drc_stateid.other);
@@ -1148,24 +1044,17 @@ static int32_t delegrecall_completion_func(rpc_call_t *call,
 
 	switch (hook) {
 	case RPC_CALL_COMPLETE:
-		LogMidDebug(COMPONENT_NFS_CB, "call result: %d", call->stat);
-		fh = call->cbt.v_u.v4.args.argarray.argarray_val->
-				nfs_cb_argop4_u.opcbrecall.fh.nfs_fh4_val;
-		if (call->stat != RPC_SUCCESS) {
-			LogEvent(COMPONENT_NFS_CB,
-				 "Call stat: %d, marking CB channel down",
-				 call->stat);
-			set_cb_chan_down(deleg_ctx->drc_clid, true);
-			resp_act = DELEG_RECALL_SCHED;
-		} else
-			resp_act = handle_recall_response(deleg_ctx,
-							  state,
-							  call);
+		LogMidDebug(COMPONENT_NFS_CB, "call result: %d", status);
+		resp_act = handle_recall_response(deleg_ctx, state, status);
 		break;
 	default:
 		LogEvent(COMPONENT_NFS_CB,
-			 "Unknown hook %d, marking CB channel down", hook);
-		set_cb_chan_down(deleg_ctx->drc_clid, true);
+			 "Recall not sent (hook %d), marking CB channel down",
+			 hook);
+		inc_failed_recalls(deleg_ctx->drc_clid->gsh_client);
+		/* The v4.1 back channel is tracked per session */
+		if (deleg_ctx->drc_clid->cid_minorversion == 0)
+			set_cb_chan_down(deleg_ctx->drc_clid, true);
 		/* Mark the recall as failed */
 		resp_act = DELEG_RECALL_SCHED;
 		break;
@@ -1214,15 +1103,10 @@ out_free_drc:
 
 out_free:
 
-	fh = call->cbt.v_u.v4.args.argarray.argarray_val->
-				nfs_cb_argop4_u.opcbrecall.fh.nfs_fh4_val;
 	gsh_free(fh);
-	free_rpc_call(call);
 
 	if (state != NULL)
 		dec_state_t_ref(state);
-
-	return 0; /*Always return zero, the delegation is recalled or revoked */
 }
 
 /**
@@ -1240,9 +1124,7 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 		     struct state_t *state,
 		     struct delegrecall_context *p_cargs)
 {
-	rpc_call_channel_t *chan;
-	rpc_call_t *call = NULL;
-	nfs_cb_argop4 argop[1];
+	nfs_cb_argop4 *argop = &p_cargs->drc_op.arg;
 	struct cf_deleg_stats *clfl_stats;
 	char str[LOG_BUFF_LEN];
 	struct display_buffer dspbuf = {sizeof(str), str, str};
@@ -1264,6 +1146,9 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 
 	inc_recalls(p_cargs->drc_clid->gsh_client);
 
+	/* The context is reused for retries, start from a clean op */
+	memset(argop, 0, sizeof(*argop));
+
 	/* Attempt a recall only if channel state is UP */
 	if (get_cb_chan_down(p_cargs->drc_clid)) {
 		LogCrit(COMPONENT_NFS_CB,
@@ -1271,28 +1156,6 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 		goto out;
 	}
 
-	chan = nfs_rpc_get_chan(p_cargs->drc_clid, NFS_RPC_FLAG_NONE);
-	if (!chan) {
-		LogCrit(COMPONENT_NFS_CB, "nfs_rpc_get_chan failed");
-		/* TODO: move this to nfs_rpc_get_chan ? */
-		set_cb_chan_down(p_cargs->drc_clid, true);
-		goto out;
-	}
-	if (!chan->clnt) {
-		LogCrit(COMPONENT_NFS_CB, "nfs_rpc_get_chan failed (no clnt)");
-		set_cb_chan_down(p_cargs->drc_clid, true);
-		goto out;
-	}
-	/* allocate a new call--freed in completion hook */
-	call = alloc_rpc_call();
-
-	call->chan = chan;
-
-	/* setup a compound */
-	cb_compound_init_v4(&call->cbt, 1, 0,
-			    p_cargs->drc_clid->cid_cb.v40.cb_callback_ident,
-			    "brrring!!!", 10);
-
 	argop->argop = NFS4_OP_CB_RECALL;
 	COPY_STATEID(&argop->nfs_cb_argop4_u.opcbrecall.stateid, state);
 	argop->nfs_cb_argop4_u.opcbrecall.truncate = false;
@@ -1305,16 +1168,16 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 		goto out;
 	}
 
-	/* add ops, till finished */
-	cb_compound_add_op(&call->cbt, argop);
-
-	/* set completion hook */
-	call->call_hook = delegrecall_completion_func;
-
-	/* call it (here, in current thread context)
-	   ret is always 0 for async calls, might change in future */
-	if (nfs_rpc_submit_call(call, p_cargs, NFS_RPC_CALL_NONE) == 0)
-		return;
+	/* Queue it with whatever else this client is being sent, the
+	 * channel is set up and the completion called on a callback
+	 * thread.
+	 */
+	p_cargs->drc_op.refer = state->state_refer;
+	p_cargs->drc_op.has_refer =
+		p_cargs->drc_clid->cid_minorversion != 0;
+	p_cargs->drc_op.completion = delegrecall_completion_func;
+	nfs_rpc_cb_batch(p_cargs->drc_clid, &p_cargs->drc_op);
+	return;
 
 out:
 
@@ -1322,9 +1185,6 @@ out:
 
 	nfs4_freeFH(&argop->nfs_cb_argop4_u.opcbrecall.fh);
 
-	if (call)
-		free_rpc_call(call);
-
 	if (!eval_deleg_revoke(state) &&
 	    !schedule_delegrecall_task(p_cargs, 1)) {
 		/* Keep the delegation in p_cargs */
@@ -1484,83 +1344,99 @@ static int schedule_delegrevoke_check(struct delegrecall_context *ctx,
 	return rc;
 }
 
-state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
+/**
+ * @brief Recall one delegation
+ *
+ * Files and directories alike.  The state_lock MUST be held for write.
+ *
+ * @param[in] obj   Object the delegation is on
+ * @param[in] state The delegation
+ */
+void delegrecall_state(struct fsal_obj_handle *obj, struct state_t *state)
 {
-	struct glist_head *glist, *glist_n;
-	state_status_t rc = 0;
 	uint32_t *deleg_state = NULL;
-	struct state_t *state;
 	state_owner_t *owner;
 	struct delegrecall_context *drc_ctx;
 
-	LogDebug(COMPONENT_FSAL_UP,
-		 "FSAL_UP_DELEG: obj %p type %u",
-		 obj, obj->type);
+	if (isDebug(COMPONENT_NFS_CB)) {
+		char str[LOG_BUFF_LEN];
+		struct display_buffer dspbuf = {sizeof(str), str, str};
 
-	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
-	glist_for_each_safe(glist, glist_n,
-			    &obj->state_hdl->file.list_of_states) {
-		state = glist_entry(glist, struct state_t, state_list);
+		display_stateid(&dspbuf, state);
+		LogDebug(COMPONENT_NFS_CB, "Delegation for %s", str);
+	}
 
-		if (state->state_type != STATE_TYPE_DELEG)
-			continue;
+	deleg_state = &state->state_data.deleg.sd_state;
+	if (*deleg_state != DELEG_GRANTED) {
+		LogDebug(COMPONENT_FSAL_UP,
+			 "Delegation already being recalled, NOOP");
+		return;
+	}
+	*deleg_state = DELEG_RECALL_WIP;
 
-		if (isDebug(COMPONENT_NFS_CB)) {
-			char str[LOG_BUFF_LEN];
-			struct display_buffer dspbuf = {sizeof(str), str, str};
+	drc_ctx = gsh_malloc(sizeof(struct delegrecall_context));
 
-			display_stateid(&dspbuf, state);
-			LogDebug(COMPONENT_NFS_CB, "Delegation for %s", str);
-		}
+	/* Get references on the owner and the the export. The
+	 * export reference we will hold while we perform the recall.
+	 * The owner reference will be used to get access to the
+	 * clientid and reserve the lease.
+	 */
+	if (!get_state_obj_export_owner_refs(state, NULL,
+					     &drc_ctx->drc_exp,
+					     &owner)) {
+		LogDebug(COMPONENT_FSAL_UP,
+			 "Something is going stale, no need to recall delegation");
+		gsh_free(drc_ctx);
+		return;
+	}
 
-		deleg_state = &state->state_data.deleg.sd_state;
-		if (*deleg_state != DELEG_GRANTED) {
-			LogDebug(COMPONENT_FSAL_UP,
-				 "Delegation already being recalled, NOOP");
-			continue;
-		}
-		*deleg_state = DELEG_RECALL_WIP;
+	drc_ctx->drc_clid = owner->so_owner.so_nfs4_owner.so_clientrec;
+	COPY_STATEID(&drc_ctx->drc_stateid, state);
+	inc_client_id_ref(drc_ctx->drc_clid);
+	dec_state_owner_ref(owner);
 
-		drc_ctx = gsh_malloc(sizeof(struct delegrecall_context));
+	if (obj->type == REGULAR_FILE)
+		obj->state_hdl->file.fdeleg_stats.fds_last_recall = time(NULL);
 
-		/* Get references on the owner and the the export. The
-		 * export reference we will hold while we perform the recall.
-		 * The owner reference will be used to get access to the
-		 * clientid and reserve the lease.
-		 */
-		if (!get_state_obj_export_owner_refs(state, NULL,
-						     &drc_ctx->drc_exp,
-						     &owner)) {
-			LogDebug(COMPONENT_FSAL_UP,
-				 "Something is going stale, no need to recall delegation");
-			gsh_free(drc_ctx);
-			continue;
-		}
+	/* Prevent client's lease expiring until we complete
+	 * this recall/revoke operation. If the client's lease
+	 * has already expired, let the reaper thread handling
+	 * expired clients revoke this delegation, and we just
+	 * skip it here.
+	 */
+	if (!reserve_lease(drc_ctx->drc_clid)) {
+		put_gsh_export(drc_ctx->drc_exp);
+		dec_client_id_ref(drc_ctx->drc_clid);
+		gsh_free(drc_ctx);
+		return;
+	}
 
-		drc_ctx->drc_clid = owner->so_owner.so_nfs4_owner.so_clientrec;
-		COPY_STATEID(&drc_ctx->drc_stateid, state);
-		inc_client_id_ref(drc_ctx->drc_clid);
-		dec_state_owner_ref(owner);
+	delegrecall_one(obj, state, drc_ctx);
+}
 
-		obj->state_hdl->file.fdeleg_stats.fds_last_recall = time(NULL);
+state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
+{
+	struct glist_head *glist, *glist_n, *list;
+	state_status_t rc = 0;
+	struct state_t *state;
 
-		/* Prevent client's lease expiring until we complete
-		 * this recall/revoke operation. If the client's lease
-		 * has already expired, let the reaper thread handling
-		 * expired clients revoke this delegation, and we just
-		 * skip it here.
-		 */
-		PTHREAD_MUTEX_lock(&drc_ctx->drc_clid->cid_mutex);
-		if (!reserve_lease(drc_ctx->drc_clid)) {
-			PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
-			put_gsh_export(drc_ctx->drc_exp);
-			dec_client_id_ref(drc_ctx->drc_clid);
-			gsh_free(drc_ctx);
+	LogDebug(COMPONENT_FSAL_UP,
+		 "FSAL_UP_DELEG: obj %p type %u",
+		 obj, obj->type);
+
+	if (obj->type == DIRECTORY)
+		list = &obj->state_hdl->dir.dir_delegs;
+	else
+		list = &obj->state_hdl->file.list_of_states;
+
+	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+	glist_for_each_safe(glist, glist_n, list) {
+		state = glist_entry(glist, struct state_t, state_list);
+
+		if (state->state_type != STATE_TYPE_DELEG)
 			continue;
-		}
-		PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
 
-		delegrecall_one(obj, state, drc_ctx);
+		delegrecall_state(obj, state);
 	}
 	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
 	return rc;
@@ -45,6 +45,7 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>		/* For inet_ntop() */
 #include "hashtable.h"
 #include "log.h"
@@ -99,64 +100,43 @@ void DispatchWork9P(request_data_t *req)
 }
 
 /**
- * _9p_socket_thread: 9p socket manager.
- *
- * This function is the main loop for the 9p socket manager.
- * One such thread exists per connection.
- *
- * @param Arg the socket number cast as a void * in pthread_create
- *
- * @return NULL
+ * @brief Set up a 9P/TCP connection on an accepted socket
  *
+ * @param[out] conn      The connection
+ * @param[in]  tcp_sock  The socket
+ * @param[out] strcaller Buffer of INET6_ADDRSTRLEN for the peer's address
  */
-
-void *_9p_socket_thread(void *Arg)
+static void _9p_tcp_conn_init(struct _9p_conn *conn, long int tcp_sock,
+			      char *strcaller)
 {
-	long int tcp_sock = (long int)Arg;
-	int rc = -1;
-	struct pollfd fds[1];
-	int fdcount = 1;
-	static char my_name[MAXNAMLEN + 1];
-	char strcaller[INET6_ADDRSTRLEN];
-	request_data_t *req = NULL;
-	int tag;
-	unsigned long sequence = 0;
-	unsigned int i = 0;
-	char *_9pmsg = NULL;
-	uint32_t msglen;
-
-	struct _9p_conn _9p_conn;
 	socklen_t addrpeerlen;
-
-	int readlen = 0;
-	int total_readlen = 0;
-
-	snprintf(my_name, MAXNAMLEN, "9p_sock_mgr#fd=%ld", tcp_sock);
-	SetNameFunction(my_name);
+	unsigned int i;
+	int rc;
 
 	/* Init the struct _9p_conn structure */
-	memset(&_9p_conn, 0, sizeof(_9p_conn));
-	PTHREAD_MUTEX_init(&_9p_conn.sock_lock, NULL);
-	_9p_conn.trans_type = _9P_TCP;
-	_9p_conn.trans_data.sockfd = tcp_sock;
+	memset(conn, 0, sizeof(*conn));
+	PTHREAD_MUTEX_init(&conn->sock_lock, NULL);
+	conn->trans_type = _9P_TCP;
+	conn->trans_data.sockfd = tcp_sock;
 	for (i = 0; i < FLUSH_BUCKETS; i++) {
-		PTHREAD_MUTEX_init(&_9p_conn.flush_buckets[i].lock, NULL);
-		glist_init(&_9p_conn.flush_buckets[i].list);
+		PTHREAD_MUTEX_init(&conn->flush_buckets[i].lock, NULL);
+		glist_init(&conn->flush_buckets[i].list);
 	}
-	atomic_store_uint32_t(&_9p_conn.refcount, 0);
+	atomic_store_uint32_t(&conn->refcount, 0);
 
-	/* Init the fids pointers array */
-	memset(&_9p_conn.fids, 0, _9P_FID_PER_CONN * sizeof(struct _9p_fid *));
+	/* Init the fids pages array */
+	memset(&conn->fid_pages, 0, sizeof(conn->fid_pages));
 
 	/* Set initial msize.
 	 * Client may request a lower value during TVERSION */
-	_9p_conn.msize = _9p_param._9p_tcp_msize;
+	conn->msize = _9p_param._9p_tcp_msize;
+	_9p_tcp_bufs_init(conn);
 
-	if (gettimeofday(&_9p_conn.birth, NULL) == -1)
+	if (gettimeofday(&conn->birth, NULL) == -1)
 		LogFatal(COMPONENT_9P, "Cannot get connection's time of birth");
 
-	addrpeerlen = sizeof(_9p_conn.addrpeer);
-	rc = getpeername(tcp_sock, (struct sockaddr *)&_9p_conn.addrpeer,
+	addrpeerlen = sizeof(conn->addrpeer);
+	rc = getpeername(tcp_sock, (struct sockaddr *)&conn->addrpeer,
 			 &addrpeerlen);
 	if (rc == -1) {
 		LogMajor(COMPONENT_9P,
@@ -166,15 +146,15 @@ void *_9p_socket_thread(void *Arg)
 		strncpy(strcaller, "(unresolved)", INET6_ADDRSTRLEN);
 		strcaller[12] = '\0';
 	} else {
-		switch (_9p_conn.addrpeer.ss_family) {
+		switch (conn->addrpeer.ss_family) {
 		case AF_INET:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in *)&_9p_conn.addrpeer)->
+			inet_ntop(conn->addrpeer.ss_family,
+				  &((struct sockaddr_in *)&conn->addrpeer)->
 				  sin_addr, strcaller, INET6_ADDRSTRLEN);
 			break;
 		case AF_INET6:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in6 *)&_9p_conn.addrpeer)->
+			inet_ntop(conn->addrpeer.ss_family,
+				  &((struct sockaddr_in6 *)&conn->addrpeer)->
 				  sin6_addr, strcaller, INET6_ADDRSTRLEN);
 			break;
 		default:
@@ -185,7 +165,89 @@ void *_9p_socket_thread(void *Arg)
 		LogEvent(COMPONENT_9P, "9p socket #%ld is connected to %s",
 			 tcp_sock, strcaller);
 	}
-	_9p_conn.client = get_gsh_client(&_9p_conn.addrpeer, false);
+	conn->client = get_gsh_client(&conn->addrpeer, false);
+}
+
+/**
+ * @brief Release a 9P/TCP connection no worker refers to anymore
+ *
+ * @param[in] conn The connection, its socket already closed
+ */
+static void _9p_tcp_conn_fini(struct _9p_conn *conn)
+{
+	_9p_cleanup_fids(conn);
+
+	if (conn->client != NULL)
+		put_gsh_client(conn->client);
+
+	_9p_tcp_bufs_fini(conn);
+}
+
+/**
+ * @brief Hand a complete 9P/TCP message to the workers
+ *
+ * @param[in] conn   The connection it came in on
+ * @param[in] _9pmsg The message, now owned by the request
+ * @param[in] msglen Its length
+ */
+static void _9p_tcp_dispatch(struct _9p_conn *conn, char *_9pmsg,
+			     uint32_t msglen)
+{
+	request_data_t *req;
+	int tag;
+
+	server_stats_transport_done(conn->client, msglen, 1, 0, 0, 0, 0);
+
+	/* Message is good. */
+	req = pool_alloc(request_pool);
+
+	req->rtype = _9P_REQUEST;
+	req->r_u._9p._9pmsg = _9pmsg;
+	req->r_u._9p.pconn = conn;
+
+	/* Add this request to the request list,
+	 * should it be flushed later. */
+	tag = *(u16 *) (_9pmsg + _9P_HDR_SIZE + _9P_TYPE_SIZE);
+	_9p_AddFlushHook(&req->r_u._9p, tag, conn->sequence++);
+	LogFullDebug(COMPONENT_9P, "Request tag is %d\n", tag);
+
+	/* Message was OK push it */
+	DispatchWork9P(req);
+}
+
+/**
+ * _9p_socket_thread: 9p socket manager.
+ *
+ * This function is the main loop for the 9p socket manager.
+ * One such thread exists per connection when _9P_TCP_Event_Loops
+ * is 0.
+ *
+ * @param Arg the socket number cast as a void * in pthread_create
+ *
+ * @return NULL
+ *
+ */
+
+void *_9p_socket_thread(void *Arg)
+{
+	long int tcp_sock = (long int)Arg;
+	int rc = -1;
+	struct pollfd fds[1];
+	int fdcount = 1;
+	static char my_name[MAXNAMLEN + 1];
+	char strcaller[INET6_ADDRSTRLEN];
+	char *_9pmsg = NULL;
+	uint32_t msglen;
+
+	struct _9p_conn _9p_conn;
+
+	int readlen = 0;
+	int total_readlen = 0;
+
+	snprintf(my_name, MAXNAMLEN, "9p_sock_mgr#fd=%ld", tcp_sock);
+	SetNameFunction(my_name);
+
+	_9p_tcp_conn_init(&_9p_conn, tcp_sock, strcaller);
 
 	/* Set up the structure used by poll */
 	memset((char *)fds, 0, sizeof(struct pollfd));
@@ -226,7 +288,7 @@ void *_9p_socket_thread(void *Arg)
 			continue;
 
 		/* Prepare to read the message */
-		_9pmsg = gsh_malloc(_9p_conn.msize);
+		_9pmsg = _9p_tcp_buf_get(&_9p_conn);
 
 		/* An incoming 9P request: the msg has a 4 bytes header
 		   showing the size of the msg including the header */
@@ -263,28 +325,7 @@ void *_9p_socket_thread(void *Arg)
 				goto badmsg;
 		}	/* while */
 
-		server_stats_transport_done(_9p_conn.client,
-					    total_readlen, 1, 0,
-					    0, 0, 0);
-
-		/* Message is good. */
-		req = pool_alloc(request_pool);
-
-		req->rtype = _9P_REQUEST;
-		req->r_u._9p._9pmsg = _9pmsg;
-		req->r_u._9p.pconn = &_9p_conn;
-
-		/* Add this request to the request list,
-		 * should it be flushed later. */
-		tag = *(u16 *) (_9pmsg + _9P_HDR_SIZE +
-				_9P_TYPE_SIZE);
-		_9p_AddFlushHook(&req->r_u._9p, tag,
-				 sequence++);
-		LogFullDebug(COMPONENT_9P,
-			     "Request tag is %d\n", tag);
-
-		/* Message was OK push it */
-		DispatchWork9P(req);
+		_9p_tcp_dispatch(&_9p_conn, _9pmsg, total_readlen);
 
 		/* Not our buffer anymore */
 		_9pmsg = NULL;
@@ -320,22 +361,320 @@ end:
 
 	/* Free buffer if we encountered an error
 	 * before we could give it to a worker */
-	if (_9pmsg)
-		gsh_free(_9pmsg);
+	_9p_tcp_buf_put(&_9p_conn, _9pmsg);
 
 	while (atomic_fetch_uint32_t(&_9p_conn.refcount)) {
 		LogEvent(COMPONENT_9P, "Waiting for workers to release pconn");
 		sleep(1);
 	}
 
-	_9p_cleanup_fids(&_9p_conn);
-
-	if (_9p_conn.client != NULL)
-		put_gsh_client(_9p_conn.client);
+	_9p_tcp_conn_fini(&_9p_conn);
 
 	pthread_exit(NULL);
 }				/* _9p_socket_thread */
 
+/*
+ * Event driven 9P/TCP transport
+ *
+ * With _9P_TCP_Event_Loops set, accepted connections are spread over
+ * that many threads, each waiting in epoll_wait on all of its sockets,
+ * instead of getting a thread each.  A loop reads whatever has arrived
+ * without blocking, keeps partial messages on the connection and hands
+ * complete ones to the workers.  Replies are still sent by the workers,
+ * so sockets stay blocking and are read with MSG_DONTWAIT.
+ *
+ * A closed connection is shut down at once, so that no reply blocks on
+ * it, and freed by its loop once the workers are done with it.
+ */
+
+/* Events looked at per epoll_wait */
+#define _9P_LOOP_EVENTS 64
+
+/* Messages read from a connection before serving the others */
+#define _9P_LOOP_CONN_MSGS 16
+
+struct _9p_tcp_conn {
+	struct _9p_conn conn;
+	struct glist_head closing;	/*< Link in the loop's closing list */
+	char *msg;		/*< Message being read, of msize bytes */
+	uint32_t msglen;	/*< Its length, 0 until the header is read */
+	uint32_t readlen;	/*< Bytes of it read so far */
+	char strcaller[INET6_ADDRSTRLEN];
+};
+
+struct _9p_event_loop {
+	int epfd;
+	/** Closed connections workers may still use, loop thread only */
+	struct glist_head closing;
+};
+
+static struct _9p_event_loop *_9p_loops;
+static uint32_t _9p_nloops;
+static uint32_t _9p_loop_next;
+
+/**
+ * @brief Read what has arrived on a connection
+ *
+ * @param[in] tc The connection
+ *
+ * @return false if the connection must be closed.
+ */
+static bool _9p_tcp_conn_read(struct _9p_tcp_conn *tc)
+{
+	long int tcp_sock = tc->conn.trans_data.sockfd;
+	ssize_t readlen;
+	size_t want;
+	int msgs = 0;
+
+	while (msgs < _9P_LOOP_CONN_MSGS) {
+		if (tc->msg == NULL) {
+			tc->msg = _9p_tcp_buf_get(&tc->conn);
+			tc->msglen = 0;
+			tc->readlen = 0;
+		}
+
+		/* The header first, it gives the length of the message */
+		if (tc->msglen == 0)
+			want = _9P_HDR_SIZE - tc->readlen;
+		else
+			want = tc->msglen - tc->readlen;
+
+		readlen = recv(tcp_sock, tc->msg + tc->readlen, want,
+			       MSG_DONTWAIT);
+		if (readlen < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+			if (errno == EINTR)
+				continue;
+			LogEvent(COMPONENT_9P,
+				 "Read error client %s on socket %lu errno=%d, total read = %u",
+				 tc->strcaller, tcp_sock, errno, tc->readlen);
+			return false;
+		}
+
+		if (readlen == 0) {
+			if (tc->readlen != 0)
+				LogEvent(COMPONENT_9P,
+					 "Premature end for Client %s on socket %lu, total read = %u",
+					 tc->strcaller, tcp_sock, tc->readlen);
+			else
+				LogEvent(COMPONENT_9P,
+					 "Client %s on socket %lu has shut down and closed",
+					 tc->strcaller, tcp_sock);
+			return false;
+		}
+
+		tc->readlen += readlen;
+
+		if (tc->msglen == 0) {
+			if (tc->readlen < _9P_HDR_SIZE)
+				continue;
+
+			tc->msglen = *(uint32_t *) tc->msg;
+			if (tc->msglen > tc->conn.msize ||
+			    tc->msglen < _9P_HDR_SIZE + _9P_TYPE_SIZE +
+					 _9P_TAG_SIZE) {
+				LogCrit(COMPONENT_9P,
+					"Bad message size from client %s! got %u, max = %u",
+					tc->strcaller, tc->msglen,
+					tc->conn.msize);
+				return false;
+			}
+		}
+
+		if (tc->readlen < tc->msglen)
+			continue;
+
+		LogFullDebug(COMPONENT_9P,
+			     "Received 9P/TCP message of size %u from client %s on socket %lu",
+			     tc->msglen, tc->strcaller, tcp_sock);
+
+		_9p_tcp_dispatch(&tc->conn, tc->msg, tc->msglen);
+
+		/* Not our buffer anymore */
+		tc->msg = NULL;
+		msgs++;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Stop serving a connection
+ *
+ * @param[in] loop The loop serving it
+ * @param[in] tc   The connection
+ */
+static void _9p_tcp_conn_close(struct _9p_event_loop *loop,
+			       struct _9p_tcp_conn *tc)
+{
+	long int tcp_sock = tc->conn.trans_data.sockfd;
+
+	LogEvent(COMPONENT_9P, "Closing connection on socket %lu", tcp_sock);
+
+	(void) epoll_ctl(loop->epfd, EPOLL_CTL_DEL, tcp_sock, NULL);
+
+	/* Replies still to come fail rather than block.  The socket is
+	 * closed once they are done, so its number isn't reused while
+	 * workers may still send on it.
+	 */
+	(void) shutdown(tcp_sock, SHUT_RDWR);
+
+	_9p_tcp_buf_put(&tc->conn, tc->msg);
+	tc->msg = NULL;
+
+	glist_add_tail(&loop->closing, &tc->closing);
+}
+
+/**
+ * @brief Free the closed connections the workers are done with
+ *
+ * @param[in] loop The loop
+ */
+static void _9p_tcp_conns_reap(struct _9p_event_loop *loop)
+{
+	struct glist_head *glist, *glistn;
+	struct _9p_tcp_conn *tc;
+
+	glist_for_each_safe(glist, glistn, &loop->closing) {
+		tc = glist_entry(glist, struct _9p_tcp_conn, closing);
+
+		if (atomic_fetch_uint32_t(&tc->conn.refcount) != 0)
+			continue;
+
+		glist_del(&tc->closing);
+		close(tc->conn.trans_data.sockfd);
+		_9p_tcp_conn_fini(&tc->conn);
+		gsh_free(tc);
+	}
+}
+
+/**
+ * @brief Main loop of a 9P/TCP event loop thread
+ *
+ * @param[in] arg The loop
+ *
+ * @return NULL, never returns.
+ */
+static void *_9p_event_loop_thread(void *arg)
+{
+	struct _9p_event_loop *loop = arg;
+	struct epoll_event events[_9P_LOOP_EVENTS];
+	struct _9p_tcp_conn *tc;
+	int n, i;
+
+	SetNameFunction("9p_evloop");
+
+	for (;;) {
+		/* Poll the closing connections once a second */
+		n = epoll_wait(loop->epfd, events, _9P_LOOP_EVENTS,
+			       glist_empty(&loop->closing) ? -1 : 1000);
+		if (n < 0) {
+			if (errno != EINTR)
+				LogCrit(COMPONENT_9P,
+					"Got error %d (%s) while waiting for 9P events",
+					errno, strerror(errno));
+			continue;
+		}
+
+		for (i = 0; i < n; i++) {
+			tc = events[i].data.ptr;
+
+			/* Errors and hangups show up when reading */
+			if (!_9p_tcp_conn_read(tc))
+				_9p_tcp_conn_close(loop, tc);
+		}
+
+		if (!glist_empty(&loop->closing))
+			_9p_tcp_conns_reap(loop);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Start the event loops, if configured
+ *
+ * Falls back to a thread per connection if they can't be started.
+ *
+ * @param[in] attr_thr Attributes for the loop threads
+ */
+static void _9p_event_loops_init(pthread_attr_t *attr_thr)
+{
+	uint32_t nloops = _9p_param._9p_tcp_event_loops;
+	pthread_t thrid;
+	uint32_t i;
+
+	if (nloops == 0)
+		return;
+
+	_9p_loops = gsh_calloc(nloops, sizeof(*_9p_loops));
+
+	for (i = 0; i < nloops; i++) {
+		struct _9p_event_loop *loop = &_9p_loops[i];
+
+		glist_init(&loop->closing);
+		loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (loop->epfd < 0) {
+			LogCrit(COMPONENT_9P_DISPATCH,
+				"Could not create 9P epoll fd, error %d (%s)",
+				errno, strerror(errno));
+			break;
+		}
+
+		if (pthread_create(&thrid, attr_thr, _9p_event_loop_thread,
+				   loop) != 0) {
+			LogCrit(COMPONENT_9P_DISPATCH,
+				"Could not create 9P event loop thread, error = %d (%s)",
+				errno, strerror(errno));
+			close(loop->epfd);
+			break;
+		}
+	}
+
+	_9p_nloops = i;
+	if (_9p_nloops == 0) {
+		gsh_free(_9p_loops);
+		_9p_loops = NULL;
+		LogWarn(COMPONENT_9P_DISPATCH,
+			"No 9P event loop, using a thread per connection");
+		return;
+	}
+
+	LogInfo(COMPONENT_9P_DISPATCH, "Serving 9P/TCP from %u event loops",
+		_9p_nloops);
+}
+
+/**
+ * @brief Hand an accepted socket to one of the event loops
+ *
+ * @param[in] tcp_sock The socket
+ */
+static void _9p_event_loops_add(long int tcp_sock)
+{
+	struct _9p_event_loop *loop;
+	struct _9p_tcp_conn *tc;
+	struct epoll_event ev;
+
+	tc = gsh_calloc(1, sizeof(*tc));
+	_9p_tcp_conn_init(&tc->conn, tcp_sock, tc->strcaller);
+
+	loop = &_9p_loops[atomic_inc_uint32_t(&_9p_loop_next) % _9p_nloops];
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.ptr = tc;
+
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, tcp_sock, &ev) != 0) {
+		LogCrit(COMPONENT_9P_DISPATCH,
+			"Could not add 9P socket %ld to event loop, error %d (%s)",
+			tcp_sock, errno, strerror(errno));
+		close(tcp_sock);
+		_9p_tcp_conn_fini(&tc->conn);
+		gsh_free(tc);
+	}
+}
+
 /**
  * _9p_create_socket_V4 : create the socket and bind for 9P using
  * the available V4 interfaces on the host. This is not the default
@@ -576,6 +915,8 @@ void *_9p_dispatcher_thread(void *Arg)
 		LogDebug(COMPONENT_9P_DISPATCH,
 			 "can't set pthread's join state");
 
+	_9p_event_loops_init(&attr_thr);
+
 	LogEvent(COMPONENT_9P_DISPATCH, "9P dispatcher started");
 
 	while (true) {
@@ -587,6 +928,11 @@ void *_9p_dispatcher_thread(void *Arg)
 			continue;
 		}
 
+		if (_9p_nloops != 0) {
+			_9p_event_loops_add(newsock);
+			continue;
+		}
+
 		/* Starting the thread dedicated to signal handling */
 		rc = pthread_create(&tcp_thrid, &attr_thr,
 				    _9p_socket_thread, (void *)newsock);
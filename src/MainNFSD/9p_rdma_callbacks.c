@@ -86,6 +86,8 @@ void _9p_rdma_callback_send_err(msk_trans_t *trans, msk_data_t *data,
 		pthread_cond_signal(&priv->outqueue->cond);
 		PTHREAD_MUTEX_unlock(&priv->outqueue->lock);
 	}
+	if (priv)
+		(void) atomic_inc_uint64_t(&priv->stats.send_errors);
 	if (priv && priv->pconn && priv->pconn->client)
 		server_stats_transport_done(priv->pconn->client,
 			    0, 0, 0,
@@ -125,6 +127,8 @@ void _9p_rdma_process_request(struct _9p_request_data *req9p)
 
 	/* get output buffer and move forward in queue */
 	PTHREAD_MUTEX_lock(&priv->outqueue->lock);
+	if (priv->outqueue->data == NULL)
+		(void) atomic_inc_uint64_t(&priv->stats.outq_waits);
 	while (priv->outqueue->data == NULL) {
 		LogDebug(COMPONENT_9P,
 			 "Waiting for outqueue buffer on trans %p\n", trans);
@@ -188,14 +192,28 @@ void _9p_rdma_process_request(struct _9p_request_data *req9p)
 			PTHREAD_MUTEX_unlock(&priv->outqueue->lock);
 		}
 	}
+	/* The receive buffer was posted again above */
+	(void) atomic_dec_uint32_t(&priv->stats.inflight);
 	_9p_DiscardFlushHook(req9p);
 }
 
 void _9p_rdma_callback_recv(msk_trans_t *trans, msk_data_t *data, void *arg)
 {
+	struct _9p_rdma_priv *priv = _9p_rdma_priv_of(trans);
 	request_data_t *req = NULL;
 	u16 tag = 0;
 	char *_9pmsg = NULL;
+	uint32_t inflight, max;
+
+	/* Receive buffers are the client's credits, note how many of
+	 * them the connection holds at once.
+	 */
+	(void) atomic_inc_uint64_t(&priv->stats.requests);
+	inflight = atomic_inc_uint32_t(&priv->stats.inflight);
+	max = atomic_fetch_uint32_t(&priv->stats.max_inflight);
+	while (inflight > max &&
+	       !atomic_cas_uint32_t(&priv->stats.max_inflight, max, inflight))
+		max = atomic_fetch_uint32_t(&priv->stats.max_inflight);
 
 	req = pool_alloc(request_pool);
 
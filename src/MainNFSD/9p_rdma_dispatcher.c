@@ -79,6 +79,13 @@ static void *_9p_rdma_cleanup_conn_thread(void *arg)
 			 "9P/RDMA: Freeing data associated with trans [%p]",
 			 trans);
 
+		LogInfo(COMPONENT_9P,
+			"9P/RDMA: trans [%p] handled %" PRIu64
+			" requests, at most %u in flight, %" PRIu64
+			" waits for a send buffer, %" PRIu64 " send errors",
+			trans, priv->stats.requests, priv->stats.max_inflight,
+			priv->stats.outq_waits, priv->stats.send_errors);
+
 		if (priv->pconn) {
 			if (priv->pconn->client != NULL)
 				put_gsh_client(priv->pconn->client);
@@ -168,10 +175,8 @@ void *_9p_rdma_thread(void *Arg)
 	p_9p_conn->client =
 		get_gsh_client(&p_9p_conn->addrpeer, false);
 
-	/* Init the fids pointers array */
-	memset(&p_9p_conn->fids,
-	       0,
-	       _9P_FID_PER_CONN * sizeof(struct _9p_fid *));
+	/* Init the fids pages array */
+	memset(&p_9p_conn->fid_pages, 0, sizeof(p_9p_conn->fid_pages));
 
 	/* Set initial msize.
 	 * Client may request a lower value during TVERSION */
@@ -339,8 +344,12 @@ void *_9p_rdma_dispatcher_thread(void *Arg)
 	trans_attr.node = "::";
 	trans_attr.use_srq = 1;
 	trans_attr.disconnect_callback = _9p_rdma_callback_disconnect;
-	trans_attr.worker_count = -1;
-	/* if worker_count isn't -1: trans_attr.worker_queue_size = 256; */
+	if (_9p_param._9p_rdma_completion_workers != 0) {
+		trans_attr.worker_count = _9p_param._9p_rdma_completion_workers;
+		trans_attr.worker_queue_size = _9P_RDMA_WORKER_QUEUE_SIZE;
+	} else {
+		trans_attr.worker_count = -1;
+	}
 	trans_attr.debug = MSK_DEBUG_EVENT;
 	/* mooshika stats:
 	 * trans_attr.stats_prefix + trans_attr.debug |= MSK_DEBUG_SPEED */
@@ -41,9 +41,16 @@
 #include "delayed_exec.h"
 #include "export_mgr.h"
 #include "fsal.h"
+#include "mdcache.h"
 #include "netgroup_cache.h"
+#include "gsh_iobuf.h"
+#include "nfs_dupreq.h"
+#include "nfs_proto_functions.h"
+#include "nfs_metrics.h"
+#include "mem_pressure.h"
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
+#include "flight_rec.h"
 #endif
 
 /**
@@ -110,6 +117,60 @@ static struct gsh_dbus_method method_get_grace = {
 		 END_ARG_LIST}
 };
 
+/**
+ * @brief Dbus method reporting the startup timeline
+ *
+ * @param[in]  args  dbus args
+ * @param[out] reply Status, then for each phase that has ended its
+ *                   name, start and end in nsecs since the server
+ *                   started.
+ */
+static bool admin_dbus_startup_timeline(DBusMessageIter *args,
+					DBusMessage *reply,
+					DBusError *error)
+{
+	char *errormsg = "OK";
+	bool success = true;
+	DBusMessageIter iter, array_iter, struct_iter;
+	nsecs_elapsed_t start, end;
+	const char *name;
+	int phase;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(stt)",
+					 &array_iter);
+	for (phase = 0; phase < NFS_START_PHASE_COUNT; phase++) {
+		if (!nfs_start_phase_get(phase, &name, &start, &end))
+			continue;
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &start);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &end);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(&iter, &array_iter);
+
+	return success;
+}
+
+static struct gsh_dbus_method method_startup_timeline = {
+	.name = "startup_timeline",
+	.method = admin_dbus_startup_timeline,
+	.args = {
+		 STATUS_REPLY,
+		 {.name = "phases",
+		  .type = "a(stt)",
+		  .direction = "out",
+		 },
+		 END_ARG_LIST}
+};
+
 /**
  * @brief Dbus method start grace period
  *
@@ -285,12 +346,206 @@ static struct gsh_dbus_method method_purge_netgroups = {
 		 END_ARG_LIST}
 };
 
+/**
+ * @brief Dbus method for writing out the flight recorder
+ *
+ * @param[in]  args  File to write, Flight_Recorder_File if empty
+ * @param[out] reply Status
+ */
+static bool admin_dbus_dump_flight_recorder(DBusMessageIter *args,
+					    DBusMessage *reply,
+					    DBusError *error)
+{
+	char *errormsg = "Flight recorder written";
+	bool success = true;
+	DBusMessageIter iter;
+	char *path = NULL;
+	int rc;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		errormsg = "Dump flight recorder takes a file name.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &path);
+
+	rc = flight_rec_dump(path[0] != '\0' ? path : NULL);
+	if (rc != 0) {
+		errormsg = rc == ENOENT ? "Flight recorder is off"
+					: "Could not write flight recorder";
+		success = false;
+	}
+
+ out:
+	dbus_status_reply(&iter, success, errormsg);
+	return success;
+}
+
+static struct gsh_dbus_method method_dump_flight_recorder = {
+	.name = "dump_flight_recorder",
+	.method = admin_dbus_dump_flight_recorder,
+	.args = {
+		 {.name = "path",
+		  .type = "s",
+		  .direction = "in",
+		 },
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+#ifdef USE_LOCK_PROF
+/* Sites the report is added up over, the busiest are returned */
+#define LOCK_PROF_REPORT_MAX 4096
+
+/**
+ * @brief Dbus method for turning the lock profiler on or off
+ *
+ * @param[in]  args  Whether to profile, turning it on starts over
+ * @param[out] reply Status
+ */
+static bool admin_dbus_enable_lock_profile(DBusMessageIter *args,
+					   DBusMessage *reply,
+					   DBusError *error)
+{
+	char *errormsg = "Lock profile updated";
+	bool success = true;
+	DBusMessageIter iter;
+	dbus_bool_t enable;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_BOOLEAN) {
+		errormsg = "Enable lock profile takes a boolean.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &enable);
+
+	lock_prof_enable(enable);
+	LogEvent(COMPONENT_DBUS, "Lock profile %s", enable ? "on" : "off");
+
+ out:
+	dbus_status_reply(&iter, success, errormsg);
+	return success;
+}
+
+static struct gsh_dbus_method method_enable_lock_profile = {
+	.name = "enable_lock_profile",
+	.method = admin_dbus_enable_lock_profile,
+	.args = {
+		 {.name = "enable",
+		  .type = "b",
+		  .direction = "in",
+		 },
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * @brief Dbus method reporting the most waited for lock sites
+ *
+ * @param[in]  args  Sites to return, 0 for all
+ * @param[out] reply Status, then for each site by decreasing time
+ *                   waited: lock, file, line, kind, times taken,
+ *                   times contended, ns waited, most ns waited at once,
+ *                   ns held and most ns held at once.
+ */
+static bool admin_dbus_lock_profile(DBusMessageIter *args,
+				    DBusMessage *reply,
+				    DBusError *error)
+{
+	char *errormsg = "OK";
+	bool success = true;
+	DBusMessageIter iter, array_iter, struct_iter;
+	struct lock_prof_stats *stats;
+	const struct lock_prof_site *site;
+	uint32_t count = 0;
+	dbus_uint32_t line;
+	int i, n;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args != NULL &&
+	    dbus_message_iter_get_arg_type(args) == DBUS_TYPE_UINT32)
+		dbus_message_iter_get_basic(args, &count);
+
+	if (!lock_prof_enabled)
+		errormsg = "Lock profile is off, counts are from when it was on";
+
+	stats = gsh_calloc(LOCK_PROF_REPORT_MAX, sizeof(*stats));
+	n = lock_prof_report(stats, LOCK_PROF_REPORT_MAX);
+	if (count != 0 && count < (uint32_t) n)
+		n = count;
+
+	dbus_status_reply(&iter, success, errormsg);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 "(ssustttttt)", &array_iter);
+	for (i = 0; i < n; i++) {
+		site = stats[i].site;
+		line = site->line;
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &site->lock);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &site->file);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &line);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &site->kind);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].acquired);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].contended);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].wait_ns);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].max_wait_ns);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].hold_ns);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].max_hold_ns);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(&iter, &array_iter);
+
+	gsh_free(stats);
+	return success;
+}
+
+static struct gsh_dbus_method method_lock_profile = {
+	.name = "lock_profile",
+	.method = admin_dbus_lock_profile,
+	.heavy = true,
+	.args = {
+		 {.name = "count",
+		  .type = "u",
+		  .direction = "in",
+		 },
+		 STATUS_REPLY,
+		 {.name = "sites",
+		  .type = "a(ssustttttt)",
+		  .direction = "out",
+		 },
+		 END_ARG_LIST}
+};
+#endif				/* USE_LOCK_PROF */
+
 static struct gsh_dbus_method *admin_methods[] = {
 	&method_shutdown,
 	&method_grace_period,
 	&method_get_grace,
+	&method_startup_timeline,
 	&method_purge_gids,
 	&method_purge_netgroups,
+	&method_dump_flight_recorder,
+#ifdef USE_LOCK_PROF
+	&method_enable_lock_profile,
+	&method_lock_profile,
+#endif
 	NULL
 };
 
@@ -356,6 +611,8 @@ static void do_shutdown(void)
 
 	LogEvent(COMPONENT_MAIN, "NFS EXIT: stopping NFS service");
 
+	nfs_metrics_pkgshutdown();
+
 	LogEvent(COMPONENT_MAIN, "Stopping delayed executor.");
 	delayed_shutdown();
 	LogEvent(COMPONENT_MAIN, "Delayed executor stopped.");
@@ -407,8 +664,15 @@ static void do_shutdown(void)
 	} else {
 		LogEvent(COMPONENT_THREAD,
 			 "Worker threads successfully shut down.");
+		/* no worker can hold a pooled buffer any more */
+		gsh_iobuf_pkgshutdown();
 	}
 
+	dupreq2_pkgshutdown();
+
+	/* no COPY can start any more, stop those in progress */
+	nfs4_copy_pkgshutdown();
+
 	(void)svc_shutdown(SVC_SHUTDOWN_FLAG_NONE);
 
 	rc = general_fridge_shutdown();
@@ -429,6 +693,16 @@ static void do_shutdown(void)
 		LogEvent(COMPONENT_THREAD, "Reaper thread shut down.");
 	}
 
+	rc = mem_pressure_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down memory pressure thread: %d", rc);
+		disorderly = true;
+	}
+
+	LogEvent(COMPONENT_MAIN, "Saving the metadata cache snapshot.");
+	mdcache_snapshot_pkgshutdown();
+
 	LogEvent(COMPONENT_MAIN, "Removing all exports.");
 	remove_all_exports();
 
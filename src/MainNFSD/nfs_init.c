@@ -39,6 +39,8 @@
 #include "nfs_ip_stats.h"
 #include "nfs_proto_functions.h"
 #include "nfs_dupreq.h"
+#include "nfs_numa.h"
+#include "gsh_iobuf.h"
 #include "config_parsing.h"
 #include "nfs4_acls.h"
 #include "nfs_rpc_callback.h"
@@ -56,6 +58,7 @@
 #include <math.h>
 #ifdef _USE_NLM
 #include "nlm_util.h"
+#include "nlm_async.h"
 #endif /* _USE_NLM */
 #include "nsm.h"
 #include "sal_functions.h"
@@ -64,6 +67,10 @@
 #include "delayed_exec.h"
 #include "client_mgr.h"
 #include "export_mgr.h"
+#include "server_stats.h"
+#include "flight_rec.h"
+#include "mem_pressure.h"
+#include "abstract_atomic.h"
 #ifdef USE_CAPS
 #include <sys/capability.h>	/* For capget/capset */
 #endif
@@ -71,6 +78,7 @@
 #include "netgroup_cache.h"
 #include "pnfs_utils.h"
 #include "mdcache.h"
+#include "nfs_metrics.h"
 
 
 /* global information exported to all layers (as extern vars) */
@@ -108,6 +116,99 @@ char *config_path = GANESHA_CONFIG_PATH;
 
 char *pidfile_path = GANESHA_PIDFILE_PATH;
 
+/* Startup timeline, the end of each phase since ServerBootTime */
+static const char * const start_phase_names[NFS_START_PHASE_COUNT] = {
+	[NFS_START_CONFIG] = "config",
+	[NFS_START_FSALS] = "fsals",
+	[NFS_START_PARAMS] = "params",
+	[NFS_START_PKGS] = "packages",
+	[NFS_START_EXPORTS] = "exports",
+	[NFS_START_EXPORT_ROOTS] = "export_roots",
+	[NFS_START_RPC] = "rpc",
+	[NFS_START_CACHES] = "caches",
+	[NFS_START_PSEUDOFS] = "pseudofs",
+	[NFS_START_RECOVERY] = "recovery",
+	[NFS_START_THREADS] = "threads",
+	[NFS_START_GRACE] = "grace",
+};
+
+static uint64_t start_phase_end[NFS_START_PHASE_COUNT];
+
+/**
+ * @brief Get a phase of the startup timeline
+ *
+ * A phase starts when the one before it ends, except for the grace
+ * period which starts once the recovery store has been read.
+ *
+ * @param[in]  phase	The phase
+ * @param[out] name	Its name
+ * @param[out] start	When it started, nsecs since ServerBootTime
+ * @param[out] end	When it ended
+ *
+ * @return false if the phase has not ended yet.
+ */
+bool nfs_start_phase_get(enum nfs_start_phase phase, const char **name,
+			 nsecs_elapsed_t *start, nsecs_elapsed_t *end)
+{
+	int prev = phase == NFS_START_GRACE ? NFS_START_RECOVERY : phase - 1;
+
+	*name = start_phase_names[phase];
+	*end = atomic_fetch_uint64_t(&start_phase_end[phase]);
+	*start = prev < 0 ? 0 : atomic_fetch_uint64_t(&start_phase_end[prev]);
+
+	return *end != 0;
+}
+
+/**
+ * @brief Mark the end of a phase of the startup
+ *
+ * Only the first end of each phase is recorded.
+ *
+ * @param[in] phase	The phase that ended
+ */
+void nfs_start_phase_done(enum nfs_start_phase phase)
+{
+	struct timespec ts;
+	nsecs_elapsed_t start, end;
+	const char *name;
+
+	if (atomic_fetch_uint64_t(&start_phase_end[phase]) != 0)
+		return;
+
+	now(&ts);
+	atomic_store_uint64_t(&start_phase_end[phase],
+			      timespec_diff(&ServerBootTime, &ts));
+
+	(void)nfs_start_phase_get(phase, &name, &start, &end);
+	LogInfo(COMPONENT_INIT,
+		"Startup phase %s took %" PRIu64 " ms, ended at %" PRIu64
+		" ms", name, (end - start) / NS_PER_MSEC, end / NS_PER_MSEC);
+}
+
+/**
+ * @brief Log the startup timeline on one line
+ */
+static void nfs_start_timeline_log(void)
+{
+	char buf[512];
+	struct display_buffer dspbuf = {sizeof(buf), buf, buf};
+	nsecs_elapsed_t start, end, total = 0;
+	const char *name;
+	int phase;
+
+	for (phase = 0; phase < NFS_START_PHASE_COUNT; phase++) {
+		if (!nfs_start_phase_get(phase, &name, &start, &end))
+			continue;
+
+		(void)display_printf(&dspbuf, "%s=%" PRIu64 "ms ", name,
+				     (end - start) / NS_PER_MSEC);
+		total = end;
+	}
+
+	LogEvent(COMPONENT_INIT, "Startup timeline: %stotal=%" PRIu64 "ms",
+		 buf, total / NS_PER_MSEC);
+}
+
 /**
  * @brief Reread the configuration file to accomplish update of options.
  *
@@ -308,6 +409,7 @@ int nfs_set_param_from_conf(config_file_t parse_tree,
 	client_pkginit();
 	export_pkginit();
 	server_pkginit();
+	server_stats_pkginit();
 
 	/* Core parameters */
 	(void) load_config_from_parse(parse_tree,
@@ -359,6 +461,20 @@ int nfs_set_param_from_conf(config_file_t parse_tree,
 		return -1;
 	}
 
+#ifdef _USE_NFS_RDMA
+	/* NFS/RDMA engine configuration */
+	(void) load_config_from_parse(parse_tree,
+				      &nfs_rdma_param,
+				      &nfs_param.rdma_param,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type)) {
+		LogCrit(COMPONENT_INIT,
+			"Error while parsing NFS/RDMA configuration");
+		return -1;
+	}
+#endif
+
 #ifdef _USE_9P
 	(void) load_config_from_parse(parse_tree,
 				      &_9p_param_blk,
@@ -372,6 +488,19 @@ int nfs_set_param_from_conf(config_file_t parse_tree,
 	}
 #endif
 
+#ifdef USE_RADOS_RECOV
+	(void) load_config_from_parse(parse_tree,
+				      &rados_kv_param_blk,
+				      NULL,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type)) {
+		LogCrit(COMPONENT_INIT,
+			"Error while parsing RADOS_KV specific configuration");
+		return -1;
+	}
+#endif
+
 	if (mdcache_set_param_from_conf(parse_tree, err_type) < 0)
 		return -1;
 
@@ -385,8 +514,12 @@ int init_server_pkgs(void)
 	fsal_status_t fsal_status;
 	state_status_t state_status;
 
+	/* Subsystem arenas, before the subsystems allocate */
+	mem_arena_init();
+
 	/* init uid2grp cache */
 	uid2grp_cache_init();
+	uid2grp_async_init();
 
 	ng_cache_init(); /* netgroup cache */
 
@@ -520,6 +653,8 @@ static void nfs_Start_threads(void)
 	LogEvent(COMPONENT_THREAD, "gsh_dbusthread was started successfully");
 #endif
 
+	nfs_metrics_pkginit();
+
 	/* Starting the admin thread */
 	rc = pthread_create(&admin_thrid, &attr_thr, admin_thread, NULL);
 	if (rc != 0) {
@@ -538,6 +673,12 @@ static void nfs_Start_threads(void)
 	}
 	LogEvent(COMPONENT_THREAD, "reaper thread was started successfully");
 
+	/* Starting the memory pressure monitor */
+	rc = mem_pressure_init();
+	if (rc != 0)
+		LogWarn(COMPONENT_THREAD,
+			"Memory pressure monitor not started, error = %d", rc);
+
 	/* Starting the general fridge */
 	rc = general_fridge_init();
 	if (rc != 0) {
@@ -563,6 +704,17 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	char GssError[MAXNAMLEN + 1];
 #endif
 
+	flight_rec_init(nfs_param.core_param.flight_rec_events,
+			nfs_param.core_param.flight_rec_file);
+
+#ifdef USE_LOCK_PROF
+	lock_prof_init(nfs_param.core_param.lock_profile);
+#else
+	if (nfs_param.core_param.lock_profile)
+		LogWarn(COMPONENT_INIT,
+			"Lock_Profile needs a build with USE_LOCK_PROF, ignored");
+#endif
+
 #ifdef USE_DBUS
 	/* DBUS init */
 	gsh_dbus_pkginit();
@@ -580,11 +732,17 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	 */
 	exports_pkginit();
 
+	/* and bring back what was cached before the last shutdown */
+	mdcache_snapshot_pkginit();
+	nfs_start_phase_done(NFS_START_EXPORT_ROOTS);
+
 	nfs41_session_pool =
-	    pool_basic_init("NFSv4.1 session pool", sizeof(nfs41_session_t));
+	    pool_arena_init("NFSv4.1 session pool", sizeof(nfs41_session_t),
+			    MEM_ARENA_SAL);
 
 	request_pool =
-	    pool_basic_init("Request pool", sizeof(request_data_t));
+	    pool_arena_init("Request pool", sizeof(request_data_t),
+			    MEM_ARENA_RPC);
 
 	/* If rpcsec_gss is used, set the path to the keytab */
 #ifdef _HAVE_GSSAPI
@@ -647,9 +805,22 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 #endif				/* HAVE_KRB5 */
 #endif				/* _HAVE_GSSAPI */
 
+	/* READ/WRITE payload buffer pool */
+	gsh_iobuf_pkginit((uint64_t) nfs_param.core_param.iobuf_pool_size
+			  * 1024 * 1024,
+			  nfs_param.core_param.io_segment_size);
+
+	/* NUMA topology, needed by the request queues and workers */
+	if (nfs_param.core_param.worker_numa_pools) {
+		nfs_numa_init();
+		/* Workers of each node share node local pools */
+		gsh_slab_numa_init(nfs_numa.nnodes, nfs_numa_cpu_node);
+	}
+
 	/* RPC Initialisation - exits on failure */
 	nfs_Init_svc();
 	LogInfo(COMPONENT_INIT, "RPC resources successfully initialized");
+	nfs_start_phase_done(NFS_START_RPC);
 
 	/* Admin initialisation */
 	nfs_Init_admin_thread();
@@ -706,6 +877,13 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 		LogInfo(COMPONENT_INIT,
 			"NLM State cache successfully initialized");
 		nlm_init();
+		if (nlm_async_callback_init() != 0) {
+			LogFatal(COMPONENT_INIT,
+				 "Error while starting NLM callback threads");
+		}
+		if (nsm_async_init() != 0)
+			LogFatal(COMPONENT_INIT,
+				 "Error while starting NSM thread");
 	}
 #endif /* _USE_NLM */
 #ifdef _USE_9P
@@ -735,6 +913,7 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	}
 	LogInfo(COMPONENT_INIT, "9P resources successfully initialized");
 #endif				/* _USE_9P */
+	nfs_start_phase_done(NFS_START_CACHES);
 
 	/* Creates the pseudo fs */
 	LogDebug(COMPONENT_INIT, "Now building pseudo fs");
@@ -743,23 +922,34 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 
 	LogInfo(COMPONENT_INIT,
 		"NFSv4 pseudo file system successfully initialized");
+	nfs_start_phase_done(NFS_START_PSEUDOFS);
 
 	/* Save Ganesha thread credentials with Frank's routine for later use */
 	fsal_save_ganesha_credentials();
 
-	/* Create stable storage directory, this needs to be done before
+	/* Set up stable storage, this needs to be done before
 	 * starting the recovery thread.
 	 */
-	nfs4_create_recov_dir();
+	if (nfs4_recovery_init() != 0)
+		LogFatal(COMPONENT_INIT,
+			 "Could not set up client recovery store");
+
+	if (nfs4_standby_init() != 0)
+		LogFatal(COMPONENT_INIT,
+			 "Could not set up hot standby replication");
 
 	/* read in the client IDs */
 	nfs4_load_recov_clids(NULL);
+	nfs_start_phase_done(NFS_START_RECOVERY);
 
 	/* Start grace period */
 	nfs4_start_grace(NULL);
 
 	/* callback dispatch */
 	nfs_rpc_cb_pkginit();
+
+	/* asynchronous COPY */
+	nfs4_copy_pkginit();
 #ifdef _USE_CB_SIMULATOR
 	nfs_rpc_cbsim_pkginit();
 #endif				/*  _USE_CB_SIMULATOR */
@@ -886,12 +1076,14 @@ void nfs_start(nfs_start_info_t *p_start_info)
 		nsm_unmonitor_all();
 	}
 #endif /* _USE_NLM */
+	nfs_start_phase_done(NFS_START_THREADS);
 
 	LogEvent(COMPONENT_INIT,
 		 "-------------------------------------------------");
 	LogEvent(COMPONENT_INIT, "             NFS SERVER INITIALIZED");
 	LogEvent(COMPONENT_INIT,
 		 "-------------------------------------------------");
+	nfs_start_timeline_log();
 
 	/* Wait for dispatcher to exit */
 	LogDebug(COMPONENT_THREAD, "Wait for admin thread to exit");
@@ -902,7 +1094,10 @@ void nfs_start(nfs_start_info_t *p_start_info)
 
 	/* if not in grace period, clean up the old state directory */
 	if (!nfs_in_grace())
-		nfs4_clean_old_recov_dir(v4_old_dir);
+		nfs4_end_grace();
+
+	nfs4_standby_shutdown();
+	nfs4_recovery_shutdown();
 
 	Cleanup();
 
@@ -101,6 +101,7 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt);
 /* in nfs_rpc_rdma.c */
 
 void *nfs_rdma_dispatcher_thread(void *nullarg);
+void nfs_rdma_account(SVCXPRT *xprt, struct nfs_request_lookahead *lkhd);
 #endif
 
 #endif				/* !NFS_INIT_H */
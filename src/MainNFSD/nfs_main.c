@@ -425,11 +425,13 @@ int main(int argc, char *argv[])
 			 "Error while parsing log configuration");
 		goto fatal_die;
 	}
+	nfs_start_phase_done(NFS_START_CONFIG);
 
 	/* We need all the fsal modules loaded so we can have
 	 * the list available at exports parsing time.
 	 */
 	start_fsals();
+	nfs_start_phase_done(NFS_START_FSALS);
 
 	/* parse configuration file */
 
@@ -440,6 +442,7 @@ int main(int argc, char *argv[])
 			 "Error setting parameters from configuration file.");
 		goto fatal_die;
 	}
+	nfs_start_phase_done(NFS_START_PARAMS);
 
 	/* initialize core subsystems and data structures */
 	if (init_server_pkgs() != 0) {
@@ -447,6 +450,7 @@ int main(int argc, char *argv[])
 			"Failed to initialize server packages");
 		goto fatal_die;
 	}
+	nfs_start_phase_done(NFS_START_PKGS);
 	/* Load Data Server entries from parsed file
 	 * returns the number of DS entries.
 	 */
@@ -474,6 +478,7 @@ int main(int argc, char *argv[])
 	/* freeing syntax tree : */
 
 	config_Free(config_struct);
+	nfs_start_phase_done(NFS_START_EXPORTS);
 
 	/* Everything seems to be OK! We can now start service threads */
 	nfs_start(&my_nfs_start_info);
@@ -0,0 +1,216 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_metrics.c
+ * @brief OpenMetrics exporter over HTTP
+ *
+ * One thread accepts scrapes on Metrics_Addr:Metrics_Port and answers
+ * each in turn; a scrape is a few milliseconds of formatting, so there
+ * is nothing to gain from more.  Anything but GET /metrics gets a 404.
+ * Connections are closed after each reply.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "log.h"
+#include "abstract_atomic.h"
+#include "nfs_core.h"
+#include "nfs_metrics.h"
+#include <os/memstream.h>
+
+#define METRICS_REQ_MAX 4096
+#define METRICS_IO_TIMEOUT 5
+
+static pthread_t metrics_thrid;
+static int metrics_fd = -1;
+static uint32_t metrics_shutdown;
+
+static const char metrics_not_found[] =
+	"HTTP/1.1 404 Not Found\r\n"
+	"Content-Length: 0\r\n"
+	"Connection: close\r\n\r\n";
+
+static void metrics_write(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+		buf += n;
+		len -= n;
+	}
+}
+
+/**
+ * @brief Read a request and answer it
+ */
+static void metrics_serve(int fd)
+{
+	char req[METRICS_REQ_MAX];
+	struct timeval tv = { .tv_sec = METRICS_IO_TIMEOUT };
+	char head[256];
+	char *body = NULL;
+	size_t len = 0, body_len = 0;
+	ssize_t n;
+	FILE *out;
+
+	(void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	(void) setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	/* Only the request line matters, read up to the end of headers */
+	while (len < sizeof(req) - 1) {
+		n = read(fd, req + len, sizeof(req) - 1 - len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		len += n;
+		req[len] = '\0';
+		if (strstr(req, "\r\n\r\n") != NULL)
+			break;
+	}
+	req[len] = '\0';
+
+	if (strncmp(req, "GET /metrics ", 13) != 0 &&
+	    strncmp(req, "GET / ", 6) != 0) {
+		metrics_write(fd, metrics_not_found,
+			      sizeof(metrics_not_found) - 1);
+		return;
+	}
+
+	out = open_memstream(&body, &body_len);
+	if (out == NULL) {
+		LogMajor(COMPONENT_MAIN, "Unable to render metrics: %s",
+			 strerror(errno));
+		return;
+	}
+
+	server_stats_metrics(out);
+	mdcache_metrics(out);
+	fputs("# EOF\n", out);
+	fclose(out);
+
+	n = snprintf(head, sizeof(head),
+		     "HTTP/1.1 200 OK\r\n"
+		     "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+		     "Content-Length: %zu\r\n"
+		     "Connection: close\r\n\r\n", body_len);
+	metrics_write(fd, head, n);
+	metrics_write(fd, body, body_len);
+
+	free(body);
+}
+
+static void *metrics_thread(void *arg)
+{
+	struct pollfd pfd = { .fd = metrics_fd, .events = POLLIN };
+	int fd;
+
+	SetNameFunction("metrics");
+
+	while (!atomic_fetch_uint32_t(&metrics_shutdown)) {
+		/* Wake up now and then to notice shutdown */
+		if (poll(&pfd, 1, 1000) <= 0)
+			continue;
+
+		fd = accept(metrics_fd, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		metrics_serve(fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Start answering scrapes if Metrics_Port is set
+ */
+void nfs_metrics_pkginit(void)
+{
+	struct sockaddr_in addr = nfs_param.core_param.metrics_addr;
+	int one = 1;
+	int rc;
+
+	if (nfs_param.core_param.metrics_port == 0)
+		return;
+
+	metrics_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (metrics_fd < 0) {
+		LogCrit(COMPONENT_INIT, "Unable to create metrics socket: %s",
+			strerror(errno));
+		return;
+	}
+
+	(void) setsockopt(metrics_fd, SOL_SOCKET, SO_REUSEADDR, &one,
+			  sizeof(one));
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(nfs_param.core_param.metrics_port);
+
+	if (bind(metrics_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    listen(metrics_fd, 16) != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Unable to listen for metrics on port %u: %s",
+			nfs_param.core_param.metrics_port, strerror(errno));
+		goto fail;
+	}
+
+	rc = pthread_create(&metrics_thrid, NULL, metrics_thread, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Unable to start metrics thread: %d", rc);
+		goto fail;
+	}
+
+	LogEvent(COMPONENT_INIT, "Serving metrics on port %u",
+		 nfs_param.core_param.metrics_port);
+	return;
+
+fail:
+	close(metrics_fd);
+	metrics_fd = -1;
+}
+
+void nfs_metrics_pkgshutdown(void)
+{
+	if (metrics_fd < 0)
+		return;
+
+	atomic_store_uint32_t(&metrics_shutdown, 1);
+	pthread_join(metrics_thrid, NULL);
+	close(metrics_fd);
+	metrics_fd = -1;
+}
@@ -0,0 +1,181 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file nfs_numa.c
+ * @brief NUMA topology discovery for worker placement
+ *
+ * We avoid a dependency on libnuma: the per-node CPU lists are
+ * parsed from /sys/devices/system/node/nodeN/cpulist, which is all
+ * we need to pin threads and to map a CPU back to its node.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "log.h"
+#include "abstract_mem.h"
+#include "nfs_numa.h"
+
+#define NUMA_SYSFS_NODE "/sys/devices/system/node"
+
+/* Do not look for more nodes than this */
+#define NUMA_MAX_NODES 64
+
+struct nfs_numa_topology nfs_numa;
+
+/**
+ * @brief Parse a sysfs cpulist ("0-3,8-11") into a cpu set
+ *
+ * @param[in]  list  The list
+ * @param[out] cpus  Set to fill
+ *
+ * @return Number of CPUs added.
+ */
+static uint32_t numa_parse_cpulist(const char *list, cpu_set_t *cpus)
+{
+	const char *p = list;
+	uint32_t count = 0;
+
+	CPU_ZERO(cpus);
+
+	while (*p != '\0' && *p != '\n') {
+		char *end;
+		long lo, hi;
+
+		lo = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		hi = lo;
+		p = end;
+		if (*p == '-') {
+			hi = strtol(p + 1, &end, 10);
+			p = end;
+		}
+		for (; lo <= hi && lo < CPU_SETSIZE; ++lo) {
+			CPU_SET(lo, cpus);
+			++count;
+		}
+		if (*p == ',')
+			++p;
+	}
+
+	return count;
+}
+
+/**
+ * @brief Discover the NUMA topology
+ *
+ * On a non-NUMA system (or without sysfs) this produces a single
+ * node containing every online CPU.
+ *
+ * @return 0 on success.
+ */
+int nfs_numa_init(void)
+{
+	struct nfs_numa_node nodes[NUMA_MAX_NODES];
+	char path[64];
+	char buf[1024];
+	long ncpu = sysconf(_SC_NPROCESSORS_CONF);
+	uint32_t ix, c;
+
+	if (ncpu <= 0)
+		ncpu = 1;
+
+	nfs_numa.nnodes = 0;
+	for (ix = 0; ix < NUMA_MAX_NODES; ++ix) {
+		FILE *f;
+		uint32_t n;
+
+		snprintf(path, sizeof(path), NUMA_SYSFS_NODE "/node%u/cpulist",
+			 ix);
+		f = fopen(path, "r");
+		if (f == NULL)
+			continue;
+		if (fgets(buf, sizeof(buf), f) == NULL) {
+			fclose(f);
+			continue;
+		}
+		fclose(f);
+
+		n = numa_parse_cpulist(buf, &nodes[nfs_numa.nnodes].cpus);
+		/* memory-only nodes cannot host workers */
+		if (n == 0)
+			continue;
+		nodes[nfs_numa.nnodes].id = ix;
+		nodes[nfs_numa.nnodes].ncpus = n;
+		++nfs_numa.nnodes;
+	}
+
+	if (nfs_numa.nnodes == 0) {
+		nodes[0].id = 0;
+		CPU_ZERO(&nodes[0].cpus);
+		for (c = 0; c < ncpu && c < CPU_SETSIZE; ++c)
+			CPU_SET(c, &nodes[0].cpus);
+		nodes[0].ncpus = c;
+		nfs_numa.nnodes = 1;
+	}
+
+	nfs_numa.nodes = gsh_calloc(nfs_numa.nnodes,
+				    sizeof(struct nfs_numa_node));
+	memcpy(nfs_numa.nodes, nodes,
+	       nfs_numa.nnodes * sizeof(struct nfs_numa_node));
+
+	nfs_numa.ncpus = ncpu;
+	nfs_numa.cpu_node = gsh_calloc(ncpu, sizeof(uint32_t));
+	for (ix = 0; ix < nfs_numa.nnodes; ++ix) {
+		for (c = 0; c < ncpu && c < CPU_SETSIZE; ++c)
+			if (CPU_ISSET(c, &nfs_numa.nodes[ix].cpus))
+				nfs_numa.cpu_node[c] = ix;
+		LogInfo(COMPONENT_INIT,
+			"NUMA node %u has %u CPUs",
+			nfs_numa.nodes[ix].id, nfs_numa.nodes[ix].ncpus);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Bind the calling thread to the CPUs of a node
+ *
+ * @param[in] node Index into nfs_numa.nodes
+ *
+ * @return 0 or an errno value.
+ */
+int nfs_numa_bind_self(uint32_t node)
+{
+	int rc;
+
+	if (node >= nfs_numa.nnodes)
+		return EINVAL;
+
+	rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+				    &nfs_numa.nodes[node].cpus);
+	if (rc != 0)
+		LogWarn(COMPONENT_THREAD,
+			"Unable to bind thread to NUMA node %u: %d",
+			nfs_numa.nodes[node].id, rc);
+	return rc;
+}
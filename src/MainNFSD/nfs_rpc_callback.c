@@ -56,6 +56,9 @@
 #include "gss_credcache.h"
 #endif /* _HAVE_GSSAPI */
 #include "sal_data.h"
+#include "sal_functions.h"
+#include "fridgethr.h"
+#include "delayed_exec.h"
 #include <misc/timespec.h>
 
 const struct __netid_nc_table netid_nc_table[9] = {
@@ -104,11 +107,26 @@ static inline void nfs_rpc_cb_init_ccache(const char *ccache)
 #endif /* _HAVE_GSSAPI */
 }
 
+/**
+ * @brief Most operations, besides CB_SEQUENCE, sent in one CB_COMPOUND
+ */
+#define NFS_RPC_CB_BATCH_MAX 16
+
+/**
+ * @brief Threads that send callbacks
+ *
+ * Calls wait out the client's reply here rather than on an NFS worker.
+ */
+static struct fridgethr *cb_fridge;
+
 /**
  * @brief Initialize callback subsystem
  */
 void nfs_rpc_cb_pkginit(void)
 {
+	struct fridgethr_params frp;
+	int rc;
+
 #ifdef _HAVE_GSSAPI
 	/* ccache */
 	nfs_rpc_cb_init_ccache(nfs_param.krb5_param.ccache_dir);
@@ -118,6 +136,19 @@ void nfs_rpc_cb_pkginit(void)
 		LogCrit(COMPONENT_INIT,
 			"sanity check: gssd_check_mechs() failed");
 #endif /* _HAVE_GSSAPI */
+
+	memset(&frp, 0, sizeof(frp));
+	frp.thr_max = nfs_param.nfsv4_param.callback_threads;
+	frp.thread_delay = 60;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&cb_fridge, "nfs_cb", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_NFS_CB,
+			 "Unable to initialize callback thread fridge: %d",
+			 rc);
+		cb_fridge = NULL;
+	}
 }
 
 /**
@@ -125,7 +156,23 @@ void nfs_rpc_cb_pkginit(void)
  */
 void nfs_rpc_cb_pkgshutdown(void)
 {
-	/* return */
+	int rc;
+
+	if (cb_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(cb_fridge, fridgethr_comm_stop, 120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_NFS_CB,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(cb_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_NFS_CB,
+			 "Failed shutting down callback threads: %d", rc);
+	}
+
+	fridgethr_destroy(cb_fridge);
+	cb_fridge = NULL;
 }
 
 /**
@@ -615,12 +662,256 @@ static void _nfs_rpc_destroy_chan(rpc_call_channel_t *chan)
 	chan->last_called = 0;
 }
 
+/**
+ * @brief Drop a channel's connection after a failed call
+ *
+ * An NFSv4.1 channel keeps its auth, made from the CREATE_SESSION
+ * security parameters, so it can be reconnected over another
+ * connection bound to the session.  Any other channel is disposed of.
+ *
+ * The caller should hold the channel mutex.
+ *
+ * @param[in] chan The channel
+ */
+static void nfs_rpc_drop_conn(rpc_call_channel_t *chan)
+{
+	if (chan->type != RPC_CHAN_V41) {
+		_nfs_rpc_destroy_chan(chan);
+		return;
+	}
+
+	if (chan->clnt) {
+		CLNT_DESTROY(chan->clnt);
+		chan->clnt = NULL;
+	}
+}
+
+/**
+ * @brief Unbind a connection from a session's back channel
+ *
+ * The caller should hold the channel mutex.
+ *
+ * @param[in,out] session The session
+ * @param[in]     i       Index of the connection in back_xprts
+ */
+static void nfs_rpc_unbind_conn_v41(nfs41_session_t *session, uint32_t i)
+{
+	SVC_RELEASE(session->back_xprts[i], SVC_RELEASE_FLAG_NONE);
+	session->nb_back_xprts--;
+	memmove(&session->back_xprts[i], &session->back_xprts[i + 1],
+		(session->nb_back_xprts - i) * sizeof(session->back_xprts[0]));
+}
+
+/**
+ * @brief Connect a session's back channel over a bound connection
+ *
+ * The connections are tried in order, and those that are gone or do
+ * not answer CB_NULL are unbound.  The one that works stays first.
+ *
+ * The caller should hold the channel mutex, and the channel must have
+ * its auth and no client.
+ *
+ * @param[in,out] session The session
+ *
+ * @return 0 or POSIX error code.
+ */
+static int nfs_rpc_connect_chan_v41(nfs41_session_t *session)
+{
+	rpc_call_channel_t *chan = &session->cb_chan;
+	struct timeval cb_timeout = { 15, 0 };
+	SVCXPRT *xprt;
+
+	while (session->nb_back_xprts > 0) {
+		xprt = session->back_xprts[0];
+
+		if (!(xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED)) {
+			chan->clnt = clnt_vc_create_svc(xprt,
+							session->cb_program,
+							NFS_CB,
+							CLNT_CREATE_FLAG_NONE);
+			if (chan->clnt &&
+			    rpc_cb_null(chan, cb_timeout, true)
+			    == RPC_SUCCESS) {
+				session->flags |= session_bc_up;
+				return 0;
+			}
+			nfs_rpc_drop_conn(chan);
+		}
+
+		nfs_rpc_unbind_conn_v41(session, 0);
+	}
+
+	session->flags &= ~session_bc_up;
+	return ENOTCONN;
+}
+
+/**
+ * @brief Move a session's back channel off a failed connection
+ *
+ * The connection in use is unbound and the channel reconnected over
+ * the next connection the client bound to the session, if any.
+ * Otherwise the channel stays down until the client binds one.
+ *
+ * The caller should hold the channel mutex.
+ *
+ * @param[in,out] session The session
+ *
+ * @return 0 if the channel is up again, POSIX error code otherwise.
+ */
+static int nfs_rpc_failover_chan_v41(nfs41_session_t *session)
+{
+	rpc_call_channel_t *chan = &session->cb_chan;
+	int code;
+
+	nfs_rpc_drop_conn(chan);
+
+	if (session->nb_back_xprts > 0)
+		nfs_rpc_unbind_conn_v41(session, 0);
+
+	if (!chan->auth) {
+		session->flags &= ~session_bc_up;
+		return ENOTCONN;
+	}
+
+	code = nfs_rpc_connect_chan_v41(session);
+
+	if (code == 0)
+		LogInfo(COMPONENT_NFS_CB,
+			"back channel of session %p failed over to another connection",
+			session);
+	else
+		LogInfo(COMPONENT_NFS_CB,
+			"back channel of session %p is down, no connection left",
+			session);
+
+	return code;
+}
+
+/**
+ * @brief Bind a connection to a session's back channel
+ *
+ * This implements the back channel half of BIND_CONN_TO_SESSION.  The
+ * connection joins those the channel can fail over to.  If the channel
+ * is down, it is reconnected over this connection.
+ *
+ * @param[in,out] session The session
+ * @param[in]     xprt    The connection
+ *
+ * @return 0 if the connection is bound, POSIX error code otherwise.
+ */
+int nfs_rpc_bind_conn_v41(nfs41_session_t *session, SVCXPRT *xprt)
+{
+	rpc_call_channel_t *chan = &session->cb_chan;
+	int code = 0;
+	uint32_t i;
+
+	if (svc_get_xprt_type(xprt) == XPRT_RDMA)
+		return EINVAL;
+
+	PTHREAD_MUTEX_lock(&chan->mtx);
+
+	/* No back channel was set up by CREATE_SESSION */
+	if (!chan->auth) {
+		code = EINVAL;
+		goto out;
+	}
+
+	for (i = 0; i < session->nb_back_xprts; i++)
+		if (session->back_xprts[i] == xprt)
+			break;
+
+	if (i == session->nb_back_xprts) {
+		if (i == NFS41_MAX_BACK_CONNS) {
+			/* Make room by dropping the last one */
+			nfs_rpc_unbind_conn_v41(session, --i);
+		}
+		SVC_REF(xprt, SVC_REF_FLAG_NONE);
+		session->back_xprts[i] = xprt;
+		session->nb_back_xprts++;
+	}
+
+	if (chan->clnt)
+		goto out;
+
+	/* Channel down, try this connection first */
+	memmove(&session->back_xprts[1], &session->back_xprts[0],
+		i * sizeof(session->back_xprts[0]));
+	session->back_xprts[0] = xprt;
+
+	code = nfs_rpc_connect_chan_v41(session);
+
+ out:
+	PTHREAD_MUTEX_unlock(&chan->mtx);
+
+	return code;
+}
+
+/**
+ * @brief Dispose of a session's back channel and its connections
+ *
+ * @param[in,out] session The session
+ */
+void nfs_rpc_destroy_chan_v41(nfs41_session_t *session)
+{
+	rpc_call_channel_t *chan = &session->cb_chan;
+
+	PTHREAD_MUTEX_lock(&chan->mtx);
+
+	_nfs_rpc_destroy_chan(chan);
+
+	while (session->nb_back_xprts > 0)
+		nfs_rpc_unbind_conn_v41(session,
+					session->nb_back_xprts - 1);
+
+	session->flags &= ~session_bc_up;
+
+	PTHREAD_MUTEX_unlock(&chan->mtx);
+}
+
+/**
+ * @brief CB_NULL a back channel taken on trust in a reconnect storm
+ *
+ * If it does not answer, the channel fails over as if a callback had
+ * failed.
+ *
+ * @param[in] session The session, whose reference is released
+ */
+static void nfs_rpc_cb_probe_v41(nfs41_session_t *session)
+{
+	rpc_call_channel_t *chan = &session->cb_chan;
+	struct timeval cb_timeout = { 15, 0 };
+
+	PTHREAD_MUTEX_lock(&chan->mtx);
+
+	if (chan->clnt != NULL &&
+	    rpc_cb_null(chan, cb_timeout, true) != RPC_SUCCESS)
+		(void) nfs_rpc_failover_chan_v41(session);
+
+	PTHREAD_MUTEX_unlock(&chan->mtx);
+
+	dec_session_ref(session);
+}
+
+static void nfs_rpc_cb_probe_v41_job(struct fridgethr_context *ctx)
+{
+	nfs_rpc_cb_probe_v41(ctx->arg);
+}
+
+/* Called from delayed_exec, whose thread must not wait on the network */
+static void nfs_rpc_cb_probe_v41_submit(void *arg)
+{
+	if (cb_fridge == NULL ||
+	    fridgethr_submit(cb_fridge, nfs_rpc_cb_probe_v41_job, arg) != 0)
+		nfs_rpc_cb_probe_v41(arg);
+}
+
 /**
  * @brief Create a channel for an NFSv4.1 session
  *
  * This function creates a channel on an NFSv4.1 session, using the
  * given security parameters.  If a channel already exists, it is
- * removed and replaced.
+ * removed and replaced.  In a reconnect storm the CB_NULL is left to
+ * nfs_rpc_cb_probe_v41().
  *
  * @param[in,out] session       The session on which to create the
  *                              back channel
@@ -638,6 +929,8 @@ int nfs_rpc_create_chan_v41(nfs41_session_t *session, int num_sec_parms,
 	int i;
 	bool authed = false;
 	struct timeval cb_timeout = { 15, 0 };
+	nsecs_elapsed_t delay;
+	enum clnt_stat stat = RPC_SUCCESS;
 
 	PTHREAD_MUTEX_lock(&chan->mtx);
 
@@ -711,15 +1004,35 @@ int nfs_rpc_create_chan_v41(nfs41_session_t *session, int num_sec_parms,
 		goto out;
 	}
 
-	if (rpc_cb_null(chan, cb_timeout, true) != RPC_SUCCESS)
+	/* In a reconnect storm, take the back channel on trust and probe
+	 * it later rather than hold up CREATE_SESSION.
+	 */
+	delay = nfs4_storm_delay(session->clientid);
+	if (delay == 0)
+		stat = rpc_cb_null(chan, cb_timeout, true);
+
+	if (stat != RPC_SUCCESS) {
 #ifdef EBADFD
 		code = EBADFD;
 #else				/* !EBADFD */
 		code = EBADF;
 #endif				/* !EBADFD */
-	else
+	} else {
+		/* The creating connection is the first one bound */
+		SVC_REF(session->xprt, SVC_REF_FLAG_NONE);
+		session->back_xprts[0] = session->xprt;
+		session->nb_back_xprts = 1;
 		session->flags |= session_bc_up;
 
+		if (delay != 0) {
+			/* Released by the probe */
+			inc_session_ref(session);
+			if (delayed_submit(nfs_rpc_cb_probe_v41_submit,
+					   session, delay) != 0)
+				dec_session_ref(session);
+		}
+	}
+
  out:
 	if (code != 0) {
 		LogWarn(COMPONENT_NFS_CB,
@@ -753,8 +1066,15 @@ rpc_call_channel_t *nfs_rpc_get_chan(nfs_client_id_t *clientid, uint32_t flags)
 
 	if (clientid->cid_minorversion == 0) {
 		chan = &clientid->cid_cb.v40.cb_chan;
-		if (!chan->clnt)
-			(void)nfs_rpc_create_chan_v40(clientid, flags);
+		PTHREAD_MUTEX_lock(&chan->mtx);
+		/* Don't reconnect while a failed probe is backing off */
+		if (!chan->clnt &&
+		    time(NULL) >=
+		    atomic_fetch_time_t(&clientid->cid_cb.v40.cb_retry_time) &&
+		    nfs_rpc_create_chan_v40(clientid, flags) != 0 &&
+		    chan->clnt)
+			_nfs_rpc_destroy_chan(chan);
+		PTHREAD_MUTEX_unlock(&chan->mtx);
 		return chan;
 	}
 
@@ -819,7 +1139,7 @@ enum clnt_stat rpc_cb_null(rpc_call_channel_t *chan, struct timeval timeout,
 	/* If a call fails, we have to assume path down, or equally fatal
 	 * error.  We may need back-off. */
 	if (stat != RPC_SUCCESS)
-		_nfs_rpc_destroy_chan(chan);
+		nfs_rpc_drop_conn(chan);
 
  unlock:
 	if (!locked)
@@ -896,9 +1216,22 @@ static inline void RPC_CALL_HOOK(rpc_call_t *call, rpc_call_hook hook,
 		call->call_hook(call, hook, arg, flags);
 }
 
+/**
+ * @brief Send a queued call on a callback thread
+ *
+ * @param[in] ctx Thread context, the argument is the call
+ */
+static void nfs_rpc_cb_dispatch_job(struct fridgethr_context *ctx)
+{
+	(void) nfs_rpc_dispatch_call(ctx->arg, NFS_RPC_CALL_NONE);
+}
+
 /**
  * @brief Fire off an RPC call
  *
+ * Calls are sent from the callback threads, falling back to the NFS
+ * workers if those are not running.
+ *
  * @param[in] call           The constructed call
  * @param[in] completion_arg Argument to completion function
  * @param[in] flags          Control flags for call
@@ -919,7 +1252,9 @@ int32_t nfs_rpc_submit_call(rpc_call_t *call, void *completion_arg,
 	reqdata = container_of(call, request_data_t, r_u.call);
 	PTHREAD_MUTEX_lock(&call->we.mtx);
 	call->states = NFS_CB_CALL_QUEUED;
-	nfs_rpc_enqueue_req(reqdata);
+	if (cb_fridge == NULL ||
+	    fridgethr_submit(cb_fridge, nfs_rpc_cb_dispatch_job, call) != 0)
+		nfs_rpc_enqueue_req(reqdata);
 	PTHREAD_MUTEX_unlock(&call->we.mtx);
 
 	return 0;
@@ -965,9 +1300,15 @@ int32_t nfs_rpc_dispatch_call(rpc_call_t *call, uint32_t flags)
 			       &call->cbt.v_u.v4.res, CB_TIMEOUT);
 
 	/* If a call fails, we have to assume path down, or equally fatal
-	 * error.  We may need back-off. */
+	 * error.  We may need back-off.  A session's channel moves to
+	 * another connection bound to it, for the calls that follow.
+	 */
 	if (call->stat != RPC_SUCCESS) {
-		_nfs_rpc_destroy_chan(call->chan);
+		if (call->chan->type == RPC_CHAN_V41)
+			(void) nfs_rpc_failover_chan_v41(
+					call->chan->source.session);
+		else
+			_nfs_rpc_destroy_chan(call->chan);
 		hook_status = RPC_CALL_ABORT;
 	}
 
@@ -1055,7 +1396,7 @@ static rpc_call_t *construct_single_call(nfs41_session_t *session,
 		    csa_referring_call_lists.csa_referring_call_lists_val =
 		    list;
 		memcpy(list->rcl_sessionid, refer->session,
-		       sizeof(NFS4_SESSIONID_SIZE));
+		       NFS4_SESSIONID_SIZE);
 		list->rcl_referring_calls.rcl_referring_calls_len = 1;
 		list->rcl_referring_calls.rcl_referring_calls_val = ref_call;
 		ref_call->rc_sequenceid = refer->sequence;
@@ -1084,22 +1425,67 @@ static void free_single_call(rpc_call_t *call)
 	CB_SEQUENCE4args *sequence =
 	    (&call->cbt.v_u.v4.args.argarray.argarray_val[0].nfs_cb_argop4_u.
 	     opcbsequence);
-
-	if (sequence->csa_referring_call_lists.csa_referring_call_lists_val) {
-		if (sequence->csa_referring_call_lists.
-		    csa_referring_call_lists_val->
-		    rcl_referring_calls.rcl_referring_calls_val) {
-			gsh_free(sequence->csa_referring_call_lists.
-				 csa_referring_call_lists_val->
-				 rcl_referring_calls.
+	referring_call_list4 *lists =
+	    sequence->csa_referring_call_lists.csa_referring_call_lists_val;
+	u_int i;
+
+	if (lists) {
+		for (i = 0;
+		     i < sequence->csa_referring_call_lists.
+			 csa_referring_call_lists_len;
+		     ++i)
+			gsh_free(lists[i].rcl_referring_calls.
 				 rcl_referring_calls_val);
-		}
-		gsh_free(sequence->csa_referring_call_lists.
-			 csa_referring_call_lists_val);
+		gsh_free(lists);
 	}
 	free_rpc_call(call);
 }
 
+/* Back channel slot statistics, the wait path is rare enough to
+ * take a mutex.
+ */
+static struct nfs_cb_slot_stats cb_slot_stats;
+static pthread_mutex_t cb_slot_stats_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Account for a wait for a callback slot
+ *
+ * @param[in] start When the wait started
+ * @param[in] found Whether a slot was found
+ */
+static void cb_slot_waited(const struct timespec *start, bool found)
+{
+	struct timespec end;
+	nsecs_elapsed_t wait;
+
+	now(&end);
+	wait = timespec_diff(start, &end);
+
+	PTHREAD_MUTEX_lock(&cb_slot_stats_mtx);
+	if (found)
+		++cb_slot_stats.waited;
+	else
+		++cb_slot_stats.missed;
+	cb_slot_stats.wait_ns += wait;
+	if (wait > cb_slot_stats.max_wait_ns)
+		cb_slot_stats.max_wait_ns = wait;
+	PTHREAD_MUTEX_unlock(&cb_slot_stats_mtx);
+}
+
+/**
+ * @brief Get the back channel slot statistics
+ *
+ * @param[out] stats Statistics since startup
+ */
+void nfs_rpc_cb_slot_stats(struct nfs_cb_slot_stats *stats)
+{
+	PTHREAD_MUTEX_lock(&cb_slot_stats_mtx);
+	*stats = cb_slot_stats;
+	PTHREAD_MUTEX_unlock(&cb_slot_stats_mtx);
+	stats->found = atomic_fetch_uint64_t(&cb_slot_stats.found);
+	stats->busy = atomic_fetch_uint64_t(&cb_slot_stats.busy);
+}
+
 /**
  * @brief Find a callback slot
  *
@@ -1120,13 +1506,12 @@ static bool find_cb_slot(nfs41_session_t *session, bool wait, slotid4 *slot,
 {
 	slotid4 cur = 0;
 	bool found = false;
+	bool waited = false;
+	struct timespec start;
 
 	PTHREAD_MUTEX_lock(&session->cb_mutex);
  retry:
-	for (cur = 0;
-	     cur < MIN(session->back_channel_attrs.ca_maxrequests,
-		       NFS41_NB_SLOTS);
-	     ++cur) {
+	for (cur = 0; cur < session->nb_cb_slots; ++cur) {
 
 		if (!(session->cb_slots[cur].in_use) && (!found)) {
 			found = true;
@@ -1142,6 +1527,11 @@ static bool find_cb_slot(nfs41_session_t *session, bool wait, slotid4 *slot,
 		struct timespec ts;
 		bool woke = false;
 
+		if (!waited) {
+			now(&start);
+			waited = true;
+		}
+
 		clock_gettime(CLOCK_REALTIME, &ts);
 		timespec_addms(&ts, 100);
 
@@ -1161,6 +1551,14 @@ static bool find_cb_slot(nfs41_session_t *session, bool wait, slotid4 *slot,
 	}
 
 	PTHREAD_MUTEX_unlock(&session->cb_mutex);
+
+	if (waited)
+		cb_slot_waited(&start, found);
+	else if (found)
+		atomic_inc_uint64_t(&cb_slot_stats.found);
+	else
+		atomic_inc_uint64_t(&cb_slot_stats.busy);
+
 	return found;
 }
 
@@ -1190,12 +1588,8 @@ static void release_cb_slot(nfs41_session_t *session, slotid4 slot, bool sent)
  * details of CB_SEQUENCE management, finding a connection with a
  * working back channel, and so forth.
  *
- * @note This should work for most practical purposes, but is not
- * ideal.  What we ought to have is a per-clientid queue that
- * operations can be submitted to that will be sent when a
- * back-channel is re-established, with a per-session queue for
- * operations that were sent but had the back-channel fail before the
- * response was received.
+ * @note Recalls go through nfs_rpc_cb_batch instead, which queues
+ * them per client and sends them together.
  *
  * @param[in] clientid       Client record
  * @param[in] op             The operation to perform
@@ -1252,9 +1646,11 @@ int nfs_rpc_v41_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
 				/* Clean up... */
 				free_single_call(call);
 				release_cb_slot(session, slot, false);
+				/* The second scan retries it if it failed
+				 * over to another connection.
+				 */
 				PTHREAD_MUTEX_lock(&chan->mtx);
-				_nfs_rpc_destroy_chan(chan);
-				session->flags &= ~session_bc_up;
+				(void) nfs_rpc_failover_chan_v41(session);
 				PTHREAD_MUTEX_unlock(&chan->mtx);
 			} else
 				return 0;
@@ -1278,6 +1674,531 @@ void nfs41_complete_single(rpc_call_t *call, rpc_call_hook hook, void *arg,
 	free_single_call(call);
 }
 
+/**
+ * @brief Reserve a backchannel slot on any session of a client
+ *
+ * Sessions are first tried without waiting, then the first one with
+ * a back channel is waited on for a while.
+ *
+ * @param[in]  clientid     v4.1 client record
+ * @param[out] slot         Slot to use
+ * @param[out] highest_slot Highest slot in use
+ *
+ * @return A referenced session, or NULL if none has a free slot.
+ */
+static nfs41_session_t *nfs_rpc_cb_batch_session(nfs_client_id_t *clientid,
+						 slotid4 *slot,
+						 slotid4 *highest_slot)
+{
+	struct glist_head *glist;
+	nfs41_session_t *session, *wait = NULL;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	glist_for_each(glist, &clientid->cid_cb.v41.cb_session_list) {
+		session = glist_entry(glist, nfs41_session_t, session_link);
+
+		if (!(session->flags & session_bc_up))
+			continue;
+
+		if (find_cb_slot(session, false, slot, highest_slot)) {
+			inc_session_ref(session);
+			PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+			return session;
+		}
+
+		if (wait == NULL)
+			wait = session;
+	}
+	if (wait != NULL)
+		inc_session_ref(wait);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	if (wait == NULL)
+		return NULL;
+
+	if (find_cb_slot(wait, true, slot, highest_slot))
+		return wait;
+
+	dec_session_ref(wait);
+	return NULL;
+}
+
+/**
+ * @brief Take the next operations to send off a client's queue
+ *
+ * @param[in]  clientid Client record
+ * @param[out] batch    List receiving the operations
+ * @param[in]  max      Most operations to take
+ *
+ * @return The number of operations taken.
+ */
+static uint32_t nfs_rpc_cb_batch_take(nfs_client_id_t *clientid,
+				      struct glist_head *batch, uint32_t max)
+{
+	struct nfs_cb_batch_op *op;
+	uint32_t count = 0;
+
+	glist_init(batch);
+
+	PTHREAD_MUTEX_lock(&clientid->cid_cb_batch_mtx);
+	while (count < max) {
+		op = glist_first_entry(&clientid->cid_cb_batch,
+				       struct nfs_cb_batch_op, batch_link);
+		if (op == NULL)
+			break;
+		glist_del(&op->batch_link);
+		glist_add_tail(batch, &op->batch_link);
+		++count;
+	}
+	if (count == 0)
+		clientid->cid_cb_batch_queued = false;
+	PTHREAD_MUTEX_unlock(&clientid->cid_cb_batch_mtx);
+
+	return count;
+}
+
+/**
+ * @brief Complete the operations of a batch
+ *
+ * A CB_COMPOUND stops at the first operation that fails, so every
+ * operation before the last result succeeded and the last one carries
+ * the compound's status.  Operations the client never reached get
+ * NFS4ERR_DELAY so they are retried, unless CB_SEQUENCE itself failed,
+ * in which case they all get its status.
+ *
+ * @param[in] batch The operations, in the order they were sent
+ * @param[in] call  The call that carried them, NULL if none was sent
+ * @param[in] first Index of the first operation in the compound
+ */
+static void nfs_rpc_cb_batch_done(struct glist_head *batch, rpc_call_t *call,
+				  uint32_t first)
+{
+	struct glist_head *glist, *glistn;
+	rpc_call_hook hook = RPC_CALL_ABORT;
+	nfsstat4 cstatus = NFS4ERR_DELAY;
+	uint32_t nres = 0, i = first;
+
+	if (call != NULL && call->stat == RPC_SUCCESS) {
+		hook = RPC_CALL_COMPLETE;
+		cstatus = call->cbt.v_u.v4.res.status;
+		nres = call->cbt.v_u.v4.res.resarray.resarray_len;
+	}
+
+	glist_for_each_safe(glist, glistn, batch) {
+		struct nfs_cb_batch_op *op =
+			glist_entry(glist, struct nfs_cb_batch_op, batch_link);
+		nfsstat4 status;
+
+		if (i + 1 < nres)
+			status = NFS4_OK;
+		else if (i + 1 == nres || (nres <= first && cstatus != NFS4_OK))
+			status = cstatus;
+		else
+			status = NFS4ERR_DELAY;
+
+		glist_del(&op->batch_link);
+		op->completion(op, hook, status);
+		++i;
+	}
+}
+
+/**
+ * @brief Send one batch to a v4.0 client
+ *
+ * @param[in] clientid Client record
+ *
+ * @retval false if the queue was empty.
+ */
+static bool nfs_rpc_cb_batch_v40(nfs_client_id_t *clientid)
+{
+	struct glist_head batch, *glist;
+	rpc_call_channel_t *chan;
+	rpc_call_t *call;
+	uint32_t count;
+
+	count = nfs_rpc_cb_batch_take(clientid, &batch, NFS_RPC_CB_BATCH_MAX);
+	if (count == 0)
+		return false;
+
+	chan = nfs_rpc_get_chan(clientid, NFS_RPC_FLAG_NONE);
+	if (chan == NULL || chan->clnt == NULL) {
+		LogDebug(COMPONENT_NFS_CB, "No callback channel for %p",
+			 clientid);
+		nfs_rpc_cb_batch_done(&batch, NULL, 0);
+		return true;
+	}
+
+	call = alloc_rpc_call();
+	call->chan = chan;
+	cb_compound_init_v4(&call->cbt, count, 0,
+			    clientid->cid_cb.v40.cb_callback_ident,
+			    "brrring!!!", 10);
+
+	glist_for_each(glist, &batch) {
+		cb_compound_add_op(&call->cbt,
+				   &glist_entry(glist, struct nfs_cb_batch_op,
+						batch_link)->arg);
+	}
+
+	(void) nfs_rpc_dispatch_call(call, NFS_RPC_CALL_NONE);
+	nfs_rpc_cb_batch_done(&batch, call, 0);
+	free_rpc_call(call);
+
+	return true;
+}
+
+/**
+ * @brief Send one batch to a v4.1 client
+ *
+ * The referring calls of the operations are grouped by session in the
+ * CB_SEQUENCE that heads the compound.
+ *
+ * @param[in] clientid Client record
+ *
+ * @retval false if the queue was empty.
+ */
+static bool nfs_rpc_cb_batch_v41(nfs_client_id_t *clientid)
+{
+	struct glist_head batch, *glist;
+	nfs41_session_t *session;
+	slotid4 slot = 0, highest_slot = 0;
+	uint32_t max = NFS_RPC_CB_BATCH_MAX, count, nlists = 0, j;
+	rpc_call_t *call;
+	nfs_cb_argop4 sequenceop;
+	CB_SEQUENCE4args *sequence = &sequenceop.nfs_cb_argop4_u.opcbsequence;
+	referring_call_list4 *lists;
+
+	session = nfs_rpc_cb_batch_session(clientid, &slot, &highest_slot);
+	if (session != NULL &&
+	    session->back_channel_attrs.ca_maxoperations > 1 &&
+	    session->back_channel_attrs.ca_maxoperations - 1 < max)
+		max = session->back_channel_attrs.ca_maxoperations - 1;
+
+	count = nfs_rpc_cb_batch_take(clientid, &batch, max);
+	if (count == 0 || session == NULL) {
+		if (session != NULL) {
+			release_cb_slot(session, slot, false);
+			dec_session_ref(session);
+		} else if (count != 0) {
+			LogDebug(COMPONENT_NFS_CB,
+				 "No back channel for %p", clientid);
+			nfs_rpc_cb_batch_done(&batch, NULL, 0);
+		}
+		return count != 0;
+	}
+
+	call = alloc_rpc_call();
+	call->chan = &session->cb_chan;
+	cb_compound_init_v4(&call->cbt, count + 1,
+			    clientid->cid_minorversion, 0, NULL, 0);
+
+	memset(sequence, 0, sizeof(CB_SEQUENCE4args));
+	sequenceop.argop = NFS4_OP_CB_SEQUENCE;
+	memcpy(sequence->csa_sessionid, session->session_id,
+	       NFS4_SESSIONID_SIZE);
+	sequence->csa_sequenceid = session->cb_slots[slot].sequence;
+	sequence->csa_slotid = slot;
+	sequence->csa_highest_slotid = highest_slot;
+	sequence->csa_cachethis = false;
+
+	lists = gsh_calloc(count, sizeof(referring_call_list4));
+
+	glist_for_each(glist, &batch) {
+		struct nfs_cb_batch_op *op =
+			glist_entry(glist, struct nfs_cb_batch_op, batch_link);
+		referring_call_list4 *list;
+		referring_call4 *ref_call;
+
+		if (!op->has_refer)
+			continue;
+
+		for (j = 0; j < nlists; ++j) {
+			if (memcmp(lists[j].rcl_sessionid, op->refer.session,
+				   NFS4_SESSIONID_SIZE) == 0)
+				break;
+		}
+
+		list = &lists[j];
+		if (j == nlists) {
+			memcpy(list->rcl_sessionid, op->refer.session,
+			       NFS4_SESSIONID_SIZE);
+			list->rcl_referring_calls.rcl_referring_calls_val =
+				gsh_calloc(count, sizeof(referring_call4));
+			++nlists;
+		}
+
+		ref_call = &list->rcl_referring_calls.rcl_referring_calls_val
+			[list->rcl_referring_calls.rcl_referring_calls_len++];
+		ref_call->rc_sequenceid = op->refer.sequence;
+		ref_call->rc_slotid = op->refer.slot;
+	}
+
+	if (nlists != 0) {
+		sequence->csa_referring_call_lists.
+		    csa_referring_call_lists_len = nlists;
+		sequence->csa_referring_call_lists.
+		    csa_referring_call_lists_val = lists;
+	} else {
+		gsh_free(lists);
+	}
+
+	cb_compound_add_op(&call->cbt, &sequenceop);
+	glist_for_each(glist, &batch) {
+		cb_compound_add_op(&call->cbt,
+				   &glist_entry(glist, struct nfs_cb_batch_op,
+						batch_link)->arg);
+	}
+
+	(void) nfs_rpc_dispatch_call(call, NFS_RPC_CALL_NONE);
+	nfs_rpc_cb_batch_done(&batch, call, 1);
+
+	release_cb_slot(session, slot, true);
+	free_single_call(call);
+	dec_session_ref(session);
+
+	return true;
+}
+
+/**
+ * @brief Send everything queued for a client
+ *
+ * @param[in] arg The client record, whose reference is released
+ */
+static void nfs_rpc_cb_batch_flush(void *arg)
+{
+	nfs_client_id_t *clientid = arg;
+
+	if (clientid->cid_minorversion == 0) {
+		while (nfs_rpc_cb_batch_v40(clientid))
+			;
+	} else {
+		while (nfs_rpc_cb_batch_v41(clientid))
+			;
+	}
+
+	dec_client_id_ref(clientid);
+}
+
+static void nfs_rpc_cb_batch_job(struct fridgethr_context *ctx)
+{
+	nfs_rpc_cb_batch_flush(ctx->arg);
+}
+
+/**
+ * @brief Queue a callback operation for a client
+ *
+ * Operations queued for the same client while an earlier batch is
+ * being sent go out together, CB_SEQUENCE first for v4.1, in as few
+ * CB_COMPOUNDs as the back channel allows.  The operation's
+ * completion is called exactly once, always from a callback thread,
+ * so the caller may hold locks the completion takes.  It then owns
+ * the operation again and must free anything the arguments point to.
+ *
+ * @param[in] clientid Client to call
+ * @param[in] op       The operation, with arg, refer and completion set
+ */
+void nfs_rpc_cb_batch(nfs_client_id_t *clientid, struct nfs_cb_batch_op *op)
+{
+	bool schedule;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_cb_batch_mtx);
+	glist_add_tail(&clientid->cid_cb_batch, &op->batch_link);
+	schedule = !clientid->cid_cb_batch_queued;
+	clientid->cid_cb_batch_queued = true;
+	PTHREAD_MUTEX_unlock(&clientid->cid_cb_batch_mtx);
+
+	if (!schedule)
+		return;
+
+	/* Released by the flush */
+	inc_client_id_ref(clientid);
+
+	if (cb_fridge == NULL ||
+	    fridgethr_submit(cb_fridge, nfs_rpc_cb_batch_job, clientid) != 0)
+		(void) delayed_submit(nfs_rpc_cb_batch_flush, clientid, 0);
+}
+
+/**
+ * @brief Connect a v4.0 callback channel if needed and send CB_NULL
+ *
+ * An established connection is reused unless @c reconnect is set.
+ * The channel mutex is held throughout, so this may wait behind a
+ * callback in flight.
+ *
+ * @param[in] clientid  v4.0 client record
+ * @param[in] reconnect Drop the current connection first
+ *
+ * @return The status of the CB_NULL.
+ */
+static enum clnt_stat nfs_rpc_probe_chan_v40(nfs_client_id_t *clientid,
+					     bool reconnect)
+{
+	struct timeval CB_TIMEOUT = {15, 0};
+	rpc_call_channel_t *chan = &clientid->cid_cb.v40.cb_chan;
+	enum clnt_stat stat = RPC_SYSTEMERROR;
+	int32_t tries;
+
+	PTHREAD_MUTEX_lock(&chan->mtx);
+
+	if (reconnect && chan->clnt)
+		_nfs_rpc_destroy_chan(chan);
+
+	/* A reused connection the client has dropped fails with RPC_INTR
+	 * after being destroyed, so connect afresh once.
+	 */
+	for (tries = 0; tries < 2; ++tries) {
+		if (!chan->clnt &&
+		    nfs_rpc_create_chan_v40(clientid, NFS_RPC_FLAG_NONE) != 0) {
+			LogDebug(COMPONENT_NFS_CB,
+				 "Could not connect callback channel of %p",
+				 clientid);
+			if (chan->clnt)
+				_nfs_rpc_destroy_chan(chan);
+			stat = RPC_SYSTEMERROR;
+			break;
+		}
+
+		stat = rpc_cb_null(chan, CB_TIMEOUT, true);
+		LogDebug(COMPONENT_NFS_CB,
+			 "rpc_cb_null on client %p returns %d", clientid, stat);
+
+		if (stat != RPC_INTR)
+			break;
+	}
+
+	PTHREAD_MUTEX_unlock(&chan->mtx);
+
+	return stat;
+}
+
+/**
+ * @brief A queued callback channel probe
+ */
+struct nfs_rpc_cb_probe {
+	nfs_client_id_t *clientid;	/*< Referenced client record */
+	uint32_t gen;			/*< cb_probe_gen when queued */
+	bool reconnect;			/*< Callback address changed */
+};
+
+static void nfs_rpc_cb_probe_run(void *arg);
+
+static void nfs_rpc_cb_probe_job(struct fridgethr_context *ctx)
+{
+	nfs_rpc_cb_probe_run(ctx->arg);
+}
+
+/**
+ * @brief Hand a probe to the callback threads
+ *
+ * Also used from delayed_exec, whose thread must not wait on the
+ * network.
+ *
+ * @param[in] arg The probe
+ */
+static void nfs_rpc_cb_probe_submit(void *arg)
+{
+	if (cb_fridge == NULL ||
+	    fridgethr_submit(cb_fridge, nfs_rpc_cb_probe_job, arg) != 0)
+		nfs_rpc_cb_probe_run(arg);
+}
+
+/**
+ * @brief Probe a v4.0 callback channel and record the outcome
+ *
+ * On failure the channel stays down and the probe is retried after a
+ * backoff that doubles up to the lease period, for as long as the
+ * client is confirmed and no newer probe has been started.
+ *
+ * @param[in] arg The probe, freed along with its reference
+ */
+static void nfs_rpc_cb_probe_run(void *arg)
+{
+	struct nfs_rpc_cb_probe *probe = arg;
+	nfs_client_id_t *clientid = probe->clientid;
+	uint32_t backoff = 0;
+	enum clnt_stat stat;
+
+	stat = nfs_rpc_probe_chan_v40(clientid, probe->reconnect);
+	probe->reconnect = false;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+
+	if (probe->gen != clientid->cid_cb.v40.cb_probe_gen) {
+		/* A newer probe owns the channel state */
+	} else if (stat == RPC_SUCCESS) {
+		set_cb_chan_down(clientid, false);
+		clientid->cid_cb.v40.cb_backoff = 0;
+		atomic_store_time_t(&clientid->cid_cb.v40.cb_retry_time, 0);
+		LogDebug(COMPONENT_NFS_CB,
+			 "Callback channel of %p is UP", clientid);
+	} else {
+		set_cb_chan_down(clientid, true);
+
+		backoff = clientid->cid_cb.v40.cb_backoff;
+		backoff = backoff == 0 ? 1 : backoff * 2;
+		if (backoff > nfs_param.nfsv4_param.lease_lifetime)
+			backoff = nfs_param.nfsv4_param.lease_lifetime;
+		clientid->cid_cb.v40.cb_backoff = backoff;
+		atomic_store_time_t(&clientid->cid_cb.v40.cb_retry_time,
+				    time(NULL) + backoff);
+
+		if (clientid->cid_confirmed != CONFIRMED_CLIENT_ID)
+			backoff = 0;
+
+		LogInfo(COMPONENT_NFS_CB,
+			"Callback channel of %p is down (%d)%s",
+			clientid, stat,
+			backoff != 0 ? ", probing again later" : "");
+	}
+
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	if (backoff != 0 &&
+	    delayed_submit(nfs_rpc_cb_probe_submit, probe,
+			   backoff * NS_PER_SEC) == 0)
+		return;
+
+	dec_client_id_ref(clientid);
+	gsh_free(probe);
+}
+
+/**
+ * @brief Probe a v4.0 client's callback channel in the background
+ *
+ * The channel is marked down until a CB_NULL gets through, so no
+ * delegation is granted on the strength of an unreachable client, and
+ * the caller never waits on connect, GSS setup or the probe itself.
+ * In a reconnect storm the probe starts later, see nfs4_storm_delay().
+ *
+ * @param[in] clientid  v4.0 client record
+ * @param[in] reconnect The callback address changed, so the current
+ *                      connection, if any, must not be reused
+ */
+void nfs_rpc_probe_cb_chan(nfs_client_id_t *clientid, bool reconnect)
+{
+	struct nfs_rpc_cb_probe *probe = gsh_malloc(sizeof(*probe));
+	nsecs_elapsed_t delay;
+
+	assert(clientid->cid_minorversion == 0);
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	set_cb_chan_down(clientid, true);
+	clientid->cid_cb.v40.cb_backoff = 0;
+	atomic_store_time_t(&clientid->cid_cb.v40.cb_retry_time, 0);
+	probe->gen = ++clientid->cid_cb.v40.cb_probe_gen;
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	/* Released once the probe stops retrying */
+	inc_client_id_ref(clientid);
+	probe->clientid = clientid;
+	probe->reconnect = reconnect;
+
+	delay = nfs4_storm_delay(clientid->cid_clientid);
+	if (delay == 0 ||
+	    delayed_submit(nfs_rpc_cb_probe_submit, probe, delay) != 0)
+		nfs_rpc_cb_probe_submit(probe);
+}
+
 /**
  * @brief test the state of callback channel for a clientid using NULL.
  * @return  enum clnt_stat
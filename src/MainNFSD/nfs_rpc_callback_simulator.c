@@ -42,6 +42,8 @@
 #include "nfs_rpc_callback_simulator.h"
 #include "sal_functions.h"
 #include "gsh_dbus.h"
+#include "common_utils.h"
+#include <misc/timespec.h>
 
 /**
  * @file nfs_rpc_callback_simulator.c
@@ -56,6 +58,9 @@
  * This concept is inspired by the upcall simulator, though
  * necessarily less fully satisfactory until delegation and layout
  * state are available.
+ *
+ * It also generates a steady load of fake callbacks, to measure how
+ * the callback path copes before delegations or pNFS are enabled.
  */
 
 /**
@@ -419,6 +424,646 @@ static struct gsh_dbus_method cbsim_fake_recall = {
 		 }
 };
 
+/*
+ * Callback load generator.
+ *
+ * start_load sends fake CB_RECALL, CB_LAYOUTRECALL and CB_NOTIFY
+ * operations at a steady rate to the confirmed clients, in turn,
+ * through nfs_rpc_cb_batch like the real recalls.  Their stateids and
+ * file handles match nothing, so clients refuse them without giving
+ * anything back, but they travel the whole path: queueing, batching,
+ * back channel slots and the round trip.  get_load_stats reports, for
+ * each operation, how many were sent, accepted, refused by the client
+ * or failed, and their latency from queueing to completion, with the
+ * back channel slot waits.
+ */
+
+enum cbsim_op_type {
+	CBSIM_RECALL,
+	CBSIM_LAYOUTRECALL,
+	CBSIM_NOTIFY,
+	CBSIM_OP_COUNT
+};
+
+static const char *cbsim_op_names[CBSIM_OP_COUNT] = {
+	[CBSIM_RECALL] = "CB_RECALL",
+	[CBSIM_LAYOUTRECALL] = "CB_LAYOUTRECALL",
+	[CBSIM_NOTIFY] = "CB_NOTIFY",
+};
+
+/* Latency histogram buckets, bucket i counts latencies below 2^i us */
+#define CBSIM_LAT_BUCKETS 32
+
+/* Operations in flight beyond which the generator drops new ones */
+#define CBSIM_MAX_INFLIGHT 16384
+
+/* Generator tick */
+#define CBSIM_TICK_MS 10
+
+struct cbsim_op_stats {
+	uint64_t sent;		/*< Queued */
+	uint64_t ok;		/*< Completed with NFS4_OK */
+	uint64_t refused;	/*< Completed with an error from the client */
+	uint64_t failed;	/*< Not sent, or no reply */
+	uint64_t lat_ns;	/*< Total latency of the completed ones */
+	uint64_t max_lat_ns;	/*< Highest latency */
+	uint64_t lat_hist[CBSIM_LAT_BUCKETS];
+};
+
+/**
+ * @brief A fake callback operation in flight
+ */
+struct cbsim_op {
+	struct nfs_cb_batch_op op;	/*< Queued operation */
+	enum cbsim_op_type type;
+	struct timespec start;		/*< When it was queued */
+	char fh[16];			/*< File handle that matches nothing */
+};
+
+static struct cbsim_load {
+	pthread_mutex_t mtx;	/*< Protects everything below */
+	pthread_cond_t cv;	/*< Wakes the generator to stop */
+	pthread_t thread;
+	bool running;		/*< Generator thread started */
+	bool stop;		/*< Generator asked to stop */
+	uint32_t rate;		/*< Operations per second */
+	uint32_t duration;	/*< Seconds to run, 0 until stopped */
+	uint32_t weight[CBSIM_OP_COUNT];	/*< Share of each operation */
+	nfs_client_id_t **clients;	/*< Referenced targets */
+	uint32_t nclients;
+	uint64_t inflight;	/*< Operations not yet completed */
+	uint64_t dropped;	/*< Not sent, too many in flight */
+	struct cbsim_op_stats stats[CBSIM_OP_COUNT];
+} cbsim_load = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.cv = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * @brief Account for a completed fake operation and free it
+ */
+static void cbsim_load_completion(struct nfs_cb_batch_op *op,
+				  rpc_call_hook hook, nfsstat4 status)
+{
+	struct cbsim_op *sop = container_of(op, struct cbsim_op, op);
+	struct cbsim_op_stats *stats = &cbsim_load.stats[sop->type];
+	struct timespec end;
+	nsecs_elapsed_t lat;
+	uint64_t us;
+	int bucket = 0;
+
+	now(&end);
+	lat = timespec_diff(&sop->start, &end);
+
+	for (us = lat / 1000; us != 0 && bucket < CBSIM_LAT_BUCKETS - 1;
+	     us >>= 1)
+		++bucket;
+
+	PTHREAD_MUTEX_lock(&cbsim_load.mtx);
+	if (hook != RPC_CALL_COMPLETE)
+		++stats->failed;
+	else if (status == NFS4_OK)
+		++stats->ok;
+	else
+		++stats->refused;
+	stats->lat_ns += lat;
+	if (lat > stats->max_lat_ns)
+		stats->max_lat_ns = lat;
+	++stats->lat_hist[bucket];
+	--cbsim_load.inflight;
+	PTHREAD_MUTEX_unlock(&cbsim_load.mtx);
+
+	gsh_free(sop);
+}
+
+/**
+ * @brief Build a fake operation of the given type
+ *
+ * CB_LAYOUTRECALL and CB_NOTIFY only exist in v4.1, v4.0 clients get
+ * a CB_RECALL instead.
+ */
+static struct cbsim_op *cbsim_load_op(enum cbsim_op_type type,
+				      nfs_client_id_t *clientid)
+{
+	struct cbsim_op *sop = gsh_calloc(1, sizeof(*sop));
+	nfs_cb_argop4 *arg = &sop->op.arg;
+	stateid4 *stateid;
+
+	if (clientid->cid_minorversion == 0)
+		type = CBSIM_RECALL;
+
+	sop->type = type;
+	memcpy(sop->fh, "cbsim-no-such-fh", sizeof(sop->fh));
+
+	switch (type) {
+	case CBSIM_RECALL:
+		arg->argop = NFS4_OP_CB_RECALL;
+		stateid = &arg->nfs_cb_argop4_u.opcbrecall.stateid;
+		arg->nfs_cb_argop4_u.opcbrecall.fh.nfs_fh4_len =
+		    sizeof(sop->fh);
+		arg->nfs_cb_argop4_u.opcbrecall.fh.nfs_fh4_val = sop->fh;
+		break;
+	case CBSIM_LAYOUTRECALL:
+	{
+		CB_LAYOUTRECALL4args *lr =
+		    &arg->nfs_cb_argop4_u.opcblayoutrecall;
+		layoutrecall_file4 *file =
+		    &lr->clora_recall.layoutrecall4_u.lor_layout;
+
+		arg->argop = NFS4_OP_CB_LAYOUTRECALL;
+		lr->clora_type = LAYOUT4_NFSV4_1_FILES;
+		lr->clora_iomode = LAYOUTIOMODE4_ANY;
+		lr->clora_recall.lor_recalltype = LAYOUTRECALL4_FILE;
+		file->lor_fh.nfs_fh4_len = sizeof(sop->fh);
+		file->lor_fh.nfs_fh4_val = sop->fh;
+		file->lor_length = NFS4_UINT64_MAX;
+		stateid = &file->lor_stateid;
+		break;
+	}
+	default:
+		arg->argop = NFS4_OP_CB_NOTIFY;
+		stateid = &arg->nfs_cb_argop4_u.opcbnotify.cna_stateid;
+		arg->nfs_cb_argop4_u.opcbnotify.cna_fh.nfs_fh4_len =
+		    sizeof(sop->fh);
+		arg->nfs_cb_argop4_u.opcbnotify.cna_fh.nfs_fh4_val = sop->fh;
+		break;
+	}
+
+	stateid->seqid = 0xdeadbeef;
+	memcpy(stateid->other, "cbsimcbsimcb", sizeof(stateid->other));
+
+	sop->op.completion = cbsim_load_completion;
+	return sop;
+}
+
+/**
+ * @brief Pick the type of the next operation from the weights
+ *
+ * Deterministic, so short runs follow the requested mix exactly.
+ */
+static enum cbsim_op_type cbsim_load_pick(uint64_t n)
+{
+	uint32_t total = 0, i;
+	uint64_t at;
+
+	for (i = 0; i < CBSIM_OP_COUNT; i++)
+		total += cbsim_load.weight[i];
+
+	at = n % total;
+	for (i = 0; i < CBSIM_OP_COUNT - 1; i++) {
+		if (at < cbsim_load.weight[i])
+			break;
+		at -= cbsim_load.weight[i];
+	}
+
+	return i;
+}
+
+/**
+ * @brief Send the fake operations due, until stopped or done
+ */
+static void *cbsim_load_thread(void *arg)
+{
+	struct timespec start, cur, wake;
+	uint64_t issued = 0, due;
+	nsecs_elapsed_t elapsed;
+
+	SetNameFunction("cbsim_load");
+
+	now(&start);
+	cur = start;
+	PTHREAD_MUTEX_lock(&cbsim_load.mtx);
+	while (!cbsim_load.stop) {
+		now(&cur);
+		elapsed = timespec_diff(&start, &cur);
+		if (cbsim_load.duration != 0 &&
+		    elapsed >= (nsecs_elapsed_t) cbsim_load.duration *
+			       NS_PER_SEC)
+			break;
+
+		due = elapsed * cbsim_load.rate / NS_PER_SEC;
+		while (issued < due) {
+			nfs_client_id_t *clientid =
+			    cbsim_load.clients[issued % cbsim_load.nclients];
+			struct cbsim_op *sop;
+
+			if (cbsim_load.inflight >= CBSIM_MAX_INFLIGHT) {
+				cbsim_load.dropped += due - issued;
+				issued = due;
+				break;
+			}
+
+			/* Each round over the clients sends one type */
+			sop = cbsim_load_op(
+				cbsim_load_pick(issued / cbsim_load.nclients),
+				clientid);
+			++cbsim_load.stats[sop->type].sent;
+			++cbsim_load.inflight;
+			++issued;
+
+			/* The completion may run before we get it back */
+			PTHREAD_MUTEX_unlock(&cbsim_load.mtx);
+			now(&sop->start);
+			nfs_rpc_cb_batch(clientid, &sop->op);
+			PTHREAD_MUTEX_lock(&cbsim_load.mtx);
+
+			if (cbsim_load.stop)
+				break;
+		}
+
+		clock_gettime(CLOCK_REALTIME, &wake);
+		timespec_addms(&wake, CBSIM_TICK_MS);
+		(void) pthread_cond_timedwait(&cbsim_load.cv, &cbsim_load.mtx,
+					      &wake);
+	}
+	/* Done, the clients are released by the next stop or start */
+	cbsim_load.stop = true;
+	PTHREAD_MUTEX_unlock(&cbsim_load.mtx);
+
+	LogEvent(COMPONENT_NFS_CB,
+		 "Callback load sent %" PRIu64 " operations in %" PRIu64
+		 " ms", issued, timespec_diff(&start, &cur) / NS_PER_MSEC);
+
+	return NULL;
+}
+
+/**
+ * @brief Take a reference on up to max confirmed clients
+ *
+ * @return The number of clients taken.
+ */
+static uint32_t cbsim_load_clients(uint32_t max)
+{
+	hash_table_t *ht = ht_confirmed_client_id;
+	struct rbt_head *head_rbt;
+	struct hash_data *pdata;
+	struct rbt_node *pn;
+	nfs_client_id_t *clientid;
+	uint32_t i, n = 0, size = 64;
+	size_t elt = sizeof(nfs_client_id_t *);
+
+	cbsim_load.clients = gsh_malloc(size * elt);
+
+	for (i = 0; i < ht->parameter.index_size && n < max; i++) {
+		head_rbt = &ht->partitions[i].rbt;
+
+		PTHREAD_RWLOCK_rdlock(&ht->partitions[i].lock);
+		RBT_LOOP(head_rbt, pn) {
+			if (n == max)
+				break;
+			pdata = RBT_OPAQ(pn);
+			clientid = pdata->val.addr;
+			RBT_INCREMENT(pn);
+
+			if (clientid->cid_confirmed != CONFIRMED_CLIENT_ID)
+				continue;
+
+			if (n == size) {
+				size *= 2;
+				cbsim_load.clients =
+				    gsh_realloc(cbsim_load.clients,
+						size * elt);
+			}
+			inc_client_id_ref(clientid);
+			cbsim_load.clients[n++] = clientid;
+		}
+		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
+	}
+
+	cbsim_load.nclients = n;
+	return n;
+}
+
+/**
+ * @brief Stop the generator and release its clients
+ *
+ * Operations in flight complete on their own.
+ */
+static void cbsim_load_stop(void)
+{
+	uint32_t i;
+
+	PTHREAD_MUTEX_lock(&cbsim_load.mtx);
+	if (!cbsim_load.running) {
+		PTHREAD_MUTEX_unlock(&cbsim_load.mtx);
+		return;
+	}
+	cbsim_load.stop = true;
+	pthread_cond_signal(&cbsim_load.cv);
+	PTHREAD_MUTEX_unlock(&cbsim_load.mtx);
+
+	(void) pthread_join(cbsim_load.thread, NULL);
+
+	for (i = 0; i < cbsim_load.nclients; i++)
+		dec_client_id_ref(cbsim_load.clients[i]);
+	gsh_free(cbsim_load.clients);
+	cbsim_load.clients = NULL;
+	cbsim_load.nclients = 0;
+
+	PTHREAD_MUTEX_lock(&cbsim_load.mtx);
+	cbsim_load.running = false;
+	PTHREAD_MUTEX_unlock(&cbsim_load.mtx);
+}
+
+/**
+ * @brief Start sending fake callbacks
+ *
+ * A run already going is stopped first, and the statistics reset.
+ *
+ * @param args  rate (ops/s), duration (s, 0 until stop_load), the
+ *              weights of CB_RECALL, CB_LAYOUTRECALL and CB_NOTIFY,
+ *              and the most clients to call (0 for all)
+ * @param reply status
+ */
+static bool nfs_rpc_cbsim_start_load(DBusMessageIter *args,
+				     DBusMessage *reply,
+				     DBusError *error)
+{
+	char *errormsg = "Callback load started";
+	bool success = true;
+	DBusMessageIter iter;
+	uint32_t param[3 + CBSIM_OP_COUNT];
+	uint32_t i, total = 0;
+	int rc;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	for (i = 0; i < sizeof(param) / sizeof(param[0]); i++) {
+		if (args == NULL ||
+		    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+			errormsg = "start_load takes 6 uint32 arguments";
+			success = false;
+			goto out;
+		}
+		dbus_message_iter_get_basic(args, &param[i]);
+		dbus_message_iter_next(args);
+	}
+
+	for (i = 0; i < CBSIM_OP_COUNT; i++)
+		total += param[2 + i];
+
+	if (param[0] == 0 || total == 0) {
+		errormsg = "rate and at least one weight must be set";
+		success = false;
+		goto out;
+	}
+
+	cbsim_load_stop();
+
+	if (cbsim_load_clients(param[5] != 0 ? param[5] : UINT32_MAX)
+	    == 0) {
+		gsh_free(cbsim_load.clients);
+		cbsim_load.clients = NULL;
+		errormsg = "No confirmed clients to call";
+		success = false;
+		goto out;
+	}
+
+	PTHREAD_MUTEX_lock(&cbsim_load.mtx);
+	cbsim_load.rate = param[0];
+	cbsim_load.duration = param[1];
+	for (i = 0; i < CBSIM_OP_COUNT; i++)
+		cbsim_load.weight[i] = param[2 + i];
+	memset(cbsim_load.stats, 0, sizeof(cbsim_load.stats));
+	cbsim_load.dropped = 0;
+	cbsim_load.stop = false;
+	cbsim_load.running = true;
+
+	rc = pthread_create(&cbsim_load.thread, NULL, cbsim_load_thread,
+			    NULL);
+	if (rc != 0)
+		cbsim_load.running = false;
+	PTHREAD_MUTEX_unlock(&cbsim_load.mtx);
+
+	if (rc != 0) {
+		for (i = 0; i < cbsim_load.nclients; i++)
+			dec_client_id_ref(cbsim_load.clients[i]);
+		gsh_free(cbsim_load.clients);
+		cbsim_load.clients = NULL;
+		cbsim_load.nclients = 0;
+		errormsg = "Could not start the load thread";
+		success = false;
+		goto out;
+	}
+
+	LogEvent(COMPONENT_NFS_CB,
+		 "Callback load: %" PRIu32 " ops/s to %" PRIu32
+		 " clients, mix %" PRIu32 "/%" PRIu32 "/%" PRIu32,
+		 param[0], cbsim_load.nclients, param[2], param[3], param[4]);
+
+ out:
+	if (!success)
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+	dbus_status_reply(&iter, success, errormsg);
+	return success;
+}
+
+static struct gsh_dbus_method cbsim_start_load = {
+	.name = "start_load",
+	.method = nfs_rpc_cbsim_start_load,
+	.args = {
+		 {
+		  .name = "rate",
+		  .type = "u",
+		  .direction = "in"},
+		 {
+		  .name = "duration",
+		  .type = "u",
+		  .direction = "in"},
+		 {
+		  .name = "recall_weight",
+		  .type = "u",
+		  .direction = "in"},
+		 {
+		  .name = "layoutrecall_weight",
+		  .type = "u",
+		  .direction = "in"},
+		 {
+		  .name = "notify_weight",
+		  .type = "u",
+		  .direction = "in"},
+		 {
+		  .name = "max_clients",
+		  .type = "u",
+		  .direction = "in"},
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * @brief Stop sending fake callbacks
+ *
+ * @param args  (not used)
+ * @param reply status
+ */
+static bool nfs_rpc_cbsim_stop_load(DBusMessageIter *args,
+				    DBusMessage *reply,
+				    DBusError *error)
+{
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	cbsim_load_stop();
+	dbus_status_reply(&iter, true, "Callback load stopped");
+	return true;
+}
+
+static struct gsh_dbus_method cbsim_stop_load = {
+	.name = "stop_load",
+	.method = nfs_rpc_cbsim_stop_load,
+	.args = {
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * @brief Latency below which a share of the operations completed
+ *
+ * @return The upper bound of the histogram bucket, in us.
+ */
+static uint64_t cbsim_load_pct(const struct cbsim_op_stats *stats,
+			       uint64_t done, uint32_t pct)
+{
+	uint64_t want = (done * pct + 99) / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < CBSIM_LAT_BUCKETS; i++) {
+		seen += stats->lat_hist[i];
+		if (seen >= want)
+			break;
+	}
+
+	return (uint64_t) 1 << i;
+}
+
+/**
+ * @brief Report the callback load statistics
+ *
+ * @param args  (not used)
+ * @param reply timestamp, whether the generator runs, the operations
+ *              in flight and dropped, one entry per operation (name,
+ *              sent, ok, refused, failed, average, p50, p99 and max
+ *              latency in us), and the back channel slot statistics
+ *              (found, busy, waited, missed, average and max wait
+ *              in us)
+ */
+static bool nfs_rpc_cbsim_get_load_stats(DBusMessageIter *args,
+					 DBusMessage *reply,
+					 DBusError *error)
+{
+	struct cbsim_op_stats stats[CBSIM_OP_COUNT];
+	struct nfs_cb_slot_stats slots;
+	DBusMessageIter iter, array_iter, struct_iter;
+	struct timespec ts;
+	dbus_bool_t running;
+	uint64_t inflight, dropped, done, val;
+	double avg;
+	const char *name;
+	int i;
+
+	PTHREAD_MUTEX_lock(&cbsim_load.mtx);
+	running = cbsim_load.running && !cbsim_load.stop;
+	inflight = cbsim_load.inflight;
+	dropped = cbsim_load.dropped;
+	memcpy(stats, cbsim_load.stats, sizeof(stats));
+	PTHREAD_MUTEX_unlock(&cbsim_load.mtx);
+
+	nfs_rpc_cb_slot_stats(&slots);
+
+	now(&ts);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_append_timestamp(&iter, &ts);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_BOOLEAN, &running);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT64, &inflight);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT64, &dropped);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 "(sttttdttt)", &array_iter);
+	for (i = 0; i < CBSIM_OP_COUNT; i++) {
+		done = stats[i].ok + stats[i].refused + stats[i].failed;
+		name = cbsim_op_names[i];
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].sent);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].ok);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].refused);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].failed);
+		avg = done ? (double) stats[i].lat_ns / done / 1000 : 0;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+					       &avg);
+		val = done ? cbsim_load_pct(&stats[i], done, 50) : 0;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = done ? cbsim_load_pct(&stats[i], done, 99) : 0;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = stats[i].max_lat_ns / 1000;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(&iter, &array_iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &slots.found);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &slots.busy);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &slots.waited);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &slots.missed);
+	done = slots.waited + slots.missed;
+	avg = done ? (double) slots.wait_ns / done / 1000 : 0;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE, &avg);
+	val = slots.max_wait_ns / 1000;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	dbus_message_iter_close_container(&iter, &struct_iter);
+
+	return true;
+}
+
+static struct gsh_dbus_method cbsim_get_load_stats = {
+	.name = "get_load_stats",
+	.method = nfs_rpc_cbsim_get_load_stats,
+	.args = {
+		 {
+		  .name = "time",
+		  .type = "(tt)",
+		  .direction = "out"},
+		 {
+		  .name = "running",
+		  .type = "b",
+		  .direction = "out"},
+		 {
+		  .name = "inflight",
+		  .type = "t",
+		  .direction = "out"},
+		 {
+		  .name = "dropped",
+		  .type = "t",
+		  .direction = "out"},
+		 {
+		  .name = "ops",
+		  .type = "a(sttttdttt)",
+		  .direction = "out"},
+		 {
+		  .name = "slots",
+		  .type = "(ttttdt)",
+		  .direction = "out"},
+		 {NULL, NULL, NULL}
+		 }
+};
+
 /* DBUS org.ganesha.nfsd.cbsim methods list
  */
 
@@ -426,6 +1071,9 @@ static struct gsh_dbus_method *cbsim_methods[] = {
 	&cbsim_get_client_ids,
 	&cbsim_get_session_ids,
 	&cbsim_fake_recall,
+	&cbsim_start_load,
+	&cbsim_stop_load,
+	&cbsim_get_load_stats,
 	NULL
 };
 
@@ -458,5 +1106,5 @@ void nfs_rpc_cbsim_pkginit(void)
  */
 void nfs_rpc_cbsim_pkgshutdown(void)
 {
-	/* return */
+	cbsim_load_stop();
 }
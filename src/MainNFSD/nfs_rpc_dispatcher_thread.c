@@ -32,12 +32,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
 #include <fcntl.h>
 #include <sys/file.h>		/* for having FNDELAY */
 #include <sys/select.h>
 #include <poll.h>
 #ifdef RPC_VSOCK
 #include <sys/types.h>
+#include <sys/param.h>
 #include <sys/socket.h>
 #include <linux/vm_sockets.h>
 #endif
@@ -46,6 +48,7 @@
 #include <assert.h>
 #include "hashtable.h"
 #include "log.h"
+#include "config_parsing.h"
 #include "gsh_rpc.h"
 #include "abstract_atomic.h"
 #include "nfs23.h"
@@ -59,9 +62,14 @@
 #include "nfs_exports.h"
 #include "nfs_proto_functions.h"
 #include "nfs_req_queue.h"
+#include "nfs_numa.h"
 #include "nfs_dupreq.h"
 #include "nfs_file_handle.h"
 #include "fridgethr.h"
+#include "delayed_exec.h"
+#include "client_mgr.h"
+#include "export_mgr.h"
+#include "gsh_qos.h"
 
 #define NFS_pcp nfs_param.core_param
 #define NFS_options NFS_pcp.core_options
@@ -75,16 +83,23 @@
 struct rpc_evchan {
 	uint32_t chan_id;	/*< Channel ID */
 	pthread_t thread_id;	/*< POSIX thread ID */
+	uint32_t nxprts;	/*< TCP connections registered */
 };
 
-#define N_TCP_EVENT_CHAN  3	/*< We don't really want to have too many,
-				   relative to the number of available cores. */
 #define UDP_EVENT_CHAN    0	/*< Put UDP on a dedicated channel */
 #define TCP_RDVS_CHAN     1	/*< Accepts new tcp connections */
 #define TCP_EVCHAN_0      2
-#define N_EVENT_CHAN (N_TCP_EVENT_CHAN + 2)
+#define TCP_EVCHAN_CPUS   4	/*< Online CPUs per TCP channel by default */
+#define TCP_EVCHAN_MIN    3	/*< Fewest TCP channels by default */
 
-static struct rpc_evchan rpc_evchan[N_EVENT_CHAN];
+#define GSS_CTX_PER_PART  128	/*< GSS contexts per partition by default */
+#define GSS_NPART_MIN     13
+#define GSS_NPART_MAX     1021
+
+static struct rpc_evchan *rpc_evchan;
+static uint32_t n_tcp_event_chan;	/*< TCP connection channels */
+static uint32_t udp_evchan_0;		/*< First extra UDP socket channel */
+static uint32_t n_event_chan;		/*< All channels */
 
 struct fridgethr *req_fridge;	/*< Decoder thread pool */
 struct nfs_req_st nfs_req_st;	/*< Shared request queues */
@@ -151,6 +166,12 @@ struct netconfig *netconfig_tcpv6;
 /* RPC Service Sockets and Transports */
 int udp_socket[P_COUNT];
 int tcp_socket[P_COUNT];
+
+/* With RPC_Listen_Reuseport, one more TCP listener per TCP event
+ * channel */
+static int *tcp_rp_socket[P_COUNT];
+/* With RPC_UDP_Sockets above 1, the extra SO_REUSEPORT UDP sockets */
+static int *udp_rp_socket[P_COUNT];
 SVCXPRT *udp_xprt[P_COUNT];
 SVCXPRT *tcp_xprt[P_COUNT];
 
@@ -243,76 +264,143 @@ static inline bool nfs_protocol_enabled(protos p)
 static void close_rpc_fd(void)
 {
 	protos p;
+	uint32_t ix;
 
 	for (p = P_NFS; p < P_COUNT; p++) {
 		if (udp_socket[p] != -1)
 			close(udp_socket[p]);
 		if (tcp_socket[p] != -1)
 			close(tcp_socket[p]);
+		if (tcp_rp_socket[p] == NULL)
+			continue;
+		for (ix = 0; ix < n_tcp_event_chan; ++ix)
+			if (tcp_rp_socket[p][ix] != -1)
+				close(tcp_rp_socket[p][ix]);
+	}
+	for (p = P_NFS; p < P_COUNT; p++) {
+		if (udp_rp_socket[p] == NULL)
+			continue;
+		for (ix = 0; ix + 1 < nfs_param.core_param.rpc.udp_sockets;
+		     ++ix)
+			if (udp_rp_socket[p][ix] != -1)
+				close(udp_rp_socket[p][ix]);
 	}
 	if (vsock)
 		close(tcp_socket[P_NFS_VSOCK]);
 }
 
-void Create_udp(protos prot)
+/**
+ * @brief Create a UDP SVCXPRT
+ *
+ * @param[in] prot Protocol
+ * @param[in] fd   Bound socket
+ * @param[in] chan Event channel that serves it
+ * @param[in] drc  Index of the shared DRC its requests use
+ *
+ * @return The transport.
+ */
+static SVCXPRT *create_udp_xprt(protos prot, int fd, uint32_t chan,
+				uint32_t drc)
 {
-	udp_xprt[prot] =
-	    svc_dg_create(udp_socket[prot],
+	SVCXPRT *xprt =
+	    svc_dg_create(fd,
 			  nfs_param.core_param.rpc.max_send_buffer_size,
 			  nfs_param.core_param.rpc.max_recv_buffer_size);
-	if (udp_xprt[prot] == NULL)
+	if (xprt == NULL)
 		LogFatal(COMPONENT_DISPATCH, "Cannot allocate %s/UDP SVCXPRT",
 			 tags[prot]);
 
 	/* Hook xp_getreq */
-	(void)SVC_CONTROL(udp_xprt[prot], SVCSET_XP_GETREQ, nfs_rpc_getreq_ng);
+	(void)SVC_CONTROL(xprt, SVCSET_XP_GETREQ, nfs_rpc_getreq_ng);
 
 	/* Hook xp_free_user_data (finalize/free private data) */
-	(void)SVC_CONTROL(udp_xprt[prot], SVCSET_XP_FREE_USER_DATA,
+	(void)SVC_CONTROL(xprt, SVCSET_XP_FREE_USER_DATA,
 			  nfs_rpc_free_user_data);
 
 	/* Setup private data */
-	(udp_xprt[prot])->xp_u1 =
-		alloc_gsh_xprt_private(udp_xprt[prot],
-				       XPRT_PRIVATE_FLAG_NONE);
+	xprt->xp_u1 = alloc_gsh_xprt_private(xprt, XPRT_PRIVATE_FLAG_NONE);
+	((gsh_xprt_private_t *) xprt->xp_u1)->udp_drc = drc;
 
 	/* bind xprt to channel--unregister it from the global event
 	 * channel (if applicable) */
-	(void)svc_rqst_evchan_reg(rpc_evchan[UDP_EVENT_CHAN].chan_id,
-				  udp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
+	(void)svc_rqst_evchan_reg(rpc_evchan[chan].chan_id,
+				  xprt, SVC_RQST_FLAG_XPRT_UREG);
+
+	return xprt;
 }
 
-void Create_tcp(protos prot)
+void Create_udp(protos prot)
+{
+	uint32_t ix;
+
+	udp_xprt[prot] = create_udp_xprt(prot, udp_socket[prot],
+					 UDP_EVENT_CHAN, 0);
+
+	/* the extra sockets each have a channel and DRC of their own */
+	if (udp_rp_socket[prot] == NULL)
+		return;
+
+	for (ix = 0; ix + 1 < nfs_param.core_param.rpc.udp_sockets; ++ix)
+		(void) create_udp_xprt(prot, udp_rp_socket[prot][ix],
+				       udp_evchan_0 + ix, ix + 1);
+}
+
+/**
+ * @brief Create a listening TCP SVCXPRT
+ *
+ * @param[in] prot Protocol
+ * @param[in] fd   Bound socket
+ * @param[in] chan Event channel that accepts its connections
+ *
+ * @return The transport.
+ */
+static SVCXPRT *create_tcp_listener(protos prot, int fd, uint32_t chan)
 {
-	tcp_xprt[prot] =
-		svc_vc_ncreatef(tcp_socket[prot],
+	SVCXPRT *xprt =
+		svc_vc_ncreatef(fd,
 				nfs_param.core_param.rpc.max_send_buffer_size,
 				nfs_param.core_param.rpc.max_recv_buffer_size,
 				SVC_CREATE_FLAG_CLOSE | SVC_CREATE_FLAG_LISTEN);
-	if (tcp_xprt[prot] == NULL)
+	if (xprt == NULL)
 		LogFatal(COMPONENT_DISPATCH, "Cannot allocate %s/TCP SVCXPRT",
 			 tags[prot]);
 
 	/* bind xprt to channel--unregister it from the global event
 	 * channel (if applicable) */
-	(void)svc_rqst_evchan_reg(rpc_evchan[TCP_RDVS_CHAN].chan_id,
-				  tcp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
+	(void)svc_rqst_evchan_reg(rpc_evchan[chan].chan_id,
+				  xprt, SVC_RQST_FLAG_XPRT_UREG);
 
 	/* Hook xp_getreq */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_GETREQ, nfs_rpc_getreq_ng);
+	(void)SVC_CONTROL(xprt, SVCSET_XP_GETREQ, nfs_rpc_getreq_ng);
 
 	/* Hook xp_recv_user_data -- allocate new xprts to event channels */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_RECV_USER_DATA,
+	(void)SVC_CONTROL(xprt, SVCSET_XP_RECV_USER_DATA,
 			  nfs_rpc_recv_user_data);
 
 	/* Hook xp_free_user_data (finalize/free private data) */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_FREE_USER_DATA,
+	(void)SVC_CONTROL(xprt, SVCSET_XP_FREE_USER_DATA,
 			  nfs_rpc_free_user_data);
 
 	/* Setup private data */
-	(tcp_xprt[prot])->xp_u1 =
-		alloc_gsh_xprt_private(tcp_xprt[prot],
-				       XPRT_PRIVATE_FLAG_NONE);
+	xprt->xp_u1 = alloc_gsh_xprt_private(xprt, XPRT_PRIVATE_FLAG_NONE);
+
+	return xprt;
+}
+
+void Create_tcp(protos prot)
+{
+	uint32_t ix;
+
+	tcp_xprt[prot] = create_tcp_listener(prot, tcp_socket[prot],
+					     TCP_RDVS_CHAN);
+
+	/* the extra listeners accept on their own channels */
+	if (tcp_rp_socket[prot] == NULL)
+		return;
+
+	for (ix = 0; ix < n_tcp_event_chan; ++ix)
+		(void) create_tcp_listener(prot, tcp_rp_socket[prot][ix],
+					   TCP_EVCHAN_0 + ix);
 }
 
 void create_vsock(void)
@@ -568,6 +656,55 @@ int bind_sockets_vsock(void)
 }
 #endif /* RPC_VSOCK */
 
+/**
+ * @brief Bind the SO_REUSEPORT listeners to their protocol's address
+ *
+ * Must follow Bind_sockets_V4 or Bind_sockets_V6, which fill in the
+ * address.
+ */
+static int bind_sockets_reuseport(void)
+{
+	protos p;
+	uint32_t ix;
+
+	for (p = P_NFS; p < P_COUNT; p++) {
+		proto_data *pdatap = &pdata[p];
+
+		if (udp_rp_socket[p] == NULL)
+			goto tcp;
+
+		for (ix = 0; ix + 1 < nfs_param.core_param.rpc.udp_sockets;
+		     ++ix) {
+			if (bind(udp_rp_socket[p][ix],
+				 (struct sockaddr *)
+				 pdatap->bindaddr_udp6.addr.buf,
+				 (socklen_t) pdatap->si_udp6.si_alen) == -1) {
+				LogWarn(COMPONENT_DISPATCH,
+					"Cannot bind %s reuseport udp socket, error %d(%s)",
+					tags[p], errno, strerror(errno));
+				return -1;
+			}
+		}
+tcp:
+		if (tcp_rp_socket[p] == NULL)
+			continue;
+
+		for (ix = 0; ix < n_tcp_event_chan; ++ix) {
+			if (bind(tcp_rp_socket[p][ix],
+				 (struct sockaddr *)
+				 pdatap->bindaddr_tcp6.addr.buf,
+				 (socklen_t) pdatap->si_tcp6.si_alen) == -1) {
+				LogWarn(COMPONENT_DISPATCH,
+					"Cannot bind %s reuseport tcp socket, error %d(%s)",
+					tags[p], errno, strerror(errno));
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
 void Bind_sockets(void)
 {
 	int rc = 0;
@@ -587,6 +724,9 @@ void Bind_sockets(void)
 			LogFatal(COMPONENT_DISPATCH,
 				 "Error binding to V6 interface. Cannot continue.");
 	}
+	if (bind_sockets_reuseport())
+		LogFatal(COMPONENT_DISPATCH,
+			 "Error binding reuseport listeners. Cannot continue.");
 #ifdef RPC_VSOCK
 	if (vsock) {
 		rc = bind_sockets_vsock();
@@ -601,28 +741,17 @@ void Bind_sockets(void)
 }
 
 /**
- * @brief Function to set the socket options on the allocated
- *	  udp and tcp sockets
+ * @brief Set the socket options of a TCP listener
  *
+ * @param[in] p  Protocol
+ * @param[in] fd Socket
  */
-static int alloc_socket_setopts(int p)
+static int tcp_socket_setopts(int p, int fd)
 {
 	int one = 1;
 	const struct nfs_core_param *nfs_cp = &nfs_param.core_param;
 
-	/* Use SO_REUSEADDR in order to avoid wait
-	 * the 2MSL timeout */
-	if (setsockopt(udp_socket[p],
-		       SOL_SOCKET, SO_REUSEADDR,
-		       &one, sizeof(one))) {
-		LogWarn(COMPONENT_DISPATCH,
-			"Bad udp socket options for %s, error %d(%s)",
-			tags[p], errno, strerror(errno));
-
-		return -1;
-	}
-
-	if (setsockopt(tcp_socket[p],
+	if (setsockopt(fd,
 		       SOL_SOCKET, SO_REUSEADDR,
 		       &one, sizeof(one))) {
 		LogWarn(COMPONENT_DISPATCH,
@@ -633,7 +762,7 @@ static int alloc_socket_setopts(int p)
 	}
 
 	if (nfs_cp->enable_tcp_keepalive) {
-		if (setsockopt(tcp_socket[p],
+		if (setsockopt(fd,
 			       SOL_SOCKET, SO_KEEPALIVE,
 			       &one, sizeof(one))) {
 			LogWarn(COMPONENT_DISPATCH,
@@ -644,7 +773,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepcnt) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP, TCP_KEEPCNT,
+			if (setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT,
 				       &nfs_cp->tcp_keepcnt,
 				       sizeof(nfs_cp->tcp_keepcnt))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -656,7 +785,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepidle) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP, TCP_KEEPIDLE,
+			if (setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE,
 				       &nfs_cp->tcp_keepidle,
 				       sizeof(nfs_cp->tcp_keepidle))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -668,7 +797,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepintvl) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP,
+			if (setsockopt(fd, IPPROTO_TCP,
 				       TCP_KEEPINTVL, &nfs_cp->tcp_keepintvl,
 				       sizeof(nfs_cp->tcp_keepintvl))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -680,9 +809,54 @@ static int alloc_socket_setopts(int p)
 		}
 	}
 
+	/* every listener on the port must set SO_REUSEPORT */
+	if (nfs_cp->rpc.listen_reuseport &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Bad tcp socket option reuseport for %s, error %d(%s)",
+			tags[p], errno, strerror(errno));
+
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Set the socket options of a UDP socket
+ *
+ * @param[in] p  Protocol
+ * @param[in] fd Socket
+ */
+static int udp_socket_setopts(int p, int fd)
+{
+	int one = 1;
+
+	/* Use SO_REUSEADDR in order to avoid wait
+	 * the 2MSL timeout */
+	if (setsockopt(fd,
+		       SOL_SOCKET, SO_REUSEADDR,
+		       &one, sizeof(one))) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Bad udp socket options for %s, error %d(%s)",
+			tags[p], errno, strerror(errno));
+
+		return -1;
+	}
+
+	/* every socket on the port must set SO_REUSEPORT */
+	if (nfs_param.core_param.rpc.udp_sockets > 1 &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Bad udp socket option reuseport for %s, error %d(%s)",
+			tags[p], errno, strerror(errno));
+
+		return -1;
+	}
+
 	/* We prefer using non-blocking socket
 	 * in the specific case */
-	if (fcntl(udp_socket[p], F_SETFL, FNDELAY) == -1) {
+	if (fcntl(fd, F_SETFL, FNDELAY) == -1) {
 		LogWarn(COMPONENT_DISPATCH,
 			"Cannot set udp socket for %s as non blocking, error %d(%s)",
 			tags[p], errno, strerror(errno));
@@ -693,6 +867,22 @@ static int alloc_socket_setopts(int p)
 	return 0;
 }
 
+/**
+ * @brief Function to set the socket options on the allocated
+ *	  udp and tcp sockets
+ *
+ */
+static int alloc_socket_setopts(int p)
+{
+	if (udp_socket_setopts(p, udp_socket[p]))
+		return -1;
+
+	if (tcp_socket_setopts(p, tcp_socket[p]))
+		return -1;
+
+	return 0;
+}
+
 /**
  * @brief Allocate the tcp and udp sockets for the nfs daemon
  * using V4 interfaces
@@ -760,6 +950,61 @@ static int allocate_socket_vsock(void)
 }
 #endif /* RPC_VSOCK */
 
+/**
+ * @brief Allocate the extra SO_REUSEPORT UDP sockets of a protocol
+ *
+ * @param[in] p Protocol, whose main sockets are allocated
+ */
+static void allocate_udp_sockets_reuseport(int p)
+{
+	uint32_t n = nfs_param.core_param.rpc.udp_sockets - 1;
+	uint32_t ix;
+
+	udp_rp_socket[p] = gsh_malloc(n * sizeof(int));
+
+	for (ix = 0; ix < n; ++ix) {
+		udp_rp_socket[p][ix] = socket(v6disabled ? AF_INET : AF_INET6,
+					      SOCK_DGRAM,
+					      IPPROTO_UDP);
+		if (udp_rp_socket[p][ix] == -1)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot allocate a reuseport udp socket for %s, error %d(%s)",
+				 tags[p], errno, strerror(errno));
+
+		if (udp_socket_setopts(p, udp_rp_socket[p][ix]))
+			LogFatal(COMPONENT_DISPATCH,
+				 "Error setting socket option for proto %d, %s",
+				 p, tags[p]);
+	}
+}
+
+/**
+ * @brief Allocate the SO_REUSEPORT listeners of a protocol
+ *
+ * @param[in] p Protocol, whose main sockets are allocated
+ */
+static void allocate_sockets_reuseport(int p)
+{
+	uint32_t ix;
+
+	tcp_rp_socket[p] = gsh_malloc(n_tcp_event_chan * sizeof(int));
+
+	for (ix = 0; ix < n_tcp_event_chan; ++ix) {
+		tcp_rp_socket[p][ix] = socket(v6disabled ? AF_INET : AF_INET6,
+					      SOCK_STREAM,
+					      IPPROTO_TCP);
+		if (tcp_rp_socket[p][ix] == -1)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot allocate a reuseport tcp socket for %s, error %d(%s)",
+				 tags[p], errno, strerror(errno));
+
+		if (tcp_socket_setopts(p, tcp_rp_socket[p][ix]))
+			LogFatal(COMPONENT_DISPATCH,
+				 "Error setting socket option for proto %d, %s",
+				 p, tags[p]);
+	}
+}
+
 /**
  * @brief Allocate the tcp and udp sockets for the nfs daemon
  */
@@ -839,6 +1084,12 @@ try_V4:
 					 "Error setting socket option for proto %d, %s",
 					 p, tags[p]);
 			}
+
+			if (nfs_param.core_param.rpc.listen_reuseport)
+				allocate_sockets_reuseport(p);
+
+			if (nfs_param.core_param.rpc.udp_sockets > 1)
+				allocate_udp_sockets_reuseport(p);
 		}
 	}
 #ifdef RPC_VSOCK
@@ -916,10 +1167,10 @@ tirpc_pkg_params ntirpc_pp = {
 	0,
 	(mem_format_t)rpc_warnx,
 	gsh_free_size,
-	gsh_malloc__,
-	gsh_malloc_aligned__,
-	gsh_calloc__,
-	gsh_realloc__,
+	mem_arena_rpc_malloc__,
+	mem_arena_rpc_malloc_aligned__,
+	mem_arena_rpc_calloc__,
+	mem_arena_rpc_realloc__,
 };
 
 /**
@@ -972,6 +1223,18 @@ void nfs_Init_svc(void)
 	/* GSS ctx cache tuning, expiration */
 	svc_params.gss_ctx_hash_partitions =
 		nfs_param.core_param.rpc.gss.ctx_hash_partitions;
+	if (svc_params.gss_ctx_hash_partitions == 0) {
+		uint32_t npart = MAX(nfs_param.core_param.rpc.gss.max_ctx /
+				     GSS_CTX_PER_PART, GSS_NPART_MIN);
+
+		while (npart < GSS_NPART_MAX && !is_prime(npart))
+			++npart;
+		svc_params.gss_ctx_hash_partitions = MIN(npart,
+							 GSS_NPART_MAX);
+		LogInfo(COMPONENT_DISPATCH,
+			"Using %" PRIu32 " GSS context partitions",
+			svc_params.gss_ctx_hash_partitions);
+	}
 	svc_params.gss_max_ctx =
 		nfs_param.core_param.rpc.gss.max_ctx;
 	svc_params.gss_max_gc =
@@ -981,7 +1244,23 @@ void nfs_Init_svc(void)
 	if (!svc_init(&svc_params))
 		LogFatal(COMPONENT_INIT, "SVC initialization failed");
 
-	for (ix = 0; ix < N_EVENT_CHAN; ++ix) {
+	n_tcp_event_chan = nfs_param.core_param.rpc.tcp_event_chans;
+	if (n_tcp_event_chan == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+		n_tcp_event_chan = MAX(ncpu / TCP_EVCHAN_CPUS, TCP_EVCHAN_MIN);
+	}
+	/* the extra UDP sockets follow the TCP channels */
+	udp_evchan_0 = TCP_EVCHAN_0 + n_tcp_event_chan;
+	n_event_chan = udp_evchan_0 + nfs_param.core_param.rpc.udp_sockets - 1;
+	rpc_evchan = gsh_calloc(n_event_chan, sizeof(struct rpc_evchan));
+
+	LogInfo(COMPONENT_DISPATCH,
+		"Using %" PRIu32 " TCP event channel(s), %" PRIu32
+		" UDP socket(s) per protocol",
+		n_tcp_event_chan, nfs_param.core_param.rpc.udp_sockets);
+
+	for (ix = 0; ix < n_event_chan; ++ix) {
 		rpc_evchan[ix].chan_id = 0;
 		code = svc_rqst_new_evchan(&rpc_evchan[ix].chan_id,
 					   NULL /* u_data */,
@@ -1134,7 +1413,7 @@ void nfs_rpc_dispatch_threads(pthread_attr_t *attr_thr)
 	int ix, code = 0;
 
 	/* Start event channel service threads */
-	for (ix = 0; ix < N_EVENT_CHAN; ++ix) {
+	for (ix = 0; ix < n_event_chan; ++ix) {
 		code = pthread_create(&rpc_evchan[ix].thread_id, attr_thr,
 				      rpc_dispatcher_thread,
 				      (void *)&rpc_evchan[ix].chan_id);
@@ -1144,27 +1423,31 @@ void nfs_rpc_dispatch_threads(pthread_attr_t *attr_thr)
 				 ix, errno, strerror(errno));
 	}
 	LogInfo(COMPONENT_THREAD,
-		"%d rpc dispatcher threads were started successfully",
-		N_EVENT_CHAN);
+		"%" PRIu32 " rpc dispatcher threads were started successfully",
+		n_event_chan);
 }
 
 void nfs_rpc_dispatch_stop(void)
 {
 	int ix;
 
-	for (ix = 0; ix < N_EVENT_CHAN; ++ix) {
+	for (ix = 0; ix < n_event_chan; ++ix) {
 		svc_rqst_thrd_signal(rpc_evchan[ix].chan_id,
 				     SVC_RQST_SIGNAL_SHUTDOWN);
 	}
 }
 
+/* Accepted TCP connections, see nfs_rpc_reclaim_idle() */
+static struct glist_head nfs_rpc_conns = GLIST_HEAD_INIT(nfs_rpc_conns);
+static pthread_mutex_t nfs_rpc_conns_mtx = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * @brief Rendezvous callout.  This routine will be called by TI-RPC
  *        after newxprt has been accepted.
  *
- * Register newxprt on a TCP event channel.  Balancing events/channels
- * could become involved.  To start with, just cycle through them as
- * new connections are accepted.
+ * Register newxprt on the TCP event channel serving the fewest
+ * connections.  The scan starts one channel further each time, so
+ * that ties are spread.
  *
  * @param[in] xprt    Transport
  * @param[in] newxprt Newly created transport
@@ -1176,32 +1459,139 @@ void nfs_rpc_dispatch_stop(void)
 static u_int nfs_rpc_recv_user_data(SVCXPRT *xprt, SVCXPRT *newxprt,
 				    const u_int flags, void *u_data)
 {
-	static uint32_t next_chan = TCP_EVCHAN_0;
+	static uint32_t next_chan;
 	static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
-	uint32_t tchan;
+	uint32_t tchan, ix, chan;
 
 	PTHREAD_MUTEX_lock(&mtx);
 
-	tchan = next_chan;
-	assert((next_chan >= TCP_EVCHAN_0) && (next_chan < N_EVENT_CHAN));
-	if (++next_chan >= N_EVENT_CHAN)
-		next_chan = TCP_EVCHAN_0;
+	tchan = TCP_EVCHAN_0 + next_chan;
+	for (ix = 1; ix < n_tcp_event_chan; ++ix) {
+		chan = TCP_EVCHAN_0 + (next_chan + ix) % n_tcp_event_chan;
+		if (atomic_fetch_uint32_t(&rpc_evchan[chan].nxprts) <
+		    atomic_fetch_uint32_t(&rpc_evchan[tchan].nxprts))
+			tchan = chan;
+	}
+	if (++next_chan >= n_tcp_event_chan)
+		next_chan = 0;
+	(void) atomic_inc_uint32_t(&rpc_evchan[tchan].nxprts);
 
 	/* setup private data (freed when xprt is destroyed) */
 	newxprt->xp_u1 =
 	    alloc_gsh_xprt_private(newxprt, XPRT_PRIVATE_FLAG_NONE);
+	((gsh_xprt_private_t *) newxprt->xp_u1)->evchan = tchan;
+
+	/* keep dispatch on the node owning the connection's RX queue */
+	if (nfs_req_st.reqs.cpu_shard != NULL) {
+		gsh_xprt_private_t *xu = newxprt->xp_u1;
+		int cpu = -1;
+		socklen_t len = sizeof(cpu);
+
+		if (getsockopt(newxprt->xp_fd, SOL_SOCKET, SO_INCOMING_CPU,
+			       &cpu, &len) == 0 && cpu >= 0
+		    && (uint32_t) cpu < nfs_req_st.reqs.ncpu_shard)
+			xu->req_q_shard = nfs_req_st.reqs.cpu_shard[cpu];
+	}
 
 	/* NB: xu->drc is allocated on first request--we need shared
 	 * TCP DRC for v3, but per-connection for v4 */
 
 	PTHREAD_MUTEX_unlock(&mtx);
 
+	/* The caller of a connection does not change, look it up once and
+	 * hold it until the connection is destroyed.  Its requests borrow
+	 * this reference, see nfs_rpc_execute().
+	 */
+	((gsh_xprt_private_t *) newxprt->xp_u1)->client =
+	    get_gsh_client((sockaddr_t *) svc_getrpccaller(newxprt), false);
+
+	PTHREAD_MUTEX_lock(&nfs_rpc_conns_mtx);
+	glist_add_tail(&nfs_rpc_conns,
+		       &((gsh_xprt_private_t *) newxprt->xp_u1)->conns);
+	PTHREAD_MUTEX_unlock(&nfs_rpc_conns_mtx);
+
 	(void)svc_rqst_evchan_reg(rpc_evchan[tchan].chan_id, newxprt,
 				  SVC_RQST_FLAG_NONE);
 
 	return 0;
 }
 
+/**
+ * @brief Release what idle TCP connections hold
+ *
+ * With RPC_Idle_Reclaim_S, a connection that has had no request in
+ * progress for that long drops its reference to its DRC, if the DRC
+ * holds no entry, and frees its memo of Manage_Gids lookups.  Its next
+ * request looks up or allocates a DRC again in nfs_dupreq_get_drc(),
+ * and starts a new memo.  Holding the decoder guard keeps that request
+ * out while they go.  The record buffers of the connection are
+ * TI-RPC's, and kept.
+ *
+ * Called by the reaper.
+ */
+void nfs_rpc_reclaim_idle(void)
+{
+	time_t idle = nfs_param.core_param.rpc.idle_reclaim_s;
+	time_t now = time(NULL);
+	gsh_xprt_private_t *xu;
+	struct glist_head *l;
+	uint32_t drcs = 0, memos = 0;
+	SVCXPRT *xprt;
+	drc_t *drc;
+
+	if (idle == 0)
+		return;
+
+	/* a destroyed connection leaves the list before it is freed */
+	PTHREAD_MUTEX_lock(&nfs_rpc_conns_mtx);
+	glist_for_each(l, &nfs_rpc_conns) {
+		xu = glist_entry(l, gsh_xprt_private_t, conns);
+		xprt = xu->xprt;
+
+		if (atomic_fetch_uint32_t(&xprt->xp_requests) != 0 ||
+		    now - atomic_fetch_time_t(&xu->idle_since) < idle ||
+		    (xprt->xp_u2 == NULL && xu->gids == NULL))
+			continue;
+
+		if (!gsh_xprt_decoder_guard(xprt, XPRT_PRIVATE_FLAG_NONE))
+			continue;
+
+		if (atomic_fetch_uint32_t(&xprt->xp_requests) != 0 ||
+		    (xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED)) {
+			gsh_xprt_clear_flag(xprt, XPRT_PRIVATE_FLAG_DECODING);
+			continue;
+		}
+
+		drc = xprt->xp_u2;
+		if (drc != NULL) {
+			PTHREAD_MUTEX_lock(&drc->mtx);
+			if (drc->size == 0) {
+				xprt->xp_u2 = NULL;
+				nfs_dupreq_put_drc(xprt, drc,
+						   DRC_FLAG_LOCKED |
+						   DRC_FLAG_RELEASE);
+				++drcs;
+			} else {
+				PTHREAD_MUTEX_unlock(&drc->mtx);
+			}
+		}
+
+		if (xu->gids != NULL) {
+			uid2grp_memo_free(xu->gids);
+			xu->gids = NULL;
+			++memos;
+		}
+
+		gsh_xprt_clear_flag(xprt, XPRT_PRIVATE_FLAG_DECODING);
+	}
+	PTHREAD_MUTEX_unlock(&nfs_rpc_conns_mtx);
+
+	if (drcs != 0 || memos != 0)
+		LogDebug(COMPONENT_DISPATCH,
+			 "idle connections released %" PRIu32
+			 " DRCs and %" PRIu32 " gid memos", drcs, memos);
+}
+
 /**
  * @brief xprt destructor callout
  *
@@ -1209,6 +1599,16 @@ static u_int nfs_rpc_recv_user_data(SVCXPRT *xprt, SVCXPRT *newxprt,
  */
 static void nfs_rpc_free_user_data(SVCXPRT *xprt)
 {
+	gsh_xprt_private_t *xu = xprt->xp_u1;
+
+	if (xu != NULL && xu->evchan >= 0) {
+		(void) atomic_dec_uint32_t(&rpc_evchan[xu->evchan].nxprts);
+
+		PTHREAD_MUTEX_lock(&nfs_rpc_conns_mtx);
+		glist_del(&xu->conns);
+		PTHREAD_MUTEX_unlock(&nfs_rpc_conns_mtx);
+	}
+
 	if (xprt->xp_u2) {
 		nfs_dupreq_put_drc(xprt, xprt->xp_u2, DRC_FLAG_RELEASE);
 		xprt->xp_u2 = NULL;
@@ -1222,38 +1622,194 @@ uint32_t nfs_rpc_outstanding_reqs_est(void)
 	static uint32_t nreqs;
 	struct req_q_pair *qpair;
 	uint32_t treqs;
+	uint32_t sx;
 	int ix;
 
 	if ((atomic_inc_uint32_t(&ctr) % 10) != 0)
 		return atomic_fetch_uint32_t(&nreqs);
 
 	treqs = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
-		treqs += atomic_fetch_uint32_t(&qpair->producer.size);
-		treqs += atomic_fetch_uint32_t(&qpair->consumer.size);
+	for (sx = 0; sx < nfs_req_st.reqs.nshards; ++sx) {
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			qpair = &(nfs_req_st.reqs.nfs_request_q[sx].qset[ix]);
+			treqs += atomic_fetch_uint32_t(&qpair->producer.size);
+			treqs += atomic_fetch_uint32_t(&qpair->consumer.size);
+		}
 	}
 
 	atomic_store_uint32_t(&nreqs, treqs);
 	return treqs;
 }
 
+/* Bytes of all requests in the dispatcher, see Dispatch_Max_Bytes */
+static uint64_t nfs_rpc_budget_bytes;
+
+/**
+ * @brief Check whether a transport must stop being read
+ *
+ * @param[in] xprt The transport
+ *
+ * @return true if it is over its request quota or a byte budget.
+ */
+static inline bool nfs_rpc_over_budget(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = xprt->xp_u1;
+	uint64_t max_bytes = nfs_param.core_param.dispatch_max_bytes;
+	uint64_t max_xprt = nfs_param.core_param.dispatch_max_bytes_xprt;
+
+	return (xprt->xp_requests
+		>= nfs_param.core_param.dispatch_max_reqs_xprt)
+		|| (max_xprt != 0 && atomic_fetch_uint64_t(&xu->budget)
+		    >= max_xprt)
+		|| (max_bytes != 0 &&
+		    atomic_fetch_uint64_t(&nfs_rpc_budget_bytes) >= max_bytes);
+}
+
 static inline bool stallq_should_unstall(SVCXPRT *xprt)
 {
-	return ((xprt->xp_requests
-		 < nfs_param.core_param.dispatch_max_reqs_xprt / 2)
-		|| (xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED));
+	gsh_xprt_private_t *xu = xprt->xp_u1;
+	uint64_t max_bytes = nfs_param.core_param.dispatch_max_bytes;
+	uint64_t max_xprt = nfs_param.core_param.dispatch_max_bytes_xprt;
+
+	if (xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED)
+		return true;
+
+	return (xprt->xp_requests
+		< nfs_param.core_param.dispatch_max_reqs_xprt / 2)
+		&& (max_xprt == 0 || atomic_fetch_uint64_t(&xu->budget)
+		    < max_xprt / 2)
+		&& (max_bytes == 0 ||
+		    atomic_fetch_uint64_t(&nfs_rpc_budget_bytes)
+		    < max_bytes / 2);
+}
+
+/**
+ * @brief Set or clear TCP_CORK on a transport for reply coalescing
+ *
+ * Called with the transport lock held, so the socket option follows
+ * the flag.
+ *
+ * @param[in] xprt The transport
+ * @param[in] cork Whether to cork
+ */
+static void nfs_rpc_set_cork(SVCXPRT *xprt, int cork)
+{
+	gsh_xprt_private_t *xu = xprt->xp_u1;
+
+	if (cork)
+		atomic_set_uint16_t_bits(&xu->flags, XPRT_PRIVATE_FLAG_CORKED);
+	else
+		atomic_clear_uint16_t_bits(&xu->flags,
+					   XPRT_PRIVATE_FLAG_CORKED);
+
+	if (setsockopt(xprt->xp_fd, IPPROTO_TCP, TCP_CORK,
+		       &cork, sizeof(cork)) != 0)
+		LogDebug(COMPONENT_DISPATCH,
+			 "TCP_CORK %d on xprt %p failed: %d",
+			 cork, xprt, errno);
+}
+
+/**
+ * @brief Hold back a reply while more of its transport's are coming
+ *
+ * With RPC_Reply_Coalesce, a TCP transport is corked when a reply is
+ * about to be sent and other requests of the transport are still in
+ * progress.  The kernel then packs the replies into full segments and
+ * sends them when nfs_rpc_req_done() uncorks the transport, once its
+ * last request completes.  The sender's own request is still counted,
+ * so its completion always follows.
+ *
+ * @param[in] xprt The transport
+ */
+void nfs_rpc_reply_cork(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = xprt->xp_u1;
+
+	if (!nfs_param.core_param.rpc.reply_coalesce ||
+	    xprt->xp_type != XPRT_TCP || xu == NULL ||
+	    atomic_fetch_uint32_t(&xprt->xp_requests) < 2 ||
+	    (atomic_fetch_uint16_t(&xu->flags) & XPRT_PRIVATE_FLAG_CORKED))
+		return;
+
+	PTHREAD_MUTEX_lock(&xprt->xp_lock);
+	if (!(xu->flags & XPRT_PRIVATE_FLAG_CORKED))
+		nfs_rpc_set_cork(xprt, 1);
+	PTHREAD_MUTEX_unlock(&xprt->xp_lock);
+}
+
+/**
+ * @brief Account for a request whose reply was sent
+ *
+ * Credits the request to the quotas of its transport, returns its
+ * transport reference, and wakes the stall queue if the transport, or
+ * the global budget, just dropped enough for a stalled one to go on.
+ * The last request of a corked transport sends its replies.
+ *
+ * @param[in] reqdata NFS request
+ */
+void nfs_rpc_req_done(request_data_t *reqdata)
+{
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	gsh_xprt_private_t *xu = xprt->xp_u1;
+	uint64_t max_bytes = nfs_param.core_param.dispatch_max_bytes;
+	uint64_t bytes = reqdata->r_u.req.budget;
+	uint64_t left = 0;
+	bool wake = false;
+
+	if (bytes != 0) {
+		reqdata->r_u.req.budget = 0;
+		(void) atomic_sub_uint64_t(&xu->budget, bytes);
+		left = atomic_sub_uint64_t(&nfs_rpc_budget_bytes, bytes);
+	}
+	if (atomic_dec_uint32_t(&xprt->xp_requests) == 0 && xu != NULL) {
+		if (nfs_param.core_param.rpc.idle_reclaim_s != 0)
+			atomic_store_time_t(&xu->idle_since, time(NULL));
+
+		if (atomic_fetch_uint16_t(&xu->flags)
+		    & XPRT_PRIVATE_FLAG_CORKED) {
+			PTHREAD_MUTEX_lock(&xprt->xp_lock);
+			if (xu->flags & XPRT_PRIVATE_FLAG_CORKED)
+				nfs_rpc_set_cork(xprt, 0);
+			PTHREAD_MUTEX_unlock(&xprt->xp_lock);
+		}
+	}
+
+	/* Pairs with the stall in nfs_rpc_cond_stall_xprt: either it sees
+	 * the credit, or this sees the stalled count.
+	 */
+	if (atomic_fetch_uint32_t(&nfs_req_st.stallq.stalled) != 0) {
+		if (xu != NULL &&
+		    (atomic_fetch_uint16_t(&xu->flags)
+		     & XPRT_PRIVATE_FLAG_STALLED))
+			wake = stallq_should_unstall(xprt);
+		if (max_bytes != 0 && left < max_bytes / 2 &&
+		    left + bytes >= max_bytes / 2)
+			wake = true;
+	}
+
+	if (wake) {
+		PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
+		pthread_cond_signal(&nfs_req_st.stallq.cv);
+		PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
+	}
+
+	gsh_xprt_unref(xprt, XPRT_PRIVATE_FLAG_NONE, __func__, __LINE__);
 }
 
+/**
+ * @brief Service the stall queue
+ *
+ * Sleeps until a request completion signals that a stalled transport
+ * may go on, and exits once none is stalled.
+ */
 void thr_stallq(struct fridgethr_context *thr_ctx)
 {
 	gsh_xprt_private_t *xu;
 	struct glist_head *l;
 	SVCXPRT *xprt;
 
+	PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
 	while (1) {
-		thread_delay_ms(1000);
-		PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
  restart:
 		if (nfs_req_st.stallq.stalled == 0) {
 			nfs_req_st.stallq.active = false;
@@ -1278,7 +1834,8 @@ void thr_stallq(struct fridgethr_context *thr_ctx)
 				/* check that we're still stalled */
 				if (xu->flags & XPRT_PRIVATE_FLAG_STALLED) {
 					glist_del(&xu->stallq);
-					--(nfs_req_st.stallq.stalled);
+					(void) atomic_dec_uint32_t(
+						&nfs_req_st.stallq.stalled);
 					atomic_clear_uint16_t_bits(&xu->flags,
 						XPRT_PRIVATE_FLAG_STALLED);
 					(void)svc_rqst_rearm_events(
@@ -1291,7 +1848,8 @@ void thr_stallq(struct fridgethr_context *thr_ctx)
 				goto restart;
 			}
 		}
-		PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
+		pthread_cond_wait(&nfs_req_st.stallq.cv,
+				  &nfs_req_st.stallq.mtx);
 	}
 
 	LogDebug(COMPONENT_DISPATCH, "stallq idle, thread exit");
@@ -1303,8 +1861,8 @@ static bool nfs_rpc_cond_stall_xprt(SVCXPRT *xprt)
 	bool activate = false;
 	uint32_t nreqs = xprt->xp_requests;
 
-	/* check per-xprt quota */
-	if (likely(nreqs < nfs_param.core_param.dispatch_max_reqs_xprt)) {
+	/* check per-xprt quota and the byte budgets */
+	if (likely(!nfs_rpc_over_budget(xprt))) {
 		LogDebug(COMPONENT_DISPATCH,
 			 "xprt %p xp_refs %" PRIu32 " has %" PRIu32
 			 " reqs active (max %d)",
@@ -1333,10 +1891,16 @@ static bool nfs_rpc_cond_stall_xprt(SVCXPRT *xprt)
 	PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
 
 	glist_add_tail(&nfs_req_st.stallq.q, &xu->stallq);
-	++(nfs_req_st.stallq.stalled);
 	atomic_set_uint16_t_bits(&xu->flags, XPRT_PRIVATE_FLAG_STALLED);
+	(void) atomic_inc_uint32_t(&nfs_req_st.stallq.stalled);
 	PTHREAD_MUTEX_unlock(&xprt->xp_lock);
 
+	/* Requests that completed before we were on the queue did not
+	 * wake it, check again.
+	 */
+	if (stallq_should_unstall(xprt))
+		pthread_cond_signal(&nfs_req_st.stallq.cv);
+
 	/* if no thread is servicing the stallq, start one */
 	if (!nfs_req_st.stallq.active) {
 		nfs_req_st.stallq.active = true;
@@ -1359,12 +1923,56 @@ static bool nfs_rpc_cond_stall_xprt(SVCXPRT *xprt)
 	return true;
 }
 
-void nfs_rpc_queue_init(void)
+/**
+ * @brief Build the order in which workers scan the request queues
+ *
+ * Smooth weighted round robin: for each position every queue gains its
+ * weight, the one with the most credit is picked and pays the total.
+ * Each queue then appears in proportion to its weight, spread evenly
+ * rather than in runs.  A worker starts its scan at the next position
+ * and moves on to the following queues when that one is empty, so the
+ * share of an idle queue goes to the others.
+ */
+static void nfs_rpc_queue_sched_init(void)
 {
-	struct fridgethr_params reqparams;
-	struct req_q_pair *qpair;
-	int rc = 0;
-	int ix;
+	const uint32_t weight[N_REQ_QUEUES] = {
+		[REQ_Q_MOUNT] = nfs_param.core_param.dispatch_weight_mount,
+		[REQ_Q_CALL] = nfs_param.core_param.dispatch_weight_call,
+		[REQ_Q_LOW_LATENCY] =
+			nfs_param.core_param.dispatch_weight_low_latency,
+		[REQ_Q_HIGH_LATENCY] =
+			nfs_param.core_param.dispatch_weight_high_latency,
+	};
+	int64_t credit[N_REQ_QUEUES] = { 0 };
+	uint32_t total = 0, px;
+	int ix, best;
+
+	for (ix = 0; ix < N_REQ_QUEUES; ++ix)
+		total += MAX(weight[ix], 1);
+
+	nfs_req_st.reqs.nsched = total;
+	nfs_req_st.reqs.sched = gsh_malloc(total);
+
+	for (px = 0; px < total; ++px) {
+		best = 0;
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			credit[ix] += MAX(weight[ix], 1);
+			if (credit[ix] > credit[best])
+				best = ix;
+		}
+		credit[best] -= total;
+		nfs_req_st.reqs.sched[px] = best;
+	}
+}
+
+void nfs_rpc_queue_init(void)
+{
+	struct fridgethr_params reqparams;
+	struct req_q_pair *qpair;
+	uint32_t nshards = nfs_param.core_param.dispatch_queue_shards;
+	uint32_t sx;
+	int rc = 0;
+	int ix;
 
 	memset(&reqparams, 0, sizeof(struct fridgethr_params));
     /**
@@ -1384,22 +1992,45 @@ void nfs_rpc_queue_init(void)
 		LogFatal(COMPONENT_DISPATCH,
 			 "Unable to initialize decoder thread pool: %d", rc);
 
-	/* queues */
+	/* queues, one set per shard (0 means one per online CPU) */
+	if (nfs_param.core_param.worker_numa_pools && nfs_numa.nnodes > 1) {
+		/* one shard per node, so node-bound workers drain
+		 * requests decoded on their own node first */
+		nshards = nfs_numa.nnodes;
+		nfs_req_st.reqs.ncpu_shard = nfs_numa.ncpus;
+		nfs_req_st.reqs.cpu_shard = nfs_numa.cpu_node;
+	} else if (nshards == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+		nshards = (ncpu > 0) ? (uint32_t) ncpu : 1;
+	}
+
+	LogInfo(COMPONENT_DISPATCH,
+		"Using %" PRIu32 " request queue shard(s)", nshards);
+
 	pthread_spin_init(&nfs_req_st.reqs.sp, PTHREAD_PROCESS_PRIVATE);
 	nfs_req_st.reqs.size = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
-		qpair->s = req_q_s[ix];
-		nfs_rpc_q_init(&qpair->producer);
-		nfs_rpc_q_init(&qpair->consumer);
+	nfs_req_st.reqs.nshards = nshards;
+	nfs_req_st.reqs.nfs_request_q =
+		gsh_calloc(nshards, sizeof(struct req_q_set));
+	for (sx = 0; sx < nshards; ++sx) {
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			qpair = &(nfs_req_st.reqs.nfs_request_q[sx].qset[ix]);
+			qpair->s = req_q_s[ix];
+			nfs_rpc_q_init(&qpair->producer);
+			nfs_rpc_q_init(&qpair->consumer);
+		}
 	}
+	nfs_rpc_queue_sched_init();
 
 	/* waitq */
 	glist_init(&nfs_req_st.reqs.wait_list);
 	nfs_req_st.reqs.waiters = 0;
+	nfs_req_st.reqs.spinners = 0;
 
 	/* stallq */
 	gsh_mutex_init(&nfs_req_st.stallq.mtx, NULL);
+	PTHREAD_COND_init(&nfs_req_st.stallq.cv, NULL);
 	glist_init(&nfs_req_st.stallq.q);
 	nfs_req_st.stallq.active = false;
 	nfs_req_st.stallq.stalled = 0;
@@ -1418,50 +2049,157 @@ uint32_t get_dequeue_count(void)
 	return dequeued_reqs;
 }
 
-void nfs_rpc_enqueue_req(request_data_t *reqdata)
+/**
+ * @brief Choose the queue set a request goes to
+ *
+ * Producers enqueue on the transport's home shard if it has one,
+ * otherwise on their local shard.
+ */
+static struct req_q_set *nfs_rpc_queue_set(request_data_t *reqdata)
 {
-	struct req_q_set *nfs_request_q;
-	struct req_q_pair *qpair;
-	struct req_q *q;
+	if (reqdata->rtype == NFS_REQUEST) {
+		gsh_xprt_private_t *xu =
+			reqdata->r_u.req.svc.rq_xprt->xp_u1;
 
-#if defined(HAVE_BLKIN)
-	BLKIN_TIMESTAMP(
-		&reqdata->r_u.req.svc.bl_trace,
-		&reqdata->r_u.req.xprt->blkin.endp,
-		"enqueue-enter");
-#endif
+		if (xu != NULL && xu->req_q_shard >= 0)
+			return &nfs_req_st.reqs.nfs_request_q[xu->req_q_shard];
+	}
 
-	nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
+	return &nfs_req_st.reqs.nfs_request_q[
+				nfs_rpc_q_local_shard(enqueued_reqs)];
+}
 
+/**
+ * @brief Choose the queue of a set a request goes to
+ *
+ * @return The queue index, or -1 for a request type that is not queued.
+ */
+static int nfs_rpc_queue_index(request_data_t *reqdata)
+{
 	switch (reqdata->rtype) {
 	case NFS_REQUEST:
 		LogFullDebug(COMPONENT_DISPATCH,
 			     "enter rq_xid=%" PRIu32 " lookahead.flags=%u",
 			     reqdata->r_u.req.svc.rq_msg.rm_xid,
 			     reqdata->r_u.req.lookahead.flags);
-		if (reqdata->r_u.req.lookahead.flags & NFS_LOOKAHEAD_MOUNT) {
-			qpair = &(nfs_request_q->qset[REQ_Q_MOUNT]);
-			break;
-		}
+		if (reqdata->r_u.req.lookahead.flags & NFS_LOOKAHEAD_MOUNT)
+			return REQ_Q_MOUNT;
 		if (NFS_LOOKAHEAD_HIGH_LATENCY(reqdata->r_u.req.lookahead))
-			qpair = &(nfs_request_q->qset[REQ_Q_HIGH_LATENCY]);
-		else
-			qpair = &(nfs_request_q->qset[REQ_Q_LOW_LATENCY]);
-		break;
+			return REQ_Q_HIGH_LATENCY;
+		return REQ_Q_LOW_LATENCY;
 	case NFS_CALL:
-		qpair = &(nfs_request_q->qset[REQ_Q_CALL]);
-		break;
+		return REQ_Q_CALL;
 #ifdef _USE_9P
 	case _9P_REQUEST:
 		/* XXX identify high-latency requests and allocate
 		 * to the high-latency queue, as above */
-		qpair = &(nfs_request_q->qset[REQ_Q_LOW_LATENCY]);
-		break;
+		return REQ_Q_LOW_LATENCY;
 #endif
 	default:
-		goto out;
+		return -1;
+	}
+}
+
+/**
+ * @brief Claim spinning workers for requests just queued
+ *
+ * Each claimed spinner stands for a wake-up that is not needed: the
+ * claim leaves one spinner unable to take itself off the count, see
+ * nfs_rpc_spin_leave(), and every spinner scans the queues once more
+ * after leaving.  The requests were queued before the claim, so that
+ * scan finds them.
+ *
+ * @param[in] count Number of requests just queued
+ *
+ * @return The number of spinners claimed.
+ */
+static uint32_t nfs_rpc_claim_spinners(uint32_t count)
+{
+	uint32_t n = atomic_fetch_uint32_t(&nfs_req_st.reqs.spinners);
+	uint32_t take;
+
+	while (n > 0) {
+		take = MIN(n, count);
+		if (atomic_cas_uint32_t(&nfs_req_st.reqs.spinners, n,
+					n - take))
+			return take;
+		n = atomic_fetch_uint32_t(&nfs_req_st.reqs.spinners);
 	}
 
+	return 0;
+}
+
+/**
+ * @brief Wake up to count idle workers
+ *
+ * Spinning workers are claimed first, the rest are taken off the wait
+ * list under a single hold of its lock, then signalled.
+ *
+ * @param[in] count Number of requests just queued
+ */
+static void nfs_rpc_queue_wake(uint32_t count)
+{
+	struct glist_head wake, *glist, *glistn;
+	wait_q_entry_t *wqe;
+
+	count -= nfs_rpc_claim_spinners(count);
+	if (count == 0)
+		return;
+
+	glist_init(&wake);
+
+	/* SPIN LOCKED */
+	pthread_spin_lock(&nfs_req_st.reqs.sp);
+	while (count-- > 0 && nfs_req_st.reqs.waiters) {
+		wqe = glist_first_entry(&nfs_req_st.reqs.wait_list,
+					wait_q_entry_t, waitq);
+
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "nfs_req_st.reqs.waiters %u signal wqe %p",
+			     nfs_req_st.reqs.waiters, wqe);
+
+		/* release 1 waiter */
+		glist_del(&wqe->waitq);
+		glist_add_tail(&wake, &wqe->waitq);
+		--(nfs_req_st.reqs.waiters);
+		--(wqe->waiters);
+	}
+	/* ! SPIN LOCKED */
+	pthread_spin_unlock(&nfs_req_st.reqs.sp);
+
+	/* once signalled, a worker may put its wqe back on the wait
+	 * list, so take it off ours first */
+	glist_for_each_safe(glist, glistn, &wake) {
+		wqe = glist_entry(glist, wait_q_entry_t, waitq);
+		glist_del(&wqe->waitq);
+		PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
+		/* XXX reliable handoff */
+		wqe->flags |= Wqe_LFlag_SyncDone;
+		if (wqe->flags & Wqe_LFlag_WaitSync)
+			pthread_cond_signal(&wqe->lwe.cv);
+		PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
+	}
+}
+
+static void nfs_rpc_queue_req(request_data_t *reqdata)
+{
+	struct req_q_pair *qpair;
+	struct req_q *q;
+	int qx;
+
+#if defined(HAVE_BLKIN)
+	BLKIN_TIMESTAMP(
+		&reqdata->r_u.req.svc.bl_trace,
+		&reqdata->r_u.req.xprt->blkin.endp,
+		"enqueue-enter");
+#endif
+
+	qx = nfs_rpc_queue_index(reqdata);
+	if (qx < 0)
+		return;
+
+	qpair = &(nfs_rpc_queue_set(reqdata)->qset[qx]);
+
 	/* this one is real, timestamp it
 	 */
 	now(&reqdata->time_queued);
@@ -1494,40 +2232,324 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 		 enqueued_reqs, dequeued_reqs);
 
 	/* potentially wakeup some thread */
+	nfs_rpc_queue_wake(1);
+}
+
+/**
+ * @brief Find the export and I/O size of a decoded NFS request
+ *
+ * NFSv3 arguments begin with the file handle.  An NFSv4 compound is
+ * charged to the export of its first PUTFH, and for all its READs and
+ * WRITEs.
+ *
+ * @param[in]  reqdata NFS request
+ * @param[out] bytes   Bytes the request reads or writes
+ *
+ * @return The export id, or -1 if there is none.
+ */
+static int nfs_rpc_qos_cost(request_data_t *reqdata, uint64_t *bytes)
+{
+	struct svc_req *req = &reqdata->r_u.req.svc;
+	nfs_arg_t *arg = &reqdata->r_u.req.arg_nfs;
+	COMPOUND4args *compound = &arg->arg_compound4;
+	int export_id = -1;
+	u_int i;
 
-	/* global waitq */
-	{
-		wait_q_entry_t *wqe;
+	*bytes = 0;
 
-		/* SPIN LOCKED */
-		pthread_spin_lock(&nfs_req_st.reqs.sp);
-		if (nfs_req_st.reqs.waiters) {
-			wqe = glist_first_entry(&nfs_req_st.reqs.wait_list,
-						wait_q_entry_t, waitq);
+	if (req->rq_msg.cb_prog != NFS_program[P_NFS]
+	    || req->rq_msg.cb_proc == NFSPROC_NULL)
+		return -1;
 
-			LogFullDebug(COMPONENT_DISPATCH,
-				     "nfs_req_st.reqs.waiters %u signal wqe %p (for q %p)",
-				     nfs_req_st.reqs.waiters, wqe, q);
-
-			/* release 1 waiter */
-			glist_del(&wqe->waitq);
-			--(nfs_req_st.reqs.waiters);
-			--(wqe->waiters);
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
-			PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
-			/* XXX reliable handoff */
-			wqe->flags |= Wqe_LFlag_SyncDone;
-			if (wqe->flags & Wqe_LFlag_WaitSync)
-				pthread_cond_signal(&wqe->lwe.cv);
-			PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
-		} else
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
+#ifdef _USE_NFS3
+	if (req->rq_msg.cb_vers == NFS_V3) {
+		if (req->rq_msg.cb_proc == NFSPROC3_READ)
+			*bytes = arg->arg_read3.count;
+		else if (req->rq_msg.cb_proc == NFSPROC3_WRITE)
+			*bytes = arg->arg_write3.count;
+		return nfs3_FhandleToExportId((nfs_fh3 *) arg);
 	}
+#endif /* _USE_NFS3 */
 
- out:
-	return;
+	/* A compound with too many operations was not decoded */
+	if (req->rq_msg.cb_vers != NFS_V4 ||
+	    compound->argarray.argarray_val == NULL)
+		return -1;
+
+	for (i = 0; i < compound->argarray.argarray_len; i++) {
+		nfs_argop4 *op = &compound->argarray.argarray_val[i];
+		nfs_fh4 *fh = &op->nfs_argop4_u.opputfh.object;
+		file_handle_v4_t *v4_handle;
+
+		switch (op->argop) {
+		case NFS4_OP_PUTFH:
+			/* PUTFH validates the handle, only peek at it */
+			v4_handle = (file_handle_v4_t *) fh->nfs_fh4_val;
+			if (export_id < 0 && v4_handle != NULL &&
+			    fh->nfs_fh4_len >=
+			    offsetof(struct file_handle_v4, fsopaque) &&
+			    v4_handle->fhversion == GANESHA_FH_VERSION &&
+			    !(v4_handle->fhflags1 & FILE_HANDLE_V4_FLAG_DS))
+				export_id = ntohs(v4_handle->id.exports);
+			break;
+		case NFS4_OP_READ:
+			*bytes += op->nfs_argop4_u.opread.count;
+			break;
+		case NFS4_OP_WRITE:
+			*bytes += op->nfs_argop4_u.opwrite.data.data_len;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return export_id;
+}
+
+/**
+ * @brief Charge a decoded request to the byte budgets
+ *
+ * A request costs its request data, plus the data it reads or writes,
+ * which its buffers hold until the reply is sent.
+ *
+ * @param[in] reqdata NFS request
+ */
+static void nfs_rpc_budget_charge(request_data_t *reqdata)
+{
+	gsh_xprt_private_t *xu = reqdata->r_u.req.svc.rq_xprt->xp_u1;
+	uint64_t bytes;
+
+	if ((nfs_param.core_param.dispatch_max_bytes == 0 &&
+	     nfs_param.core_param.dispatch_max_bytes_xprt == 0) ||
+	    xu == NULL)
+		return;
+
+	(void) nfs_rpc_qos_cost(reqdata, &bytes);
+	bytes += sizeof(request_data_t);
+
+	reqdata->r_u.req.budget = bytes;
+	(void) atomic_add_uint64_t(&xu->budget, bytes);
+	(void) atomic_add_uint64_t(&nfs_rpc_budget_bytes, bytes);
+}
+
+static void nfs_rpc_qos_release(void *arg)
+{
+	nfs_rpc_queue_req(arg);
+}
+
+/**
+ * @brief Delay a request that is over its client's or export's budget
+ *
+ * A request that must wait is handed to the delayed executor, which
+ * queues it to the workers when its buckets allow.  Delayed requests
+ * are released in the order of their buckets' arrival times, so the
+ * limited clients and exports share the workers in proportion to
+ * their rates, as in virtual clock fair queuing.
+ *
+ * @param[in] reqdata NFS request
+ *
+ * @return true if the request will be queued later.
+ */
+static bool nfs_rpc_qos_delay(request_data_t *reqdata)
+{
+	uint64_t client_iops = nfs_param.core_param.client_qos_iops;
+	uint64_t client_bw = nfs_param.core_param.client_qos_bandwidth;
+	uint64_t burst = nfs_param.core_param.qos_burst * NS_PER_MSEC;
+	struct gsh_client *client;
+	struct gsh_export *export;
+	struct timespec ts;
+	uint64_t now_ns, release, bytes;
+	int export_id;
+
+	if (client_iops == 0 && client_bw == 0 && !gsh_qos_exports)
+		return false;
+
+	export_id = nfs_rpc_qos_cost(reqdata, &bytes);
+
+	now(&ts);
+	now_ns = timespec_diff(&ServerBootTime, &ts);
+	release = now_ns;
+
+	if (client_iops != 0 || client_bw != 0) {
+		client = get_gsh_client((sockaddr_t *)
+				svc_getrpccaller(reqdata->r_u.req.svc.rq_xprt),
+				false);
+		if (client != NULL) {
+			release = MAX(release,
+				      gsh_qos_charge(&client->qos.ops_tat,
+						     client_iops, 1, now_ns,
+						     burst));
+			release = MAX(release,
+				      gsh_qos_charge(&client->qos.bytes_tat,
+						     client_bw, bytes, now_ns,
+						     burst));
+			put_gsh_client(client);
+		}
+	}
+
+	if (gsh_qos_exports && export_id >= 0) {
+		export = get_gsh_export(export_id);
+		if (export != NULL) {
+			release = MAX(release,
+				gsh_qos_charge(&export->qos.ops_tat,
+					atomic_fetch_uint64_t(&export->qos_iops),
+					1, now_ns, burst));
+			release = MAX(release,
+				gsh_qos_charge(&export->qos.bytes_tat,
+				  atomic_fetch_uint64_t(&export->qos_bandwidth),
+				  bytes, now_ns, burst));
+			put_gsh_export(export);
+		}
+	}
+
+	if (release == now_ns)
+		return false;
+
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "delaying rq_xid=%" PRIu32 " by %" PRIu64 " nsecs",
+		     reqdata->r_u.req.svc.rq_msg.rm_xid, release - now_ns);
+
+	return delayed_submit(nfs_rpc_qos_release, reqdata,
+			      release - now_ns) == 0;
+}
+
+/**
+ * @brief Queue a request to the workers
+ *
+ * New NFS requests are first charged to the rate limits of their
+ * client and export, and delayed if they are over them.  Resumed
+ * requests, and those back from waiting for their caller's groups,
+ * were charged when they first arrived.
+ *
+ * @param[in] reqdata Request
+ */
+void nfs_rpc_enqueue_req(request_data_t *reqdata)
+{
+	if (reqdata->rtype == NFS_REQUEST &&
+	    reqdata->r_u.req.resume_fn == NULL &&
+	    !reqdata->r_u.req.gids_wait.parked &&
+	    nfs_rpc_qos_delay(reqdata))
+		return;
+
+	nfs_rpc_queue_req(reqdata);
+}
+
+/** Requests a decoder collects before handing them to the workers */
+#define NFS_REQ_BATCH_MAX 32
+
+/**
+ * @brief Requests decoded from one transport, not yet queued
+ *
+ * A decoder draining a transport collects what it decodes here and
+ * queues it with one lock per queue and one pass over the waiters.
+ */
+struct nfs_req_batch {
+	struct req_q_set *qset;	/*< Set of the transport, once known */
+	struct glist_head q[N_REQ_QUEUES];
+	uint32_t size[N_REQ_QUEUES];
+	uint32_t count;
+	uint32_t inline_budget;	/*< Requests the decoder may still run */
+};
+
+static void nfs_rpc_batch_init(struct nfs_req_batch *batch)
+{
+	int qx;
+
+	batch->qset = NULL;
+	for (qx = 0; qx < N_REQ_QUEUES; ++qx) {
+		glist_init(&batch->q[qx]);
+		batch->size[qx] = 0;
+	}
+	batch->count = 0;
+	batch->inline_budget = nfs_param.core_param.dispatch_inline_budget;
+}
+
+/**
+ * @brief Queue a batch to the workers and wake as many as it needs
+ *
+ * @param[in,out] batch Batch, empty on return
+ */
+static void nfs_rpc_batch_flush(struct nfs_req_batch *batch)
+{
+	struct req_q *q;
+	int qx;
+
+	if (batch->count == 0)
+		return;
+
+	for (qx = 0; qx < N_REQ_QUEUES; ++qx) {
+		if (batch->size[qx] == 0)
+			continue;
+
+		q = &batch->qset->qset[qx].producer;
+		pthread_spin_lock(&q->sp);
+		glist_splice_tail(&q->q, &batch->q[qx]);
+		q->size += batch->size[qx];
+		pthread_spin_unlock(&q->sp);
+		batch->size[qx] = 0;
+	}
+
+	(void) atomic_add_uint32_t(&enqueued_reqs, batch->count);
+
+	LogDebug(COMPONENT_DISPATCH,
+		 "enqueued %u reqs (enq %u deq %u)",
+		 batch->count, enqueued_reqs, dequeued_reqs);
+
+	nfs_rpc_queue_wake(batch->count);
+	batch->count = 0;
+}
+
+/**
+ * @brief Whether a decoder may execute a request itself
+ *
+ * Only low latency requests that cannot be expected to block, nor to
+ * hold state locks for long, are run on the decoder.
+ *
+ * @param[in,out] batch   Batch of the decoder, holding its budget
+ * @param[in]     reqdata New NFS request
+ *
+ * @return true if the request was charged to the budget.
+ */
+static bool nfs_rpc_batch_inline(struct nfs_req_batch *batch,
+				 request_data_t *reqdata)
+{
+	const uint32_t blocking = NFS_LOOKAHEAD_OPEN | NFS_LOOKAHEAD_CLOSE |
+				  NFS_LOOKAHEAD_CREATE | NFS_LOOKAHEAD_REMOVE |
+				  NFS_LOOKAHEAD_RENAME | NFS_LOOKAHEAD_LOCK;
+
+	if (batch->inline_budget == 0 ||
+	    nfs_rpc_queue_index(reqdata) != REQ_Q_LOW_LATENCY ||
+	    (reqdata->r_u.req.lookahead.flags & blocking))
+		return false;
+
+	--(batch->inline_budget);
+	return true;
+}
+
+/**
+ * @brief Add a new NFS request to a batch
+ *
+ * The caller has applied the rate limits.  A full batch is flushed so
+ * that workers need not wait for a long pipeline.
+ *
+ * @param[in,out] batch   Batch
+ * @param[in]     reqdata NFS request
+ */
+static void nfs_rpc_batch_add(struct nfs_req_batch *batch,
+			      request_data_t *reqdata)
+{
+	int qx;
+
+	if (batch->qset == NULL)
+		batch->qset = nfs_rpc_queue_set(reqdata);
+
+	qx = nfs_rpc_queue_index(reqdata);
+	now(&reqdata->time_queued);
+	glist_add_tail(&batch->q[qx], &reqdata->req_q);
+	++(batch->size[qx]);
+
+	if (++(batch->count) >= NFS_REQ_BATCH_MAX)
+		nfs_rpc_batch_flush(batch);
 }
 
 /* static inline */
@@ -1588,43 +2610,34 @@ request_data_t *nfs_rpc_consume_req(struct req_q_pair *qpair)
 	return reqdata;
 }
 
-request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
+/**
+ * @brief Try to consume one request from a single queue set
+ *
+ * The scan starts at the queue the weighted schedule names next.  The
+ * high latency queue is passed over while the workers allowed in such
+ * requests are all busy.
+ *
+ * @param[in] nfs_request_q Queue set (shard) to scan
+ * @param[in] worker        Worker doing the dequeue
+ *
+ * @return A request, or NULL if every queue in the set is empty.
+ */
+static request_data_t *nfs_rpc_consume_qset(struct req_q_set *nfs_request_q,
+					    nfs_worker_data_t *worker)
 {
 	request_data_t *reqdata = NULL;
-	struct req_q_set *nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
 	struct req_q_pair *qpair;
-	uint32_t ix, slot;
-	struct timespec timeout;
+	uint32_t ix, qx, first;
 
-	/* XXX: the following stands in for a more robust/flexible
-	 * weighting function */
+	first = nfs_req_st.reqs.sched[nfs_rpc_q_next_slot()
+				      % nfs_req_st.reqs.nsched];
+	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+		qx = (first + ix) % N_REQ_QUEUES;
+		if (qx == REQ_Q_HIGH_LATENCY
+		    && !nfs_rpc_q_hl_enter(&worker->high_latency))
+			continue;
 
-	/* slot in 1..4 */
- retry_deq:
-	slot = (nfs_rpc_q_next_slot() % 4);
-	for (ix = 0; ix < 4; ++ix) {
-		switch (slot) {
-		case 0:
-			/* MOUNT */
-			qpair = &(nfs_request_q->qset[REQ_Q_MOUNT]);
-			break;
-		case 1:
-			/* NFS_CALL */
-			qpair = &(nfs_request_q->qset[REQ_Q_CALL]);
-			break;
-		case 2:
-			/* LL */
-			qpair = &(nfs_request_q->qset[REQ_Q_LOW_LATENCY]);
-			break;
-		case 3:
-			/* HL */
-			qpair = &(nfs_request_q->qset[REQ_Q_HIGH_LATENCY]);
-			break;
-		default:
-			/* not here */
-			abort();
-			break;
-		}
+		qpair = &(nfs_request_q->qset[qx]);
 
 		LogFullDebug(COMPONENT_DISPATCH,
 			     "dequeue_req try qpair %s %p:%p", qpair->s,
@@ -1637,11 +2650,129 @@ request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 			break;
 		}
 
-		++slot;
-		slot = slot % 4;
-
+		if (qx == REQ_Q_HIGH_LATENCY)
+			nfs_rpc_q_hl_exit(&worker->high_latency);
 	}			/* for */
 
+	return reqdata;
+}
+
+/**
+ * @brief Consume a request from the worker's shard, or steal one
+ *
+ * @param[in] worker Worker doing the dequeue
+ *
+ * @return A request, or NULL if every queue is empty.
+ */
+static request_data_t *nfs_rpc_consume_any(nfs_worker_data_t *worker)
+{
+	request_data_t *reqdata;
+	uint32_t nshards = nfs_req_st.reqs.nshards;
+	uint32_t local, sx;
+
+	/* drain the local shard first */
+	local = nfs_rpc_q_local_shard(worker->worker_index);
+	reqdata = nfs_rpc_consume_qset(&nfs_req_st.reqs.nfs_request_q[local],
+				       worker);
+
+	/* then steal from the other shards before going idle */
+	for (sx = 1; !reqdata && sx < nshards; ++sx) {
+		reqdata = nfs_rpc_consume_qset(
+			&nfs_req_st.reqs.nfs_request_q[(local + sx) % nshards],
+			worker);
+	}
+
+	return reqdata;
+}
+
+static inline void nfs_rpc_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#else
+	sched_yield();
+#endif
+}
+
+/**
+ * @brief Take a spinning worker off the count
+ *
+ * If nfs_rpc_claim_spinners() took the count to zero, a request was
+ * queued that counted on a spinner and the worker leaves nothing.  It
+ * scans the queues again either way.
+ */
+static void nfs_rpc_spin_leave(void)
+{
+	uint32_t n = atomic_fetch_uint32_t(&nfs_req_st.reqs.spinners);
+
+	while (n > 0) {
+		if (atomic_cas_uint32_t(&nfs_req_st.reqs.spinners, n, n - 1))
+			return;
+		n = atomic_fetch_uint32_t(&nfs_req_st.reqs.spinners);
+	}
+}
+
+/**
+ * @brief Poll the queues for a while before going to sleep
+ *
+ * The queues are only scanned when the counters say a request is
+ * waiting, and the worker pauses between looks.
+ *
+ * @param[in] worker Worker doing the dequeue
+ *
+ * @return A request, or NULL if none came within Dispatch_Spin_Usec.
+ */
+static request_data_t *nfs_rpc_spin_dequeue(nfs_worker_data_t *worker)
+{
+	uint64_t budget =
+		nfs_param.core_param.dispatch_spin_usec * NS_PER_USEC;
+	request_data_t *reqdata = NULL;
+	struct timespec start, ts;
+
+	now(&start);
+	(void) atomic_inc_uint32_t(&nfs_req_st.reqs.spinners);
+
+	do {
+		if (atomic_fetch_uint32_t(&enqueued_reqs) !=
+		    atomic_fetch_uint32_t(&dequeued_reqs)) {
+			reqdata = nfs_rpc_consume_any(worker);
+			if (reqdata)
+				break;
+		}
+		nfs_rpc_cpu_relax();
+		now(&ts);
+	} while (timespec_diff(&start, &ts) < budget);
+
+	nfs_rpc_spin_leave();
+
+	return reqdata;
+}
+
+request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
+{
+	request_data_t *reqdata = NULL;
+	struct timespec timeout;
+	bool spun = false;
+
+ retry_deq:
+	/* the previous request, if any, is done */
+	nfs_rpc_q_hl_exit(&worker->high_latency);
+
+	reqdata = nfs_rpc_consume_any(worker);
+
+	/* a worker fresh from a request spins once before sleeping, then
+	 * scans again: a request may count on it, see
+	 * nfs_rpc_claim_spinners() */
+	if (!reqdata && !spun &&
+	    nfs_param.core_param.dispatch_spin_usec != 0) {
+		spun = true;
+		reqdata = nfs_rpc_spin_dequeue(worker);
+		if (!reqdata)
+			goto retry_deq;
+	}
+
 	/* wait */
 	if (!reqdata) {
 		struct fridgethr_context *ctx =
@@ -1726,6 +2857,7 @@ static inline request_data_t *alloc_nfs_request(SVCXPRT *xprt)
 	reqdata->r_u.req.svc.rq_xprt = xprt;
 	reqdata->r_u.req.svc.rq_daddr_len = 0;
 	reqdata->r_u.req.svc.rq_raddr_len = 0;
+	reqdata->r_u.req.budget = 0;
 
 	return reqdata;
 }
@@ -1868,7 +3000,17 @@ static bool is_rpc_call_valid(struct svc_req *req)
 	return false;
 }				/* is_rpc_call_valid */
 
-enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
+/**
+ * @brief Decode one request from a transport
+ *
+ * @param[in] context Private context of the transport's receive
+ * @param[in] xprt    Transport
+ * @param[in] batch   Batch to add the request to, or NULL to queue it
+ *
+ * @return The transport's status.
+ */
+static enum xprt_stat thr_decode_rpc_req(void *context, SVCXPRT *xprt,
+					 struct nfs_req_batch *batch)
 {
 	request_data_t *reqdata;
 	enum auth_stat why;
@@ -1876,6 +3018,8 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 	bool no_dispatch = false;
 	bool enqueued = false;
 	bool recv_status;
+	bool args_ok;
+	enum mem_arena arena;
 
 	if (!xprt) {
 		LogCrit(COMPONENT_DISPATCH,
@@ -2029,10 +3173,15 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 		     "Before SVC_GETARGS on socket %d, xprt=%p",
 		     xprt->xp_fd, xprt);
 
-	if (!SVC_GETARGS(&reqdata->r_u.req.svc,
-			 reqdata->r_u.req.funcdesc->xdr_decode_func,
-			 &reqdata->r_u.req.arg_nfs,
-			 &reqdata->r_u.req.lookahead)) {
+	/* What the decoder allocates is counted to the XDR arena */
+	arena = mem_arena_rpc_set(MEM_ARENA_XDR);
+	args_ok = SVC_GETARGS(&reqdata->r_u.req.svc,
+			      reqdata->r_u.req.funcdesc->xdr_decode_func,
+			      &reqdata->r_u.req.arg_nfs,
+			      &reqdata->r_u.req.lookahead);
+	(void) mem_arena_rpc_set(arena);
+
+	if (!args_ok) {
 		LogInfo(COMPONENT_DISPATCH,
 			"SVC_GETARGS failed for Program %" PRIu32
 			", Version %" PRIu32
@@ -2047,11 +3196,23 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 		goto finish;
 	}
 
+#ifdef _USE_NFS_RDMA
+	if (xprt->xp_type == XPRT_RDMA)
+		nfs_rdma_account(xprt, &reqdata->r_u.req.lookahead);
+#endif
+
+	nfs_rpc_budget_charge(reqdata);
+
 	if (context) {
 		/* release internal locks, result ignored */
 		stat = SVC_STAT(xprt);
-		/* already running worker thread, do not enqueue */
-		nfs_rpc_execute(reqdata);
+		/* already running worker thread, do not enqueue; if the
+		 * request suspends it is resumed on a worker, which
+		 * returns this ref */
+		gsh_xprt_ref(xprt, XPRT_PRIVATE_FLAG_INCREQ, __func__,
+			     __LINE__);
+		if (nfs_rpc_execute(reqdata) != NFS_REQ_ASYNC_WAIT)
+			nfs_rpc_req_done(reqdata);
 		return XPRT_IDLE;
 	}
 
@@ -2059,7 +3220,21 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 
 	/* XXX as above, the call has already passed is_rpc_call_valid,
 	 * the former check here is removed. */
-	nfs_rpc_enqueue_req(reqdata);
+	if (batch == NULL) {
+		nfs_rpc_enqueue_req(reqdata);
+	} else if (nfs_rpc_qos_delay(reqdata)) {
+		/* queued later by the delayed executor */
+	} else if (nfs_rpc_batch_inline(batch, reqdata)) {
+		/* run to completion; hand what is already decoded to the
+		 * workers first so it does not wait behind this one */
+		nfs_rpc_batch_flush(batch);
+		if (nfs_rpc_execute(reqdata) != NFS_REQ_ASYNC_WAIT) {
+			nfs_rpc_req_done(reqdata);
+			pool_free(request_pool, reqdata);
+		}
+	} else {
+		nfs_rpc_batch_add(batch, reqdata);
+	}
 	enqueued = true;
 
  finish:
@@ -2073,10 +3248,14 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 	return stat;
 }
 
+enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
+{
+	return thr_decode_rpc_req(context, xprt, NULL);
+}
+
 static inline bool thr_continue_decoding(SVCXPRT *xprt, enum xprt_stat stat)
 {
-	if (unlikely(xprt->xp_requests
-		     > nfs_param.core_param.dispatch_max_reqs_xprt))
+	if (unlikely(nfs_rpc_over_budget(xprt)))
 		return false;
 
 	return (stat == XPRT_MOREREQS);
@@ -2086,12 +3265,16 @@ void thr_decode_rpc_requests(struct fridgethr_context *thr_ctx)
 {
 	enum xprt_stat stat;
 	SVCXPRT *xprt = (SVCXPRT *) thr_ctx->arg;
+	struct nfs_req_batch batch;
 
 	LogFullDebug(COMPONENT_RPC, "enter xprt=%p", xprt);
 
+	/* queue everything the transport has buffered at once */
+	nfs_rpc_batch_init(&batch);
 	do {
-		stat = thr_decode_rpc_request(NULL, xprt);
+		stat = thr_decode_rpc_req(NULL, xprt, &batch);
 	} while (thr_continue_decoding(xprt, stat));
+	nfs_rpc_batch_flush(&batch);
 
 	LogDebug(COMPONENT_DISPATCH, "exiting, stat=%s", xprt_stat_s[stat]);
 
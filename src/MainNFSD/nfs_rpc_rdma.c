@@ -39,8 +39,139 @@
 #endif
 
 #include "gsh_rpc.h"
+#include "gsh_list.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "nfs_dupreq.h"
 #include "nfs_init.h"
 
+/**
+ * @brief Counters of a connection, hung off its private data
+ */
+struct nfs_rdma_conn {
+	struct glist_head list;	/*< On nfs_rdma_conns */
+	SVCXPRT *xprt;
+	uint64_t requests;
+	uint64_t credit_stalls;
+	uint64_t rdma_read_reqs;
+	uint64_t rdma_write_reqs;
+};
+
+static struct glist_head nfs_rdma_conns = GLIST_HEAD_INIT(nfs_rdma_conns);
+static uint32_t nfs_rdma_nconns;
+static pthread_mutex_t nfs_rdma_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Count a decoded request against its connection
+ *
+ * A request that finds all but one credit in use leaves the client
+ * no more to send with until a reply goes back.
+ *
+ * @param[in] xprt Transport the request came on
+ * @param[in] lkhd The request's lookahead
+ */
+void nfs_rdma_account(SVCXPRT *xprt, struct nfs_request_lookahead *lkhd)
+{
+	gsh_xprt_private_t *xu = xprt->xp_u1;
+	struct nfs_rdma_conn *conn;
+
+	if (xu == NULL || xu->rdma == NULL)
+		return;
+
+	conn = xu->rdma;
+	(void) atomic_inc_uint64_t(&conn->requests);
+	if (atomic_fetch_uint32_t(&xprt->xp_requests) + 1 >=
+	    nfs_param.rdma_param.credits)
+		(void) atomic_inc_uint64_t(&conn->credit_stalls);
+	if (lkhd->flags & NFS_LOOKAHEAD_WRITE)
+		(void) atomic_inc_uint64_t(&conn->rdma_read_reqs);
+	if (lkhd->flags & NFS_LOOKAHEAD_READ)
+		(void) atomic_inc_uint64_t(&conn->rdma_write_reqs);
+}
+
+/**
+ * @brief Snapshot the counters of all connections
+ *
+ * @param[out] stats Array of the connections, to free with gsh_free
+ *
+ * @return The number of connections.
+ */
+uint32_t nfs_rdma_get_conn_stats(struct nfs_rdma_conn_stats **stats)
+{
+	struct nfs_rdma_conn_stats *st;
+	struct glist_head *glist;
+	uint32_t n = 0;
+
+	PTHREAD_MUTEX_lock(&nfs_rdma_mtx);
+
+	st = gsh_calloc(nfs_rdma_nconns + 1, sizeof(*st));
+	glist_for_each(glist, &nfs_rdma_conns) {
+		struct nfs_rdma_conn *conn =
+			glist_entry(glist, struct nfs_rdma_conn, list);
+
+		sprint_sockaddr((sockaddr_t *) svc_getrpccaller(conn->xprt),
+				st[n].peer, sizeof(st[n].peer));
+		st[n].requests = atomic_fetch_uint64_t(&conn->requests);
+		st[n].credit_stalls =
+			atomic_fetch_uint64_t(&conn->credit_stalls);
+		st[n].rdma_read_reqs =
+			atomic_fetch_uint64_t(&conn->rdma_read_reqs);
+		st[n].rdma_write_reqs =
+			atomic_fetch_uint64_t(&conn->rdma_write_reqs);
+		++n;
+	}
+
+	PTHREAD_MUTEX_unlock(&nfs_rdma_mtx);
+
+	*stats = st;
+	return n;
+}
+
+/**
+ * @brief Set up the private data and counters of a new connection
+ *
+ * @param[in] xprt The child transport
+ */
+static void nfs_rdma_conn_init(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu =
+		alloc_gsh_xprt_private(xprt, XPRT_PRIVATE_FLAG_NONE);
+	struct nfs_rdma_conn *conn = gsh_calloc(1, sizeof(*conn));
+
+	conn->xprt = xprt;
+	xu->rdma = conn;
+	xprt->xp_u1 = xu;
+
+	PTHREAD_MUTEX_lock(&nfs_rdma_mtx);
+	glist_add_tail(&nfs_rdma_conns, &conn->list);
+	++nfs_rdma_nconns;
+	PTHREAD_MUTEX_unlock(&nfs_rdma_mtx);
+}
+
+/**
+ * @brief xprt destructor callout
+ *
+ * @param[in] xprt Transport to destroy
+ */
+static void nfs_rdma_free_user_data(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = xprt->xp_u1;
+
+	if (xu != NULL && xu->rdma != NULL) {
+		PTHREAD_MUTEX_lock(&nfs_rdma_mtx);
+		glist_del(&xu->rdma->list);
+		--nfs_rdma_nconns;
+		PTHREAD_MUTEX_unlock(&nfs_rdma_mtx);
+		gsh_free(xu->rdma);
+	}
+
+	if (xprt->xp_u2) {
+		nfs_dupreq_put_drc(xprt, xprt->xp_u2, DRC_FLAG_RELEASE);
+		xprt->xp_u2 = NULL;
+	}
+	free_gsh_xprt_private(xprt);
+}
+
 /**
  * rpc_rdma_disconnect_callback: placeholder
  *
@@ -67,46 +198,67 @@ rpc_rdma_disconnect_callback(SVCXPRT *xprt)
 void *
 nfs_rdma_dispatcher_thread(void *nullarg)
 {
+	nfs_rdma_parameter_t *param = &nfs_param.rdma_param;
+	char port[8];
 	struct rpc_rdma_attr xa = {
 		.statistics_prefix = NULL,
-		.node = "::",
-		.port = "20049",
+		.node = param->bind_addr,
+		.port = port,
 		.disconnect_cb = rpc_rdma_disconnect_callback,
 		.request_cb = thr_decode_rpc_request,
-		.sq_depth = 32,			/* default was 50 */
-		.max_send_sge = 32,		/* minimum 2 */
-		.rq_depth = 32,			/* default was 50 */
-		.max_recv_sge = 31,		/* minimum 1 */
-		.backlog = 10,			/* minimum 2 */
-		.credits = 30,			/* default 10 */
+		.sq_depth = param->sq_depth,
+		.max_send_sge = param->max_send_sge,
+		.rq_depth = param->rq_depth,
+		.max_recv_sge = param->max_recv_sge,
+		.backlog = param->backlog,
+		.credits = param->credits,
 		.destroy_on_disconnect = true,
-		.use_srq = false,
+		.use_srq = param->use_srq,
 	};
-	SVCXPRT *l_xprt = rpc_rdma_create(&xa);
+	SVCXPRT *l_xprt;
+
+	(void) snprintf(port, sizeof(port), "%" PRIu16, param->port);
 
+	/* a connection's credits must fit its own receive queue; a
+	 * shared one is sized for all of them */
+	if (!param->use_srq && param->credits > param->rq_depth)
+		LogWarn(COMPONENT_DISPATCH,
+			"NFS/RDMA Credits %" PRIu32 " exceed RQ_Depth %" PRIu32,
+			param->credits, param->rq_depth);
+
+	l_xprt = rpc_rdma_create(&xa);
 	if (!l_xprt) {
 		LogCrit(COMPONENT_DISPATCH,
 			"NFS/RDMA dispatcher could not start engine");
 		return NULL;
 	}
 	LogEvent(COMPONENT_DISPATCH,
-		"NFS/RDMA engine initialized");
+		 "NFS/RDMA engine initialized on [%s]:%s, credits %" PRIu32
+		 ", sq %" PRIu32 ", rq %" PRIu32 "%s",
+		 xa.node, port, xa.credits, xa.sq_depth, xa.rq_depth,
+		 xa.use_srq ? " (shared)" : "");
 
 	/* All clones and large allocations are done in this loop,
 	 * avoiding contention in the heap(s), serialized by the
 	 * connection_requests queue.
 	 */
 	while (l_xprt->xp_refs > 0) {
-		/* values used in Mooshika were 8*1024, 4*8*1024;
-		 * should be configurable.
-		 */
-		SVCXPRT *c_xprt = svc_rdma_create(l_xprt, 4*1024, 4*1024,
-							SVC_XPRT_FLAG_NONE);
+		/* values used in Mooshika were 8*1024, 4*8*1024 */
+		SVCXPRT *c_xprt = svc_rdma_create(l_xprt,
+						  param->send_buffer_size,
+						  param->recv_buffer_size,
+						  SVC_XPRT_FLAG_NONE);
 		if (!c_xprt) {
 			/* message already logged */
 			continue;
 		}
 
+		nfs_rdma_conn_init(c_xprt);
+
+		/* Hook xp_free_user_data (finalize/free private data) */
+		(void)SVC_CONTROL(c_xprt, SVCSET_XP_FREE_USER_DATA,
+				  nfs_rdma_free_user_data);
+
 		LogEvent(COMPONENT_DISPATCH,
 			"cloned (child) transport %p",
 			c_xprt);
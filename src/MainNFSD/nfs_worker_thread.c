@@ -42,6 +42,7 @@
 #include <sys/file.h>		/* for having FNDELAY */
 #include <sys/signal.h>
 #include <poll.h>
+#include <sys/param.h>
 #include "hashtable.h"
 #include "abstract_atomic.h"
 #include "log.h"
@@ -52,13 +53,16 @@
 #include "nfs_creds.h"
 #include "nfs_proto_functions.h"
 #include "nfs_req_queue.h"
+#include "nfs_numa.h"
 #include "nfs_dupreq.h"
 #include "nfs_file_handle.h"
 #include "fridgethr.h"
 #include "client_mgr.h"
 #include "export_mgr.h"
 #include "server_stats.h"
+#include "delayed_exec.h"
 #include "uid2grp.h"
+#include "flight_rec.h"
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
@@ -71,6 +75,35 @@ pool_t *request_pool;
 
 static struct fridgethr *worker_fridge;
 
+/* Per-NUMA-node worker pools, when Worker_NUMA_Pools is set */
+static struct fridgethr **worker_node_fridges;
+static uint32_t worker_node_nfridges;
+
+/** Seconds the pool must be quiet in a row before it shrinks */
+#define WORKER_POOL_CALM_TICKS 30
+
+/**
+ * @brief Load driven sizing of the worker pools
+ *
+ * Once a second the controller looks at how long requests waited in
+ * the queues, from the phase histograms, and how many workers are not
+ * waiting for a request.  Those are busy, and mostly blocked in the
+ * FSAL when there are many of them.  Only when requests queue up and
+ * nearly every worker is busy would more workers help, so the pool
+ * grows quickly then; it shrinks slowly once both fall well below.
+ */
+static struct {
+	bool adaptive;
+	uint32_t target;
+	uint32_t calm;		/*< Quiet ticks in a row */
+	uint64_t last_count;	/*< Queue phase totals at the last tick */
+	uint64_t last_usecs;
+	uint64_t queue_wait;
+	uint32_t busy;
+	uint64_t grown;
+	uint64_t shrunk;
+} worker_pool;
+
 const nfs_function_desc_t invalid_funcdesc = {
 	.service_function = nfs_null,
 	.free_function = nfs_null_free,
@@ -282,7 +315,7 @@ const nfs_function_desc_t nfs4_func_desc[] = {
 	 .service_function = nfs4_Compound,
 	 .free_function = nfs4_Compound_Free,
 	 .xdr_decode_func = (xdrproc_t) xdr_COMPOUND4args,
-	 .xdr_encode_func = (xdrproc_t) xdr_COMPOUND4res,
+	 .xdr_encode_func = (xdrproc_t) xdr_COMPOUND4res_extended,
 	 .funcname = "nfs4_Comp",
 	 .dispatch_behaviour = CAN_BE_DUP}
 };
@@ -702,13 +735,254 @@ const nfs_function_desc_t *nfs_rpc_get_funcdesc(nfs_request_t *reqnfs)
 	return funcdesc;
 }
 
+/**
+ * @brief Release the resources held by a request
+ *
+ * @param[in,out] reqdata	NFS request
+ *
+ */
+static void nfs_rpc_release_request(request_data_t *reqdata)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	gsh_xprt_private_t *xu = reqdata->r_u.req.svc.rq_xprt->xp_u1;
+
+	/* Free the allocated resources once the work is done */
+	/* Free the arguments */
+	if ((reqdata->r_u.req.svc.rq_msg.cb_vers == 2)
+	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 3)
+	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 4)) {
+		if (!SVC_FREEARGS(&reqdata->r_u.req.svc,
+				  reqdesc->xdr_decode_func,
+				  (caddr_t) &reqdata->r_u.req.arg_nfs)) {
+			LogCrit(COMPONENT_DISPATCH,
+				"NFS DISPATCHER: FAILURE: Bad SVC_FREEARGS for %s",
+				reqdesc->funcname);
+		}
+	}
+
+	/* Finalize the request. */
+	if (reqdata->r_u.req.res_nfs)
+		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
+
+	SetClientIP(NULL);
+	if (op_ctx->client != NULL) {
+		/* The connection's client was borrowed, not referenced */
+		if (xu == NULL || op_ctx->client != xu->client)
+			put_gsh_client(op_ctx->client);
+		op_ctx->client = NULL;
+	}
+	if (op_ctx->ctx_export != NULL) {
+		put_gsh_export(op_ctx->ctx_export);
+		op_ctx->ctx_export = NULL;
+	}
+	clean_credentials();
+	op_ctx = NULL;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, end, reqdata);
+#endif
+
+	if (flight_rec_enabled) {
+		struct timespec time_done;
+
+		now(&time_done);
+		/* requests executed by the decoder were never queued */
+		flight_rec_event(FR_RPC_END,
+				 reqdata->r_u.req.svc.rq_msg.rm_xid,
+				 reqdata->r_u.req.svc.rq_msg.cb_proc, 0,
+				 timespec_diff(reqdata->time_queued.tv_sec != 0
+					       ? &reqdata->time_queued
+					       : &reqdata->time_dequeued,
+					       &time_done));
+	}
+}
+
+/**
+ * @brief Account for the end of one phase of a request
+ *
+ * @param[in] reqdata	NFS request
+ * @param[in] phase	The phase that ended
+ * @param[in] start	When it began
+ * @param[in] end	When it ended
+ */
+static inline void nfs_rpc_phase_done(request_data_t *reqdata,
+				      enum nfs_req_phase phase,
+				      struct timespec *start,
+				      struct timespec *end)
+{
+	nsecs_elapsed_t elapsed = timespec_diff(start, end);
+
+	server_stats_req_phase_done(phase, elapsed);
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, phase, reqdata, phase, elapsed);
+#endif
+
+	flight_rec(FR_RPC_PHASE, reqdata->r_u.req.svc.rq_msg.rm_xid, phase, 0,
+		   elapsed);
+}
+
+/**
+ * @brief Send the result of a request and release it
+ *
+ * @param[in,out] reqdata	NFS request
+ * @param[in]     rc		NFS_REQ_OK or NFS_REQ_DROP
+ *
+ */
+static void nfs_rpc_complete_request(request_data_t *reqdata, int rc)
+{
+	const char *client_ip = "<unknown client>";
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	nfs_res_t *res_nfs = reqdata->r_u.req.res_nfs;
+	struct timespec time_replied;
+
+	if (op_ctx->client != NULL)
+		client_ip = op_ctx->client->hostaddr_str;
+
+/* NFSv4 stats are handled in nfs4_compound()
+ */
+	if (reqdata->r_u.req.svc.rq_msg.cb_prog != NFS_program[P_NFS]
+	    || reqdata->r_u.req.svc.rq_msg.cb_vers != NFS_V4)
+		server_stats_nfs_done(reqdata, rc, false);
+
+	/* If request is dropped, no return to the client */
+	if (rc == NFS_REQ_DROP) {
+		/* The request was dropped */
+		LogDebug(COMPONENT_DISPATCH,
+			 "Drop request rpc_xid=%" PRIu32
+			 ", program %" PRIu32
+			 ", version %" PRIu32
+			 ", function %" PRIu32,
+			 reqdata->r_u.req.svc.rq_msg.rm_xid,
+			 reqdata->r_u.req.svc.rq_msg.cb_prog,
+			 reqdata->r_u.req.svc.rq_msg.cb_vers,
+			 reqdata->r_u.req.svc.rq_msg.cb_proc);
+
+		/* If the request is not normally cached, then the entry
+		 * will be removed later.  We only remove a reply that is
+		 * normally cached that has been dropped.
+		 */
+		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
+		    != DUPREQ_SUCCESS) {
+			LogCrit(COMPONENT_DISPATCH,
+				"Attempt to delete duplicate request failed on line %d",
+				__LINE__);
+		}
+		goto freeargs;
+	} else {
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "Before svc_sendreply on socket %d", xprt->xp_fd);
+
+		nfs_rpc_reply_cork(xprt);
+
+		/* encoding the result on xdr output */
+		if (!svc_sendreply(&reqdata->r_u.req.svc,
+				   reqdesc->xdr_encode_func,
+				   (caddr_t) res_nfs)) {
+			LogDebug(COMPONENT_DISPATCH,
+				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request."
+				 " rpcxid=%" PRIu32
+				 " socket=%d function:%s client:%s"
+				 " program:%" PRIu32
+				 " nfs version:%" PRIu32
+				 " proc:%" PRIu32
+				 " errno: %d",
+				 reqdata->r_u.req.svc.rq_msg.rm_xid,
+				 xprt->xp_fd,
+				 reqdesc->funcname,
+				 client_ip,
+				 reqdata->r_u.req.svc.rq_msg.cb_prog,
+				 reqdata->r_u.req.svc.rq_msg.cb_vers,
+				 reqdata->r_u.req.svc.rq_msg.cb_proc,
+				 errno);
+			if (xprt->xp_type != XPRT_UDP)
+				svc_destroy(xprt);
+			goto freeargs;
+		}
+
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "After svc_sendreply on socket %d", xprt->xp_fd);
+
+		/* requests refused before reaching the service function
+		 * have no reply phase of their own */
+		if (reqdata->time_serviced.tv_sec != 0) {
+			now(&time_replied);
+			nfs_rpc_phase_done(reqdata, NFS_REQ_PHASE_REPLY,
+					   &reqdata->time_serviced,
+					   &time_replied);
+		}
+	}			/* rc == NFS_REQ_DROP */
+
+	/* Finish the request, it was not deleted above */
+	(void) nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
+
+ freeargs:
+	server_stats_cpu_done();
+	nfs_rpc_release_request(reqdata);
+}
+
+/**
+ * @brief Requeue a request once its caller's groups are known
+ *
+ * @param[in] waiter The request's waiter
+ */
+static void nfs_rpc_gids_resolved(struct uid2grp_waiter *waiter)
+{
+	nfs_rpc_enqueue_req(container_of(waiter, request_data_t,
+					 r_u.req.gids_wait));
+}
+
+/**
+ * @brief Put a request aside while its caller's groups are looked up
+ *
+ * With Manage_Gids, the groups of an AUTH_SYS caller not in the cache
+ * are looked up by the uid2grp threads rather than on the worker, which
+ * would otherwise sit in the name service.  Once they are in the
+ * transport's memo the request is requeued and starts over.
+ *
+ * @param[in,out] reqdata NFS request
+ *
+ * @return true if the request has been parked.
+ */
+static bool nfs_rpc_park_gids(request_data_t *reqdata)
+{
+	struct svc_req *req = &reqdata->r_u.req.svc;
+	gsh_xprt_private_t *xu = req->rq_xprt->xp_u1;
+	struct authunix_parms *creds;
+
+	if (reqdata->r_u.req.gids_wait.parked) {
+		/* Back from the lookup, whichever way it went */
+		reqdata->r_u.req.gids_wait.parked = false;
+		return false;
+	}
+
+	if (req->rq_msg.cb_cred.oa_flavor != AUTH_SYS ||
+	    req->rq_msg.cb_proc == 0 || xu == NULL)
+		return false;
+
+	creds = (struct authunix_parms *)req->rq_msg.rq_cred_body;
+	reqdata->r_u.req.gids_wait.done = nfs_rpc_gids_resolved;
+
+	return uid2grp_park(&xu->gids, creds->aup_uid,
+			    &reqdata->r_u.req.gids_wait);
+}
+
 /**
  * @brief Main RPC dispatcher routine
  *
+ * A request whose processing is suspended on asynchronous I/O is
+ * requeued by the completion and passed in again, in which case it is
+ * resumed where it left off.  One parked before it started, waiting for
+ * its caller's groups, is passed in again from the start.
+ *
  * @param[in,out] reqdata	NFS request
  *
+ * @retval NFS_REQ_ASYNC_WAIT if the request has been suspended; the
+ *         caller must not touch reqdata.
+ * @retval NFS_REQ_OK otherwise, reqdata is done with.
  */
-void nfs_rpc_execute(request_data_t *reqdata)
+int nfs_rpc_execute(request_data_t *reqdata)
 {
 	const char *client_ip = "<unknown client>";
 	const char *progname = "unknown";
@@ -716,9 +990,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
 	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
 	nfs_res_t *res_nfs;
-	struct export_perms export_perms;
-	struct user_cred user_credentials;
-	struct req_op_context req_ctx;
+	struct export_perms *export_perms = &reqdata->r_u.req.export_perms;
 	dupreq_status_t dpq_status;
 	struct timespec timer_start;
 	enum auth_stat auth_rc;
@@ -728,10 +1000,43 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	int exportid = -1;
 #endif /* _USE_NFS3 */
 
+	if (reqdata->r_u.req.resume_fn != NULL) {
+		/* Pick up a suspended request where it left off */
+		op_ctx = &reqdata->r_u.req.req_ctx;
+		if (op_ctx->client != NULL)
+			SetClientIP(op_ctx->client->hostaddr_str);
+
+		/* The CPU time before the request was suspended was spent
+		 * by another thread, and is not accounted */
+		op_ctx->cpu_start = server_stats_cpu_now();
+
+		rc = reqdata->r_u.req.resume_fn(&reqdata->r_u.req);
+		if (rc == NFS_REQ_ASYNC_WAIT)
+			goto async_wait;
+
+		/* the suspended time is part of the service phase */
+		now(&reqdata->time_serviced);
+		nfs_rpc_phase_done(reqdata, NFS_REQ_PHASE_SERVICE,
+				   &reqdata->time_service,
+				   &reqdata->time_serviced);
+
+		nfs_rpc_complete_request(reqdata, rc);
+		return NFS_REQ_OK;
+	}
+
+	/* Nothing has been set up yet, the request is simply requeued */
+	if (nfs_rpc_park_gids(reqdata))
+		return NFS_REQ_ASYNC_WAIT;
+
 #ifdef USE_LTTNG
 	tracepoint(nfs_rpc, start, reqdata);
 #endif
 
+	flight_rec(FR_RPC_START, reqdata->r_u.req.svc.rq_msg.rm_xid,
+		   reqdata->r_u.req.svc.rq_msg.cb_proc, 0,
+		   (uint64_t)reqdata->r_u.req.svc.rq_msg.cb_prog << 32 |
+		   reqdata->r_u.req.svc.rq_msg.cb_vers);
+
 #if defined(HAVE_BLKIN)
 	BLKIN_TIMESTAMP(
 		&reqdata->r_u.req.svc.bl_trace,
@@ -741,14 +1046,14 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 	/* set up the request context
 	 */
-	memset(&export_perms, 0, sizeof(export_perms));
-	memset(&req_ctx, 0, sizeof(req_ctx));
-	op_ctx = &req_ctx;
-	op_ctx->creds = &user_credentials;
+	memset(export_perms, 0, sizeof(*export_perms));
+	memset(&reqdata->r_u.req.req_ctx, 0, sizeof(reqdata->r_u.req.req_ctx));
+	op_ctx = &reqdata->r_u.req.req_ctx;
+	op_ctx->creds = &reqdata->r_u.req.user_credentials;
 	op_ctx->caller_addr = (sockaddr_t *)svc_getrpccaller(xprt);
 	op_ctx->nfs_vers = reqdata->r_u.req.svc.rq_msg.cb_vers;
 	op_ctx->req_type = reqdata->rtype;
-	op_ctx->export_perms = &export_perms;
+	op_ctx->export_perms = export_perms;
 
 	/* Set up initial export permissions that don't allow anything. */
 	export_check_access();
@@ -759,10 +1064,18 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	 */
 	now(&timer_start);
 	op_ctx->start_time = timespec_diff(&ServerBootTime, &timer_start);
+	op_ctx->cpu_start = server_stats_cpu_now();
 	op_ctx->queue_wait =
 	    op_ctx->start_time - timespec_diff(&ServerBootTime,
 					       &reqdata->time_queued);
 
+	/* requests executed by the decoder were never queued */
+	reqdata->time_dequeued = timer_start;
+	if (reqdata->time_queued.tv_sec != 0)
+		nfs_rpc_phase_done(reqdata, NFS_REQ_PHASE_QUEUE,
+				   &reqdata->time_queued,
+				   &reqdata->time_dequeued);
+
 	/* Initialized user_credentials */
 	init_credentials();
 
@@ -776,7 +1089,17 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	 * xprt private data. */
 
 	port = get_port(op_ctx->caller_addr);
-	op_ctx->client = get_gsh_client(op_ctx->caller_addr, false);
+
+	/* A TCP connection holds its client for as long as it lives, so
+	 * its requests use it without a lookup or a reference of their
+	 * own.  Export access decisions are cached on the client, so
+	 * they come along.
+	 */
+	if (xprt->xp_u1 != NULL &&
+	    ((gsh_xprt_private_t *) xprt->xp_u1)->client != NULL)
+		op_ctx->client = ((gsh_xprt_private_t *) xprt->xp_u1)->client;
+	else
+		op_ctx->client = get_gsh_client(op_ctx->caller_addr, false);
 	if (op_ctx->client == NULL) {
 		LogDebug(COMPONENT_DISPATCH,
 			 "Cannot get client block for Program %" PRIu32
@@ -1057,7 +1380,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 		export_check_access();
 
-		if ((export_perms.options & EXPORT_OPTION_ACCESS_MASK) == 0) {
+		if ((export_perms->options & EXPORT_OPTION_ACCESS_MASK) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Client %s is not allowed to access Export_Id %d %s"
 				", vers=%" PRIu32
@@ -1072,7 +1395,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			goto auth_failure;
 		}
 
-		if ((EXPORT_OPTION_NFSV3 & export_perms.options) == 0) {
+		if ((EXPORT_OPTION_NFSV3 & export_perms->options) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" not allowed on Export_Id %d %s for client %s",
@@ -1088,9 +1411,9 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 		/* Check transport type */
 		if (((xprt_type == XPRT_UDP)
-		     && ((export_perms.options & EXPORT_OPTION_UDP) == 0))
+		     && ((export_perms->options & EXPORT_OPTION_UDP) == 0))
 		    || ((xprt_type == XPRT_TCP)
-			&& ((export_perms.options & EXPORT_OPTION_TCP) == 0))) {
+			&& ((export_perms->options & EXPORT_OPTION_TCP) == 0))) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" over %s not allowed on Export_Id %d %s for client %s",
@@ -1124,7 +1447,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		/* Check if client is using a privileged port,
 		 * but only for NFS protocol */
 		if ((reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
-		 && (export_perms.options & EXPORT_OPTION_PRIVILEGED_PORT)
+		 && (export_perms->options & EXPORT_OPTION_PRIVILEGED_PORT)
 		 && (port >= IPPORT_RESERVED)) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Non-reserved Port %d is not allowed on Export_Id %d %s for client %s",
@@ -1143,7 +1466,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	 */
 	if (op_ctx->ctx_export != NULL
 	    && (reqdesc->dispatch_behaviour & MAKES_IO)
-	    && !(export_perms.options & EXPORT_OPTION_RW_ACCESS)) {
+	    && !(export_perms->options & EXPORT_OPTION_RW_ACCESS)) {
 		/* Request of type MDONLY_RO were rejected at the
 		 * nfs_rpc_dispatcher level.
 		 * This is done by replying EDQUOT
@@ -1175,7 +1498,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		}
 	} else if (op_ctx->ctx_export != NULL
 		   && (reqdesc->dispatch_behaviour & MAKES_WRITE)
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_WRITE_ACCESS
 			| EXPORT_OPTION_MD_WRITE_ACCESS)) == 0) {
 		if (reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
@@ -1202,7 +1525,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			rc = NFS_REQ_DROP;
 		}
 	} else if (op_ctx->ctx_export != NULL
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_READ_ACCESS
 			 | EXPORT_OPTION_MD_READ_ACCESS)) == 0) {
 		LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
@@ -1222,7 +1545,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				/* If NEEDS_CRED and not NEEDS_EXPORT,
 				 * don't squash
 				 */
-				export_perms.options = EXPORT_OPTION_ROOT;
+				export_perms->options = EXPORT_OPTION_ROOT;
 			}
 
 			if (nfs_req_creds(&reqdata->r_u.req.svc) != NFS4_OK) {
@@ -1268,6 +1591,11 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			    ? op_ctx->ctx_export->export_id : -1));
 #endif
 
+		flight_rec(FR_RPC_OP_START, reqdata->r_u.req.svc.rq_msg.rm_xid,
+			   reqdata->r_u.req.svc.rq_msg.cb_proc, 0,
+			   op_ctx->ctx_export != NULL
+			   ? op_ctx->ctx_export->export_id : -1);
+
 #if defined(HAVE_BLKIN)
 		BLKIN_TIMESTAMP(
 			&reqdata->r_u.req.svc.bl_trace,
@@ -1288,13 +1616,32 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			(op_ctx->ctx_export != NULL)
 			? op_ctx->ctx_export->export_id : -1);
 #endif
+		now(&reqdata->time_service);
+		nfs_rpc_phase_done(reqdata, NFS_REQ_PHASE_SETUP,
+				   &reqdata->time_dequeued,
+				   &reqdata->time_service);
+
 		rc = reqdesc->service_function(arg_nfs, &reqdata->r_u.req.svc,
 					res_nfs);
 
+		if (rc != NFS_REQ_ASYNC_WAIT) {
+			now(&reqdata->time_serviced);
+			nfs_rpc_phase_done(reqdata, NFS_REQ_PHASE_SERVICE,
+					   &reqdata->time_service,
+					   &reqdata->time_serviced);
+		}
+
 #ifdef USE_LTTNG
 	tracepoint(nfs_rpc, op_end, reqdata);
 #endif
 
+		if (rc != NFS_REQ_ASYNC_WAIT)
+			flight_rec(FR_RPC_OP_END,
+				   reqdata->r_u.req.svc.rq_msg.rm_xid,
+				   reqdata->r_u.req.svc.rq_msg.cb_proc, rc,
+				   timespec_diff(&reqdata->time_service,
+						 &reqdata->time_serviced));
+
 #if defined(HAVE_BLKIN)
 		BLKIN_TIMESTAMP(
 			&reqdata->r_u.req.svc.bl_trace,
@@ -1303,78 +1650,14 @@ void nfs_rpc_execute(request_data_t *reqdata)
 #endif
 	}
 
+	if (rc == NFS_REQ_ASYNC_WAIT)
+		goto async_wait;
+
 #ifdef _USE_NFS3
  req_error:
 #endif /* _USE_NFS3 */
-
-/* NFSv4 stats are handled in nfs4_compound()
- */
-	if (reqdata->r_u.req.svc.rq_msg.cb_prog != NFS_program[P_NFS]
-	    || reqdata->r_u.req.svc.rq_msg.cb_vers != NFS_V4)
-		server_stats_nfs_done(reqdata, rc, false);
-
-	/* If request is dropped, no return to the client */
-	if (rc == NFS_REQ_DROP) {
-		/* The request was dropped */
-		LogDebug(COMPONENT_DISPATCH,
-			 "Drop request rpc_xid=%" PRIu32
-			 ", program %" PRIu32
-			 ", version %" PRIu32
-			 ", function %" PRIu32,
-			 reqdata->r_u.req.svc.rq_msg.rm_xid,
-			 reqdata->r_u.req.svc.rq_msg.cb_prog,
-			 reqdata->r_u.req.svc.rq_msg.cb_vers,
-			 reqdata->r_u.req.svc.rq_msg.cb_proc);
-
-		/* If the request is not normally cached, then the entry
-		 * will be removed later.  We only remove a reply that is
-		 * normally cached that has been dropped.
-		 */
-		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
-		    != DUPREQ_SUCCESS) {
-			LogCrit(COMPONENT_DISPATCH,
-				"Attempt to delete duplicate request failed on line %d",
-				__LINE__);
-		}
-		goto freeargs;
-	} else {
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "Before svc_sendreply on socket %d", xprt->xp_fd);
-
-		/* encoding the result on xdr output */
-		if (!svc_sendreply(&reqdata->r_u.req.svc,
-				   reqdesc->xdr_encode_func,
-				   (caddr_t) res_nfs)) {
-			LogDebug(COMPONENT_DISPATCH,
-				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request."
-				 " rpcxid=%" PRIu32
-				 " socket=%d function:%s client:%s"
-				 " program:%" PRIu32
-				 " nfs version:%" PRIu32
-				 " proc:%" PRIu32
-				 " errno: %d",
-				 reqdata->r_u.req.svc.rq_msg.rm_xid,
-				 xprt->xp_fd,
-				 reqdesc->funcname,
-				 client_ip,
-				 reqdata->r_u.req.svc.rq_msg.cb_prog,
-				 reqdata->r_u.req.svc.rq_msg.cb_vers,
-				 reqdata->r_u.req.svc.rq_msg.cb_proc,
-				 errno);
-			if (xprt->xp_type != XPRT_UDP)
-				svc_destroy(xprt);
-			goto freeargs;
-		}
-
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "After svc_sendreply on socket %d", xprt->xp_fd);
-
-	}			/* rc == NFS_REQ_DROP */
-
-	/* Finish any request not already deleted */
-	if (dpq_status == DUPREQ_SUCCESS)
-		dpq_status = nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
-	goto freeargs;
+	nfs_rpc_complete_request(reqdata, rc);
+	return NFS_REQ_OK;
 
 	/* Reject the request for authentication reason (incompatible
 	 * file handle) */
@@ -1401,39 +1684,15 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	}
 
  freeargs:
-	/* Free the allocated resources once the work is done */
-	/* Free the arguments */
-	if ((reqdata->r_u.req.svc.rq_msg.cb_vers == 2)
-	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 3)
-	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 4)) {
-		if (!SVC_FREEARGS(&reqdata->r_u.req.svc,
-				  reqdesc->xdr_decode_func,
-				  (caddr_t) arg_nfs)) {
-			LogCrit(COMPONENT_DISPATCH,
-				"NFS DISPATCHER: FAILURE: Bad SVC_FREEARGS for %s",
-				reqdesc->funcname);
-		}
-	}
-
-	/* Finalize the request. */
-	if (res_nfs)
-		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
+	nfs_rpc_release_request(reqdata);
+	return NFS_REQ_OK;
 
+ async_wait:
+	/* Another worker may already own the request, only clean up
+	 * this thread's state. */
 	SetClientIP(NULL);
-	if (op_ctx->client != NULL) {
-		put_gsh_client(op_ctx->client);
-		op_ctx->client = NULL;
-	}
-	if (op_ctx->ctx_export != NULL) {
-		put_gsh_export(op_ctx->ctx_export);
-		op_ctx->ctx_export = NULL;
-	}
-	clean_credentials();
 	op_ctx = NULL;
-
-#ifdef USE_LTTNG
-	tracepoint(nfs_rpc, end, reqdata);
-#endif
+	return NFS_REQ_ASYNC_WAIT;
 }
 
 #ifdef _USE_9P
@@ -1474,7 +1733,7 @@ static void _9p_execute(request_data_t *reqdata)
 static void _9p_free_reqdata(struct _9p_request_data *req9p)
 {
 	if (req9p->pconn->trans_type == _9P_TCP)
-		gsh_free(req9p->_9pmsg);
+		_9p_tcp_buf_put(req9p->pconn, req9p->_9pmsg);
 
 	/* decrease connection refcount */
 	(void) atomic_dec_uint32_t(&req9p->pconn->refcount);
@@ -1500,6 +1759,11 @@ static void worker_thread_initializer(struct fridgethr_context *ctx)
 
 	/* Initalize thr waitq */
 	init_wait_q_entry(&wd->wqe);
+
+	/* node pools pass their node index as the thread argument */
+	if (ctx->arg != NULL)
+		(void) nfs_numa_bind_self(
+			(uint32_t) ((uintptr_t) ctx->arg - 1));
 }
 
 /**
@@ -1546,8 +1810,11 @@ static void worker_run(struct fridgethr_context *ctx)
 				"Unexpected unknown request");
 			break;
 		case NFS_REQUEST:
-			/* check for destroyed xprts */
-			if (reqdata->r_u.req.svc.rq_xprt->
+			/* check for destroyed xprts, a resumed request
+			 * still has to be completed to release what it
+			 * holds */
+			if (reqdata->r_u.req.resume_fn == NULL &&
+			    reqdata->r_u.req.svc.rq_xprt->
 			    xp_flags & SVC_XPRT_FLAG_DESTROYED) {
 				/* Idempotent: once set, the DESTROYED flag
 				 * is never cleared. No lock needed.
@@ -1560,7 +1827,11 @@ static void worker_run(struct fridgethr_context *ctx)
 				 reqdata,
 				 reqdata->r_u.req.svc.rq_xprt,
 				 reqdata->r_u.req.svc.rq_xprt->xp_requests);
-			nfs_rpc_execute(reqdata);
+			if (nfs_rpc_execute(reqdata) == NFS_REQ_ASYNC_WAIT) {
+				/* Requeued by the I/O completion, which
+				 * now owns reqdata and its xprt ref */
+				continue;
+			}
 			break;
 
 		case NFS_CALL:
@@ -1582,10 +1853,9 @@ static void worker_run(struct fridgethr_context *ctx)
 
 		switch (reqdata->rtype) {
 		case NFS_REQUEST:
-			/* adjust request count and return xprt ref */
-			gsh_xprt_unref(reqdata->r_u.req.svc.rq_xprt,
-				       XPRT_PRIVATE_FLAG_DECREQ, __func__,
-				       __LINE__);
+			/* adjust request count and budgets, return
+			 * xprt ref */
+			nfs_rpc_req_done(reqdata);
 			break;
 		case NFS_CALL:
 			break;
@@ -1604,6 +1874,192 @@ static void worker_run(struct fridgethr_context *ctx)
 
 		pool_free(request_pool, reqdata);
 	}
+
+	nfs_rpc_q_hl_exit(&worker_data->high_latency);
+}
+
+/**
+ * @brief Share of a worker count for one NUMA node pool
+ *
+ * @param[in] nthr Threads for the whole server
+ * @param[in] ix   Index of the node
+ *
+ * @return Threads for the node, in proportion to its CPUs, at least one.
+ */
+static uint32_t worker_node_share(uint32_t nthr, uint32_t ix)
+{
+	uint32_t total_cpus = 0;
+	uint32_t jx;
+
+	for (jx = 0; jx < nfs_numa.nnodes; ++jx)
+		total_cpus += nfs_numa.nodes[jx].ncpus;
+
+	nthr = ((uint64_t) nthr * nfs_numa.nodes[ix].ncpus) / total_cpus;
+	return nthr == 0 ? 1 : nthr;
+}
+
+static uint32_t worker_pool_nthreads(void)
+{
+	uint32_t ix, nthreads = 0;
+
+	if (worker_fridge != NULL)
+		nthreads = atomic_fetch_uint32_t(&worker_fridge->nthreads);
+
+	for (ix = 0; ix < worker_node_nfridges; ++ix)
+		nthreads += atomic_fetch_uint32_t(
+			&worker_node_fridges[ix]->nthreads);
+
+	return nthreads;
+}
+
+static void worker_pool_resize(uint32_t nthr)
+{
+	uint32_t ix;
+
+	if (worker_fridge != NULL)
+		(void) fridgethr_resize(worker_fridge, nthr, worker_run, NULL);
+
+	for (ix = 0; ix < worker_node_nfridges; ++ix)
+		(void) fridgethr_resize(worker_node_fridges[ix],
+					worker_node_share(nthr, ix),
+					worker_run,
+					(void *) ((uintptr_t) ix + 1));
+
+	/* idle surplus workers notice on their next wake up */
+	if (nthr < worker_pool_nthreads())
+		nfs_rpc_queue_awaken(&nfs_req_st);
+}
+
+/**
+ * @brief Resize the worker pools to the load, once a second
+ */
+static void worker_pool_tick(void *arg)
+{
+	uint64_t target_wait = NFS_pcp.worker_queue_wait_target;
+	uint32_t nthreads = worker_pool_nthreads();
+	uint32_t target = worker_pool.target;
+	uint64_t count, usecs;
+	uint32_t waiters;
+
+	server_stats_req_phase_sum(NFS_REQ_PHASE_QUEUE, &count, &usecs);
+	worker_pool.queue_wait = count > worker_pool.last_count
+		? (usecs - worker_pool.last_usecs) /
+		  (count - worker_pool.last_count)
+		: 0;
+	worker_pool.last_count = count;
+	worker_pool.last_usecs = usecs;
+
+	waiters = atomic_fetch_uint32_t(&nfs_req_st.reqs.waiters);
+	worker_pool.busy = nthreads > waiters ? nthreads - waiters : 0;
+
+	if (worker_pool.queue_wait > target_wait &&
+	    worker_pool.busy * 10 >= nthreads * 9) {
+		/* every worker is tied up and requests pile up */
+		worker_pool.calm = 0;
+		target += MAX(target / 4, 1);
+	} else if (worker_pool.queue_wait < target_wait / 4 &&
+		   worker_pool.busy * 2 < nthreads) {
+		if (++worker_pool.calm >= WORKER_POOL_CALM_TICKS) {
+			worker_pool.calm = 0;
+			target -= MAX(target / 8, 1);
+		}
+	} else {
+		worker_pool.calm = 0;
+	}
+
+	target = MIN(MAX(target, NFS_pcp.nb_worker_min), NFS_pcp.nb_worker_max);
+	if (target != worker_pool.target) {
+		LogEvent(COMPONENT_DISPATCH,
+			 "Resizing worker pool from %" PRIu32 " to %" PRIu32
+			 " threads, %" PRIu32 " busy, queue wait %" PRIu64
+			 " usecs",
+			 worker_pool.target, target, worker_pool.busy,
+			 worker_pool.queue_wait);
+		if (target > worker_pool.target)
+			++worker_pool.grown;
+		else
+			++worker_pool.shrunk;
+		worker_pool.target = target;
+		worker_pool_resize(target);
+	}
+
+	(void) delayed_submit(worker_pool_tick, NULL, NS_PER_SEC);
+}
+
+void worker_pool_get_stats(struct worker_pool_stats *st)
+{
+	st->adaptive = worker_pool.adaptive;
+	st->min = NFS_pcp.nb_worker_min;
+	st->max = NFS_pcp.nb_worker_max;
+	st->target = worker_pool.adaptive ? worker_pool.target
+					  : NFS_pcp.nb_worker;
+	st->nthreads = worker_pool_nthreads();
+	st->busy = worker_pool.busy;
+	st->queue_wait = worker_pool.queue_wait;
+	st->grown = worker_pool.grown;
+	st->shrunk = worker_pool.shrunk;
+}
+
+/**
+ * @brief Start one worker pool per NUMA node
+ *
+ * Nb_Worker is split across the nodes in proportion to their CPU
+ * count.  Each pool's threads are bound to their node's CPUs.
+ *
+ * @param[in] frp Template fridge parameters
+ *
+ * @return 0 or an errno value.
+ */
+static int worker_init_numa(struct fridgethr_params *frp)
+{
+	uint32_t ix;
+	int rc = 0;
+
+	worker_node_nfridges = nfs_numa.nnodes;
+	worker_node_fridges = gsh_calloc(worker_node_nfridges,
+					 sizeof(struct fridgethr *));
+
+	for (ix = 0; ix < worker_node_nfridges; ++ix) {
+		char name[16];
+		uint32_t nthr = worker_node_share(NFS_pcp.nb_worker, ix);
+
+		if (worker_pool.adaptive) {
+			/* start at the minimum, grown below */
+			frp->thr_min = worker_node_share(NFS_pcp.nb_worker_min,
+							 ix);
+			frp->thr_max = worker_node_share(NFS_pcp.nb_worker_max,
+							 ix);
+		} else {
+			frp->thr_max = nthr;
+			frp->thr_min = nthr;
+		}
+		snprintf(name, sizeof(name), "Wrk%u", nfs_numa.nodes[ix].id);
+
+		rc = fridgethr_init(&worker_node_fridges[ix], name, frp);
+		if (rc != 0) {
+			LogMajor(COMPONENT_DISPATCH,
+				 "Unable to initialize worker fridge %s: %d",
+				 name, rc);
+			return rc;
+		}
+
+		/* the argument is the node index + 1 so NULL means
+		 * unbound */
+		rc = fridgethr_populate(worker_node_fridges[ix], worker_run,
+					(void *) ((uintptr_t) ix + 1));
+		if (rc != 0) {
+			LogMajor(COMPONENT_DISPATCH,
+				 "Unable to populate worker fridge %s: %d",
+				 name, rc);
+			return rc;
+		}
+
+		LogInfo(COMPONENT_DISPATCH,
+			"Started %u workers on NUMA node %u",
+			frp->thr_min, nfs_numa.nodes[ix].id);
+	}
+
+	return 0;
 }
 
 int worker_init(void)
@@ -1612,14 +2068,27 @@ int worker_init(void)
 	int rc = 0;
 
 	memset(&frp, 0, sizeof(struct fridgethr_params));
-	frp.thr_max = nfs_param.core_param.nb_worker;
-	frp.thr_min = nfs_param.core_param.nb_worker;
+	frp.thr_max = NFS_pcp.nb_worker;
+	frp.thr_min = NFS_pcp.nb_worker;
 	frp.flavor = fridgethr_flavor_looper;
 	frp.thread_initialize = worker_thread_initializer;
 	frp.thread_finalize = worker_thread_finalizer;
 	frp.wake_threads = nfs_rpc_queue_awaken;
 	frp.wake_threads_arg = &nfs_req_st;
 
+	worker_pool.adaptive = NFS_pcp.nb_worker_min != 0 &&
+			       NFS_pcp.nb_worker_max > NFS_pcp.nb_worker_min;
+	if (worker_pool.adaptive) {
+		/* start at the minimum, grown below */
+		frp.thr_min = NFS_pcp.nb_worker_min;
+		frp.thr_max = NFS_pcp.nb_worker_max;
+	}
+
+	if (nfs_param.core_param.worker_numa_pools && nfs_numa.nnodes > 1) {
+		rc = worker_init_numa(&frp);
+		goto adapt;
+	}
+
 	rc = fridgethr_init(&worker_fridge, "Wrk", &frp);
 	if (rc != 0) {
 		LogMajor(COMPONENT_DISPATCH,
@@ -1634,22 +2103,54 @@ int worker_init(void)
 			 "Unable to populate worker fridge: %d", rc);
 	}
 
+ adapt:
+	if (rc == 0 && worker_pool.adaptive) {
+		worker_pool.target = MIN(MAX(NFS_pcp.nb_worker,
+					     NFS_pcp.nb_worker_min),
+					 NFS_pcp.nb_worker_max);
+		worker_pool_resize(worker_pool.target);
+		LogInfo(COMPONENT_DISPATCH,
+			"Sizing worker pool between %" PRIu32 " and %" PRIu32
+			" threads, starting at %" PRIu32,
+			NFS_pcp.nb_worker_min, NFS_pcp.nb_worker_max,
+			worker_pool.target);
+		(void) delayed_submit(worker_pool_tick, NULL, NS_PER_SEC);
+	}
+
 	return rc;
 }
 
-int worker_shutdown(void)
+static int worker_shutdown_fridge(struct fridgethr *fr)
 {
-	int rc = fridgethr_sync_command(worker_fridge,
+	int rc = fridgethr_sync_command(fr,
 					fridgethr_comm_stop,
 					120);
 
 	if (rc == ETIMEDOUT) {
 		LogMajor(COMPONENT_DISPATCH,
 			 "Shutdown timed out, cancelling threads.");
-		fridgethr_cancel(worker_fridge);
+		fridgethr_cancel(fr);
 	} else if (rc != 0) {
 		LogMajor(COMPONENT_DISPATCH,
 			 "Failed shutting down worker threads: %d", rc);
 	}
 	return rc;
 }
+
+int worker_shutdown(void)
+{
+	uint32_t ix;
+	int rc = 0;
+
+	if (worker_fridge != NULL)
+		rc = worker_shutdown_fridge(worker_fridge);
+
+	for (ix = 0; ix < worker_node_nfridges; ++ix) {
+		int rc2 = worker_shutdown_fridge(worker_node_fridges[ix]);
+
+		if (rc == 0)
+			rc = rc2;
+	}
+
+	return rc;
+}
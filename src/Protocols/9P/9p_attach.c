@@ -157,7 +157,7 @@ int _9p_attach(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	get_gsh_export_ref(pfid->export);
 
 	pfid->fid = *fid;
-	req9p->pconn->fids[*fid] = pfid;
+	_9p_fid_set(req9p->pconn, *fid, pfid);
 
 	/* Is user name provided as a string or as an uid ? */
 	if (*n_uname != _9P_NONUNAME) {
@@ -123,11 +123,88 @@ static ssize_t tcp_conn_send(struct _9p_conn *conn, const void *buf, size_t len,
 	return ret;
 }
 
+/**
+ * @brief Set up the message buffers of a 9P/TCP connection
+ *
+ * Buffers are of the msize the connection starts with.  TVERSION can
+ * only lower msize, so they are always large enough for a message.
+ *
+ * @param[in] conn The connection, with its initial msize
+ */
+void _9p_tcp_bufs_init(struct _9p_conn *conn)
+{
+	PTHREAD_MUTEX_init(&conn->buf_lock, NULL);
+	conn->bufsize = conn->msize;
+	conn->nfree_bufs = 0;
+}
+
+/**
+ * @brief Get a buffer for a request or reply of a 9P/TCP connection
+ *
+ * Large msizes make these buffers too big for the heap to hand out
+ * cheaply, so a few freed ones are kept on the connection for reuse.
+ *
+ * @param[in] conn The connection
+ *
+ * @return A buffer of conn->bufsize bytes.
+ */
+char *_9p_tcp_buf_get(struct _9p_conn *conn)
+{
+	char *buf = NULL;
+
+	PTHREAD_MUTEX_lock(&conn->buf_lock);
+	if (conn->nfree_bufs > 0)
+		buf = conn->free_bufs[--conn->nfree_bufs];
+	PTHREAD_MUTEX_unlock(&conn->buf_lock);
+
+	if (buf == NULL)
+		buf = gsh_malloc(conn->bufsize);
+
+	return buf;
+}
+
+/**
+ * @brief Give back a buffer from _9p_tcp_buf_get
+ *
+ * @param[in] conn The connection
+ * @param[in] buf  The buffer, may be NULL
+ */
+void _9p_tcp_buf_put(struct _9p_conn *conn, char *buf)
+{
+	if (buf == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&conn->buf_lock);
+	if (conn->nfree_bufs < _9P_CONN_FREE_BUFS) {
+		conn->free_bufs[conn->nfree_bufs++] = buf;
+		buf = NULL;
+	}
+	PTHREAD_MUTEX_unlock(&conn->buf_lock);
+
+	gsh_free(buf);
+}
+
+/**
+ * @brief Free the buffers kept by a connection going away
+ *
+ * @param[in] conn The connection
+ */
+void _9p_tcp_bufs_fini(struct _9p_conn *conn)
+{
+	while (conn->nfree_bufs > 0)
+		gsh_free(conn->free_bufs[--conn->nfree_bufs]);
+
+	PTHREAD_MUTEX_destroy(&conn->buf_lock);
+}
+
 void _9p_tcp_process_request(struct _9p_request_data *req9p)
 {
 	u32 outdatalen = 0;
 	int rc = 0;
-	char replydata[_9P_MSG_SIZE];
+	/* RREAD data goes straight into this buffer, so it must hold
+	 * the negotiated msize rather than a fixed size.
+	 */
+	char *replydata = _9p_tcp_buf_get(req9p->pconn);
 
 	rc = _9p_process_buffer(req9p, replydata, &outdatalen);
 	if (rc != 1) {
@@ -141,6 +218,7 @@ void _9p_tcp_process_request(struct _9p_request_data *req9p)
 				 "Could not send 9P/TCP reply correctly on socket #%lu",
 				 req9p->pconn->trans_data.sockfd);
 	}
+	_9p_tcp_buf_put(req9p->pconn, replydata);
 	_9p_DiscardFlushHook(req9p);
 }				/* _9p_process_request */
 
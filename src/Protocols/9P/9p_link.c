@@ -71,7 +71,7 @@ int _9p_link(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	if (*dfid >= _9P_FID_PER_CONN)
 		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
 
-	pdfid = req9p->pconn->fids[*dfid];
+	pdfid = _9p_fid_get(req9p->pconn, *dfid);
 
 	/* Check that it is a valid fid */
 	if (pdfid == NULL || pdfid->pentry == NULL) {
@@ -88,7 +88,7 @@ int _9p_link(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	if (*targetfid >= _9P_FID_PER_CONN)
 		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
 
-	ptargetfid = req9p->pconn->fids[*targetfid];
+	ptargetfid = _9p_fid_get(req9p->pconn, *targetfid);
 	/* Check that it is a valid fid */
 	if (ptargetfid == NULL || ptargetfid->pentry == NULL) {
 		LogDebug(COMPONENT_9P, "request on invalid targetfid=%u",
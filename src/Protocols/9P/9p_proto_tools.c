@@ -440,9 +440,51 @@ int _9p_tools_clunk(struct _9p_fid *pfid)
 	return 0;
 }
 
+/**
+ * @brief Set or clear a fid of a connection
+ *
+ * The page for the fid is allocated on first use.  Pages stay until the
+ * connection goes away, so _9p_fid_get() needs no lock.
+ *
+ * @param[in] conn The connection
+ * @param[in] fid  The fid number, below _9P_FID_PER_CONN
+ * @param[in] pfid The fid, or NULL to clear it
+ */
+void _9p_fid_set(struct _9p_conn *conn, u32 fid, struct _9p_fid *pfid)
+{
+	struct _9p_fid_page **slot;
+	struct _9p_fid_page *page;
+	struct _9p_fid **fidp;
+
+	slot = &conn->fid_pages[fid >> _9P_FID_PAGE_SHIFT];
+	page = atomic_fetch_voidptr((void **)slot);
+
+	if (page == NULL) {
+		if (pfid == NULL)
+			return;
+
+		page = gsh_calloc(1, sizeof(*page));
+		if (!atomic_cas_voidptr((void **)slot, NULL, page)) {
+			/* Someone else allocated it */
+			gsh_free(page);
+			page = atomic_fetch_voidptr((void **)slot);
+		}
+	}
+
+	fidp = &page->fids[fid & (_9P_FID_PAGE_SIZE - 1)];
+
+	if (*fidp == NULL && pfid != NULL)
+		(void) atomic_inc_uint32_t(&page->nfids);
+	else if (*fidp != NULL && pfid == NULL)
+		(void) atomic_dec_uint32_t(&page->nfids);
+
+	atomic_store_voidptr((void **)fidp, pfid);
+}
+
 void _9p_cleanup_fids(struct _9p_conn *conn)
 {
-	int i;
+	struct _9p_fid_page *page;
+	int i, j;
 
 	/* Allocate op_ctx, is should always be NULL here
 	 * Note we only need it if there is a non-null fid,
@@ -450,13 +492,27 @@ void _9p_cleanup_fids(struct _9p_conn *conn)
 	 */
 	op_ctx = gsh_calloc(1, sizeof(struct req_op_context));
 
-	for (i = 0; i < _9P_FID_PER_CONN; i++) {
-		if (conn->fids[i]) {
-			_9p_init_opctx(conn->fids[i], NULL);
-			_9p_tools_clunk(conn->fids[i]);
+	/* Only pages the client used, and of those the ones still
+	 * holding fids, are looked at.
+	 */
+	for (i = 0; i < _9P_FID_PAGES; i++) {
+		page = conn->fid_pages[i];
+		if (page == NULL)
+			continue;
+
+		for (j = 0; j < _9P_FID_PAGE_SIZE && page->nfids != 0; j++) {
+			if (page->fids[j] == NULL)
+				continue;
+
+			_9p_init_opctx(page->fids[j], NULL);
+			_9p_tools_clunk(page->fids[j]);
 			_9p_release_opctx();
-			conn->fids[i] = NULL;	/* poison the entry */
+			page->fids[j] = NULL;	/* poison the entry */
+			page->nfids--;
 		}
+
+		gsh_free(page);
+		conn->fid_pages[i] = NULL;
 	}
 
 	gsh_free(op_ctx);
@@ -42,6 +42,8 @@ static struct config_item _9p_params[] = {
 		       _9p_param, _9p_rdma_port),
 	CONF_ITEM_UI32("_9P_TCP_Msize", 1024, UINT32_MAX, _9P_TCP_MSIZE,
 		       _9p_param, _9p_tcp_msize),
+	CONF_ITEM_UI32("_9P_TCP_Event_Loops", 0, 1024, _9P_TCP_EVENT_LOOPS,
+		       _9p_param, _9p_tcp_event_loops),
 	CONF_ITEM_UI32("_9P_RDMA_Msize", 1024, UINT32_MAX, _9P_RDMA_MSIZE,
 		       _9p_param, _9p_rdma_msize),
 	CONF_ITEM_UI16("_9P_RDMA_Backlog", 1, UINT16_MAX, _9P_RDMA_BACKLOG,
@@ -51,6 +53,9 @@ static struct config_item _9p_params[] = {
 	CONF_ITEM_UI16("_9P_RDMA_Outpool_Size", 1, UINT16_MAX,
 		       _9P_RDMA_OUTPOOL_SIZE,
 		       _9p_param, _9p_rdma_outpool_size),
+	CONF_ITEM_UI16("_9P_RDMA_Completion_Workers", 0, 1024,
+		       _9P_RDMA_COMPLETION_WORKERS,
+		       _9p_param, _9p_rdma_completion_workers),
 	CONFIG_EOL
 };
 
@@ -42,16 +42,43 @@
 #include "nfs_proto_functions.h"
 #include "export_mgr.h"
 
-struct proc_state {
-	exports head;
-	exports tail;
+/**
+ * @brief The exports and their clients, as EXPORT lists them
+ *
+ * Listing the clients of each export takes its lock and formats every
+ * address, for each EXPORT call.  The list is built once and kept
+ * until the export list changes.  Which exports a caller sees depends
+ * on its access, so that is still checked on each call.
+ *
+ * The directories and groups are shared by the results sent from the
+ * list, which hold a reference to it until they are freed.
+ */
+struct mnt_export_list {
+	int32_t refcnt;
+	uint32_t gen;		/*< get_gsh_export_gen() when built */
+	uint32_t count;
+	uint32_t size;
+	struct mnt_export_ent {
+		uint16_t export_id;
+		char *ex_dir;
+		struct groupnode *ex_groups;
+	} *ents;
 	int retval;
 };
 
-static bool proc_export(struct gsh_export *export, void *arg)
+/** A result, its nodes point into the list */
+struct mnt_export_res {
+	struct mnt_export_list *list;
+	struct exportnode nodes[];
+};
+
+static struct mnt_export_list *mnt_exports;
+static pthread_mutex_t mnt_exports_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static bool build_export(struct gsh_export *export, void *arg)
 {
-	struct proc_state *state = arg;
-	struct exportnode *new_expnode;
+	struct mnt_export_list *list = arg;
+	struct mnt_export_ent *ent;
 	struct glist_head *glist_item;
 	exportlist_client_entry_t *client;
 	struct groupnode *group, *grp_tail = NULL;
@@ -59,34 +86,18 @@ static bool proc_export(struct gsh_export *export, void *arg)
 	char addr_buf[INET6_ADDRSTRLEN + 1];
 	uint32_t naddr;
 
-	state->retval = 0;
-
-	/* If client does not have any access to the export,
-	 * don't add it to the list
-	 */
-	op_ctx->ctx_export = export;
-	op_ctx->fsal_export = export->fsal_export;
-	export_check_access();
-	if (!(op_ctx->export_perms->options & EXPORT_OPTION_ACCESS_MASK)) {
-		LogFullDebug(COMPONENT_NFSPROTO,
-			     "Client is not allowed to access Export_Id %d %s",
-			     export->export_id, export_path(export));
-
-		return true;
-	}
-
-	if (!(op_ctx->export_perms->options & EXPORT_OPTION_NFSV3)) {
-		LogFullDebug(COMPONENT_NFSPROTO,
-			     "Not exported for NFSv3, Export_Id %d %s",
-			     export->export_id, export_path(export));
-
-		return true;
+	if (list->count == list->size) {
+		list->size = list->size ? list->size * 2 : 16;
+		list->ents = gsh_realloc(list->ents,
+					 list->size * sizeof(*list->ents));
 	}
 
-	new_expnode = gsh_calloc(1, sizeof(struct exportnode));
-	new_expnode->ex_dir = gsh_strdup(export_path(export));
+	ent = &list->ents[list->count++];
+	ent->export_id = export->export_id;
+	ent->ex_dir = gsh_strdup(export_path(export));
+	ent->ex_groups = NULL;
 
-	PTHREAD_RWLOCK_rdlock(&op_ctx->ctx_export->lock);
+	PTHREAD_RWLOCK_rdlock(&export->lock);
 
 	glist_for_each(glist_item, &export->clients) {
 		client =
@@ -95,7 +106,7 @@ static bool proc_export(struct gsh_export *export, void *arg)
 		group = gsh_calloc(1, sizeof(struct groupnode));
 
 		if (grp_tail == NULL)
-			new_expnode->ex_groups = group;
+			ent->ex_groups = group;
 		else
 			grp_tail->gr_next = group;
 
@@ -107,7 +118,7 @@ static bool proc_export(struct gsh_export *export, void *arg)
 				      &client->client.hostif.clientaddr,
 				      addr_buf, INET6_ADDRSTRLEN);
 			if (grp_name == NULL) {
-				state->retval = errno;
+				list->retval = errno;
 				grp_name = "Invalid Host Address";
 			}
 			break;
@@ -117,7 +128,7 @@ static bool proc_export(struct gsh_export *export, void *arg)
 			    inet_ntop(AF_INET, &naddr,
 				      addr_buf, INET6_ADDRSTRLEN);
 			if (grp_name == NULL) {
-				state->retval = errno;
+				list->retval = errno;
 				grp_name = "Invalid Network Address";
 			}
 			break;
@@ -139,7 +150,7 @@ static bool proc_export(struct gsh_export *export, void *arg)
 				      &client->client.hostif.clientaddr6,
 				      addr_buf, INET6_ADDRSTRLEN);
 			if (grp_name == NULL) {
-				state->retval = errno;
+				list->retval = errno;
 				grp_name = "Invalid Host Address";
 			}
 			break;
@@ -152,17 +163,111 @@ static bool proc_export(struct gsh_export *export, void *arg)
 		group->gr_name = gsh_strdup(grp_name);
 	}
 
-	PTHREAD_RWLOCK_unlock(&op_ctx->ctx_export->lock);
-
-	if (state->head == NULL)
-		state->head = new_expnode;
-	else
-		state->tail->ex_next = new_expnode;
+	PTHREAD_RWLOCK_unlock(&export->lock);
 
-	state->tail = new_expnode;
 	return true;
 }
 
+static void put_export_list(struct mnt_export_list *list)
+{
+	struct groupnode *grp, *next_grp;
+	uint32_t i;
+
+	if (atomic_dec_int32_t(&list->refcnt) != 0)
+		return;
+
+	for (i = 0; i < list->count; i++) {
+		grp = list->ents[i].ex_groups;
+		while (grp != NULL) {
+			next_grp = grp->gr_next;
+			gsh_free(grp->gr_name);
+			gsh_free(grp);
+			grp = next_grp;
+		}
+		gsh_free(list->ents[i].ex_dir);
+	}
+	gsh_free(list->ents);
+	gsh_free(list);
+}
+
+/**
+ * @brief Get the export list, building it again if exports changed
+ *
+ * @return The list, with a reference.
+ */
+static struct mnt_export_list *get_export_list(void)
+{
+	struct mnt_export_list *list;
+	uint32_t gen;
+
+	PTHREAD_MUTEX_lock(&mnt_exports_mtx);
+
+	gen = get_gsh_export_gen();
+	if (mnt_exports == NULL || mnt_exports->gen != gen) {
+		list = gsh_calloc(1, sizeof(*list));
+		list->refcnt = 1;	/* mnt_exports */
+		list->gen = gen;
+
+		(void)foreach_gsh_export(build_export, list);
+		if (list->retval != 0) {
+			LogCrit(COMPONENT_NFSPROTO,
+				"Processing exports failed. error = \"%s\" (%d)",
+				strerror(list->retval), list->retval);
+		}
+
+		if (mnt_exports != NULL)
+			put_export_list(mnt_exports);
+		mnt_exports = list;
+	}
+
+	list = mnt_exports;
+	(void) atomic_inc_int32_t(&list->refcnt);
+
+	PTHREAD_MUTEX_unlock(&mnt_exports_mtx);
+
+	return list;
+}
+
+/**
+ * @brief Whether the caller may see an export in the EXPORT list
+ *
+ * @param[in] export_id The export
+ *
+ * @return true if the export is exported to the caller over NFSv3.
+ */
+static bool export_visible(uint16_t export_id)
+{
+	struct gsh_export *export = get_gsh_export(export_id);
+	bool visible = false;
+
+	if (export == NULL)
+		return false;
+
+	/* If client does not have any access to the export,
+	 * don't add it to the list
+	 */
+	op_ctx->ctx_export = export;
+	op_ctx->fsal_export = export->fsal_export;
+	export_check_access();
+	if (!(op_ctx->export_perms->options & EXPORT_OPTION_ACCESS_MASK)) {
+		LogFullDebug(COMPONENT_NFSPROTO,
+			     "Client is not allowed to access Export_Id %d %s",
+			     export->export_id, export_path(export));
+	} else if (!(op_ctx->export_perms->options & EXPORT_OPTION_NFSV3)) {
+		LogFullDebug(COMPONENT_NFSPROTO,
+			     "Not exported for NFSv3, Export_Id %d %s",
+			     export->export_id, export_path(export));
+	} else {
+		visible = true;
+	}
+
+	op_ctx->ctx_export = NULL;
+	op_ctx->fsal_export = NULL;
+	put_gsh_export(export);
+
+	return visible;
+}
+
 /**
  * @brief The Mount proc EXPORT function, for all versions.
  *
@@ -176,21 +281,37 @@ static bool proc_export(struct gsh_export *export, void *arg)
 
 int mnt_Export(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 {
-	struct proc_state proc_state;
+	struct mnt_export_list *list = get_export_list();
+	struct mnt_export_res *exp_res;
+	struct exportnode *tail = NULL;
+	uint32_t i, n = 0;
 
 	/* init everything of interest to good state. */
 	memset(res, 0, sizeof(nfs_res_t));
-	memset(&proc_state, 0, sizeof(proc_state));
 
-	(void)foreach_gsh_export(proc_export, &proc_state);
-	if (proc_state.retval != 0) {
-		LogCrit(COMPONENT_NFSPROTO,
-			"Processing exports failed. error = \"%s\" (%d)",
-			strerror(proc_state.retval), proc_state.retval);
+	exp_res = gsh_malloc(sizeof(*exp_res) +
+			     list->count * sizeof(exp_res->nodes[0]));
+	exp_res->list = list;
+
+	for (i = 0; i < list->count; i++) {
+		if (!export_visible(list->ents[i].export_id))
+			continue;
+
+		exp_res->nodes[n].ex_dir = list->ents[i].ex_dir;
+		exp_res->nodes[n].ex_groups = list->ents[i].ex_groups;
+		exp_res->nodes[n].ex_next = NULL;
+		if (tail != NULL)
+			tail->ex_next = &exp_res->nodes[n];
+		tail = &exp_res->nodes[n++];
 	}
-	op_ctx->ctx_export = NULL;
-	op_ctx->fsal_export = NULL;
-	res->res_mntexport = proc_state.head;
+
+	if (n == 0) {
+		put_export_list(list);
+		gsh_free(exp_res);
+		return NFS_REQ_OK;
+	}
+
+	res->res_mntexport = exp_res->nodes;
 	return NFS_REQ_OK;
 }				/* mnt_Export */
 
@@ -204,21 +325,15 @@ int mnt_Export(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
  */
 void mnt_Export_Free(nfs_res_t *res)
 {
-	struct exportnode *exp, *next_exp;
-	struct groupnode *grp, *next_grp;
+	struct mnt_export_res *exp_res;
 
-	exp = res->res_mntexport;
-	while (exp != NULL) {
-		next_exp = exp->ex_next;
-		grp = exp->ex_groups;
-		while (grp != NULL) {
-			next_grp = grp->gr_next;
-			if (grp->gr_name != NULL)
-				gsh_free(grp->gr_name);
-			gsh_free(grp);
-			grp = next_grp;
-		}
-		gsh_free(exp);
-		exp = next_exp;
-	}
+	if (res->res_mntexport == NULL)
+		return;
+
+	/* The nodes are the result's, the rest belongs to the list */
+	exp_res = container_of(res->res_mntexport, struct mnt_export_res,
+			       nodes[0]);
+	put_export_list(exp_res->list);
+	gsh_free(exp_res);
+	res->res_mntexport = NULL;
 }				/* mnt_Export_Free */
@@ -40,6 +40,97 @@
 #include "client_mgr.h"
 #include "export_mgr.h"
 
+/* Paths mounted recently, a power of two */
+#define MNT_CACHE_SLOTS 64
+
+/**
+ * @brief What a mounted path resolved to
+ *
+ * When many clients boot at once, they mount the same few paths, and
+ * resolving a path below an export root takes an FSAL lookup_path
+ * each time.  The export and handle a path resolved to are kept until
+ * the export list changes.  Access and flavors depend on the client
+ * and are still checked on each MNT.
+ */
+struct mnt_cache_entry {
+	char *path;
+	uint32_t gen;		/*< get_gsh_export_gen() when resolved */
+	uint16_t export_id;
+	u_int fh_len;
+	char fh[NFS3_FHSIZE];
+};
+
+static struct mnt_cache_entry mnt_cache[MNT_CACHE_SLOTS];
+static pthread_rwlock_t mnt_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static struct mnt_cache_entry *mnt_cache_slot(const char *path)
+{
+	uint32_t h = 5381;
+
+	while (*path != '\0')
+		h = h * 33 + (unsigned char) *path++;
+
+	return &mnt_cache[h & (MNT_CACHE_SLOTS - 1)];
+}
+
+/**
+ * @brief Look a path up in the mount cache
+ *
+ * @param[in]  path      Path as mounted
+ * @param[out] export_id Export the path resolved to
+ * @param[out] fh3       Handle the path resolved to, allocated
+ *
+ * @return true if the path was found and is still current.
+ */
+static bool mnt_cache_get(const char *path, uint16_t *export_id,
+			  nfs_fh3 *fh3)
+{
+	struct mnt_cache_entry *ent = mnt_cache_slot(path);
+	bool found = false;
+
+	PTHREAD_RWLOCK_rdlock(&mnt_cache_lock);
+	if (ent->path != NULL && ent->gen == get_gsh_export_gen() &&
+	    strcmp(ent->path, path) == 0) {
+		*export_id = ent->export_id;
+		fh3->data.data_len = ent->fh_len;
+		fh3->data.data_val = gsh_malloc(ent->fh_len);
+		memcpy(fh3->data.data_val, ent->fh, ent->fh_len);
+		found = true;
+	}
+	PTHREAD_RWLOCK_unlock(&mnt_cache_lock);
+
+	return found;
+}
+
+/**
+ * @brief Remember what a path resolved to
+ *
+ * @param[in] path   Path as mounted
+ * @param[in] gen    get_gsh_export_gen() from before the path was
+ *                   resolved, so a change meanwhile leaves it stale
+ * @param[in] export Export the path resolved to
+ * @param[in] fh3    Handle the path resolved to
+ */
+static void mnt_cache_put(const char *path, uint32_t gen,
+			  struct gsh_export *export, nfs_fh3 *fh3)
+{
+	struct mnt_cache_entry *ent = mnt_cache_slot(path);
+
+	if (fh3->data.data_len > NFS3_FHSIZE)
+		return;
+
+	PTHREAD_RWLOCK_wrlock(&mnt_cache_lock);
+	if (ent->path == NULL || strcmp(ent->path, path) != 0) {
+		gsh_free(ent->path);
+		ent->path = gsh_strdup(path);
+	}
+	ent->gen = gen;
+	ent->export_id = export->export_id;
+	ent->fh_len = fh3->data.data_len;
+	memcpy(ent->fh, fh3->data.data_val, fh3->data.data_len);
+	PTHREAD_RWLOCK_unlock(&mnt_cache_lock);
+}
+
 /**
  * @brief The Mount proc mount function for MOUNT_V3 version
  *
@@ -61,6 +152,9 @@ int mnt_Mnt(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	int retval = NFS_REQ_OK;
 	nfs_fh3 *fh3 = (nfs_fh3 *) &res->res_mnt3.mountres3_u.mountinfo.fhandle;
 	struct fsal_obj_handle *obj = NULL;
+	uint32_t gen = get_gsh_export_gen();
+	uint16_t export_id;
+	bool cached = false;
 
 	LogDebug(COMPONENT_NFSPROTO,
 		 "REQUEST PROCESSING: Calling mnt_Mnt path=%s", arg->arg_mnt);
@@ -87,9 +181,24 @@ int mnt_Mnt(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	    (arg->arg_mnt[strlen(arg->arg_mnt) - 1] == '/'))
 		arg->arg_mnt[strlen(arg->arg_mnt) - 1] = '\0';
 
+	/* A path mounted recently needs no lookup */
+	if (mnt_cache_get(arg->arg_mnt, &export_id, fh3)) {
+		export = get_gsh_export(export_id);
+		if (export != NULL) {
+			cached = true;
+		} else {
+			gsh_free(fh3->data.data_val);
+			fh3->data.data_val = NULL;
+		}
+	}
+
 	/*  Find the export for the dirname (using as well Path, Pseudo, or Tag)
 	 */
-	if (arg->arg_mnt[0] != '/') {
+	if (cached) {
+		LogFullDebug(COMPONENT_NFSPROTO,
+			     "Found export %d for %s in mount cache",
+			     export_id, arg->arg_mnt);
+	} else if (arg->arg_mnt[0] != '/') {
 		LogFullDebug(COMPONENT_NFSPROTO,
 			     "Searching for export by tag for %s",
 			     arg->arg_mnt);
@@ -137,6 +246,13 @@ int mnt_Mnt(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		goto out;
 	}
 
+	if (cached) {
+		if (isDebug(COMPONENT_NFSPROTO))
+			sprint_fhandle3(dumpfh, fh3);
+		res->res_mnt3.fhs_status = MNT3_OK;
+		goto flavors;
+	}
+
 	/* retrieve the associated NFS handle */
 	if (arg->arg_mnt[0] != '/' ||
 	    !strcmp(arg->arg_mnt, export_path(export))) {
@@ -168,6 +284,7 @@ int mnt_Mnt(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		if (isDebug(COMPONENT_NFSPROTO))
 			sprint_fhandle3(dumpfh, fh3);
 		res->res_mnt3.fhs_status = MNT3_OK;
+		mnt_cache_put(arg->arg_mnt, gen, export, fh3);
 	}
 
 	/* Release the fsal_obj_handle created for the path */
@@ -175,6 +292,7 @@ int mnt_Mnt(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		     "Releasing %p", obj);
 	obj->obj_ops.put_ref(obj);
 
+ flavors:
 	/* Return the supported authentication flavor in V3 based
 	 * on the client's export permissions. These should be listed
 	 * in a preferred order.
@@ -216,6 +334,12 @@ int mnt_Mnt(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		    auth_flavor[i];
 
  out:
+	/* A cached handle is only freed with the result if it is sent */
+	if (cached && res->res_mnt3.fhs_status != MNT3_OK) {
+		gsh_free(fh3->data.data_val);
+		fh3->data.data_val = NULL;
+	}
+
 	if (export != NULL) {
 		op_ctx->ctx_export = NULL;
 		op_ctx->fsal_export = NULL;
@@ -44,13 +44,14 @@
 #include "server_stats.h"
 #include "export_mgr.h"
 #include "sal_functions.h"
+#include "gsh_iobuf.h"
 
 static void nfs_read_ok(struct svc_req *req, nfs_res_t *res, char *data,
 			uint32_t read_size, struct fsal_obj_handle *obj,
 			int eof)
 {
 	if ((read_size == 0) && (data != NULL)) {
-		gsh_free(data);
+		gsh_iobuf_put(data);
 		data = NULL;
 	}
 
@@ -204,8 +205,6 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		rc = NFS_REQ_OK;
 		goto out;
 	} else {
-		data = gsh_malloc(size);
-
 		res->res_read3.status = nfs3_Errno_state(
 				state_share_anonymous_io_start(
 					obj,
@@ -214,24 +213,27 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 		if (res->res_read3.status != NFS3_OK) {
 			rc = NFS_REQ_OK;
-			gsh_free(data);
 			goto out;
 		}
 
 		if (obj->fsal->m_ops.support_ex(obj)) {
-			/* Call the new fsal_read2 */
+			state_read_pattern(obj, NULL, offset, size);
+
+			/* Call the new fsal_read_ref2, the FSAL may hand
+			 * us a reference to its own buffer */
 			/** @todo for now pass NULL state */
-			fsal_status = fsal_read2(obj,
-						  true,
-						  NULL,
-						  offset,
-						  size,
-						  &read_size,
-						  data,
-						  &eof_met,
-						  NULL);
+			fsal_status = fsal_read_ref2(obj,
+						     true,
+						     NULL,
+						     offset,
+						     size,
+						     &read_size,
+						     &data,
+						     &eof_met,
+						     NULL);
 		} else {
 			/* Call legacy fsal_rdwr */
+			data = gsh_iobuf_get(size);
 			fsal_status = fsal_rdwr(obj,
 						FSAL_IO_READ,
 						offset,
@@ -250,7 +252,7 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			rc = NFS_REQ_OK;
 			goto out;
 		}
-		gsh_free(data);
+		gsh_iobuf_put(data);
 	}
 
 	/* If we are here, there was an error */
@@ -268,13 +270,14 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	rc = NFS_REQ_OK;
 
  out:
+	server_stats_io_done(obj, size, read_size,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     false);
+
 	/* return references */
 	if (obj)
 		obj->obj_ops.put_ref(obj);
 
-	server_stats_io_done(size, read_size,
-			     (rc == NFS_REQ_OK) ? true : false,
-			     false);
 	return rc;
 }				/* nfs3_read */
 
@@ -289,6 +292,6 @@ void nfs3_read_free(nfs_res_t *res)
 {
 	if ((res->res_read3.status == NFS3_OK)
 	    && (res->res_read3.READ3res_u.resok.data.data_len != 0)) {
-		gsh_free(res->res_read3.READ3res_u.resok.data.data_val);
+		gsh_iobuf_put(res->res_read3.READ3res_u.resok.data.data_val);
 	}
 }
@@ -46,6 +46,7 @@
 #include "server_stats.h"
 #include "export_mgr.h"
 #include "sal_functions.h"
+#include "gsh_iobuf.h"
 
 /**
  *
@@ -231,26 +232,28 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	if (obj->fsal->m_ops.support_ex(obj)) {
 		/* Call the new fsal_write */
 		/** @todo for now pass NULL state */
-		fsal_status = fsal_write2(obj,
-					  true,
-					  NULL,
-					  offset,
-					  size,
-					  &written_size,
-					  data,
-					  &sync,
-					  NULL);
+		fsal_status = fsal_write_iobuf2(obj,
+						true,
+						NULL,
+						offset,
+						size,
+						&written_size,
+						data,
+						&sync);
 	} else {
-		/* Call legacy fsal_rdwr */
+		/* Call legacy fsal_rdwr on a flat copy of the payload */
+		void *flat = gsh_iobuf_flatten(data, size);
+
 		fsal_status = fsal_rdwr(obj,
 					FSAL_IO_WRITE,
 					offset,
 					size,
 					&written_size,
-					data,
+					flat,
 					&eof_met,
 					&sync,
 					NULL);
+		gsh_iobuf_put(flat);
 	}
 
 	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
@@ -297,12 +300,13 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	rc = NFS_REQ_OK;
 
  out:
+	server_stats_io_done(obj, size, written_size,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     true);
+
 	/* return references */
 	obj->obj_ops.put_ref(obj);
 
-	server_stats_io_done(size, written_size,
-			     (rc == NFS_REQ_OK) ? true : false,
-			     true);
 	return rc;
 
 }				/* nfs3_write */
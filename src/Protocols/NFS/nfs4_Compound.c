@@ -42,6 +42,8 @@
 #include "server_stats.h"
 #include "export_mgr.h"
 #include "nfs_creds.h"
+#include "flight_rec.h"
+#include "city.h"
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
@@ -270,9 +272,9 @@ static const struct nfs4_op_desc optabv4[] = {
 		.exp_perm_flags = 0	/* tbd */},
 	[NFS4_OP_BIND_CONN_TO_SESSION] = {
 		.name = "OP_BIND_CONN_TO_SESSION",
-		.funct = nfs4_op_illegal,
-		.free_res = nfs4_op_illegal_Free,
-		.exp_perm_flags = 0	/* tbd */},
+		.funct = nfs4_op_bind_conn_to_session,
+		.free_res = nfs4_op_bind_conn_to_session_Free,
+		.exp_perm_flags = 0},
 	[NFS4_OP_EXCHANGE_ID] = {
 		.name = "OP_EXCHANGE_ID",
 		.funct = nfs4_op_exchange_id,
@@ -295,9 +297,9 @@ static const struct nfs4_op_desc optabv4[] = {
 		.exp_perm_flags = 0},
 	[NFS4_OP_GET_DIR_DELEGATION] = {
 		.name = "OP_GET_DIR_DELEGATION",
-		.funct = nfs4_op_illegal,
-		.free_res = nfs4_op_illegal_Free,
-		.exp_perm_flags = 0	/* tbd */},
+		.funct = nfs4_op_get_dir_delegation,
+		.free_res = nfs4_op_get_dir_delegation_Free,
+		.exp_perm_flags = EXPORT_OPTION_MD_READ_ACCESS},
 	[NFS4_OP_GETDEVICEINFO] = {
 		.name = "OP_GETDEVICEINFO",
 		.funct = nfs4_op_getdeviceinfo,
@@ -367,13 +369,13 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_COPY] = {
 				.name = "OP_COPY",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
-				.exp_perm_flags = 0},
+				.funct = nfs4_op_copy,
+				.free_res = nfs4_op_copy_Free,
+				.exp_perm_flags = EXPORT_OPTION_WRITE_ACCESS},
 	[NFS4_OP_COPY_NOTIFY] = {
 				.name = "OP_COPY_NOTIFY",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_copy_notify,
+				.free_res = nfs4_op_copy_notify_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_DEALLOCATE] = {
 				.name = "OP_DEALLOCATE",
@@ -397,13 +399,13 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_CANCEL] = {
 				.name = "OP_OFFLOAD_CANCEL",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_offload_cancel,
+				.free_res = nfs4_op_offload_cancel_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_STATUS] = {
 				.name = "OP_OFFLOAD_STATUS",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_offload_status,
+				.free_res = nfs4_op_offload_status_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_READ_PLUS] = {
 				.name = "OP_READ_PLUS",
@@ -422,9 +424,9 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_CLONE] = {
 				.name = "OP_CLONE",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
-				.exp_perm_flags = 0},
+				.funct = nfs4_op_clone,
+				.free_res = nfs4_op_clone_Free,
+				.exp_perm_flags = EXPORT_OPTION_WRITE_ACCESS},
 
 	/* NFSv4.3 */
 	[NFS4_OP_GETXATTR] = {
@@ -458,6 +460,530 @@ nfs_opnum4 LastOpcode[] = {
 	NFS4_OP_REMOVEXATTR
 };
 
+/**
+ * @brief Result of processing one operation of a compound
+ */
+enum nfs4_compound_step {
+	NFS4_COMPOUND_NEXT,	/*< Go on with the next operation */
+	NFS4_COMPOUND_STOP,	/*< Stop and send the reply */
+	NFS4_COMPOUND_SUSPEND,	/*< Operation is waiting for I/O */
+};
+
+/**
+ * @brief Finish the operation at data->oppos
+ *
+ * @param[in,out] data   Compound data
+ * @param[in]     status Status returned by the operation
+ *
+ * @return Whether to go on with the compound.
+ */
+static enum nfs4_compound_step nfs4_Compound_op_done(compound_data_t *data,
+						     int status)
+{
+	const uint32_t i = data->oppos;
+	nfs_res_t *res = data->res;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, v4op_end, i, data->argarray[i].argop,
+		   optabv4[data->opcode].name);
+#endif
+
+	if (flight_rec_enabled) {
+		struct timespec ts;
+
+		now(&ts);
+		flight_rec_event(FR_V4OP_END, data->req->rq_msg.rm_xid,
+				 data->argarray[i].argop, status,
+				 timespec_diff(&ServerBootTime, &ts) -
+				 data->op_start_time);
+	}
+
+	LogCompoundFH(data);
+
+	/* All the operation, like NFS4_OP_ACESS, have a first replyied
+	 * field called .status
+	 */
+	data->resarray[i].nfs_resop4_u.opaccess.status = status;
+	data->status = status;
+
+	server_stats_nfsv4_op_done(data->opcode, data->op_start_time,
+				   data->op_cpu_start, status);
+
+	/* Give back the payload of a finished WRITE now, rather than
+	 * holding it until the reply of the whole compound is sent.
+	 */
+	if (data->argarray[i].argop == NFS4_OP_WRITE)
+		xdr_free((xdrproc_t) xdr_WRITE4args,
+			 &data->argarray[i].nfs_argop4_u.opwrite);
+
+	if (status != NFS4_OK) {
+		/* An error occured, we do not manage the other requests
+		 * in the COMPOUND, this may be a regular behavior
+		 */
+		LogDebug(COMPONENT_NFS_V4,
+			 "Status of %s in position %d = %s",
+			 optabv4[data->opcode].name, i,
+			 nfsstat4_to_str(status));
+
+		res->res_compound4.resarray.resarray_len = i + 1;
+
+		return NFS4_COMPOUND_STOP;
+	}
+
+	/* Check Req size */
+
+	/* NFS_V4.1 specific stuff */
+	if (data->use_drc) {
+		/* Replay cache, only true for SEQUENCE or
+		 * CREATE_SESSION w/o SEQUENCE. Since will only be set
+		 * in those cases, no need to check operation or
+		 * anything.
+		 */
+
+		/* Free the reply allocated above, and the tag with it */
+		gsh_arena_release(&res->res_compound4_extended.res_arena);
+
+		if (data->replay_xdr != NULL) {
+			/* Send the bytes nfs4_op_sequence copied out of the
+			 * slot, the reply owns them from here.
+			 */
+			memset(&res->res_compound4_extended, 0,
+			       sizeof(res->res_compound4_extended));
+			res->res_compound4.status = data->replay_status;
+			res->res_compound4_extended.res_xdr = data->replay_xdr;
+			res->res_compound4_extended.res_xdr_len =
+							data->replay_len;
+			data->replay_xdr = NULL;
+			data->status = data->replay_status;
+			LogFullDebug(COMPONENT_SESSIONS,
+				     "Use encoded session replay, %u bytes result %s",
+				     data->replay_len,
+				     nfsstat4_to_str(data->status));
+			return NFS4_COMPOUND_STOP;
+		}
+
+		/* Copy the reply from the cache */
+		res->res_compound4_extended = *data->cached_res;
+		data->status = ((COMPOUND4res *) data->cached_res)->status;
+		LogFullDebug(COMPONENT_SESSIONS,
+			     "Use session replay cache %p result %s",
+			     data->cached_res, nfsstat4_to_str(data->status));
+		return NFS4_COMPOUND_STOP;
+	}
+
+	return NFS4_COMPOUND_NEXT;
+}
+
+/**
+ * @brief Process the operation at data->oppos
+ *
+ * @param[in,out] data Compound data
+ *
+ * @return Whether to go on with the compound.  On NFS4_COMPOUND_SUSPEND
+ *         the compound may already have been resumed on another thread,
+ *         so data must not be touched.
+ */
+static enum nfs4_compound_step nfs4_Compound_one(compound_data_t *data)
+{
+	const uint32_t i = data->oppos;
+	nfs_argop4 * const argarray = data->argarray;
+	nfs_resop4 * const resarray = data->resarray;
+	struct timespec ts;
+	int perm_flags;
+	int status;
+
+	/* Verify BIND_CONN_TO_SESSION is not used in a compound
+	 * with length > 1.
+	 */
+	if (i > 0 && argarray[i].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
+		status = NFS4ERR_NOT_ONLY_OP;
+		goto bad_op_state;
+	}
+
+	/* time each op */
+	now(&ts);
+	data->op_start_time = timespec_diff(&ServerBootTime, &ts);
+	data->op_cpu_start = server_stats_cpu_now();
+	data->opcode = argarray[i].argop;
+
+	/* Handle opcode overflow */
+	if (data->opcode > LastOpcode[data->minorversion])
+		data->opcode = 0;
+
+	if (data->minorversion > 0 && data->session != NULL &&
+	    data->session->fore_channel_attrs.ca_maxoperations == i) {
+		status = NFS4ERR_TOO_MANY_OPS;
+		goto bad_op_state;
+	}
+
+	LogDebug(COMPONENT_NFS_V4, "Request %d: opcode %d is %s", i,
+		 argarray[i].argop, optabv4[data->opcode].name);
+	perm_flags =
+	    optabv4[data->opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
+
+	if (perm_flags != 0) {
+		status = nfs4_Is_Fh_Empty(&data->currentFH);
+		if (status != NFS4_OK) {
+			LogDebug(COMPONENT_NFS_V4,
+				 "Status of %s for CurrentFH in position %d = %s",
+				 optabv4[data->opcode].name,
+				 i,
+				 nfsstat4_to_str(status));
+			goto bad_op_state;
+		}
+
+		/* Operation uses a CurrentFH, so we can check export
+		 * perms. Perms should even be set reasonably for pseudo
+		 * file system.
+		 */
+		LogMidDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
+			       "Check export perms export = %08x req = %08x",
+			       op_ctx->export_perms->options &
+					EXPORT_OPTION_ACCESS_MASK,
+			       perm_flags);
+		if ((op_ctx->export_perms->options &
+		     perm_flags) != perm_flags) {
+			/* Export doesn't allow requested
+			 * access for this client.
+			 */
+			if ((perm_flags & EXPORT_OPTION_MODIFY_ACCESS)
+			    != 0)
+				status = NFS4ERR_ROFS;
+			else
+				status = NFS4ERR_ACCESS;
+
+			LogDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
+				    "Status of %s due to export permissions in position %d = %s",
+				    optabv4[data->opcode].name, i,
+				    nfsstat4_to_str(status));
+ bad_op_state:
+			/* All the operation, like NFS4_OP_ACESS, have
+			 * a first replied field called .status
+			 */
+			resarray[i].nfs_resop4_u.opaccess.status = status;
+			resarray[i].resop = argarray[i].argop;
+			data->status = status;
+
+			/* Do not manage the other requests in the
+			 * COMPOUND.
+			 */
+			data->res->res_compound4.resarray.resarray_len = i + 1;
+			return NFS4_COMPOUND_STOP;
+		}
+	}
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, v4op_start, i, argarray[i].argop,
+		   optabv4[data->opcode].name);
+#endif
+
+	if (flight_rec_enabled)
+		flight_rec_event(FR_V4OP_START, data->req->rq_msg.rm_xid,
+				 argarray[i].argop, i,
+				 data->currentFH.nfs_fh4_len == 0 ? 0 :
+				 CityHash64(data->currentFH.nfs_fh4_val,
+					    data->currentFH.nfs_fh4_len));
+
+	status = (optabv4[data->opcode].funct) (&argarray[i], data,
+						&resarray[i]);
+
+	if (status == NFS4_OP_ASYNC_WAIT)
+		return NFS4_COMPOUND_SUSPEND;
+
+	return nfs4_Compound_op_done(data, status);
+}
+
+/**
+ * @brief Bytes held by encoded slot replies, against Slot_Reply_Cache_Size
+ */
+static uint64_t slot_reply_bytes;
+
+/**
+ * @brief Largest encoded reply a slot keeps
+ */
+#define SLOT_REPLY_MAX (64 * 1024)
+
+/**
+ * @brief Release the reply cached in a session slot
+ *
+ * Handles both the result tree and the encoded form.
+ *
+ * @param[in,out] slot The slot
+ */
+void nfs41_Slot_Release_Reply(nfs41_session_slot_t *slot)
+{
+	if (slot->cached_result.res_cached) {
+		slot->cached_result.res_cached = false;
+		nfs4_Compound_Free((nfs_res_t *) &slot->cached_result);
+	}
+
+	if (slot->reply_xdr != NULL) {
+		(void) atomic_sub_uint64_t(&slot_reply_bytes,
+					   slot->reply_len);
+		gsh_free(slot->reply_xdr);
+		slot->reply_xdr = NULL;
+		slot->reply_len = 0;
+	}
+}
+
+/**
+ * @brief Keep the reply of a compound encoded in its slot
+ *
+ * Only the status is kept if the client did not ask for the reply to
+ * be cached, if it exceeds ca_maxresponsesize_cached or if the cache is
+ * full.  The result tree itself is released with the request, which
+ * unpins READ buffers.
+ *
+ * @param[in] data Compound data
+ * @param[in] res  The complete reply
+ */
+static void nfs4_Compound_save_encoded(compound_data_t *data, nfs_res_t *res)
+{
+	nfs41_session_slot_t *slot = &data->session->slots[data->slot];
+	uint64_t budget =
+	    (uint64_t) nfs_param.nfsv4_param.slot_reply_cache_size << 20;
+	u_int limit = data->session->fore_channel_attrs
+						.ca_maxresponsesize_cached;
+	char *buf = NULL;
+	u_int len = 0;
+	XDR xdrs;
+
+	if (limit > SLOT_REPLY_MAX)
+		limit = SLOT_REPLY_MAX;
+
+	if (data->cachethis && limit > 0) {
+		buf = gsh_malloc(limit);
+		xdrmem_create(&xdrs, buf, limit, XDR_ENCODE);
+		if (xdr_COMPOUND4res(&xdrs, &res->res_compound4))
+			len = xdr_getpos(&xdrs);
+		xdr_destroy(&xdrs);
+
+		if (len != 0 &&
+		    atomic_add_uint64_t(&slot_reply_bytes, len) > budget) {
+			(void) atomic_sub_uint64_t(&slot_reply_bytes, len);
+			len = 0;
+		}
+
+		if (len == 0) {
+			LogFullDebug(COMPONENT_SESSIONS,
+				     "Reply on slot %" PRIu32
+				     " not cached, too big or cache full",
+				     data->slot);
+			gsh_free(buf);
+			buf = NULL;
+		} else {
+			buf = gsh_realloc(buf, len);
+		}
+	}
+
+	PTHREAD_MUTEX_lock(&slot->lock);
+	nfs41_Slot_Release_Reply(slot);
+	slot->reply_xdr = buf;
+	slot->reply_len = len;
+	slot->reply_status = res->res_compound4.status;
+	slot->reply_pending = false;
+	PTHREAD_MUTEX_unlock(&slot->lock);
+
+	LogFullDebug(COMPONENT_SESSIONS,
+		     "Saved %u encoded bytes in session slot %" PRIu32,
+		     len, data->slot);
+}
+
+/**
+ * @brief Complete the reply of a compound and release its data
+ *
+ * @param[in] data Compound data, freed on return
+ */
+static void nfs4_Compound_complete(compound_data_t *data)
+{
+	nfs_res_t *res = data->res;
+	int status = data->status;
+
+	server_stats_compound_done(data->argarray_len, status);
+
+	/* Complete the reply, in particular, tell where you stopped if
+	 * unsuccessfull COMPOUD
+	 */
+	res->res_compound4.status = status;
+
+	/* Manage session's DRC: keep NFS4.1 replay for later use, but don't
+	 * save a replayed result again.
+	 */
+	if (data->slot_encoded && !data->use_drc)
+		nfs4_Compound_save_encoded(data, res);
+
+	if (data->cached_res != NULL && !data->use_drc) {
+		/* Pointer has been set by nfs4_op_sequence and points to slot
+		 * to cache result in.
+		 */
+		LogFullDebug(COMPONENT_SESSIONS,
+			     "Save result in session replay cache %p sizeof nfs_res_t=%d",
+			     data->cached_res, (int)sizeof(nfs_res_t));
+
+		/* Indicate to nfs4_Compound_Free that this reply is cached. */
+		res->res_compound4_extended.res_cached = true;
+
+		/* If the cache is already in use, free it. */
+		if (data->cached_res->res_cached) {
+			data->cached_res->res_cached = false;
+			nfs4_Compound_Free((nfs_res_t *) data->cached_res);
+		}
+
+		/* Save the result in the cache. */
+		*data->cached_res = res->res_compound4_extended;
+	}
+
+	/* If we have reserved a lease, update it and release it */
+	if (data->preserved_clientid != NULL) {
+		/* Update and release lease */
+		update_lease(data->preserved_clientid);
+	}
+
+	if (status != NFS4_OK)
+		LogDebug(COMPONENT_NFS_V4, "End status = %s lastindex = %d",
+			 nfsstat4_to_str(status), data->oppos);
+
+	compound_data_Free(data);
+	gsh_free(data);
+}
+
+/**
+ * @brief Process the compound from data->oppos on
+ *
+ * @param[in] data Compound data
+ *
+ * @retval NFS_REQ_OK if the reply is complete.
+ * @retval NFS_REQ_ASYNC_WAIT if an operation suspended the compound.
+ */
+static int nfs4_Compound_run(compound_data_t *data)
+{
+	enum nfs4_compound_step step;
+
+	while (data->oppos < data->argarray_len) {
+		step = nfs4_Compound_one(data);
+
+		if (step == NFS4_COMPOUND_SUSPEND)
+			return NFS_REQ_ASYNC_WAIT;
+
+		if (step == NFS4_COMPOUND_STOP)
+			break;
+
+		data->oppos++;
+	}
+
+	nfs4_Compound_complete(data);
+
+	return NFS_REQ_OK;
+}
+
+/**
+ * @brief Resume a compound suspended by an operation
+ *
+ * Called from a worker once the operation's I/O has completed.
+ *
+ * @param[in] reqnfs The suspended request
+ *
+ * @retval NFS_REQ_OK if the reply is complete.
+ * @retval NFS_REQ_ASYNC_WAIT if an operation suspended the compound again.
+ */
+static int nfs4_Compound_resume(nfs_request_t *reqnfs)
+{
+	compound_data_t *data = reqnfs->proc_data;
+	const uint32_t i = data->oppos;
+	int status;
+
+	reqnfs->resume_fn = NULL;
+	reqnfs->proc_data = NULL;
+
+	/* Only the CPU time of this thread counts */
+	data->op_cpu_start = server_stats_cpu_now();
+
+	status = data->op_resume(&data->argarray[i], data, &data->resarray[i]);
+
+	if (status == NFS4_OP_ASYNC_WAIT)
+		return NFS_REQ_ASYNC_WAIT;
+
+	if (nfs4_Compound_op_done(data, status) == NFS4_COMPOUND_NEXT) {
+		data->oppos++;
+		return nfs4_Compound_run(data);
+	}
+
+	nfs4_Compound_complete(data);
+
+	return NFS_REQ_OK;
+}
+
+/**
+ * @brief Get ready to suspend the current operation
+ *
+ * Must be called before the asynchronous I/O is issued, since it may
+ * complete before the issuing call returns.
+ *
+ * @param[in,out] data    Compound data
+ * @param[in]     resume  Function finishing the operation once the I/O
+ *                        has completed
+ * @param[in]     op_data Operation's private state, in data->op_data
+ */
+void nfs4_async_prepare(compound_data_t *data, nfs4_op_function_t resume,
+			void *op_data)
+{
+	nfs_request_t *reqnfs = container_of(data->req, nfs_request_t, svc);
+
+	data->op_resume = resume;
+	data->op_data = op_data;
+	data->async_flags = 0;
+	reqnfs->proc_data = data;
+	reqnfs->resume_fn = nfs4_Compound_resume;
+}
+
+/**
+ * @brief The asynchronous I/O of the current operation has been issued
+ *
+ * If the I/O already completed, the operation is finished inline.
+ * Otherwise the compound is suspended and the completion will requeue
+ * the request; the caller must not touch data after it returns
+ * NFS4_OP_ASYNC_WAIT.
+ *
+ * @return The operation's status, or NFS4_OP_ASYNC_WAIT.
+ */
+int nfs4_async_issued(struct nfs_argop4 *op, compound_data_t *data,
+		      struct nfs_resop4 *resp)
+{
+	nfs_request_t *reqnfs = container_of(data->req, nfs_request_t, svc);
+	uint32_t flags;
+
+	flags = atomic_postset_uint32_t_bits(&data->async_flags,
+					     NFS4_ASYNC_EXIT);
+
+	if (!(flags & NFS4_ASYNC_DONE))
+		return NFS4_OP_ASYNC_WAIT;
+
+	/* Completed before we got here, carry on in this thread */
+	reqnfs->resume_fn = NULL;
+	reqnfs->proc_data = NULL;
+
+	return data->op_resume(op, data, resp);
+}
+
+/**
+ * @brief The asynchronous I/O of the current operation has completed
+ *
+ * Called from the I/O completion callback, possibly on an FSAL thread.
+ *
+ * @param[in] data Compound data
+ */
+void nfs4_async_done(compound_data_t *data)
+{
+	uint32_t flags;
+
+	flags = atomic_postset_uint32_t_bits(&data->async_flags,
+					     NFS4_ASYNC_DONE);
+
+	if (flags & NFS4_ASYNC_EXIT)
+		nfs_rpc_enqueue_req(container_of(data->req, request_data_t,
+						 r_u.req.svc));
+}
+
 /**
  * @brief The NFS PROC4 COMPOUND
  *
@@ -477,24 +1003,23 @@ nfs_opnum4 LastOpcode[] = {
  *
  * @retval NFS_REQ_OKAY if a result is sent.
  * @retval NFS_REQ_DROP if we pretend we never saw the request.
+ * @retval NFS_REQ_ASYNC_WAIT if an operation suspended the compound.
  */
 
 int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 {
-	unsigned int i = 0;
 	int status = NFS4_OK;
-	compound_data_t data;
-	nfs_opnum4 opcode;
+	compound_data_t *data;
 	const uint32_t compound4_minor = arg->arg_compound4.minorversion;
 	const uint32_t argarray_len = arg->arg_compound4.argarray.argarray_len;
 	/* Array of op arguments */
 	nfs_argop4 * const argarray = arg->arg_compound4.argarray.argarray_val;
-	nfs_resop4 *resarray;
-	nsecs_elapsed_t op_start_time;
-	struct timespec ts;
-	int perm_flags;
 	char *tagname = NULL;
 	char *notag = "NO TAG";
+	/* Small allocations of the reply, freed along with it */
+	struct gsh_arena *arena = &res->res_compound4_extended.res_arena;
+
+	gsh_arena_init(arena);
 
 	if (compound4_minor > 2) {
 		LogCrit(COMPONENT_NFS_V4, "Bad Minor Version %d",
@@ -511,7 +1036,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	if (res->res_compound4.tag.utf8string_len > 0) {
 
 		res->res_compound4.tag.utf8string_val =
-		    gsh_malloc(res->res_compound4.tag.utf8string_len + 1);
+		    gsh_arena_alloc(arena,
+				    res->res_compound4.tag.utf8string_len + 1);
 
 		memcpy(res->res_compound4.tag.utf8string_val,
 		       arg->arg_compound4.tag.utf8string_val,
@@ -553,8 +1079,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		return NFS_REQ_OK;
 	}
 
-	/* Check for too long request */
-	if (argarray_len > 100) {
+	/* Check for too long request, its operations were not decoded */
+	if (argarray_len > NFS4_MAX_COMPOUND_OPS) {
 		LogMajor(COMPONENT_NFS_V4,
 			 "A COMPOUND with too many operations (%d) was received",
 			 argarray_len);
@@ -565,16 +1091,18 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	}
 
 	/* Initialisation of the compound request internal's data */
-	memset(&data, 0, sizeof(data));
+	data = gsh_calloc(1, sizeof(*data));
 	op_ctx->nfs_minorvers = compound4_minor;
 
 	/* Minor version related stuff */
-	data.minorversion = compound4_minor;
-	data.req = req;
+	data->minorversion = compound4_minor;
+	data->req = req;
 
 	/* Building the client credential field */
-	if (nfs_rpc_req2client_cred(req, &(data.credential)) == -1)
+	if (nfs_rpc_req2client_cred(req, &(data->credential)) == -1) {
+		gsh_free(data);
 		return NFS_REQ_DROP;	/* Malformed credential */
+	}
 
 	/* Keeping the same tag as in the arguments */
 	res->res_compound4.tag.utf8string_len =
@@ -582,10 +1110,15 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	/* Allocating the reply nfs_resop4 */
 	res->res_compound4.resarray.resarray_val =
-		gsh_calloc(argarray_len, sizeof(struct nfs_resop4));
+		gsh_arena_calloc(arena, argarray_len, sizeof(struct nfs_resop4));
 
 	res->res_compound4.resarray.resarray_len = argarray_len;
-	resarray = res->res_compound4.resarray.resarray_val;
+
+	data->argarray = argarray;
+	data->argarray_len = argarray_len;
+	data->resarray = res->res_compound4.resarray.resarray_val;
+	data->res = res;
+	data->status = NFS4_OK;
 
 	/* Manage errors NFS4ERR_OP_NOT_IN_SESSION and NFS4ERR_NOT_ONLY_OP.
 	 * These checks apply only to 4.1 */
@@ -603,6 +1136,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			status = NFS4ERR_OP_NOT_IN_SESSION;
 			res->res_compound4.status = status;
 			res->res_compound4.resarray.resarray_len = 0;
+			gsh_free(data);
 			return NFS_REQ_OK;
 		}
 
@@ -628,6 +1162,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 				status = NFS4ERR_NOT_ONLY_OP;
 				res->res_compound4.status = status;
 				res->res_compound4.resarray.resarray_len = 0;
+				gsh_free(data);
 				return NFS_REQ_OK;
 			}
 		}
@@ -646,204 +1181,31 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			status = NFS4ERR_NOT_ONLY_OP;
 			res->res_compound4.status = status;
 			res->res_compound4.resarray.resarray_len = 0;
+			gsh_free(data);
 			return NFS_REQ_OK;
 		}
 	}
 
-	for (i = 0; i < argarray_len; i++) {
-		/* Used to check if OP_SEQUENCE is the first operation */
-		data.oppos = i;
-
-		/* Verify BIND_CONN_TO_SESSION is not used in a compound
-		 * with length > 1.
-		 */
-		if (i > 0 &&
-		    argarray[i].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
-			status = NFS4ERR_NOT_ONLY_OP;
-			goto bad_op_state;
-		}
-
-		/* time each op */
-		now(&ts);
-		op_start_time = timespec_diff(&ServerBootTime, &ts);
-		opcode = argarray[i].argop;
-
-		/* Handle opcode overflow */
-		if (opcode > LastOpcode[compound4_minor])
-			opcode = 0;
-
-		if (compound4_minor > 0 && data.session != NULL &&
-		    data.session->fore_channel_attrs.ca_maxoperations == i) {
-			status = NFS4ERR_TOO_MANY_OPS;
-			goto bad_op_state;
-		}
-
-		LogDebug(COMPONENT_NFS_V4, "Request %d: opcode %d is %s", i,
-			 argarray[i].argop, optabv4[opcode].name);
-		perm_flags =
-		    optabv4[opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
-
-		if (perm_flags != 0) {
-			status = nfs4_Is_Fh_Empty(&data.currentFH);
-			if (status != NFS4_OK) {
-				LogDebug(COMPONENT_NFS_V4,
-					 "Status of %s for CurrentFH in position %d = %s",
-					 optabv4[opcode].name,
-					 i,
-					 nfsstat4_to_str(status));
-				goto bad_op_state;
-			}
-
-			/* Operation uses a CurrentFH, so we can check export
-			 * perms. Perms should even be set reasonably for pseudo
-			 * file system.
-			 */
-			LogMidDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
-				       "Check export perms export = %08x req = %08x",
-				       op_ctx->export_perms->options &
-						EXPORT_OPTION_ACCESS_MASK,
-				       perm_flags);
-			if ((op_ctx->export_perms->options &
-			     perm_flags) != perm_flags) {
-				/* Export doesn't allow requested
-				 * access for this client.
-				 */
-				if ((perm_flags & EXPORT_OPTION_MODIFY_ACCESS)
-				    != 0)
-					status = NFS4ERR_ROFS;
-				else
-					status = NFS4ERR_ACCESS;
-
-				LogDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
-					    "Status of %s due to export permissions in position %d = %s",
-					    optabv4[opcode].name, i,
-					    nfsstat4_to_str(status));
- bad_op_state:
-				/* All the operation, like NFS4_OP_ACESS, have
-				 * a first replied field called .status
-				 */
-				resarray[i].nfs_resop4_u.opaccess.status =
-				    status;
-				resarray[i].resop = argarray[i].argop;
-
-				/* Do not manage the other requests in the
-				 * COMPOUND.
-				 */
-				res->res_compound4.resarray.resarray_len =
-					i + 1;
-				break;
-			}
-		}
-
-#ifdef USE_LTTNG
-		tracepoint(nfs_rpc, v4op_start, i, argarray[i].argop,
-			   optabv4[opcode].name);
-#endif
-
-		status = (optabv4[opcode].funct) (&argarray[i],
-						  &data,
-						  &resarray[i]);
-
-#ifdef USE_LTTNG
-		tracepoint(nfs_rpc, v4op_end, i, argarray[i].argop,
-			   optabv4[opcode].name);
-#endif
-
-		LogCompoundFH(&data);
-
-		/* All the operation, like NFS4_OP_ACESS, have a first replyied
-		 * field called .status
-		 */
-		resarray[i].nfs_resop4_u.opaccess.status = status;
-
-		server_stats_nfsv4_op_done(opcode, op_start_time, status);
-
-		if (status != NFS4_OK) {
-			/* An error occured, we do not manage the other requests
-			 * in the COMPOUND, this may be a regular behavior
-			 */
-			LogDebug(COMPONENT_NFS_V4,
-				 "Status of %s in position %d = %s",
-				 optabv4[opcode].name, i,
-				 nfsstat4_to_str(status));
-
-			res->res_compound4.resarray.resarray_len = i + 1;
-
-			break;
-		}
-
-		/* Check Req size */
-
-		/* NFS_V4.1 specific stuff */
-		if (data.use_drc) {
-			/* Replay cache, only true for SEQUENCE or
-			 * CREATE_SESSION w/o SEQUENCE. Since will only be set
-			 * in those cases, no need to check operation or
-			 * anything.
-			 */
-
-			/* Free the reply allocated above */
-			gsh_free(res->res_compound4.resarray.resarray_val);
-
-			/* Copy the reply from the cache */
-			res->res_compound4_extended = *data.cached_res;
-			status = ((COMPOUND4res *) data.cached_res)->status;
-			LogFullDebug(COMPONENT_SESSIONS,
-				     "Use session replay cache %p result %s",
-				     data.cached_res, nfsstat4_to_str(status));
-			break;	/* Exit the for loop */
-		}
-	}			/* for */
-
-	server_stats_compound_done(argarray_len, status);
-
-	/* Complete the reply, in particular, tell where you stopped if
-	 * unsuccessfull COMPOUD
-	 */
-	res->res_compound4.status = status;
-
-	/* Manage session's DRC: keep NFS4.1 replay for later use, but don't
-	 * save a replayed result again.
-	 */
-	if (data.cached_res != NULL && !data.use_drc) {
-		/* Pointer has been set by nfs4_op_sequence and points to slot
-		 * to cache result in.
-		 */
-		LogFullDebug(COMPONENT_SESSIONS,
-			     "Save result in session replay cache %p sizeof nfs_res_t=%d",
-			     data.cached_res, (int)sizeof(nfs_res_t));
-
-		/* Indicate to nfs4_Compound_Free that this reply is cached. */
-		res->res_compound4_extended.res_cached = true;
-
-		/* If the cache is already in use, free it. */
-		if (data.cached_res->res_cached) {
-			data.cached_res->res_cached = false;
-			nfs4_Compound_Free((nfs_res_t *) data.cached_res);
-		}
-
-		/* Save the result in the cache. */
-		*data.cached_res = res->res_compound4_extended;
-	}
-
-	/* If we have reserved a lease, update it and release it */
-	if (data.preserved_clientid != NULL) {
-		/* Update and release lease */
-		PTHREAD_MUTEX_lock(&data.preserved_clientid->cid_mutex);
-
-		update_lease(data.preserved_clientid);
-
-		PTHREAD_MUTEX_unlock(&data.preserved_clientid->cid_mutex);
-	}
-
-	if (status != NFS4_OK)
-		LogDebug(COMPONENT_NFS_V4, "End status = %s lastindex = %d",
-			 nfsstat4_to_str(status), i);
+	return nfs4_Compound_run(data);
+}				/* nfs4_Compound */
 
-	compound_data_Free(&data);
+/**
+ * @brief Encode the result of NFS4PROC_COMPOUND
+ *
+ * A reply replayed from an encoded slot cache goes out as is.
+ *
+ * @param[in] xdrs XDR stream
+ * @param[in] objp The result
+ *
+ * @return true on success.
+ */
+bool xdr_COMPOUND4res_extended(XDR *xdrs, struct COMPOUND4res_extended *objp)
+{
+	if (xdrs->x_op == XDR_ENCODE && objp->res_xdr != NULL)
+		return XDR_PUTBYTES(xdrs, objp->res_xdr, objp->res_xdr_len);
 
-	return NFS_REQ_OK;
-}				/* nfs4_Compound */
+	return xdr_COMPOUND4res(xdrs, &objp->res_compound4);
+}
 
 /**
  *
@@ -864,6 +1226,30 @@ void nfs4_Compound_FreeOne(nfs_resop4 *res)
 	optabv4[opcode].free_res(res);
 }
 
+/**
+ * @brief Detach arena memory from an operation's result
+ *
+ * The operation's own free function would hand it to gsh_free, so
+ * clear it first.  Only GETATTR puts anything there.
+ *
+ * @param[in,out] res   The operation's result
+ * @param[in]     arena The compound's arena
+ */
+static void nfs4_Compound_unlink_arena(nfs_resop4 *res,
+				       struct gsh_arena *arena)
+{
+	fattr4 *attrs;
+
+	if (res->resop != NFS4_OP_GETATTR ||
+	    res->nfs_resop4_u.opgetattr.status != NFS4_OK)
+		return;
+
+	attrs = &res->nfs_resop4_u.opgetattr.GETATTR4res_u.resok4
+							.obj_attributes;
+	if (gsh_arena_owns(arena, attrs->attr_vals.attrlist4_val))
+		attrs->attr_vals.attrlist4_val = NULL;
+}
+
 /**
  *
  * @brief Free the result for NFS4PROC_COMPOUND
@@ -877,6 +1263,7 @@ void nfs4_Compound_Free(nfs_res_t *res)
 {
 	unsigned int i = 0;
 	log_components_t component = COMPONENT_NFS_V4;
+	struct gsh_arena *arena = &res->res_compound4_extended.res_arena;
 
 	if (isFullDebug(COMPONENT_SESSIONS))
 		component = COMPONENT_SESSIONS;
@@ -888,6 +1275,11 @@ void nfs4_Compound_Free(nfs_res_t *res)
 		return;
 	}
 
+	if (res->res_compound4_extended.res_xdr != NULL) {
+		gsh_free(res->res_compound4_extended.res_xdr);
+		res->res_compound4_extended.res_xdr = NULL;
+	}
+
 	LogFullDebug(component,
 		     "nfs4_Compound_Free %p (resarraylen=%i)",
 		     res,
@@ -900,14 +1292,19 @@ void nfs4_Compound_Free(nfs_res_t *res)
 			/* !val is an error case, but it can occur, so avoid
 			 * indirect on NULL
 			 */
+			nfs4_Compound_unlink_arena(val, arena);
 			nfs4_Compound_FreeOne(val);
 		}
 	}
 
-	gsh_free(res->res_compound4.resarray.resarray_val);
+	if (!gsh_arena_owns(arena, res->res_compound4.resarray.resarray_val))
+		gsh_free(res->res_compound4.resarray.resarray_val);
 
-	if (res->res_compound4.tag.utf8string_val)
+	if (res->res_compound4.tag.utf8string_val &&
+	    !gsh_arena_owns(arena, res->res_compound4.tag.utf8string_val))
 		gsh_free(res->res_compound4.tag.utf8string_val);
+
+	gsh_arena_release(arena);
 }
 
 /**
@@ -920,6 +1317,10 @@ void nfs4_Compound_Free(nfs_res_t *res)
  */
 void compound_data_Free(compound_data_t *data)
 {
+	/* An encoded replay that was never handed to the reply */
+	gsh_free(data->replay_xdr);
+	data->replay_xdr = NULL;
+
 	/* Release refcounted cache entries */
 	if (data->current_obj) {
 		set_current_entry(data, NULL);
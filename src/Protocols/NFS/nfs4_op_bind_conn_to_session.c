@@ -0,0 +1,123 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file    nfs4_op_bind_conn_to_session.c
+ * @brief   Routines used for managing the NFS4_OP_BIND_CONN_TO_SESSION
+ *          operation.
+ *
+ * A session's requests are taken on any connection and replied to on
+ * the connection they came in on, so binding a connection to the fore
+ * channel needs no record.  Connections bound to the back channel are
+ * kept on the session, for its back channel to fail over to.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "nfs4.h"
+#include "nfs_core.h"
+#include "nfs_rpc_callback.h"
+#include "nfs_proto_functions.h"
+#include "sal_functions.h"
+
+/**
+ *
+ * @brief The NFS4_OP_BIND_CONN_TO_SESSION operation
+ *
+ * @param[in]     op   nfs4_op arguments
+ * @param[in,out] data Compound request's data
+ * @param[out]    resp nfs4_op results
+ *
+ * @return values as per RFC5661 p. 492
+ *
+ * @see nfs4_Compound
+ *
+ */
+
+int nfs4_op_bind_conn_to_session(struct nfs_argop4 *op,
+				 compound_data_t *data,
+				 struct nfs_resop4 *resp)
+{
+	BIND_CONN_TO_SESSION4args * const arg_BIND_CONN_TO_SESSION4 =
+	    &op->nfs_argop4_u.opbind_conn_to_session;
+	BIND_CONN_TO_SESSION4res * const res_BIND_CONN_TO_SESSION4 =
+	    &resp->nfs_resop4_u.opbind_conn_to_session;
+	BIND_CONN_TO_SESSION4resok * const resok =
+	    &res_BIND_CONN_TO_SESSION4->BIND_CONN_TO_SESSION4res_u.bctsr_resok4;
+	channel_dir_from_client4 dir = arg_BIND_CONN_TO_SESSION4->bctsa_dir;
+	nfs41_session_t *session;
+	int code;
+
+	resp->resop = NFS4_OP_BIND_CONN_TO_SESSION;
+	res_BIND_CONN_TO_SESSION4->bctsr_status = NFS4_OK;
+
+	if (data->minorversion == 0) {
+		res_BIND_CONN_TO_SESSION4->bctsr_status = NFS4ERR_INVAL;
+		return res_BIND_CONN_TO_SESSION4->bctsr_status;
+	}
+
+	if (!nfs41_Session_Get_Pointer(arg_BIND_CONN_TO_SESSION4->bctsa_sessid,
+				       &session)) {
+		res_BIND_CONN_TO_SESSION4->bctsr_status = NFS4ERR_BADSESSION;
+		return res_BIND_CONN_TO_SESSION4->bctsr_status;
+	}
+
+	resok->bctsr_dir = CDFS4_FORE;
+
+	if (dir & CDFC4_BACK) {
+		code = nfs_rpc_bind_conn_v41(session, data->req->rq_xprt);
+
+		LogDebug(COMPONENT_SESSIONS,
+			 "Binding connection %p to back channel of session %p returned %d",
+			 data->req->rq_xprt, session, code);
+
+		if (code == 0) {
+			resok->bctsr_dir =
+			    dir == CDFC4_BACK ? CDFS4_BACK : CDFS4_BOTH;
+		} else if (dir == CDFC4_BACK) {
+			/* The client does not take the fore channel alone */
+			res_BIND_CONN_TO_SESSION4->bctsr_status =
+			    NFS4ERR_INVAL;
+			dec_session_ref(session);
+			return res_BIND_CONN_TO_SESSION4->bctsr_status;
+		}
+	}
+
+	memcpy(resok->bctsr_sessid, arg_BIND_CONN_TO_SESSION4->bctsa_sessid,
+	       NFS4_SESSIONID_SIZE);
+	resok->bctsr_use_conn_in_rdma_mode = false;
+
+	/* Release ref taken in get_pointer */
+	dec_session_ref(session);
+
+	return res_BIND_CONN_TO_SESSION4->bctsr_status;
+}				/* nfs4_op_bind_conn_to_session */
+
+/**
+ * @brief Free memory allocated for result of nfs4_op_bind_conn_to_session
+ *
+ * @param[in,out] resp  nfs4_op results
+ *
+ */
+void nfs4_op_bind_conn_to_session_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
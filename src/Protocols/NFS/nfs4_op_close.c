@@ -305,9 +305,10 @@ int nfs4_op_close(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* File is closed, release the corresponding state. If the FSAL
 	 * supports extended ops, this will result in closing any open files
-	 * the FSAL has for this state.
+	 * the FSAL has for this state, unless it is kept for reuse or left
+	 * to a close thread.
 	 */
-	state_del_locked(state_found);
+	state_close_locked(state_found);
 
 	/* Poison the current stateid */
 	data->current_stateid_valid = false;
@@ -340,6 +341,11 @@ int nfs4_op_close(struct nfs_argop4 *op, compound_data_t *data,
 	if (data->minorversion == 0)
 		op_ctx->clientid = NULL;
 
+	/* Closing the FSAL files may have dropped FSAL locks that blocked
+	 * lock requests are waiting on.
+	 */
+	state_retry_blocked_locks(data->current_obj->state_hdl);
+
 	PTHREAD_RWLOCK_unlock(&data->current_obj->state_hdl->state_lock);
 	res_CLOSE4->status = NFS4_OK;
 
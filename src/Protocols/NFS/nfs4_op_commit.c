@@ -52,6 +52,73 @@
 static int op_dscommit(struct nfs_argop4 *op, compound_data_t *data,
 		       struct nfs_resop4 *resp);
 
+/**
+ * @brief State of a COMMIT waiting for asynchronous I/O
+ */
+struct nfs4_commit_data {
+	compound_data_t *data;		/*< Compound the COMMIT is part of */
+	fsal_status_t status;		/*< Result of the commit */
+};
+
+/**
+ * @brief Fill in a successful COMMIT result
+ */
+static int nfs4_commit_ok(COMMIT4res *res_COMMIT4)
+{
+	struct gsh_buffdesc verf_desc;
+
+	verf_desc.addr = &res_COMMIT4->COMMIT4res_u.resok4.writeverf;
+	verf_desc.len = sizeof(verifier4);
+
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "Commit verifier %d-%d",
+		     ((int *)verf_desc.addr)[0], ((int *)verf_desc.addr)[1]);
+
+	res_COMMIT4->status = NFS4_OK;
+	return res_COMMIT4->status;
+}
+
+/**
+ * @brief Finish a COMMIT once its asynchronous commit has completed
+ *
+ * @param[in]     op    The nfs4_op arguments
+ * @param[in,out] data  The compound request's data
+ * @param[out]    resp  The nfs4_op results
+ *
+ * @return per RFC5661 p. 362-3
+ */
+static int nfs4_commit_resume(struct nfs_argop4 *op, compound_data_t *data,
+			      struct nfs_resop4 *resp)
+{
+	COMMIT4res * const res_COMMIT4 = &resp->nfs_resop4_u.opcommit;
+	struct nfs4_commit_data *cd = data->op_data;
+	fsal_status_t fsal_status = cd->status;
+
+	gsh_free(cd);
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_COMMIT4->status = nfs4_Errno_status(fsal_status);
+		return res_COMMIT4->status;
+	}
+
+	return nfs4_commit_ok(res_COMMIT4);
+}
+
+/**
+ * @brief Completion callback for an asynchronous COMMIT
+ */
+static void nfs4_commit_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			   void *obj_data, void *caller_data)
+{
+	struct nfs4_commit_data *cd = caller_data;
+
+	cd->status = ret;
+	nfs4_async_done(cd->data);
+}
+
 /**
  * @brief Implemtation of NFS4_OP_COMMIT
  *
@@ -71,7 +138,7 @@ int nfs4_op_commit(struct nfs_argop4 *op, compound_data_t *data,
 	COMMIT4args * const arg_COMMIT4 = &op->nfs_argop4_u.opcommit;
 	COMMIT4res * const res_COMMIT4 = &resp->nfs_resop4_u.opcommit;
 	fsal_status_t fsal_status = { 0, 0 };
-	struct gsh_buffdesc verf_desc;
+	struct fsal_obj_handle *obj;
 
 	resp->resop = NFS4_OP_COMMIT;
 	res_COMMIT4->status = NFS4_OK;
@@ -92,26 +159,29 @@ int nfs4_op_commit(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_COMMIT4->status != NFS4_OK)
 		return res_COMMIT4->status;
 
-	fsal_status = fsal_commit(data->current_obj, arg_COMMIT4->offset,
+	obj = data->current_obj;
+
+	if (nfs_param.core_param.async_io &&
+	    obj->fsal->m_ops.support_ex(obj) &&
+	    (uint64_t) arg_COMMIT4->count <= ~(uint64_t) arg_COMMIT4->offset) {
+		struct nfs4_commit_data *cd = gsh_malloc(sizeof(*cd));
+
+		cd->data = data;
+		nfs4_async_prepare(data, nfs4_commit_resume, cd);
+		obj->obj_ops.commit2_async(obj, arg_COMMIT4->offset,
+					   arg_COMMIT4->count,
+					   nfs4_commit_cb, cd);
+		return nfs4_async_issued(op, data, resp);
+	}
+
+	fsal_status = fsal_commit(obj, arg_COMMIT4->offset,
 				  arg_COMMIT4->count);
 	if (FSAL_IS_ERROR(fsal_status)) {
 		res_COMMIT4->status = nfs4_Errno_status(fsal_status);
 		return res_COMMIT4->status;
 	}
 
-	verf_desc.addr = &res_COMMIT4->COMMIT4res_u.resok4.writeverf;
-	verf_desc.len = sizeof(verifier4);
-
-	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
-							&verf_desc);
-
-	LogFullDebug(COMPONENT_NFS_V4,
-		     "Commit verifier %d-%d",
-		     ((int *)verf_desc.addr)[0], ((int *)verf_desc.addr)[1]);
-
-	/* If you reach this point, then an error occured */
-	res_COMMIT4->status = NFS4_OK;
-	return res_COMMIT4->status;
+	return nfs4_commit_ok(res_COMMIT4);
 }				/* nfs4_op_commit */
 
 /**
@@ -0,0 +1,1075 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs4_op_copy.c
+ * @brief NFSv4.2 server side copy and clone
+ *
+ * COPY between two files of the same export, through the FSAL's copy
+ * method.  Small copies, and copies the client asks to be synchronous,
+ * are done before replying.  Larger ones are handed to the copy fridge
+ * and the reply carries a copy stateid; the result is delivered with
+ * CB_OFFLOAD and may be polled with OFFLOAD_STATUS or stopped with
+ * OFFLOAD_CANCEL.  A copy is kept on its client until its CB_OFFLOAD
+ * gets through, it is cancelled, or the client expires.
+ *
+ * CLONE takes the same arguments as an intra-server COPY and is passed
+ * to the FSAL's clone method whole.
+ *
+ * Inter-server copy is not supported, so COPY_NOTIFY only validates
+ * its arguments.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+#include "nfs_convert.h"
+#include "nfs_file_handle.h"
+#include "nfs_rpc_callback.h"
+#include "export_mgr.h"
+#include "fridgethr.h"
+#include "abstract_atomic.h"
+
+/** Most the FSAL is asked to copy at once, between cancel checks */
+#define NFS4_COPY_CHUNK (16 * 1024 * 1024)
+
+/**
+ * @brief An asynchronous copy
+ */
+struct nfs4_copy {
+	struct glist_head copy_link;	/*< Link in cid_copies */
+	stateid4 stateid;		/*< Copy stateid given the client */
+	int32_t refcount;		/*< The client list and the job */
+	nfs_client_id_t *clientid;	/*< Client, referenced */
+	struct gsh_export *export;	/*< Export, referenced */
+	struct fsal_obj_handle *src_obj;	/*< Source, referenced */
+	struct fsal_obj_handle *dst_obj;	/*< Destination, referenced */
+	state_t *src_state;		/*< Source state, or NULL */
+	state_t *dst_state;		/*< Destination state, or NULL */
+	bool src_anonymous;		/*< Anonymous read started */
+	bool dst_anonymous;		/*< Anonymous write started */
+	struct user_cred creds;		/*< Caller's credentials */
+	struct export_perms export_perms;	/*< Caller's export perms */
+	uint64_t src_offset;		/*< Where the copy reads */
+	uint64_t dst_offset;		/*< Where the copy writes */
+	uint64_t count;			/*< Bytes to copy */
+	uint64_t copied;		/*< Bytes copied so far, atomic */
+	uint32_t cancelled;		/*< OFFLOAD_CANCEL or expiry, atomic */
+	bool done;			/*< Finished, under cid_mutex */
+	nfsstat4 status;		/*< Result once done */
+	verifier4 verifier;		/*< Write verifier of the export */
+	nfs_fh4 fh;			/*< Destination handle for CB_OFFLOAD */
+	struct nfs_cb_batch_op cb_op;	/*< The CB_OFFLOAD */
+};
+
+static struct fridgethr *copy_fridge;
+static uint32_t copy_counter;
+static uint32_t copy_shutdown;
+
+/**
+ * @brief Initialize the copy fridge
+ */
+void nfs4_copy_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(frp));
+	frp.thr_max = nfs_param.nfsv4_param.copy_threads;
+	frp.thread_delay = 60;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&copy_fridge, "nfs_copy", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "Unable to initialize copy thread fridge: %d", rc);
+		copy_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Stop the copies in progress and the copy fridge
+ *
+ * Copies stop at their next chunk and report NFS4ERR_SERVERFAULT.
+ */
+void nfs4_copy_pkgshutdown(void)
+{
+	int rc;
+
+	if (copy_fridge == NULL)
+		return;
+
+	atomic_store_uint32_t(&copy_shutdown, 1);
+
+	rc = fridgethr_sync_command(copy_fridge, fridgethr_comm_stop, 120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(copy_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "Failed shutting down copy threads: %d", rc);
+	}
+
+	fridgethr_destroy(copy_fridge);
+	copy_fridge = NULL;
+}
+
+/**
+ * @brief Drop a reference to a copy, freeing it with the last one
+ *
+ * @param[in] copy The copy
+ */
+static void nfs4_copy_put(struct nfs4_copy *copy)
+{
+	struct root_op_context root_op_context;
+
+	if (atomic_dec_int32_t(&copy->refcount) != 0)
+		return;
+
+	init_root_op_context(&root_op_context, copy->export,
+			     copy->export->fsal_export, NFS_V4, 2,
+			     NFS_REQUEST);
+
+	if (copy->src_anonymous)
+		state_share_anonymous_io_done(copy->src_obj,
+					      OPEN4_SHARE_ACCESS_READ);
+	if (copy->dst_anonymous)
+		state_share_anonymous_io_done(copy->dst_obj,
+					      OPEN4_SHARE_ACCESS_WRITE);
+	if (copy->src_state != NULL)
+		dec_state_t_ref(copy->src_state);
+	if (copy->dst_state != NULL)
+		dec_state_t_ref(copy->dst_state);
+
+	copy->src_obj->obj_ops.put_ref(copy->src_obj);
+	copy->dst_obj->obj_ops.put_ref(copy->dst_obj);
+
+	release_root_op_context();
+
+	put_gsh_export(copy->export);
+	dec_client_id_ref(copy->clientid);
+
+	gsh_free(copy->creds.caller_garray);
+	nfs4_freeFH(&copy->fh);
+	gsh_free(copy);
+}
+
+/**
+ * @brief Take a copy off its client, if it is still there
+ *
+ * @param[in] copy The copy
+ */
+static void nfs4_copy_unlink(struct nfs4_copy *copy)
+{
+	nfs_client_id_t *clientid = copy->clientid;
+	bool linked;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	linked = !glist_null(&copy->copy_link);
+	if (linked)
+		glist_del(&copy->copy_link);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	if (linked)
+		nfs4_copy_put(copy);
+}
+
+/**
+ * @brief Find a client's copy by stateid and take a reference
+ *
+ * @param[in] clientid The client
+ * @param[in] stateid  Copy stateid the client gave
+ *
+ * @return The copy, or NULL if the client has no such copy.
+ */
+static struct nfs4_copy *nfs4_copy_lookup(nfs_client_id_t *clientid,
+					  stateid4 *stateid)
+{
+	struct glist_head *glist;
+	struct nfs4_copy *copy, *found = NULL;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+
+	glist_for_each(glist, &clientid->cid_copies) {
+		copy = glist_entry(glist, struct nfs4_copy, copy_link);
+		if (memcmp(copy->stateid.other, stateid->other,
+			   OTHERSIZE) == 0) {
+			found = copy;
+			(void) atomic_inc_int32_t(&found->refcount);
+			break;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	return found;
+}
+
+/**
+ * @brief Cancel and drop all copies of an expiring client
+ *
+ * Copies in progress stop at their next chunk and send no CB_OFFLOAD.
+ *
+ * @param[in] clientid The client
+ */
+void nfs4_copy_client_expire(nfs_client_id_t *clientid)
+{
+	struct nfs4_copy *copy;
+
+	while (true) {
+		PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+		copy = glist_first_entry(&clientid->cid_copies,
+					 struct nfs4_copy, copy_link);
+		if (copy != NULL)
+			glist_del(&copy->copy_link);
+		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+		if (copy == NULL)
+			break;
+
+		atomic_store_uint32_t(&copy->cancelled, 1);
+		nfs4_copy_put(copy);
+	}
+}
+
+/**
+ * @brief Copy a range through the FSAL, chunk by chunk
+ *
+ * @param[in]  src_obj    File to copy from
+ * @param[in]  src_state  State to read with, or NULL
+ * @param[in]  src_offset Position from which to copy
+ * @param[in]  dst_obj    File to copy to
+ * @param[in]  dst_state  State to write with, or NULL
+ * @param[in]  dst_offset Position at which to copy
+ * @param[in]  count      Bytes to copy
+ * @param[out] copied     Bytes copied, updated after each chunk
+ * @param[in]  cancelled  Checked between chunks, or NULL
+ *
+ * @return NFS4_OK if anything was copied or the source ended.
+ */
+static nfsstat4 nfs4_copy_range(struct fsal_obj_handle *src_obj,
+				state_t *src_state, uint64_t src_offset,
+				struct fsal_obj_handle *dst_obj,
+				state_t *dst_state, uint64_t dst_offset,
+				uint64_t count, uint64_t *copied,
+				uint32_t *cancelled)
+{
+	fsal_status_t status = { ERR_FSAL_NO_ERROR, 0 };
+	uint64_t done = 0, chunk, n;
+
+	while (done < count) {
+		if (atomic_fetch_uint32_t(&copy_shutdown) ||
+		    (cancelled != NULL && atomic_fetch_uint32_t(cancelled)))
+			return NFS4ERR_SERVERFAULT;
+
+		chunk = count - done;
+		if (chunk > NFS4_COPY_CHUNK)
+			chunk = NFS4_COPY_CHUNK;
+
+		n = 0;
+		status = src_obj->obj_ops.copy(src_obj, src_state,
+					       src_offset + done, dst_obj,
+					       dst_state, dst_offset + done,
+					       chunk, &n);
+		if (FSAL_IS_ERROR(status) || n == 0)
+			break;
+
+		done += n;
+		atomic_store_uint64_t(copied, done);
+	}
+
+	if (FSAL_IS_ERROR(status) && done == 0) {
+		LogDebug(COMPONENT_NFS_V4, "copy returned %s",
+			 fsal_err_txt(status));
+		return nfs4_Errno_status(status);
+	}
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Completion of a CB_OFFLOAD
+ *
+ * A copy whose CB_OFFLOAD the client took is forgotten.  Otherwise it
+ * is kept for OFFLOAD_STATUS until the client cancels it or expires.
+ *
+ * @param[in] op     The CB_OFFLOAD
+ * @param[in] hook   RPC_CALL_ABORT if it could not be sent
+ * @param[in] status The client's status for it
+ */
+static void nfs4_copy_cb_done(struct nfs_cb_batch_op *op, rpc_call_hook hook,
+			      nfsstat4 status)
+{
+	struct nfs4_copy *copy = container_of(op, struct nfs4_copy, cb_op);
+
+	if (hook == RPC_CALL_COMPLETE && status == NFS4_OK)
+		nfs4_copy_unlink(copy);
+	else
+		LogDebug(COMPONENT_NFS_CB,
+			 "CB_OFFLOAD not taken, hook %d status %s",
+			 hook, nfsstat4_to_str(status));
+
+	nfs4_copy_put(copy);
+}
+
+/**
+ * @brief Run an asynchronous copy and report it with CB_OFFLOAD
+ *
+ * @param[in] ctx Thread context, the copy is its argument
+ */
+static void nfs4_copy_job(struct fridgethr_context *ctx)
+{
+	struct nfs4_copy *copy = ctx->arg;
+	struct root_op_context root_op_context;
+	CB_OFFLOAD4args *cb;
+	nfsstat4 status;
+
+	init_root_op_context(&root_op_context, copy->export,
+			     copy->export->fsal_export, NFS_V4, 2,
+			     NFS_REQUEST);
+	root_op_context.req_ctx.creds = &copy->creds;
+	root_op_context.req_ctx.export_perms = &copy->export_perms;
+	root_op_context.req_ctx.clientid = &copy->clientid->cid_clientid;
+
+	status = nfs4_copy_range(copy->src_obj, copy->src_state,
+				 copy->src_offset, copy->dst_obj,
+				 copy->dst_state, copy->dst_offset,
+				 copy->count, &copy->copied,
+				 &copy->cancelled);
+
+	release_root_op_context();
+
+	PTHREAD_MUTEX_lock(&copy->clientid->cid_mutex);
+	copy->status = status;
+	copy->done = true;
+	PTHREAD_MUTEX_unlock(&copy->clientid->cid_mutex);
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "Copy of %" PRIu64 " bytes done, %" PRIu64 " copied, %s",
+		     copy->count, atomic_fetch_uint64_t(&copy->copied),
+		     nfsstat4_to_str(status));
+
+	if (atomic_fetch_uint32_t(&copy->cancelled)) {
+		nfs4_copy_put(copy);
+		return;
+	}
+
+	/* The job's reference goes with the callback */
+	copy->cb_op.arg.argop = NFS4_OP_CB_OFFLOAD;
+	cb = &copy->cb_op.arg.nfs_cb_argop4_u.opcboffload;
+	cb->coa_fh = copy->fh;
+	cb->coa_stateid = copy->stateid;
+	cb->coa_offload_info.coa_status = status;
+	if (status == NFS4_OK) {
+		write_response4 *wr =
+		    &cb->coa_offload_info.offload_info4_u.coa_resok4;
+
+		wr->wr_ids = 0;
+		wr->wr_count = atomic_fetch_uint64_t(&copy->copied);
+		wr->wr_committed = UNSTABLE4;
+		memcpy(wr->wr_writeverf, copy->verifier, sizeof(verifier4));
+	} else {
+		cb->coa_offload_info.offload_info4_u.coa_bytes_copied =
+		    atomic_fetch_uint64_t(&copy->copied);
+	}
+	copy->cb_op.completion = nfs4_copy_cb_done;
+
+	nfs_rpc_cb_batch(copy->clientid, &copy->cb_op);
+}
+
+/**
+ * @brief Check a COPY stateid and start its I/O
+ *
+ * As READ and WRITE do: open and lock stateids must have the file open
+ * for the access, delegations must allow it, and anonymous stateids
+ * start anonymous I/O against share reservations.
+ *
+ * @param[in]  data      Compound request's data
+ * @param[in]  stateid   Stateid to check
+ * @param[in]  obj       File it is for
+ * @param[in]  access    OPEN4_SHARE_ACCESS_READ or _WRITE
+ * @param[out] state     State found, referenced, or NULL
+ * @param[out] anonymous Whether anonymous I/O was started
+ * @param[in]  tag       Name for the log
+ *
+ * @return NFS4_OK or the error for the stateid.
+ */
+static nfsstat4 nfs4_copy_check_state(compound_data_t *data,
+				      stateid4 *stateid,
+				      struct fsal_obj_handle *obj,
+				      uint32_t access, state_t **state,
+				      bool *anonymous, const char *tag)
+{
+	state_t *state_found = NULL;
+	state_t *state_open = NULL;
+	struct state_deleg *sdeleg;
+	fsal_status_t fsal_status;
+	nfsstat4 status;
+
+	*state = NULL;
+	*anonymous = false;
+
+	status = nfs4_Check_Stateid(stateid, obj, &state_found, data,
+				    STATEID_SPECIAL_ANY, 0, false, tag);
+	if (status != NFS4_OK)
+		return status;
+
+	if (state_found == NULL) {
+		status = nfs4_Errno_state(
+			state_share_anonymous_io_start(obj, access,
+						       SHARE_BYPASS_NONE));
+		if (status != NFS4_OK)
+			return status;
+		*anonymous = true;
+		goto access;
+	}
+
+	switch (state_found->state_type) {
+	case STATE_TYPE_SHARE:
+		state_open = state_found;
+		break;
+
+	case STATE_TYPE_LOCK:
+		state_open = state_found->state_data.lock.openstate;
+		break;
+
+	case STATE_TYPE_DELEG:
+		sdeleg = &state_found->state_data.deleg;
+		if (sdeleg->sd_state != DELEG_GRANTED ||
+		    (access == OPEN4_SHARE_ACCESS_WRITE &&
+		     !(sdeleg->sd_type & OPEN_DELEGATE_WRITE))) {
+			LogDebug(COMPONENT_STATE,
+				 "%s delegation type:%d state:%d",
+				 tag, sdeleg->sd_type, sdeleg->sd_state);
+			status = NFS4ERR_BAD_STATEID;
+			goto out;
+		}
+		break;
+
+	case STATE_TYPE_LAYOUT:
+		break;
+
+	default:
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "%s with invalid stateid of type %d",
+			 tag, (int)state_found->state_type);
+		status = NFS4ERR_BAD_STATEID;
+		goto out;
+	}
+
+	if (state_open != NULL &&
+	    (state_open->state_data.share.share_access & access) == 0) {
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "%s stateid not open for access %" PRIu32,
+			 tag, access);
+		status = NFS4ERR_OPENMODE;
+		goto out;
+	}
+
+ access:
+	fsal_status = obj->obj_ops.test_access(
+		obj, access == OPEN4_SHARE_ACCESS_WRITE ? FSAL_WRITE_ACCESS
+							: FSAL_READ_ACCESS,
+		NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	*state = state_found;
+	return NFS4_OK;
+
+ out:
+	if (*anonymous) {
+		state_share_anonymous_io_done(obj, access);
+		*anonymous = false;
+	}
+	if (state_found != NULL)
+		dec_state_t_ref(state_found);
+	return status;
+}
+
+/**
+ * @brief I/O of a COPY or CLONE, between checking and finishing
+ */
+struct nfs4_copy_io {
+	state_t *src_state;	/*< Source state, or NULL */
+	state_t *dst_state;	/*< Destination state, or NULL */
+	bool src_anonymous;	/*< Anonymous read started */
+	bool dst_anonymous;	/*< Anonymous write started */
+	uint64_t count;		/*< Bytes, with 0 resolved to the source EOF */
+};
+
+/**
+ * @brief End what nfs4_copy_io_start began
+ *
+ * @param[in]     data Compound request's data
+ * @param[in,out] io   States and anonymous I/O, cleared
+ */
+static void nfs4_copy_io_done(compound_data_t *data, struct nfs4_copy_io *io)
+{
+	if (io->src_anonymous)
+		state_share_anonymous_io_done(data->saved_obj,
+					      OPEN4_SHARE_ACCESS_READ);
+	if (io->dst_anonymous)
+		state_share_anonymous_io_done(data->current_obj,
+					      OPEN4_SHARE_ACCESS_WRITE);
+	if (io->src_state != NULL)
+		dec_state_t_ref(io->src_state);
+	if (io->dst_state != NULL)
+		dec_state_t_ref(io->dst_state);
+
+	memset(io, 0, sizeof(*io));
+}
+
+/**
+ * @brief Check the arguments shared by COPY and CLONE
+ *
+ * The source is the saved filehandle and the destination the current
+ * one, both regular files of the same export.  The ranges must lie
+ * within the source and must not overlap within one file.
+ *
+ * @param[in]  data        Compound request's data
+ * @param[in]  src_stateid Stateid to read the source with
+ * @param[in]  dst_stateid Stateid to write the destination with
+ * @param[in]  src_offset  Where to read
+ * @param[in]  dst_offset  Where to write
+ * @param[in]  count       Bytes, 0 for up to the end of the source
+ * @param[out] io          States and anonymous I/O started, to be
+ *                         ended with nfs4_copy_io_done
+ * @param[in]  tag         Name for the log
+ *
+ * @return NFS4_OK or the error for the operation.
+ */
+static nfsstat4 nfs4_copy_io_start(compound_data_t *data,
+				   stateid4 *src_stateid,
+				   stateid4 *dst_stateid,
+				   uint64_t src_offset, uint64_t dst_offset,
+				   uint64_t count, struct nfs4_copy_io *io,
+				   const char *tag)
+{
+	struct fsal_obj_handle *src_obj, *dst_obj;
+	struct attrlist attrs;
+	fsal_status_t fsal_status;
+	char src_tag[32], dst_tag[32];
+	uint64_t size;
+	nfsstat4 status;
+
+	memset(io, 0, sizeof(*io));
+
+	status = nfs4_sanity_check_saved_FH(data, REGULAR_FILE, false);
+	if (status != NFS4_OK)
+		return status;
+
+	status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+	if (status != NFS4_OK)
+		return status;
+
+	if (data->saved_export != op_ctx->ctx_export)
+		return NFS4ERR_XDEV;
+
+	src_obj = data->saved_obj;
+	dst_obj = data->current_obj;
+
+	if (!dst_obj->fsal->m_ops.support_ex(dst_obj))
+		return NFS4ERR_NOTSUPP;
+
+	(void) snprintf(src_tag, sizeof(src_tag), "%s source", tag);
+	(void) snprintf(dst_tag, sizeof(dst_tag), "%s destination", tag);
+
+	status = nfs4_copy_check_state(data, src_stateid, src_obj,
+				       OPEN4_SHARE_ACCESS_READ,
+				       &io->src_state, &io->src_anonymous,
+				       src_tag);
+	if (status != NFS4_OK)
+		return status;
+
+	status = nfs4_copy_check_state(data, dst_stateid, dst_obj,
+				       OPEN4_SHARE_ACCESS_WRITE,
+				       &io->dst_state, &io->dst_anonymous,
+				       dst_tag);
+	if (status != NFS4_OK)
+		goto out;
+
+	fsal_prepare_attrs(&attrs, ATTR_SIZE);
+	fsal_status = src_obj->obj_ops.getattrs(src_obj, &attrs);
+	size = attrs.filesize;
+	fsal_release_attrs(&attrs);
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	if (src_offset > size ||
+	    (count != 0 && count > size - src_offset)) {
+		status = NFS4ERR_INVAL;
+		goto out;
+	}
+	if (count == 0)
+		count = size - src_offset;
+
+	if (src_obj == dst_obj && src_offset < dst_offset + count &&
+	    dst_offset < src_offset + count) {
+		status = NFS4ERR_INVAL;
+		goto out;
+	}
+
+	io->count = count;
+	return NFS4_OK;
+
+ out:
+	nfs4_copy_io_done(data, io);
+	return status;
+}
+
+/**
+ * @brief Hand a checked COPY to the copy fridge
+ *
+ * Takes over the states and anonymous I/O of @c io when it succeeds.
+ *
+ * @param[in]     data Compound request's data
+ * @param[in]     args The COPY
+ * @param[in,out] io   Checked I/O, cleared if queued
+ * @param[in,out] wr   Reply, with the verifier set
+ *
+ * @return true if the copy was queued.
+ */
+static bool nfs4_copy_queue(compound_data_t *data, COPY4args *args,
+			    struct nfs4_copy_io *io, write_response4 *wr)
+{
+	nfs_client_id_t *clientid = data->session->clientid_record;
+	struct nfs4_copy *copy;
+	uint32_t idx;
+
+	copy = gsh_calloc(1, sizeof(*copy));
+
+	idx = atomic_inc_uint32_t(&copy_counter);
+	copy->stateid.seqid = 1;
+	memcpy(copy->stateid.other, &clientid->cid_clientid,
+	       sizeof(clientid4));
+	memcpy(copy->stateid.other + sizeof(clientid4), &idx, sizeof(idx));
+
+	/* One for the client list, one for the job */
+	copy->refcount = 2;
+	copy->clientid = clientid;
+	inc_client_id_ref(clientid);
+	copy->export = op_ctx->ctx_export;
+	get_gsh_export_ref(copy->export);
+	copy->src_obj = data->saved_obj;
+	copy->src_obj->obj_ops.get_ref(copy->src_obj);
+	copy->dst_obj = data->current_obj;
+	copy->dst_obj->obj_ops.get_ref(copy->dst_obj);
+	copy->src_state = io->src_state;
+	copy->src_anonymous = io->src_anonymous;
+	copy->dst_state = io->dst_state;
+	copy->dst_anonymous = io->dst_anonymous;
+
+	copy->creds = *op_ctx->creds;
+	if (copy->creds.caller_glen != 0) {
+		size_t len = copy->creds.caller_glen * sizeof(gid_t);
+
+		copy->creds.caller_garray = gsh_malloc(len);
+		memcpy(copy->creds.caller_garray,
+		       op_ctx->creds->caller_garray, len);
+	} else {
+		copy->creds.caller_garray = NULL;
+	}
+	copy->export_perms = *op_ctx->export_perms;
+
+	copy->src_offset = args->ca_src_offset;
+	copy->dst_offset = args->ca_dst_offset;
+	copy->count = io->count;
+	memcpy(copy->verifier, wr->wr_writeverf, sizeof(verifier4));
+
+	copy->fh.nfs_fh4_len = data->currentFH.nfs_fh4_len;
+	copy->fh.nfs_fh4_val = gsh_malloc(copy->fh.nfs_fh4_len);
+	memcpy(copy->fh.nfs_fh4_val, data->currentFH.nfs_fh4_val,
+	       copy->fh.nfs_fh4_len);
+
+	memcpy(copy->cb_op.refer.session, data->session->session_id,
+	       sizeof(sessionid4));
+	copy->cb_op.refer.sequence = data->sequence;
+	copy->cb_op.refer.slot = data->slot;
+	copy->cb_op.has_refer = true;
+
+	/* The copy may be gone as soon as it is submitted */
+	wr->wr_ids = 1;
+	wr->wr_callback_id = copy->stateid;
+	wr->wr_count = 0;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	glist_add_tail(&clientid->cid_copies, &copy->copy_link);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	if (fridgethr_submit(copy_fridge, nfs4_copy_job, copy) != 0) {
+		/* Give the states back to the caller */
+		copy->src_state = NULL;
+		copy->src_anonymous = false;
+		copy->dst_state = NULL;
+		copy->dst_anonymous = false;
+		nfs4_copy_unlink(copy);
+		nfs4_copy_put(copy);
+		return false;
+	}
+
+	memset(io, 0, sizeof(*io));
+	return true;
+}
+
+/**
+ * @brief The NFS4_OP_COPY operation
+ *
+ * Copies from the saved filehandle to the current filehandle.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862.
+ */
+int nfs4_op_copy(struct nfs_argop4 *op, compound_data_t *data,
+		 struct nfs_resop4 *resp)
+{
+	COPY4args * const arg_COPY = &op->nfs_argop4_u.opcopy;
+	COPY4res * const res_COPY = &resp->nfs_resop4_u.opcopy;
+	COPY4resok *resok = &res_COPY->COPY4res_u.cr_resok4;
+	struct nfs4_copy_io io = { NULL };
+	struct gsh_buffdesc verf_desc;
+	uint64_t copied = 0;
+
+	resp->resop = NFS4_OP_COPY;
+
+	if (data->minorversion < 2) {
+		res_COPY->cr_status = NFS4ERR_NOTSUPP;
+		goto out;
+	}
+
+	/* Only intra-server copies */
+	if (arg_COPY->ca_source_server.ca_source_server_len != 0) {
+		res_COPY->cr_status = NFS4ERR_NOTSUPP;
+		goto out;
+	}
+
+	res_COPY->cr_status = nfs4_copy_io_start(data,
+						 &arg_COPY->ca_src_stateid,
+						 &arg_COPY->ca_dst_stateid,
+						 arg_COPY->ca_src_offset,
+						 arg_COPY->ca_dst_offset,
+						 arg_COPY->ca_count, &io,
+						 "COPY");
+	if (res_COPY->cr_status != NFS4_OK)
+		goto out;
+
+	verf_desc.addr = resok->cr_response.wr_writeverf;
+	verf_desc.len = sizeof(verifier4);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+	resok->cr_response.wr_committed = UNSTABLE4;
+	resok->cr_requirements.cr_consecutive = true;
+
+	if (!arg_COPY->ca_synchronous && copy_fridge != NULL &&
+	    io.count > nfs_param.nfsv4_param.copy_async_threshold &&
+	    (data->session->flags & session_bc_up) &&
+	    nfs4_copy_queue(data, arg_COPY, &io, &resok->cr_response)) {
+		resok->cr_requirements.cr_synchronous = false;
+		res_COPY->cr_status = NFS4_OK;
+		goto out;
+	}
+
+	res_COPY->cr_status = nfs4_copy_range(data->saved_obj, io.src_state,
+					      arg_COPY->ca_src_offset,
+					      data->current_obj, io.dst_state,
+					      arg_COPY->ca_dst_offset,
+					      io.count, &copied, NULL);
+	if (res_COPY->cr_status != NFS4_OK)
+		goto out;
+
+	resok->cr_response.wr_ids = 0;
+	resok->cr_response.wr_count = copied;
+	resok->cr_requirements.cr_synchronous = true;
+
+ out:
+	LogDebug(COMPONENT_NFS_V4,
+		 "COPY %" PRIu64 " bytes from %" PRIu64 " to %" PRIu64 ": %s",
+		 arg_COPY->ca_count, arg_COPY->ca_src_offset,
+		 arg_COPY->ca_dst_offset,
+		 nfsstat4_to_str(res_COPY->cr_status));
+
+	nfs4_copy_io_done(data, &io);
+
+	return res_COPY->cr_status;
+}
+
+/**
+ * @brief Free memory allocated for COPY result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_copy_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_CLONE operation
+ *
+ * Shares a range of the saved filehandle with the current filehandle,
+ * through the FSAL's clone method.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862.
+ */
+int nfs4_op_clone(struct nfs_argop4 *op, compound_data_t *data,
+		  struct nfs_resop4 *resp)
+{
+	CLONE4args * const arg_CLONE = &op->nfs_argop4_u.opclone;
+	CLONE4res * const res_CLONE = &resp->nfs_resop4_u.opclone;
+	struct nfs4_copy_io io = { NULL };
+	struct fsal_obj_handle *src_obj = data->saved_obj;
+	fsal_status_t fsal_status;
+
+	resp->resop = NFS4_OP_CLONE;
+
+	if (data->minorversion < 2) {
+		res_CLONE->cl_status = NFS4ERR_NOTSUPP;
+		goto out;
+	}
+
+	res_CLONE->cl_status = nfs4_copy_io_start(data,
+						  &arg_CLONE->cl_src_stateid,
+						  &arg_CLONE->cl_dst_stateid,
+						  arg_CLONE->cl_src_offset,
+						  arg_CLONE->cl_dst_offset,
+						  arg_CLONE->cl_count, &io,
+						  "CLONE");
+	if (res_CLONE->cl_status != NFS4_OK)
+		goto out;
+
+	/* The FSAL gets the count as given, so 0 is still up to EOF
+	 * should the source grow meanwhile.
+	 */
+	fsal_status = src_obj->obj_ops.clone(src_obj, io.src_state,
+					     arg_CLONE->cl_src_offset,
+					     data->current_obj, io.dst_state,
+					     arg_CLONE->cl_dst_offset,
+					     arg_CLONE->cl_count);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		LogDebug(COMPONENT_NFS_V4, "clone returned %s",
+			 fsal_err_txt(fsal_status));
+		res_CLONE->cl_status = nfs4_Errno_status(fsal_status);
+	}
+
+ out:
+	LogDebug(COMPONENT_NFS_V4,
+		 "CLONE %" PRIu64 " bytes from %" PRIu64 " to %" PRIu64 ": %s",
+		 arg_CLONE->cl_count, arg_CLONE->cl_src_offset,
+		 arg_CLONE->cl_dst_offset,
+		 nfsstat4_to_str(res_CLONE->cl_status));
+
+	nfs4_copy_io_done(data, &io);
+
+	return res_CLONE->cl_status;
+}
+
+/**
+ * @brief Free memory allocated for CLONE result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_clone_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_COPY_NOTIFY operation
+ *
+ * Only needed by the source of an inter-server copy, which this server
+ * does not take part in.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862.
+ */
+int nfs4_op_copy_notify(struct nfs_argop4 *op, compound_data_t *data,
+			struct nfs_resop4 *resp)
+{
+	COPY_NOTIFY4res * const res_COPY_NOTIFY =
+	    &resp->nfs_resop4_u.opcopy_notify;
+
+	resp->resop = NFS4_OP_COPY_NOTIFY;
+
+	if (data->minorversion < 2) {
+		res_COPY_NOTIFY->cnr_status = NFS4ERR_NOTSUPP;
+		return res_COPY_NOTIFY->cnr_status;
+	}
+
+	res_COPY_NOTIFY->cnr_status = nfs4_sanity_check_FH(data, REGULAR_FILE,
+							   false);
+	if (res_COPY_NOTIFY->cnr_status != NFS4_OK)
+		return res_COPY_NOTIFY->cnr_status;
+
+	res_COPY_NOTIFY->cnr_status = NFS4ERR_NOTSUPP;
+	return res_COPY_NOTIFY->cnr_status;
+}
+
+/**
+ * @brief Free memory allocated for COPY_NOTIFY result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_copy_notify_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_CANCEL operation
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862.
+ */
+int nfs4_op_offload_cancel(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_CANCEL4args * const arg_OFFLOAD_CANCEL =
+	    &op->nfs_argop4_u.opoffload_cancel;
+	OFFLOAD_CANCEL4res * const res_OFFLOAD_CANCEL =
+	    &resp->nfs_resop4_u.opoffload_cancel;
+	struct nfs4_copy *copy;
+
+	resp->resop = NFS4_OP_OFFLOAD_CANCEL;
+
+	if (data->minorversion < 2) {
+		res_OFFLOAD_CANCEL->ocr_status = NFS4ERR_NOTSUPP;
+		return res_OFFLOAD_CANCEL->ocr_status;
+	}
+
+	res_OFFLOAD_CANCEL->ocr_status =
+	    nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+	if (res_OFFLOAD_CANCEL->ocr_status != NFS4_OK)
+		return res_OFFLOAD_CANCEL->ocr_status;
+
+	copy = nfs4_copy_lookup(data->session->clientid_record,
+				&arg_OFFLOAD_CANCEL->oca_stateid);
+	if (copy == NULL) {
+		res_OFFLOAD_CANCEL->ocr_status = NFS4ERR_BAD_STATEID;
+		return res_OFFLOAD_CANCEL->ocr_status;
+	}
+
+	atomic_store_uint32_t(&copy->cancelled, 1);
+	nfs4_copy_unlink(copy);
+	nfs4_copy_put(copy);
+
+	res_OFFLOAD_CANCEL->ocr_status = NFS4_OK;
+	return res_OFFLOAD_CANCEL->ocr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_CANCEL result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_STATUS operation
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862.
+ */
+int nfs4_op_offload_status(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_STATUS4args * const arg_OFFLOAD_STATUS =
+	    &op->nfs_argop4_u.opoffload_status;
+	OFFLOAD_STATUS4res * const res_OFFLOAD_STATUS =
+	    &resp->nfs_resop4_u.opoffload_status;
+	OFFLOAD_STATUS4resok *resok =
+	    &res_OFFLOAD_STATUS->OFFLOAD_STATUS4res_u.osr_resok4;
+	nfs_client_id_t *clientid;
+	struct nfs4_copy *copy;
+
+	resp->resop = NFS4_OP_OFFLOAD_STATUS;
+
+	if (data->minorversion < 2) {
+		res_OFFLOAD_STATUS->osr_status = NFS4ERR_NOTSUPP;
+		return res_OFFLOAD_STATUS->osr_status;
+	}
+
+	res_OFFLOAD_STATUS->osr_status =
+	    nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+	if (res_OFFLOAD_STATUS->osr_status != NFS4_OK)
+		return res_OFFLOAD_STATUS->osr_status;
+
+	clientid = data->session->clientid_record;
+	copy = nfs4_copy_lookup(clientid, &arg_OFFLOAD_STATUS->osa_stateid);
+	if (copy == NULL) {
+		res_OFFLOAD_STATUS->osr_status = NFS4ERR_BAD_STATEID;
+		return res_OFFLOAD_STATUS->osr_status;
+	}
+
+	resok->osr_count = atomic_fetch_uint64_t(&copy->copied);
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	if (copy->done) {
+		resok->osr_complete.osr_complete_len = 1;
+		resok->osr_complete.osr_complete_val[0] = copy->status;
+	} else {
+		resok->osr_complete.osr_complete_len = 0;
+	}
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	nfs4_copy_put(copy);
+
+	res_OFFLOAD_STATUS->osr_status = NFS4_OK;
+	return res_OFFLOAD_STATUS->osr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_STATUS result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_offload_status_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
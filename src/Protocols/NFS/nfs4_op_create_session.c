@@ -86,7 +86,7 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	struct display_buffer dspbuf_clientid4 = {
 		sizeof(str_clientid4), str_clientid4, str_clientid4};
 	/* Return code from clientid calls */
-	int i, rc = 0;
+	int rc = 0;
 	/* Component for logging */
 	log_components_t component = COMPONENT_CLIENTID;
 	/* Abbreviated alias for arguments */
@@ -324,8 +324,23 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	nfs41_session->cb_program = 0;
 	PTHREAD_MUTEX_init(&nfs41_session->cb_mutex, NULL);
 	PTHREAD_COND_init(&nfs41_session->cb_cond, NULL);
-	for (i = 0; i < NFS41_NB_SLOTS; i++)
-		PTHREAD_MUTEX_init(&nfs41_session->slots[i].lock, NULL);
+	(void) nfs41_Session_Alloc_Slots(nfs41_session,
+			arg_CREATE_SESSION4->csa_fore_chan_attrs.ca_maxrequests);
+
+	/* The backchannel slot table is negotiated the same way, and the
+	 * reply below returns the count we will use.
+	 */
+	nfs41_session->nb_cb_slots = nfs_param.nfsv4_param.max_cb_slots;
+	if (nfs41_session->back_channel_attrs.ca_maxrequests <
+	    nfs41_session->nb_cb_slots)
+		nfs41_session->nb_cb_slots =
+			nfs41_session->back_channel_attrs.ca_maxrequests;
+	if (nfs41_session->nb_cb_slots == 0)
+		nfs41_session->nb_cb_slots = 1;
+	nfs41_session->cb_slots = gsh_calloc(nfs41_session->nb_cb_slots,
+					     sizeof(*nfs41_session->cb_slots));
+	nfs41_session->back_channel_attrs.ca_maxrequests =
+		nfs41_session->nb_cb_slots;
 
 	/* Take reference to clientid record on behalf the session. */
 	inc_client_id_ref(found);
@@ -336,8 +351,9 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 		  &nfs41_session->session_link);
 	PTHREAD_MUTEX_unlock(&found->cid_mutex);
 
-	/* Set ca_maxrequests */
-	nfs41_session->fore_channel_attrs.ca_maxrequests = NFS41_NB_SLOTS;
+	/* Set ca_maxrequests to what we negotiated */
+	nfs41_session->fore_channel_attrs.ca_maxrequests =
+	    nfs41_session->nb_slots;
 	nfs41_Build_sessionid(&clientid, nfs41_session->session_id);
 
 	res_CREATE_SESSION4ok->csr_sequence = arg_CREATE_SESSION4->csa_sequence;
@@ -473,7 +489,7 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	conf->cid_create_session_sequence++;
 
 	/* Bump the lease timer */
-	conf->cid_last_renew = time(NULL);
+	atomic_store_time_t(&conf->cid_last_renew, time(NULL));
 
 	/* Release our reference to the confirmed record */
 	dec_client_id_ref(conf);
@@ -78,12 +78,18 @@ int nfs4_op_delegreturn(struct nfs_argop4 *op, compound_data_t *data,
 	resp->resop = NFS4_OP_DELEGRETURN;
 
 	/* If the filehandle is invalid. Delegations are only supported on
-	 * regular files at the moment.
+	 * regular files and, from GET_DIR_DELEGATION, on directories.
 	 */
 	res_DELEGRETURN4->status = nfs4_sanity_check_FH(data,
-							REGULAR_FILE,
+							NO_FILE_TYPE,
 							false);
 
+	if (res_DELEGRETURN4->status == NFS4_OK &&
+	    data->current_filetype != DIRECTORY)
+		res_DELEGRETURN4->status = nfs4_sanity_check_FH(data,
+								REGULAR_FILE,
+								false);
+
 	if (res_DELEGRETURN4->status != NFS4_OK) {
 		if (res_DELEGRETURN4->status == NFS4ERR_ISDIR)
 			res_DELEGRETURN4->status = NFS4ERR_INVAL;
@@ -104,6 +110,16 @@ int nfs4_op_delegreturn(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_DELEGRETURN4->status != NFS4_OK)
 		return res_DELEGRETURN4->status;
 
+	if (data->current_obj->type == DIRECTORY) {
+		/* No heuristics and no lease to give back */
+		PTHREAD_RWLOCK_wrlock(
+			&data->current_obj->state_hdl->state_lock);
+		state_del_locked(state_found);
+		PTHREAD_RWLOCK_unlock(
+			&data->current_obj->state_hdl->state_lock);
+		goto out_unlock;
+	}
+
 	owner = get_state_owner_ref(state_found);
 
 	if (owner == NULL) {
@@ -113,7 +129,7 @@ int nfs4_op_delegreturn(struct nfs_argop4 *op, compound_data_t *data,
 		goto out_unlock;
 	}
 
-	deleg_heuristics_recall(data->current_obj, owner, state_found);
+	deleg_heuristics_recall(data->current_obj, owner, state_found, false);
 
 	/* Release reference taken above. */
 	dec_state_owner_ref(owner);
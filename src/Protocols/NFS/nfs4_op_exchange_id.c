@@ -105,6 +105,8 @@ int nfs4_op_exchange_id(struct nfs_argop4 *op, compound_data_t *data,
 	if (data->minorversion == 0)
 		return res_EXCHANGE_ID4->eir_status = NFS4ERR_INVAL;
 
+	nfs4_storm_count();
+
 	if ((arg_EXCHANGE_ID4->
 	     eia_flags & ~(EXCHGID4_FLAG_SUPP_MOVED_REFER |
 			   EXCHGID4_FLAG_SUPP_MOVED_MIGR |
@@ -0,0 +1,223 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file    nfs4_op_get_dir_delegation.c
+ * @brief   Routines used for managing the NFS4_OP_GET_DIR_DELEGATION
+ *          operation.
+ *
+ * A directory delegation is a delegation state on the directory, owned
+ * by the client like file delegations.  Changes to the directory's
+ * entries are sent to it by state_dir_deleg_notify().
+ */
+
+#include "config.h"
+#include <string.h>
+#include "log.h"
+#include "fsal.h"
+#include "nfs4.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+#include "sal_functions.h"
+
+/**
+ * @brief Check whether a directory delegation may be granted
+ *
+ * @param[in] data Compound request's data
+ *
+ * @return true if it may.
+ */
+static bool dir_deleg_available(compound_data_t *data)
+{
+	struct fsal_export *fsal_export = op_ctx->fsal_export;
+
+	if (!nfs_param.nfsv4_param.allow_delegations ||
+	    !nfs_param.nfsv4_param.dir_delegations)
+		return false;
+
+	if (!(op_ctx->export_perms->options & EXPORT_OPTION_READ_DELEG) ||
+	    !fsal_export->exp_ops.fs_supports(fsal_export,
+					      fso_delegations_r))
+		return false;
+
+	/* Changes can't be notified, nor the delegation recalled */
+	return (data->session->flags & session_bc_up) != 0;
+}
+
+/**
+ * @brief The NFS4_OP_GET_DIR_DELEGATION operation
+ *
+ * @param[in]     op   nfs4_op arguments
+ * @param[in,out] data Compound request's data
+ * @param[out]    resp nfs4_op results
+ *
+ * @return values as per RFC5661 p. 377
+ *
+ * @see nfs4_Compound
+ */
+int nfs4_op_get_dir_delegation(struct nfs_argop4 *op,
+			       compound_data_t *data,
+			       struct nfs_resop4 *resp)
+{
+	GET_DIR_DELEGATION4args * const arg_GDD4 =
+	    &op->nfs_argop4_u.opget_dir_delegation;
+	GET_DIR_DELEGATION4res * const res_GDD4 =
+	    &resp->nfs_resop4_u.opget_dir_delegation;
+	GET_DIR_DELEGATION4res_non_fatal * const res_nf =
+	    &res_GDD4->GET_DIR_DELEGATION4res_u.gddr_res_non_fatal4;
+	GET_DIR_DELEGATION4resok * const resok =
+	    &res_nf->GET_DIR_DELEGATION4res_non_fatal_u.gddrnf_resok4;
+	struct fsal_obj_handle *obj;
+	nfs_client_id_t *client;
+	struct state_hdl *ostate;
+	union state_data state_data;
+	struct state_refer refer;
+	struct glist_head *glist;
+	state_t *state = NULL, *old;
+	state_status_t state_status;
+	uint32_t notify = 0;
+
+	resp->resop = NFS4_OP_GET_DIR_DELEGATION;
+	res_GDD4->gddr_status = NFS4_OK;
+
+	if (data->minorversion == 0) {
+		res_GDD4->gddr_status = NFS4ERR_NOTSUPP;
+		return res_GDD4->gddr_status;
+	}
+
+	res_GDD4->gddr_status = nfs4_sanity_check_FH(data, DIRECTORY, false);
+	if (res_GDD4->gddr_status != NFS4_OK)
+		return res_GDD4->gddr_status;
+
+	obj = data->current_obj;
+	client = data->session->clientid_record;
+	ostate = obj->state_hdl;
+
+	if (!dir_deleg_available(data) || ostate == NULL)
+		goto unavail;
+
+	if (arg_GDD4->gdda_notification_types.bitmap4_len > 0)
+		notify = arg_GDD4->gdda_notification_types.map[0] &
+			 DIR_DELEG_NOTIFY_MASK;
+
+	/* Record the sequence info */
+	memcpy(refer.session, data->session->session_id, sizeof(sessionid4));
+	refer.sequence = data->sequence;
+	refer.slot = data->slot;
+
+	PTHREAD_RWLOCK_wrlock(&ostate->state_lock);
+
+	/* A client holds one delegation per directory, asking again
+	 * updates the notifications it gets.
+	 */
+	glist_for_each(glist, &ostate->dir.dir_delegs) {
+		old = glist_entry(glist, state_t, state_list);
+
+		if (old->state_owner != &client->cid_owner)
+			continue;
+
+		if (old->state_data.deleg.sd_state != DELEG_GRANTED) {
+			/* Being recalled */
+			PTHREAD_RWLOCK_unlock(&ostate->state_lock);
+			goto unavail;
+		}
+
+		state = old;
+		inc_state_t_ref(state);
+		break;
+	}
+
+	if (state == NULL) {
+		init_new_deleg_state(&state_data, OPEN_DELEGATE_READ, client);
+		state_data.deleg.sd_notify = notify;
+
+		state_status = state_add_impl(obj, STATE_TYPE_DELEG,
+					      &state_data, &client->cid_owner,
+					      &state, &refer);
+		if (state_status != STATE_SUCCESS) {
+			PTHREAD_RWLOCK_unlock(&ostate->state_lock);
+			LogDebug(COMPONENT_NFS_V4_LOCK,
+				 "GET_DIR_DELEGATION failed to add state with status %s",
+				 state_err_str(state_status));
+			goto unavail;
+		}
+	} else {
+		state->state_data.deleg.sd_notify = notify;
+	}
+
+	state->state_seqid++;
+	COPY_STATEID(&resok->gddr_stateid, state);
+
+	PTHREAD_RWLOCK_unlock(&ostate->state_lock);
+
+	LogFullDebugOpaque(COMPONENT_STATE,
+			   "directory delegation granted, stateid: %s",
+			   100, state->stateid_other, OTHERSIZE);
+
+	dec_state_t_ref(state);
+
+	res_nf->gddrnf_status = GDD4_OK;
+
+	/* The cookie verifier READDIR returns */
+	memset(resok->gddr_cookieverf, 0, NFS4_VERIFIER_SIZE);
+	if (op_ctx_export_has_option(EXPORT_OPTION_USE_COOKIE_VERIFIER)) {
+		struct attrlist attrs;
+		time_t change_time;
+
+		fsal_prepare_attrs(&attrs, ATTR_CHGTIME);
+
+		if (!FSAL_IS_ERROR(obj->obj_ops.getattrs(obj, &attrs))) {
+			change_time = timespec_to_nsecs(&attrs.chgtime);
+			memcpy(resok->gddr_cookieverf, &change_time,
+			       sizeof(change_time));
+		}
+
+		fsal_release_attrs(&attrs);
+	}
+
+	resok->gddr_notification.bitmap4_len = 1;
+	resok->gddr_notification.map[0] = notify;
+
+	/* Attribute changes are not notified */
+	resok->gddr_child_attributes.bitmap4_len = 0;
+	resok->gddr_dir_attributes.bitmap4_len = 0;
+
+	return res_GDD4->gddr_status;
+
+ unavail:
+	res_nf->gddrnf_status = GDD4_UNAVAIL;
+	res_nf->GET_DIR_DELEGATION4res_non_fatal_u.
+		gddrnf_will_signal_deleg_avail = false;
+
+	return res_GDD4->gddr_status;
+}				/* nfs4_op_get_dir_delegation */
+
+/**
+ * @brief Free memory allocated for result of nfs4_op_get_dir_delegation
+ *
+ * @param[in,out] resp  nfs4_op results
+ */
+void nfs4_op_get_dir_delegation_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
@@ -195,7 +195,7 @@ static nfsstat4 acquire_layout_state(compound_data_t *data,
 			goto out;
 		}
 
-		glist_init(&(*layout_state)->state_data.layout.state_segments);
+		state_layout_index_init(*layout_state);
 	} else {
 		/* A state eixsts but is of an invalid type. */
 		nfs_status = NFS4ERR_BAD_STATEID;
@@ -550,6 +550,47 @@ void nfs4_op_layouterror_Free(nfs_resop4 *res)
 {
 }
 
+/**
+ * @brief Log what a flex files client saw of a data server
+ *
+ * @param[in] update The layoutupdate4 of a LAYOUTSTATS
+ */
+static void layoutstats_flex_files(layoutupdate4 *update)
+{
+	ff_layoutupdate4 ff_update;
+	XDR xdrs;
+
+	memset(&ff_update, 0, sizeof(ff_update));
+	xdrmem_create(&xdrs, update->lou_body.lou_body_val,
+		      update->lou_body.lou_body_len, XDR_DECODE);
+
+	if (!xdr_ff_layoutupdate4(&xdrs, &ff_update)) {
+		LogDebug(COMPONENT_PNFS,
+			 "LAYOUTSTATS could not decode ff_layoutupdate4");
+	} else {
+		LogDebug(COMPONENT_PNFS,
+			 "LAYOUTSTATS data server %s %s over %" PRId64
+			 " s: read %u ops, avg %" PRId64 ".%09u s, max %"
+			 PRId64 ".%09u s; write %u ops, avg %" PRId64
+			 ".%09u s, max %" PRId64 ".%09u s",
+			 ff_update.ffl_addr.r_netid, ff_update.ffl_addr.r_addr,
+			 ff_update.ffl_duration.seconds,
+			 ff_update.ffl_read.ffil_count,
+			 ff_update.ffl_read.ffil_avg.seconds,
+			 ff_update.ffl_read.ffil_avg.nseconds,
+			 ff_update.ffl_read.ffil_max.seconds,
+			 ff_update.ffl_read.ffil_max.nseconds,
+			 ff_update.ffl_write.ffil_count,
+			 ff_update.ffl_write.ffil_avg.seconds,
+			 ff_update.ffl_write.ffil_avg.nseconds,
+			 ff_update.ffl_write.ffil_max.seconds,
+			 ff_update.ffl_write.ffil_max.nseconds);
+	}
+
+	xdr_free((xdrproc_t) xdr_ff_layoutupdate4, &ff_update);
+	xdr_destroy(&xdrs);
+}
+
 int nfs4_op_layoutstats(struct nfs_argop4 *op, compound_data_t *data,
 		      struct nfs_resop4 *resp)
 {
@@ -575,6 +616,11 @@ int nfs4_op_layoutstats(struct nfs_argop4 *op, compound_data_t *data,
 		 arg_LAYOUTSTATS4->lsa_write.ii_count,
 		 arg_LAYOUTSTATS4->lsa_write.ii_bytes);
 
+	if (arg_LAYOUTSTATS4->lsa_layoutupdate.lou_type == LAYOUT4_FLEX_FILES &&
+	    arg_LAYOUTSTATS4->lsa_layoutupdate.lou_body.lou_body_len != 0 &&
+	    isDebug(COMPONENT_PNFS))
+		layoutstats_flex_files(&arg_LAYOUTSTATS4->lsa_layoutupdate);
+
 	/** @todo: what else do we want to do with the stats ???  */
 
 	res_LAYOUTSTATS4->lsr_status = nfs_status;
@@ -461,8 +461,8 @@ void handle_recalls(struct fsal_layoutreturn_arg *arg,
 			}
 
 			if (satisfaction
-			    && glist_length(&state->state_data.layout.
-					    state_segments) == 1) {
+			    && state->state_data.layout.
+			       state_segment_count == 1) {
 				dec_state_t_ref(s->state);
 				glist_del(&s->link);
 				arg->recall_cookies[arg->ncookies++]
@@ -517,6 +517,10 @@ nfsstat4 nfs4_return_one_state(struct fsal_obj_handle *obj,
 	struct glist_head *seg_iter = NULL;
 	/* Saved 'next' pointer for iterating over segment list */
 	struct glist_head *seg_next = NULL;
+	/* Segments whose range changed, out of the index */
+	struct glist_head changed;
+	/* Next overlapping segment */
+	state_layout_segment_t *next = NULL;
 	/* Input arguments to FSAL_layoutreturn */
 	struct fsal_layoutreturn_arg *arg;
 	/* XDR stream holding the lrf_body opaque */
@@ -567,20 +571,23 @@ nfsstat4 nfs4_return_one_state(struct fsal_obj_handle *obj,
 		arg->lo_type =
 			layout_state->state_data.layout.state_layout_type;
 
-		/* The _safe version of glist_for_each allows us to
-		 * delete segments while we iterate.
+		/* Only the segments the index finds may overlap the
+		 * returned range.  A segment may be deleted once its
+		 * successor was found.  Segments whose range changes are
+		 * kept out of the index until the walk is over, so that
+		 * none is visited twice.
 		 */
-		glist_for_each_safe(seg_iter, seg_next,
-				    &layout_state->state_data.layout.
-				    state_segments) {
-			/* The current segment in iteration */
-			g = glist_entry(seg_iter, state_layout_segment_t,
-					sls_state_segments);
+		glist_init(&changed);
+		nfs_status = NFS4_OK;
+
+		for (g = state_layout_segment_first(layout_state,
+						    &spec_segment);
+		     g != NULL; g = next) {
+			next = state_layout_segment_next(g, &spec_segment);
 
 			arg->cur_segment = g->sls_segment;
 			arg->fsal_seg_data = g->sls_fsal_data;
-			/* TODO: why this check does not work */
-			arg->last_segment = (seg_next->next == seg_next);
+			arg->last_segment = (next == NULL);
 
 			if (pnfs_segment_contains
 			    (&spec_segment, &g->sls_segment)) {
@@ -601,22 +608,39 @@ nfsstat4 nfs4_return_one_state(struct fsal_obj_handle *obj,
 						arg);
 
 			if (nfs_status != NFS4_OK)
-				goto out;
+				break;
 
 			if (arg->dispose) {
 				state_status = state_delete_segment(g);
 				if (state_status != STATE_SUCCESS) {
 					nfs_status =
 					    nfs4_Errno_state(state_status);
-					goto out;
+					break;
 				}
 			} else {
+				state_segment_unindex(g);
 				g->sls_segment =
 				    pnfs_segment_difference(&spec_segment,
 							    &g->sls_segment);
+				glist_del(&g->sls_state_segments);
+				glist_add_tail(&changed,
+					       &g->sls_state_segments);
 			}
 		}
 
+		glist_for_each_safe(seg_iter, seg_next, &changed) {
+			g = glist_entry(seg_iter, state_layout_segment_t,
+					sls_state_segments);
+			glist_del(&g->sls_state_segments);
+			glist_add_tail(&layout_state->state_data.layout.
+				       state_segments,
+				       &g->sls_state_segments);
+			state_segment_reindex(g);
+		}
+
+		if (nfs_status != NFS4_OK)
+			goto out;
+
 		if (body_val) {
 			/* This really should work in all cases for an
 			 * in-memory decode stream.
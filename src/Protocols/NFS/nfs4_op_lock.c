@@ -425,7 +425,8 @@ int nfs4_op_lock(struct nfs_argop4 *op, compound_data_t *data,
 			fs_supports(op_ctx->fsal_export, fso_grace_method))
 				fsal_grace = true;
 
-		if (!fsal_grace && !arg_LOCK4->reclaim) {
+		if (!fsal_grace && !arg_LOCK4->reclaim &&
+		    nfs_in_grace_client(clientid)) {
 			LogLock(COMPONENT_NFS_V4_LOCK, NIV_DEBUG,
 			"LOCK failed, non-reclaim while in grace",
 				data->current_obj, resp_owner, &lock_desc);
@@ -102,11 +102,6 @@ int nfs4_op_lockt(struct nfs_argop4 *op, compound_data_t *data,
 		return res_LOCKT4->status;
 	}
 
-	if (nfs_in_grace()) {
-		res_LOCKT4->status = NFS4ERR_GRACE;
-		return res_LOCKT4->status;
-	}
-
 	/* Convert lock parameters to internal types */
 	switch (arg_LOCKT4->locktype) {
 	case READ_LT:
@@ -154,17 +149,18 @@ int nfs4_op_lockt(struct nfs_argop4 *op, compound_data_t *data,
 		return res_LOCKT4->status;
 	}
 
-	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	if (nfs_in_grace_client(clientid)) {
+		dec_client_id_ref(clientid);
+		res_LOCKT4->status = NFS4ERR_GRACE;
+		return res_LOCKT4->status;
+	}
 
 	if (data->minorversion == 0 && !reserve_lease(clientid)) {
-		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
 		dec_client_id_ref(clientid);
 		res_LOCKT4->status = NFS4ERR_EXPIRED;
 		return res_LOCKT4->status;
 	}
 
-	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
-
 	/* Is this lock_owner known ? */
 	convert_nfs4_lock_owner(&arg_LOCKT4->owner, &owner_name);
 
@@ -235,11 +231,8 @@ int nfs4_op_lockt(struct nfs_argop4 *op, compound_data_t *data,
  out:
 
 	/* Update the lease before exit */
-	if (data->minorversion == 0) {
-		PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	if (data->minorversion == 0)
 		update_lease(clientid);
-		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
-	}
 
 	dec_client_id_ref(clientid);
 
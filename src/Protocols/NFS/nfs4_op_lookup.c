@@ -41,6 +41,7 @@
 #include "nfs_proto_tools.h"
 #include "nfs_convert.h"
 #include "export_mgr.h"
+#include "nfs_proto_functions.h"
 
 /**
  * @brief NFS4_OP_LOOKUP
@@ -103,6 +104,9 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Sanity check: dir_obj should be ACTUALLY a directory */
 
+	/* Mount the exports below name if they are still waiting */
+	(void) pseudo_lazy_mount(dir_obj, name);
+
 	status = fsal_lookup(dir_obj, name, &file_obj, NULL);
 	if (FSAL_IS_ERROR(status)) {
 		res_LOOKUP4->status = nfs4_Errno_status(status);
@@ -42,6 +42,7 @@
 #include "nfs_file_handle.h"
 #include "nfs_convert.h"
 #include "export_mgr.h"
+#include "nfs_proto_functions.h"
 
 /**
  * @brief NFS4_OP_LOOKUPP
@@ -85,6 +86,9 @@ int nfs4_op_lookupp(struct nfs_argop4 *op, compound_data_t *data,
 	if (data->current_obj->type != DIRECTORY)
 		goto not_junction;
 
+	/* An export reached by handle may not be in the PseudoFS yet */
+	pseudo_lazy_mount_export(original_export);
+
 	PTHREAD_RWLOCK_rdlock(&original_export->lock);
 
 	status = nfs_export_get_root_entry(original_export, &root_obj);
@@ -360,7 +360,7 @@ static nfsstat4 open4_validate_claim(compound_data_t *data,
 
 	switch (claim) {
 	case CLAIM_NULL:
-		if (nfs_in_grace() || ((data->minorversion > 0)
+		if (nfs_in_grace_client(clientid) || ((data->minorversion > 0)
 		    && !clientid->cid_cb.v41.cid_reclaim_complete))
 			status = NFS4ERR_GRACE;
 		break;
@@ -372,7 +372,7 @@ static nfsstat4 open4_validate_claim(compound_data_t *data,
 		if (op_ctx->fsal_export->exp_ops.
 			fs_supports(op_ctx->fsal_export, fso_grace_method))
 				fsal_grace = true;
-		if (!fsal_grace && nfs_in_grace())
+		if (!fsal_grace && nfs_in_grace_client(clientid))
 			status = NFS4ERR_GRACE;
 		break;
 
@@ -1384,6 +1384,13 @@ static void open4_ex(OPEN4args *arg,
 			goto out;
 		}
 
+		/* Opens kept after CLOSE still count as readers. */
+		if ((openflags &
+		     (FSAL_O_DENY_READ | FSAL_O_DENY_WRITE_MAND)) != 0)
+			state_flush_parked_locked(file_obj);
+		else
+			state_flush_closing_locked(file_obj);
+
 		/* Check if there is already a state for this entry and owner.
 		 */
 		*file_state = nfs4_State_Get_Obj(file_obj, owner);
@@ -1412,8 +1419,30 @@ static void open4_ex(OPEN4args *arg,
 		}
 	}
 
-	/* If that did not succeed, allocate a state from the FSAL. */
-	if (*file_state == NULL) {
+	/* The owner may have just closed the file, and the FSAL may still
+	 * have it open.
+	 */
+	if (*file_state == NULL && file_obj != NULL &&
+	    arg->openhow.opentype == OPEN4_NOCREATE) {
+		*file_state = state_reuse_parked_locked(file_obj, owner,
+							openflags);
+		*new_state = *file_state != NULL;
+	}
+
+	if (*new_state) {
+		/* No open2, but the permission check it would have done. */
+		status = fsal_reuse_open2(file_obj, openflags);
+
+		if (FSAL_IS_ERROR(status)) {
+			(void) file_obj->obj_ops.close2(file_obj, *file_state);
+			res_OPEN4->status = nfs4_Errno_status(status);
+			goto out;
+		}
+
+		/* We need an extra reference below. */
+		file_obj->obj_ops.get_ref(file_obj);
+	} else if (*file_state == NULL) {
+		/* If that did not succeed, allocate a state from the FSAL. */
 		*file_state = op_ctx->fsal_export->exp_ops.alloc_state(
 							op_ctx->fsal_export,
 							STATE_TYPE_SHARE,
@@ -1775,17 +1804,12 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
 	}
 
 	/* Check if lease is expired and reserve it */
-	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
-
 	if (data->minorversion == 0 && !reserve_lease(clientid)) {
-		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
 		res_OPEN4->status = NFS4ERR_EXPIRED;
 		LogDebug(COMPONENT_NFS_V4, "Lease expired");
 		goto out3;
 	}
 
-	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
-
 	/* Get the open owner */
 	if (!open4_open_owner(op, data, resp, clientid, &owner)) {
 		LogDebug(COMPONENT_NFS_V4, "open4_open_owner failed");
@@ -2027,11 +2051,8 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
  out2:
 
 	/* Update the lease before exit */
-	if (data->minorversion == 0) {
-		PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	if (data->minorversion == 0)
 		update_lease(clientid);
-		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
-	}
 
 	if (file_state != NULL)
 		dec_state_t_ref(file_state);
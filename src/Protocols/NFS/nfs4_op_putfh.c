@@ -125,8 +125,8 @@ static int nfs4_ds_putfh(compound_data_t *data)
 	 */
 	data->current_filetype = REGULAR_FILE;
 
-	return pds->s_ops.make_ds_handle(pds, &fh_desc, &data->current_ds,
-					 v4_handle->fhflags1);
+	return pnfs_ds_make_handle(pds, &fh_desc, v4_handle->fhflags1,
+				   &data->current_ds);
 }
 
 static int nfs4_mds_putfh(compound_data_t *data)
@@ -139,6 +139,7 @@ static int nfs4_mds_putfh(compound_data_t *data)
 	struct fsal_obj_handle *new_hdl;
 	fsal_status_t fsal_status = { 0, 0 };
 	bool changed = true;
+	uint64_t hint;
 
 	LogFullDebug(COMPONENT_FILEHANDLE,
 		     "NFS4 Handle flags 0x%X export id %d",
@@ -195,12 +196,15 @@ static int nfs4_mds_putfh(compound_data_t *data)
 
 	fh_desc.len = v4_handle->fs_len;
 	fh_desc.addr = &v4_handle->fsopaque;
+	hint = nfs_get_cache_hint(v4_handle->fhflags1, v4_handle->fsopaque,
+				  v4_handle->fs_len);
 
 	/* adjust the handle opaque into a cache key */
 	fsal_status = export->exp_ops.extract_handle(export,
 						     FSAL_DIGEST_NFSV4,
 						     &fh_desc,
-						     v4_handle->fhflags1);
+						     v4_handle->fhflags1 &
+						     ~FH_CACHE_HINT);
 	if (FSAL_IS_ERROR(fsal_status)) {
 		LogFullDebug(COMPONENT_FILEHANDLE,
 			     "extract_handle failed %s",
@@ -208,8 +212,21 @@ static int nfs4_mds_putfh(compound_data_t *data)
 		return nfs4_Errno_status(fsal_status);
 	}
 
-	fsal_status = export->exp_ops.create_handle(export, &fh_desc,
-						    &new_hdl, NULL);
+	if (hint != 0)
+		fsal_status = export->exp_ops.create_handle_hint(export,
+								 &fh_desc,
+								 hint,
+								 &new_hdl);
+	else
+		fsal_status = export->exp_ops.create_handle(export, &fh_desc,
+							    &new_hdl, NULL);
+
+	/* A PseudoFS node from before a restart may not be built yet */
+	if (fsal_status.major == ERR_FSAL_STALE &&
+	    pseudo_lazy_mount(NULL, NULL))
+		fsal_status = export->exp_ops.create_handle(export, &fh_desc,
+							    &new_hdl, NULL);
+
 	if (FSAL_IS_ERROR(fsal_status)) {
 		LogDebug(COMPONENT_FILEHANDLE,
 			 "could not get create_handle object error %s",
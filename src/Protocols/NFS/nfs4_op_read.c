@@ -47,6 +47,7 @@
 #include "fsal_pnfs.h"
 #include "server_stats.h"
 #include "export_mgr.h"
+#include "gsh_iobuf.h"
 
 /**
  * @brief Read on a pNFS pNFS data server
@@ -86,7 +87,7 @@ static int op_dsread(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Construct the FSAL file handle */
 
-	buffer = gsh_malloc_aligned(4096, arg_READ4->count);
+	buffer = gsh_iobuf_get(arg_READ4->count);
 
 	res_READ4->READ4res_u.resok4.data.data_val = buffer;
 
@@ -101,7 +102,7 @@ static int op_dsread(struct nfs_argop4 *op, compound_data_t *data,
 				&eof);
 
 	if (nfs_status != NFS4_OK) {
-		gsh_free(buffer);
+		gsh_iobuf_put(buffer);
 		res_READ4->READ4res_u.resok4.data.data_val = NULL;
 	}
 
@@ -157,7 +158,7 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Construct the FSAL file handle */
 
-	buffer = gsh_malloc_aligned(4096, arg_READ4->count);
+	buffer = gsh_iobuf_get(arg_READ4->count);
 
 	nfs_status = data->current_ds->dsh_ops.read_plus(
 				data->current_ds,
@@ -171,7 +172,7 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	res_RPLUS->rpr_status = nfs_status;
 	if (nfs_status != NFS4_OK) {
-		gsh_free(buffer);
+		gsh_iobuf_put(buffer);
 		return res_RPLUS->rpr_status;
 	}
 
@@ -182,6 +183,8 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 	if (info->io_content.what == NFS4_CONTENT_HOLE) {
 		contentp->hole.di_offset = info->io_content.hole.di_offset;
 		contentp->hole.di_length = info->io_content.hole.di_length;
+		/* no data to send, the buffer is not referenced */
+		gsh_iobuf_put(buffer);
 	}
 	if (info->io_content.what == NFS4_CONTENT_DATA) {
 		contentp->data.d_offset = info->io_content.data.d_offset;
@@ -193,6 +196,205 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 	return res_RPLUS->rpr_status;
 }
 
+/**
+ * @brief Check a short read against the file size
+ *
+ * Some clients (ESXi) expect EOF to be set when the read reaches the
+ * end of the file, which not all FSALs report.
+ */
+static bool nfs4_read_eof(struct fsal_obj_handle *obj, uint64_t offset,
+			  size_t read_size)
+{
+	/** @todo FSF: add a config option for this behavior?
+	 */
+	struct attrlist attrs;
+	bool eof_met = false;
+
+	fsal_prepare_attrs(&attrs, ATTR_SIZE);
+
+	if (!FSAL_IS_ERROR(obj->obj_ops.getattrs(obj, &attrs)))
+		eof_met = (offset + read_size) >= attrs.filesize;
+
+	/* Done with the attrs */
+	fsal_release_attrs(&attrs);
+
+	return eof_met;
+}
+
+/**
+ * @brief Find the extent a READ_PLUS starts in
+ *
+ * Asks the FSAL where data and holes are, so that a hole is answered
+ * without reading it and a read of data stops where the next hole
+ * begins.
+ *
+ * @param[in]     obj    File being read
+ * @param[in]     state  State to seek with
+ * @param[in]     offset Where the read starts
+ * @param[in,out] size   Bytes asked, trimmed to the extent
+ * @param[out]    hole   Whether the extent is a hole
+ * @param[out]    eof    Whether the hole runs to the end of the file
+ *
+ * @return false if the FSAL can't seek data and holes.
+ */
+static bool nfs4_read_plus_extent(struct fsal_obj_handle *obj,
+				  state_t *state, uint64_t offset,
+				  uint64_t *size, bool *hole, bool *eof)
+{
+	struct io_info seek;
+	struct attrlist attrs;
+	fsal_status_t status;
+	uint64_t found, filesize;
+
+	memset(&seek, 0, sizeof(seek));
+	seek.io_content.what = NFS4_CONTENT_DATA;
+	seek.io_content.hole.di_offset = offset;
+
+	status = obj->obj_ops.seek2(obj, state, &seek);
+	if (FSAL_IS_ERROR(status))
+		return false;
+
+	*hole = false;
+	*eof = false;
+
+	if (seek.io_eof) {
+		/* No data from offset on, so a hole up to the end of the
+		 * file, unless offset is already past it.
+		 */
+		fsal_prepare_attrs(&attrs, ATTR_SIZE);
+		status = obj->obj_ops.getattrs(obj, &attrs);
+		filesize = attrs.filesize;
+		fsal_release_attrs(&attrs);
+
+		if (FSAL_IS_ERROR(status) || offset >= filesize)
+			return true;
+
+		*hole = true;
+		if (filesize - offset <= *size) {
+			*size = filesize - offset;
+			*eof = true;
+		}
+		return true;
+	}
+
+	found = seek.io_content.hole.di_offset;
+	if (found > offset) {
+		*hole = true;
+		if (found - offset < *size)
+			*size = found - offset;
+		return true;
+	}
+
+	/* Data at offset, read up to the next hole */
+	seek.io_content.what = NFS4_CONTENT_HOLE;
+	seek.io_content.hole.di_offset = offset;
+
+	status = obj->obj_ops.seek2(obj, state, &seek);
+	if (!FSAL_IS_ERROR(status) && !seek.io_eof) {
+		found = seek.io_content.hole.di_offset;
+		if (found > offset && found - offset < *size)
+			*size = found - offset;
+	}
+
+	return true;
+}
+
+/**
+ * @brief State of a READ waiting for asynchronous I/O
+ *
+ * Allocated with room for read_arg and its iovecs after it.
+ */
+struct nfs4_read_data {
+	compound_data_t *data;		/*< Compound the READ is part of */
+	struct fsal_obj_handle *obj;	/*< File being read */
+	state_t *state_found;		/*< State from the stateid */
+	state_t *state_open;		/*< Open state, if any */
+	state_owner_t *owner;		/*< Owner, for NFSv4.0 */
+	bool anonymous_started;		/*< Anonymous I/O in progress */
+	uint64_t size;			/*< Requested size */
+	void *bufferdata;		/*< Payload buffer */
+	fsal_status_t status;		/*< Result of the I/O */
+	struct fsal_io_arg *read_arg;	/*< I/O arguments and results */
+};
+
+/**
+ * @brief Finish a READ once its asynchronous I/O has completed
+ *
+ * @param[in]     op    The nfs4_op arguments
+ * @param[in,out] data  The compound request's data
+ * @param[out]    resp  The nfs4_op results
+ *
+ * @return Errors as specified by RFC3550 RFC5661 p. 371.
+ */
+static int nfs4_read_resume(struct nfs_argop4 *op, compound_data_t *data,
+			    struct nfs_resop4 *resp)
+{
+	READ4res * const res_READ4 = &resp->nfs_resop4_u.opread;
+	struct nfs4_read_data *rd = data->op_data;
+	uint64_t offset = rd->read_arg->offset;
+	size_t read_size = 0;
+	bool eof_met;
+
+	if (!rd->anonymous_started && data->minorversion == 0)
+		op_ctx->clientid = NULL;
+
+	if (FSAL_IS_ERROR(rd->status)) {
+		res_READ4->status = nfs4_Errno_status(rd->status);
+		gsh_iobuf_put(rd->bufferdata);
+		res_READ4->READ4res_u.resok4.data.data_val = NULL;
+		goto done;
+	}
+
+	read_size = rd->read_arg->io_amount;
+	eof_met = rd->read_arg->end_of_file;
+
+	if (!eof_met)
+		eof_met = nfs4_read_eof(rd->obj, offset, read_size);
+
+	res_READ4->READ4res_u.resok4.data.data_len = read_size;
+	res_READ4->READ4res_u.resok4.data.data_val = rd->bufferdata;
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "NFS4_OP_READ: offset = %" PRIu64
+		     " read length = %zu eof=%u", offset, read_size, eof_met);
+
+	res_READ4->READ4res_u.resok4.eof = eof_met;
+	res_READ4->status = NFS4_OK;
+
+ done:
+
+	if (rd->anonymous_started)
+		state_share_anonymous_io_done(rd->obj, OPEN4_SHARE_ACCESS_READ);
+
+	server_stats_io_done(rd->obj, rd->size, read_size,
+			     (res_READ4->status == NFS4_OK) ? true : false,
+			     false);
+
+	if (rd->owner != NULL)
+		dec_state_owner_ref(rd->owner);
+
+	if (rd->state_found != NULL)
+		dec_state_t_ref(rd->state_found);
+
+	if (rd->state_open != NULL)
+		dec_state_t_ref(rd->state_open);
+
+	gsh_free(rd);
+
+	return res_READ4->status;
+}
+
+/**
+ * @brief Completion callback for an asynchronous READ
+ */
+static void nfs4_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			 void *read_data, void *caller_data)
+{
+	struct nfs4_read_data *rd = caller_data;
+
+	rd->status = ret;
+	nfs4_async_done(rd->data);
+}
 
 static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		    struct nfs_resop4 *resp, fsal_io_direction_t io,
@@ -213,10 +415,9 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	bool anonymous_started = false;
 	state_owner_t *owner = NULL;
 	bool bypass = false;
-	uint64_t MaxRead = atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxRead);
-	uint64_t MaxOffsetRead =
-			atomic_fetch_uint64_t(
-				&op_ctx->ctx_export->MaxOffsetRead);
+	bool sparse = false;
+	uint64_t MaxRead;
+	uint64_t MaxOffsetRead;
 
 	/* Say we are managing NFS4_OP_READ */
 	resp->resop = NFS4_OP_READ;
@@ -236,6 +437,11 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_READ4->status != NFS4_OK)
 		return res_READ4->status;
 
+	/* A DS handle may have no export, fetch these past the DS path */
+	MaxRead = atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxRead);
+	MaxOffsetRead = atomic_fetch_uint64_t(
+				&op_ctx->ctx_export->MaxOffsetRead);
+
 	obj = data->current_obj;
 	/* Check stateid correctness and get pointer to state (also
 	   checks for special stateids) */
@@ -447,8 +653,36 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		goto done;
 	}
 
-	/* Some work is to be done */
-	bufferdata = gsh_malloc_aligned(4096, size);
+	if (info != NULL && obj->fsal->m_ops.support_ex(obj)) {
+		/* A hole may be answered past MaxRead, it costs nothing */
+		uint64_t extent = arg_READ4->count;
+		bool hole;
+
+		if (nfs4_read_plus_extent(obj, state_found, offset, &extent,
+					  &hole, &eof_met)) {
+			if (hole) {
+				info->io_content.what = NFS4_CONTENT_HOLE;
+				info->io_content.hole.di_offset = offset;
+				info->io_content.hole.di_length = extent;
+				res_READ4->READ4res_u.resok4.eof = eof_met;
+				res_READ4->READ4res_u.resok4.data.data_len = 0;
+				res_READ4->READ4res_u.resok4.data.data_val =
+									NULL;
+				res_READ4->status = NFS4_OK;
+				goto done;
+			}
+
+			/* Only data to read, the FSAL needn't know it is
+			 * for READ_PLUS.
+			 */
+			if (extent < size)
+				size = extent;
+			sparse = true;
+		}
+	}
+
+	if (obj->fsal->m_ops.support_ex(obj))
+		state_read_pattern(obj, state_found, offset, size);
 
 	if (!anonymous_started && data->minorversion == 0) {
 		owner = get_state_owner_ref(state_found);
@@ -458,38 +692,61 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
+	if (nfs_param.core_param.async_io && info == NULL &&
+	    obj->fsal->m_ops.support_ex(obj)) {
+		/* Hand the references over to nfs4_read_resume */
+		struct nfs4_read_data *rd;
+		void *payload = gsh_iobuf_get_payload(size);
+
+		rd = gsh_malloc(sizeof(*rd) + sizeof(struct fsal_io_arg) +
+				gsh_iobuf_iovcnt(payload) *
+				sizeof(struct iovec));
+		rd->data = data;
+		rd->obj = obj;
+		rd->state_found = state_found;
+		rd->state_open = state_open;
+		rd->owner = owner;
+		rd->anonymous_started = anonymous_started;
+		rd->size = size;
+		rd->bufferdata = payload;
+		rd->read_arg = (struct fsal_io_arg *) (rd + 1);
+		rd->read_arg->io_amount = 0;
+		rd->read_arg->info = NULL;
+		rd->read_arg->end_of_file = false;
+		rd->read_arg->state = state_found;
+		rd->read_arg->offset = offset;
+		rd->read_arg->iov_count =
+			gsh_iobuf_fill_iov(payload, rd->read_arg->iov, size);
+
+		nfs4_async_prepare(data, nfs4_read_resume, rd);
+		obj->obj_ops.read2_async(obj, bypass, nfs4_read_cb,
+					 rd->read_arg, rd);
+		return nfs4_async_issued(op, data, resp);
+	}
+
 	if (obj->fsal->m_ops.support_ex(obj)) {
-		/* Call the new fsal_read2 */
-		fsal_status = fsal_read2(obj, bypass, state_found, offset, size,
-					 &read_size, bufferdata, &eof_met,
-					 info);
+		/* Call the new fsal_read_ref2, the FSAL may hand us a
+		 * reference to its own buffer rather than copying */
+		fsal_status = fsal_read_ref2(obj, bypass, state_found, offset,
+					     size, &read_size, &bufferdata,
+					     &eof_met, sparse ? NULL : info);
 	} else {
 		/* Call legacy fsal_rdwr */
+		bufferdata = gsh_iobuf_get(size);
 		fsal_status = fsal_rdwr(obj, io, offset, size, &read_size,
 					bufferdata, &eof_met, &sync, info);
 	}
 
 	if (FSAL_IS_ERROR(fsal_status)) {
 		res_READ4->status = nfs4_Errno_status(fsal_status);
-		gsh_free(bufferdata);
+		gsh_iobuf_put(bufferdata);
 		res_READ4->READ4res_u.resok4.data.data_val = NULL;
 		goto done;
 	}
 
-	if (!eof_met) {
-		/** @todo FSF: add a config option for this behavior?
-		 */
-		/* Need to check against filesize for ESXi clients */
-		struct attrlist attrs;
-
-		fsal_prepare_attrs(&attrs, ATTR_SIZE);
-
-		if (!FSAL_IS_ERROR(obj->obj_ops.getattrs(obj, &attrs)))
-			eof_met = (offset + read_size) >= attrs.filesize;
-
-		/* Done with the attrs */
-		fsal_release_attrs(&attrs);
-	}
+	/* Need to check against filesize for ESXi clients */
+	if (!eof_met)
+		eof_met = nfs4_read_eof(obj, offset, read_size);
 
 	if (!anonymous_started && data->minorversion == 0)
 		op_ctx->clientid = NULL;
@@ -497,6 +754,13 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	res_READ4->READ4res_u.resok4.data.data_len = read_size;
 	res_READ4->READ4res_u.resok4.data.data_val = bufferdata;
 
+	if (sparse) {
+		info->io_content.what = NFS4_CONTENT_DATA;
+		info->io_content.data.d_offset = offset;
+		info->io_content.data.d_data.data_len = read_size;
+		info->io_content.data.d_data.data_val = bufferdata;
+	}
+
 	LogFullDebug(COMPONENT_NFS_V4,
 		     "NFS4_OP_READ: offset = %" PRIu64
 		     " read length = %zu eof=%u", offset, read_size, eof_met);
@@ -512,7 +776,7 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	if (anonymous_started)
 		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
 
-	server_stats_io_done(size, read_size,
+	server_stats_io_done(obj, size, read_size,
 			     (res_READ4->status == NFS4_OK) ? true : false,
 			     false);
 
@@ -568,7 +832,7 @@ void nfs4_op_read_Free(nfs_resop4 *res)
 
 	if (resp->status == NFS4_OK)
 		if (resp->READ4res_u.resok4.data.data_val != NULL)
-			gsh_free(resp->READ4res_u.resok4.data.data_val);
+			gsh_iobuf_put(resp->READ4res_u.resok4.data.data_val);
 }
 
 /**
@@ -596,6 +860,7 @@ int nfs4_op_read_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	resp->resop = NFS4_OP_READ_PLUS;
 
+	memset(&info, 0, sizeof(info));
 	nfs4_read(op, data, &res, FSAL_IO_READ_PLUS, &info);
 
 	res_RPLUS->rpr_status = res_READ4->status;
@@ -610,6 +875,8 @@ int nfs4_op_read_plus(struct nfs_argop4 *op, compound_data_t *data,
 	if (info.io_content.what == NFS4_CONTENT_HOLE) {
 		contentp->hole.di_offset = info.io_content.hole.di_offset;
 		contentp->hole.di_length = info.io_content.hole.di_length;
+		/* no data to send, the buffer is not referenced */
+		gsh_iobuf_put(res_READ4->READ4res_u.resok4.data.data_val);
 	}
 	if (info.io_content.what == NFS4_CONTENT_DATA) {
 		contentp->data.d_offset = info.io_content.data.d_offset;
@@ -628,7 +895,7 @@ void nfs4_op_read_plus_Free(nfs_resop4 *res)
 
 	if (resp->rpr_status == NFS4_OK && conp->what == NFS4_CONTENT_DATA)
 		if (conp->data.d_data.data_val != NULL)
-			gsh_free(conp->data.d_data.data_val);
+			gsh_iobuf_put(conp->data.d_data.data_val);
 }
 
 /**
@@ -773,7 +1040,11 @@ int nfs4_op_seek(struct nfs_argop4 *op, compound_data_t *data,
 		else
 			info.io_content.adb.adb_offset = arg_SEEK->sa_offset;
 
-		fsal_status = obj->obj_ops.seek(obj, &info);
+		if (obj->fsal->m_ops.support_ex(obj))
+			fsal_status = obj->obj_ops.seek2(obj, state_found,
+							 &info);
+		else
+			fsal_status = obj->obj_ops.seek(obj, &info);
 		if (FSAL_IS_ERROR(fsal_status)) {
 			res_SEEK->sr_status = NFS4ERR_NXIO;
 			goto done;
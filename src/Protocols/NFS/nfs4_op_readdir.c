@@ -77,6 +77,181 @@ static void restore_data(struct nfs4_readdir_cb_data *tracker)
 	}
 }
 
+/*
+ * Encoded entry cache
+ *
+ * With Readdir_Encode_Cache set, the attributes encoded for an entry
+ * are kept with its cached dirent, along with everything they were
+ * encoded from.  A later READDIR from any client asking for the same
+ * attributes of the unchanged file copies them instead of encoding
+ * again.  Only attributes computed from that key are cached, so a
+ * match can't hand out anything stale.
+ */
+
+#define NFS4_ENC_BIT(attr) (1U << ((attr) % 32))
+
+/** Attributes whose encoding is cached, by bitmap word */
+static const uint32_t nfs4_readdir_enc_map[BITMAP4_MAPLEN] = {
+	[0] = NFS4_ENC_BIT(FATTR4_TYPE) |
+	      NFS4_ENC_BIT(FATTR4_CHANGE) |
+	      NFS4_ENC_BIT(FATTR4_SIZE) |
+	      NFS4_ENC_BIT(FATTR4_FSID) |
+	      NFS4_ENC_BIT(FATTR4_RDATTR_ERROR) |
+	      NFS4_ENC_BIT(FATTR4_FILEHANDLE) |
+	      NFS4_ENC_BIT(FATTR4_FILEID),
+	[1] = NFS4_ENC_BIT(FATTR4_MODE) |
+	      NFS4_ENC_BIT(FATTR4_NUMLINKS) |
+	      NFS4_ENC_BIT(FATTR4_OWNER) |
+	      NFS4_ENC_BIT(FATTR4_OWNER_GROUP) |
+	      NFS4_ENC_BIT(FATTR4_RAWDEV) |
+	      NFS4_ENC_BIT(FATTR4_SPACE_USED) |
+	      NFS4_ENC_BIT(FATTR4_TIME_ACCESS) |
+	      NFS4_ENC_BIT(FATTR4_TIME_METADATA) |
+	      NFS4_ENC_BIT(FATTR4_TIME_MODIFY) |
+	      NFS4_ENC_BIT(FATTR4_MOUNTED_ON_FILEID),
+};
+
+/** Everything the cached attributes are computed from */
+struct nfs4_readdir_enc_key {
+	uint32_t req[BITMAP4_MAPLEN];
+	uint32_t minorversion;
+	uint16_t export_id;
+	object_file_type_t type;
+	uint64_t change;
+	uint64_t filesize;
+	uint64_t fileid;
+	uint64_t mounted_on_fileid;
+	uint64_t spaceused;
+	fsal_fsid_t fsid;
+	fsal_dev_t rawdev;
+	uint32_t mode;
+	uint32_t numlinks;
+	uid_t owner;
+	gid_t group;
+	struct timespec atime;
+	struct timespec ctime;
+	struct timespec mtime;
+};
+
+struct nfs4_readdir_enc {
+	struct nfs4_readdir_enc_key key;
+	struct bitmap4 attrmask;	/*< Attributes encoded */
+	u_int len;			/*< Bytes in vals */
+	char vals[];
+};
+
+/**
+ * @brief Make the cache key of an entry
+ *
+ * @param[in]  tracker READDIR state
+ * @param[in]  args    Encoding arguments for the entry
+ * @param[out] key     The key
+ *
+ * @return false if the requested attributes can't be cached.
+ */
+static bool nfs4_readdir_enc_key(struct nfs4_readdir_cb_data *tracker,
+				 struct xdr_attrs_args *args,
+				 struct nfs4_readdir_enc_key *key)
+{
+	struct bitmap4 *req = tracker->req_attr;
+	const struct attrlist *attr = args->attrs;
+	u_int i;
+
+	if (req->bitmap4_len > BITMAP4_MAPLEN)
+		return false;
+
+	/* Zeroed first, the key is compared whole */
+	memset(key, 0, sizeof(*key));
+
+	for (i = 0; i < req->bitmap4_len; i++) {
+		if ((req->map[i] & ~nfs4_readdir_enc_map[i]) != 0)
+			return false;
+		key->req[i] = req->map[i];
+	}
+
+	key->minorversion = tracker->data->minorversion;
+	key->export_id = op_ctx->ctx_export->export_id;
+	key->type = attr->type;
+	key->change = attr->change;
+	key->filesize = attr->filesize;
+	key->fileid = args->fileid;
+	key->mounted_on_fileid = args->mounted_on_fileid;
+	key->spaceused = attr->spaceused;
+	key->fsid = args->fsid;
+	key->rawdev = attr->rawdev;
+	key->mode = attr->mode;
+	key->numlinks = attr->numlinks;
+	key->owner = attr->owner;
+	key->group = attr->group;
+	key->atime = attr->atime;
+	key->ctime = attr->ctime;
+	key->mtime = attr->mtime;
+
+	return true;
+}
+
+/**
+ * @brief Copy an entry's cached attributes, if they still apply
+ *
+ * @param[in]  key   Key of the entry as it is now
+ * @param[out] Fattr The attributes
+ *
+ * @return true if the cache had them.
+ */
+static bool nfs4_readdir_enc_get(const struct nfs4_readdir_enc_key *key,
+				 fattr4 *Fattr)
+{
+	struct fsal_dirent_enc *slot = op_ctx->dirent_enc;
+	struct nfs4_readdir_enc *enc;
+	bool hit = false;
+
+	PTHREAD_MUTEX_lock(slot->mutex);
+
+	enc = *slot->blob;
+	if (enc != NULL && memcmp(&enc->key, key, sizeof(*key)) == 0) {
+		Fattr->attrmask = enc->attrmask;
+		Fattr->attr_vals.attrlist4_len = enc->len;
+		if (enc->len != 0) {
+			Fattr->attr_vals.attrlist4_val = gsh_malloc(enc->len);
+			memcpy(Fattr->attr_vals.attrlist4_val, enc->vals,
+			       enc->len);
+		}
+		hit = true;
+	}
+
+	PTHREAD_MUTEX_unlock(slot->mutex);
+
+	return hit;
+}
+
+/**
+ * @brief Keep an entry's encoded attributes with its dirent
+ *
+ * @param[in] key   Key of the entry
+ * @param[in] Fattr The attributes just encoded
+ */
+static void nfs4_readdir_enc_put(const struct nfs4_readdir_enc_key *key,
+				 const fattr4 *Fattr)
+{
+	struct fsal_dirent_enc *slot = op_ctx->dirent_enc;
+	u_int len = Fattr->attr_vals.attrlist4_len;
+	struct nfs4_readdir_enc *enc, *old;
+
+	enc = gsh_malloc(sizeof(*enc) + len);
+	enc->key = *key;
+	enc->attrmask = Fattr->attrmask;
+	enc->len = len;
+	if (len != 0)
+		memcpy(enc->vals, Fattr->attr_vals.attrlist4_val, len);
+
+	PTHREAD_MUTEX_lock(slot->mutex);
+	old = *slot->blob;
+	*slot->blob = enc;
+	PTHREAD_MUTEX_unlock(slot->mutex);
+
+	gsh_free(old);
+}
+
 /**
  * @brief Populate entry4s when called from fsal_readdir
  *
@@ -113,6 +288,8 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 	entry4 *tracker_entry = tracker->entries + tracker->count;
 	fsal_status_t fsal_status;
 	fsal_accessflags_t access_mask_attr = 0;
+	struct nfs4_readdir_enc_key enc_key;
+	bool enc_cache;
 
 	/* Cleanup after problem with junction processing. */
 	if (cb_state == CB_PROBLEM) {
@@ -366,12 +543,22 @@ not_junction:
 	args.fileid = obj->fileid;
 	args.fsid = obj->fsid;
 
-	if (nfs4_FSALattr_To_Fattr(&args,
-				   tracker->req_attr,
-				   &tracker_entry->attrs) != 0) {
-		LogCrit(COMPONENT_NFS_READDIR,
-			"nfs4_FSALattr_To_Fattr failed to convert attr");
-		goto server_fault;
+	enc_cache = nfs_param.nfsv4_param.readdir_encode_cache &&
+		    op_ctx->dirent_enc != NULL && cb_state == CB_ORIGINAL &&
+		    nfs4_readdir_enc_key(tracker, &args, &enc_key);
+
+	if (!enc_cache ||
+	    !nfs4_readdir_enc_get(&enc_key, &tracker_entry->attrs)) {
+		if (nfs4_FSALattr_To_Fattr(&args,
+					   tracker->req_attr,
+					   &tracker_entry->attrs) != 0) {
+			LogCrit(COMPONENT_NFS_READDIR,
+				"nfs4_FSALattr_To_Fattr failed to convert attr");
+			goto server_fault;
+		}
+
+		if (enc_cache)
+			nfs4_readdir_enc_put(&enc_key, &tracker_entry->attrs);
 	}
 
 	if (obj->type == DIRECTORY && is_sticky_bit_set(obj, attr)) {
@@ -507,6 +694,9 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 
 	dir_obj = data->current_obj;
 
+	/* Make sure the exports below show up */
+	(void) pseudo_lazy_mount(dir_obj, NULL);
+
 	/* get the characteristic value for readdir operation */
 	dircount = arg_READDIR4->dircount;
 	maxcount = (arg_READDIR4->maxcount * 9) / 10;
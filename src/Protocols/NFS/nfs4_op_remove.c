@@ -83,7 +83,7 @@ int nfs4_op_remove(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_REMOVE4->status != NFS4_OK)
 		goto out;
 
-	if (nfs_in_grace()) {
+	if (nfs4_in_grace(data)) {
 		res_REMOVE4->status = NFS4ERR_GRACE;
 		goto out;
 	}
@@ -99,7 +99,7 @@ int nfs4_op_rename(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_RENAME4->status != NFS4_OK)
 		goto out;
 
-	if (nfs_in_grace()) {
+	if (nfs4_in_grace(data)) {
 		res_RENAME4->status = NFS4ERR_GRACE;
 		goto out;
 	}
@@ -87,12 +87,13 @@ int nfs4_op_renew(struct nfs_argop4 *op, compound_data_t *data,
 		return res_RENEW4->status;
 	}
 
-	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
-
 	if (!reserve_lease(clientid)) {
 		res_RENEW4->status = NFS4ERR_EXPIRED;
 	} else {
 		update_lease(clientid);
+
+		PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+
 		/* update the lease, check the state of callback
 		 * path and return correct error */
 		if (nfs_param.nfsv4_param.allow_delegations &&
@@ -107,9 +108,9 @@ int nfs4_op_renew(struct nfs_argop4 *op, compound_data_t *data,
 			/* Reset */
 			clientid->first_path_down_resp_time = 0;
 		}
-	}
 
-	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+	}
 
 	dec_client_id_ref(clientid);
 
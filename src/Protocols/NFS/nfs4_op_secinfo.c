@@ -88,6 +88,7 @@ int nfs4_op_secinfo(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_SECINFO4->status != NFS4_OK)
 		goto out;
 
+	(void) pseudo_lazy_mount(data->current_obj, secinfo_fh_name);
 
 	fsal_status = fsal_lookup(data->current_obj, secinfo_fh_name,
 				  &obj_src, NULL);
@@ -34,6 +34,38 @@
 #include "sal_functions.h"
 #include "nfs_rpc_callback.h"
 #include "nfs_convert.h"
+#include "nfs_proto_functions.h"
+
+/**
+ * @brief Replay a request from a slot's encoded reply
+ *
+ * The bytes are copied out under the slot lock, so the reply being
+ * replaced or the session going away cannot affect the replay.
+ *
+ * @param[in,out] data Compound request's data
+ * @param[in]     slot The slot, locked
+ *
+ * @return Status for SEQUENCE.
+ */
+static nfsstat4 nfs4_sequence_replay_encoded(compound_data_t *data,
+					     nfs41_session_slot_t *slot)
+{
+	/* Still working on the original */
+	if (slot->reply_pending)
+		return NFS4ERR_DELAY;
+
+	/* Only the status was kept */
+	if (slot->reply_xdr == NULL)
+		return NFS4ERR_RETRY_UNCACHED_REP;
+
+	data->use_drc = true;
+	data->replay_xdr = gsh_malloc(slot->reply_len);
+	memcpy(data->replay_xdr, slot->reply_xdr, slot->reply_len);
+	data->replay_len = slot->reply_len;
+	data->replay_status = slot->reply_status;
+
+	return NFS4_OK;
+}
 
 /**
  * @brief the NFS4_OP_SEQUENCE operation
@@ -83,11 +115,7 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	LogDebug(COMPONENT_SESSIONS, "SEQUENCE session=%p", session);
 
 	/* Check if lease is expired and reserve it */
-	PTHREAD_MUTEX_lock(&session->clientid_record->cid_mutex);
-
 	if (!reserve_lease(session->clientid_record)) {
-		PTHREAD_MUTEX_unlock(&session->clientid_record->cid_mutex);
-
 		dec_session_ref(session);
 		res_SEQUENCE4->sr_status = NFS4ERR_EXPIRED;
 		LogDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
@@ -98,8 +126,6 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 
 	data->preserved_clientid = session->clientid_record;
 
-	PTHREAD_MUTEX_unlock(&session->clientid_record->cid_mutex);
-
 	/* Check is slot is compliant with ca_maxrequests */
 	if (arg_SEQUENCE4->sa_slotid >=
 	    session->fore_channel_attrs.ca_maxrequests) {
@@ -117,6 +143,20 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	PTHREAD_MUTEX_lock(&session->slots[arg_SEQUENCE4->sa_slotid].lock);
 	if (session->slots[arg_SEQUENCE4->sa_slotid].sequence + 1 !=
 	    arg_SEQUENCE4->sa_sequenceid) {
+		if (session->slots[arg_SEQUENCE4->sa_slotid].sequence ==
+		    arg_SEQUENCE4->sa_sequenceid &&
+		    nfs_param.nfsv4_param.slot_reply_encoded) {
+			res_SEQUENCE4->sr_status = nfs4_sequence_replay_encoded(
+				data, &session->slots[arg_SEQUENCE4->sa_slotid]);
+			PTHREAD_MUTEX_unlock(&session->
+				slots[arg_SEQUENCE4->sa_slotid].lock);
+			dec_session_ref(session);
+			LogDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
+				    "SEQUENCE encoded replay status %s",
+				    nfsstat4_to_str(res_SEQUENCE4->sr_status));
+			return res_SEQUENCE4->sr_status;
+		}
+
 		if (session->slots[arg_SEQUENCE4->sa_slotid].sequence ==
 		    arg_SEQUENCE4->sa_sequenceid) {
 #if IMPLEMENT_CACHETHIS
@@ -191,9 +231,10 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_slotid =
 	    arg_SEQUENCE4->sa_slotid;
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_highest_slotid =
-	    NFS41_NB_SLOTS - 1;
+	    session->nb_slots - 1;
+	/* Ask the client to use fewer slots under pressure */
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid =
-	    session->fore_channel_attrs.ca_maxrequests - 1;
+	    nfs41_Session_Target_Slotid(session);
 
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_status_flags = 0;
 
@@ -202,6 +243,19 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 		    SEQ4_STATUS_CB_PATH_DOWN;
 	}
 
+	if (nfs_param.nfsv4_param.slot_reply_encoded) {
+		/* The client has seen the previous reply on this slot, the
+		 * new one is saved by nfs4_Compound once complete.
+		 */
+		nfs41_Slot_Release_Reply(
+			&session->slots[arg_SEQUENCE4->sa_slotid]);
+		session->slots[arg_SEQUENCE4->sa_slotid].reply_pending = true;
+		data->slot_encoded = true;
+		data->cachethis = arg_SEQUENCE4->sa_cachethis;
+		data->cached_res = NULL;
+		goto out;
+	}
+
 #if IMPLEMENT_CACHETHIS
 /* Ganesha always caches result anyway so ignore cachethis */
 	if (arg_SEQUENCE4->sa_cachethis) {
@@ -224,6 +278,7 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	}
 #endif
 
+ out:
 	PTHREAD_MUTEX_unlock(&session->slots[arg_SEQUENCE4->sa_slotid].lock);
 
 	/* If we were successful, stash the clientid in the request
@@ -82,7 +82,7 @@ int nfs4_op_setattr(struct nfs_argop4 *op, compound_data_t *data,
 	 * Required for delegation reclaims and may be needed for other
 	 * reclaimable states as well.
 	 */
-	if (nfs_in_grace()) {
+	if (nfs4_in_grace(data)) {
 		res_SETATTR4->status = NFS4ERR_GRACE;
 		return res_SETATTR4->status;
 	}
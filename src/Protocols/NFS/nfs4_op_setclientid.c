@@ -89,6 +89,8 @@ int nfs4_op_setclientid(struct nfs_argop4 *op, compound_data_t *data,
 		return res_SETCLIENTID4->status;
 	}
 
+	nfs4_storm_count();
+
 	if (op_ctx->client != NULL)
 		str_client_addr = op_ctx->client->hostaddr_str;
 
@@ -68,6 +68,7 @@ int nfs4_op_setclientid_confirm(struct nfs_argop4 *op, compound_data_t *data,
 	nfs_client_id_t *unconf = NULL;
 	nfs_client_record_t *client_record;
 	clientid4 clientid = 0;
+	bool reconnect = false;
 	char str_verifier[NFS4_VERIFIER_SIZE * 2 + 1];
 	const char *str_client_addr = "(unknown)";
 	/* The client name, for gratuitous logging */
@@ -368,6 +369,14 @@ int nfs4_op_setclientid_confirm(struct nfs_argop4 *op, compound_data_t *data,
 				     str);
 		}
 
+		/* Keep the callback connection if the client still wants
+		 * to be called at the same place.
+		 */
+		reconnect = strcmp(conf->cid_cb.v40.cb_client_r_addr,
+				   unconf->cid_cb.v40.cb_client_r_addr) != 0 ||
+			    conf->cid_cb.v40.cb_program !=
+			    unconf->cid_cb.v40.cb_program;
+
 		/* Copy callback information into confirmed clientid record */
 		memcpy(conf->cid_cb.v40.cb_client_r_addr,
 		       unconf->cid_cb.v40.cb_client_r_addr,
@@ -379,8 +388,6 @@ int nfs4_op_setclientid_confirm(struct nfs_argop4 *op, compound_data_t *data,
 		conf->cid_cb.v40.cb_callback_ident =
 		    unconf->cid_cb.v40.cb_callback_ident;
 
-		nfs_rpc_destroy_chan(&conf->cid_cb.v40.cb_chan);
-
 		memcpy(conf->cid_verifier, unconf->cid_verifier,
 		       NFS4_VERIFIER_SIZE);
 
@@ -397,16 +404,15 @@ int nfs4_op_setclientid_confirm(struct nfs_argop4 *op, compound_data_t *data,
 			display_client_id_rec(&dspbuf, conf);
 			LogDebug(COMPONENT_CLIENTID, "Updated %s", str);
 		}
-		/* Check and update call back channel state */
-		if (nfs_param.nfsv4_param.allow_delegations &&
-		    nfs_test_cb_chan(conf) != RPC_SUCCESS) {
-			set_cb_chan_down(conf, true);
-			LogCrit(COMPONENT_CLIENTID,
-				"setclid confirm: Callback channel is down");
+		/* Check and update call back channel state, the channel
+		 * is down until the probe gets through.
+		 */
+		if (nfs_param.nfsv4_param.allow_delegations) {
+			nfs_rpc_probe_cb_chan(conf, reconnect);
 		} else {
+			if (reconnect)
+				nfs_rpc_destroy_chan(&conf->cid_cb.v40.cb_chan);
 			set_cb_chan_down(conf, false);
-			LogDebug(COMPONENT_CLIENTID,
-				"setclid confirm: Callback channel is UP");
 		}
 
 		/* Release our reference to the confirmed clientid. */
@@ -450,17 +456,13 @@ int nfs4_op_setclientid_confirm(struct nfs_argop4 *op, compound_data_t *data,
 			LogDebug(COMPONENT_CLIENTID, "Confirmed %s", str);
 		}
 
-		/* Check and update call back channel state */
-		if (nfs_param.nfsv4_param.allow_delegations &&
-		    nfs_test_cb_chan(unconf) != RPC_SUCCESS) {
-			set_cb_chan_down(unconf, true);
-			LogCrit(COMPONENT_CLIENTID,
-				"setclid confirm: Callback channel is down");
-		} else {
+		/* Check and update call back channel state, the channel
+		 * is down until the probe gets through.
+		 */
+		if (nfs_param.nfsv4_param.allow_delegations)
+			nfs_rpc_probe_cb_chan(unconf, false);
+		else
 			set_cb_chan_down(unconf, false);
-			LogDebug(COMPONENT_CLIENTID,
-				"setclid confirm: Callback channel is UP");
-		}
 
 		/* Release our reference to the now confirmed record */
 		dec_client_id_ref(unconf);
@@ -42,6 +42,7 @@
 #include "fsal_pnfs.h"
 #include "server_stats.h"
 #include "export_mgr.h"
+#include "gsh_iobuf.h"
 
 /**
  * @brief Write for a data server
@@ -64,6 +65,10 @@ static int op_dswrite(struct nfs_argop4 *op, compound_data_t *data,
 	WRITE4res * const res_WRITE4 = &resp->nfs_resop4_u.opwrite;
 	/* NFSv4 return code */
 	nfsstat4 nfs_status = 0;
+	/* DS handles take a flat buffer */
+	void *buffer = arg_WRITE4->data.data_len == 0 ? NULL :
+		gsh_iobuf_flatten(arg_WRITE4->data.data_val,
+				  arg_WRITE4->data.data_len);
 
 	nfs_status = data->current_ds->dsh_ops.write(
 				data->current_ds,
@@ -71,12 +76,13 @@ static int op_dswrite(struct nfs_argop4 *op, compound_data_t *data,
 				&arg_WRITE4->stateid,
 				arg_WRITE4->offset,
 				arg_WRITE4->data.data_len,
-				arg_WRITE4->data.data_val,
+				buffer,
 				arg_WRITE4->stable,
 				&res_WRITE4->WRITE4res_u.resok4.count,
 				&res_WRITE4->WRITE4res_u.resok4.writeverf,
 				&res_WRITE4->WRITE4res_u.resok4.committed);
 
+	gsh_iobuf_put(buffer);
 	res_WRITE4->status = nfs_status;
 	return res_WRITE4->status;
 }
@@ -146,6 +152,107 @@ static int op_dswrite_plus(struct nfs_argop4 *op, compound_data_t *data,
  * @return per RFC5661, p. 376
  */
 
+/**
+ * @brief State of a WRITE waiting for asynchronous I/O
+ *
+ * Allocated with room for write_arg and its iovecs after it.
+ */
+struct nfs4_write_data {
+	compound_data_t *data;		/*< Compound the WRITE is part of */
+	struct fsal_obj_handle *obj;	/*< File being written */
+	state_t *state_found;		/*< State from the stateid */
+	state_t *state_open;		/*< Open state, if any */
+	state_owner_t *owner;		/*< Owner, for NFSv4.0 */
+	bool anonymous_started;		/*< Anonymous I/O in progress */
+	uint64_t size;			/*< Requested size */
+	fsal_status_t status;		/*< Result of the I/O */
+	struct fsal_io_arg *write_arg;	/*< I/O arguments and results */
+};
+
+/**
+ * @brief Finish a WRITE once its asynchronous I/O has completed
+ *
+ * @param[in]     op    The nfs4_op arguments
+ * @param[in,out] data  The compound request's data
+ * @param[out]    resp  The nfs4_op results
+ *
+ * @return Errors as specified by RFC3550 RFC5661 p. 376.
+ */
+static int nfs4_write_resume(struct nfs_argop4 *op, compound_data_t *data,
+			     struct nfs_resop4 *resp)
+{
+	WRITE4res * const res_WRITE4 = &resp->nfs_resop4_u.opwrite;
+	struct nfs4_write_data *wd = data->op_data;
+	struct gsh_buffdesc verf_desc;
+	size_t written_size = 0;
+
+	if (!wd->anonymous_started && data->minorversion == 0)
+		op_ctx->clientid = NULL;
+
+	/* Fixup ERR_FSAL_SHARE_DENIED status, as fsal_write2 does */
+	if (wd->status.major == ERR_FSAL_SHARE_DENIED)
+		wd->status = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	if (FSAL_IS_ERROR(wd->status)) {
+		LogDebug(COMPONENT_NFS_V4, "write returned %s",
+			 fsal_err_txt(wd->status));
+		res_WRITE4->status = nfs4_Errno_status(wd->status);
+		goto done;
+	}
+
+	written_size = wd->write_arg->io_amount;
+
+	/* Set the returned value */
+	if (wd->write_arg->fsal_stable)
+		res_WRITE4->WRITE4res_u.resok4.committed = FILE_SYNC4;
+	else
+		res_WRITE4->WRITE4res_u.resok4.committed = UNSTABLE4;
+
+	res_WRITE4->WRITE4res_u.resok4.count = written_size;
+
+	verf_desc.addr = res_WRITE4->WRITE4res_u.resok4.writeverf;
+	verf_desc.len = sizeof(verifier4);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+
+	res_WRITE4->status = NFS4_OK;
+
+ done:
+
+	if (wd->anonymous_started)
+		state_share_anonymous_io_done(wd->obj,
+					      OPEN4_SHARE_ACCESS_WRITE);
+
+	server_stats_io_done(wd->obj, wd->size, written_size,
+			     (res_WRITE4->status == NFS4_OK) ? true : false,
+			     true);
+
+	if (wd->owner != NULL)
+		dec_state_owner_ref(wd->owner);
+
+	if (wd->state_found != NULL)
+		dec_state_t_ref(wd->state_found);
+
+	if (wd->state_open != NULL)
+		dec_state_t_ref(wd->state_open);
+
+	gsh_free(wd);
+
+	return res_WRITE4->status;
+}
+
+/**
+ * @brief Completion callback for an asynchronous WRITE
+ */
+static void nfs4_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			  void *write_data, void *caller_data)
+{
+	struct nfs4_write_data *wd = caller_data;
+
+	wd->status = ret;
+	nfs4_async_done(wd->data);
+}
+
 static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		     struct nfs_resop4 *resp, fsal_io_direction_t io,
 		     struct io_info *info)
@@ -166,10 +273,8 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	bool anonymous_started = false;
 	struct gsh_buffdesc verf_desc;
 	state_owner_t *owner = NULL;
-	uint64_t MaxWrite =
-		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxWrite);
-	uint64_t MaxOffsetWrite =
-		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
+	uint64_t MaxWrite;
+	uint64_t MaxOffsetWrite;
 
 	/* Lock are not supported */
 	resp->resop = NFS4_OP_WRITE;
@@ -191,6 +296,11 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_WRITE4->status != NFS4_OK)
 		return res_WRITE4->status;
 
+	/* A DS handle may have no export, fetch these past the DS path */
+	MaxWrite = atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxWrite);
+	MaxOffsetWrite = atomic_fetch_uint64_t(
+				&op_ctx->ctx_export->MaxOffsetWrite);
+
 	/* if quota support is active, then we should check is the FSAL
 	   allows inode creation or not */
 	fsal_status = op_ctx->fsal_export->exp_ops.check_quota(
@@ -402,15 +512,60 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
-	if (obj->fsal->m_ops.support_ex(obj)) {
+	if (nfs_param.core_param.async_io && info == NULL &&
+	    obj->fsal->m_ops.support_ex(obj)) {
+		/* Hand the references over to nfs4_write_resume */
+		struct nfs4_write_data *wd;
+		int iovcnt = gsh_iobuf_iovcnt(bufferdata);
+
+		wd = gsh_malloc(sizeof(*wd) + sizeof(struct fsal_io_arg) +
+				iovcnt * sizeof(struct iovec));
+		wd->data = data;
+		wd->obj = obj;
+		wd->state_found = state_found;
+		wd->state_open = state_open;
+		wd->owner = owner;
+		wd->anonymous_started = anonymous_started;
+		wd->size = size;
+		wd->write_arg = (struct fsal_io_arg *) (wd + 1);
+		wd->write_arg->io_amount = 0;
+		wd->write_arg->info = NULL;
+		/* Force sync if export requires it */
+		wd->write_arg->fsal_stable = sync ||
+			(op_ctx->export_perms->options & EXPORT_OPTION_COMMIT);
+		wd->write_arg->state = state_found;
+		wd->write_arg->offset = offset;
+		wd->write_arg->iov_count =
+			gsh_iobuf_fill_iov(bufferdata, wd->write_arg->iov,
+					   size);
+
+		nfs4_async_prepare(data, nfs4_write_resume, wd);
+		obj->obj_ops.write2_async(obj, false, nfs4_write_cb,
+					  wd->write_arg, wd);
+		return nfs4_async_issued(op, data, resp);
+	}
+
+	if (obj->fsal->m_ops.support_ex(obj) && info == NULL) {
+		/* Call the new fsal_write, the payload may be segmented */
+		fsal_status = fsal_write_iobuf2(obj, false, state_found, offset,
+						size, &written_size,
+						bufferdata, &sync);
+	} else if (obj->fsal->m_ops.support_ex(obj)) {
 		/* Call the new fsal_write */
 		fsal_status = fsal_write2(obj, false, state_found, offset, size,
 					  &written_size, bufferdata, &sync,
 					  info);
 	} else {
-		/* Call legacy fsal_rdwr */
+		/* Call legacy fsal_rdwr on a flat copy of the payload */
+		void *flat = info == NULL
+				? gsh_iobuf_flatten(bufferdata, size)
+				: NULL;
+
 		fsal_status = fsal_rdwr(obj, io, offset, size, &written_size,
-					bufferdata, &eof_met, &sync, info);
+					flat != NULL ? flat : bufferdata,
+					&eof_met, &sync, info);
+		if (flat != NULL)
+			gsh_iobuf_put(flat);
 	}
 
 	if (FSAL_IS_ERROR(fsal_status)) {
@@ -443,7 +598,7 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	if (anonymous_started)
 		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
 
-	server_stats_io_done(size, written_size,
+	server_stats_io_done(obj, size, written_size,
 			     (res_WRITE4->status == NFS4_OK) ? true : false,
 			     true);
 
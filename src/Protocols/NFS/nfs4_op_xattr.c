@@ -182,7 +182,7 @@ int nfs4_op_setxattr(struct nfs_argop4 *op, compound_data_t *data,
 	 * Required for delegation reclaims and may be needed for other
 	 * reclaimable states as well.
 	 */
-	if (nfs_in_grace()) {
+	if (nfs4_in_grace(data)) {
 		res_SETXATTR4->status = NFS4ERR_GRACE;
 		return res_SETXATTR4->status;
 	}
@@ -361,7 +361,7 @@ int nfs4_op_removexattr(struct nfs_argop4 *op, compound_data_t *data,
 	 * Required for delegation reclaims and may be needed for other
 	 * reclaimable states as well.
 	 */
-	if (nfs_in_grace()) {
+	if (nfs4_in_grace(data)) {
 		res_REMOVEXATTR4->status = NFS4ERR_GRACE;
 		return res_REMOVEXATTR4->status;
 	}
@@ -38,6 +38,7 @@
 #include "nfs_exports.h"
 #include "fsal.h"
 #include "export_mgr.h"
+#include "avltree.h"
 
 /**
  * @brief Find the node for this path component
@@ -80,6 +81,375 @@ static bool is_export_pseudo(struct gsh_export *export)
 	return false;
 }
 
+/**
+ * With Pseudo_Lazy_Mount, create_pseudofs() leaves the exports waiting
+ * by pseudo path instead of building the whole PseudoFS at startup.  A
+ * LOOKUP in a directory of the PseudoFS mounts the exports at or below
+ * the name looked up, one per name needed to make the directory node; a
+ * READDIR mounts what it takes for every name of the directory to be
+ * there.  In an export that is not PSEUDO all the exports below it are
+ * mounted at once, since the path of the directory is not known.
+ *
+ * The pseudo path of the PSEUDO directories made along the way is kept
+ * by fileid, which PSEUDO never reuses.  Exports added or removed later
+ * are mounted and unmounted at once as before.
+ */
+struct pseudo_pending {
+	struct avltree_node node;
+	struct gsh_export *export;	/*< referenced */
+};
+
+struct pseudo_dir {
+	struct avltree_node node;
+	uint64_t fileid;
+	char *path;
+};
+
+static struct {
+	/** Protects pending, held while mounting from it */
+	pthread_mutex_t mtx;
+	struct avltree pending;		/*< by pseudo path */
+	uint32_t count;			/*< pending, read without the lock */
+	/** Protects dirs */
+	pthread_mutex_t dirs_mtx;
+	struct avltree dirs;		/*< by fileid */
+	bool init;
+} pseudo_lazy = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.dirs_mtx = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static int pseudo_pending_cmpf(const struct avltree_node *lhs,
+			       const struct avltree_node *rhs)
+{
+	struct pseudo_pending *lk =
+		avltree_container_of(lhs, struct pseudo_pending, node);
+	struct pseudo_pending *rk =
+		avltree_container_of(rhs, struct pseudo_pending, node);
+
+	return strcmp(lk->export->pseudopath, rk->export->pseudopath);
+}
+
+static int pseudo_dir_cmpf(const struct avltree_node *lhs,
+			   const struct avltree_node *rhs)
+{
+	struct pseudo_dir *lk =
+		avltree_container_of(lhs, struct pseudo_dir, node);
+	struct pseudo_dir *rk =
+		avltree_container_of(rhs, struct pseudo_dir, node);
+
+	if (lk->fileid < rk->fileid)
+		return -1;
+	return lk->fileid > rk->fileid;
+}
+
+/**
+ * @brief Remember the pseudo path of a PSEUDO directory
+ *
+ * @param[in] obj  The directory
+ * @param[in] path Its pseudo path
+ * @param[in] len  Length of the path
+ */
+static void pseudo_dir_add(struct fsal_obj_handle *obj, const char *path,
+			   size_t len)
+{
+	struct pseudo_dir *dir;
+	size_t copied;
+
+	if (!pseudo_lazy.init)
+		return;
+
+	dir = gsh_malloc(sizeof(*dir));
+	dir->fileid = obj->fileid;
+	dir->path = gsh_strldup(path, len, &copied);
+
+	PTHREAD_MUTEX_lock(&pseudo_lazy.dirs_mtx);
+	if (avltree_insert(&dir->node, &pseudo_lazy.dirs) != NULL) {
+		/* Already known */
+		gsh_free(dir->path);
+		gsh_free(dir);
+	}
+	PTHREAD_MUTEX_unlock(&pseudo_lazy.dirs_mtx);
+}
+
+static void pseudo_dir_del(struct fsal_obj_handle *obj)
+{
+	struct pseudo_dir key, *dir = NULL;
+	struct avltree_node *node;
+
+	if (!pseudo_lazy.init)
+		return;
+
+	key.fileid = obj->fileid;
+
+	PTHREAD_MUTEX_lock(&pseudo_lazy.dirs_mtx);
+	node = avltree_lookup(&key.node, &pseudo_lazy.dirs);
+	if (node != NULL) {
+		dir = avltree_container_of(node, struct pseudo_dir, node);
+		avltree_remove(node, &pseudo_lazy.dirs);
+	}
+	PTHREAD_MUTEX_unlock(&pseudo_lazy.dirs_mtx);
+
+	if (dir != NULL) {
+		gsh_free(dir->path);
+		gsh_free(dir);
+	}
+}
+
+/**
+ * @brief Get a copy of the pseudo path of a PSEUDO directory
+ *
+ * @return The path, to be freed, or NULL if not known.
+ */
+static char *pseudo_dir_path(struct fsal_obj_handle *obj)
+{
+	struct pseudo_dir key;
+	struct avltree_node *node;
+	char *path = NULL;
+
+	key.fileid = obj->fileid;
+
+	PTHREAD_MUTEX_lock(&pseudo_lazy.dirs_mtx);
+	node = avltree_lookup(&key.node, &pseudo_lazy.dirs);
+	if (node != NULL)
+		path = gsh_strdup(avltree_container_of(node, struct pseudo_dir,
+						       node)->path);
+	PTHREAD_MUTEX_unlock(&pseudo_lazy.dirs_mtx);
+
+	return path;
+}
+
+/**
+ * @brief Find the first export waiting at or below a path
+ *
+ * Called with the pending lock held.
+ *
+ * @param[in] path The path, including the trailing / for below only
+ *
+ * @return The first export in order whose pseudo path starts with
+ *         @a path, or NULL.
+ */
+static struct pseudo_pending *pseudo_pending_first(char *path)
+{
+	struct gsh_export key_export;
+	struct pseudo_pending key, *pp;
+	struct avltree_node *node;
+
+	key_export.pseudopath = path;
+	key.export = &key_export;
+
+	node = avltree_sup(&key.node, &pseudo_lazy.pending);
+	if (node == NULL)
+		return NULL;
+
+	pp = avltree_container_of(node, struct pseudo_pending, node);
+	if (strncmp(pp->export->pseudopath, path, strlen(path)) != 0)
+		return NULL;
+
+	return pp;
+}
+
+static struct pseudo_pending *pseudo_pending_next(struct pseudo_pending *pp,
+						  const char *path)
+{
+	struct avltree_node *node = avltree_next(&pp->node);
+
+	if (node == NULL)
+		return NULL;
+
+	pp = avltree_container_of(node, struct pseudo_pending, node);
+	if (strncmp(pp->export->pseudopath, path, strlen(path)) != 0)
+		return NULL;
+
+	return pp;
+}
+
+/**
+ * @brief Mount an export that was waiting
+ *
+ * Called with the pending lock held.
+ */
+static void pseudo_pending_mount(struct pseudo_pending *pp)
+{
+	avltree_remove(&pp->node, &pseudo_lazy.pending);
+	(void) atomic_dec_uint32_t(&pseudo_lazy.count);
+
+	LogDebug(COMPONENT_EXPORT,
+		 "Lazily mounting Export_Id %d Pseudo Path %s",
+		 pp->export->export_id, pp->export->pseudopath);
+
+	if (!mount_gsh_export(pp->export))
+		LogCrit(COMPONENT_EXPORT,
+			"Could not mount Export_Id %d Pseudo Path %s in the PseudoFS",
+			pp->export->export_id, pp->export->pseudopath);
+
+	put_gsh_export(pp->export);
+	gsh_free(pp);
+}
+
+/**
+ * @brief Mount the exports needed to look into a directory
+ *
+ * Does nothing unless exports are waiting.  With @a name, makes sure
+ * that @a name is there in the directory if an export is at or below
+ * it; without, makes sure that all the names of the directory are.
+ * With no directory, mounts all the exports below the current export.
+ *
+ * @param[in] dir  The directory, in op_ctx->ctx_export, or NULL
+ * @param[in] name The name looked up, or NULL
+ *
+ * @return true if something was mounted.
+ */
+bool pseudo_lazy_mount(struct fsal_obj_handle *dir, const char *name)
+{
+	struct gsh_export *export = op_ctx->ctx_export;
+	struct pseudo_pending *pp, *next;
+	struct fsal_obj_handle *obj;
+	fsal_status_t status;
+	char *dir_path = NULL;
+	char *path;
+	size_t len;
+	bool done = false;
+
+	if (atomic_fetch_uint32_t(&pseudo_lazy.count) == 0 ||
+	    export == NULL || export->pseudopath == NULL)
+		return false;
+
+	if (dir != NULL && is_export_pseudo(export)) {
+		dir_path = pseudo_dir_path(dir);
+		PTHREAD_RWLOCK_rdlock(&export->lock);
+		if (dir_path == NULL && dir != export->exp_root_obj) {
+			/* Not ours, take everything below */
+			dir = NULL;
+		}
+		PTHREAD_RWLOCK_unlock(&export->lock);
+	} else {
+		dir = NULL;
+	}
+
+	if (dir_path == NULL)
+		dir_path = gsh_strdup(export->pseudopath);
+
+	/* The pseudo root is "/", the others have no trailing / */
+	len = strlen(dir_path);
+	if (len == 1)
+		len = 0;
+	path = gsh_malloc(len + (name != NULL ? strlen(name) : 0) + 3);
+	memcpy(path, dir_path, len);
+	path[len++] = '/';
+	path[len] = '\0';
+	gsh_free(dir_path);
+
+	PTHREAD_MUTEX_lock(&pseudo_lazy.mtx);
+
+	if (dir == NULL) {
+		/* Everything below */
+		while ((pp = pseudo_pending_first(path)) != NULL) {
+			pseudo_pending_mount(pp);
+			done = true;
+		}
+	} else if (name != NULL) {
+		/* The export at the name, or one below to make the node */
+		strcpy(path + len, name);
+		pp = pseudo_pending_first(path);
+		if (pp != NULL && strcmp(pp->export->pseudopath, path) == 0) {
+			pseudo_pending_mount(pp);
+			done = true;
+		}
+
+		strcat(path, "/");
+		pp = pseudo_pending_first(path);
+		if (pp != NULL) {
+			status = fsal_lookup(dir, name, &obj, NULL);
+			if (FSAL_IS_ERROR(status)) {
+				pseudo_pending_mount(pp);
+				done = true;
+			} else {
+				obj->obj_ops.put_ref(obj);
+			}
+		}
+	} else {
+		/* Each name of the directory */
+		for (pp = pseudo_pending_first(path); pp != NULL; pp = next) {
+			const char *comp = pp->export->pseudopath + len;
+			char *slash = strchr(comp, '/');
+			char *cname;
+			size_t copied;
+
+			next = pseudo_pending_next(pp, path);
+
+			if (slash != NULL) {
+				/* Below a name, which may be there already */
+				cname = gsh_strldup(comp, slash - comp,
+						    &copied);
+				status = fsal_lookup(dir, cname, &obj, NULL);
+				gsh_free(cname);
+				if (!FSAL_IS_ERROR(status)) {
+					obj->obj_ops.put_ref(obj);
+					continue;
+				}
+			}
+
+			pseudo_pending_mount(pp);
+			done = true;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&pseudo_lazy.mtx);
+
+	gsh_free(path);
+	return done;
+}
+
+/**
+ * @brief Mount an export itself if it is still waiting
+ *
+ * So that LOOKUPP can get back out of an export reached by handle.
+ *
+ * @param[in] export The export
+ */
+void pseudo_lazy_mount_export(struct gsh_export *export)
+{
+	struct pseudo_pending *pp;
+
+	if (atomic_fetch_uint32_t(&pseudo_lazy.count) == 0 ||
+	    export->pseudopath == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&pseudo_lazy.mtx);
+	pp = pseudo_pending_first(export->pseudopath);
+	if (pp != NULL && pp->export == export)
+		pseudo_pending_mount(pp);
+	PTHREAD_MUTEX_unlock(&pseudo_lazy.mtx);
+}
+
+/**
+ * @brief Stop an export being removed from waiting to be mounted
+ */
+static void pseudo_lazy_forget(struct gsh_export *export)
+{
+	struct pseudo_pending *pp;
+
+	if (atomic_fetch_uint32_t(&pseudo_lazy.count) == 0 ||
+	    export->pseudopath == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&pseudo_lazy.mtx);
+	pp = pseudo_pending_first(export->pseudopath);
+	if (pp != NULL && pp->export == export) {
+		avltree_remove(&pp->node, &pseudo_lazy.pending);
+		(void) atomic_dec_uint32_t(&pseudo_lazy.count);
+	} else {
+		pp = NULL;
+	}
+	PTHREAD_MUTEX_unlock(&pseudo_lazy.mtx);
+
+	if (pp != NULL) {
+		put_gsh_export(pp->export);
+		gsh_free(pp);
+	}
+}
+
 /**
  * @brief Delete the unecessary directories from pseudo FS
  *
@@ -148,6 +518,8 @@ void cleanup_pseudofs_node(char *pseudopath,
 		goto out;
 	}
 
+	pseudo_dir_del(obj);
+
 	/* Before recursing the check the parent, get export lock for looking at
 	 * exp_root_obj so we can check if we have reached the root of
 	 * the mounted on export.
@@ -302,6 +674,7 @@ bool pseudo_mount_export(struct gsh_export *export)
 	fsal_status_t fsal_status;
 	char *tok;
 	char *saveptr = NULL;
+	bool on_pseudo;
 	int rc;
 
 	/* skip exports that aren't for NFS v4
@@ -384,6 +757,8 @@ bool pseudo_mount_export(struct gsh_export *export)
 		return false;
 	}
 
+	on_pseudo = is_export_pseudo(op_ctx->ctx_export);
+
 	/* Now we need to process the rest of the path, creating directories
 	 * if necessary.
 	 */
@@ -399,6 +774,12 @@ bool pseudo_mount_export(struct gsh_export *export)
 			put_gsh_export(op_ctx->ctx_export);
 			return false;
 		}
+
+		/* tmp_pseudopath is a copy, so the node's path is the
+		 * export's up to the end of tok. */
+		if (on_pseudo)
+			pseudo_dir_add(state.obj, export->pseudopath,
+				       tok + strlen(tok) - tmp_pseudopath);
 	}
 
 	/* Now that all entries are added to pseudofs tree, and we are pointing
@@ -446,6 +827,13 @@ void create_pseudofs(void)
 {
 	struct root_op_context root_op_context;
 	struct gsh_export *export;
+	struct pseudo_pending *pp;
+
+	if (nfs_param.nfsv4_param.pseudo_lazy_mount && !pseudo_lazy.init) {
+		avltree_init(&pseudo_lazy.pending, pseudo_pending_cmpf, 0);
+		avltree_init(&pseudo_lazy.dirs, pseudo_dir_cmpf, 0);
+		pseudo_lazy.init = true;
+	}
 
 	/* Initialize a root context */
 	init_root_op_context(&root_op_context, NULL, NULL,
@@ -455,11 +843,31 @@ void create_pseudofs(void)
 		export = export_take_mount_work();
 		if (export == NULL)
 			break;
+
+		if (pseudo_lazy.init && export->pseudopath != NULL &&
+		    export->export_id != 0 && export->pseudopath[1] != '\0' &&
+		    (export->export_perms.options & EXPORT_OPTION_NFSV4)) {
+			/* Mounted when first looked for */
+			pp = gsh_malloc(sizeof(*pp));
+			get_gsh_export_ref(export);
+			pp->export = export;
+			PTHREAD_MUTEX_lock(&pseudo_lazy.mtx);
+			(void) avltree_insert(&pp->node, &pseudo_lazy.pending);
+			(void) atomic_inc_uint32_t(&pseudo_lazy.count);
+			PTHREAD_MUTEX_unlock(&pseudo_lazy.mtx);
+			continue;
+		}
+
 		if (!pseudo_mount_export(export))
 			LogFatal(COMPONENT_EXPORT,
 				 "Could not complete creating PseudoFS");
 	}
 	release_root_op_context();
+
+	if (pseudo_lazy.init)
+		LogInfo(COMPONENT_EXPORT,
+			"%"PRIu32" exports will be mounted in the PseudoFS on first use",
+			atomic_fetch_uint32_t(&pseudo_lazy.count));
 }
 
 /**
@@ -474,6 +882,9 @@ void pseudo_unmount_export(struct gsh_export *export)
 	struct fsal_obj_handle *junction_inode;
 	struct root_op_context root_op_context;
 
+	/* It may never have been mounted */
+	pseudo_lazy_forget(export);
+
 	/* Unmount any exports mounted on us */
 	while (true) {
 		PTHREAD_RWLOCK_rdlock(&export->lock);
@@ -40,6 +40,8 @@
 #include "nfs4_acls.h"
 #include "idmapper.h"
 #include "export_mgr.h"
+#include "gsh_arena.h"
+#include "abstract_atomic.h"
 
 /* Define mapping of NFS4 who name and type. */
 static struct {
@@ -385,36 +387,42 @@ static fattr_xdr_result decode_supported_attrs(XDR *xdr,
  * FATTR4_TYPE
  */
 
-static fattr_xdr_result encode_type(XDR *xdr, struct xdr_attrs_args *args)
+static bool nfs4_file_type(object_file_type_t type, uint32_t *file_type)
 {
-	uint32_t file_type;
-
-	switch (args->attrs->type) {
+	switch (type) {
 	case REGULAR_FILE:
 	case EXTENDED_ATTR:
-		file_type = NF4REG;	/* Regular file */
-		break;
+		*file_type = NF4REG;	/* Regular file */
+		return true;
 	case DIRECTORY:
-		file_type = NF4DIR;	/* Directory */
-		break;
+		*file_type = NF4DIR;	/* Directory */
+		return true;
 	case BLOCK_FILE:
-		file_type = NF4BLK;	/* Special File - block device */
-		break;
+		*file_type = NF4BLK;	/* Special File - block device */
+		return true;
 	case CHARACTER_FILE:
-		file_type = NF4CHR;	/* Special File - character device */
-		break;
+		*file_type = NF4CHR;	/* Special File - character device */
+		return true;
 	case SYMBOLIC_LINK:
-		file_type = NF4LNK;	/* Symbolic Link */
-		break;
+		*file_type = NF4LNK;	/* Symbolic Link */
+		return true;
 	case SOCKET_FILE:
-		file_type = NF4SOCK;	/* Special File - socket */
-		break;
+		*file_type = NF4SOCK;	/* Special File - socket */
+		return true;
 	case FIFO_FILE:
-		file_type = NF4FIFO;	/* Special File - fifo */
-		break;
+		*file_type = NF4FIFO;	/* Special File - fifo */
+		return true;
 	default:		/* includes NO_FILE_TYPE & FS_JUNCTION: */
-		return FATTR_XDR_FAILED;	/* silently skip bogus? */
+		return false;	/* silently skip bogus? */
 	}			/* switch( pattr->type ) */
+}
+
+static fattr_xdr_result encode_type(XDR *xdr, struct xdr_attrs_args *args)
+{
+	uint32_t file_type;
+
+	if (!nfs4_file_type(args->attrs->type, &file_type))
+		return FATTR_XDR_FAILED;
 	if (!xdr_u_int32_t(xdr, &file_type))
 		return FATTR_XDR_FAILED;
 	return FATTR_XDR_SUCCESS;
@@ -604,21 +612,26 @@ static fattr_xdr_result decode_namedattrsupport(XDR *xdr,
  * FATTR4_FSID
  */
 
-static fattr_xdr_result encode_fsid(XDR *xdr, struct xdr_attrs_args *args)
+static void nfs4_fsid(struct xdr_attrs_args *args, fsid4 *fsid)
 {
-	fsid4 fsid = {0, 0};
-
 	if (args->data != NULL &&
 	    op_ctx_export_has_option_set(EXPORT_OPTION_FSID_SET)) {
-		fsid.major = op_ctx->ctx_export->filesystem_id.major;
-		fsid.minor = op_ctx->ctx_export->filesystem_id.minor;
+		fsid->major = op_ctx->ctx_export->filesystem_id.major;
+		fsid->minor = op_ctx->ctx_export->filesystem_id.minor;
 	} else {
-		fsid.major = args->fsid.major;
-		fsid.minor = args->fsid.minor;
+		fsid->major = args->fsid.major;
+		fsid->minor = args->fsid.minor;
 	}
 	LogDebug(COMPONENT_NFS_V4,
 		 "fsid.major = %"PRIu64", fsid.minor = %"PRIu64,
-		 fsid.major, fsid.minor);
+		 fsid->major, fsid->minor);
+}
+
+static fattr_xdr_result encode_fsid(XDR *xdr, struct xdr_attrs_args *args)
+{
+	fsid4 fsid;
+
+	nfs4_fsid(args, &fsid);
 
 	if (!xdr_u_int64_t(xdr, &fsid.major))
 		return FATTR_XDR_FAILED;
@@ -3403,6 +3416,7 @@ void nfs4_Fattr_Free(fattr4 *fattr)
  * @param[in/out] attr          attrlist to fill in and mask to request
  * @param[out]    Fattr         NFSv4 Fattr buffer
  * @param[in]     Bitmap        Bitmap of attributes being requested
+ * @param[in]     arena         Arena to allocate attr_val from, or NULL
  *
  * @retval NFSv4 status
  */
@@ -3411,13 +3425,15 @@ nfsstat4 file_To_Fattr(compound_data_t *data,
 		       attrmask_t request_mask,
 		       struct attrlist *attr,
 		       fattr4 *Fattr,
-		       struct bitmap4 *Bitmap)
+		       struct bitmap4 *Bitmap,
+		       struct gsh_arena *arena)
 {
 	fsal_status_t status;
 	struct xdr_attrs_args args = {
 		.attrs = attr,
 		.data = data,
 		.hdl4 = &data->currentFH,
+		.arena = arena,
 	};
 
 	/* Permission check only if ACL is asked for.
@@ -3558,6 +3574,323 @@ int nfs4_Fattr_Fill_Error(fattr4 *Fattr, nfsstat4 rdattr_error)
 	}
 }
 
+/**
+ * @brief Give back an unused attr_vals buffer
+ *
+ * @param[in]     args  Encoding arguments, naming the arena if any
+ * @param[in,out] Fattr Attributes whose buffer is released
+ */
+static void nfs4_Fattr_Release_Vals(struct xdr_attrs_args *args,
+				    fattr4 *Fattr)
+{
+	if (args->arena != NULL)
+		gsh_arena_trim(args->arena, Fattr->attr_vals.attrlist4_val, 0);
+	else
+		gsh_free(Fattr->attr_vals.attrlist4_val);
+	Fattr->attr_vals.attrlist4_val = NULL;
+}
+
+/*
+ * Encoder plans
+ *
+ * Nearly all GETATTR and READDIR requests carry one of the few bitmaps
+ * the client was built with.  The first time such a bitmap is seen a
+ * plan is made for it: the attributes in encoding order, with runs of
+ * fixed size attributes grouped together.  Each run is reserved in the
+ * XDR buffer with a single bounds check and filled with direct stores.
+ * Everything else goes through its fattr4tab encoder as usual.
+ */
+
+/** Bitmaps that get a plan, later ones use the generic loop */
+#define FATTR4_PLANS 32
+
+/** Fixed size attributes a bitmap needs for a plan to be worth it */
+#define FATTR4_PLAN_MIN_DIRECT 4
+
+#define FATTR4_DIRECT_BIT(attr) (1U << ((attr) % 32))
+
+/** Attributes with a direct store, by bitmap word */
+static const uint32_t fattr4_direct_map[BITMAP4_MAPLEN] = {
+	[0] = FATTR4_DIRECT_BIT(FATTR4_TYPE) |
+	      FATTR4_DIRECT_BIT(FATTR4_CHANGE) |
+	      FATTR4_DIRECT_BIT(FATTR4_SIZE) |
+	      FATTR4_DIRECT_BIT(FATTR4_FSID) |
+	      FATTR4_DIRECT_BIT(FATTR4_FILEID),
+	[1] = FATTR4_DIRECT_BIT(FATTR4_MODE) |
+	      FATTR4_DIRECT_BIT(FATTR4_NUMLINKS) |
+	      FATTR4_DIRECT_BIT(FATTR4_RAWDEV) |
+	      FATTR4_DIRECT_BIT(FATTR4_SPACE_USED) |
+	      FATTR4_DIRECT_BIT(FATTR4_TIME_ACCESS) |
+	      FATTR4_DIRECT_BIT(FATTR4_TIME_METADATA) |
+	      FATTR4_DIRECT_BIT(FATTR4_TIME_MODIFY) |
+	      FATTR4_DIRECT_BIT(FATTR4_MOUNTED_ON_FILEID),
+};
+
+static inline void fattr4_put_u32(uint32_t **p, uint32_t val)
+{
+	*(*p)++ = htonl(val);
+}
+
+static inline void fattr4_put_u64(uint32_t **p, uint64_t val)
+{
+	fattr4_put_u32(p, val >> 32);
+	fattr4_put_u32(p, (uint32_t) val);
+}
+
+static inline void fattr4_put_time(uint32_t **p, struct timespec *ts)
+{
+	fattr4_put_u64(p, ts->tv_sec);
+	fattr4_put_u32(p, ts->tv_nsec);
+}
+
+/**
+ * @brief Store one fixed size attribute
+ *
+ * Must write exactly what the attribute's fattr4tab encoder would.
+ *
+ * @param[in,out] p    Where to store, advanced past the attribute
+ * @param[in]     attr Attribute, one of fattr4_direct_map
+ * @param[in]     args Encoding arguments
+ *
+ * @return false if the attribute can't be encoded.
+ */
+static bool fattr4_put(uint32_t **p, int attr, struct xdr_attrs_args *args)
+{
+	uint32_t file_type;
+	fsid4 fsid;
+
+	switch (attr) {
+	case FATTR4_TYPE:
+		if (!nfs4_file_type(args->attrs->type, &file_type))
+			return false;
+		fattr4_put_u32(p, file_type);
+		break;
+	case FATTR4_CHANGE:
+		fattr4_put_u64(p, args->attrs->change);
+		break;
+	case FATTR4_SIZE:
+		fattr4_put_u64(p, args->attrs->filesize);
+		break;
+	case FATTR4_FSID:
+		nfs4_fsid(args, &fsid);
+		fattr4_put_u64(p, fsid.major);
+		fattr4_put_u64(p, fsid.minor);
+		break;
+	case FATTR4_FILEID:
+		fattr4_put_u64(p, args->fileid);
+		break;
+	case FATTR4_MODE:
+		fattr4_put_u32(p, fsal2unix_mode(args->attrs->mode));
+		break;
+	case FATTR4_NUMLINKS:
+		fattr4_put_u32(p, args->attrs->numlinks);
+		break;
+	case FATTR4_RAWDEV:
+		fattr4_put_u32(p, args->attrs->rawdev.major);
+		fattr4_put_u32(p, args->attrs->rawdev.minor);
+		break;
+	case FATTR4_SPACE_USED:
+		fattr4_put_u64(p, args->attrs->spaceused);
+		break;
+	case FATTR4_TIME_ACCESS:
+		fattr4_put_time(p, &args->attrs->atime);
+		break;
+	case FATTR4_TIME_METADATA:
+		fattr4_put_time(p, &args->attrs->ctime);
+		break;
+	case FATTR4_TIME_MODIFY:
+		fattr4_put_time(p, &args->attrs->mtime);
+		break;
+	case FATTR4_MOUNTED_ON_FILEID:
+		fattr4_put_u64(p, args->mounted_on_fileid);
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Encoded size of a fixed size attribute
+ */
+static uint32_t fattr4_put_size(int attr)
+{
+	switch (attr) {
+	case FATTR4_TYPE:
+	case FATTR4_MODE:
+	case FATTR4_NUMLINKS:
+		return BYTES_PER_XDR_UNIT;
+	case FATTR4_RAWDEV:
+	case FATTR4_CHANGE:
+	case FATTR4_SIZE:
+	case FATTR4_FILEID:
+	case FATTR4_SPACE_USED:
+	case FATTR4_MOUNTED_ON_FILEID:
+		return 2 * BYTES_PER_XDR_UNIT;
+	case FATTR4_TIME_ACCESS:
+	case FATTR4_TIME_METADATA:
+	case FATTR4_TIME_MODIFY:
+		return 3 * BYTES_PER_XDR_UNIT;
+	case FATTR4_FSID:
+		return 4 * BYTES_PER_XDR_UNIT;
+	default:
+		return 0;
+	}
+}
+
+/** A run of fixed size attributes, or a single generic one */
+struct fattr4_step {
+	uint8_t first;		/*< Index in attrs of the first attribute */
+	uint8_t count;		/*< Attributes in the step */
+	uint16_t size;		/*< Bytes of a run, 0 for a generic step */
+};
+
+struct fattr4_plan {
+	uint32_t map[BITMAP4_MAPLEN];	/*< Bitmap the plan encodes */
+	int max_attr_idx;	/*< Highest attribute of the minor version */
+	struct bitmap4 direct;	/*< Attributes the runs always encode */
+	uint8_t nattrs;
+	uint8_t nsteps;
+	uint8_t attrs[FATTR4_XATTR_SUPPORT + 1];
+	struct fattr4_step steps[FATTR4_XATTR_SUPPORT + 1];
+};
+
+static struct fattr4_plan fattr4_plans[FATTR4_PLANS];
+static uint32_t fattr4_nplans;
+static pthread_mutex_t fattr4_plan_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void fattr4_plan_build(struct fattr4_plan *plan, struct bitmap4 *Bitmap,
+			      const uint32_t *map, int max_attr_idx)
+{
+	struct fattr4_step *step = NULL;
+	int attr;
+
+	memset(plan, 0, sizeof(*plan));
+	memcpy(plan->map, map, sizeof(plan->map));
+	plan->max_attr_idx = max_attr_idx;
+
+	for (attr = next_attr_from_bitmap(Bitmap, -1);
+	     attr != -1 && attr <= max_attr_idx;
+	     attr = next_attr_from_bitmap(Bitmap, attr)) {
+		uint32_t size = fattr4_put_size(attr);
+
+		if (size == 0 || step == NULL || step->size == 0) {
+			step = &plan->steps[plan->nsteps++];
+			step->first = plan->nattrs;
+		}
+		plan->attrs[plan->nattrs++] = attr;
+		step->count++;
+		step->size += size;
+
+		if (size != 0)
+			set_attribute_in_bitmap(&plan->direct, attr);
+	}
+}
+
+/**
+ * @brief Find, or make, the plan for a bitmap
+ *
+ * @param[in] Bitmap       Requested attributes
+ * @param[in] max_attr_idx Highest attribute of the minor version
+ *
+ * @return The plan, NULL to use the generic loop.
+ */
+static const struct fattr4_plan *fattr4_plan_get(struct bitmap4 *Bitmap,
+						 int max_attr_idx)
+{
+	uint32_t map[BITMAP4_MAPLEN] = { 0 };
+	uint32_t i, n, ndirect = 0;
+	struct fattr4_plan *plan = NULL;
+
+	for (i = 0; i < Bitmap->bitmap4_len && i < BITMAP4_MAPLEN; i++) {
+		map[i] = Bitmap->map[i];
+		ndirect += __builtin_popcount(map[i] & fattr4_direct_map[i]);
+	}
+
+	if (ndirect < FATTR4_PLAN_MIN_DIRECT)
+		return NULL;
+
+	n = atomic_fetch_uint32_t(&fattr4_nplans);
+	for (i = 0; i < n; i++) {
+		if (fattr4_plans[i].max_attr_idx == max_attr_idx &&
+		    memcmp(fattr4_plans[i].map, map, sizeof(map)) == 0)
+			return &fattr4_plans[i];
+	}
+
+	if (n == FATTR4_PLANS)
+		return NULL;
+
+	PTHREAD_MUTEX_lock(&fattr4_plan_mutex);
+
+	/* Someone may have planned it, or others, meanwhile */
+	n = atomic_fetch_uint32_t(&fattr4_nplans);
+	for (i = 0; i < n; i++) {
+		if (fattr4_plans[i].max_attr_idx == max_attr_idx &&
+		    memcmp(fattr4_plans[i].map, map, sizeof(map)) == 0) {
+			plan = &fattr4_plans[i];
+			break;
+		}
+	}
+
+	if (plan == NULL && n < FATTR4_PLANS) {
+		plan = &fattr4_plans[n];
+		fattr4_plan_build(plan, Bitmap, map, max_attr_idx);
+		atomic_store_uint32_t(&fattr4_nplans, n + 1);
+		LogDebug(COMPONENT_NFS_V4,
+			 "Planned attribute bitmap %08"PRIx32" %08"PRIx32
+			 " %08"PRIx32" in %"PRIu8" steps",
+			 map[0], map[1], map[2], plan->nsteps);
+	}
+
+	PTHREAD_MUTEX_unlock(&fattr4_plan_mutex);
+
+	return plan;
+}
+
+/**
+ * @brief Encode attributes by a plan
+ *
+ * @param[in]     plan Plan for the requested bitmap
+ * @param[in]     xdr  Stream over the attr_vals buffer
+ * @param[in]     args Encoding arguments
+ * @param[in,out] Fattr Attributes, whose attrmask is filled in
+ *
+ * @return false if an attribute failed to encode.
+ */
+static bool fattr4_plan_encode(const struct fattr4_plan *plan, XDR *xdr,
+			       struct xdr_attrs_args *args, fattr4 *Fattr)
+{
+	const struct fattr4_step *step;
+	fattr_xdr_result xdr_res;
+	uint32_t *p;
+	int i, attr;
+
+	Fattr->attrmask = plan->direct;
+
+	for (step = plan->steps; step < plan->steps + plan->nsteps; step++) {
+		if (step->size == 0) {
+			attr = plan->attrs[step->first];
+			xdr_res = fattr4tab[attr].encode(xdr, args);
+			if (xdr_res == FATTR_XDR_SUCCESS)
+				set_attribute_in_bitmap(&Fattr->attrmask, attr);
+			else if (xdr_res != FATTR_XDR_NOOP)
+				return false;
+			continue;
+		}
+
+		p = (uint32_t *) xdr_inline(xdr, step->size);
+		if (p == NULL)
+			return false;
+
+		for (i = step->first; i < step->first + step->count; i++) {
+			if (!fattr4_put(&p, plan->attrs[i], args))
+				return false;
+		}
+	}
+
+	return true;
+}
+
 /**
  * @brief Converts FSAL Attributes to NFSv4 Fattr buffer.
  *
@@ -3583,6 +3916,7 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	fsal_dynamicfsinfo_t dynamicinfo;
 	XDR attr_body;
 	fattr_xdr_result xdr_res;
+	const struct fattr4_plan *plan;
 
 	/* basic init */
 	memset(Fattr, 0, sizeof(*Fattr));
@@ -3590,7 +3924,12 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	if (Bitmap->bitmap4_len == 0)
 		return 0;	/* they ask for nothing, they get nothing */
 
-	Fattr->attr_vals.attrlist4_val = gsh_malloc(NFS4_ATTRVALS_BUFFLEN);
+	if (args->arena != NULL)
+		Fattr->attr_vals.attrlist4_val =
+			gsh_arena_alloc(args->arena, NFS4_ATTRVALS_BUFFLEN);
+	else
+		Fattr->attr_vals.attrlist4_val =
+			gsh_malloc(NFS4_ATTRVALS_BUFFLEN);
 
 	max_attr_idx = nfs4_max_attr_index(args->data);
 	LogFullDebug(COMPONENT_NFS_V4, "Maximum allowed attr index = %d",
@@ -3604,6 +3943,13 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	if (args->dynamicinfo == NULL)
 		args->dynamicinfo = &dynamicinfo;
 
+	plan = fattr4_plan_get(Bitmap, max_attr_idx);
+	if (plan != NULL) {
+		if (!fattr4_plan_encode(plan, &attr_body, args, Fattr))
+			goto err;
+		goto encoded;
+	}
+
 	for (attribute_to_set = next_attr_from_bitmap(Bitmap, -1);
 	     attribute_to_set != -1;
 	     attribute_to_set =
@@ -3637,20 +3983,24 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 		}
 		/* mark the attribute in the bitmap should be new bitmap btw */
 	}
+
+ encoded:
 	LastOffset = xdr_getpos(&attr_body);	/* dumb but for now */
 	xdr_destroy(&attr_body);
 
 	if (LastOffset == 0) {	/* no supported attrs so we can free */
 		assert(Fattr->attrmask.bitmap4_len == 0);
-		gsh_free(Fattr->attr_vals.attrlist4_val);
-		Fattr->attr_vals.attrlist4_val = NULL;
+		nfs4_Fattr_Release_Vals(args, Fattr);
+	} else if (args->arena != NULL) {
+		/* Hand back what the encoding did not use */
+		gsh_arena_trim(args->arena, Fattr->attr_vals.attrlist4_val,
+			       LastOffset);
 	}
 	Fattr->attr_vals.attrlist4_len = LastOffset;
 	return 0;
 
  err:
-	gsh_free(Fattr->attr_vals.attrlist4_val);
-	Fattr->attr_vals.attrlist4_val = NULL;
+	nfs4_Fattr_Release_Vals(args, Fattr);
 	return -1;
 }
 
@@ -4384,6 +4734,26 @@ int nfs4_Fattr_To_FSAL_attr(struct attrlist *FSAL_attr, fattr4 *Fattr,
 	return Fattr4_To_FSAL_attr(FSAL_attr, Fattr, NULL, NULL, data);
 }
 
+/**
+ * @brief Convert NFSv4 attributes, also returning the file handle
+ *
+ * Like nfs4_Fattr_To_FSAL_attr, but if FATTR4_FILEHANDLE is present it
+ * is copied into hdl4, which must point to a buffer of NFS4_FHSIZE
+ * bytes.  hdl4->nfs_fh4_len is left untouched if there is no handle.
+ *
+ * @param[out]    FSAL_attr FSAL attributes
+ * @param[in]     Fattr     NFSv4 attributes
+ * @param[in,out] hdl4      File handle
+ *
+ * @return NFS4_OK if successful, NFS4ERR codes if not.
+ */
+int nfs4_Fattr_To_FSAL_attr_fh(struct attrlist *FSAL_attr, fattr4 *Fattr,
+			       nfs_fh4 *hdl4)
+{
+	memset(FSAL_attr, 0, sizeof(struct attrlist));
+	return Fattr4_To_FSAL_attr(FSAL_attr, Fattr, hdl4, NULL, NULL);
+}
+
 /**
  *
  * nfs4_Fattr_To_fsinfo: Decode filesystem info out of NFSv4 attributes.
@@ -99,7 +99,6 @@ int nlm4_Granted_Res(nfs_arg_t *args, struct svc_req *req, nfs_res_t *res)
 		}
 	} else {
 		state_complete_grant(cookie_entry);
-		nlm_signal_async_resp(cookie_entry);
 	}
 
 	return NFS_REQ_OK;
@@ -235,8 +235,7 @@ static void nlm4_lock_message_resp(state_async_queue_t *arg)
 
 	nlm_send_async(NLMPROC4_LOCK_RES,
 		       nlm_arg->nlm_async_host,
-		       &nlm_arg->nlm_async_args.nlm_async_res,
-		       NULL);
+		       &nlm_arg->nlm_async_args.nlm_async_res);
 
 	nlm4_Lock_Free(&nlm_arg->nlm_async_args.nlm_async_res);
 	dec_nsm_client_ref(nlm_arg->nlm_async_host->slc_nsm_client);
@@ -24,6 +24,7 @@
 
 #include "config.h"
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
 #include <rpc/types.h>
 #include <rpc/nettype.h>
@@ -34,9 +35,112 @@
 #include "sal_functions.h"
 #include "nlm_util.h"
 #include "nlm_async.h"
+#include "fridgethr.h"
 
-pthread_mutex_t nlm_async_resp_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t nlm_async_resp_cond = PTHREAD_COND_INITIALIZER;
+/*
+ * Callbacks to a client are queued on the client and sent in order by
+ * one NLM_Async thread at a time, over the client's callback
+ * connection.  Other clients' callbacks go out on the other threads
+ * meanwhile.
+ */
+static struct fridgethr *nlm_async_fridge;
+
+/**
+ * @brief Send the callbacks queued on a client
+ *
+ * @param[in] ctx Thread context, the client is the argument
+ */
+static void nlm_async_sender(struct fridgethr_context *ctx)
+{
+	state_nlm_client_t *host = ctx->arg;
+	state_async_queue_t *arg;
+
+	for (;;) {
+		PTHREAD_MUTEX_lock(&host->slc_async_mutex);
+		arg = glist_first_entry(&host->slc_async_queue,
+					state_async_queue_t,
+					state_async_glist);
+		if (arg == NULL) {
+			host->slc_async_sending = false;
+			PTHREAD_MUTEX_unlock(&host->slc_async_mutex);
+			break;
+		}
+		glist_del(&arg->state_async_glist);
+		PTHREAD_MUTEX_unlock(&host->slc_async_mutex);
+
+		arg->state_async_func(arg);
+	}
+
+	/* Taken by nlm_async_schedule */
+	dec_nlm_client_ref(host);
+}
+
+/**
+ * @brief Queue a callback to a client
+ *
+ * @param[in] arg Callback, its nlm_async_host is the client
+ *
+ * @return State status.
+ */
+state_status_t nlm_async_schedule(state_async_queue_t *arg)
+{
+	state_nlm_client_t *host =
+		arg->state_async_data.state_nlm_async_data.nlm_async_host;
+	bool start;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&host->slc_async_mutex);
+	glist_add_tail(&host->slc_async_queue, &arg->state_async_glist);
+	start = !host->slc_async_sending;
+	host->slc_async_sending = true;
+	PTHREAD_MUTEX_unlock(&host->slc_async_mutex);
+
+	if (!start)
+		return STATE_SUCCESS;
+
+	inc_nlm_client_ref(host);
+
+	rc = fridgethr_submit(nlm_async_fridge, nlm_async_sender, host);
+
+	if (rc == 0)
+		return STATE_SUCCESS;
+
+	LogCrit(COMPONENT_NLM, "Unable to schedule NLM callback: %d", rc);
+
+	/* Callbacks queued meanwhile go with the next one */
+	PTHREAD_MUTEX_lock(&host->slc_async_mutex);
+	glist_del(&arg->state_async_glist);
+	host->slc_async_sending = false;
+	PTHREAD_MUTEX_unlock(&host->slc_async_mutex);
+
+	dec_nlm_client_ref(host);
+
+	return STATE_SIGNAL_ERROR;
+}
+
+/**
+ * @brief Start the threads sending NLM callbacks
+ *
+ * @return 0 or an error from fridgethr_init.
+ */
+int nlm_async_callback_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.core_param.nlm_callback_threads;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&nlm_async_fridge, "NLM_Async", &frp);
+
+	if (rc != 0)
+		LogMajor(COMPONENT_NLM,
+			 "Unable to initialize NLM async thread fridge: %d",
+			 rc);
+
+	return rc;
+}
 
 int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 			    nfs_res_t *pres)
@@ -54,7 +158,7 @@ int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 	copy_netobj(&nlm_arg->nlm_async_args.nlm_async_res.res_nlm4.cookie,
 		    &pres->res_nlm4.cookie);
 
-	status = state_async_schedule(arg);
+	status = nlm_async_schedule(arg);
 
 	if (status != STATE_SUCCESS) {
 		gsh_free(arg);
@@ -88,7 +192,7 @@ int nlm_send_async_res_nlm4test(state_nlm_client_t *host,
 		      holder.oh);
 	}
 
-	status = state_async_schedule(arg);
+	status = nlm_async_schedule(arg);
 
 	if (status != STATE_SUCCESS) {
 		netobj_free(
@@ -112,19 +216,19 @@ xdrproc_t nlm_reply_proc[] = {
 	[NLMPROC4_UNLOCK_RES] = (xdrproc_t) xdr_nlm4_res,
 };
 
-static void *resp_key;
-
 static const int MAX_ASYNC_RETRY = 2;
 
-/* Client routine  to send the asynchrnous response,
- * key is used to wait for a response
+/* Client routine to send the asynchronous response.
+ *
+ * The calls are messages, the reply to a GRANTED_MSG comes back as a
+ * GRANTED_RES request, so nothing is waited for.  Called from the
+ * sender of the client's callbacks, which is what serializes the use of
+ * its callback connection.
  */
-int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
+int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg)
 {
 	struct timeval tout = { 0, 10 };
 	int retval, retry;
-	struct timeval start, now;
-	struct timespec timeout;
 
 	for (retry = 0; retry < MAX_ASYNC_RETRY; retry++) {
 		if (host->slc_callback_clnt == NULL) {
@@ -254,10 +358,6 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 			host->slc_callback_auth = authnone_create();
 		}
 
-		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = key;
-		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
-
 		LogFullDebug(COMPONENT_NLM, "About to make clnt_call");
 
 		retval = clnt_call(host->slc_callback_clnt,
@@ -285,58 +385,10 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 		host->slc_callback_clnt = NULL;
 	}
 
-	if (retry == MAX_ASYNC_RETRY) {
+	if (retry == MAX_ASYNC_RETRY)
 		LogMajor(COMPONENT_NLM,
 			 "NLM async Client exceeded retry count %d",
 			 MAX_ASYNC_RETRY);
-		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = NULL;
-		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
-		return retval;
-	}
-
-	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-
-	if (resp_key != NULL) {
-		/* Wait for 5 seconds or a signal */
-		gettimeofday(&start, NULL);
-		gettimeofday(&now, NULL);
-		timeout.tv_sec = 5 + start.tv_sec;
-		timeout.tv_nsec = 0;
-
-		LogFullDebug(COMPONENT_NLM,
-			     "About to wait for signal for key %p", resp_key);
-
-		while (resp_key != NULL && now.tv_sec < (start.tv_sec + 5)) {
-			int rc;
-
-			rc = pthread_cond_timedwait(&nlm_async_resp_cond,
-						    &nlm_async_resp_mutex,
-						    &timeout);
-			LogFullDebug(COMPONENT_NLM,
-				     "pthread_cond_timedwait returned %d",
-				     rc);
-			gettimeofday(&now, NULL);
-		}
-		LogFullDebug(COMPONENT_NLM, "Done waiting");
-	}
-
-	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
 
 	return retval;
 }
-
-void nlm_signal_async_resp(void *key)
-{
-	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-
-	if (resp_key == key) {
-		resp_key = NULL;
-		pthread_cond_signal(&nlm_async_resp_cond);
-		LogFullDebug(COMPONENT_NLM, "Signaled condition variable");
-	} else {
-		LogFullDebug(COMPONENT_NLM, "Didn't signal condition variable");
-	}
-
-	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
-}
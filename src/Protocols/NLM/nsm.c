@@ -29,13 +29,42 @@
 #include "gsh_rpc.h"
 #include "nsm.h"
 #include "sal_data.h"
+#include "sal_functions.h"
+#include "fridgethr.h"
+#include "gsh_config.h"
+
+/*
+ * Monitoring is asynchronous, NLM requests never wait for statd.
+ *
+ * nsm_monitor() marks the host NSM_MONITORING and queues an SM_MON, and
+ * the NSM thread sends the queue over a connection to statd that stays
+ * open.  If the call fails the host goes back to NSM_UNMONITORED and
+ * the next request for it queues a new SM_MON.
+ *
+ * A host that is released is unmonitored NSM_Unmonitor_Delay seconds
+ * later.  If it comes back meanwhile, which a client dropping its last
+ * lock and taking a new one does, the SM_UNMON and the SM_MON are both
+ * dropped and the host is still monitored.
+ */
+
+struct nsm_req {
+	struct glist_head nr_list;
+	time_t nr_time;		/*< When queued */
+	state_nsm_client_t *nr_host;	/*< SM_MON, holds a reference */
+	char *nr_name;		/*< SM_UNMON, the caller name */
+};
 
 pthread_mutex_t nsm_mutex = PTHREAD_MUTEX_INITIALIZER;
 CLIENT *nsm_clnt;
 AUTH *nsm_auth;
-unsigned long nsm_count;
 char *nodename;
 
+/* Protects the queues, never held across a call to statd */
+static pthread_mutex_t nsm_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head nsm_mon_queue = GLIST_HEAD_INIT(nsm_mon_queue);
+static struct glist_head nsm_unmon_queue = GLIST_HEAD_INIT(nsm_unmon_queue);
+static struct fridgethr *nsm_fridge;
+
 bool nsm_connect(void)
 {
 	struct utsname utsname;
@@ -68,7 +97,7 @@ bool nsm_connect(void)
 
 void nsm_disconnect(void)
 {
-	if (nsm_count == 0 && nsm_clnt != NULL) {
+	if (nsm_clnt != NULL) {
 		gsh_clnt_destroy(nsm_clnt);
 		nsm_clnt = NULL;
 		AUTH_DESTROY(nsm_auth);
@@ -78,40 +107,35 @@ void nsm_disconnect(void)
 	}
 }
 
-bool nsm_monitor(state_nsm_client_t *host)
+/**
+ * @brief Send SM_MON for a host
+ *
+ * @param[in] name The caller name of the host
+ *
+ * @return Whether statd monitors the host.
+ */
+static bool nsm_send_mon(char *name)
 {
 	enum clnt_stat ret;
 	struct mon nsm_mon;
 	struct sm_stat_res res;
 	struct timeval tout = { 25, 0 };
 
-	if (host == NULL)
-		return true;
-
-	PTHREAD_MUTEX_lock(&host->ssc_mutex);
-
-	if (atomic_fetch_int32_t(&host->ssc_monitored)) {
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
-		return true;
-	}
-
 	memset(&nsm_mon, 0, sizeof(nsm_mon));
-	nsm_mon.mon_id.mon_name = host->ssc_nlm_caller_name;
+	nsm_mon.mon_id.mon_name = name;
 	nsm_mon.mon_id.my_id.my_prog = NLMPROG;
 	nsm_mon.mon_id.my_id.my_vers = NLM4_VERS;
 	nsm_mon.mon_id.my_id.my_proc = NLMPROC4_SM_NOTIFY;
 	/* nothing to put in the private data */
-	LogDebug(COMPONENT_NLM, "Monitor %s", host->ssc_nlm_caller_name);
+	LogDebug(COMPONENT_NLM, "Monitor %s", name);
 
 	PTHREAD_MUTEX_lock(&nsm_mutex);
 
 	/* create a connection to nsm on the localhost */
 	if (!nsm_connect()) {
 		LogCrit(COMPONENT_NLM,
-			"Can not monitor %s clnt_create returned NULL",
-			nsm_mon.mon_id.mon_name);
+			"Can not monitor %s clnt_create returned NULL", name);
 		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
@@ -130,57 +154,42 @@ bool nsm_monitor(state_nsm_client_t *host)
 	if (ret != RPC_SUCCESS) {
 		LogCrit(COMPONENT_NLM,
 			"Can not monitor %s SM_MON ret %d %s",
-			nsm_mon.mon_id.mon_name,
-			ret,
-			clnt_sperror(nsm_clnt, ""));
+			name, ret, clnt_sperror(nsm_clnt, ""));
 
 		nsm_disconnect();
 		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
 	if (res.res_stat != STAT_SUCC) {
 		LogCrit(COMPONENT_NLM,
 			"Can not monitor %s SM_MON status %d",
-			nsm_mon.mon_id.mon_name, res.res_stat);
+			name, res.res_stat);
 
-		nsm_disconnect();
 		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
-	nsm_count++;
-	atomic_store_int32_t(&host->ssc_monitored, true);
-
 	LogDebug(COMPONENT_NLM,
-		 "Monitored %s for nodename %s",
-		 nsm_mon.mon_id.mon_name, nodename);
+		 "Monitored %s for nodename %s", name, nodename);
 
 	PTHREAD_MUTEX_unlock(&nsm_mutex);
-	PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 	return true;
 }
 
-bool nsm_unmonitor(state_nsm_client_t *host)
+/**
+ * @brief Send SM_UNMON for a host
+ *
+ * @param[in] name The caller name of the host
+ */
+static void nsm_send_unmon(char *name)
 {
 	enum clnt_stat ret;
 	struct sm_stat res;
 	struct mon_id nsm_mon_id;
 	struct timeval tout = { 25, 0 };
 
-	if (host == NULL)
-		return true;
-
-	PTHREAD_MUTEX_lock(&host->ssc_mutex);
-
-	if (!atomic_fetch_int32_t(&host->ssc_monitored)) {
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
-		return true;
-	}
-
-	nsm_mon_id.mon_name = host->ssc_nlm_caller_name;
+	nsm_mon_id.mon_name = name;
 	nsm_mon_id.my_id.my_prog = NLMPROG;
 	nsm_mon_id.my_id.my_vers = NLM4_VERS;
 	nsm_mon_id.my_id.my_proc = NLMPROC4_SM_NOTIFY;
@@ -191,10 +200,9 @@ bool nsm_unmonitor(state_nsm_client_t *host)
 	if (!nsm_connect()) {
 		LogCrit(COMPONENT_NLM,
 			"Can not unmonitor %s clnt_create returned NULL",
-			nsm_mon_id.mon_name);
+			name);
 		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
-		return false;
+		return;
 	}
 
 	/* Set this after we call nsm_connect() */
@@ -212,26 +220,205 @@ bool nsm_unmonitor(state_nsm_client_t *host)
 	if (ret != RPC_SUCCESS) {
 		LogCrit(COMPONENT_NLM,
 			"Can not unmonitor %s SM_MON ret %d %s",
-			nsm_mon_id.mon_name,
-			ret,
-			clnt_sperror(nsm_clnt, ""));
+			name, ret, clnt_sperror(nsm_clnt, ""));
 
 		nsm_disconnect();
 		PTHREAD_MUTEX_unlock(&nsm_mutex);
+		return;
+	}
+
+	LogDebug(COMPONENT_NLM, "Unonitored %s for nodename %s",
+		 name, nodename);
+
+	PTHREAD_MUTEX_unlock(&nsm_mutex);
+}
+
+/**
+ * @brief Send the queued SM_MON and the due SM_UNMON calls
+ *
+ * @param[in] ctx Thread context
+ */
+static void nsm_run(struct fridgethr_context *ctx)
+{
+	time_t delay = nfs_param.core_param.nsm_unmonitor_delay;
+	struct nsm_req *req;
+	state_nsm_client_t *host;
+	bool monitored;
+
+	SetNameFunction("nsm");
+
+	while (!fridgethr_you_should_break(ctx)) {
+		PTHREAD_MUTEX_lock(&nsm_queue_mutex);
+		req = glist_first_entry(&nsm_mon_queue, struct nsm_req,
+					nr_list);
+		if (req == NULL) {
+			req = glist_first_entry(&nsm_unmon_queue,
+						struct nsm_req, nr_list);
+			if (req != NULL && time(NULL) - req->nr_time < delay)
+				req = NULL;
+		}
+		if (req != NULL)
+			glist_del(&req->nr_list);
+		PTHREAD_MUTEX_unlock(&nsm_queue_mutex);
+
+		if (req == NULL)
+			break;
+
+		host = req->nr_host;
+		if (host == NULL) {
+			nsm_send_unmon(req->nr_name);
+			gsh_free(req->nr_name);
+			gsh_free(req);
+			continue;
+		}
+
+		monitored = nsm_send_mon(host->ssc_nlm_caller_name);
+
+		PTHREAD_MUTEX_lock(&host->ssc_mutex);
+		atomic_store_int32_t(&host->ssc_monitored,
+				     monitored ? NSM_MONITORED
+					       : NSM_UNMONITORED);
 		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
-		return false;
+
+		dec_nsm_client_ref(host);
+		gsh_free(req);
 	}
+}
+
+/**
+ * @brief Start the NSM thread
+ *
+ * @return 0 or an error from fridgethr.
+ */
+int nsm_async_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
 
-	atomic_store_int32_t(&host->ssc_monitored, false);
-	nsm_count--;
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = 1;
+	frp.flavor = fridgethr_flavor_looper;
 
-	LogDebug(COMPONENT_NLM, "Unonitored %s for nodename %s",
-		 nsm_mon_id.mon_name, nodename);
+	rc = fridgethr_init(&nsm_fridge, "NSM", &frp);
 
-	nsm_disconnect();
+	if (rc != 0) {
+		LogMajor(COMPONENT_NLM,
+			 "Unable to initialize NSM thread fridge: %d", rc);
+		return rc;
+	}
 
-	PTHREAD_MUTEX_unlock(&nsm_mutex);
+	rc = fridgethr_submit(nsm_fridge, nsm_run, NULL);
+
+	if (rc != 0)
+		LogMajor(COMPONENT_NLM,
+			 "Unable to start NSM thread, error code %d.", rc);
+
+	return rc;
+}
+
+/**
+ * @brief Have statd monitor a host
+ *
+ * The host counts as monitored as soon as the SM_MON is queued.
+ *
+ * @param[in] host The host
+ *
+ * @return Always true, the result is kept for the callers.
+ */
+bool nsm_monitor(state_nsm_client_t *host)
+{
+	struct glist_head *glist;
+	struct nsm_req *req;
+
+	if (host == NULL ||
+	    atomic_fetch_int32_t(&host->ssc_monitored) != NSM_UNMONITORED)
+		return true;
+
+	PTHREAD_MUTEX_lock(&host->ssc_mutex);
+
+	if (atomic_fetch_int32_t(&host->ssc_monitored) != NSM_UNMONITORED) {
+		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+		return true;
+	}
+
+	PTHREAD_MUTEX_lock(&nsm_queue_mutex);
+
+	/* If the host is still waiting to be unmonitored, statd still
+	 * monitors it.
+	 */
+	glist_for_each(glist, &nsm_unmon_queue) {
+		req = glist_entry(glist, struct nsm_req, nr_list);
+		if (strcmp(req->nr_name, host->ssc_nlm_caller_name) == 0) {
+			glist_del(&req->nr_list);
+			PTHREAD_MUTEX_unlock(&nsm_queue_mutex);
+
+			atomic_store_int32_t(&host->ssc_monitored,
+					     NSM_MONITORED);
+			PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+
+			LogDebug(COMPONENT_NLM, "Still monitoring %s",
+				 req->nr_name);
+			gsh_free(req->nr_name);
+			gsh_free(req);
+			return true;
+		}
+	}
+
+	req = gsh_calloc(1, sizeof(*req));
+	req->nr_host = host;
+	inc_nsm_client_ref(host);
+	glist_add_tail(&nsm_mon_queue, &req->nr_list);
+
+	PTHREAD_MUTEX_unlock(&nsm_queue_mutex);
+
+	atomic_store_int32_t(&host->ssc_monitored, NSM_MONITORING);
+	PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+
+	(void) fridgethr_wake(nsm_fridge);
+
+	return true;
+}
+
+/**
+ * @brief Have statd stop monitoring a host being released
+ *
+ * The SM_UNMON is sent NSM_Unmonitor_Delay seconds later, unless the
+ * host is monitored again meanwhile.
+ *
+ * @param[in] host The host
+ *
+ * @return Always true, the result is kept for the callers.
+ */
+bool nsm_unmonitor(state_nsm_client_t *host)
+{
+	struct nsm_req *req;
+
+	if (host == NULL)
+		return true;
+
+	PTHREAD_MUTEX_lock(&host->ssc_mutex);
+
+	/* A host with an SM_MON queued is referenced by it and not
+	 * released.
+	 */
+	if (atomic_fetch_int32_t(&host->ssc_monitored) != NSM_MONITORED) {
+		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+		return true;
+	}
+
+	req = gsh_calloc(1, sizeof(*req));
+	req->nr_time = time(NULL);
+	req->nr_name = gsh_strdup(host->ssc_nlm_caller_name);
+
+	PTHREAD_MUTEX_lock(&nsm_queue_mutex);
+	glist_add_tail(&nsm_unmon_queue, &req->nr_list);
+	PTHREAD_MUTEX_unlock(&nsm_queue_mutex);
+
+	atomic_store_int32_t(&host->ssc_monitored, NSM_UNMONITORED);
 	PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+
 	return true;
 }
 
@@ -273,8 +460,8 @@ void nsm_unmonitor_all(void)
 			"Can not unmonitor all ret %d %s",
 			ret,
 			clnt_sperror(nsm_clnt, ""));
+		nsm_disconnect();
 	}
 
-	nsm_disconnect();
 	PTHREAD_MUTEX_unlock(&nsm_mutex);
 }
@@ -3,6 +3,7 @@
  * It was generated using rpcgen.
  */
 #include "config.h"
+#include <string.h>
 #include "gsh_rpc.h"
 #include "nfs23.h"
 #include "nfs_fh.h"
@@ -13,6 +14,70 @@ static struct nfs_request_lookahead dummy_lookahead = {
 	.write = 0
 };
 
+/* The arguments of the hot NFSv3 procedures and the attributes in
+ * their replies are decoded and encoded in place when the stream holds
+ * them contiguously, with a single length check, as rpcgen -i would.
+ * Split buffers go through the generic routines.
+ */
+#define FATTR3_UNITS 21
+
+#define IXDR3_GET_U64(buf, v)					\
+	do {							\
+		(v) = (uint64_t) IXDR_GET_U_INT32(buf) << 32;	\
+		(v) |= IXDR_GET_U_INT32(buf);			\
+	} while (0)
+
+#define IXDR3_PUT_U64(buf, v)					\
+	do {							\
+		IXDR_PUT_U_INT32(buf, (uint32_t) ((v) >> 32));	\
+		IXDR_PUT_U_INT32(buf, (uint32_t) (v));		\
+	} while (0)
+
+/**
+ * @brief Decode a file handle and the fixed size fields following it
+ *
+ * @param[in]  xdrs	XDR stream
+ * @param[out] objp	File handle
+ * @param[in]  fixed	Size of the fields following it
+ * @param[out] bufp	The fields in the stream, NULL if they are to go
+ *			through the generic routines
+ *
+ * @return false on error.
+ */
+static bool xdr_nfs_fh3_fixed(XDR *xdrs, nfs_fh3 *objp, u_int fixed,
+			      int32_t **bufp)
+{
+	int32_t *buf;
+	u_int len;
+
+	*bufp = NULL;
+
+	if (xdrs->x_op != XDR_DECODE)
+		return xdr_nfs_fh3(xdrs, objp);
+
+	buf = XDR_INLINE(xdrs, BYTES_PER_XDR_UNIT);
+	if (buf == NULL)
+		return xdr_nfs_fh3(xdrs, objp);
+
+	len = IXDR_GET_U_INT32(buf);
+	if (len > NFS3_FHSIZE)
+		return false;
+
+	/* as xdr_bytes() does */
+	objp->data.data_len = len;
+	if (len != 0 && objp->data.data_val == NULL)
+		objp->data.data_val = mem_alloc(len);
+
+	buf = XDR_INLINE(xdrs, RNDUP(len) + fixed);
+	if (buf == NULL)
+		return len == 0 || xdr_opaque(xdrs, objp->data.data_val, len);
+
+	if (len != 0)
+		memcpy(objp->data.data_val, buf, len);
+	*bufp = buf + RNDUP(len) / BYTES_PER_XDR_UNIT;
+	return true;
+}
+
 bool xdr_nfspath2(xdrs, objp)
 register XDR *xdrs;
 nfspath2 *objp;
@@ -480,12 +545,53 @@ bool xdr_fattr3(xdrs, objp)
 register XDR *xdrs;
 fattr3 *objp;
 {
-
-#if defined(_LP64) || defined(_KERNEL)
-	register int __attribute__ ((__unused__)) * buf;
-#else
-	register long __attribute__ ((__unused__)) * buf;
-#endif
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = XDR_INLINE(xdrs, FATTR3_UNITS * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			IXDR_PUT_U_INT32(buf, objp->type);
+			IXDR_PUT_U_INT32(buf, objp->mode);
+			IXDR_PUT_U_INT32(buf, objp->nlink);
+			IXDR_PUT_U_INT32(buf, objp->uid);
+			IXDR_PUT_U_INT32(buf, objp->gid);
+			IXDR3_PUT_U64(buf, objp->size);
+			IXDR3_PUT_U64(buf, objp->used);
+			IXDR_PUT_U_INT32(buf, objp->rdev.specdata1);
+			IXDR_PUT_U_INT32(buf, objp->rdev.specdata2);
+			IXDR3_PUT_U64(buf, objp->fsid);
+			IXDR3_PUT_U64(buf, objp->fileid);
+			IXDR_PUT_U_INT32(buf, objp->atime.tv_sec);
+			IXDR_PUT_U_INT32(buf, objp->atime.tv_nsec);
+			IXDR_PUT_U_INT32(buf, objp->mtime.tv_sec);
+			IXDR_PUT_U_INT32(buf, objp->mtime.tv_nsec);
+			IXDR_PUT_U_INT32(buf, objp->ctime.tv_sec);
+			IXDR_PUT_U_INT32(buf, objp->ctime.tv_nsec);
+			return (true);
+		}
+	} else if (xdrs->x_op == XDR_DECODE) {
+		buf = XDR_INLINE(xdrs, FATTR3_UNITS * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			objp->type = (ftype3) IXDR_GET_U_INT32(buf);
+			objp->mode = IXDR_GET_U_INT32(buf);
+			objp->nlink = IXDR_GET_U_INT32(buf);
+			objp->uid = IXDR_GET_U_INT32(buf);
+			objp->gid = IXDR_GET_U_INT32(buf);
+			IXDR3_GET_U64(buf, objp->size);
+			IXDR3_GET_U64(buf, objp->used);
+			objp->rdev.specdata1 = IXDR_GET_U_INT32(buf);
+			objp->rdev.specdata2 = IXDR_GET_U_INT32(buf);
+			IXDR3_GET_U64(buf, objp->fsid);
+			IXDR3_GET_U64(buf, objp->fileid);
+			objp->atime.tv_sec = IXDR_GET_U_INT32(buf);
+			objp->atime.tv_nsec = IXDR_GET_U_INT32(buf);
+			objp->mtime.tv_sec = IXDR_GET_U_INT32(buf);
+			objp->mtime.tv_nsec = IXDR_GET_U_INT32(buf);
+			objp->ctime.tv_sec = IXDR_GET_U_INT32(buf);
+			objp->ctime.tv_nsec = IXDR_GET_U_INT32(buf);
+			return (true);
+		}
+	}
 
 	if (!xdr_ftype3(xdrs, &objp->type))
 		return (false);
@@ -834,14 +940,9 @@ bool xdr_GETATTR3args(xdrs, objp)
 register XDR *xdrs;
 GETATTR3args *objp;
 {
+	int32_t *buf;
 
-#if defined(_LP64) || defined(_KERNEL)
-	register int __attribute__ ((__unused__)) * buf;
-#else
-	register long __attribute__ ((__unused__)) * buf;
-#endif
-
-	if (!xdr_nfs_fh3(xdrs, &objp->object))
+	if (!xdr_nfs_fh3_fixed(xdrs, &objp->object, 0, &buf))
 		return (false);
 	return (true);
 }
@@ -995,14 +1096,11 @@ bool xdr_LOOKUP3args(xdrs, objp)
 register XDR *xdrs;
 LOOKUP3args *objp;
 {
+	int32_t *buf;
 
-#if defined(_LP64) || defined(_KERNEL)
-	register int __attribute__ ((__unused__)) * buf;
-#else
-	register long __attribute__ ((__unused__)) * buf;
-#endif
-
-	if (!xdr_diropargs3(xdrs, &objp->what))
+	if (!xdr_nfs_fh3_fixed(xdrs, &objp->what.dir, 0, &buf))
+		return (false);
+	if (!xdr_filename3(xdrs, &objp->what.name))
 		return (false);
 	return (true);
 }
@@ -1073,15 +1171,14 @@ bool xdr_ACCESS3args(xdrs, objp)
 register XDR *xdrs;
 ACCESS3args *objp;
 {
+	int32_t *buf;
 
-#if defined(_LP64) || defined(_KERNEL)
-	register int __attribute__ ((__unused__)) * buf;
-#else
-	register long __attribute__ ((__unused__)) * buf;
-#endif
-
-	if (!xdr_nfs_fh3(xdrs, &objp->object))
+	if (!xdr_nfs_fh3_fixed(xdrs, &objp->object, BYTES_PER_XDR_UNIT, &buf))
 		return (false);
+	if (buf != NULL) {
+		objp->access = IXDR_GET_U_INT32(buf);
+		return (true);
+	}
 	if (!xdr_nfs3_uint32(xdrs, &objp->access))
 		return (false);
 	return (true);
@@ -1227,21 +1324,23 @@ bool xdr_READ3args(xdrs, objp)
 register XDR *xdrs;
 READ3args *objp;
 {
-#if defined(_LP64) || defined(_KERNEL)
-	register int __attribute__ ((__unused__)) * buf;
-#else
-	register long __attribute__ ((__unused__)) * buf;
-#endif
+	int32_t *buf;
 	struct nfs_request_lookahead *lkhd =
 	    xdrs->x_public ? (struct nfs_request_lookahead *)xdrs->
 	    x_public : &dummy_lookahead;
 
-	if (!xdr_nfs_fh3(xdrs, &objp->file))
-		return (false);
-	if (!xdr_offset3(xdrs, &objp->offset))
-		return (false);
-	if (!xdr_count3(xdrs, &objp->count))
+	if (!xdr_nfs_fh3_fixed(xdrs, &objp->file, 3 * BYTES_PER_XDR_UNIT,
+			       &buf))
 		return (false);
+	if (buf != NULL) {
+		IXDR3_GET_U64(buf, objp->offset);
+		objp->count = IXDR_GET_U_INT32(buf);
+	} else {
+		if (!xdr_offset3(xdrs, &objp->offset))
+			return (false);
+		if (!xdr_count3(xdrs, &objp->count))
+			return (false);
+	}
 	lkhd->flags = NFS_LOOKAHEAD_READ;
 	(lkhd->read)++;
 	return (true);
@@ -1264,7 +1363,7 @@ READ3resok *objp;
 		return (false);
 	if (!xdr_bool(xdrs, &objp->eof))
 		return (false);
-	if (!xdr_bytes
+	if (!xdr_iobuf_payload
 	    (xdrs, (char **)&objp->data.data_val,
 	     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
 		return (false);
@@ -1333,24 +1432,27 @@ bool xdr_WRITE3args(xdrs, objp)
 register XDR *xdrs;
 WRITE3args *objp;
 {
-#if defined(_LP64) || defined(_KERNEL)
-	register int __attribute__ ((__unused__)) * buf;
-#else
-	register long __attribute__ ((__unused__)) * buf;
-#endif
+	int32_t *buf;
 	struct nfs_request_lookahead *lkhd =
 	    xdrs->x_public ? (struct nfs_request_lookahead *)xdrs->
 	    x_public : &dummy_lookahead;
 
-	if (!xdr_nfs_fh3(xdrs, &objp->file))
+	if (!xdr_nfs_fh3_fixed(xdrs, &objp->file, 4 * BYTES_PER_XDR_UNIT,
+			       &buf))
 		return (false);
-	if (!xdr_offset3(xdrs, &objp->offset))
-		return (false);
-	if (!xdr_count3(xdrs, &objp->count))
-		return (false);
-	if (!xdr_stable_how(xdrs, &objp->stable))
-		return (false);
-	if (!xdr_bytes
+	if (buf != NULL) {
+		IXDR3_GET_U64(buf, objp->offset);
+		objp->count = IXDR_GET_U_INT32(buf);
+		objp->stable = (stable_how) IXDR_GET_U_INT32(buf);
+	} else {
+		if (!xdr_offset3(xdrs, &objp->offset))
+			return (false);
+		if (!xdr_count3(xdrs, &objp->count))
+			return (false);
+		if (!xdr_stable_how(xdrs, &objp->stable))
+			return (false);
+	}
+	if (!xdr_iobuf_bytes
 	    (xdrs, (char **)&objp->data.data_val,
 	     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
 		return (false);
@@ -2307,25 +2409,30 @@ bool xdr_READDIRPLUS3args(xdrs, objp)
 register XDR *xdrs;
 READDIRPLUS3args *objp;
 {
-#if defined(_LP64) || defined(_KERNEL)
-	register int __attribute__ ((__unused__)) * buf;
-#else
-	register long __attribute__ ((__unused__)) * buf;
-#endif
+	int32_t *buf;
 	struct nfs_request_lookahead *lkhd =
 	    xdrs->x_public ? (struct nfs_request_lookahead *)xdrs->
 	    x_public : &dummy_lookahead;
 
-	if (!xdr_nfs_fh3(xdrs, &objp->dir))
-		return (false);
-	if (!xdr_cookie3(xdrs, &objp->cookie))
-		return (false);
-	if (!xdr_cookieverf3(xdrs, objp->cookieverf))
-		return (false);
-	if (!xdr_count3(xdrs, &objp->dircount))
-		return (false);
-	if (!xdr_count3(xdrs, &objp->maxcount))
-		return (false);
+	if (!xdr_nfs_fh3_fixed(xdrs, &objp->dir, 6 * BYTES_PER_XDR_UNIT,
+			       &buf))
+		return (false);
+	if (buf != NULL) {
+		IXDR3_GET_U64(buf, objp->cookie);
+		memcpy(objp->cookieverf, buf, NFS3_COOKIEVERFSIZE);
+		buf += NFS3_COOKIEVERFSIZE / BYTES_PER_XDR_UNIT;
+		objp->dircount = IXDR_GET_U_INT32(buf);
+		objp->maxcount = IXDR_GET_U_INT32(buf);
+	} else {
+		if (!xdr_cookie3(xdrs, &objp->cookie))
+			return (false);
+		if (!xdr_cookieverf3(xdrs, objp->cookieverf))
+			return (false);
+		if (!xdr_count3(xdrs, &objp->dircount))
+			return (false);
+		if (!xdr_count3(xdrs, &objp->maxcount))
+			return (false);
+	}
 	lkhd->flags |= NFS_LOOKAHEAD_READDIR;
 	return (true);
 }
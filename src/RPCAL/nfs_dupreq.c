@@ -49,6 +49,9 @@
 #include "abstract_mem.h"
 #include "gsh_intrinsic.h"
 #include "wait_queue.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
+#include "mem_pressure.h"
 
 #define DUPREQ_BAD_ADDR1 0x01	/* safe for marked pointers, etc */
 #define DUPREQ_NOCACHE   0x02
@@ -93,7 +96,7 @@ const char *dupreq_state_table[] = {
  * ref count goes up again. At the same time, the drc will be removed
  * from the recycle queue. Only drc's with ref count zero end up in the
  * recycle queue. If a reconnection doesn't happen in time, the drc gets
- * freed by drc_free_expired() after some period of inactivety.
+ * freed by drc_retire_expired() after some period of inactivety.
  *
  * Most ref count methods assume that a ref count doesn't go up from
  * zero, so a thread that decrements the ref count to zero would be the
@@ -104,19 +107,52 @@ const char *dupreq_state_table[] = {
  * the current implementation. If we let nfs_dupreq_get_drc() reuse the
  * drc before it gets into recycle queue, we could end up with multiple
  * threads that decrement the ref count to zero.
+ *
+ * The recycle tree is partitioned by address hash, and each partition
+ * has its own recycle queue under the partition's mutex, so connection
+ * setup and teardown only contend within a partition.  Expired DRCs are
+ * retired in batches by the DRC_recycle thread rather than on the
+ * connection path.
  */
+struct drc_recycle_q {
+	TAILQ_HEAD(drc_recycle_tailq, drc) q;	/* fifo */
+	int32_t qlen;
+};
+
 struct drc_st {
-	pthread_mutex_t mtx;
-	drc_t udp_drc;		/* shared DRC */
+	drc_t *udp_drc;		/* shared DRCs, one per UDP socket */
+	uint32_t n_udp_drc;
 	struct rbtree_x tcp_drc_recycle_t;
-	 TAILQ_HEAD(drc_st_tailq, drc) tcp_drc_recycle_q;	/* fifo */
-	int32_t tcp_drc_recycle_qlen;
-	time_t last_expire_check;
+	struct drc_recycle_q *tcp_drc_recycle_q;	/* one per partition */
 	uint32_t expire_delta;
 };
 
 static struct drc_st *drc_st;
 
+/**
+ * @brief Thread retiring expired TCP DRCs
+ */
+static struct fridgethr *drc_recycle_fridge;
+
+/**
+ * @brief Longest pause between two recycle queue scans, in seconds
+ */
+#define DRC_RECYCLE_MAX_DELAY 60
+
+static struct dupreq_stats dupreq_stats;
+
+/**
+ * @brief Recycle queue of a recycle tree partition
+ *
+ * @param[in] t The partition
+ *
+ * @return The partition's queue.
+ */
+static inline struct drc_recycle_q *drc_recycle_q_of(struct rbtree_x_part *t)
+{
+	return &drc_st->tcp_drc_recycle_q[t - drc_st->tcp_drc_recycle_t.tree];
+}
+
 /**
  * @brief Comparison function for duplicate request entries.
  *
@@ -246,10 +282,11 @@ static inline int drc_recycle_cmpf(const struct opr_rbtree_node *lhs,
 
 /**
  * @brief Initialize a shared duplicate request cache
+ *
+ * @param[in] drc The DRC
  */
-static inline void init_shared_drc(void)
+static inline void init_shared_drc(drc_t *drc)
 {
-	drc_t *drc = &drc_st->udp_drc;
 	int ix, code __attribute__ ((unused)) = 0;
 
 	drc->type = DRC_UDP_V234;
@@ -282,25 +319,29 @@ static inline void init_shared_drc(void)
 	}
 }
 
+static void drc_retire_expired(struct fridgethr_context *ctx);
+
 /**
  * @brief Initialize the DRC package.
  */
 void dupreq2_pkginit(void)
 {
+	struct fridgethr_params frp;
 	int code __attribute__ ((unused)) = 0;
+	uint32_t ix;
 
 	dupreq_pool =
-	    pool_basic_init("Duplicate Request Pool", sizeof(dupreq_entry_t));
+	    pool_arena_init("Duplicate Request Pool", sizeof(dupreq_entry_t),
+			    MEM_ARENA_RPC);
 
-	nfs_res_pool = pool_basic_init("nfs_res_t pool", sizeof(nfs_res_t));
+	nfs_res_pool = pool_arena_init("nfs_res_t pool", sizeof(nfs_res_t),
+				       MEM_ARENA_RPC);
 
-	tcp_drc_pool = pool_basic_init("TCP DRC Pool", sizeof(drc_t));
+	tcp_drc_pool = pool_arena_init("TCP DRC Pool", sizeof(drc_t),
+				       MEM_ARENA_RPC);
 
 	drc_st = gsh_calloc(1, sizeof(struct drc_st));
 
-	/* init shared statics */
-	gsh_mutex_init(&drc_st->mtx, NULL);
-
 	/* recycle_t */
 	code =
 	    rbtx_init(&drc_st->tcp_drc_recycle_t, drc_recycle_cmpf,
@@ -308,14 +349,44 @@ void dupreq2_pkginit(void)
 		      RBT_X_FLAG_ALLOC);
 	/* XXX error? */
 
-	/* init recycle_q */
-	TAILQ_INIT(&drc_st->tcp_drc_recycle_q);
-	drc_st->tcp_drc_recycle_qlen = 0;
-	drc_st->last_expire_check = time(NULL);
+	/* init recycle_q, one per partition */
+	drc_st->tcp_drc_recycle_q =
+	    gsh_calloc(drc_st->tcp_drc_recycle_t.npart,
+		       sizeof(struct drc_recycle_q));
+	for (ix = 0; ix < drc_st->tcp_drc_recycle_t.npart; ++ix)
+		TAILQ_INIT(&drc_st->tcp_drc_recycle_q[ix].q);
 	drc_st->expire_delta = nfs_param.core_param.drc.tcp.recycle_expire_s;
 
-	/* UDP DRC is global, shared */
-	init_shared_drc();
+	/* UDP DRCs are shared, one per UDP socket */
+	drc_st->n_udp_drc = nfs_param.core_param.rpc.udp_sockets;
+	drc_st->udp_drc = gsh_calloc(drc_st->n_udp_drc, sizeof(drc_t));
+	for (ix = 0; ix < drc_st->n_udp_drc; ++ix)
+		init_shared_drc(&drc_st->udp_drc[ix]);
+
+	mem_pressure_register(&drc_shrinker);
+
+	/* background retirement of expired TCP DRCs */
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = drc_st->expire_delta / 4;
+	if (frp.thread_delay < 1)
+		frp.thread_delay = 1;
+	if (frp.thread_delay > DRC_RECYCLE_MAX_DELAY)
+		frp.thread_delay = DRC_RECYCLE_MAX_DELAY;
+	frp.flavor = fridgethr_flavor_looper;
+
+	code = fridgethr_init(&drc_recycle_fridge, "DRC_recycle", &frp);
+	if (code != 0) {
+		LogMajor(COMPONENT_DUPREQ,
+			 "Unable to initialize DRC recycle fridge: %d", code);
+		return;
+	}
+
+	code = fridgethr_submit(drc_recycle_fridge, drc_retire_expired, NULL);
+	if (code != 0)
+		LogMajor(COMPONENT_DUPREQ,
+			 "Unable to start DRC recycle thread: %d", code);
 }
 
 /**
@@ -451,74 +522,68 @@ static inline uint32_t nfs_dupreq_unref_drc(drc_t *drc)
 	return --(drc->refcnt); /* locked */
 }
 
-#define DRC_ST_LOCK()				\
-	PTHREAD_MUTEX_lock(&drc_st->mtx)
-
-#define DRC_ST_UNLOCK()				\
-	PTHREAD_MUTEX_unlock(&drc_st->mtx)
-
 /**
- * @brief Check for expired TCP DRCs.
+ * @brief Retire expired TCP DRCs
+ *
+ * Each partition's queue is in recycle order, so the expired DRCs are
+ * at its head.  They are unhashed in one pass under the partition lock
+ * and freed once it is dropped.
+ *
+ * @param[in] ctx Fridge context, unused
  */
-static inline void drc_free_expired(void)
+static void drc_retire_expired(struct fridgethr_context *ctx)
 {
-	drc_t *drc;
-	time_t now = time(NULL);
+	struct drc_recycle_tailq batch;
 	struct rbtree_x_part *t;
-	struct opr_rbtree_node *odrc = NULL;
+	struct drc_recycle_q *rq;
+	time_t now = time(NULL);
+	uint64_t retired = 0;
+	uint32_t ix;
+	drc_t *drc;
+
+	TAILQ_INIT(&batch);
 
-	DRC_ST_LOCK();
+	for (ix = 0; ix < drc_st->tcp_drc_recycle_t.npart; ++ix) {
+		t = &drc_st->tcp_drc_recycle_t.tree[ix];
+		rq = &drc_st->tcp_drc_recycle_q[ix];
 
-	if ((drc_st->tcp_drc_recycle_qlen < 1) ||
-	    (now - drc_st->last_expire_check) < 600) /* 10m */
-		goto unlock;
+		PTHREAD_MUTEX_lock(&t->mtx);
+		while ((drc = TAILQ_FIRST(&rq->q)) != NULL) {
+			if ((now - drc->d_u.tcp.recycle_time) <=
+			    drc_st->expire_delta)
+				break;
 
-	do {
-		drc = TAILQ_FIRST(&drc_st->tcp_drc_recycle_q);
-		if (drc && (drc->d_u.tcp.recycle_time > 0)
-		    && ((now - drc->d_u.tcp.recycle_time) >
-			drc_st->expire_delta) && (drc->refcnt == 0)) {
 			LogFullDebug(COMPONENT_DUPREQ,
 				     "remove expired drc %p from recycle queue",
 				     drc);
-			t = rbtx_partition_of_scalar(&drc_st->tcp_drc_recycle_t,
-						     drc->d_u.tcp.hk);
+			(void)opr_rbtree_remove(&t->t, &drc->d_u.tcp.recycle_k);
+			TAILQ_REMOVE(&rq->q, drc, d_u.tcp.recycle_q);
+			--(rq->qlen);
 
-			odrc =
-			    opr_rbtree_lookup(&t->t, &drc->d_u.tcp.recycle_k);
-			if (!odrc) {
-				LogCrit(COMPONENT_DUPREQ,
-					"BUG: asked to dequeue DRC not on queue");
-			} else {
-				(void)opr_rbtree_remove(&t->t,
-							&drc->d_u.tcp.
-							recycle_k);
-			}
-			TAILQ_REMOVE(&drc_st->tcp_drc_recycle_q, drc,
-				     d_u.tcp.recycle_q);
-			--(drc_st->tcp_drc_recycle_qlen);
-			/* expect DRC to be reachable from some xprt(s) */
 			PTHREAD_MUTEX_lock(&drc->mtx);
 			drc->flags &= ~DRC_FLAG_RECYCLE;
-			/* but if not, dispose it */
-			if (drc->refcnt == 0) {
-				PTHREAD_MUTEX_unlock(&drc->mtx);
-				free_tcp_drc(drc);
-				continue;
-			}
+			/* expect DRC to be reachable from some xprt(s),
+			 * but if not, dispose it
+			 */
+			if (drc->refcnt == 0)
+				TAILQ_INSERT_TAIL(&batch, drc,
+						  d_u.tcp.recycle_q);
 			PTHREAD_MUTEX_unlock(&drc->mtx);
-		} else {
-			LogFullDebug(COMPONENT_DUPREQ,
-				     "unexpired drc %p in recycle queue expire check (nothing happens)",
-				     drc);
-			drc_st->last_expire_check = now;
-			break;
 		}
+		PTHREAD_MUTEX_unlock(&t->mtx);
 
-	} while (1);
+		while ((drc = TAILQ_FIRST(&batch)) != NULL) {
+			TAILQ_REMOVE(&batch, drc, d_u.tcp.recycle_q);
+			free_tcp_drc(drc);
+			++retired;
+		}
+	}
 
- unlock:
-	DRC_ST_UNLOCK();
+	if (retired != 0) {
+		(void)atomic_add_uint64_t(&dupreq_stats.retired, retired);
+		LogFullDebug(COMPONENT_DUPREQ,
+			     "retired %" PRIu64 " expired TCP DRCs", retired);
+	}
 }
 
 /**
@@ -533,16 +598,20 @@ nfs_dupreq_get_drc(struct svc_req *req)
 {
 	enum drc_type dtype = get_drc_type(req);
 	drc_t *drc = NULL;
-	bool drc_check_expired = false;
 
 	switch (dtype) {
 	case DRC_UDP_V234:
-		LogFullDebug(COMPONENT_DUPREQ, "ref shared UDP DRC");
-		drc = &(drc_st->udp_drc);
-		DRC_ST_LOCK();
+	{
+		/* each UDP socket has its own */
+		gsh_xprt_private_t *xu = req->rq_xprt->xp_u1;
+
+		drc = &drc_st->udp_drc[xu->udp_drc % drc_st->n_udp_drc];
+		LogFullDebug(COMPONENT_DUPREQ, "ref shared UDP DRC=%p", drc);
+		PTHREAD_MUTEX_lock(&drc->mtx);
 		(void)nfs_dupreq_ref_drc(drc);
-		DRC_ST_UNLOCK();
+		PTHREAD_MUTEX_unlock(&drc->mtx);
 		goto out;
+	}
 retry:
 	case DRC_TCP_V4:
 	case DRC_TCP_V3:
@@ -584,7 +653,7 @@ retry:
 
 			t = rbtx_partition_of_scalar(&drc_st->tcp_drc_recycle_t,
 						     drc_k.d_u.tcp.hk);
-			DRC_ST_LOCK();
+			PTHREAD_MUTEX_lock(&t->mtx);	/* partition lock */
 			ndrc =
 			    opr_rbtree_lookup(&t->t, &drc_k.d_u.tcp.recycle_k);
 			if (ndrc) {
@@ -598,15 +667,18 @@ retry:
 				 * other thread to put it in the queue.
 				 */
 				if (tdrc->refcnt == 0) {
+					struct drc_recycle_q *rq =
+							drc_recycle_q_of(t);
+
 					if (!(tdrc->flags & DRC_FLAG_RECYCLE)) {
 						PTHREAD_MUTEX_unlock(
 								&tdrc->mtx);
-						DRC_ST_UNLOCK();
+						PTHREAD_MUTEX_unlock(&t->mtx);
 						goto retry;
 					}
-					TAILQ_REMOVE(&drc_st->tcp_drc_recycle_q,
-						     tdrc, d_u.tcp.recycle_q);
-					--(drc_st->tcp_drc_recycle_qlen);
+					TAILQ_REMOVE(&rq->q, tdrc,
+						     d_u.tcp.recycle_q);
+					--(rq->qlen);
 					tdrc->flags &= ~DRC_FLAG_RECYCLE;
 				}
 				drc = tdrc;
@@ -626,21 +698,17 @@ retry:
 				/* assign already-computed hash */
 				drc->d_u.tcp.hk = drc_k.d_u.tcp.hk;
 				PTHREAD_MUTEX_lock(&drc->mtx);	/* LOCKED */
-				/* xprt ref */
-				drc->refcnt = 1;
+				/* the xprt ref is taken below */
+				drc->refcnt = 0;
 				/* insert dict */
 				opr_rbtree_insert(&t->t,
 						  &drc->d_u.tcp.recycle_k);
 			}
-			DRC_ST_UNLOCK();
+			PTHREAD_MUTEX_unlock(&t->mtx);
 			drc->d_u.tcp.recycle_time = 0;
 
 			(void)nfs_dupreq_ref_drc(drc);	/* xprt ref */
 
-			/* try to expire unused DRCs somewhat in proportion to
-			 * new connection arrivals */
-			drc_check_expired = true;
-
 			LogFullDebug(COMPONENT_DUPREQ,
 				     "after ref drc %p refcnt==%u ", drc,
 				     drc->refcnt);
@@ -662,9 +730,6 @@ retry:
 	(void)nfs_dupreq_ref_drc(drc);
 	PTHREAD_MUTEX_unlock(&drc->mtx);
 
-	if (drc_check_expired)
-		drc_free_expired();
-
 out:
 	return drc;
 }
@@ -681,6 +746,8 @@ out:
  */
 void nfs_dupreq_put_drc(SVCXPRT *xprt, drc_t *drc, uint32_t flags)
 {
+	struct rbtree_x_part *t;
+
 	if (!(flags & DRC_FLAG_LOCKED))
 		PTHREAD_MUTEX_lock(&drc->mtx);
 	/* drc LOCKED */
@@ -704,12 +771,15 @@ void nfs_dupreq_put_drc(SVCXPRT *xprt, drc_t *drc, uint32_t flags)
 		if (drc->refcnt != 0) /* quick path */
 			break;
 
+		t = rbtx_partition_of_scalar(&drc_st->tcp_drc_recycle_t,
+					     drc->d_u.tcp.hk);
+
 		/* note t's lock order wrt drc->mtx is the opposite of
 		 * drc->xt[*].lock. Drop and reacquire locks in correct
 		 * order.
 		 */
 		PTHREAD_MUTEX_unlock(&drc->mtx);
-		DRC_ST_LOCK();
+		PTHREAD_MUTEX_lock(&t->mtx);
 		PTHREAD_MUTEX_lock(&drc->mtx);
 
 		/* Since we dropped and reacquired the drc lock for the
@@ -717,15 +787,16 @@ void nfs_dupreq_put_drc(SVCXPRT *xprt, drc_t *drc, uint32_t flags)
 		 * again!
 		 */
 		if (drc->refcnt == 0 && !(drc->flags & DRC_FLAG_RECYCLE)) {
+			struct drc_recycle_q *rq = drc_recycle_q_of(t);
+
 			drc->d_u.tcp.recycle_time = time(NULL);
 			drc->flags |= DRC_FLAG_RECYCLE;
-			TAILQ_INSERT_TAIL(&drc_st->tcp_drc_recycle_q,
-					  drc, d_u.tcp.recycle_q);
-			++(drc_st->tcp_drc_recycle_qlen);
+			TAILQ_INSERT_TAIL(&rq->q, drc, d_u.tcp.recycle_q);
+			++(rq->qlen);
 			LogFullDebug(COMPONENT_DUPREQ,
 				     "enqueue drc %p for recycle", drc);
 		}
-		DRC_ST_UNLOCK();
+		PTHREAD_MUTEX_unlock(&t->mtx);
 		break;
 
 	default:
@@ -921,6 +992,26 @@ static inline void dupreq_entry_put(dupreq_entry_t *dv)
 			--((drc)->retwnd);	\
 	} while (0)
 
+/* Percent of their high water marks DRCs keep at each memory pressure */
+static const uint32_t drc_pressure_pct[] = {
+	[MEM_PRESSURE_NONE] = 100,
+	[MEM_PRESSURE_LOW] = 100,
+	[MEM_PRESSURE_MEDIUM] = 50,
+	[MEM_PRESSURE_HIGH] = 10,
+};
+
+static uint32_t drc_retain_pct = 100;
+
+static void drc_shrink(enum mem_pressure level)
+{
+	atomic_store_uint32_t(&drc_retain_pct, drc_pressure_pct[level]);
+}
+
+static struct mem_pressure_shrinker drc_shrinker = {
+	.name = "DRC",
+	.shrink = drc_shrink,
+};
+
 /**
  * @brief retire request predicate.
  *
@@ -941,8 +1032,11 @@ static inline bool drc_should_retire(drc_t *drc)
 	if (unlikely(drc->retwnd > 0))
 		return false;
 
-	/* finally, retire if drc->size is above intended high water mark */
-	if (unlikely(drc->size > drc->hiwat))
+	/* finally, retire if drc->size is above intended high water mark,
+	 * lowered under memory pressure
+	 */
+	if (unlikely(drc->size > (uint64_t) drc->hiwat *
+				 atomic_fetch_uint32_t(&drc_retain_pct) / 100))
 		return true;
 
 	return false;
@@ -1060,6 +1154,8 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 			PTHREAD_MUTEX_lock(&dv->mtx);
 			if (unlikely(dv->state == DUPREQ_START)) {
 				status = DUPREQ_BEING_PROCESSED;
+				(void)atomic_inc_uint64_t(
+					&dupreq_stats.in_progress);
 			} else {
 				/* satisfy req from the DRC, incref,
 				   extend window */
@@ -1067,6 +1163,7 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 				reqnfs->res_nfs = req->rq_u2 = dv->res;
 				status = DUPREQ_EXISTS;
 				dupreq_entry_get(dv);
+				(void)atomic_inc_uint64_t(&dupreq_stats.hits);
 			}
 			PTHREAD_MUTEX_unlock(&dv->mtx);
 
@@ -1083,6 +1180,7 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 				 dupreq_state_table[dv->state]);
 		} else {
 			/* new request */
+			(void)atomic_inc_uint64_t(&dupreq_stats.misses);
 			req->rq_u1 = dk;
 			dk->res = alloc_nfs_res();
 			reqnfs->res_nfs = req->rq_u2 = dk->res;
@@ -1359,5 +1457,41 @@ void nfs_dupreq_rele(struct svc_req *req, const nfs_function_desc_t *func)
  */
 void dupreq2_pkgshutdown(void)
 {
-	/* XXX do nothing */
+	int rc;
+
+	mem_pressure_unregister(&drc_shrinker);
+
+	if (drc_recycle_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(drc_recycle_fridge, fridgethr_comm_stop,
+				    120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_DUPREQ,
+			 "Shutdown timed out, cancelling DRC recycle thread.");
+		fridgethr_cancel(drc_recycle_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_DUPREQ,
+			 "Failed shutting down DRC recycle thread: %d", rc);
+	}
+}
+
+/**
+ * @brief Get DRC counters
+ *
+ * @param[out] st Counters
+ */
+void dupreq2_get_stats(struct dupreq_stats *st)
+{
+	uint32_t ix;
+
+	st->hits = atomic_fetch_uint64_t(&dupreq_stats.hits);
+	st->misses = atomic_fetch_uint64_t(&dupreq_stats.misses);
+	st->in_progress = atomic_fetch_uint64_t(&dupreq_stats.in_progress);
+	st->retired = atomic_fetch_uint64_t(&dupreq_stats.retired);
+
+	/* racy, but only a gauge */
+	st->recycle_qlen = 0;
+	for (ix = 0; ix < drc_st->tcp_drc_recycle_t.npart; ++ix)
+		st->recycle_qlen += drc_st->tcp_drc_recycle_q[ix].qlen;
 }
@@ -35,7 +35,10 @@
  */
 
 #include "config.h"
+#include "abstract_atomic.h"
 #include "nfs_core.h"
+#include "nfs_proto_functions.h"
+#include "nfs_rpc_callback.h"
 #include "sal_functions.h"
 
 /**
@@ -55,6 +58,12 @@ hash_table_t *ht_session_id;
 
 uint64_t global_sequence = 0;
 
+/**
+ * @param Forechannel slots held by all sessions, for the slot budget
+ */
+
+static uint64_t nfs41_slots_in_use;
+
 /**
  * @brief Display a session ID
  *
@@ -239,7 +248,7 @@ int32_t inc_session_ref(nfs41_session_t *session)
 
 int32_t dec_session_ref(nfs41_session_t *session)
 {
-	int i;
+	uint32_t i;
 	int32_t refcnt = atomic_dec_int32_t(&session->refcount);
 
 	if (refcnt == 0) {
@@ -252,17 +261,26 @@ int32_t dec_session_ref(nfs41_session_t *session)
 
 		/* Decrement our reference to the clientid record */
 		dec_client_id_ref(session->clientid_record);
-		/* Destroy this session's mutexes and condition variable */
+		/* Destroy this session's mutexes and condition variable,
+		 * and release the replies still cached in its slots.
+		 */
 
-		for (i = 0; i < NFS41_NB_SLOTS; i++)
+		for (i = 0; i < session->nb_slots; i++) {
+			nfs41_Slot_Release_Reply(&session->slots[i]);
 			PTHREAD_MUTEX_destroy(&session->slots[i].lock);
+		}
+		gsh_free(session->slots);
+		(void) atomic_sub_uint64_t(&nfs41_slots_in_use,
+					   session->nb_slots);
 
+		gsh_free(session->cb_slots);
 		PTHREAD_COND_destroy(&session->cb_cond);
 		PTHREAD_MUTEX_destroy(&session->cb_mutex);
 
-		/* Destroy the session's back channel (if any) */
-		if (session->flags & session_bc_up)
-			nfs_rpc_destroy_chan(&session->cb_chan);
+		/* Destroy the session's back channel (if any) and
+		 * release the connections bound to it.
+		 */
+		nfs_rpc_destroy_chan_v41(session);
 
 		/* Free the memory for the session */
 		pool_free(nfs41_session_pool, session);
@@ -271,6 +289,67 @@ int32_t dec_session_ref(nfs41_session_t *session)
 	return refcnt;
 }
 
+/**
+ * @brief Allocate a session's forechannel slot table
+ *
+ * The table is sized once, here, and lives as long as the session:
+ * nfs4_Compound caches replies through pointers into it after the slot
+ * lock is dropped.  Later growing and shrinking is done by moving
+ * sr_target_highest_slotid within it.
+ *
+ * @param[in,out] session   The session being created
+ * @param[in]     requested The client's ca_maxrequests
+ *
+ * @return The number of slots allocated.
+ */
+
+uint32_t nfs41_Session_Alloc_Slots(nfs41_session_t *session,
+				   count4 requested)
+{
+	uint32_t nb_slots = nfs_param.nfsv4_param.max_slots;
+	uint32_t i;
+
+	if (requested < nb_slots)
+		nb_slots = requested;
+	if (nb_slots == 0)
+		nb_slots = 1;
+
+	session->slots = gsh_calloc(nb_slots, sizeof(*session->slots));
+	session->nb_slots = nb_slots;
+
+	for (i = 0; i < nb_slots; i++)
+		PTHREAD_MUTEX_init(&session->slots[i].lock, NULL);
+
+	(void) atomic_add_uint64_t(&nfs41_slots_in_use, nb_slots);
+
+	return nb_slots;
+}
+
+/**
+ * @brief Compute the target highest slot ID for a session
+ *
+ * With no Slot_Table_Budget, or while all sessions together hold no
+ * more slots than the budget, the whole table is offered.  Past it,
+ * every session is asked to scale down by the same ratio, so clients
+ * converge on the budget and grow back as other sessions go away.
+ *
+ * @param[in] session The session
+ *
+ * @return Value for sr_target_highest_slotid.
+ */
+
+slotid4 nfs41_Session_Target_Slotid(nfs41_session_t *session)
+{
+	uint64_t budget = nfs_param.nfsv4_param.slot_table_budget;
+	uint64_t in_use = atomic_fetch_uint64_t(&nfs41_slots_in_use);
+	uint64_t target = session->nb_slots;
+
+	if (budget != 0 && in_use > budget)
+		target = target * budget / in_use;
+
+	return target > 1 ? target - 1 : 0;
+}
+
 /**
  * @brief Set a session into the session hashtable.
  *
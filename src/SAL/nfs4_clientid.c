@@ -49,6 +49,7 @@
 #include "abstract_atomic.h"
 #include "city.h"
 #include "client_mgr.h"
+#include "nfs_proto_functions.h"
 
 /**
  * @brief Hashtable used to cache NFSv4 clientids
@@ -346,6 +347,7 @@ void free_client_id(nfs_client_id_t *clientid)
 	}
 
 	PTHREAD_MUTEX_destroy(&clientid->cid_mutex);
+	PTHREAD_MUTEX_destroy(&clientid->cid_cb_batch_mtx);
 	PTHREAD_MUTEX_destroy(&clientid->cid_owner.so_mutex);
 	if (clientid->cid_minorversion == 0)
 		PTHREAD_MUTEX_destroy(&clientid->cid_cb.v40.cb_chan.mtx);
@@ -532,6 +534,9 @@ nfs_client_id_t *create_client_id(clientid4 clientid,
 	state_owner_t *owner;
 
 	PTHREAD_MUTEX_init(&client_rec->cid_mutex, NULL);
+	PTHREAD_MUTEX_init(&client_rec->cid_cb_batch_mtx, NULL);
+	glist_init(&client_rec->cid_cb_batch);
+	glist_init(&client_rec->cid_copies);
 
 	owner = &client_rec->cid_owner;
 
@@ -635,6 +640,11 @@ clientid_status_t nfs_client_id_insert(nfs_client_id_t *clientid)
 	/* Take a reference to the unconfirmed clientid for the hash table. */
 	(void)inc_client_id_ref(clientid);
 
+	/* Schedule the first lease expiry check */
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	lease_wheel_queue(clientid);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
 	if (isFullDebug(COMPONENT_CLIENTID) &&
 	    isFullDebug(COMPONENT_HASHTABLE)) {
 		LogFullDebug(COMPONENT_CLIENTID,
@@ -881,6 +891,7 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 	char str[LOG_BUFF_LEN];
 	struct display_buffer dspbuf = {sizeof(str), str, str};
 	bool str_valid = false;
+	bool wheel_ref = false;
 	struct root_op_context root_op_context;
 
 	/* Initialize req_ctx */
@@ -934,6 +945,7 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 	} else {
 		/* unhash clientids that are truly expired */
 		clientid->cid_confirmed = EXPIRED_CLIENT_ID;
+		wheel_ref = lease_wheel_cancel(clientid);
 
 		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
 
@@ -958,6 +970,9 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 		}
 	}
 
+	/* Stop the client's copies before its states go away */
+	nfs4_copy_client_expire(clientid);
+
 	/* Traverse the client's lock owners, and release all
 	 * locks and owners.
 	 *
@@ -1100,7 +1115,7 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 	}
 
 	if (clientid->cid_recov_dir != NULL && !make_stale) {
-		nfs4_rm_clid(clientid->cid_recov_dir, v4_recov_dir, 0);
+		nfs4_rm_clid(clientid);
 		gsh_free(clientid->cid_recov_dir);
 		clientid->cid_recov_dir = NULL;
 	}
@@ -1113,6 +1128,10 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 		str_valid = true;
 	}
 
+	/* Release the lease wheel reference unless the reaper has it */
+	if (wheel_ref)
+		(void)dec_client_id_ref(clientid);
+
 	/* Release the hash table reference to the clientid. */
 	if (!make_stale)
 		(void)dec_client_id_ref(clientid);
@@ -1281,6 +1300,15 @@ static hash_parameter_t cr_hash_param = {
  */
 int nfs_Init_client_id(void)
 {
+	uint32_t clients = nfs_param.nfsv4_param.expected_clients;
+
+	/* A partition for every 16 clients */
+	cid_confirmed_hash_param.index_size =
+		hashtable_prime(MAX(PRIME_STATE, clients / 16));
+	cid_unconfirmed_hash_param.index_size =
+		cid_confirmed_hash_param.index_size;
+	cr_hash_param.index_size = cid_confirmed_hash_param.index_size;
+
 	ht_confirmed_client_id =
 		hashtable_init(&cid_confirmed_hash_param);
 
@@ -1308,11 +1336,77 @@ int nfs_Init_client_id(void)
 	}
 
 	client_id_pool =
-	    pool_basic_init("NFS4 Client ID Pool", sizeof(nfs_client_id_t));
+	    pool_arena_init("NFS4 Client ID Pool", sizeof(nfs_client_id_t),
+			    MEM_ARENA_SAL);
+
+	lease_wheel_init();
 
 	return CLIENT_ID_SUCCESS;
 }
 
+/* Seconds a reconnect storm outlasts the last second over the rate */
+#define NFS4_STORM_HOLD 10
+
+static time_t storm_second;	/*< Second storm_count is for */
+static uint32_t storm_count;	/*< Client ids established in it */
+static time_t storm_until;	/*< Last second of the storm */
+
+/**
+ * @brief Count a client establishing its client id
+ *
+ * Called by EXCHANGE_ID and SETCLIENTID.  Once Reconnect_Storm_Rate
+ * of them arrive within a second, as after a network outage, the
+ * server is in a reconnect storm until NFS4_STORM_HOLD seconds after
+ * the last such second.  The count is approximate, a second's first
+ * callers may race to restart it.
+ */
+void nfs4_storm_count(void)
+{
+	uint32_t rate = nfs_param.nfsv4_param.reconnect_storm_rate;
+	time_t now;
+
+	if (rate == 0)
+		return;
+
+	now = time(NULL);
+	if (atomic_fetch_time_t(&storm_second) != now) {
+		atomic_store_time_t(&storm_second, now);
+		atomic_store_uint32_t(&storm_count, 0);
+	}
+
+	if (atomic_inc_uint32_t(&storm_count) != rate)
+		return;
+
+	if (atomic_fetch_time_t(&storm_until) < now)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Reconnect storm, %" PRIu32
+			 " clients in a second, callback probes postponed",
+			 rate);
+
+	atomic_store_time_t(&storm_until, now + NFS4_STORM_HOLD);
+}
+
+/**
+ * @brief How long to put off a client's callback probe
+ *
+ * In a reconnect storm the probes are spread over half a lease, by
+ * client id, so they do not compete with the clients' own requests.
+ *
+ * @param[in] clientid Client id
+ *
+ * @return Nanoseconds, 0 outside a storm.
+ */
+nsecs_elapsed_t nfs4_storm_delay(clientid4 clientid)
+{
+	uint32_t spread = nfs_param.nfsv4_param.lease_lifetime * 500;
+
+	if (spread == 0 || atomic_fetch_time_t(&storm_until) < time(NULL))
+		return 0;
+
+	return (((uint32_t) clientid * 2654435761U) % spread + 1)
+		* NS_PER_MSEC;
+}
+
 int display_clientid(struct display_buffer *dspbuf, clientid4 clientid)
 {
 	int b_left = display_buffer_remain(dspbuf);
@@ -1790,4 +1884,48 @@ nfs41_foreach_client_callback(bool(*cb) (nfs_client_id_t *cl, void *state),
 	}
 }
 
+/**
+ * @brief Sum the state held by the confirmed clientids of a client
+ *
+ * @param[in]  client Client host
+ * @param[out] counts The totals
+ */
+void nfs_client_id_state_counts(struct gsh_client *client,
+				struct nfs_client_state_counts *counts)
+{
+	uint32_t i;
+	hash_table_t *ht = ht_confirmed_client_id;
+	struct rbt_head *head_rbt;
+	struct hash_data *pdata;
+	struct rbt_node *pn;
+	nfs_client_id_t *pclientid;
+
+	memset(counts, 0, sizeof(*counts));
+
+	for (i = 0; i < ht->parameter.index_size; i++) {
+		head_rbt = &(ht->partitions[i].rbt);
+
+		PTHREAD_RWLOCK_rdlock(&(ht->partitions[i].lock));
+
+		RBT_LOOP(head_rbt, pn) {
+			pdata = RBT_OPAQ(pn);
+			pclientid = pdata->val.addr;
+			RBT_INCREMENT(pn);
+
+			if (pclientid->gsh_client != client)
+				continue;
+
+			counts->clientids++;
+			counts->open_owners += atomic_fetch_int32_t(
+				&pclientid->cid_open_owners);
+			counts->lock_owners += atomic_fetch_int32_t(
+				&pclientid->cid_lock_owners);
+			counts->states += atomic_fetch_int32_t(
+				&pclientid->cid_states);
+		}
+
+		PTHREAD_RWLOCK_unlock(&(ht->partitions[i].lock));
+	}
+}
+
 /** @} */
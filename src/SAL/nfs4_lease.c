@@ -43,25 +43,32 @@
 /**
  * @brief Return the lifetime of a valid lease
  *
+ * Reservations and the renewal time are read atomically, so no lock is
+ * needed.  update_lease stores the renewal time before it drops its
+ * reservation, so once no reservations are seen the renewal time is
+ * current.  A lease that ran out with no reservations can only be
+ * revived by CREATE_SESSION; nothing else can reserve it again.
+ *
  * @param[in] clientid The client record to check
  *
  * @return The lease lifetime or 0 if expired.
  */
 static unsigned int _valid_lease(nfs_client_id_t *clientid)
 {
-	time_t t;
+	time_t t, expire;
 
 	if (clientid->cid_confirmed == EXPIRED_CLIENT_ID)
 		return 0;
 
-	if (clientid->cid_lease_reservations != 0)
+	if (atomic_fetch_int32_t(&clientid->cid_lease_reservations) != 0)
 		return nfs_param.nfsv4_param.lease_lifetime;
 
 	t = time(NULL);
+	expire = atomic_fetch_time_t(&clientid->cid_last_renew) +
+		 nfs_param.nfsv4_param.lease_lifetime;
 
-	if (clientid->cid_last_renew + nfs_param.nfsv4_param.lease_lifetime > t)
-		return (clientid->cid_last_renew +
-			nfs_param.nfsv4_param.lease_lifetime) - t;
+	if (expire > t)
+		return expire - t;
 
 	return 0;
 }
@@ -69,7 +76,8 @@ static unsigned int _valid_lease(nfs_client_id_t *clientid)
 /**
  * @brief Check if lease is valid
  *
- * The caller must hold cid_mutex.
+ * The caller need not hold cid_mutex, but must hold it if the answer
+ * is used to expire the client.
  *
  * @param[in] clientid Record to check lease for.
  *
@@ -96,10 +104,11 @@ bool valid_lease(nfs_client_id_t *clientid)
 }
 
 /**
- * @brief Check if lease is valid and reserve it and retain cid_mutex.
+ * @brief Check if lease is valid and reserve it
  *
  * Lease reservation prevents any other thread from expiring the lease. Caller
- * must call update lease to release the reservation.
+ * must call update lease to release the reservation.  No lock is taken;
+ * the reservation count is bumped only if the lease is still valid.
  *
  * @param[in] clientid Client record to check lease for
  *
@@ -109,11 +118,14 @@ bool valid_lease(nfs_client_id_t *clientid)
 int reserve_lease(nfs_client_id_t *clientid)
 {
 	unsigned int valid;
+	int32_t cur;
 
-	valid = _valid_lease(clientid);
-
-	if (valid != 0)
-		clientid->cid_lease_reservations++;
+	do {
+		cur = atomic_fetch_int32_t(&clientid->cid_lease_reservations);
+		valid = _valid_lease(clientid);
+	} while (valid != 0 &&
+		 !atomic_cas_int32_t(&clientid->cid_lease_reservations,
+				     cur, cur + 1));
 
 	if (isFullDebug(COMPONENT_CLIENTID)) {
 		char str[LOG_BUFF_LEN];
@@ -132,21 +144,22 @@ int reserve_lease(nfs_client_id_t *clientid)
  * @brief Release a lease reservation and update lease.
  *
  * Lease reservation prevents any other thread from expiring the lease. This
- * function releases the lease reservation. Before releasing the last
- * reservation, cid_last_renew will be updated.
+ * function releases the lease reservation and renews the lease.  Only
+ * releasing the last reservation takes cid_mutex, to make sure the
+ * clientid is on the lease wheel, so the caller must not hold it.
  *
  * @param[in] clientid Clientid record to update
- *
- * @return 1 if lease is valid, 0 if not.
- *
  */
 void update_lease(nfs_client_id_t *clientid)
 {
-	clientid->cid_lease_reservations--;
+	/* Renew before releasing, see _valid_lease */
+	atomic_store_time_t(&clientid->cid_last_renew, time(NULL));
 
-	/* Renew lease when last reservation is released */
-	if (clientid->cid_lease_reservations == 0)
-		clientid->cid_last_renew = time(NULL);
+	if (atomic_dec_int32_t(&clientid->cid_lease_reservations) == 0) {
+		PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+		lease_wheel_queue(clientid);
+		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+	}
 
 	if (isFullDebug(COMPONENT_CLIENTID)) {
 		char str[LOG_BUFF_LEN];
@@ -157,4 +170,182 @@ void update_lease(nfs_client_id_t *clientid)
 	}
 }
 
+/**
+ * @brief Lease expiry wheel
+ *
+ * Each live clientid sits in the slot for the second its lease is
+ * due to expire, so the reaper only looks at clients that may have
+ * expired instead of walking both clientid hash tables.  A lease
+ * lasts at most 120 seconds, well within one turn of the wheel.
+ *
+ * Renewals do not move a clientid: when its slot comes due the reaper
+ * checks the lease again and files it under the new expiry if it was
+ * renewed.  While filed, or while the reaper is looking at it, the
+ * wheel holds a clientid reference and cid_lease_queued is set.
+ *
+ * Lock order is cid_mutex, then lease_wheel_mtx.
+ */
+
+#define LEASE_WHEEL_SLOTS 256
+
+static struct glist_head lease_wheel[LEASE_WHEEL_SLOTS];
+static struct glist_head lease_wheel_due;	/*< Popped, not yet visited */
+static time_t lease_wheel_next;	/*< First second not yet moved to due */
+static pthread_mutex_t lease_wheel_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+void lease_wheel_init(void)
+{
+	int i;
+
+	for (i = 0; i < LEASE_WHEEL_SLOTS; i++)
+		glist_init(&lease_wheel[i]);
+
+	glist_init(&lease_wheel_due);
+	lease_wheel_next = time(NULL);
+}
+
+/**
+ * @brief Time at which a lease is due to expire
+ */
+static time_t lease_expiry(nfs_client_id_t *clientid)
+{
+	if (atomic_fetch_int32_t(&clientid->cid_lease_reservations) != 0)
+		return time(NULL) + nfs_param.nfsv4_param.lease_lifetime;
+
+	return atomic_fetch_time_t(&clientid->cid_last_renew) +
+	       nfs_param.nfsv4_param.lease_lifetime;
+}
+
+/**
+ * @brief File a clientid in its slot, lease_wheel_mtx held
+ */
+static void lease_wheel_file(nfs_client_id_t *clientid, time_t expire)
+{
+	if (expire < lease_wheel_next)
+		expire = lease_wheel_next;
+
+	glist_add_tail(&lease_wheel[(uint64_t) expire % LEASE_WHEEL_SLOTS],
+		       &clientid->cid_lease_link);
+}
+
+/**
+ * @brief Put a clientid on the lease wheel if it is not already there
+ *
+ * The caller must hold cid_mutex.
+ *
+ * @param[in] clientid Client record
+ */
+void lease_wheel_queue(nfs_client_id_t *clientid)
+{
+	if (clientid->cid_lease_queued ||
+	    clientid->cid_confirmed == EXPIRED_CLIENT_ID)
+		return;
+
+	(void)inc_client_id_ref(clientid);
+
+	PTHREAD_MUTEX_lock(&lease_wheel_mtx);
+	clientid->cid_lease_queued = true;
+	lease_wheel_file(clientid, lease_expiry(clientid));
+	PTHREAD_MUTEX_unlock(&lease_wheel_mtx);
+}
+
+/**
+ * @brief Refile a clientid returned by lease_wheel_next_due
+ *
+ * The caller must hold cid_mutex.  If the lease is still valid the
+ * clientid goes back on the wheel, otherwise the wheel reference
+ * passes to the caller.
+ *
+ * @param[in] clientid Client record
+ *
+ * @return true if the lease is valid and the clientid was refiled.
+ */
+bool lease_wheel_requeue(nfs_client_id_t *clientid)
+{
+	bool valid = valid_lease(clientid);
+
+	PTHREAD_MUTEX_lock(&lease_wheel_mtx);
+
+	if (valid)
+		lease_wheel_file(clientid, lease_expiry(clientid));
+	else
+		clientid->cid_lease_queued = false;
+
+	PTHREAD_MUTEX_unlock(&lease_wheel_mtx);
+
+	return valid;
+}
+
+/**
+ * @brief Take an expired clientid off the lease wheel
+ *
+ * The caller must hold cid_mutex and a reference of its own.  A
+ * clientid the reaper is looking at stays with the reaper.
+ *
+ * @param[in] clientid Client record
+ *
+ * @return true if the caller now owns the wheel reference.
+ */
+bool lease_wheel_cancel(nfs_client_id_t *clientid)
+{
+	bool dropped = false;
+
+	PTHREAD_MUTEX_lock(&lease_wheel_mtx);
+
+	if (clientid->cid_lease_queued &&
+	    !glist_null(&clientid->cid_lease_link)) {
+		glist_del(&clientid->cid_lease_link);
+		clientid->cid_lease_queued = false;
+		dropped = true;
+	}
+
+	PTHREAD_MUTEX_unlock(&lease_wheel_mtx);
+
+	return dropped;
+}
+
+/**
+ * @brief Pop the next clientid due for a lease check
+ *
+ * The returned clientid keeps the wheel reference and must be passed
+ * to lease_wheel_requeue.
+ *
+ * @param[in] now Current time
+ *
+ * @return A clientid or NULL if none are due.
+ */
+nfs_client_id_t *lease_wheel_next_due(time_t now)
+{
+	nfs_client_id_t *clientid;
+	int i;
+
+	PTHREAD_MUTEX_lock(&lease_wheel_mtx);
+
+	while (glist_empty(&lease_wheel_due) && lease_wheel_next <= now) {
+		if (now - lease_wheel_next >= LEASE_WHEEL_SLOTS) {
+			/* The clock jumped a full turn, everything is due */
+			for (i = 0; i < LEASE_WHEEL_SLOTS; i++)
+				glist_splice_tail(&lease_wheel_due,
+						  &lease_wheel[i]);
+			lease_wheel_next = now + 1;
+			break;
+		}
+
+		glist_splice_tail(&lease_wheel_due,
+				  &lease_wheel[(uint64_t) lease_wheel_next %
+					       LEASE_WHEEL_SLOTS]);
+		lease_wheel_next++;
+	}
+
+	clientid = glist_first_entry(&lease_wheel_due, nfs_client_id_t,
+				     cid_lease_link);
+
+	if (clientid != NULL)
+		glist_del(&clientid->cid_lease_link);
+
+	PTHREAD_MUTEX_unlock(&lease_wheel_mtx);
+
+	return clientid;
+}
+
 /** @} */
@@ -323,6 +323,13 @@ uint64_t nfs4_owner_rbt_hash_func(hash_parameter_t *hparam,
 
 void free_nfs4_owner(state_owner_t *owner)
 {
+	nfs_client_id_t *clientid = owner->so_owner.so_nfs4_owner.so_clientrec;
+
+	if (owner->so_type == STATE_OPEN_OWNER_NFSV4)
+		(void) atomic_dec_int32_t(&clientid->cid_open_owners);
+	else if (owner->so_type == STATE_LOCK_OWNER_NFSV4)
+		(void) atomic_dec_int32_t(&clientid->cid_lock_owners);
+
 	if (owner->so_owner.so_nfs4_owner.so_related_owner != NULL)
 		dec_state_owner_ref(owner->so_owner.so_nfs4_owner.
 				    so_related_owner);
@@ -349,7 +356,7 @@ static hash_parameter_t nfs4_owner_param = {
 	.compare_key = compare_nfs4_owner_key,
 	.key_to_str = display_nfs4_owner_key,
 	.val_to_str = display_nfs4_owner_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_OPEN,
 };
 
 /**
@@ -370,6 +377,15 @@ int Init_nfs4_owner(void)
 	return 0;
 }				/* nfs4_Init_nfs4_owner */
 
+/**
+ * @brief Number of open and lock owners a client holds
+ */
+static inline uint32_t nfs4_owner_count(nfs_client_id_t *clientid)
+{
+	return atomic_fetch_int32_t(&clientid->cid_open_owners) +
+	       atomic_fetch_int32_t(&clientid->cid_lock_owners);
+}
+
 /**
  * @brief Initialize an NFS4 open owner object
  *
@@ -378,6 +394,21 @@ int Init_nfs4_owner(void)
  */
 static void init_nfs4_owner(state_owner_t *owner)
 {
+	nfs_client_id_t *clientid = owner->so_owner.so_nfs4_owner.so_clientrec;
+
+	if (owner->so_type == STATE_OPEN_OWNER_NFSV4)
+		(void) atomic_inc_int32_t(&clientid->cid_open_owners);
+	else if (owner->so_type == STATE_LOCK_OWNER_NFSV4)
+		(void) atomic_inc_int32_t(&clientid->cid_lock_owners);
+
+	if (nfs4_owner_count(clientid) ==
+	    nfs_param.nfsv4_param.client_owners_soft)
+		LogWarn(COMPONENT_STATE,
+			"Client %" PRIx64 " reached %" PRIu32
+			" open and lock owners",
+			clientid->cid_clientid,
+			nfs_param.nfsv4_param.client_owners_soft);
+
 	glist_init(&owner->so_owner.so_nfs4_owner.so_state_list);
 
 	/* Increment refcount on related owner */
@@ -438,6 +469,15 @@ state_owner_t *create_nfs4_owner(state_nfs4_owner_name_t *name,
 	state_owner_t key;
 	state_owner_t *owner;
 	bool_t isnew;
+	uint32_t hard = nfs_param.nfsv4_param.client_owners_hard;
+	bool limited = false;
+
+	if (care != CARE_NOT && hard != 0 &&
+	    nfs4_owner_count(clientid) >= hard) {
+		/* Existing owners are still found, new ones are refused */
+		care = CARE_NOT;
+		limited = true;
+	}
 
 	/* set up the content of the open_owner */
 	memset(&key, 0, sizeof(key));
@@ -469,6 +509,14 @@ state_owner_t *create_nfs4_owner(state_nfs4_owner_name_t *name,
 
 	owner = get_state_owner(care, &key, init_nfs4_owner, &isnew);
 
+	if (owner == NULL && limited) {
+		LogDebug(COMPONENT_STATE,
+			 "Client %" PRIx64 " is at its limit of %" PRIu32
+			 " owners",
+			 clientid->cid_clientid, hard);
+		return NULL;
+	}
+
 	if (owner != NULL && related_owner != NULL) {
 		PTHREAD_MUTEX_lock(&owner->so_mutex);
 		/* Related owner already exists. */
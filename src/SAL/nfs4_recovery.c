@@ -50,6 +50,9 @@ char v4_old_dir[PATH_MAX];
 time_t current_grace;
 pthread_mutex_t grace_mutex = PTHREAD_MUTEX_INITIALIZER;        /*< Mutex */
 struct glist_head clid_list = GLIST_HEAD_INIT(clid_list);  /*< Clients */
+static int clid_reclaim_pending;	/*< clid_list entries still reclaiming */
+static bool grace_scoped;	/*< Grace only holds back reclaiming clients */
+static struct nfs4_recovery_backend *recovery_backend = &fs_recovery_backend;
 
 static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp);
 static void nfs_release_nlm_state(char *release_ip);
@@ -74,6 +77,13 @@ void nfs4_start_grace(nfs_grace_start_t *gsp)
 
 	PTHREAD_MUTEX_lock(&grace_mutex);
 
+	/* A failover elsewhere only concerns the clients that reclaim
+	 * here, but a grace already covering everyone stays so.
+	 */
+	atomic_store_int8_t((int8_t *) &grace_scoped,
+			    nfs_param.nfsv4_param.scoped_grace && gsp &&
+			    (grace_scoped || !nfs_in_grace()));
+
 	/* grace should always be greater than or equal to lease time,
 	 * some clients are known to have problems with grace greater than 60
 	 * seconds Lease_Lifetime should be set to a smaller value for those
@@ -134,6 +144,8 @@ int nfs_in_grace(void)
 		LogEvent(COMPONENT_STATE, "NFS Server Now %s",
 			 in_grace ? "IN GRACE" : "NOT IN GRACE");
 		last_grace = in_grace;
+		if (!in_grace)
+			nfs_start_phase_done(NFS_START_GRACE);
 	} else if (in_grace) {
 		LogDebug(COMPONENT_STATE, "NFS Server IN GRACE");
 	}
@@ -141,6 +153,29 @@ int nfs_in_grace(void)
 	return in_grace;
 }
 
+/**
+ * @brief Check if a client is held to the grace period
+ *
+ * With Scoped_Grace, a grace period started by the cluster manager
+ * only holds back the clients allowed to reclaim on this node.  Any
+ * other grace period holds back everyone.
+ *
+ * @param[in] clientid Client record, NULL if not known
+ *
+ * @retval true if its non-reclaim requests must wait for grace to end.
+ */
+bool nfs_in_grace_client(nfs_client_id_t *clientid)
+{
+	if (!nfs_in_grace())
+		return false;
+
+	if (clientid == NULL ||
+	    !atomic_fetch_int8_t((int8_t *) &grace_scoped))
+		return true;
+
+	return clientid->cid_allow_reclaim;
+}
+
 /**
  * @brief convert clientid opaque bytes as a hex string for mkdir purpose.
  *
@@ -241,21 +276,91 @@ void nfs4_create_clid_name(nfs_client_record_t *cl_rec,
 }
 
 /**
- * @brief Create an entry in the recovery directory
+ * @brief Record a client in stable storage
  *
- * This entry alows the client to reclaim state after a server
+ * The record alows the client to reclaim state after a server
  * reboot/restart.
  *
  * @param[in] clientid Client record
  */
 void nfs4_add_clid(nfs_client_id_t *clientid)
+{
+	nfs4_create_clid_name(clientid->cid_client_record, clientid);
+
+	if (clientid->cid_recov_dir != NULL) {
+		recovery_backend->add_clid(clientid);
+		nfs4_standby_add_clid(clientid->cid_recov_dir);
+	}
+}
+
+/**
+ * @brief Remove a client's record from stable storage
+ *
+ * This function would be called when a client expires.
+ *
+ * @param[in] clientid Client record
+ */
+void nfs4_rm_clid(nfs_client_id_t *clientid)
+{
+	if (clientid->cid_recov_dir != NULL) {
+		recovery_backend->rm_clid(clientid);
+		nfs4_standby_rm_clid(clientid->cid_recov_dir);
+	}
+}
+
+/**
+ * @brief Add an entry to the list of clients allowed to reclaim
+ *
+ * Called by the backends' read_clids with grace_mutex held.
+ *
+ * @param[in] cl_name Client name made by nfs4_create_clid_name
+ *
+ * @return The new entry.
+ */
+clid_entry_t *nfs4_add_clid_entry(const char *cl_name)
+{
+	clid_entry_t *new_ent = gsh_malloc(sizeof(clid_entry_t));
+
+	glist_init(&new_ent->cl_rfh_list);
+	new_ent->cl_reclaim_complete = false;
+	strlcpy(new_ent->cl_name, cl_name, sizeof(new_ent->cl_name));
+	glist_add(&clid_list, &new_ent->cl_list);
+	clid_reclaim_pending++;
+
+	LogDebug(COMPONENT_CLIENTID, "added %s to clid list",
+		 new_ent->cl_name);
+
+	return new_ent;
+}
+
+/**
+ * @brief Add a revoked handle to a reclaiming client's entry
+ *
+ * @param[in] clid_ent Entry from nfs4_add_clid_entry
+ * @param[in] rfh      Base64url encoded file handle
+ */
+void nfs4_add_rfh_entry(clid_entry_t *clid_ent, const char *rfh)
+{
+	rdel_fh_t *new_ent = gsh_malloc(sizeof(rdel_fh_t));
+
+	new_ent->rdfh_handle_str = gsh_strdup(rfh);
+	glist_add(&clid_ent->cl_rfh_list, &new_ent->rdfh_list);
+
+	LogFullDebug(COMPONENT_CLIENTID, "revoked handle: %s",
+		     new_ent->rdfh_handle_str);
+}
+
+/**
+ * @brief Create an entry in the recovery directory
+ *
+ * @param[in] clientid Client record
+ */
+static void fs_add_clid(nfs_client_id_t *clientid)
 {
 	int err = 0;
 	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
 	int length, position = 0;
 
-	nfs4_create_clid_name(clientid->cid_client_record, clientid);
-
 	/* break clientid down if it is greater than max dir name */
 	/* and create a directory hierachy to represent the clientid. */
 	snprintf(path, sizeof(path), "%s", v4_recov_dir);
@@ -299,7 +404,7 @@ void nfs4_add_clid(nfs_client_id_t *clientid)
  * @param[in] path Path of the client-id on the stable storage.
  */
 
-void nfs4_rm_revoked_handles(char *path)
+static void fs_rm_revoked_handles(char *path)
 {
 	DIR *dp;
 	struct dirent *dentp;
@@ -334,11 +439,12 @@ void nfs4_rm_revoked_handles(char *path)
 /**
  * @brief Remove a client entry from the recovery directory
  *
- * This function would be called when a client expires.
- *
- * @param[in] recov_dir Recovery directory
+ * @param[in] recov_dir   Client name
+ * @param[in] parent_path Directory the remaining name is under
+ * @param[in] position    Offset of the remaining name in recov_dir
  */
-void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
+static void fs_rm_clid_impl(const char *recov_dir, char *parent_path,
+			    int position)
 {
 	int err;
 	char *path;
@@ -354,7 +460,7 @@ void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
 		/* We are at the tail directory of the clid,
 		 * remove revoked handles, if any.
 		 */
-		nfs4_rm_revoked_handles(parent_path);
+		fs_rm_revoked_handles(parent_path);
 		return;
 	}
 	segment = gsh_malloc(NAME_MAX+1);
@@ -377,7 +483,7 @@ void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
 	/* recursively remove the directory hirerchy which represent the
 	 *clientid
 	 */
-	nfs4_rm_clid(recov_dir, path, position+segment_len);
+	fs_rm_clid_impl(recov_dir, path, position+segment_len);
 
 	err = rmdir(path);
 	if (err == -1) {
@@ -390,6 +496,11 @@ void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
 	gsh_free(path);
 }
 
+static void fs_rm_clid(nfs_client_id_t *clientid)
+{
+	fs_rm_clid_impl(clientid->cid_recov_dir, v4_recov_dir, 0);
+}
+
 /**
  * @brief Determine whether or not this client may reclaim state
  *
@@ -453,6 +564,53 @@ void  nfs4_chk_clid(nfs_client_id_t *clientid)
 	PTHREAD_MUTEX_unlock(&grace_mutex);
 }
 
+/**
+ * @brief Note that a client has finished reclaiming
+ *
+ * Once every client allowed to reclaim has sent a global
+ * RECLAIM_COMPLETE nobody is left to reclaim, so grace is lifted
+ * rather than left to run out.
+ *
+ * @param[in] clientid Client record
+ */
+void nfs4_reclaim_complete(nfs_client_id_t *clientid)
+{
+	struct glist_head *node;
+	clid_entry_t *clid_ent;
+	bool found = false;
+
+	if (clientid->cid_recov_dir == NULL || !nfs_in_grace())
+		return;
+
+	PTHREAD_MUTEX_lock(&grace_mutex);
+
+	/* A restart during grace can leave the same name listed twice */
+	glist_for_each(node, &clid_list) {
+		clid_ent = glist_entry(node, clid_entry_t, cl_list);
+		if (clid_ent->cl_reclaim_complete ||
+		    strncmp(clid_ent->cl_name, clientid->cid_recov_dir,
+			    PATH_MAX) != 0)
+			continue;
+		clid_ent->cl_reclaim_complete = true;
+		clid_reclaim_pending--;
+		found = true;
+	}
+
+	LogDebug(COMPONENT_CLIENTID, "%s reclaim complete, %d still reclaiming",
+		 clientid->cid_recov_dir, clid_reclaim_pending);
+
+	if (found && clid_reclaim_pending == 0 &&
+	    nfs_param.nfsv4_param.lift_grace) {
+		LogEvent(COMPONENT_STATE,
+			 "All clients have reclaimed, lifting grace");
+		atomic_store_time_t(&current_grace,
+				    time(NULL) -
+				    nfs_param.nfsv4_param.grace_period);
+	}
+
+	PTHREAD_MUTEX_unlock(&grace_mutex);
+}
+
 static void free_heap(char *path, char *new_path, char *build_clid)
 {
 	if (path)
@@ -479,16 +637,14 @@ static void free_heap(char *path, char *new_path, char *build_clid)
  * @param[in] del Delete after populating
  */
 
-void nfs4_cp_pop_revoked_delegs(clid_entry_t *clid_ent,
-				char *path,
-				char *tgtdir,
-				bool del)
+static void fs_cp_pop_revoked_delegs(clid_entry_t *clid_ent,
+				     char *path,
+				     char *tgtdir,
+				     bool del)
 {
 	struct dirent *dentp;
 	DIR *dp;
-	rdel_fh_t *new_ent;
 
-	glist_init(&clid_ent->cl_rfh_list);
 	/* Read the contents from recov dir of this clientid. */
 	dp = opendir(path);
 	if (dp == NULL) {
@@ -525,15 +681,8 @@ void nfs4_cp_pop_revoked_delegs(clid_entry_t *clid_ent,
 			}
 		}
 
-		new_ent = gsh_malloc(sizeof(rdel_fh_t));
-
 		/* Ignore the beginning \x1 and copy the rest (file handle) */
-		new_ent->rdfh_handle_str = gsh_strdup(dentp->d_name+1);
-
-		glist_add(&clid_ent->cl_rfh_list, &new_ent->rdfh_list);
-		LogFullDebug(COMPONENT_CLIENTID,
-			"revoked handle: %s",
-			new_ent->rdfh_handle_str);
+		nfs4_add_rfh_entry(clid_ent, dentp->d_name + 1);
 
 		/* Since the handle is loaded into memory, go ahead and
 		 * delete it from the stable storage.
@@ -574,7 +723,7 @@ void nfs4_cp_pop_revoked_delegs(clid_entry_t *clid_ent,
  *
  * @return POSIX error codes.
  */
-static int nfs4_read_recov_clids(DIR *dp,
+static int fs_read_recov_clids(DIR *dp,
 				 const char *parent_path,
 				 char *clid_str,
 				 char *tgtdir,
@@ -668,17 +817,17 @@ static int nfs4_read_recov_clids(DIR *dp,
 		}
 
 		if (tgtdir)
-			rc = nfs4_read_recov_clids(subdp,
-						   path,
-						   build_clid,
-						   new_path,
-						   takeover);
+			rc = fs_read_recov_clids(subdp,
+						 path,
+						 build_clid,
+						 new_path,
+						 takeover);
 		else
-			rc = nfs4_read_recov_clids(subdp,
-						   path,
-						   build_clid,
-						   NULL,
-						   takeover);
+			rc = fs_read_recov_clids(subdp,
+						 path,
+						 build_clid,
+						 NULL,
+						 takeover);
 
 		/* close the sub directory */
 		(void)closedir(subdp);
@@ -735,18 +884,11 @@ static int nfs4_read_recov_clids(DIR *dp,
 			cid_len = atoi(temp);
 			len = strlen(ptr2);
 			if ((len == (cid_len+2)) && (ptr2[len-1] == ')')) {
-				new_ent = gsh_malloc(sizeof(clid_entry_t));
-
-				nfs4_cp_pop_revoked_delegs(new_ent,
-							path,
-							tgtdir,
-							!takeover);
-				strcpy(new_ent->cl_name, build_clid);
-				glist_add(&clid_list,
-					  &new_ent->cl_list);
-				LogDebug(COMPONENT_CLIENTID,
-					 "added %s to clid list",
-					 new_ent->cl_name);
+				new_ent = nfs4_add_clid_entry(build_clid);
+				fs_cp_pop_revoked_delegs(new_ent,
+							 path,
+							 tgtdir,
+							 !takeover);
 			}
 		}
 		gsh_free(build_clid);
@@ -768,28 +910,17 @@ static int nfs4_read_recov_clids(DIR *dp,
 }
 
 /**
- * @brief Load clients for recovery, with no lock
+ * @brief Read the client reclaim list from the recovery directories
  *
- * @param[in] nodeid Node, on takeover
+ * @param[in] gsp Grace start information, NULL at startup
  */
-static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
+static void fs_read_clids(nfs_grace_start_t *gsp)
 {
 	DIR *dp;
-	struct clid_entry *clid_entry;
 	int rc;
 	char path[PATH_MAX];
 
-	LogDebug(COMPONENT_STATE, "Load recovery cli %p", gsp);
-
 	if (gsp == NULL) {
-		/* when not doing a takeover, start with an empty list */
-		while ((clid_entry = glist_first_entry(&clid_list,
-						       struct clid_entry,
-						       cl_list)) != NULL) {
-			glist_del(&clid_entry->cl_list);
-			gsh_free(clid_entry);
-		}
-
 		dp = opendir(v4_old_dir);
 		if (dp == NULL) {
 			LogEvent(COMPONENT_CLIENTID,
@@ -797,7 +928,7 @@ static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
 				 v4_old_dir, errno);
 			return;
 		}
-		rc = nfs4_read_recov_clids(dp, v4_old_dir, NULL, NULL, 0);
+		rc = fs_read_recov_clids(dp, v4_old_dir, NULL, NULL, 0);
 		if (rc == -1) {
 			(void)closedir(dp);
 			LogEvent(COMPONENT_CLIENTID,
@@ -815,8 +946,8 @@ static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
 			return;
 		}
 
-		rc = nfs4_read_recov_clids(dp, v4_recov_dir,
-					   NULL, v4_old_dir, 0);
+		rc = fs_read_recov_clids(dp, v4_recov_dir,
+					 NULL, v4_old_dir, 0);
 		if (rc == -1) {
 			(void)closedir(dp);
 			LogEvent(COMPONENT_CLIENTID,
@@ -859,7 +990,7 @@ static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
 			return;
 		}
 
-		rc = nfs4_read_recov_clids(dp, path, NULL, v4_old_dir, 1);
+		rc = fs_read_recov_clids(dp, path, NULL, v4_old_dir, 1);
 		if (rc == -1) {
 			(void)closedir(dp);
 			LogEvent(COMPONENT_CLIENTID,
@@ -875,10 +1006,38 @@ static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
 	}
 }
 
+/**
+ * @brief Load clients for recovery, with no lock
+ *
+ * @param[in] gsp Grace start information, NULL at startup
+ */
+static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
+{
+	struct clid_entry *clid_entry;
+
+	LogDebug(COMPONENT_STATE, "Load recovery cli %p", gsp);
+
+	if (gsp == NULL) {
+		/* when not doing a takeover, start with an empty list */
+		while ((clid_entry = glist_first_entry(&clid_list,
+						       struct clid_entry,
+						       cl_list)) != NULL) {
+			glist_del(&clid_entry->cl_list);
+			gsh_free(clid_entry);
+		}
+		clid_reclaim_pending = 0;
+	}
+
+	recovery_backend->read_clids(gsp);
+
+	/* On a standby, the clients of the node it takes over for */
+	nfs4_standby_load_clids();
+}
+
 /**
  * @brief Load clients for recovery
  *
- * @param[in] nodeid Node, on takeover
+ * @param[in] gsp Grace start information, NULL at startup
  */
 void nfs4_load_recov_clids(nfs_grace_start_t *gsp)
 {
@@ -892,7 +1051,7 @@ void nfs4_load_recov_clids(nfs_grace_start_t *gsp)
 /**
  * @brief Clean up recovery directory
  */
-void nfs4_clean_old_recov_dir(char *parent_path)
+static void fs_clean_old_recov_dir(char *parent_path)
 {
 	DIR *dp;
 	struct dirent *dentp;
@@ -938,7 +1097,7 @@ void nfs4_clean_old_recov_dir(char *parent_path)
 
 		snprintf(path, total_len, "%s/%s", parent_path, dentp->d_name);
 
-		nfs4_clean_old_recov_dir(path);
+		fs_clean_old_recov_dir(path);
 		rc = rmdir(path);
 		if (rc == -1) {
 			LogEvent(COMPONENT_CLIENTID,
@@ -956,7 +1115,7 @@ void nfs4_clean_old_recov_dir(char *parent_path)
  * should only need to be done once (if at all).  Also, the location
  * of the directory could be configurable.
  */
-void nfs4_create_recov_dir(void)
+static int fs_create_recov_dir(void)
 {
 	int err;
 
@@ -1005,6 +1164,109 @@ void nfs4_create_recov_dir(void)
 				 v4_old_dir, errno);
 		}
 	}
+
+	return 0;
+}
+
+static void fs_end_grace(void)
+{
+	fs_clean_old_recov_dir(v4_old_dir);
+}
+
+/**
+ * @brief Record a revoked filehandle under the client's directory
+ *
+ * @param[in] delr_clid Client record
+ * @param[in] rhdlstr   Base64url encoded file handle
+ */
+static void fs_add_revoke_fh(nfs_client_id_t *delr_clid, const char *rhdlstr)
+{
+	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
+	int length, position = 0;
+	int fd;
+
+	/* Parse through the clientid directory structure */
+	snprintf(path, sizeof(path), "%s", v4_recov_dir);
+	length = strlen(delr_clid->cid_recov_dir);
+	while (position < length) {
+		int len = strlen(&delr_clid->cid_recov_dir[position]);
+
+		if (len <= NAME_MAX) {
+			strcat(path, "/");
+			strncat(path, &delr_clid->cid_recov_dir[position], len);
+			strcat(path, "/\x1"); /* Prefix 1 to converted fh */
+			strncat(path, rhdlstr, strlen(rhdlstr));
+			fd = creat(path, 0700);
+			if (fd < 0) {
+				LogEvent(COMPONENT_CLIENTID,
+					"Failed to record revoke errno:%d\n",
+					errno);
+			} else {
+				close(fd);
+			}
+			return;
+		}
+		strncpy(segment, &delr_clid->cid_recov_dir[position], NAME_MAX);
+		strcat(path, "/");
+		strncat(path, segment, NAME_MAX);
+		position += NAME_MAX;
+	}
+}
+
+struct nfs4_recovery_backend fs_recovery_backend = {
+	.name = "fs",
+	.recovery_init = fs_create_recov_dir,
+	.read_clids = fs_read_clids,
+	.end_grace = fs_end_grace,
+	.add_clid = fs_add_clid,
+	.rm_clid = fs_rm_clid,
+	.add_revoke_fh = fs_add_revoke_fh,
+};
+
+/**
+ * @brief Set up the configured recovery backend
+ *
+ * This needs to be done before the client ids are read in.
+ *
+ * @return 0 or -errno.
+ */
+int nfs4_recovery_init(void)
+{
+	switch (nfs_param.nfsv4_param.recovery_backend) {
+	case RECOVERY_BACKEND_FS:
+		recovery_backend = &fs_recovery_backend;
+		break;
+	case RECOVERY_BACKEND_RADOS_KV:
+#ifdef USE_RADOS_RECOV
+		recovery_backend = &rados_kv_recovery_backend;
+		break;
+#else
+		LogCrit(COMPONENT_CLIENTID,
+			"RecoveryBackend rados_kv is not built in");
+		return -ENOTSUP;
+#endif
+	default:
+		return -EINVAL;
+	}
+
+	LogInfo(COMPONENT_CLIENTID, "Using %s recovery backend",
+		recovery_backend->name);
+
+	return recovery_backend->recovery_init();
+}
+
+void nfs4_recovery_shutdown(void)
+{
+	if (recovery_backend->recovery_shutdown != NULL)
+		recovery_backend->recovery_shutdown();
+}
+
+/**
+ * @brief Grace is over, drop the records of the previous instance
+ */
+void nfs4_end_grace(void)
+{
+	recovery_backend->end_grace();
 }
 
 /**
@@ -1016,9 +1278,6 @@ void nfs4_create_recov_dir(void)
 void nfs4_record_revoke(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle)
 {
 	char rhdlstr[NAME_MAX];
-	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
-	int length, position = 0;
-	int fd;
 	int retval;
 
 	/* Convert nfs_fh4_val into base64 encoded string */
@@ -1043,34 +1302,10 @@ void nfs4_record_revoke(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle)
 	}
 	PTHREAD_MUTEX_unlock(&delr_clid->cid_mutex);
 
-	/* Parse through the clientid directory structure */
 	assert(delr_clid->cid_recov_dir != NULL);
 
-	snprintf(path, sizeof(path), "%s", v4_recov_dir);
-	length = strlen(delr_clid->cid_recov_dir);
-	while (position < length) {
-		int len = strlen(&delr_clid->cid_recov_dir[position]);
-
-		if (len <= NAME_MAX) {
-			strcat(path, "/");
-			strncat(path, &delr_clid->cid_recov_dir[position], len);
-			strcat(path, "/\x1"); /* Prefix 1 to converted fh */
-			strncat(path, rhdlstr, strlen(rhdlstr));
-			fd = creat(path, 0700);
-			if (fd < 0) {
-				LogEvent(COMPONENT_CLIENTID,
-					"Failed to record revoke errno:%d\n",
-					errno);
-			} else {
-				close(fd);
-			}
-			return;
-		}
-		strncpy(segment, &delr_clid->cid_recov_dir[position], NAME_MAX);
-		strcat(path, "/");
-		strncat(path, segment, NAME_MAX);
-		position += NAME_MAX;
-	}
+	recovery_backend->add_revoke_fh(delr_clid, rhdlstr);
+	nfs4_standby_revoke(delr_clid->cid_recov_dir, rhdlstr);
 }
 
 /**
@@ -0,0 +1,549 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup SAL
+ * @{
+ */
+
+/**
+ * @file nfs4_recovery_rados_kv.c
+ * @brief NFSv4 recovery records in the omap of RADOS objects
+ *
+ * Each node keeps its current records in node<nodeid>_recov.  At
+ * startup those move to node<nodeid>_old, which holds the clients
+ * allowed to reclaim until grace ends.
+ *
+ * A client is keyed by its clientid in hex and the value is the name
+ * made by nfs4_create_clid_name.  A delegation revoked from it is
+ * keyed by the clientid, a ':' and the encoded handle, so a client's
+ * revoked handles sort right after it and go away with one range
+ * removal.
+ *
+ * Updates are queued and a single thread writes everything queued
+ * since its last write in one operation, so a burst of clients
+ * confirming after a failover costs a few round trips rather than
+ * one each.  Callers that need their record stable wait for the
+ * write that carries it.
+ */
+
+#include "config.h"
+
+#ifdef USE_RADOS_RECOV
+
+#include <rados/librados.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "nfs4.h"
+#include "sal_functions.h"
+#include "config_parsing.h"
+#include "fsal.h"
+
+#define RADOS_KV_CID_LEN 16	/*< Hex digits of a clientid key */
+#define RADOS_KV_KEY_MAX (RADOS_KV_CID_LEN + NAME_MAX + 2)
+#define RADOS_KV_READ_BATCH 1024
+
+struct rados_kv_parameter {
+	char *ceph_conf;
+	char *userid;
+	char *pool;
+};
+
+static struct rados_kv_parameter rados_kv_param;
+
+static struct config_item rados_kv_params[] = {
+	CONF_ITEM_PATH("ceph_conf", 1, MAXPATHLEN, NULL,
+		       rados_kv_parameter, ceph_conf),
+	CONF_ITEM_STR("userid", 1, MAXPATHLEN, NULL,
+		      rados_kv_parameter, userid),
+	CONF_ITEM_STR("pool", 1, MAXPATHLEN, "nfs-ganesha",
+		      rados_kv_parameter, pool),
+	CONFIG_EOL
+};
+
+static void *rados_kv_param_init(void *link_mem, void *self_struct)
+{
+	if (self_struct == NULL)
+		return &rados_kv_param;
+	else
+		return NULL;
+}
+
+struct config_block rados_kv_param_blk = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.rados_kv",
+	.blk_desc.name = "RADOS_KV",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = rados_kv_param_init,
+	.blk_desc.u.blk.params = rados_kv_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+enum rados_kv_op_type {
+	RADOS_KV_SET,		/*< Set key to val */
+	RADOS_KV_RM_CLIENT,	/*< Remove a client key and its handles */
+};
+
+struct rados_kv_op {
+	struct glist_head link;
+	enum rados_kv_op_type type;
+	char key[RADOS_KV_KEY_MAX];
+	char *val;
+	size_t val_len;
+};
+
+static rados_t rados_kv_cluster;
+static rados_ioctx_t rados_kv_io;
+static char rados_kv_recov_oid[NAME_MAX];
+static char rados_kv_old_oid[NAME_MAX];
+
+/* Write queue, all protected by rados_kv_mtx */
+static pthread_mutex_t rados_kv_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rados_kv_work_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t rados_kv_done_cv = PTHREAD_COND_INITIALIZER;
+static struct glist_head rados_kv_pending = GLIST_HEAD_INIT(rados_kv_pending);
+static uint64_t rados_kv_queued;	/*< Sequence of the last op queued */
+static uint64_t rados_kv_written;	/*< Sequence of the last op written */
+static bool rados_kv_stop;
+static pthread_t rados_kv_thread;
+
+static void rados_kv_cid_key(char *key, size_t size, clientid4 clientid)
+{
+	snprintf(key, size, "%0*" PRIx64, RADOS_KV_CID_LEN, clientid);
+}
+
+/**
+ * @brief Write a batch of updates to the records object in one go
+ *
+ * @param[in] batch The ops, freed on return
+ */
+static void rados_kv_write_batch(struct glist_head *batch)
+{
+	rados_write_op_t wop = rados_create_write_op();
+	struct rados_kv_op *op;
+	char end[RADOS_KV_CID_LEN + 2];
+	int count = 0;
+	int rc;
+
+	rados_write_op_create(wop, LIBRADOS_CREATE_IDEMPOTENT, NULL);
+
+	/* Sub-operations apply in order, so a removal queued after a
+	 * set still wins.
+	 */
+	glist_for_each_entry(op, batch, link) {
+		const char *key = op->key;
+		const char *val = op->val;
+
+		if (op->type == RADOS_KV_SET) {
+			rados_write_op_omap_set(wop, &key, &val,
+						&op->val_len, 1);
+		} else {
+			/* ';' sorts right after the ':' of handle keys */
+			snprintf(end, sizeof(end), "%s;", op->key);
+			rados_write_op_omap_rm_range2(wop, op->key,
+						      RADOS_KV_CID_LEN,
+						      end,
+						      RADOS_KV_CID_LEN + 1);
+		}
+		count++;
+	}
+
+	rc = rados_write_op_operate(wop, rados_kv_io, rados_kv_recov_oid,
+				    NULL, 0);
+	if (rc < 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to write %d recovery updates to %s: %s",
+			 count, rados_kv_recov_oid, strerror(-rc));
+	else
+		LogFullDebug(COMPONENT_CLIENTID,
+			     "Wrote %d recovery updates to %s",
+			     count, rados_kv_recov_oid);
+
+	rados_release_write_op(wop);
+
+	while ((op = glist_first_entry(batch, struct rados_kv_op, link))) {
+		glist_del(&op->link);
+		gsh_free(op->val);
+		gsh_free(op);
+	}
+}
+
+static void *rados_kv_writer(void *arg)
+{
+	struct glist_head batch = GLIST_HEAD_INIT(batch);
+	uint64_t seq;
+
+	SetNameFunction("rados_kv");
+
+	PTHREAD_MUTEX_lock(&rados_kv_mtx);
+
+	for (;;) {
+		while (glist_empty(&rados_kv_pending) && !rados_kv_stop)
+			pthread_cond_wait(&rados_kv_work_cv, &rados_kv_mtx);
+
+		if (glist_empty(&rados_kv_pending))
+			break;
+
+		glist_splice_tail(&batch, &rados_kv_pending);
+		seq = rados_kv_queued;
+
+		PTHREAD_MUTEX_unlock(&rados_kv_mtx);
+
+		rados_kv_write_batch(&batch);
+
+		PTHREAD_MUTEX_lock(&rados_kv_mtx);
+
+		rados_kv_written = seq;
+		pthread_cond_broadcast(&rados_kv_done_cv);
+	}
+
+	PTHREAD_MUTEX_unlock(&rados_kv_mtx);
+
+	return NULL;
+}
+
+/**
+ * @brief Queue an update for the writer
+ *
+ * @return The sequence to pass to rados_kv_wait.
+ */
+static uint64_t rados_kv_queue(enum rados_kv_op_type type, const char *key,
+			       const char *val)
+{
+	struct rados_kv_op *op = gsh_calloc(1, sizeof(*op));
+	uint64_t seq;
+
+	op->type = type;
+	strlcpy(op->key, key, sizeof(op->key));
+	if (val != NULL) {
+		op->val = gsh_strdup(val);
+		op->val_len = strlen(val);
+	}
+
+	PTHREAD_MUTEX_lock(&rados_kv_mtx);
+	glist_add_tail(&rados_kv_pending, &op->link);
+	seq = ++rados_kv_queued;
+	pthread_cond_signal(&rados_kv_work_cv);
+	PTHREAD_MUTEX_unlock(&rados_kv_mtx);
+
+	return seq;
+}
+
+static void rados_kv_wait(uint64_t seq)
+{
+	PTHREAD_MUTEX_lock(&rados_kv_mtx);
+	while (rados_kv_written < seq)
+		pthread_cond_wait(&rados_kv_done_cv, &rados_kv_mtx);
+	PTHREAD_MUTEX_unlock(&rados_kv_mtx);
+}
+
+static int rados_kv_init(void)
+{
+	int rc;
+
+	rc = rados_create(&rados_kv_cluster, rados_kv_param.userid);
+	if (rc < 0) {
+		LogCrit(COMPONENT_CLIENTID, "rados_create failed: %s",
+			strerror(-rc));
+		return rc;
+	}
+
+	rc = rados_conf_read_file(rados_kv_cluster, rados_kv_param.ceph_conf);
+	if (rc < 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Could not read Ceph configuration: %s",
+			strerror(-rc));
+		goto out_shutdown;
+	}
+
+	rc = rados_connect(rados_kv_cluster);
+	if (rc < 0) {
+		LogCrit(COMPONENT_CLIENTID, "rados_connect failed: %s",
+			strerror(-rc));
+		goto out_shutdown;
+	}
+
+	rc = rados_ioctx_create(rados_kv_cluster, rados_kv_param.pool,
+				&rados_kv_io);
+	if (rc < 0) {
+		LogCrit(COMPONENT_CLIENTID, "Could not open pool %s: %s",
+			rados_kv_param.pool, strerror(-rc));
+		goto out_shutdown;
+	}
+
+	snprintf(rados_kv_recov_oid, sizeof(rados_kv_recov_oid),
+		 "node%d_recov", g_nodeid);
+	snprintf(rados_kv_old_oid, sizeof(rados_kv_old_oid),
+		 "node%d_old", g_nodeid);
+
+	rados_kv_stop = false;
+	rc = pthread_create(&rados_kv_thread, NULL, rados_kv_writer, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_CLIENTID,
+			"Could not start recovery writer thread: %s",
+			strerror(rc));
+		rados_ioctx_destroy(rados_kv_io);
+		rc = -rc;
+		goto out_shutdown;
+	}
+
+	return 0;
+
+ out_shutdown:
+	rados_shutdown(rados_kv_cluster);
+	return rc;
+}
+
+static void rados_kv_shutdown(void)
+{
+	PTHREAD_MUTEX_lock(&rados_kv_mtx);
+	rados_kv_stop = true;
+	pthread_cond_signal(&rados_kv_work_cv);
+	PTHREAD_MUTEX_unlock(&rados_kv_mtx);
+
+	/* The writer drains the queue before it exits */
+	(void) pthread_join(rados_kv_thread, NULL);
+
+	rados_ioctx_destroy(rados_kv_io);
+	rados_shutdown(rados_kv_cluster);
+}
+
+/**
+ * @brief Turn one record into a clid_list entry
+ *
+ * Handle keys come right after their client's key, so they belong to
+ * the last client added.
+ *
+ * @param[in,out] cur     Last client entry added
+ * @param[in,out] cur_key That client's key
+ */
+static void rados_kv_add_entry(const char *key, size_t key_len,
+			       const char *val, size_t val_len,
+			       clid_entry_t **cur, char *cur_key)
+{
+	char name[PATH_MAX];
+
+	if (key_len == RADOS_KV_CID_LEN) {
+		if (val_len >= sizeof(name)) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Skipping recovery record %s, name too long",
+				 key);
+			*cur = NULL;
+			return;
+		}
+		memcpy(name, val, val_len);
+		name[val_len] = '\0';
+		*cur = nfs4_add_clid_entry(name);
+		memcpy(cur_key, key, RADOS_KV_CID_LEN);
+		return;
+	}
+
+	if (key_len > RADOS_KV_CID_LEN + 1 && key[RADOS_KV_CID_LEN] == ':' &&
+	    *cur != NULL && memcmp(key, cur_key, RADOS_KV_CID_LEN) == 0) {
+		nfs4_add_rfh_entry(*cur, key + RADOS_KV_CID_LEN + 1);
+		return;
+	}
+
+	LogMidDebug(COMPONENT_CLIENTID, "Skipping recovery record %s", key);
+}
+
+/**
+ * @brief Load the records of an object into clid_list
+ *
+ * @param[in] oid      Object to read
+ * @param[in] copy_oid Object to copy the records into, or NULL
+ *
+ * @return 0 or -errno.
+ */
+static int rados_kv_load(const char *oid, const char *copy_oid)
+{
+	char start[RADOS_KV_KEY_MAX] = "";
+	char cur_key[RADOS_KV_CID_LEN];
+	clid_entry_t *cur = NULL;
+	unsigned char more = 1;
+	int count = 0;
+	int rc = 0;
+
+	while (more) {
+		rados_read_op_t rop = rados_create_read_op();
+		rados_write_op_t wop = NULL;
+		rados_omap_iter_t iter;
+		char *key, *val;
+		size_t key_len, val_len;
+		int prval;
+
+		rados_read_op_omap_get_vals2(rop, start, "",
+					     RADOS_KV_READ_BATCH, &iter,
+					     &more, &prval);
+		rc = rados_read_op_operate(rop, rados_kv_io, oid, 0);
+		rados_release_read_op(rop);
+
+		if (rc == -ENOENT)
+			return 0;
+
+		if (rc < 0 || prval < 0) {
+			if (rc >= 0)
+				rc = prval;
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to read recovery records from %s: %s",
+				 oid, strerror(-rc));
+			return rc;
+		}
+
+		if (copy_oid != NULL) {
+			wop = rados_create_write_op();
+			rados_write_op_create(wop, LIBRADOS_CREATE_IDEMPOTENT,
+					      NULL);
+		}
+
+		while (rados_omap_get_next2(iter, &key, &val, &key_len,
+					    &val_len) == 0 && key != NULL) {
+			rados_kv_add_entry(key, key_len, val, val_len,
+					   &cur, cur_key);
+			if (wop != NULL)
+				rados_write_op_omap_set(wop,
+							(const char **)&key,
+							(const char **)&val,
+							&val_len, 1);
+			strlcpy(start, key, sizeof(start));
+			count++;
+		}
+
+		if (wop != NULL) {
+			rc = rados_write_op_operate(wop, rados_kv_io,
+						    copy_oid, NULL, 0);
+			rados_release_write_op(wop);
+		}
+
+		rados_omap_get_end(iter);
+
+		if (rc < 0) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to copy recovery records to %s: %s",
+				 copy_oid, strerror(-rc));
+			return rc;
+		}
+	}
+
+	LogEvent(COMPONENT_CLIENTID, "Read %d recovery records from %s",
+		 count, oid);
+
+	return 0;
+}
+
+static void rados_kv_read_clids(nfs_grace_start_t *gsp)
+{
+	char oid[NAME_MAX];
+	rados_write_op_t wop;
+	int rc;
+
+	if (gsp == NULL) {
+		/* Records left in old by a restart during grace are
+		 * still good, then move the current ones over.
+		 */
+		if (rados_kv_load(rados_kv_old_oid, NULL) != 0)
+			return;
+
+		if (rados_kv_load(rados_kv_recov_oid, rados_kv_old_oid) != 0)
+			return;
+
+		wop = rados_create_write_op();
+		rados_write_op_omap_clear(wop);
+		rc = rados_write_op_operate(wop, rados_kv_io,
+					    rados_kv_recov_oid, NULL, 0);
+		rados_release_write_op(wop);
+		if (rc < 0 && rc != -ENOENT)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to clear %s: %s",
+				 rados_kv_recov_oid, strerror(-rc));
+		return;
+	}
+
+	if (gsp->event == EVENT_UPDATE_CLIENTS)
+		snprintf(oid, sizeof(oid), "%s", rados_kv_recov_oid);
+	else if (gsp->event == EVENT_TAKE_IP)
+		snprintf(oid, sizeof(oid), "%s_recov", gsp->ipaddr);
+	else if (gsp->event == EVENT_TAKE_NODEID)
+		snprintf(oid, sizeof(oid), "node%d_recov", gsp->nodeid);
+	else
+		return;
+
+	LogEvent(COMPONENT_CLIENTID, "Recovery for nodeid %d object (%s)",
+		 gsp->nodeid, oid);
+
+	(void) rados_kv_load(oid, rados_kv_old_oid);
+}
+
+static void rados_kv_end_grace(void)
+{
+	int rc = rados_remove(rados_kv_io, rados_kv_old_oid);
+
+	if (rc < 0 && rc != -ENOENT)
+		LogEvent(COMPONENT_CLIENTID, "Failed to remove %s: %s",
+			 rados_kv_old_oid, strerror(-rc));
+}
+
+static void rados_kv_add_clid(nfs_client_id_t *clientid)
+{
+	char key[RADOS_KV_KEY_MAX];
+
+	rados_kv_cid_key(key, sizeof(key), clientid->cid_clientid);
+	rados_kv_wait(rados_kv_queue(RADOS_KV_SET, key,
+				     clientid->cid_recov_dir));
+
+	LogDebug(COMPONENT_CLIENTID, "Recorded client %s [%s]",
+		 key, clientid->cid_recov_dir);
+}
+
+static void rados_kv_rm_clid(nfs_client_id_t *clientid)
+{
+	char key[RADOS_KV_KEY_MAX];
+
+	rados_kv_cid_key(key, sizeof(key), clientid->cid_clientid);
+	(void) rados_kv_queue(RADOS_KV_RM_CLIENT, key, NULL);
+}
+
+static void rados_kv_add_revoke_fh(nfs_client_id_t *clientid,
+				   const char *rhdlstr)
+{
+	char key[RADOS_KV_KEY_MAX];
+
+	rados_kv_cid_key(key, sizeof(key), clientid->cid_clientid);
+	key[RADOS_KV_CID_LEN] = ':';
+	strlcpy(key + RADOS_KV_CID_LEN + 1, rhdlstr,
+		sizeof(key) - RADOS_KV_CID_LEN - 1);
+
+	rados_kv_wait(rados_kv_queue(RADOS_KV_SET, key, ""));
+}
+
+struct nfs4_recovery_backend rados_kv_recovery_backend = {
+	.name = "rados_kv",
+	.recovery_init = rados_kv_init,
+	.recovery_shutdown = rados_kv_shutdown,
+	.read_clids = rados_kv_read_clids,
+	.end_grace = rados_kv_end_grace,
+	.add_clid = rados_kv_add_clid,
+	.rm_clid = rados_kv_rm_clid,
+	.add_revoke_fh = rados_kv_add_revoke_fh,
+};
+
+#endif				/* USE_RADOS_RECOV */
+
+/** @} */
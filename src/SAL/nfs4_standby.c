@@ -0,0 +1,754 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup SAL
+ * @{
+ */
+
+/**
+ * @file nfs4_standby.c
+ * @brief Client recovery records replicated to a hot standby
+ *
+ * The active node sends every change to its client recovery records,
+ * a client confirmed, expired or had a delegation revoked, to the node
+ * at Standby_Host and Standby_Port.  The standby, listening on
+ * Standby_Listen_Port, keeps them in memory.  When it takes over for
+ * the active node, the replicated clients join those allowed to
+ * reclaim.  The standby thus needs no shared recovery storage, and
+ * with Lift_Grace leaves grace as soon as those clients reclaimed.
+ *
+ * Records are queued and a single thread sends everything queued
+ * since its last send in one write.  On every connection it first
+ * sends the whole set, so a standby that restarted or lost the link
+ * catches up.
+ *
+ * Each record is a type byte and a client name, both length
+ * prefixed in network order, and for a revoke the encoded handle:
+ *
+ *   type(1) name_len(2) name [handle_len(2) handle]
+ *
+ * Only the client records are replicated.  Clients still reclaim
+ * their opens, locks and delegations from the node that took over.
+ */
+
+#include "config.h"
+
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "avltree.h"
+
+#define STANDBY_RETRY_SEC 5	/*< Between attempts to reach the standby */
+#define STANDBY_POLL_MS 1000	/*< How often the listener checks for stop */
+#define STANDBY_RBUF_SIZE (64 * 1024)
+
+enum standby_rec_type {
+	STANDBY_ADD = 1,	/*< Client confirmed */
+	STANDBY_RM,		/*< Client expired */
+	STANDBY_REVOKE,		/*< Delegation revoked from a client */
+	STANDBY_RESET,		/*< Whole set follows */
+};
+
+/* A client known to the mirror or the replica */
+struct standby_client {
+	struct avltree_node node;
+	struct glist_head rfh_list;	/*< rdel_fh_t revoked handles */
+	char *name;
+};
+
+struct standby_buf {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+/* All protected by standby_mtx */
+static pthread_mutex_t standby_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t standby_cv = PTHREAD_COND_INITIALIZER;
+static struct avltree standby_mirror;	/*< What we sent the standby */
+static struct avltree standby_replica;	/*< What the active sent us */
+static struct standby_buf standby_out;	/*< Queued for the sender */
+static int standby_fd = -1;		/*< Link to the standby */
+static bool standby_stop;
+
+static bool standby_sending;
+static bool standby_listening;
+static pthread_t standby_send_thread;
+static pthread_t standby_listen_thread;
+
+static int standby_client_cmpf(const struct avltree_node *lhs,
+			       const struct avltree_node *rhs)
+{
+	struct standby_client *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct standby_client, node);
+	rk = avltree_container_of(rhs, struct standby_client, node);
+
+	return strcmp(lk->name, rk->name);
+}
+
+static struct standby_client *standby_lookup(struct avltree *tree,
+					     const char *name)
+{
+	struct standby_client key;
+	struct avltree_node *node;
+
+	key.name = (char *) name;
+	node = avltree_lookup(&key.node, tree);
+
+	return node ? avltree_container_of(node, struct standby_client, node)
+		    : NULL;
+}
+
+static struct standby_client *standby_add(struct avltree *tree,
+					  const char *name)
+{
+	struct standby_client *client = standby_lookup(tree, name);
+
+	if (client != NULL)
+		return client;
+
+	client = gsh_malloc(sizeof(*client));
+	glist_init(&client->rfh_list);
+	client->name = gsh_strdup(name);
+	avltree_insert(&client->node, tree);
+
+	return client;
+}
+
+static void standby_free(struct avltree *tree, struct standby_client *client)
+{
+	rdel_fh_t *rfh;
+
+	avltree_remove(&client->node, tree);
+
+	while ((rfh = glist_first_entry(&client->rfh_list, rdel_fh_t,
+					rdfh_list)) != NULL) {
+		glist_del(&rfh->rdfh_list);
+		gsh_free(rfh->rdfh_handle_str);
+		gsh_free(rfh);
+	}
+
+	gsh_free(client->name);
+	gsh_free(client);
+}
+
+static void standby_rm(struct avltree *tree, const char *name)
+{
+	struct standby_client *client = standby_lookup(tree, name);
+
+	if (client != NULL)
+		standby_free(tree, client);
+}
+
+static void standby_revoke(struct avltree *tree, const char *name,
+			   const char *rhdlstr)
+{
+	struct standby_client *client = standby_add(tree, name);
+	rdel_fh_t *rfh = gsh_malloc(sizeof(*rfh));
+
+	rfh->rdfh_handle_str = gsh_strdup(rhdlstr);
+	glist_add_tail(&client->rfh_list, &rfh->rdfh_list);
+}
+
+static void standby_reset(struct avltree *tree)
+{
+	struct avltree_node *node;
+
+	while ((node = avltree_first(tree)) != NULL)
+		standby_free(tree,
+			     avltree_container_of(node, struct standby_client,
+						  node));
+}
+
+static void standby_put(struct standby_buf *buf, const void *data,
+			size_t len)
+{
+	if (buf->len + len > buf->size) {
+		buf->size = MAX(buf->size * 2, buf->len + len + 4096);
+		buf->data = gsh_realloc(buf->data, buf->size);
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static void standby_put_str(struct standby_buf *buf, const char *str)
+{
+	uint16_t len = strlen(str);
+	uint16_t nlen = htons(len);
+
+	standby_put(buf, &nlen, sizeof(nlen));
+	standby_put(buf, str, len);
+}
+
+static void standby_encode(struct standby_buf *buf,
+			   enum standby_rec_type type, const char *name,
+			   const char *rhdlstr)
+{
+	uint8_t t = type;
+
+	standby_put(buf, &t, sizeof(t));
+	standby_put_str(buf, name);
+	if (type == STANDBY_REVOKE)
+		standby_put_str(buf, rhdlstr);
+}
+
+/**
+ * @brief Encode the whole mirror, for a new link
+ *
+ * @note standby_mtx MUST be held
+ */
+static void standby_encode_all(struct standby_buf *buf)
+{
+	struct avltree_node *node;
+	struct glist_head *glist;
+	struct standby_client *client;
+	rdel_fh_t *rfh;
+
+	standby_encode(buf, STANDBY_RESET, "", NULL);
+
+	for (node = avltree_first(&standby_mirror); node != NULL;
+	     node = avltree_next(node)) {
+		client = avltree_container_of(node, struct standby_client,
+					      node);
+		standby_encode(buf, STANDBY_ADD, client->name, NULL);
+		glist_for_each(glist, &client->rfh_list) {
+			rfh = glist_entry(glist, rdel_fh_t, rdfh_list);
+			standby_encode(buf, STANDBY_REVOKE, client->name,
+				       rfh->rdfh_handle_str);
+		}
+	}
+}
+
+/**
+ * @brief Record a change and queue it for the standby
+ *
+ * The mirror is updated even while the standby is unreachable, the
+ * record itself is only queued while it is connected.
+ */
+static void standby_queue(enum standby_rec_type type, const char *name,
+			  const char *rhdlstr)
+{
+	if (!standby_sending || name == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&standby_mtx);
+
+	switch (type) {
+	case STANDBY_ADD:
+		standby_add(&standby_mirror, name);
+		break;
+	case STANDBY_RM:
+		standby_rm(&standby_mirror, name);
+		break;
+	case STANDBY_REVOKE:
+		standby_revoke(&standby_mirror, name, rhdlstr);
+		break;
+	case STANDBY_RESET:
+		break;
+	}
+
+	if (standby_fd >= 0) {
+		standby_encode(&standby_out, type, name, rhdlstr);
+		pthread_cond_signal(&standby_cv);
+	}
+
+	PTHREAD_MUTEX_unlock(&standby_mtx);
+}
+
+void nfs4_standby_add_clid(const char *name)
+{
+	standby_queue(STANDBY_ADD, name, NULL);
+}
+
+void nfs4_standby_rm_clid(const char *name)
+{
+	standby_queue(STANDBY_RM, name, NULL);
+}
+
+void nfs4_standby_revoke(const char *name, const char *rhdlstr)
+{
+	standby_queue(STANDBY_REVOKE, name, rhdlstr);
+}
+
+static int standby_connect(void)
+{
+	struct addrinfo hints, *res, *ai;
+	char port[8];
+	int fd = -1;
+	int rc;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(port, sizeof(port), "%u",
+		 nfs_param.nfsv4_param.standby_port);
+
+	rc = getaddrinfo(nfs_param.nfsv4_param.standby_host, port, &hints,
+			 &res);
+	if (rc != 0) {
+		LogDebug(COMPONENT_CLIENTID, "Could not resolve standby %s: %s",
+			 nfs_param.nfsv4_param.standby_host, gai_strerror(rc));
+		return -1;
+	}
+
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+			    ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(res);
+
+	return fd;
+}
+
+static int standby_write(int fd, const char *data, size_t len)
+{
+	ssize_t rc;
+
+	while (len > 0) {
+		rc = send(fd, data, len, MSG_NOSIGNAL);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		data += rc;
+		len -= rc;
+	}
+
+	return 0;
+}
+
+static void *standby_sender(void *arg)
+{
+	struct standby_buf batch = {NULL, 0, 0};
+	struct timespec ts;
+	int fd;
+	int rc;
+
+	SetNameFunction("standby_send");
+
+	PTHREAD_MUTEX_lock(&standby_mtx);
+
+	for (;;) {
+		while (!standby_stop && standby_fd >= 0 &&
+		       standby_out.len == 0)
+			pthread_cond_wait(&standby_cv, &standby_mtx);
+
+		/* Send what was queued before stopping */
+		if (standby_stop &&
+		    (standby_fd < 0 || standby_out.len == 0))
+			break;
+
+		if (standby_fd < 0) {
+			PTHREAD_MUTEX_unlock(&standby_mtx);
+			fd = standby_connect();
+			PTHREAD_MUTEX_lock(&standby_mtx);
+
+			if (fd < 0) {
+				clock_gettime(CLOCK_REALTIME, &ts);
+				ts.tv_sec += STANDBY_RETRY_SEC;
+				pthread_cond_timedwait(&standby_cv,
+						       &standby_mtx, &ts);
+				continue;
+			}
+
+			LogEvent(COMPONENT_CLIENTID,
+				 "Replicating %" PRIu64 " clients to standby %s",
+				 avltree_size(&standby_mirror),
+				 nfs_param.nfsv4_param.standby_host);
+
+			standby_out.len = 0;
+			standby_encode_all(&standby_out);
+			standby_fd = fd;
+		}
+
+		/* Take the whole queue */
+		batch = standby_out;
+		standby_out.data = NULL;
+		standby_out.len = 0;
+		standby_out.size = 0;
+		fd = standby_fd;
+
+		PTHREAD_MUTEX_unlock(&standby_mtx);
+
+		rc = standby_write(fd, batch.data, batch.len);
+		gsh_free(batch.data);
+
+		PTHREAD_MUTEX_lock(&standby_mtx);
+
+		if (rc < 0) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Lost standby %s: %s",
+				 nfs_param.nfsv4_param.standby_host,
+				 strerror(-rc));
+			close(standby_fd);
+			standby_fd = -1;
+		}
+	}
+
+	if (standby_fd >= 0) {
+		close(standby_fd);
+		standby_fd = -1;
+	}
+
+	PTHREAD_MUTEX_unlock(&standby_mtx);
+
+	return NULL;
+}
+
+/**
+ * @brief Apply the complete records at the start of a buffer
+ *
+ * @return Bytes consumed, or -1 if the stream is corrupt.
+ */
+static ssize_t standby_apply(const char *data, size_t len)
+{
+	const char *p = data;
+	char name[PATH_MAX];
+	char rhdlstr[NAME_MAX];
+	uint16_t nlen, hlen;
+	uint8_t type;
+
+	while (len - (p - data) >= 3) {
+		const char *rec = p;
+		size_t left = len - (p - data);
+
+		type = p[0];
+		memcpy(&nlen, p + 1, sizeof(nlen));
+		nlen = ntohs(nlen);
+		if (nlen >= sizeof(name))
+			return -1;
+		if (left < 3 + (size_t) nlen)
+			break;
+		memcpy(name, p + 3, nlen);
+		name[nlen] = '\0';
+		p += 3 + nlen;
+
+		if (type == STANDBY_REVOKE) {
+			if (left < 5 + (size_t) nlen) {
+				p = rec;
+				break;
+			}
+			memcpy(&hlen, p, sizeof(hlen));
+			hlen = ntohs(hlen);
+			if (hlen >= sizeof(rhdlstr))
+				return -1;
+			if (left < 5 + (size_t) nlen + hlen) {
+				p = rec;
+				break;
+			}
+			memcpy(rhdlstr, p + 2, hlen);
+			rhdlstr[hlen] = '\0';
+			p += 2 + hlen;
+		}
+
+		PTHREAD_MUTEX_lock(&standby_mtx);
+		switch (type) {
+		case STANDBY_ADD:
+			standby_add(&standby_replica, name);
+			break;
+		case STANDBY_RM:
+			standby_rm(&standby_replica, name);
+			break;
+		case STANDBY_REVOKE:
+			standby_revoke(&standby_replica, name, rhdlstr);
+			break;
+		case STANDBY_RESET:
+			standby_reset(&standby_replica);
+			break;
+		default:
+			PTHREAD_MUTEX_unlock(&standby_mtx);
+			return -1;
+		}
+		PTHREAD_MUTEX_unlock(&standby_mtx);
+	}
+
+	return p - data;
+}
+
+static bool standby_should_stop(void)
+{
+	bool stop;
+
+	PTHREAD_MUTEX_lock(&standby_mtx);
+	stop = standby_stop;
+	PTHREAD_MUTEX_unlock(&standby_mtx);
+
+	return stop;
+}
+
+/**
+ * @brief Take the records of one active node until it goes away
+ */
+static void standby_receive(int fd, char *rbuf)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	size_t len = 0;
+	ssize_t rc;
+
+	while (!standby_should_stop()) {
+		if (poll(&pfd, 1, STANDBY_POLL_MS) <= 0)
+			continue;
+
+		rc = recv(fd, rbuf + len, STANDBY_RBUF_SIZE - len, 0);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			break;
+		len += rc;
+
+		rc = standby_apply(rbuf, len);
+		if (rc < 0) {
+			LogWarn(COMPONENT_CLIENTID,
+				"Corrupt record from the active node, dropping the link");
+			break;
+		}
+
+		len -= rc;
+		memmove(rbuf, rbuf + rc, len);
+	}
+}
+
+static void *standby_listener(void *arg)
+{
+	int lfd = (intptr_t) arg;
+	struct pollfd pfd = { .fd = lfd, .events = POLLIN };
+	char *rbuf = gsh_malloc(STANDBY_RBUF_SIZE);
+	int fd;
+
+	SetNameFunction("standby_recv");
+
+	while (!standby_should_stop()) {
+		if (poll(&pfd, 1, STANDBY_POLL_MS) <= 0)
+			continue;
+
+		fd = accept(lfd, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		LogEvent(COMPONENT_CLIENTID,
+			 "Active node connected, replicating its clients");
+
+		standby_receive(fd, rbuf);
+		close(fd);
+
+		PTHREAD_MUTEX_lock(&standby_mtx);
+		LogEvent(COMPONENT_CLIENTID,
+			 "Active node went away, holding %" PRIu64 " clients",
+			 avltree_size(&standby_replica));
+		PTHREAD_MUTEX_unlock(&standby_mtx);
+	}
+
+	gsh_free(rbuf);
+	close(lfd);
+
+	return NULL;
+}
+
+static int standby_listen(void)
+{
+	struct addrinfo hints, *res;
+	char port[8];
+	int one = 1;
+	int fd;
+	int rc;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET6;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	snprintf(port, sizeof(port), "%u",
+		 nfs_param.nfsv4_param.standby_listen_port);
+
+	rc = getaddrinfo(NULL, port, &hints, &res);
+	if (rc != 0) {
+		LogCrit(COMPONENT_CLIENTID, "getaddrinfo failed: %s",
+			gai_strerror(rc));
+		return -EINVAL;
+	}
+
+	fd = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC,
+		    res->ai_protocol);
+	if (fd < 0) {
+		rc = -errno;
+		goto out;
+	}
+
+	(void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	if (bind(fd, res->ai_addr, res->ai_addrlen) < 0 ||
+	    listen(fd, 1) < 0) {
+		rc = -errno;
+		close(fd);
+		goto out;
+	}
+
+	rc = fd;
+
+ out:
+	freeaddrinfo(res);
+	if (rc < 0)
+		LogCrit(COMPONENT_CLIENTID,
+			"Could not listen for the active node on port %u: %s",
+			nfs_param.nfsv4_param.standby_listen_port,
+			strerror(-rc));
+	return rc;
+}
+
+/**
+ * @brief Add the replicated clients to those allowed to reclaim
+ *
+ * Called when grace starts, the replica is only filled on a standby
+ * so this does nothing on the active node.  The replica is consumed,
+ * from now on this node is the one clients record themselves with.
+ *
+ * @note grace_mutex MUST be held
+ */
+void nfs4_standby_load_clids(void)
+{
+	struct avltree_node *node;
+	struct glist_head *glist;
+	struct standby_client *client;
+	clid_entry_t *clid_ent;
+	rdel_fh_t *rfh;
+	int count = 0;
+
+	PTHREAD_MUTEX_lock(&standby_mtx);
+
+	for (node = avltree_first(&standby_replica); node != NULL;
+	     node = avltree_next(node)) {
+		client = avltree_container_of(node, struct standby_client,
+					      node);
+
+		/* The recovery backend may list it too, reclaim copes
+		 * with a name listed twice.
+		 */
+		clid_ent = nfs4_add_clid_entry(client->name);
+		glist_for_each(glist, &client->rfh_list) {
+			rfh = glist_entry(glist, rdel_fh_t, rdfh_list);
+			nfs4_add_rfh_entry(clid_ent, rfh->rdfh_handle_str);
+		}
+		count++;
+	}
+
+	standby_reset(&standby_replica);
+
+	PTHREAD_MUTEX_unlock(&standby_mtx);
+
+	if (count != 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Taking over %d clients replicated from the active node",
+			 count);
+}
+
+/**
+ * @brief Start replicating to a standby and listening as one
+ *
+ * @return 0 or -errno.
+ */
+int nfs4_standby_init(void)
+{
+	int lfd;
+	int rc;
+
+	avltree_init(&standby_mirror, standby_client_cmpf, 0);
+	avltree_init(&standby_replica, standby_client_cmpf, 0);
+	standby_stop = false;
+
+	if (nfs_param.nfsv4_param.standby_listen_port != 0) {
+		lfd = standby_listen();
+		if (lfd < 0)
+			return lfd;
+
+		rc = pthread_create(&standby_listen_thread, NULL,
+				    standby_listener, (void *) (intptr_t) lfd);
+		if (rc != 0) {
+			LogCrit(COMPONENT_CLIENTID,
+				"Could not start standby listener thread: %s",
+				strerror(rc));
+			close(lfd);
+			return -rc;
+		}
+		standby_listening = true;
+	}
+
+	if (nfs_param.nfsv4_param.standby_host != NULL &&
+	    nfs_param.nfsv4_param.standby_port != 0) {
+		/* Before any client confirms, so the mirror is complete */
+		standby_sending = true;
+		rc = pthread_create(&standby_send_thread, NULL,
+				    standby_sender, NULL);
+		if (rc != 0) {
+			LogCrit(COMPONENT_CLIENTID,
+				"Could not start standby sender thread: %s",
+				strerror(rc));
+			standby_sending = false;
+			return -rc;
+		}
+	}
+
+	return 0;
+}
+
+void nfs4_standby_shutdown(void)
+{
+	PTHREAD_MUTEX_lock(&standby_mtx);
+	standby_stop = true;
+	pthread_cond_signal(&standby_cv);
+	PTHREAD_MUTEX_unlock(&standby_mtx);
+
+	if (standby_sending) {
+		/* The sender sends what is queued before it exits */
+		(void) pthread_join(standby_send_thread, NULL);
+		standby_sending = false;
+	}
+
+	if (standby_listening) {
+		(void) pthread_join(standby_listen_thread, NULL);
+		standby_listening = false;
+	}
+
+	PTHREAD_MUTEX_lock(&standby_mtx);
+	standby_reset(&standby_mirror);
+	standby_reset(&standby_replica);
+	gsh_free(standby_out.data);
+	standby_out.data = NULL;
+	standby_out.len = 0;
+	standby_out.size = 0;
+	PTHREAD_MUTEX_unlock(&standby_mtx);
+}
+
+/** @} */
@@ -52,6 +52,8 @@
 #include "fsal_up.h"
 #include "nfs_file_handle.h"
 #include "nfs_proto_tools.h"
+#include "delayed_exec.h"
+#include "fridgethr.h"
 #ifdef USE_LTTNG
 #include "gsh_lttng/state.h"
 #endif
@@ -98,6 +100,9 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 	state_status_t status = 0;
 	bool mutex_init = false;
 	struct state_t *openstate = NULL;
+	nfs_client_id_t *clientid =
+			owner_input->so_owner.so_nfs4_owner.so_clientrec;
+	uint32_t hard = nfs_param.nfsv4_param.client_states_hard;
 
 	if (isFullDebug(COMPONENT_STATE) && pnew_state != NULL) {
 		display_stateid(&dspbuf, pnew_state);
@@ -105,6 +110,16 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 		display_reset_buffer(&dspbuf);
 	}
 
+	if (hard != 0 &&
+	    atomic_fetch_int32_t(&clientid->cid_states) >= hard) {
+		LogDebug(COMPONENT_STATE,
+			 "Client %" PRIx64 " is at its limit of %" PRIu32
+			 " states",
+			 clientid->cid_clientid, hard);
+		status = STATE_RESOURCE_LIMIT;
+		goto errout;
+	}
+
 	/* Attempt to get a reference to the export. */
 	if (!export_ready(op_ctx->ctx_export)) {
 		/* If we could not get a reference, return stale.
@@ -133,7 +148,7 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 
 	mutex_init = true;
 
-	/* Add the stateid.other, this will increment cid_stateid_counter */
+	/* Start the stateid.other, nfs4_State_Set adds the slot */
 	nfs4_BuildStateId_Other(owner_input->so_owner.so_nfs4_owner.
 				so_clientrec, pnew_state->stateid_other);
 
@@ -184,6 +199,13 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 		goto errout;
 	}
 
+	if (atomic_inc_int32_t(&clientid->cid_states) ==
+	    nfs_param.nfsv4_param.client_states_soft)
+		LogWarn(COMPONENT_STATE,
+			"Client %" PRIx64 " reached %" PRIu32 " states",
+			clientid->cid_clientid,
+			nfs_param.nfsv4_param.client_states_soft);
+
 	/* Each of the following blocks takes the state_mutex and releases it
 	 * because we always want state_mutex to be the last lock taken.
 	 *
@@ -199,9 +221,16 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 	PTHREAD_MUTEX_unlock(&pnew_state->state_mutex);
 	PTHREAD_RWLOCK_unlock(&op_ctx->ctx_export->lock);
 
-	/* Add state to list for file */
+	/* Add state to list for file, or for directory delegations */
 	PTHREAD_MUTEX_lock(&pnew_state->state_mutex);
-	glist_add_tail(&ostate->file.list_of_states, &pnew_state->state_list);
+	if (obj->type == DIRECTORY) {
+		glist_add_tail(&ostate->dir.dir_delegs,
+			       &pnew_state->state_list);
+		(void) atomic_inc_uint32_t(&ostate->dir.num_dir_delegs);
+	} else {
+		glist_add_tail(&ostate->file.list_of_states,
+			       &pnew_state->state_list);
+	}
 	/* Get ref for this state entry */
 	obj->obj_ops.get_ref(obj);
 	PTHREAD_MUTEX_unlock(&pnew_state->state_mutex);
@@ -255,7 +284,8 @@ errout:
 		/* Make sure the new state is closed (may have been passed in
 		 * with file open).
 		 */
-		(void) obj->obj_ops.close2(obj, pnew_state);
+		if (obj->type == REGULAR_FILE)
+			(void) obj->obj_ops.close2(obj, pnew_state);
 
 		pnew_state->state_exp->exp_ops.free_state(pnew_state->state_exp,
 							  pnew_state);
@@ -314,15 +344,107 @@ state_status_t _state_add(struct fsal_obj_handle *obj,
 }
 
 /**
- * @brief Remove a state from a file
+ * @brief A closed open the FSAL still has open
+ *
+ * Holds the state's sentinel reference and references to the file,
+ * owner and export the open was for.  Once on parked_opens only the
+ * holder of the state_lock may take po_state; if the timer or the
+ * close thread has started by then, po_state is cleared and it frees
+ * this.
+ */
+struct state_parked {
+	struct glist_head po_list;	/*< On file.parked_opens */
+	struct delayed_timer po_timer;	/*< Closes it after Open_Reuse_Delay */
+	struct fsal_obj_handle *po_obj;
+	state_t *po_state;
+	state_owner_t *po_owner;
+	struct gsh_export *po_export;
+	fsal_openflags_t po_openflags;
+	bool po_reuse;		/*< Else only waiting for a close thread */
+};
+
+static void state_parked_free(struct state_parked *po)
+{
+	dec_state_owner_ref(po->po_owner);
+	put_gsh_export(po->po_export);
+	po->po_obj->obj_ops.put_ref(po->po_obj);
+	gsh_free(po);
+}
+
+/**
+ * @brief Take the state out of a parked open
  *
  * @note The state_lock MUST be held for write.
  *
- * @param[in]     state The state to remove
+ * @param[in] po The parked open
  *
+ * @return The state, still open, with only the sentinel reference.
  */
+static state_t *state_parked_take(struct state_parked *po)
+{
+	state_t *state = po->po_state;
 
-void _state_del_locked(state_t *state, const char *func, int line)
+	glist_del(&po->po_list);
+
+	if (delayed_timer_cancel(&po->po_timer)) {
+		/* The caller has its own reference to the file. */
+		state_parked_free(po);
+	} else {
+		/* The timer is waiting for the state_lock, let it go */
+		po->po_state = NULL;
+	}
+
+	return state;
+}
+
+static void state_parked_expire(void *arg)
+{
+	struct state_parked *po = arg;
+	struct fsal_obj_handle *obj = po->po_obj;
+	struct root_op_context root_op_context;
+	state_t *state;
+
+	init_root_op_context(&root_op_context, po->po_export,
+			     po->po_export->fsal_export, 0, 0,
+			     UNKNOWN_REQUEST);
+
+	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+
+	state = po->po_state;
+	if (state != NULL) {
+		glist_del(&po->po_list);
+		(void) obj->obj_ops.close2(obj, state);
+	}
+
+	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+
+	if (state != NULL)
+		dec_state_t_ref(state);
+
+	state_parked_free(po);
+
+	release_root_op_context();
+}
+
+static void state_parked_close(struct fridgethr_context *ctx)
+{
+	state_parked_expire(ctx->arg);
+}
+
+/**
+ * @brief Remove a state from a file
+ *
+ * @note The state_lock MUST be held for write.
+ *
+ * @param[in] state The state to remove
+ * @param[in] park  Keep it open if nobody else holds a reference
+ * @param[in] reuse Keep it for reuse, else for a close thread
+ * @param[in] func  Caller, for tracing
+ * @param[in] line  Caller, for tracing
+ */
+
+static void state_del_impl(state_t *state, bool park, bool reuse,
+			   const char *func, int line)
 {
 	char str[LOG_BUFF_LEN];
 	struct display_buffer dspbuf = {sizeof(str), str, str};
@@ -330,6 +452,7 @@ void _state_del_locked(state_t *state, const char *func, int line)
 	struct fsal_obj_handle *obj;
 	struct gsh_export *export;
 	state_owner_t *owner;
+	struct state_parked *po;
 
 	if (isDebug(COMPONENT_STATE)) {
 		display_stateid(&dspbuf, state);
@@ -375,6 +498,13 @@ void _state_del_locked(state_t *state, const char *func, int line)
 	owner = state->state_owner;
 	PTHREAD_MUTEX_unlock(&state->state_mutex);
 
+	/* References for the parked open, dropped if we can't park */
+	park = park && owner != NULL;
+	if (park) {
+		inc_state_owner_ref(owner);
+		get_gsh_export_ref(export);
+	}
+
 	/* Don't cleanup when ref is dropped, as this could recurse into here.
 	 * Caller must have a ref anyway.
 	 */
@@ -383,12 +513,17 @@ void _state_del_locked(state_t *state, const char *func, int line)
 	/* Remove from the list of states for a particular file */
 	PTHREAD_MUTEX_lock(&state->state_mutex);
 	glist_del(&state->state_list);
+	if (obj->type == DIRECTORY)
+		(void) atomic_dec_uint32_t(
+				&obj->state_hdl->dir.num_dir_delegs);
 	/* Put ref for this state entry */
 	obj->obj_ops.put_ref(obj);
 	state->state_obj = NULL;
 	PTHREAD_MUTEX_unlock(&state->state_mutex);
 
-	if (obj->fsal->m_ops.support_ex(obj)) {
+	/* Only files are ever open */
+	if (obj->fsal->m_ops.support_ex(obj) && !park &&
+	    obj->type == REGULAR_FILE) {
 		/* We need to close the state at this point. The state will
 		 * eventually be freed and it must be closed before free. This
 		 * is the last point we have a valid reference to the object
@@ -403,6 +538,9 @@ void _state_del_locked(state_t *state, const char *func, int line)
 
 		nfs4_owner = &owner->so_owner.so_nfs4_owner;
 
+		(void) atomic_dec_int32_t(
+				&nfs4_owner->so_clientrec->cid_states);
+
 		/* Remove from list of states owned by owner and
 		 * release the state owner reference.
 		 */
@@ -495,6 +633,53 @@ void _state_del_locked(state_t *state, const char *func, int line)
 	PTHREAD_MUTEX_unlock(&all_state_v4_mutex);
 #endif
 
+	/* Nothing can find the state now, so if the caller's is the only
+	 * other reference, the sentinel one can go to a parked open.
+	 */
+	if (park && atomic_fetch_int32_t(&state->state_refcount) == 2) {
+		po = gsh_malloc(sizeof(*po));
+		po->po_obj = obj;
+		po->po_state = state;
+		po->po_owner = owner;
+		po->po_export = export;
+		po->po_openflags = obj->obj_ops.status2(obj, state) &
+				   FSAL_O_RDWR;
+		po->po_reuse = reuse;
+		obj->obj_ops.get_ref(obj);
+
+		glist_add_tail(&obj->state_hdl->file.parked_opens,
+			       &po->po_list);
+
+		delayed_timer_init(&po->po_timer, state_parked_expire, po);
+		if (reuse) {
+			delayed_timer_add(&po->po_timer,
+				(nsecs_elapsed_t)
+				nfs_param.nfsv4_param.open_reuse_delay
+				* NS_PER_MSEC);
+		} else if (fridgethr_submit(state_close_fridge,
+					    state_parked_close, po) != 0) {
+			/* No thread took it, close it here */
+			glist_del(&po->po_list);
+			(void) obj->obj_ops.close2(obj, state);
+			dec_state_t_ref(state);
+			state_parked_free(po);
+			str_valid = false;
+		}
+
+		if (str_valid)
+			LogFullDebug(COMPONENT_STATE, "Parked %s", str);
+
+		obj->obj_ops.put_ref(obj);
+		obj->state_hdl->no_cleanup = false;
+		return;
+	}
+
+	if (park) {
+		(void) obj->obj_ops.close2(obj, state);
+		dec_state_owner_ref(owner);
+		put_gsh_export(export);
+	}
+
 	/* Remove the sentinel reference */
 	dec_state_t_ref(state);
 
@@ -503,6 +688,150 @@ void _state_del_locked(state_t *state, const char *func, int line)
 	obj->state_hdl->no_cleanup = false;
 }
 
+void _state_del_locked(state_t *state, const char *func, int line)
+{
+	state_del_impl(state, false, false, func, line);
+}
+
+/**
+ * @brief Remove an open state on CLOSE
+ *
+ * If Open_Reuse_Delay is set, a read-only open that denies nothing is
+ * left open in the FSAL for that long, so state_reuse_parked_locked()
+ * can hand it to another OPEN of the file by the same owner.  Else,
+ * with Async_Close_Threads, the FSAL close is left to a close thread,
+ * and the CLOSE does not wait for it.  The stateid goes away as with
+ * state_del_locked().
+ *
+ * @note The state_lock MUST be held for write, and the caller must
+ *       hold a reference to the state.
+ *
+ * @param[in] state The open state being closed
+ * @param[in] func  Caller, for tracing
+ * @param[in] line  Caller, for tracing
+ */
+
+void _state_close_locked(state_t *state, const char *func, int line)
+{
+	struct fsal_obj_handle *obj = state->state_obj;
+	bool park, reuse;
+
+	park = state->state_type == STATE_TYPE_SHARE &&
+	       obj != NULL && obj->type == REGULAR_FILE &&
+	       obj->fsal->m_ops.support_ex(obj);
+
+	reuse = park && nfs_param.nfsv4_param.open_reuse_delay != 0 &&
+	       state->state_data.share.share_access ==
+			OPEN4_SHARE_ACCESS_READ &&
+	       state->state_data.share.share_deny == OPEN4_SHARE_DENY_NONE;
+
+	park = reuse || (park && state_close_fridge != NULL);
+
+	state_del_impl(state, park, reuse, func, line);
+}
+
+/**
+ * @brief Reuse a parked open for an OPEN
+ *
+ * @note The state_lock MUST be held for write.
+ *
+ * @param[in] obj       File being opened
+ * @param[in] owner     Open owner
+ * @param[in] openflags Access asked for, nothing else
+ *
+ * @return A state the FSAL has open, ready for state_add_impl(), or
+ *         NULL.
+ */
+
+state_t *state_reuse_parked_locked(struct fsal_obj_handle *obj,
+				   state_owner_t *owner,
+				   fsal_openflags_t openflags)
+{
+	struct glist_head *glist;
+	struct state_parked *po;
+	state_t *state;
+
+	glist_for_each(glist, &obj->state_hdl->file.parked_opens) {
+		po = glist_entry(glist, struct state_parked, po_list);
+
+		if (!po->po_reuse || po->po_owner != owner ||
+		    po->po_export != op_ctx->ctx_export ||
+		    po->po_openflags != openflags)
+			continue;
+
+		state = state_parked_take(po);
+
+		/* state_add_impl starts it over */
+		PTHREAD_MUTEX_destroy(&state->state_mutex);
+		memset(&state->state_read_pattern, 0,
+		       sizeof(state->state_read_pattern));
+
+		LogFullDebug(COMPONENT_STATE, "Reusing parked open %p",
+			     state);
+
+		return state;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Close every parked open on a file
+ *
+ * Used before share reservations that deny anything are checked,
+ * since the parked opens still count as readers.
+ *
+ * @note The state_lock MUST be held for write.
+ *
+ * @param[in] obj File
+ */
+
+void state_flush_parked_locked(struct fsal_obj_handle *obj)
+{
+	struct glist_head *glist, *glistn;
+	struct state_parked *po;
+	state_t *state;
+
+	glist_for_each_safe(glist, glistn,
+			    &obj->state_hdl->file.parked_opens) {
+		po = glist_entry(glist, struct state_parked, po_list);
+		state = state_parked_take(po);
+
+		(void) obj->obj_ops.close2(obj, state);
+		dec_state_t_ref(state);
+	}
+}
+
+/**
+ * @brief Finish the closes a close thread has yet to do on a file
+ *
+ * Used before the file is opened again, so the FSAL sees its closes
+ * and opens in the order the clients sent them.
+ *
+ * @note The state_lock MUST be held for write.
+ *
+ * @param[in] obj File
+ */
+
+void state_flush_closing_locked(struct fsal_obj_handle *obj)
+{
+	struct glist_head *glist, *glistn;
+	struct state_parked *po;
+	state_t *state;
+
+	glist_for_each_safe(glist, glistn,
+			    &obj->state_hdl->file.parked_opens) {
+		po = glist_entry(glist, struct state_parked, po_list);
+		if (po->po_reuse)
+			continue;
+
+		state = state_parked_take(po);
+
+		(void) obj->obj_ops.close2(obj, state);
+		dec_state_t_ref(state);
+	}
+}
+
 /**
  * @brief Delete a state
  *
@@ -913,7 +1242,8 @@ void revoke_owner_delegs(state_owner_t *client_owner)
 		state_deleg_revoke(obj, state);
 		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
 
-		if (!obj->fsal->m_ops.support_ex(obj)) {
+		if (!obj->fsal->m_ops.support_ex(obj) &&
+		    obj->type == REGULAR_FILE) {
 			/* Close the file in FSAL */
 			obj->obj_ops.close(obj);
 		}
@@ -63,11 +63,46 @@
 #include "city.h"
 
 /**
- * @brief Hash table for stateids.
+ * @brief Hash table of LOCK and SHARE states by entry/owner.
  */
-hash_table_t *ht_state_id;
 hash_table_t *ht_state_obj;
 
+/**
+ * @brief Stateid index
+ *
+ * The last four bytes of a stateid other hold a slot in this table and
+ * the slot's generation, so looking a stateid up is an array access.
+ * The generation changes each time a slot is reused and the whole
+ * other is compared, so a stale stateid never finds a newer state.
+ *
+ * The table grows a chunk at a time and chunks never move, so lookups
+ * only need the lock stripe covering the slot.  Freed slots go to the
+ * tail of the free list and a minimum number are kept free, which
+ * spreads reuse over the table and makes generations wrap slowly.
+ */
+#define STATEID_CHUNK_BITS 12
+#define STATEID_CHUNK_SLOTS (1 << STATEID_CHUNK_BITS)
+#define STATEID_CHUNKS (1 << (STATEID_SLOT_BITS - STATEID_CHUNK_BITS))
+#define STATEID_FREE_MIN 1024
+#define STATEID_LOCKS 64
+#define STATEID_NO_SLOT UINT32_MAX
+
+struct stateid_slot {
+	state_t *state;		/*< NULL if free or not yet set */
+	uint32_t next_free;	/*< Free list link */
+	uint8_t gen;		/*< Generation of the current or next state */
+};
+
+static struct stateid_slot *stateid_chunks[STATEID_CHUNKS];
+static pthread_rwlock_t stateid_locks[STATEID_LOCKS];
+
+/* Allocation state, protected by stateid_alloc_mtx */
+static pthread_mutex_t stateid_alloc_mtx = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t stateid_nslots;
+static uint32_t stateid_nfree;
+static uint32_t stateid_free_head = STATEID_NO_SLOT;
+static uint32_t stateid_free_tail = STATEID_NO_SLOT;
+
 /**
  * @brief All-zeroes stateid4.other
  */
@@ -90,7 +125,7 @@ char all_ones[OTHERSIZE];
 int display_stateid_other(struct display_buffer *dspbuf, char *other)
 {
 	uint64_t clientid = *((uint64_t *) other);
-	uint32_t count    = *((uint32_t *) (other + sizeof(uint64_t)));
+	uint32_t idx    = *((uint32_t *) (other + sizeof(uint64_t)));
 	int b_left = display_cat(dspbuf, "OTHER=");
 
 	if (b_left <= 0)
@@ -111,23 +146,9 @@ int display_stateid_other(struct display_buffer *dspbuf, char *other)
 	if (b_left <= 0)
 		return b_left;
 
-	return display_printf(dspbuf, "} StateIdCounter=0x%08"PRIx32"}", count);
-}
-
-/**
- * @brief Display a stateid other in the hash table
- *
- * @param[in]  buff The key
- * @param[out] str  Output buffer
- *
- * @return Length of output string.
- */
-int display_state_id_key(struct gsh_buffdesc *buff, char *str)
-{
-	struct display_buffer dspbuf = {HASHTABLE_DISPLAY_STRLEN, str, str};
-
-	display_stateid_other(&dspbuf, buff->addr);
-	return display_buffer_len(&dspbuf);
+	return display_printf(dspbuf, "} Slot=%" PRIu32 " Gen=%" PRIu32 "}",
+			      idx & STATEID_SLOT_MASK,
+			      idx >> STATEID_SLOT_BITS);
 }
 
 /**
@@ -235,95 +256,6 @@ int display_state_id_val(struct gsh_buffdesc *buff, char *str)
 	return display_buffer_len(&dspbuf);
 }
 
-/**
- * @brief Compare two stateids
- *
- * @param[in] buff1 One key
- * @param[in] buff2 Another key
- *
- * @retval 0 if equal.
- * @retval 1 if not equal.
- */
-int compare_state_id(struct gsh_buffdesc *buff1, struct gsh_buffdesc *buff2)
-{
-	if (isFullDebug(COMPONENT_STATE)) {
-		char str1[DISPLAY_STATEID_OTHER_SIZE];
-		char str2[DISPLAY_STATEID_OTHER_SIZE];
-		struct display_buffer dspbuf1 = {sizeof(str1), str1, str1};
-		struct display_buffer dspbuf2 = {sizeof(str2), str2, str2};
-
-		display_stateid_other(&dspbuf1, buff1->addr);
-		display_stateid_other(&dspbuf2, buff2->addr);
-
-		if (isDebug(COMPONENT_HASHTABLE))
-			LogFullDebug(COMPONENT_STATE, "{%s} vs {%s}", str1,
-				     str2);
-	}
-
-	return memcmp(buff1->addr, buff2->addr, OTHERSIZE);
-}				/* compare_state_id */
-
-/**
- * @brief Hash a stateid
- *
- * @param[in] stateid Array aliased to stateid
- */
-static inline uint32_t compute_stateid_hash_value(uint32_t *stateid)
-{
-	return stateid[1] ^ stateid[2];
-}
-
-/**
- * @brief Hash index for a stateid
- *
- * @param[in] hparam Hash parameter
- * @param[in] key    Key to hash
- *
- * @return The hash index.
- */
-uint32_t state_id_value_hash_func(hash_parameter_t *hparam,
-				  struct gsh_buffdesc *key)
-{
-	uint32_t val =
-	    compute_stateid_hash_value(key->addr) % hparam->index_size;
-
-	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "val = %" PRIu32, val);
-
-	return val;
-}
-
-/**
- * @brief RBT hash for a stateid
- *
- * @param[in] hparam Hash parameter
- * @param[in] key    Key to hash
- *
- * @return The RBT hash.
- */
-uint64_t state_id_rbt_hash_func(hash_parameter_t *hparam,
-				struct gsh_buffdesc *key)
-{
-	uint64_t val = compute_stateid_hash_value(key->addr);
-
-	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "rbt = %" PRIu64, val);
-
-	return val;
-}
-
-static hash_parameter_t state_id_param = {
-	.index_size = PRIME_STATE,
-	.hash_func_key = state_id_value_hash_func,
-	.hash_func_rbt = state_id_rbt_hash_func,
-	.compare_key = compare_state_id,
-	.key_to_str = display_state_id_key,
-	.val_to_str = display_state_id_val,
-	.flags = HT_FLAG_CACHE,
-	.ht_log_component = COMPONENT_STATE,
-	.ht_name = "State ID Table"
-};
-
 /**
  * @brief Compare two stateids by entry/owner
  *
@@ -431,29 +363,27 @@ static hash_parameter_t state_obj_param = {
 	.compare_key = compare_state_obj,
 	.key_to_str = display_state_id_val,
 	.val_to_str = display_state_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_OPEN,
 	.ht_log_component = COMPONENT_STATE,
 	.ht_name = "State Obj Table"
 };
 
 /**
- * @brief Init the hashtable for stateids
+ * @brief Init the stateid table and the entry/owner hashtable
  *
  * @retval 0 if successful.
  * @retval -1 on failure.
  */
 int nfs4_Init_state_id(void)
 {
+	int i;
+
 	/* Init  all_one */
 	memset(all_zero, 0, OTHERSIZE);
 	memset(all_ones, 0xFF, OTHERSIZE);
 
-	ht_state_id = hashtable_init(&state_id_param);
-
-	if (ht_state_id == NULL) {
-		LogCrit(COMPONENT_STATE, "Cannot init State Id cache");
-		return -1;
-	}
+	for (i = 0; i < STATEID_LOCKS; i++)
+		PTHREAD_RWLOCK_init(&stateid_locks[i], NULL);
 
 	ht_state_obj = hashtable_init(&state_obj_param);
 
@@ -468,23 +398,147 @@ int nfs4_Init_state_id(void)
 /**
  * @brief Build the 12 byte "other" portion of a stateid
  *
- * It is built from the ServerEpoch and a 64 bit global counter.
+ * The first part of the other is the 64 bit clientid, which consists
+ * of the epoch in the high order 32 bits followed by the clientid
+ * counter in the low order 32 bits.  The stateid index that follows
+ * is filled in by nfs4_State_Set.
  *
- * @param[in] other stateid.other object (a char[OTHERSIZE] string)
+ * @param[in]  clientid Client the state belongs to
+ * @param[out] other    stateid.other object (a char[OTHERSIZE] string)
  */
 void nfs4_BuildStateId_Other(nfs_client_id_t *clientid, char *other)
 {
-	uint32_t my_stateid =
-	    atomic_inc_uint32_t(&clientid->cid_stateid_counter);
-
-	/* The first part of the other is the 64 bit clientid, which
-	 * consists of the epoch in the high order 32 bits followed by
-	 * the clientid counter in the low order 32 bits.
-	 */
 	memcpy(other, &clientid->cid_clientid, sizeof(clientid->cid_clientid));
+	memset(other + sizeof(clientid->cid_clientid), 0,
+	       OTHERSIZE - sizeof(clientid->cid_clientid));
+}
+
+static inline uint32_t stateid_index(const char *other)
+{
+	uint32_t idx;
+
+	memcpy(&idx, other + sizeof(clientid4), sizeof(idx));
+	return idx;
+}
+
+static inline struct stateid_slot *stateid_slot(uint32_t slot)
+{
+	struct stateid_slot *chunk = atomic_fetch_voidptr(
+		(void **)&stateid_chunks[slot >> STATEID_CHUNK_BITS]);
+
+	if (chunk == NULL)
+		return NULL;
+
+	return &chunk[slot & (STATEID_CHUNK_SLOTS - 1)];
+}
+
+static inline pthread_rwlock_t *stateid_lock(uint32_t slot)
+{
+	return &stateid_locks[slot % STATEID_LOCKS];
+}
+
+/**
+ * @brief Take a slot off the free list, growing the table if needed
+ *
+ * @return The slot or STATEID_NO_SLOT if the table is full.
+ */
+static uint32_t stateid_slot_alloc(void)
+{
+	struct stateid_slot *chunk;
+	uint32_t slot, i;
+
+	PTHREAD_MUTEX_lock(&stateid_alloc_mtx);
+
+	if (stateid_nfree <= STATEID_FREE_MIN &&
+	    stateid_nslots < STATEID_CHUNKS * STATEID_CHUNK_SLOTS) {
+		chunk = gsh_calloc(STATEID_CHUNK_SLOTS, sizeof(*chunk));
+
+		for (i = 0; i < STATEID_CHUNK_SLOTS; i++)
+			chunk[i].next_free = STATEID_NO_SLOT;
+
+		atomic_store_voidptr(
+		    (void **)&stateid_chunks[stateid_nslots >>
+					     STATEID_CHUNK_BITS],
+		    chunk);
+
+		for (i = 0; i < STATEID_CHUNK_SLOTS; i++) {
+			slot = stateid_nslots + i;
+			if (stateid_free_tail == STATEID_NO_SLOT)
+				stateid_free_head = slot;
+			else
+				stateid_slot(stateid_free_tail)->next_free =
+				    slot;
+			stateid_free_tail = slot;
+		}
+
+		stateid_nslots += STATEID_CHUNK_SLOTS;
+		stateid_nfree += STATEID_CHUNK_SLOTS;
+	}
+
+	slot = stateid_free_head;
+
+	if (slot != STATEID_NO_SLOT) {
+		stateid_free_head = stateid_slot(slot)->next_free;
+		if (stateid_free_head == STATEID_NO_SLOT)
+			stateid_free_tail = STATEID_NO_SLOT;
+		stateid_nfree--;
+	}
+
+	PTHREAD_MUTEX_unlock(&stateid_alloc_mtx);
+
+	return slot;
+}
+
+/**
+ * @brief Return a slot to the tail of the free list
+ *
+ * The slot's state must already have been cleared.
+ */
+static void stateid_slot_free(uint32_t slot)
+{
+	struct stateid_slot *s = stateid_slot(slot);
+
+	PTHREAD_MUTEX_lock(&stateid_alloc_mtx);
+
+	s->gen++;
+	s->next_free = STATEID_NO_SLOT;
+
+	if (stateid_free_tail == STATEID_NO_SLOT)
+		stateid_free_head = slot;
+	else
+		stateid_slot(stateid_free_tail)->next_free = slot;
+
+	stateid_free_tail = slot;
+	stateid_nfree++;
+
+	PTHREAD_MUTEX_unlock(&stateid_alloc_mtx);
+}
+
+/**
+ * @brief Clear a slot if it still holds state
+ *
+ * @retval true if the slot held state and was freed.
+ */
+static bool stateid_slot_clear(uint32_t slot, state_t *state)
+{
+	struct stateid_slot *s = stateid_slot(slot);
+	pthread_rwlock_t *lock = stateid_lock(slot);
+	bool cleared = false;
+
+	if (s == NULL)
+		return false;
+
+	PTHREAD_RWLOCK_wrlock(lock);
+	if (s->state == state) {
+		s->state = NULL;
+		cleared = true;
+	}
+	PTHREAD_RWLOCK_unlock(lock);
+
+	if (cleared)
+		stateid_slot_free(slot);
 
-	memcpy(other + sizeof(clientid->cid_clientid), &my_stateid,
-	       sizeof(my_stateid));
+	return cleared;
 }
 
 /**
@@ -536,26 +590,30 @@ int nfs4_State_Set(state_t *state)
 {
 	struct gsh_buffdesc buffkey;
 	struct gsh_buffdesc buffval;
+	struct stateid_slot *s;
+	pthread_rwlock_t *lock;
 	hash_error_t err;
+	uint32_t slot, idx;
 
-	buffkey.addr = state->stateid_other;
-	buffkey.len = OTHERSIZE;
-
-	buffval.addr = state;
-	buffval.len = sizeof(state_t);
-
-	err = hashtable_test_and_set(ht_state_id,
-				     &buffkey,
-				     &buffval,
-				     HASHTABLE_SET_HOW_SET_NO_OVERWRITE);
+	slot = stateid_slot_alloc();
 
-	if (err != HASHTABLE_SUCCESS) {
-		LogCrit(COMPONENT_STATE,
-			"hashtable_test_and_set failed %s for key %p",
-			hash_table_err_to_str(err), buffkey.addr);
+	if (slot == STATEID_NO_SLOT) {
+		LogCrit(COMPONENT_STATE, "Stateid table is full");
 		return 0;
 	}
 
+	s = stateid_slot(slot);
+	lock = stateid_lock(slot);
+
+	/* The generation only changes while the slot is free */
+	idx = ((uint32_t) s->gen << STATEID_SLOT_BITS) | slot;
+	memcpy(state->stateid_other + sizeof(clientid4), &idx,
+	       sizeof(idx));
+
+	PTHREAD_RWLOCK_wrlock(lock);
+	s->state = state;
+	PTHREAD_RWLOCK_unlock(lock);
+
 	/* If stateid is a LOCK or SHARE state, we also index by entry/owner */
 	if (state->state_type != STATE_TYPE_LOCK &&
 	    state->state_type != STATE_TYPE_SHARE)
@@ -577,14 +635,9 @@ int nfs4_State_Set(state_t *state)
 				     HASHTABLE_SET_HOW_SET_OVERWRITE);
 
 	if (err != HASHTABLE_SUCCESS) {
-		struct gsh_buffdesc buffkey, old_key, old_value;
-
-		buffkey.addr = state->stateid_other;
-		buffkey.len = OTHERSIZE;
-
 		LogCrit(COMPONENT_STATE,
 			"hashtable_test_and_set failed %s for key %p",
-			hash_table_err_to_str(err), buffkey.addr);
+			hash_table_err_to_str(err), state->stateid_other);
 
 		if (isFullDebug(COMPONENT_STATE)) {
 			char str[LOG_BUFF_LEN];
@@ -605,14 +658,7 @@ int nfs4_State_Set(state_t *state)
 			}
 		}
 
-		err = HashTable_Del(ht_state_id, &buffkey,
-				    &old_key, &old_value);
-
-		if (err != HASHTABLE_SUCCESS) {
-			LogDebug(COMPONENT_STATE,
-				 "Failure to delete stateid %s",
-				 hash_table_err_to_str(err));
-		}
+		(void) stateid_slot_clear(slot, state);
 		return 0;
 	}
 
@@ -628,31 +674,33 @@ int nfs4_State_Set(state_t *state)
  */
 struct state_t *nfs4_State_Get_Pointer(char *other)
 {
-	struct gsh_buffdesc buffkey;
-	struct gsh_buffdesc buffval;
-	hash_error_t rc;
-	struct hash_latch latch;
-	struct state_t *state;
+	uint32_t idx = stateid_index(other);
+	uint32_t slot = idx & STATEID_SLOT_MASK;
+	struct stateid_slot *s = stateid_slot(slot);
+	pthread_rwlock_t *lock = stateid_lock(slot);
+	struct state_t *state = NULL;
+
+	if (s == NULL) {
+		LogDebug(COMPONENT_STATE, "Stateid slot %" PRIu32 " unused",
+			 slot);
+		return NULL;
+	}
 
-	buffkey.addr = other;
-	buffkey.len = OTHERSIZE;
+	PTHREAD_RWLOCK_rdlock(lock);
 
-	rc = hashtable_getlatch(ht_state_id, &buffkey, &buffval, true, &latch);
+	if (s->state != NULL && s->gen == idx >> STATEID_SLOT_BITS &&
+	    memcmp(s->state->stateid_other, other, OTHERSIZE) == 0) {
+		state = s->state;
 
-	if (rc != HASHTABLE_SUCCESS) {
-		if (rc == HASHTABLE_ERROR_NO_SUCH_KEY)
-			hashtable_releaselatched(ht_state_id, &latch);
-		LogDebug(COMPONENT_STATE, "HashTable_Get returned %d", rc);
-		return NULL;
+		/* Take a reference under the lock */
+		inc_state_t_ref(state);
 	}
 
-	state = buffval.addr;
-
-	/* Take a reference under latch */
-	inc_state_t_ref(state);
+	PTHREAD_RWLOCK_unlock(lock);
 
-	/* Release latch */
-	hashtable_releaselatched(ht_state_id, &latch);
+	if (state == NULL)
+		LogDebug(COMPONENT_STATE, "No state in stateid slot %" PRIu32,
+			 slot);
 
 	return state;
 }
@@ -717,33 +765,16 @@ struct state_t *nfs4_State_Get_Obj(struct fsal_obj_handle *obj,
  */
 bool nfs4_State_Del(state_t *state)
 {
-	struct gsh_buffdesc buffkey, old_key, old_value;
+	struct gsh_buffdesc buffkey, old_value;
 	struct hash_latch latch;
 	hash_error_t err;
 
-	buffkey.addr = state->stateid_other;
-	buffkey.len = OTHERSIZE;
-
-	err = HashTable_Del(ht_state_id, &buffkey, &old_key, &old_value);
-
-	if (err == HASHTABLE_ERROR_NO_SUCH_KEY) {
+	if (!stateid_slot_clear(stateid_index(state->stateid_other) &
+				STATEID_SLOT_MASK, state)) {
 		/* Already gone */
 		return false;
-	} else if (err != HASHTABLE_SUCCESS) {
-		char str[LOG_BUFF_LEN];
-		struct display_buffer dspbuf = {sizeof(str), str, str};
-
-		display_stateid(&dspbuf, state);
-
-		LogDebug(COMPONENT_STATE,
-			 "Failure to delete stateid %s %s",
-			 str,
-			 hash_table_err_to_str(err));
-		return false;
 	}
 
-	assert(state == old_value.addr);
-
 	/* If stateid is a LOCK or SHARE state, we had also indexed by
 	 * entry/owner
 	 */
@@ -751,11 +782,9 @@ bool nfs4_State_Del(state_t *state)
 	    state->state_type != STATE_TYPE_SHARE)
 		return true;
 
-	/* Delete the stateid hashed by entry/owner.
-	 * Use the old_value from above as the key.
-	 */
-	buffkey.addr = old_value.addr;
-	buffkey.len = old_value.len;
+	/* Delete the stateid hashed by entry/owner. */
+	buffkey.addr = state;
+	buffkey.len = sizeof(state_t);
 
 	/* Get latch: we need to check we're deleting the right state */
 	err = hashtable_getlatch(ht_state_obj, &buffkey, &old_value, true,
@@ -956,21 +985,14 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 				/* We don't expect this, but, just in case...
 				 * Update and release already reserved lease.
 				 */
-				PTHREAD_MUTEX_lock(&data->preserved_clientid
-						   ->cid_mutex);
 				update_lease(data->preserved_clientid);
-				PTHREAD_MUTEX_unlock(&data->preserved_clientid
-						     ->cid_mutex);
 				data->preserved_clientid = NULL;
 			}
 
 			/* Check if lease is expired and reserve it */
-			PTHREAD_MUTEX_lock(&pclientid->cid_mutex);
-
 			if (!reserve_lease(pclientid)) {
 				LogDebug(COMPONENT_STATE,
 					 "Returning NFS4ERR_EXPIRED");
-				PTHREAD_MUTEX_unlock(&pclientid->cid_mutex);
 				status = NFS4ERR_EXPIRED;
 				goto failure;
 			}
@@ -986,7 +1008,6 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 				 */
 				data->preserved_clientid = pclientid;
 			}
-			PTHREAD_MUTEX_unlock(&pclientid->cid_mutex);
 
 			/* Replayed close, it's ok, but stateid doesn't exist */
 			LogDebug(COMPONENT_STATE,
@@ -1004,12 +1025,9 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 			 * midst of tear down due to expired lease or if
 			 * in fact the entry is actually stale.
 			 */
-			PTHREAD_MUTEX_lock(&pclientid->cid_mutex);
-
 			if (!reserve_lease(pclientid)) {
 				LogDebug(COMPONENT_STATE,
 					 "Returning NFS4ERR_EXPIRED");
-				PTHREAD_MUTEX_unlock(&pclientid->cid_mutex);
 
 				/* Release the clientid reference we just
 				 * acquired.
@@ -1023,7 +1041,6 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 			 * clientid NULL.
 			 */
 			update_lease(pclientid);
-			PTHREAD_MUTEX_unlock(&pclientid->cid_mutex);
 
 			/* The lease was valid, so this must be a stale
 			 * entry.
@@ -1043,37 +1060,21 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 			/* We don't expect this to happen, but, just in case...
 			 * Update and release already reserved lease.
 			 */
-			PTHREAD_MUTEX_lock(&data->preserved_clientid
-					   ->cid_mutex);
-
 			update_lease(data->preserved_clientid);
-
-			PTHREAD_MUTEX_unlock(&data->preserved_clientid
-					     ->cid_mutex);
-
 			data->preserved_clientid = NULL;
 		}
 
 		/* Check if lease is expired and reserve it */
-		PTHREAD_MUTEX_lock(
-		    &owner2->so_owner.so_nfs4_owner.so_clientrec->cid_mutex);
-
 		if (!reserve_lease(
 				owner2->so_owner.so_nfs4_owner.so_clientrec)) {
 			LogDebug(COMPONENT_STATE, "Returning NFS4ERR_EXPIRED");
 
-			PTHREAD_MUTEX_unlock(&owner2->so_owner.so_nfs4_owner
-					     .so_clientrec->cid_mutex);
-
 			status = NFS4ERR_EXPIRED;
 			goto failure;
 		}
 
 		data->preserved_clientid =
 		    owner2->so_owner.so_nfs4_owner.so_clientrec;
-
-		PTHREAD_MUTEX_unlock(
-		    &owner2->so_owner.so_nfs4_owner.so_clientrec->cid_mutex);
 	}
 
 	/* Sanity check : Is this the right file ? */
@@ -1231,8 +1232,29 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 
 void nfs_State_PrintAll(void)
 {
-	if (isFullDebug(COMPONENT_STATE))
-		hashtable_log(COMPONENT_STATE, ht_state_id);
+	char str[LOG_BUFF_LEN];
+	struct display_buffer dspbuf = {sizeof(str), str, str};
+	struct stateid_slot *s;
+	uint32_t slot, nslots;
+
+	if (!isFullDebug(COMPONENT_STATE))
+		return;
+
+	PTHREAD_MUTEX_lock(&stateid_alloc_mtx);
+	nslots = stateid_nslots;
+	PTHREAD_MUTEX_unlock(&stateid_alloc_mtx);
+
+	for (slot = 0; slot < nslots; slot++) {
+		s = stateid_slot(slot);
+
+		PTHREAD_RWLOCK_rdlock(stateid_lock(slot));
+		if (s->state != NULL) {
+			display_reset_buffer(&dspbuf);
+			display_stateid(&dspbuf, s->state);
+			LogFullDebug(COMPONENT_STATE, "%s", str);
+		}
+		PTHREAD_RWLOCK_unlock(stateid_lock(slot));
+	}
 }
 
 /**
@@ -104,8 +104,9 @@ int display_nsm_client(struct display_buffer *dspbuf, state_nsm_client_t *key)
 
 	return display_printf(dspbuf, " ssc_client=%p %s refcount=%d",
 			      key->ssc_client,
-			      atomic_fetch_int32_t(&key->ssc_monitored)
-					? "monitored" : "unmonitored",
+			      atomic_fetch_int32_t(&key->ssc_monitored) ==
+					NSM_UNMONITORED
+					? "unmonitored" : "monitored",
 			      atomic_fetch_int32_t(&key->ssc_refcount));
 }
 
@@ -717,7 +718,8 @@ static hash_parameter_t nlm_owner_hash_param = {
 	.compare_key = compare_nlm_owner_key,
 	.key_to_str = display_nlm_owner_key,
 	.val_to_str = display_nlm_owner_val,
-	.flags = HT_FLAG_NONE,
+	.flags = HT_FLAG_OPEN,
+	.cache_entry_count = 1024,
 };
 
 /**
@@ -727,6 +729,17 @@ static hash_parameter_t nlm_owner_hash_param = {
  */
 int Init_nlm_hash(void)
 {
+	uint32_t clients = nfs_param.core_param.nlm_clients;
+
+	/* A partition for every 16 clients, and for every other client in
+	 * the owner table since clients have several lock owners.
+	 */
+	nsm_client_hash_param.index_size =
+		hashtable_prime(MAX(PRIME_STATE, clients / 16));
+	nlm_client_hash_param.index_size = nsm_client_hash_param.index_size;
+	nlm_owner_hash_param.index_size =
+		hashtable_prime(MAX(PRIME_STATE, MIN(clients / 2, 1021)));
+
 	ht_nsm_client = hashtable_init(&nsm_client_hash_param);
 
 	if (ht_nsm_client == NULL) {
@@ -1045,6 +1058,7 @@ void free_nlm_client(state_nlm_client_t *client)
 	if (client->slc_nlm_caller_name != NULL)
 		gsh_free(client->slc_nlm_caller_name);
 
+	PTHREAD_MUTEX_destroy(&client->slc_async_mutex);
 	gsh_free(client);
 }
 
@@ -1252,6 +1266,8 @@ state_nlm_client_t *get_nlm_client(care_t care, SVCXPRT *xprt,
 
 	/* Copy everything over */
 	memcpy(pclient, &key, sizeof(key));
+	PTHREAD_MUTEX_init(&pclient->slc_async_mutex, NULL);
+	glist_init(&pclient->slc_async_queue);
 
 	pclient->slc_nlm_caller_name = gsh_strdup(key.slc_nlm_caller_name);
 
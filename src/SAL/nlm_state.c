@@ -38,6 +38,7 @@
 #include <netdb.h>
 
 #include "city.h"
+#include "gsh_config.h"
 #include "sal_functions.h"
 #include "nsm.h"
 #include "log.h"
@@ -230,7 +231,8 @@ static hash_parameter_t nlm_state_hash_param = {
 	.compare_key = compare_nlm_state_key,
 	.key_to_str = display_nlm_state_key,
 	.val_to_str = display_nlm_state_val,
-	.flags = HT_FLAG_NONE,
+	.flags = HT_FLAG_OPEN,
+	.cache_entry_count = 1024,
 };
 
 /**
@@ -240,6 +242,12 @@ static hash_parameter_t nlm_state_hash_param = {
  */
 int Init_nlm_state_hash(void)
 {
+	/* As for the owner table, see Init_nlm_hash */
+	nlm_state_hash_param.index_size =
+		hashtable_prime(MAX(PRIME_STATE,
+				    MIN(nfs_param.core_param.nlm_clients / 2,
+					1021)));
+
 	ht_nlm_states = hashtable_init(&nlm_state_hash_param);
 
 	if (ht_nlm_states == NULL) {
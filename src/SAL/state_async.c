@@ -51,6 +51,8 @@
 
 struct fridgethr *state_async_fridge;
 struct fridgethr *state_poll_fridge;
+/** FSAL closes left by CLOSE, NULL without Async_Close_Threads */
+struct fridgethr *state_close_fridge;
 
 /**
  * @brief Process a blocked lock request
@@ -173,6 +175,21 @@ state_status_t state_async_init(void)
 		return STATE_INIT_ENTRY_FAILED;
 	}
 
+	if (nfs_param.nfsv4_param.async_close_threads != 0) {
+		memset(&frp, 0, sizeof(struct fridgethr_params));
+		frp.thr_max = nfs_param.nfsv4_param.async_close_threads;
+		frp.deferment = fridgethr_defer_queue;
+
+		rc = fridgethr_init(&state_close_fridge, "state_close", &frp);
+
+		if (rc != 0) {
+			LogMajor(COMPONENT_STATE,
+				 "Unable to initialize state close thread fridge: %d",
+				 rc);
+			return STATE_INIT_ENTRY_FAILED;
+		}
+	}
+
 	return STATE_SUCCESS;
 }
 
@@ -183,7 +200,7 @@ state_status_t state_async_init(void)
  */
 state_status_t state_async_shutdown(void)
 {
-	int rc1, rc2;
+	int rc1, rc2, rc = 0;
 
 	rc1 = fridgethr_sync_command(state_async_fridge,
 				     fridgethr_comm_stop,
@@ -212,7 +229,24 @@ state_status_t state_async_shutdown(void)
 			 rc2);
 	}
 
-	return ((rc1 == 0) && (rc2 == 0)) ? STATE_SUCCESS : STATE_SIGNAL_ERROR;
+	if (state_close_fridge != NULL) {
+		rc = fridgethr_sync_command(state_close_fridge,
+					    fridgethr_comm_stop,
+					    120);
+
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_STATE,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(state_close_fridge);
+		} else if (rc != 0) {
+			LogMajor(COMPONENT_STATE,
+				 "Failed shutting down state close thread: %d",
+				 rc);
+		}
+	}
+
+	return ((rc1 == 0) && (rc2 == 0) && (rc == 0)) ?
+		STATE_SUCCESS : STATE_SIGNAL_ERROR;
 }
 
 /** @} */
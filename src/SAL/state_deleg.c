@@ -128,6 +128,7 @@ void init_new_deleg_state(union state_data *deleg_state,
 	deleg_state->deleg.sd_type = deleg_type;
 	deleg_state->deleg.sd_grant_time = time(NULL);
 	deleg_state->deleg.sd_state = DELEG_GRANTED;
+	deleg_state->deleg.sd_notify = 0;
 
 	clfile_entry->cfd_rs_time = 0;
 	clfile_entry->cfd_r_time = 0;
@@ -286,22 +287,113 @@ static int advance_avg(time_t prev_avg, time_t new_time,
 	return ((prev_tot * prev_avg) + new_time) / curr_tot;
 }
 
+/* Adaptive delegation policy.
+ *
+ * When a delegation ends we estimate what it was worth, in operations:
+ * the opens it absorbed, taken as the file's open rate times the time
+ * it was held, against what its recall cost.  A recall costs the
+ * CB_RECALL and DELEGRETURN plus the conflicting opener sitting on
+ * NFS4ERR_DELAY for as long as the recall took, and a revoke costs it
+ * a whole lease.  Running averages of that estimate are kept for the
+ * file and for the client, and a delegation is only offered while
+ * neither is negative.  Decisions are a few seconds apart so the
+ * scores are kept with plain atomic loads and stores; a lost update
+ * only makes an average a little stale.
+ */
+#define DELEG_BENEFIT_MAX 1000	/*< Cap on one delegation's saving */
+#define DELEG_RECALL_OPS 2	/*< CB_RECALL and DELEGRETURN */
+#define DELEG_STALL_OPS 10	/*< Cost of a second of blocked opener */
+#define DELEG_SCORE_SHIFT 2	/*< Averages move 1/4 of the way */
+#define DELEG_SCORE_FORGET 300	/*< Seconds before a score is retried */
+
+/* Current value of a score, forgotten once it has gone untouched */
+static inline int32_t deleg_score(int32_t *score, time_t *when)
+{
+	if (time(NULL) - atomic_fetch_time_t(when) > DELEG_SCORE_FORGET)
+		return 0;
+
+	return atomic_fetch_int32_t(score);
+}
+
+static inline void deleg_score_update(int32_t *score, time_t *when,
+				      int32_t net)
+{
+	int32_t old = deleg_score(score, when);
+
+	atomic_store_int32_t(score,
+			     old + ((net - old) >> DELEG_SCORE_SHIFT));
+	atomic_store_time_t(when, time(NULL));
+}
+
 /**
- * @brief Update statistics on successfully recalled delegation.
+ * @brief Estimate what an ending delegation saved, net of its cost
+ */
+static int32_t deleg_net_benefit(struct file_deleg_stats *statistics,
+				 struct state_t *deleg, bool revoked)
+{
+	time_t now = time(NULL);
+	time_t recalled = deleg->state_data.deleg.sd_clfile_stats.cfd_r_time;
+	time_t held = (recalled != 0 ? recalled : now) -
+		      deleg->state_data.deleg.sd_grant_time;
+	time_t span = now - statistics->fds_first_open + 1;
+	int64_t benefit = 0;
+	int64_t cost = 0;
+
+	if (statistics->fds_first_open != 0 && held > 0)
+		benefit = (int64_t) statistics->fds_num_opens * held / span;
+	if (benefit > DELEG_BENEFIT_MAX)
+		benefit = DELEG_BENEFIT_MAX;
+
+	if (recalled != 0) {
+		/* The opener waits at least one retry even when the
+		 * recall is answered within the second.
+		 */
+		cost = DELEG_RECALL_OPS +
+		       DELEG_STALL_OPS * (now - recalled + 1);
+	}
+
+	if (revoked)
+		cost += DELEG_STALL_OPS *
+			(int64_t) nfs_param.nfsv4_param.lease_lifetime;
+
+	if (cost > DELEG_BENEFIT_MAX * 4)
+		cost = DELEG_BENEFIT_MAX * 4;
+
+	return benefit - cost;
+}
+
+/**
+ * @brief Update statistics on a delegation that was returned or revoked.
  *
- * Update statistics on successfully recalled delegation.
- * Note: This should be called only when a delegation is successfully recalled.
+ * Note: This should be called only once per delegation, when it is
+ * returned or revoked.
  *
- * @param[in] deleg Delegation state
+ * @param[in] obj     File the delegation was on
+ * @param[in] owner   Owner of the delegation
+ * @param[in] deleg   Delegation state
+ * @param[in] revoked Whether the delegation was revoked
  */
 void deleg_heuristics_recall(struct fsal_obj_handle *obj,
 			     state_owner_t *owner,
-			     struct state_t *deleg)
+			     struct state_t *deleg,
+			     bool revoked)
 {
 	nfs_client_id_t *client = owner->so_owner.so_nfs4_owner.so_clientrec;
 	/* Update delegation stats for file. */
 	struct file_deleg_stats *statistics =
 		&obj->state_hdl->file.fdeleg_stats;
+	int32_t net = deleg_net_benefit(statistics, deleg, revoked);
+
+	deleg_score_update(&statistics->fds_deleg_score,
+			   &statistics->fds_score_time, net);
+	deleg_score_update(&client->cid_deleg_score,
+			   &client->cid_deleg_score_time, net);
+
+	LogDebug(COMPONENT_STATE,
+		 "Delegation %s, net %" PRId32 " file score %" PRId32
+		 " client score %" PRId32,
+		 revoked ? "revoked" : "returned", net,
+		 statistics->fds_deleg_score, client->cid_deleg_score);
 
 	statistics->fds_curr_delegations--;
 	statistics->fds_recall_count++;
@@ -346,6 +438,8 @@ bool init_deleg_heuristics(struct fsal_obj_handle *obj)
 	statistics->fds_avg_hold = 0;
 	statistics->fds_num_opens = 0;
 	statistics->fds_first_open = 0;
+	statistics->fds_deleg_score = 0;
+	statistics->fds_score_time = 0;
 
 	return true;
 }
@@ -431,6 +525,21 @@ bool should_we_grant_deleg(struct state_hdl *ostate, nfs_client_id_t *client,
 	if (client->num_revokes > 2) /* more than 2 revokes */
 		return false;
 
+	/* Only delegate where past delegations paid for their recalls */
+	if (nfs_param.nfsv4_param.adaptive_delegations &&
+	    (deleg_score(&file_stats->fds_deleg_score,
+			 &file_stats->fds_score_time) < 0 ||
+	     deleg_score(&client->cid_deleg_score,
+			 &client->cid_deleg_score_time) < 0)) {
+		LogDebug(COMPONENT_STATE,
+			 "Not delegating, file score %" PRId32
+			 " client score %" PRId32,
+			 file_stats->fds_deleg_score,
+			 client->cid_deleg_score);
+		inc_deleg_declines(client->gsh_client);
+		return false;
+	}
+
 	LogDebug(COMPONENT_STATE, "Let's delegate!!");
 	return true;
 }
@@ -492,7 +601,11 @@ nfsstat4 deleg_revoke(struct fsal_obj_handle *obj, struct state_t *deleg_state)
 	/* Building a new fh ; Ignore return code, should not fail*/
 	(void) nfs4_FSALToFhandle(true, &fhandle, obj, export);
 
-	deleg_heuristics_recall(obj, owner, deleg_state);
+	/* Directory delegations have no heuristics and no lease */
+	if (obj->type != REGULAR_FILE)
+		goto del;
+
+	deleg_heuristics_recall(obj, owner, deleg_state, true);
 
 	/* Build op_context for state_unlock_locked */
 	init_root_op_context(&root_op_context, NULL, NULL, 0, 0,
@@ -511,6 +624,7 @@ nfsstat4 deleg_revoke(struct fsal_obj_handle *obj, struct state_t *deleg_state)
 			 state_status);
 	}
 
+ del:
 	/* Put the revoked delegation on the stable storage. */
 	nfs4_record_revoke(clid, &fhandle);
 	state_del_locked(deleg_state);
@@ -670,3 +784,228 @@ bool can_we_grant_deleg(struct state_hdl *ostate, state_t *open_state)
 
 	return true;
 }
+
+/*
+ * Directory delegations
+ *
+ * A directory delegation lets a client cache the directory's entries.
+ * Entries added, removed or renamed in it by other clients are either
+ * sent to the holder in a CB_NOTIFY, when it asked for that kind of
+ * notification, or recall the delegation.
+ */
+
+/* Room for the XDR of a notification besides its names */
+#define DIR_NOTIFY_OVERHEAD 96
+
+/**
+ * @brief A CB_NOTIFY queued for a directory delegation
+ */
+struct dir_notify_context {
+	struct nfs_cb_batch_op dnc_op;	/*< The CB_NOTIFY */
+	nfs_client_id_t *dnc_clid;	/*< Referenced client */
+	stateid4 dnc_stateid;		/*< The delegation */
+	notify4 dnc_notify;		/*< The change */
+	char dnc_body[];		/*< XDR of the change */
+};
+
+/**
+ * @brief Check whether a directory has delegations
+ *
+ * Lock-free, for callers to skip state_dir_deleg_notify() cheaply.
+ *
+ * @param[in] dir The directory
+ *
+ * @return true if a delegation may be held.
+ */
+bool state_dir_deleg_held(struct fsal_obj_handle *dir)
+{
+	return dir->type == DIRECTORY && dir->state_hdl != NULL &&
+	       atomic_fetch_uint32_t(&dir->state_hdl->dir.num_dir_delegs) != 0;
+}
+
+static void dir_notify_completion(struct nfs_cb_batch_op *op,
+				  rpc_call_hook hook, nfsstat4 status)
+{
+	struct dir_notify_context *dnc =
+		container_of(op, struct dir_notify_context, dnc_op);
+	struct state_t *state;
+	struct fsal_obj_handle *obj;
+
+	if (hook == RPC_CALL_COMPLETE && status == NFS4_OK)
+		goto out;
+
+	LogDebug(COMPONENT_NFS_CB,
+		 "CB_NOTIFY failed, hook %d status %d, recalling",
+		 hook, status);
+
+	/* The client may have missed the change, it must not go on
+	 * trusting its cache.
+	 */
+	state = nfs4_State_Get_Pointer(dnc->dnc_stateid.other);
+	if (state == NULL)
+		goto out;
+
+	obj = get_state_obj_ref(state);
+	if (obj != NULL) {
+		PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+		delegrecall_state(obj, state);
+		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+		obj->obj_ops.put_ref(obj);
+	}
+
+	dec_state_t_ref(state);
+
+ out:
+	nfs4_freeFH(&op->arg.nfs_cb_argop4_u.opcbnotify.cna_fh);
+	dec_client_id_ref(dnc->dnc_clid);
+	gsh_free(dnc);
+}
+
+static void dir_notify_entry(notify_entry4 *entry, const char *name)
+{
+	entry->ne_file.utf8string_len = strlen(name);
+	entry->ne_file.utf8string_val = (char *) name;
+}
+
+/**
+ * @brief Queue a CB_NOTIFY for one directory delegation
+ *
+ * Entries are sent without attributes and with no cookies, the client
+ * only learns their names.
+ *
+ * @param[in] dir      The directory
+ * @param[in] state    The delegation
+ * @param[in] export   Export the delegation was granted through
+ * @param[in] clid     Client holding it
+ * @param[in] type     NOTIFY4_ADD_ENTRY, _REMOVE_ENTRY or _RENAME_ENTRY
+ * @param[in] name     Entry name, the new one for a rename
+ * @param[in] old_name Old entry name of a rename
+ *
+ * @return true if queued.
+ */
+static bool dir_deleg_send_notify(struct fsal_obj_handle *dir,
+				  struct state_t *state,
+				  struct gsh_export *export,
+				  nfs_client_id_t *clid, notify_type4 type,
+				  const char *name, const char *old_name)
+{
+	size_t size = strlen(name) + DIR_NOTIFY_OVERHEAD +
+		      (old_name != NULL ? strlen(old_name) : 0);
+	struct dir_notify_context *dnc = gsh_calloc(1, sizeof(*dnc) + size);
+	CB_NOTIFY4args *arg = &dnc->dnc_op.arg.nfs_cb_argop4_u.opcbnotify;
+	notify_remove4 rm;
+	notify_add4 add;
+	notify_rename4 rn;
+	XDR xdrs;
+	bool ok;
+
+	if (get_cb_chan_down(clid))
+		goto fail;
+
+	memset(&rm, 0, sizeof(rm));
+	memset(&add, 0, sizeof(add));
+	memset(&rn, 0, sizeof(rn));
+
+	xdrmem_create(&xdrs, dnc->dnc_body, size, XDR_ENCODE);
+
+	switch (type) {
+	case NOTIFY4_REMOVE_ENTRY:
+		dir_notify_entry(&rm.nrm_old_entry, name);
+		ok = xdr_notify_remove4(&xdrs, &rm);
+		break;
+	case NOTIFY4_ADD_ENTRY:
+		dir_notify_entry(&add.nad_new_entry, name);
+		ok = xdr_notify_add4(&xdrs, &add);
+		break;
+	default:
+		dir_notify_entry(&rn.nrn_old_entry.nrm_old_entry, old_name);
+		dir_notify_entry(&rn.nrn_new_entry.nad_new_entry, name);
+		ok = xdr_notify_rename4(&xdrs, &rn);
+		break;
+	}
+
+	dnc->dnc_notify.notify_vals.notifylist4_len = xdr_getpos(&xdrs);
+	xdr_destroy(&xdrs);
+
+	if (!ok || !nfs4_FSALToFhandle(true, &arg->cna_fh, dir, export))
+		goto fail;
+
+	dnc->dnc_notify.notify_mask.bitmap4_len = 1;
+	dnc->dnc_notify.notify_mask.map[0] = 1U << type;
+	dnc->dnc_notify.notify_vals.notifylist4_val = dnc->dnc_body;
+
+	dnc->dnc_op.arg.argop = NFS4_OP_CB_NOTIFY;
+	COPY_STATEID(&arg->cna_stateid, state);
+	arg->cna_changes.cna_changes_len = 1;
+	arg->cna_changes.cna_changes_val = &dnc->dnc_notify;
+
+	dnc->dnc_op.refer = state->state_refer;
+	dnc->dnc_op.has_refer = true;
+	dnc->dnc_op.completion = dir_notify_completion;
+
+	COPY_STATEID(&dnc->dnc_stateid, state);
+	inc_client_id_ref(clid);
+	dnc->dnc_clid = clid;
+
+	nfs_rpc_cb_batch(clid, &dnc->dnc_op);
+	return true;
+
+ fail:
+	gsh_free(dnc);
+	return false;
+}
+
+/**
+ * @brief Tell the holders of a directory's delegations of a change
+ *
+ * Called after an entry of the directory was added, removed or renamed.
+ * The client making the change is not told.  Other holders are sent a
+ * CB_NOTIFY if they asked for this kind of change, or else recalled.
+ *
+ * @param[in] dir      The directory
+ * @param[in] type     NOTIFY4_ADD_ENTRY, _REMOVE_ENTRY or _RENAME_ENTRY
+ * @param[in] name     Entry name, the new one for a rename
+ * @param[in] old_name Old entry name of a rename, or NULL
+ */
+void state_dir_deleg_notify(struct fsal_obj_handle *dir, notify_type4 type,
+			    const char *name, const char *old_name)
+{
+	struct glist_head *glist, *glistn;
+	struct state_t *state;
+	struct gsh_export *export;
+	state_owner_t *owner;
+	nfs_client_id_t *clid;
+
+	if (!state_dir_deleg_held(dir))
+		return;
+
+	PTHREAD_RWLOCK_wrlock(&dir->state_hdl->state_lock);
+
+	glist_for_each_safe(glist, glistn, &dir->state_hdl->dir.dir_delegs) {
+		state = glist_entry(glist, struct state_t, state_list);
+
+		if (state->state_data.deleg.sd_state != DELEG_GRANTED)
+			continue;
+
+		if (!get_state_obj_export_owner_refs(state, NULL, &export,
+						     &owner))
+			continue;
+
+		clid = owner->so_owner.so_nfs4_owner.so_clientrec;
+
+		if (op_ctx != NULL && op_ctx->clientid != NULL &&
+		    *op_ctx->clientid == clid->cid_clientid)
+			goto next;
+
+		if (!(state->state_data.deleg.sd_notify & (1U << type)) ||
+		    !dir_deleg_send_notify(dir, state, export, clid, type,
+					   name, old_name))
+			delegrecall_state(dir, state);
+
+ next:
+		dec_state_owner_ref(owner);
+		put_gsh_export(export);
+	}
+
+	PTHREAD_RWLOCK_unlock(&dir->state_hdl->state_lock);
+}
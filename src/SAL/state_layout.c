@@ -47,6 +47,234 @@
 #include "nfs_core.h"
 #include "nfs_proto_tools.h"
 
+/*
+ * Segment index
+ *
+ * Every segment on a layout state's state_segments list is also in
+ * state_segment_tree, an AVL tree ordered by offset in which each node
+ * records the last byte covered anywhere in its subtree, as the lock
+ * index of state_lock.c does for locks.  Finding the segments that
+ * may overlap a range costs O(log n) per segment found instead of a
+ * walk of the whole list, which matters for files with many small
+ * segments.
+ *
+ * A segment covers offset to offset + length inclusive here, matching
+ * pnfs_segments_overlap(), which callers still apply for io_mode.
+ */
+
+static inline uint64_t segment_last(const struct pnfs_segment *segment)
+{
+	if (segment->length == NFS4_UINT64_MAX ||
+	    segment->offset > NFS4_UINT64_MAX - segment->length)
+		return NFS4_UINT64_MAX;
+
+	return segment->offset + segment->length;
+}
+
+static inline state_layout_segment_t *segment_index_entry(
+					struct avltree_node *node)
+{
+	return avltree_container_of(node, state_layout_segment_t, sls_tree);
+}
+
+/**
+ * @brief Order indexed segments by offset, then by address
+ */
+static int segment_index_cmpf(const struct avltree_node *lhs,
+			      const struct avltree_node *rhs)
+{
+	state_layout_segment_t *lk = segment_index_entry(
+					(struct avltree_node *)lhs);
+	state_layout_segment_t *rk = segment_index_entry(
+					(struct avltree_node *)rhs);
+
+	if (lk->sls_segment.offset < rk->sls_segment.offset)
+		return -1;
+
+	if (lk->sls_segment.offset > rk->sls_segment.offset)
+		return 1;
+
+	if (lk == rk)
+		return 0;
+
+	return lk < rk ? -1 : 1;
+}
+
+/**
+ * @brief Recompute the last byte covered in a subtree
+ */
+static void segment_index_augment(struct avltree_node *node)
+{
+	state_layout_segment_t *segment = segment_index_entry(node);
+	uint64_t max_end = segment_last(&segment->sls_segment);
+
+	if (node->left &&
+	    segment_index_entry(node->left)->sls_max_end > max_end)
+		max_end = segment_index_entry(node->left)->sls_max_end;
+
+	if (node->right &&
+	    segment_index_entry(node->right)->sls_max_end > max_end)
+		max_end = segment_index_entry(node->right)->sls_max_end;
+
+	segment->sls_max_end = max_end;
+}
+
+/**
+ * @brief Initialize the segment index of a new layout state
+ *
+ * @param[in,out] state The layout state
+ */
+void state_layout_index_init(state_t *state)
+{
+	glist_init(&state->state_data.layout.state_segments);
+	avltree_init(&state->state_data.layout.state_segment_tree,
+		     segment_index_cmpf, 0);
+	avltree_set_augment(&state->state_data.layout.state_segment_tree,
+			    segment_index_augment);
+	state->state_data.layout.state_segment_count = 0;
+}
+
+/**
+ * @brief Find the first segment in a subtree ending at or after an offset
+ */
+static state_layout_segment_t *segment_index_descend(struct avltree_node *node,
+						     uint64_t start)
+{
+	while (node != NULL) {
+		state_layout_segment_t *segment = segment_index_entry(node);
+
+		if (node->left &&
+		    segment_index_entry(node->left)->sls_max_end >= start)
+			node = node->left;
+		else if (segment_last(&segment->sls_segment) >= start)
+			return segment;
+		else if (node->right &&
+			 segment_index_entry(node->right)->sls_max_end >= start)
+			node = node->right;
+		else
+			break;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Find the first segment of a layout state that may overlap a range
+ *
+ * Together with state_layout_segment_next() this visits, in order of
+ * offset, every segment overlapping the range whatever its io_mode.
+ * The current segment may be deleted once its successor was found.
+ *
+ * @note state_lock must be held.
+ *
+ * @param[in] state The layout state
+ * @param[in] range The range
+ *
+ * @return The first segment or NULL.
+ */
+state_layout_segment_t *state_layout_segment_first(state_t *state,
+					const struct pnfs_segment *range)
+{
+	state_layout_segment_t *segment;
+
+	segment = segment_index_descend(
+			state->state_data.layout.state_segment_tree.root,
+			range->offset);
+
+	if (segment == NULL ||
+	    segment->sls_segment.offset > segment_last(range))
+		return NULL;
+
+	return segment;
+}
+
+/**
+ * @brief Find the next segment of a layout state that may overlap a range
+ *
+ * @param[in] segment Previous segment from state_layout_segment_first()
+ *                    or state_layout_segment_next()
+ * @param[in] range   The range
+ *
+ * @return The next segment or NULL.
+ */
+state_layout_segment_t *state_layout_segment_next(
+					state_layout_segment_t *segment,
+					const struct pnfs_segment *range)
+{
+	struct avltree_node *node = &segment->sls_tree;
+	struct avltree_node *parent;
+	state_layout_segment_t *next = NULL;
+	uint64_t start = range->offset;
+	uint64_t end = segment_last(range);
+
+	if (node->right &&
+	    segment_index_entry(node->right)->sls_max_end >= start) {
+		next = segment_index_descend(node->right, start);
+	} else {
+		/* Climb to each ancestor reached from its left subtree,
+		 * that is the ancestor itself and then its right subtree.
+		 */
+		while ((parent = avltree_parent(node)) != NULL) {
+			if (parent->left == node) {
+				next = segment_index_entry(parent);
+
+				if (next->sls_segment.offset > end)
+					return NULL;
+
+				if (segment_last(&next->sls_segment) >= start)
+					break;
+
+				next = NULL;
+
+				if (parent->right &&
+				    segment_index_entry(parent->right)->
+				    sls_max_end >= start) {
+					next = segment_index_descend(
+							parent->right, start);
+					break;
+				}
+			}
+			node = parent;
+		}
+	}
+
+	if (next == NULL || next->sls_segment.offset > end)
+		return NULL;
+
+	return next;
+}
+
+/**
+ * @brief Take a segment out of the index before changing its range
+ *
+ * The segment stays on state_segments and must be given back to
+ * state_segment_reindex() once its new range is set.
+ *
+ * @note state_lock must be held for write.
+ *
+ * @param[in] segment The segment
+ */
+void state_segment_unindex(state_layout_segment_t *segment)
+{
+	avltree_remove(&segment->sls_tree,
+		       &segment->sls_state->state_data.layout.
+		       state_segment_tree);
+}
+
+/**
+ * @brief Put a segment back in the index after changing its range
+ *
+ * @note state_lock must be held for write.
+ *
+ * @param[in] segment The segment
+ */
+void state_segment_reindex(state_layout_segment_t *segment)
+{
+	avltree_insert(&segment->sls_tree,
+		       &segment->sls_state->state_data.layout.
+		       state_segment_tree);
+}
+
 /**
  * @brief Add a segment to an existing layout state
  *
@@ -90,6 +318,9 @@ state_status_t state_add_segment(state_t *state, struct pnfs_segment *segment,
 
 	glist_add_tail(&state->state_data.layout.state_segments,
 		       &new_segment->sls_state_segments);
+	avltree_insert(&new_segment->sls_tree,
+		       &state->state_data.layout.state_segment_tree);
+	state->state_data.layout.state_segment_count++;
 
 	/* Based on comments by Benny Halevy, if any segment is marked
 	   return_on_close, all segments should be treated as
@@ -111,7 +342,11 @@ state_status_t state_add_segment(state_t *state, struct pnfs_segment *segment,
  */
 state_status_t state_delete_segment(state_layout_segment_t *segment)
 {
+	struct state_layout *layout = &segment->sls_state->state_data.layout;
+
 	glist_del(&segment->sls_state_segments);
+	avltree_remove(&segment->sls_tree, &layout->state_segment_tree);
+	layout->state_segment_count--;
 	gsh_free(segment);
 	return STATE_SUCCESS;
 }
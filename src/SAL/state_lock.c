@@ -39,6 +39,7 @@
 #include <sys/param.h>
 #include <time.h>
 #include <pthread.h>
+#include <sched.h>
 #include <string.h>
 
 #include "log.h"
@@ -72,14 +73,40 @@
  */
 
 #ifdef DEBUG_SAL
+/**
+ * @brief Number of all locks shards, a power of 2
+ */
+#define STATE_ALL_LOCKS_SHARDS 32
+
 /**
  * @brief All locks.
+ *
+ * Split by the CPU that created the lock, so that locking different
+ * files on different CPUs doesn't serialize on one mutex. Only
+ * dump_all_locks() looks at every shard.
  */
-static struct glist_head state_all_locks = GLIST_HEAD_INIT(state_all_locks);
+static struct state_all_locks_shard {
+	pthread_mutex_t mtx;	/*< Protects list */
+	struct glist_head list;	/*< Locks created on this shard */
+} __attribute__ ((aligned(64))) state_all_locks[STATE_ALL_LOCKS_SHARDS];
+
 /**
- * @brief All locks mutex
+ * @brief Pick the all locks shard for a new lock
+ *
+ * @param[in] lock_entry New lock
+ *
+ * @return Shard index.
  */
-pthread_mutex_t all_locks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static inline uint32_t all_locks_shard(state_lock_entry_t *lock_entry)
+{
+	int cpu = sched_getcpu();
+
+	if (cpu < 0)
+		return (((uintptr_t) lock_entry) >> 6) &
+			(STATE_ALL_LOCKS_SHARDS - 1);
+
+	return ((uint32_t) cpu) & (STATE_ALL_LOCKS_SHARDS - 1);
+}
 #endif
 
 /**
@@ -92,6 +119,13 @@ struct glist_head state_blocked_locks = GLIST_HEAD_INIT(state_blocked_locks);
  */
 pthread_mutex_t blocked_locks_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/**
+ * @brief Slab cache for lock entries
+ */
+static struct gsh_slab state_lock_entry_slab =
+	GSH_SLAB_ARENA_INITIALIZER("state_lock_entry_t",
+				   sizeof(state_lock_entry_t), MEM_ARENA_SAL);
+
 /**
  * @brief Owner of state with no defined owner
  */
@@ -144,6 +178,15 @@ state_status_t state_lock_init(void)
 {
 	state_status_t status = STATE_SUCCESS;
 
+#ifdef DEBUG_SAL
+	int i;
+
+	for (i = 0; i < STATE_ALL_LOCKS_SHARDS; i++) {
+		PTHREAD_MUTEX_init(&state_all_locks[i].mtx, NULL);
+		glist_init(&state_all_locks[i].list);
+	}
+#endif
+
 	ht_lock_cookies = hashtable_init(&cookie_param);
 	if (ht_lock_cookies == NULL) {
 		LogCrit(COMPONENT_STATE, "Cannot init NLM Client cache");
@@ -154,7 +197,7 @@ state_status_t state_lock_init(void)
 	status = state_async_init();
 
 	state_owner_pool =
-		pool_basic_init("NFSv4 state owners", sizeof(state_owner_t));
+		pool_slab_init("NFSv4 state owners", sizeof(state_owner_t));
 
 	return status;
 }
@@ -529,20 +572,27 @@ void dump_all_locks(const char *label)
 {
 #ifdef DEBUG_SAL
 	struct glist_head *glist;
+	bool empty = true;
+	int i;
 
-	PTHREAD_MUTEX_lock(&all_locks_mutex);
+	/* Each shard is locked in turn, so this is not a snapshot of all
+	 * locks at one instant.
+	 */
+	for (i = 0; i < STATE_ALL_LOCKS_SHARDS; i++) {
+		PTHREAD_MUTEX_lock(&state_all_locks[i].mtx);
+
+		glist_for_each(glist, &state_all_locks[i].list) {
+			empty = false;
+			LogEntry(label,
+				 glist_entry(glist, state_lock_entry_t,
+					     sle_all_locks));
+		}
 
-	if (glist_empty(&state_all_locks)) {
-		LogFullDebug(COMPONENT_STATE, "All Locks are freed");
-		PTHREAD_MUTEX_unlock(&all_locks_mutex);
-		return;
+		PTHREAD_MUTEX_unlock(&state_all_locks[i].mtx);
 	}
 
-	glist_for_each(glist, &state_all_locks)
-	    LogEntry(label,
-		     glist_entry(glist, state_lock_entry_t, sle_all_locks));
-
-	PTHREAD_MUTEX_unlock(&all_locks_mutex);
+	if (empty)
+		LogFullDebug(COMPONENT_STATE, "All Locks are freed");
 #else
 	return;
 #endif
@@ -576,13 +626,11 @@ static state_lock_entry_t *create_state_lock_entry(struct fsal_obj_handle *obj,
 {
 	state_lock_entry_t *new_entry;
 
-	new_entry = gsh_malloc(sizeof(*new_entry));
+	new_entry = gsh_slab_alloc(&state_lock_entry_slab);
 
 	LogFullDebug(COMPONENT_STATE, "new_entry = %p owner %p", new_entry,
 		     owner);
 
-	memset(new_entry, 0, sizeof(*new_entry));
-
 	PTHREAD_MUTEX_init(&new_entry->sle_mutex, NULL);
 
 	/* sle_block_data will be filled in later if necessary */
@@ -639,11 +687,16 @@ static state_lock_entry_t *create_state_lock_entry(struct fsal_obj_handle *obj,
 	PTHREAD_MUTEX_unlock(&owner->so_mutex);
 
 #ifdef DEBUG_SAL
-	PTHREAD_MUTEX_lock(&all_locks_mutex);
+	new_entry->sle_all_locks_shard = all_locks_shard(new_entry);
+
+	PTHREAD_MUTEX_lock(&state_all_locks[new_entry->sle_all_locks_shard]
+			   .mtx);
 
-	glist_add_tail(&state_all_locks, &new_entry->sle_all_locks);
+	glist_add_tail(&state_all_locks[new_entry->sle_all_locks_shard].list,
+		       &new_entry->sle_all_locks);
 
-	PTHREAD_MUTEX_unlock(&all_locks_mutex);
+	PTHREAD_MUTEX_unlock(&state_all_locks[new_entry->sle_all_locks_shard]
+			     .mtx);
 #endif
 
 	return new_entry;
@@ -703,16 +756,293 @@ static void lock_entry_dec_ref(state_lock_entry_t *lock_entry)
 			gsh_free(lock_entry->sle_block_data);
 		}
 #ifdef DEBUG_SAL
-		PTHREAD_MUTEX_lock(&all_locks_mutex);
+		PTHREAD_MUTEX_lock(
+			&state_all_locks[lock_entry->sle_all_locks_shard].mtx);
 		glist_del(&lock_entry->sle_all_locks);
-		PTHREAD_MUTEX_unlock(&all_locks_mutex);
+		PTHREAD_MUTEX_unlock(
+			&state_all_locks[lock_entry->sle_all_locks_shard].mtx);
 #endif
 
 		lock_entry->sle_obj->obj_ops.put_ref(lock_entry->sle_obj);
 		put_gsh_export(lock_entry->sle_export);
 		PTHREAD_MUTEX_destroy(&lock_entry->sle_mutex);
-		gsh_free(lock_entry);
+		gsh_slab_free(&state_lock_entry_slab, lock_entry);
+	}
+}
+
+/******************************************************************************
+ *
+ * Per-file lock index
+ *
+ * Every entry on a file's lock_list is also in lock_tree, an AVL tree
+ * ordered by lock start in which each node records the last byte locked
+ * anywhere in its subtree. A range query then skips any subtree ending
+ * before the range, so finding the locks overlapping a range costs
+ * O(log n) per lock found instead of a walk of the whole list.
+ *
+ * lock_list keeps the insertion order that blocked locks are granted
+ * in. Both are protected by the state_lock.
+ *
+ ******************************************************************************/
+
+static inline state_lock_entry_t *lock_index_entry(struct avltree_node *node)
+{
+	return avltree_container_of(node, state_lock_entry_t, sle_tree);
+}
+
+/**
+ * @brief Order indexed locks by start, then by address
+ */
+static int lock_index_cmpf(const struct avltree_node *lhs,
+			   const struct avltree_node *rhs)
+{
+	state_lock_entry_t *lk, *rk;
+
+	lk = avltree_container_of(lhs, state_lock_entry_t, sle_tree);
+	rk = avltree_container_of(rhs, state_lock_entry_t, sle_tree);
+
+	if (lk->sle_lock.lock_start < rk->sle_lock.lock_start)
+		return -1;
+
+	if (lk->sle_lock.lock_start > rk->sle_lock.lock_start)
+		return 1;
+
+	if (lk == rk)
+		return 0;
+
+	return lk < rk ? -1 : 1;
+}
+
+/**
+ * @brief Recompute the last byte locked in a subtree
+ */
+static void lock_index_augment(struct avltree_node *node)
+{
+	state_lock_entry_t *entry = lock_index_entry(node);
+	uint64_t max_end = lock_end(&entry->sle_lock);
+
+	if (node->left && lock_index_entry(node->left)->sle_max_end > max_end)
+		max_end = lock_index_entry(node->left)->sle_max_end;
+
+	if (node->right &&
+	    lock_index_entry(node->right)->sle_max_end > max_end)
+		max_end = lock_index_entry(node->right)->sle_max_end;
+
+	entry->sle_max_end = max_end;
+}
+
+/**
+ * @brief Initialize the lock index of a file
+ *
+ * @param[in,out] ostate File state
+ */
+void state_lock_index_init(struct state_hdl *ostate)
+{
+	avltree_init(&ostate->file.lock_tree, lock_index_cmpf, 0);
+	avltree_set_augment(&ostate->file.lock_tree, lock_index_augment);
+}
+
+/**
+ * @brief Add an entry to a file's lock list and index
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] ostate     File state
+ * @param[in]     lock_entry Entry to add, its range must be final
+ */
+static void lock_index_insert(struct state_hdl *ostate,
+			      state_lock_entry_t *lock_entry)
+{
+	glist_add_tail(&ostate->file.lock_list, &lock_entry->sle_list);
+	avltree_insert(&lock_entry->sle_tree, &ostate->file.lock_tree);
+	lock_entry->sle_indexed = true;
+
+	if (lock_entry->sle_blocked != STATE_NON_BLOCKING)
+		ostate->file.lock_ungranted++;
+
+	if (ostate->file.lock_export == NULL)
+		ostate->file.lock_export = lock_entry->sle_export;
+	else if (ostate->file.lock_export != lock_entry->sle_export)
+		ostate->file.lock_mixed_exports = true;
+}
+
+/**
+ * @brief Take an indexed entry out of the tree only
+ *
+ * Used around a change of the entry's range, which would otherwise
+ * leave the tree unsorted. The entry keeps its place on lock_list.
+ */
+static inline void lock_index_unlink(struct state_hdl *ostate,
+				     state_lock_entry_t *lock_entry)
+{
+	avltree_remove(&lock_entry->sle_tree, &ostate->file.lock_tree);
+}
+
+/**
+ * @brief Put an entry back in the tree after lock_index_unlink()
+ */
+static inline void lock_index_link(struct state_hdl *ostate,
+				   state_lock_entry_t *lock_entry)
+{
+	avltree_insert(&lock_entry->sle_tree, &ostate->file.lock_tree);
+}
+
+/**
+ * @brief Mark a lock entry as granted
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] lock_entry Entry being granted
+ */
+static inline void lock_entry_granted(state_lock_entry_t *lock_entry)
+{
+	if (lock_entry->sle_indexed &&
+	    lock_entry->sle_blocked != STATE_NON_BLOCKING)
+		lock_entry->sle_obj->state_hdl->file.lock_ungranted--;
+
+	lock_entry->sle_blocked = STATE_NON_BLOCKING;
+}
+
+/**
+ * @brief Take an entry off whatever lock list it is on
+ *
+ * If the entry is on its file's lock list it also leaves the index.
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] lock_entry Entry to unlink
+ */
+static void lock_index_remove(state_lock_entry_t *lock_entry)
+{
+	struct state_hdl *ostate;
+
+	glist_del(&lock_entry->sle_list);
+
+	if (!lock_entry->sle_indexed)
+		return;
+
+	ostate = lock_entry->sle_obj->state_hdl;
+	avltree_remove(&lock_entry->sle_tree, &ostate->file.lock_tree);
+	lock_entry->sle_indexed = false;
+
+	if (lock_entry->sle_blocked != STATE_NON_BLOCKING)
+		ostate->file.lock_ungranted--;
+
+	if (glist_empty(&ostate->file.lock_list)) {
+		ostate->file.lock_export = NULL;
+		ostate->file.lock_mixed_exports = false;
+	}
+}
+
+/**
+ * @brief Find the first lock in a subtree ending at or after an offset
+ *
+ * @param[in] node  Subtree root
+ * @param[in] start Offset
+ *
+ * @return The lock with the lowest start among those ending at or
+ *         after start, or NULL.
+ */
+static state_lock_entry_t *lock_index_descend(struct avltree_node *node,
+					      uint64_t start)
+{
+	while (node != NULL) {
+		state_lock_entry_t *entry = lock_index_entry(node);
+
+		if (node->left &&
+		    lock_index_entry(node->left)->sle_max_end >= start)
+			node = node->left;
+		else if (lock_end(&entry->sle_lock) >= start)
+			return entry;
+		else if (node->right &&
+			 lock_index_entry(node->right)->sle_max_end >= start)
+			node = node->right;
+		else
+			break;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Find the first lock of a file overlapping a range
+ *
+ * Together with lock_index_next() this visits the overlapping locks in
+ * order of start. The current entry may be removed from the index
+ * once its successor has been found.
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] ostate File state
+ * @param[in] start  First byte of the range
+ * @param[in] end    Last byte of the range
+ *
+ * @return The first overlapping lock or NULL.
+ */
+static state_lock_entry_t *lock_index_first(struct state_hdl *ostate,
+					    uint64_t start, uint64_t end)
+{
+	state_lock_entry_t *entry;
+
+	entry = lock_index_descend(ostate->file.lock_tree.root, start);
+
+	if (entry == NULL || entry->sle_lock.lock_start > end)
+		return NULL;
+
+	return entry;
+}
+
+/**
+ * @brief Find the next lock of a file overlapping a range
+ *
+ * @param[in] entry Previous overlapping lock
+ * @param[in] start First byte of the range
+ * @param[in] end   Last byte of the range
+ *
+ * @return The next overlapping lock or NULL.
+ */
+static state_lock_entry_t *lock_index_next(state_lock_entry_t *entry,
+					   uint64_t start, uint64_t end)
+{
+	struct avltree_node *node = &entry->sle_tree;
+	struct avltree_node *parent;
+	state_lock_entry_t *next = NULL;
+
+	if (node->right &&
+	    lock_index_entry(node->right)->sle_max_end >= start) {
+		next = lock_index_descend(node->right, start);
+	} else {
+		/* Climb to each ancestor reached from its left subtree,
+		 * that is the ancestor itself and then its right subtree.
+		 */
+		while ((parent = avltree_parent(node)) != NULL) {
+			if (parent->left == node) {
+				next = lock_index_entry(parent);
+
+				if (next->sle_lock.lock_start > end)
+					return NULL;
+
+				if (lock_end(&next->sle_lock) >= start)
+					break;
+
+				next = NULL;
+
+				if (parent->right &&
+				    lock_index_entry(parent->right)->sle_max_end
+				    >= start) {
+					next = lock_index_descend(parent->right,
+								  start);
+					break;
+				}
+			}
+			node = parent;
+		}
 	}
+
+	if (next == NULL || next->sle_lock.lock_start > end)
+		return NULL;
+
+	return next;
 }
 
 /**
@@ -770,7 +1100,7 @@ static void remove_from_locklist(state_lock_entry_t *lock_entry)
 	}
 
 	lock_entry->sle_owner = NULL;
-	glist_del(&lock_entry->sle_list);
+	lock_index_remove(lock_entry);
 	lock_entry_dec_ref(lock_entry);
 }
 
@@ -789,13 +1119,14 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 						 state_owner_t *owner,
 						 fsal_lock_param_t *lock)
 {
-	struct glist_head *glist;
-	state_lock_entry_t *found_entry = NULL;
-	uint64_t found_entry_end, range_end = lock_end(lock);
-
-	glist_for_each(glist, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	state_lock_entry_t *found_entry;
+	uint64_t range_end = lock_end(lock);
 
+	for (found_entry = lock_index_first(ostate, lock->lock_start,
+					    range_end);
+	     found_entry != NULL;
+	     found_entry = lock_index_next(found_entry, lock->lock_start,
+					   range_end)) {
 		LogEntry("Checking", found_entry);
 
 		/* Skip blocked or cancelled locks */
@@ -804,33 +1135,66 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 		    || found_entry->sle_blocked == STATE_CANCELED)
 			continue;
 
-		found_entry_end = lock_end(&found_entry->sle_lock);
-
-		if ((found_entry_end >= lock->lock_start)
-		    && (found_entry->sle_lock.lock_start <= range_end)) {
-			/* lock overlaps see if we can allow:
-			 * allow if neither lock is exclusive or
-			 * the owner is the same
-			 */
-			if ((found_entry->sle_lock.lock_type == FSAL_LOCK_W
-			     || lock->lock_type == FSAL_LOCK_W)
-			    && different_owners(found_entry->sle_owner, owner)
-			    ) {
-				/* found a conflicting lock, return it */
-				return found_entry;
-			}
+		/* lock overlaps see if we can allow:
+		 * allow if neither lock is exclusive or
+		 * the owner is the same
+		 */
+		if ((found_entry->sle_lock.lock_type == FSAL_LOCK_W
+		     || lock->lock_type == FSAL_LOCK_W)
+		    && different_owners(found_entry->sle_owner, owner)) {
+			/* found a conflicting lock, return it */
+			return found_entry;
 		}
 	}
 
 	return NULL;
 }
 
+/**
+ * @brief Find a lock of this owner on the file through another export
+ *
+ * The file remembers the export its locks came through, so the list
+ * is only walked once locks from several exports are present.
+ *
+ * @note The state_lock MUST be held for read
+ *
+ * @param[in] ostate File state to search
+ * @param[in] owner  The lock owner
+ *
+ * @return An entry held via another export or NULL.
+ */
+static state_lock_entry_t *lock_export_conflict(struct state_hdl *ostate,
+						state_owner_t *owner)
+{
+	struct glist_head *glist;
+	state_lock_entry_t *found_entry;
+
+	if (!ostate->file.lock_mixed_exports &&
+	    (ostate->file.lock_export == NULL ||
+	     ostate->file.lock_export == op_ctx->ctx_export))
+		return NULL;
+
+	glist_for_each(glist, &ostate->file.lock_list) {
+		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+
+		if (found_entry->sle_export != op_ctx->ctx_export
+		    && !different_owners(found_entry->sle_owner, owner))
+			return found_entry;
+	}
+
+	return NULL;
+}
+
 /**
  * @brief Add a lock, potentially merging with existing locks
  *
- * We need to iterate over the full lock list and remove
- * any mapping entry. And l_offset = 0 and sle_lock.lock_length = 0 lock_entry
- * implies remove all entries
+ * Only granted locks of the same owner that overlap or touch lock_entry
+ * are visited: they are merged into lock_entry, or trimmed (and maybe
+ * split) to stay clear of it.
+ *
+ * A trimmed right part may be visited again further on, which leaves
+ * it as is: the owner's locks of the other type can't extend
+ * lock_entry into it.
  *
  * @note The state_lock MUST be held for write
  *
@@ -842,19 +1206,31 @@ static void merge_lock_entry(struct state_hdl *ostate,
 {
 	state_lock_entry_t *check_entry;
 	state_lock_entry_t *check_entry_right;
+	state_lock_entry_t *next_entry;
 	uint64_t check_entry_end;
 	uint64_t lock_entry_end;
-	struct glist_head *glist;
-	struct glist_head *glistn;
+	uint64_t touch_start, touch_end;
 
 	/* lock_entry might be STATE_NON_BLOCKING or STATE_GRANTING */
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		check_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-
-		/* Skip entry being merged - it could be in the list */
-		if (check_entry == lock_entry)
-			continue;
+	/* If lock_entry is on the list its range may grow, take it out of
+	 * the index until it is final.
+	 */
+	if (lock_entry->sle_indexed)
+		lock_index_unlink(ostate, lock_entry);
+
+	touch_start = lock_entry->sle_lock.lock_start;
+	if (touch_start > 0)
+		touch_start--;
+	touch_end = lock_end(&lock_entry->sle_lock);
+	if (touch_end < UINT64_MAX)
+		touch_end++;
+
+	for (check_entry = lock_index_first(ostate, touch_start, touch_end);
+	     check_entry != NULL;
+	     check_entry = next_entry) {
+		next_entry = lock_index_next(check_entry, touch_start,
+					     touch_end);
 
 		if (different_owners
 		    (check_entry->sle_owner, lock_entry->sle_owner))
@@ -891,14 +1267,16 @@ static void merge_lock_entry(struct state_hdl *ostate,
 				/* Need to split old lock */
 				check_entry_right =
 				    state_lock_entry_t_dup(check_entry);
-				glist_add_tail(&ostate->file.lock_list,
-					       &(check_entry_right->sle_list));
 			} else {
 				/* No split, just shrink, make the logic below
 				 * work on original lock
 				 */
 				check_entry_right = check_entry;
 			}
+
+			/* The index is re-sorted once the range is final */
+			lock_index_unlink(ostate, check_entry);
+
 			if (lock_entry_end < check_entry_end) {
 				/* Need to shrink old lock from beginning
 				 * (right lock if split)
@@ -923,6 +1301,11 @@ static void merge_lock_entry(struct state_hdl *ostate,
 				    check_entry->sle_lock.lock_start;
 				LogEntry("Merge shrunk left", check_entry);
 			}
+
+			lock_index_link(ostate, check_entry);
+			if (check_entry_right != check_entry)
+				lock_index_insert(ostate, check_entry_right);
+
 			/* Done splitting/shrinking old lock */
 			continue;
 		}
@@ -949,6 +1332,9 @@ static void merge_lock_entry(struct state_hdl *ostate,
 		LogEntry("Merging removing", check_entry);
 		remove_from_locklist(check_entry);
 	}
+
+	if (lock_entry->sle_indexed)
+		lock_index_link(ostate, lock_entry);
 }
 
 /**
@@ -1048,7 +1434,7 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
 	/* Remove the lock from the list it's
 	 * on and put it on the remove_list
 	 */
-	glist_del(&found_entry->sle_list);
+	lock_index_remove(found_entry);
 	glist_add_tail(remove_list, &(found_entry->sle_list));
 
 	*removed = true;
@@ -1064,6 +1450,8 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
  * @param[in]     state   Associated lock state
  * @param[in]     lock    Lock to remove
  * @param[out]    removed True if an entry was removed
+ * @param[in,out] ostate  If not NULL, list is this file's lock list and
+ *                        only its locks overlapping lock are visited
  * @param[in,out] list    List of locks to modify
  *
  * @return State status.
@@ -1073,12 +1461,14 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 					      int32_t state,
 					      fsal_lock_param_t *lock,
 					      bool *removed,
+					      struct state_hdl *ostate,
 					      struct glist_head *list)
 {
-	state_lock_entry_t *found_entry;
+	state_lock_entry_t *found_entry, *next_entry;
 	struct glist_head split_lock_list, remove_list;
 	struct glist_head *glist, *glistn;
 	state_status_t status = STATE_SUCCESS;
+	uint64_t range_end = lock_end(lock);
 	bool removed_one = false;
 
 	*removed = false;
@@ -1086,8 +1476,23 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 	glist_init(&split_lock_list);
 	glist_init(&remove_list);
 
-	glist_for_each_safe(glist, glistn, list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	if (ostate != NULL)
+		found_entry = lock_index_first(ostate, lock->lock_start,
+					       range_end);
+	else
+		found_entry = glist_first_entry(list, state_lock_entry_t,
+						sle_list);
+
+	for (; found_entry != NULL; found_entry = next_entry) {
+		/* Find the next entry before this one may be moved */
+		if (ostate != NULL)
+			next_entry = lock_index_next(found_entry,
+						     lock->lock_start,
+						     range_end);
+		else
+			next_entry = glist_next_entry(list, state_lock_entry_t,
+						      sle_list,
+						      &found_entry->sle_list);
 
 		if (owner != NULL
 		    && different_owners(found_entry->sle_owner, owner))
@@ -1133,14 +1538,27 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 			found_entry =
 			    glist_entry(glist, state_lock_entry_t, sle_list);
 			glist_del(&found_entry->sle_list);
-			glist_add_tail(list, &(found_entry->sle_list));
+			if (ostate != NULL)
+				lock_index_insert(ostate, found_entry);
+			else
+				glist_add_tail(list, &(found_entry->sle_list));
 		}
 	} else {
 		/* free the enttries on the remove_list */
 		free_list(&remove_list);
 
 		/* now add the split lock list */
-		glist_add_list_tail(list, &split_lock_list);
+		if (ostate != NULL) {
+			glist_for_each_safe(glist, glistn, &split_lock_list) {
+				found_entry = glist_entry(glist,
+							  state_lock_entry_t,
+							  sle_list);
+				glist_del(&found_entry->sle_list);
+				lock_index_insert(ostate, found_entry);
+			}
+		} else {
+			glist_add_list_tail(list, &split_lock_list);
+		}
 	}
 
 	LogFullDebug(COMPONENT_STATE,
@@ -1173,7 +1591,7 @@ static state_status_t subtract_list_from_list(struct fsal_obj_handle *obj,
 
 		status = subtract_lock_from_list(NULL, false, 0,
 						 &found_entry->sle_lock,
-						 &removed, target);
+						 &removed, NULL, target);
 		if (status != STATE_SUCCESS)
 			break;
 	}
@@ -1691,7 +2109,7 @@ void grant_blocked_lock_immediate(struct state_hdl *ostate,
 	}
 
 	/* Mark lock as granted */
-	lock_entry->sle_blocked = STATE_NON_BLOCKING;
+	lock_entry_granted(lock_entry);
 
 	/* Merge any touching or overlapping locks into this one. */
 	LogEntry("Granted immediate, merging locks for", lock_entry);
@@ -1730,7 +2148,7 @@ void state_complete_grant(state_cookie_entry_t *cookie_entry)
 	/* We need to make sure lock is ready to be granted */
 	if (lock_entry->sle_blocked == STATE_GRANTING) {
 		/* Mark lock as granted */
-		lock_entry->sle_blocked = STATE_NON_BLOCKING;
+		lock_entry_granted(lock_entry);
 
 		/* Merge any touching or overlapping locks into this one. */
 		LogEntry("Granted, merging locks for", lock_entry);
@@ -1865,7 +2283,7 @@ static void grant_blocked_locks(struct state_hdl *ostate)
 	struct glist_head *glist, *glistn;
 	struct fsal_export *export = op_ctx->ctx_export->fsal_export;
 
-	if (!ostate)
+	if (!ostate || ostate->file.lock_ungranted == 0)
 		return;
 
 	/* If FSAL supports async blocking locks,
@@ -1893,6 +2311,58 @@ static void grant_blocked_locks(struct state_hdl *ostate)
 	}
 }
 
+/**
+ * @brief Retry the polled blocked locks of a file right away
+ *
+ * Locks the FSAL refused while SAL saw no conflict are otherwise only
+ * retried by blocked_lock_polling() every Blocked_Lock_Poller_Interval.
+ * When something releases FSAL locks on the file behind SAL's back,
+ * such as closing the FSAL files of a CLOSE, queue those locks for an
+ * immediate asynchronous retry instead.
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] ostate File state
+ */
+void state_retry_blocked_locks(struct state_hdl *ostate)
+{
+	state_lock_entry_t *found_entry;
+	struct glist_head *glist;
+	state_block_data_t *pblock;
+
+	if (ostate->file.lock_ungranted == 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+
+	glist_for_each(glist, &ostate->file.lock_list) {
+		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+		pblock = found_entry->sle_block_data;
+
+		if (pblock == NULL || pblock->sbd_block_type != STATE_BLOCK_POLL)
+			continue;
+
+		if (found_entry->sle_blocked != STATE_NLM_BLOCKING
+		    && found_entry->sle_blocked != STATE_NFSV4_BLOCKING)
+			continue;
+
+		/* Already queued by the poller or an earlier retry */
+		if (pblock->sbd_grant_type == STATE_GRANT_POLL)
+			continue;
+
+		pblock->sbd_grant_type = STATE_GRANT_POLL;
+
+		if (state_block_schedule(pblock) != STATE_SUCCESS) {
+			LogMajor(COMPONENT_STATE,
+				 "Unable to schedule lock notification.");
+		}
+
+		LogEntry("Blocked Lock retry", found_entry);
+	}
+
+	PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+}
+
 /**
  * @brief Cancel a blocked lock
  *
@@ -2006,6 +2476,10 @@ void cancel_blocked_locks_range(struct state_hdl *ostate,
 	state_lock_entry_t *found_entry = NULL;
 	uint64_t found_entry_end, range_end = lock_end(lock);
 
+	/* Nothing but granted locks */
+	if (ostate->file.lock_ungranted == 0)
+		return;
+
 	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
 		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
 
@@ -2504,7 +2978,6 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 			  fsal_lock_param_t *conflict)
 {
 	bool allow = true, overlap = false;
-	struct glist_head *glist;
 	state_lock_entry_t *found_entry;
 	uint64_t found_entry_end;
 	uint64_t range_end = lock_end(lock);
@@ -2549,39 +3022,43 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 
 	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 
-	if (blocking != STATE_NON_BLOCKING) {
+	/* Need to reject lock request if this lock owner already has a
+	 * lock on this file via a different export.
+	 */
+	found_entry = lock_export_conflict(obj->state_hdl, owner);
+
+	if (found_entry != NULL) {
+		LogEvent(COMPONENT_STATE,
+			 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
+			 found_entry->sle_export->export_id,
+			 op_ctx_export_path(found_entry->sle_export),
+			 op_ctx->ctx_export->export_id,
+			 op_ctx_export_path(op_ctx->ctx_export));
+
+		LogEntry("Found lock entry belonging to another export",
+			 found_entry);
+
+		status = STATE_INVALID_ARGUMENT;
+		goto out_unlock;
+	}
+
+	if (blocking != STATE_NON_BLOCKING &&
+	    obj->state_hdl->file.lock_ungranted != 0) {
 		/* First search for a blocked request. Client can ignore the
 		 * blocked request and keep sending us new lock request again
 		 * and again. So if we have a mapping blocked request return
-		 * that
+		 * that. A mapping request starts at the same offset.
 		 */
-		glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-			found_entry =
-			    glist_entry(glist, state_lock_entry_t, sle_list);
-
+		for (found_entry = lock_index_first(obj->state_hdl,
+						    lock->lock_start,
+						    lock->lock_start);
+		     found_entry != NULL;
+		     found_entry = lock_index_next(found_entry,
+						   lock->lock_start,
+						   lock->lock_start)) {
 			if (different_owners(found_entry->sle_owner, owner))
 				continue;
 
-			/* Need to reject lock request if this lock owner
-			 * already has a lock on this file via a different
-			 * export.
-			 */
-			if (found_entry->sle_export != op_ctx->ctx_export) {
-				LogEvent(COMPONENT_STATE,
-					 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-					 found_entry->sle_export->export_id,
-					 op_ctx_export_path(
-						found_entry->sle_export),
-					 op_ctx->ctx_export->export_id,
-					 op_ctx_export_path(
-							op_ctx->ctx_export));
-				LogEntry(
-					"Found lock entry belonging to another export",
-					found_entry);
-				status = STATE_INVALID_ARGUMENT;
-				goto out_unlock;
-			}
-
 			if (found_entry->sle_blocked != blocking)
 				continue;
 
@@ -2598,33 +3075,18 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		}
 	}
 
-	glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-		/* Need to reject lock request if this lock owner already has
-		 * a lock on this file via a different export.
-		 */
-		if (found_entry->sle_export != op_ctx->ctx_export
-		    && !different_owners(found_entry->sle_owner, owner)) {
-			LogEvent(COMPONENT_STATE,
-				 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-				 found_entry->sle_export->export_id,
-				 op_ctx_export_path(found_entry->sle_export),
-				 op_ctx->ctx_export->export_id,
-				 op_ctx_export_path(op_ctx->ctx_export));
-
-			LogEntry("Found lock entry belonging to another export",
-				 found_entry);
-
-			status = STATE_INVALID_ARGUMENT;
-			goto out_unlock;
-		}
-
+	/* Only locks overlapping the request can conflict with it or
+	 * cover it.
+	 */
+	for (found_entry = lock_index_first(obj->state_hdl, lock->lock_start,
+					    range_end);
+	     found_entry != NULL;
+	     found_entry = lock_index_next(found_entry, lock->lock_start,
+					   range_end)) {
 		/* Don't skip blocked locks for fairness */
 		found_entry_end = lock_end(&found_entry->sle_lock);
 
-		if (!(lock->lock_reclaim)
-		    && (found_entry_end >= lock->lock_start)
-		    && (found_entry->sle_lock.lock_start <= range_end)) {
+		if (!(lock->lock_reclaim)) {
 			/* lock overlaps see if we can allow:
 			 * allow if neither lock is exclusive or
 			 * the owner is the same
@@ -2807,8 +3269,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("New lock", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
+		lock_index_insert(obj->state_hdl, found_entry);
 
 		/* A lock downgrade could unblock blocked locks */
 		grant_blocked_locks(obj->state_hdl);
@@ -2840,8 +3301,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("FSAL block for", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
+		lock_index_insert(obj->state_hdl, found_entry);
 
 		PTHREAD_MUTEX_lock(&blocked_locks_mutex);
 
@@ -2915,7 +3375,7 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 
 	/* Release the lock from cache inode lock list for entry */
 	status = subtract_lock_from_list(owner, state_applies, nsm_state, lock,
-					 &removed,
+					 &removed, obj->state_hdl,
 					 &obj->state_hdl->file.lock_list);
 
 	/* If the lock list has become zero; decrement the pin ref count pt
@@ -170,6 +170,8 @@ const char *state_err_str(state_status_t err)
 		return "STATE_BADHANDLE";
 	case STATE_BAD_RANGE:
 		return "STATE_BAD_RANGE";
+	case STATE_RESOURCE_LIMIT:
+		return "STATE_RESOURCE_LIMIT";
 	}
 	return "unknown";
 }
@@ -419,6 +421,7 @@ nfsstat4 nfs4_Errno_state(state_status_t error)
 		break;
 
 	case STATE_FSAL_DELAY:
+	case STATE_RESOURCE_LIMIT:
 		nfserror = NFS4ERR_DELAY;
 		break;
 
@@ -586,6 +589,7 @@ nfsstat3 nfs3_Errno_state(state_status_t error)
 
 	case STATE_FSAL_DELAY:
 	case STATE_SHARE_DENIED:
+	case STATE_RESOURCE_LIMIT:
 		nfserror = NFS3ERR_JUKEBOX;
 		break;
 
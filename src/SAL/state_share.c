@@ -691,6 +691,95 @@ void state_share_anonymous_io_done(struct fsal_obj_handle *obj,
 	(void) atomic_dec_uint32_t(&obj->state_hdl->file.anon_ops);
 }
 
+/**
+ * @brief Watch the access pattern of READs and advise the FSAL
+ *
+ * READs through a state are tracked in the state, the others (NFSv3
+ * and special stateids) in the file.  A READ is sequential when it
+ * starts within four READ sizes of where the last one ended, which
+ * allows for a client's parallel READs arriving out of order.
+ *
+ * After Readahead_Hint_Reads sequential READs in a row the FSAL is
+ * told SEQUENTIAL and WILLNEED for the next Readahead_Hint_Size bytes,
+ * and WILLNEED again whenever the READs come within half of that of the
+ * end of the advised range.  After as many non-sequential READs in a
+ * row it is told RANDOM, so it stops reading ahead.
+ *
+ * No lock is taken, racing READs can only skew the heuristic.
+ *
+ * @param[in] obj	File being read
+ * @param[in] state	State the READ is done through, or NULL
+ * @param[in] offset	Offset of the READ
+ * @param[in] size	Size of the READ
+ */
+void state_read_pattern(struct fsal_obj_handle *obj, state_t *state,
+			uint64_t offset, uint64_t size)
+{
+	int32_t threshold = nfs_param.core_param.readahead_hint_reads;
+	uint64_t window = nfs_param.core_param.readahead_hint_size;
+	struct state_read_pattern *pat;
+	struct io_hints hints;
+	uint64_t end = offset + size;
+	uint64_t slack = 4 * size;
+
+	if (threshold == 0)
+		return;
+
+	if (state != NULL)
+		pat = &state->state_read_pattern;
+	else
+		pat = &obj->state_hdl->file.read_pattern;
+
+	if (offset + slack >= pat->next_offset &&
+	    offset <= pat->next_offset + slack) {
+		if (pat->run < 0)
+			pat->run = 0;
+		if (pat->run < INT32_MAX)
+			pat->run++;
+	} else {
+		if (pat->run > 0)
+			pat->run = 0;
+		if (pat->run > INT32_MIN)
+			pat->run--;
+	}
+
+	pat->next_offset = end;
+
+	if (pat->run >= threshold) {
+		hints.hints = 1 << IO_ADVISE4_WILLNEED;
+
+		if (pat->advised != IO_ADVISE4_SEQUENTIAL) {
+			hints.hints |= 1 << IO_ADVISE4_SEQUENTIAL;
+			pat->advised = IO_ADVISE4_SEQUENTIAL;
+			pat->ra_end = end;
+		} else if (end + window / 2 <= pat->ra_end) {
+			/* Still well inside the advised range */
+			return;
+		}
+
+		hints.offset = pat->ra_end > end ? pat->ra_end : end;
+		hints.count = end + window - hints.offset;
+		pat->ra_end = end + window;
+	} else if (pat->run <= -threshold) {
+		if (pat->advised == IO_ADVISE4_RANDOM)
+			return;
+
+		hints.hints = 1 << IO_ADVISE4_RANDOM;
+		hints.offset = 0;
+		hints.count = 0;
+		pat->advised = IO_ADVISE4_RANDOM;
+	} else {
+		return;
+	}
+
+	LogFullDebug(COMPONENT_STATE,
+		     "obj %p state %p advising 0x%x offset %" PRIu64
+		     " count %" PRIu64,
+		     obj, state, hints.hints, hints.offset, hints.count);
+
+	(void) obj->obj_ops.io_advise2(obj, state, &hints);
+}
+
 #ifdef _USE_NLM
 /**
  * @brief Remove an NLM share
@@ -796,6 +885,16 @@ static state_status_t state_nlm_share2(struct fsal_obj_handle *obj,
 	if ((share_deny & fsm_DW) != 0)
 		openflags |= FSAL_O_DENY_WRITE;
 
+	/* Opens kept after an NFSv4 CLOSE still count as readers, and
+	 * the ones a close thread has yet to close may deny.
+	 */
+	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+	if (share_deny != 0)
+		state_flush_parked_locked(obj);
+	else
+		state_flush_closing_locked(obj);
+	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+
 	if (reclaim)
 		openflags |= FSAL_O_RECLAIM;
 
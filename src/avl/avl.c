@@ -143,6 +143,11 @@ struct avltree_node *avltree_prev(const struct avltree_node *node)
 	return parent;
 }
 
+struct avltree_node *avltree_parent(const struct avltree_node *node)
+{
+	return get_parent(node);
+}
+
 uint64_t avltree_size(const struct avltree * tree)
 {
 	return tree->size;
@@ -153,6 +158,27 @@ uint64_t avltree_size(const struct avltree * tree)
  * to slower insertion and removal but faster retrieval.
  */
 
+/* Refresh the augmented data from node up to the root */
+static void augment_path(struct avltree_node *node, struct avltree *tree)
+{
+	if (!tree->augment_fn)
+		return;
+
+	for (; node; node = get_parent(node))
+		tree->augment_fn(node);
+}
+
+/* After a rotation only the two rotated nodes summarize different sets */
+static inline void augment_rotated(struct avltree_node *p,
+				   struct avltree_node *q,
+				   struct avltree *tree)
+{
+	if (tree->augment_fn) {
+		tree->augment_fn(p);
+		tree->augment_fn(q);
+	}
+}
+
 /* node->balance = height(node->right) - height(node->left); */
 static void rotate_left(struct avltree_node *node, struct avltree *tree)
 {
@@ -174,6 +200,8 @@ static void rotate_left(struct avltree_node *node, struct avltree *tree)
 	if (p->right)
 		set_parent(p, p->right);
 	q->left = p;
+
+	augment_rotated(p, q, tree);
 }
 
 static void rotate_right(struct avltree_node *node, struct avltree *tree)
@@ -196,6 +224,8 @@ static void rotate_right(struct avltree_node *node, struct avltree *tree)
 	if (p->left)
 		set_parent(p, p->left);
 	q->right = p;
+
+	augment_rotated(p, q, tree);
 }
 
 struct avltree_node *avltree_inf(const struct avltree_node *key,
@@ -292,6 +322,7 @@ void avltree_do_insert(struct avltree_node *node,
 		tree->first = tree->last = node;
 		tree->height++;
 		tree->size++;
+		augment_path(node, tree);
 		return;
 	}
 	if (is_left) {
@@ -303,6 +334,7 @@ void avltree_do_insert(struct avltree_node *node,
 	}
 	set_parent(parent, node);
 	set_child(node, parent, is_left);
+	augment_path(node, tree);
 
 	for (;;) {
 		if (parent->left == node)
@@ -444,6 +476,9 @@ void avltree_remove(struct avltree_node *node, struct avltree *tree)
 	/* removed */
 	tree->size--;
 
+	/* 'parent' is the lowest node whose subtree lost an entry */
+	augment_path(parent, tree);
+
 	/*
 	 * At this point, 'parent' can only be null, if 'node' is the
 	 * tree's root and has at most one child.
@@ -591,6 +626,7 @@ int avltree_init(struct avltree *tree, avltree_cmp_fn_t cmp,
 		return -1;
 	tree->root = NULL;
 	tree->cmp_fn = cmp;
+	tree->augment_fn = NULL;
 	tree->height = -1;
 	tree->first = NULL;
 	tree->last = NULL;
@@ -77,6 +77,27 @@ else (NOT CEPH_FS)
   else(NOT CEPH_FS_LOOKUP_ROOT)
     set(USE_FSAL_CEPH_LL_LOOKUP_ROOT ON)
   endif(NOT CEPH_FS_LOOKUP_ROOT)
+  check_library_exists(cephfs ceph_ll_readv ${CEPHFS_LIBRARY_DIR} CEPH_FS_LL_READV)
+  if(NOT CEPH_FS_LL_READV)
+    message("Cannot find ceph_ll_readv. Vectored I/O will be done a segment at a time")
+    set(USE_FSAL_CEPH_LL_READV OFF)
+  else(NOT CEPH_FS_LL_READV)
+    set(USE_FSAL_CEPH_LL_READV ON)
+  endif(NOT CEPH_FS_LL_READV)
+  check_library_exists(cephfs ceph_ll_nonblocking_readv_writev ${CEPHFS_LIBRARY_DIR} CEPH_FS_NONBLOCKING_IO)
+  if(NOT CEPH_FS_NONBLOCKING_IO)
+    message("Cannot find ceph_ll_nonblocking_readv_writev. Disabling CEPH fsal async I/O")
+    set(USE_FSAL_CEPH_LL_NONBLOCKING_RW OFF)
+  else(NOT CEPH_FS_NONBLOCKING_IO)
+    set(USE_FSAL_CEPH_LL_NONBLOCKING_RW ON)
+  endif(NOT CEPH_FS_NONBLOCKING_IO)
+  check_library_exists(cephfs ceph_ll_lookup_inode ${CEPHFS_LIBRARY_DIR} CEPH_FS_LOOKUP_INODE)
+  if(NOT CEPH_FS_LOOKUP_INODE)
+    message("Cannot find ceph_ll_lookup_inode. CEPH exports will use one mount")
+    set(USE_FSAL_CEPH_LL_LOOKUP_INODE OFF)
+  else(NOT CEPH_FS_LOOKUP_INODE)
+    set(USE_FSAL_CEPH_LL_LOOKUP_INODE ON)
+  endif(NOT CEPH_FS_LOOKUP_INODE)
   set(CMAKE_REQUIRED_INCLUDES ${CEPHFS_INCLUDE_DIR})
   check_symbol_exists(CEPH_STATX_INO "cephfs/libcephfs.h" CEPH_FS_CEPH_STATX)
   if(NOT CEPH_FS_CEPH_STATX)
@@ -103,3 +124,6 @@ mark_as_advanced(USE_FSAL_CEPH_MKNOD)
 mark_as_advanced(USE_FSAL_CEPH_SETLK)
 mark_as_advanced(USE_FSAL_CEPH_LL_LOOKUP_ROOT)
 mark_as_advanced(USE_FSAL_CEPH_STATX)
+mark_as_advanced(USE_FSAL_CEPH_LL_READV)
+mark_as_advanced(USE_FSAL_CEPH_LL_NONBLOCKING_RW)
+mark_as_advanced(USE_FSAL_CEPH_LL_LOOKUP_INODE)
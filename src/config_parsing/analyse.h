@@ -122,6 +122,8 @@ char *save_token(char *token, bool esc, struct parser_state *st);
 int ganesha_yyparse(struct parser_state *st);
 int ganeshun_yy_init_parser(char *srcfile,
 			   struct parser_state *st);
+int ganeshun_yy_init_parser_buf(char *buf, char *name,
+				struct parser_state *st);
 void ganeshun_yy_cleanup_parser(struct parser_state *st);
 
 /**
@@ -70,6 +70,35 @@ config_file_t config_ParseFile(char *file_path,
 	return (config_file_t)root;
 }
 
+/* config_ParseBuffer:
+ * Like config_ParseFile, for configuration held in a string.
+ * name stands for the file in error messages.
+ */
+
+config_file_t config_ParseBuffer(char *buf, char *name,
+				 struct config_error_type *err_type)
+{
+	struct parser_state st;
+	struct config_root *root;
+	int rc;
+
+	memset(&st, 0, sizeof(struct parser_state));
+	st.err_type = err_type;
+	rc = ganeshun_yy_init_parser_buf(buf, name, &st);
+	if (rc) {
+		return NULL;
+	}
+	rc = ganesha_yyparse(&st);
+	root = st.root_node;
+	if (rc != 0)
+		config_proc_error(root, err_type,
+				  (rc == 1
+				   ? "Configuration syntax errors found"
+				   : "Configuration parse ran out of memory"));
+	ganeshun_yy_cleanup_parser(&st);
+	return (config_file_t)root;
+}
+
 /**
  * config_Print:
  * Print the content of the syntax tree
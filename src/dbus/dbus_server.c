@@ -45,6 +45,7 @@
 #include "log.h"
 #include "nfs_rpc_callback.h"
 #include "gsh_dbus.h"
+#include "fridgethr.h"
 #include <os/memstream.h>
 #include "dbus_priv.h"
 
@@ -94,6 +95,33 @@ struct _dbus_thread_state {
 
 static struct _dbus_thread_state thread_state;
 
+/*
+ * Paths registered before gsh_dbus_pkginit, such as those of FSALs
+ * loaded while the exports are read.  They are registered when the
+ * connection is up.
+ */
+struct dbus_pending_path {
+	struct glist_head list;
+	char *name;
+	struct gsh_dbus_interface **interfaces;
+};
+
+static struct glist_head dbus_pending_paths =
+	GLIST_HEAD_INIT(dbus_pending_paths);
+static bool dbus_pkginit_done;
+
+/*
+ * Threads running the heavy methods, so that a query walking every
+ * client does not hold up the DBus thread.  NULL without Dbus_Workers.
+ */
+static struct fridgethr *dbus_fridge;
+
+struct dbus_method_job {
+	DBusConnection *conn;
+	DBusMessage *msg;
+	struct gsh_dbus_method *method;
+};
+
 static inline int dbus_callout_cmpf(const struct avltree_node *lhs,
 				    const struct avltree_node *rhs)
 {
@@ -207,12 +235,19 @@ void gsh_dbus_pkginit(void)
 {
 	char regbuf[128];
 	int code = 0;
+	struct glist_head *glist, *glistn;
+	struct dbus_pending_path *pending;
 
 	LogDebug(COMPONENT_DBUS, "init");
 
 	avltree_init(&thread_state.callouts, dbus_callout_cmpf,
 		     0 /* must be 0 */);
 
+	/* The workers send replies on the connection too */
+	if (nfs_param.core_param.dbus_workers > 0 &&
+	    !dbus_threads_init_default())
+		LogCrit(COMPONENT_DBUS, "dbus_threads_init_default failed");
+
 	dbus_error_init(&thread_state.dbus_err);	/* sigh */
 	thread_state.dbus_conn =
 	    dbus_bus_get(DBUS_BUS_SYSTEM, &thread_state.dbus_err);
@@ -245,10 +280,36 @@ void gsh_dbus_pkginit(void)
 
 	init_dbus_broadcast();
 
+	if (nfs_param.core_param.dbus_workers > 0) {
+		struct fridgethr_params frp;
+
+		memset(&frp, 0, sizeof(frp));
+		frp.thr_max = nfs_param.core_param.dbus_workers;
+		frp.thread_delay = 60;
+		frp.deferment = fridgethr_defer_queue;
+
+		code = fridgethr_init(&dbus_fridge, "dbus_wrk", &frp);
+		if (code != 0) {
+			LogMajor(COMPONENT_DBUS,
+				 "Unable to initialize DBus worker fridge: %d",
+				 code);
+			dbus_fridge = NULL;
+		}
+	}
+
 	thread_state.initialized = true;
 
  out:
-	return;
+	dbus_pkginit_done = true;
+
+	glist_for_each_safe(glist, glistn, &dbus_pending_paths) {
+		pending = glist_entry(glist, struct dbus_pending_path, list);
+		glist_del(&pending->list);
+		(void) gsh_dbus_register_path(pending->name,
+					      pending->interfaces);
+		gsh_free(pending->name);
+		gsh_free(pending);
+	}
 }
 
 #define INTROSPECT_HEAD \
@@ -466,6 +527,101 @@ void dbus_append_timestamp(DBusMessageIter *iterp, struct timespec *timestamp)
 	dbus_message_iter_close_container(iterp, &ts_iter);
 }
 
+/**
+ * @brief Send the reply to a method call, or an error if it failed
+ *
+ * Consumes the reply.
+ *
+ * @return false if the reply could not be queued.
+ */
+static bool dbus_send_reply(DBusConnection *conn, DBusMessage *msg,
+			    DBusMessage *reply, bool success,
+			    DBusError *error, const char *interface,
+			    const char *method, uint32_t *serial)
+{
+	if (!success) {
+		const char *err_name, *err_text;
+
+		if (dbus_error_is_set(error)) {
+			err_name = error->name;
+			err_text = error->message;
+		} else {
+			err_name = interface;
+			err_text = method;
+		}
+		LogMajor(COMPONENT_DBUS,
+			 "Method (%s) on (%s) failed: name = (%s), message = (%s)",
+			 method, interface, err_name, err_text);
+		dbus_message_unref(reply);
+		reply = dbus_message_new_error(msg, err_name, err_text);
+	}
+	success = dbus_connection_send(conn, reply, serial);
+	if (!success) {
+		LogCrit(COMPONENT_DBUS, "reply failed");
+		dbus_connection_flush(conn);
+	}
+	if (reply)
+		dbus_message_unref(reply);
+	return success;
+}
+
+/**
+ * @brief Run a heavy method on a DBus worker
+ *
+ * libdbus queues the reply, and the DBus thread writes it out on its
+ * next pass.
+ */
+static void dbus_method_job_run(struct fridgethr_context *ctx)
+{
+	struct dbus_method_job *job = ctx->arg;
+	DBusMessageIter args;
+	DBusError error;
+	DBusMessage *reply;
+	bool success;
+
+	dbus_error_init(&error);
+	reply = dbus_message_new_method_return(job->msg);
+	success = job->method->method(dbus_message_iter_init(job->msg, &args)
+					? &args : NULL,
+				      reply, &error);
+	(void) dbus_send_reply(job->conn, job->msg, reply, success, &error,
+			       dbus_message_get_interface(job->msg),
+			       job->method->name, NULL);
+	dbus_error_free(&error);
+
+	dbus_message_unref(job->msg);
+	dbus_connection_unref(job->conn);
+	gsh_free(job);
+}
+
+/**
+ * @brief Hand a heavy method to the DBus workers
+ *
+ * @return false if it must be run on the DBus thread.
+ */
+static bool dbus_method_submit(DBusConnection *conn, DBusMessage *msg,
+			       struct gsh_dbus_method *method)
+{
+	struct dbus_method_job *job;
+
+	if (dbus_fridge == NULL || !method->heavy)
+		return false;
+
+	job = gsh_malloc(sizeof(*job));
+	job->conn = dbus_connection_ref(conn);
+	job->msg = dbus_message_ref(msg);
+	job->method = method;
+
+	if (fridgethr_submit(dbus_fridge, dbus_method_job_run, job) != 0) {
+		dbus_message_unref(job->msg);
+		dbus_connection_unref(job->conn);
+		gsh_free(job);
+		return false;
+	}
+
+	return true;
+}
+
 static DBusHandlerResult dbus_message_entrypoint(DBusConnection *conn,
 						 DBusMessage *msg,
 						 void *user_data)
@@ -509,6 +665,9 @@ static DBusHandlerResult dbus_message_entrypoint(DBusConnection *conn,
 
 				for (m = (*iface)->methods; m && *m; m++) {
 					if (strcmp(method, (*m)->name) == 0) {
+						if (dbus_method_submit(conn,
+								       msg, *m))
+							goto queued;
 						success = (*m)->method(argsp,
 								       reply,
 								       &error);
@@ -525,33 +684,18 @@ static DBusHandlerResult dbus_message_entrypoint(DBusConnection *conn,
 		LogMajor(COMPONENT_DBUS, "Unknown interface (%s)", interface);
 	}
  done:
-	if (!success) {
-		const char *err_name, *err_text;
-
-		if (dbus_error_is_set(&error)) {
-			err_name = error.name;
-			err_text = error.message;
-		} else {
-			err_name = interface;
-			err_text = method;
-		}
-		LogMajor(COMPONENT_DBUS,
-			 "Method (%s) on (%s) failed: name = (%s), message = (%s)",
-			 method, interface, err_name, err_text);
-		dbus_message_unref(reply);
-		reply = dbus_message_new_error(msg, err_name, err_text);
-	}
-	success = dbus_connection_send(conn, reply, &serial);
-	if (!success) {
-		LogCrit(COMPONENT_DBUS, "reply failed");
+	if (!dbus_send_reply(conn, msg, reply, success, &error, interface,
+			     method, &serial))
 		result = DBUS_HANDLER_RESULT_NEED_MEMORY;
-		dbus_connection_flush(conn);
-	}
-	if (reply)
-		dbus_message_unref(reply);
 	dbus_error_free(&error);
 	serial++;
 	return result;
+
+ queued:
+	/* The worker makes its own reply */
+	dbus_message_unref(reply);
+	dbus_error_free(&error);
+	return result;
 }
 
 static void path_unregistered_func(DBusConnection *connection, void *user_data)
@@ -567,6 +711,18 @@ int32_t gsh_dbus_register_path(const char *name,
 	char path[512];
 	int code = 0;
 
+	if (!dbus_pkginit_done) {
+		struct dbus_pending_path *pending;
+
+		pending = gsh_malloc(sizeof(*pending));
+		pending->name = gsh_strdup(name);
+		pending->interfaces = interfaces;
+		glist_add_tail(&dbus_pending_paths, &pending->list);
+
+		LogDebug(COMPONENT_DBUS, "deferred handler for %s", name);
+		return 0;
+	}
+
 	/* XXX if this works, add ifc level */
 	snprintf(path, 512, "%s%s", DBUS_PATH, name);
 
@@ -609,6 +765,55 @@ int32_t gsh_dbus_register_path(const char *name,
 	return code;
 }
 
+/**
+ * @brief Remove a path, for modules that are unloaded
+ *
+ * @param[in] name  The name given to gsh_dbus_register_path
+ */
+
+void gsh_dbus_unregister_path(const char *name)
+{
+	struct ganesha_dbus_handler key, *handler;
+	struct avltree_node *node;
+	struct glist_head *glist, *glistn;
+	struct dbus_pending_path *pending;
+	char path[512];
+
+	if (!dbus_pkginit_done) {
+		glist_for_each_safe(glist, glistn, &dbus_pending_paths) {
+			pending = glist_entry(glist, struct dbus_pending_path,
+					      list);
+			if (strcmp(pending->name, name) != 0)
+				continue;
+			glist_del(&pending->list);
+			gsh_free(pending->name);
+			gsh_free(pending);
+		}
+		return;
+	}
+
+	snprintf(path, 512, "%s%s", DBUS_PATH, name);
+	key.name = path;
+
+	node = avltree_lookup(&key.node_k, &thread_state.callouts);
+	if (node == NULL)
+		return;
+
+	handler = avltree_container_of(node, struct ganesha_dbus_handler,
+				       node_k);
+
+	if (thread_state.dbus_conn)
+		(void) dbus_connection_unregister_object_path(
+				thread_state.dbus_conn, handler->name);
+
+	avltree_remove(node, &thread_state.callouts);
+
+	LogDebug(COMPONENT_DBUS, "unregistered handler for %s", path);
+
+	gsh_free(handler->name);
+	gsh_free(handler);
+}
+
 void gsh_dbus_pkgshutdown(void)
 {
 	struct avltree_node *node, *onode;
@@ -616,6 +821,14 @@ void gsh_dbus_pkgshutdown(void)
 
 	LogDebug(COMPONENT_DBUS, "shutdown");
 
+	if (dbus_fridge != NULL) {
+		if (fridgethr_sync_command(dbus_fridge, fridgethr_comm_stop,
+					   10) != 0)
+			fridgethr_cancel(dbus_fridge);
+		fridgethr_destroy(dbus_fridge);
+		dbus_fridge = NULL;
+	}
+
 	/* remove and free handlers */
 	onode = NULL;
 	node = avltree_first(&thread_state.callouts);
@@ -0,0 +1,398 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * In-process NFS load generator.
+ *
+ * Starts the server from libganeshaNFS with the given config (an
+ * export on FSAL_PSEUDO or FSAL_VFS over tmpfs keeps the backend out
+ * of the numbers), mounts an export over loopback and has a number of
+ * client threads, each with its own connection, send NFSv3 calls in
+ * the given mix for a while.  Every call goes through the decoder,
+ * nfs_rpc_enqueue_req(), a worker and nfs_rpc_execute() like a remote
+ * one, without a network or client hosts.  Throughput and latency
+ * percentiles are printed per operation.
+ *
+ *  nfs_loadgen --config ganesha.conf --path /export --threads 16 \
+ *	--seconds 30 --mix getattr=60,lookup=20,access=15,null=5 \
+ *	--name somefile
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Ganesha headers */
+#include "nfs_lib.h"
+#include "gsh_rpc.h"
+#include "mount.h"
+#include "nfs23.h"
+}
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+
+  std::string mnt_path = "/";
+  std::string lookup_name = ".";
+  char host[] = "localhost";
+  char tcp[] = "tcp";
+
+  enum lg_op { LG_NULL, LG_GETATTR, LG_LOOKUP, LG_ACCESS, LG_FSSTAT,
+	       LG_NOPS };
+  const char *lg_op_names[LG_NOPS] = {
+    "null", "getattr", "lookup", "access", "fsstat"
+  };
+
+  /* Log-linear latency histogram: 8 sub-buckets per power of 2 ns */
+  const int LG_SUB = 8;
+  const int LG_BUCKETS = 64 * LG_SUB;
+
+  struct lg_stats {
+    uint64_t ops[LG_NOPS] = {};
+    uint64_t errors[LG_NOPS] = {};
+    std::vector<uint64_t> hist[LG_NOPS];
+
+    lg_stats() {
+      for (auto& h : hist)
+	h.assign(LG_BUCKETS, 0);
+    }
+  };
+
+  int lg_bucket(uint64_t ns) {
+    if (ns < LG_SUB)
+      return ns;
+    int msb = 63 - __builtin_clzll(ns);
+    return msb * LG_SUB + ((ns >> (msb - 3)) & (LG_SUB - 1));
+  }
+
+  uint64_t lg_bucket_ns(int b) {
+    if (b < LG_SUB)
+      return b;
+    int msb = b / LG_SUB;
+    return (1ULL << msb) | ((uint64_t)(b % LG_SUB) << (msb - 3));
+  }
+
+  uint64_t lg_percentile(const std::vector<uint64_t>& h, uint64_t n,
+			 double pct) {
+    uint64_t want = n * pct / 100, seen = 0;
+    for (int b = 0; b < LG_BUCKETS; ++b) {
+      seen += h[b];
+      if (seen > want)
+	return lg_bucket_ns(b);
+    }
+    return 0;
+  }
+
+  int ganesha_server() {
+    return nfs_libmain(
+      ganesha_conf,
+      lpath,
+      dlevel
+      );
+  }
+
+  struct timeval lg_timeout = { 30, 0 };
+
+  /* Mount the export, retrying while the server comes up */
+  bool lg_mount(nfs_fh3& root, int wait_secs) {
+    static mountres3 res;
+    dirpath path = (char*) mnt_path.c_str();
+
+    for (int i = 0; i < wait_secs; ++i) {
+      CLIENT *clnt = gsh_clnt_create(host, MOUNTPROG, MOUNT_V3, tcp);
+      if (clnt == nullptr) {
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	continue;
+      }
+      AUTH *auth = authunix_create_default();
+      memset(&res, 0, sizeof(res));
+      enum clnt_stat st = clnt_call(clnt, auth, MOUNTPROC3_MNT,
+				    (xdrproc_t) xdr_dirpath, &path,
+				    (xdrproc_t) xdr_mountres3, &res,
+				    lg_timeout);
+      AUTH_DESTROY(auth);
+      gsh_clnt_destroy(clnt);
+      if (st != RPC_SUCCESS) {
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	continue;
+      }
+      if (res.fhs_status != MNT3_OK) {
+	std::cerr << "MNT " << mnt_path << " failed: " << res.fhs_status
+		  << std::endl;
+	return false;
+      }
+      fhandle3& fh = res.mountres3_u.mountinfo.fhandle;
+      root.data.data_len = fh.fhandle3_len;
+      root.data.data_val = fh.fhandle3_val;
+      return true;
+    }
+    std::cerr << "Server did not come up" << std::endl;
+    return false;
+  }
+
+  void lg_worker(const nfs_fh3& root, const std::vector<lg_op>& wheel,
+		 std::chrono::steady_clock::time_point deadline,
+		 unsigned seed, lg_stats& stats) {
+    CLIENT *clnt = gsh_clnt_create(host, NFS_PROGRAM, NFS_V3, tcp);
+    if (clnt == nullptr) {
+      std::cerr << "Could not connect to the server" << std::endl;
+      return;
+    }
+    AUTH *auth = authunix_create_default();
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(0, wheel.size() - 1);
+
+    GETATTR3args ga = { root };
+    LOOKUP3args la = { { root, (char*) lookup_name.c_str() } };
+    ACCESS3args aa = { root, ACCESS3_READ | ACCESS3_LOOKUP };
+    FSSTAT3args fa = { root };
+
+    while (std::chrono::steady_clock::now() < deadline) {
+      lg_op op = wheel[pick(rng)];
+      enum clnt_stat st = RPC_SUCCESS;
+      bool ok = true;
+      auto t0 = std::chrono::steady_clock::now();
+
+      switch (op) {
+      case LG_NULL:
+	st = clnt_call(clnt, auth, NFSPROC3_NULL,
+		       (xdrproc_t) xdr_void, nullptr,
+		       (xdrproc_t) xdr_void, nullptr, lg_timeout);
+	break;
+      case LG_GETATTR: {
+	GETATTR3res res;
+	memset(&res, 0, sizeof(res));
+	st = clnt_call(clnt, auth, NFSPROC3_GETATTR,
+		       (xdrproc_t) xdr_GETATTR3args, &ga,
+		       (xdrproc_t) xdr_GETATTR3res, &res, lg_timeout);
+	ok = res.status == NFS3_OK;
+	xdr_free((xdrproc_t) xdr_GETATTR3res, &res);
+	break;
+      }
+      case LG_LOOKUP: {
+	LOOKUP3res res;
+	memset(&res, 0, sizeof(res));
+	st = clnt_call(clnt, auth, NFSPROC3_LOOKUP,
+		       (xdrproc_t) xdr_LOOKUP3args, &la,
+		       (xdrproc_t) xdr_LOOKUP3res, &res, lg_timeout);
+	ok = res.status == NFS3_OK;
+	xdr_free((xdrproc_t) xdr_LOOKUP3res, &res);
+	break;
+      }
+      case LG_ACCESS: {
+	ACCESS3res res;
+	memset(&res, 0, sizeof(res));
+	st = clnt_call(clnt, auth, NFSPROC3_ACCESS,
+		       (xdrproc_t) xdr_ACCESS3args, &aa,
+		       (xdrproc_t) xdr_ACCESS3res, &res, lg_timeout);
+	ok = res.status == NFS3_OK;
+	xdr_free((xdrproc_t) xdr_ACCESS3res, &res);
+	break;
+      }
+      case LG_FSSTAT: {
+	FSSTAT3res res;
+	memset(&res, 0, sizeof(res));
+	st = clnt_call(clnt, auth, NFSPROC3_FSSTAT,
+		       (xdrproc_t) xdr_FSSTAT3args, &fa,
+		       (xdrproc_t) xdr_FSSTAT3res, &res, lg_timeout);
+	ok = res.status == NFS3_OK;
+	xdr_free((xdrproc_t) xdr_FSSTAT3res, &res);
+	break;
+      }
+      default:
+	break;
+      }
+
+      uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+	std::chrono::steady_clock::now() - t0).count();
+
+      stats.ops[op]++;
+      if (st != RPC_SUCCESS || !ok)
+	stats.errors[op]++;
+      stats.hist[op][lg_bucket(ns)]++;
+    }
+
+    AUTH_DESTROY(auth);
+    gsh_clnt_destroy(clnt);
+  }
+
+  /* "getattr=60,lookup=40" to a wheel of 100 ops */
+  bool lg_parse_mix(const std::string& mix, std::vector<lg_op>& wheel) {
+    std::stringstream ss(mix);
+    std::string item;
+
+    while (std::getline(ss, item, ',')) {
+      size_t eq = item.find('=');
+      std::string name = item.substr(0, eq);
+      int weight = eq == std::string::npos ? 1 : std::stoi(item.substr(eq + 1));
+      int op;
+
+      for (op = 0; op < LG_NOPS; ++op)
+	if (name == lg_op_names[op])
+	  break;
+      if (op == LG_NOPS || weight < 0) {
+	std::cerr << "Unknown op in mix: " << item << std::endl;
+	return false;
+      }
+      wheel.insert(wheel.end(), weight, (lg_op) op);
+    }
+    return !wheel.empty();
+  }
+
+} /* namespace */
+
+int main(int argc, char *argv[])
+{
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+  int nthreads = 8, seconds = 10;
+  string mix = "getattr=60,lookup=20,access=15,null=5";
+  vector<lg_op> wheel;
+  nfs_fh3 root;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+	"path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+	"log to the provided file path")
+
+      ("debug", po::value<string>(),
+	"ganesha debug level")
+
+      ("path", po::value<string>(&mnt_path),
+	"export path or pseudo path to mount")
+
+      ("name", po::value<string>(&lookup_name),
+	"name looked up in the export root")
+
+      ("threads", po::value<int>(&nthreads),
+	"client threads, one connection each")
+
+      ("seconds", po::value<int>(&seconds),
+	"how long to run")
+
+      ("mix", po::value<string>(&mix),
+	"op=weight,... of null, getattr, lookup, access, fsstat")
+      ;
+
+    po::store(po::parse_command_line(argc, argv, opts), vm);
+    po::notify(vm);
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+    return 1;
+  }
+
+  // use config vars--leaves them on the stack
+  auto vm_iter = vm.find("config");
+  if (vm_iter != vm.end()) {
+    ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+  }
+  vm_iter = vm.find("logfile");
+  if (vm_iter != vm.end()) {
+    lpath = (char*) vm_iter->second.as<std::string>().c_str();
+  }
+  vm_iter = vm.find("debug");
+  if (vm_iter != vm.end()) {
+    dlevel = ReturnLevelAscii(
+      (char*) vm_iter->second.as<std::string>().c_str());
+  }
+
+  if (!lg_parse_mix(mix, wheel) || nthreads <= 0 || seconds <= 0) {
+    cout << opts << endl;
+    return 1;
+  }
+
+  std::thread ganesha(ganesha_server);
+  ganesha.detach();
+
+  if (!lg_mount(root, 60))
+    return 1;
+
+  vector<lg_stats> stats(nthreads);
+  vector<std::thread> workers;
+  auto start = chrono::steady_clock::now();
+  auto deadline = start + chrono::seconds(seconds);
+
+  for (int i = 0; i < nthreads; ++i)
+    workers.emplace_back(lg_worker, std::cref(root), std::cref(wheel),
+			 deadline, 8675309 + i, std::ref(stats[i]));
+  for (auto& w : workers)
+    w.join();
+
+  double elapsed = chrono::duration<double>(
+    chrono::steady_clock::now() - start).count();
+  uint64_t total = 0;
+
+  cout << nthreads << " threads, " << elapsed << " s, mix " << mix << endl;
+  cout << left << setw(10) << "op" << right << setw(12) << "ops/s"
+       << setw(10) << "errors" << setw(10) << "p50 us" << setw(10)
+       << "p99 us" << setw(10) << "p99.9 us" << endl;
+
+  for (int op = 0; op < LG_NOPS; ++op) {
+    vector<uint64_t> h(LG_BUCKETS, 0);
+    uint64_t n = 0, errors = 0;
+
+    for (auto& s : stats) {
+      n += s.ops[op];
+      errors += s.errors[op];
+      for (int b = 0; b < LG_BUCKETS; ++b)
+	h[b] += s.hist[op][b];
+    }
+    if (n == 0)
+      continue;
+    total += n;
+
+    cout << left << setw(10) << lg_op_names[op] << right << fixed
+	 << setprecision(0) << setw(12) << n / elapsed << setw(10) << errors
+	 << setprecision(1)
+	 << setw(10) << lg_percentile(h, n, 50) / 1e3
+	 << setw(10) << lg_percentile(h, n, 99) / 1e3
+	 << setw(10) << lg_percentile(h, n, 99.9) / 1e3 << endl;
+  }
+
+  cout << left << setw(10) << "total" << right << setprecision(0)
+       << setw(12) << total / elapsed << endl;
+
+  /* The server has no clean in-process shutdown, just leave */
+  _exit(0);
+}
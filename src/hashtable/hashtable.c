@@ -39,6 +39,15 @@
  * determines which of the partitions (each containing a tree and each
  * separately locked), and a hash which acts as the key within an
  * individual Red-Black Tree.
+ *
+ * Tables created with HT_FLAG_OPEN keep each partition in an open
+ * addressed array of (hash, entry) slots instead, probed linearly from
+ * the hash, four slots to a cache line.  A lookup then reads adjacent
+ * slots rather than chasing tree nodes.  Each partition doubles its
+ * array on its own when three quarters full, so growth is spread over
+ * the partitions and no partition count needs tuning for the number
+ * of entries.  Deletion shifts the following slots back, so there are
+ * no tombstones.
  */
 
 #include "config.h"
@@ -86,6 +95,121 @@ cache_offsetof(struct hash_table *ht, uint64_t rbthash)
 	return rbthash % ht->parameter.cache_entry_count;
 }
 
+/* Slots of a new open addressed partition */
+#define HT_OPEN_MIN_SLOTS 16
+
+static inline bool ht_open(const struct hash_table *ht)
+{
+	return ht->parameter.flags & HT_FLAG_OPEN;
+}
+
+/**
+ * @brief Locate a key within an open addressed partition
+ *
+ * @param[in]  ht      The hashtable to be used
+ * @param[in]  key     The key to look up
+ * @param[in]  index   Index into the partition array
+ * @param[in]  rbthash Hash of the key
+ * @param[out] slot    The slot of the key, or the free slot ending the
+ *                     probe
+ * @param[out] data    The entry found, NULL otherwise
+ *
+ * @retval HASHTABLE_SUCCESS if successfull
+ * @retval HASHTABLE_NO_SUCH_KEY if key was not found
+ */
+static hash_error_t
+slot_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
+	    uint32_t index, uint64_t rbthash, uint32_t *slot,
+	    struct hash_data **data)
+{
+	struct hash_partition *partition = &ht->partitions[index];
+	uint32_t mask = partition->nslots - 1;
+	uint32_t i = rbthash & mask;
+
+	while (partition->slots[i].data != NULL) {
+		if (partition->slots[i].hash == rbthash &&
+		    ht->parameter.compare_key((struct gsh_buffdesc *)key,
+					      &partition->slots[i].data->key)
+		    == 0) {
+			*slot = i;
+			*data = partition->slots[i].data;
+			return HASHTABLE_SUCCESS;
+		}
+		i = (i + 1) & mask;
+	}
+
+	*slot = i;
+	*data = NULL;
+	return HASHTABLE_ERROR_NO_SUCH_KEY;
+}
+
+/**
+ * @brief Double the slots of an open addressed partition
+ *
+ * Called with the partition write locked.
+ *
+ * @param[in,out] partition The partition to grow
+ */
+static void
+slots_grow(struct hash_partition *partition)
+{
+	struct hash_slot *old = partition->slots;
+	uint32_t nold = partition->nslots;
+	uint32_t mask = nold * 2 - 1;
+	uint32_t i, j;
+
+	partition->slots = gsh_calloc(nold * 2, sizeof(struct hash_slot));
+	partition->nslots = nold * 2;
+
+	for (i = 0; i < nold; i++) {
+		if (old[i].data == NULL)
+			continue;
+
+		for (j = old[i].hash & mask; partition->slots[j].data != NULL;
+		     j = (j + 1) & mask)
+			;
+
+		partition->slots[j] = old[i];
+	}
+
+	gsh_free(old);
+}
+
+/**
+ * @brief Empty a slot of an open addressed partition
+ *
+ * Entries probed past the slot are shifted back so that every entry
+ * stays reachable from its home slot.
+ *
+ * @param[in,out] partition The partition
+ * @param[in]     i         The slot to empty
+ */
+static void
+slot_remove(struct hash_partition *partition, uint32_t i)
+{
+	uint32_t mask = partition->nslots - 1;
+	uint32_t j = i;
+	uint32_t k;
+
+	for (;;) {
+		j = (j + 1) & mask;
+		if (partition->slots[j].data == NULL)
+			break;
+
+		/* Leave the entry at j if its home k lies cyclically
+		 * in (i, j], it is still reachable from there.
+		 */
+		k = partition->slots[j].hash & mask;
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		partition->slots[i] = partition->slots[j];
+		i = j;
+	}
+
+	partition->slots[i].data = NULL;
+}
+
 /**
  * @brief Return an error string for an error code
  *
@@ -268,6 +392,30 @@ compute(struct hash_table *ht, const struct gsh_buffdesc *key,
 	return HASHTABLE_SUCCESS;
 }
 
+/**
+ * @brief Find a partition count for a hash table
+ *
+ * @param[in] n Fewest partitions wanted
+ *
+ * @return The smallest prime no less than n, for index_size.
+ */
+
+uint32_t hashtable_prime(uint32_t n)
+{
+	uint32_t d;
+
+	if (n <= 2)
+		return 2;
+
+	for (n |= 1;; n += 2) {
+		for (d = 3; d * d <= n; d += 2)
+			if (n % d == 0)
+				break;
+		if (d * d > n)
+			return n;
+	}
+}
+
 /* The following are the hash table primitives implementing the
    actual functionality. */
 
@@ -317,6 +465,10 @@ hashtable_init(struct hash_param *hparam)
 			(sizeof(struct hash_partition) *
 			 hparam->index_size));
 
+	/* The slots are their own cache */
+	if (hparam->flags & HT_FLAG_OPEN)
+		hparam->flags &= ~HT_FLAG_CACHE;
+
 	/* Fixup entry size */
 	if (hparam->flags & HT_FLAG_CACHE) {
 		if (!hparam->cache_entry_count)
@@ -340,6 +492,12 @@ hashtable_init(struct hash_param *hparam)
 		if (hparam->flags & HT_FLAG_CACHE)
 			partition->cache = gsh_calloc(1, cache_page_size(ht));
 
+		if (hparam->flags & HT_FLAG_OPEN) {
+			partition->nslots = HT_OPEN_MIN_SLOTS;
+			partition->slots = gsh_calloc(HT_OPEN_MIN_SLOTS,
+						      sizeof(struct hash_slot));
+		}
+
 		completed++;
 	}
 
@@ -355,6 +513,8 @@ hashtable_init(struct hash_param *hparam)
 		if (hparam->flags & HT_FLAG_CACHE)
 			gsh_free(ht->partitions[completed - 1].cache);
 
+		gsh_free(ht->partitions[completed - 1].slots);
+
 		PTHREAD_RWLOCK_destroy(&(ht->partitions[completed - 1].lock));
 		completed--;
 	}
@@ -399,6 +559,9 @@ hashtable_destroy(struct hash_table *ht,
 			ht->partitions[index].cache = NULL;
 		}
 
+		gsh_free(ht->partitions[index].slots);
+		ht->partitions[index].slots = NULL;
+
 		PTHREAD_RWLOCK_destroy(&(ht->partitions[index].lock));
 	}
 	pool_destroy(ht->node_pool);
@@ -445,6 +608,8 @@ hashtable_getlatch(struct hash_table *ht,
 	struct hash_data *data = NULL;
 	/* The hash value to be searched for within the Red-Black tree */
 	uint64_t rbt_hash = 0;
+	/* The slot of the key with HT_FLAG_OPEN */
+	uint32_t slot = 0;
 	/* Stored error return */
 	hash_error_t rc = HASHTABLE_SUCCESS;
 
@@ -461,11 +626,15 @@ hashtable_getlatch(struct hash_table *ht,
 	else
 		PTHREAD_RWLOCK_rdlock(&(ht->partitions[index].lock));
 
-	rc = key_locate(ht, key, index, rbt_hash, &locator);
+	if (ht_open(ht))
+		rc = slot_locate(ht, key, index, rbt_hash, &slot, &data);
+	else
+		rc = key_locate(ht, key, index, rbt_hash, &locator);
 
 	if (rc == HASHTABLE_SUCCESS) {
 		/* Key was found */
-		data = RBT_OPAQ(locator);
+		if (locator != NULL)
+			data = RBT_OPAQ(locator);
 		if (val) {
 			val->addr = data->val.addr;
 			val->len = data->val.len;
@@ -492,6 +661,8 @@ hashtable_getlatch(struct hash_table *ht,
 		latch->index = index;
 		latch->rbt_hash = rbt_hash;
 		latch->locator = locator;
+		latch->data = ht_open(ht) ? data : NULL;
+		latch->slot = slot;
 	} else {
 		PTHREAD_RWLOCK_unlock(&ht->partitions[index].lock);
 	}
@@ -595,13 +766,14 @@ hashtable_setlatched(struct hash_table *ht,
 	}
 
 	/* In the case of collision */
-	if (latch->locator) {
+	if (latch->locator || latch->data) {
 		if (!overwrite) {
 			rc = HASHTABLE_ERROR_KEY_ALREADY_EXISTS;
 			goto out;
 		}
 
-		descriptors = RBT_OPAQ(latch->locator);
+		descriptors = latch->data ? latch->data
+					  : RBT_OPAQ(latch->locator);
 
 		if (isDebug(COMPONENT_HASHTABLE)
 		    && isFullDebug(ht->parameter.ht_log_component)) {
@@ -644,15 +816,37 @@ hashtable_setlatched(struct hash_table *ht,
 	/* We have no collision, so go about creating and inserting a new
 	   node. */
 
-	RBT_FIND(&ht->partitions[latch->index].rbt, locator, latch->rbt_hash);
+	descriptors = pool_alloc(ht->data_pool);
+
+	if (ht_open(ht)) {
+		struct hash_partition *partition =
+					&ht->partitions[latch->index];
+		uint32_t slot = latch->slot;
 
-	mutator = pool_alloc(ht->node_pool);
+		if ((partition->count + 1) * 4 > partition->nslots * 3) {
+			uint32_t mask;
 
-	descriptors = pool_alloc(ht->data_pool);
+			slots_grow(partition);
+			mask = partition->nslots - 1;
+			for (slot = latch->rbt_hash & mask;
+			     partition->slots[slot].data != NULL;
+			     slot = (slot + 1) & mask)
+				;
+		}
 
-	RBT_OPAQ(mutator) = descriptors;
-	RBT_VALUE(mutator) = latch->rbt_hash;
-	RBT_INSERT(&ht->partitions[latch->index].rbt, mutator, locator);
+		partition->slots[slot].hash = latch->rbt_hash;
+		partition->slots[slot].data = descriptors;
+	} else {
+		RBT_FIND(&ht->partitions[latch->index].rbt, locator,
+			 latch->rbt_hash);
+
+		mutator = pool_alloc(ht->node_pool);
+
+		RBT_OPAQ(mutator) = descriptors;
+		RBT_VALUE(mutator) = latch->rbt_hash;
+		RBT_INSERT(&ht->partitions[latch->index].rbt, mutator,
+			   locator);
+	}
 
 	descriptors->key.addr = key->addr;
 	descriptors->key.len = key->len;
@@ -707,10 +901,10 @@ void hashtable_deletelatched(struct hash_table *ht,
 	/* Its partition */
 	struct hash_partition *partition = &ht->partitions[latch->index];
 
-	if (!latch->locator)
+	if (!latch->locator && !latch->data)
 		return;
 
-	data = RBT_OPAQ(latch->locator);
+	data = latch->data ? latch->data : RBT_OPAQ(latch->locator);
 
 	if (isDebug(COMPONENT_HASHTABLE)
 	    && isFullDebug(ht->parameter.ht_log_component)) {
@@ -768,12 +962,54 @@ void hashtable_deletelatched(struct hash_table *ht,
 	}
 
 	/* Now remove the entry */
-	RBT_UNLINK(&partition->rbt, latch->locator);
+	if (latch->data) {
+		slot_remove(partition, latch->slot);
+		latch->data = NULL;
+	} else {
+		RBT_UNLINK(&partition->rbt, latch->locator);
+		pool_free(ht->node_pool, latch->locator);
+		latch->locator = NULL;
+	}
 	pool_free(ht->data_pool, data);
-	pool_free(ht->node_pool, latch->locator);
 	--ht->partitions[latch->index].count;
 }
 
+/**
+ * @brief Remove and free all entries of an open addressed partition
+ *
+ * Called with the partition write locked.
+ *
+ * @return false if free_func failed.
+ */
+static bool
+slots_delall(struct hash_table *ht, uint32_t index,
+	     int (*free_func)(struct gsh_buffdesc, struct gsh_buffdesc))
+{
+	struct hash_partition *partition = &ht->partitions[index];
+	struct hash_data *data;
+	struct gsh_buffdesc key;
+	struct gsh_buffdesc val;
+	uint32_t i;
+
+	for (i = 0; i < partition->nslots; i++) {
+		data = partition->slots[i].data;
+		if (data == NULL)
+			continue;
+
+		/* Every slot is emptied, so nothing needs shifting */
+		partition->slots[i].data = NULL;
+		key = data->key;
+		val = data->val;
+		pool_free(ht->data_pool, data);
+		--partition->count;
+
+		if (free_func(key, val) == 0)
+			return false;
+	}
+
+	return true;
+}
+
 /**
  * @brief Remove and free all (key,val) couples from the hash store
  *
@@ -802,6 +1038,11 @@ hashtable_delall(struct hash_table *ht,
 
 		PTHREAD_RWLOCK_wrlock(&ht->partitions[index].lock);
 
+		if (ht_open(ht) && !slots_delall(ht, index, free_func)) {
+			PTHREAD_RWLOCK_unlock(&ht->partitions[index].lock);
+			return HASHTABLE_ERROR_DELALL_FAIL;
+		}
+
 		/* Continue until there are no more entries in the red-black
 		   tree */
 		while ((cursor = RBT_LEFTMOST(root)) != NULL) {
@@ -867,6 +1108,8 @@ hashtable_log(log_components_t component, struct hash_table *ht)
 	char dispval[HASHTABLE_DISPLAY_STRLEN];
 	/* Index for traversing the partitions */
 	uint32_t i = 0;
+	/* Index for traversing open addressed slots */
+	uint32_t j = 0;
 	/* Running count of entries  */
 	size_t nb_entries = 0;
 	/* Recomputed partitionindex */
@@ -874,8 +1117,9 @@ hashtable_log(log_components_t component, struct hash_table *ht)
 	/* Recomputed hash for Red-Black tree */
 	uint64_t rbt_hash = 0;
 
-	LogFullDebug(component, "The hash is partitioned into %d trees",
-		     ht->parameter.index_size);
+	LogFullDebug(component, "The hash is partitioned into %d %s",
+		     ht->parameter.index_size,
+		     ht_open(ht) ? "slot arrays" : "trees");
 
 	for (i = 0; i < ht->parameter.index_size; i++)
 		nb_entries += ht->partitions[i].count;
@@ -888,6 +1132,17 @@ hashtable_log(log_components_t component, struct hash_table *ht)
 			     "The partition in position %" PRIu32
 			     "contains: %u entries", i, root->rbt_num_node);
 		PTHREAD_RWLOCK_rdlock(&ht->partitions[i].lock);
+		for (j = 0; j < ht->partitions[i].nslots; j++) {
+			data = ht->partitions[i].slots[j].data;
+			if (data == NULL)
+				continue;
+
+			ht->parameter.key_to_str(&(data->key), dispkey);
+			ht->parameter.val_to_str(&(data->val), dispval);
+
+			LogFullDebug(component, "%s => %s; index=%" PRIu32
+				     " slot=%" PRIu32, dispkey, dispval, i, j);
+		}
 		RBT_LOOP(root, it) {
 			data = it->rbt_opaq;
 
@@ -911,6 +1166,47 @@ hashtable_log(log_components_t component, struct hash_table *ht)
 	}
 }
 
+/**
+ * @brief Call a function on every entry of the hashtable
+ *
+ * Each partition is read locked while it is walked, so the function
+ * must not modify the hashtable.  Entries added or removed during the
+ * walk may or may not be seen.
+ *
+ * @param[in] ht   The hashtable to walk
+ * @param[in] func The function to call with each key and value
+ * @param[in] arg  Passed to func
+ */
+
+void
+hashtable_for_each(struct hash_table *ht,
+		   void (*func)(struct gsh_buffdesc *, struct gsh_buffdesc *,
+				void *),
+		   void *arg)
+{
+	struct rbt_node *it = NULL;
+	struct rbt_head *root;
+	struct hash_data *data = NULL;
+	uint32_t i = 0;
+	uint32_t j = 0;
+
+	for (i = 0; i < ht->parameter.index_size; i++) {
+		root = &ht->partitions[i].rbt;
+		PTHREAD_RWLOCK_rdlock(&ht->partitions[i].lock);
+		for (j = 0; j < ht->partitions[i].nslots; j++) {
+			data = ht->partitions[i].slots[j].data;
+			if (data != NULL)
+				func(&data->key, &data->val, arg);
+		}
+		RBT_LOOP(root, it) {
+			data = it->rbt_opaq;
+			func(&data->key, &data->val, arg);
+			RBT_INCREMENT(it);
+		}
+		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
+	}
+}
+
 /**
  * @brief Set a pair (key,value) into the Hash Table
  *
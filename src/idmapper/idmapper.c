@@ -52,10 +52,221 @@
 #include "common_utils.h"
 #include "gsh_rpc.h"
 #include "nfs_core.h"
+#include "fridgethr.h"
 #include "idmapper.h"
 
 static struct gsh_buffdesc owner_domain;
 
+/** Thread looking stale names up again */
+static struct fridgethr *idmapper_refresh_fridge;
+
+/**
+ * @brief Size of the buffer idmapper_id2name() needs
+ *
+ * @param[in] group True if this is a GID, false for a UID
+ */
+
+static int idmapper_id2name_size(bool group)
+{
+	int size;
+
+	if (!nfs_param.nfsv4_param.use_getpwnam)
+		return NFS4_MAX_DOMAIN_LEN + 2;
+
+	if (group)
+		size = sysconf(_SC_GETGR_R_SIZE_MAX);
+	else
+		size = sysconf(_SC_GETPW_R_SIZE_MAX);
+	if (size == -1)
+		size = PWENT_BEST_GUESS_LEN;
+
+	return size + owner_domain.len + 2;
+}
+
+/**
+ * @brief Look up the name of a UID or GID and cache it
+ *
+ * Falls back on the numeric ID or nobody if the lookup fails.
+ *
+ * @param[in]  id       UID or GID
+ * @param[in]  group    True if this is a GID, false for a UID
+ * @param[out] new_name The name, addr points to a buffer of
+ *                      idmapper_id2name_size() bytes
+ */
+
+static void idmapper_id2name(uint32_t id, bool group,
+			     struct gsh_buffdesc *new_name)
+{
+	char *namebuff = new_name->addr;
+	bool looked_up = false;
+	bool success;
+	int rc;
+
+	if (nfs_param.nfsv4_param.use_getpwnam) {
+		char *cursor;
+		bool nulled;
+
+		new_name->len = idmapper_id2name_size(group) -
+				owner_domain.len - 2;
+
+		if (group) {
+			struct group g;
+			struct group *gres;
+
+			rc = getgrgid_r(id, &g, namebuff, new_name->len,
+					&gres);
+			nulled = (gres == NULL);
+		} else {
+			struct passwd p;
+			struct passwd *pres;
+
+			rc = getpwuid_r(id, &p, namebuff, new_name->len,
+					&pres);
+			nulled = (pres == NULL);
+		}
+
+		if ((rc == 0) && !nulled) {
+			new_name->len = strlen(namebuff);
+			cursor = namebuff + new_name->len;
+			*(cursor++) = '@';
+			++new_name->len;
+			memcpy(cursor, owner_domain.addr,
+			       owner_domain.len);
+			new_name->len += owner_domain.len;
+			looked_up = true;
+		} else {
+			LogInfo(COMPONENT_IDMAPPER,
+				"%s failed with code %d.",
+				(group ? "getgrgid_r" : "getpwuid_r"),
+				rc);
+		}
+	} else {
+#ifdef USE_NFSIDMAP
+		if (group) {
+			rc = nfs4_gid_to_name(id, owner_domain.addr,
+					      namebuff,
+					      NFS4_MAX_DOMAIN_LEN + 1);
+		} else {
+			rc = nfs4_uid_to_name(id, owner_domain.addr,
+					      namebuff,
+					      NFS4_MAX_DOMAIN_LEN + 1);
+		}
+		if (rc == 0) {
+			new_name->len = strlen(namebuff);
+			looked_up = true;
+		} else {
+			LogInfo(COMPONENT_IDMAPPER,
+				"%s failed with code %d.",
+				(group ? "nfs4_gid_to_name" :
+				"nfs4_uid_to_name"), rc);
+		}
+#else				/* USE_NFSIDMAP */
+		looked_up = false;
+#endif				/* !USE_NFSIDMAP */
+	}
+
+	if (!looked_up) {
+		if (nfs_param.nfsv4_param.allow_numeric_owners) {
+			LogInfo(COMPONENT_IDMAPPER,
+				"Lookup for %d failed, using numeric %s",
+				id, (group ? "group" : "owner"));
+			/* 2**32 is 10 digits long in decimal */
+			sprintf(namebuff, "%"PRIu32, id);
+			new_name->len = strlen(namebuff);
+		} else {
+			LogInfo(COMPONENT_IDMAPPER,
+				"Lookup for %d failed, using nobody.",
+				id);
+			memcpy(new_name->addr, "nobody", 6);
+			new_name->len = 6;
+		}
+	}
+
+	/* Add to the cache */
+	PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
+	if (group)
+		success = idmapper_add_group(new_name, id);
+	else
+		success = idmapper_add_user(new_name, id, NULL, false);
+
+	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
+	if (unlikely(!success)) {
+		LogMajor(COMPONENT_IDMAPPER, "%s failed.",
+			 group ? "idmapper_add_group" :
+			 "idmaper_add_user");
+	}
+}
+
+/**
+ * @brief Look the names of stale IDs up again
+ *
+ * Runs on the refresh thread.  Each name is replaced in the cache once
+ * looked up, requests go on using the old one until then.
+ *
+ * @param[in] ctx Thread context
+ */
+
+static void idmapper_refresh(struct fridgethr_context *ctx)
+{
+	time_t before = time(NULL) - nfs_param.nfsv4_param.idmap_cache_refresh;
+	struct gsh_buffdesc new_name;
+	uint32_t *ids;
+	uint32_t count, i;
+	int group;
+
+	for (group = 0; group <= 1; group++) {
+		count = idmapper_cache_stale(group, before, &ids);
+		if (count == 0)
+			continue;
+
+		LogDebug(COMPONENT_IDMAPPER, "Refreshing %"PRIu32" %s",
+			 count, group ? "groups" : "users");
+
+		new_name.addr = gsh_malloc(idmapper_id2name_size(group));
+		for (i = 0; i < count && !fridgethr_you_should_break(ctx); i++)
+			idmapper_id2name(ids[i], group, &new_name);
+
+		gsh_free(new_name.addr);
+		gsh_free(ids);
+	}
+}
+
+/**
+ * @brief Start the thread refreshing stale names
+ */
+
+static void idmapper_refresh_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (nfs_param.nfsv4_param.idmap_cache_refresh == 0)
+		return;
+
+	memset(&frp, 0, sizeof(frp));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = nfs_param.nfsv4_param.idmap_cache_refresh / 4;
+	if (frp.thread_delay < 1)
+		frp.thread_delay = 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&idmapper_refresh_fridge, "idmap_refresh", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to initialize ID mapper refresh fridge: %d",
+			 rc);
+		return;
+	}
+
+	rc = fridgethr_submit(idmapper_refresh_fridge, idmapper_refresh, NULL);
+	if (rc != 0)
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to start ID mapper refresh thread: %d", rc);
+}
+
 /**
  * @brief Initialize the ID Mapper
  *
@@ -87,12 +298,16 @@ bool idmapper_init(void)
 	}
 
 	idmapper_cache_init();
+	idmapper_refresh_init();
 	return true;
 }
 
 /**
  * @brief Encode a UID or GID as a string
  *
+ * This is done for the owner and group of most GETATTR replies, so the
+ * lock-free tables are tried first.
+ *
  * @param[in,out] xdrs  XDR stream to which to encode
  * @param[in]     id    UID or GID
  * @param[in]     group True if this is a GID, false for a UID
@@ -104,6 +319,8 @@ bool idmapper_init(void)
 static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 {
 	const struct gsh_buffdesc *found;
+	struct gsh_buffdesc new_name;
+	char fastbuff[IDMAPPER_NAME_MAX];
 	uint32_t not_a_size_t;
 	bool success = false;
 
@@ -120,6 +337,12 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 					&not_a_size_t, UINT32_MAX);
 	}
 
+	if (likely(idmapper_fast_name(id, group, fastbuff, &not_a_size_t))) {
+		new_name.addr = fastbuff;
+		return inline_xdr_bytes(xdrs, (char **)&new_name.addr,
+					&not_a_size_t, UINT32_MAX);
+	}
+
 	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
 			      &idmapper_user_lock);
 	if (group)
@@ -138,128 +361,16 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
 				      &idmapper_user_lock);
 		return success;
-	} else {
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		int rc;
-		int size;
-		bool looked_up = false;
-		char *namebuff = NULL;
-		struct gsh_buffdesc new_name;
-
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			if (group)
-				size = sysconf(_SC_GETGR_R_SIZE_MAX);
-			else
-				size = sysconf(_SC_GETPW_R_SIZE_MAX);
-			if (size == -1)
-				size = PWENT_BEST_GUESS_LEN;
-			new_name.len = size;
-			size += owner_domain.len + 2;
-		} else {
-			size = NFS4_MAX_DOMAIN_LEN + 2;
-		}
-
-		namebuff = alloca(size);
-
-		new_name.addr = namebuff;
-
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			char *cursor;
-			bool nulled;
-
-			if (group) {
-				struct group g;
-				struct group *gres;
-
-				rc = getgrgid_r(id, &g, namebuff, new_name.len,
-						&gres);
-				nulled = (gres == NULL);
-			} else {
-				struct passwd p;
-				struct passwd *pres;
-
-				rc = getpwuid_r(id, &p, namebuff, new_name.len,
-						&pres);
-				nulled = (pres == NULL);
-			}
-
-			if ((rc == 0) && !nulled) {
-				new_name.len = strlen(namebuff);
-				cursor = namebuff + new_name.len;
-				*(cursor++) = '@';
-				++new_name.len;
-				memcpy(cursor, owner_domain.addr,
-				       owner_domain.len);
-				new_name.len += owner_domain.len;
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "getgrgid_r" : "getpwuid_r"),
-					rc);
-			}
-		} else {
-#ifdef USE_NFSIDMAP
-			if (group) {
-				rc = nfs4_gid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			} else {
-				rc = nfs4_uid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			}
-			if (rc == 0) {
-				new_name.len = strlen(namebuff);
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "nfs4_gid_to_name" :
-					"nfs4_uid_to_name"), rc);
-			}
-#else				/* USE_NFSIDMAP */
-			looked_up = false;
-#endif				/* !USE_NFSIDMAP */
-		}
-
-		if (!looked_up) {
-			if (nfs_param.nfsv4_param.allow_numeric_owners) {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using numeric %s",
-					id, (group ? "group" : "owner"));
-				/* 2**32 is 10 digits long in decimal */
-				sprintf(namebuff, "%"PRIu32, id);
-				new_name.len = strlen(namebuff);
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using nobody.",
-					id);
-				memcpy(new_name.addr, "nobody", 6);
-				new_name.len = 6;
-			}
-		}
+	}
+	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
 
-		/* Add to the cache and encode the result. */
-		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (group)
-			success = idmapper_add_group(&new_name, id);
-		else
-			success = idmapper_add_user(&new_name, id, NULL, false);
+	new_name.addr = alloca(idmapper_id2name_size(group));
+	idmapper_id2name(id, group, &new_name);
 
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (unlikely(!success)) {
-			LogMajor(COMPONENT_IDMAPPER, "%s failed.",
-				 group ? "idmapper_add_group" :
-				 "idmaper_add_user");
-		}
-		not_a_size_t = new_name.len;
-		return inline_xdr_bytes(xdrs, (char **)&new_name.addr,
-					&not_a_size_t, UINT32_MAX);
-	}
+	not_a_size_t = new_name.len;
+	return inline_xdr_bytes(xdrs, (char **)&new_name.addr,
+				&not_a_size_t, UINT32_MAX);
 }
 
 /**
@@ -522,6 +633,9 @@ static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 {
 	bool success;
 
+	if (likely(idmapper_fast_id(name, group, id)))
+		return true;
+
 	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
 			      &idmapper_user_lock);
 	if (group)
@@ -42,7 +42,9 @@
 #include "common_utils.h"
 #include "avltree.h"
 #include "idmapper.h"
+#include "nfs_core.h"
 #include "abstract_atomic.h"
+#include "city.h"
 
 /**
  * @brief User entry in the IDMapper cache
@@ -56,6 +58,7 @@ struct cache_user {
 	struct avltree_node uname_node;	/*< Node in the name tree */
 	struct avltree_node uid_node;	/*< Node in the UID tree */
 	bool in_uidtree;		/* true iff this is in uid_tree */
+	time_t epoch;		/*< When the mapping was made */
 };
 
 /**
@@ -67,6 +70,7 @@ struct cache_group {
 	gid_t gid;		/*< Group ID */
 	struct avltree_node gname_node;	/*< Node in the name tree */
 	struct avltree_node gid_node;	/*< Node in the GID tree */
+	time_t epoch;		/*< When the mapping was made */
 };
 
 /**
@@ -128,6 +132,74 @@ static struct avltree gname_tree;
 
 static struct avltree gid_tree;
 
+/**
+ * @brief Slots in each lock-free table
+ */
+
+#define IDMAP_SLOT_BITS 10
+#define IDMAP_SLOTS (1 << IDMAP_SLOT_BITS)
+
+/**
+ * @brief A mapping in one of the lock-free tables
+ *
+ * The tables mirror the trees for the mappings whose name fits, each
+ * slot holding the last one hashed to it.  Slots are read without a
+ * lock: seq is odd while a writer updates the slot, and a reader that
+ * sees it change misses and takes the locked path.  Writers either
+ * hold the tree's lock for write, or for read and give up on a slot
+ * that is busy.
+ */
+
+struct idmap_slot {
+	uint32_t seq;		/*< Update count, odd while writing */
+	uint32_t len;		/*< Length of name, 0 if the slot is empty */
+	uint32_t id;		/*< UID or GID */
+	char name[IDMAPPER_NAME_MAX];
+};
+
+static struct idmap_slot uid_slots[IDMAP_SLOTS];	/*< By UID */
+static struct idmap_slot uname_slots[IDMAP_SLOTS];	/*< By user name */
+static struct idmap_slot gid_slots[IDMAP_SLOTS];	/*< By GID */
+static struct idmap_slot gname_slots[IDMAP_SLOTS];	/*< By group name */
+
+#ifdef _HAVE_GSSAPI
+/**
+ * @brief Longest principal kept in the GSS context cache
+ */
+
+#define GSS_ID_PRINC_MAX 128
+
+/**
+ * @brief Mapping of a GSS context's principal
+ *
+ * Entries are read without a lock: seq is odd while a writer updates
+ * the entry, and a reader that sees it change retries or misses.
+ */
+
+struct gss_id_entry {
+	uint32_t seq;		/*< Update count, odd while writing */
+	uint32_t len;		/*< Length of principal */
+	const void *gd;		/*< GSS context the entry is for */
+	uint64_t gen;		/*< gss_id_gen when mapped */
+	uid_t uid;
+	gid_t gid;
+	char principal[GSS_ID_PRINC_MAX];
+};
+
+/**
+ * @brief Direct-mapped cache of GSS context to uid and gid
+ */
+
+static struct gss_id_entry *gss_id_cache;
+static uint32_t gss_id_mask;
+
+/**
+ * @brief Bumped whenever a cached user mapping may have changed
+ */
+
+static uint64_t gss_id_gen;
+#endif				/* _HAVE_GSSAPI */
+
 /**
  * @brief Compare two buffers
  *
@@ -265,6 +337,87 @@ static int gid_comparator(const struct avltree_node *node1,
 		return 0;
 }
 
+static inline struct idmap_slot *idmap_id_slot(struct idmap_slot *table,
+					       uint32_t id)
+{
+	return &table[(id * 0x9e3779b1U) >> (32 - IDMAP_SLOT_BITS)];
+}
+
+static inline struct idmap_slot *idmap_name_slot(struct idmap_slot *table,
+						 const struct gsh_buffdesc *name)
+{
+	return &table[CityHash64(name->addr, name->len) & (IDMAP_SLOTS - 1)];
+}
+
+/**
+ * @brief Store a mapping in a slot
+ *
+ * A name too long for the slot empties it, in case it held an older
+ * mapping of the same ID.
+ *
+ * @param[in] slot  The slot
+ * @param[in] name  The name, NULL to empty the slot
+ * @param[in] id    The UID or GID
+ * @param[in] wait  Wait for a busy slot, if the tree is write locked
+ */
+
+static void idmap_slot_store(struct idmap_slot *slot,
+			     const struct gsh_buffdesc *name, uint32_t id,
+			     bool wait)
+{
+	uint32_t seq;
+
+	/* Filled from a lookup, nothing older can be in the slot */
+	if (!wait && name->len > IDMAPPER_NAME_MAX)
+		return;
+
+	do {
+		seq = atomic_fetch_uint32_t(&slot->seq);
+		if ((seq & 1) && !wait)
+			return;
+	} while ((seq & 1) || !atomic_cas_uint32_t(&slot->seq, seq, seq + 1));
+
+	if (name == NULL || name->len > IDMAPPER_NAME_MAX) {
+		slot->len = 0;
+	} else {
+		slot->len = name->len;
+		slot->id = id;
+		memcpy(slot->name, name->addr, name->len);
+	}
+
+	atomic_store_uint32_t(&slot->seq, seq + 2);
+}
+
+/**
+ * @brief Empty the slot of an ID if it maps that ID
+ *
+ * @note The caller must hold the tree's lock for write.
+ */
+
+static void idmap_slot_drop_id(struct idmap_slot *table, uint32_t id)
+{
+	struct idmap_slot *slot = idmap_id_slot(table, id);
+
+	if (slot->len != 0 && slot->id == id)
+		idmap_slot_store(slot, NULL, 0, true);
+}
+
+/**
+ * @brief Empty the slot of a name if it maps that name
+ *
+ * @note The caller must hold the tree's lock for write.
+ */
+
+static void idmap_slot_drop_name(struct idmap_slot *table,
+				 const struct gsh_buffdesc *name)
+{
+	struct idmap_slot *slot = idmap_name_slot(table, name);
+
+	if (slot->len == name->len &&
+	    memcmp(slot->name, name->addr, name->len) == 0)
+		idmap_slot_store(slot, NULL, 0, true);
+}
+
 /**
  * @brief Initialize the IDMapper cache
  */
@@ -278,6 +431,15 @@ void idmapper_cache_init(void)
 	avltree_init(&gname_tree, gname_comparator, 0);
 	avltree_init(&gid_tree, gid_comparator, 0);
 	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
+
+#ifdef _HAVE_GSSAPI
+	/* one slot per context the GSS table may hold */
+	gss_id_mask = 1;
+	while (gss_id_mask < nfs_param.core_param.rpc.gss.max_ctx)
+		gss_id_mask <<= 1;
+	gss_id_cache = gsh_calloc(gss_id_mask, sizeof(struct gss_id_entry));
+	--gss_id_mask;
+#endif
 }
 
 /**
@@ -317,6 +479,7 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 		new->gid_set = false;
 	}
 	new->in_uidtree = (gss_princ) ? false : true;
+	new->epoch = time(NULL);
 
 	/*
 	 * There are 3 cases why we find an existing cache entry.
@@ -360,16 +523,24 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 				new->in_uidtree = true;
 		}
 
+#ifdef _HAVE_GSSAPI
+		/* GSS contexts may have cached the old mapping */
+		(void) atomic_inc_uint64_t(&gss_id_gen);
+#endif
+
 		/* Remove the old and insert the new */
 		avltree_remove(found_name, &uname_tree);
 		if (old->in_uidtree) {
 			uid_cache[old->uid % id_cache_size] = NULL;
+			idmap_slot_drop_id(uid_slots, old->uid);
 			avltree_remove(&old->uid_node, &uid_tree);
 		}
 		gsh_free(old);
 		found_name = avltree_insert(&new->uname_node, &uname_tree);
 		assert(found_name == NULL);
 	}
+	idmap_slot_store(idmap_name_slot(uname_slots, &new->uname),
+			 &new->uname, new->uid, true);
 
 	if (!new->in_uidtree) /* all done */
 		return true;
@@ -379,6 +550,7 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 		old = avltree_container_of(found_id, struct cache_user,
 					   uid_node);
 		uid_cache[old->uid % id_cache_size] = NULL;
+		idmap_slot_drop_name(uname_slots, &old->uname);
 		avltree_remove(found_id, &uid_tree);
 		avltree_remove(&old->uname_node, &uname_tree);
 		gsh_free(old);
@@ -386,6 +558,7 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 		assert(found_id == NULL);
 	}
 	uid_cache[uid % id_cache_size] = &new->uid_node;
+	idmap_slot_store(idmap_id_slot(uid_slots, uid), &new->uname, uid, true);
 
 	return true;
 }
@@ -414,6 +587,7 @@ bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
 	new->gname.addr = (char *)new + sizeof(struct cache_group);
 	new->gname.len = name->len;
 	new->gid = gid;
+	new->epoch = time(NULL);
 	memcpy(new->gname.addr, name->addr, name->len);
 
 	/*
@@ -437,6 +611,7 @@ bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
 		avltree_remove(found_name, &gname_tree);
 		avltree_remove(&tmp->gid_node, &gid_tree);
 		gid_cache[tmp->gid % id_cache_size] = NULL;
+		idmap_slot_drop_id(gid_slots, tmp->gid);
 		gsh_free(tmp);
 		found_name = avltree_insert(&new->gname_node, &gname_tree);
 		assert(found_name == NULL);
@@ -448,6 +623,7 @@ bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
 					   gid_node);
 
 		gid_cache[tmp->gid % id_cache_size] = NULL;
+		idmap_slot_drop_name(gname_slots, &tmp->gname);
 		avltree_remove(found_id, &gid_tree);
 		avltree_remove(&tmp->gname_node, &gname_tree);
 		gsh_free(tmp);
@@ -455,6 +631,9 @@ bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
 		assert(found_id == NULL);
 	}
 	gid_cache[gid % id_cache_size] = &new->gid_node;
+	idmap_slot_store(idmap_id_slot(gid_slots, gid), &new->gname, gid, true);
+	idmap_slot_store(idmap_name_slot(gname_slots, &new->gname),
+			 &new->gname, gid, true);
 
 	return true;
 }
@@ -505,6 +684,9 @@ bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 		atomic_store_voidptr(cache_slot, &found_user->uid_node);
 	}
 
+	idmap_slot_store(idmap_name_slot(uname_slots, name),
+			 &found_user->uname, found_user->uid, false);
+
 	if (likely(uid))
 		*uid = found_user->uid;
 
@@ -560,6 +742,9 @@ bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
 						  uid_node);
 	}
 
+	idmap_slot_store(idmap_id_slot(uid_slots, uid), &found_user->uname,
+			 uid, false);
+
 	if (likely(name))
 		*name = &found_user->uname;
 
@@ -606,6 +791,8 @@ bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
 
 	cache_slot = (void **)&gid_cache[found_group->gid % id_cache_size];
 	atomic_store_voidptr(cache_slot, &found_group->gid_node);
+	idmap_slot_store(idmap_name_slot(gname_slots, name),
+			 &found_group->gname, found_group->gid, false);
 
 	if (likely(gid))
 		*gid = found_group->gid;
@@ -657,6 +844,9 @@ bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
 						   gid_node);
 	}
 
+	idmap_slot_store(idmap_id_slot(gid_slots, gid), &found_group->gname,
+			 gid, false);
+
 	if (likely(name))
 		*name = &found_group->gname;
 	else
@@ -672,13 +862,24 @@ bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
 void idmapper_clear_cache(void)
 {
 	struct avltree_node *node;
+	int i;
 
 	PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
 	PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
 
+#ifdef _HAVE_GSSAPI
+	(void) atomic_inc_uint64_t(&gss_id_gen);
+#endif
 	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
 	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
 
+	for (i = 0; i < IDMAP_SLOTS; i++) {
+		idmap_slot_store(&uid_slots[i], NULL, 0, true);
+		idmap_slot_store(&uname_slots[i], NULL, 0, true);
+		idmap_slot_store(&gid_slots[i], NULL, 0, true);
+		idmap_slot_store(&gname_slots[i], NULL, 0, true);
+	}
+
 	for (node = avltree_first(&uname_tree);
 	     node != NULL;
 	     node = avltree_first(&uname_tree)) {
@@ -711,4 +912,210 @@ void idmapper_clear_cache(void)
 	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
 }
 
+/**
+ * @brief Look up the name of an ID without a lock
+ *
+ * @param[in]  id    The UID or GID
+ * @param[in]  group True for a GID
+ * @param[out] name  Buffer of IDMAPPER_NAME_MAX bytes for the name
+ * @param[out] len   Length of the name
+ *
+ * @retval true if the mapping was found.
+ * @retval false if the locked lookup has to be used.
+ */
+
+bool idmapper_fast_name(uint32_t id, bool group, char *name, uint32_t *len)
+{
+	struct idmap_slot *slot = idmap_id_slot(group ? gid_slots : uid_slots,
+						id);
+	uint32_t seq = atomic_fetch_uint32_t(&slot->seq);
+	bool found;
+
+	if (seq & 1)
+		return false;
+
+	*len = slot->len;
+	found = *len != 0 && *len <= IDMAPPER_NAME_MAX && slot->id == id;
+	if (found)
+		memcpy(name, slot->name, *len);
+
+	/* a writer got in, what was read may be torn */
+	return found && atomic_fetch_uint32_t(&slot->seq) == seq;
+}
+
+/**
+ * @brief Look up the ID of a name without a lock
+ *
+ * @param[in]  name  The user or group name
+ * @param[in]  group True for a group name
+ * @param[out] id    The UID or GID found
+ *
+ * @retval true if the mapping was found.
+ * @retval false if the locked lookup has to be used.
+ */
+
+bool idmapper_fast_id(const struct gsh_buffdesc *name, bool group,
+		      uint32_t *id)
+{
+	struct idmap_slot *slot;
+	uint32_t seq;
+	bool found;
+
+	if (name->len == 0 || name->len > IDMAPPER_NAME_MAX)
+		return false;
+
+	slot = idmap_name_slot(group ? gname_slots : uname_slots, name);
+	seq = atomic_fetch_uint32_t(&slot->seq);
+	if (seq & 1)
+		return false;
+
+	found = slot->len == name->len &&
+		memcmp(slot->name, name->addr, name->len) == 0;
+	*id = slot->id;
+
+	return found && atomic_fetch_uint32_t(&slot->seq) == seq;
+}
+
+/**
+ * @brief List the IDs whose mapping is older than a given time
+ *
+ * Principals, which are not mapped by ID, are left out.
+ *
+ * @param[in]  group  True for groups
+ * @param[in]  before Mappings made before this are listed
+ * @param[out] ids    The IDs, to be freed by the caller
+ *
+ * @return The number of IDs listed.
+ */
+
+uint32_t idmapper_cache_stale(bool group, time_t before, uint32_t **ids)
+{
+	struct avltree_node *node;
+	uint32_t count = 0, size = 0;
+	time_t epoch;
+	uint32_t id;
+
+	*ids = NULL;
+
+	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
+
+	for (node = avltree_first(group ? &gid_tree : &uid_tree);
+	     node != NULL;
+	     node = avltree_next(node)) {
+		if (group) {
+			struct cache_group *grp = avltree_container_of(
+					node, struct cache_group, gid_node);
+
+			epoch = grp->epoch;
+			id = grp->gid;
+		} else {
+			struct cache_user *user = avltree_container_of(
+					node, struct cache_user, uid_node);
+
+			epoch = user->epoch;
+			id = user->uid;
+		}
+
+		if (epoch >= before)
+			continue;
+
+		if (count == size) {
+			size = size == 0 ? 64 : size * 2;
+			*ids = gsh_realloc(*ids, size * sizeof(uint32_t));
+		}
+		(*ids)[count++] = id;
+	}
+
+	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
+
+	return count;
+}
+
+#ifdef _HAVE_GSSAPI
+static inline struct gss_id_entry *gss_id_slot(const void *gd)
+{
+	uint64_t h = (uintptr_t) gd * 0x9e3779b97f4a7c15ULL;
+
+	return &gss_id_cache[(h >> 32) & gss_id_mask];
+}
+
+/**
+ * @brief Look up the uid and gid a GSS context's principal maps to
+ *
+ * Takes no lock.  An entry only matches for the same context and the
+ * same principal, so a context freed and reused for another principal
+ * misses.
+ *
+ * @param[in]  gd        The GSS context
+ * @param[in]  principal Its principal
+ * @param[out] uid       The mapped UID
+ * @param[out] gid       The mapped GID
+ *
+ * @retval true if the mapping was cached.
+ */
+
+bool idmapper_lookup_by_gss(const void *gd,
+			    const struct gsh_buffdesc *principal,
+			    uid_t *uid, gid_t *gid)
+{
+	struct gss_id_entry *e;
+	uint32_t seq;
+	bool found;
+
+	if (gss_id_cache == NULL || principal->len > GSS_ID_PRINC_MAX)
+		return false;
+
+	e = gss_id_slot(gd);
+	seq = atomic_fetch_uint32_t(&e->seq);
+	if (seq & 1)
+		return false;
+
+	found = e->gd == gd && e->len == principal->len &&
+		e->gen == atomic_fetch_uint64_t(&gss_id_gen) &&
+		memcmp(e->principal, principal->addr, principal->len) == 0;
+	*uid = e->uid;
+	*gid = e->gid;
+
+	/* a writer got in, what was read may be torn */
+	return found && atomic_fetch_uint32_t(&e->seq) == seq;
+}
+
+/**
+ * @brief Cache the uid and gid a GSS context's principal maps to
+ *
+ * Gives up rather than wait if another thread is updating the slot.
+ *
+ * @param[in] gd        The GSS context
+ * @param[in] principal Its principal
+ * @param[in] uid       The mapped UID
+ * @param[in] gid       The mapped GID
+ */
+
+void idmapper_add_gss(const void *gd, const struct gsh_buffdesc *principal,
+		      uid_t uid, gid_t gid)
+{
+	struct gss_id_entry *e;
+	uint32_t seq;
+
+	if (gss_id_cache == NULL || principal->len > GSS_ID_PRINC_MAX)
+		return;
+
+	e = gss_id_slot(gd);
+	seq = atomic_fetch_uint32_t(&e->seq);
+	if ((seq & 1) || !atomic_cas_uint32_t(&e->seq, seq, seq + 1))
+		return;
+
+	e->gd = gd;
+	e->len = principal->len;
+	e->gen = atomic_fetch_uint64_t(&gss_id_gen);
+	e->uid = uid;
+	e->gid = gid;
+	memcpy(e->principal, principal->addr, principal->len);
+
+	atomic_store_uint32_t(&e->seq, seq + 2);
+}
+#endif				/* _HAVE_GSSAPI */
+
 /** @} */
@@ -38,6 +38,7 @@
 #include <fcntl.h>
 
 #include "9p_types.h"
+#include "abstract_atomic.h"
 #include "fsal_types.h"
 #include "sal_data.h"
 
@@ -53,10 +54,15 @@
 
 #define _9P_LOCK_CLIENT_LEN 64
 
-#define _9P_FID_PER_CONN        1024
+/* Fids of a connection are kept in pages of _9P_FID_PAGE_SIZE, allocated
+ * as clients use them, see _9p_fid_get() */
+#define _9P_FID_PAGE_SHIFT      8
+#define _9P_FID_PAGE_SIZE       (1 << _9P_FID_PAGE_SHIFT)
+#define _9P_FID_PAGES           256
+#define _9P_FID_PER_CONN        (_9P_FID_PAGE_SIZE * _9P_FID_PAGES)
 
-/* _9P_MSG_SIZE: maximum message size for 9P/TCP */
-#define _9P_MSG_SIZE 70000
+/* Message buffers kept for reuse by an idle 9P/TCP connection */
+#define _9P_CONN_FREE_BUFS      2
 
 #define _9P_HDR_SIZE  4
 #define _9P_TYPE_SIZE 1
@@ -351,6 +357,11 @@ struct _9p_flush_bucket {
 
 #define FLUSH_BUCKETS 32
 
+struct _9p_fid_page {
+	uint32_t nfids;		/* fids set in the page */
+	struct _9p_fid *fids[_9P_FID_PAGE_SIZE];
+};
+
 struct _9p_conn {
 	union trans_data {
 		long int sockfd;
@@ -363,13 +374,18 @@ struct _9p_conn {
 	struct gsh_client *client;
 	struct timeval birth;	/* This is useful if same sockfd is
 				   reused on socket's close/open */
-	struct _9p_fid *fids[_9P_FID_PER_CONN];
+	struct _9p_fid_page *fid_pages[_9P_FID_PAGES];
 	struct _9p_flush_bucket flush_buckets[FLUSH_BUCKETS];
 	unsigned long sequence;
 	pthread_mutex_t sock_lock;
 	struct sockaddr_storage addrpeer;
 	struct export_perms export_perms;
 	unsigned int msize;
+	/* 9P/TCP message buffers, all of bufsize bytes, see _9p_tcp_buf_get */
+	pthread_mutex_t buf_lock;
+	unsigned int bufsize;
+	unsigned int nfree_bufs;
+	char *free_bufs[_9P_CONN_FREE_BUFS];
 };
 
 #ifdef _USE_9P_RDMA
@@ -386,10 +402,20 @@ struct _9p_rdma_priv_pernic {
 	msk_data_t *rdata;
 };
 
+/* Credit use of a 9P/RDMA connection */
+struct _9p_rdma_stats {
+	uint64_t requests;	/* receive buffers consumed */
+	uint32_t inflight;	/* of them not yet reposted */
+	uint32_t max_inflight;
+	uint64_t outq_waits;	/* replies that waited for a send buffer */
+	uint64_t send_errors;
+};
+
 struct _9p_rdma_priv {
 	struct _9p_conn *pconn;
 	struct _9p_outqueue *outqueue;
 	struct _9p_rdma_priv_pernic *pernic;
+	struct _9p_rdma_stats stats;
 };
 #define _9p_rdma_priv_of(x) ((struct _9p_rdma_priv *)x->private_data)
 #endif
@@ -593,6 +619,11 @@ do {                                                   \
  */
 #define _9P_TCP_MSIZE 65536
 
+/**
+ * @brief Default value for _9p_tcp_event_loops
+ */
+#define _9P_TCP_EVENT_LOOPS 4
+
 /**
  * @brief Default value for _9p_rdma_msize
  */
@@ -617,6 +648,17 @@ do {                                                   \
  */
 #define _9P_RDMA_BACKLOG 10
 
+/**
+ * @brief Default number of rdma completion workers, 0 handles
+ * completions in the completion channel thread
+ */
+#define _9P_RDMA_COMPLETION_WORKERS 0
+
+/**
+ * @brief Completions queued per rdma completion worker
+ */
+#define _9P_RDMA_WORKER_QUEUE_SIZE 256
+
 
 /**
  * @brief 9p configuration
@@ -632,6 +674,10 @@ struct _9p_param {
 	/** Msize for 9P operation on tcp.  Defaults to _9P_TCP_MSIZE,
 	    settable by _9P_TCP_Msize */
 	uint32_t _9p_tcp_msize;
+	/** Threads serving 9P/TCP connections with epoll, 0 for a thread
+	    per connection.  Defaults to _9P_TCP_EVENT_LOOPS, settable by
+	    _9P_TCP_Event_Loops */
+	uint32_t _9p_tcp_event_loops;
 	/** Msize for 9P operation on rdma.  Defaults to _9P_RDMA_MSIZE,
 	    settable by _9P_RDMA_Msize */
 	uint32_t _9p_rdma_msize;
@@ -646,6 +692,12 @@ struct _9p_param {
 	    Defaults to _9P_RDMA_OUTPOOL_SIZE,
 	    settable by _9P_RDMA_OutPool_Size */
 	uint16_t _9p_rdma_outpool_size;
+	/** Threads handling rdma completions, so that completions of
+	    different connections are handled in parallel.  0 handles
+	    them in the completion channel thread.  Defaults to
+	    _9P_RDMA_COMPLETION_WORKERS, settable by
+	    _9P_RDMA_Completion_Workers */
+	uint16_t _9p_rdma_completion_workers;
 
 };
 
@@ -714,6 +766,32 @@ int _9p_tools_errno(fsal_status_t fsal_status);
 void _9p_openflags2FSAL(u32 *inflags, fsal_openflags_t *outflags);
 int _9p_tools_clunk(struct _9p_fid *pfid);
 void _9p_cleanup_fids(struct _9p_conn *conn);
+void _9p_fid_set(struct _9p_conn *conn, u32 fid, struct _9p_fid *pfid);
+
+/**
+ * @brief Look up a fid of a connection
+ *
+ * @param[in] conn The connection
+ * @param[in] fid  The fid number, below _9P_FID_PER_CONN
+ *
+ * @return The fid, or NULL if it isn't in use.
+ */
+static inline struct _9p_fid *_9p_fid_get(struct _9p_conn *conn, u32 fid)
+{
+	struct _9p_fid_page *page;
+
+	page = atomic_fetch_voidptr(
+			(void **)&conn->fid_pages[fid >> _9P_FID_PAGE_SHIFT]);
+	if (page == NULL)
+		return NULL;
+
+	return page->fids[fid & (_9P_FID_PAGE_SIZE - 1)];
+}
+
+void _9p_tcp_bufs_init(struct _9p_conn *conn);
+char *_9p_tcp_buf_get(struct _9p_conn *conn);
+void _9p_tcp_buf_put(struct _9p_conn *conn, char *buf);
+void _9p_tcp_bufs_fini(struct _9p_conn *conn);
 
 static inline unsigned int _9p_openflags_to_share_access(u32 *inflags)
 {
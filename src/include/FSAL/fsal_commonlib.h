@@ -245,4 +245,16 @@ bool check_verifier_stat(struct stat *st, fsal_verifier_t verifier);
 
 bool check_verifier_attrlist(struct attrlist *attrs, fsal_verifier_t verifier);
 
+/** Bounce buffer size of fsal_copy_rw */
+#define FSAL_COPY_BUFSIZE (1024 * 1024)
+
+fsal_status_t fsal_copy_rw(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count,
+			   uint64_t *copied);
+
 #endif				/* FSAL_COMMONLIB_H */
@@ -66,12 +66,17 @@
  * uint64_t atomic_postclear_uint64_t_bits(uint64_t *var,
  * uint64_t atomic_postset_uint64_t_bits(uint64_t *var,
  *
+ * The following conditional increment is provided for int32_t:
+ *
+ * bool atomic_inc_not_zero_int32_t(int32_t *var)
+ *
  */
 
 #ifndef _ABSTRACT_ATOMIC_H
 #define _ABSTRACT_ATOMIC_H
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <time.h>
 
 #undef GCC_SYNC_FUNCTIONS
@@ -2470,4 +2475,142 @@ static inline void atomic_store_uint8_t(uint8_t *var, uint8_t val)
 	(void)__sync_lock_test_and_set(var, val);
 }
 #endif
+/**
+ * @brief Atomically increment an int32_t unless it is zero
+ *
+ * This function increments the value indicated by the supplied
+ * pointer, as long as it is not zero.  It is used to take a reference
+ * on an object that may concurrently be released by its last holder.
+ *
+ * @param[in,out] var Pointer to the variable to modify
+ *
+ * @return true if the value was incremented.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_inc_not_zero_int32_t(int32_t *var)
+{
+	int32_t cur = __atomic_load_n(var, __ATOMIC_SEQ_CST);
+
+	while (cur != 0) {
+		if (__atomic_compare_exchange_n(var, &cur, cur + 1, false,
+						__ATOMIC_SEQ_CST,
+						__ATOMIC_SEQ_CST))
+			return true;
+	}
+
+	return false;
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_inc_not_zero_int32_t(int32_t *var)
+{
+	int32_t cur = __sync_fetch_and_add(var, 0);
+
+	while (cur != 0) {
+		int32_t old = __sync_val_compare_and_swap(var, cur, cur + 1);
+
+		if (old == cur)
+			return true;
+		cur = old;
+	}
+
+	return false;
+}
+#endif
+
+/**
+ * @brief Atomically compare and swap an int32_t
+ *
+ * @param[in,out] var Pointer to the variable to modify
+ * @param[in]     old Value var is expected to hold
+ * @param[in]     val Value to store if it does
+ *
+ * @return true if var held old and now holds val.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_cas_int32_t(int32_t *var, int32_t old, int32_t val)
+{
+	return __atomic_compare_exchange_n(var, &old, val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_cas_int32_t(int32_t *var, int32_t old, int32_t val)
+{
+	return __sync_bool_compare_and_swap(var, old, val);
+}
+#endif
+
+/**
+ * @brief Atomically compare and swap a uint32_t
+ *
+ * @param[in,out] var Pointer to the variable to modify
+ * @param[in]     old Value var is expected to hold
+ * @param[in]     val Value to store if it does
+ *
+ * @return true if var held old and now holds val.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_cas_uint32_t(uint32_t *var, uint32_t old,
+				       uint32_t val)
+{
+	return __atomic_compare_exchange_n(var, &old, val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_cas_uint32_t(uint32_t *var, uint32_t old,
+				       uint32_t val)
+{
+	return __sync_bool_compare_and_swap(var, old, val);
+}
+#endif
+
+/**
+ * @brief Atomically compare and swap a uint64_t
+ *
+ * @param[in,out] var Pointer to the variable to modify
+ * @param[in]     old Value var is expected to hold
+ * @param[in]     val Value to store if it does
+ *
+ * @return true if var held old and now holds val.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_cas_uint64_t(uint64_t *var, uint64_t old,
+				       uint64_t val)
+{
+	return __atomic_compare_exchange_n(var, &old, val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_cas_uint64_t(uint64_t *var, uint64_t old,
+				       uint64_t val)
+{
+	return __sync_bool_compare_and_swap(var, old, val);
+}
+#endif
+
+/**
+ * @brief Atomically compare and swap a pointer
+ *
+ * @param[in,out] var Pointer to the variable to modify
+ * @param[in]     old Value var is expected to hold
+ * @param[in]     val Value to store if it does
+ *
+ * @return true if var held old and now holds val.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_cas_voidptr(void **var, void *old, void *val)
+{
+	return __atomic_compare_exchange_n(var, &old, val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_cas_voidptr(void **var, void *old, void *val)
+{
+	return __sync_bool_compare_and_swap(var, old, val);
+}
+#endif
 #endif				/* !_ABSTRACT_ATOMIC_H */
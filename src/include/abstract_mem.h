@@ -43,6 +43,7 @@
 #include <string.h>
 #include <assert.h>
 #include "log.h"
+#include "gsh_slab.h"
 
 /**
  * @page GeneralAllocator General Allocator Shim
@@ -302,22 +303,23 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
 typedef struct pool {
 	char *name; /*< The name of the pool */
 	size_t object_size; /*< The size of the objects created */
+	struct gsh_slab *slab; /*< Slab cache the objects come from */
 } pool_t;
 
 /**
- * @brief Create a basic object pool
+ * @brief Create an object pool
  *
- * This function creates a new object pool, given a name, object size,
- * constructor and destructor.
- *
- * This particular implementation throws the name away, but other
- * implementations that do tracking or keep counts of allocated or
- * de-allocated objects will likely wish to use it in log messages.
+ * This function creates a new object pool, given a name and object
+ * size.  Objects come from a gsh_slab cache, with per-thread magazines
+ * in front of a shared depot, so an alloc/free pair on a busy thread
+ * takes no lock and never reaches malloc.  The cache is listed by name
+ * in the slab statistics; pools of the same name and size share it.
  *
  * This initializer function is expected to abort if it fails.
  *
  * @param[in] name             The name of this pool
  * @param[in] object_size      The size of objects to allocate
+ * @param[in] arena            Arena the cache's chunks come from
  * @param[in] file             Calling source file
  * @param[in] line             Calling source line
  * @param[in] function         Calling source function
@@ -331,6 +333,7 @@ typedef struct pool {
 
 static inline pool_t *
 pool_basic_init__(const char *name, size_t object_size,
+		  enum mem_arena arena,
 		  const char *file, int line, const char *function)
 {
 	pool_t *pool = (pool_t *) gsh_malloc__(sizeof(pool_t), file, line,
@@ -343,11 +346,29 @@ pool_basic_init__(const char *name, size_t object_size,
 	else
 		pool->name = NULL;
 
+	pool->slab = (struct gsh_slab *) gsh_calloc__(1,
+						      sizeof(struct gsh_slab),
+						      file, line, function);
+	pool->slab->name = pool->name ? pool->name : "pool";
+	pool->slab->size = object_size;
+	pool->slab->arena = arena;
+
 	return pool;
 }
 
 #define pool_basic_init(name, object_size) \
-	pool_basic_init__(name, object_size, __FILE__, __LINE__, __func__)
+	pool_basic_init__(name, object_size, MEM_ARENA_DEFAULT, \
+			  __FILE__, __LINE__, __func__)
+
+/* Every pool is slab backed now */
+#define pool_slab_init(name, object_size) \
+	pool_basic_init__(name, object_size, MEM_ARENA_DEFAULT, \
+			  __FILE__, __LINE__, __func__)
+
+/* A pool whose memory is counted to a subsystem's arena */
+#define pool_arena_init(name, object_size, arena) \
+	pool_basic_init__(name, object_size, arena, \
+			  __FILE__, __LINE__, __func__)
 
 /**
  * @brief Destroy a memory pool
@@ -355,12 +376,17 @@ pool_basic_init__(const char *name, size_t object_size,
  * This function destroys a memory pool.  All objects must be returned
  * to the pool before this function is called.
  *
+ * Other threads may still hold free objects of the slab cache in their
+ * magazines, so its depot stays registered and is taken up again by the
+ * next pool of the same name and size.
+ *
  * @param[in] pool The pool to be destroyed.
  */
 
 static inline void
 pool_destroy(pool_t *pool)
 {
+	gsh_free(pool->slab);
 	gsh_free(pool->name);
 	gsh_free(pool);
 }
@@ -392,7 +418,7 @@ pool_destroy(pool_t *pool)
 static inline void *
 pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
 {
-	return gsh_calloc__(1, pool->object_size, file, line, function);
+	return gsh_slab_alloc(pool->slab);
 }
 
 #define pool_alloc(pool) \
@@ -417,7 +443,7 @@ pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
 static inline void
 pool_free(pool_t *pool, void *object)
 {
-	gsh_free(object);
+	gsh_slab_free(pool->slab, object);
 }
 
 #endif /* ABSTRACT_MEM_H */
@@ -173,9 +173,19 @@ static inline signed int get_balance(struct avltree_node *node)
 typedef int (*avltree_cmp_fn_t) (const struct avltree_node *,
 				 const struct avltree_node *);
 
+/**
+ * @brief Recompute a node's subtree summary from its children
+ *
+ * Optional.  When set, the tree calls it on every node whose subtree
+ * changes, children before parents, so callers can keep an aggregate
+ * such as the largest interval end in each node's container.
+ */
+typedef void (*avltree_augment_fn_t) (struct avltree_node *);
+
 struct avltree {
 	struct avltree_node *root;
 	avltree_cmp_fn_t cmp_fn;
+	avltree_augment_fn_t augment_fn;
 	int height;
 	struct avltree_node *first, *last;
 	uint64_t size;
@@ -298,6 +308,7 @@ struct avltree_node *avltree_last(const struct avltree *tree)
 
 struct avltree_node *avltree_next(const struct avltree_node *node);
 struct avltree_node *avltree_prev(const struct avltree_node *node);
+struct avltree_node *avltree_parent(const struct avltree_node *node);
 uint64_t avltree_size(const struct avltree *tree);
 struct avltree_node *avltree_inf(const struct avltree_node *key,
 				 const struct avltree *tree);
@@ -309,6 +320,18 @@ void avltree_replace(struct avltree_node *old, struct avltree_node *newe,
 int avltree_init(struct avltree *tree, avltree_cmp_fn_t cmp,
 		 unsigned long flags);
 
+/**
+ * @brief Set the augment callback of an empty tree
+ *
+ * @note avltree_replace() copies the node links only, the caller must
+ * copy the aggregate along with it.
+ */
+static inline void avltree_set_augment(struct avltree *tree,
+				       avltree_augment_fn_t augment)
+{
+	tree->augment_fn = augment;
+}
+
 /*
  * Splay tree
  */
@@ -44,6 +44,9 @@
 
 #include "avltree.h"
 #include "gsh_types.h"
+#include "gsh_qos.h"
+
+#define GSH_CLIENT_ACL_SLOTS 8
 
 struct gsh_client {
 	struct avltree_node node_k;
@@ -52,6 +55,10 @@ struct gsh_client {
 	int64_t refcnt;
 	nsecs_elapsed_t last_update;
 	char *hostaddr_str;
+	/** Rate limit buckets, see Client_QoS_IOPS */
+	struct gsh_qos qos;
+	/** Cached export access decisions, see export_check_access() */
+	uint64_t acl_cache[GSH_CLIENT_ACL_SLOTS];
 	unsigned char addrbuf[];
 };
 
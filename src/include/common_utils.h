@@ -82,6 +82,25 @@ extern int portable_clock_gettime(struct timespec *ts);
 #define SCANDIR_CONST
 #endif
 
+#ifdef USE_LOCK_PROF
+#include "lock_prof.h"
+
+/* Where a lock is taken, for the contention profiler */
+#define LOCK_PROF_SITE(_lock, _kind)					\
+	static const struct lock_prof_site lock_prof_site = {		\
+		#_lock, __FILE__, __LINE__, _kind }
+#define LOCK_PROF_MUTEX_LOCK(_mtx) lock_prof_mutex_lock(_mtx, &lock_prof_site)
+#define LOCK_PROF_RDLOCK(_lock) lock_prof_rdlock(_lock, &lock_prof_site)
+#define LOCK_PROF_WRLOCK(_lock) lock_prof_wrlock(_lock, &lock_prof_site)
+#define LOCK_PROF_RELEASE(_lock) lock_prof_release(_lock)
+#else
+#define LOCK_PROF_SITE(_lock, _kind) do { } while (0)
+#define LOCK_PROF_MUTEX_LOCK(_mtx) pthread_mutex_lock(_mtx)
+#define LOCK_PROF_RDLOCK(_lock) pthread_rwlock_rdlock(_lock)
+#define LOCK_PROF_WRLOCK(_lock) pthread_rwlock_wrlock(_lock)
+#define LOCK_PROF_RELEASE(_lock) do { } while (0)
+#endif
+
 /**
  * @brief Logging rwlock initialization
  *
@@ -140,8 +159,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 #define PTHREAD_RWLOCK_wrlock(_lock)					\
 	do {								\
 		int rc;							\
+		LOCK_PROF_SITE(_lock, "wrlock");			\
 									\
-		rc = pthread_rwlock_wrlock(_lock);			\
+		rc = LOCK_PROF_WRLOCK(_lock);				\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got write lock on %p (%s) "	\
@@ -165,8 +185,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 #define PTHREAD_RWLOCK_rdlock(_lock)					\
 	do {								\
 		int rc;							\
+		LOCK_PROF_SITE(_lock, "rdlock");			\
 									\
-		rc = pthread_rwlock_rdlock(_lock);			\
+		rc = LOCK_PROF_RDLOCK(_lock);				\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got read lock on %p (%s) "	\
@@ -191,6 +212,7 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
+		LOCK_PROF_RELEASE(_lock);				\
 		rc = pthread_rwlock_unlock(_lock);			\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
@@ -215,8 +237,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 #define PTHREAD_MUTEX_lock(_mtx)					\
 	do {								\
 		int rc;							\
+		LOCK_PROF_SITE(_mtx, "mutex");				\
 									\
-		rc = pthread_mutex_lock(_mtx);				\
+		rc = LOCK_PROF_MUTEX_LOCK(_mtx);			\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Acquired mutex %p (%s) at %s:%d",	\
@@ -241,6 +264,7 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
+		LOCK_PROF_RELEASE(_mtx);				\
 		rc = pthread_mutex_unlock(_mtx);			\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
@@ -47,18 +47,28 @@
 #cmakedefine HAVE_STRING_H 1
 #cmakedefine HAVE_STRINGS_H 1
 #cmakedefine HAVE_STRNLEN 1
+#cmakedefine HAVE_STATX 1
 #cmakedefine LITTLEEND 1
 #cmakedefine BIGEND 1
 #cmakedefine HAVE_XATTR_H 1
 #cmakedefine HAVE_DAEMON 1
 #cmakedefine USE_LTTNG 1
+#cmakedefine USE_JEMALLOC 1
+#cmakedefine USE_IO_URING 1
+#cmakedefine USE_RADOS_RECOV 1
+#cmakedefine USE_LOCK_PROF 1
 #cmakedefine ENABLE_VFS_DEBUG_ACL 1
 #cmakedefine ENABLE_RFC_ACL 1
 #cmakedefine USE_GLUSTER_SYMLINK_MOUNT 1
+#cmakedefine USE_GLUSTER_COPY_FILE_RANGE 1
+#cmakedefine USE_GLUSTER_UPCALL_REGISTER 1
 #cmakedefine USE_FSAL_CEPH_MKNOD 1
 #cmakedefine USE_FSAL_CEPH_SETLK 1
 #cmakedefine USE_FSAL_CEPH_LL_LOOKUP_ROOT 1
 #cmakedefine USE_FSAL_CEPH_STATX 1
+#cmakedefine USE_FSAL_CEPH_LL_READV 1
+#cmakedefine USE_FSAL_CEPH_LL_NONBLOCKING_RW 1
+#cmakedefine USE_FSAL_CEPH_LL_LOOKUP_INODE 1
 #cmakedefine ENABLE_LOCKTRACE 1
 #cmakedefine SANITIZE_ADDRESS 1
 
@@ -817,6 +817,18 @@ static inline bool is_prime(int v)
 config_file_t config_ParseFile(char *file_path,
 			       struct config_error_type *err_type);
 
+/**
+ * @brief Parse configuration held in a string into a parse tree.
+ *
+ * @param buf       [IN]  NUL terminated configuration text
+ * @param name      [IN]  name to report errors against
+ * @param err_type  [OUT] Error type. Check this for success.
+ *
+ * @return pointer to parse tree.  Must be freed if != NULL
+ */
+config_file_t config_ParseBuffer(char *buf, char *name,
+				 struct config_error_type *err_type);
+
 /**
  * config_Print:
  * Print the content of the syntax tree
@@ -29,6 +29,13 @@
  *
  * This provides a simple system allowing tasks to be submitted along
  * with a delay.
+ *
+ * Tasks are kept in a hierarchical timing wheel with a resolution of
+ * a millisecond, so adding and cancelling a timer costs the same
+ * however many are pending.  Timers are added to an insert buffer
+ * picked by the calling thread and moved into the wheel by the
+ * executor, so submitters don't share a lock unless their timer is
+ * the next to fire.
 
  * This is similar to the thread fridge, however there is a lot of
  * complication in the thread fridge that would make no sense here,
@@ -52,11 +59,35 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "gsh_types.h"
+#include "gsh_list.h"
+
+/**
+ * @brief A timer, embedded in whatever it times
+ *
+ * Set up with delayed_timer_init, then added and cancelled any
+ * number of times.  Nothing is allocated, so the owner may free it
+ * once it is neither pending nor running.  The fields are private.
+ */
+
+struct delayed_timer {
+	struct glist_head link;	/*< In an insert buffer or the wheel */
+	uint64_t expires;	/*< Tick at which it fires */
+	void (*func)(void *);	/*< Function to run */
+	void *arg;		/*< Its argument */
+	uint32_t buffer;	/*< Insert buffer it was last added to */
+	uint32_t state;		/*< enum delayed_timer_state */
+	bool free_on_fire;	/*< Allocated by delayed_submit */
+};
 
 void delayed_start(void);
 void delayed_shutdown(void);
 int delayed_submit(void (*)(void *), void *, nsecs_elapsed_t);
 
+void delayed_timer_init(struct delayed_timer *timer, void (*func)(void *),
+			void *arg);
+void delayed_timer_add(struct delayed_timer *timer, nsecs_elapsed_t delay);
+bool delayed_timer_cancel(struct delayed_timer *timer);
+
 #endif				/* DELAYED_EXEC_H */
 
 /** @} */
@@ -39,6 +39,7 @@
 #include "gsh_list.h"
 #include "avltree.h"
 #include "abstract_atomic.h"
+#include "gsh_qos.h"
 #include "fsal.h"
 
 #ifndef EXPORT_MGR_H
@@ -77,8 +78,12 @@ struct gsh_export {
 	struct glist_head mounted_exports_node;
 	/** Entry for the root of this export, protected by lock */
 	struct fsal_obj_handle *exp_root_obj;
+	/** Root lookup queued at startup, protected by lock */
+	bool exp_root_pending;
 	/** CFG Allowed clients - update protected by lock */
 	struct glist_head clients;
+	/** Compiled form of clients - protected by lock */
+	struct client_acl *client_acl;
 	/** Entry for the junction of this export.  Protected by lock */
 	struct fsal_obj_handle *exp_junction_obj;
 	/** The export this export sits on. Protected by lock */
@@ -107,10 +112,29 @@ struct gsh_export {
 	uint64_t MaxOffsetWrite;
 	/** CFG: Maximum Offset allowed for read - atomic changeable option */
 	uint64_t MaxOffsetRead;
+	/** CFG: Ops per second allowed, 0 for no limit.  Settable with
+	    QoS_IOPS - atomic changeable option */
+	uint64_t qos_iops;
+	/** CFG: Bytes read and written per second allowed, 0 for no limit.
+	    Settable with QoS_Bandwidth - atomic changeable option */
+	uint64_t qos_bandwidth;
+	/** CFG: MDCACHE entries the export may hold, 0 for no limit.
+	    Settable with Cache_Entries_Max - atomic changeable option */
+	uint64_t cache_entries_max;
+	/** CFG: Bytes of readdir chunks the export may hold in MDCACHE,
+	    0 for no limit.  Settable with Cache_Dirent_Mem_Max - atomic
+	    changeable option */
+	uint64_t cache_dirent_mem_max;
+	/** Rate limit buckets */
+	struct gsh_qos qos;
 	/** CFG: Filesystem ID for overriding fsid from FSAL - ????? */
 	fsal_fsid_t filesystem_id;
 	/** References to this export */
 	int64_t refcnt;
+	/** While in the export manager, references are counted in
+	    ref_shards instead; see get_gsh_export_ref() */
+	uint32_t ref_sharded;
+	struct export_ref_shard *ref_shards;
 	/** Read/Write lock protecting export */
 	pthread_rwlock_t lock;
 	/** CFG: available mount options - update protected by lock */
@@ -176,6 +200,8 @@ void put_gsh_export(struct gsh_export *a_export);
 void remove_gsh_export(uint16_t export_id);
 bool foreach_gsh_export(bool(*cb) (struct gsh_export *exp, void *state),
 			void *state);
+uint32_t get_gsh_export_gen(void);
+void bump_gsh_export_gen(void);
 
 /**
  * @brief Advisory check of export readiness.
@@ -195,10 +221,7 @@ static inline bool export_ready(struct gsh_export *a_export)
 	return a_export->export_status == EXPORT_READY;
 }
 
-static inline void get_gsh_export_ref(struct gsh_export *a_export)
-{
-	(void) atomic_inc_int64_t(&a_export->refcnt);
-}
+void get_gsh_export_ref(struct gsh_export *a_export);
 
 void export_revert(struct gsh_export *a_export);
 void export_add_to_mount_work(struct gsh_export *a_export);
@@ -0,0 +1,80 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file flight_rec.h
+ * @brief Always-on binary event recorder
+ *
+ * Each thread records compact events in a ring of its own.  The rings
+ * are written to a file on request or when the server dies of a fatal
+ * signal, and scripts/flight_rec_decode.py prints them.
+ */
+
+#ifndef FLIGHT_REC_H
+#define FLIGHT_REC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* The format of the dump file, see flight_rec.c */
+#define FLIGHT_REC_MAGIC "GSHFLTR1"
+
+enum flight_rec_type {
+	FR_RPC_START = 1,	/*< op: RPC proc, arg: prog << 32 | vers */
+	FR_RPC_OP_START,	/*< op: RPC proc, arg: export id */
+	FR_RPC_OP_END,		/*< op: RPC proc, status: NFS_REQ_*, arg: ns */
+	FR_RPC_PHASE,		/*< op: nfs_req_phase, arg: ns in the phase */
+	FR_RPC_END,		/*< op: RPC proc, arg: ns since queued */
+	FR_V4OP_START,		/*< op: NFSv4 op, status: index, arg: fh hash */
+	FR_V4OP_END,		/*< op: NFSv4 op, status: nfsstat4, arg: ns */
+};
+
+/**
+ * @brief An event, 32 bytes
+ */
+struct flight_rec_event {
+	uint64_t ts;		/*< CLOCK_REALTIME in ns */
+	uint32_t xid;		/*< RPC xid of the request */
+	uint16_t type;		/*< enum flight_rec_type */
+	uint16_t op;
+	int32_t status;
+	uint32_t pad;
+	uint64_t arg;
+};
+
+extern bool flight_rec_enabled;
+
+void flight_rec_init(uint32_t events, const char *path);
+void flight_rec_event(enum flight_rec_type type, uint32_t xid, uint16_t op,
+		      int32_t status, uint64_t arg);
+int flight_rec_dump(const char *path);
+
+/**
+ * @brief Record an event if the recorder is on
+ */
+static inline void flight_rec(enum flight_rec_type type, uint32_t xid,
+			      uint16_t op, int32_t status, uint64_t arg)
+{
+	if (flight_rec_enabled)
+		flight_rec_event(type, xid, op, status, arg);
+}
+
+#endif				/* FLIGHT_REC_H */
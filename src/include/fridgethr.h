@@ -59,6 +59,7 @@ extern struct fridgethr *req_fridge;
 typedef struct nfs_worker_data {
 	wait_q_entry_t wqe;	/*< Queue for coordinating with decoder */
 	unsigned int worker_index;	/*< Index for log messages */
+	bool high_latency;	/*< Holds a high latency slot */
 } nfs_worker_data_t;
 
 /**
@@ -95,6 +96,7 @@ struct fridgethr_entry {
 	struct glist_head thread_link; /*< Link in the list of all
 					   threads */
 	struct glist_head idle_link; /*< Link in the idle queue */
+	struct fridgethr_deque *dq; /*< Our deque, in a stealer fridge */
 	struct fridgethr *fr; /*< The fridge we belong to */
 };
 
@@ -106,8 +108,15 @@ typedef enum {
 	fridgethr_flavor_worker = 0, /*< Take submitted jobs, do them,
 					 and then wait for more work
 					 to be submitted. */
-	fridgethr_flavor_looper = 1 /*< Each thread takes a single
+	fridgethr_flavor_looper = 1, /*< Each thread takes a single
 					job and repeats it. */
+	fridgethr_flavor_stealer = 2 /*< Like worker, but submitted
+					 jobs go on a lock-free
+					 injector and threads keep
+					 deques of work that idle
+					 threads steal from.  Needs
+					 thr_max and
+					 fridgethr_defer_queue. */
 } fridgethr_flavor_t;
 
 /**
@@ -186,11 +195,25 @@ struct fridgethr_params {
  */
 struct fridgethr_work {
 	struct glist_head link;	/*< Link in the work queue */
+	struct fridgethr_work *next; /*< Link in the injector */
 	void (*func)(struct fridgethr_context *); /*< Function being
 						      executed */
 	void *arg; /*< Functions argument */
 };
 
+/**
+ * @brief A stealer thread's work
+ *
+ * Only the owning thread adds to it, any thread takes from it.
+ */
+struct fridgethr_deque {
+	pthread_mutex_t mtx;	/*< Protects q */
+	struct glist_head q;	/*< Work, oldest first */
+	uint32_t len;		/*< Length of q, read without mtx */
+	bool used;		/*< Owned by a thread, under the fridge
+				   mutex */
+};
+
 /**
  * @brief Commands a caller can issue
  */
@@ -214,6 +237,7 @@ struct fridgethr {
 	uint32_t nthreads;	/*< Number of threads in fridge */
 	struct glist_head idle_q;	/*< Idle threads */
 	uint32_t nidle;		/*< Number of idle threads */
+	uint32_t nretire;	/*< Looper threads asked to exit */
 	uint32_t flags;		/*< Fridge-wide flags */
 	fridgethr_comm_t command;	/*< Command state */
 	void (*cb_func)(void *);	/*< Callback on command completion */
@@ -233,6 +257,16 @@ struct fridgethr {
 					      thread. */
 		} block;
 	} deferment;
+	struct {
+		struct fridgethr_work *inject; /*< Submitted work, a
+						   lock-free stack, newest
+						   first */
+		struct fridgethr_deque *deques; /*< thr_max deques */
+		pthread_cond_t cond; /*< Parked threads wait here */
+		uint32_t wake_pending; /*< A parked thread has been
+					   signalled and not yet
+					   woken */
+	} steal; /*< For fridgethr_flavor_stealer */
 };
 
 #define fridgethr_flag_none 0x0000 /*< Null flag */
@@ -258,6 +292,8 @@ int fridgethr_sync_command(struct fridgethr *, fridgethr_comm_t, time_t);
 bool fridgethr_you_should_break(struct fridgethr_context *);
 int fridgethr_populate(struct fridgethr *, void (*)(struct fridgethr_context *),
 		      void *);
+int fridgethr_resize(struct fridgethr *, uint32_t,
+		     void (*)(struct fridgethr_context *), void *);
 
 void fridgethr_setwait(struct fridgethr_context *ctx, time_t thread_delay);
 time_t fridgethr_getwait(struct fridgethr_context *ctx);
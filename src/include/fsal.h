@@ -363,6 +363,15 @@ fsal_status_t fsal_read2(struct fsal_obj_handle *obj,
 			 void *buffer,
 			 bool *eof,
 			 struct io_info *info);
+fsal_status_t fsal_read_ref2(struct fsal_obj_handle *obj,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     size_t io_size,
+			     size_t *bytes_moved,
+			     void **buffer,
+			     bool *eof,
+			     struct io_info *info);
 fsal_status_t fsal_write2(struct fsal_obj_handle *obj,
 			  bool bypass,
 			  struct state_t *state,
@@ -372,6 +381,14 @@ fsal_status_t fsal_write2(struct fsal_obj_handle *obj,
 			  void *buffer,
 			  bool *sync,
 			  struct io_info *info);
+fsal_status_t fsal_write_iobuf2(struct fsal_obj_handle *obj,
+				bool bypass,
+				struct state_t *state,
+				uint64_t offset,
+				size_t io_size,
+				size_t *bytes_moved,
+				void *buffer,
+				bool *sync);
 fsal_status_t fsal_rdwr(struct fsal_obj_handle *obj,
 		      fsal_io_direction_t io_direction,
 		      uint64_t offset, size_t io_size,
@@ -398,6 +415,8 @@ fsal_status_t fsal_open2(struct fsal_obj_handle *in_obj,
 			 fsal_verifier_t verifier,
 			 struct fsal_obj_handle **obj,
 			 struct attrlist *attrs_out);
+fsal_status_t fsal_reuse_open2(struct fsal_obj_handle *obj,
+			       fsal_openflags_t openflags);
 fsal_status_t fsal_reopen2(struct fsal_obj_handle *obj,
 			   struct state_t *state,
 			   fsal_openflags_t openflags,
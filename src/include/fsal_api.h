@@ -46,6 +46,7 @@
 #include "config_parsing.h"
 #include "avltree.h"
 #include "abstract_atomic.h"
+#include <sys/uio.h>
 
 /**
 ** Forward declarations to resolve circular dependency conflicts
@@ -325,7 +326,7 @@ struct state_t;
  * rules), increment the minor version
  */
 
-#define FSAL_MINOR_VERSION 0
+#define FSAL_MINOR_VERSION 6
 
 /* Forward references for object methods */
 
@@ -366,6 +367,19 @@ struct io_hints {
 	uint32_t hints;
 };
 
+/**
+ * @brief Where a readdir caller may keep its encoding of an entry
+ *
+ * A caching FSAL may keep one of these with each cached dirent and
+ * point op_ctx->dirent_enc at it while passing the entry to the readdir
+ * callback.  The blob is opaque to the FSAL, which frees it with
+ * gsh_free() when the dirent leaves the cache.
+ */
+struct fsal_dirent_enc {
+	pthread_mutex_t *mutex;	/*< Protects *blob */
+	void **blob;		/*< The caller's encoding, or NULL */
+};
+
 /**
  * @brief request op context
  *
@@ -418,9 +432,15 @@ struct req_op_context {
 	struct export_perms *export_perms;	/*< Effective export perms */
 	nsecs_elapsed_t start_time;	/*< start time of this op/request */
 	nsecs_elapsed_t queue_wait;	/*< time in wait queue */
+	nsecs_elapsed_t cpu_start;	/*< thread CPU time when this thread
+					    took the request up, 0 if not
+					    accounted */
 	void *fsal_private;		/*< private for FSAL use */
 	struct fsal_module *fsal_module;	/*< current fsal module */
 	struct fsal_pnfs_ds *fsal_pnfs_ds;	/*< current pNFS DS */
+	struct fsal_dirent_enc *dirent_enc;	/*< Encoding slot of the entry
+						    being passed to a readdir
+						    callback, if any */
 	/* add new context members here */
 };
 
@@ -800,6 +820,28 @@ struct export_ops {
 					struct gsh_buffdesc *hdl_desc,
 					struct fsal_obj_handle **handle,
 					struct attrlist *attrs_out);
+
+/**
+ * @brief Create a FSAL object handle from a wire handle and a hint
+ *
+ * As create_handle, for a wire handle that carried the hint given by
+ * handle_cache_hint.  The hint may be stale or made up by the client,
+ * so it must only speed up finding the object, never change which
+ * object is found.  The default method calls create_handle.
+ *
+ * @param[in]  exp_hdl   The export in which to create the handle
+ * @param[in]  hdl_desc  Buffer descriptor for the "wire" handle
+ * @param[in]  hint      Hint from the wire handle
+ * @param[out] handle    FSAL object handle
+ *
+ * @note On success, @a handle has been ref'd
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*create_handle_hint)(struct fsal_export *exp_hdl,
+					     struct gsh_buffdesc *hdl_desc,
+					     uint64_t hint,
+					     struct fsal_obj_handle **handle);
 /**@}*/
 
 /**@{*/
@@ -1293,6 +1335,56 @@ typedef enum fsal_dir_result (*fsal_readdir_cb)(
 				struct attrlist *attrs,
 				void *dir_state, fsal_cookie_t cookie,
 				fsal_cookie_t *ret_cookie);
+
+/**
+ * @brief A directory entry returned by readdir_plus
+ *
+ * The FSAL fills in all fields.  The caller owns the result: it frees
+ * name with gsh_free, releases attrs with fsal_release_attrs, and
+ * either keeps or releases the reference on obj.
+ */
+struct fsal_readdir_ent {
+	char *name;			/*< Entry name */
+	struct fsal_obj_handle *obj;	/*< Entry object, ref'd */
+	struct attrlist attrs;		/*< Requested attributes */
+	fsal_cookie_t cookie;		/*< Cookie of this entry */
+};
+
+/**
+ * @brief Arguments and results of an asynchronous read or write
+ *
+ * The caller allocates this with room for iov_count iovecs and keeps it
+ * (and the buffers it describes) alive until the completion callback
+ * has run.
+ */
+struct fsal_io_arg {
+	size_t io_amount;	/*< Total amount of I/O actually done */
+	struct io_info *info;	/*< More info about data for read_plus */
+	union {
+		bool end_of_file;	/*< True if end-of-file reached */
+		bool fsal_stable;	/*< In, stable write requested;
+					    out, what the FSAL did */
+	};
+	struct state_t *state;	/*< State to use for this I/O */
+	uint64_t offset;	/*< Offset into file to read or write */
+	int iov_count;		/*< Number of vectors in iov */
+	struct iovec iov[];	/*< Vector of buffers to fill or drain */
+};
+
+/**
+ * @brief Completion callback for asynchronous I/O
+ *
+ * May be called from the thread that issued the I/O, before the issuing
+ * method returns, or from an FSAL completion thread.
+ *
+ * @param[in] obj         Object the I/O was done on
+ * @param[in] ret         Result of the I/O
+ * @param[in] obj_data    The struct fsal_io_arg passed in
+ * @param[in] caller_data The caller's argument
+ */
+typedef void (*fsal_async_cb)(struct fsal_obj_handle *obj, fsal_status_t ret,
+			      void *obj_data, void *caller_data);
+
 /**
  * @brief FSAL object operations vector
  */
@@ -1420,6 +1512,34 @@ struct fsal_obj_ops {
 				  attrmask_t attrmask,
 				  bool *eof);
 
+/**
+ * @brief Read a batch of directory entries with their attributes
+ *
+ * Optional bulk form of readdir, for FSALs that can return names,
+ * handles and attributes for many entries in one back end call.  It
+ * lets a caching layer fill a whole directory chunk without a
+ * callback, and a lookup or getattr, per entry.
+ *
+ * FSALs that do not implement it return ERR_FSAL_NOTSUPP and the
+ * caller falls back to readdir.
+ *
+ * @param[in]     dir_hdl  Directory to read
+ * @param[in]     whence   Point at which to start reading.  NULL to
+ *                         start at beginning.
+ * @param[in]     attrmask Attributes the caller is interested in
+ * @param[out]    ents     Array to fill
+ * @param[in,out] nents    Size of ents on input, entries filled on output
+ * @param[out]    eof      true if the last entry was reached
+ *
+ * @return FSAL status.  On error no entries are returned.
+ */
+	 fsal_status_t (*readdir_plus)(struct fsal_obj_handle *dir_hdl,
+				       fsal_cookie_t *whence,
+				       attrmask_t attrmask,
+				       struct fsal_readdir_ent *ents,
+				       uint32_t *nents,
+				       bool *eof);
+
 /**
  * @brief Release a cached cookie.
  *
@@ -2247,6 +2367,19 @@ struct fsal_obj_ops {
  */
 	void (*handle_to_key)(struct fsal_obj_handle *obj_hdl,
 			      struct gsh_buffdesc *fh_desc);
+/**
+ * @brief Get a cache hint for handle
+ *
+ * The hint is put in the wire handle next to the digest, and given
+ * back to create_handle_hint when the client presents the handle.  It
+ * must be the same for the whole life of the object, since clients
+ * compare handles.  The default method returns 0, meaning no hint.
+ *
+ * @param[in] obj_hdl Handle whose hint is to be got
+ *
+ * @return The hint, or 0.
+ */
+	uint64_t (*handle_cache_hint)(const struct fsal_obj_handle *obj_hdl);
 /**
  * @brief Compare two handles
  *
@@ -2741,6 +2874,251 @@ struct fsal_obj_ops {
 	 fsal_status_t (*close2)(struct fsal_obj_handle *obj_hdl,
 				 struct state_t *state);
 
+/**
+ * @brief Read data from a file by reference
+ *
+ * This is an optional variant of read2 in which the FSAL supplies the
+ * buffer.  An FSAL that already holds the data in a gsh_iobuf (for
+ * example an in-memory or caching FSAL, or one whose backend can read
+ * straight into pinned pooled buffers) may return a new reference to
+ * that buffer instead of copying into a caller-provided one.
+ *
+ * On success, *buffer is a gsh_iobuf holding at least *read_amount
+ * bytes, and the caller owns one reference which it releases with
+ * gsh_iobuf_put.  FSALs that do not implement this return
+ * ERR_FSAL_NOTSUPP and the caller falls back to read2.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position from which to read
+ * @param[in]     buffer_size    Amount of data to read
+ * @param[out]    buffer         Referenced buffer holding the data
+ * @param[out]    read_amount    Amount of data read
+ * @param[out]    end_of_file    true if the end of file has been reached
+ * @param[in,out] info           more information about the data
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*read_ref2)(struct fsal_obj_handle *obj_hdl,
+				    bool bypass,
+				    struct state_t *state,
+				    uint64_t offset,
+				    size_t buffer_size,
+				    void **buffer,
+				    size_t *read_amount,
+				    bool *end_of_file,
+				    struct io_info *info);
+
+/**
+ * @brief Read data from a file into an iovec
+ *
+ * This is the scatter variant of read2.  Data is read from offset into
+ * the iovcnt segments of iov in order.  The default method reads into
+ * a bounce buffer with read2 and scatters it, so FSALs only need to
+ * implement this when their backend can do vectored I/O directly.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position from which to read
+ * @param[in]     iov            Segments to fill
+ * @param[in]     iovcnt         Number of segments
+ * @param[out]    read_amount    Amount of data read
+ * @param[out]    end_of_file    true if the end of file has been reached
+ * @param[in,out] info           more information about the data
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*readv2)(struct fsal_obj_handle *obj_hdl,
+				 bool bypass,
+				 struct state_t *state,
+				 uint64_t offset,
+				 const struct iovec *iov,
+				 int iovcnt,
+				 size_t *read_amount,
+				 bool *end_of_file,
+				 struct io_info *info);
+
+/**
+ * @brief Write data to a file from an iovec
+ *
+ * This is the gather variant of write2.  The iovcnt segments of iov are
+ * written in order starting at offset.  The default method coalesces
+ * the segments into a bounce buffer and calls write2.
+ *
+ * As with write2, if *fsal_stable is true on entry the data must be on
+ * stable storage when this returns.  An FSAL should use the cheapest
+ * mechanism available to it (a per-I/O sync flag rather than a
+ * separate fsync, for example).
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position at which to write
+ * @param[in]     iov            Segments to write
+ * @param[in]     iovcnt         Number of segments
+ * @param[out]    wrote_amount   Number of bytes written
+ * @param[in,out] fsal_stable    In, if on, the fsal is requested to write data
+ *                               to stable store. Out, the fsal reports what
+ *                               it did.
+ * @param[in,out] info           more information about the data
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*writev2)(struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  struct state_t *state,
+				  uint64_t offset,
+				  const struct iovec *iov,
+				  int iovcnt,
+				  size_t *wrote_amount,
+				  bool *fsal_stable,
+				  struct io_info *info);
+
+/**
+ * @brief Read data from a file asynchronously
+ *
+ * Start a read and return; done_cb is called with the result once the
+ * data are in read_arg's iovecs.  done_cb is always called exactly
+ * once, possibly before this method returns.  The default method does
+ * a synchronous readv2 and calls done_cb inline, so only FSALs whose
+ * backend can complete I/O from another thread need implement it.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     done_cb        Callback to call when I/O is done
+ * @param[in,out] read_arg       Info about read, passed back in callback
+ * @param[in]     caller_arg     Opaque arg from the caller for callback
+ */
+	 void (*read2_async)(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     fsal_async_cb done_cb,
+			     struct fsal_io_arg *read_arg,
+			     void *caller_arg);
+
+/**
+ * @brief Write data to a file asynchronously
+ *
+ * Start a write and return; done_cb is called with the result once the
+ * data have been written, to stable storage if write_arg->fsal_stable
+ * was set.  done_cb is always called exactly once, possibly before this
+ * method returns.  The default method does a synchronous writev2.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in]     done_cb        Callback to call when I/O is done
+ * @param[in,out] write_arg      Info about write, passed back in callback
+ * @param[in]     caller_arg     Opaque arg from the caller for callback
+ */
+	 void (*write2_async)(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      fsal_async_cb done_cb,
+			      struct fsal_io_arg *write_arg,
+			      void *caller_arg);
+
+/**
+ * @brief Commit written data asynchronously
+ *
+ * Start a commit2 and return; done_cb is called with the result, and
+ * a NULL obj_data, once the data are on stable storage.  done_cb is
+ * always called exactly once, possibly before this method returns.  The
+ * default method does a synchronous commit2.
+ *
+ * @param[in] obj_hdl          File on which to operate
+ * @param[in] offset           Start of range to commit
+ * @param[in] len              Length of range to commit
+ * @param[in] done_cb          Callback to call when the commit is done
+ * @param[in] caller_arg       Opaque arg from the caller for callback
+ */
+	 void (*commit2_async)(struct fsal_obj_handle *obj_hdl,
+			       off_t offset,
+			       size_t len,
+			       fsal_async_cb done_cb,
+			       void *caller_arg);
+
+/**
+ * @brief Copy a range of one file into another
+ *
+ * Server side copy for NFSv4.2 COPY.  Both handles belong to this FSAL
+ * and export.  The FSAL may copy less than asked, the caller then calls
+ * again from where it stopped; a short copy with nothing copied means
+ * the end of the source was reached.  Data need not be stable when this
+ * returns.  The default method reads and writes through read2 and
+ * write2 in the server, so FSALs only need to implement it when their
+ * backend can copy without moving the data through Ganesha.
+ *
+ * @param[in]  src_hdl    File to copy from
+ * @param[in]  src_state  state_t to read with, or NULL
+ * @param[in]  src_offset Position from which to copy
+ * @param[in]  dst_hdl    File to copy to
+ * @param[in]  dst_state  state_t to write with, or NULL
+ * @param[in]  dst_offset Position at which to copy
+ * @param[in]  count      Amount of data to copy
+ * @param[out] copied     Amount of data copied
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*copy)(struct fsal_obj_handle *src_hdl,
+			       struct state_t *src_state,
+			       uint64_t src_offset,
+			       struct fsal_obj_handle *dst_hdl,
+			       struct state_t *dst_state,
+			       uint64_t dst_offset,
+			       uint64_t count,
+			       uint64_t *copied);
+
+/**
+ * @brief Share a range of one file with another
+ *
+ * Server side clone for NFSv4.2 CLONE.  The destination range is made
+ * to share the source's blocks, as a reflink does, so no data move.
+ * Both handles belong to this FSAL and export.  Unlike copy, this is
+ * done entirely or not at all.  The default method returns
+ * ERR_FSAL_NOTSUPP.
+ *
+ * @param[in] src_hdl    File to clone from
+ * @param[in] src_state  state_t to read with, or NULL
+ * @param[in] src_offset Position from which to clone
+ * @param[in] dst_hdl    File to clone to
+ * @param[in] dst_state  state_t to write with, or NULL
+ * @param[in] dst_offset Position at which to clone
+ * @param[in] count      Amount to clone, 0 for up to the end of the
+ *                       source
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*clone)(struct fsal_obj_handle *src_hdl,
+				struct state_t *src_state,
+				uint64_t src_offset,
+				struct fsal_obj_handle *dst_hdl,
+				struct state_t *dst_state,
+				uint64_t dst_offset,
+				uint64_t count);
+
+/**
+ * @brief Get the change attribute of an object
+ *
+ * This is an optional, cheaper, variant of getattrs that only fetches
+ * the change attribute, so a caching layer can tell whether attributes
+ * it holds are still current without fetching them all.  The value
+ * MUST be the one getattrs reports in attrs->change.  FSALs that do
+ * not implement this return ERR_FSAL_NOTSUPP and the caller falls
+ * back to getattrs.
+ *
+ * @param[in]  obj_hdl Object to query
+ * @param[out] change  The change attribute
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*getchange)(struct fsal_obj_handle *obj_hdl,
+				    uint64_t *change);
+
 /**@}*/
 };
 
@@ -3188,6 +3566,9 @@ struct fsal_pnfs_ds {
 	struct avltree_node ds_node;	/*< Node in tree of all Data Servers. */
 	pthread_rwlock_t lock;		/*< Lock to be held when
 					    manipulating its list (above). */
+	pthread_mutex_t dsh_cache_lock;	/*< Lock for dsh_cache */
+	struct pnfs_dsh_slot *dsh_cache;	/*< Recently made DS handles,
+						    see support/ds.c */
 	int32_t refcount;		/*< Reference count */
 	uint16_t id_servers;		/*< Identifier */
 	uint8_t pnfs_ds_status;		/*< current condition */
@@ -201,11 +201,15 @@ typedef struct fsal_ace__ {
 	} who;
 } fsal_ace_t;
 
+struct fsal_acl_compiled;
+
 typedef struct fsal_acl__ {
 	uint32_t naces;
 	fsal_ace_t *aces;
 	pthread_rwlock_t lock;
 	uint32_t ref;
+	/** Evaluation form of shared entries, see nfs4_acls.h */
+	struct fsal_acl_compiled *compiled;
 } fsal_acl_t;
 
 typedef struct fsal_acl_data__ {
@@ -610,6 +614,27 @@ enum fsal_create_mode {
 	FSAL_EXCLUSIVE_9P,
 };
 
+/** Kinds of object operation, for timing calls into an FSAL */
+enum fsal_call {
+	FSAL_CALL_LOOKUP,
+	FSAL_CALL_READDIR,
+	FSAL_CALL_GETATTRS,
+	FSAL_CALL_SETATTRS,
+	FSAL_CALL_OPEN,
+	FSAL_CALL_CLOSE,
+	FSAL_CALL_READ,
+	FSAL_CALL_WRITE,
+	FSAL_CALL_COMMIT,
+	FSAL_CALL_LOCK,
+	FSAL_CALL_CREATE,	/*< mkdir, mknode and symlink */
+	FSAL_CALL_LINK,
+	FSAL_CALL_UNLINK,
+	FSAL_CALL_RENAME,
+	FSAL_CALL_READLINK,
+	FSAL_CALL_GETCHANGE,
+	FSAL_CALL_COUNT
+};
+
 /** File system static info. */
 
 /* enums for accessing
@@ -641,6 +666,7 @@ typedef enum enum_fsal_fsinfo_options {
 	fso_link_supports_permission_checks,
 	fso_rename_changes_key,
 	fso_compute_readdir_cookie,
+	fso_upcall_invalidation,
 } fsal_fsinfo_options_t;
 
 /* The largest maxread and maxwrite value */
@@ -693,6 +719,10 @@ typedef struct fsal_staticfsinfo_t {
 	bool link_supports_permission_checks;
 	bool rename_changes_key;/*< Handle key is changed across rename */
 	bool compute_readdir_cookie;
+	bool upcall_invalidation;	/*< Every change to the file system,
+					   including from other nodes, is
+					   reported through FSAL_UP, so
+					   cached metadata need not expire */
 } fsal_staticfsinfo_t;
 
 /**
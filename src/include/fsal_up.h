@@ -138,6 +138,14 @@ static const uint32_t FSAL_UP_INVALIDATE_CLOSE = 0x100;
  * address of the handle stored in the cache.
  */
 
+/**
+ * @brief One of a batch of invalidations
+ */
+struct fsal_up_invalidate {
+	struct gsh_buffdesc obj;	/*< The file to invalidate */
+	uint32_t flags;			/*< FSAL_UP_INVALIDATE_* */
+};
+
 struct fsal_up_vector {
 	/** The export this vector lives in */
 	struct fsal_export *up_export;
@@ -257,6 +265,20 @@ struct fsal_up_vector {
 	fsal_status_t (*invalidate_close)(struct fsal_export *exp,
 					  struct gsh_buffdesc *obj,
 					  uint32_t flags);
+
+	/** Invalidate several cache entries at once
+	 *
+	 * Optional; without it each is passed to @c invalidate.  Used for
+	 * the invalidations coalesced by up_async_invalidate.  Errors of
+	 * single entries are not reported.
+	 *
+	 * @param[in] export	FSAL export owning ops
+	 * @param[in] inv	The files and what to invalidate of each
+	 * @param[in] count	Number of @a inv
+	 */
+	void (*invalidate_batch)(struct fsal_export *exp,
+				 struct fsal_up_invalidate *inv,
+				 uint32_t count);
 };
 
 extern struct fsal_up_vector fsal_up_top;
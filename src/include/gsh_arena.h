@@ -0,0 +1,145 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_arena.h
+ * @brief Bump allocator for memory released all at once
+ *
+ * An arena hands out memory from chunks by moving an offset, and frees
+ * it only when the whole arena is released.  One chunk covers the
+ * result of a typical compound, and a released chunk is kept for the
+ * thread's next arena, so the common case calls malloc not at all.
+ *
+ * An arena does no locking of its own.
+ */
+
+#ifndef GSH_ARENA_H
+#define GSH_ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/** Size of a standard chunk, header included */
+#define GSH_ARENA_CHUNK 2048
+
+/** Allocations are aligned to this */
+#define GSH_ARENA_ALIGN 16
+
+struct gsh_arena_chunk {
+	struct gsh_arena_chunk *next;	/*< Older chunk */
+	size_t size;		/*< Bytes in data */
+	size_t used;		/*< Bytes handed out */
+	char data[] __attribute__ ((aligned(GSH_ARENA_ALIGN)));
+};
+
+struct gsh_arena {
+	struct gsh_arena_chunk *chunk;	/*< Current chunk, NULL if none */
+	void *last;		/*< Most recent allocation, for trimming */
+};
+
+void *gsh_arena_alloc_slow(struct gsh_arena *arena, size_t size);
+void gsh_arena_release(struct gsh_arena *arena);
+
+static inline void gsh_arena_init(struct gsh_arena *arena)
+{
+	arena->chunk = NULL;
+	arena->last = NULL;
+}
+
+/**
+ * @brief Allocate from an arena
+ *
+ * @param[in] arena The arena
+ * @param[in] size  Bytes wanted
+ *
+ * @return Uninitialized memory, valid until the arena is released.
+ */
+static inline void *gsh_arena_alloc(struct gsh_arena *arena, size_t size)
+{
+	struct gsh_arena_chunk *chunk = arena->chunk;
+	size_t need = (size + GSH_ARENA_ALIGN - 1) & ~(GSH_ARENA_ALIGN - 1);
+
+	if (chunk == NULL || chunk->size - chunk->used < need)
+		return gsh_arena_alloc_slow(arena, need);
+
+	arena->last = chunk->data + chunk->used;
+	chunk->used += need;
+	return arena->last;
+}
+
+static inline void *gsh_arena_calloc(struct gsh_arena *arena, size_t n,
+				     size_t size)
+{
+	void *p = gsh_arena_alloc(arena, n * size);
+
+	memset(p, 0, n * size);
+	return p;
+}
+
+/**
+ * @brief Shrink the most recent allocation
+ *
+ * Lets a caller reserve room for the worst case and give back what it
+ * did not use.  Does nothing if @c p is not the last allocation.
+ *
+ * @param[in] arena The arena
+ * @param[in] p     The allocation
+ * @param[in] size  Bytes to keep, 0 to give it all back
+ */
+static inline void gsh_arena_trim(struct gsh_arena *arena, void *p,
+				  size_t size)
+{
+	struct gsh_arena_chunk *chunk = arena->chunk;
+	size_t keep = (size + GSH_ARENA_ALIGN - 1) & ~(GSH_ARENA_ALIGN - 1);
+
+	if (p == NULL || p != arena->last)
+		return;
+
+	chunk->used = (char *)p - chunk->data + keep;
+	if (keep == 0)
+		arena->last = NULL;
+}
+
+/**
+ * @brief Whether memory came from an arena
+ *
+ * @param[in] arena The arena
+ * @param[in] p     The memory
+ *
+ * @return true if @c p lies in one of the arena's chunks.
+ */
+static inline bool gsh_arena_owns(const struct gsh_arena *arena,
+				  const void *p)
+{
+	const struct gsh_arena_chunk *chunk;
+
+	for (chunk = arena->chunk; chunk != NULL; chunk = chunk->next) {
+		if ((const char *)p >= chunk->data &&
+		    (const char *)p < chunk->data + chunk->size)
+			return true;
+	}
+
+	return false;
+}
+
+#endif				/* GSH_ARENA_H */
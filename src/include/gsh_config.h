@@ -83,6 +83,11 @@ typedef enum protos {
  */
 #define NB_WORKER_THREAD_DEFAULT 256
 
+/**
+ * @brief Default value for core_param.iobuf_pool_size (MiB)
+ */
+#define IOBUF_POOL_SIZE_DEFAULT 256
+
 /**
  * @brief Default value for core_param.drc.tcp.npart
  */
@@ -158,6 +163,17 @@ typedef enum protos {
  */
 #define NFS_DEFAULT_RECV_BUFFER_SIZE 1048576
 
+/**
+ * Largest core_param.rpc.max_send_buffer_size and max_recv_buffer_size,
+ * a 16 MiB payload and room for the rest of the compound
+ */
+#define NFS_MAX_RPC_BUFFER_SIZE (17 * 1048576)
+
+/**
+ * @brief Default value for core_param.io_segment_size
+ */
+#define IO_SEGMENT_SIZE_DEFAULT 1048576
+
 /**
  * @brief Support NFSv3
  */
@@ -208,6 +224,16 @@ typedef struct nfs_core_param {
 	/** Number of worker threads.  Set to NB_WORKER_DEFAULT by
 	    default and changed with the Nb_Worker option. */
 	uint32_t nb_worker;
+	/** Fewest and most worker threads when the pool is sized to the
+	    load, starting from Nb_Worker.  0 for either keeps the pool
+	    at Nb_Worker.  Default to 0 and settable with Nb_Worker_Min
+	    and Nb_Worker_Max. */
+	uint32_t nb_worker_min;
+	uint32_t nb_worker_max;
+	/** Average time in usecs requests may wait for a worker before
+	    a pool with every worker busy grows.  Defaults to 2000 and
+	    settable with Worker_Queue_Wait_Target. */
+	uint32_t worker_queue_wait_target;
 	/** For NFSv3, whether to drop rather than reply to requests
 	    yielding I/O errors.  True by default and settable with
 	    Drop_IO_Errors.  As this generally results in client
@@ -232,6 +258,83 @@ typedef struct nfs_core_param {
 	    specific transport.  Defaults to 512 and settable by
 	    Dispatch_Max_Reqs_Xprt. */
 	uint32_t dispatch_max_reqs_xprt;
+	/** Bytes of requests to allow into the dispatcher at once, 0
+	    for no limit.  A request costs its request data plus the
+	    data it reads or writes, from decode until its reply is
+	    sent.  Defaults to 0 and settable by Dispatch_Max_Bytes. */
+	uint64_t dispatch_max_bytes;
+	/** Bytes of requests to allow into the dispatcher from one
+	    transport, 0 for no limit.  Defaults to 0 and settable by
+	    Dispatch_Max_Bytes_Xprt. */
+	uint64_t dispatch_max_bytes_xprt;
+	/** Number of request queue sets (shards).  Decoders enqueue on
+	    the shard of the CPU they run on and workers drain their
+	    local shard before stealing from the others.  0 means one
+	    shard per online CPU.  Defaults to 1 (a single shared set)
+	    and settable by Dispatch_Queue_Shards. */
+	uint32_t dispatch_queue_shards;
+	/** Relative shares of dequeues given to the MOUNT, CALL, low
+	    latency and high latency queues when all have work.
+	    Default to 1 each and settable by Dispatch_Weight_Mount,
+	    Dispatch_Weight_Call, Dispatch_Weight_Low_Latency and
+	    Dispatch_Weight_High_Latency. */
+	uint32_t dispatch_weight_mount;
+	uint32_t dispatch_weight_call;
+	uint32_t dispatch_weight_low_latency;
+	uint32_t dispatch_weight_high_latency;
+	/** Most workers that may be inside high latency requests (READ,
+	    WRITE, COMMIT...) at once, 0 for no limit.  Defaults to 0 and
+	    settable by Dispatch_Max_High_Latency. */
+	uint32_t dispatch_max_high_latency;
+	/** Cheap requests a decoder may run itself, rather than queue to
+	    the workers, each time it drains a transport.  0 disables.
+	    Defaults to 0 and settable by Dispatch_Inline_Budget. */
+	uint32_t dispatch_inline_budget;
+	/** Microseconds a worker that just finished a request polls the
+	    queues before going to sleep.  0 disables.  Defaults to 0 and
+	    settable by Dispatch_Spin_Usec. */
+	uint32_t dispatch_spin_usec;
+	/** Size (in MiB) of the shared depot of pooled READ buffers,
+	    in front of which each worker keeps a small per-thread
+	    cache.  0 disables pooling.  Defaults to
+	    IOBUF_POOL_SIZE_DEFAULT and settable by IOBuf_Pool_Size. */
+	uint32_t iobuf_pool_size;
+	/** READ and WRITE payloads larger than this many bytes are
+	    held in pooled segments of this size instead of one
+	    contiguous buffer.  0 never segments.  Defaults to
+	    IO_SEGMENT_SIZE_DEFAULT and settable by IO_Segment_Size. */
+	uint32_t io_segment_size;
+	/** Whether to split the workers into one pool per NUMA node,
+	    bound to that node's CPUs, with one request queue shard
+	    per node.  Requests from a connection are queued on the
+	    node that received its packets.  Object pools then keep a
+	    depot per node as well.  Defaults to false and settable by
+	    Worker_NUMA_Pools. */
+	bool worker_numa_pools;
+	/** Whether the cache, state, RPC and XDR memory each come from
+	    a jemalloc arena of their own, reported by ShowMemArenas.
+	    Needs a build with ALLOCATOR=jemalloc.  Defaults to false
+	    and settable by Memory_Arenas. */
+	bool memory_arenas;
+	/** Milliseconds upcall invalidations are held to merge those
+	    of one file and hand them to the cache as one batch.  0
+	    processes each as it comes.  Defaults to 0 and settable
+	    with Upcall_Coalesce_Window. */
+	uint32_t upcall_coalesce_window;
+	/** Whether NFSv4 READ and WRITE use the FSALs' asynchronous
+	    I/O methods, releasing the worker while the I/O is in
+	    flight.  Defaults to false and settable by Async_IO. */
+	bool async_io;
+	/** Sequential (or non-sequential) READs in a row, through an
+	    open state or of a file without one, after which the FSAL
+	    is advised to read ahead (or not to).  0 disables the
+	    detection.  Defaults to 0 and settable by
+	    Readahead_Hint_Reads. */
+	uint32_t readahead_hint_reads;
+	/** Bytes ahead of sequential READs the FSAL is asked to read
+	    in.  Defaults to 4 MiB and settable by
+	    Readahead_Hint_Size. */
+	uint32_t readahead_hint_size;
 	/** Parameters controlling the Duplicate Request Cache.  */
 	struct {
 		/** Whether to disable the DRC entirely.  Defaults to
@@ -326,8 +429,32 @@ typedef struct nfs_core_param {
 		/** TIRPC ioq max simultaneous io threads.  Defaults to
 		    200 and settable by RPC_Ioq_ThrdMax. */
 		uint32_t ioq_thrd_max;
+		/** Event channels (epoll threads) serving TCP
+		    connections, 0 for one per four CPUs, at least
+		    three.  Defaults to 0 and settable by
+		    RPC_TCP_Event_Channels. */
+		uint32_t tcp_event_chans;
+		/** Open an SO_REUSEPORT listener on each TCP event
+		    channel, so the kernel spreads accepts.  Defaults
+		    to false and settable by RPC_Listen_Reuseport. */
+		bool listen_reuseport;
+		/** SO_REUSEPORT UDP sockets per protocol, each with
+		    its own event channel and shared DRC.  Defaults to
+		    1 and settable by RPC_UDP_Sockets. */
+		uint32_t udp_sockets;
+		/** Cork a TCP connection while it has requests in
+		    progress, so their replies leave in full segments
+		    rather than one send each.  Defaults to false and
+		    settable by RPC_Reply_Coalesce. */
+		bool reply_coalesce;
+		/** Seconds a TCP connection has no request in progress
+		    before its empty DRC and its Manage_Gids memo are
+		    released, 0 to keep them.  Defaults to 0 and
+		    settable by RPC_Idle_Reclaim_S. */
+		uint32_t idle_reclaim_s;
 		struct {
-			/** Partitions in GSS ctx cache table (default 13). */
+			/** Partitions in GSS ctx cache table, 0 to size
+			 * them to max_ctx (default 0). */
 			uint32_t ctx_hash_partitions;
 			/** Max GSS contexts in cache (i.e.,
 			 * max GSS clients, default 16K)
@@ -368,6 +495,29 @@ typedef struct nfs_core_param {
 	bool enable_RQUOTA;
 	/** Whether to use fast stats.  Defaults to false. */
 	bool enable_FASTSTATS;
+	/** Whether to keep latency histograms per client as well as per
+	    export.  Defaults to false and settable with
+	    Enable_Client_Latency_Histograms */
+	bool enable_client_histograms;
+	/** Whether to account the CPU time of requests and NFSv4
+	    operations to their export and client.  Defaults to false
+	    and settable with Enable_CPU_Stats */
+	bool enable_cpu_stats;
+	/** Seconds per window of the top files, clients and exports
+	    tracking, 0 to turn it off.  Defaults to 60 and settable with
+	    Heavy_Hitters_Window */
+	uint32_t heavy_hitters_window;
+	/** Ops per second allowed to each client, 0 for no limit.
+	    Defaults to 0 and settable with Client_QoS_IOPS */
+	uint64_t client_qos_iops;
+	/** Bytes read and written per second allowed to each client, 0
+	    for no limit.  Defaults to 0 and settable with
+	    Client_QoS_Bandwidth */
+	uint64_t client_qos_bandwidth;
+	/** Milliseconds of its rate a client or export may use at once
+	    before being delayed.  Defaults to 100 and settable with
+	    QoS_Burst */
+	uint32_t qos_burst;
 	/** Whether tcp sockets should use SO_KEEPALIVE */
 	bool enable_tcp_keepalive;
 	/** Maximum number of TCP probes before dropping the connection */
@@ -385,11 +535,76 @@ typedef struct nfs_core_param {
 	    calling getgroups() when "Manage_Gids = TRUE" is
 	    used in a export entry. */
 	time_t manage_gids_expiration;
+	/** Threads looking up the groups of callers not in the cache, so
+	    that requests wait for them instead of workers.  0 looks them
+	    up on the worker.  Defaults to 4 and settable with
+	    Manage_Gids_Lookup_Threads. */
+	uint32_t manage_gids_lookup_threads;
+	/** Threads looking up netgroup membership, so that requests
+	    never wait on NIS or LDAP.  0 looks it up on the worker.
+	    Defaults to 0 and settable with Netgroup_Lookup_Threads. */
+	uint32_t netgroup_lookup_threads;
+	/** Seconds netgroup membership is cached.  Defaults to 1800
+	    and settable with Netgroup_Expiration. */
+	uint32_t netgroup_expiration;
 	/** Path to the directory containing server specific
 	    modules.  In particular, this is where FSALs live. */
 	char *ganesha_modules_loc;
 	/** Frequency of dbus health heartbeat in ms. Set to 0 to disable */
 	uint32_t heartbeat_freq;
+	/** Threads running the DBus methods that walk every client or
+	    export, so the DBus thread goes on serving the others.  0
+	    runs them on the DBus thread.  Defaults to 0 and settable
+	    with Dbus_Workers. */
+	uint32_t dbus_workers;
+	/** Seconds a snapshot of the client and export stats is served
+	    to DBus queries before being rebuilt.  0 walks the live
+	    tables on every query.  Defaults to 0 and settable with
+	    Dbus_Stats_Interval. */
+	uint32_t dbus_stats_interval;
+	/** TCP port stats are served on in the OpenMetrics format, 0
+	    for none.  Defaults to 0 and settable with Metrics_Port. */
+	uint16_t metrics_port;
+	/** Address the metrics port is bound to.  Defaults to
+	    127.0.0.1 and settable with Metrics_Addr. */
+	struct sockaddr_in metrics_addr;
+	/** Events the flight recorder keeps per thread, 0 to turn it
+	    off.  Defaults to 1024 and settable with
+	    Flight_Recorder_Events. */
+	uint32_t flight_rec_events;
+	/** Where the flight recorder is written on a fatal signal, and
+	    by default when asked over DBus.  Settable with
+	    Flight_Recorder_File. */
+	char *flight_rec_file;
+	/** Whether the lock contention profiler starts on, in a build
+	    with USE_LOCK_PROF.  Defaults to false and settable with
+	    Lock_Profile. */
+	bool lock_profile;
+	/** Seconds between ratings of the memory pressure, which
+	    shrinks the caches, 0 to leave them be.  Defaults to 0 and
+	    settable with Memory_Pressure_Interval. */
+	uint32_t memory_pressure_interval;
+	/** Resident size of the server the memory pressure is rated
+	    against, besides the limits of its cgroup, 0 for none.
+	    Defaults to 0 and settable with Memory_Pressure_Limit. */
+	uint64_t memory_pressure_limit;
+	/** NLM clients the NLM client, owner and state tables are sized
+	    for.  Defaults to 256 and settable with NLM_Clients. */
+	uint32_t nlm_clients;
+	/** Threads sending NLM callbacks, each client's callbacks being
+	    sent in order by one thread at a time.  Defaults to 4 and
+	    settable with NLM_Callback_Threads. */
+	uint32_t nlm_callback_threads;
+	/** Seconds before statd is told to stop monitoring a released
+	    NLM client, so that a client coming back meanwhile costs no
+	    SM_UNMON and SM_MON.  Defaults to 60 and settable with
+	    NSM_Unmonitor_Delay. */
+	uint32_t nsm_unmonitor_delay;
+	/** Threads looking up export roots at startup, the server
+	    starting while they run.  Defaults to 1, which looks them up
+	    in turn before starting.  Settable with
+	    Export_Init_Threads. */
+	uint32_t export_init_threads;
 	/** Whether to use device major/minor for fsid. Defaults to false. */
 	bool fsid_device;
 	/** Whether to use Pseudo (true) or Path (false) for NFS v3 and 9P
@@ -430,6 +645,24 @@ typedef struct nfs_core_param {
  */
 #define DELEG_RECALL_RETRY_DELAY_DEFAULT 1
 
+/**
+ * @brief Default number of forechannel slots offered per session
+ */
+#define NFS41_MAX_SLOTS_DEFAULT 64
+
+/**
+ * @brief Default number of backchannel slots used per session
+ */
+#define NFS41_MAX_CB_SLOTS_DEFAULT 16
+
+/**
+ * @brief Where client recovery records are kept
+ */
+enum recovery_backend {
+	RECOVERY_BACKEND_FS,	/*< Directories under NFS_V4_RECOV_ROOT */
+	RECOVERY_BACKEND_RADOS_KV,	/*< Omap of a RADOS object */
+};
+
 typedef struct nfs_version4_parameter {
 	/** Whether to disable the NFSv4 grace period.  Defaults to
 	    false and settable with Graceless. */
@@ -441,6 +674,37 @@ typedef struct nfs_version4_parameter {
 	/** The NFS grace period.  Defaults to
 	    GRACE_PERIOD_DEFAULT and is settable with Grace_Period. */
 	uint32_t grace_period;
+	/** Whether to end grace once every recovered client has sent
+	    RECLAIM_COMPLETE.  Defaults to true and settable with
+	    Lift_Grace. */
+	bool lift_grace;
+	/** Whether a grace period started for a failover only holds
+	    back the clients that may reclaim on this node.  Defaults
+	    to false and settable with Scoped_Grace. */
+	bool scoped_grace;
+	/** Open and lock owners one client may hold before a warning
+	    is logged, 0 for none.  Settable with
+	    Client_Owners_Soft_Limit. */
+	uint32_t client_owners_soft;
+	/** Open and lock owners one client may hold, further owners
+	    are refused.  0 for no limit, settable with
+	    Client_Owners_Hard_Limit. */
+	uint32_t client_owners_hard;
+	/** Stateids one client may hold before a warning is logged, 0
+	    for none.  Settable with Client_States_Soft_Limit. */
+	uint32_t client_states_soft;
+	/** Stateids one client may hold, further states get
+	    NFS4ERR_DELAY.  0 for no limit, settable with
+	    Client_States_Hard_Limit. */
+	uint32_t client_states_hard;
+	/** NFSv4 clients the client id and client record tables are
+	    sized for.  Defaults to 256 and settable with
+	    Expected_Clients. */
+	uint32_t expected_clients;
+	/** EXCHANGE_IDs and SETCLIENTIDs in one second that start a
+	    reconnect storm, see nfs4_storm_count().  0, the default,
+	    never does.  Settable with Reconnect_Storm_Rate. */
+	uint32_t reconnect_storm_rate;
 	/** Domain to use if we aren't using the nfsidmap.  Defaults
 	    to DOMAINNAME_DEFAULT and is set with DomainName. */
 	char *domainname;
@@ -461,19 +725,136 @@ typedef struct nfs_version4_parameter {
 	    Only_Numeric_Owners. NB., this is permissible for a server
 	    implementation (RFC 5661). */
 	bool only_numeric_owners;
+	/** Seconds after which the ID mapper looks an owner or group name
+	    up again, in the background.  0 keeps names until the cache
+	    is purged.  Defaults to 30 minutes and settable with
+	    Idmap_Cache_Refresh. */
+	uint32_t idmap_cache_refresh;
 	/** Whether to allow delegations. Defaults to false and settable
 	    with Delegations */
 	bool allow_delegations;
+	/** Whether to offer delegations only where past ones were worth
+	    their recalls.  Defaults to false and settable with
+	    Adaptive_Delegations */
+	bool adaptive_delegations;
+	/** Whether to grant NFSv4.1 directory delegations, where READ
+	    delegations are.  Defaults to false and settable with
+	    Directory_Delegations */
+	bool dir_delegations;
 	/** Delay after which server will retry a recall in case of failures */
 	uint32_t deleg_recall_retry_delay;
 	/** Whether this a pNFS MDS server. Defaults to false */
 	bool pnfs_mds;
 	/** Whether this a pNFS DS server. Defaults to false */
 	bool pnfs_ds;
+	/** Most forechannel slots a session may negotiate.  Defaults to
+	    NFS41_MAX_SLOTS_DEFAULT and settable with Max_Slots. */
+	uint32_t max_slots;
+	/** Most backchannel slots a session may negotiate.  Defaults to
+	    NFS41_MAX_CB_SLOTS_DEFAULT and settable with Max_CB_Slots. */
+	uint32_t max_cb_slots;
+	/** Threads sending callbacks, so no worker waits on a client.
+	    Defaults to 8 and settable with Callback_Threads. */
+	uint32_t callback_threads;
+	/** Threads that run asynchronous COPY operations.  Defaults to 4
+	    and settable with Copy_Threads. */
+	uint32_t copy_threads;
+	/** Bytes above which a COPY not asking to be synchronous is run
+	    in the background.  Defaults to 4 MiB and settable with
+	    Copy_Async_Threshold. */
+	uint64_t copy_async_threshold;
+	/** Total forechannel slots across all sessions beyond which
+	    SEQUENCE asks clients to use fewer.  0 means no limit.
+	    Defaults to 0 and settable with Slot_Table_Budget. */
+	uint32_t slot_table_budget;
+	/** Whether session slots cache encoded replies instead of the
+	    result tree.  Defaults to false and settable with
+	    Slot_Reply_Encoded. */
+	bool slot_reply_encoded;
+	/** MiB of encoded replies all slots may hold together.  Defaults
+	    to 64 and settable with Slot_Reply_Cache_Size. */
+	uint32_t slot_reply_cache_size;
+	/** Whether READDIR keeps each cached entry's encoded attributes
+	    for reuse.  Defaults to false and settable with
+	    Readdir_Encode_Cache. */
+	bool readdir_encode_cache;
+	/** Milliseconds a closed read-only open stays open in the FSAL
+	    for the same owner to open the file again.  0, the default,
+	    closes at once.  Settable with Open_Reuse_Delay. */
+	uint32_t open_reuse_delay;
+	/** Threads doing the FSAL close of CLOSE in the background, so
+	    the reply does not wait for it.  0, the default, closes
+	    before replying.  Settable with Async_Close_Threads. */
+	uint32_t async_close_threads;
+	/** Whether exports are mounted in the PseudoFS when a client
+	    first looks for them rather than at startup.  Defaults to
+	    false and settable with Pseudo_Lazy_Mount. */
+	bool pseudo_lazy_mount;
+	/** Client recovery record store.  Defaults to
+	    RECOVERY_BACKEND_FS and settable with RecoveryBackend. */
+	uint32_t recovery_backend;
+	/** Node client recovery records are replicated to, with
+	    standby_port.  Defaults to NULL, which replicates to none,
+	    and settable with Standby_Host. */
+	char *standby_host;
+	/** Port of the standby at standby_host.  Defaults to 0 and
+	    settable with Standby_Port. */
+	uint16_t standby_port;
+	/** Port this node listens on, as a standby, for the records
+	    of the active node.  0, the default, does not listen.
+	    Settable with Standby_Listen_Port. */
+	uint16_t standby_listen_port;
 } nfs_version4_parameter_t;
 
 /** @} */
 
+#ifdef _USE_NFS_RDMA
+/**
+ * @defgroup config_rdma Structure and defaults for NFS_RDMA
+ *
+ * @{
+ */
+
+typedef struct nfs_rdma_parameter {
+	/** Address the listener binds.  Defaults to "::" and settable
+	    with Bind_Addr. */
+	char *bind_addr;
+	/** Port the listener binds.  Defaults to 20049 and settable
+	    with Port. */
+	uint16_t port;
+	/** Accepts pending on the listener.  Defaults to 10 and
+	    settable with Backlog. */
+	uint32_t backlog;
+	/** Send queue depth of a connection.  Defaults to 32 and
+	    settable with SQ_Depth. */
+	uint32_t sq_depth;
+	/** Scatter/gather entries of a send.  Defaults to 32 and
+	    settable with Max_Send_SGE. */
+	uint32_t max_send_sge;
+	/** Receive queue depth of a connection, or of the shared
+	    receive queue.  Defaults to 32 and settable with
+	    RQ_Depth. */
+	uint32_t rq_depth;
+	/** Scatter/gather entries of a receive.  Defaults to 31 and
+	    settable with Max_Recv_SGE. */
+	uint32_t max_recv_sge;
+	/** Requests a client may have outstanding on a connection.
+	    Defaults to 30 and settable with Credits. */
+	uint32_t credits;
+	/** Whether connections post receives to one shared receive
+	    queue.  Defaults to false and settable with Use_SRQ. */
+	bool use_srq;
+	/** Inline send buffer of a connection.  Defaults to 4096 and
+	    settable with Send_Buffer_Size. */
+	uint32_t send_buffer_size;
+	/** Inline receive buffer of a connection.  Defaults to 4096
+	    and settable with Recv_Buffer_Size. */
+	uint32_t recv_buffer_size;
+} nfs_rdma_parameter_t;
+
+/** @} */
+#endif				/* _USE_NFS_RDMA */
+
 typedef struct nfs_param {
 	/** NFS Core parameters, settable in the NFS_Core_Param
 	    stanza. */
@@ -484,6 +865,10 @@ typedef struct nfs_param {
 	/** kerberos configuration.  Settable in the NFS_KRB5 stanza. */
 	nfs_krb5_parameter_t krb5_param;
 #endif				/* _HAVE_GSSAPI */
+#ifdef _USE_NFS_RDMA
+	/** NFS/RDMA engine.  Settable in the NFS_RDMA stanza. */
+	nfs_rdma_parameter_t rdma_param;
+#endif				/* _USE_NFS_RDMA */
 } nfs_parameter_t;
 
 extern nfs_parameter_t nfs_param;
@@ -123,6 +123,13 @@
 	.direction = "in"	\
 }
 
+#define BLOCK_ARG		\
+{				\
+	.name = "block",	\
+	.type = "s",		\
+	.direction = "in"	\
+}
+
 /* Properties list helper macros
  */
 
@@ -155,6 +162,7 @@ struct gsh_dbus_method {
 	 bool (*method)(DBusMessageIter *args,
 			DBusMessage *reply,
 			DBusError *error);
+	bool heavy;	/*< run on the DBus workers, if there are any */
 	struct gsh_dbus_arg args[];
 };
 
@@ -212,6 +220,7 @@ void dbus_append_timestamp(DBusMessageIter *iterp, struct timespec *ts);
 void dbus_status_reply(DBusMessageIter *iter, bool success, char *errormsg);
 int32_t gsh_dbus_register_path(const char *name,
 			       struct gsh_dbus_interface **interfaces);
+void gsh_dbus_unregister_path(const char *name);
 int gsh_dbus_broadcast(char *obj_name, char *int_name,
 		       char *sig_name, int type, ...);
 /* more to come */
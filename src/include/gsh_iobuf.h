@@ -0,0 +1,112 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_iobuf.h
+ * @brief Size-classed buffer pool for READ/WRITE payloads
+ *
+ * Buffers are page aligned and come in power-of-two size classes
+ * from IOBUF_MIN_SIZE to IOBUF_MAX_SIZE.  Each thread keeps a
+ * small cache per class in front of a shared, bounded depot, so
+ * the common case of a worker allocating a READ buffer and freeing
+ * it in the reply's free function takes no lock at all.
+ *
+ * Buffers are reference counted.  Buffers obtained with
+ * gsh_iobuf_get (or referenced with gsh_iobuf_ref) must be released
+ * with gsh_iobuf_put, never with gsh_free.
+ *
+ * A transport that moves payloads by DMA, NFS/RDMA in particular, may
+ * register buffers with its device through gsh_iobuf_reg.  The
+ * registration stays with the buffer while the pool recycles it and is
+ * dropped only when the buffer goes back to the allocator, so the cost
+ * of registering is paid once per buffer rather than once per I/O.
+ */
+
+#ifndef GSH_IOBUF_H
+#define GSH_IOBUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+#define IOBUF_MIN_SHIFT 12	/*< 4 KiB */
+#define IOBUF_MAX_SHIFT 24	/*< 16 MiB */
+#define IOBUF_NCLASS (IOBUF_MAX_SHIFT - IOBUF_MIN_SHIFT + 1)
+#define IOBUF_MIN_SIZE (1UL << IOBUF_MIN_SHIFT)
+#define IOBUF_MAX_SIZE (1UL << IOBUF_MAX_SHIFT)
+
+/**
+ * @brief Pool statistics for one size class
+ */
+struct gsh_iobuf_stats {
+	uint64_t tc_hits;	/*< served from the thread cache */
+	uint64_t depot_hits;	/*< served from the shared depot */
+	uint64_t misses;	/*< had to allocate */
+	uint64_t releases;	/*< freed back to the allocator */
+	uint64_t depot_count;	/*< buffers currently in the depot */
+};
+
+/**
+ * @brief A payload held in segments
+ *
+ * Payloads larger than the segment size (IO_Segment_Size) are held in
+ * several pooled buffers rather than one contiguous one, so a 16 MiB
+ * READ or WRITE needs no 16 MiB allocation.  FSALs are handed the
+ * segments through readv2 and writev2, XDR encodes and decodes them one
+ * at a time.
+ */
+struct gsh_iobuf_vec {
+	uint32_t cnt;		/*< Number of segments */
+	struct iovec iov[];	/*< Segments, each a gsh_iobuf */
+};
+
+/**
+ * @brief Memory registration callbacks of a DMA capable transport
+ */
+struct gsh_iobuf_reg_ops {
+	/** Register size bytes at buf, return a handle or NULL */
+	void *(*reg)(void *buf, size_t size);
+	/** Drop a registration returned by reg */
+	void (*dereg)(void *handle);
+};
+
+void gsh_iobuf_pkginit(uint64_t depot_max_bytes, size_t seg_size);
+void gsh_iobuf_pkgshutdown(void);
+
+void *gsh_iobuf_get(size_t size);
+void gsh_iobuf_ref(void *buf);
+void gsh_iobuf_put(void *buf);
+size_t gsh_iobuf_size(void *buf);
+
+bool gsh_iobuf_segmented(size_t size);
+void *gsh_iobuf_get_payload(size_t size);
+bool gsh_iobuf_is_vec(void *buf);
+int gsh_iobuf_iovcnt(void *buf);
+int gsh_iobuf_fill_iov(void *buf, struct iovec *iov, size_t len);
+void *gsh_iobuf_flatten(void *buf, size_t len);
+
+void gsh_iobuf_set_reg_ops(const struct gsh_iobuf_reg_ops *ops);
+void *gsh_iobuf_reg(void *buf);
+
+void gsh_iobuf_get_stats(struct gsh_iobuf_stats *stats, int nclass);
+
+#endif				/* GSH_IOBUF_H */
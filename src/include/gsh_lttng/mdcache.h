@@ -187,6 +187,53 @@ TRACEPOINT_LOGLEVEL(
 	mdc_lru_remove,
 	TRACE_INFO)
 
+/**
+ * @brief Trace a call into the sub-FSAL
+ *
+ * @param[in] op	Kind of call, enum fsal_call
+ * @param[in] entry	Address of the entry called on
+ */
+TRACEPOINT_EVENT(
+	mdcache,
+	fsal_call_enter,
+	TP_ARGS(int, op,
+		void *, entry),
+	TP_FIELDS(
+		ctf_integer(int, op, op)
+		ctf_integer_hex(void *, entry, entry)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	mdcache,
+	fsal_call_enter,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the return of a call into the sub-FSAL
+ *
+ * @param[in] op	Kind of call, enum fsal_call
+ * @param[in] entry	Address of the entry called on
+ * @param[in] major	fsal_errors_t returned
+ */
+TRACEPOINT_EVENT(
+	mdcache,
+	fsal_call_exit,
+	TP_ARGS(int, op,
+		void *, entry,
+		int, major),
+	TP_FIELDS(
+		ctf_integer(int, op, op)
+		ctf_integer_hex(void *, entry, entry)
+		ctf_integer(int, major, major)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	mdcache,
+	fsal_call_exit,
+	TRACE_INFO)
+
 #endif /* GANESHA_LTTNG_MDCACHE_TP_H */
 
 #undef TRACEPOINT_INCLUDE
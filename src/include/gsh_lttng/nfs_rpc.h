@@ -95,6 +95,32 @@ TRACEPOINT_LOGLEVEL(
 	op_end,
 	TRACE_INFO)
 
+/**
+ * @brief Trace the end of one phase of a request
+ *
+ * @param req      - the address of the request
+ * @param phase    - the enum nfs_req_phase that ended
+ * @param duration - nsecs spent in the phase
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	phase,
+	TP_ARGS(request_data_t *, req,
+		int, phase,
+		uint64_t, duration),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer(int, phase, phase)
+		ctf_integer(uint64_t, duration, duration)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	phase,
+	TRACE_INFO)
+
 /**
  * @brief Trace the start of the NFSv4 op function
  *
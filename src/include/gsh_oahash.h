@@ -0,0 +1,119 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_oahash.h
+ * @brief Open-addressing hash index of pointers keyed by 64-bit hash
+ *
+ * Slots are grouped seven to a cache line, with one tag byte per slot
+ * taken from the top bits of the hash.  A lookup usually reads the
+ * tags of one group and dereferences only the items whose tag
+ * matches, instead of chasing tree pointers through cold lines.
+ *
+ * Each group counts the inserts that had to probe past it because it
+ * was full.  A lookup stops at the first group with a zero count, so
+ * removal needs no tombstones.  The table grows when 7/8 full.
+ *
+ * The table does no locking of its own.
+ */
+
+#ifndef GSH_OAHASH_H
+#define GSH_OAHASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define OAHASH_GROUP_SLOTS 7
+#define OAHASH_OVERFLOW_MAX UINT8_MAX
+
+struct oahash_group {
+	uint8_t tag[OAHASH_GROUP_SLOTS];	/*< 0 for an empty slot */
+	uint8_t overflow;	/*< inserts that probed past this group */
+	void *item[OAHASH_GROUP_SLOTS];
+} __attribute__ ((aligned(64)));
+
+/** Recompute an item's hash when growing */
+typedef uint64_t (*oahash_hash_fn)(const void *item);
+
+/** Return true if item matches the lookup key */
+typedef bool (*oahash_match_fn)(const void *item, const void *key);
+
+struct oahash {
+	struct oahash_group *groups;
+	uint64_t mask;		/*< number of groups - 1 */
+	uint64_t count;		/*< items in the table */
+	oahash_hash_fn hash_fn;
+};
+
+void oahash_init(struct oahash *t, uint64_t capacity, oahash_hash_fn hash_fn);
+void oahash_destroy(struct oahash *t);
+void oahash_insert(struct oahash *t, uint64_t hash, void *item);
+bool oahash_remove(struct oahash *t, uint64_t hash, void *item);
+
+static inline uint8_t oahash_tag(uint64_t hash)
+{
+	/* High bit set so a tag is never 0 (empty) */
+	return (uint8_t) (hash >> 57) | 0x80;
+}
+
+static inline uint64_t oahash_count(const struct oahash *t)
+{
+	return t->count;
+}
+
+/**
+ * @brief Find an item
+ *
+ * Groups are probed triangularly from the one selected by the low bits
+ * of the hash, which visits every group of a power-of-two table.
+ *
+ * @param[in] t     The table
+ * @param[in] hash  Hash of the key
+ * @param[in] match Key comparison
+ * @param[in] key   Key passed to match
+ *
+ * @return The item or NULL.
+ */
+static inline void *oahash_lookup(const struct oahash *t, uint64_t hash,
+				  oahash_match_fn match, const void *key)
+{
+	uint8_t tag = oahash_tag(hash);
+	uint64_t g = hash & t->mask;
+	uint64_t probe = 0;
+	int i;
+
+	for (;;) {
+		const struct oahash_group *grp = &t->groups[g];
+
+		for (i = 0; i < OAHASH_GROUP_SLOTS; ++i) {
+			if (grp->tag[i] == tag && match(grp->item[i], key))
+				return grp->item[i];
+		}
+
+		if (grp->overflow == 0 || probe == t->mask)
+			return NULL;
+
+		g = (g + ++probe) & t->mask;
+	}
+}
+
+#endif				/* GSH_OAHASH_H */
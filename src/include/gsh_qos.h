@@ -0,0 +1,83 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_qos.h
+ * @brief Token bucket rate limits for exports and clients
+ *
+ * A bucket is kept in the form of the generic cell rate algorithm: the
+ * only state is the theoretical arrival time (TAT), when the bucket
+ * would be full again had every request so far arrived at once.  A
+ * request costing c at rate r pushes it out by c/r and may run once
+ * the TAT, less the burst allowance, is in the past.  Requests are
+ * delayed until then rather than refused.  Because the state is one
+ * word, a bucket is updated with compare and swap and needs no lock.
+ */
+
+#ifndef GSH_QOS_H
+#define GSH_QOS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gsh_types.h"
+#include "abstract_atomic.h"
+
+/** Buckets of one export or client, in nsecs since server boot */
+struct gsh_qos {
+	uint64_t ops_tat;	/*< TAT of the IOPS bucket */
+	uint64_t bytes_tat;	/*< TAT of the bandwidth bucket */
+};
+
+/** Set once any export has been configured with a limit */
+extern bool gsh_qos_exports;
+
+/**
+ * @brief Charge a request to a bucket
+ *
+ * @param[in,out] tat   The bucket's theoretical arrival time
+ * @param[in]     rate  Units per second, 0 for no limit
+ * @param[in]     cost  Units the request consumes
+ * @param[in]     now   Current time
+ * @param[in]     burst How far ahead of its rate the bucket may run
+ *
+ * @return When the request may run, now if it is within budget.
+ */
+static inline uint64_t gsh_qos_charge(uint64_t *tat, uint64_t rate,
+				      uint64_t cost, uint64_t now,
+				      uint64_t burst)
+{
+	uint64_t interval, old, next, release;
+
+	if (rate == 0 || cost == 0)
+		return now;
+
+	interval = cost * NS_PER_SEC / rate;
+
+	do {
+		old = atomic_fetch_uint64_t(tat);
+		release = old > now + burst ? old - burst : now;
+		next = (old > now ? old : now) + interval;
+	} while (!atomic_cas_uint64_t(tat, old, next));
+
+	return release;
+}
+
+#endif				/* GSH_QOS_H */
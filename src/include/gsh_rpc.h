@@ -31,6 +31,7 @@
 #include "gsh_list.h"
 #include "log.h"
 #include "fridgethr.h"
+#include "gsh_iobuf.h"
 
 #define NFS_LOOKAHEAD_NONE 0x0000
 #define NFS_LOOKAHEAD_MOUNT 0x0001
@@ -56,6 +57,7 @@ struct nfs_request_lookahead {
 	uint32_t flags;
 	uint16_t read;
 	uint16_t write;
+	uint32_t payload;	/*< WRITE bytes decoded so far */
 };
 
 #define NFS_LOOKAHEAD_HIGH_LATENCY(lkhd)		\
@@ -71,6 +73,109 @@ struct nfs_request_lookahead {
 #define XDR_BYTES_MAXLEN_IO (64*1024*1024)
 #define XDR_STRING_MAXLEN (8*1024)
 
+/* Most operations in a COMPOUND, a longer one is refused with
+ * NFS4ERR_RESOURCE without decoding its operations.
+ */
+#define NFS4_MAX_COMPOUND_OPS 100
+
+/**
+ * @brief XDR the data of a segmented payload
+ *
+ * Segments are whole pages, so only the last one is padded.
+ *
+ * @param[in] xdrs	XDR stream, encoding or decoding
+ * @param[in] vec	The segments
+ * @param[in] len	Bytes of payload
+ */
+static inline bool xdr_iobuf_vec(XDR *xdrs, struct gsh_iobuf_vec *vec,
+				 u_int len)
+{
+	uint32_t i;
+
+	for (i = 0; i < vec->cnt && len > 0; i++) {
+		char *base = vec->iov[i].iov_base;
+		u_int n = vec->iov[i].iov_len < len
+				? vec->iov[i].iov_len : len;
+
+		if (n == len)
+			return inline_xdr_opaque(xdrs, base, n);
+
+		if (xdrs->x_op == XDR_ENCODE) {
+			if (!XDR_PUTBYTES(xdrs, base, n))
+				return false;
+		} else if (!XDR_GETBYTES(xdrs, base, n)) {
+			return false;
+		}
+
+		len -= n;
+	}
+
+	return len == 0;
+}
+
+/**
+ * @brief XDR an I/O payload held in a pooled buffer
+ *
+ * Like xdr_bytes, but a decoded payload lands in a gsh_iobuf, page
+ * aligned and reused from the pool, which a transport can keep
+ * registered for DMA and an FSAL can hand to its backend as is.  A
+ * payload larger than IO_Segment_Size is decoded into segments, see
+ * gsh_iobuf_get_payload.  The buffer is released with gsh_iobuf_put on
+ * XDR_FREE.
+ */
+static inline bool xdr_iobuf_bytes(XDR *xdrs, char **cpp, u_int *sizep,
+				   u_int maxsize)
+{
+	bool ok;
+
+	switch (xdrs->x_op) {
+	case XDR_DECODE:
+		if (!inline_xdr_u_int(xdrs, sizep) || *sizep > maxsize)
+			return false;
+		if (*sizep == 0)
+			return true;
+		if (*cpp == NULL)
+			*cpp = gsh_iobuf_get_payload(*sizep);
+		if (gsh_iobuf_is_vec(*cpp))
+			ok = xdr_iobuf_vec(xdrs, (struct gsh_iobuf_vec *) *cpp,
+					   *sizep);
+		else
+			ok = inline_xdr_opaque(xdrs, *cpp, *sizep);
+		if (!ok) {
+			gsh_iobuf_put(*cpp);
+			*cpp = NULL;
+			return false;
+		}
+		return true;
+	case XDR_FREE:
+		gsh_iobuf_put(*cpp);
+		*cpp = NULL;
+		return true;
+	default:
+		return inline_xdr_bytes(xdrs, cpp, sizep, maxsize);
+	}
+}
+
+/**
+ * @brief XDR a READ payload held in a pooled buffer
+ *
+ * Like xdr_bytes, but a segmented payload is encoded one segment at a
+ * time.  Only for replies the server builds, whose data is always a
+ * gsh_iobuf; decoding and freeing are those of xdr_bytes.
+ */
+static inline bool xdr_iobuf_payload(XDR *xdrs, char **cpp, u_int *sizep,
+				     u_int maxsize)
+{
+	if (xdrs->x_op != XDR_ENCODE || *cpp == NULL ||
+	    !gsh_iobuf_is_vec(*cpp))
+		return inline_xdr_bytes(xdrs, cpp, sizep, maxsize);
+
+	if (*sizep > maxsize || !inline_xdr_u_int(xdrs, sizep))
+		return false;
+
+	return xdr_iobuf_vec(xdrs, (struct gsh_iobuf_vec *) *cpp, *sizep);
+}
+
 typedef struct sockaddr_storage sockaddr_t;
 
 #define SOCK_NAME_MAX 128
@@ -145,6 +250,7 @@ const char *str_gc_proc(rpc_gss_proc_t);
 /* uint16_t actually used */
 #define XPRT_PRIVATE_FLAG_DECODING 0x0008
 #define XPRT_PRIVATE_FLAG_STALLED 0x0010	/* ie, -on stallq- */
+#define XPRT_PRIVATE_FLAG_CORKED 0x0020	/* TCP_CORK set for replies */
 
 /* uint32_t instructions */
 #define XPRT_PRIVATE_FLAG_LOCKED	SVC_XPRT_FLAG_LOCKED
@@ -152,10 +258,26 @@ const char *str_gc_proc(rpc_gss_proc_t);
 #define XPRT_PRIVATE_FLAG_INCREQ	0x00040000
 #define XPRT_PRIVATE_FLAG_DECREQ	0x00080000
 
+struct nfs_rdma_conn;
+struct uid2grp_memo;
+struct gsh_client;
+
+void uid2grp_memo_free(struct uid2grp_memo *memo);
+void put_gsh_client(struct gsh_client *client);
+
 typedef struct gsh_xprt_private {
 	SVCXPRT *xprt;
 	struct glist_head stallq;
 	uint16_t flags;
+	int32_t req_q_shard;	/*< request queue shard, -1 if none */
+	int32_t evchan;		/*< TCP event channel, -1 if none */
+	uint32_t udp_drc;	/*< shared DRC of a UDP socket */
+	struct nfs_rdma_conn *rdma;	/*< NFS/RDMA connection stats */
+	struct uid2grp_memo *gids;	/*< Recent Manage_Gids lookups */
+	struct gsh_client *client;	/*< Caller of a TCP connection */
+	uint64_t budget;	/*< Bytes of requests in the dispatcher */
+	struct glist_head conns;	/*< TCP connections, for idle reclaim */
+	time_t idle_since;	/*< When its last request completed */
 } gsh_xprt_private_t;
 
 static inline gsh_xprt_private_t *alloc_gsh_xprt_private(SVCXPRT *xprt,
@@ -166,6 +288,15 @@ static inline gsh_xprt_private_t *alloc_gsh_xprt_private(SVCXPRT *xprt,
 
 	xu->xprt = xprt;
 	xu->flags = flags;
+	xu->req_q_shard = -1;
+	xu->evchan = -1;
+	xu->udp_drc = 0;
+	xu->rdma = NULL;
+	xu->gids = NULL;
+	xu->client = NULL;
+	xu->budget = 0;
+	glist_init(&xu->conns);
+	xu->idle_since = 0;
 
 	return xu;
 }
@@ -179,6 +310,10 @@ static inline void free_gsh_xprt_private(SVCXPRT *xprt)
 	gsh_xprt_private_t *xu = (gsh_xprt_private_t *)xprt->xp_u1;
 
 	if (xu) {
+		if (xu->gids != NULL)
+			uid2grp_memo_free(xu->gids);
+		if (xu->client != NULL)
+			put_gsh_client(xu->client);
 		gsh_free(xu);
 		xprt->xp_u1 = NULL;
 	}
@@ -233,19 +368,21 @@ static inline bool gsh_xprt_decoder_guard(SVCXPRT *xprt, uint32_t flags)
 	gsh_xprt_private_t *xu = (gsh_xprt_private_t *)xprt->xp_u1;
 	bool rslt = false;
 
-	if (xu->flags & XPRT_PRIVATE_FLAG_DECODING) {
+	if (xu->flags & XPRT_PRIVATE_FLAG_STALLED) {
 		LogDebug(COMPONENT_DISPATCH, "guard failed: flag %s",
-			 "XPRT_PRIVATE_FLAG_DECODING");
+			 "XPRT_PRIVATE_FLAG_STALLED");
 		goto unlock;
 	}
 
-	if (xu->flags & XPRT_PRIVATE_FLAG_STALLED) {
+	/* the idle reclaim takes the guard too, from another thread */
+	if (atomic_postset_uint16_t_bits(&xu->flags,
+					 XPRT_PRIVATE_FLAG_DECODING)
+	    & XPRT_PRIVATE_FLAG_DECODING) {
 		LogDebug(COMPONENT_DISPATCH, "guard failed: flag %s",
-			 "XPRT_PRIVATE_FLAG_STALLED");
+			 "XPRT_PRIVATE_FLAG_DECODING");
 		goto unlock;
 	}
 
-	atomic_set_uint16_t_bits(&xu->flags, XPRT_PRIVATE_FLAG_DECODING);
 	rslt = true;
 
  unlock:
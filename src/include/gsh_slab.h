@@ -0,0 +1,82 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_slab.h
+ * @brief Fixed size object caches with per-thread magazines
+ *
+ * A slab cache hands out zeroed objects of one size, carved from
+ * large chunks.  Each thread keeps two magazines of free objects per
+ * cache in front of a shared depot of full and empty magazines, so
+ * the common alloc/free pair of a worker takes no lock and never
+ * reaches malloc.  Chunks are never given back; a cache keeps the
+ * high water mark of its objects for the life of the process.
+ *
+ * A cache is a static struct gsh_slab set up with GSH_SLAB_INITIALIZER
+ * (or one behind every pool_t) and registers itself on first use, so it
+ * may be used from constructors of loaded modules.  Caches with the
+ * same name and size share their depot.  Objects must be returned to
+ * the cache they came from, with gsh_slab_free, never with gsh_free.
+ */
+
+#ifndef GSH_SLAB_H
+#define GSH_SLAB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "mem_arena.h"
+
+/* Caches that can be registered, later ones fall back to malloc */
+#define GSH_SLAB_MAX 128
+
+struct gsh_slab {
+	const char *name;
+	size_t size;		/*< Object size */
+	int32_t index;		/*< 0 until registered, then slot + 1 */
+	enum mem_arena arena;	/*< where chunks are allocated */
+};
+
+#define GSH_SLAB_INITIALIZER(_name, _size) \
+	{ .name = (_name), .size = (_size), .index = 0 }
+
+#define GSH_SLAB_ARENA_INITIALIZER(_name, _size, _arena) \
+	{ .name = (_name), .size = (_size), .index = 0, .arena = (_arena) }
+
+/**
+ * @brief Counters of one cache
+ */
+struct gsh_slab_stats {
+	const char *name;	/*< valid for the life of the process */
+	uint64_t size;		/*< object size */
+	uint64_t live;		/*< objects handed out and not freed */
+	uint64_t depot_count;	/*< free objects in the shared depot */
+	uint64_t bytes;		/*< bytes of chunks carved so far */
+	enum mem_arena arena;	/*< arena the chunks come from */
+};
+
+void *gsh_slab_alloc(struct gsh_slab *slab);
+void gsh_slab_free(struct gsh_slab *slab, void *obj);
+
+int gsh_slab_get_stats(struct gsh_slab_stats *stats, int max);
+
+void gsh_slab_numa_init(uint32_t nnodes, uint32_t (*cpu_node)(int cpu));
+
+#endif				/* GSH_SLAB_H */
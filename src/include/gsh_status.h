@@ -86,6 +86,7 @@ typedef enum state_status {
 	STATE_IN_GRACE,
 	STATE_BADHANDLE,
 	STATE_BAD_RANGE,
+	STATE_RESOURCE_LIMIT,
 } state_status_t;
 
 #define STATE_FSAL_ESTALE STATE_ESTALE
@@ -77,6 +77,10 @@ typedef int (*val_display_function_t)(struct gsh_buffdesc *, char *);
 #define HT_FLAG_NONE 0x0000	/*< Null hash table flags */
 #define HT_FLAG_CACHE 0x0001	/*< Indicates that caching should be
 				   enabled */
+#define HT_FLAG_OPEN 0x0002	/*< Partitions are open addressed arrays
+				   instead of trees, see hashtable.c.
+				   Such tables must only be walked with
+				   hashtable_for_each. */
 
 /**
  * @brief Hash parameters
@@ -144,11 +148,18 @@ typedef struct hash_stat {
  * a hash table.
  */
 
+struct hash_slot {
+	uint64_t hash; /*< The red-black hash of the entry */
+	struct hash_data *data; /*< The entry, NULL if the slot is free */
+};
+
 struct hash_partition {
 	size_t count; /*< Numer of entries in this partition */
 	struct rbt_head rbt; /*< The red-black tree */
 	pthread_rwlock_t lock; /*< Lock for this partition */
 	struct rbt_node **cache; /*< Expected entry cache */
+	struct hash_slot *slots; /*< Slots with HT_FLAG_OPEN */
+	uint32_t nslots; /*< Number of slots, a power of 2 */
 };
 
 /**
@@ -176,8 +187,10 @@ typedef struct hash_table {
 
 struct hash_latch {
 	struct rbt_node *locator; /*< Saved location in the tree */
+	struct hash_data *data; /*< Entry found with HT_FLAG_OPEN */
 	uint64_t rbt_hash; /*< Saved red-black hash */
 	uint32_t index;	/*< Saved partition index */
+	uint32_t slot; /*< Saved slot with HT_FLAG_OPEN */
 };
 
 typedef enum hash_set_how {
@@ -206,6 +219,7 @@ const char *hash_table_err_to_str(hash_error_t err);
 /* These are the primitives of the hash table */
 
 struct hash_table *hashtable_init(struct hash_param *);
+uint32_t hashtable_prime(uint32_t);
 hash_error_t hashtable_destroy(struct hash_table *,
 			       int (*)(struct gsh_buffdesc,
 				       struct gsh_buffdesc));
@@ -228,6 +242,10 @@ hash_error_t hashtable_delall(struct hash_table *,
 				      struct gsh_buffdesc));
 
 void hashtable_log(log_components_t, struct hash_table *);
+void hashtable_for_each(struct hash_table *,
+			void (*)(struct gsh_buffdesc *, struct gsh_buffdesc *,
+				 void *),
+			void *);
 
 /* These are very simple wrappers around the primitives */
 
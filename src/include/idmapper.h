@@ -47,6 +47,9 @@
 /* Arbitrary string buffer lengths */
 #define PWENT_BEST_GUESS_LEN 1024
 
+/* Longest name kept in the lock-free tables */
+#define IDMAPPER_NAME_MAX 128
+
 /**
  * @brief Shared between idmapper.c and idmapper_cache.c.  If you
  * aren't in idmapper.c, leave these symbols alone.
@@ -67,6 +70,9 @@ bool idmapper_lookup_by_uid(const uid_t, const struct gsh_buffdesc **,
 			    const gid_t **);
 bool idmapper_lookup_by_gname(const struct gsh_buffdesc *, uid_t *);
 bool idmapper_lookup_by_gid(const gid_t, const struct gsh_buffdesc **);
+bool idmapper_fast_name(uint32_t, bool, char *, uint32_t *);
+bool idmapper_fast_id(const struct gsh_buffdesc *, bool, uint32_t *);
+uint32_t idmapper_cache_stale(bool, time_t, uint32_t **);
 /** @} */
 
 bool idmapper_init(void);
@@ -84,6 +90,10 @@ bool principal2uid(char *, uid_t *, gid_t *, struct svc_rpc_gss_data *);
 #else
 bool principal2uid(char *, uid_t *, gid_t *);
 #endif
+bool idmapper_lookup_by_gss(const void *, const struct gsh_buffdesc *,
+			    uid_t *, gid_t *);
+void idmapper_add_gss(const void *, const struct gsh_buffdesc *, uid_t,
+		      gid_t);
 #endif
 
 #endif				/* IDMAPPER_H */
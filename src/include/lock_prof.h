@@ -0,0 +1,136 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file lock_prof.h
+ * @brief Lock contention profiler
+ *
+ * In a build with USE_LOCK_PROF, the PTHREAD_MUTEX_lock,
+ * PTHREAD_RWLOCK_rdlock and PTHREAD_RWLOCK_wrlock macros of
+ * common_utils.h give each call site a struct lock_prof_site, and, while
+ * the profiler is on, go through the functions below.  They try the lock
+ * first and only time the wait if that fails, then time how long the
+ * lock is held.  Totals are kept per site in tables of each thread and
+ * merged by lock_prof_report().
+ *
+ * Without USE_LOCK_PROF none of this is compiled in.
+ */
+
+#ifndef LOCK_PROF_H
+#define LOCK_PROF_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief A place locks are taken, one per macro expansion
+ */
+struct lock_prof_site {
+	const char *lock;	/*< the lock expression */
+	const char *file;
+	int line;
+	const char *kind;	/*< "mutex", "rdlock" or "wrlock" */
+};
+
+/**
+ * @brief Totals of a site, as reported
+ */
+struct lock_prof_stats {
+	const struct lock_prof_site *site;
+	uint64_t acquired;	/*< times the lock was taken here */
+	uint64_t contended;	/*< of which it was not free at once */
+	uint64_t wait_ns;	/*< time spent waiting for it */
+	uint64_t max_wait_ns;
+	uint64_t hold_ns;	/*< time it was held after being taken here */
+	uint64_t max_hold_ns;
+};
+
+extern bool lock_prof_enabled;
+
+void lock_prof_init(bool enable);
+void lock_prof_enable(bool enable);
+uint64_t lock_prof_now(void);
+void lock_prof_acquired(const struct lock_prof_site *site, const void *lock,
+			uint64_t start);
+void lock_prof_released(const void *lock);
+int lock_prof_report(struct lock_prof_stats *stats, int max);
+
+/* Time waits only if the lock was busy: start is 0 when it was not */
+#define LOCK_PROF_TAKE(_try, _take, _lock, _site)			\
+	do {								\
+		uint64_t _start = 0;					\
+									\
+		rc = _try(_lock);					\
+		if (rc == EBUSY) {					\
+			_start = lock_prof_now();			\
+			rc = _take(_lock);				\
+		}							\
+		if (rc == 0)						\
+			lock_prof_acquired(_site, _lock, _start);	\
+	} while (0)
+
+static inline int lock_prof_mutex_lock(pthread_mutex_t *mtx,
+				       const struct lock_prof_site *site)
+{
+	int rc;
+
+	if (!lock_prof_enabled)
+		return pthread_mutex_lock(mtx);
+
+	LOCK_PROF_TAKE(pthread_mutex_trylock, pthread_mutex_lock, mtx, site);
+	return rc;
+}
+
+static inline int lock_prof_rdlock(pthread_rwlock_t *lock,
+				   const struct lock_prof_site *site)
+{
+	int rc;
+
+	if (!lock_prof_enabled)
+		return pthread_rwlock_rdlock(lock);
+
+	LOCK_PROF_TAKE(pthread_rwlock_tryrdlock, pthread_rwlock_rdlock,
+		       lock, site);
+	return rc;
+}
+
+static inline int lock_prof_wrlock(pthread_rwlock_t *lock,
+				   const struct lock_prof_site *site)
+{
+	int rc;
+
+	if (!lock_prof_enabled)
+		return pthread_rwlock_wrlock(lock);
+
+	LOCK_PROF_TAKE(pthread_rwlock_trywrlock, pthread_rwlock_wrlock,
+		       lock, site);
+	return rc;
+}
+
+static inline void lock_prof_release(const void *lock)
+{
+	if (lock_prof_enabled)
+		lock_prof_released(lock);
+}
+
+#endif				/* LOCK_PROF_H */
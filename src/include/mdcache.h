@@ -48,9 +48,18 @@ mdcache_fsal_create_export(struct fsal_module *fsal_hdl, void *parse_node,
 /* Clean up on init failure */
 void mdcache_export_uninit(void);
 
+/* Drop what is cached of an export's objects */
+void mdcache_invalidate_export(struct fsal_export *exp_hdl);
+
 /* Initialize the MDCACHE package. */
 fsal_status_t mdcache_pkginit(void);
 
+/* Warm up the cache from its last snapshot, once exports are set up */
+void mdcache_snapshot_pkginit(void);
+
+/* Save the cache to its snapshot at shutdown */
+void mdcache_snapshot_pkgshutdown(void);
+
 /* Parse mdcache config */
 int mdcache_set_param_from_conf(config_file_t parse_tree,
 				struct config_error_type *err_type);
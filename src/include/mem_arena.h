@@ -0,0 +1,97 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file mem_arena.h
+ * @brief Allocator arenas per subsystem
+ *
+ * When built with jemalloc and Memory_Arenas is set, memory of the
+ * main subsystems comes from a jemalloc arena of its own, so their
+ * usage can be told apart and one subsystem's churn does not fragment
+ * another's pages.  Otherwise every arena is the default heap.
+ *
+ * Only allocation is tagged.  jemalloc frees memory to the arena it
+ * came from, so all of it is still released with gsh_free (or returned
+ * to its pool or slab as before).
+ */
+
+#ifndef MEM_ARENA_H
+#define MEM_ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+enum mem_arena {
+	MEM_ARENA_DEFAULT,
+	MEM_ARENA_MDCACHE,	/*< cache entries and dirents */
+	MEM_ARENA_SAL,		/*< clients, sessions, states and locks */
+	MEM_ARENA_RPC,		/*< requests, DRC and transport buffers */
+	MEM_ARENA_XDR,		/*< decoded arguments */
+	MEM_ARENA_COUNT
+};
+
+/**
+ * @brief Usage of one arena
+ */
+struct mem_arena_stats {
+	const char *name;
+	bool enabled;		/*< has a jemalloc arena of its own */
+	uint64_t allocated;	/*< bytes handed out by the arena */
+	uint64_t resident;	/*< bytes of the arena's resident pages */
+	uint64_t slab_bytes;	/*< bytes of slab chunks in the arena */
+};
+
+void mem_arena_init(void);
+bool mem_arena_enabled(void);
+const char *mem_arena_name(enum mem_arena arena);
+void mem_arena_get_stats(struct mem_arena_stats *stats);
+
+void *mem_arena_malloc__(enum mem_arena arena, size_t n,
+			 const char *file, int line, const char *function);
+void *mem_arena_malloc_aligned__(enum mem_arena arena, size_t a, size_t n,
+				 const char *file, int line,
+				 const char *function);
+void *mem_arena_calloc__(enum mem_arena arena, size_t n, size_t s,
+			 const char *file, int line, const char *function);
+
+#define mem_arena_malloc(arena, n) \
+	mem_arena_malloc__(arena, n, __FILE__, __LINE__, __func__)
+#define mem_arena_malloc_aligned(arena, a, n) \
+	mem_arena_malloc_aligned__(arena, a, n, __FILE__, __LINE__, __func__)
+#define mem_arena_calloc(arena, n, s) \
+	mem_arena_calloc__(arena, n, s, __FILE__, __LINE__, __func__)
+
+/* The allocators handed to TI-RPC, which use the thread's RPC arena */
+void *mem_arena_rpc_malloc__(size_t n,
+			     const char *file, int line, const char *function);
+void *mem_arena_rpc_malloc_aligned__(size_t a, size_t n,
+				     const char *file, int line,
+				     const char *function);
+void *mem_arena_rpc_calloc__(size_t n, size_t s,
+			     const char *file, int line, const char *function);
+void *mem_arena_rpc_realloc__(void *p, size_t n,
+			      const char *file, int line,
+			      const char *function);
+
+enum mem_arena mem_arena_rpc_set(enum mem_arena arena);
+
+#endif				/* MEM_ARENA_H */
@@ -0,0 +1,72 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file mem_pressure.h
+ * @brief Memory pressure monitor
+ *
+ * Every Memory_Pressure_Interval seconds the monitor rates the memory
+ * pressure on the server, from the PSI and events of its cgroup and
+ * from its own size, and tells the caches that registered a shrinker
+ * when the rating changes.  Each cache decides how far to shrink at
+ * each level.  The cheapest to rebuild go first:
+ *
+ * - MEM_PRESSURE_LOW: pooled I/O buffers;
+ * - MEM_PRESSURE_MEDIUM: DRC retention and directory chunks;
+ * - MEM_PRESSURE_HIGH: MDCACHE entries.
+ *
+ * The rating goes up at once, and down one level at a time once it
+ * has stayed lower for a while, so caches regrow in steps.
+ */
+
+#ifndef MEM_PRESSURE_H
+#define MEM_PRESSURE_H
+
+#include "gsh_list.h"
+
+enum mem_pressure {
+	MEM_PRESSURE_NONE,
+	MEM_PRESSURE_LOW,
+	MEM_PRESSURE_MEDIUM,
+	MEM_PRESSURE_HIGH,
+};
+
+/**
+ * @brief A cache that shrinks under memory pressure
+ *
+ * shrink is called with the new level whenever it changes, and once
+ * on registration if there is pressure.  It is called from the
+ * monitor thread and must not block for long.
+ */
+struct mem_pressure_shrinker {
+	struct glist_head list;		/*< Link in the shrinker list */
+	const char *name;
+	void (*shrink)(enum mem_pressure level);
+};
+
+void mem_pressure_register(struct mem_pressure_shrinker *shrinker);
+void mem_pressure_unregister(struct mem_pressure_shrinker *shrinker);
+enum mem_pressure mem_pressure_level(void);
+const char *mem_pressure_str(enum mem_pressure level);
+int mem_pressure_init(void);
+int mem_pressure_shutdown(void);
+
+#endif				/* MEM_PRESSURE_H */
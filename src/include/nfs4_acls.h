@@ -40,6 +40,56 @@ typedef int fsal_acl_status_t;
 #define NFS_V4_ACL_INIT_ENTRY_FAILED  6
 #define NFS_V4_ACL_NOT_FOUND  7
 
+/*
+ * Entries shared through nfs4_acl_new_entry can't change, so they are
+ * compiled once for fsal_test_access.  The ACEs that can apply to each
+ * object type are kept in order, with the uids and gids they name
+ * moved into sorted tables.  A credential then reduces to which of
+ * those ids it holds, and recent decisions are cached on that.
+ */
+
+enum fsal_acl_who {
+	FSAL_ACL_WHO_NOBODY,	/*< Unknown special id, only root */
+	FSAL_ACL_WHO_OWNER,
+	FSAL_ACL_WHO_GROUP,
+	FSAL_ACL_WHO_EVERYONE,
+	FSAL_ACL_WHO_UID,
+	FSAL_ACL_WHO_GID
+};
+
+struct fsal_acl_cace {
+	uint32_t ace;		/*< Index in aces */
+	uint32_t who;		/*< enum fsal_acl_who */
+	uint32_t id;		/*< Index in uids or gids */
+};
+
+/* Decisions are only cached when the gids fit the bitmap */
+#define FSAL_ACL_MAX_CACHED_GIDS 64
+#define FSAL_ACL_DECISIONS 8
+
+struct fsal_acl_decision {
+	uint64_t gids;		/*< Bitmap of gids held */
+	int32_t uid;		/*< Index of the uid held, or -1 */
+	uint32_t flags;
+	fsal_aceperm_t v4mask;
+	fsal_errors_t major;
+	fsal_accessflags_t allowed;
+	fsal_accessflags_t denied;
+};
+
+struct fsal_acl_compiled {
+	uint32_t nuids;
+	uint32_t ngids;
+	uid_t *uids;
+	gid_t *gids;
+	/** Allow and deny ACEs applicable to files, then to dirs */
+	struct fsal_acl_cace *caces[2];
+	uint32_t ncaces[2];
+	pthread_mutex_t mtx;	/*< Protects decisions */
+	uint32_t next;
+	struct fsal_acl_decision decisions[FSAL_ACL_DECISIONS];
+};
+
 fsal_acl_t *nfs4_acl_alloc();
 fsal_ace_t *nfs4_ace_alloc(int nace);
 
@@ -107,11 +107,48 @@ typedef enum request_type {
 #endif				/* _USE_9P */
 } request_type_t;
 
+/**
+ * @brief Phases of a request's life, each ended by a timestamp
+ */
+enum nfs_req_phase {
+	NFS_REQ_PHASE_QUEUE,	/*< enqueue to dequeue by a worker */
+	NFS_REQ_PHASE_SETUP,	/*< dequeue to service function entry */
+	NFS_REQ_PHASE_SERVICE,	/*< service function (FSAL) entry to exit */
+	NFS_REQ_PHASE_REPLY,	/*< service function exit to reply sent */
+	NFS_REQ_PHASE_COUNT
+};
+
+/**
+ * @brief Phases of the server's startup, in order
+ */
+enum nfs_start_phase {
+	NFS_START_CONFIG,	/*< config file parse */
+	NFS_START_FSALS,	/*< FSAL modules loaded */
+	NFS_START_PARAMS,	/*< core parameters set */
+	NFS_START_PKGS,		/*< MDCACHE, state and ID mapping set up */
+	NFS_START_EXPORTS,	/*< exports created */
+	NFS_START_EXPORT_ROOTS,	/*< export roots and cache snapshot */
+	NFS_START_RPC,		/*< buffers and RPC transports */
+	NFS_START_CACHES,	/*< client, DRC, state and session caches */
+	NFS_START_PSEUDOFS,	/*< NFSv4 pseudo file system */
+	NFS_START_RECOVERY,	/*< recovery store and client IDs read */
+	NFS_START_THREADS,	/*< service threads started */
+	NFS_START_GRACE,	/*< grace period, from recovery to lifted */
+	NFS_START_PHASE_COUNT
+};
+
+void nfs_start_phase_done(enum nfs_start_phase phase);
+bool nfs_start_phase_get(enum nfs_start_phase phase, const char **name,
+			 nsecs_elapsed_t *start, nsecs_elapsed_t *end);
+
 typedef struct request_data {
 	struct glist_head req_q;	/* chaining of pending requests */
 	struct timespec time_queued;	/*< The time at which a request was
 					 *  added to the worker thread queue.
 					 */
+	struct timespec time_dequeued;	/*< taken off the queue by a worker */
+	struct timespec time_service;	/*< service function entered */
+	struct timespec time_serviced;	/*< service function returned */
 	request_type_t rtype;
 
 	union request_content {
@@ -163,17 +200,56 @@ void nfs_rpc_dispatch_stop(void);
 
 request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker);
 void nfs_rpc_enqueue_req(request_data_t *req);
+void nfs_rpc_req_done(request_data_t *req);
+void nfs_rpc_reply_cork(SVCXPRT *xprt);
+void nfs_rpc_reclaim_idle(void);
 uint32_t get_dequeue_count(void);
 uint32_t get_enqueue_count(void);
 
 /* in nfs_worker_thread.c */
 
-void nfs_rpc_execute(request_data_t *req);
+int nfs_rpc_execute(request_data_t *req);
 const nfs_function_desc_t *nfs_rpc_get_funcdesc(nfs_request_t *);
 
 int worker_init(void);
 int worker_shutdown(void);
 
+/**
+ * @brief State of the worker pool sizing
+ */
+struct worker_pool_stats {
+	bool adaptive;		/*< Pool is sized to the load */
+	uint32_t min;		/*< Nb_Worker_Min */
+	uint32_t max;		/*< Nb_Worker_Max */
+	uint32_t target;	/*< Size last decided on */
+	uint32_t nthreads;	/*< Threads running now */
+	uint32_t busy;		/*< Threads not waiting for a request */
+	uint64_t queue_wait;	/*< Average queue wait last second, usecs */
+	uint64_t grown;		/*< Times the pool grew */
+	uint64_t shrunk;	/*< Times the pool shrank */
+};
+
+void worker_pool_get_stats(struct worker_pool_stats *st);
+
+#ifdef _USE_NFS_RDMA
+/**
+ * @brief Counters of an NFS/RDMA connection
+ *
+ * Chunks are managed by TI-RPC, so they are counted by the requests
+ * that use them: READ replies go back in RDMA WRITE chunks and WRITE
+ * data comes in by RDMA READ, once larger than the inline buffers.
+ */
+struct nfs_rdma_conn_stats {
+	char peer[SOCK_NAME_MAX];	/*< Client address */
+	uint64_t requests;	/*< Requests decoded */
+	uint64_t credit_stalls;	/*< Requests that used the last credit */
+	uint64_t rdma_read_reqs;	/*< WRITE requests */
+	uint64_t rdma_write_reqs;	/*< READ requests */
+};
+
+uint32_t nfs_rdma_get_conn_stats(struct nfs_rdma_conn_stats **stats);
+#endif				/* _USE_NFS_RDMA */
+
 /* Config parsing routines */
 extern config_file_t config_struct;
 extern struct config_block nfs_core;
@@ -182,6 +258,9 @@ extern struct config_block nfs_ip_name;
 extern struct config_block krb5_param;
 #endif
 extern struct config_block version4_param;
+#ifdef _USE_NFS_RDMA
+extern struct config_block nfs_rdma_param;
+#endif
 
 /* in nfs_admin_thread.c */
 
@@ -191,8 +270,6 @@ void admin_halt(void);
 
 /* Tools */
 
-int compare_state_id(struct gsh_buffdesc *buff1, struct gsh_buffdesc *buff2);
-
 /* used in DBUS-api diagnostic functions (e.g., serialize sessionid) */
 int b64_ntop(u_char const *src, size_t srclength, char *target,
 	     size_t targsize);
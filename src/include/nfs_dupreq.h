@@ -133,8 +133,20 @@ typedef enum dupreq_status {
 	DUPREQ_ERROR,
 } dupreq_status_t;
 
+/**
+ * @brief DRC counters, for DBus
+ */
+struct dupreq_stats {
+	uint64_t hits;		/*< Retransmits answered from the cache */
+	uint64_t misses;	/*< Requests entered in the cache */
+	uint64_t in_progress;	/*< Retransmits of requests still running */
+	uint64_t retired;	/*< Expired TCP DRCs freed */
+	uint64_t recycle_qlen;	/*< TCP DRCs of closed connections kept */
+};
+
 void dupreq2_pkginit(void);
 void dupreq2_pkgshutdown(void);
+void dupreq2_get_stats(struct dupreq_stats *st);
 
 drc_t *drc_get_tcp_drc(struct svc_req *);
 void drc_release_tcp_drc(drc_t *);
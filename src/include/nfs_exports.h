@@ -121,6 +121,9 @@ typedef struct exportlist_client_entry__ {
 						 specified */
 #define EXPORT_OPTION_PREFWRITE_SET 0x00000080 /* Set if PrefWrite was
 						  specified */
+/** The tree never changes: nothing cached of it expires, and nothing is
+    written to it. */
+#define EXPORT_OPTION_IMMUTABLE 0x00000100
 
 /* Constants for export permissions masks */
 #define EXPORT_OPTION_ROOT 0	/*< Allow root access as root uid */
@@ -220,6 +223,8 @@ typedef struct exportlist_client_entry__ {
 uid_t get_anonymous_uid(void);
 gid_t get_anonymous_gid(void);
 void export_check_access(void);
+void foreach_export_netgroup(void (*cb)(const char *group, void *arg),
+			     void *arg);
 
 bool export_check_security(struct svc_req *req);
 
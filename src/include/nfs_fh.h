@@ -45,6 +45,7 @@
 
 #define GANESHA_FH_VERSION 0x43
 #define FILE_HANDLE_V4_FLAG_DS	0x01 /*< handle for a DS */
+#define FH_CACHE_HINT		0x20 /*< fsopaque is followed by a cache hint */
 #define FH_FSAL_BIG_ENDIAN	0x40 /*< FSAL FH is big endian */
 
 /**
@@ -40,6 +40,38 @@
 #include "export_mgr.h"
 #include "nfs_fh.h"
 
+/**
+ * @brief Get the size of the cache hint of a handle
+ *
+ * With FH_CACHE_HINT, the FSAL's handle_cache_hint is stored, unaligned,
+ * right after the fs_len bytes of fsopaque.
+ *
+ * @return The hint size, 0 if the handle has none
+ */
+
+static inline size_t nfs_sizeof_cache_hint(uint8_t fhflags1)
+{
+	return (fhflags1 & FH_CACHE_HINT) ? sizeof(uint64_t) : 0;
+}
+
+/**
+ * @brief Get the cache hint of a handle
+ *
+ * @return The hint, 0 if the handle has none
+ */
+
+static inline uint64_t nfs_get_cache_hint(uint8_t fhflags1,
+					  const uint8_t *fsopaque,
+					  uint8_t fs_len)
+{
+	uint64_t hint = 0;
+
+	if (fhflags1 & FH_CACHE_HINT)
+		memcpy(&hint, fsopaque + fs_len, sizeof(hint));
+
+	return hint;
+}
+
 /**
  * @brief Get the actual size of a v3 handle based on the sized fsopaque
  *
@@ -51,7 +83,8 @@ static inline size_t nfs3_sizeof_handle(struct file_handle_v3 *hdl)
 	int hsize;
 	int aligned_hsize;
 
-	hsize = offsetof(struct file_handle_v3, fsopaque) + hdl->fs_len;
+	hsize = offsetof(struct file_handle_v3, fsopaque) + hdl->fs_len +
+		nfs_sizeof_cache_hint(hdl->fhflags1);
 
 	/* correct packet's fh length so it's divisible by 4 to trick dNFS into
 	   working. This is essentially sending the padding. */
@@ -118,7 +151,8 @@ static inline void nfs4_freeFH(nfs_fh4 *fh)
 
 static inline size_t nfs4_sizeof_handle(struct file_handle_v4 *hdl)
 {
-	return offsetof(struct file_handle_v4, fsopaque)+hdl->fs_len;
+	return offsetof(struct file_handle_v4, fsopaque) + hdl->fs_len +
+		nfs_sizeof_cache_hint(hdl->fhflags1);
 }
 
 #define LEN_FH_STR 1024
@@ -13,17 +13,28 @@
 #define IP_NAME_INSERT_MALLOC_ERROR 1
 #define IP_NAME_NOT_FOUND           2
 #define IP_NAME_NETDB_ERROR         3
+#define IP_NAME_PENDING             4
 
 #define IP_NAME_PREALLOC_SIZE      200
 
+/* State of an IP/name cache entry */
+enum ip_name_state {
+	IP_NAME_RESOLVED,	/*< hostname is the name of the address */
+	IP_NAME_FAILED,		/*< no name, hostname is the address */
+	IP_NAME_RESOLVING,	/*< being resolved, no hostname yet */
+};
+
 /* NFS IPaddr cache entry structure */
 typedef struct nfs_ip_name__ {
 	time_t timestamp;
+	uint8_t state;		/*< enum ip_name_state */
+	bool refreshing;	/*< queued to be resolved again */
 	char hostname[MAXHOSTNAMELEN + 1];
 } nfs_ip_name_t;
 
 int nfs_ip_name_get(sockaddr_t *ipaddr, char *hostname, size_t size);
 int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size);
+int nfs_ip_name_resolve(sockaddr_t *ipaddr, char *hostname, size_t size);
 int nfs_ip_name_remove(sockaddr_t *ipaddr);
 
 int display_ip_name_key(struct gsh_buffdesc *pbuff, char *str);
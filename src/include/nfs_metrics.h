@@ -0,0 +1,47 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_metrics.h
+ * @brief OpenMetrics exporter over HTTP
+ *
+ * With Metrics_Port set, a thread answers GET /metrics with the server
+ * stats in the OpenMetrics text format, so they can be scraped without
+ * DBus.  Each module that has stats to offer renders them into the
+ * stream it is handed; they must not use DBus to do it.
+ */
+
+#ifndef NFS_METRICS_H
+#define NFS_METRICS_H
+
+#include <stdio.h>
+
+void nfs_metrics_pkginit(void);
+void nfs_metrics_pkgshutdown(void);
+
+/* Start a metric family */
+void metrics_family(FILE *out, const char *name, const char *type,
+		    const char *help);
+
+void server_stats_metrics(FILE *out);
+void mdcache_metrics(FILE *out);
+
+#endif				/* NFS_METRICS_H */
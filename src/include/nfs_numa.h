@@ -0,0 +1,71 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file nfs_numa.h
+ * @brief NUMA topology discovery for worker placement
+ *
+ * The topology is read once from sysfs at startup and is immutable
+ * afterwards, so lookups need no locking.
+ */
+
+#ifndef NFS_NUMA_H
+#define NFS_NUMA_H
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+struct nfs_numa_node {
+	uint32_t id;		/*< sysfs node number */
+	uint32_t ncpus;		/*< number of CPUs in cpus */
+	cpu_set_t cpus;		/*< CPUs belonging to this node */
+};
+
+struct nfs_numa_topology {
+	uint32_t nnodes;	/*< number of populated nodes */
+	struct nfs_numa_node *nodes;
+	uint32_t ncpus;		/*< size of cpu_node */
+	uint32_t *cpu_node;	/*< map CPU number -> index into nodes */
+};
+
+extern struct nfs_numa_topology nfs_numa;
+
+int nfs_numa_init(void);
+
+/**
+ * @brief Return the node index owning a CPU
+ *
+ * @param[in] cpu CPU number, may be negative if unknown
+ *
+ * @return Index into nfs_numa.nodes (0 if the CPU is unknown)
+ */
+static inline uint32_t nfs_numa_cpu_node(int cpu)
+{
+	if (cpu < 0 || (uint32_t) cpu >= nfs_numa.ncpus)
+		return 0;
+
+	return nfs_numa.cpu_node[cpu];
+}
+
+int nfs_numa_bind_self(uint32_t node);
+
+#endif				/* NFS_NUMA_H */
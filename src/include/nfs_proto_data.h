@@ -38,6 +38,8 @@
 
 #include "fsal_api.h"
 #include "rquota.h"
+#include "uid2grp.h"
+#include "gsh_arena.h"
 
 /*
  * mount was autogenerated, and requires several headers to compile;
@@ -103,6 +105,12 @@ typedef union nfs_arg__ {
 struct COMPOUND4res_extended {
 	COMPOUND4res res_compound4;
 	bool res_cached;
+	char *res_xdr;		/*< Pre-encoded reply, sent instead of
+				    res_compound4 if set */
+	u_int res_xdr_len;	/*< Length of res_xdr */
+	struct gsh_arena res_arena;	/*< Holds the result array, the tag
+					   and GETATTR attributes, released
+					   by nfs4_Compound_Free */
 };
 
 typedef union nfs_res__ {
@@ -189,12 +197,31 @@ typedef struct nfs_function_desc__ {
 	unsigned int dispatch_behaviour;
 } nfs_function_desc_t;
 
+struct nfs_request;
+
+/**
+ * @brief Resume a request suspended on asynchronous I/O
+ *
+ * @return NFS_REQ_OK, NFS_REQ_DROP or NFS_REQ_ASYNC_WAIT.
+ */
+typedef int (*nfs_protocol_resume_t)(struct nfs_request *reqnfs);
+
 typedef struct nfs_request {
 	struct svc_req svc;
 	struct nfs_request_lookahead lookahead;
 	nfs_arg_t arg_nfs;
 	nfs_res_t *res_nfs;
 	const nfs_function_desc_t *funcdesc;
+	void *proc_data;	/*< Protocol state of a suspended request */
+	nfs_protocol_resume_t resume_fn; /*< Set while suspended */
+	/* The request context lives with the request rather than on the
+	 * worker's stack, so a suspended request can be resumed by any
+	 * worker. */
+	struct export_perms export_perms;
+	struct user_cred user_credentials;
+	struct req_op_context req_ctx;
+	struct uid2grp_waiter gids_wait; /*< Parked for Manage_Gids */
+	uint64_t budget;	/*< Bytes charged to the dispatch budgets */
 } nfs_request_t;
 
 enum rpc_chan_type {
@@ -317,6 +344,11 @@ typedef struct compound_data {
 							   cached RPC result in
 							   a session's slot */
 	bool use_drc;		/*< Set to true if session DRC is to be used */
+	bool slot_encoded;	/*< Cache the reply encoded in the slot */
+	bool cachethis;		/*< Client asked for the reply to be cached */
+	char *replay_xdr;	/*< Encoded reply to replay */
+	u_int replay_len;	/*< Length of replay_xdr */
+	nfsstat4 replay_status;	/*< Status of the replayed reply */
 	uint32_t oppos;		/*< Position of the operation within the
 				    request processed  */
 	nfs41_session_t *session;	/*< Related session
@@ -325,8 +357,26 @@ typedef struct compound_data {
 				   (if applicable) */
 	slotid4 slot;		/*< Slot ID of the current compound
 				   (if applicable) */
+	nfs_argop4 *argarray;	/*< Operations of the compound */
+	nfs_resop4 *resarray;	/*< Results of the compound */
+	uint32_t argarray_len;	/*< Number of operations */
+	nfs_res_t *res;		/*< Reply to the compound */
+	int status;		/*< Status of the last operation */
+	nfs_opnum4 opcode;	/*< Operation being processed */
+	nsecs_elapsed_t op_start_time;	/*< Start time of that operation */
+	nsecs_elapsed_t op_cpu_start;	/*< Thread CPU time at its start */
+	int (*op_resume)(struct nfs_argop4 *, struct compound_data *,
+			 struct nfs_resop4 *);	/*< Resumes a suspended
+						    operation */
+	void *op_data;		/*< Private state of a suspended operation */
+	uint32_t async_flags;	/*< NFS4_ASYNC_* */
 } compound_data_t;
 
+/* Handshake between an operation suspending on asynchronous I/O and
+ * the I/O completion; whichever comes second resumes the compound. */
+#define NFS4_ASYNC_EXIT 0x00000001	/*< Issuing thread has let go */
+#define NFS4_ASYNC_DONE 0x00000002	/*< I/O has completed */
+
 typedef int (*nfs4_op_function_t) (struct nfs_argop4 *, compound_data_t *,
 				   struct nfs_resop4 *);
 
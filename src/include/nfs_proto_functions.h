@@ -275,6 +275,9 @@ int nfs4_op_getdevicelist(struct nfs_argop4 *, compound_data_t *,
 int nfs4_op_free_stateid(struct nfs_argop4 *, compound_data_t *,
 			 struct nfs_resop4 *);
 
+int nfs4_op_get_dir_delegation(struct nfs_argop4 *, compound_data_t *,
+			       struct nfs_resop4 *);
+
 int nfs4_op_getdeviceinfo(struct nfs_argop4 *, compound_data_t *,
 			  struct nfs_resop4 *);
 
@@ -284,6 +287,9 @@ int nfs4_op_destroy_clientid(struct nfs_argop4 *, compound_data_t *,
 int nfs4_op_destroy_session(struct nfs_argop4 *, compound_data_t *,
 			    struct nfs_resop4 *);
 
+int nfs4_op_bind_conn_to_session(struct nfs_argop4 *, compound_data_t *,
+				 struct nfs_resop4 *);
+
 int nfs4_op_layoutget(struct nfs_argop4 *, compound_data_t *,
 		      struct nfs_resop4 *);
 
@@ -338,6 +344,35 @@ int nfs4_op_io_advise(struct nfs_argop4 *, compound_data_t *,
 
 void nfs4_op_io_advise_Free(nfs_resop4 *resp);
 
+int nfs4_op_copy(struct nfs_argop4 *, compound_data_t *,
+		 struct nfs_resop4 *);
+
+void nfs4_op_copy_Free(nfs_resop4 *resp);
+
+int nfs4_op_clone(struct nfs_argop4 *, compound_data_t *,
+		  struct nfs_resop4 *);
+
+void nfs4_op_clone_Free(nfs_resop4 *resp);
+
+int nfs4_op_copy_notify(struct nfs_argop4 *, compound_data_t *,
+			struct nfs_resop4 *);
+
+void nfs4_op_copy_notify_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_cancel(struct nfs_argop4 *, compound_data_t *,
+			   struct nfs_resop4 *);
+
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_status(struct nfs_argop4 *, compound_data_t *,
+			   struct nfs_resop4 *);
+
+void nfs4_op_offload_status_Free(nfs_resop4 *resp);
+
+void nfs4_copy_pkginit(void);
+void nfs4_copy_pkgshutdown(void);
+void nfs4_copy_client_expire(nfs_client_id_t *clientid);
+
 int nfs4_op_layouterror(struct nfs_argop4 *, compound_data_t *,
 		      struct nfs_resop4 *);
 
@@ -375,6 +410,10 @@ void nfs4_op_removexattr_Free(nfs_resop4 *resp);
 
 #define NFS_REQ_OK   0
 #define NFS_REQ_DROP 1
+#define NFS_REQ_ASYNC_WAIT 2	/*< Suspended, will be resumed on a worker */
+
+/* Returned by an NFSv4 operation that has suspended the compound */
+#define NFS4_OP_ASYNC_WAIT (-1)
 
 /* Free functions */
 void mnt1_Mnt_Free(nfs_res_t *);
@@ -430,6 +469,8 @@ void nfs3_read_free(nfs_res_t *);
 
 void nfs4_Compound_FreeOne(nfs_resop4 *);
 void nfs4_Compound_Free(nfs_res_t *);
+bool xdr_COMPOUND4res_extended(XDR *, struct COMPOUND4res_extended *);
+void nfs41_Slot_Release_Reply(nfs41_session_slot_t *);
 void nfs4_Compound_CopyResOne(nfs_resop4 *, nfs_resop4 *);
 void nfs4_Compound_CopyRes(nfs_res_t *, nfs_res_t *);
 
@@ -490,7 +531,9 @@ void nfs4_op_create_session_Free(nfs_resop4 *);
 void nfs4_op_getdevicelist_Free(nfs_resop4 *);
 void nfs4_op_getdeviceinfo_Free(nfs_resop4 *);
 void nfs4_op_free_stateid_Free(nfs_resop4 *);
+void nfs4_op_get_dir_delegation_Free(nfs_resop4 *);
 void nfs4_op_destroy_session_Free(nfs_resop4 *);
+void nfs4_op_bind_conn_to_session_Free(nfs_resop4 *);
 void nfs4_op_lock_Free(nfs_resop4 *);
 void nfs4_op_lockt_Free(nfs_resop4 *);
 void nfs4_op_locku_Free(nfs_resop4 *);
@@ -504,9 +547,17 @@ void nfs4_op_reclaim_complete_Free(nfs_resop4 *);
 
 void compound_data_Free(compound_data_t *);
 
+void nfs4_async_prepare(compound_data_t *data, nfs4_op_function_t resume,
+			void *op_data);
+int nfs4_async_issued(struct nfs_argop4 *op, compound_data_t *data,
+		      struct nfs_resop4 *resp);
+void nfs4_async_done(compound_data_t *data);
+
 /* Pseudo FS functions */
 bool pseudo_mount_export(struct gsh_export *exp);
 void create_pseudofs(void);
 void pseudo_unmount_export(struct gsh_export *exp);
+bool pseudo_lazy_mount(struct fsal_obj_handle *dir, const char *name);
+void pseudo_lazy_mount_export(struct gsh_export *exp);
 
 #endif	/* NFS_PROTO_FUNCTIONS_H */
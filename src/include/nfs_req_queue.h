@@ -35,6 +35,7 @@
 #ifndef NFS_REQ_QUEUE_H
 #define NFS_REQ_QUEUE_H
 
+#include <sched.h>
 #include "gsh_list.h"
 #include "wait_queue.h"
 
@@ -70,15 +71,23 @@ struct req_q_set {
 struct nfs_req_st {
 	struct {
 		uint32_t ctr;
-		struct req_q_set nfs_request_q;
+		uint32_t nshards;	/*< number of queue sets */
+		uint32_t ncpu_shard;	/*< size of cpu_shard */
+		uint32_t *cpu_shard;	/*< optional CPU -> shard map */
+		struct req_q_set *nfs_request_q; /*< nshards queue sets */
+		uint8_t *sched;		/*< weighted order of the queues */
+		uint32_t nsched;	/*< length of sched */
+		uint32_t hl_active;	/*< workers in high latency requests */
 		uint64_t size;
 		pthread_spinlock_t sp;
 		struct glist_head wait_list;
 		uint32_t waiters;
+		uint32_t spinners;	/*< idle workers polling the queues */
 	} reqs;
 	GSH_CACHE_PAD(1);
 	struct {
 		pthread_mutex_t mtx;
+		pthread_cond_t cv;	/*< Signaled when one may unstall */
 		struct glist_head q;
 		uint32_t stalled;
 		bool active;
@@ -97,6 +106,39 @@ static inline void nfs_rpc_q_init(struct req_q *q)
 	q->waiters = 0;
 }
 
+/**
+ * @brief Select the queue set (shard) local to the calling thread
+ *
+ * With a single shard this is always 0.  Otherwise, the shard is
+ * chosen by the CPU the caller is currently running on, so that
+ * decoders and workers sharing a CPU also share producer/consumer
+ * locks.  When a CPU to shard map is installed (NUMA worker pools),
+ * it is used instead of a simple modulus.  If the CPU cannot be
+ * determined, fall back to the hint.
+ *
+ * @param[in] hint  Fallback value (e.g. worker index)
+ *
+ * @return Shard index in 0..nshards-1
+ */
+static inline uint32_t nfs_rpc_q_local_shard(uint32_t hint)
+{
+	uint32_t nshards = nfs_req_st.reqs.nshards;
+	int cpu;
+
+	if (nshards <= 1)
+		return 0;
+
+	cpu = sched_getcpu();
+	if (cpu < 0)
+		return hint % nshards;
+
+	if (nfs_req_st.reqs.cpu_shard != NULL
+	    && (uint32_t) cpu < nfs_req_st.reqs.ncpu_shard)
+		return nfs_req_st.reqs.cpu_shard[cpu];
+
+	return ((uint32_t) cpu) % nshards;
+}
+
 static inline uint32_t nfs_rpc_q_next_slot(void)
 {
 	uint32_t ix = atomic_inc_uint32_t(&nfs_req_st.reqs.ctr);
@@ -106,6 +148,40 @@ static inline uint32_t nfs_rpc_q_next_slot(void)
 	return ix;
 }
 
+/**
+ * @brief Take a high latency slot before dequeuing such a request
+ *
+ * At most Dispatch_Max_High_Latency workers may be inside high latency
+ * requests at once, so that streaming I/O leaves workers for metadata.
+ *
+ * @param[in,out] held Whether the worker holds a slot
+ *
+ * @return false if all the slots are taken.
+ */
+static inline bool nfs_rpc_q_hl_enter(bool *held)
+{
+	uint32_t max = nfs_param.core_param.dispatch_max_high_latency;
+
+	if (max == 0 || *held)
+		return true;
+
+	if (atomic_inc_uint32_t(&nfs_req_st.reqs.hl_active) > max) {
+		(void) atomic_dec_uint32_t(&nfs_req_st.reqs.hl_active);
+		return false;
+	}
+
+	*held = true;
+	return true;
+}
+
+static inline void nfs_rpc_q_hl_exit(bool *held)
+{
+	if (*held) {
+		(void) atomic_dec_uint32_t(&nfs_req_st.reqs.hl_active);
+		*held = false;
+	}
+}
+
 static inline void nfs_rpc_queue_awaken(void *arg)
 {
 	struct nfs_req_st *st = arg;
@@ -131,6 +131,8 @@ int nfs_rpc_create_chan_v40(nfs_client_id_t *pclientid, uint32_t flags);
 
 int nfs_rpc_create_chan_v41(nfs41_session_t *session, int num_sec_parms,
 			    callback_sec_parms4 *sec_parms);
+int nfs_rpc_bind_conn_v41(nfs41_session_t *session, SVCXPRT *xprt);
+void nfs_rpc_destroy_chan_v41(nfs41_session_t *session);
 
 /* Dispose a channel. */
 void nfs_rpc_destroy_chan(rpc_call_channel_t *chan);
@@ -156,6 +158,43 @@ int nfs_rpc_v41_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
 		       void (*free_op)(nfs_cb_argop4 *op));
 void nfs41_complete_single(rpc_call_t *call, rpc_call_hook hook, void *arg,
 			   uint32_t flags);
+
+/**
+ * @brief Back channel slot statistics, since startup
+ *
+ * A search for a v4.1 callback slot either finds one free at once, or
+ * finds the session busy and, when allowed to, waits for a slot to be
+ * released.
+ */
+struct nfs_cb_slot_stats {
+	uint64_t found;		/*< Slots found free at once */
+	uint64_t busy;		/*< Searches that found none, without waiting */
+	uint64_t waited;	/*< Slots found after waiting */
+	uint64_t missed;	/*< Waits that timed out */
+	uint64_t wait_ns;	/*< Total time spent waiting */
+	uint64_t max_wait_ns;	/*< Longest wait */
+};
+
+void nfs_rpc_cb_slot_stats(struct nfs_cb_slot_stats *stats);
+
+/**
+ * @brief A callback operation queued with nfs_rpc_cb_batch
+ *
+ * Embedded in the caller's own context.
+ */
+struct nfs_cb_batch_op {
+	struct glist_head batch_link;	/*< Link in cid_cb_batch */
+	nfs_cb_argop4 arg;	/*< The operation */
+	struct state_refer refer;	/*< Call that created the state */
+	bool has_refer;		/*< Whether refer is set (v4.1) */
+	/** Called with the operation's status once its compound is done,
+	    hook is RPC_CALL_ABORT if the compound could not be sent */
+	void (*completion)(struct nfs_cb_batch_op *op, rpc_call_hook hook,
+			   nfsstat4 status);
+};
+
+void nfs_rpc_cb_batch(nfs_client_id_t *clientid, struct nfs_cb_batch_op *op);
 enum clnt_stat nfs_test_cb_chan(nfs_client_id_t *);
+void nfs_rpc_probe_cb_chan(nfs_client_id_t *clientid, bool reconnect);
 
 #endif /* !NFS_RPC_CALLBACK_H */
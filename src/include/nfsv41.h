@@ -2505,9 +2505,9 @@ extern "C" {
 
 	/* NFSv4.2 */
 	enum netloc_type4 {
-		NL4_NAME        = 0,
-		NL4_URL         = 1,
-		NL4_NETADDR     = 2
+		NL4_NAME        = 1,
+		NL4_URL         = 2,
+		NL4_NETADDR     = 3
 	};
 	typedef enum netloc_type4 netloc_type4;
 
@@ -2573,88 +2573,100 @@ extern "C" {
 		offset4         sr_offset;
 	} seek_res4;
 
-	typedef struct OFFLOAD_STATUS4resok {
-		length4         osr_bytes_copied;
-		count4          osr_count_complete;
-		nfsstat4        osr_complete;
-	} OFFLOAD_STATUS4resok;
-
-	struct COPY_NOTIFY4args {
-		stateid4 cna_stateid;
-		netloc_type4        cna_type;
+	struct netloc4 {
+		netloc_type4 nl_type;
 		union {
-			utf8str_cis cna_name;
-			utf8str_cis cna_url;
-			netaddr4    cna_addr;
-		};
-	};
-	typedef struct COPY_NOTIFY4args COPY_NOTIFY4args;
-
-	struct COPY_NOTIFY4res {
-		nfstime4 cnr_time;
-		netloc_type4        cna_type;
-		union {
-			utf8str_cis cnr_name;
-			utf8str_cis cnr_url;
-			netaddr4    cnr_addr;
-		};
-	};
-	typedef struct COPY_NOTIFY4res COPY_NOTIFY4res;
-
-	struct OFFLOAD_REVOKE4args {
-		netloc_type4        ora_type;
-		union {
-			utf8str_cis ora_name;
-			utf8str_cis ora_url;
-			netaddr4    ora_addr;
-		};
+			utf8str_cis nl_name;
+			utf8str_cis nl_url;
+			netaddr4 nl_addr;
+		} netloc4_u;
 	};
-	typedef struct OFFLOAD_REVOKE4args OFFLOAD_REVOKE4args;
+	typedef struct netloc4 netloc4;
 
-	struct OFFLOAD_REVOKE4res {
-		netloc_type4        orr_type;
+	struct copy_requirements4 {
+		bool_t cr_consecutive;
+		bool_t cr_synchronous;
 	};
-	typedef struct OFFLOAD_REVOKE4res OFFLOAD_REVOKE4res;
+	typedef struct copy_requirements4 copy_requirements4;
 
 	struct COPY4args {
-		stateid4        ca_src_stateid;
-		stateid4        ca_dst_stateid;
-		offset4         ca_src_offset;
-		offset4         ca_dst_offset;
-		length4         ca_count;
-		netloc_type4        ca_type;
-		union {
-			utf8str_cis ca_name;
-			utf8str_cis ca_url;
-			netaddr4    ca_addr;
-		};
+		stateid4 ca_src_stateid;
+		stateid4 ca_dst_stateid;
+		offset4 ca_src_offset;
+		offset4 ca_dst_offset;
+		length4 ca_count;
+		bool_t ca_consecutive;
+		bool_t ca_synchronous;
+		struct {
+			u_int ca_source_server_len;
+			netloc4 *ca_source_server_val;
+		} ca_source_server;
 	};
 	typedef struct COPY4args COPY4args;
 
+	struct COPY4resok {
+		write_response4 cr_response;
+		copy_requirements4 cr_requirements;
+	};
+	typedef struct COPY4resok COPY4resok;
+
 	struct COPY4res {
 		nfsstat4 cr_status;
 		union {
-			write_response4 cr_resok4;
-			length4         cr_bytes_copied;
+			COPY4resok cr_resok4;
+			copy_requirements4 cr_requirements;
 		} COPY4res_u;
 	};
 	typedef struct COPY4res COPY4res;
 
-	struct OFFLOAD_ABORT4args {
-		stateid4        oaa_stateid;
+	struct COPY_NOTIFY4args {
+		stateid4 cna_src_stateid;
+		netloc4 cna_destination_server;
+	};
+	typedef struct COPY_NOTIFY4args COPY_NOTIFY4args;
+
+	struct COPY_NOTIFY4resok {
+		nfstime4 cnr_lease_time;
+		stateid4 cnr_stateid;
+		struct {
+			u_int cnr_source_server_len;
+			netloc4 *cnr_source_server_val;
+		} cnr_source_server;
+	};
+	typedef struct COPY_NOTIFY4resok COPY_NOTIFY4resok;
+
+	struct COPY_NOTIFY4res {
+		nfsstat4 cnr_status;
+		union {
+			COPY_NOTIFY4resok resok4;
+		} COPY_NOTIFY4res_u;
+	};
+	typedef struct COPY_NOTIFY4res COPY_NOTIFY4res;
+
+	struct OFFLOAD_CANCEL4args {
+		stateid4 oca_stateid;
 	};
-	typedef struct OFFLOAD_ABORT4args OFFLOAD_ABORT4args;
+	typedef struct OFFLOAD_CANCEL4args OFFLOAD_CANCEL4args;
 
-	struct OFFLOAD_ABORT4res {
-		stateid4        oar_stateid;
+	struct OFFLOAD_CANCEL4res {
+		nfsstat4 ocr_status;
 	};
-	typedef struct OFFLOAD_ABORT4res OFFLOAD_ABORT4res;
+	typedef struct OFFLOAD_CANCEL4res OFFLOAD_CANCEL4res;
 
 	struct OFFLOAD_STATUS4args {
-		stateid4        osa_stateid;
+		stateid4 osa_stateid;
 	};
 	typedef struct OFFLOAD_STATUS4args OFFLOAD_STATUS4args;
 
+	struct OFFLOAD_STATUS4resok {
+		length4 osr_count;
+		struct {
+			u_int osr_complete_len;
+			nfsstat4 osr_complete_val[1];
+		} osr_complete;
+	};
+	typedef struct OFFLOAD_STATUS4resok OFFLOAD_STATUS4resok;
+
 	struct OFFLOAD_STATUS4res {
 		nfsstat4 osr_status;
 		union {
@@ -2663,6 +2675,20 @@ extern "C" {
 	};
 	typedef struct OFFLOAD_STATUS4res OFFLOAD_STATUS4res;
 
+	struct CLONE4args {
+		stateid4 cl_src_stateid;
+		stateid4 cl_dst_stateid;
+		offset4 cl_src_offset;
+		offset4 cl_dst_offset;
+		length4 cl_count;
+	};
+	typedef struct CLONE4args CLONE4args;
+
+	struct CLONE4res {
+		nfsstat4 cl_status;
+	};
+	typedef struct CLONE4res CLONE4res;
+
 	struct WRITE_SAME4args {
 		stateid4        wp_stateid;
 		stable_how4     wp_stable;
@@ -3164,10 +3190,9 @@ extern "C" {
 			RECLAIM_COMPLETE4args opreclaim_complete;
 
 			/* NFSv4.2 */
-			COPY_NOTIFY4args opoffload_notify;
-			OFFLOAD_REVOKE4args opcopy_revoke;
+			COPY_NOTIFY4args opcopy_notify;
 			COPY4args opcopy;
-			OFFLOAD_ABORT4args opoffload_abort;
+			OFFLOAD_CANCEL4args opoffload_cancel;
 			OFFLOAD_STATUS4args opoffload_status;
 			WRITE_SAME4args opwrite_plus;
 			ALLOCATE4args opallocate;
@@ -3177,6 +3202,7 @@ extern "C" {
 			IO_ADVISE4args opio_advise;
 			LAYOUTERROR4args oplayouterror;
 			LAYOUTSTATS4args oplayoutstats;
+			CLONE4args opclone;
 
 			/* NFSv4.3 */
 			GETXATTR4args opgetxattr;
@@ -3249,10 +3275,9 @@ extern "C" {
 			RECLAIM_COMPLETE4res opreclaim_complete;
 
 			/* NFSv4.2 */
-			COPY_NOTIFY4res opoffload_notify;
-			OFFLOAD_REVOKE4res opcopy_revoke;
+			COPY_NOTIFY4res opcopy_notify;
 			COPY4res opcopy;
-			OFFLOAD_ABORT4res opoffload_abort;
+			OFFLOAD_CANCEL4res opoffload_cancel;
 			OFFLOAD_STATUS4res opoffload_status;
 			WRITE_SAME4res opwrite_plus;
 			ALLOCATE4res opallocate;
@@ -3262,6 +3287,7 @@ extern "C" {
 			IO_ADVISE4res opio_advise;
 			LAYOUTERROR4res oplayouterror;
 			LAYOUTSTATS4res oplayoutstats;
+			CLONE4res opclone;
 
 			/* NFSv4.3 */
 			GETXATTR4res opgetxattr;
@@ -3606,6 +3632,27 @@ extern "C" {
 	};
 	typedef struct CB_NOTIFY_DEVICEID4res CB_NOTIFY_DEVICEID4res;
 
+	struct offload_info4 {
+		nfsstat4 coa_status;
+		union {
+			write_response4 coa_resok4;
+			length4 coa_bytes_copied;
+		} offload_info4_u;
+	};
+	typedef struct offload_info4 offload_info4;
+
+	struct CB_OFFLOAD4args {
+		nfs_fh4 coa_fh;
+		stateid4 coa_stateid;
+		offload_info4 coa_offload_info;
+	};
+	typedef struct CB_OFFLOAD4args CB_OFFLOAD4args;
+
+	struct CB_OFFLOAD4res {
+		nfsstat4 cor_status;
+	};
+	typedef struct CB_OFFLOAD4res CB_OFFLOAD4res;
+
 /* Callback operations new to NFSv4.1 */
 
 	enum nfs_cb_opnum4 {
@@ -3621,6 +3668,7 @@ extern "C" {
 		NFS4_OP_CB_WANTS_CANCELLED = 12,
 		NFS4_OP_CB_NOTIFY_LOCK = 13,
 		NFS4_OP_CB_NOTIFY_DEVICEID = 14,
+		NFS4_OP_CB_OFFLOAD = 15,
 		NFS4_OP_CB_ILLEGAL = 10044,
 	};
 	typedef enum nfs_cb_opnum4 nfs_cb_opnum4;
@@ -3640,6 +3688,7 @@ extern "C" {
 			CB_WANTS_CANCELLED4args opcbwants_cancelled;
 			CB_NOTIFY_LOCK4args opcbnotify_lock;
 			CB_NOTIFY_DEVICEID4args opcbnotify_deviceid;
+			CB_OFFLOAD4args opcboffload;
 		} nfs_cb_argop4_u;
 	};
 	typedef struct nfs_cb_argop4 nfs_cb_argop4;
@@ -3659,6 +3708,7 @@ extern "C" {
 			CB_WANTS_CANCELLED4res opcbwants_cancelled;
 			CB_NOTIFY_LOCK4res opcbnotify_lock;
 			CB_NOTIFY_DEVICEID4res opcbnotify_deviceid;
+			CB_OFFLOAD4res opcboffload;
 			CB_ILLEGAL4res opcbillegal;
 		} nfs_cb_resop4_u;
 	};
@@ -6386,7 +6436,7 @@ extern "C" {
 	{
 		if (!inline_xdr_bool(xdrs, &objp->eof))
 			return false;
-		if (!inline_xdr_bytes
+		if (!xdr_iobuf_payload
 		    (xdrs, (char **)&objp->data.data_val,
 		     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
 			return false;
@@ -6764,16 +6814,30 @@ extern "C" {
 
 	static inline bool xdr_WRITE4args(XDR * xdrs, WRITE4args *objp)
 	{
+		struct nfs_request_lookahead *lkhd = NULL;
+		u_int maxlen = XDR_BYTES_MAXLEN_IO;
+
+		/* All the WRITEs of a request share one payload budget,
+		 * so a compound cannot make the decoder allocate more
+		 * than a single maximal WRITE would.
+		 */
+		if (xdrs->x_op == XDR_DECODE)
+			lkhd = xdrs->x_public;
+		if (lkhd != NULL)
+			maxlen -= lkhd->payload;
+
 		if (!xdr_stateid4(xdrs, &objp->stateid))
 			return false;
 		if (!xdr_offset4(xdrs, &objp->offset))
 			return false;
 		if (!xdr_stable_how4(xdrs, &objp->stable))
 			return false;
-		if (!inline_xdr_bytes
+		if (!xdr_iobuf_bytes
 		    (xdrs, (char **)&objp->data.data_val,
-		     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
+		     &objp->data.data_len, maxlen))
 			return false;
+		if (lkhd != NULL)
+			lkhd->payload += objp->data.data_len;
 		return true;
 	}
 
@@ -7977,7 +8041,7 @@ extern "C" {
 			if (!xdr_offset4(xdrs,
 					&objp->rpr_contents.data.d_offset))
 				return false;
-			if (!inline_xdr_bytes
+			if (!xdr_iobuf_payload
 			    (xdrs,
 			     (char **)&objp->rpr_contents.data.d_data.data_val,
 			     &objp->rpr_contents.data.d_data.data_len,
@@ -8213,6 +8277,206 @@ extern "C" {
 		return true;
 	}
 
+	static inline bool xdr_netloc_type4(XDR * xdrs, netloc_type4 *objp)
+	{
+		if (!inline_xdr_enum(xdrs, (enum_t *) objp))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_netloc4(XDR * xdrs, netloc4 *objp)
+	{
+		if (!xdr_netloc_type4(xdrs, &objp->nl_type))
+			return false;
+		switch (objp->nl_type) {
+		case NL4_NAME:
+			if (!xdr_utf8str_cis(xdrs, &objp->netloc4_u.nl_name))
+				return false;
+			break;
+		case NL4_URL:
+			if (!xdr_utf8str_cis(xdrs, &objp->netloc4_u.nl_url))
+				return false;
+			break;
+		case NL4_NETADDR:
+			if (!xdr_netaddr4(xdrs, &objp->netloc4_u.nl_addr))
+				return false;
+			break;
+		default:
+			return false;
+		}
+		return true;
+	}
+
+	static inline bool xdr_copy_requirements4(XDR * xdrs,
+						  copy_requirements4 *objp)
+	{
+		if (!inline_xdr_bool(xdrs, &objp->cr_consecutive))
+			return false;
+		if (!inline_xdr_bool(xdrs, &objp->cr_synchronous))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_COPY4args(XDR * xdrs, COPY4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->ca_src_stateid))
+			return false;
+		if (!xdr_stateid4(xdrs, &objp->ca_dst_stateid))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->ca_src_offset))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->ca_dst_offset))
+			return false;
+		if (!xdr_length4(xdrs, &objp->ca_count))
+			return false;
+		if (!inline_xdr_bool(xdrs, &objp->ca_consecutive))
+			return false;
+		if (!inline_xdr_bool(xdrs, &objp->ca_synchronous))
+			return false;
+		if (!xdr_array(xdrs,
+			(char **)&objp->ca_source_server.ca_source_server_val,
+			&objp->ca_source_server.ca_source_server_len,
+			XDR_ARRAY_MAXLEN, sizeof(netloc4),
+			(xdrproc_t) xdr_netloc4))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_COPY4res(XDR * xdrs, COPY4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->cr_status))
+			return false;
+		switch (objp->cr_status) {
+		case NFS4_OK:
+			if (!xdr_WRITE_SAME4resok(xdrs,
+				&objp->COPY4res_u.cr_resok4.cr_response))
+				return false;
+			if (!xdr_copy_requirements4(xdrs,
+				&objp->COPY4res_u.cr_resok4.cr_requirements))
+				return false;
+			break;
+		case NFS4ERR_OFFLOAD_NO_REQS:
+			if (!xdr_copy_requirements4(xdrs,
+				&objp->COPY4res_u.cr_requirements))
+				return false;
+			break;
+		default:
+			break;
+		}
+		return true;
+	}
+
+	static inline bool xdr_COPY_NOTIFY4args(XDR * xdrs,
+						COPY_NOTIFY4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->cna_src_stateid))
+			return false;
+		if (!xdr_netloc4(xdrs, &objp->cna_destination_server))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_COPY_NOTIFY4res(XDR * xdrs,
+					       COPY_NOTIFY4res *objp)
+	{
+		COPY_NOTIFY4resok *resok = &objp->COPY_NOTIFY4res_u.resok4;
+
+		if (!xdr_nfsstat4(xdrs, &objp->cnr_status))
+			return false;
+		switch (objp->cnr_status) {
+		case NFS4_OK:
+			if (!xdr_nfstime4(xdrs, &resok->cnr_lease_time))
+				return false;
+			if (!xdr_stateid4(xdrs, &resok->cnr_stateid))
+				return false;
+			if (!xdr_array(xdrs,
+			    (char **)&resok->cnr_source_server
+						.cnr_source_server_val,
+			    &resok->cnr_source_server.cnr_source_server_len,
+			    XDR_ARRAY_MAXLEN, sizeof(netloc4),
+			    (xdrproc_t) xdr_netloc4))
+				return false;
+			break;
+		default:
+			break;
+		}
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_CANCEL4args(XDR * xdrs,
+						   OFFLOAD_CANCEL4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->oca_stateid))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_CANCEL4res(XDR * xdrs,
+						  OFFLOAD_CANCEL4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->ocr_status))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_STATUS4args(XDR * xdrs,
+						   OFFLOAD_STATUS4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->osa_stateid))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_STATUS4res(XDR * xdrs,
+						  OFFLOAD_STATUS4res *objp)
+	{
+		OFFLOAD_STATUS4resok *resok =
+					&objp->OFFLOAD_STATUS4res_u.osr_resok4;
+
+		if (!xdr_nfsstat4(xdrs, &objp->osr_status))
+			return false;
+		switch (objp->osr_status) {
+		case NFS4_OK:
+			if (!xdr_length4(xdrs, &resok->osr_count))
+				return false;
+			if (!inline_xdr_u_int(xdrs,
+				&resok->osr_complete.osr_complete_len))
+				return false;
+			if (resok->osr_complete.osr_complete_len > 1)
+				return false;
+			if (resok->osr_complete.osr_complete_len == 1 &&
+			    !xdr_nfsstat4(xdrs,
+				&resok->osr_complete.osr_complete_val[0]))
+				return false;
+			break;
+		default:
+			break;
+		}
+		return true;
+	}
+
+	static inline bool xdr_CLONE4args(XDR * xdrs, CLONE4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->cl_src_stateid))
+			return false;
+		if (!xdr_stateid4(xdrs, &objp->cl_dst_stateid))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->cl_src_offset))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->cl_dst_offset))
+			return false;
+		if (!xdr_length4(xdrs, &objp->cl_count))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_CLONE4res(XDR * xdrs, CLONE4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->cl_status))
+			return false;
+		return true;
+	}
+
 /* new operations for NFSv4.1 */
 
 	static inline bool xdr_nfs_opnum4(XDR * xdrs, nfs_opnum4 *objp)
@@ -8558,10 +8822,29 @@ extern "C" {
 			break;
 
 		case NFS4_OP_COPY:
+			if (!xdr_COPY4args(xdrs,
+					&objp->nfs_argop4_u.opcopy))
+				return false;
+			break;
 		case NFS4_OP_COPY_NOTIFY:
+			if (!xdr_COPY_NOTIFY4args(xdrs,
+					&objp->nfs_argop4_u.opcopy_notify))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_CANCEL:
+			if (!xdr_OFFLOAD_CANCEL4args(xdrs,
+					&objp->nfs_argop4_u.opoffload_cancel))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_STATUS:
+			if (!xdr_OFFLOAD_STATUS4args(xdrs,
+					&objp->nfs_argop4_u.opoffload_status))
+				return false;
+			break;
 		case NFS4_OP_CLONE:
+			if (!xdr_CLONE4args(xdrs,
+					&objp->nfs_argop4_u.opclone))
+				return false;
 			break;
 
 		/* NFSv4.3 */
@@ -8908,10 +9191,29 @@ extern "C" {
 			break;
 
 		case NFS4_OP_COPY:
+			if (!xdr_COPY4res(xdrs, &objp->nfs_resop4_u.opcopy))
+				return false;
+			break;
 		case NFS4_OP_COPY_NOTIFY:
+			if (!xdr_COPY_NOTIFY4res(xdrs,
+					&objp->nfs_resop4_u.opcopy_notify))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_CANCEL:
+			if (!xdr_OFFLOAD_CANCEL4res(xdrs,
+					&objp->nfs_resop4_u.opoffload_cancel))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_STATUS:
+			if (!xdr_OFFLOAD_STATUS4res(xdrs,
+					&objp->nfs_resop4_u.opoffload_status))
+				return false;
+			break;
 		case NFS4_OP_CLONE:
+			if (!xdr_CLONE4res(xdrs,
+					&objp->nfs_resop4_u.opclone))
+				return false;
+			break;
 
 		/* NFSv4.3 */
 		case NFS4_OP_GETXATTR:
@@ -8948,6 +9250,8 @@ extern "C" {
 
 	static inline bool xdr_COMPOUND4args(XDR * xdrs, COMPOUND4args *objp)
 	{
+		u_int i;
+
 		if (!xdr_utf8str_cs(xdrs, &objp->tag))
 			return false;
 		if (!inline_xdr_u_int32_t(xdrs, &objp->minorversion))
@@ -8955,11 +9259,36 @@ extern "C" {
 		/* decoder hint */
 		if (objp->minorversion > 0)
 			xdrs->x_flags &= ~XDR_FLAG_CKSUM;
-		if (!xdr_array
-		    (xdrs, (char **)&objp->argarray.argarray_val,
-		     &objp->argarray.argarray_len, XDR_ARRAY_MAXLEN,
-		     sizeof(nfs_argop4), (xdrproc_t) xdr_nfs_argop4))
-			return false;
+		if (xdrs->x_op != XDR_DECODE)
+			return xdr_array
+			    (xdrs, (char **)&objp->argarray.argarray_val,
+			     &objp->argarray.argarray_len, XDR_ARRAY_MAXLEN,
+			     sizeof(nfs_argop4), (xdrproc_t) xdr_nfs_argop4);
+
+		/* Decode the operations one at a time and stop at the
+		 * first malformed one.  A compound with more operations
+		 * than nfs4_Compound accepts keeps only its count, it is
+		 * refused from that alone, so its operations are never
+		 * allocated nor decoded.
+		 */
+		if (!inline_xdr_u_int(xdrs, &objp->argarray.argarray_len))
+			return false;
+		if (objp->argarray.argarray_len == 0 ||
+		    objp->argarray.argarray_len > NFS4_MAX_COMPOUND_OPS)
+			return true;
+
+		objp->argarray.argarray_val =
+		    mem_zalloc(objp->argarray.argarray_len *
+			       sizeof(nfs_argop4));
+
+		for (i = 0; i < objp->argarray.argarray_len; i++) {
+			if (!xdr_nfs_argop4(xdrs,
+					    &objp->argarray.argarray_val[i])) {
+				/* Only what was decoded is freed */
+				objp->argarray.argarray_len = i + 1;
+				return false;
+			}
+		}
 		return true;
 	}
 
@@ -9720,6 +10049,44 @@ extern "C" {
 		return true;
 	}
 
+	static inline bool xdr_offload_info4(XDR * xdrs, offload_info4 *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->coa_status))
+			return false;
+		switch (objp->coa_status) {
+		case NFS4_OK:
+			if (!xdr_WRITE_SAME4resok(xdrs,
+				&objp->offload_info4_u.coa_resok4))
+				return false;
+			break;
+		default:
+			if (!xdr_length4(xdrs,
+				&objp->offload_info4_u.coa_bytes_copied))
+				return false;
+			break;
+		}
+		return true;
+	}
+
+	static inline bool xdr_CB_OFFLOAD4args(XDR * xdrs,
+					       CB_OFFLOAD4args *objp)
+	{
+		if (!xdr_nfs_fh4(xdrs, &objp->coa_fh))
+			return false;
+		if (!xdr_stateid4(xdrs, &objp->coa_stateid))
+			return false;
+		if (!xdr_offload_info4(xdrs, &objp->coa_offload_info))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_CB_OFFLOAD4res(XDR * xdrs, CB_OFFLOAD4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->cor_status))
+			return false;
+		return true;
+	}
+
 /* Callback operations new to NFSv4.1 */
 
 	static inline bool xdr_nfs_cb_opnum4(XDR * xdrs, nfs_cb_opnum4 *objp)
@@ -9795,6 +10162,11 @@ extern "C" {
 			    (xdrs, &objp->nfs_cb_argop4_u.opcbnotify_deviceid))
 				return false;
 			break;
+		case NFS4_OP_CB_OFFLOAD:
+			if (!xdr_CB_OFFLOAD4args
+			    (xdrs, &objp->nfs_cb_argop4_u.opcboffload))
+				return false;
+			break;
 		case NFS4_OP_CB_ILLEGAL:
 			break;
 		default:
@@ -9869,6 +10241,11 @@ extern "C" {
 			    (xdrs, &objp->nfs_cb_resop4_u.opcbnotify_deviceid))
 				return false;
 			break;
+		case NFS4_OP_CB_OFFLOAD:
+			if (!xdr_CB_OFFLOAD4res
+			    (xdrs, &objp->nfs_cb_resop4_u.opcboffload))
+				return false;
+			break;
 		case NFS4_OP_CB_ILLEGAL:
 			if (!xdr_CB_ILLEGAL4res
 			    (xdrs, &objp->nfs_cb_resop4_u.opcbillegal))
@@ -66,6 +66,12 @@ extern "C" {
 	};
 	typedef struct notify notify;
 
+/* Values of ssc_monitored */
+#define NSM_UNMONITORED 0
+#define NSM_MONITORED 1
+#define NSM_MONITORING 2	/* SM_MON queued */
+
+	extern int nsm_async_init(void);
 	extern bool nsm_monitor(state_nsm_client_t *host);
 	extern bool nsm_unmonitor(state_nsm_client_t *host);
 	extern void nsm_unmonitor_all(void);
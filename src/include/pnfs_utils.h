@@ -225,6 +225,27 @@ nfsstat4 FSAL_encode_file_layout(XDR *xdrs,
 nfsstat4 FSAL_encode_v4_multipath(XDR *xdrs, const uint32_t num_hosts,
 				  const fsal_multipath_member_t *hosts);
 
+/**
+ * A data server of a flex files layout, see FSAL_encode_flex_file_layout.
+ */
+
+struct fsal_ff_ds {
+	struct pnfs_deviceid deviceid;	/*< Device of the data server */
+	uint16_t ds_id;			/*< Server ID for the DS handle */
+	struct gsh_buffdesc fh;		/*< FSAL specific DS handle */
+};
+
+nfsstat4 FSAL_encode_flex_file_layout(XDR *xdrs, const length4 stripe_unit,
+				      const uint32_t num_mirrors,
+				      const uint32_t stripes,
+				      const struct fsal_ff_ds *ds,
+				      const uid_t uid, const gid_t gid);
+
+nfsstat4 FSAL_encode_flex_file_device(XDR *xdrs, const uint32_t num_hosts,
+				      const fsal_multipath_member_t *hosts,
+				      const uint32_t rsize,
+				      const uint32_t wsize);
+
 nfsstat4 posix2nfs4_error(int posix_errorcode);
 
 /*
@@ -244,6 +265,10 @@ static inline void pnfs_ds_get_ref(struct fsal_pnfs_ds *pds)
 
 void pnfs_ds_put(struct fsal_pnfs_ds *pds);
 void pnfs_ds_remove(uint16_t id_servers, bool final);
+nfsstat4 pnfs_ds_make_handle(struct fsal_pnfs_ds *pds,
+			     const struct gsh_buffdesc *desc, int flags,
+			     struct fsal_ds_handle **handle);
+void pnfs_ds_flush_handles(struct fsal_pnfs_ds *pds);
 
 int ReadDataServers(config_file_t in_config,
 		    struct config_error_type *err_type);
@@ -46,6 +46,7 @@
 
 #include "abstract_atomic.h"
 #include "abstract_mem.h"
+#include "avltree.h"
 #include "hashtable.h"
 #include "fsal_pnfs.h"
 #include "config_parsing.h"
@@ -100,6 +101,7 @@ typedef struct state_t			state_t;
 #define STATE_LOCK_OFFSET_EOF 0xFFFFFFFFFFFFFFFFLL
 
 extern struct fridgethr *state_async_fridge;
+extern struct fridgethr *state_close_fridge;
 
 /*****************************************************************************
  *
@@ -115,14 +117,6 @@ extern pool_t *nfs41_session_pool;
 
 extern hash_table_t *ht_session_id;
 
-/**
- * @brief Number of forechannel slots in a session
- *
- * This is also the maximum number of backchannel slots we'll use,
- * even if the client offers more.
- */
-#define NFS41_NB_SLOTS 3
-
 /**
  * @brief Members in the slot table
  */
@@ -134,6 +128,10 @@ typedef struct nfs41_session_slot__ {
 							   cached RPC result in
 							   a session's slot */
 	unsigned int cache_used;	/*< If we cached the result */
+	char *reply_xdr;	/*< Encoded reply, with Slot_Reply_Encoded */
+	uint32_t reply_len;	/*< Length of reply_xdr */
+	nfsstat4 reply_status;	/*< Status of the last reply */
+	bool reply_pending;	/*< Request in progress on this slot */
 } nfs41_session_slot_t;
 
 /**
@@ -153,6 +151,11 @@ enum {
 	session_bc_fault = 0x02, /* not actually used anywhere */
 };
 
+/**
+ * Connections a session's back channel may fail over to
+ */
+#define NFS41_MAX_BACK_CONNS 8
+
 /**
  * @brief Structure representing an NFSv4.1 session
  */
@@ -170,13 +173,24 @@ struct nfs41_session {
 	SVCXPRT *xprt;		/*< Referenced pointer to transport */
 
 	channel_attrs4 fore_channel_attrs;	/*< Fore-channel attributes */
-	nfs41_session_slot_t slots[NFS41_NB_SLOTS];	/*< Slot table */
+	nfs41_session_slot_t *slots;	/*< Slot table, nb_slots long.  Never
+					   reallocated since replies are
+					   cached through pointers into it */
+	uint32_t nb_slots;	/*< Number of forechannel slots */
 
 	channel_attrs4 back_channel_attrs;	/*< Back-channel attributes */
-	nfs41_cb_session_slot_t cb_slots[NFS41_NB_SLOTS];	/*< Callback
-								   Slot table */
+	nfs41_cb_session_slot_t *cb_slots;	/*< Callback slot table,
+						   nb_cb_slots long */
+	uint32_t nb_cb_slots;	/*< Number of backchannel slots */
 	uint32_t cb_program;	/*< Callback program ID */
 	struct rpc_call_channel cb_chan;	/*< Back channel */
+	SVCXPRT *back_xprts[NFS41_MAX_BACK_CONNS];	/*< Referenced
+							   connections bound
+							   to the back
+							   channel, the one
+							   in use first */
+	uint32_t nb_back_xprts;	/*< Number of back_xprts, protected by
+				   the cb_chan mutex */
 	pthread_mutex_t cb_mutex;	/*< Protects the cb slot table,
 					   when searching for a free slot */
 	pthread_cond_t cb_cond;	/*< Condition variable on which we
@@ -216,6 +230,7 @@ typedef struct rdel_fh {
 typedef struct clid_entry {
 	struct glist_head cl_list;	/*< Link in the list */
 	struct glist_head cl_rfh_list;
+	bool cl_reclaim_complete;	/*< Sent a global RECLAIM_COMPLETE */
 	char cl_name[PATH_MAX];	/*< Client name */
 } clid_entry_t;
 
@@ -228,8 +243,6 @@ extern char v4_recov_dir[PATH_MAX];
  *
  *****************************************************************************/
 
-extern hash_table_t *ht_state_id;
-
 #include "sal_shared.h"
 
 /**
@@ -315,6 +328,8 @@ struct state_deleg {
 	time_t sd_grant_time;               /* time of successful delegation */
 	enum deleg_state sd_state;
 	struct cf_deleg_stats sd_clfile_stats;  /* client specific */
+	uint32_t sd_notify;	/* notify_type4 bits a directory delegation
+				   is notified of rather than recalled */
 };
 
 /**
@@ -323,6 +338,9 @@ struct state_deleg {
 
 struct state_layout {
 	struct glist_head state_segments;	/*< List of segments */
+	struct avltree state_segment_tree;	/*< Segments by offset, see
+						   state_layout.c */
+	uint32_t state_segment_count;	/*< Segments on state_segments */
 	layouttype4 state_layout_type;	/*< The type of layout this state
 					   represents */
 	uint32_t granting;	/*< Number of LAYOUTGETs in progress */
@@ -330,6 +348,19 @@ struct state_layout {
 					   returned on last close. */
 };
 
+/**
+ * @brief Access pattern of the READs through a state or of a file
+ *
+ * Updated without a lock, see state_read_pattern().
+ */
+struct state_read_pattern {
+	uint64_t next_offset;	/*< Where the last READ ended */
+	uint64_t ra_end;	/*< End of the range last advised WILLNEED */
+	int32_t run;		/*< Sequential READs in a row if positive,
+				    non-sequential ones if negative */
+	uint32_t advised;	/*< IO_ADVISE4 pattern the FSAL was given */
+};
+
 /**
  * @brief Type specific state data
  */
@@ -351,6 +382,15 @@ union state_data {
  */
 #define OTHERSIZE 12
 
+/**
+ * @brief Layout of the stateid index in the last 4 bytes of the other
+ *
+ * The first 8 bytes are the clientid.  The index holds a stateid table
+ * slot in its low bits and the slot's generation above them.
+ */
+#define STATEID_SLOT_BITS 24
+#define STATEID_SLOT_MASK ((1U << STATEID_SLOT_BITS) - 1)
+
 extern char all_zero[OTHERSIZE];
 extern char all_ones[OTHERSIZE];
 
@@ -378,6 +418,8 @@ struct state_t {
 	struct fsal_obj_handle *state_obj; /**< owning object */
 	struct fsal_export *state_exp;  /**< FSAL export */
 	union state_data state_data;
+	/** READs through this state.  See state_read_pattern() */
+	struct state_read_pattern state_read_pattern;
 	enum state_type state_type;
 	u_int32_t state_seqid;		/**< The NFSv4 Sequence id */
 	int32_t state_refcount;		/**< Refcount for state_t objects */
@@ -477,7 +519,7 @@ typedef struct state_nsm_client_t {
 	int32_t ssc_refcount;	/*< Reference count to protect
 				   structure */
 	int32_t ssc_monitored;	/*< If this client is actively
-				   monitored */
+				   monitored, NSM_MONITORED etc. */
 	int32_t ssc_nlm_caller_name_len;	/*< Length of identifier */
 	char *ssc_nlm_caller_name;	/*< Client identifier */
 } state_nsm_client_t;
@@ -497,6 +539,9 @@ struct state_nlm_client_t {
 	char *slc_nlm_caller_name;	/*< Client name */
 	CLIENT *slc_callback_clnt;	/*< Callback for blocking locks */
 	AUTH *slc_callback_auth;	/*< Authentication for callback */
+	pthread_mutex_t slc_async_mutex;	/*< Protects the two below */
+	struct glist_head slc_async_queue;	/*< Callbacks to send */
+	bool slc_async_sending;	/*< A thread is sending the queue */
 };
 
 /**
@@ -653,7 +698,7 @@ struct nfs_client_id_t {
 	clientid4 cid_clientid;	/*< The clientid */
 	verifier4 cid_verifier;	/*< Known verifier */
 	verifier4 cid_incoming_verifier; /*< Most recently supplied verifier */
-	time_t cid_last_renew;	/*< Time of last renewal */
+	time_t cid_last_renew;	/*< Time of last renewal, atomic */
 	nfs_clientid_confirm_state_t cid_confirmed; /*< Confirm/expire state */
 	nfs_client_cred_t cid_credential;	/*< Client credential */
 	int cid_allow_reclaim;	/*< Whether this client can still
@@ -665,6 +710,14 @@ struct nfs_client_id_t {
 	struct glist_head cid_openowners;	/*< All open owners */
 	struct glist_head cid_lockowners;	/*< All lock owners */
 	pthread_mutex_t cid_mutex;	/*< Mutex for this client */
+	pthread_mutex_t cid_cb_batch_mtx;	/*< Protects cid_cb_batch and
+						   cid_cb_batch_queued */
+	struct glist_head cid_cb_batch;	/*< Callback operations waiting to
+					   be sent, see nfs_rpc_cb_batch */
+	bool cid_cb_batch_queued;	/*< A flush of cid_cb_batch is
+					   scheduled and holds a reference */
+	struct glist_head cid_copies;	/*< Asynchronous COPYs not yet
+					   reported, under cid_mutex */
 	union {
 		struct {
 			/** Callback channel */
@@ -678,6 +731,13 @@ struct nfs_client_id_t {
 			/** Callback program */
 			uint32_t cb_program;
 			bool cb_chan_down;    /* Callback channel state */
+			/** No connect is tried before this, atomic */
+			time_t cb_retry_time;
+			/** Seconds the next failed probe backs off */
+			uint32_t cb_backoff;
+			/** Bumped by each new probe so that the retries
+			    of older ones stop, under cid_mutex */
+			uint32_t cb_probe_gen;
 		} v40;		/*< v4.0 callback information */
 		struct {
 			bool cid_reclaim_complete; /*< reclaim complete
@@ -695,13 +755,22 @@ struct nfs_client_id_t {
 						   creation. */
 	state_owner_t cid_owner;	/*< Owner for per-client state */
 	int32_t cid_refcount;	/*< Reference count for lifecycle */
-	int cid_lease_reservations;	/*< Counted lease reservations, to spare
-					   this clientid from the reaper */
+	int32_t cid_lease_reservations;	/*< Counted lease reservations, to
+					   spare this clientid from the
+					   reaper, atomic */
+	struct glist_head cid_lease_link;	/*< Lease wheel slot linkage */
+	bool cid_lease_queued;	/*< The lease wheel holds a reference, set
+				   and cleared under cid_mutex and the
+				   wheel mutex */
 	uint32_t cid_minorversion;
-	uint32_t cid_stateid_counter;
+	int32_t cid_open_owners;	/*< Open owners, atomic */
+	int32_t cid_lock_owners;	/*< Lock owners, atomic */
+	int32_t cid_states;	/*< States in the stateid table, atomic */
 
 	uint32_t curr_deleg_grants; /* current num of delegations owned by
 				       this client */
+	int32_t cid_deleg_score;	/* adaptive saving minus cost, atomic */
+	time_t cid_deleg_score_time;	/* last update of cid_deleg_score */
 	uint32_t num_revokes;       /* Num revokes for the client */
 	struct gsh_client *gsh_client; /* for client specific statistics. */
 };
@@ -819,11 +888,15 @@ struct state_block_data_t {
 
 struct state_lock_entry_t {
 	struct glist_head sle_list;	/*< Locks on this file */
+	struct avltree_node sle_tree;	/*< Node in the file's lock index */
+	uint64_t sle_max_end;	/*< Last byte locked in this sle_tree subtree */
+	bool sle_indexed;	/*< On the file's lock_list and lock index */
 	struct glist_head sle_owner_locks; /*< Link on the owner lock list */
 	struct glist_head sle_client_locks;	/*< Locks on this client */
 	struct glist_head sle_state_locks;	/*< Locks on this state */
 #ifdef DEBUG_SAL
 	struct glist_head sle_all_locks; /*< Link on the global lock list */
+	uint32_t sle_all_locks_shard;	/*< Which global lock list */
 #endif				/* DEBUG_SAL */
 	struct glist_head sle_export_locks;	/*< Link on the export
 						   lock list */
@@ -872,6 +945,8 @@ struct file_deleg_stats {
 	uint32_t fds_num_opens;         /* total num of opens so far. */
 	time_t fds_first_open;          /* time that we started recording
 					   num_opens */
+	int32_t fds_deleg_score;        /* adaptive saving minus cost */
+	time_t fds_score_time;          /* last update of fds_deleg_score */
 };
 
 /**
@@ -888,6 +963,18 @@ struct state_file {
 	struct glist_head layoutrecall_list;
 	/** Pointers for lock list. Protected by state_lock */
 	struct glist_head lock_list;
+	/** Entries of lock_list ordered by start, each node also tracking
+	 *  the last byte locked under it. Protected by state_lock */
+	struct avltree lock_tree;
+	/** Export of every entry on lock_list, unless lock_mixed_exports.
+	 *  Not a reference. Protected by state_lock */
+	struct gsh_export *lock_export;
+	/** lock_list holds entries from more than one export.
+	 *  Protected by state_lock */
+	bool lock_mixed_exports;
+	/** Entries on lock_list not granted yet (blocked, being granted or
+	 *  cancelled). Protected by state_lock */
+	uint32_t lock_ungranted;
 	/** Pointers for NLM share list. Protected by state_lock */
 	struct glist_head nlm_share_list;
 	/** Share reservation state for this file. Protected by state_lock */
@@ -899,6 +986,11 @@ struct state_file {
 			      * happening at the moment which
 			      * prevents delegations from being
 			      * granted */
+	/** READs without an open state.  See state_read_pattern() */
+	struct state_read_pattern read_pattern;
+	/** Closed opens the FSAL still has open, see state_close_locked().
+	 *  Protected by state_lock */
+	struct glist_head parked_opens;
 };
 
 /**
@@ -917,6 +1009,12 @@ struct state_dir {
 	    for which this entry is a root for. This field is used
 	    with the atomic inc/dec/fetch routines. */
 	int32_t exp_root_refcount;
+	/** Directory delegations granted on this directory.
+	 * Protected by state_lock. */
+	struct glist_head dir_delegs;
+	/** Length of dir_delegs, read atomically to skip the lock
+	    when there are none. */
+	uint32_t num_dir_delegs;
 };
 
 struct state_hdl {
@@ -936,6 +1034,9 @@ struct state_hdl {
 typedef struct state_layout_segment {
 	struct glist_head sls_state_segments;	/*< Link on the per-layout-state
 						   segment list */
+	struct avltree_node sls_tree;	/*< Node in state_segment_tree */
+	uint64_t sls_max_end;	/*< Last byte of any segment in the
+				   subtree of sls_tree */
 	state_t *sls_state;	/*< Associated layout state */
 	struct pnfs_segment sls_segment;	/*< Segment descriptor */
 	void *sls_fsal_data;	/*< FSAL data */
@@ -1026,7 +1127,6 @@ typedef void (state_async_func_t) (state_async_queue_t *arg);
  */
 typedef struct state_nlm_async_data_t {
 	state_nlm_client_t *nlm_async_host;	/*< The client */
-	void *nlm_async_key;	/*< Identifying key */
 	union {
 		nfs_res_t nlm_async_res;	/*< Asynchronous response */
 		nlm4_testargs nlm_async_grant;	/*< Arguments for grant */
@@ -91,6 +91,8 @@ void state_release_export(struct gsh_export *exp);
 
 bool state_unlock_err_ok(state_status_t status);
 
+void state_lock_index_init(struct state_hdl *ostate);
+
 /**
  * @brief Initialize a state handle
  *
@@ -110,11 +112,14 @@ static inline void state_hdl_init(struct state_hdl *ostate,
 		glist_init(&ostate->file.list_of_states);
 		glist_init(&ostate->file.layoutrecall_list);
 		glist_init(&ostate->file.lock_list);
+		state_lock_index_init(ostate);
 		glist_init(&ostate->file.nlm_share_list);
+		glist_init(&ostate->file.parked_opens);
 		ostate->file.obj = obj;
 		break;
 	case DIRECTORY:
 		glist_init(&ostate->dir.export_roots);
+		glist_init(&ostate->dir.dir_delegs);
 		break;
 	default:
 		break;
@@ -260,6 +265,9 @@ const char *clientid_error_to_str(clientid_status_t err);
 
 int nfs_Init_client_id(void);
 
+void nfs4_storm_count(void);
+nsecs_elapsed_t nfs4_storm_delay(clientid4 clientid);
+
 clientid_status_t nfs_client_id_get_unconfirmed(clientid4 clientid,
 						nfs_client_id_t **pclient_rec);
 
@@ -312,6 +320,19 @@ void
 nfs41_foreach_client_callback(bool(*cb) (nfs_client_id_t *cl, void *state),
 			      void *state);
 
+/**
+ * @brief State held by the confirmed clientids of one client host
+ */
+struct nfs_client_state_counts {
+	uint32_t clientids;
+	uint32_t open_owners;
+	uint32_t lock_owners;
+	uint32_t states;
+};
+
+void nfs_client_id_state_counts(struct gsh_client *client,
+				struct nfs_client_state_counts *counts);
+
 bool client_id_has_state(nfs_client_id_t *clientid);
 
 int32_t inc_client_id_ref(nfs_client_id_t *clientid);
@@ -373,6 +394,9 @@ int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 
 int nfs41_Session_Del(char sessionid[NFS4_SESSIONID_SIZE]);
 void nfs41_Build_sessionid(clientid4 *clientid, char *sessionid);
+uint32_t nfs41_Session_Alloc_Slots(nfs41_session_t *session,
+				   count4 requested);
+slotid4 nfs41_Session_Target_Slotid(nfs41_session_t *session);
 void nfs41_Session_PrintAll(void);
 
 /******************************************************************************
@@ -459,13 +483,6 @@ struct state_t *nfs4_State_Get_Obj(struct fsal_obj_handle *obj,
 				     state_owner_t *owner);
 
 int display_state_id_val(struct gsh_buffdesc *buff, char *str);
-int display_state_id_key(struct gsh_buffdesc *buff, char *str);
-
-uint32_t state_id_value_hash_func(hash_parameter_t *hparam,
-				  struct gsh_buffdesc *key);
-
-uint64_t state_id_rbt_hash_func(hash_parameter_t *hparam,
-				struct gsh_buffdesc *key);
 
 /******************************************************************************
  *
@@ -476,6 +493,11 @@ uint64_t state_id_rbt_hash_func(hash_parameter_t *hparam,
 int reserve_lease(nfs_client_id_t *clientid);
 void update_lease(nfs_client_id_t *clientid);
 bool valid_lease(nfs_client_id_t *clientid);
+void lease_wheel_init(void);
+void lease_wheel_queue(nfs_client_id_t *clientid);
+bool lease_wheel_requeue(nfs_client_id_t *clientid);
+bool lease_wheel_cancel(nfs_client_id_t *clientid);
+nfs_client_id_t *lease_wheel_next_due(time_t now);
 
 /******************************************************************************
  *
@@ -670,6 +692,8 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 state_status_t state_cancel(struct fsal_obj_handle *obj,
 			    state_owner_t *owner, fsal_lock_param_t *lock);
 
+void state_retry_blocked_locks(struct state_hdl *ostate);
+
 state_status_t state_nlm_notify(state_nsm_client_t *nsmclient,
 				bool state_applies,
 				int32_t state);
@@ -719,6 +743,14 @@ state_status_t state_set(state_t *state);
 #define state_del_locked(s) _state_del_locked(s, __func__, __LINE__)
 void _state_del_locked(state_t *state, const char *func, int line);
 
+#define state_close_locked(s) _state_close_locked(s, __func__, __LINE__)
+void _state_close_locked(state_t *state, const char *func, int line);
+state_t *state_reuse_parked_locked(struct fsal_obj_handle *obj,
+				   state_owner_t *owner,
+				   fsal_openflags_t openflags);
+void state_flush_parked_locked(struct fsal_obj_handle *obj);
+void state_flush_closing_locked(struct fsal_obj_handle *obj);
+
 void state_del(state_t *state);
 
 static inline struct fsal_obj_handle *get_state_obj_ref(state_t *state)
@@ -862,16 +894,27 @@ void init_new_deleg_state(union state_data *deleg_state,
 
 void deleg_heuristics_recall(struct fsal_obj_handle *obj,
 			     state_owner_t *owner,
-			     struct state_t *deleg);
+			     struct state_t *deleg,
+			     bool revoked);
 void get_deleg_perm(nfsace4 *permissions, open_delegation_type4 type);
 void update_delegation_stats(struct state_hdl *ostate,
 			     state_owner_t *owner,
 			     struct state_t *deleg);
 state_status_t delegrecall_impl(struct fsal_obj_handle *obj);
+void delegrecall_state(struct fsal_obj_handle *obj, struct state_t *state);
 nfsstat4 deleg_revoke(struct fsal_obj_handle *obj, struct state_t *deleg_state);
 void state_deleg_revoke(struct fsal_obj_handle *obj, state_t *state);
 bool state_deleg_conflict(struct fsal_obj_handle *obj, bool write);
 
+/* Notifications a directory delegation can be given instead of a recall */
+#define DIR_DELEG_NOTIFY_MASK ((1U << NOTIFY4_REMOVE_ENTRY) | \
+			       (1U << NOTIFY4_ADD_ENTRY) | \
+			       (1U << NOTIFY4_RENAME_ENTRY))
+
+bool state_dir_deleg_held(struct fsal_obj_handle *dir);
+void state_dir_deleg_notify(struct fsal_obj_handle *dir, notify_type4 type,
+			    const char *name, const char *old_name);
+
 /******************************************************************************
  *
  * Layout functions
@@ -882,6 +925,14 @@ state_status_t state_add_segment(state_t *state, struct pnfs_segment *segment,
 				 void *fsal_data, bool return_on_close);
 
 state_status_t state_delete_segment(state_layout_segment_t *segment);
+void state_layout_index_init(state_t *state);
+void state_segment_unindex(state_layout_segment_t *segment);
+void state_segment_reindex(state_layout_segment_t *segment);
+state_layout_segment_t *state_layout_segment_first(state_t *state,
+					const struct pnfs_segment *range);
+state_layout_segment_t *state_layout_segment_next(
+					state_layout_segment_t *segment,
+					const struct pnfs_segment *range);
 state_status_t state_lookup_layout_state(struct fsal_obj_handle *obj,
 					 state_owner_t *owner,
 					 layouttype4 type, state_t **state);
@@ -944,6 +995,9 @@ state_status_t state_share_anonymous_io_start(struct fsal_obj_handle *obj,
 void state_share_anonymous_io_done(struct fsal_obj_handle *obj,
 				   int share_access);
 
+void state_read_pattern(struct fsal_obj_handle *obj, state_t *state,
+			uint64_t offset, uint64_t size);
+
 state_status_t state_nlm_share(struct fsal_obj_handle *obj,
 			       int share_access,
 			       int share_deny,
@@ -994,17 +1048,74 @@ void blocked_lock_polling(struct fridgethr_context *ctx);
  *
  ******************************************************************************/
 
+/**
+ * @brief A store for client recovery records
+ *
+ * read_clids is called with grace_mutex held and fills clid_list
+ * through nfs4_add_clid_entry and nfs4_add_rfh_entry.  add_clid must
+ * not return before the record is stable, the other updates may be
+ * written later.
+ */
+struct nfs4_recovery_backend {
+	const char *name;
+	/** Set up the store, returns 0 or -errno */
+	int (*recovery_init)(void);
+	/** Flush and close the store, may be NULL */
+	void (*recovery_shutdown)(void);
+	/** Load the clients allowed to reclaim, see nfs4_load_recov_clids */
+	void (*read_clids)(nfs_grace_start_t *gsp);
+	/** Grace is over, drop the records of the previous instance */
+	void (*end_grace)(void);
+	/** Record a confirmed client */
+	void (*add_clid)(nfs_client_id_t *clientid);
+	/** Remove an expired client and its revoked handles */
+	void (*rm_clid)(nfs_client_id_t *clientid);
+	/** Record a delegation revoked from a client */
+	void (*add_revoke_fh)(nfs_client_id_t *clientid, const char *rhdlstr);
+};
+
+extern struct nfs4_recovery_backend fs_recovery_backend;
+#ifdef USE_RADOS_RECOV
+extern struct nfs4_recovery_backend rados_kv_recovery_backend;
+extern struct config_block rados_kv_param_blk;
+#endif
+
 void nfs4_start_grace(nfs_grace_start_t *gsp);
 int nfs_in_grace(void);
+bool nfs_in_grace_client(nfs_client_id_t *clientid);
+
+/**
+ * @brief Check if a compound's client is held to the grace period
+ *
+ * Only NFSv4.1 compounds name their client up front, NFSv4.0 ones are
+ * always held to it.
+ */
+static inline bool nfs4_in_grace(compound_data_t *data)
+{
+	return nfs_in_grace_client(data->session != NULL ?
+				   data->session->clientid_record : NULL);
+}
+int nfs4_recovery_init(void);
+void nfs4_recovery_shutdown(void);
+void nfs4_end_grace(void);
 void nfs4_add_clid(nfs_client_id_t *);
-void nfs4_rm_clid(const char *, char *, int);
+void nfs4_rm_clid(nfs_client_id_t *);
 void nfs4_chk_clid(nfs_client_id_t *);
+void nfs4_reclaim_complete(nfs_client_id_t *);
 void nfs4_load_recov_clids(nfs_grace_start_t *gsp);
-void nfs4_clean_old_recov_dir(char *);
-void nfs4_create_recov_dir(void);
+clid_entry_t *nfs4_add_clid_entry(const char *cl_name);
+void nfs4_add_rfh_entry(clid_entry_t *clid_ent, const char *rfh);
 void nfs4_record_revoke(nfs_client_id_t *, nfs_fh4 *);
 bool nfs4_check_deleg_reclaim(nfs_client_id_t *, nfs_fh4 *);
 
+/* Hot standby, see nfs4_standby.c */
+int nfs4_standby_init(void);
+void nfs4_standby_shutdown(void);
+void nfs4_standby_add_clid(const char *name);
+void nfs4_standby_rm_clid(const char *name);
+void nfs4_standby_revoke(const char *name, const char *rhdlstr);
+void nfs4_standby_load_clids(void);
+
 
 #endif				/* SAL_FUNCTIONS_H */
 
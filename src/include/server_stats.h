@@ -47,11 +47,23 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup);
 void server_stats_9p_done(u8 msgtype, struct _9p_request_data *req9p);
 #endif
 
-void server_stats_io_done(size_t requested,
+struct fsal_obj_handle;
+
+void server_stats_pkginit(void);
+void server_stats_io_done(struct fsal_obj_handle *obj, size_t requested,
 			  size_t transferred, bool success, bool is_write);
 void server_stats_compound_done(int num_ops, int status);
 void server_stats_nfsv4_op_done(int proto_op,
-				nsecs_elapsed_t start_time, int status);
+				nsecs_elapsed_t start_time,
+				nsecs_elapsed_t cpu_start, int status);
+nsecs_elapsed_t server_stats_cpu_now(void);
+void server_stats_cpu_done(void);
+void server_stats_req_phase_done(enum nfs_req_phase phase,
+				 nsecs_elapsed_t elapsed);
+void server_stats_req_phase_sum(enum nfs_req_phase phase, uint64_t *count,
+				uint64_t *usecs);
+void server_stats_fsal_call_done(const char *fsal, enum fsal_call call,
+				 nsecs_elapsed_t elapsed);
 void server_stats_transport_done(struct gsh_client *client,
 				uint64_t rx_bytes, uint64_t rx_pkt,
 				uint64_t rx_err, uint64_t tx_bytes,
@@ -63,6 +75,7 @@ void dec_grants(struct gsh_client *client);
 void inc_revokes(struct gsh_client *client);
 void inc_recalls(struct gsh_client *client);
 void inc_failed_recalls(struct gsh_client *client);
+void inc_deleg_declines(struct gsh_client *client);
 
 #endif				/* !SERVER_STATS_H */
 /** @} */
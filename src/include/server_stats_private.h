@@ -60,8 +60,14 @@ struct nfsv41_stats;
 struct nfsv42_stats;
 struct deleg_stats;
 struct _9p_stats;
+struct lat_hists;
+struct cpu_stats;
+
+/** Copies of each export block, one per group of worker threads */
+#define GSH_STATS_SHARDS 16
 
 struct gsh_stats {
+	uint32_t shards;	/*< copies of each protocol block, 0 for 1 */
 	struct nfsv3_stats *nfsv3;
 	struct mnt_stats *mnt;
 	struct nlmv4_stats *nlm4;
@@ -71,6 +77,8 @@ struct gsh_stats {
 	struct nfsv41_stats *nfsv42;
 	struct deleg_stats *deleg;
 	struct _9p_stats *_9p;
+	struct lat_hists *hist;
+	struct cpu_stats *cpu;
 };
 
 /**
@@ -174,6 +182,13 @@ struct export_stats {
 	.direction = "out"   \
 }
 
+#define CACHE_EXPORTS_REPLY	\
+{				\
+	.name = "exports",	\
+	.type = "a(qtttttt)",	\
+	.direction = "out"	\
+}
+
 #define LAYOUTS_REPLY		\
 {				\
 	.name = "getdevinfo",	\
@@ -202,14 +217,51 @@ struct export_stats {
 }
 
 /* number of delegations, number of sent recalls,
- * number of failed recalls, number of revokes */
+ * number of failed recalls, number of revokes,
+ * number of grants declined by the adaptive policy */
 #define DELEG_REPLY		       \
 {				       \
 	.name = "delegation_stats",    \
-	.type = "(tttt)",	       \
+	.type = "(ttttt)",	       \
+	.direction = "out"	       \
+}
+
+/* number of clientids, open owners, lock owners, states */
+#define NFSV4_STATE_REPLY	       \
+{				       \
+	.name = "nfsv4_state",	       \
+	.type = "(uuuu)",	       \
 	.direction = "out"	       \
 }
 
+/* peer, requests, credit_stalls, rdma_read_reqs, rdma_write_reqs */
+#define RDMA_CONNS_REPLY_ARRAY_TYPE "(stttt)"
+#define RDMA_CONNS_REPLY			\
+{						\
+	.name = "connections",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		RDMA_CONNS_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
+#define SLABS_REPLY_ARRAY_TYPE "(stttt)"
+#define SLABS_REPLY				\
+{						\
+	.name = "slabs",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		SLABS_REPLY_ARRAY_TYPE,		\
+	.direction = "out"			\
+}
+
+#define MEM_ARENAS_REPLY_ARRAY_TYPE "(sbttt)"
+#define MEM_ARENAS_REPLY			\
+{						\
+	.name = "arenas",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		MEM_ARENAS_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
 #define NFS_ALL_IO_REPLY_ARRAY_TYPE "(qs(tttttt)(tttttt))"
 #define NFS_ALL_IO_REPLY			\
 {						\
@@ -235,22 +287,84 @@ struct export_stats {
 	.direction = "out"  \
 }
 
+/* protocol, op, (bucket upper bound in usec, count) for each
+ * non-empty bucket.  The global reply adds the request phases as
+ * protocol "RPC", and the calls into each FSAL with the FSAL's name as
+ * protocol.
+ */
+#define LAT_HIST_REPLY		\
+{				\
+	.name = "histograms",	\
+	.type = "a(ssa(tt))",	\
+	.direction = "out"	\
+}
+
+/* requests and their CPU time in nsecs, then name, count and CPU time
+ * of each NFSv4 op seen
+ */
+#define CPU_STATS_REPLY		\
+{				\
+	.name = "requests",	\
+	.type = "(tt)",		\
+	.direction = "out"	\
+},				\
+{				\
+	.name = "ops",		\
+	.type = "a(stt)",	\
+	.direction = "out"	\
+}
+
+#define HEAVY_HITTERS_MAX_ARG	\
+{				\
+	.name = "max",		\
+	.type = "u",		\
+	.direction = "in"	\
+}
+
+/* window in seconds, then kind (file, client or export), metric (ops
+ * or bytes), name, count and its possible overcount, largest first
+ */
+#define HEAVY_HITTERS_REPLY	\
+{				\
+	.name = "window",	\
+	.type = "u",		\
+	.direction = "out"	\
+},				\
+{				\
+	.name = "heavy_hitters",\
+	.type = "a(ssstt)",	\
+	.direction = "out"	\
+}
 
 void server_stats_summary(DBusMessageIter *iter, struct gsh_stats *st);
-void server_dbus_v3_iostats(struct nfsv3_stats *v3p, DBusMessageIter *iter);
-void server_dbus_v40_iostats(struct nfsv40_stats *v40p, DBusMessageIter *iter);
-void server_dbus_v41_iostats(struct nfsv41_stats *v41p, DBusMessageIter *iter);
-void server_dbus_v41_layouts(struct nfsv41_stats *v41p, DBusMessageIter *iter);
-void server_dbus_v42_iostats(struct nfsv41_stats *v42p, DBusMessageIter *iter);
-void server_dbus_v42_layouts(struct nfsv41_stats *v42p, DBusMessageIter *iter);
+void server_dbus_v3_iostats(struct gsh_stats *st, DBusMessageIter *iter);
+void server_dbus_v40_iostats(struct gsh_stats *st, DBusMessageIter *iter);
+void server_dbus_v41_iostats(struct gsh_stats *st, DBusMessageIter *iter);
+void server_dbus_v41_layouts(struct gsh_stats *st, DBusMessageIter *iter);
+void server_dbus_v42_iostats(struct gsh_stats *st, DBusMessageIter *iter);
+void server_dbus_v42_layouts(struct gsh_stats *st, DBusMessageIter *iter);
 void server_dbus_delegations(struct deleg_stats *ds, DBusMessageIter *iter);
 void server_dbus_all_iostats(struct export_stats *export_statistics,
 			     DBusMessageIter *iter);
+bool server_dbus_snapshot_clients(DBusMessageIter *iter);
+bool server_dbus_snapshot_iostats(DBusMessageIter *iter);
 void server_dbus_total_ops(struct export_stats *export_st,
 			   DBusMessageIter *iter);
 void global_dbus_total_ops(DBusMessageIter *iter);
+void server_dbus_lat_hists(struct gsh_stats *st, DBusMessageIter *iter);
+void global_dbus_lat_hists(DBusMessageIter *iter);
+void server_dbus_cpu_stats(struct gsh_stats *st, DBusMessageIter *iter);
 void server_dbus_fast_ops(DBusMessageIter *iter);
+void server_dbus_heavy_hitters(uint32_t max, DBusMessageIter *iter);
 void mdcache_dbus_show(DBusMessageIter *iter);
+void iobuf_dbus_show(DBusMessageIter *iter);
+void drc_dbus_show(DBusMessageIter *iter);
+void worker_pool_dbus_show(DBusMessageIter *iter);
+void slab_dbus_show(DBusMessageIter *iter);
+void mem_arena_dbus_show(DBusMessageIter *iter);
+#ifdef _USE_NFS_RDMA
+void rdma_dbus_show(DBusMessageIter *iter);
+#endif
 
 #ifdef _USE_9P
 void server_dbus_9p_iostats(struct _9p_stats *_9pp, DBusMessageIter *iter);
@@ -43,6 +43,7 @@
 #include <pthread.h>
 #include "gsh_rpc.h"
 #include "gsh_types.h"
+#include "gsh_list.h"
 
 /**
  * @brief Shared between idmapper.c and uid2grp_cache.c.  If you
@@ -81,5 +82,25 @@ void uid2grp_unref(struct group_data *gdata);
 void uid2grp_hold_group_data(struct group_data *);
 void uid2grp_release_group_data(struct group_data *);
 
+/**
+ * @brief A request waiting for its caller's groups
+ *
+ * Filled in by uid2grp_park(), except done, which the caller sets.
+ */
+struct uid2grp_waiter {
+	struct glist_head list;	/*< On the lookup being waited for */
+	struct uid2grp_memo **memo;	/*< Memo the result goes to */
+	void (*done)(struct uid2grp_waiter *);	/*< Called once resolved */
+	bool parked;		/*< Set while, and after, waiting */
+};
+
+extern uint32_t uid2grp_gen;
+
+void uid2grp_async_init(void);
+bool uid2grp_xprt(struct uid2grp_memo **memo, uid_t uid,
+		  struct group_data **gdata);
+bool uid2grp_park(struct uid2grp_memo **memo, uid_t uid,
+		  struct uid2grp_waiter *waiter);
+
 #endif				/* UID2GRP_H */
 /** @} */
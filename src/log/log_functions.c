@@ -42,6 +42,7 @@
 #include <libgen.h>
 #include <execinfo.h>
 #include <sys/resource.h>
+#include <sys/uio.h>
 
 #include "log.h"
 #include "gsh_list.h"
@@ -49,6 +50,7 @@
 #include "gsh_rpc.h"
 #include "common_utils.h"
 #include "abstract_mem.h"
+#include "abstract_atomic.h"
 
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
@@ -1289,6 +1291,373 @@ static int log_to_stream(log_header_t headers, void *private,
 		return 0;
 }
 
+/*
+ * Asynchronous logging
+ *
+ * With Async_Buffer_Size set in the LOG block, threads still format
+ * their messages into log_buffer, but then append them to a ring of
+ * their own instead of calling the facilities.  A writer thread drains
+ * the rings and hands the messages to the facilities, writing each file
+ * facility's share of a batch with a single writev().  When a thread's
+ * ring is full its message is dropped and counted, and the writer
+ * reports the drops.  FATAL messages and messages of the writer itself
+ * are written at once, FATAL ones after what is queued.
+ *
+ * A ring has a single producer, its thread, and a single consumer, the
+ * writer, so head and tail are only read and stored atomically.
+ */
+
+/* A message in a ring, followed by its text */
+struct log_rec {
+	uint32_t size;		/*< Of the record, a multiple of its header */
+	uint32_t len;		/*< Of the text, LOG_REC_PAD for padding */
+	uint16_t comp_off;	/*< Of the component part in the text */
+	uint16_t msg_off;	/*< Of the message part in the text */
+	log_levels_t level;
+};
+
+/* Record filling the end of the ring, the next one is at its start */
+#define LOG_REC_PAD UINT32_MAX
+
+#define LOG_REC_SIZE(len) \
+	((sizeof(struct log_rec) + (len) + sizeof(struct log_rec) - 1) & \
+	 ~(sizeof(struct log_rec) - 1))
+
+/* Smallest ring, room for a few messages of LOG_BUFF_LEN */
+#define LOG_RING_MIN (8 * LOG_BUFF_LEN)
+
+/* Messages handed to the facilities at once */
+#define LOG_BATCH 256
+
+struct log_ring {
+	struct glist_head rings;	/*< Link in log_rings */
+	uint64_t head;		/*< Where the thread appends */
+	uint64_t tail;		/*< Where the writer reads */
+	uint64_t dropped;	/*< Messages that found the ring full */
+	uint64_t reported;	/*< Of those, the ones the writer reported */
+	uint32_t dead;		/*< The thread has exited */
+	uint32_t size;		/*< Of buf, a power of 2 */
+	char *buf;
+};
+
+/* Ring size for new threads, 0 when logging synchronously */
+static uint32_t log_async_size;
+static bool log_async_started;
+static pthread_key_t log_ring_key;
+static __thread struct log_ring *log_ring;
+static __thread bool log_async_writer;
+
+/* Serializes the consumers of the rings and protects log_rings */
+static pthread_mutex_t log_async_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_async_cond = PTHREAD_COND_INITIALIZER;
+static struct glist_head log_rings = GLIST_HEAD_INIT(log_rings);
+
+static void log_ring_release(void *arg)
+{
+	struct log_ring *ring = arg;
+
+	/* The writer frees it once drained */
+	atomic_store_uint32_t(&ring->dead, 1);
+}
+
+static struct log_ring *log_ring_create(uint32_t size)
+{
+	struct log_ring *ring = gsh_calloc(1, sizeof(*ring));
+
+	ring->size = size;
+	ring->buf = gsh_malloc(size);
+
+	pthread_mutex_lock(&log_async_mtx);
+	glist_add_tail(&log_rings, &ring->rings);
+	pthread_mutex_unlock(&log_async_mtx);
+
+	(void) pthread_setspecific(log_ring_key, ring);
+	log_ring = ring;
+
+	return ring;
+}
+
+/**
+ * @brief Queue a formatted message for the writer thread
+ *
+ * @return false if the message must be written synchronously.
+ */
+static bool log_async_put(log_levels_t level, struct display_buffer *dsp,
+			  char *compstr, char *message)
+{
+	struct log_ring *ring = log_ring;
+	uint32_t len = display_buffer_len(dsp);
+	uint32_t need = LOG_REC_SIZE(len);
+	uint32_t off, pad = 0;
+	uint64_t head, tail;
+	struct log_rec *rec;
+
+	if (ring == NULL)
+		ring = log_ring_create(atomic_fetch_uint32_t(&log_async_size));
+
+	head = ring->head;
+	tail = atomic_fetch_uint64_t(&ring->tail);
+	off = head & (ring->size - 1);
+
+	/* A record doesn't wrap, pad to the end of the ring instead */
+	if (ring->size - off < need)
+		pad = ring->size - off;
+
+	if (head + pad + need - tail > ring->size) {
+		(void) atomic_inc_uint64_t(&ring->dropped);
+		return true;
+	}
+
+	if (pad != 0) {
+		rec = (struct log_rec *)(ring->buf + off);
+		rec->size = pad;
+		rec->len = LOG_REC_PAD;
+		head += pad;
+		off = 0;
+	}
+
+	rec = (struct log_rec *)(ring->buf + off);
+	rec->size = need;
+	rec->len = len;
+	rec->comp_off = compstr - dsp->b_start;
+	rec->msg_off = message - dsp->b_start;
+	rec->level = level;
+	memcpy(rec + 1, dsp->b_start, len);
+
+	atomic_store_uint64_t(&ring->head, head + need);
+
+	/* Otherwise the writer comes by on its own */
+	if (head + need - tail > ring->size / 2)
+		pthread_cond_signal(&log_async_cond);
+
+	return true;
+}
+
+/**
+ * @brief Write a batch of messages to a file facility
+ *
+ * The file is opened once for the batch, rather than once per message
+ * as log_to_file() does.
+ */
+static void log_async_writev(struct log_facility *facility,
+			     struct log_rec **recs, int n)
+{
+	struct iovec iov[2 * LOG_BATCH];
+	char *path = facility->lf_private;
+	ssize_t rc = 0;
+	int fd, i, cnt = 0;
+
+	for (i = 0; i < n; i++) {
+		if (recs[i]->level > facility->lf_max_level)
+			continue;
+		iov[cnt].iov_base = recs[i] + 1;
+		iov[cnt++].iov_len = recs[i]->len;
+		iov[cnt].iov_base = "\n";
+		iov[cnt++].iov_len = 1;
+	}
+
+	if (cnt == 0)
+		return;
+
+	fd = open(path, O_WRONLY | O_APPEND | O_CREAT, log_mask);
+	if (fd != -1) {
+		rc = writev(fd, iov, cnt);
+		(void)close(fd);
+	}
+
+	if (fd == -1 || rc < 0)
+		fprintf(stderr,
+			"Error: couldn't complete write of %d messages to the log file %s (%s)\n",
+			cnt / 2, path, strerror(errno));
+}
+
+/**
+ * @brief Hand a batch of messages to the active facilities
+ *
+ * @note The caller must hold log_rwlock for read
+ */
+static void log_async_write(struct log_rec **recs, int n)
+{
+	struct glist_head *glist;
+	struct log_facility *facility;
+	char buf[LOG_BUFF_LEN + 2];
+	struct display_buffer dsp = {sizeof(buf), buf, buf};
+	int i;
+
+	glist_for_each(glist, &active_facility_list) {
+		facility = glist_entry(glist, struct log_facility, lf_active);
+
+		if (facility->lf_func == NULL)
+			continue;
+
+		if (facility->lf_func == log_to_file) {
+			log_async_writev(facility, recs, n);
+			continue;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (recs[i]->level > facility->lf_max_level)
+				continue;
+
+			/* Facilities append a newline in the buffer */
+			memcpy(buf, recs[i] + 1, recs[i]->len);
+			buf[recs[i]->len] = '\0';
+			dsp.b_current = buf + recs[i]->len;
+			facility->lf_func(facility->lf_headers,
+					  facility->lf_private,
+					  recs[i]->level, &dsp,
+					  buf + recs[i]->comp_off,
+					  buf + recs[i]->msg_off);
+		}
+	}
+}
+
+/**
+ * @brief Write out what a ring holds
+ *
+ * @note The caller must hold log_async_mtx and log_rwlock for read
+ */
+static void log_ring_drain(struct log_ring *ring)
+{
+	struct log_rec *recs[LOG_BATCH];
+	uint64_t head = atomic_fetch_uint64_t(&ring->head);
+	uint64_t tail = ring->tail;
+	struct log_rec *rec;
+	int n = 0;
+
+	while (tail != head) {
+		rec = (struct log_rec *)(ring->buf +
+					 (tail & (ring->size - 1)));
+		tail += rec->size;
+
+		if (rec->len == LOG_REC_PAD)
+			continue;
+
+		recs[n++] = rec;
+		if (n == LOG_BATCH) {
+			log_async_write(recs, n);
+			n = 0;
+			/* Hand the space back to the thread */
+			atomic_store_uint64_t(&ring->tail, tail);
+		}
+	}
+
+	if (n != 0)
+		log_async_write(recs, n);
+
+	atomic_store_uint64_t(&ring->tail, tail);
+}
+
+/**
+ * @brief Write out all the rings
+ *
+ * @note The caller must hold log_async_mtx
+ *
+ * @return Messages dropped since the last drain.
+ */
+static uint64_t log_async_drain(void)
+{
+	struct glist_head *glist, *glistn;
+	struct log_ring *ring;
+	uint64_t dropped = 0, d;
+	bool dead;
+
+	PTHREAD_RWLOCK_rdlock(&log_rwlock);
+
+	glist_for_each_safe(glist, glistn, &log_rings) {
+		ring = glist_entry(glist, struct log_ring, rings);
+
+		/* Read before draining, a dead ring gets no more records */
+		dead = atomic_fetch_uint32_t(&ring->dead) != 0;
+
+		log_ring_drain(ring);
+
+		d = atomic_fetch_uint64_t(&ring->dropped);
+		dropped += d - ring->reported;
+		ring->reported = d;
+
+		if (dead) {
+			glist_del(&ring->rings);
+			gsh_free(ring->buf);
+			gsh_free(ring);
+		}
+	}
+
+	PTHREAD_RWLOCK_unlock(&log_rwlock);
+
+	return dropped;
+}
+
+static void *log_async_thread(void *arg)
+{
+	struct timespec ts;
+	uint64_t dropped;
+
+	SetNameFunction("log_writer");
+	log_async_writer = true;
+
+	pthread_mutex_lock(&log_async_mtx);
+	for (;;) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 50 * 1000 * 1000;
+		if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000 * 1000 * 1000;
+		}
+		(void) pthread_cond_timedwait(&log_async_cond, &log_async_mtx,
+					      &ts);
+
+		dropped = log_async_drain();
+		if (dropped != 0)
+			LogWarn(COMPONENT_LOG,
+				"Dropped %" PRIu64
+				" log messages, Async_Buffer_Size is too small",
+				dropped);
+	}
+	pthread_mutex_unlock(&log_async_mtx);
+
+	return NULL;
+}
+
+/**
+ * @brief Switch asynchronous logging on or off
+ *
+ * @param[in] size Ring size per thread, 0 to log synchronously
+ */
+static void log_async_set(uint32_t size)
+{
+	pthread_attr_t attr;
+	pthread_t thrid;
+	uint32_t ring = LOG_RING_MIN;
+
+	if (size == 0) {
+		/* Queued messages are still written */
+		atomic_store_uint32_t(&log_async_size, 0);
+		return;
+	}
+
+	while (ring < size)
+		ring <<= 1;
+
+	if (!log_async_started) {
+		if (pthread_key_create(&log_ring_key, log_ring_release) != 0 ||
+		    pthread_attr_init(&attr) != 0 ||
+		    pthread_attr_setdetachstate(&attr,
+						PTHREAD_CREATE_DETACHED) != 0 ||
+		    pthread_create(&thrid, &attr, log_async_thread,
+				   NULL) != 0) {
+			LogCrit(COMPONENT_LOG,
+				"Could not start the log writer, logging synchronously");
+			return;
+		}
+		log_async_started = true;
+	}
+
+	atomic_store_uint32_t(&log_async_size, ring);
+	LogInfo(COMPONENT_LOG, "Logging asynchronously, %u bytes per thread",
+		ring);
+}
+
 int display_timeval(struct display_buffer *dspbuf, struct timeval *tv)
 {
 	char *fmt = date_time_fmt;
@@ -1495,6 +1864,17 @@ void display_log_component_level(log_components_t component, const char *file,
 		   component, level, file, line, function, message);
 #endif
 
+	if (atomic_fetch_uint32_t(&log_async_size) != 0 && !log_async_writer) {
+		if (level != NIV_FATAL &&
+		    log_async_put(level, &dsp_log, compstr, message))
+			return;
+
+		/* Queued messages go first */
+		pthread_mutex_lock(&log_async_mtx);
+		(void) log_async_drain();
+		pthread_mutex_unlock(&log_async_mtx);
+	}
+
 	PTHREAD_RWLOCK_rdlock(&log_rwlock);
 
 	glist_for_each(glist, &active_facility_list) {
@@ -1910,6 +2290,7 @@ struct facility_config {
 
 struct logger_config {
 	log_levels_t default_level;
+	uint32_t async_buffer_size;
 	struct glist_head facility_list;
 	struct logfields *logfields;
 	log_levels_t *comp_log_level;
@@ -2507,6 +2888,7 @@ static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 		(void)facility_init(&logger->facility_list, conf);
 	}
 	if (errcnt == 0) {
+		log_async_set(logger->async_buffer_size);
 		if (logger->logfields != NULL) {
 			LogEvent(COMPONENT_CONFIG,
 				 "Changing definition of log fields");
@@ -2550,6 +2932,8 @@ static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 static struct config_item logging_params[] = {
 	CONF_ITEM_TOKEN("Default_log_level", NB_LOG_LEVEL, log_levels,
 			 logger_config, default_level),
+	CONF_ITEM_UI32("Async_Buffer_Size", 0, 64 * 1024 * 1024, 0,
+		       logger_config, async_buffer_size),
 	CONF_ITEM_BLOCK("Facility", facility_params,
 			facility_init, facility_commit,
 			logger_config, facility_list),
@@ -0,0 +1,143 @@
+#!/usr/bin/python
+#
+# Print a flight recorder dump written by ganesha.nfsd, on a fatal
+# signal or through the dump_flight_recorder DBus admin method.
+#
+# Events of all threads are printed in time order.  The format is
+# described in src/support/flight_rec.c.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 3 of the License, or (at your option) any later version.
+
+import argparse
+import struct
+import sys
+import time
+
+MAGIC = b"GSHFLTR1"
+FILE_HDR = struct.Struct("=8sII")
+RING_HDR = struct.Struct("=IIQ16s")
+EVENT = struct.Struct("=QIHHiIQ")
+
+TYPES = {
+    1: "rpc_start",
+    2: "rpc_op_start",
+    3: "rpc_op_end",
+    4: "rpc_phase",
+    5: "rpc_end",
+    6: "v4op_start",
+    7: "v4op_end",
+}
+
+PHASES = ["queue", "setup", "service", "reply"]
+
+NFS4_OPS = {
+    3: "ACCESS", 4: "CLOSE", 5: "COMMIT", 6: "CREATE",
+    7: "DELEGPURGE", 8: "DELEGRETURN", 9: "GETATTR", 10: "GETFH",
+    11: "LINK", 12: "LOCK", 13: "LOCKT", 14: "LOCKU", 15: "LOOKUP",
+    16: "LOOKUPP", 17: "NVERIFY", 18: "OPEN", 19: "OPENATTR",
+    20: "OPEN_CONFIRM", 21: "OPEN_DOWNGRADE", 22: "PUTFH",
+    23: "PUTPUBFH", 24: "PUTROOTFH", 25: "READ", 26: "READDIR",
+    27: "READLINK", 28: "REMOVE", 29: "RENAME", 30: "RENEW",
+    31: "RESTOREFH", 32: "SAVEFH", 33: "SECINFO", 34: "SETATTR",
+    35: "SETCLIENTID", 36: "SETCLIENTID_CONFIRM", 37: "VERIFY",
+    38: "WRITE", 39: "RELEASE_LOCKOWNER", 40: "BACKCHANNEL_CTL",
+    41: "BIND_CONN_TO_SESSION", 42: "EXCHANGE_ID",
+    43: "CREATE_SESSION", 44: "DESTROY_SESSION", 45: "FREE_STATEID",
+    46: "GET_DIR_DELEGATION", 47: "GETDEVICEINFO",
+    48: "GETDEVICELIST", 49: "LAYOUTCOMMIT", 50: "LAYOUTGET",
+    51: "LAYOUTRETURN", 52: "SECINFO_NO_NAME", 53: "SEQUENCE",
+    54: "SET_SSV", 55: "TEST_STATEID", 56: "WANT_DELEGATION",
+    57: "DESTROY_CLIENTID", 58: "RECLAIM_COMPLETE", 59: "ALLOCATE",
+    60: "COPY", 61: "COPY_NOTIFY", 62: "DEALLOCATE",
+    63: "IO_ADVISE", 64: "LAYOUTERROR", 65: "LAYOUTSTATS",
+    66: "OFFLOAD_CANCEL", 67: "OFFLOAD_STATUS", 68: "READ_PLUS",
+    69: "SEEK", 70: "WRITE_SAME",
+}
+
+
+def read_dump(f):
+    hdr = f.read(FILE_HDR.size)
+    if len(hdr) < FILE_HDR.size:
+        sys.exit("Truncated dump")
+    magic, event_size, nrings = FILE_HDR.unpack(hdr)
+    if magic != MAGIC:
+        sys.exit("Not a flight recorder dump")
+    if event_size != EVENT.size:
+        sys.exit("Events are %d bytes, expected %d" %
+                 (event_size, EVENT.size))
+
+    events = []
+    for _ in range(nrings):
+        hdr = f.read(RING_HDR.size)
+        if len(hdr) < RING_HDR.size:
+            break
+        tid, nevents, head, name = RING_HDR.unpack(hdr)
+        name = name.split(b"\0", 1)[0].decode("ascii", "replace")
+        buf = f.read(nevents * EVENT.size)
+        if len(buf) < nevents * EVENT.size:
+            break
+        first = head - nevents if head > nevents else 0
+        for seq in range(first, head):
+            slot = seq % nevents
+            ev = EVENT.unpack_from(buf, slot * EVENT.size)
+            events.append((ev, tid, name))
+
+    events.sort(key=lambda e: e[0][0])
+    return events
+
+
+def describe(etype, op, status, arg):
+    if etype in (1, 2, 3, 5):
+        text = "proc %d" % op
+        if etype == 1:
+            text += " prog %d vers %d" % (arg >> 32, arg & 0xffffffff)
+        elif etype == 2:
+            if arg >= 1 << 63:
+                arg -= 1 << 64
+            text += " export %d" % arg
+        elif etype == 3:
+            text += " rc %d %d ns" % (status, arg)
+        else:
+            text += " %d ns" % arg
+        return text
+    if etype == 4:
+        phase = PHASES[op] if op < len(PHASES) else str(op)
+        return "%s %d ns" % (phase, arg)
+    name = NFS4_OPS.get(op, str(op))
+    if etype == 6:
+        return "%s #%d fh %016x" % (name, status, arg)
+    return "%s status %d %d ns" % (name, status, arg)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Print a ganesha flight recorder dump")
+    parser.add_argument("dump", help="file written by ganesha.nfsd")
+    parser.add_argument("--xid", type=lambda x: int(x, 0),
+                        help="only events of this RPC xid")
+    parser.add_argument("--tid", type=int,
+                        help="only events of this thread")
+    args = parser.parse_args()
+
+    with open(args.dump, "rb") as f:
+        events = read_dump(f)
+
+    for (ts, xid, etype, op, status, _, arg), tid, name in events:
+        if etype == 0:
+            continue
+        if args.xid is not None and xid != args.xid:
+            continue
+        if args.tid is not None and tid != args.tid:
+            continue
+        stamp = time.strftime("%H:%M:%S", time.localtime(ts // 1000000000))
+        print("%s.%09d %6d %-15s xid %08x %-12s %s" %
+              (stamp, ts % 1000000000, tid, name, xid,
+               TYPES.get(etype, str(etype)),
+               describe(etype, op, status, arg)))
+
+
+if __name__ == "__main__":
+    main()
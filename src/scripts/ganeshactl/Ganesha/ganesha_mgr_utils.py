@@ -165,6 +165,16 @@ class ExportMgr():
 
         return True, "Done: "+msg
 
+    def UpdateExportBlock(self, block):
+        update_export_method = self.dbusobj.get_dbus_method("UpdateExportBlock",
+                                                            self.dbus_interface)
+        try:
+           msg = update_export_method(block)
+        except dbus.exceptions.DBusException as e:
+           return False, e
+
+        return True, "Done: "+msg
+
     def RemoveExport(self, exp_id):
         rm_export_method = self.dbusobj.get_dbus_method("RemoveExport",
                                                         self.dbus_interface)
@@ -93,6 +93,27 @@ class RetrieveExportStats():
         else:
             stats_dict[export_id] = stats_op(int(export_id))
             return PNFSStats(stats_dict)
+    # NFSv3/NFSv4 latency histograms of one export, or of the server
+    def latency_stats(self, export_id):
+        if export_id < 0:
+            stats_op = self.exportmgrobj.get_dbus_method(
+                "GetGlobalLatencyHistograms", self.dbus_exportstats_name)
+            return LatencyStats(stats_op(), "all exports")
+        stats_op = self.exportmgrobj.get_dbus_method("GetLatencyHistograms",
+                                 self.dbus_exportstats_name)
+        return LatencyStats(stats_op(int(export_id)),
+                            "export id " + str(export_id))
+    # CPU time of the requests and NFSv4 ops of one export
+    def cpu_stats(self, export_id):
+        stats_op = self.exportmgrobj.get_dbus_method("GetCPUStats",
+                                 self.dbus_exportstats_name)
+        return CPUStats(stats_op(int(export_id)),
+                        "export id " + str(export_id))
+    # top files, clients and exports by ops and by bytes
+    def heavy_hitters(self, count):
+        stats_op = self.exportmgrobj.get_dbus_method("GetHeavyHitters",
+                                 self.dbus_exportstats_name)
+        return HeavyHitters(stats_op(dbus.UInt32(count)))
 
 class RetrieveClientStats():
     def __init__(self):
@@ -114,6 +135,21 @@ class RetrieveClientStats():
         stats_op = self.clientmgrobj.get_dbus_method("GetDelegations",
                           self.dbus_clientstats_name)
         return DelegStats(stats_op(ip))
+    # NFSv4 owners and states held by a single client ip
+    def v4state_stats(self, ip):
+        stats_op = self.clientmgrobj.get_dbus_method("GetNFSv4State",
+                          self.dbus_clientstats_name)
+        return V4StateStats(stats_op(ip))
+    # NFSv3/NFSv4 latency histograms of a single client ip
+    def latency_stats(self, ip):
+        stats_op = self.clientmgrobj.get_dbus_method("GetLatencyHistograms",
+                          self.dbus_clientstats_name)
+        return LatencyStats(stats_op(ip), "client " + ip)
+    # CPU time of the requests and NFSv4 ops of a single client ip
+    def cpu_stats(self, ip):
+        stats_op = self.clientmgrobj.get_dbus_method("GetCPUStats",
+                          self.dbus_clientstats_name)
+        return CPUStats(stats_op(ip), "client " + ip)
     def list_clients(self):
         stats_op = self.clientmgrobj.get_dbus_method("ShowClients",
                           self.dbus_clientmgr_name)
@@ -146,6 +182,7 @@ class DelegStats():
             self.curr_recall = stats[3][1]
             self.fail_recall = stats[3][2]
             self.num_revokes = stats[3][3]
+            self.num_declines = stats[3][4]
     def __str__(self):
         if self.status != "OK":
             return ("GANESHA RESPONSE STATUS: " + self.status)
@@ -155,7 +192,112 @@ class DelegStats():
                      "\nCurrent Delegations: " + str(self.curr_deleg) +
                      "\nCurrent Recalls: " + str(self.curr_recall) +
                      "\nCurrent Failed Recalls: " + str(self.fail_recall) +
-                     "\nCurrent Number of Revokes: " + str(self.num_revokes) )
+                     "\nCurrent Number of Revokes: " + str(self.num_revokes) +
+                     "\nAdaptively Declined Grants: " + str(self.num_declines) )
+
+class V4StateStats():
+    def __init__(self, stats):
+        self.status = stats[1]
+        if stats[1] == "OK":
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.clientids = stats[3][0]
+            self.open_owners = stats[3][1]
+            self.lock_owners = stats[3][2]
+            self.states = stats[3][3]
+    def __str__(self):
+        if self.status != "OK":
+            return ("GANESHA RESPONSE STATUS: " + self.status)
+        else:
+            return ( "GANESHA RESPONSE STATUS: " + self.status +
+                     "\nTimestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs" +
+                     "\nClient IDs: " + str(self.clientids) +
+                     "\nOpen Owners: " + str(self.open_owners) +
+                     "\nLock Owners: " + str(self.lock_owners) +
+                     "\nStates: " + str(self.states) )
+
+class LatencyStats():
+    percentiles = (50, 90, 99, 99.9)
+    def __init__(self, stats, title):
+        self.status = stats[1]
+        self.title = title
+        if stats[1] == "OK":
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.ops = stats[3]
+    # smallest bucket bound at or above the given percentile
+    def percentile(self, buckets, total, pct):
+        seen = 0
+        for bucket in buckets:
+            seen += bucket[1]
+            if seen * 100.0 >= total * pct:
+                return bucket[0]
+        return buckets[-1][0]
+    def __str__(self):
+        if self.status != "OK":
+            return ("GANESHA RESPONSE STATUS: " + self.status)
+        output = ("Latency histograms (usec) for " + self.title +
+                  "\nTimestamp: " + time.ctime(self.timestamp[0]) +
+                  str(self.timestamp[1]) + " nsecs\n")
+        output += "%-6s %-22s %12s" % ("", "op", "count")
+        for pct in self.percentiles:
+            output += " %10s" % ("p" + str(pct))
+        for op in self.ops:
+            buckets = op[2]
+            total = sum(bucket[1] for bucket in buckets)
+            if total == 0:
+                continue
+            output += "\n%-6s %-22s %12d" % (op[0], op[1], total)
+            for pct in self.percentiles:
+                output += " %10d" % self.percentile(buckets, total, pct)
+        return output
+
+class CPUStats():
+    def __init__(self, stats, title):
+        self.status = stats[1]
+        self.title = title
+        if stats[1] == "OK":
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.requests = stats[3]
+            self.ops = stats[4]
+    def __str__(self):
+        if self.status != "OK":
+            return ("GANESHA RESPONSE STATUS: " + self.status)
+        output = ("CPU time (usec) for " + self.title +
+                  "\nTimestamp: " + time.ctime(self.timestamp[0]) +
+                  str(self.timestamp[1]) + " nsecs\n")
+        output += "%-22s %12s %14s %10s" % ("", "count", "total", "average")
+        rows = [("requests", self.requests[0], self.requests[1])]
+        rows += [(op[0], op[1], op[2]) for op in self.ops]
+        for row in rows:
+            if row[1] == 0:
+                continue
+            output += "\n%-22s %12d %14d %10d" % (row[0], row[1],
+                                                  row[2] / 1000,
+                                                  row[2] / 1000 / row[1])
+        return output
+
+class HeavyHitters():
+    def __init__(self, stats):
+        self.status = stats[1]
+        if stats[1] == "OK":
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.window = stats[3]
+            self.items = stats[4]
+    def __str__(self):
+        if self.status != "OK":
+            return ("GANESHA RESPONSE STATUS: " + self.status)
+        output = ("Heavy hitters over the last " + str(self.window) +
+                  " to " + str(2 * self.window) + " seconds" +
+                  "\nTimestamp: " + time.ctime(self.timestamp[0]) +
+                  str(self.timestamp[1]) + " nsecs")
+        current = None
+        for item in self.items:
+            if (item[0], item[1]) != current:
+                current = (item[0], item[1])
+                output += "\n\nTop %ss by %s:" % current
+                output += "\n%-40s %16s %16s" % (item[0], item[1],
+                                                  "overcount")
+            output += "\n%-40s %16d %16d" % (item[2], item[3], item[4])
+        return output
 
 class Export():
     def __init__(self, export):
@@ -225,6 +367,14 @@ class InodeStats():
         self.cache_conflict = stats[3][7]
         self.cache_add = stats[3][9]
         self.cache_mapping = stats[3][11]
+        self.cache_ghost_add = stats[3][13]
+        self.cache_ghost_hit = stats[3][15]
+        self.cache_mem_bytes = stats[3][17]
+        self.cache_readlink_hit = stats[3][19]
+        self.cache_readlink_miss = stats[3][21]
+        self.cache_xattr_hit = stats[3][23]
+        self.cache_xattr_miss = stats[3][25]
+        self.exports = stats[4]
     def __str__(self):
         if self.status != "OK":
             return "No NFS activity, GANESHA RESPONSE STATUS: " + self.status
@@ -234,7 +384,22 @@ class InodeStats():
                  "\nInode Cache Misses: " + str(self.cache_miss) +
                  "\nInode Cache Conflicts:: " + str(self.cache_conflict) +
                  "\nInode Cache Adds: " + str(self.cache_add) +
-                 "\nInode Cache Mapping: " + str(self.cache_mapping) )
+                 "\nInode Cache Mapping: " + str(self.cache_mapping) +
+                 "\nInode Cache Ghost Adds: " + str(self.cache_ghost_add) +
+                 "\nInode Cache Ghost Hits: " + str(self.cache_ghost_hit) +
+                 "\nInode Cache Memory Bytes: " + str(self.cache_mem_bytes) +
+                 "\nInode Cache Readlink Hits: " + str(self.cache_readlink_hit) +
+                 "\nInode Cache Readlink Misses: " + str(self.cache_readlink_miss) +
+                 "\nInode Cache Xattr Hits: " + str(self.cache_xattr_hit) +
+                 "\nInode Cache Xattr Misses: " + str(self.cache_xattr_miss) +
+                 "".join("\nExport " + str(exp[0]) +
+                         ": Entries: " + str(exp[1]) +
+                         ", Dirent Memory: " + str(exp[2]) +
+                         ", Hits: " + str(exp[3]) +
+                         ", Misses: " + str(exp[4]) +
+                         ", Quota Hits: " + str(exp[5]) +
+                         ", Quota Misses: " + str(exp[6])
+                         for exp in self.exports) )
 
 class FastStats():
     def __init__(self, stats):
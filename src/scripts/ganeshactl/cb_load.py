@@ -0,0 +1,100 @@
+#!/usr/bin/python3
+#
+# Callback path load test, through the callback simulator.
+#
+# Asks a server built with USE_CB_SIMULATOR to send fake CB_RECALL,
+# CB_LAYOUTRECALL and CB_NOTIFY operations to its connected clients at
+# a steady rate, and prints, every interval, how many were sent,
+# accepted, refused by the client or failed, their latency, and the
+# waits for a back channel slot.  The operations match no state, so
+# clients refuse them without giving anything back.
+#
+# ./cb_load.py -r 500 -d 60 --mix 6,3,1
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 3 of the License, or (at your option) any later version.
+
+import argparse
+import sys
+import time
+
+import dbus
+
+
+def get_cbsim():
+    bus = dbus.SystemBus()
+    cbsim = bus.get_object("org.ganesha.nfsd", "/org/ganesha/nfsd/CBSIM")
+    return dbus.Interface(cbsim, "org.ganesha.nfsd.cbsim")
+
+
+def print_stats(stats, elapsed):
+    _, running, inflight, dropped, ops, slots = stats
+    print("%.0fs: %s, %d in flight, %d dropped" %
+          (elapsed, "running" if running else "stopped", inflight,
+           dropped))
+    print("  %-16s %10s %10s %10s %10s %10s %10s %10s %10s" %
+          ("op", "sent", "ok", "refused", "failed", "avg us", "p50 us",
+           "p99 us", "max us"))
+    for (name, sent, ok, refused, failed, avg, p50, p99,
+         lat_max) in ops:
+        print("  %-16s %10d %10d %10d %10d %10.1f %10d %10d %10d" %
+              (name, sent, ok, refused, failed, avg, p50, p99, lat_max))
+    found, busy, waited, missed, wait_avg, wait_max = slots
+    print("  slots: %d free, %d busy, %d after waiting, %d timed out, "
+          "wait avg %.1f us max %d us" %
+          (found, busy, waited, missed, wait_avg, wait_max))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Load test the callback path of a ganesha server")
+    parser.add_argument("-r", "--rate", type=int, default=100,
+                        help="callbacks per second (default 100)")
+    parser.add_argument("-d", "--duration", type=int, default=30,
+                        help="seconds to run (default 30)")
+    parser.add_argument("-m", "--mix", default="1,1,1",
+                        help="weights of CB_RECALL, CB_LAYOUTRECALL and "
+                             "CB_NOTIFY (default 1,1,1)")
+    parser.add_argument("-c", "--clients", type=int, default=0,
+                        help="most clients to call (default all)")
+    parser.add_argument("-i", "--interval", type=int, default=5,
+                        help="seconds between reports (default 5)")
+    args = parser.parse_args()
+
+    try:
+        mix = [int(w) for w in args.mix.split(",")]
+    except ValueError:
+        mix = []
+    if len(mix) != 3:
+        parser.error("--mix takes three comma separated weights")
+    if args.rate <= 0 or args.duration <= 0:
+        parser.error("rate and duration must be positive")
+
+    cbsim = get_cbsim()
+    status, msg = cbsim.start_load(dbus.UInt32(args.rate),
+                                   dbus.UInt32(args.duration),
+                                   dbus.UInt32(mix[0]),
+                                   dbus.UInt32(mix[1]),
+                                   dbus.UInt32(mix[2]),
+                                   dbus.UInt32(args.clients))
+    if not status:
+        sys.exit(msg)
+
+    start = time.monotonic()
+    try:
+        while True:
+            time.sleep(args.interval)
+            stats = cbsim.get_load_stats()
+            print_stats(stats, time.monotonic() - start)
+            # Let the operations in flight complete once stopped
+            if not stats[1] and stats[2] == 0:
+                break
+    except KeyboardInterrupt:
+        cbsim.stop_load()
+        print_stats(cbsim.get_load_stats(), time.monotonic() - start)
+
+
+if __name__ == "__main__":
+    main()
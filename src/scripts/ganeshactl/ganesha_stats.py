@@ -15,8 +15,11 @@ import Ganesha.glib_dbus_stats
 def usage():
     message = "Command gives global stats by default.\n"
     message += "%s [list_clients | deleg <ip address> | " % (sys.argv[0])
+    message += "v4state <ip address> | client_latency <ip address> | "
+    message += "client_cpu <ip address> | "
     message += "inode | iov3 [export id] | iov4 [export id] | export |"
-    message += " total [export id] | fast | pnfs [export id] ]"
+    message += " total [export id] | fast | pnfs [export id] |"
+    message += " latency [export id] | cpu <export id> | top [count] ]"
     sys.exit(message)
 
 if len(sys.argv) < 2:
@@ -25,25 +28,40 @@ else:
     command = sys.argv[1]
 
 # check arguments
-commands = ('help', 'list_clients', 'deleg', 'global', 'inode', 'iov3', 'iov4',
-           'export', 'total', 'fast', 'pnfs')
+commands = ('help', 'list_clients', 'deleg', 'v4state', 'client_latency',
+           'client_cpu', 'global', 'inode', 'iov3', 'iov4', 'export',
+           'total', 'fast', 'pnfs', 'latency', 'cpu', 'top')
 if command not in commands:
     print "Option \"%s\" is not correct." % (command)
     usage()
 # requires an IP address
-elif command in ('deleg'):
+elif command in ('deleg', 'v4state', 'client_latency', 'client_cpu'):
     if not len(sys.argv) == 3:
         print "Option \"%s\" must be followed by an ip address." % (command)
         usage()
     command_arg = sys.argv[2]
 # optionally accepts an export id
-elif command in ('iov3', 'iov4', 'total', 'pnfs'):
+elif command in ('iov3', 'iov4', 'total', 'pnfs', 'latency'):
     if (len(sys.argv) == 2):
         command_arg = -1
     elif (len(sys.argv) == 3) and sys.argv[2].isdigit():
         command_arg = sys.argv[2]
     else:
         usage()
+# requires an export id
+elif command == 'cpu':
+    if (len(sys.argv) == 3) and sys.argv[2].isdigit():
+        command_arg = sys.argv[2]
+    else:
+        usage()
+# optionally accepts a count
+elif command == 'top':
+    if (len(sys.argv) == 2):
+        command_arg = 10
+    elif (len(sys.argv) == 3) and sys.argv[2].isdigit():
+        command_arg = int(sys.argv[2])
+    else:
+        usage()
 elif command == "help":
     usage()
 
@@ -62,6 +80,12 @@ elif command == "list_clients":
     print cl_interface.list_clients()
 elif command == "deleg":
     print cl_interface.deleg_stats(command_arg)
+elif command == "v4state":
+    print cl_interface.v4state_stats(command_arg)
+elif command == "client_latency":
+    print cl_interface.latency_stats(command_arg)
+elif command == "client_cpu":
+    print cl_interface.cpu_stats(command_arg)
 elif command == "iov3":
     print exp_interface.v3io_stats(command_arg)
 elif command == "iov4":
@@ -70,3 +94,9 @@ elif command == "total":
     print exp_interface.total_stats(command_arg)
 elif command == "pnfs":
     print exp_interface.pnfs_stats(command_arg)
+elif command == "latency":
+    print exp_interface.latency_stats(command_arg)
+elif command == "cpu":
+    print exp_interface.cpu_stats(command_arg)
+elif command == "top":
+    print exp_interface.heavy_hitters(command_arg)
@@ -0,0 +1,286 @@
+#!/usr/bin/python3
+#
+# Metadata and I/O performance suite, run through an NFS mount.
+#
+# Each test runs the same workload in a number of parallel worker
+# processes, and reports the operations per second of all of them and
+# the latency percentiles of a single operation.  Results are printed,
+# and written as one JSON object per line with --output.  Given a
+# baseline written by an earlier run, each test is compared with it
+# and a drop in ops/s beyond the tolerance fails the run.
+#
+# ./test_perf.py -j 8 -n 2000 --output run.json /mnt/nfs
+# ./test_perf.py -j 8 -n 2000 --baseline run.json /mnt/nfs
+#
+# The tests, in the order they run, as each uses the files of the
+# previous ones:
+#
+#   create    each worker creates its files in one shared directory
+#   stat      each worker stats its files
+#   readdir   each worker lists the whole, large, directory
+#   rename    each worker renames its files within the directory
+#   unlink    each worker removes its files
+#   smallio   each worker writes and reads back small files
+#   stream    each worker writes and reads back one large file
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 3 of the License, or (at your option) any later version.
+
+import argparse
+import json
+import multiprocessing
+import os
+import shutil
+import sys
+import time
+
+TESTS = ["create", "stat", "readdir", "rename", "unlink", "smallio",
+         "stream"]
+
+CHUNK = 1024 * 1024
+
+
+def name(worker, i, prefix="f"):
+    return "%s-%d-%d" % (prefix, worker, i)
+
+
+def run_create(args, worker, lat):
+    for i in range(args.files):
+        t0 = time.monotonic()
+        fd = os.open(os.path.join(args.dir, name(worker, i)),
+                     os.O_CREAT | os.O_EXCL | os.O_WRONLY, 0o644)
+        os.close(fd)
+        lat.append(time.monotonic() - t0)
+
+
+def run_stat(args, worker, lat):
+    for i in range(args.files):
+        t0 = time.monotonic()
+        os.stat(os.path.join(args.dir, name(worker, i)))
+        lat.append(time.monotonic() - t0)
+
+
+def run_readdir(args, worker, lat):
+    # One op is a full listing, the directory holds jobs * files
+    for _ in range(args.rounds):
+        t0 = time.monotonic()
+        n = sum(1 for _ in os.scandir(args.dir))
+        lat.append(time.monotonic() - t0)
+        if n < args.jobs * args.files:
+            raise RuntimeError("readdir found %d entries" % n)
+
+
+def run_rename(args, worker, lat):
+    for i in range(args.files):
+        t0 = time.monotonic()
+        os.rename(os.path.join(args.dir, name(worker, i)),
+                  os.path.join(args.dir, name(worker, i, "r")))
+        lat.append(time.monotonic() - t0)
+
+
+def run_unlink(args, worker, lat):
+    for i in range(args.files):
+        t0 = time.monotonic()
+        os.unlink(os.path.join(args.dir, name(worker, i, "r")))
+        lat.append(time.monotonic() - t0)
+
+
+def run_smallio(args, worker, lat):
+    data = os.urandom(args.small_size)
+    for i in range(args.files):
+        path = os.path.join(args.dir, name(worker, i, "s"))
+        t0 = time.monotonic()
+        fd = os.open(path, os.O_CREAT | os.O_WRONLY | os.O_TRUNC, 0o644)
+        os.write(fd, data)
+        os.close(fd)
+        fd = os.open(path, os.O_RDONLY)
+        if len(os.read(fd, args.small_size)) != args.small_size:
+            raise RuntimeError("short read of %s" % path)
+        os.close(fd)
+        lat.append(time.monotonic() - t0)
+    for i in range(args.files):
+        os.unlink(os.path.join(args.dir, name(worker, i, "s")))
+
+
+def run_stream(args, worker, lat):
+    # One op is one MiB written or read
+    path = os.path.join(args.dir, name(worker, 0, "stream"))
+    data = os.urandom(CHUNK)
+    fd = os.open(path, os.O_CREAT | os.O_WRONLY | os.O_TRUNC, 0o644)
+    for _ in range(args.stream_mb):
+        t0 = time.monotonic()
+        os.write(fd, data)
+        lat.append(time.monotonic() - t0)
+    os.fsync(fd)
+    os.close(fd)
+    fd = os.open(path, os.O_RDONLY)
+    for _ in range(args.stream_mb):
+        t0 = time.monotonic()
+        if len(os.read(fd, CHUNK)) != CHUNK:
+            raise RuntimeError("short read of %s" % path)
+        lat.append(time.monotonic() - t0)
+    os.close(fd)
+    os.unlink(path)
+
+
+RUN = {
+    "create": run_create,
+    "stat": run_stat,
+    "readdir": run_readdir,
+    "rename": run_rename,
+    "unlink": run_unlink,
+    "smallio": run_smallio,
+    "stream": run_stream,
+}
+
+
+def worker_main(test, args, worker, barrier, results):
+    lat = []
+    error = None
+    barrier.wait()
+    start = time.monotonic()
+    try:
+        RUN[test](args, worker, lat)
+    except (OSError, RuntimeError) as e:
+        error = str(e)
+    results.put((worker, start, time.monotonic(), lat, error))
+
+
+def percentile(lat, pct):
+    return lat[(len(lat) - 1) * pct // 100]
+
+
+def run_test(test, args):
+    barrier = multiprocessing.Barrier(args.jobs)
+    results = multiprocessing.Queue()
+    procs = [multiprocessing.Process(target=worker_main,
+                                     args=(test, args, w, barrier, results))
+             for w in range(args.jobs)]
+    for p in procs:
+        p.start()
+
+    starts, ends, lat = [], [], []
+    for _ in procs:
+        worker, start, end, wlat, error = results.get()
+        if error is not None:
+            sys.exit("%s: worker %d failed: %s" % (test, worker, error))
+        starts.append(start)
+        ends.append(end)
+        lat.extend(wlat)
+
+    for p in procs:
+        p.join()
+
+    lat.sort()
+    secs = max(ends) - min(starts)
+    return {
+        "test": test,
+        "jobs": args.jobs,
+        "ops": len(lat),
+        "secs": round(secs, 6),
+        "ops_per_sec": round(len(lat) / secs, 1) if secs > 0 else 0.0,
+        "lat_us": {
+            "p50": round(percentile(lat, 50) * 1e6, 1),
+            "p90": round(percentile(lat, 90) * 1e6, 1),
+            "p99": round(percentile(lat, 99) * 1e6, 1),
+            "max": round(lat[-1] * 1e6, 1),
+        },
+    }
+
+
+def load_baseline(path):
+    baseline = {}
+    with open(path) as f:
+        for line in f:
+            if line.strip():
+                result = json.loads(line)
+                baseline[result["test"]] = result
+    return baseline
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Metadata and I/O performance suite for a mount")
+    parser.add_argument("test_dir", help="directory in the mount to test")
+    parser.add_argument("-j", "--jobs", type=int, default=4,
+                        help="parallel worker processes (default 4)")
+    parser.add_argument("-n", "--files", type=int, default=1000,
+                        help="files per worker (default 1000)")
+    parser.add_argument("-r", "--rounds", type=int, default=5,
+                        help="listings per worker in readdir (default 5)")
+    parser.add_argument("--small-size", type=int, default=4096,
+                        help="bytes per file in smallio (default 4096)")
+    parser.add_argument("--stream-mb", type=int, default=256,
+                        help="MiB per worker in stream (default 256)")
+    parser.add_argument("-t", "--tests", default=",".join(TESTS),
+                        help="comma separated tests to run (default all)")
+    parser.add_argument("-o", "--output",
+                        help="write the results as JSON lines to this file")
+    parser.add_argument("-b", "--baseline",
+                        help="compare with the results of an earlier run")
+    parser.add_argument("--tolerance", type=float, default=10.0,
+                        help="percent drop in ops/s that fails a test "
+                             "against the baseline (default 10)")
+    args = parser.parse_args()
+
+    tests = args.tests.split(",")
+    for test in tests:
+        if test not in RUN:
+            parser.error("unknown test %s" % test)
+    if "rename" in tests or "unlink" in tests or "stat" in tests \
+            or "readdir" in tests:
+        if "create" not in tests:
+            parser.error("stat, readdir, rename and unlink need create")
+    if "unlink" in tests and "rename" not in tests:
+        parser.error("unlink removes the files renamed by rename")
+
+    if not os.path.isdir(args.test_dir):
+        parser.error("%s is not a directory" % args.test_dir)
+
+    args.dir = os.path.join(args.test_dir, "perf-%d" % os.getpid())
+    os.mkdir(args.dir)
+
+    baseline = load_baseline(args.baseline) if args.baseline else {}
+    out = open(args.output, "w") if args.output else None
+    regressions = 0
+
+    print("%-8s %6s %10s %12s %10s %10s %10s %10s  %s" %
+          ("test", "jobs", "ops", "ops/s", "p50 us", "p90 us", "p99 us",
+           "max us", "vs baseline"))
+
+    try:
+        for test in [t for t in TESTS if t in tests]:
+            result = run_test(test, args)
+            versus = ""
+            base = baseline.get(test)
+            if base is not None and base["ops_per_sec"] > 0:
+                change = (result["ops_per_sec"] / base["ops_per_sec"]
+                          - 1) * 100
+                result["baseline_change_pct"] = round(change, 1)
+                versus = "%+.1f%%" % change
+                if change < -args.tolerance:
+                    regressions += 1
+                    versus += " REGRESSION"
+            lat = result["lat_us"]
+            print("%-8s %6d %10d %12.1f %10.1f %10.1f %10.1f %10.1f  %s" %
+                  (test, result["jobs"], result["ops"],
+                   result["ops_per_sec"], lat["p50"], lat["p90"],
+                   lat["p99"], lat["max"], versus))
+            if out is not None:
+                out.write(json.dumps(result, sort_keys=True) + "\n")
+                out.flush()
+    finally:
+        if out is not None:
+            out.close()
+        shutil.rmtree(args.dir, ignore_errors=True)
+
+    if regressions:
+        print("%d tests regressed more than %.1f%% from the baseline" %
+              (regressions, args.tolerance))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -532,9 +532,12 @@ static bool gsh_client_showclients(DBusMessageIter *args,
 	struct showclients_state iter_state;
 	struct timespec timestamp;
 
-	now(&timestamp);
 	/* create a reply from the message */
 	dbus_message_iter_init_append(reply, &iter);
+	if (server_dbus_snapshot_clients(&iter))
+		return true;
+
+	now(&timestamp);
 	dbus_append_timestamp(&iter, &timestamp);
 	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
 					 "(sbbbbbbbb(tt))",
@@ -549,6 +552,7 @@ static bool gsh_client_showclients(DBusMessageIter *args,
 static struct gsh_dbus_method cltmgr_show_clients = {
 	.name = "ShowClients",
 	.method = gsh_client_showclients,
+	.heavy = true,
 	.args = {TIMESTAMP_REPLY,
 		 {
 		  .name = "clients",
@@ -623,7 +627,7 @@ static bool get_nfsv3_stats_io(DBusMessageIter *args,
 	}
 	dbus_status_reply(&iter, success, errormsg);
 	if (success)
-		server_dbus_v3_iostats(server_st->st.nfsv3, &iter);
+		server_dbus_v3_iostats(&server_st->st, &iter);
 
 	if (client != NULL)
 		put_gsh_client(client);
@@ -670,7 +674,7 @@ static bool get_nfsv40_stats_io(DBusMessageIter *args,
 	}
 	dbus_status_reply(&iter, success, errormsg);
 	if (success)
-		server_dbus_v40_iostats(server_st->st.nfsv40, &iter);
+		server_dbus_v40_iostats(&server_st->st, &iter);
 
 	if (client != NULL)
 		put_gsh_client(client);
@@ -717,7 +721,7 @@ static bool get_nfsv41_stats_io(DBusMessageIter *args,
 	}
 	dbus_status_reply(&iter, success, errormsg);
 	if (success)
-		server_dbus_v41_iostats(server_st->st.nfsv41, &iter);
+		server_dbus_v41_iostats(&server_st->st, &iter);
 
 	if (client != NULL)
 		put_gsh_client(client);
@@ -765,7 +769,7 @@ static bool get_nfsv41_stats_layouts(DBusMessageIter *args,
 	}
 	dbus_status_reply(&iter, success, errormsg);
 	if (success)
-		server_dbus_v41_layouts(server_st->st.nfsv41, &iter);
+		server_dbus_v41_layouts(&server_st->st, &iter);
 
 	if (client != NULL)
 		put_gsh_client(client);
@@ -829,6 +833,147 @@ static struct gsh_dbus_method cltmgr_show_delegations = {
 		 END_ARG_LIST}
 };
 
+/**
+ * DBUS method to report the NFSv4 owners and states a client holds
+ */
+static bool get_nfsv4_state(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	char *errormsg = "OK";
+	struct gsh_client *client = NULL;
+	struct nfs_client_state_counts counts;
+	struct timespec timestamp;
+	bool success = true;
+	DBusMessageIter iter, struct_iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client == NULL) {
+		success = false;
+		errormsg = "Client IP address not found";
+	}
+
+	dbus_status_reply(&iter, success, errormsg);
+	if (success) {
+		nfs_client_id_state_counts(client, &counts);
+		now(&timestamp);
+		dbus_append_timestamp(&iter, &timestamp);
+		dbus_message_iter_open_container(&iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &counts.clientids);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &counts.open_owners);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &counts.lock_owners);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &counts.states);
+		dbus_message_iter_close_container(&iter, &struct_iter);
+	}
+
+	if (client != NULL)
+		put_gsh_client(client);
+
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_nfsv4_state = {
+	.name = "GetNFSv4State",
+	.method = get_nfsv4_state,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 NFSV4_STATE_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the latency histograms of a client
+ */
+static bool get_client_lat_hists(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	struct server_stats *server_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client == NULL) {
+		success = false;
+	} else if (!nfs_param.core_param.enable_client_histograms) {
+		success = false;
+		errormsg = "Client latency histograms are disabled";
+	}
+
+	dbus_status_reply(&iter, success, errormsg);
+	if (success) {
+		server_st = container_of(client, struct server_stats, client);
+		server_dbus_lat_hists(&server_st->st, &iter);
+	}
+
+	if (client != NULL)
+		put_gsh_client(client);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_lat_hists = {
+	.name = "GetLatencyHistograms",
+	.method = get_client_lat_hists,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LAT_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the CPU time of a client's requests
+ */
+static bool get_client_cpu_stats(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	struct server_stats *server_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client == NULL) {
+		success = false;
+	} else if (!nfs_param.core_param.enable_cpu_stats) {
+		success = false;
+		errormsg = "CPU stats are disabled";
+	}
+
+	dbus_status_reply(&iter, success, errormsg);
+	if (success) {
+		server_st = container_of(client, struct server_stats, client);
+		server_dbus_cpu_stats(&server_st->st, &iter);
+	}
+
+	if (client != NULL)
+		put_gsh_client(client);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_cpu_stats = {
+	.name = "GetCPUStats",
+	.method = get_client_cpu_stats,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 CPU_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
 #ifdef _USE_9P
 /**
  * DBUS method to report 9p I/O statistics
@@ -982,6 +1127,9 @@ static struct gsh_dbus_method *cltmgr_stats_methods[] = {
 	&cltmgr_show_v41_io,
 	&cltmgr_show_v41_layouts,
 	&cltmgr_show_delegations,
+	&cltmgr_show_nfsv4_state,
+	&cltmgr_show_lat_hists,
+	&cltmgr_show_cpu_stats,
 #ifdef _USE_9P
 	&cltmgr_show_9p_io,
 	&cltmgr_show_9p_trans,
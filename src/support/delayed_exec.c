@@ -43,42 +43,59 @@
 #include <signal.h>
 #endif
 #include "abstract_mem.h"
+#include "abstract_atomic.h"
 #include "delayed_exec.h"
 #include "log.h"
-#include "avltree.h"
 #include "misc/queue.h"
 #include "gsh_intrinsic.h"
 #include "common_utils.h"
 
 /**
- * @brief A list of tasks
+ * @brief The wheel's geometry
+ *
+ * Level 0 has a slot per tick for the next 256 ticks, each further
+ * level has 64 slots each spanning all of the level below.  Five
+ * levels of millisecond ticks reach 49 days, later timers are
+ * clamped to that.
+ *
+ * @{
  */
 
-LIST_HEAD(delayed_tasklist, delayed_task);
+#define DELAYED_TICK_NS NS_PER_MSEC
+#define WHEEL_BITS0 8
+#define WHEEL_BITS 6
+#define WHEEL_SIZE0 (1 << WHEEL_BITS0)
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 5
+
+/** @} */
+
+/** Insert buffers, threads are spread over them */
+#define DELAYED_BUFFERS 64
 
 /**
- * @brief All tasks executing at a given time.
+ * @brief Where a timer is
  */
 
-struct delayed_multi {
-	struct timespec realtime;	/*< A wallclock time at which to
-					   perform the given task. */
-	struct delayed_tasklist list;	/*< The linked list of tasks to
-					   perform. */
-	struct avltree_node node;	/*< Our node in the tree */
+enum delayed_timer_state {
+	delayed_timer_idle,	/*< Not pending */
+	delayed_timer_buffered,	/*< In an insert buffer */
+	delayed_timer_expired,	/*< Due, waiting for the executor */
+	delayed_timer_wheel	/*< In the wheel, plus its level */
 };
 
 /**
- * @brief An individual delayed task
+ * @brief An insert buffer
+ *
+ * Timers move from here to the wheel under both the buffer and the
+ * executor mutex, so either is enough to know a timer is buffered.
  */
 
-struct delayed_task {
-	/** Function for delayed task */
-	void (*func)(void *);
-	/** Argument for delayed task */
-	void *arg;
-	/** Link in the task list. */
-	LIST_ENTRY(delayed_task) link;
+struct delayed_buffer {
+	pthread_mutex_t mtx;	/*< Protects list */
+	struct glist_head list;	/*< Timers added */
+	uint32_t count;		/*< Length of list, read without mtx */
+	GSH_CACHE_PAD(0);
 };
 
 /**
@@ -103,12 +120,28 @@ struct delayed_thread {
 
 /** list of all threads */
 static struct delayed_threadlist thread_list;
-/** Mutex for delayed execution */
+/** Mutex for delayed execution, protects the wheel */
 static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
-/** Condition variable for delayed execution */
-static pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
-/** The timer tree */
-static struct avltree tree;
+/** Condition variable for delayed execution, on CLOCK_MONOTONIC */
+static pthread_cond_t cv;
+
+/** The timing wheel */
+static struct {
+	uint64_t now;		/*< Last tick processed */
+	struct glist_head expired;	/*< Due timers, in order */
+	struct glist_head level0[WHEEL_SIZE0];
+	struct glist_head levels[WHEEL_LEVELS - 1][WHEEL_SIZE];
+	uint32_t count[WHEEL_LEVELS];	/*< Timers in each level */
+} wheel;
+
+/** Tick the executor sleeps until, UINT64_MAX if none */
+static uint64_t next_wake;
+/** The insert buffers */
+static struct delayed_buffer buffers[DELAYED_BUFFERS];
+/** Round robin of threads over buffers */
+static uint32_t buffer_rr;
+/** This thread's buffer plus one, 0 if none yet */
+static __thread uint32_t thread_buffer;
 
 /**
  * @brief Posssible states for the delayed executor
@@ -121,74 +154,232 @@ enum delayed_state {
 /** State for the executor */
 static enum delayed_state delayed_state;
 
-enum delayed_employment {
-	delayed_employed,	/*< Work is available, do it. */
-	delayed_on_break,	/*< Work is available, but wait for it */
-	delayed_unemployed	/*< No work is available, wait indefinitely */
-};
-
 /** @} */
 
-static int comparator(const struct avltree_node *a,
-		      const struct avltree_node *b)
+/**
+ * @brief The current tick
+ */
+
+static uint64_t delayed_ticks(void)
 {
-	struct delayed_multi *p =
-	    avltree_container_of(a, struct delayed_multi, node);
-	struct delayed_multi *q =
-	    avltree_container_of(b, struct delayed_multi, node);
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return timespec_to_nsecs(&ts) / DELAYED_TICK_NS;
+}
 
-	return gsh_time_cmp(&p->realtime, &q->realtime);
+/**
+ * @brief Ticks spanned by a slot of a level
+ */
+
+static inline unsigned int wheel_shift(int level)
+{
+	return level == 0 ? 0 : WHEEL_BITS0 + (level - 1) * WHEEL_BITS;
 }
 
 /**
- * @brief Get a task to perform
+ * @brief Put a timer in the wheel
  *
  * This function must be called with the mutex held.
  *
- * @param[out] when The time for which to wait, if there is one
- * @param[out] func The function to execute, if there is one
- * @param[out] arg  The argument to supply, if there is one
+ * @param[in] timer The timer
+ */
+
+static void wheel_insert(struct delayed_timer *timer)
+{
+	uint64_t delta, limit;
+	struct glist_head *slot;
+	int level;
+
+	if (timer->expires <= wheel.now) {
+		timer->state = delayed_timer_expired;
+		glist_add_tail(&wheel.expired, &timer->link);
+		return;
+	}
+
+	delta = timer->expires - wheel.now;
+
+	if (delta < WHEEL_SIZE0) {
+		level = 0;
+		slot = &wheel.level0[timer->expires & (WHEEL_SIZE0 - 1)];
+	} else {
+		for (level = 1; level < WHEEL_LEVELS - 1; level++) {
+			if (delta < (1ULL << wheel_shift(level + 1)))
+				break;
+		}
+
+		limit = 1ULL << wheel_shift(WHEEL_LEVELS);
+		if (delta >= limit)
+			timer->expires = wheel.now + limit - 1;
+
+		slot = &wheel.levels[level - 1][(timer->expires >>
+						 wheel_shift(level)) &
+						(WHEEL_SIZE - 1)];
+	}
+
+	timer->state = delayed_timer_wheel + level;
+	glist_add_tail(slot, &timer->link);
+	wheel.count[level]++;
+}
+
+/**
+ * @brief Move the timers of a slot back into the wheel
+ *
+ * This function must be called with the mutex held.
  *
- * @retval delayed_employed if there is a task to perform now.  Its
- *         argument and function are stored in @c arg and @c func.
- * @retval delayed_on_break if there is work but it is not to be
- *         performed yet.  The time at which it is to be performed is
- *         set in *when.
- * @retval delayed_unemployed if there is no work at all.  The caller
- *         should wait indefinitely to be signalled.
+ * @param[in] level The level of the slot
+ * @param[in] slot  The slot
  */
 
-static enum delayed_employment delayed_get_work(struct timespec *when,
-						void (**func) (void *),
-						void **arg)
+static void wheel_reinsert(int level, struct glist_head *slot)
 {
-	struct avltree_node *first = avltree_first(&tree);
-	struct delayed_multi *mul;
-	struct timespec current;
-	struct delayed_task *task;
+	struct glist_head work;
+	struct delayed_timer *timer;
+
+	glist_init(&work);
+	glist_splice_tail(&work, slot);
+
+	while (!glist_empty(&work)) {
+		timer = glist_first_entry(&work, struct delayed_timer, link);
+		glist_del(&timer->link);
+		wheel.count[level]--;
+		wheel_insert(timer);
+	}
+}
+
+/**
+ * @brief Process the wheel up to a tick
+ *
+ * Timers that are due go on the expired list.  Ticks are skipped
+ * while level 0 is empty.
+ *
+ * This function must be called with the mutex held.
+ *
+ * @param[in] target The tick to process up to
+ */
+
+static void wheel_advance(uint64_t target)
+{
+	uint64_t t;
+	uint32_t idx;
+	int level;
+
+	while (wheel.now < target) {
+		t = wheel.now + 1;
+
+		if (wheel.count[0] == 0 && (t & (WHEEL_SIZE0 - 1)) != 0) {
+			/* Nothing can fire before the next cascade */
+			t = (t | (WHEEL_SIZE0 - 1)) + 1;
+			if (t > target) {
+				wheel.now = target;
+				break;
+			}
+		}
+
+		wheel.now = t;
+
+		/* Higher levels cascade when the one below wraps */
+		for (level = 1;
+		     level < WHEEL_LEVELS &&
+		     (t & ((1ULL << wheel_shift(level)) - 1)) == 0;
+		     level++) {
+			idx = (t >> wheel_shift(level)) & (WHEEL_SIZE - 1);
+			if (wheel.count[level] != 0)
+				wheel_reinsert(level,
+					       &wheel.levels[level - 1][idx]);
+		}
+
+		if (wheel.count[0] != 0)
+			wheel_reinsert(0,
+				       &wheel.level0[t & (WHEEL_SIZE0 - 1)]);
+	}
+}
+
+/**
+ * @brief The tick at which the executor has to look again
+ *
+ * This function must be called with the mutex held.
+ *
+ * @return The tick, or UINT64_MAX if the wheel is empty.
+ */
+
+static uint64_t wheel_next(void)
+{
+	uint64_t next = UINT64_MAX;
+	struct glist_head *slot;
+	uint64_t t;
+	int level;
+
+	if (!glist_empty(&wheel.expired))
+		return wheel.now;
+
+	if (wheel.count[0] != 0) {
+		for (t = wheel.now + 1; ; t++) {
+			slot = &wheel.level0[t & (WHEEL_SIZE0 - 1)];
+			if (!glist_empty(slot)) {
+				next = t;
+				break;
+			}
+		}
+	}
+
+	/* A cascade may bring something due before that */
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		if (wheel.count[level] != 0) {
+			t = (wheel.now | ((1ULL << wheel_shift(level)) - 1)) +
+			    1;
+			if (t < next)
+				next = t;
+			break;
+		}
+	}
+
+	return next;
+}
 
-	if (first == NULL)
-		return delayed_unemployed;
+/**
+ * @brief Move the insert buffers into the wheel
+ *
+ * This function must be called with the mutex held.
+ */
 
-	now(&current);
-	mul = avltree_container_of(first, struct delayed_multi, node);
+static void delayed_drain(void)
+{
+	struct delayed_buffer *buffer;
+	struct delayed_timer *timer;
+	int i;
 
-	if (gsh_time_cmp(&mul->realtime, &current) > 0) {
-		*when = mul->realtime;
-		return delayed_on_break;
+	for (i = 0; i < DELAYED_BUFFERS; i++) {
+		buffer = &buffers[i];
+		if (atomic_fetch_uint32_t(&buffer->count) == 0)
+			continue;
+
+		PTHREAD_MUTEX_lock(&buffer->mtx);
+		while (!glist_empty(&buffer->list)) {
+			timer = glist_first_entry(&buffer->list,
+						  struct delayed_timer, link);
+			glist_del(&timer->link);
+			wheel_insert(timer);
+		}
+		atomic_store_uint32_t(&buffer->count, 0);
+		PTHREAD_MUTEX_unlock(&buffer->mtx);
 	}
+}
 
-	task = LIST_FIRST(&mul->list);
-	*func = task->func;
-	*arg = task->arg;
-	LIST_REMOVE(task, link);
-	gsh_free(task);
-	if (LIST_EMPTY(&mul->list)) {
-		avltree_remove(first, &tree);
-		gsh_free(mul);
+/**
+ * @brief Test whether any insert buffer holds a timer
+ */
+
+static bool delayed_buffered(void)
+{
+	int i;
+
+	for (i = 0; i < DELAYED_BUFFERS; i++) {
+		if (atomic_fetch_uint32_t(&buffers[i].count) != 0)
+			return true;
 	}
 
-	return delayed_employed;
+	return false;
 }
 
 /**
@@ -220,24 +411,44 @@ void *delayed_thread(void *arg)
 
 	PTHREAD_MUTEX_lock(&mtx);
 	while (delayed_state == delayed_running) {
+		struct delayed_timer *timer;
 		struct timespec then;
+		uint64_t wake;
 		void (*func)(void *);
 		void *arg;
 
-		switch (delayed_get_work(&then, &func, &arg)) {
-		case delayed_unemployed:
-			pthread_cond_wait(&cv, &mtx);
-			break;
+		delayed_drain();
+		wheel_advance(delayed_ticks());
 
-		case delayed_on_break:
-			pthread_cond_timedwait(&cv, &mtx, &then);
-			break;
+		if (!glist_empty(&wheel.expired)) {
+			timer = glist_first_entry(&wheel.expired,
+						  struct delayed_timer, link);
+			glist_del(&timer->link);
+			timer->state = delayed_timer_idle;
+			func = timer->func;
+			arg = timer->arg;
+			if (timer->free_on_fire)
+				gsh_free(timer);
 
-		case delayed_employed:
 			PTHREAD_MUTEX_unlock(&mtx);
 			func(arg);
 			PTHREAD_MUTEX_lock(&mtx);
-			break;
+			continue;
+		}
+
+		wake = wheel_next();
+		atomic_store_uint64_t(&next_wake, wake);
+
+		/* Submitters look at next_wake after buffering, so either
+		   they see the new one or we see their timer. */
+		if (delayed_buffered())
+			continue;
+
+		if (wake == UINT64_MAX) {
+			pthread_cond_wait(&cv, &mtx);
+		} else {
+			nsecs_to_timespec(wake * DELAYED_TICK_NS, &then);
+			pthread_cond_timedwait(&cv, &mtx, &then);
 		}
 	}
 	LIST_REMOVE(thr, link);
@@ -263,8 +474,29 @@ void delayed_start(void)
 	/* Thread index */
 	int i;
 
+	/* Condition attributes */
+	pthread_condattr_t cattr;
+
 	LIST_INIT(&thread_list);
-	avltree_init(&tree, comparator, 0);
+
+	glist_init(&wheel.expired);
+	for (i = 0; i < WHEEL_SIZE0; i++)
+		glist_init(&wheel.level0[i]);
+	for (i = 0; i < (WHEEL_LEVELS - 1) * WHEEL_SIZE; i++)
+		glist_init(&wheel.levels[i / WHEEL_SIZE][i % WHEEL_SIZE]);
+	wheel.now = delayed_ticks();
+	next_wake = UINT64_MAX;
+
+	for (i = 0; i < DELAYED_BUFFERS; i++) {
+		PTHREAD_MUTEX_init(&buffers[i].mtx, NULL);
+		glist_init(&buffers[i].list);
+	}
+
+	if (pthread_condattr_init(&cattr) != 0 ||
+	    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC) != 0 ||
+	    pthread_cond_init(&cv, &cattr) != 0)
+		LogFatal(COMPONENT_THREAD, "can't init condition variable");
+	pthread_condattr_destroy(&cattr);
 
 	if (threads_to_start == 0) {
 		LogFatal(COMPONENT_THREAD,
@@ -304,7 +536,7 @@ void delayed_shutdown(void)
 	int rc = -1;
 	struct timespec then;
 
-	now(&then);
+	clock_gettime(CLOCK_MONOTONIC, &then);
 	then.tv_sec += 120;
 
 	PTHREAD_MUTEX_lock(&mtx);
@@ -327,6 +559,118 @@ void delayed_shutdown(void)
 	PTHREAD_MUTEX_unlock(&mtx);
 }
 
+/**
+ * @brief Set up a timer
+ *
+ * @param[out] timer The timer
+ * @param[in]  func  The function to run when it fires
+ * @param[in]  arg   The argument to run it with
+ */
+
+void delayed_timer_init(struct delayed_timer *timer, void (*func)(void *),
+			void *arg)
+{
+	glist_init(&timer->link);
+	timer->expires = 0;
+	timer->func = func;
+	timer->arg = arg;
+	timer->buffer = 0;
+	timer->state = delayed_timer_idle;
+	timer->free_on_fire = false;
+}
+
+/**
+ * @brief Arm a timer
+ *
+ * A timer that is already pending is cancelled first.  The function
+ * runs on the executor no sooner than the delay, and may add its
+ * timer again.
+ *
+ * @param[in,out] timer The timer
+ * @param[in]     delay The delay in nanoseconds
+ */
+
+void delayed_timer_add(struct delayed_timer *timer, nsecs_elapsed_t delay)
+{
+	struct delayed_buffer *buffer;
+	uint64_t expires;
+
+	(void) delayed_timer_cancel(timer);
+
+	if (thread_buffer == 0)
+		thread_buffer = atomic_inc_uint32_t(&buffer_rr) %
+				DELAYED_BUFFERS + 1;
+	buffer = &buffers[thread_buffer - 1];
+
+	/* Round up and add the partial tick we are in, never early */
+	expires = delayed_ticks() +
+		  (delay + DELAYED_TICK_NS - 1) / DELAYED_TICK_NS +
+		  (delay != 0);
+
+	PTHREAD_MUTEX_lock(&buffer->mtx);
+	timer->expires = expires;
+	timer->buffer = thread_buffer - 1;
+	timer->state = delayed_timer_buffered;
+	glist_add_tail(&buffer->list, &timer->link);
+	atomic_store_uint32_t(&buffer->count, buffer->count + 1);
+	PTHREAD_MUTEX_unlock(&buffer->mtx);
+
+	/* The timer may already have fired, only use our copy. */
+	if (expires < atomic_fetch_uint64_t(&next_wake)) {
+		PTHREAD_MUTEX_lock(&mtx);
+		if (expires < next_wake) {
+			/* Later submitters before this need not signal */
+			next_wake = expires;
+			pthread_cond_signal(&cv);
+		}
+		PTHREAD_MUTEX_unlock(&mtx);
+	}
+}
+
+/**
+ * @brief Disarm a timer
+ *
+ * @param[in,out] timer The timer
+ *
+ * @retval true if the timer was pending and will not run.
+ * @retval false if it was not pending, or is running.
+ */
+
+bool delayed_timer_cancel(struct delayed_timer *timer)
+{
+	struct delayed_buffer *buffer;
+	uint32_t state;
+	bool cancelled = false;
+
+	/* Only the owner makes an idle timer pending */
+	if (atomic_fetch_uint32_t(&timer->state) == delayed_timer_idle)
+		return false;
+
+	buffer = &buffers[timer->buffer];
+	PTHREAD_MUTEX_lock(&buffer->mtx);
+	if (timer->state == delayed_timer_buffered) {
+		glist_del(&timer->link);
+		atomic_store_uint32_t(&buffer->count, buffer->count - 1);
+		timer->state = delayed_timer_idle;
+		PTHREAD_MUTEX_unlock(&buffer->mtx);
+		return true;
+	}
+	PTHREAD_MUTEX_unlock(&buffer->mtx);
+
+	PTHREAD_MUTEX_lock(&mtx);
+	state = timer->state;
+	if (state >= delayed_timer_expired) {
+		glist_del(&timer->link);
+		if (state >= delayed_timer_wheel)
+			wheel.count[state - delayed_timer_wheel]--;
+		timer->state = delayed_timer_idle;
+		cancelled = true;
+	}
+	PTHREAD_MUTEX_unlock(&mtx);
+
+	return cancelled;
+}
+
 /**
  * @brief Submit a new task
  *
@@ -340,36 +684,11 @@ void delayed_shutdown(void)
 
 int delayed_submit(void (*func) (void *), void *arg, nsecs_elapsed_t delay)
 {
-	struct delayed_multi *mul = NULL;
-	struct delayed_task *task = NULL;
-	struct avltree_node *collision = NULL;
-	struct avltree_node *first = NULL;
+	struct delayed_timer *timer = gsh_malloc(sizeof(struct delayed_timer));
 
-	mul = gsh_malloc(sizeof(struct delayed_multi));
-	task = gsh_malloc(sizeof(struct delayed_task));
-
-	now(&mul->realtime);
-	timespec_add_nsecs(delay, &mul->realtime);
-
-	PTHREAD_MUTEX_lock(&mtx);
-	first = avltree_first(&tree);
-	collision = avltree_insert(&mul->node, &tree);
-	if (unlikely(collision)) {
-		gsh_free(mul);
-		/* There is already a node for this exact time in the
-		   tree.  Add our task to its list. */
-		mul =
-		    avltree_container_of(collision, struct delayed_multi, node);
-	} else {
-		LIST_INIT(&mul->list);
-	}
-	task->func = func;
-	task->arg = arg;
-	LIST_INSERT_HEAD(&mul->list, task, link);
-	if (!first || comparator(&mul->node, first) < 0)
-		pthread_cond_broadcast(&cv);
-
-	PTHREAD_MUTEX_unlock(&mtx);
+	delayed_timer_init(timer, func, arg);
+	timer->free_on_fire = true;
+	delayed_timer_add(timer, delay);
 
 	return 0;
 }
@@ -32,6 +32,7 @@
 #include "nfs_core.h"
 #include "FSAL/fsal_commonlib.h"
 #include "pnfs_utils.h"
+#include "city.h"
 
 /**
  * @brief Servers are stored in an AVL tree with front-end cache.
@@ -48,6 +49,28 @@ struct server_by_id {
 
 static struct server_by_id server_by_id;
 
+/**
+ * @brief DS handles are cached per server by wire handle.
+ *
+ * Every DS READ, WRITE and COMMIT follows a PUTFH, and making a DS
+ * handle may cost the FSAL a round trip to its backend to validate
+ * the wire handle.  The handles most recently made for a server are
+ * kept, each holding a reference, so that PUTFH of a handle already
+ * seen only takes a reference.  Slots are direct mapped by hash of
+ * the wire handle.
+ *
+ * @note  number of cache slots should be prime.
+ */
+#define DS_HANDLE_CACHE_SIZE 251
+
+struct pnfs_dsh_slot {
+	uint64_t hash;
+	struct fsal_ds_handle *dsh;
+	int flags;
+	uint32_t len;
+	char wire[NFS4_FHSIZE];
+};
+
 /**
  * @brief Compute cache slot for an entry
  *
@@ -215,6 +238,8 @@ void pnfs_ds_put(struct fsal_pnfs_ds *pds)
 	}
 
 	/* free resources */
+	pnfs_ds_flush_handles(pds);
+	gsh_free(pds->dsh_cache);
 	fsal_pnfs_ds_fini(pds);
 	gsh_free(pds);
 }
@@ -257,6 +282,9 @@ void pnfs_ds_remove(uint16_t id_servers, bool final)
 
 	/* removal has a once-only semantic */
 	if (pds != NULL) {
+		/* Cached handles may need the related export */
+		pnfs_ds_flush_handles(pds);
+
 		if (pds->mds_export != NULL)
 			/* special case: avoid lookup of related export.
 			 * get_gsh_export_ref() was bumped in pnfs_ds_insert()
@@ -282,6 +310,95 @@ void pnfs_ds_remove(uint16_t id_servers, bool final)
 	}
 }
 
+/**
+ * @brief Make a DS handle from a wire handle, through the cache
+ *
+ * @param[in]  pds    The server, from pnfs_ds_get()
+ * @param[in]  desc   The wire handle
+ * @param[in]  flags  fhflags1 of the NFS handle
+ * @param[out] handle The DS handle, with a reference for the caller
+ *
+ * @return NFSv4.1 status of make_ds_handle.
+ */
+
+nfsstat4 pnfs_ds_make_handle(struct fsal_pnfs_ds *pds,
+			     const struct gsh_buffdesc *desc, int flags,
+			     struct fsal_ds_handle **handle)
+{
+	struct pnfs_dsh_slot *slot;
+	struct fsal_ds_handle *old;
+	uint64_t hash;
+	nfsstat4 status;
+
+	if (desc->len > NFS4_FHSIZE)
+		return pds->s_ops.make_ds_handle(pds, desc, handle, flags);
+
+	hash = CityHash64(desc->addr, desc->len);
+
+	PTHREAD_MUTEX_lock(&pds->dsh_cache_lock);
+	if (pds->dsh_cache == NULL)
+		pds->dsh_cache = gsh_calloc(DS_HANDLE_CACHE_SIZE,
+					    sizeof(struct pnfs_dsh_slot));
+
+	slot = &pds->dsh_cache[hash % DS_HANDLE_CACHE_SIZE];
+	if (slot->dsh != NULL && slot->hash == hash &&
+	    slot->flags == flags && slot->len == desc->len &&
+	    memcmp(slot->wire, desc->addr, desc->len) == 0) {
+		ds_handle_get_ref(slot->dsh);
+		*handle = slot->dsh;
+		PTHREAD_MUTEX_unlock(&pds->dsh_cache_lock);
+		return NFS4_OK;
+	}
+	PTHREAD_MUTEX_unlock(&pds->dsh_cache_lock);
+
+	status = pds->s_ops.make_ds_handle(pds, desc, handle, flags);
+	if (status != NFS4_OK)
+		return status;
+
+	/* The cache holds a reference of its own */
+	ds_handle_get_ref(*handle);
+
+	PTHREAD_MUTEX_lock(&pds->dsh_cache_lock);
+	old = slot->dsh;
+	slot->dsh = *handle;
+	slot->hash = hash;
+	slot->flags = flags;
+	slot->len = desc->len;
+	memcpy(slot->wire, desc->addr, desc->len);
+	PTHREAD_MUTEX_unlock(&pds->dsh_cache_lock);
+
+	/* Released outside the lock, release takes pds->lock */
+	if (old != NULL)
+		ds_handle_put(old);
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Drop the cached DS handles of a server
+ *
+ * @param[in] pds The server
+ */
+
+void pnfs_ds_flush_handles(struct fsal_pnfs_ds *pds)
+{
+	struct fsal_ds_handle *old;
+	int i;
+
+	if (pds->dsh_cache == NULL)
+		return;
+
+	for (i = 0; i < DS_HANDLE_CACHE_SIZE; i++) {
+		PTHREAD_MUTEX_lock(&pds->dsh_cache_lock);
+		old = pds->dsh_cache[i].dsh;
+		pds->dsh_cache[i].dsh = NULL;
+		PTHREAD_MUTEX_unlock(&pds->dsh_cache_lock);
+
+		if (old != NULL)
+			ds_handle_put(old);
+	}
+}
+
 /**
  * @brief Commit a FSAL sub-block
  *
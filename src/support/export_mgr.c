@@ -45,6 +45,7 @@
 #include <sys/types.h>
 #include <sys/param.h>
 #include <pthread.h>
+#include <sched.h>
 #include <assert.h>
 #include <arpa/inet.h>
 #include "fsal.h"
@@ -64,22 +65,215 @@
 #include "nfs_exports.h"
 #include "nfs_proto_functions.h"
 #include "pnfs_utils.h"
+#include "mdcache.h"
 
 /**
- * @brief Exports are stored in an AVL tree with front-end cache.
- *
- * @note  number of cache slots should be prime.
+ * @brief Exports are stored in an AVL tree
  */
-#define EXPORT_BY_ID_CACHE_SIZE 769
-
 struct export_by_id {
 	pthread_rwlock_t lock;
 	struct avltree t;
-	struct avltree_node *cache[EXPORT_BY_ID_CACHE_SIZE];
 };
 
 static struct export_by_id export_by_id;
 
+/**
+ * @brief Lock-free lookup by id, and sharded references
+ *
+ * Exports in the AVL tree are also in export_table, indexed by export
+ * id, which get_gsh_export() reads without taking export_by_id.lock.
+ * While an export is there, references to it are counted in shards
+ * picked per thread, rather than in refcnt.
+ *
+ * Both rely on read sections.  A thread bumps its own sequence on entry
+ * and on exit, so it is odd while inside.  Taking an export out of the
+ * table waits for every thread that was inside to leave.  After that no
+ * thread can be about to take a reference from the table slot or the
+ * shards, and the shards are folded into refcnt.
+ */
+#define EXPORT_TABLE_PAGE 256
+#define EXPORT_REF_SHARDS 32
+
+/** Pages of EXPORT_TABLE_PAGE slots, protected by export_by_id.lock
+ *  for writing.  Pages are allocated on first use and never freed.
+ */
+static struct gsh_export **export_table[(UINT16_MAX + 1) /
+					EXPORT_TABLE_PAGE];
+
+struct export_ref_shard {
+	int64_t refs;
+	GSH_CACHE_PAD(0);
+};
+
+struct export_reader {
+	uint64_t seq;		/*< odd while in a read section */
+	uint32_t shard;		/*< reference shard of the thread */
+	bool in_use;		/*< owned by a live thread */
+	struct glist_head list;	/*< link in export_readers */
+	GSH_CACHE_PAD(0);
+};
+
+/** All readers ever registered, protected by export_readers_mtx */
+static struct glist_head export_readers = GLIST_HEAD_INIT(export_readers);
+static pthread_mutex_t export_readers_mtx = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t export_readers_count;
+static pthread_key_t export_reader_key;
+static __thread struct export_reader *export_reader;
+
+/* Destructor of export_reader_key, leaves the reader for another thread */
+static void export_reader_release(void *arg)
+{
+	struct export_reader *rd = arg;
+
+	PTHREAD_MUTEX_lock(&export_readers_mtx);
+	rd->in_use = false;
+	PTHREAD_MUTEX_unlock(&export_readers_mtx);
+}
+
+static struct export_reader *export_reader_register(void)
+{
+	struct export_reader *rd;
+	struct glist_head *glist;
+	bool found = false;
+
+	PTHREAD_MUTEX_lock(&export_readers_mtx);
+	glist_for_each(glist, &export_readers) {
+		rd = glist_entry(glist, struct export_reader, list);
+		if (!rd->in_use) {
+			found = true;
+			break;
+		}
+	}
+	if (!found) {
+		rd = gsh_calloc(1, sizeof(*rd));
+		rd->shard = export_readers_count++ % EXPORT_REF_SHARDS;
+		glist_add_tail(&export_readers, &rd->list);
+	}
+	rd->in_use = true;
+	PTHREAD_MUTEX_unlock(&export_readers_mtx);
+
+	(void) pthread_setspecific(export_reader_key, rd);
+	export_reader = rd;
+
+	return rd;
+}
+
+static inline struct export_reader *export_read_begin(void)
+{
+	struct export_reader *rd = export_reader;
+
+	if (unlikely(rd == NULL))
+		rd = export_reader_register();
+
+	(void) atomic_inc_uint64_t(&rd->seq);
+
+	return rd;
+}
+
+static inline void export_read_end(struct export_reader *rd)
+{
+	(void) atomic_inc_uint64_t(&rd->seq);
+}
+
+/**
+ * @brief Wait until all threads in a read section have left it
+ */
+static void export_wait_readers(void)
+{
+	struct glist_head *glist;
+	struct export_reader *rd;
+	uint64_t seq;
+
+	PTHREAD_MUTEX_lock(&export_readers_mtx);
+	glist_for_each(glist, &export_readers) {
+		rd = glist_entry(glist, struct export_reader, list);
+		seq = atomic_fetch_uint64_t(&rd->seq);
+		if (!(seq & 1))
+			continue;
+		while (atomic_fetch_uint64_t(&rd->seq) == seq)
+			sched_yield();
+	}
+	PTHREAD_MUTEX_unlock(&export_readers_mtx);
+}
+
+/* Called in a read section */
+static inline void export_ref_read(struct export_reader *rd,
+				   struct gsh_export *export)
+{
+	if (atomic_fetch_uint32_t(&export->ref_sharded))
+		(void) atomic_inc_int64_t(&export->ref_shards[rd->shard].refs);
+	else
+		(void) atomic_inc_int64_t(&export->refcnt);
+}
+
+/**
+ * @brief Get a reference on an export
+ *
+ * @param export [IN] export already referenced by the caller
+ */
+void get_gsh_export_ref(struct gsh_export *export)
+{
+	struct export_reader *rd = export_read_begin();
+
+	export_ref_read(rd, export);
+	export_read_end(rd);
+}
+
+/**
+ * @brief Count references in refcnt again
+ *
+ * Called after the export has been taken out of export_table, with
+ * ref_sharded cleared, by the one who did so.
+ */
+static void export_unshard_refs(struct gsh_export *export)
+{
+	int64_t sum = 0;
+	int i;
+
+	export_wait_readers();
+
+	for (i = 0; i < EXPORT_REF_SHARDS; i++)
+		sum += atomic_fetch_int64_t(&export->ref_shards[i].refs);
+
+	(void) atomic_add_int64_t(&export->refcnt, sum);
+}
+
+/* Called with export_by_id.lock held for writing */
+static void export_table_set(uint16_t export_id, struct gsh_export *export)
+{
+	struct gsh_export **page = export_table[export_id /
+						EXPORT_TABLE_PAGE];
+
+	if (page == NULL) {
+		page = gsh_calloc(EXPORT_TABLE_PAGE, sizeof(*page));
+		atomic_store_voidptr((void **)&export_table[export_id /
+							    EXPORT_TABLE_PAGE],
+				     page);
+	}
+
+	atomic_store_voidptr((void **)&page[export_id % EXPORT_TABLE_PAGE],
+			     export);
+}
+
+/* Called with export_by_id.lock held for writing, returns true if the
+ * export was in the table
+ */
+static bool export_table_clear(struct gsh_export *export)
+{
+	struct gsh_export **page = export_table[export->export_id /
+						EXPORT_TABLE_PAGE];
+
+	if (page == NULL ||
+	    page[export->export_id % EXPORT_TABLE_PAGE] != export)
+		return false;
+
+	atomic_store_voidptr((void **)&page[export->export_id %
+					    EXPORT_TABLE_PAGE], NULL);
+	atomic_store_uint32_t(&export->ref_sharded, 0);
+
+	return true;
+}
+
 /** List of all active exports,
   * protected by export_by_id.lock
   */
@@ -95,6 +289,29 @@ static struct glist_head mount_work;
   */
 static struct glist_head unexport_work;
 
+/** Bumped each time an export is added, removed or updated, so that
+  * caches of what a path resolves to can tell they are stale.
+  */
+static uint32_t export_gen;
+
+/**
+ * @brief Get the current generation of the export list
+ *
+ * @return The generation, to be compared with a later one.
+ */
+uint32_t get_gsh_export_gen(void)
+{
+	return atomic_fetch_uint32_t(&export_gen);
+}
+
+/**
+ * @brief Note that an export was added, removed or updated
+ */
+void bump_gsh_export_gen(void)
+{
+	(void) atomic_inc_uint32_t(&export_gen);
+}
+
 void export_add_to_mount_work(struct gsh_export *export)
 {
 	PTHREAD_RWLOCK_wrlock(&export_by_id.lock);
@@ -148,21 +365,6 @@ struct gsh_export *export_take_unexport_work(void)
 	return export;
 }
 
-/**
- * @brief Compute cache slot for an entry
- *
- * This function computes a hash slot, taking an address modulo the
- * number of cache slotes (which should be prime).
- *
- * @param k [in] Entry index value
- *
- * @return The computed offset.
- */
-static inline uint16_t eid_cache_offsetof(uint16_t k)
-{
-	return k % EXPORT_BY_ID_CACHE_SIZE;
-}
-
 /**
  * @brief Revert export_commit()
  *
@@ -170,20 +372,20 @@ static inline uint16_t eid_cache_offsetof(uint16_t k)
  */
 void export_revert(struct gsh_export *export)
 {
-	struct avltree_node *cnode;
-	void **cache_slot = (void **)
-	     &(export_by_id.cache[eid_cache_offsetof(export->export_id)]);
+	bool unshard;
 
 	PTHREAD_RWLOCK_wrlock(&export_by_id.lock);
 
-	cnode = (struct avltree_node *)atomic_fetch_voidptr(cache_slot);
-	if (&export->node_k == cnode)
-		atomic_store_voidptr(cache_slot, NULL);
+	unshard = export_table_clear(export);
 	avltree_remove(&export->node_k, &export_by_id.t);
 	glist_del(&export->exp_list);
 	glist_del(&export->exp_work);
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
+
+	if (unshard)
+		export_unshard_refs(export);
+
 	put_gsh_export(export); /* Release sentinel ref */
 }
 
@@ -220,6 +422,7 @@ struct gsh_export *alloc_export(void)
 
 	export_st = gsh_calloc(1, sizeof(struct export_stats));
 
+	export_st->st.shards = GSH_STATS_SHARDS;
 	export = &export_st->export;
 
 	LogFullDebug(COMPONENT_EXPORT, "Allocated export %p", export);
@@ -230,6 +433,9 @@ struct gsh_export *alloc_export(void)
 	glist_init(&export->mounted_exports_list);
 	glist_init(&export->clients);
 
+	export->ref_shards = gsh_calloc(EXPORT_REF_SHARDS,
+					sizeof(struct export_ref_shard));
+
 	PTHREAD_RWLOCK_init(&export->lock, NULL);
 
 	return export;
@@ -252,6 +458,7 @@ void free_export(struct gsh_export *export)
 	free_export_resources(export);
 	export_st = container_of(export, struct export_stats, export);
 	server_stats_free(&export_st->st);
+	gsh_free(export->ref_shards);
 	gsh_free(export_st);
 	PTHREAD_RWLOCK_destroy(&export->lock);
 }
@@ -272,8 +479,6 @@ void free_export(struct gsh_export *export)
 bool insert_gsh_export(struct gsh_export *export)
 {
 	struct avltree_node *node;
-	void **cache_slot = (void **)
-	    &(export_by_id.cache[eid_cache_offsetof(export->export_id)]);
 
 	PTHREAD_RWLOCK_wrlock(&export_by_id.lock);
 	node = avltree_insert(&export->node_k, &export_by_id.t);
@@ -286,11 +491,14 @@ bool insert_gsh_export(struct gsh_export *export)
 	/* we will hold a ref starting out... */
 	get_gsh_export_ref(export);
 
-	/* update cache */
-	atomic_store_voidptr(cache_slot, &export->node_k);
 	glist_add_tail(&exportlist, &export->exp_list);
 	get_gsh_export_ref(export);		/* == 2 */
 
+	/* further references go to the shards */
+	atomic_store_uint32_t(&export->ref_sharded, 1);
+	export_table_set(export->export_id, export);
+	bump_gsh_export_gen();
+
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 	return true;
 }
@@ -308,42 +516,20 @@ bool insert_gsh_export(struct gsh_export *export)
  */
 struct gsh_export *get_gsh_export(uint16_t export_id)
 {
-	struct gsh_export v;
-	struct avltree_node *node;
-	struct gsh_export *exp;
-	void **cache_slot = (void **)
-	    &(export_by_id.cache[eid_cache_offsetof(export_id)]);
+	struct export_reader *rd = export_read_begin();
+	struct gsh_export **page;
+	struct gsh_export *exp = NULL;
 
-	v.export_id = export_id;
-	PTHREAD_RWLOCK_rdlock(&export_by_id.lock);
+	page = atomic_fetch_voidptr((void **)&export_table[export_id /
+							   EXPORT_TABLE_PAGE]);
+	if (page != NULL)
+		exp = atomic_fetch_voidptr((void **)&page[export_id %
+							  EXPORT_TABLE_PAGE]);
+	if (exp != NULL)
+		export_ref_read(rd, exp);
 
-	/* check cache */
-	node = (struct avltree_node *)atomic_fetch_voidptr(cache_slot);
-	if (node) {
-		exp = avltree_container_of(node, struct gsh_export, node_k);
-		if (exp->export_id == export_id) {
-			/* got it in 1 */
-			LogDebug(COMPONENT_HASHTABLE_CACHE,
-				 "export_mgr cache hit slot %d",
-				 eid_cache_offsetof(export_id));
-			goto out;
-		}
-	}
+	export_read_end(rd);
 
-	/* fall back to AVL */
-	node = avltree_lookup(&v.node_k, &export_by_id.t);
-	if (node) {
-		exp = avltree_container_of(node, struct gsh_export, node_k);
-		/* update cache */
-		atomic_store_voidptr(cache_slot, node);
-	} else {
-		PTHREAD_RWLOCK_unlock(&export_by_id.lock);
-		return NULL;
-	}
-
- out:
-	get_gsh_export_ref(exp);
-	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 	return exp;
 }
 
@@ -628,7 +814,17 @@ bool mount_gsh_export(struct gsh_export *exp)
 
 void put_gsh_export(struct gsh_export *export)
 {
-	int64_t refcount = atomic_dec_int64_t(&export->refcnt);
+	struct export_reader *rd = export_read_begin();
+	int64_t refcount;
+
+	if (atomic_fetch_uint32_t(&export->ref_sharded)) {
+		(void) atomic_dec_int64_t(&export->ref_shards[rd->shard].refs);
+		export_read_end(rd);
+		return;
+	}
+	export_read_end(rd);
+
+	refcount = atomic_dec_int64_t(&export->refcnt);
 
 	if (refcount != 0) {
 		assert(refcount > 0);
@@ -651,33 +847,32 @@ void remove_gsh_export(uint16_t export_id)
 	struct gsh_export v;
 	struct avltree_node *node;
 	struct gsh_export *export = NULL;
-	void **cache_slot = (void **)
-	    &(export_by_id.cache[eid_cache_offsetof(export_id)]);
+	bool unshard = false;
 
 	v.export_id = export_id;
 	PTHREAD_RWLOCK_wrlock(&export_by_id.lock);
 
 	node = avltree_lookup(&v.node_k, &export_by_id.t);
 	if (node) {
-		struct avltree_node *cnode = (struct avltree_node *)
-			atomic_fetch_voidptr(cache_slot);
+		export = avltree_container_of(node, struct gsh_export, node_k);
 
-		/* Remove from the AVL cache and tree */
-		if (node == cnode)
-			atomic_store_voidptr(cache_slot, NULL);
+		/* Remove from the table and tree */
+		unshard = export_table_clear(export);
 		avltree_remove(node, &export_by_id.t);
 
-		export = avltree_container_of(node, struct gsh_export, node_k);
-
 		/* Remove the export from the export list */
 		glist_del(&export->exp_list);
 
 		/* No new references will be granted. Idempotent. */
 		export->export_status = EXPORT_STALE;
+		bump_gsh_export_gen();
 	}
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 
+	if (unshard)
+		export_unshard_refs(export);
+
 	/* removal has a once-only semantic */
 	if (export != NULL) {
 		if (export->has_pnfs_ds) {
@@ -1196,6 +1391,49 @@ static struct gsh_dbus_method export_display_export = {
 		 END_ARG_LIST}
 };
 
+/**
+ * @brief Drop what is cached of an export's objects
+ *
+ * Nothing cached of an Immutable export expires, this is how a change
+ * made to its tree anyway is picked up.
+ *
+ * @param "id"  [IN] the id of the export
+ *
+ * @return           As above, use DBusError to return errors.
+ */
+
+static bool gsh_export_invalidatecache(DBusMessageIter *args,
+				       DBusMessage *reply,
+				       DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	char *errormsg;
+
+	export = lookup_export(args, &errormsg);
+	if (export == NULL) {
+		LogDebug(COMPONENT_EXPORT, "lookup_export failed with %s",
+			errormsg);
+		dbus_set_error(error, DBUS_ERROR_INVALID_ARGS,
+			       "lookup_export failed with %s",
+			       errormsg);
+		return false;
+	}
+
+	mdcache_invalidate_export(export->fsal_export);
+	LogInfo(COMPONENT_EXPORT, "Invalidated cache of export with id %d",
+		export->export_id);
+
+	put_gsh_export(export);
+	return true;
+}
+
+static struct gsh_dbus_method export_invalidate_cache = {
+	.name = "InvalidateCache",
+	.method = gsh_export_invalidatecache,
+	.args = {ID_ARG,
+		 END_ARG_LIST}
+};
+
 static bool export_to_dbus(struct gsh_export *exp_node, void *state)
 {
 	struct showexports_state *iter_state =
@@ -1246,6 +1484,7 @@ static bool gsh_export_showexports(DBusMessageIter *args,
 static struct gsh_dbus_method export_show_exports = {
 	.name = "ShowExports",
 	.method = gsh_export_showexports,
+	.heavy = true,
 	.args = {TIMESTAMP_REPLY,
 		 {
 		  .name = "exports",
@@ -1255,25 +1494,26 @@ static struct gsh_dbus_method export_show_exports = {
 };
 
 /**
- * @brief Update an export
+ * @brief Update exports from a parsed config source
  *
- * This method passes a pathname in the server's local filesystem
- * that should be parsed and processed by the config_parsing module.
- * The resulting export entry is then updated. Params are in the args iter
+ * Only the EXPORT blocks selected by export_expr are loaded, and an
+ * export is changed only where its block differs from what is live.
  *
- * @param "path"   [IN] A local path to a file with only an EXPORT {...}
+ * @param[in]  file_path   File to parse, or the name of block
+ * @param[in]  block       Config text to parse, NULL to parse source
+ * @param[in]  export_expr Selects the EXPORT blocks to apply
+ * @param[out] reply       Reply message
+ * @param[out] error       Error to set on failure
  *
- * @return        true for success, false with error filled out for failure
+ * @return true for success, false with error filled out for failure
  */
 
-static bool gsh_export_update_export(DBusMessageIter *args,
-				     DBusMessage *reply,
-				     DBusError *error)
+static bool export_update_config(char *file_path, char *block,
+				 char *export_expr, DBusMessage *reply,
+				 DBusError *error)
 {
 	int rc, exp_cnt = 0;
 	bool status = true;
-	char *file_path = NULL;
-	char *export_expr = NULL;
 	config_file_t config_struct = NULL;
 	struct config_node_list *config_list, *lp, *lp_next;
 	struct config_error_type err_type;
@@ -1281,34 +1521,15 @@ static bool gsh_export_update_export(DBusMessageIter *args,
 	char *err_detail = NULL;
 	struct error_detail conf_errs = {NULL, 0, NULL};
 
-	/* Get path */
-	if (dbus_message_iter_get_arg_type(args) == DBUS_TYPE_STRING)
-		dbus_message_iter_get_basic(args, &file_path);
-	else {
-		dbus_set_error(error, DBUS_ERROR_INVALID_ARGS,
-			       "Pathname is not a string. It is a (%c)",
-			       dbus_message_iter_get_arg_type(args));
-		status = false;
-		goto out;
-	}
-	if (dbus_message_iter_next(args) &&
-	    dbus_message_iter_get_arg_type(args) == DBUS_TYPE_STRING)
-		dbus_message_iter_get_basic(args, &export_expr);
-	else {
-		dbus_set_error(error, DBUS_ERROR_INVALID_ARGS,
-			       "expression is not a string. It is a (%c)",
-			       dbus_message_iter_get_arg_type(args));
-		status = false;
-		goto out;
-	}
-	LogInfo(COMPONENT_EXPORT, "Adding export from file: %s with %s",
-		file_path, export_expr);
-
 	/* Create a memstream for parser+processing error messages */
 	if (!init_error_type(&err_type))
 		goto out;
 
-	config_struct = config_ParseFile(file_path, &err_type);
+	if (block != NULL)
+		config_struct = config_ParseBuffer(block, file_path,
+						   &err_type);
+	else
+		config_struct = config_ParseFile(file_path, &err_type);
 	if (!config_error_is_harmless(&err_type)) {
 		err_detail = err_type_str(&err_type);
 		LogCrit(COMPONENT_EXPORT,
@@ -1429,6 +1650,80 @@ out:
 	return status;
 }
 
+/**
+ * @brief Update an export
+ *
+ * This method passes a pathname in the server's local filesystem
+ * that should be parsed and processed by the config_parsing module.
+ * The resulting export entry is then updated. Params are in the args iter
+ *
+ * @param "path"   [IN] A local path to a file with only an EXPORT {...}
+ *
+ * @return        true for success, false with error filled out for failure
+ */
+
+static bool gsh_export_update_export(DBusMessageIter *args,
+				     DBusMessage *reply,
+				     DBusError *error)
+{
+	char *file_path = NULL;
+	char *export_expr = NULL;
+
+	/* Get path */
+	if (dbus_message_iter_get_arg_type(args) == DBUS_TYPE_STRING)
+		dbus_message_iter_get_basic(args, &file_path);
+	else {
+		dbus_set_error(error, DBUS_ERROR_INVALID_ARGS,
+			       "Pathname is not a string. It is a (%c)",
+			       dbus_message_iter_get_arg_type(args));
+		return false;
+	}
+	if (dbus_message_iter_next(args) &&
+	    dbus_message_iter_get_arg_type(args) == DBUS_TYPE_STRING)
+		dbus_message_iter_get_basic(args, &export_expr);
+	else {
+		dbus_set_error(error, DBUS_ERROR_INVALID_ARGS,
+			       "expression is not a string. It is a (%c)",
+			       dbus_message_iter_get_arg_type(args));
+		return false;
+	}
+	LogInfo(COMPONENT_EXPORT, "Adding export from file: %s with %s",
+		file_path, export_expr);
+
+	return export_update_config(file_path, NULL, export_expr, reply,
+				    error);
+}
+
+/**
+ * DBUS method to update an export from an EXPORT block sent as a string
+ *
+ * Like UpdateExport, without a file to write first.  Every EXPORT block
+ * in the string is applied.
+ *
+ * @param "block"  [IN] One or more EXPORT {...} blocks
+ *
+ * @return        true for success, false with error filled out for failure
+ */
+
+static bool gsh_export_update_export_block(DBusMessageIter *args,
+					   DBusMessage *reply,
+					   DBusError *error)
+{
+	char *block = NULL;
+
+	if (dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		dbus_set_error(error, DBUS_ERROR_INVALID_ARGS,
+			       "Block is not a string. It is a (%c)",
+			       dbus_message_iter_get_arg_type(args));
+		return false;
+	}
+	dbus_message_iter_get_basic(args, &block);
+
+	LogInfo(COMPONENT_EXPORT, "Updating export from DBus block");
+
+	return export_update_config("<dbus>", block, "EXPORT", reply, error);
+}
+
 static struct gsh_dbus_method export_update_export = {
 	.name = "UpdateExport",
 	.method = gsh_export_update_export,
@@ -1438,12 +1733,22 @@ static struct gsh_dbus_method export_update_export = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method export_update_export_block = {
+	.name = "UpdateExportBlock",
+	.method = gsh_export_update_export_block,
+	.args =	{BLOCK_ARG,
+		 MESSAGE_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *export_mgr_methods[] = {
 	&export_add_export,
 	&export_remove_export,
 	&export_display_export,
+	&export_invalidate_cache,
 	&export_show_exports,
 	&export_update_export,
+	&export_update_export_block,
 	NULL
 };
 
@@ -1487,7 +1792,7 @@ static bool get_nfsv3_export_io(DBusMessageIter *args,
 	}
 	dbus_status_reply(&iter, success, errormsg);
 	if (success)
-		server_dbus_v3_iostats(export_st->st.nfsv3, &iter);
+		server_dbus_v3_iostats(&export_st->st, &iter);
 
 	if (export != NULL)
 		put_gsh_export(export);
@@ -1532,7 +1837,7 @@ static bool get_nfsv40_export_io(DBusMessageIter *args,
 	}
 	dbus_status_reply(&iter, success, errormsg);
 	if (success)
-		server_dbus_v40_iostats(export_st->st.nfsv40, &iter);
+		server_dbus_v40_iostats(&export_st->st, &iter);
 
 	if (export != NULL)
 		put_gsh_export(export);
@@ -1577,7 +1882,7 @@ static bool get_nfsv41_export_io(DBusMessageIter *args,
 	}
 	dbus_status_reply(&iter, success, errormsg);
 	if (success)
-		server_dbus_v41_iostats(export_st->st.nfsv41, &iter);
+		server_dbus_v41_iostats(&export_st->st, &iter);
 
 	if (export != NULL)
 		put_gsh_export(export);
@@ -1622,7 +1927,7 @@ static bool get_nfsv41_export_layouts(DBusMessageIter *args,
 	}
 	dbus_status_reply(&iter, success, errormsg);
 	if (success)
-		server_dbus_v41_layouts(export_st->st.nfsv41, &iter);
+		server_dbus_v41_layouts(&export_st->st, &iter);
 
 	if (export != NULL)
 		put_gsh_export(export);
@@ -1675,6 +1980,83 @@ static bool get_nfsv_global_total_ops(DBusMessageIter *args,
 	return true;
 }
 
+/**
+ * DBUS method to report the latency histograms of an export
+ */
+static bool get_export_lat_hists(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export != NULL) {
+		export_st = container_of(export, struct export_stats, export);
+		dbus_status_reply(&iter, success, errormsg);
+		server_dbus_lat_hists(&export_st->st, &iter);
+		put_gsh_export(export);
+	} else {
+		success = false;
+		errormsg = "Export does not have any activity";
+		dbus_status_reply(&iter, success, errormsg);
+	}
+	return true;
+}
+
+/**
+ * DBUS method to report the CPU time of an export's requests
+ */
+static bool get_export_cpu_stats(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL) {
+		success = false;
+	} else if (!nfs_param.core_param.enable_cpu_stats) {
+		success = false;
+		errormsg = "CPU stats are disabled";
+	}
+
+	dbus_status_reply(&iter, success, errormsg);
+	if (success) {
+		export_st = container_of(export, struct export_stats, export);
+		server_dbus_cpu_stats(&export_st->st, &iter);
+	}
+
+	if (export != NULL)
+		put_gsh_export(export);
+	return true;
+}
+
+static bool get_global_lat_hists(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	global_dbus_lat_hists(&iter);
+
+	return true;
+}
+
 static bool get_nfsv_global_fast_ops(DBusMessageIter *args,
 				     DBusMessage *reply,
 				     DBusError *error)
@@ -1691,6 +2073,35 @@ static bool get_nfsv_global_fast_ops(DBusMessageIter *args,
 	return true;
 }
 
+static bool get_heavy_hitters(DBusMessageIter *args,
+			      DBusMessage *reply,
+			      DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	uint32_t max = 0;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args == NULL) {
+		success = false;
+		errormsg = "message has no arguments";
+	} else if (DBUS_TYPE_UINT32 != dbus_message_iter_get_arg_type(args)) {
+		success = false;
+		errormsg = "arg not a 32 bit integer";
+	} else if (nfs_param.core_param.heavy_hitters_window == 0) {
+		success = false;
+		errormsg = "Heavy hitters are not being tracked";
+	} else {
+		dbus_message_iter_get_basic(args, &max);
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_heavy_hitters(max, &iter);
+
+	return true;
+}
+
 static bool show_cache_inode_stats(DBusMessageIter *args,
 				   DBusMessage *reply,
 				   DBusError *error)
@@ -1707,6 +2118,107 @@ static bool show_cache_inode_stats(DBusMessageIter *args,
 	return true;
 }
 
+static bool show_iobuf_pool_stats(DBusMessageIter *args,
+				  DBusMessage *reply,
+				  DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	iobuf_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_drc_stats(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	drc_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_worker_pool_stats(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	worker_pool_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_slab_stats(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	slab_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_mem_arena_stats(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	if (!mem_arena_enabled())
+		errormsg = "Memory arenas are not enabled";
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	mem_arena_dbus_show(&iter);
+
+	return true;
+}
+
+#ifdef _USE_NFS_RDMA
+static bool show_rdma_stats(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	rdma_dbus_show(&iter);
+
+	return true;
+}
+#endif
+
 static struct gsh_dbus_method export_show_v41_layouts = {
 	.name = "GetNFSv41Layouts",
 	.method = get_nfsv41_export_layouts,
@@ -1831,6 +2343,35 @@ static struct gsh_dbus_method global_show_total_ops = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method export_show_lat_hists = {
+	.name = "GetLatencyHistograms",
+	.method = get_export_lat_hists,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LAT_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_lat_hists = {
+	.name = "GetGlobalLatencyHistograms",
+	.method = get_global_lat_hists,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LAT_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method export_show_cpu_stats = {
+	.name = "GetCPUStats",
+	.method = get_export_cpu_stats,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 CPU_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method global_show_fast_ops = {
 	.name = "GetFastOPS",
 	.method = get_nfsv_global_fast_ops,
@@ -1840,15 +2381,82 @@ static struct gsh_dbus_method global_show_fast_ops = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method global_show_heavy_hitters = {
+	.name = "GetHeavyHitters",
+	.method = get_heavy_hitters,
+	.args = {HEAVY_HITTERS_MAX_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 HEAVY_HITTERS_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method cache_inode_show = {
 	.name = "ShowCacheInode",
 	.method = show_cache_inode_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOTAL_OPS_REPLY,
+		 CACHE_EXPORTS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method iobuf_pool_show = {
+	.name = "ShowIOBufPool",
+	.method = show_iobuf_pool_stats,
 	.args = {STATUS_REPLY,
 		 TIMESTAMP_REPLY,
 		 TOTAL_OPS_REPLY,
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method drc_show = {
+	.name = "ShowDRC",
+	.method = show_drc_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOTAL_OPS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method worker_pool_show = {
+	.name = "ShowWorkerPool",
+	.method = show_worker_pool_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOTAL_OPS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method slab_show = {
+	.name = "ShowSlabs",
+	.method = show_slab_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 SLABS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method mem_arena_show = {
+	.name = "ShowMemArenas",
+	.method = show_mem_arena_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 MEM_ARENAS_REPLY,
+		 END_ARG_LIST}
+};
+
+#ifdef _USE_NFS_RDMA
+static struct gsh_dbus_method rdma_show = {
+	.name = "ShowRDMA",
+	.method = show_rdma_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 RDMA_CONNS_REPLY,
+		 END_ARG_LIST}
+};
+#endif
+
 /**
  * @brief Report all IO stats of all exports in one call
  *
@@ -1881,6 +2489,9 @@ static bool get_nfs_io(DBusMessageIter *args,
 
 	/* status and timestamp reply */
 	dbus_status_reply(&reply_iter, success, errormsg);
+	if (server_dbus_snapshot_iostats(&reply_iter))
+		return true;
+
 	now(&timestamp);
 	dbus_append_timestamp(&reply_iter, &timestamp);
 
@@ -1897,6 +2508,7 @@ static bool get_nfs_io(DBusMessageIter *args,
 static struct gsh_dbus_method export_show_all_io = {
 	.name = "GetNFSIO",
 	.method = get_nfs_io,
+	.heavy = true,
 	.args = {STATUS_REPLY,
 		 TIMESTAMP_REPLY,
 		 NFS_ALL_IO_REPLY,
@@ -1915,7 +2527,19 @@ static struct gsh_dbus_method *export_stats_methods[] = {
 #endif
 	&global_show_total_ops,
 	&global_show_fast_ops,
+	&export_show_lat_hists,
+	&global_show_lat_hists,
+	&export_show_cpu_stats,
+	&global_show_heavy_hitters,
 	&cache_inode_show,
+	&iobuf_pool_show,
+	&drc_show,
+	&worker_pool_show,
+	&slab_show,
+	&mem_arena_show,
+#ifdef _USE_NFS_RDMA
+	&rdma_show,
+#endif
 	&export_show_all_io,
 	NULL
 };
@@ -1956,7 +2580,7 @@ void export_pkginit(void)
 #endif
 	PTHREAD_RWLOCK_init(&export_by_id.lock, &rwlock_attr);
 	avltree_init(&export_by_id.t, export_id_cmpf, 0);
-	memset(&export_by_id.cache, 0, sizeof(export_by_id.cache));
+	(void) pthread_key_create(&export_reader_key, export_reader_release);
 
 	glist_init(&exportlist);
 	glist_init(&mount_work);
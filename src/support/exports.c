@@ -52,6 +52,7 @@
 #include "pnfs_utils.h"
 #include "netgroup_cache.h"
 #include "mdcache.h"
+#include "fridgethr.h"
 
 /**
  * @brief Protect EXPORT_DEFAULTS structure for dynamic update.
@@ -62,6 +63,9 @@
  */
 pthread_rwlock_t export_opt_lock = PTHREAD_RWLOCK_INITIALIZER;
 
+/* Never cleared, it only saves looking up exports when none is limited */
+bool gsh_qos_exports;
+
 #define GLOBAL_EXPORT_PERMS_INITIALIZER				\
 	.def.anonymous_uid = ANON_UID,				\
 	.def.anonymous_gid = ANON_GID,				\
@@ -87,6 +91,19 @@ struct global_export_perms export_opt_cfg = {
 };
 
 static void FreeClientList(struct glist_head *clients);
+static struct client_acl *client_acl_build(struct glist_head *clients);
+static void client_acl_free(struct client_acl *acl);
+
+/**
+ * @brief Whether an export was declared Immutable
+ *
+ * @param[in] export The export
+ */
+static inline bool export_immutable(struct gsh_export *export)
+{
+	return atomic_fetch_uint32_t(&export->options) &
+	       EXPORT_OPTION_IMMUTABLE;
+}
 
 static int StrExportOptions(struct display_buffer *dspbuf,
 			    struct export_perms *p_perms)
@@ -771,7 +788,8 @@ static int fsal_cfg_commit(void *node, void *link_mem, void *self_struct,
 	PTHREAD_RWLOCK_rdlock(&export_opt_lock);
 
 	if ((export->options_set & EXPORT_OPTION_EXPIRE_SET) == 0)
-		export->expire_time_attr = export_opt.expire_time_attr;
+		export->expire_time_attr = export_immutable(export)
+			? -1 : export_opt.expire_time_attr;
 
 	PTHREAD_RWLOCK_unlock(&export_opt_lock);
 
@@ -859,7 +877,8 @@ static int fsal_update_cfg_commit(void *node, void *link_mem, void *self_struct,
 	PTHREAD_RWLOCK_rdlock(&export_opt_lock);
 
 	if ((export->options_set & EXPORT_OPTION_EXPIRE_SET) == 0)
-		export->expire_time_attr = export_opt.expire_time_attr;
+		export->expire_time_attr = export_immutable(export)
+			? -1 : export_opt.expire_time_attr;
 
 	PTHREAD_RWLOCK_unlock(&export_opt_lock);
 
@@ -971,6 +990,96 @@ static inline int strcmp_null(const char *s1, const char *s2)
 	return strcmp(s1, s2);
 }
 
+static bool export_perms_equal(struct export_perms *a,
+			       struct export_perms *b)
+{
+	return a->anonymous_uid == b->anonymous_uid &&
+	       a->anonymous_gid == b->anonymous_gid &&
+	       a->options == b->options &&
+	       a->set == b->set;
+}
+
+static bool client_entry_equal(exportlist_client_entry_t *a,
+			       exportlist_client_entry_t *b)
+{
+	if (a->type != b->type ||
+	    !export_perms_equal(&a->client_perms, &b->client_perms))
+		return false;
+
+	switch (a->type) {
+	case HOSTIF_CLIENT:
+		return a->client.hostif.clientaddr ==
+		       b->client.hostif.clientaddr;
+	case HOSTIF_CLIENT_V6:
+		return memcmp(&a->client.hostif.clientaddr6,
+			      &b->client.hostif.clientaddr6,
+			      sizeof(struct in6_addr)) == 0;
+	case NETWORK_CLIENT:
+		return a->client.network.netaddr ==
+		       b->client.network.netaddr &&
+		       a->client.network.netmask ==
+		       b->client.network.netmask;
+	case NETGROUP_CLIENT:
+		return strcmp_null(a->client.netgroup.netgroupname,
+				   b->client.netgroup.netgroupname) == 0;
+	case WILDCARDHOST_CLIENT:
+		return strcmp_null(a->client.wildcard.wildcard,
+				   b->client.wildcard.wildcard) == 0;
+	case GSSPRINCIPAL_CLIENT:
+		return strcmp_null(a->client.gssprinc.princname,
+				   b->client.gssprinc.princname) == 0;
+	default:
+		return true;
+	}
+}
+
+/**
+ * @brief Compare two client lists entry by entry
+ *
+ * Order matters, the first matching entry decides.
+ */
+static bool client_lists_equal(struct glist_head *a, struct glist_head *b)
+{
+	struct glist_head *la, *lb;
+
+	for (la = a->next, lb = b->next; la != a && lb != b;
+	     la = la->next, lb = lb->next) {
+		if (!client_entry_equal(
+			glist_entry(la, exportlist_client_entry_t, cle_list),
+			glist_entry(lb, exportlist_client_entry_t, cle_list)))
+			return false;
+	}
+
+	return la == a && lb == b;
+}
+
+static bool atomic_fields_equal(struct gsh_export *export,
+				struct gsh_export *src)
+{
+	return atomic_fetch_uint64_t(&export->MaxRead) == src->MaxRead &&
+	       atomic_fetch_uint64_t(&export->MaxWrite) == src->MaxWrite &&
+	       atomic_fetch_uint64_t(&export->PrefRead) == src->PrefRead &&
+	       atomic_fetch_uint64_t(&export->PrefWrite) == src->PrefWrite &&
+	       atomic_fetch_uint64_t(&export->PrefReaddir) ==
+							src->PrefReaddir &&
+	       atomic_fetch_uint64_t(&export->MaxOffsetWrite) ==
+							src->MaxOffsetWrite &&
+	       atomic_fetch_uint64_t(&export->MaxOffsetRead) ==
+							src->MaxOffsetRead &&
+	       atomic_fetch_uint32_t(&export->options) == src->options &&
+	       atomic_fetch_uint32_t(&export->options_set) ==
+							src->options_set &&
+	       atomic_fetch_int32_t(&export->expire_time_attr) ==
+							src->expire_time_attr &&
+	       atomic_fetch_uint64_t(&export->qos_iops) == src->qos_iops &&
+	       atomic_fetch_uint64_t(&export->qos_bandwidth) ==
+							src->qos_bandwidth &&
+	       atomic_fetch_uint64_t(&export->cache_entries_max) ==
+						src->cache_entries_max &&
+	       atomic_fetch_uint64_t(&export->cache_dirent_mem_max) ==
+						src->cache_dirent_mem_max;
+}
+
 static inline void update_atomic_fields(struct gsh_export *export,
 					struct gsh_export *src)
 {
@@ -984,6 +1093,12 @@ static inline void update_atomic_fields(struct gsh_export *export,
 	atomic_store_uint32_t(&export->options, src->options);
 	atomic_store_uint32_t(&export->options_set, src->options_set);
 	atomic_store_int32_t(&export->expire_time_attr, src->expire_time_attr);
+	atomic_store_uint64_t(&export->qos_iops, src->qos_iops);
+	atomic_store_uint64_t(&export->qos_bandwidth, src->qos_bandwidth);
+	atomic_store_uint64_t(&export->cache_entries_max,
+			      src->cache_entries_max);
+	atomic_store_uint64_t(&export->cache_dirent_mem_max,
+			      src->cache_dirent_mem_max);
 }
 
 /**
@@ -1010,6 +1125,9 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 
 	LogFullDebug(COMPONENT_EXPORT, "Processing %p", export);
 
+	if (export->qos_iops != 0 || export->qos_bandwidth != 0)
+		gsh_qos_exports = true;
+
 	/* validate the export now */
 	if (export->export_perms.options & EXPORT_OPTION_NFSV4) {
 		if (export->pseudopath == NULL) {
@@ -1078,6 +1196,9 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 	probe_exp = get_gsh_export(export->export_id);
 
 	if (commit_type == update_export && probe_exp != NULL) {
+		struct client_acl *client_acl;
+		bool atomic_changed, perms_changed, clients_changed;
+
 		/* We have an actual update case, probe_exp is the target
 		 * to update. Check all the options that MUST match.
 		 * Note that Path/fullpath will not be NULL, but we compare
@@ -1151,8 +1272,49 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 			return errcnt;
 		}
 
-		/* Update atomic fields */
-		update_atomic_fields(probe_exp, export);
+		/* Apply only what changed.  An export whose block is the
+		 * same is left alone, so rereading a large config does not
+		 * take every export's lock for writing nor throw away the
+		 * client decisions cached for it.
+		 */
+		atomic_changed = !atomic_fields_equal(probe_exp, export);
+
+		PTHREAD_RWLOCK_rdlock(&probe_exp->lock);
+		perms_changed = !export_perms_equal(&probe_exp->export_perms,
+						    &export->export_perms);
+		clients_changed = !client_lists_equal(&probe_exp->clients,
+						      &export->clients);
+		PTHREAD_RWLOCK_unlock(&probe_exp->lock);
+
+		if (!atomic_changed && !perms_changed && !clients_changed) {
+			LogDebug(COMPONENT_CONFIG,
+				 "Export %d unchanged", export->export_id);
+			err_type->dispose = true;
+			put_gsh_export(probe_exp);
+			return 0;
+		}
+
+		LogDebug(COMPONENT_CONFIG,
+			 "Export %d update changes%s%s%s", export->export_id,
+			 atomic_changed ? " options" : "",
+			 perms_changed ? " perms" : "",
+			 clients_changed ? " clients" : "");
+
+		if (atomic_changed)
+			update_atomic_fields(probe_exp, export);
+
+		if (!clients_changed) {
+			if (perms_changed) {
+				PTHREAD_RWLOCK_wrlock(&probe_exp->lock);
+				probe_exp->export_perms = export->export_perms;
+				PTHREAD_RWLOCK_unlock(&probe_exp->lock);
+			}
+			err_type->dispose = true;
+			put_gsh_export(probe_exp);
+			goto success;
+		}
+
+		export->client_acl = client_acl_build(&export->clients);
 
 		/* Now take lock and swap out client list and export_perms... */
 		PTHREAD_RWLOCK_wrlock(&probe_exp->lock);
@@ -1171,6 +1333,13 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 
 		glist_swap_lists(&probe_exp->clients, &export->clients);
 
+		/* The compiled list goes with it, and its new generation
+		 * invalidates the access decisions cached for the old one.
+		 */
+		client_acl = probe_exp->client_acl;
+		probe_exp->client_acl = export->client_acl;
+		export->client_acl = client_acl;
+
 		PTHREAD_RWLOCK_unlock(&probe_exp->lock);
 
 		/* We will need to dispose of the config export since we
@@ -1263,6 +1432,8 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 		return errcnt;  /* have errors. don't init or load a fsal */
 	}
 
+	export->client_acl = client_acl_build(&export->clients);
+
 	if (!insert_gsh_export(export)) {
 		LogCrit(COMPONENT_CONFIG,
 			"Export id %d already in use.",
@@ -1316,6 +1487,8 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 	display_clients(export);
 
 success:
+	/* An updated export may have new clients or permissions */
+	bump_gsh_export_gen();
 
 	(void) StrExportOptions(&dspbuf, &export->export_perms);
 
@@ -1730,9 +1903,20 @@ static struct config_item fsal_params[] = {
 	CONF_ITEM_BOOLBIT_SET("Disable_ACL",				\
 		false, EXPORT_OPTION_DISABLE_ACL,			\
 		_struct_, options, options_set),			\
+	CONF_ITEM_BOOLBIT_SET("Immutable",				\
+		false, EXPORT_OPTION_IMMUTABLE,				\
+		_struct_, options, options_set),			\
 	CONF_ITEM_I32_SET("Attr_Expiration_Time", -1, INT32_MAX, 60,	\
 		       _struct_, expire_time_attr,			\
-		       EXPORT_OPTION_EXPIRE_SET, options_set)
+		       EXPORT_OPTION_EXPIRE_SET, options_set),		\
+	CONF_ITEM_UI64("QoS_IOPS", 0, UINT64_MAX, 0,			\
+		       _struct_, qos_iops),				\
+	CONF_ITEM_UI64("QoS_Bandwidth", 0, UINT64_MAX, 0,		\
+		       _struct_, qos_bandwidth),			\
+	CONF_ITEM_UI64("Cache_Entries_Max", 0, UINT64_MAX, 0,		\
+		       _struct_, cache_entries_max),			\
+	CONF_ITEM_UI64("Cache_Dirent_Mem_Max", 0, UINT64_MAX, 0,	\
+		       _struct_, cache_dirent_mem_max)
 
 /**
  * @brief Table of EXPORT block parameters
@@ -2096,6 +2280,8 @@ static void FreeClientList(struct glist_head *clients)
 
 void free_export_resources(struct gsh_export *export)
 {
+	client_acl_free(export->client_acl);
+	export->client_acl = NULL;
 	FreeClientList(&export->clients);
 	if (export->fsal_export != NULL) {
 		struct fsal_module *fsal = export->fsal_export->fsal;
@@ -2125,13 +2311,155 @@ static bool init_export_cb(struct gsh_export *exp, void *state)
 	return !(init_export_root(exp));
 }
 
+/* Threads looking up export roots at startup */
+static struct fridgethr *export_init_fridge;
+
+struct export_init_list {
+	struct gsh_export **exports;
+	size_t count;
+	size_t size;
+};
+
+static bool export_init_collect(struct gsh_export *exp, void *state)
+{
+	struct export_init_list *list = state;
+
+	if (list->count == list->size) {
+		list->size = list->size ? list->size * 2 : 64;
+		list->exports = gsh_realloc(list->exports,
+					    list->size * sizeof(exp));
+	}
+
+	get_gsh_export_ref(exp);
+	list->exports[list->count++] = exp;
+
+	return true;
+}
+
+/**
+ * @brief Whether another export is mounted under this one's pseudo path
+ *
+ * Building the pseudo FS needs the root of such an export, so it is not
+ * left to the background.
+ */
+static bool export_has_children(struct export_init_list *list,
+				struct gsh_export *exp)
+{
+	size_t len, i;
+
+	if (exp->pseudopath == NULL)
+		return false;
+
+	len = strlen(exp->pseudopath);
+
+	for (i = 0; i < list->count; i++) {
+		const char *path = list->exports[i]->pseudopath;
+
+		if (path == NULL || strncmp(path, exp->pseudopath, len) != 0)
+			continue;
+
+		if (len == 1 ? path[1] != '\0' : path[len] == '/')
+			return true;
+	}
+
+	return false;
+}
+
+/* Look up a pending root and drop the reference the job held */
+static void export_init_pending(struct gsh_export *exp)
+{
+	(void) init_export_root(exp);
+
+	PTHREAD_RWLOCK_wrlock(&exp->lock);
+	exp->exp_root_pending = false;
+	PTHREAD_RWLOCK_unlock(&exp->lock);
+
+	put_gsh_export(exp);
+}
+
+static void export_init_job(struct fridgethr_context *ctx)
+{
+	export_init_pending(ctx->arg);
+}
+
 /**
  * @brief Initialize exports over a live cache inode and fsal layer
+ *
+ * With Export_Init_Threads above 1 the roots are looked up in parallel
+ * and the server starts meanwhile, each export becoming usable as its
+ * lookup finishes.  Until then getting its root fails with
+ * ERR_FSAL_DELAY, which clients see as NFS4ERR_DELAY or
+ * NFS3ERR_JUKEBOX.  Exports with others mounted under them are done
+ * first, in line, since the pseudo FS is built over them.
  */
 
 void exports_pkginit(void)
 {
-	foreach_gsh_export(init_export_cb, NULL);
+	struct export_init_list list = {NULL, 0, 0};
+	struct fridgethr_params frp;
+	size_t i;
+	int rc;
+
+	if (nfs_param.core_param.export_init_threads <= 1) {
+		foreach_gsh_export(init_export_cb, NULL);
+		return;
+	}
+
+	memset(&frp, 0, sizeof(frp));
+	frp.thr_max = nfs_param.core_param.export_init_threads;
+	frp.thread_delay = 60;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&export_init_fridge, "export_init", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_EXPORT,
+			 "Unable to initialize export init fridge: %d", rc);
+		foreach_gsh_export(init_export_cb, NULL);
+		return;
+	}
+
+	foreach_gsh_export(export_init_collect, &list);
+
+	for (i = 0; i < list.count; i++) {
+		struct gsh_export *exp = list.exports[i];
+
+		if (!export_has_children(&list, exp))
+			continue;
+
+		(void) init_export_root(exp);
+	}
+
+	for (i = 0; i < list.count; i++) {
+		struct gsh_export *exp = list.exports[i];
+
+		if (exp->exp_root_obj != NULL ||
+		    export_has_children(&list, exp))
+			continue;
+
+		PTHREAD_RWLOCK_wrlock(&exp->lock);
+		exp->exp_root_pending = true;
+		PTHREAD_RWLOCK_unlock(&exp->lock);
+
+		/* The job drops the reference */
+		get_gsh_export_ref(exp);
+		rc = fridgethr_submit(export_init_fridge, export_init_job,
+				      exp);
+		if (rc != 0) {
+			LogMajor(COMPONENT_EXPORT,
+				 "Unable to schedule root lookup of export %d: %d",
+				 exp->export_id, rc);
+			export_init_pending(exp);
+		}
+	}
+
+	for (i = 0; i < list.count; i++)
+		put_gsh_export(list.exports[i]);
+
+	LogInfo(COMPONENT_EXPORT,
+		"Looking up export roots with %u threads",
+		nfs_param.core_param.export_init_threads);
+
+	gsh_free(list.exports);
 }
 
 /**
@@ -2151,17 +2479,21 @@ void exports_pkginit(void)
 fsal_status_t nfs_export_get_root_entry(struct gsh_export *export,
 					struct fsal_obj_handle **obj)
 {
+	bool pending;
+
 	PTHREAD_RWLOCK_rdlock(&export->lock);
 
 	if (export->exp_root_obj)
 		export->exp_root_obj->obj_ops.get_ref(export->exp_root_obj);
 
+	pending = export->exp_root_pending;
+
 	PTHREAD_RWLOCK_unlock(&export->lock);
 
 	*obj = export->exp_root_obj;
 
 	if (!(*obj))
-		return fsalstat(ERR_FSAL_NOENT, 0);
+		return fsalstat(pending ? ERR_FSAL_DELAY : ERR_FSAL_NOENT, 0);
 
 	if ((*obj)->type != DIRECTORY)
 		return fsalstat(ERR_FSAL_NOTDIR, 0);
@@ -2391,133 +2723,200 @@ void unexport(struct gsh_export *export)
 		release_root_op_context();
 }
 
+struct export_netgroup_state {
+	void (*cb)(const char *group, void *arg);
+	void *arg;
+};
+
+static bool export_netgroups(struct gsh_export *export, void *state)
+{
+	struct export_netgroup_state *ngs = state;
+	struct glist_head *glist;
+	exportlist_client_entry_t *client;
+
+	PTHREAD_RWLOCK_rdlock(&export->lock);
+
+	glist_for_each(glist, &export->clients) {
+		client = glist_entry(glist, exportlist_client_entry_t,
+				     cle_list);
+		if (client->type == NETGROUP_CLIENT)
+			ngs->cb(client->client.netgroup.netgroupname,
+				ngs->arg);
+	}
+
+	PTHREAD_RWLOCK_unlock(&export->lock);
+
+	return true;
+}
+
 /**
- * @brief Match a specific option in the client export list
+ * @brief Call a function on the netgroup of every netgroup client entry
  *
- * @param[in]  hostaddr      Host to search for
- * @param[in]  clients       Client list to search
- * @param[out] client_found Matching entry
- * @param[in]  export_option Option to search for
+ * A netgroup named by several entries is passed once per entry.
  *
- * @return true if found, false otherwise.
+ * @param[in] cb  Function, called with the exports locked
+ * @param[in] arg Argument of cb
  */
-static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
-					       struct gsh_export *export)
+void foreach_export_netgroup(void (*cb)(const char *group, void *arg),
+			     void *arg)
 {
-	struct glist_head *glist;
-	in_addr_t addr = get_in_addr(hostaddr);
-	int rc;
-	int ipvalid = -1;	/* -1 need to print, 0 - invalid, 1 - ok */
+	struct export_netgroup_state ngs = { cb, arg };
+
+	(void) foreach_gsh_export(export_netgroups, &ngs);
+}
+
+/* Per address state for matching client entries, so the address is
+ * formatted and reverse resolved at most once per match.
+ */
+struct client_match_ctx {
+	sockaddr_t *hostaddr;
+	in_addr_t addr;
+	int ipvalid;		/* -1 need to print, 0 - invalid, 1 - ok */
+	int namevalid;		/* -1 need to resolve, 0 - invalid, 1 - ok */
+	bool used_names;	/* a host or netgroup name was consulted */
+	bool name_pending;	/* the name is still being resolved */
 	char hostname[MAXHOSTNAMELEN + 1];
 	char ipstring[SOCK_NAME_MAX + 1];
+};
 
-	glist_for_each(glist, &export->clients) {
-		exportlist_client_entry_t *client;
+static void client_match_init(struct client_match_ctx *ctx,
+			      sockaddr_t *hostaddr)
+{
+	ctx->hostaddr = hostaddr;
+	ctx->addr = get_in_addr(hostaddr);
+	ctx->ipvalid = -1;
+	ctx->namevalid = -1;
+	ctx->used_names = false;
+	ctx->name_pending = false;
+}
 
-		client = glist_entry(glist, exportlist_client_entry_t,
-				     cle_list);
-		LogClientListEntry(NIV_MID_DEBUG,
-				   COMPONENT_EXPORT,
-				   __LINE__,
-				   (char *) __func__,
-				   "Match V4: ",
-				   client);
+static bool client_match_hostname(struct client_match_ctx *ctx)
+{
+	int rc;
 
-		switch (client->type) {
-		case HOSTIF_CLIENT:
-			if (client->client.hostif.clientaddr == addr)
-				return client;
-			break;
+	ctx->used_names = true;
 
-		case NETWORK_CLIENT:
-			if ((client->client.network.netmask & ntohl(addr)) ==
-			    client->client.network.netaddr)
-				return client;
-			break;
+	if (ctx->namevalid >= 0)
+		return ctx->namevalid;
 
-		case NETGROUP_CLIENT:
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
-
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
-			}
+	/** @todo this change from 1.5 is not IPv6
+	 * useful.  come back to this and use the
+	 * string from client mgr inside req_ctx...
+	 */
+	rc = nfs_ip_name_resolve(ctx->hostaddr, ctx->hostname,
+				 sizeof(ctx->hostname));
 
-			if (rc != IP_NAME_SUCCESS)
-				break; /* Fatal failure */
+	/* Until the resolver is done, name entries do not match */
+	ctx->name_pending = rc == IP_NAME_PENDING;
+	ctx->namevalid = rc == IP_NAME_SUCCESS;
+	return ctx->namevalid;
+}
 
-			/* At this point 'hostname' should contain the
-			 * name that was found
-			 */
-			if (ng_innetgr(client->client.netgroup.netgroupname,
-				    hostname)) {
-				return client;
-			}
-			break;
+/**
+ * @brief Match an IPv4 address against one client entry
+ *
+ * @param[in] ctx    Address being matched
+ * @param[in] client Client entry
+ *
+ * @return true if the entry matches.
+ */
+static bool client_match_entry(struct client_match_ctx *ctx,
+			       exportlist_client_entry_t *client)
+{
+	LogClientListEntry(NIV_MID_DEBUG,
+			   COMPONENT_EXPORT,
+			   __LINE__,
+			   (char *) __func__,
+			   "Match V4: ",
+			   client);
 
-		case WILDCARDHOST_CLIENT:
-			/* Now checking for IP wildcards */
-			if (ipvalid < 0)
-				ipvalid = sprint_sockip(hostaddr,
-							ipstring,
-							sizeof(ipstring));
-
-			if (ipvalid &&
-			    (fnmatch(client->client.wildcard.wildcard,
-				     ipstring,
-				     FNM_PATHNAME) == 0)) {
-				return client;
-			}
+	switch (client->type) {
+	case HOSTIF_CLIENT:
+		return client->client.hostif.clientaddr == ctx->addr;
 
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
+	case NETWORK_CLIENT:
+		return (client->client.network.netmask & ntohl(ctx->addr)) ==
+		       client->client.network.netaddr;
 
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
+	case NETGROUP_CLIENT: {
+		bool pending;
+		bool member;
 
-				/** @todo this change from 1.5 is not IPv6
-				 * useful.  come back to this and use the
-				 * string from client mgr inside req_ctx...
-				 */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
-			}
+		if (!client_match_hostname(ctx))
+			return false; /* Fatal failure */
+
+		/* At this point 'hostname' should contain the
+		 * name that was found
+		 */
+		member = ng_innetgr(client->client.netgroup.netgroupname,
+				    ctx->hostname, &pending);
+		if (pending)
+			ctx->name_pending = true;
+		return member;
+	}
 
-			if (rc != IP_NAME_SUCCESS)
-					break;
+	case WILDCARDHOST_CLIENT:
+		/* Now checking for IP wildcards */
+		if (ctx->ipvalid < 0)
+			ctx->ipvalid = sprint_sockip(ctx->hostaddr,
+						     ctx->ipstring,
+						     sizeof(ctx->ipstring));
+
+		if (ctx->ipvalid &&
+		    (fnmatch(client->client.wildcard.wildcard,
+			     ctx->ipstring,
+			     FNM_PATHNAME) == 0)) {
+			return true;
+		}
 
-			/* At this point 'hostname' should contain the
-			 * name that was found
-			 */
-			if (fnmatch
-			    (client->client.wildcard.wildcard, hostname,
-			     FNM_PATHNAME) == 0) {
-				return client;
-			}
-			break;
+		if (!client_match_hostname(ctx))
+			return false;
 
-		case GSSPRINCIPAL_CLIENT:
+		/* At this point 'hostname' should contain the
+		 * name that was found
+		 */
+		return fnmatch(client->client.wildcard.wildcard,
+			       ctx->hostname, FNM_PATHNAME) == 0;
+
+	case GSSPRINCIPAL_CLIENT:
 	  /** @todo BUGAZOMEU a completer lors de l'integration de RPCSEC_GSS */
-			LogCrit(COMPONENT_EXPORT,
-				"Unsupported type GSS_PRINCIPAL_CLIENT");
-			break;
+		LogCrit(COMPONENT_EXPORT,
+			"Unsupported type GSS_PRINCIPAL_CLIENT");
+		return false;
 
-		case HOSTIF_CLIENT_V6:
-			break;
+	case HOSTIF_CLIENT_V6:
+		return false;
 
-		case MATCH_ANY_CLIENT:
-			return client;
+	case MATCH_ANY_CLIENT:
+		return true;
 
-		case BAD_CLIENT:
-		default:
-			continue;
-		}
+	case BAD_CLIENT:
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief Match a specific option in the client export list
+ *
+ * @param[in] ctx    Host to search for
+ * @param[in] export Export whose client list to search
+ *
+ * @return The first matching entry or NULL.
+ */
+static exportlist_client_entry_t *client_match(struct client_match_ctx *ctx,
+					       struct gsh_export *export)
+{
+	struct glist_head *glist;
+
+	glist_for_each(glist, &export->clients) {
+		exportlist_client_entry_t *client;
+
+		client = glist_entry(glist, exportlist_client_entry_t,
+				     cle_list);
+
+		if (client_match_entry(ctx, client))
+			return client;
 	}
 
 	/* no export found for this option */
@@ -2591,8 +2990,354 @@ static exportlist_client_entry_t *client_match_any(sockaddr_t *hostaddr,
 		    (struct sockaddr_in6 *)hostaddr;
 		return client_matchv6(&(psockaddr_in6->sin6_addr), export);
 	} else {
-		return client_match(hostaddr, export);
+		struct client_match_ctx ctx;
+
+		client_match_init(&ctx, hostaddr);
+		return client_match(&ctx, export);
+	}
+}
+
+/* Compiled client lists
+ *
+ * The first entry of an export's client list that matches the caller
+ * decides its permissions.  When the list is committed it is compiled
+ * into a binary trie of its host and network entries, a sorted array
+ * of its IPv6 hosts and the few entries that still need evaluating
+ * (netgroups, wildcards and oddly masked networks).  A lookup walks
+ * the trie once to find the first address entry that matches, then
+ * evaluates only the name entries listed ahead of it.
+ *
+ * The decision is also remembered on the gsh_client, one word per
+ * slot holding the generation of the compiled list, an expiry and the
+ * entry index, so the usual request does no matching at all.  Every
+ * compile takes a new generation, which invalidates all the cached
+ * decisions for the export it replaces.  Decisions that consulted
+ * host or netgroup names expire so DNS and netgroup changes are
+ * picked up.
+ */
+
+#define CLIENT_ACL_NONE UINT32_MAX
+
+struct client_acl_node {
+	uint32_t child[2];	/*< node index, 0 for none */
+	uint32_t first;		/*< first entry ending at this node */
+};
+
+struct client_acl_v6 {
+	struct in6_addr addr;
+	uint32_t first;
+};
+
+struct client_acl {
+	uint32_t gen;		/*< generation, never 0 */
+	uint32_t count;		/*< number of entries */
+	exportlist_client_entry_t **entries;	/*< in list order */
+	uint32_t first_any;	/*< first MATCH_ANY_CLIENT entry */
+	struct client_acl_node *nodes;	/*< trie, root at 0 */
+	uint32_t nnodes;
+	uint32_t nodes_size;
+	uint32_t *slow;		/*< IPv4 entries to evaluate, in order */
+	uint32_t nslow;
+	struct client_acl_v6 *v6;	/*< sorted by address */
+	uint32_t nv6;
+};
+
+static uint32_t client_acl_gen;
+
+#define ACL_CACHE_IDX_NONE 0xffff
+#define ACL_CACHE_TICK_SHIFT 4	/*< expiry in 16 second ticks */
+#define ACL_CACHE_NAME_TTL 60	/*< seconds a name decision is kept */
+
+static void client_acl_insert(struct client_acl *acl, uint32_t key,
+			      int len, uint32_t first)
+{
+	uint32_t n = 0;
+	int bit;
+
+	for (bit = 31; bit >= 32 - len; bit--) {
+		uint32_t b = (key >> bit) & 1;
+
+		if (acl->nodes[n].child[b] == 0) {
+			if (acl->nnodes == acl->nodes_size) {
+				acl->nodes_size *= 2;
+				acl->nodes = gsh_realloc(acl->nodes,
+					acl->nodes_size * sizeof(*acl->nodes));
+			}
+			acl->nodes[acl->nnodes].child[0] = 0;
+			acl->nodes[acl->nnodes].child[1] = 0;
+			acl->nodes[acl->nnodes].first = CLIENT_ACL_NONE;
+			acl->nodes[n].child[b] = acl->nnodes++;
+		}
+		n = acl->nodes[n].child[b];
 	}
+
+	/* Entries are added in list order, so the earliest one wins */
+	if (acl->nodes[n].first == CLIENT_ACL_NONE)
+		acl->nodes[n].first = first;
+}
+
+static int client_acl_v6_cmp(const void *a, const void *b)
+{
+	const struct client_acl_v6 *l = a, *r = b;
+	int rc = memcmp(&l->addr, &r->addr, sizeof(l->addr));
+
+	if (rc != 0)
+		return rc;
+
+	return l->first < r->first ? -1 : l->first > r->first;
+}
+
+/**
+ * @brief Compile a client list
+ *
+ * @param[in] clients Client list, which must outlive the result
+ *
+ * @return The compiled list.
+ */
+static struct client_acl *client_acl_build(struct glist_head *clients)
+{
+	struct client_acl *acl = gsh_calloc(1, sizeof(*acl));
+	struct glist_head *glist;
+	uint32_t i = 0;
+
+	acl->gen = atomic_inc_uint32_t(&client_acl_gen);
+	if (acl->gen == 0)
+		acl->gen = atomic_inc_uint32_t(&client_acl_gen);
+
+	acl->count = glist_length(clients);
+	acl->first_any = CLIENT_ACL_NONE;
+	acl->entries = gsh_calloc(acl->count + 1, sizeof(*acl->entries));
+	acl->slow = gsh_calloc(acl->count + 1, sizeof(*acl->slow));
+	acl->v6 = gsh_calloc(acl->count + 1, sizeof(*acl->v6));
+	acl->nodes_size = 64;
+	acl->nodes = gsh_malloc(acl->nodes_size * sizeof(*acl->nodes));
+	acl->nodes[0].child[0] = 0;
+	acl->nodes[0].child[1] = 0;
+	acl->nodes[0].first = CLIENT_ACL_NONE;
+	acl->nnodes = 1;
+
+	glist_for_each(glist, clients) {
+		exportlist_client_entry_t *client;
+		uint32_t mask, key;
+		int len;
+
+		client = glist_entry(glist, exportlist_client_entry_t,
+				     cle_list);
+		acl->entries[i] = client;
+
+		switch (client->type) {
+		case HOSTIF_CLIENT:
+			key = ntohl(client->client.hostif.clientaddr);
+			client_acl_insert(acl, key, 32, i);
+			break;
+
+		case NETWORK_CLIENT:
+			mask = client->client.network.netmask;
+			len = __builtin_popcount(mask);
+
+			if (client->client.network.netaddr & ~mask) {
+				/* Can never match */
+				break;
+			}
+
+			if (len != 0 && mask != UINT32_MAX << (32 - len)) {
+				/* Not a prefix, evaluate it the slow way */
+				acl->slow[acl->nslow++] = i;
+				break;
+			}
+
+			client_acl_insert(acl, client->client.network.netaddr,
+					  len, i);
+			break;
+
+		case NETGROUP_CLIENT:
+		case WILDCARDHOST_CLIENT:
+		case GSSPRINCIPAL_CLIENT:
+			acl->slow[acl->nslow++] = i;
+			break;
+
+		case HOSTIF_CLIENT_V6:
+			acl->v6[acl->nv6].addr =
+				client->client.hostif.clientaddr6;
+			acl->v6[acl->nv6++].first = i;
+			break;
+
+		case MATCH_ANY_CLIENT:
+			if (acl->first_any == CLIENT_ACL_NONE)
+				acl->first_any = i;
+			break;
+
+		case BAD_CLIENT:
+		default:
+			break;
+		}
+
+		i++;
+	}
+
+	qsort(acl->v6, acl->nv6, sizeof(*acl->v6), client_acl_v6_cmp);
+
+	return acl;
+}
+
+static void client_acl_free(struct client_acl *acl)
+{
+	if (acl == NULL)
+		return;
+
+	gsh_free(acl->entries);
+	gsh_free(acl->slow);
+	gsh_free(acl->v6);
+	gsh_free(acl->nodes);
+	gsh_free(acl);
+}
+
+/**
+ * @brief Find the first matching entry of a compiled client list
+ *
+ * @return The entry index or CLIENT_ACL_NONE.
+ */
+static uint32_t client_acl_match(struct client_acl *acl,
+				 struct client_match_ctx *ctx)
+{
+	uint32_t best = acl->first_any;
+	uint32_t key = ntohl(ctx->addr);
+	uint32_t n = 0;
+	uint32_t i;
+	int bit = 31;
+
+	for (;;) {
+		if (acl->nodes[n].first < best)
+			best = acl->nodes[n].first;
+		if (bit < 0)
+			break;
+		n = acl->nodes[n].child[(key >> bit--) & 1];
+		if (n == 0)
+			break;
+	}
+
+	for (i = 0; i < acl->nslow && acl->slow[i] < best; i++) {
+		if (client_match_entry(ctx, acl->entries[acl->slow[i]]))
+			return acl->slow[i];
+	}
+
+	return best;
+}
+
+static uint32_t client_acl_match_v6(struct client_acl *acl,
+				    struct in6_addr *paddrv6)
+{
+	uint32_t lo = 0, hi = acl->nv6;
+
+	/* Find the lowest index entry for the address */
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (memcmp(&acl->v6[mid].addr, paddrv6, sizeof(*paddrv6)) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < acl->nv6 &&
+	    memcmp(&acl->v6[lo].addr, paddrv6, sizeof(*paddrv6)) == 0 &&
+	    acl->v6[lo].first < acl->first_any)
+		return acl->v6[lo].first;
+
+	return acl->first_any;
+}
+
+static bool client_acl_cached(struct gsh_client *gsh_client,
+			      struct client_acl *acl,
+			      uint16_t export_id, uint32_t *idx)
+{
+	uint64_t v = atomic_fetch_uint64_t(
+		&gsh_client->acl_cache[export_id % GSH_CLIENT_ACL_SLOTS]);
+	uint16_t expire = (v >> 16) & 0xffff;
+	uint16_t tick = time(NULL) >> ACL_CACHE_TICK_SHIFT;
+
+	if ((uint32_t) (v >> 32) != acl->gen)
+		return false;
+
+	if (expire != 0 && (int16_t) (expire - tick) <= 0)
+		return false;
+
+	*idx = v & 0xffff;
+	if (*idx == ACL_CACHE_IDX_NONE)
+		*idx = CLIENT_ACL_NONE;
+
+	return true;
+}
+
+static void client_acl_cache(struct gsh_client *gsh_client,
+			     struct client_acl *acl, uint16_t export_id,
+			     uint32_t idx, bool used_names)
+{
+	uint16_t expire = 0;
+
+	if (acl->count >= ACL_CACHE_IDX_NONE)
+		return;
+
+	if (used_names) {
+		expire = (time(NULL) + ACL_CACHE_NAME_TTL) >>
+			 ACL_CACHE_TICK_SHIFT;
+		if (expire == 0)
+			expire = 1;
+	}
+
+	atomic_store_uint64_t(
+		&gsh_client->acl_cache[export_id % GSH_CLIENT_ACL_SLOTS],
+		(uint64_t) acl->gen << 32 | (uint64_t) expire << 16 |
+		(idx == CLIENT_ACL_NONE ? ACL_CACHE_IDX_NONE : idx));
+}
+
+/**
+ * @brief Find the client entry of an export that applies to a caller
+ *
+ * Must be called with the export lock held.
+ *
+ * @param[in] hostaddr   Caller address
+ * @param[in] export     Export
+ * @param[in] gsh_client Caller, may be NULL
+ *
+ * @return The first matching entry or NULL.
+ */
+static exportlist_client_entry_t *client_match_export(
+					sockaddr_t *hostaddr,
+					struct gsh_export *export,
+					struct gsh_client *gsh_client)
+{
+	struct client_acl *acl = export->client_acl;
+	struct client_match_ctx ctx;
+	uint32_t idx;
+
+	if (acl == NULL)
+		return client_match_any(hostaddr, export);
+
+	if (gsh_client != NULL &&
+	    client_acl_cached(gsh_client, acl, export->export_id, &idx))
+		goto out;
+
+	if (hostaddr->ss_family == AF_INET6) {
+		struct sockaddr_in6 *psockaddr_in6 =
+		    (struct sockaddr_in6 *)hostaddr;
+
+		ctx.used_names = false;
+		ctx.name_pending = false;
+		idx = client_acl_match_v6(acl, &psockaddr_in6->sin6_addr);
+	} else {
+		client_match_init(&ctx, hostaddr);
+		idx = client_acl_match(acl, &ctx);
+	}
+
+	/* A decision made without the name is not remembered, the next
+	 * request gets to use it. */
+	if (gsh_client != NULL && !ctx.name_pending)
+		client_acl_cache(gsh_client, acl, export->export_id, idx,
+				 ctx.used_names);
+
+ out:
+	return idx == CLIENT_ACL_NONE ? NULL : acl->entries[idx];
 }
 
 /**
@@ -2856,7 +3601,8 @@ void export_check_access(void)
 	}
 
 	/* Does the client match anyone on the client list? */
-	client = client_match_any(hostaddr, op_ctx->ctx_export);
+	client = client_match_export(hostaddr, op_ctx->ctx_export,
+				     op_ctx->client);
 	if (client != NULL) {
 		/* Take client options */
 		op_ctx->export_perms->options = client->client_perms.options &
@@ -2930,6 +3676,12 @@ void export_check_access(void)
 
 	op_ctx->export_perms->set |= export_opt.def.set;
 
+	/* Nobody writes to an immutable export, whatever the client list
+	 * says, so write requests are refused before they lock anything.
+	 */
+	if (op_ctx->ctx_export != NULL && export_immutable(op_ctx->ctx_export))
+		op_ctx->export_perms->options &= ~EXPORT_OPTION_MODIFY_ACCESS;
+
 	if (isMidDebug(COMPONENT_EXPORT)) {
 		char perms[1024];
 		struct display_buffer dspbuf = {sizeof(perms), perms, perms};
@@ -0,0 +1,305 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file flight_rec.c
+ * @brief Always-on binary event recorder
+ *
+ * Recording an event is a clock read and a 32 byte store in the ring
+ * of the thread, no lock and no formatting.  A ring holds the last
+ * Flight_Recorder_Events events of its thread.  Rings of threads that
+ * exited are kept, with their events, until a new thread takes them.
+ *
+ * The dump is written with plain write() calls so that it can be
+ * taken from a fatal signal handler.  It is:
+ *
+ * - FLIGHT_REC_MAGIC, then the event size and the number of rings, as
+ *   uint32_t;
+ * - for each ring, a struct flight_rec_ring_hdr, then its nevents
+ *   events in slot order.  Slot head % nevents holds the oldest event
+ *   once head reaches nevents.
+ *
+ * Everything is in host byte order.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "log.h"
+#include "gsh_list.h"
+#include "abstract_mem.h"
+#include "flight_rec.h"
+
+struct flight_rec_ring_hdr {
+	uint32_t tid;
+	uint32_t nevents;
+	uint64_t head;		/*< Events recorded, the next slot */
+	char name[16];		/*< Thread name */
+};
+
+struct flight_rec_ring {
+	struct glist_head rings;	/*< Link in fr_rings or fr_free */
+	struct flight_rec_ring_hdr hdr;
+	struct flight_rec_event events[];
+};
+
+bool flight_rec_enabled;
+
+static uint32_t fr_nevents;
+static char *fr_path;
+static pthread_mutex_t fr_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t fr_key;
+static __thread struct flight_rec_ring *fr_ring;
+
+/* Rings of live threads, then rings of exited threads */
+static struct glist_head fr_rings = GLIST_HEAD_INIT(fr_rings);
+static struct glist_head fr_free = GLIST_HEAD_INIT(fr_free);
+static uint32_t fr_count;
+
+extern __thread char thread_name[16];
+
+static void fr_ring_release(void *arg)
+{
+	struct flight_rec_ring *ring = arg;
+
+	PTHREAD_MUTEX_lock(&fr_mtx);
+	glist_del(&ring->rings);
+	glist_add_tail(&fr_free, &ring->rings);
+	PTHREAD_MUTEX_unlock(&fr_mtx);
+}
+
+static struct flight_rec_ring *fr_ring_get(void)
+{
+	struct flight_rec_ring *ring;
+
+	PTHREAD_MUTEX_lock(&fr_mtx);
+	ring = glist_first_entry(&fr_free, struct flight_rec_ring, rings);
+	if (ring != NULL) {
+		glist_del(&ring->rings);
+		ring->hdr.head = 0;
+	} else {
+		ring = gsh_calloc(1, sizeof(*ring) +
+				     fr_nevents * sizeof(ring->events[0]));
+		ring->hdr.nevents = fr_nevents;
+		fr_count++;
+	}
+	ring->hdr.tid = syscall(SYS_gettid);
+	memcpy(ring->hdr.name, thread_name, sizeof(ring->hdr.name));
+	glist_add_tail(&fr_rings, &ring->rings);
+	PTHREAD_MUTEX_unlock(&fr_mtx);
+
+	(void) pthread_setspecific(fr_key, ring);
+	fr_ring = ring;
+
+	return ring;
+}
+
+/**
+ * @brief Record an event in the ring of the thread
+ *
+ * @param[in] type   What happened
+ * @param[in] xid    RPC xid of the request
+ * @param[in] op     Operation, see enum flight_rec_type
+ * @param[in] status Status, see enum flight_rec_type
+ * @param[in] arg    Argument, see enum flight_rec_type
+ */
+
+void flight_rec_event(enum flight_rec_type type, uint32_t xid, uint16_t op,
+		      int32_t status, uint64_t arg)
+{
+	struct flight_rec_ring *ring = fr_ring;
+	struct flight_rec_event *ev;
+	struct timespec ts;
+
+	if (ring == NULL)
+		ring = fr_ring_get();
+
+	(void) clock_gettime(CLOCK_REALTIME, &ts);
+
+	ev = &ring->events[ring->hdr.head % ring->hdr.nevents];
+	ev->ts = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	ev->xid = xid;
+	ev->type = type;
+	ev->op = op;
+	ev->status = status;
+	ev->arg = arg;
+	ring->hdr.head++;
+}
+
+static bool fr_write(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+static bool fr_write_list(int fd, struct glist_head *list)
+{
+	struct glist_head *glist;
+	struct flight_rec_ring *ring;
+
+	glist_for_each(glist, list) {
+		ring = glist_entry(glist, struct flight_rec_ring, rings);
+		if (!fr_write(fd, &ring->hdr, sizeof(ring->hdr)) ||
+		    !fr_write(fd, ring->events,
+			      ring->hdr.nevents * sizeof(ring->events[0])))
+			return false;
+	}
+
+	return true;
+}
+
+/* Only calls async-signal-safe functions */
+static int fr_dump_rings(const char *path)
+{
+	uint32_t sizes[2] = {sizeof(struct flight_rec_event), fr_count};
+	int fd, rc = 0;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return errno;
+
+	if (!fr_write(fd, FLIGHT_REC_MAGIC, strlen(FLIGHT_REC_MAGIC)) ||
+	    !fr_write(fd, sizes, sizeof(sizes)) ||
+	    !fr_write_list(fd, &fr_rings) ||
+	    !fr_write_list(fd, &fr_free))
+		rc = errno != 0 ? errno : EIO;
+
+	if (close(fd) != 0 && rc == 0)
+		rc = errno;
+
+	return rc;
+}
+
+/**
+ * @brief Write the rings to a file
+ *
+ * Threads keep recording meanwhile, so the newest events of a ring may
+ * be torn.
+ *
+ * @param[in] path File to write, Flight_Recorder_File if NULL
+ *
+ * @return 0 or an errno.
+ */
+
+int flight_rec_dump(const char *path)
+{
+	int rc;
+
+	if (!flight_rec_enabled)
+		return ENOENT;
+
+	if (path == NULL)
+		path = fr_path;
+
+	PTHREAD_MUTEX_lock(&fr_mtx);
+	rc = fr_dump_rings(path);
+	PTHREAD_MUTEX_unlock(&fr_mtx);
+
+	if (rc != 0)
+		LogCrit(COMPONENT_INIT,
+			"Could not write flight recorder to %s: %s",
+			path, strerror(rc));
+	else
+		LogEvent(COMPONENT_INIT, "Wrote flight recorder to %s", path);
+
+	return rc;
+}
+
+/**
+ * @brief Dump the rings and let the signal take its course
+ *
+ * The rings are walked without fr_mtx, the thread that faulted may hold
+ * it.
+ */
+
+static void fr_fatal_signal(int sig)
+{
+	int save_errno = errno;
+
+	(void) fr_dump_rings(fr_path);
+	errno = save_errno;
+
+	/* SA_RESETHAND restored the default action, re-raise for the core */
+	(void) raise(sig);
+}
+
+/**
+ * @brief Start the recorder
+ *
+ * @param[in] events Events kept per thread, 0 to record nothing
+ * @param[in] path   Where to dump the rings on a fatal signal
+ */
+
+void flight_rec_init(uint32_t events, const char *path)
+{
+	static const int fatal_signals[] = {
+		SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT
+	};
+	struct sigaction act;
+	int i;
+
+	if (events == 0 || flight_rec_enabled)
+		return;
+
+	if (pthread_key_create(&fr_key, fr_ring_release) != 0) {
+		LogCrit(COMPONENT_INIT, "Could not start the flight recorder");
+		return;
+	}
+
+	fr_nevents = events;
+	fr_path = gsh_strdup(path);
+
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = fr_fatal_signal;
+	act.sa_flags = SA_RESETHAND | SA_NODEFER;
+	sigemptyset(&act.sa_mask);
+
+	for (i = 0; i < sizeof(fatal_signals) / sizeof(fatal_signals[0]);
+	     i++)
+		if (sigaction(fatal_signals[i], &act, NULL) != 0)
+			LogWarn(COMPONENT_INIT,
+				"Could not arm signal %d for the flight recorder: %s",
+				fatal_signals[i], strerror(errno));
+
+	flight_rec_enabled = true;
+
+	LogInfo(COMPONENT_INIT,
+		"Flight recorder keeping %u events per thread, dumped to %s",
+		events, path);
+}
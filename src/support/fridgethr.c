@@ -47,6 +47,7 @@
 #include <signal.h>
 #endif
 #include "abstract_mem.h"
+#include "abstract_atomic.h"
 #include "fridgethr.h"
 #include "nfs_core.h"
 
@@ -99,6 +100,7 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 	frobj->s = NULL;
 	frobj->nthreads = 0;
 	frobj->nidle = 0;
+	frobj->nretire = 0;
 	frobj->flags = fridgethr_flag_none;
 
 	/* This always succeeds on Linux, but it might fail on other
@@ -170,6 +172,27 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 			rc = EINVAL;
 			goto out;
 		}
+	} else if (frobj->p.flavor == fridgethr_flavor_stealer) {
+		uint32_t i;
+
+		if ((frobj->p.thr_max == 0) ||
+		    (frobj->p.deferment != fridgethr_defer_queue)) {
+			LogMajor(COMPONENT_THREAD,
+				 "Stealer fridge %s needs a maximum thread count and queued deferment.",
+				 s);
+			rc = EINVAL;
+			goto out;
+		}
+		frobj->steal.inject = NULL;
+		frobj->steal.wake_pending = 0;
+		frobj->steal.deques =
+			gsh_calloc(frobj->p.thr_max,
+				   sizeof(struct fridgethr_deque));
+		for (i = 0; i < frobj->p.thr_max; i++) {
+			PTHREAD_MUTEX_init(&frobj->steal.deques[i].mtx, NULL);
+			glist_init(&frobj->steal.deques[i].q);
+		}
+		PTHREAD_COND_init(&frobj->steal.cond, NULL);
 	} else if (frobj->p.flavor == fridgethr_flavor_looper) {
 		if (frobj->p.deferment != fridgethr_defer_fail) {
 			LogMajor(COMPONENT_THREAD,
@@ -221,6 +244,14 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 
 void fridgethr_destroy(struct fridgethr *fr)
 {
+	if (fr->p.flavor == fridgethr_flavor_stealer) {
+		uint32_t i;
+
+		for (i = 0; i < fr->p.thr_max; i++)
+			PTHREAD_MUTEX_destroy(&fr->steal.deques[i].mtx);
+		gsh_free(fr->steal.deques);
+		PTHREAD_COND_destroy(&fr->steal.cond);
+	}
 	PTHREAD_MUTEX_destroy(&fr->mtx);
 	pthread_attr_destroy(&fr->attr);
 	gsh_free(fr->s);
@@ -265,6 +296,32 @@ static void fridgethr_finish_transition(struct fridgethr *fr, bool locked)
 	fr->transitioning = false;
 }
 
+/**
+ * @brief Test whether a stealer fridge has work anywhere
+ *
+ * Lock-free, so only a hint unless the submitters and thieves are
+ * known to be quiet.
+ *
+ * @param[in] fr The fridge
+ *
+ * @return true if the injector or a deque holds work.
+ */
+
+static bool fridgethr_steal_pending(struct fridgethr *fr)
+{
+	uint32_t i;
+
+	if (atomic_fetch_voidptr((void **)&fr->steal.inject) != NULL)
+		return true;
+
+	for (i = 0; i < fr->p.thr_max; i++) {
+		if (atomic_fetch_uint32_t(&fr->steal.deques[i].len) != 0)
+			return true;
+	}
+
+	return false;
+}
+
 /**
  * @brief Test whether the fridge has deferred work waiting
  *
@@ -277,6 +334,9 @@ static bool fridgethr_deferredwork(struct fridgethr *fr)
 {
 	bool res = false;
 
+	if (fr->p.flavor == fridgethr_flavor_stealer)
+		return fridgethr_steal_pending(fr);
+
 	switch (fr->p.deferment) {
 	case fridgethr_defer_queue:
 		res = !glist_empty(&fr->deferment.work_q);
@@ -329,6 +389,267 @@ static bool fridgethr_getwork(struct fridgethr *fr, struct fridgethr_entry *fe)
 	}
 }
 
+/**
+ * @brief Wake a parked thread in a stealer fridge
+ *
+ * Only one wake-up is outstanding at a time, so a burst of
+ * submissions to parked threads costs one signal.  The thread that
+ * wakes takes the whole burst off the injector and wakes the next
+ * one if it has more than it can start on, which then steals half.
+ *
+ * @param[in] fr The fridge
+ *
+ * @retval true if a parked thread is on its way.
+ * @retval false if none is parked or the fridge is paused.
+ */
+
+static bool fridgethr_steal_wake(struct fridgethr *fr)
+{
+	bool woken = true;
+
+	if (fr->command == fridgethr_comm_pause ||
+	    atomic_fetch_uint32_t(&fr->nidle) == 0)
+		return false;
+
+	if (!atomic_cas_uint32_t(&fr->steal.wake_pending, 0, 1))
+		return true;
+
+	PTHREAD_MUTEX_lock(&fr->mtx);
+	if (fr->nidle == 0) {
+		/* They all left, nobody is there to clear it. */
+		atomic_store_uint32_t(&fr->steal.wake_pending, 0);
+		woken = false;
+	} else {
+		pthread_cond_signal(&fr->steal.cond);
+	}
+	PTHREAD_MUTEX_unlock(&fr->mtx);
+
+	return woken;
+}
+
+/**
+ * @brief Give a new stealer thread a deque
+ *
+ * @note This function must be called with the fridge mutex held.
+ *
+ * @param[in,out] fr Fridge
+ * @param[in,out] fe Fridge entry
+ */
+
+static void fridgethr_steal_slot(struct fridgethr *fr,
+				 struct fridgethr_entry *fe)
+{
+	uint32_t i;
+
+	for (i = 0; i < fr->p.thr_max; i++) {
+		if (!fr->steal.deques[i].used)
+			break;
+	}
+
+	/* We never have more threads than deques. */
+	assert(i < fr->p.thr_max);
+	fe->dq = &fr->steal.deques[i];
+	fe->dq->used = true;
+}
+
+/**
+ * @brief Load the first of some work into a thread, queue the rest
+ *
+ * @param[in]     fr   Fridge
+ * @param[in,out] fe   Fridge entry
+ * @param[in,out] work Jobs, oldest first, not empty.  Emptied.
+ */
+
+static void fridgethr_steal_load(struct fridgethr *fr,
+				 struct fridgethr_entry *fe,
+				 struct glist_head *work)
+{
+	struct fridgethr_work *q = glist_first_entry(work,
+						     struct fridgethr_work,
+						     link);
+	size_t n;
+
+	glist_del(&q->link);
+	fe->ctx.func = q->func;
+	fe->ctx.arg = q->arg;
+	gsh_free(q);
+
+	if (glist_empty(work))
+		return;
+
+	n = glist_length(work);
+	PTHREAD_MUTEX_lock(&fe->dq->mtx);
+	glist_splice_tail(&fe->dq->q, work);
+	atomic_store_uint32_t(&fe->dq->len, fe->dq->len + n);
+	PTHREAD_MUTEX_unlock(&fe->dq->mtx);
+
+	/* More than we can start on, let a parked thread have some. */
+	(void) fridgethr_steal_wake(fr);
+}
+
+/**
+ * @brief Take up to half the jobs of a deque, oldest first
+ *
+ * @param[in,out] dq   The deque
+ * @param[in]     one  Take one job rather than half
+ * @param[out]    work Where to put them
+ */
+
+static void fridgethr_steal_take(struct fridgethr_deque *dq, bool one,
+				 struct glist_head *work)
+{
+	struct fridgethr_work *q;
+	uint32_t n;
+
+	if (atomic_fetch_uint32_t(&dq->len) == 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&dq->mtx);
+	n = one ? (dq->len != 0) : (dq->len + 1) / 2;
+	atomic_store_uint32_t(&dq->len, dq->len - n);
+	while (n-- > 0) {
+		q = glist_first_entry(&dq->q, struct fridgethr_work, link);
+		glist_del(&q->link);
+		glist_add_tail(work, &q->link);
+	}
+	PTHREAD_MUTEX_unlock(&dq->mtx);
+}
+
+/**
+ * @brief Get work for a stealer thread
+ *
+ * Work is taken from our own deque, then all at once from the
+ * injector, then by stealing from the other threads.
+ *
+ * @param[in,out] fr Fridge
+ * @param[in,out] fe Fridge entry
+ *
+ * @return true if work has been loaded into the context.
+ */
+
+static bool fridgethr_steal_getwork(struct fridgethr *fr,
+				    struct fridgethr_entry *fe)
+{
+	struct fridgethr_work *head, *q, *next;
+	struct glist_head work;
+	uint32_t start, i;
+
+	glist_init(&work);
+
+	fridgethr_steal_take(fe->dq, true, &work);
+	if (!glist_empty(&work)) {
+		fridgethr_steal_load(fr, fe, &work);
+		return true;
+	}
+
+	/* Taking the whole stack can't suffer ABA, only the pointer
+	   is compared. */
+	do {
+		head = atomic_fetch_voidptr((void **)&fr->steal.inject);
+	} while (head != NULL &&
+		 !atomic_cas_voidptr((void **)&fr->steal.inject, head, NULL));
+
+	if (head != NULL) {
+		/* The stack is newest first, adding each at the front
+		   puts the oldest first. */
+		for (q = head; q != NULL; q = next) {
+			next = q->next;
+			glist_add(&work, &q->link);
+		}
+		fridgethr_steal_load(fr, fe, &work);
+		return true;
+	}
+
+	start = fe->dq - fr->steal.deques;
+	for (i = 1; i < fr->p.thr_max; i++) {
+		fridgethr_steal_take(
+			&fr->steal.deques[(start + i) % fr->p.thr_max],
+			false, &work);
+		if (!glist_empty(&work)) {
+			fridgethr_steal_load(fr, fe, &work);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief Wait for more work in a stealer fridge
+ *
+ * Threads look everywhere for work before they park.  Parked
+ * threads count in nidle, which submitters check after pushing
+ * their work and parking threads increment before looking for work
+ * one last time, so one of them always sees the other.
+ *
+ * @param[in,out] fr Fridge
+ * @param[in,out] fe Fridge entry
+ *
+ * @retval true if we have more work to do.
+ * @retval false if we need to go away.
+ */
+
+static bool fridgethr_steal_freeze(struct fridgethr *fr,
+				   struct fridgethr_entry *fe)
+{
+	struct timespec ts;
+	int rc = 0;
+
+	while (true) {
+		if (fr->command != fridgethr_comm_pause &&
+		    fridgethr_steal_getwork(fr, fe))
+			return true;
+
+		PTHREAD_MUTEX_lock(&fr->mtx);
+
+		if ((rc == ETIMEDOUT && fr->nthreads > fr->p.thr_min &&
+		     !fridgethr_steal_pending(fr)) ||
+		    (fr->command == fridgethr_comm_stop &&
+		     !fridgethr_steal_pending(fr))) {
+			/* Our deque is empty, only we fill it. */
+			fe->dq->used = false;
+			--(fr->nthreads);
+			glist_del(&fe->thread_link);
+			if ((fr->nthreads == 0) &&
+			    (fr->command == fridgethr_comm_stop) &&
+			    (fr->transitioning)) {
+				/* We're the last thread to exit, signal
+				   the transition to stop complete. */
+				fridgethr_finish_transition(fr, false);
+			}
+			PTHREAD_MUTEX_unlock(&fr->mtx);
+			return false;
+		}
+
+		(void) atomic_inc_uint32_t(&fr->nidle);
+		if ((fr->nidle == fr->nthreads) &&
+		    (fr->command == fridgethr_comm_pause) &&
+		    (fr->transitioning)) {
+			/* We're the last thread to suspend, signal the
+			   transition to pause complete. */
+			fridgethr_finish_transition(fr, false);
+		}
+
+		rc = 0;
+		if (fr->command == fridgethr_comm_pause ||
+		    !fridgethr_steal_pending(fr)) {
+			if (fr->p.thread_delay > 0) {
+				clock_gettime(CLOCK_REALTIME, &ts);
+				ts.tv_sec += fr->p.thread_delay;
+				rc = pthread_cond_timedwait(&fr->steal.cond,
+							    &fr->mtx, &ts);
+			} else {
+				rc = pthread_cond_wait(&fr->steal.cond,
+						       &fr->mtx);
+			}
+			atomic_store_uint32_t(&fr->steal.wake_pending, 0);
+		}
+		(void) atomic_dec_uint32_t(&fr->nidle);
+
+		PTHREAD_MUTEX_unlock(&fr->mtx);
+	}
+}
+
 /**
  * @brief Wait for more work
  *
@@ -355,6 +676,9 @@ static bool fridgethr_freeze(struct fridgethr *fr,
 	/* Return code from system calls */
 	int rc = 0;
 
+	if (fr->p.flavor == fridgethr_flavor_stealer)
+		return fridgethr_steal_freeze(fr, fe);
+
 	PTHREAD_MUTEX_lock(&fr->mtx);
  restart:
 	/* If we are not paused and there is work left to do in the
@@ -367,7 +691,10 @@ static bool fridgethr_freeze(struct fridgethr *fr,
 
 	/* rc would have been set in the while loop below */
 	if (((rc == ETIMEDOUT) && (fr->nthreads > fr->p.thr_min))
-	    || (fr->command == fridgethr_comm_stop)) {
+	    || (fr->command == fridgethr_comm_stop)
+	    || (fr->nretire > 0 && fr->nthreads > fr->p.thr_min)) {
+		if (fr->nretire > 0)
+			--(fr->nretire);
 		/* We do this here since we already have the fridge
 		   lock. */
 		--(fr->nthreads);
@@ -596,6 +923,8 @@ static int fridgethr_spawn(struct fridgethr *fr,
 
 	glist_init(&fe->thread_link);
 	fe->fr = fr;
+	if (fr->p.flavor == fridgethr_flavor_stealer)
+		fridgethr_steal_slot(fr, fe);
 	rc = pthread_mutex_init(&fe->ctx.mtx, NULL);
 	if (rc != 0) {
 		LogMajor(COMPONENT_THREAD,
@@ -649,6 +978,9 @@ static int fridgethr_spawn(struct fridgethr *fr,
 	if (mutexed)
 		PTHREAD_MUTEX_destroy(&fe->ctx.mtx);
 
+	if (fe->dq != NULL)
+		fe->dq->used = false;
+
 	gsh_free(fe);
 	PTHREAD_MUTEX_unlock(&fr->mtx);
 
@@ -803,6 +1135,70 @@ static int fridgethr_block(struct fridgethr *fr,
 	return rc;
 }
 
+/**
+ * @brief Slightly stupid workaround for an unlikely case
+ *
+ * @param[in] dummy Ignored
+ */
+static void fridgethr_noop(struct fridgethr_context *dummy)
+{
+	/* return */
+}
+
+/**
+ * @brief Submit to a stealer fridge
+ *
+ * The work is pushed on the injector without taking the fridge
+ * mutex, which is only taken to wake a parked thread or to spawn
+ * one.
+ *
+ * @param[in] fr   The fridge
+ * @param[in] func The thing to do
+ * @param[in] arg  The thing to do it to
+ *
+ * @return 0 or POSIX errors.
+ */
+
+static int fridgethr_steal_submit(struct fridgethr *fr,
+				  void (*func)(struct fridgethr_context *),
+				  void *arg)
+{
+	struct fridgethr_work *q;
+
+	if (fr->command == fridgethr_comm_stop) {
+		LogMajor(COMPONENT_THREAD,
+			 "Attempt to schedule job in stopped fridge %s.",
+			 fr->s);
+		return EPIPE;
+	}
+
+	q = gsh_malloc(sizeof(struct fridgethr_work));
+	q->func = func;
+	q->arg = arg;
+
+	do {
+		q->next = atomic_fetch_voidptr((void **)&fr->steal.inject);
+	} while (!atomic_cas_voidptr((void **)&fr->steal.inject, q->next, q));
+
+	if (fridgethr_steal_wake(fr))
+		return 0;
+
+	/* Busy threads look at the injector before they park. */
+	if (atomic_fetch_uint32_t(&fr->nthreads) >= fr->p.thr_max)
+		return 0;
+
+	PTHREAD_MUTEX_lock(&fr->mtx);
+	if ((fr->nthreads >= fr->p.thr_max) ||
+	    (fr->command == fridgethr_comm_pause) ||
+	    (fr->command == fridgethr_comm_stop && fr->nthreads > 0)) {
+		PTHREAD_MUTEX_unlock(&fr->mtx);
+		return 0;
+	}
+
+	/* If we raced a stop, this drains what we queued. */
+	return fridgethr_spawn(fr, fridgethr_noop, NULL);
+}
+
 /**
  * @brief Schedule a thread to perform a function
  *
@@ -833,6 +1229,9 @@ int fridgethr_submit(struct fridgethr *fr,
 		return EPIPE;
 	}
 
+	if (fr->p.flavor == fridgethr_flavor_stealer)
+		return fridgethr_steal_submit(fr, func, arg);
+
 	PTHREAD_MUTEX_lock(&fr->mtx);
 	if (fr->command == fridgethr_comm_stop) {
 		LogMajor(COMPONENT_THREAD,
@@ -918,6 +1317,9 @@ int fridgethr_wake(struct fridgethr *fr)
 		PTHREAD_MUTEX_unlock(&fe->ctx.mtx);
 	}
 
+	if (fr->p.flavor == fridgethr_flavor_stealer)
+		pthread_cond_broadcast(&fr->steal.cond);
+
 	PTHREAD_MUTEX_unlock(&fr->mtx);
 	return 0;
 }
@@ -995,16 +1397,6 @@ int fridgethr_pause(struct fridgethr *fr, pthread_mutex_t *mtx,
 	return 0;
 }
 
-/**
- * @brief Slightly stupid workaround for an unlikely case
- *
- * @param[in] dummy Ignored
- */
-static void fridgethr_noop(struct fridgethr_context *dummy)
-{
-	/* return */
-}
-
 /**
  * @brief Stop execution in the fridge
  *
@@ -1099,11 +1491,14 @@ int fridgethr_stop(struct fridgethr *fr, pthread_mutex_t *mtx,
 			if (fr->p.wake_threads != NULL)
 				fr->p.wake_threads(fr->p.wake_threads_arg);
 		}
+		if (fr->p.flavor == fridgethr_flavor_stealer)
+			pthread_cond_broadcast(&fr->steal.cond);
 		PTHREAD_MUTEX_unlock(&fr->mtx);
 	} else {
 		/* Well, this is embarrassing. */
 		assert(fr->p.deferment != fridgethr_defer_fail);
-		if (fr->p.deferment == fridgethr_defer_queue) {
+		if (fr->p.deferment == fridgethr_defer_queue &&
+		    fr->p.flavor != fridgethr_flavor_stealer) {
 			struct fridgethr_work *q =
 			    glist_first_entry(&fr->deferment.work_q,
 					      struct fridgethr_work,
@@ -1207,11 +1602,15 @@ int fridgethr_start(struct fridgethr *fr, pthread_mutex_t *mtx,
 		}
 	}
 
+	if (fr->p.flavor == fridgethr_flavor_stealer)
+		pthread_cond_broadcast(&fr->steal.cond);
+
 	while (fridgethr_deferredwork(fr) && (maybe_spawn-- > 0)
 	       && ((fr->nthreads < fr->p.thr_max) || (fr->p.thr_max == 0))) {
 		assert(fr->p.deferment != fridgethr_defer_block);
 		/* Start some threads to finish the work */
-		if (fr->p.deferment == fridgethr_defer_queue) {
+		if (fr->p.deferment == fridgethr_defer_queue &&
+		    fr->p.flavor != fridgethr_flavor_stealer) {
 			struct fridgethr_work *q =
 			    glist_first_entry(&fr->deferment.work_q,
 					      struct fridgethr_work,
@@ -1348,7 +1747,7 @@ bool fridgethr_you_should_break(struct fridgethr_context *ctx)
 	struct fridgethr *fr = fe->fr;
 
 	/* No locking is needed as it is only read */
-	return fr->transitioning;
+	return fr->transitioning || fr->nretire > 0;
 }
 
 /**
@@ -1394,6 +1793,8 @@ int fridgethr_populate(struct fridgethr *fr,
 		glist_add_tail(&fr->thread_list, &fe->thread_link);
 
 		fe->fr = fr;
+		if (fr->p.flavor == fridgethr_flavor_stealer)
+			fridgethr_steal_slot(fr, fe);
 		rc = pthread_mutex_init(&fe->ctx.mtx, NULL);
 		if (rc != 0) {
 			LogMajor(COMPONENT_THREAD,
@@ -1430,6 +1831,56 @@ int fridgethr_populate(struct fridgethr *fr,
 	return 0;
 }
 
+/**
+ * @brief Grow or shrink a looper fridge
+ *
+ * New threads run the given function.  Surplus threads exit the next
+ * time their function returns, which it does once
+ * fridgethr_you_should_break tells it to.
+ *
+ * @param[in,out] fr       Fridge to resize
+ * @param[in]     nthreads Number of threads wanted, kept within
+ *                         thr_min and thr_max
+ * @param[in]     func     Function new threads should run
+ * @param[in]     arg      Argument supplied for that function
+ *
+ * @retval 0 on success.
+ * @retval EINVAL if the fridge is not a looper.
+ * @retval Other codes from thread creation.
+ */
+
+int fridgethr_resize(struct fridgethr *fr, uint32_t nthreads,
+		     void (*func)(struct fridgethr_context *), void *arg)
+{
+	int rc = 0;
+
+	PTHREAD_MUTEX_lock(&fr->mtx);
+	if (fr->p.flavor != fridgethr_flavor_looper) {
+		PTHREAD_MUTEX_unlock(&fr->mtx);
+		return EINVAL;
+	}
+
+	if (nthreads < fr->p.thr_min)
+		nthreads = fr->p.thr_min;
+	if (fr->p.thr_max != 0 && nthreads > fr->p.thr_max)
+		nthreads = fr->p.thr_max;
+
+	fr->nretire = 0;
+	while (fr->command == fridgethr_comm_run && fr->nthreads < nthreads) {
+		/* releases the fridge mutex */
+		rc = fridgethr_spawn(fr, func, arg);
+		PTHREAD_MUTEX_lock(&fr->mtx);
+		if (rc != 0)
+			break;
+	}
+
+	if (fr->nthreads > nthreads)
+		fr->nretire = fr->nthreads - nthreads;
+	PTHREAD_MUTEX_unlock(&fr->mtx);
+
+	return rc;
+}
+
 /**
  * @brief Set the wait time of a running fridge
  *
@@ -1513,7 +1964,8 @@ int general_fridge_init(void)
 	memset(&frp, 0, sizeof(struct fridgethr_params));
 	frp.thr_max = 4;
 	frp.thr_min = 0;
-	frp.flavor = fridgethr_flavor_worker;
+	/* Upcalls arrive in bursts from FSAL threads */
+	frp.flavor = fridgethr_flavor_stealer;
 	frp.deferment = fridgethr_defer_queue;
 
 	rc = fridgethr_init(&general_fridge, "Gen_Fridge", &frp);
@@ -0,0 +1,92 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_arena.c
+ * @brief Bump allocator chunk management
+ */
+
+#include "config.h"
+#include "abstract_mem.h"
+#include "gsh_arena.h"
+
+/** A released standard chunk, kept for the thread's next arena */
+static __thread struct gsh_arena_chunk *gsh_arena_spare;
+
+/**
+ * @brief Allocate from a new chunk
+ *
+ * Requests larger than a standard chunk get a chunk of their own.
+ *
+ * @param[in] arena The arena
+ * @param[in] need  Bytes wanted, already aligned
+ *
+ * @return Uninitialized memory.
+ */
+void *gsh_arena_alloc_slow(struct gsh_arena *arena, size_t need)
+{
+	const size_t standard =
+		GSH_ARENA_CHUNK - sizeof(struct gsh_arena_chunk);
+	struct gsh_arena_chunk *chunk;
+
+	if (need <= standard && gsh_arena_spare != NULL) {
+		chunk = gsh_arena_spare;
+		gsh_arena_spare = NULL;
+	} else if (need <= standard) {
+		chunk = gsh_malloc_aligned(GSH_ARENA_ALIGN, GSH_ARENA_CHUNK);
+		chunk->size = standard;
+	} else {
+		chunk = gsh_malloc_aligned(GSH_ARENA_ALIGN,
+					   sizeof(*chunk) + need);
+		chunk->size = need;
+	}
+
+	chunk->used = need;
+	chunk->next = arena->chunk;
+	arena->chunk = chunk;
+	arena->last = chunk->data;
+
+	return chunk->data;
+}
+
+/**
+ * @brief Free everything allocated from an arena
+ *
+ * The arena may be used again afterwards.
+ *
+ * @param[in] arena The arena
+ */
+void gsh_arena_release(struct gsh_arena *arena)
+{
+	const size_t standard =
+		GSH_ARENA_CHUNK - sizeof(struct gsh_arena_chunk);
+	struct gsh_arena_chunk *chunk, *next;
+
+	for (chunk = arena->chunk; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		if (chunk->size == standard && gsh_arena_spare == NULL)
+			gsh_arena_spare = chunk;
+		else
+			gsh_free(chunk);
+	}
+
+	gsh_arena_init(arena);
+}
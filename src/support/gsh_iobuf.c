@@ -0,0 +1,642 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_iobuf.c
+ * @brief Size-classed buffer pool for READ/WRITE payloads
+ *
+ * Every buffer is preceded by one page holding its header, so the
+ * payload stays page aligned and the size class can be recovered
+ * from the pointer alone in gsh_iobuf_put().
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "common_utils.h"
+#include "log.h"
+#include "mem_pressure.h"
+#include "gsh_iobuf.h"
+
+#define IOBUF_ALIGN 4096
+#define IOBUF_MAGIC 0x10b0f00d
+
+/* Per-thread cache byte budget for each size class; at least one
+ * buffer is always cached. */
+#define IOBUF_TC_BYTES (2 * 1024 * 1024)
+
+/* Class index used for oversize, uncached buffers */
+#define IOBUF_CLASS_NONE IOBUF_NCLASS
+
+struct iobuf_hdr {
+	struct iobuf_hdr *next;	/*< free list link */
+	size_t size;		/*< usable size */
+	uint32_t magic;
+	uint32_t klass;
+	int32_t refcnt;		/*< references held by reply/FSAL */
+	bool vec;		/*< holds a struct gsh_iobuf_vec */
+	void *reg;		/*< device registration, kept while pooled */
+};
+
+struct iobuf_depot {
+	pthread_mutex_t mtx;
+	struct iobuf_hdr *head;
+	uint64_t count;
+	struct gsh_iobuf_stats st;
+	GSH_CACHE_PAD(0);
+};
+
+struct iobuf_tcache {
+	struct iobuf_hdr *head[IOBUF_NCLASS];
+	uint32_t count[IOBUF_NCLASS];
+};
+
+static struct iobuf_depot iobuf_depot[IOBUF_NCLASS];
+static uint64_t iobuf_depot_bytes;
+static uint64_t iobuf_depot_max;
+static uint64_t iobuf_depot_cfg;
+static bool iobuf_initialized;
+static const struct gsh_iobuf_reg_ops *iobuf_reg_ops;
+static size_t iobuf_seg_size;
+static pthread_key_t iobuf_tc_key;
+static __thread struct iobuf_tcache *iobuf_tc;
+
+static inline struct iobuf_hdr *iobuf_hdr(void *buf)
+{
+	return (struct iobuf_hdr *) ((char *) buf - sizeof(struct iobuf_hdr));
+}
+
+static inline void *iobuf_data(struct iobuf_hdr *hdr)
+{
+	return (char *) hdr + sizeof(struct iobuf_hdr);
+}
+
+/* Hand out a buffer with a single reference */
+static inline void *iobuf_hand_out(struct iobuf_hdr *hdr)
+{
+	hdr->refcnt = 1;
+	hdr->vec = false;
+	return iobuf_data(hdr);
+}
+
+static inline uint32_t iobuf_class(size_t size)
+{
+	uint32_t klass = 0;
+
+	if (size > IOBUF_MAX_SIZE)
+		return IOBUF_CLASS_NONE;
+
+	while ((IOBUF_MIN_SIZE << klass) < size)
+		++klass;
+
+	return klass;
+}
+
+static inline uint32_t iobuf_tc_max(uint32_t klass)
+{
+	uint32_t max = IOBUF_TC_BYTES >> (IOBUF_MIN_SHIFT + klass);
+
+	return max ? max : 1;
+}
+
+static struct iobuf_hdr *iobuf_alloc(size_t size, uint32_t klass)
+{
+	char *base = mem_arena_malloc_aligned(MEM_ARENA_RPC, IOBUF_ALIGN,
+					      IOBUF_ALIGN + size);
+	struct iobuf_hdr *hdr =
+		(struct iobuf_hdr *) (base + IOBUF_ALIGN -
+				      sizeof(struct iobuf_hdr));
+
+	hdr->next = NULL;
+	hdr->size = size;
+	hdr->magic = IOBUF_MAGIC;
+	hdr->klass = klass;
+	hdr->reg = NULL;
+
+	return hdr;
+}
+
+static void iobuf_release(struct iobuf_hdr *hdr)
+{
+	if (hdr->reg != NULL)
+		iobuf_reg_ops->dereg(hdr->reg);
+	hdr->magic = 0;
+	gsh_free((char *) hdr + sizeof(struct iobuf_hdr) - IOBUF_ALIGN);
+}
+
+/**
+ * @brief Return a buffer to the shared depot, or free it if full
+ */
+static void iobuf_depot_put(struct iobuf_hdr *hdr)
+{
+	struct iobuf_depot *d = &iobuf_depot[hdr->klass];
+	size_t size = hdr->size;
+
+	if (atomic_add_uint64_t(&iobuf_depot_bytes, size) >
+	    atomic_fetch_uint64_t(&iobuf_depot_max)) {
+		(void) atomic_sub_uint64_t(&iobuf_depot_bytes, size);
+		(void) atomic_inc_uint64_t(&d->st.releases);
+		iobuf_release(hdr);
+		return;
+	}
+
+	PTHREAD_MUTEX_lock(&d->mtx);
+	hdr->next = d->head;
+	d->head = hdr;
+	++d->count;
+	PTHREAD_MUTEX_unlock(&d->mtx);
+}
+
+/**
+ * @brief Flush a thread's cache to the depot when the thread exits
+ */
+static void iobuf_tc_destroy(void *arg)
+{
+	struct iobuf_tcache *tc = arg;
+	uint32_t klass;
+
+	for (klass = 0; klass < IOBUF_NCLASS; ++klass) {
+		while (tc->head[klass] != NULL) {
+			struct iobuf_hdr *hdr = tc->head[klass];
+
+			tc->head[klass] = hdr->next;
+			iobuf_depot_put(hdr);
+		}
+	}
+
+	gsh_free(tc);
+}
+
+static struct iobuf_tcache *iobuf_tc_get(void)
+{
+	if (likely(iobuf_tc != NULL))
+		return iobuf_tc;
+
+	iobuf_tc = gsh_calloc(1, sizeof(struct iobuf_tcache));
+	(void) pthread_setspecific(iobuf_tc_key, iobuf_tc);
+
+	return iobuf_tc;
+}
+
+/* Percent of the depot kept at each memory pressure */
+static const uint32_t iobuf_pressure_pct[] = {
+	[MEM_PRESSURE_NONE] = 100,
+	[MEM_PRESSURE_LOW] = 25,
+	[MEM_PRESSURE_MEDIUM] = 0,
+	[MEM_PRESSURE_HIGH] = 0,
+};
+
+/**
+ * @brief Resize the depot to the memory pressure
+ *
+ * Pooled buffers over the new size are freed, the largest first.
+ * Those in the caches of the threads are left there.
+ *
+ * @param[in] level  The memory pressure
+ */
+static void iobuf_shrink(enum mem_pressure level)
+{
+	int klass;
+
+	atomic_store_uint64_t(&iobuf_depot_max,
+			      iobuf_depot_cfg / 100 *
+			      iobuf_pressure_pct[level]);
+
+	for (klass = IOBUF_NCLASS - 1; klass >= 0; --klass) {
+		struct iobuf_depot *d = &iobuf_depot[klass];
+
+		PTHREAD_MUTEX_lock(&d->mtx);
+		while (d->head != NULL &&
+		       atomic_fetch_uint64_t(&iobuf_depot_bytes) >
+		       atomic_fetch_uint64_t(&iobuf_depot_max)) {
+			struct iobuf_hdr *hdr = d->head;
+
+			d->head = hdr->next;
+			--d->count;
+			(void) atomic_sub_uint64_t(&iobuf_depot_bytes,
+						   hdr->size);
+			(void) atomic_inc_uint64_t(&d->st.releases);
+			iobuf_release(hdr);
+		}
+		PTHREAD_MUTEX_unlock(&d->mtx);
+	}
+}
+
+static struct mem_pressure_shrinker iobuf_shrinker = {
+	.name = "I/O buffer pool",
+	.shrink = iobuf_shrink,
+};
+
+/**
+ * @brief Initialize the buffer pool
+ *
+ * @param[in] depot_max_bytes Bytes to keep in the shared depot.  0
+ *                            disables pooling entirely.
+ * @param[in] seg_size        Payloads larger than this are held in
+ *                            segments of this size.  0 never segments.
+ */
+void gsh_iobuf_pkginit(uint64_t depot_max_bytes, size_t seg_size)
+{
+	uint32_t klass;
+
+	/* Segments must keep XDR alignment, make them whole pages */
+	iobuf_seg_size = seg_size & ~(IOBUF_MIN_SIZE - 1);
+
+	if (depot_max_bytes == 0)
+		return;
+
+	for (klass = 0; klass < IOBUF_NCLASS; ++klass) {
+		PTHREAD_MUTEX_init(&iobuf_depot[klass].mtx, NULL);
+		iobuf_depot[klass].head = NULL;
+		iobuf_depot[klass].count = 0;
+	}
+
+	if (pthread_key_create(&iobuf_tc_key, iobuf_tc_destroy) != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Unable to create I/O buffer pool key, pool disabled");
+		return;
+	}
+
+	iobuf_depot_max = depot_max_bytes;
+	iobuf_depot_cfg = depot_max_bytes;
+	iobuf_initialized = true;
+
+	mem_pressure_register(&iobuf_shrinker);
+}
+
+/**
+ * @brief Release every pooled buffer
+ */
+void gsh_iobuf_pkgshutdown(void)
+{
+	uint32_t klass;
+
+	if (!iobuf_initialized)
+		return;
+
+	mem_pressure_unregister(&iobuf_shrinker);
+
+	for (klass = 0; klass < IOBUF_NCLASS; ++klass) {
+		struct iobuf_depot *d = &iobuf_depot[klass];
+
+		PTHREAD_MUTEX_lock(&d->mtx);
+		while (d->head != NULL) {
+			struct iobuf_hdr *hdr = d->head;
+
+			d->head = hdr->next;
+			--d->count;
+			iobuf_release(hdr);
+		}
+		PTHREAD_MUTEX_unlock(&d->mtx);
+	}
+	atomic_store_uint64_t(&iobuf_depot_bytes, 0);
+}
+
+/**
+ * @brief Get a page-aligned buffer of at least size bytes
+ *
+ * @param[in] size Requested size
+ *
+ * @return The buffer (never NULL; aborts on allocation failure).
+ */
+void *gsh_iobuf_get(size_t size)
+{
+	uint32_t klass = iobuf_class(size);
+	struct iobuf_tcache *tc;
+	struct iobuf_depot *d;
+	struct iobuf_hdr *hdr;
+
+	if (!iobuf_initialized || klass == IOBUF_CLASS_NONE)
+		return iobuf_hand_out(iobuf_alloc(size, IOBUF_CLASS_NONE));
+
+	d = &iobuf_depot[klass];
+	tc = iobuf_tc_get();
+	hdr = tc->head[klass];
+	if (hdr != NULL) {
+		tc->head[klass] = hdr->next;
+		--tc->count[klass];
+		(void) atomic_inc_uint64_t(&d->st.tc_hits);
+		return iobuf_hand_out(hdr);
+	}
+
+	PTHREAD_MUTEX_lock(&d->mtx);
+	hdr = d->head;
+	if (hdr != NULL) {
+		d->head = hdr->next;
+		--d->count;
+	}
+	PTHREAD_MUTEX_unlock(&d->mtx);
+
+	if (hdr != NULL) {
+		(void) atomic_sub_uint64_t(&iobuf_depot_bytes, hdr->size);
+		(void) atomic_inc_uint64_t(&d->st.depot_hits);
+		return iobuf_hand_out(hdr);
+	}
+
+	(void) atomic_inc_uint64_t(&d->st.misses);
+	return iobuf_hand_out(iobuf_alloc(IOBUF_MIN_SIZE << klass, klass));
+}
+
+/**
+ * @brief Take an additional reference on a buffer
+ *
+ * This lets a holder of buffered data (an FSAL, for example) hand
+ * the same buffer to a reply without copying it.
+ *
+ * @param[in] buf The buffer
+ */
+void gsh_iobuf_ref(void *buf)
+{
+	struct iobuf_hdr *hdr = iobuf_hdr(buf);
+
+	assert(hdr->magic == IOBUF_MAGIC);
+	(void) atomic_inc_int32_t(&hdr->refcnt);
+}
+
+/**
+ * @brief Drop a reference to a buffer obtained from gsh_iobuf_get
+ *
+ * The buffer is recycled when the last reference is dropped.
+ *
+ * @param[in] buf The buffer, may be NULL
+ */
+void gsh_iobuf_put(void *buf)
+{
+	struct iobuf_tcache *tc;
+	struct iobuf_hdr *hdr;
+	uint32_t klass;
+
+	if (buf == NULL)
+		return;
+
+	hdr = iobuf_hdr(buf);
+	assert(hdr->magic == IOBUF_MAGIC);
+
+	if (atomic_dec_int32_t(&hdr->refcnt) != 0)
+		return;
+
+	if (hdr->vec) {
+		struct gsh_iobuf_vec *vec = buf;
+		uint32_t i;
+
+		for (i = 0; i < vec->cnt; i++)
+			gsh_iobuf_put(vec->iov[i].iov_base);
+	}
+
+	klass = hdr->klass;
+
+	if (!iobuf_initialized || klass == IOBUF_CLASS_NONE) {
+		iobuf_release(hdr);
+		return;
+	}
+
+	tc = iobuf_tc_get();
+	if (tc->count[klass] < iobuf_tc_max(klass)) {
+		hdr->next = tc->head[klass];
+		tc->head[klass] = hdr;
+		++tc->count[klass];
+		return;
+	}
+
+	iobuf_depot_put(hdr);
+}
+
+/**
+ * @brief Whether a payload of this size is held in segments
+ *
+ * @param[in] size Payload size
+ */
+bool gsh_iobuf_segmented(size_t size)
+{
+	return iobuf_seg_size != 0 && size > iobuf_seg_size;
+}
+
+/**
+ * @brief Get a payload buffer of size bytes, segmented if it is large
+ *
+ * A payload no larger than the segment size is an ordinary buffer.  A
+ * larger one is a struct gsh_iobuf_vec, itself a pooled buffer, whose
+ * segments are buffers of the segment size, the last one holding the
+ * remainder.  Either way it is released with gsh_iobuf_put.  Use
+ * gsh_iobuf_is_vec to tell them apart.
+ *
+ * @param[in] size Payload size
+ *
+ * @return The buffer (never NULL; aborts on allocation failure).
+ */
+void *gsh_iobuf_get_payload(size_t size)
+{
+	struct gsh_iobuf_vec *vec;
+	uint32_t cnt, i;
+	size_t left = size;
+
+	if (!gsh_iobuf_segmented(size))
+		return gsh_iobuf_get(size);
+
+	cnt = (size + iobuf_seg_size - 1) / iobuf_seg_size;
+	vec = gsh_iobuf_get(sizeof(*vec) + cnt * sizeof(struct iovec));
+	iobuf_hdr(vec)->vec = true;
+	vec->cnt = cnt;
+
+	for (i = 0; i < cnt; i++) {
+		size_t len = left < iobuf_seg_size ? left : iobuf_seg_size;
+
+		vec->iov[i].iov_base = gsh_iobuf_get(len);
+		vec->iov[i].iov_len = len;
+		left -= len;
+	}
+
+	return vec;
+}
+
+/**
+ * @brief Whether a buffer is a segmented payload
+ *
+ * @param[in] buf A buffer from gsh_iobuf_get or gsh_iobuf_get_payload
+ */
+bool gsh_iobuf_is_vec(void *buf)
+{
+	return iobuf_hdr(buf)->vec;
+}
+
+/**
+ * @brief Describe the first len bytes of a payload as an iovec
+ *
+ * @param[in]  buf	Payload buffer
+ * @param[out] iov	At least gsh_iobuf_iovcnt(buf) entries
+ * @param[in]  len	Bytes of payload to describe
+ *
+ * @return The number of entries filled in.
+ */
+int gsh_iobuf_fill_iov(void *buf, struct iovec *iov, size_t len)
+{
+	struct gsh_iobuf_vec *vec = buf;
+	uint32_t i;
+
+	if (!gsh_iobuf_is_vec(buf)) {
+		iov[0].iov_base = buf;
+		iov[0].iov_len = len;
+		return 1;
+	}
+
+	for (i = 0; i < vec->cnt && len > 0; i++) {
+		iov[i] = vec->iov[i];
+		if (iov[i].iov_len > len)
+			iov[i].iov_len = len;
+		len -= iov[i].iov_len;
+	}
+
+	return i;
+}
+
+/**
+ * @brief Number of iovec entries a payload needs
+ *
+ * @param[in] buf Payload buffer
+ */
+int gsh_iobuf_iovcnt(void *buf)
+{
+	if (!gsh_iobuf_is_vec(buf))
+		return 1;
+
+	return ((struct gsh_iobuf_vec *) buf)->cnt;
+}
+
+/**
+ * @brief Copy a segmented payload into one contiguous buffer
+ *
+ * For the few consumers that cannot take an iovec.  An unsegmented
+ * buffer is returned as is with an extra reference, so the caller
+ * always puts the result.
+ *
+ * @param[in] buf	Payload buffer
+ * @param[in] len	Bytes of payload
+ *
+ * @return A contiguous buffer holding the payload.
+ */
+void *gsh_iobuf_flatten(void *buf, size_t len)
+{
+	struct gsh_iobuf_vec *vec = buf;
+	char *flat;
+	size_t off = 0;
+	uint32_t i;
+
+	if (!gsh_iobuf_is_vec(buf)) {
+		gsh_iobuf_ref(buf);
+		return buf;
+	}
+
+	flat = gsh_iobuf_get(len);
+
+	for (i = 0; i < vec->cnt && off < len; i++) {
+		size_t n = vec->iov[i].iov_len;
+
+		if (n > len - off)
+			n = len - off;
+		memcpy(flat + off, vec->iov[i].iov_base, n);
+		off += n;
+	}
+
+	return flat;
+}
+
+/**
+ * @brief Usable size of a pooled buffer
+ */
+size_t gsh_iobuf_size(void *buf)
+{
+	return iobuf_hdr(buf)->size;
+}
+
+/**
+ * @brief Install the memory registration callbacks
+ *
+ * Must be called before any buffer is registered, and only once.
+ *
+ * @param[in] ops The callbacks, which must stay valid
+ */
+void gsh_iobuf_set_reg_ops(const struct gsh_iobuf_reg_ops *ops)
+{
+	assert(iobuf_reg_ops == NULL);
+	iobuf_reg_ops = ops;
+}
+
+/**
+ * @brief Get the device registration of a buffer
+ *
+ * The buffer is registered on first use; a recycled buffer keeps the
+ * registration it already has.
+ *
+ * @param[in] buf A buffer the caller holds a reference on
+ *
+ * @return The registration handle, NULL if there are no callbacks or
+ *         registration failed.
+ */
+void *gsh_iobuf_reg(void *buf)
+{
+	struct iobuf_hdr *hdr = iobuf_hdr(buf);
+	void *reg;
+
+	assert(hdr->magic == IOBUF_MAGIC);
+
+	reg = atomic_fetch_voidptr(&hdr->reg);
+	if (reg != NULL || iobuf_reg_ops == NULL)
+		return reg;
+
+	reg = iobuf_reg_ops->reg(buf, hdr->size);
+	if (reg == NULL)
+		return NULL;
+
+	/* another holder of the buffer may have raced us */
+	if (!atomic_cas_voidptr(&hdr->reg, NULL, reg)) {
+		iobuf_reg_ops->dereg(reg);
+		reg = atomic_fetch_voidptr(&hdr->reg);
+	}
+
+	return reg;
+}
+
+/**
+ * @brief Copy out per-class statistics
+ *
+ * @param[out] stats  Array of nclass entries
+ * @param[in]  nclass Number of entries (at most IOBUF_NCLASS)
+ */
+void gsh_iobuf_get_stats(struct gsh_iobuf_stats *stats, int nclass)
+{
+	int klass;
+
+	for (klass = 0; klass < nclass && klass < IOBUF_NCLASS; ++klass) {
+		struct iobuf_depot *d = &iobuf_depot[klass];
+
+		stats[klass].tc_hits = atomic_fetch_uint64_t(&d->st.tc_hits);
+		stats[klass].depot_hits =
+			atomic_fetch_uint64_t(&d->st.depot_hits);
+		stats[klass].misses = atomic_fetch_uint64_t(&d->st.misses);
+		stats[klass].releases = atomic_fetch_uint64_t(&d->st.releases);
+		stats[klass].depot_count = atomic_fetch_uint64_t(&d->count);
+	}
+}
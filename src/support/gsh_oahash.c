@@ -0,0 +1,190 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_oahash.c
+ * @brief Open-addressing hash index of pointers keyed by 64-bit hash
+ */
+
+#include "config.h"
+#include <string.h>
+#include "abstract_mem.h"
+#include "gsh_oahash.h"
+
+#define OAHASH_MIN_GROUPS 16
+
+static struct oahash_group *oahash_alloc_groups(uint64_t ngroups)
+{
+	size_t size = ngroups * sizeof(struct oahash_group);
+	struct oahash_group *groups =
+		gsh_malloc_aligned(sizeof(struct oahash_group), size);
+
+	memset(groups, 0, size);
+	return groups;
+}
+
+/* Item limit before growing, 7/8 of the slots */
+static inline uint64_t oahash_limit(const struct oahash *t)
+{
+	return ((t->mask + 1) * OAHASH_GROUP_SLOTS * 7) / 8;
+}
+
+/**
+ * @brief Place an item, without growing
+ */
+static void oahash_place(struct oahash *t, uint64_t hash, void *item)
+{
+	uint64_t g = hash & t->mask;
+	uint64_t probe = 0;
+	int i;
+
+	for (;;) {
+		struct oahash_group *grp = &t->groups[g];
+
+		for (i = 0; i < OAHASH_GROUP_SLOTS; ++i) {
+			if (grp->tag[i] == 0) {
+				grp->tag[i] = oahash_tag(hash);
+				grp->item[i] = item;
+				++t->count;
+				return;
+			}
+		}
+
+		if (grp->overflow != OAHASH_OVERFLOW_MAX)
+			++grp->overflow;
+
+		/* The load limit guarantees a free slot somewhere */
+		g = (g + ++probe) & t->mask;
+	}
+}
+
+static void oahash_grow(struct oahash *t)
+{
+	struct oahash_group *old = t->groups;
+	uint64_t ngroups = t->mask + 1;
+	uint64_t g;
+	int i;
+
+	t->groups = oahash_alloc_groups(ngroups * 2);
+	t->mask = ngroups * 2 - 1;
+	t->count = 0;
+
+	for (g = 0; g < ngroups; ++g) {
+		for (i = 0; i < OAHASH_GROUP_SLOTS; ++i) {
+			if (old[g].tag[i] != 0)
+				oahash_place(t, t->hash_fn(old[g].item[i]),
+					     old[g].item[i]);
+		}
+	}
+
+	gsh_free(old);
+}
+
+/**
+ * @brief Initialize a table
+ *
+ * @param[in] t        The table
+ * @param[in] capacity Expected number of items, the table grows past it
+ * @param[in] hash_fn  Returns an item's hash, used when growing
+ */
+void oahash_init(struct oahash *t, uint64_t capacity, oahash_hash_fn hash_fn)
+{
+	uint64_t ngroups = OAHASH_MIN_GROUPS;
+
+	while (ngroups * OAHASH_GROUP_SLOTS * 7 / 8 < capacity)
+		ngroups <<= 1;
+
+	t->groups = oahash_alloc_groups(ngroups);
+	t->mask = ngroups - 1;
+	t->count = 0;
+	t->hash_fn = hash_fn;
+}
+
+void oahash_destroy(struct oahash *t)
+{
+	gsh_free(t->groups);
+	t->groups = NULL;
+	t->mask = 0;
+	t->count = 0;
+}
+
+/**
+ * @brief Insert an item
+ *
+ * The caller must make sure the item is not already present.
+ *
+ * @param[in] t    The table
+ * @param[in] hash Hash of the item's key
+ * @param[in] item The item
+ */
+void oahash_insert(struct oahash *t, uint64_t hash, void *item)
+{
+	if (t->count >= oahash_limit(t))
+		oahash_grow(t);
+
+	oahash_place(t, hash, item);
+}
+
+/**
+ * @brief Remove an item
+ *
+ * @param[in] t    The table
+ * @param[in] hash Hash the item was inserted with
+ * @param[in] item The item
+ *
+ * @return true if the item was found and removed.
+ */
+bool oahash_remove(struct oahash *t, uint64_t hash, void *item)
+{
+	uint8_t tag = oahash_tag(hash);
+	uint64_t home = hash & t->mask;
+	uint64_t g = home;
+	uint64_t probe = 0;
+	uint64_t p;
+	int i;
+
+	for (;;) {
+		struct oahash_group *grp = &t->groups[g];
+
+		for (i = 0; i < OAHASH_GROUP_SLOTS; ++i) {
+			if (grp->tag[i] == tag && grp->item[i] == item)
+				goto found;
+		}
+
+		if (grp->overflow == 0 || probe == t->mask)
+			return false;
+
+		g = (g + ++probe) & t->mask;
+	}
+
+ found:
+	t->groups[g].tag[i] = 0;
+	t->groups[g].item[i] = NULL;
+	--t->count;
+
+	/* Undo the overflow counts the insert left along its probe */
+	for (g = home, p = 0; p < probe; g = (g + ++p) & t->mask) {
+		if (t->groups[g].overflow != OAHASH_OVERFLOW_MAX)
+			--t->groups[g].overflow;
+	}
+
+	return true;
+}
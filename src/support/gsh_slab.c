@@ -0,0 +1,441 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_slab.c
+ * @brief Fixed size object caches with per-thread magazines
+ *
+ * This follows the magazine layer of Bonwick's slab allocator.  A
+ * thread allocates from its loaded magazine and frees into it; when
+ * that is empty (or full) it swaps in its previous magazine, and only
+ * when both are exhausted does it trade a magazine with the depot
+ * under the depot lock.  A depot with no full magazine refills one
+ * from the current chunk.
+ *
+ * Live object counts are kept per thread so allocating does not
+ * bounce a shared cache line; the totals are summed when read.
+ *
+ * Once gsh_slab_numa_init is called each cache has a depot per NUMA
+ * node, and a thread trades magazines with the depot of the node it
+ * ran on when it first allocated.  Chunks are first touched by the
+ * threads of the node that carves them, so their pages stay local.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "gsh_list.h"
+#include "common_utils.h"
+#include "log.h"
+#include "gsh_slab.h"
+
+#define SLAB_MAG_ROUNDS 32
+#define SLAB_ALIGN 16
+#define SLAB_CHUNK_BYTES (64 * 1024)
+#define SLAB_CHUNK_MIN_OBJS 16
+#define SLAB_MAX_NODES 8
+
+struct slab_mag {
+	struct slab_mag *next;	/*< depot list link */
+	uint32_t rounds;	/*< free objects held */
+	void *obj[SLAB_MAG_ROUNDS];
+};
+
+/* The part of a depot shared by the threads of one NUMA node */
+struct slab_node {
+	pthread_mutex_t mtx;
+	struct slab_mag *full;	/*< magazines with rounds */
+	struct slab_mag *empty;	/*< magazines without */
+	char *carve;		/*< unused part of the current chunk */
+	size_t carve_left;
+	uint64_t count;		/*< objects in full */
+	uint64_t bytes;		/*< chunk bytes allocated */
+	GSH_CACHE_PAD(0);
+};
+
+struct slab_depot {
+	char *name;		/*< copied, the gsh_slab may be unloaded */
+	size_t obj_size;	/*< object size as requested */
+	size_t size;		/*< object size rounded to SLAB_ALIGN */
+	size_t chunk_size;
+	enum mem_arena arena;	/*< where chunks are allocated */
+	int64_t live_exited;	/*< live counts of exited threads */
+	struct slab_node node[SLAB_MAX_NODES];
+};
+
+struct slab_tcache {
+	struct glist_head tc_list;	/*< on slab_tcaches */
+	uint32_t node;			/*< depot node traded with */
+	struct slab_mag *loaded[GSH_SLAB_MAX];
+	struct slab_mag *prev[GSH_SLAB_MAX];
+	int64_t live[GSH_SLAB_MAX];
+};
+
+/* Protects slab_depots, slab_ndepots and slab_tcaches */
+static pthread_mutex_t slab_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct slab_depot *slab_depots[GSH_SLAB_MAX];
+static int32_t slab_ndepots;
+static struct glist_head slab_tcaches = GLIST_HEAD_INIT(slab_tcaches);
+static pthread_key_t slab_tc_key;
+static __thread struct slab_tcache *slab_tc;
+
+/* Set once by gsh_slab_numa_init, before the workers start */
+static uint32_t slab_nnodes = 1;
+static uint32_t (*slab_cpu_node)(int cpu);
+
+/**
+ * @brief Give each cache a depot per NUMA node
+ *
+ * Threads that allocate for the first time after this trade with the
+ * depot of the node they run on.  Threads that already have magazines
+ * keep using node 0's.
+ *
+ * @param[in] nnodes      Number of nodes, more than SLAB_MAX_NODES share
+ * @param[in] cpu_node    Map of a CPU to its node index
+ */
+void gsh_slab_numa_init(uint32_t nnodes, uint32_t (*cpu_node)(int cpu))
+{
+	slab_cpu_node = cpu_node;
+	atomic_store_uint32_t(&slab_nnodes, nnodes > SLAB_MAX_NODES
+					    ? SLAB_MAX_NODES : nnodes);
+}
+
+/**
+ * @brief Return a thread's magazines to the depots when it exits
+ */
+static void slab_tc_destroy(void *arg)
+{
+	struct slab_tcache *tc = arg;
+	struct slab_mag *mags[2];
+	int32_t i, j;
+
+	PTHREAD_MUTEX_lock(&slab_mtx);
+	glist_del(&tc->tc_list);
+
+	for (i = 0; i < slab_ndepots; ++i) {
+		struct slab_depot *d = slab_depots[i];
+		struct slab_node *sn = &d->node[tc->node];
+
+		mags[0] = tc->loaded[i];
+		mags[1] = tc->prev[i];
+
+		PTHREAD_MUTEX_lock(&sn->mtx);
+		for (j = 0; j < 2; ++j) {
+			if (mags[j] == NULL)
+				continue;
+			if (mags[j]->rounds != 0) {
+				mags[j]->next = sn->full;
+				sn->full = mags[j];
+				sn->count += mags[j]->rounds;
+			} else {
+				mags[j]->next = sn->empty;
+				sn->empty = mags[j];
+			}
+		}
+		PTHREAD_MUTEX_unlock(&sn->mtx);
+		(void) atomic_add_int64_t(&d->live_exited, tc->live[i]);
+	}
+	PTHREAD_MUTEX_unlock(&slab_mtx);
+
+	gsh_free(tc);
+	slab_tc = NULL;
+}
+
+static struct slab_tcache *slab_tc_get(void)
+{
+	if (likely(slab_tc != NULL))
+		return slab_tc;
+
+	slab_tc = gsh_calloc(1, sizeof(struct slab_tcache));
+
+	if (atomic_fetch_uint32_t(&slab_nnodes) > 1)
+		slab_tc->node = slab_cpu_node(sched_getcpu()) %
+				atomic_fetch_uint32_t(&slab_nnodes);
+
+	PTHREAD_MUTEX_lock(&slab_mtx);
+	glist_add_tail(&slab_tcaches, &slab_tc->tc_list);
+	PTHREAD_MUTEX_unlock(&slab_mtx);
+
+	(void) pthread_setspecific(slab_tc_key, slab_tc);
+
+	return slab_tc;
+}
+
+/**
+ * @brief Give a cache a slot on first use
+ *
+ * Caches of the same name and size share a slot, so a pool that is
+ * destroyed and created again, or the pools of each hash table, reuse
+ * one depot rather than using up the slots.
+ *
+ * @return The slot, or -1 if all are taken and the cache is unpooled.
+ */
+static int32_t slab_register(struct gsh_slab *slab)
+{
+	struct slab_depot *d;
+	int32_t index, i;
+
+	PTHREAD_MUTEX_lock(&slab_mtx);
+
+	index = atomic_fetch_int32_t(&slab->index);
+	if (index != 0)
+		goto out;
+
+	for (i = 0; i < slab_ndepots; ++i) {
+		d = slab_depots[i];
+		if (d->obj_size == slab->size && !strcmp(d->name, slab->name)) {
+			index = i + 1;
+			goto out;
+		}
+	}
+
+	if (slab_ndepots == 0 &&
+	    pthread_key_create(&slab_tc_key, slab_tc_destroy) != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Unable to create slab key, %s not cached",
+			slab->name);
+		index = -1;
+		goto out;
+	}
+
+	if (slab_ndepots == GSH_SLAB_MAX) {
+		LogCrit(COMPONENT_INIT,
+			"Out of slab caches, %s not cached", slab->name);
+		index = -1;
+		goto out;
+	}
+
+	d = gsh_calloc(1, sizeof(*d));
+	for (i = 0; i < SLAB_MAX_NODES; ++i)
+		PTHREAD_MUTEX_init(&d->node[i].mtx, NULL);
+	d->name = gsh_strdup(slab->name);
+	d->obj_size = slab->size;
+	d->arena = slab->arena;
+	d->size = (slab->size + SLAB_ALIGN - 1) & ~(size_t) (SLAB_ALIGN - 1);
+	d->chunk_size = SLAB_CHUNK_BYTES;
+	if (d->chunk_size < SLAB_CHUNK_MIN_OBJS * d->size)
+		d->chunk_size = SLAB_CHUNK_MIN_OBJS * d->size;
+
+	slab_depots[slab_ndepots] = d;
+	index = ++slab_ndepots;
+
+out:
+	atomic_store_int32_t(&slab->index, index);
+	PTHREAD_MUTEX_unlock(&slab_mtx);
+
+	return index;
+}
+
+static inline int32_t slab_slot(struct gsh_slab *slab)
+{
+	int32_t index = atomic_fetch_int32_t(&slab->index);
+
+	if (unlikely(index == 0))
+		index = slab_register(slab);
+
+	return index > 0 ? index - 1 : -1;
+}
+
+/**
+ * @brief Fill an empty magazine from the current chunk
+ *
+ * Called with the node's depot lock held.
+ */
+static void slab_refill(struct slab_depot *d, struct slab_node *sn,
+			struct slab_mag *mag)
+{
+	while (mag->rounds < SLAB_MAG_ROUNDS) {
+		if (sn->carve_left < d->size) {
+			/* The tail of the old chunk is too small to use */
+			sn->carve = mem_arena_malloc_aligned(d->arena,
+							     SLAB_ALIGN,
+							     d->chunk_size);
+			sn->carve_left = d->chunk_size;
+			sn->bytes += d->chunk_size;
+		}
+		mag->obj[mag->rounds++] = sn->carve;
+		sn->carve += d->size;
+		sn->carve_left -= d->size;
+	}
+}
+
+/**
+ * @brief Allocate a zeroed object from a cache
+ *
+ * @param[in] slab The cache
+ *
+ * @return The object (never NULL; aborts on allocation failure).
+ */
+void *gsh_slab_alloc(struct gsh_slab *slab)
+{
+	int32_t i = slab_slot(slab);
+	struct slab_tcache *tc;
+	struct slab_node *sn;
+	struct slab_mag *mag;
+	void *obj;
+
+	if (i < 0)
+		return mem_arena_calloc(slab->arena, 1, slab->size);
+
+	tc = slab_tc_get();
+	mag = tc->loaded[i];
+
+	if (mag == NULL || mag->rounds == 0) {
+		if (tc->prev[i] != NULL && tc->prev[i]->rounds != 0) {
+			tc->loaded[i] = tc->prev[i];
+			tc->prev[i] = mag;
+		} else {
+			/* Trade the empty magazine for a full one */
+			sn = &slab_depots[i]->node[tc->node];
+			PTHREAD_MUTEX_lock(&sn->mtx);
+			if (sn->full != NULL) {
+				tc->loaded[i] = sn->full;
+				sn->full = sn->full->next;
+				sn->count -= tc->loaded[i]->rounds;
+				if (mag != NULL) {
+					mag->next = sn->empty;
+					sn->empty = mag;
+				}
+			} else {
+				if (mag == NULL)
+					mag = gsh_calloc(1, sizeof(*mag));
+				slab_refill(slab_depots[i], sn, mag);
+				tc->loaded[i] = mag;
+			}
+			PTHREAD_MUTEX_unlock(&sn->mtx);
+		}
+		mag = tc->loaded[i];
+	}
+
+	obj = mag->obj[--mag->rounds];
+	atomic_store_int64_t(&tc->live[i], tc->live[i] + 1);
+
+	memset(obj, 0, slab->size);
+
+	return obj;
+}
+
+/**
+ * @brief Return an object to its cache
+ *
+ * @param[in] slab The cache the object came from
+ * @param[in] obj  The object, may be NULL
+ */
+void gsh_slab_free(struct gsh_slab *slab, void *obj)
+{
+	int32_t i;
+	struct slab_tcache *tc;
+	struct slab_node *sn;
+	struct slab_mag *mag;
+
+	if (obj == NULL)
+		return;
+
+	i = slab_slot(slab);
+	if (i < 0) {
+		gsh_free(obj);
+		return;
+	}
+
+	tc = slab_tc_get();
+	mag = tc->loaded[i];
+
+	if (mag == NULL || mag->rounds == SLAB_MAG_ROUNDS) {
+		if (mag == NULL || tc->prev[i] == NULL ||
+		    tc->prev[i]->rounds != SLAB_MAG_ROUNDS) {
+			tc->loaded[i] = tc->prev[i];
+			tc->prev[i] = mag;
+		} else {
+			/* Both are full, hand one to the depot */
+			sn = &slab_depots[i]->node[tc->node];
+			PTHREAD_MUTEX_lock(&sn->mtx);
+			mag->next = sn->full;
+			sn->full = mag;
+			sn->count += mag->rounds;
+			tc->loaded[i] = sn->empty;
+			if (sn->empty != NULL)
+				sn->empty = sn->empty->next;
+			PTHREAD_MUTEX_unlock(&sn->mtx);
+		}
+		if (tc->loaded[i] == NULL)
+			tc->loaded[i] = gsh_calloc(1, sizeof(*mag));
+		mag = tc->loaded[i];
+	}
+
+	mag->obj[mag->rounds++] = obj;
+	atomic_store_int64_t(&tc->live[i], tc->live[i] - 1);
+}
+
+/**
+ * @brief Copy out the counters of every registered cache
+ *
+ * @param[out] stats Array of max entries
+ * @param[in]  max   Number of entries
+ *
+ * @return The number of entries filled in.
+ */
+int gsh_slab_get_stats(struct gsh_slab_stats *stats, int max)
+{
+	struct glist_head *glist;
+	int32_t i, n;
+
+	PTHREAD_MUTEX_lock(&slab_mtx);
+	n = slab_ndepots < max ? slab_ndepots : max;
+
+	for (i = 0; i < n; ++i) {
+		struct slab_depot *d = slab_depots[i];
+		int64_t live = atomic_fetch_int64_t(&d->live_exited);
+		int32_t j;
+
+		stats[i].depot_count = 0;
+		stats[i].bytes = 0;
+		stats[i].arena = d->arena;
+		for (j = 0; j < SLAB_MAX_NODES; ++j) {
+			struct slab_node *sn = &d->node[j];
+
+			PTHREAD_MUTEX_lock(&sn->mtx);
+			stats[i].depot_count += sn->count;
+			stats[i].bytes += sn->bytes;
+			PTHREAD_MUTEX_unlock(&sn->mtx);
+		}
+
+		/* A thread frees objects others allocated, so only the
+		 * sum means anything. */
+		glist_for_each(glist, &slab_tcaches) {
+			struct slab_tcache *tc =
+				glist_entry(glist, struct slab_tcache,
+					    tc_list);
+
+			live += atomic_fetch_int64_t(&tc->live[i]);
+		}
+
+		stats[i].name = d->name;
+		stats[i].size = d->obj_size;
+		stats[i].live = live > 0 ? live : 0;
+	}
+	PTHREAD_MUTEX_unlock(&slab_mtx);
+
+	return n;
+}
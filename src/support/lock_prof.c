@@ -0,0 +1,330 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file lock_prof.c
+ * @brief Lock contention profiler
+ *
+ * Each thread counts in a table of its own, an open addressed hash of
+ * sites, so counting takes no lock and shares no cache line.  Tables of
+ * threads that exited are kept, with their counts, until a new thread
+ * takes them.  A report adds the tables up without stopping anyone, so
+ * the counts of a busy site may be a few events behind.
+ *
+ * To time how long a lock is held, each thread stacks the locks it took
+ * since the profiler was last turned on.  Locks taken before then are
+ * not in the stack and their release is not timed.
+ *
+ * The profiler's own lock is a plain pthread mutex, it must not go
+ * through the macros it hooks.
+ */
+
+#include "config.h"
+
+#ifdef USE_LOCK_PROF
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gsh_list.h"
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "lock_prof.h"
+
+/* Sites a thread can count, a power of two */
+#define LOCK_PROF_SLOTS 512
+
+/* Locks a thread can hold and have timed at once */
+#define LOCK_PROF_HELD 32
+
+struct lock_prof_held {
+	const void *lock;
+	struct lock_prof_stats *stats;
+	uint64_t taken;
+};
+
+struct lock_prof_table {
+	struct glist_head tables;	/*< Link in lp_tables or lp_free */
+	uint32_t gen;			/*< lp_gen the counts are from */
+	uint32_t nheld;
+	struct lock_prof_held held[LOCK_PROF_HELD];
+	struct lock_prof_stats slots[LOCK_PROF_SLOTS];
+};
+
+bool lock_prof_enabled;
+
+/* Bumped to zero the counts, each table zeroes its own when it sees it */
+static uint32_t lp_gen;
+static pthread_mutex_t lp_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t lp_key;
+static __thread struct lock_prof_table *lp_table;
+
+/* Tables of live threads, then tables of exited threads */
+static struct glist_head lp_tables = GLIST_HEAD_INIT(lp_tables);
+static struct glist_head lp_free = GLIST_HEAD_INIT(lp_free);
+
+static void lp_table_release(void *arg)
+{
+	struct lock_prof_table *table = arg;
+
+	pthread_mutex_lock(&lp_mtx);
+	glist_del(&table->tables);
+	glist_add_tail(&lp_free, &table->tables);
+	pthread_mutex_unlock(&lp_mtx);
+
+	/* Called in the exiting thread, which may still take locks */
+	lp_table = NULL;
+}
+
+static struct lock_prof_table *lp_table_get(void)
+{
+	struct lock_prof_table *table;
+
+	pthread_mutex_lock(&lp_mtx);
+	table = glist_first_entry(&lp_free, struct lock_prof_table, tables);
+	if (table != NULL)
+		glist_del(&table->tables);
+	else
+		table = gsh_calloc(1, sizeof(*table));
+	table->nheld = 0;
+	glist_add_tail(&lp_tables, &table->tables);
+	pthread_mutex_unlock(&lp_mtx);
+
+	(void) pthread_setspecific(lp_key, table);
+	lp_table = table;
+
+	return table;
+}
+
+/**
+ * @brief Set up the profiler
+ *
+ * @param[in] enable Turn it on, from Lock_Profile
+ */
+void lock_prof_init(bool enable)
+{
+	(void) pthread_key_create(&lp_key, lp_table_release);
+	lock_prof_enable(enable);
+}
+
+/**
+ * @brief Turn the profiler on or off
+ *
+ * Turning it on starts the counts over.
+ */
+void lock_prof_enable(bool enable)
+{
+	if (enable && !lock_prof_enabled)
+		(void) atomic_inc_uint32_t(&lp_gen);
+	lock_prof_enabled = enable;
+}
+
+uint64_t lock_prof_now(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct lock_prof_stats *lp_slot(struct lock_prof_table *table,
+				       const struct lock_prof_site *site)
+{
+	uintptr_t h = (uintptr_t) site;
+	uint32_t i, n;
+
+	h ^= h >> 17;
+	for (n = 0; n < LOCK_PROF_SLOTS; n++) {
+		i = (h + n) & (LOCK_PROF_SLOTS - 1);
+		if (table->slots[i].site == site)
+			return &table->slots[i];
+		if (table->slots[i].site == NULL) {
+			table->slots[i].site = site;
+			return &table->slots[i];
+		}
+	}
+
+	/* Table full, the site goes uncounted in this thread */
+	return NULL;
+}
+
+/**
+ * @brief Count a lock taken
+ *
+ * @param[in] site  Where it was taken
+ * @param[in] lock  The lock
+ * @param[in] start When the wait started, 0 if the lock was free
+ */
+void lock_prof_acquired(const struct lock_prof_site *site, const void *lock,
+			uint64_t start)
+{
+	struct lock_prof_table *table = lp_table;
+	struct lock_prof_stats *st;
+	uint32_t gen = atomic_fetch_uint32_t(&lp_gen);
+	uint64_t now = lock_prof_now();
+	uint64_t wait;
+
+	if (table == NULL)
+		table = lp_table_get();
+
+	if (table->gen != gen) {
+		memset(table->slots, 0, sizeof(table->slots));
+		table->nheld = 0;
+		table->gen = gen;
+	}
+
+	st = lp_slot(table, site);
+	if (st == NULL)
+		return;
+
+	st->acquired++;
+	if (start != 0) {
+		wait = now - start;
+		st->contended++;
+		st->wait_ns += wait;
+		if (wait > st->max_wait_ns)
+			st->max_wait_ns = wait;
+	}
+
+	if (table->nheld < LOCK_PROF_HELD) {
+		table->held[table->nheld].lock = lock;
+		table->held[table->nheld].stats = st;
+		table->held[table->nheld].taken = now;
+		table->nheld++;
+	}
+}
+
+/**
+ * @brief Count how long a lock about to be released was held
+ *
+ * @param[in] lock The lock
+ */
+void lock_prof_released(const void *lock)
+{
+	struct lock_prof_table *table = lp_table;
+	struct lock_prof_stats *st;
+	uint64_t hold;
+	int i;
+
+	if (table == NULL || table->gen != atomic_fetch_uint32_t(&lp_gen))
+		return;
+
+	/* Locks are mostly released in the reverse order */
+	for (i = table->nheld - 1; i >= 0; i--) {
+		if (table->held[i].lock != lock)
+			continue;
+
+		st = table->held[i].stats;
+		hold = lock_prof_now() - table->held[i].taken;
+		st->hold_ns += hold;
+		if (hold > st->max_hold_ns)
+			st->max_hold_ns = hold;
+
+		table->nheld--;
+		memmove(&table->held[i], &table->held[i + 1],
+			(table->nheld - i) * sizeof(table->held[0]));
+		return;
+	}
+}
+
+static void lp_add(struct lock_prof_stats *stats, int *n, int max,
+		   const struct lock_prof_stats *st)
+{
+	struct lock_prof_stats *tot = NULL;
+	int i;
+
+	for (i = 0; i < *n; i++) {
+		if (stats[i].site == st->site) {
+			tot = &stats[i];
+			break;
+		}
+	}
+
+	if (tot == NULL) {
+		if (*n == max)
+			return;
+		tot = &stats[(*n)++];
+		*tot = *st;
+		return;
+	}
+
+	tot->acquired += st->acquired;
+	tot->contended += st->contended;
+	tot->wait_ns += st->wait_ns;
+	tot->hold_ns += st->hold_ns;
+	if (st->max_wait_ns > tot->max_wait_ns)
+		tot->max_wait_ns = st->max_wait_ns;
+	if (st->max_hold_ns > tot->max_hold_ns)
+		tot->max_hold_ns = st->max_hold_ns;
+}
+
+static void lp_add_list(struct lock_prof_stats *stats, int *n, int max,
+			struct glist_head *list, uint32_t gen)
+{
+	struct glist_head *glist;
+	struct lock_prof_table *table;
+	int i;
+
+	glist_for_each(glist, list) {
+		table = glist_entry(glist, struct lock_prof_table, tables);
+		if (table->gen != gen)
+			continue;
+		for (i = 0; i < LOCK_PROF_SLOTS; i++)
+			if (table->slots[i].site != NULL)
+				lp_add(stats, n, max, &table->slots[i]);
+	}
+}
+
+static int lp_cmp(const void *a, const void *b)
+{
+	const struct lock_prof_stats *sa = a, *sb = b;
+
+	if (sa->wait_ns != sb->wait_ns)
+		return sa->wait_ns < sb->wait_ns ? 1 : -1;
+	if (sa->hold_ns != sb->hold_ns)
+		return sa->hold_ns < sb->hold_ns ? 1 : -1;
+	return 0;
+}
+
+/**
+ * @brief Add up the counts of all threads
+ *
+ * @param[out] stats Sites, by decreasing time waited
+ * @param[in]  max   Room in stats
+ *
+ * @return The number of sites filled in.
+ */
+int lock_prof_report(struct lock_prof_stats *stats, int max)
+{
+	uint32_t gen = atomic_fetch_uint32_t(&lp_gen);
+	int n = 0;
+
+	pthread_mutex_lock(&lp_mtx);
+	lp_add_list(stats, &n, max, &lp_tables, gen);
+	lp_add_list(stats, &n, max, &lp_free, gen);
+	pthread_mutex_unlock(&lp_mtx);
+
+	qsort(stats, n, sizeof(*stats), lp_cmp);
+
+	return n;
+}
+
+#endif				/* USE_LOCK_PROF */
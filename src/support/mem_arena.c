@@ -0,0 +1,367 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file mem_arena.c
+ * @brief Allocator arenas per subsystem
+ *
+ * Each arena gets a jemalloc arena from arenas.create, and each thread
+ * a jemalloc thread cache per arena it allocates from, so tagged small
+ * allocations stay as cheap as plain ones.  A small block freed with
+ * gsh_free passes through the freeing thread's own cache before it is
+ * flushed back to its arena, so the split of usage is close rather
+ * than exact.
+ *
+ * Arenas are set up once at startup, before the workers run, and are
+ * never torn down.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <errno.h>
+#include "abstract_mem.h"
+#include "gsh_intrinsic.h"
+#include "log.h"
+#include "nfs_core.h"
+#include "gsh_slab.h"
+#include "mem_arena.h"
+#ifdef USE_JEMALLOC
+#include <jemalloc/jemalloc.h>
+#endif
+
+static const char *const mem_arena_names[MEM_ARENA_COUNT] = {
+	[MEM_ARENA_DEFAULT] = "default",
+	[MEM_ARENA_MDCACHE] = "mdcache",
+	[MEM_ARENA_SAL] = "sal",
+	[MEM_ARENA_RPC] = "rpc",
+	[MEM_ARENA_XDR] = "xdr",
+};
+
+/* The arena TI-RPC allocations of this thread are tagged with */
+static __thread uint8_t mem_arena_rpc_tag = MEM_ARENA_RPC;
+
+const char *mem_arena_name(enum mem_arena arena)
+{
+	return mem_arena_names[arena];
+}
+
+/**
+ * @brief Tag this thread's TI-RPC allocations
+ *
+ * @param[in] arena The arena to use from now on
+ *
+ * @return The arena used until now, to be set back after.
+ */
+enum mem_arena mem_arena_rpc_set(enum mem_arena arena)
+{
+	enum mem_arena old = mem_arena_rpc_tag;
+
+	mem_arena_rpc_tag = arena;
+	return old;
+}
+
+#ifdef USE_JEMALLOC
+
+static bool mem_arena_on;
+
+/* jemalloc arena index of each arena */
+static unsigned mem_arena_index[MEM_ARENA_COUNT];
+
+/* Thread caches, one per arena, index + 1 or 0 if not created yet */
+static __thread unsigned mem_arena_tcache[MEM_ARENA_COUNT];
+static pthread_key_t mem_arena_tc_key;
+
+static void mem_arena_tc_destroy(void *arg)
+{
+	unsigned tc;
+	int i;
+
+	for (i = MEM_ARENA_DEFAULT + 1; i < MEM_ARENA_COUNT; ++i) {
+		if (mem_arena_tcache[i] == 0)
+			continue;
+		tc = mem_arena_tcache[i] - 1;
+		(void) mallctl("tcache.destroy", NULL, NULL, &tc, sizeof(tc));
+		mem_arena_tcache[i] = 0;
+	}
+}
+
+/**
+ * @brief mallocx flags for an arena
+ *
+ * The first allocation of a thread from an arena creates its cache.
+ * Without one the allocation bypasses caching rather than fail.
+ */
+static int mem_arena_flags(enum mem_arena arena)
+{
+	unsigned tc;
+	size_t sz = sizeof(tc);
+
+	if (unlikely(mem_arena_tcache[arena] == 0)) {
+		if (mallctl("tcache.create", &tc, &sz, NULL, 0) != 0)
+			return MALLOCX_ARENA(mem_arena_index[arena]) |
+			       MALLOCX_TCACHE_NONE;
+		mem_arena_tcache[arena] = tc + 1;
+		(void) pthread_setspecific(mem_arena_tc_key, mem_arena_tcache);
+	}
+
+	return MALLOCX_ARENA(mem_arena_index[arena]) |
+	       MALLOCX_TCACHE(mem_arena_tcache[arena] - 1);
+}
+
+static inline bool mem_arena_tagged(enum mem_arena arena)
+{
+	return mem_arena_on && arena != MEM_ARENA_DEFAULT;
+}
+
+/**
+ * @brief Create the arenas if Memory_Arenas is set
+ */
+void mem_arena_init(void)
+{
+	unsigned idx;
+	size_t sz;
+	int i, rc;
+
+	if (!nfs_param.core_param.memory_arenas)
+		return;
+
+	rc = pthread_key_create(&mem_arena_tc_key, mem_arena_tc_destroy);
+	if (rc != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Unable to create arena key, memory arenas off: %d",
+			rc);
+		return;
+	}
+
+	for (i = MEM_ARENA_DEFAULT + 1; i < MEM_ARENA_COUNT; ++i) {
+		sz = sizeof(idx);
+		rc = mallctl("arenas.create", &idx, &sz, NULL, 0);
+		if (rc != 0) {
+			LogCrit(COMPONENT_INIT,
+				"Unable to create %s arena, memory arenas off: %s",
+				mem_arena_names[i], strerror(rc));
+			return;
+		}
+		mem_arena_index[i] = idx;
+	}
+
+	mem_arena_on = true;
+	LogEvent(COMPONENT_INIT, "Memory arenas per subsystem enabled");
+}
+
+bool mem_arena_enabled(void)
+{
+	return mem_arena_on;
+}
+
+static inline void *mem_arena_mallocx(enum mem_arena arena, size_t n,
+				      int flags)
+{
+	return mallocx(n == 0 ? 1 : n, mem_arena_flags(arena) | flags);
+}
+
+static size_t mem_arena_ctl_size(const char *fmt, unsigned idx)
+{
+	char name[64];
+	size_t val = 0, sz = sizeof(val);
+
+	(void) snprintf(name, sizeof(name), fmt, idx);
+	if (mallctl(name, &val, &sz, NULL, 0) != 0)
+		return 0;
+
+	return val;
+}
+
+static void mem_arena_fill_stats(struct mem_arena_stats *stats)
+{
+	uint64_t epoch = 1;
+	size_t sz = sizeof(epoch);
+	unsigned idx;
+	int i;
+
+	if (!mem_arena_on)
+		return;
+
+	/* Have jemalloc refresh its stats */
+	(void) mallctl("epoch", &epoch, &sz, &epoch, sz);
+
+	for (i = MEM_ARENA_DEFAULT + 1; i < MEM_ARENA_COUNT; ++i) {
+		idx = mem_arena_index[i];
+		stats[i].enabled = true;
+		stats[i].allocated =
+		    mem_arena_ctl_size("stats.arenas.%u.small.allocated",
+				       idx) +
+		    mem_arena_ctl_size("stats.arenas.%u.large.allocated",
+				       idx);
+		stats[i].resident =
+		    mem_arena_ctl_size("stats.arenas.%u.resident", idx);
+	}
+}
+
+#else				/* USE_JEMALLOC */
+
+void mem_arena_init(void)
+{
+	if (nfs_param.core_param.memory_arenas)
+		LogWarn(COMPONENT_INIT,
+			"Memory_Arenas needs a build with jemalloc, ignored");
+}
+
+bool mem_arena_enabled(void)
+{
+	return false;
+}
+
+static inline bool mem_arena_tagged(enum mem_arena arena)
+{
+	return false;
+}
+
+static inline void *mem_arena_mallocx(enum mem_arena arena, size_t n,
+				      int flags)
+{
+	return NULL;
+}
+
+static void mem_arena_fill_stats(struct mem_arena_stats *stats)
+{
+}
+
+#define MALLOCX_ZERO 0
+#define MALLOCX_ALIGN(a) 0
+
+#endif				/* USE_JEMALLOC */
+
+void *mem_arena_malloc__(enum mem_arena arena, size_t n,
+			 const char *file, int line, const char *function)
+{
+	void *p;
+
+	if (!mem_arena_tagged(arena))
+		return gsh_malloc__(n, file, line, function);
+
+	p = mem_arena_mallocx(arena, n, 0);
+	if (p == NULL) {
+		LogMallocFailure(file, line, function, "mem_arena_malloc");
+		abort();
+	}
+
+	return p;
+}
+
+void *mem_arena_malloc_aligned__(enum mem_arena arena, size_t a, size_t n,
+				 const char *file, int line,
+				 const char *function)
+{
+	void *p;
+
+	if (!mem_arena_tagged(arena))
+		return gsh_malloc_aligned__(a, n, file, line, function);
+
+	p = mem_arena_mallocx(arena, n, MALLOCX_ALIGN(a));
+	if (p == NULL) {
+		LogMallocFailure(file, line, function,
+				 "mem_arena_malloc_aligned");
+		abort();
+	}
+
+	return p;
+}
+
+void *mem_arena_calloc__(enum mem_arena arena, size_t n, size_t s,
+			 const char *file, int line, const char *function)
+{
+	void *p = NULL;
+
+	if (!mem_arena_tagged(arena))
+		return gsh_calloc__(n, s, file, line, function);
+
+	if (s == 0 || n <= SIZE_MAX / s)
+		p = mem_arena_mallocx(arena, n * s, MALLOCX_ZERO);
+	if (p == NULL) {
+		LogMallocFailure(file, line, function, "mem_arena_calloc");
+		abort();
+	}
+
+	return p;
+}
+
+void *mem_arena_rpc_malloc__(size_t n,
+			     const char *file, int line, const char *function)
+{
+	return mem_arena_malloc__(mem_arena_rpc_tag, n, file, line, function);
+}
+
+void *mem_arena_rpc_malloc_aligned__(size_t a, size_t n,
+				     const char *file, int line,
+				     const char *function)
+{
+	return mem_arena_malloc_aligned__(mem_arena_rpc_tag, a, n,
+					  file, line, function);
+}
+
+void *mem_arena_rpc_calloc__(size_t n, size_t s,
+			     const char *file, int line, const char *function)
+{
+	return mem_arena_calloc__(mem_arena_rpc_tag, n, s,
+				  file, line, function);
+}
+
+/**
+ * @brief Resize a TI-RPC block
+ *
+ * A block grown or moved by realloc lands in the thread's default
+ * arena; TI-RPC only resizes the occasional record buffer.
+ */
+void *mem_arena_rpc_realloc__(void *p, size_t n,
+			      const char *file, int line,
+			      const char *function)
+{
+	if (p == NULL)
+		return mem_arena_rpc_malloc__(n, file, line, function);
+
+	return gsh_realloc__(p, n, file, line, function);
+}
+
+/**
+ * @brief Report the usage of every arena
+ *
+ * Slab chunk bytes are reported in any build, so the split of the
+ * pools is known even without jemalloc.
+ *
+ * @param[out] stats Array of MEM_ARENA_COUNT entries
+ */
+void mem_arena_get_stats(struct mem_arena_stats *stats)
+{
+	struct gsh_slab_stats st[GSH_SLAB_MAX];
+	int i, n;
+
+	memset(stats, 0, MEM_ARENA_COUNT * sizeof(*stats));
+	for (i = 0; i < MEM_ARENA_COUNT; ++i)
+		stats[i].name = mem_arena_names[i];
+
+	mem_arena_fill_stats(stats);
+
+	n = gsh_slab_get_stats(st, GSH_SLAB_MAX);
+	for (i = 0; i < n; ++i)
+		stats[st[i].arena].slab_bytes += st[i].bytes;
+}
@@ -0,0 +1,444 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file mem_pressure.c
+ * @brief Memory pressure monitor
+ *
+ * The rating is the highest of:
+ *
+ * - the share of the memory limit in use, the limit being the
+ *   smaller of memory.max and memory.high of the cgroup (v2) the
+ *   server runs in, and usage its memory.current; or, when
+ *   Memory_Pressure_Limit is set, the resident size of the process
+ *   against it;
+ * - the PSI of the cgroup, or of the system without a cgroup, over
+ *   the last 10 seconds;
+ * - the memory.events of the cgroup, the kernel having throttled it
+ *   at memory.high or reclaimed at memory.max since the last check.
+ *
+ * Sources that cannot be read are left out, with none the rating
+ * stays MEM_PRESSURE_NONE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include "log.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "mem_pressure.h"
+
+/* Percent of the limit in use for each level */
+#define MP_USE_LOW 80
+#define MP_USE_MEDIUM 90
+#define MP_USE_HIGH 95
+
+/* Percent of time some tasks stalled on memory, avg10 */
+#define MP_SOME_LOW 5.0
+#define MP_SOME_MEDIUM 20.0
+
+/* Percent of time all tasks stalled on memory, avg10 */
+#define MP_FULL_HIGH 10.0
+
+/* Checks the rating must stay lower before it comes down a level */
+#define MP_CALM_CHECKS 3
+
+#define MP_CGROUP_ROOT "/sys/fs/cgroup"
+
+struct mp_state {
+	/** Directory of the cgroup of the server, empty if none */
+	char cgroup[MAXPATHLEN];
+	/** memory.events counts at the last check */
+	uint64_t ev_high;
+	uint64_t ev_max;
+	/** Checks the rating has stayed lower */
+	uint32_t calm;
+};
+
+static struct mp_state mp_state;
+static struct fridgethr *mp_fridge;
+static pthread_mutex_t mp_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head mp_shrinkers = GLIST_HEAD_INIT(mp_shrinkers);
+static uint32_t mp_level;
+
+static const char * const mp_level_str[] = {
+	[MEM_PRESSURE_NONE] = "none",
+	[MEM_PRESSURE_LOW] = "low",
+	[MEM_PRESSURE_MEDIUM] = "medium",
+	[MEM_PRESSURE_HIGH] = "high",
+};
+
+const char *mem_pressure_str(enum mem_pressure level)
+{
+	return mp_level_str[level];
+}
+
+/**
+ * @brief The current memory pressure
+ */
+enum mem_pressure mem_pressure_level(void)
+{
+	return atomic_fetch_uint32_t(&mp_level);
+}
+
+/**
+ * @brief Add a cache to those told of memory pressure
+ *
+ * @param[in] shrinker  The cache's shrinker, static
+ */
+void mem_pressure_register(struct mem_pressure_shrinker *shrinker)
+{
+	enum mem_pressure level;
+
+	PTHREAD_MUTEX_lock(&mp_mtx);
+	glist_add_tail(&mp_shrinkers, &shrinker->list);
+	level = atomic_fetch_uint32_t(&mp_level);
+	if (level != MEM_PRESSURE_NONE)
+		shrinker->shrink(level);
+	PTHREAD_MUTEX_unlock(&mp_mtx);
+}
+
+/**
+ * @brief Remove a cache being shut down
+ *
+ * @param[in] shrinker  The cache's shrinker
+ */
+void mem_pressure_unregister(struct mem_pressure_shrinker *shrinker)
+{
+	PTHREAD_MUTEX_lock(&mp_mtx);
+	glist_del(&shrinker->list);
+	PTHREAD_MUTEX_unlock(&mp_mtx);
+}
+
+/**
+ * @brief Read a small file of the cgroup, or any file
+ *
+ * @param[in]  dir   Directory, NULL for an absolute @a name
+ * @param[in]  name  File name
+ * @param[out] buf   Content, NUL terminated
+ * @param[in]  len   Size of @a buf
+ *
+ * @return true if read.
+ */
+static bool mp_read(const char *dir, const char *name, char *buf, size_t len)
+{
+	char path[MAXPATHLEN];
+	FILE *f;
+	size_t n;
+	int rc;
+
+	if (dir != NULL) {
+		rc = snprintf(path, sizeof(path), "%s/%s", dir, name);
+		if (rc < 0 || rc >= (int) sizeof(path))
+			return false;
+		name = path;
+	}
+
+	f = fopen(name, "r");
+	if (f == NULL)
+		return false;
+
+	n = fread(buf, 1, len - 1, f);
+	buf[n] = '\0';
+	fclose(f);
+
+	return n > 0;
+}
+
+/**
+ * @brief Read a number of bytes of the cgroup, "max" being none
+ *
+ * @return The number, or 0 if unlimited or unreadable.
+ */
+static uint64_t mp_read_bytes(const char *name)
+{
+	char buf[64];
+
+	if (mp_state.cgroup[0] == '\0' ||
+	    !mp_read(mp_state.cgroup, name, buf, sizeof(buf)) ||
+	    strncmp(buf, "max", 3) == 0)
+		return 0;
+
+	return strtoull(buf, NULL, 10);
+}
+
+/**
+ * @brief Find the cgroup v2 directory of the server
+ */
+static void mp_find_cgroup(void)
+{
+	char buf[MAXPATHLEN], *line, *nl;
+	int n;
+
+	mp_state.cgroup[0] = '\0';
+
+	if (!mp_read(NULL, "/proc/self/cgroup", buf, sizeof(buf)))
+		return;
+
+	/* The unified hierarchy is the "0::<path>" line */
+	for (line = buf; line != NULL && *line != '\0'; line = nl) {
+		nl = strchr(line, '\n');
+		if (nl != NULL)
+			*nl++ = '\0';
+		if (strncmp(line, "0::", 3) != 0)
+			continue;
+		n = snprintf(mp_state.cgroup, sizeof(mp_state.cgroup), "%s%s",
+			     MP_CGROUP_ROOT, strcmp(line + 3, "/") == 0
+						? "" : line + 3);
+		if (n < 0 || n >= (int) sizeof(mp_state.cgroup) ||
+		    access(mp_state.cgroup, R_OK) != 0)
+			mp_state.cgroup[0] = '\0';
+		break;
+	}
+}
+
+/**
+ * @brief Percent of the memory limit in use
+ *
+ * @return The larger of the cgroup's and the process's, 0 without
+ *	   a limit.
+ */
+static uint32_t mp_usage(void)
+{
+	uint64_t limit, high, current, rss;
+	uint32_t pct = 0;
+	char buf[128];
+
+	limit = mp_read_bytes("memory.max");
+	high = mp_read_bytes("memory.high");
+	if (high != 0 && (limit == 0 || high < limit))
+		limit = high;
+	if (limit != 0) {
+		current = mp_read_bytes("memory.current");
+		pct = current * 100 / limit;
+	}
+
+	limit = nfs_param.core_param.memory_pressure_limit;
+	if (limit != 0 &&
+	    mp_read(NULL, "/proc/self/statm", buf, sizeof(buf)) &&
+	    sscanf(buf, "%*u %"SCNu64, &rss) == 1) {
+		rss *= sysconf(_SC_PAGESIZE);
+		pct = MAX(pct, rss * 100 / limit);
+	}
+
+	return pct;
+}
+
+/**
+ * @brief Read the PSI of the cgroup, or of the system
+ *
+ * @param[out] some  avg10 of some tasks stalled
+ * @param[out] full  avg10 of all tasks stalled
+ */
+static void mp_psi(double *some, double *full)
+{
+	char buf[256];
+	char *line;
+
+	*some = 0.0;
+	*full = 0.0;
+
+	if (!(mp_state.cgroup[0] != '\0' &&
+	      mp_read(mp_state.cgroup, "memory.pressure", buf, sizeof(buf))) &&
+	    !mp_read(NULL, "/proc/pressure/memory", buf, sizeof(buf)))
+		return;
+
+	line = strstr(buf, "some avg10=");
+	if (line != NULL)
+		*some = strtod(line + strlen("some avg10="), NULL);
+	line = strstr(buf, "full avg10=");
+	if (line != NULL)
+		*full = strtod(line + strlen("full avg10="), NULL);
+}
+
+/**
+ * @brief Read a count of memory.events
+ */
+static uint64_t mp_event(const char *buf, const char *name)
+{
+	size_t len = strlen(name);
+	const char *p = buf;
+
+	while ((p = strstr(p, name)) != NULL) {
+		if ((p == buf || p[-1] == '\n') && p[len] == ' ')
+			return strtoull(p + len + 1, NULL, 10);
+		p += len;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Rate the memory pressure now
+ */
+static enum mem_pressure mp_rate(void)
+{
+	enum mem_pressure level = MEM_PRESSURE_NONE;
+	uint64_t ev_high = 0, ev_max = 0;
+	uint32_t usage = mp_usage();
+	double some, full;
+	char buf[256];
+
+	mp_psi(&some, &full);
+
+	if (mp_state.cgroup[0] != '\0' &&
+	    mp_read(mp_state.cgroup, "memory.events", buf, sizeof(buf))) {
+		ev_high = mp_event(buf, "high");
+		ev_max = mp_event(buf, "max") + mp_event(buf, "oom");
+	}
+
+	if (usage >= MP_USE_LOW || some >= MP_SOME_LOW)
+		level = MEM_PRESSURE_LOW;
+	if (usage >= MP_USE_MEDIUM || some >= MP_SOME_MEDIUM ||
+	    ev_high > mp_state.ev_high)
+		level = MEM_PRESSURE_MEDIUM;
+	if (usage >= MP_USE_HIGH || full >= MP_FULL_HIGH ||
+	    ev_max > mp_state.ev_max)
+		level = MEM_PRESSURE_HIGH;
+
+	LogFullDebug(COMPONENT_MEM_ALLOC,
+		     "usage %"PRIu32"%% some %.2f full %.2f high %"PRIu64
+		     " max %"PRIu64" rates %s",
+		     usage, some, full, ev_high, ev_max,
+		     mem_pressure_str(level));
+
+	mp_state.ev_high = ev_high;
+	mp_state.ev_max = ev_max;
+
+	return level;
+}
+
+static void mp_run(struct fridgethr_context *ctx)
+{
+	enum mem_pressure old = atomic_fetch_uint32_t(&mp_level);
+	enum mem_pressure level = mp_rate();
+	struct glist_head *glist;
+
+	SetNameFunction("mem_pressure");
+
+	if (level >= old) {
+		mp_state.calm = 0;
+	} else if (++mp_state.calm < MP_CALM_CHECKS) {
+		level = old;
+	} else {
+		/* Come down a level at a time */
+		mp_state.calm = 0;
+		level = old - 1;
+	}
+
+	if (level == old)
+		return;
+
+	LogEvent(COMPONENT_MEM_ALLOC,
+		 "Memory pressure went from %s to %s",
+		 mem_pressure_str(old), mem_pressure_str(level));
+
+	PTHREAD_MUTEX_lock(&mp_mtx);
+	atomic_store_uint32_t(&mp_level, level);
+	glist_for_each(glist, &mp_shrinkers) {
+		struct mem_pressure_shrinker *shrinker =
+			glist_entry(glist, struct mem_pressure_shrinker, list);
+
+		LogDebug(COMPONENT_MEM_ALLOC, "Telling %s", shrinker->name);
+		shrinker->shrink(level);
+	}
+	PTHREAD_MUTEX_unlock(&mp_mtx);
+}
+
+/**
+ * @brief Start the monitor, if configured
+ *
+ * @return 0 or an error from the fridge.
+ */
+int mem_pressure_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (nfs_param.core_param.memory_pressure_interval == 0)
+		return 0;
+
+	mp_find_cgroup();
+	if (mp_state.cgroup[0] == '\0')
+		LogInfo(COMPONENT_MEM_ALLOC,
+			"No cgroup v2 found, rating memory pressure from the system PSI and Memory_Pressure_Limit");
+
+	/* Only events from now on count */
+	(void) mp_rate();
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = nfs_param.core_param.memory_pressure_interval;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&mp_fridge, "mem_pressure", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_MEM_ALLOC,
+			 "Unable to initialize memory pressure fridge, error code %d.",
+			 rc);
+		mp_fridge = NULL;
+		return rc;
+	}
+
+	rc = fridgethr_submit(mp_fridge, mp_run, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_MEM_ALLOC,
+			 "Unable to start memory pressure thread, error code %d.",
+			 rc);
+		fridgethr_destroy(mp_fridge);
+		mp_fridge = NULL;
+	}
+
+	return rc;
+}
+
+int mem_pressure_shutdown(void)
+{
+	int rc;
+
+	if (mp_fridge == NULL)
+		return 0;
+
+	rc = fridgethr_sync_command(mp_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_MEM_ALLOC,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(mp_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_MEM_ALLOC,
+			 "Failed shutting down memory pressure thread: %d", rc);
+	}
+
+	fridgethr_destroy(mp_fridge);
+	mp_fridge = NULL;
+
+	return rc;
+}
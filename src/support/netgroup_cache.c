@@ -24,27 +24,78 @@
 #include <unistd.h>
 #include "gsh_intrinsic.h"
 #include "gsh_types.h"
+#include "gsh_list.h"
 #include "common_utils.h"
 #include "avltree.h"
 #include "abstract_atomic.h"
 #include "netdb.h"
 #include "abstract_mem.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
 #include "netgroup_cache.h"
 
+/**
+ * @file netgroup_cache.c
+ * @brief Cache of netgroup membership
+ *
+ * Results are spread over shards by hash, each with its own lock, tree
+ * and slot cache, so lookups of different hosts do not contend.
+ *
+ * With Netgroup_Lookup_Threads set, innetgr() is never called by a
+ * request.  A miss leaves a placeholder and is looked up by the
+ * lookup threads, the request going on as if the host were not a
+ * member, and the membership of the host in every netgroup named by
+ * an export is looked up in the same pass.  Results are looked up
+ * again once 3/4 of Netgroup_Expiration has passed, the old result
+ * being used until then.
+ */
+
+enum ng_state {
+	NG_MEMBER,
+	NG_NOT_MEMBER,
+	NG_RESOLVING,
+};
+
 /* Netgroup cache information */
 struct ng_cache_info {
 	struct avltree_node ng_node;
 	struct gsh_buffdesc ng_group;
 	struct gsh_buffdesc ng_host;
 	time_t ng_epoch;
+	uint32_t ng_state;	/*< enum ng_state */
+	uint32_t ng_refreshing;	/*< queued to be looked up again */
 };
 
-#define NG_CACHE_SIZE 1009
+#define NG_CACHE_SHARDS 16
+#define NG_CACHE_SIZE 251
+
+struct ng_shard {
+	pthread_rwlock_t ng_lock;
+	struct avltree ng_tree;
+	struct avltree_node *ng_cache[NG_CACHE_SIZE];
+} __attribute__((aligned(GSH_CACHE_LINE_SIZE)));
+
+static struct ng_shard ng_shards[NG_CACHE_SHARDS];
+
+/* Threads looking netgroups up, NULL to look them up on the caller */
+static struct fridgethr *ng_fridge;
+
+/* Hosts whose membership of all the exports' netgroups is being
+ * looked up */
+static pthread_mutex_t ng_hosts_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head ng_hosts = GLIST_HEAD_INIT(ng_hosts);
+
+struct ng_job {
+	struct glist_head list;	/*< on ng_hosts, for a host job */
+	char *group;		/*< NULL for all the exports' netgroups */
+	char *host;
+};
 
 /* Uses FNV hash */
 #define FNV_PRIME32 16777619
 #define FNV_OFFSET32 2166136261U
-static int ng_hash_key(struct ng_cache_info *info)
+static uint32_t ng_hash_key(struct ng_cache_info *info)
 {
 	uint32_t hash = FNV_OFFSET32;
 	char *bp, *end;
@@ -61,16 +112,19 @@ static int ng_hash_key(struct ng_cache_info *info)
 		hash ^= *bp++;
 		hash *= FNV_PRIME32;
 	}
-	return hash % NG_CACHE_SIZE;
+	return hash;
 }
 
-static struct avltree_node *ng_cache[NG_CACHE_SIZE];
-
-pthread_rwlock_t ng_lock = PTHREAD_RWLOCK_INITIALIZER;
+static inline struct ng_shard *ng_shard_of(uint32_t hash)
+{
+	return &ng_shards[hash % NG_CACHE_SHARDS];
+}
 
-/* Positive and negative cache trees */
-static struct avltree pos_ng_tree;
-static struct avltree neg_ng_tree;
+static inline struct avltree_node **ng_slot_of(struct ng_shard *shard,
+					       uint32_t hash)
+{
+	return &shard->ng_cache[(hash / NG_CACHE_SHARDS) % NG_CACHE_SIZE];
+}
 
 static inline int buffdesc_comparator(const struct gsh_buffdesc *buff1,
 				      const struct gsh_buffdesc *buff2)
@@ -100,29 +154,65 @@ static int ng_comparator(const struct avltree_node *node1,
 	return rc;
 }
 
-static bool ng_expired(struct avltree_node *node)
+static inline time_t ng_age(struct ng_cache_info *info)
 {
-	struct ng_cache_info *info;
-
-	info = avltree_container_of(node, struct ng_cache_info, ng_node);
+	return time(NULL) - info->ng_epoch;
+}
 
-	/* Hardcoded to 30 minutes for now */
-	if (time(NULL) - info->ng_epoch > 30 * 60)
-		return true;
+static bool ng_expired(struct ng_cache_info *info)
+{
+	return ng_age(info) > nfs_param.core_param.netgroup_expiration;
+}
 
-	return false;
+static inline void ng_prototype(struct ng_cache_info *prototype,
+				const char *group, const char *host)
+{
+	prototype->ng_group.addr = (char *)group;
+	prototype->ng_group.len = strlen(group) + 1;
+	prototype->ng_host.addr = (char *)host;
+	prototype->ng_host.len = strlen(host) + 1;
 }
 
+/**
+ * @brief Start the netgroup lookup threads
+ */
+static void ng_async_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (nfs_param.core_param.netgroup_lookup_threads == 0)
+		return;
 
+	memset(&frp, 0, sizeof(frp));
+	frp.thr_max = nfs_param.core_param.netgroup_lookup_threads;
+	frp.thread_delay = 60;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&ng_fridge, "netgroup", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_EXPORT,
+			 "Unable to initialize netgroup thread fridge: %d",
+			 rc);
+		ng_fridge = NULL;
+	}
+}
 
 /**
  * @brief Initialize the netgroups cache
  */
 void ng_cache_init(void)
 {
-	avltree_init(&pos_ng_tree, ng_comparator, 0);
-	avltree_init(&neg_ng_tree, ng_comparator, 0);
-	memset(ng_cache, 0, NG_CACHE_SIZE * sizeof(struct avltree_node *));
+	int i;
+
+	for (i = 0; i < NG_CACHE_SHARDS; i++) {
+		PTHREAD_RWLOCK_init(&ng_shards[i].ng_lock, NULL);
+		avltree_init(&ng_shards[i].ng_tree, ng_comparator, 0);
+		memset(ng_shards[i].ng_cache, 0,
+		       NG_CACHE_SIZE * sizeof(struct avltree_node *));
+	}
+
+	ng_async_init();
 }
 
 static void ng_free(struct ng_cache_info *info)
@@ -132,166 +222,303 @@ static void ng_free(struct ng_cache_info *info)
 	gsh_free(info);
 }
 
-/* The caller must hold ng_lock for write */
-static void ng_remove(struct ng_cache_info *info, bool negative)
+/* The caller must hold the shard's ng_lock for write */
+static void ng_remove(struct ng_shard *shard, struct ng_cache_info *info)
 {
-	if (negative) {
-		avltree_remove(&info->ng_node, &neg_ng_tree);
-	} else {
-		ng_cache[ng_hash_key(info)] = NULL;
-		avltree_remove(&info->ng_node, &pos_ng_tree);
-	}
+	struct avltree_node **slot = ng_slot_of(shard, ng_hash_key(info));
+
+	if (*slot == &info->ng_node)
+		*slot = NULL;
+	avltree_remove(&info->ng_node, &shard->ng_tree);
 }
 
- /* The caller must hold ng_lock for write */
-static void ng_add(const char *group, const char *host, bool negative)
+/* The caller must hold the shard's ng_lock */
+static struct ng_cache_info *ng_lookup(struct ng_shard *shard,
+				       struct ng_cache_info *prototype,
+				       uint32_t hash)
 {
-	struct ng_cache_info *info;
-	struct avltree_node *found_node;
-	struct ng_cache_info *found_info;
+	struct avltree_node **cache_slot = ng_slot_of(shard, hash);
+	struct avltree_node *node;
 
-	info = gsh_malloc(sizeof(struct ng_cache_info));
-	if (!info)
-		LogFatal(COMPONENT_IDMAPPER, "memory alloc failed");
+	node = atomic_fetch_voidptr((void **)cache_slot);
+	if (node && ng_comparator(node, &prototype->ng_node) == 0)
+		goto found;
 
-	info->ng_group.addr = gsh_strdup(group);
-	info->ng_group.len = strlen(group)+1;
-	info->ng_host.addr = gsh_strdup(host);
-	info->ng_host.len = strlen(host)+1;
-	info->ng_epoch = time(NULL);
+	/* cache miss, search AVL tree */
+	node = avltree_lookup(&prototype->ng_node, &shard->ng_tree);
+	if (!node)
+		return NULL;
 
-	if (negative) {
-		/* @todo check positive cache first? */
-		found_node = avltree_insert(&info->ng_node, &neg_ng_tree);
-
-		/* If an already existing entry is found, keep the old
-		 * entry, and free the current entry
-		 */
-		if (found_node) {
-			found_info = avltree_container_of(found_node,
-					struct ng_cache_info, ng_node);
-			found_info->ng_epoch = info->ng_epoch;
-			ng_free(info);
-		}
-	} else {
-		/* @todo delete from negative cache if there? */
-		found_node = avltree_insert(&info->ng_node, &pos_ng_tree);
-
-		/* If an already existing entry is found, keep the old
-		 * entry, and free the current entry
-		 */
-		if (found_node) {
-			found_info = avltree_container_of(found_node,
-					struct ng_cache_info, ng_node);
-			ng_cache[ng_hash_key(found_info)] = found_node;
-			found_info->ng_epoch = info->ng_epoch;
-			ng_free(info);
-		} else {
-			ng_cache[ng_hash_key(info)] = &info->ng_node;
-		}
+	atomic_store_voidptr((void **)cache_slot, node);
+
+found:
+	return avltree_container_of(node, struct ng_cache_info, ng_node);
+}
+
+/**
+ * @brief Set the state of a group and host, adding them if need be
+ *
+ * @param[in] group The netgroup
+ * @param[in] host  The host
+ * @param[in] state Its state
+ *
+ * @return false if the entry was already there and state is
+ *         NG_RESOLVING, so it has not been changed.
+ */
+static bool ng_set(const char *group, const char *host, enum ng_state state)
+{
+	struct ng_cache_info prototype, *info;
+	uint32_t hash;
+	struct ng_shard *shard;
+	bool added = true;
+
+	ng_prototype(&prototype, group, host);
+	hash = ng_hash_key(&prototype);
+	shard = ng_shard_of(hash);
+
+	PTHREAD_RWLOCK_wrlock(&shard->ng_lock);
+
+	info = ng_lookup(shard, &prototype, hash);
+	if (info == NULL) {
+		info = gsh_malloc(sizeof(struct ng_cache_info));
+		info->ng_group.addr = gsh_strdup(group);
+		info->ng_group.len = prototype.ng_group.len;
+		info->ng_host.addr = gsh_strdup(host);
+		info->ng_host.len = prototype.ng_host.len;
+		(void) avltree_insert(&info->ng_node, &shard->ng_tree);
+		*ng_slot_of(shard, hash) = &info->ng_node;
+	} else if (state == NG_RESOLVING) {
+		/* Someone else got there first */
+		added = false;
+		goto out;
 	}
+
+	info->ng_state = state;
+	info->ng_refreshing = state == NG_RESOLVING;
+	info->ng_epoch = time(NULL);
+
+out:
+	PTHREAD_RWLOCK_unlock(&shard->ng_lock);
+	return added;
 }
 
-/* The caller must hold ng_lock for read */
-static bool ng_lookup(const char *group, const char *host, bool negative)
+/**
+ * @brief Whether a group and host has a current result
+ */
+static bool ng_known(const char *group, const char *host)
 {
-	struct ng_cache_info prototype = {
-		.ng_group.addr = (char *)group,
-		.ng_group.len = strlen(group)+1,
-		.ng_host.addr = (char *)host,
-		.ng_host.len = strlen(host)+1
-	};
-	struct avltree_node *node;
-	struct ng_cache_info *info;
-	void **cache_slot;
+	struct ng_cache_info prototype, *info;
+	uint32_t hash;
+	struct ng_shard *shard;
+	bool known;
+
+	ng_prototype(&prototype, group, host);
+	hash = ng_hash_key(&prototype);
+	shard = ng_shard_of(hash);
+
+	PTHREAD_RWLOCK_rdlock(&shard->ng_lock);
+	info = ng_lookup(shard, &prototype, hash);
+	known = info != NULL && info->ng_state != NG_RESOLVING &&
+		!atomic_fetch_uint32_t(&info->ng_refreshing);
+	PTHREAD_RWLOCK_unlock(&shard->ng_lock);
+
+	return known;
+}
+
+static void ng_resolve(const char *group, const char *host)
+{
+	int rc = innetgr(group, host, NULL, NULL);
 
-	if (negative) {
-		node = avltree_lookup(&prototype.ng_node, &neg_ng_tree);
-		if (!node)
-			return false;
+	(void) ng_set(group, host, rc ? NG_MEMBER : NG_NOT_MEMBER);
+}
 
-		if (!ng_expired(node))
-			return true;
+struct ng_groups {
+	char **groups;
+	uint32_t count;
+	uint32_t size;
+};
 
-		goto expired;
+static void ng_collect_group(const char *group, void *arg)
+{
+	struct ng_groups *ngg = arg;
+	uint32_t i;
+
+	for (i = 0; i < ngg->count; i++)
+		if (strcmp(ngg->groups[i], group) == 0)
+			return;
+
+	if (ngg->count == ngg->size) {
+		ngg->size = ngg->size ? ngg->size * 2 : 8;
+		ngg->groups = gsh_realloc(ngg->groups,
+					  ngg->size * sizeof(char *));
 	}
+	ngg->groups[ngg->count++] = gsh_strdup(group);
+}
+
+/**
+ * @brief Look up the membership of a host in every export's netgroups
+ */
+static void ng_resolve_host(const char *host)
+{
+	struct ng_groups ngg = { NULL, 0, 0 };
+	uint32_t i;
 
-	/* Positive lookups are stored in the cache */
-	cache_slot = (void **)&ng_cache[ng_hash_key(&prototype)];
-	node = atomic_fetch_voidptr(cache_slot);
-	if (node && ng_comparator(node, &prototype.ng_node) == 0) {
-		if (!ng_expired(node))
-			return true;
-		goto expired;
+	foreach_export_netgroup(ng_collect_group, &ngg);
+
+	LogDebug(COMPONENT_EXPORT,
+		 "Looking up %s in %"PRIu32" netgroups", host, ngg.count);
+
+	for (i = 0; i < ngg.count; i++) {
+		if (!ng_known(ngg.groups[i], host))
+			ng_resolve(ngg.groups[i], host);
+		gsh_free(ngg.groups[i]);
 	}
+	gsh_free(ngg.groups);
+}
 
-	/* cache miss, search AVL tree */
-	node = avltree_lookup(&prototype.ng_node, &pos_ng_tree);
-	if (!node)
-		return false;
+static void ng_job_free(struct ng_job *job)
+{
+	gsh_free(job->group);
+	gsh_free(job->host);
+	gsh_free(job);
+}
 
-	if (ng_expired(node))
-		goto expired;
+static void ng_lookup_job(struct fridgethr_context *ctx)
+{
+	struct ng_job *job = ctx->arg;
 
-	atomic_store_voidptr(cache_slot, node);
+	if (job->group != NULL) {
+		ng_resolve(job->group, job->host);
+		ng_job_free(job);
+		return;
+	}
 
-	return true;
+	ng_resolve_host(job->host);
 
-expired:
-	/* entry expired, acquire write mode lock for removal */
-	PTHREAD_RWLOCK_unlock(&ng_lock);
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	PTHREAD_MUTEX_lock(&ng_hosts_lock);
+	glist_del(&job->list);
+	PTHREAD_MUTEX_unlock(&ng_hosts_lock);
 
-	/* Since we dropped the read mode lock and acquired write mode
-	 * lock, make sure that the entry is still in the tree.
-	 */
-	if (negative)
-		node = avltree_lookup(&prototype.ng_node, &neg_ng_tree);
-	else
-		node = avltree_lookup(&prototype.ng_node, &pos_ng_tree);
+	ng_job_free(job);
+}
 
-	if (node) {
-		info = avltree_container_of(node, struct ng_cache_info,
-					    ng_node);
-		ng_remove(info, negative);
-		ng_free(info);
+/**
+ * @brief Queue a lookup
+ *
+ * Looked up on the caller if it cannot be queued, so no entry is left
+ * resolving.
+ *
+ * @param[in] group The netgroup, NULL for all the exports' netgroups
+ * @param[in] host  The host
+ */
+static void ng_queue(const char *group, const char *host)
+{
+	struct ng_job *job;
+	struct glist_head *glist;
+	int rc;
+
+	job = gsh_calloc(1, sizeof(*job));
+	job->host = gsh_strdup(host);
+
+	if (group != NULL) {
+		job->group = gsh_strdup(group);
+		rc = fridgethr_submit(ng_fridge, ng_lookup_job, job);
+		if (rc != 0) {
+			LogMajor(COMPONENT_EXPORT,
+				 "Unable to queue netgroup lookup: %d", rc);
+			ng_resolve(group, host);
+			ng_job_free(job);
+		}
+		return;
 	}
-	PTHREAD_RWLOCK_unlock(&ng_lock);
-	PTHREAD_RWLOCK_rdlock(&ng_lock);
-	return false;
+
+	/* One pass over the exports' netgroups per host at a time */
+	PTHREAD_MUTEX_lock(&ng_hosts_lock);
+	glist_for_each(glist, &ng_hosts) {
+		if (strcmp(glist_entry(glist, struct ng_job, list)->host,
+			   host) == 0) {
+			PTHREAD_MUTEX_unlock(&ng_hosts_lock);
+			ng_job_free(job);
+			return;
+		}
+	}
+
+	rc = fridgethr_submit(ng_fridge, ng_lookup_job, job);
+	if (rc == 0)
+		glist_add_tail(&ng_hosts, &job->list);
+	PTHREAD_MUTEX_unlock(&ng_hosts_lock);
+
+	/* Only a prefetch, nothing waits for it */
+	if (rc != 0)
+		ng_job_free(job);
 }
 
 /**
  * @brief Verify if the given host is in the given netgroup or not
+ *
+ * @param[in]  group   The netgroup
+ * @param[in]  host    The host
+ * @param[out] pending Set if the result is not known yet, may be NULL
+ *
+ * @return true if the host is known to be in the netgroup.
  */
-bool ng_innetgr(const char *group, const char *host)
+bool ng_innetgr(const char *group, const char *host, bool *pending)
 {
+	struct ng_cache_info prototype, *info;
+	uint32_t hash;
+	struct ng_shard *shard;
+	bool refresh = false;
 	int rc;
 
-	/* Check positive lookup and then negative lookup.  If absent in
-	 * both, then do a real innetgr call and cache the results.
-	 */
-	PTHREAD_RWLOCK_rdlock(&ng_lock);
-	if (ng_lookup(group, host, false)) { /* positive lookup */
-		PTHREAD_RWLOCK_unlock(&ng_lock);
-		return true;
-	}
-	if (ng_lookup(group, host, true)) { /* negative lookup */
-		PTHREAD_RWLOCK_unlock(&ng_lock);
+	if (pending != NULL)
+		*pending = false;
+
+	ng_prototype(&prototype, group, host);
+	hash = ng_hash_key(&prototype);
+	shard = ng_shard_of(hash);
+
+	PTHREAD_RWLOCK_rdlock(&shard->ng_lock);
+	info = ng_lookup(shard, &prototype, hash);
+	if (info != NULL && info->ng_state == NG_RESOLVING) {
+		PTHREAD_RWLOCK_unlock(&shard->ng_lock);
+		if (pending != NULL)
+			*pending = true;
 		return false;
 	}
-	PTHREAD_RWLOCK_unlock(&ng_lock);
 
-	rc = innetgr(group, host, NULL, NULL);
+	if (info != NULL && (ng_fridge != NULL || !ng_expired(info))) {
+		rc = info->ng_state == NG_MEMBER;
 
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
-	if (rc)
-		ng_add(group, host, false);	/* positive lookup */
-	else
-		ng_add(group, host, true);	/* negative lookup */
-	PTHREAD_RWLOCK_unlock(&ng_lock);
+		/* Stale results are used while they are looked up again */
+		if (ng_fridge != NULL &&
+		    ng_age(info) >=
+			nfs_param.core_param.netgroup_expiration / 4 * 3)
+			refresh = atomic_cas_uint32_t(&info->ng_refreshing,
+						      0, 1);
+		PTHREAD_RWLOCK_unlock(&shard->ng_lock);
 
-	return rc;
+		if (refresh)
+			ng_queue(group, host);
+		return rc;
+	}
+	PTHREAD_RWLOCK_unlock(&shard->ng_lock);
+
+	if (ng_fridge == NULL) {
+		rc = innetgr(group, host, NULL, NULL);
+		(void) ng_set(group, host, rc ? NG_MEMBER : NG_NOT_MEMBER);
+		return rc;
+	}
+
+	/* First lookup of the pair, likely of a new client: look it up
+	 * along with the host's other netgroups. */
+	if (ng_set(group, host, NG_RESOLVING)) {
+		ng_queue(group, host);
+		ng_queue(NULL, host);
+	}
+
+	if (pending != NULL)
+		*pending = true;
+	return false;
 }
 
 /**
@@ -301,25 +528,24 @@ void ng_clear_cache(void)
 {
 	struct avltree_node *node;
 	struct ng_cache_info *info;
+	struct ng_shard *shard;
+	int i;
 
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	for (i = 0; i < NG_CACHE_SHARDS; i++) {
+		shard = &ng_shards[i];
 
-	while ((node = avltree_first(&pos_ng_tree))) {
-		info = avltree_container_of(node, struct ng_cache_info,
-					    ng_node);
-		ng_remove(info, false);
-		ng_free(info);
-	}
+		PTHREAD_RWLOCK_wrlock(&shard->ng_lock);
 
-	while ((node = avltree_first(&neg_ng_tree))) {
-		info = avltree_container_of(node, struct ng_cache_info,
-					    ng_node);
-		ng_remove(info, true);
-		ng_free(info);
-	}
+		/* Lookups in flight put their entries back */
+		while ((node = avltree_first(&shard->ng_tree))) {
+			info = avltree_container_of(node, struct ng_cache_info,
+						    ng_node);
+			ng_remove(shard, info);
+			ng_free(info);
+		}
 
-	assert(avltree_first(&pos_ng_tree) == NULL);
-	assert(avltree_first(&neg_ng_tree) == NULL);
+		assert(avltree_first(&shard->ng_tree) == NULL);
 
-	PTHREAD_RWLOCK_unlock(&ng_lock);
+		PTHREAD_RWLOCK_unlock(&shard->ng_lock);
+	}
 }
@@ -72,11 +72,152 @@ void nfs4_ace_free(fsal_ace_t *ace)
 	gsh_free(ace);
 }
 
+static int nfs4_acl_id_cmp(const void *a, const void *b)
+{
+	uint32_t ia = *(const uint32_t *)a;
+	uint32_t ib = *(const uint32_t *)b;
+
+	return ia < ib ? -1 : ia > ib;
+}
+
+/* Sort ids and drop duplicates, returns how many are left */
+static uint32_t nfs4_acl_id_sort(uint32_t *ids, uint32_t n)
+{
+	uint32_t i, j;
+
+	if (n == 0)
+		return 0;
+
+	qsort(ids, n, sizeof(*ids), nfs4_acl_id_cmp);
+
+	for (i = 1, j = 1; i < n; i++)
+		if (ids[i] != ids[j - 1])
+			ids[j++] = ids[i];
+
+	return j;
+}
+
+static uint32_t nfs4_acl_id_index(uint32_t *ids, uint32_t n, uint32_t id)
+{
+	uint32_t *found = bsearch(&id, ids, n, sizeof(*ids), nfs4_acl_id_cmp);
+
+	return found - ids;
+}
+
+static bool nfs4_acl_ace_counts(fsal_ace_t *ace)
+{
+	return (IS_FSAL_ACE_ALLOW(*ace) || IS_FSAL_ACE_DENY(*ace)) &&
+	       !IS_FSAL_ACE_INHERIT_ONLY(*ace);
+}
+
+/**
+ * @brief Build the evaluation form of a shared ACL
+ *
+ * Only the allow and deny ACEs that aren't inherit only are kept, in
+ * their original order, and those excluded from files or directories
+ * are dropped from that list.  The uid and gid tables are sorted for
+ * bsearch.
+ *
+ * @param[in] acl The ACL
+ *
+ * @return The compiled ACL.
+ */
+static struct fsal_acl_compiled *nfs4_acl_compile(fsal_acl_t *acl)
+{
+	struct fsal_acl_compiled *cacl;
+	struct fsal_acl_cace *cace;
+	fsal_ace_t *ace;
+	uint32_t i;
+	int is_dir;
+
+	cacl = gsh_calloc(1, sizeof(*cacl));
+	PTHREAD_MUTEX_init(&cacl->mtx, NULL);
+
+	/* uid_t and gid_t are both 32 bits, which the sort relies on */
+	cacl->uids = gsh_calloc(acl->naces + 1, sizeof(uid_t));
+	cacl->gids = gsh_calloc(acl->naces + 1, sizeof(gid_t));
+
+	for (ace = acl->aces; ace < acl->aces + acl->naces; ace++) {
+		if (!nfs4_acl_ace_counts(ace) || IS_FSAL_ACE_SPECIAL_ID(*ace))
+			continue;
+		if (IS_FSAL_ACE_GROUP_ID(*ace))
+			cacl->gids[cacl->ngids++] = ace->who.gid;
+		else
+			cacl->uids[cacl->nuids++] = ace->who.uid;
+	}
+
+	cacl->nuids = nfs4_acl_id_sort(cacl->uids, cacl->nuids);
+	cacl->ngids = nfs4_acl_id_sort(cacl->gids, cacl->ngids);
+
+	for (is_dir = 0; is_dir < 2; is_dir++) {
+		cace = gsh_calloc(acl->naces + 1, sizeof(*cace));
+		cacl->caces[is_dir] = cace;
+
+		for (i = 0; i < acl->naces; i++) {
+			ace = &acl->aces[i];
+
+			if (!nfs4_acl_ace_counts(ace))
+				continue;
+			if (is_dir ? !IS_FSAL_DIR_APPLICABLE(*ace)
+				   : !IS_FSAL_FILE_APPLICABLE(*ace))
+				continue;
+
+			cace->ace = i;
+
+			if (!IS_FSAL_ACE_SPECIAL_ID(*ace)) {
+				if (IS_FSAL_ACE_GROUP_ID(*ace)) {
+					cace->who = FSAL_ACL_WHO_GID;
+					cace->id = nfs4_acl_id_index(
+						cacl->gids, cacl->ngids,
+						ace->who.gid);
+				} else {
+					cace->who = FSAL_ACL_WHO_UID;
+					cace->id = nfs4_acl_id_index(
+						cacl->uids, cacl->nuids,
+						ace->who.uid);
+				}
+			} else if (ace->who.uid == FSAL_ACE_SPECIAL_OWNER) {
+				cace->who = FSAL_ACL_WHO_OWNER;
+			} else if (ace->who.uid == FSAL_ACE_SPECIAL_GROUP) {
+				cace->who = FSAL_ACL_WHO_GROUP;
+			} else if (ace->who.uid == FSAL_ACE_SPECIAL_EVERYONE) {
+				cace->who = FSAL_ACL_WHO_EVERYONE;
+			} else {
+				cace->who = FSAL_ACL_WHO_NOBODY;
+			}
+
+			cace++;
+		}
+
+		cacl->ncaces[is_dir] = cace - cacl->caces[is_dir];
+	}
+
+	LogFullDebug(COMPONENT_NFS_V4_ACL,
+		     "acl %p: %u uids, %u gids, %u file aces, %u dir aces",
+		     acl, cacl->nuids, cacl->ngids, cacl->ncaces[0],
+		     cacl->ncaces[1]);
+
+	return cacl;
+}
+
+static void nfs4_acl_compiled_free(struct fsal_acl_compiled *cacl)
+{
+	PTHREAD_MUTEX_destroy(&cacl->mtx);
+	gsh_free(cacl->uids);
+	gsh_free(cacl->gids);
+	gsh_free(cacl->caces[0]);
+	gsh_free(cacl->caces[1]);
+	gsh_free(cacl);
+}
+
 void nfs4_acl_free(fsal_acl_t *acl)
 {
 	if (!acl)
 		return;
 
+	if (acl->compiled)
+		nfs4_acl_compiled_free(acl->compiled);
+
 	if (acl->aces)
 		nfs4_ace_free(acl->aces);
 
@@ -154,6 +295,7 @@ fsal_acl_t *nfs4_acl_new_entry(fsal_acl_data_t *acldata,
 	acl->naces = acldata->naces;
 	acl->aces = acldata->aces;
 	acl->ref = 1;		/* We give out one reference */
+	acl->compiled = nfs4_acl_compile(acl);
 
 	/* Build the value */
 	value.addr = acl;
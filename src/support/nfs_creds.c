@@ -300,9 +300,21 @@ nfsstat4 nfs_req_creds(struct svc_req *req)
 #ifdef _HAVE_GSSAPI
 	case RPCSEC_GSS:
 		if ((op_ctx->cred_flags & CREDS_LOADED) == 0) {
+			struct gsh_buffdesc cname;
+
 			/* Get the gss data to process them */
 			gd = SVCAUTH_PRIVATE(req->rq_auth);
 
+			/* the context's mapping, from earlier requests */
+			cname.addr = gd->cname.value;
+			cname.len = gd->cname.length;
+			if (idmapper_lookup_by_gss(gd, &cname,
+					&op_ctx->original_creds.caller_uid,
+					&op_ctx->original_creds.caller_gid)) {
+				op_ctx->cred_flags |= CREDS_LOADED;
+				goto gss_loaded;
+			}
+
 			memcpy(principal, gd->cname.value, gd->cname.length);
 			principal[gd->cname.length] = 0;
 
@@ -335,9 +347,13 @@ nfsstat4 nfs_req_creds(struct svc_req *req)
 				break;
 			}
 
+			idmapper_add_gss(gd, &cname,
+					 op_ctx->original_creds.caller_uid,
+					 op_ctx->original_creds.caller_gid);
 			op_ctx->cred_flags |= CREDS_LOADED;
 		}
 
+ gss_loaded:
 		auth_label = "RPCSEC_GSS";
 		op_ctx->cred_flags |= MANAGED_GIDS;
 		garray_copy = &op_ctx->managed_garray_copy;
@@ -414,10 +430,13 @@ nfsstat4 nfs_req_creds(struct svc_req *req)
 	/* Check if we have manage_gids.				*/
 	/****************************************************************/
 	if ((op_ctx->cred_flags & MANAGED_GIDS) != 0) {
+		gsh_xprt_private_t *xu = req->rq_xprt->xp_u1;
+
 		/* Fetch the group data if required */
 		if (op_ctx->caller_gdata == NULL &&
-		    !uid2grp(op_ctx->original_creds.caller_uid,
-			     &op_ctx->caller_gdata)) {
+		    !uid2grp_xprt(xu != NULL ? &xu->gids : NULL,
+				  op_ctx->original_creds.caller_uid,
+				  &op_ctx->caller_gdata)) {
 			/** @todo: do we really want to bail here? */
 			LogCrit(COMPONENT_DISPATCH,
 				"Attempt to fetch managed_gids failed");
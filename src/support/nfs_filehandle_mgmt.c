@@ -67,6 +67,7 @@ struct fsal_obj_handle *nfs3_FhandleToCache(nfs_fh3 *fh3,
 	struct fsal_export *export;
 	struct fsal_obj_handle *obj = NULL;
 	struct gsh_buffdesc fh_desc;
+	uint64_t hint;
 
 	/* Default behaviour */
 	*rc = NFS_REQ_OK;
@@ -87,14 +88,21 @@ struct fsal_obj_handle *nfs3_FhandleToCache(nfs_fh3 *fh3,
 	/* Give the export a crack at it */
 	fh_desc.len = v3_handle->fs_len;
 	fh_desc.addr = &v3_handle->fsopaque;
+	hint = nfs_get_cache_hint(v3_handle->fhflags1, v3_handle->fsopaque,
+				  v3_handle->fs_len);
 
 	/* adjust the handle opaque into a cache key */
 	fsal_status =
 	    export->exp_ops.extract_handle(export, FSAL_DIGEST_NFSV3,
 					   &fh_desc,
-					   v3_handle->fhflags1);
-
-	if (!FSAL_IS_ERROR(fsal_status))
+					   v3_handle->fhflags1 &
+					   ~FH_CACHE_HINT);
+
+	if (!FSAL_IS_ERROR(fsal_status) && hint != 0)
+		fsal_status = export->exp_ops.create_handle_hint(export,
+								 &fh_desc,
+								 hint, &obj);
+	else if (!FSAL_IS_ERROR(fsal_status))
 		fsal_status = export->exp_ops.create_handle(export, &fh_desc,
 							    &obj, NULL);
 
@@ -124,6 +132,7 @@ bool nfs4_FSALToFhandle(bool allocate,
 {
 	file_handle_v4_t *file_handle;
 	struct gsh_buffdesc fh_desc;
+	uint64_t hint;
 
 	if (allocate) {
 		/* Allocating the filehandle in memory */
@@ -158,6 +167,14 @@ bool nfs4_FSALToFhandle(bool allocate,
 	/* keep track of the export id network byte order for nfs_fh4*/
 	file_handle->id.exports = htons(exp->export_id);
 
+	hint = fsalhandle->obj_ops.handle_cache_hint(fsalhandle);
+	if (hint != 0 &&
+	    nfs4_sizeof_handle(file_handle) + sizeof(hint) <= NFS4_FHSIZE) {
+		memcpy(file_handle->fsopaque + file_handle->fs_len, &hint,
+		       sizeof(hint));
+		file_handle->fhflags1 |= FH_CACHE_HINT;
+	}
+
 	/* Set the len */
 	fh4->nfs_fh4_len = nfs4_sizeof_handle(file_handle);
 
@@ -188,6 +205,8 @@ bool nfs3_FSALToFhandle(bool allocate,
 {
 	file_handle_v3_t *file_handle;
 	struct gsh_buffdesc fh_desc;
+	size_t max_len;
+	uint64_t hint;
 
 	if (allocate) {
 		/* Allocating the filehandle in memory */
@@ -222,6 +241,17 @@ bool nfs3_FSALToFhandle(bool allocate,
 	/* keep track of the export id in network byte order*/
 	file_handle->exportid = htons(exp->export_id);
 
+	/* Only add a hint if the handle stays within the client's limit */
+	max_len = nfs_param.core_param.short_file_handle ? 56 : NFS3_FHSIZE;
+	hint = fsalhandle->obj_ops.handle_cache_hint(fsalhandle);
+	if (hint != 0 &&
+	    offsetof(file_handle_v3_t, fsopaque) + file_handle->fs_len +
+	    sizeof(hint) <= max_len) {
+		memcpy(file_handle->fsopaque + file_handle->fs_len, &hint,
+		       sizeof(hint));
+		file_handle->fhflags1 |= FH_CACHE_HINT;
+	}
+
 	/* Set the len */
 	/* re-adjust to as built */
 	fh3->data.data_len = nfs3_sizeof_handle(file_handle);
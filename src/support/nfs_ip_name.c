@@ -27,6 +27,14 @@
 /**
  * @file    nfs_ip_name.c
  * @brief   The management of the IP/name cache.
+ *
+ * With Async_Resolve set, a worker never waits on DNS: a miss puts a
+ * placeholder in the cache and queues the address to the resolver
+ * threads, and the request goes on as if the name did not match (or
+ * waits at most Unresolved_Wait for it).  Names are looked up again
+ * in the background once 3/4 of their lifetime has passed, and
+ * addresses without a name are remembered for
+ * Negative_Expiration_Time.
  */
 
 #include "config.h"
@@ -36,7 +44,10 @@
 #include "nfs_exports.h"
 #include "nfs_ip_stats.h"
 #include "config_parsing.h"
+#include "fridgethr.h"
+#include "common_utils.h"
 #include <stdlib.h>
+#include <errno.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -46,6 +57,13 @@
 hash_table_t *ht_ip_name;
 unsigned int expiration_time;
 
+/* Threads resolving addresses for Async_Resolve */
+static struct fridgethr *ip_name_fridge;
+
+/* Broadcast whenever a resolution completes, for Unresolved_Wait */
+static pthread_mutex_t ip_name_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ip_name_cond = PTHREAD_COND_INITIALIZER;
+
 /**
  * @name Compute the hash value for the entry in IP/name cache
  *
@@ -131,6 +149,49 @@ int display_ip_name_val(struct gsh_buffdesc *pbuff, char *str)
 			nfs_ip_name->hostname);
 }
 
+/**
+ * @brief Reverse resolve an address
+ *
+ * @param[in]  ipaddr   The address
+ * @param[out] hostname Its name, or the address printed if it has none
+ * @param[in]  size     Size of hostname
+ *
+ * @return IP_NAME_RESOLVED or IP_NAME_FAILED.
+ */
+static enum ip_name_state ip_name_lookup(sockaddr_t *ipaddr, char *hostname,
+					 size_t size)
+{
+	struct timeval tv0, tv1, dur;
+	int rc;
+	char ipstring[SOCK_NAME_MAX + 1];
+
+	gettimeofday(&tv0, NULL);
+	rc = getnameinfo((struct sockaddr *)ipaddr, sizeof(sockaddr_t),
+			 hostname, size, NULL, 0, 0);
+	gettimeofday(&tv1, NULL);
+	timersub(&tv1, &tv0, &dur);
+
+	sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
+
+	/* display warning if DNS resolution took more that 1.0s */
+	if (dur.tv_sec >= 1) {
+		LogEvent(COMPONENT_DISPATCH,
+			 "Warning: long DNS query for %s: %u.%06u sec",
+			 ipstring, (unsigned int)dur.tv_sec,
+			 (unsigned int)dur.tv_usec);
+	}
+
+	if (rc != 0) {
+		strmaxcpy(hostname, ipstring, size);
+		LogEvent(COMPONENT_DISPATCH,
+			 "Cannot resolve address %s, error %s, using %s as hostname",
+			 ipstring, gai_strerror(rc), hostname);
+		return IP_NAME_FAILED;
+	}
+
+	return IP_NAME_RESOLVED;
+}
+
 /**
  *
  * nfs_ip_name_add: adds an entry into IP/name cache.
@@ -152,8 +213,6 @@ int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
 	struct gsh_buffdesc buffdata;
 	nfs_ip_name_t *nfs_ip_name = NULL;
 	sockaddr_t *pipaddr = NULL;
-	struct timeval tv0, tv1, dur;
-	int rc;
 	char ipstring[SOCK_NAME_MAX + 1];
 
 	nfs_ip_name = gsh_malloc(sizeof(nfs_ip_name_t));
@@ -168,32 +227,12 @@ int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
 	buffkey.addr = (caddr_t) pipaddr;
 	buffkey.len = sizeof(sockaddr_t);
 
-	gettimeofday(&tv0, NULL);
-	rc = getnameinfo((struct sockaddr *)pipaddr, sizeof(sockaddr_t),
-			 nfs_ip_name->hostname, sizeof(nfs_ip_name->hostname),
-			 NULL, 0, 0);
-	gettimeofday(&tv1, NULL);
-	timersub(&tv1, &tv0, &dur);
+	nfs_ip_name->state = ip_name_lookup(pipaddr, nfs_ip_name->hostname,
+					    sizeof(nfs_ip_name->hostname));
+	nfs_ip_name->refreshing = false;
 
 	sprint_sockip(pipaddr, ipstring, sizeof(ipstring));
 
-	/* display warning if DNS resolution took more that 1.0s */
-	if (dur.tv_sec >= 1) {
-		LogEvent(COMPONENT_DISPATCH,
-			 "Warning: long DNS query for %s: %u.%06u sec",
-			 ipstring, (unsigned int)dur.tv_sec,
-			 (unsigned int)dur.tv_usec);
-	}
-
-	/* Ask for the name to be cached */
-	if (rc != 0) {
-		strmaxcpy(nfs_ip_name->hostname, ipstring,
-			sizeof(nfs_ip_name->hostname));
-		LogEvent(COMPONENT_DISPATCH,
-			 "Cannot resolve address %s, error %s, using %s as hostname",
-			 ipstring, gai_strerror(rc), nfs_ip_name->hostname);
-	}
-
 	LogDebug(COMPONENT_DISPATCH, "Inserting %s->%s to addr cache", ipstring,
 		 nfs_ip_name->hostname);
 
@@ -224,30 +263,46 @@ int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
  * @param hostname [OUT] the hostname
  *
  * @return the result previously set if *pstatus == IP_NAME_SUCCESS
+ * @return IP_NAME_PENDING if the address is still being resolved.
  *
  */
 int nfs_ip_name_get(sockaddr_t *ipaddr, char *hostname, size_t size)
 {
 	struct gsh_buffdesc buffkey;
 	struct gsh_buffdesc buffval;
+	struct hash_latch latch;
 	nfs_ip_name_t *nfs_ip_name;
 	char ipstring[SOCK_NAME_MAX + 1];
+	int rc = IP_NAME_SUCCESS;
 
 	sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
 
 	buffkey.addr = (caddr_t) ipaddr;
 	buffkey.len = sizeof(sockaddr_t);
 
-	if (HashTable_Get(ht_ip_name,
-			  &buffkey,
-			  &buffval) == HASHTABLE_SUCCESS) {
+	/* Copy under the latch, the resolver updates entries in place */
+	switch (hashtable_getlatch(ht_ip_name, &buffkey, &buffval, false,
+				   &latch)) {
+	case HASHTABLE_SUCCESS:
 		nfs_ip_name = buffval.addr;
-		strmaxcpy(hostname, nfs_ip_name->hostname, size);
+		if (nfs_ip_name->state == IP_NAME_RESOLVING)
+			rc = IP_NAME_PENDING;
+		else
+			strmaxcpy(hostname, nfs_ip_name->hostname, size);
+		hashtable_releaselatched(ht_ip_name, &latch);
 
 		LogFullDebug(COMPONENT_DISPATCH, "Cache get hit for %s->%s",
-			     ipstring, nfs_ip_name->hostname);
+			     ipstring,
+			     rc == IP_NAME_PENDING ? "(resolving)" : hostname);
 
-		return IP_NAME_SUCCESS;
+		return rc;
+
+	case HASHTABLE_ERROR_NO_SUCH_KEY:
+		hashtable_releaselatched(ht_ip_name, &latch);
+		break;
+
+	default:
+		break;
 	}
 
 	LogFullDebug(COMPONENT_DISPATCH, "Cache get miss for %s", ipstring);
@@ -309,6 +364,11 @@ int nfs_ip_name_remove(sockaddr_t *ipaddr)
  */
 #define IP_NAME_EXPIRATION 3600
 
+/**
+ * @brief Default value for ip_name_param.negative_expiration_time
+ */
+#define IP_NAME_NEGATIVE_EXPIRATION 60
+
 
 /** @} */
 
@@ -324,6 +384,21 @@ struct ip_name_cache {
 	/** Expiration time for ip-name mappings.  Defautls to
 	    IP_NAME_Expiration, and settable with Expiration_Time. */
 	uint32_t expiration_time;
+	/** Expiration time for addresses without a name.  Defaults to
+	    IP_NAME_NEGATIVE_EXPIRATION, and settable with
+	    Negative_Expiration_Time. */
+	uint32_t negative_expiration_time;
+	/** Whether misses are resolved by the resolver threads rather
+	    than the worker.  Defaults to false, and settable with
+	    Async_Resolve. */
+	bool async_resolve;
+	/** Number of resolver threads.  Defaults to 4, and settable
+	    with Resolver_Threads. */
+	uint32_t resolver_threads;
+	/** Milliseconds a request waits for the resolver on a miss
+	    before going on without the name.  Defaults to 0, and
+	    settable with Unresolved_Wait. */
+	uint32_t unresolved_wait;
 };
 
 static struct ip_name_cache ip_name_cache = {
@@ -344,6 +419,15 @@ static struct config_item ip_name_params[] = {
 		       ip_name_cache, hash_param.index_size),
 	CONF_ITEM_UI32("Expiration_Time", 1, 60*60*24, IP_NAME_EXPIRATION,
 		       ip_name_cache, expiration_time),
+	CONF_ITEM_UI32("Negative_Expiration_Time", 1, 60*60*24,
+		       IP_NAME_NEGATIVE_EXPIRATION,
+		       ip_name_cache, negative_expiration_time),
+	CONF_ITEM_BOOL("Async_Resolve", false,
+		       ip_name_cache, async_resolve),
+	CONF_ITEM_UI32("Resolver_Threads", 1, 64, 4,
+		       ip_name_cache, resolver_threads),
+	CONF_ITEM_UI32("Unresolved_Wait", 0, 10000, 0,
+		       ip_name_cache, unresolved_wait),
 	CONFIG_EOL
 };
 
@@ -377,6 +461,192 @@ struct config_block nfs_ip_name = {
 	.blk_desc.u.blk.commit = ip_name_commit
 };
 
+/**
+ * @brief Resolve an address and update its entry
+ *
+ * @param[in] ipaddr The address, freed here
+ */
+static void ip_name_resolve_addr(sockaddr_t *ipaddr)
+{
+	char hostname[MAXHOSTNAMELEN + 1];
+	enum ip_name_state state;
+	struct gsh_buffdesc buffkey, buffval;
+	struct hash_latch latch;
+	nfs_ip_name_t *nfs_ip_name;
+	hash_error_t rc;
+
+	state = ip_name_lookup(ipaddr, hostname, sizeof(hostname));
+
+	buffkey.addr = (caddr_t) ipaddr;
+	buffkey.len = sizeof(sockaddr_t);
+
+	rc = hashtable_getlatch(ht_ip_name, &buffkey, &buffval, true, &latch);
+	if (rc == HASHTABLE_SUCCESS) {
+		nfs_ip_name = buffval.addr;
+		strmaxcpy(nfs_ip_name->hostname, hostname,
+			  sizeof(nfs_ip_name->hostname));
+		nfs_ip_name->state = state;
+		nfs_ip_name->refreshing = false;
+		nfs_ip_name->timestamp = time(NULL);
+	}
+	if (rc == HASHTABLE_SUCCESS || rc == HASHTABLE_ERROR_NO_SUCH_KEY)
+		hashtable_releaselatched(ht_ip_name, &latch);
+
+	PTHREAD_MUTEX_lock(&ip_name_mtx);
+	pthread_cond_broadcast(&ip_name_cond);
+	PTHREAD_MUTEX_unlock(&ip_name_mtx);
+
+	gsh_free(ipaddr);
+}
+
+static void ip_name_resolve_job(struct fridgethr_context *ctx)
+{
+	ip_name_resolve_addr(ctx->arg);
+}
+
+/**
+ * @brief Queue an address to the resolver threads
+ *
+ * Resolved inline if it cannot be queued, so no entry is left
+ * resolving.
+ */
+static void ip_name_queue(sockaddr_t *ipaddr)
+{
+	sockaddr_t *copy = gsh_malloc(sizeof(sockaddr_t));
+	int rc;
+
+	memcpy(copy, ipaddr, sizeof(sockaddr_t));
+
+	rc = fridgethr_submit(ip_name_fridge, ip_name_resolve_job, copy);
+	if (rc != 0) {
+		LogMajor(COMPONENT_DISPATCH,
+			 "Unable to queue address resolution: %d", rc);
+		ip_name_resolve_addr(copy);
+	}
+}
+
+/**
+ * @brief Wait up to Unresolved_Wait for an address being resolved
+ */
+static int ip_name_wait(sockaddr_t *ipaddr, char *hostname, size_t size)
+{
+	struct timespec deadline;
+	int rc;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	timespec_add_nsecs((nsecs_elapsed_t) ip_name_cache.unresolved_wait *
+			   NS_PER_MSEC, &deadline);
+
+	/* The resolver broadcasts under the mutex, so checking under it
+	 * does not miss a wakeup. */
+	PTHREAD_MUTEX_lock(&ip_name_mtx);
+	for (;;) {
+		rc = nfs_ip_name_get(ipaddr, hostname, size);
+		if (rc != IP_NAME_PENDING)
+			break;
+		if (pthread_cond_timedwait(&ip_name_cond, &ip_name_mtx,
+					   &deadline) == ETIMEDOUT) {
+			rc = nfs_ip_name_get(ipaddr, hostname, size);
+			break;
+		}
+	}
+	PTHREAD_MUTEX_unlock(&ip_name_mtx);
+
+	return rc;
+}
+
+/**
+ * @brief Get the name of an address for client matching
+ *
+ * Without Async_Resolve a miss is resolved by the caller.  With it, a
+ * miss is queued to the resolver threads, and a name found past 3/4
+ * of its lifetime is queued to be looked up again while it goes on
+ * being used.
+ *
+ * @param[in]  ipaddr   The address
+ * @param[out] hostname Its name
+ * @param[in]  size     Size of hostname
+ *
+ * @return IP_NAME_SUCCESS, or IP_NAME_PENDING if the name is not known
+ *         yet, or another error.
+ */
+int nfs_ip_name_resolve(sockaddr_t *ipaddr, char *hostname, size_t size)
+{
+	struct gsh_buffdesc buffkey, buffval;
+	struct hash_latch latch;
+	nfs_ip_name_t *nfs_ip_name;
+	sockaddr_t *pipaddr;
+	time_t now = time(NULL);
+	uint32_t ttl;
+	bool queue = false;
+	int rc;
+
+	if (!ip_name_cache.async_resolve) {
+		rc = nfs_ip_name_get(ipaddr, hostname, size);
+		if (rc == IP_NAME_NOT_FOUND)
+			rc = nfs_ip_name_add(ipaddr, hostname, size);
+		return rc;
+	}
+
+	buffkey.addr = (caddr_t) ipaddr;
+	buffkey.len = sizeof(sockaddr_t);
+
+	switch (hashtable_getlatch(ht_ip_name, &buffkey, &buffval, true,
+				   &latch)) {
+	case HASHTABLE_SUCCESS:
+		nfs_ip_name = buffval.addr;
+		if (nfs_ip_name->state == IP_NAME_RESOLVING) {
+			rc = IP_NAME_PENDING;
+		} else {
+			strmaxcpy(hostname, nfs_ip_name->hostname, size);
+			rc = IP_NAME_SUCCESS;
+
+			ttl = nfs_ip_name->state == IP_NAME_FAILED
+				? ip_name_cache.negative_expiration_time
+				: ip_name_cache.expiration_time;
+			if (!nfs_ip_name->refreshing &&
+			    now - nfs_ip_name->timestamp >= ttl / 4 * 3) {
+				nfs_ip_name->refreshing = true;
+				queue = true;
+			}
+		}
+		hashtable_releaselatched(ht_ip_name, &latch);
+		break;
+
+	case HASHTABLE_ERROR_NO_SUCH_KEY:
+		/* Claim the address, later misses find it resolving */
+		nfs_ip_name = gsh_malloc(sizeof(nfs_ip_name_t));
+		nfs_ip_name->state = IP_NAME_RESOLVING;
+		nfs_ip_name->refreshing = true;
+		nfs_ip_name->timestamp = now;
+		nfs_ip_name->hostname[0] = '\0';
+
+		pipaddr = gsh_malloc(sizeof(sockaddr_t));
+		memcpy(pipaddr, ipaddr, sizeof(sockaddr_t));
+
+		buffkey.addr = (caddr_t) pipaddr;
+		buffval.addr = (caddr_t) nfs_ip_name;
+		buffval.len = sizeof(nfs_ip_name_t);
+
+		(void) hashtable_setlatched(ht_ip_name, &buffkey, &buffval,
+					    &latch, false, NULL, NULL);
+		rc = IP_NAME_PENDING;
+		queue = true;
+		break;
+
+	default:
+		return IP_NAME_INSERT_MALLOC_ERROR;
+	}
+
+	if (queue)
+		ip_name_queue(ipaddr);
+
+	if (rc == IP_NAME_PENDING && ip_name_cache.unresolved_wait != 0)
+		rc = ip_name_wait(ipaddr, hostname, size);
+
+	return rc;
+}
+
 /**
  *
  * nfs_Init_ip_name: Init the hashtable for IP/name cache.
@@ -399,5 +669,22 @@ int nfs_Init_ip_name(void)
 	/* Set the expiration time */
 	expiration_time = ip_name_cache.expiration_time;
 
+	if (ip_name_cache.async_resolve) {
+		struct fridgethr_params frp;
+		int rc;
+
+		memset(&frp, 0, sizeof(frp));
+		frp.thr_max = ip_name_cache.resolver_threads;
+		frp.deferment = fridgethr_defer_queue;
+
+		rc = fridgethr_init(&ip_name_fridge, "ip_name", &frp);
+		if (rc != 0) {
+			LogCrit(COMPONENT_INIT,
+				"NFS IP_NAME: Cannot start resolver threads: %d",
+				rc);
+			return -1;
+		}
+	}
+
 	return IP_NAME_SUCCESS;
 }				/* nfs_Init_ip_name */
@@ -92,6 +92,12 @@ static struct config_item core_params[] = {
 		       nfs_core_param, program[P_RQUOTA]),
 	CONF_ITEM_UI32("Nb_Worker", 1, 1024*128, NB_WORKER_THREAD_DEFAULT,
 		       nfs_core_param, nb_worker),
+	CONF_ITEM_UI32("Nb_Worker_Min", 0, 1024*128, 0,
+		       nfs_core_param, nb_worker_min),
+	CONF_ITEM_UI32("Nb_Worker_Max", 0, 1024*128, 0,
+		       nfs_core_param, nb_worker_max),
+	CONF_ITEM_UI32("Worker_Queue_Wait_Target", 1, 10000000, 2000,
+		       nfs_core_param, worker_queue_wait_target),
 	CONF_ITEM_BOOL("Drop_IO_Errors", false,
 		       nfs_core_param, drop_io_errors),
 	CONF_ITEM_BOOL("Drop_Inval_Errors", false,
@@ -102,6 +108,44 @@ static struct config_item core_params[] = {
 		       nfs_core_param, dispatch_max_reqs),
 	CONF_ITEM_UI32("Dispatch_Max_Reqs_Xprt", 1, 2048, 512,
 		       nfs_core_param, dispatch_max_reqs_xprt),
+	CONF_ITEM_UI64("Dispatch_Max_Bytes", 0, UINT64_MAX, 0,
+		       nfs_core_param, dispatch_max_bytes),
+	CONF_ITEM_UI64("Dispatch_Max_Bytes_Xprt", 0, UINT64_MAX, 0,
+		       nfs_core_param, dispatch_max_bytes_xprt),
+	CONF_ITEM_UI32("Dispatch_Queue_Shards", 0, 1024, 1,
+		       nfs_core_param, dispatch_queue_shards),
+	CONF_ITEM_UI32("Dispatch_Weight_Mount", 1, 1000, 1,
+		       nfs_core_param, dispatch_weight_mount),
+	CONF_ITEM_UI32("Dispatch_Weight_Call", 1, 1000, 1,
+		       nfs_core_param, dispatch_weight_call),
+	CONF_ITEM_UI32("Dispatch_Weight_Low_Latency", 1, 1000, 1,
+		       nfs_core_param, dispatch_weight_low_latency),
+	CONF_ITEM_UI32("Dispatch_Weight_High_Latency", 1, 1000, 1,
+		       nfs_core_param, dispatch_weight_high_latency),
+	CONF_ITEM_UI32("Dispatch_Max_High_Latency", 0, 10000, 0,
+		       nfs_core_param, dispatch_max_high_latency),
+	CONF_ITEM_UI32("Dispatch_Inline_Budget", 0, 1024, 0,
+		       nfs_core_param, dispatch_inline_budget),
+	CONF_ITEM_UI32("Dispatch_Spin_Usec", 0, 1000, 0,
+		       nfs_core_param, dispatch_spin_usec),
+	CONF_ITEM_BOOL("Worker_NUMA_Pools", false,
+		       nfs_core_param, worker_numa_pools),
+	CONF_ITEM_BOOL("Memory_Arenas", false,
+		       nfs_core_param, memory_arenas),
+	CONF_ITEM_UI32("Upcall_Coalesce_Window", 0, 1000, 0,
+		       nfs_core_param, upcall_coalesce_window),
+	CONF_ITEM_BOOL("Async_IO", false,
+		       nfs_core_param, async_io),
+	CONF_ITEM_UI32("Readahead_Hint_Reads", 0, 1024, 0,
+		       nfs_core_param, readahead_hint_reads),
+	CONF_ITEM_UI32("Readahead_Hint_Size", 65536, 256 * 1024 * 1024,
+		       4 * 1024 * 1024,
+		       nfs_core_param, readahead_hint_size),
+	CONF_ITEM_UI32("IOBuf_Pool_Size", 0, 65536, IOBUF_POOL_SIZE_DEFAULT,
+		       nfs_core_param, iobuf_pool_size),
+	CONF_ITEM_UI32("IO_Segment_Size", 0, 16 * 1048576,
+		       IO_SEGMENT_SIZE_DEFAULT,
+		       nfs_core_param, io_segment_size),
 	CONF_ITEM_BOOL("DRC_Disabled", false,
 		       nfs_core_param, drc.disabled),
 	CONF_ITEM_UI32("DRC_TCP_Npart", 1, 20, DRC_TCP_NPART,
@@ -112,7 +156,7 @@ static struct config_item core_params[] = {
 		       nfs_core_param, drc.tcp.cachesz),
 	CONF_ITEM_UI32("DRC_TCP_Hiwat", 1, 256, DRC_TCP_HIWAT,
 		       nfs_core_param, drc.tcp.hiwat),
-	CONF_ITEM_UI32("DRC_TCP_Recycle_Npart", 1, 20, DRC_TCP_RECYCLE_NPART,
+	CONF_ITEM_UI32("DRC_TCP_Recycle_Npart", 1, 1021, DRC_TCP_RECYCLE_NPART,
 		       nfs_core_param, drc.tcp.recycle_npart),
 	CONF_ITEM_UI32("DRC_TCP_Recycle_Expire_S", 0, 60*60, 600,
 		       nfs_core_param, drc.tcp.recycle_expire_s),
@@ -134,15 +178,25 @@ static struct config_item core_params[] = {
 		       nfs_core_param, rpc.max_connections),
 	CONF_ITEM_UI32("RPC_Idle_Timeout_S", 0, 60*60, 300,
 		       nfs_core_param, rpc.idle_timeout_s),
-	CONF_ITEM_UI32("MaxRPCSendBufferSize", 1, 1048576*9,
+	CONF_ITEM_UI32("MaxRPCSendBufferSize", 1, NFS_MAX_RPC_BUFFER_SIZE,
 		       NFS_DEFAULT_SEND_BUFFER_SIZE,
 		       nfs_core_param, rpc.max_send_buffer_size),
-	CONF_ITEM_UI32("MaxRPCRecvBufferSize", 1, 1048576*9,
+	CONF_ITEM_UI32("MaxRPCRecvBufferSize", 1, NFS_MAX_RPC_BUFFER_SIZE,
 		       NFS_DEFAULT_RECV_BUFFER_SIZE,
 		       nfs_core_param, rpc.max_recv_buffer_size),
 	CONF_ITEM_UI32("RPC_Ioq_ThrdMax", 1, 1024*128, 200,
 		       nfs_core_param, rpc.ioq_thrd_max),
-	CONF_ITEM_UI32("RPC_GSS_Npart", 1, 1021, 13,
+	CONF_ITEM_UI32("RPC_TCP_Event_Channels", 0, 256, 0,
+		       nfs_core_param, rpc.tcp_event_chans),
+	CONF_ITEM_BOOL("RPC_Listen_Reuseport", false,
+		       nfs_core_param, rpc.listen_reuseport),
+	CONF_ITEM_UI32("RPC_UDP_Sockets", 1, 64, 1,
+		       nfs_core_param, rpc.udp_sockets),
+	CONF_ITEM_BOOL("RPC_Reply_Coalesce", false,
+		       nfs_core_param, rpc.reply_coalesce),
+	CONF_ITEM_UI32("RPC_Idle_Reclaim_S", 0, 60*60, 0,
+		       nfs_core_param, rpc.idle_reclaim_s),
+	CONF_ITEM_UI32("RPC_GSS_Npart", 0, 1021, 0,
 		       nfs_core_param, rpc.gss.ctx_hash_partitions),
 	CONF_ITEM_UI32("RPC_GSS_Max_Ctx", 1, 1024*1024, 16384,
 		       nfs_core_param, rpc.gss.max_ctx),
@@ -164,6 +218,12 @@ static struct config_item core_params[] = {
 		       nfs_core_param, clustered),
 	CONF_ITEM_BOOL("Enable_NLM", true,
 		       nfs_core_param, enable_NLM),
+	CONF_ITEM_UI32("NLM_Clients", 1, 1024 * 1024, 256,
+		       nfs_core_param, nlm_clients),
+	CONF_ITEM_UI32("NLM_Callback_Threads", 1, 256, 4,
+		       nfs_core_param, nlm_callback_threads),
+	CONF_ITEM_UI32("NSM_Unmonitor_Delay", 0, 3600, 60,
+		       nfs_core_param, nsm_unmonitor_delay),
 	CONF_ITEM_BOOL("Enable_RQUOTA", true,
 		       nfs_core_param, enable_RQUOTA),
 	CONF_ITEM_BOOL("Enable_TCP_keepalive", true,
@@ -176,18 +236,57 @@ static struct config_item core_params[] = {
 		       nfs_core_param, tcp_keepintvl),
 	CONF_ITEM_BOOL("Enable_Fast_Stats", false,
 		       nfs_core_param, enable_FASTSTATS),
+	CONF_ITEM_BOOL("Enable_Client_Latency_Histograms", false,
+		       nfs_core_param, enable_client_histograms),
+	CONF_ITEM_BOOL("Enable_CPU_Stats", false,
+		       nfs_core_param, enable_cpu_stats),
+	CONF_ITEM_UI32("Heavy_Hitters_Window", 0, 3600, 60,
+		       nfs_core_param, heavy_hitters_window),
+	CONF_ITEM_UI64("Client_QoS_IOPS", 0, UINT64_MAX, 0,
+		       nfs_core_param, client_qos_iops),
+	CONF_ITEM_UI64("Client_QoS_Bandwidth", 0, UINT64_MAX, 0,
+		       nfs_core_param, client_qos_bandwidth),
+	CONF_ITEM_UI32("QoS_Burst", 0, 60000, 100,
+		       nfs_core_param, qos_burst),
 	CONF_ITEM_BOOL("Short_File_Handle", false,
 		       nfs_core_param, short_file_handle),
 	CONF_ITEM_I64("Manage_Gids_Expiration", 0, 7*24*60*60, 30*60,
 			nfs_core_param, manage_gids_expiration),
+	CONF_ITEM_UI32("Manage_Gids_Lookup_Threads", 0, 256, 4,
+		       nfs_core_param, manage_gids_lookup_threads),
+	CONF_ITEM_UI32("Netgroup_Lookup_Threads", 0, 256, 0,
+		       nfs_core_param, netgroup_lookup_threads),
+	CONF_ITEM_UI32("Netgroup_Expiration", 60, 7*24*60*60, 30*60,
+		       nfs_core_param, netgroup_expiration),
+	CONF_ITEM_UI32("Export_Init_Threads", 1, 256, 1,
+		       nfs_core_param, export_init_threads),
 	CONF_ITEM_PATH("Plugins_Dir", 1, MAXPATHLEN, FSAL_MODULE_LOC,
 		       nfs_core_param, ganesha_modules_loc),
 	CONF_ITEM_UI32("heartbeat_freq", 0, 5000, 1000,
 		       nfs_core_param, heartbeat_freq),
+	CONF_ITEM_UI32("Dbus_Workers", 0, 64, 0,
+		       nfs_core_param, dbus_workers),
+	CONF_ITEM_UI32("Dbus_Stats_Interval", 0, 3600, 0,
+		       nfs_core_param, dbus_stats_interval),
+	CONF_ITEM_UI16("Metrics_Port", 0, UINT16_MAX, 0,
+		       nfs_core_param, metrics_port),
+	CONF_ITEM_IP_ADDR("Metrics_Addr", "127.0.0.1",
+			  nfs_core_param, metrics_addr),
 	CONF_ITEM_BOOL("fsid_device", false,
 		       nfs_core_param, fsid_device),
 	CONF_ITEM_BOOL("mount_path_pseudo", false,
 		       nfs_core_param, mount_path_pseudo),
+	CONF_ITEM_UI32("Flight_Recorder_Events", 0, 1024 * 1024, 1024,
+		       nfs_core_param, flight_rec_events),
+	CONF_ITEM_PATH("Flight_Recorder_File", 1, MAXPATHLEN,
+		       "/var/tmp/ganesha.flight",
+		       nfs_core_param, flight_rec_file),
+	CONF_ITEM_BOOL("Lock_Profile", false,
+		       nfs_core_param, lock_profile),
+	CONF_ITEM_UI32("Memory_Pressure_Interval", 0, 60, 0,
+		       nfs_core_param, memory_pressure_interval),
+	CONF_ITEM_UI64("Memory_Pressure_Limit", 0, UINT64_MAX, 0,
+		       nfs_core_param, memory_pressure_limit),
 	CONFIG_EOL
 };
 
@@ -235,6 +334,12 @@ struct config_block krb5_param = {
 #define GETPWNAMDEF true
 #endif
 
+static struct config_item_list recovery_backends[] = {
+	CONFIG_LIST_TOK("fs", RECOVERY_BACKEND_FS),
+	CONFIG_LIST_TOK("rados_kv", RECOVERY_BACKEND_RADOS_KV),
+	CONFIG_LIST_EOL
+};
+
 /**
  * @brief NFSv4 specific parameters
  */
@@ -246,6 +351,22 @@ static struct config_item version4_params[] = {
 		       nfs_version4_parameter, lease_lifetime),
 	CONF_ITEM_UI32("Grace_Period", 0, 180, GRACE_PERIOD_DEFAULT,
 		       nfs_version4_parameter, grace_period),
+	CONF_ITEM_BOOL("Lift_Grace", true,
+		       nfs_version4_parameter, lift_grace),
+	CONF_ITEM_BOOL("Scoped_Grace", false,
+		       nfs_version4_parameter, scoped_grace),
+	CONF_ITEM_UI32("Client_Owners_Soft_Limit", 0, UINT32_MAX, 0,
+		       nfs_version4_parameter, client_owners_soft),
+	CONF_ITEM_UI32("Client_Owners_Hard_Limit", 0, UINT32_MAX, 0,
+		       nfs_version4_parameter, client_owners_hard),
+	CONF_ITEM_UI32("Client_States_Soft_Limit", 0, UINT32_MAX, 0,
+		       nfs_version4_parameter, client_states_soft),
+	CONF_ITEM_UI32("Client_States_Hard_Limit", 0, UINT32_MAX, 0,
+		       nfs_version4_parameter, client_states_hard),
+	CONF_ITEM_UI32("Expected_Clients", 1, 1024 * 1024, 256,
+		       nfs_version4_parameter, expected_clients),
+	CONF_ITEM_UI32("Reconnect_Storm_Rate", 0, 1024 * 1024, 0,
+		       nfs_version4_parameter, reconnect_storm_rate),
 	CONF_ITEM_STR("DomainName", 1, MAXPATHLEN, DOMAINNAME_DEFAULT,
 		      nfs_version4_parameter, domainname),
 	CONF_ITEM_PATH("IdmapConf", 1, MAXPATHLEN, IDMAPCONF_DEFAULT,
@@ -256,8 +377,14 @@ static struct config_item version4_params[] = {
 		       nfs_version4_parameter, allow_numeric_owners),
 	CONF_ITEM_BOOL("Only_Numeric_Owners", false,
 		       nfs_version4_parameter, only_numeric_owners),
+	CONF_ITEM_UI32("Idmap_Cache_Refresh", 0, 7*24*60*60, 30*60,
+		       nfs_version4_parameter, idmap_cache_refresh),
 	CONF_ITEM_BOOL("Delegations", false,
 		       nfs_version4_parameter, allow_delegations),
+	CONF_ITEM_BOOL("Adaptive_Delegations", false,
+		       nfs_version4_parameter, adaptive_delegations),
+	CONF_ITEM_BOOL("Directory_Delegations", false,
+		       nfs_version4_parameter, dir_delegations),
 	CONF_ITEM_UI32("Deleg_Recall_Retry_Delay", 0, 10,
 			DELEG_RECALL_RETRY_DELAY_DEFAULT,
 			nfs_version4_parameter, deleg_recall_retry_delay),
@@ -265,6 +392,39 @@ static struct config_item version4_params[] = {
 		       nfs_version4_parameter, pnfs_mds),
 	CONF_ITEM_BOOL("PNFS_DS", true,
 		       nfs_version4_parameter, pnfs_ds),
+	CONF_ITEM_UI32("Max_Slots", 1, 1024, NFS41_MAX_SLOTS_DEFAULT,
+		       nfs_version4_parameter, max_slots),
+	CONF_ITEM_UI32("Max_CB_Slots", 1, 1024, NFS41_MAX_CB_SLOTS_DEFAULT,
+		       nfs_version4_parameter, max_cb_slots),
+	CONF_ITEM_UI32("Callback_Threads", 1, 256, 8,
+		       nfs_version4_parameter, callback_threads),
+	CONF_ITEM_UI32("Copy_Threads", 1, 256, 4,
+		       nfs_version4_parameter, copy_threads),
+	CONF_ITEM_UI64("Copy_Async_Threshold", 0, UINT64_MAX, 4194304,
+		       nfs_version4_parameter, copy_async_threshold),
+	CONF_ITEM_UI32("Slot_Table_Budget", 0, UINT32_MAX, 0,
+		       nfs_version4_parameter, slot_table_budget),
+	CONF_ITEM_BOOL("Slot_Reply_Encoded", false,
+		       nfs_version4_parameter, slot_reply_encoded),
+	CONF_ITEM_UI32("Slot_Reply_Cache_Size", 1, 65536, 64,
+		       nfs_version4_parameter, slot_reply_cache_size),
+	CONF_ITEM_BOOL("Readdir_Encode_Cache", false,
+		       nfs_version4_parameter, readdir_encode_cache),
+	CONF_ITEM_UI32("Open_Reuse_Delay", 0, 10000, 0,
+		       nfs_version4_parameter, open_reuse_delay),
+	CONF_ITEM_UI32("Async_Close_Threads", 0, 64, 0,
+		       nfs_version4_parameter, async_close_threads),
+	CONF_ITEM_BOOL("Pseudo_Lazy_Mount", false,
+		       nfs_version4_parameter, pseudo_lazy_mount),
+	CONF_ITEM_TOKEN("RecoveryBackend", RECOVERY_BACKEND_FS,
+			recovery_backends,
+			nfs_version4_parameter, recovery_backend),
+	CONF_ITEM_STR("Standby_Host", 1, MAXPATHLEN, NULL,
+		      nfs_version4_parameter, standby_host),
+	CONF_ITEM_UI16("Standby_Port", 0, UINT16_MAX, 0,
+		       nfs_version4_parameter, standby_port),
+	CONF_ITEM_UI16("Standby_Listen_Port", 0, UINT16_MAX, 0,
+		       nfs_version4_parameter, standby_listen_port),
 	CONFIG_EOL
 };
 
@@ -276,3 +436,44 @@ struct config_block version4_param = {
 	.blk_desc.u.blk.params = version4_params,
 	.blk_desc.u.blk.commit = noop_conf_commit
 };
+
+#ifdef _USE_NFS_RDMA
+/**
+ * @brief NFS/RDMA engine parameters
+ */
+
+static struct config_item rdma_params[] = {
+	CONF_ITEM_STR("Bind_Addr", 1, MAXPATHLEN, "::",
+		      nfs_rdma_parameter, bind_addr),
+	CONF_ITEM_UI16("Port", 1, UINT16_MAX, 20049,
+		       nfs_rdma_parameter, port),
+	CONF_ITEM_UI32("Backlog", 2, 4096, 10,
+		       nfs_rdma_parameter, backlog),
+	CONF_ITEM_UI32("SQ_Depth", 2, 16384, 32,
+		       nfs_rdma_parameter, sq_depth),
+	CONF_ITEM_UI32("Max_Send_SGE", 2, 256, 32,
+		       nfs_rdma_parameter, max_send_sge),
+	CONF_ITEM_UI32("RQ_Depth", 2, 16384, 32,
+		       nfs_rdma_parameter, rq_depth),
+	CONF_ITEM_UI32("Max_Recv_SGE", 1, 256, 31,
+		       nfs_rdma_parameter, max_recv_sge),
+	CONF_ITEM_UI32("Credits", 1, 16384, 30,
+		       nfs_rdma_parameter, credits),
+	CONF_ITEM_BOOL("Use_SRQ", false,
+		       nfs_rdma_parameter, use_srq),
+	CONF_ITEM_UI32("Send_Buffer_Size", 1024, 1048576, 4096,
+		       nfs_rdma_parameter, send_buffer_size),
+	CONF_ITEM_UI32("Recv_Buffer_Size", 1024, 1048576, 4096,
+		       nfs_rdma_parameter, recv_buffer_size),
+	CONFIG_EOL
+};
+
+struct config_block nfs_rdma_param = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.rdma",
+	.blk_desc.name = "NFS_RDMA",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = rdma_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+#endif				/* _USE_NFS_RDMA */
@@ -43,6 +43,8 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/param.h>
 #include <pthread.h>
 #include <assert.h>
@@ -60,6 +62,10 @@
 #include "server_stats.h"
 #include <abstract_atomic.h>
 #include "nfs_proto_functions.h"
+#include "gsh_iobuf.h"
+#include "gsh_slab.h"
+#include "nfs_dupreq.h"
+#include "nfs_metrics.h"
 
 #define NFS_V3_NB_COMMAND (NFSPROC3_COMMIT + 1)
 #define NFS_V4_NB_COMMAND 2
@@ -75,12 +81,12 @@
 #define NFS_pcp nfs_param.core_param
 #define NFS_program NFS_pcp.program
 
-#ifdef USE_DBUS
-
 struct op_name {
 	char *name;
 };
 
+#ifdef USE_DBUS
+
 static const struct op_name optqta[] = {
 	[RQUOTAPROC_GETQUOTA] = {.name = "GETQUOTA", },
 	[RQUOTAPROC_GETACTIVEQUOTA] = {.name = "GETACTIVEQUOTA", },
@@ -121,6 +127,9 @@ static const struct op_name optnlm[] = {
 	[NLMPROC4_FREE_ALL] = {.name = "FREE_ALL", },
 };
 
+#endif
+
+/* Also used to name the latency histograms */
 static const struct op_name optabv3[] = {
 	[NFSPROC3_NULL] = {.name = "NULL", },
 	[NFSPROC3_GETATTR] = {.name = "GETATTR", },
@@ -226,8 +235,6 @@ static const struct op_name optabv4[] = {
 	[NFS4_OP_REMOVEXATTR] = {.name = "OP_REMOVEXATTR",},
 };
 
-#endif
-
 /* Classify protocol ops for stats purposes
  */
 
@@ -431,14 +438,494 @@ struct deleg_stats {
 				       recall */
 	uint32_t failed_recalls;    /* times client failed to process recall */
 	uint32_t num_revokes;	    /* Num revokes for the client */
+	uint32_t num_declines;	    /* Grants declined by the adaptive policy */
 };
 
-static struct global_stats global_st;
+/* CPU time of the requests and NFSv4 ops of an export or client, with
+ * Enable_CPU_Stats
+ */
+struct cpu_stats {
+	uint64_t requests;
+	uint64_t nsecs;
+	uint64_t v4_ops[NFS4_OP_LAST_ONE];
+	uint64_t v4_nsecs[NFS4_OP_LAST_ONE];
+};
 
 /* include the top level server_stats struct definition
  */
 #include "server_stats_private.h"
 
+/* Per thread shards
+ *
+ * Export and global counters are updated by every worker for every
+ * request.  Each of their blocks is allocated as GSH_STATS_SHARDS
+ * copies, a cache line apart, and a thread only updates its own copy,
+ * so the atomics stay on lines no other core is writing.  The copies
+ * are only summed when DBus reports them.  A client's counters are
+ * only updated by that client's requests and there can be very many
+ * clients, so their blocks keep a single copy.
+ */
+static struct {
+	struct global_stats st;
+} __attribute__ ((aligned(GSH_CACHE_LINE_SIZE))) global_st[GSH_STATS_SHARDS];
+
+static __thread int32_t stats_thread_shard = -1;
+static uint32_t stats_next_shard;
+
+static inline uint32_t stats_shard(void)
+{
+	if (unlikely(stats_thread_shard < 0))
+		stats_thread_shard = atomic_inc_uint32_t(&stats_next_shard) %
+				     GSH_STATS_SHARDS;
+
+	return stats_thread_shard;
+}
+
+static inline struct global_stats *global_stats_shard(void)
+{
+	return &global_st[stats_shard()].st;
+}
+
+static inline size_t stats_stride(size_t size)
+{
+	return (size + GSH_CACHE_LINE_SIZE - 1) & ~(GSH_CACHE_LINE_SIZE - 1);
+}
+
+static inline uint32_t stats_nshards(struct gsh_stats *stats)
+{
+	return stats->shards > 1 ? stats->shards : 1;
+}
+
+/* Copy i of a block of size bytes */
+static inline void *stats_block_shard(void *block, size_t size, uint32_t i)
+{
+	return (char *)block + stats_stride(size) * i;
+}
+
+/* Latency histograms
+ *
+ * Buckets are log-linear in microseconds: below LAT_HIST_SUB usec each
+ * microsecond has a bucket, above it each power of two is split into
+ * LAT_HIST_SUB equal buckets, so a bucket is never wider than 1/8 of
+ * its lower bound.  The last bucket takes everything from about two
+ * minutes up.  A histogram is allocated for an op the first time it
+ * completes.
+ */
+#define LAT_HIST_SUB_BITS 3
+#define LAT_HIST_SUB (1 << LAT_HIST_SUB_BITS)
+#define LAT_HIST_OCTAVES 24
+#define LAT_HIST_BUCKETS ((LAT_HIST_OCTAVES + 1) * LAT_HIST_SUB)
+
+struct lat_hist {
+	uint64_t bucket[LAT_HIST_BUCKETS];
+};
+
+struct lat_hists {
+	struct lat_hist *v3[NFS_V3_NB_COMMAND];
+	struct lat_hist *v4[NFS4_OP_LAST_ONE];
+};
+
+static struct lat_hists global_hist;
+static pthread_rwlock_t global_hist_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* Server wide histograms of the time requests spend in each phase */
+static struct lat_hist *phase_hist[NFS_REQ_PHASE_COUNT];
+
+static const char * const phase_names[NFS_REQ_PHASE_COUNT] = {
+	[NFS_REQ_PHASE_QUEUE] = "queue",
+	[NFS_REQ_PHASE_SETUP] = "setup",
+	[NFS_REQ_PHASE_SERVICE] = "service",
+	[NFS_REQ_PHASE_REPLY] = "reply",
+};
+
+/* Server wide histograms of the time calls into each FSAL take, filled
+ * in by MDCACHE with FSAL_Latency_Histograms.  An FSAL takes a slot the
+ * first time it is timed, and keeps it.
+ */
+#define FSAL_HIST_MAX 16
+
+struct fsal_call_hists {
+	const char *fsal;	/*< FSAL name, NULL for a free slot */
+	struct lat_hist *call[FSAL_CALL_COUNT];
+};
+
+static struct fsal_call_hists fsal_hist[FSAL_HIST_MAX];
+
+static const char * const fsal_call_names[FSAL_CALL_COUNT] = {
+	[FSAL_CALL_LOOKUP] = "lookup",
+	[FSAL_CALL_READDIR] = "readdir",
+	[FSAL_CALL_GETATTRS] = "getattrs",
+	[FSAL_CALL_SETATTRS] = "setattrs",
+	[FSAL_CALL_OPEN] = "open",
+	[FSAL_CALL_CLOSE] = "close",
+	[FSAL_CALL_READ] = "read",
+	[FSAL_CALL_WRITE] = "write",
+	[FSAL_CALL_COMMIT] = "commit",
+	[FSAL_CALL_LOCK] = "lock",
+	[FSAL_CALL_CREATE] = "create",
+	[FSAL_CALL_LINK] = "link",
+	[FSAL_CALL_UNLINK] = "unlink",
+	[FSAL_CALL_RENAME] = "rename",
+	[FSAL_CALL_READLINK] = "readlink",
+	[FSAL_CALL_GETCHANGE] = "getchange",
+};
+
+static inline int lat_hist_index(nsecs_elapsed_t latency)
+{
+	uint64_t usec = latency / NS_PER_USEC;
+	int msb, idx;
+
+	if (usec < LAT_HIST_SUB)
+		return usec;
+
+	msb = 63 - __builtin_clzll(usec);
+	idx = (msb - LAT_HIST_SUB_BITS + 1) * LAT_HIST_SUB +
+	      ((usec >> (msb - LAT_HIST_SUB_BITS)) & (LAT_HIST_SUB - 1));
+
+	return idx < LAT_HIST_BUCKETS ? idx : LAT_HIST_BUCKETS - 1;
+}
+
+/* Smallest latency in usec that lands in bucket idx */
+static inline uint64_t lat_hist_lower(int idx)
+{
+	if (idx < LAT_HIST_SUB)
+		return idx;
+
+	return (uint64_t) (LAT_HIST_SUB + idx % LAT_HIST_SUB) <<
+	       (idx / LAT_HIST_SUB - 1);
+}
+
+/**
+ * @brief Count a latency in an op's histogram
+ *
+ * @param op      [IN] histogram slot of the op
+ * @param latency [IN] time consumed by the op
+ * @param lock    [IN] lock protecting allocation in hists
+ */
+static void record_lat_hist(struct lat_hist **op, nsecs_elapsed_t latency,
+			    pthread_rwlock_t *lock)
+{
+	if (unlikely(*op == NULL)) {
+		PTHREAD_RWLOCK_wrlock(lock);
+		if (*op == NULL)
+			*op = gsh_calloc(1, sizeof(struct lat_hist));
+		PTHREAD_RWLOCK_unlock(lock);
+	}
+
+	(void)atomic_inc_uint64_t(&(*op)->bucket[lat_hist_index(latency)]);
+}
+
+static struct lat_hists *get_lat_hists(struct gsh_stats *stats,
+				       pthread_rwlock_t *lock)
+{
+	if (unlikely(stats->hist == NULL)) {
+		PTHREAD_RWLOCK_wrlock(lock);
+		if (stats->hist == NULL)
+			stats->hist = gsh_calloc(1, sizeof(struct lat_hists));
+		PTHREAD_RWLOCK_unlock(lock);
+	}
+	return stats->hist;
+}
+
+static void record_v3_lat_hist(struct gsh_stats *stats,
+			       pthread_rwlock_t *lock, uint32_t proto_op,
+			       nsecs_elapsed_t latency)
+{
+	struct lat_hists *hists = get_lat_hists(stats, lock);
+
+	record_lat_hist(&hists->v3[proto_op], latency, lock);
+}
+
+static void record_v4_lat_hist(struct gsh_stats *stats,
+			       pthread_rwlock_t *lock, int proto_op,
+			       nsecs_elapsed_t latency)
+{
+	struct lat_hists *hists = get_lat_hists(stats, lock);
+
+	record_lat_hist(&hists->v4[proto_op], latency, lock);
+}
+
+/**
+ * @brief Count the time a request spent in one phase
+ *
+ * @param phase   [IN] the phase that ended
+ * @param elapsed [IN] time spent in it
+ */
+void server_stats_req_phase_done(enum nfs_req_phase phase,
+				 nsecs_elapsed_t elapsed)
+{
+	record_lat_hist(&phase_hist[phase], elapsed, &global_hist_lock);
+}
+
+/**
+ * @brief Total the time requests have spent in one phase
+ *
+ * Each request is counted at the bottom of its bucket, so the total
+ * is short by up to an eighth.
+ *
+ * @param phase  [IN]  the phase
+ * @param count  [OUT] requests that went through it
+ * @param usecs  [OUT] time they spent in it
+ */
+void server_stats_req_phase_sum(enum nfs_req_phase phase, uint64_t *count,
+				uint64_t *usecs)
+{
+	struct lat_hist *hist =
+		atomic_fetch_voidptr((void **)&phase_hist[phase]);
+	uint64_t n;
+	int idx;
+
+	*count = 0;
+	*usecs = 0;
+	if (hist == NULL)
+		return;
+
+	for (idx = 0; idx < LAT_HIST_BUCKETS; ++idx) {
+		n = atomic_fetch_uint64_t(&hist->bucket[idx]);
+		*count += n;
+		*usecs += n * lat_hist_lower(idx);
+	}
+}
+
+/**
+ * @brief Count the time a call into an FSAL took
+ *
+ * FSALs are told apart by the address of their name, which lives as
+ * long as the module.  Past FSAL_HIST_MAX of them, calls go uncounted.
+ *
+ * @param fsal    [IN] name of the FSAL called
+ * @param call    [IN] what was called
+ * @param elapsed [IN] time it took
+ */
+void server_stats_fsal_call_done(const char *fsal, enum fsal_call call,
+				 nsecs_elapsed_t elapsed)
+{
+	const char *name;
+	int i;
+
+	for (i = 0; i < FSAL_HIST_MAX; i++) {
+		name = atomic_fetch_voidptr((void **)&fsal_hist[i].fsal);
+		if (name == fsal)
+			break;
+		if (name != NULL)
+			continue;
+
+		PTHREAD_RWLOCK_wrlock(&global_hist_lock);
+		if (fsal_hist[i].fsal == NULL)
+			atomic_store_voidptr((void **)&fsal_hist[i].fsal,
+					     (void *)fsal);
+		name = fsal_hist[i].fsal;
+		PTHREAD_RWLOCK_unlock(&global_hist_lock);
+
+		/* Another FSAL may have raced us to the slot */
+		if (name == fsal)
+			break;
+	}
+
+	if (i == FSAL_HIST_MAX)
+		return;
+
+	record_lat_hist(&fsal_hist[i].call[call], elapsed, &global_hist_lock);
+}
+
+static void lat_hists_free(struct lat_hists *hists)
+{
+	int i;
+
+	for (i = 0; i < NFS_V3_NB_COMMAND; i++)
+		gsh_free(hists->v3[i]);
+	for (i = 0; i < NFS4_OP_LAST_ONE; i++)
+		gsh_free(hists->v4[i]);
+}
+
+/* Heavy hitters
+ *
+ * The files, clients and exports doing the most ops and moving the most
+ * bytes are tracked with the space-saving algorithm.  A table keeps
+ * HH_SLOTS counters; a key not in a full table takes over the smallest
+ * counter and inherits its count as its error, so any key with more
+ * than 1/HH_SLOTS of the table's weight is always present and no count
+ * is low.  Tables are sharded per thread like the global stats, and
+ * kept for the current and the previous window of Heavy_Hitters_Window
+ * seconds, so a report covers between one and two windows.
+ */
+#define HH_SLOTS 32
+
+enum hh_kind {
+	HH_FILE,
+	HH_CLIENT,
+	HH_EXPORT,
+	HH_KIND_COUNT
+};
+
+enum hh_metric {
+	HH_OPS,
+	HH_BYTES,
+	HH_METRIC_COUNT
+};
+
+static const char * const hh_kind_names[HH_KIND_COUNT] = {
+	[HH_FILE] = "file",
+	[HH_CLIENT] = "client",
+	[HH_EXPORT] = "export",
+};
+
+static const char * const hh_metric_names[HH_METRIC_COUNT] = {
+	[HH_OPS] = "ops",
+	[HH_BYTES] = "bytes",
+};
+
+/* fsid major, minor, fileid for a file; address bytes and length for
+ * a client; export id for an export */
+struct hh_key {
+	uint64_t w[3];
+};
+
+struct hh_item {
+	struct hh_key key;
+	uint64_t count;
+	uint64_t error;
+};
+
+struct hh_table {
+	uint32_t used;
+	uint32_t tag[HH_SLOTS];
+	uint64_t count[HH_SLOTS];
+	uint64_t error[HH_SLOTS];
+	struct hh_key key[HH_SLOTS];
+};
+
+struct hh_shard {
+	pthread_mutex_t mtx;
+	time_t epoch;
+	/* current and previous window */
+	struct hh_table win[2][HH_METRIC_COUNT];
+} __attribute__ ((aligned(GSH_CACHE_LINE_SIZE)));
+
+static struct hh_shard hh_shards[HH_KIND_COUNT][GSH_STATS_SHARDS];
+
+static inline uint32_t hh_tag(const struct hh_key *key)
+{
+	uint64_t h = key->w[0] * 0x9e3779b97f4a7c15ULL ^
+		     key->w[1] * 0xc2b2ae3d27d4eb4fULL ^
+		     key->w[2] * 0x165667b19e3779f9ULL;
+
+	return h ^ (h >> 32);
+}
+
+static inline bool hh_key_eq(const struct hh_key *a, const struct hh_key *b)
+{
+	return a->w[0] == b->w[0] && a->w[1] == b->w[1] &&
+	       a->w[2] == b->w[2];
+}
+
+static void hh_table_add(struct hh_table *t, const struct hh_key *key,
+			 uint32_t tag, uint64_t weight)
+{
+	uint32_t i, min;
+
+	for (i = 0; i < t->used; i++) {
+		if (t->tag[i] == tag && hh_key_eq(&t->key[i], key)) {
+			t->count[i] += weight;
+			return;
+		}
+	}
+
+	if (t->used < HH_SLOTS) {
+		i = t->used++;
+		t->error[i] = 0;
+		t->count[i] = weight;
+	} else {
+		for (min = 0, i = 1; i < HH_SLOTS; i++) {
+			if (t->count[i] < t->count[min])
+				min = i;
+		}
+		i = min;
+		t->error[i] = t->count[i];
+		t->count[i] += weight;
+	}
+	t->tag[i] = tag;
+	t->key[i] = *key;
+}
+
+/* Called with the shard locked */
+static void hh_rotate(struct hh_shard *shard, time_t epoch)
+{
+	if (likely(shard->epoch == epoch))
+		return;
+
+	if (epoch == shard->epoch + 1)
+		memcpy(shard->win[1], shard->win[0], sizeof(shard->win[0]));
+	else
+		memset(shard->win[1], 0, sizeof(shard->win[1]));
+	memset(shard->win[0], 0, sizeof(shard->win[0]));
+	shard->epoch = epoch;
+}
+
+static void hh_record(enum hh_kind kind, const struct hh_key *key,
+		      uint64_t ops, uint64_t bytes, time_t epoch)
+{
+	struct hh_shard *shard = &hh_shards[kind][stats_shard()];
+	uint32_t tag = hh_tag(key);
+
+	PTHREAD_MUTEX_lock(&shard->mtx);
+	hh_rotate(shard, epoch);
+	if (ops != 0)
+		hh_table_add(&shard->win[0][HH_OPS], key, tag, ops);
+	if (bytes != 0)
+		hh_table_add(&shard->win[0][HH_BYTES], key, tag, bytes);
+	PTHREAD_MUTEX_unlock(&shard->mtx);
+}
+
+/**
+ * @brief Feed the heavy hitters from the current request
+ *
+ * @param obj   [IN] file the request did I/O to, or NULL
+ * @param ops   [IN] ops to count for the client and export
+ * @param bytes [IN] bytes transferred
+ */
+static void hh_record_request(struct fsal_obj_handle *obj, uint64_t ops,
+			      uint64_t bytes)
+{
+	struct gsh_client *client = op_ctx->client;
+	uint32_t window = nfs_param.core_param.heavy_hitters_window;
+	struct hh_key key;
+	time_t epoch;
+
+	if (window == 0)
+		return;
+
+	epoch = time(NULL) / window;
+
+	if (obj != NULL) {
+		key.w[0] = obj->fsid.major;
+		key.w[1] = obj->fsid.minor;
+		key.w[2] = obj->fileid;
+		hh_record(HH_FILE, &key, 1, bytes, epoch);
+	}
+	if (client != NULL) {
+		memset(&key, 0, sizeof(key));
+		memcpy(key.w, client->addr.addr,
+		       MIN(client->addr.len, sizeof(key.w[0]) * 2));
+		key.w[2] = client->addr.len;
+		hh_record(HH_CLIENT, &key, ops, bytes, epoch);
+	}
+	if (op_ctx->ctx_export != NULL) {
+		memset(&key, 0, sizeof(key));
+		key.w[0] = op_ctx->ctx_export->export_id;
+		hh_record(HH_EXPORT, &key, ops, bytes, epoch);
+	}
+}
+
+void server_stats_pkginit(void)
+{
+	int k, s;
+
+	for (k = 0; k < HH_KIND_COUNT; k++)
+		for (s = 0; s < GSH_STATS_SHARDS; s++)
+			PTHREAD_MUTEX_init(&hh_shards[k][s].mtx, NULL);
+}
+
 /**
  * @brief Get stats struct helpers
  *
@@ -453,93 +940,81 @@ static struct global_stats global_st;
  * @TODO make them inlines for release
  */
 
-static struct nfsv3_stats *get_v3(struct gsh_stats *stats,
-				  pthread_rwlock_t *lock)
+static void *get_stats_block(void **blockp, size_t size,
+			     struct gsh_stats *stats, pthread_rwlock_t *lock)
 {
-	if (unlikely(stats->nfsv3 == NULL)) {
+	uint32_t nshards = stats_nshards(stats);
+
+	if (unlikely(*blockp == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->nfsv3 == NULL)
-			stats->nfsv3 =
-			    gsh_calloc(1, sizeof(struct nfsv3_stats));
+		if (*blockp == NULL) {
+			void *block = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+						stats_stride(size) * nshards);
+
+			memset(block, 0, stats_stride(size) * nshards);
+			*blockp = block;
+		}
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->nfsv3;
+
+	return stats_block_shard(*blockp, size,
+				 nshards > 1 ? stats_shard() : 0);
+}
+
+static struct nfsv3_stats *get_v3(struct gsh_stats *stats,
+				  pthread_rwlock_t *lock)
+{
+	return get_stats_block((void **)&stats->nfsv3,
+			       sizeof(struct nfsv3_stats), stats, lock);
 }
 
 static struct mnt_stats *get_mnt(struct gsh_stats *stats,
 				 pthread_rwlock_t *lock)
 {
-	if (unlikely(stats->mnt == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->mnt == NULL)
-			stats->mnt = gsh_calloc(1, sizeof(struct mnt_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->mnt;
+	return get_stats_block((void **)&stats->mnt,
+			       sizeof(struct mnt_stats), stats, lock);
 }
 
 static struct nlmv4_stats *get_nlm4(struct gsh_stats *stats,
 				    pthread_rwlock_t *lock)
 {
-	if (unlikely(stats->nlm4 == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->nlm4 == NULL)
-			stats->nlm4 = gsh_calloc(1, sizeof(struct nlmv4_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->nlm4;
+	return get_stats_block((void **)&stats->nlm4,
+			       sizeof(struct nlmv4_stats), stats, lock);
 }
 
 static struct rquota_stats *get_rquota(struct gsh_stats *stats,
 				       pthread_rwlock_t *lock)
 {
-	if (unlikely(stats->rquota == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->rquota == NULL)
-			stats->rquota =
-			    gsh_calloc(1, sizeof(struct rquota_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->rquota;
+	return get_stats_block((void **)&stats->rquota,
+			       sizeof(struct rquota_stats), stats, lock);
 }
 
 static struct nfsv40_stats *get_v40(struct gsh_stats *stats,
 				    pthread_rwlock_t *lock)
 {
-	if (unlikely(stats->nfsv40 == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->nfsv40 == NULL)
-			stats->nfsv40 =
-			    gsh_calloc(1, sizeof(struct nfsv40_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->nfsv40;
+	return get_stats_block((void **)&stats->nfsv40,
+			       sizeof(struct nfsv40_stats), stats, lock);
 }
 
 static struct nfsv41_stats *get_v41(struct gsh_stats *stats,
 				    pthread_rwlock_t *lock)
 {
-	if (unlikely(stats->nfsv41 == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->nfsv41 == NULL)
-			stats->nfsv41 =
-			    gsh_calloc(1, sizeof(struct nfsv41_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->nfsv41;
+	return get_stats_block((void **)&stats->nfsv41,
+			       sizeof(struct nfsv41_stats), stats, lock);
 }
 
 static struct nfsv41_stats *get_v42(struct gsh_stats *stats,
 				    pthread_rwlock_t *lock)
 {
-	if (unlikely(stats->nfsv42 == NULL)) {
-		PTHREAD_RWLOCK_wrlock(lock);
-		if (stats->nfsv42 == NULL)
-			stats->nfsv42 =
-			    gsh_calloc(1, sizeof(struct nfsv41_stats));
-		PTHREAD_RWLOCK_unlock(lock);
-	}
-	return stats->nfsv42;
+	return get_stats_block((void **)&stats->nfsv42,
+			       sizeof(struct nfsv41_stats), stats, lock);
+}
+
+static struct cpu_stats *get_cpu(struct gsh_stats *stats,
+				 pthread_rwlock_t *lock)
+{
+	return get_stats_block((void **)&stats->cpu,
+			       sizeof(struct cpu_stats), stats, lock);
 }
 
 #ifdef _USE_9P
@@ -855,6 +1330,7 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 	struct svc_req *req = &reqdata->r_u.req.svc;
 	uint32_t proto_op = req->rq_msg.cb_proc;
 	uint32_t program_op = req->rq_msg.cb_prog;
+	struct global_stats *gst = global_stats_shard();
 
 	if (program_op == NFS_program[P_NFS]) {
 		if (proto_op == 0)
@@ -864,7 +1340,7 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 
 			/* record stuff */
 			if (global)
-				record_op(&global_st.nfsv3.cmds, request_time,
+				record_op(&gst->nfsv3.cmds, request_time,
 					  qwait_time, success, dup);
 			switch (nfsv3_optype[proto_op]) {
 			case READ_OP:
@@ -887,10 +1363,10 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		struct mnt_stats *sp = get_mnt(gsh_st, lock);
 
 		if (global && req->rq_msg.cb_vers == MOUNT_V1)
-			record_op(&global_st.mnt.v1_ops, request_time,
+			record_op(&gst->mnt.v1_ops, request_time,
 				  qwait_time, success, dup);
 		else if (global)
-			record_op(&global_st.mnt.v3_ops, request_time,
+			record_op(&gst->mnt.v3_ops, request_time,
 				  qwait_time, success, dup);
 
 		/* record stuff */
@@ -904,7 +1380,7 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		struct nlmv4_stats *sp = get_nlm4(gsh_st, lock);
 
 		if (global)
-			record_op(&global_st.nlm4.ops, request_time,
+			record_op(&gst->nlm4.ops, request_time,
 				  qwait_time, success, dup);
 		/* record stuff */
 		record_op(&sp->ops, request_time, qwait_time, success, dup);
@@ -912,7 +1388,7 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		struct rquota_stats *sp = get_rquota(gsh_st, lock);
 
 		if (global)
-			record_op(&global_st.rquota.ops, request_time,
+			record_op(&gst->rquota.ops, request_time,
 				  qwait_time, success, dup);
 		/* record stuff */
 		if (req->rq_msg.cb_vers == RQUOTAVERS)
@@ -1006,44 +1482,136 @@ void server_stats_9p_done(u8 opc, struct _9p_request_data *req9p)
 #endif
 
 /**
- * @brief record NFS op finished
+ * @brief Thread CPU time for request accounting
  *
- * Called from nfs_rpc_execute at operation/command completion
+ * @return The calling thread's CPU time in nsecs, or 0 if CPU time is
+ *         not accounted.
  */
+nsecs_elapsed_t server_stats_cpu_now(void)
+{
+	struct timespec ts;
 
-void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
+	if (!nfs_param.core_param.enable_cpu_stats ||
+	    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+		return 0;
+
+	return timespec_to_nsecs(&ts);
+}
+
+static void record_cpu(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
+		       int proto_op, nsecs_elapsed_t cpu)
 {
-	struct gsh_client *client = op_ctx->client;
-	struct timespec current_time;
-	nsecs_elapsed_t stop_time;
-	struct svc_req *req = &reqdata->r_u.req.svc;
-	uint32_t proto_op = req->rq_msg.cb_proc;
-	uint32_t program_op = req->rq_msg.cb_prog;
+	struct cpu_stats *sp = get_cpu(gsh_st, lock);
 
-	if (program_op == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V3)
-		global_st.v3.op[proto_op]++;
-	else if (program_op == NFS_program[P_NLM])
-		global_st.lm.op[proto_op]++;
-	else if (program_op == NFS_program[P_MNT])
-		global_st.mn.op[proto_op]++;
-	else if (program_op == NFS_program[P_RQUOTA])
-		global_st.qt.op[proto_op]++;
+	if (proto_op < 0) {
+		(void)atomic_inc_uint64_t(&sp->requests);
+		(void)atomic_add_uint64_t(&sp->nsecs, cpu);
+	} else {
+		(void)atomic_inc_uint64_t(&sp->v4_ops[proto_op]);
+		(void)atomic_add_uint64_t(&sp->v4_nsecs[proto_op], cpu);
+	}
+}
 
-	if (nfs_param.core_param.enable_FASTSTATS)
+/**
+ * @brief Charge CPU time to the client and export of the request
+ *
+ * @param[in] proto_op	NFSv4 op, or -1 for the whole request
+ * @param[in] start	server_stats_cpu_now() when it started
+ */
+static void record_cpu_ctx(int proto_op, nsecs_elapsed_t start)
+{
+	nsecs_elapsed_t stop;
+
+	if (start == 0)
 		return;
 
-	now(&current_time);
-	stop_time = timespec_diff(&ServerBootTime, &current_time);
-	if (client != NULL) {
+	/* Enable_CPU_Stats may have been turned off meanwhile */
+	stop = server_stats_cpu_now();
+	if (stop < start)
+		return;
+
+	if (op_ctx->client != NULL) {
 		struct server_stats *server_st;
 
-		server_st = container_of(client, struct server_stats, client);
-		record_stats(&server_st->st, &client->lock, reqdata,
-			     stop_time - op_ctx->start_time,
-			     op_ctx->queue_wait,
-			     rc == NFS_REQ_OK, dup, true);
-		(void)atomic_store_uint64_t(&client->last_update, stop_time);
-	}
+		server_st = container_of(op_ctx->client, struct server_stats,
+					 client);
+		record_cpu(&server_st->st, &op_ctx->client->lock, proto_op,
+			   stop - start);
+	}
+	if (op_ctx->ctx_export != NULL) {
+		struct export_stats *exp_st;
+
+		exp_st = container_of(op_ctx->ctx_export, struct export_stats,
+				      export);
+		record_cpu(&exp_st->st, &op_ctx->ctx_export->lock, proto_op,
+			   stop - start);
+	}
+}
+
+/**
+ * @brief Record the CPU time of a request
+ *
+ * Called once the reply has been sent.
+ */
+void server_stats_cpu_done(void)
+{
+	record_cpu_ctx(-1, op_ctx->cpu_start);
+}
+
+/**
+ * @brief record NFS op finished
+ *
+ * Called from nfs_rpc_execute at operation/command completion
+ */
+
+void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
+{
+	struct gsh_client *client = op_ctx->client;
+	struct timespec current_time;
+	nsecs_elapsed_t stop_time;
+	struct svc_req *req = &reqdata->r_u.req.svc;
+	uint32_t proto_op = req->rq_msg.cb_proc;
+	uint32_t program_op = req->rq_msg.cb_prog;
+	struct global_stats *gst = global_stats_shard();
+	bool v3_hist;
+
+	if (program_op == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V3)
+		gst->v3.op[proto_op]++;
+	else if (program_op == NFS_program[P_NLM])
+		gst->lm.op[proto_op]++;
+	else if (program_op == NFS_program[P_MNT])
+		gst->mn.op[proto_op]++;
+	else if (program_op == NFS_program[P_RQUOTA])
+		gst->qt.op[proto_op]++;
+
+	hh_record_request(NULL, 1, 0);
+
+	if (nfs_param.core_param.enable_FASTSTATS)
+		return;
+
+	now(&current_time);
+	stop_time = timespec_diff(&ServerBootTime, &current_time);
+	/* Histograms are of executed NFSv3 procedures, not replays */
+	v3_hist = !dup && proto_op != 0 && program_op == NFS_PROGRAM &&
+		  op_ctx->nfs_vers == NFS_V3;
+	if (v3_hist)
+		record_lat_hist(&global_hist.v3[proto_op],
+				stop_time - op_ctx->start_time,
+				&global_hist_lock);
+	if (client != NULL) {
+		struct server_stats *server_st;
+
+		server_st = container_of(client, struct server_stats, client);
+		record_stats(&server_st->st, &client->lock, reqdata,
+			     stop_time - op_ctx->start_time,
+			     op_ctx->queue_wait,
+			     rc == NFS_REQ_OK, dup, true);
+		if (v3_hist && nfs_param.core_param.enable_client_histograms)
+			record_v3_lat_hist(&server_st->st, &client->lock,
+					   proto_op,
+					   stop_time - op_ctx->start_time);
+		(void)atomic_store_uint64_t(&client->last_update, stop_time);
+	}
 	if (!dup && op_ctx->ctx_export != NULL) {
 		struct export_stats *exp_st;
 
@@ -1053,6 +1621,10 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 		record_stats(&exp_st->st, &op_ctx->ctx_export->lock, reqdata,
 			     stop_time - op_ctx->start_time,
 			     op_ctx->queue_wait, rc == NFS_REQ_OK, dup, false);
+		if (v3_hist)
+			record_v3_lat_hist(&exp_st->st,
+					   &op_ctx->ctx_export->lock, proto_op,
+					   stop_time - op_ctx->start_time);
 		(void)atomic_store_uint64_t(&op_ctx->ctx_export->last_update,
 					    stop_time);
 	}
@@ -1065,14 +1637,18 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
  */
 
 void server_stats_nfsv4_op_done(int proto_op,
-				nsecs_elapsed_t start_time, int status)
+				nsecs_elapsed_t start_time,
+				nsecs_elapsed_t cpu_start, int status)
 {
 	struct gsh_client *client = op_ctx->client;
+	struct global_stats *gst = global_stats_shard();
 	struct timespec current_time;
 	nsecs_elapsed_t stop_time;
 
 	if (op_ctx->nfs_vers == NFS_V4)
-		global_st.v4.op[proto_op]++;
+		gst->v4.op[proto_op]++;
+
+	record_cpu_ctx(proto_op, cpu_start);
 
 	if (nfs_param.core_param.enable_FASTSTATS)
 		return;
@@ -1087,17 +1663,23 @@ void server_stats_nfsv4_op_done(int proto_op,
 		record_nfsv4_op(&server_st->st, &client->lock, proto_op,
 				op_ctx->nfs_minorvers, stop_time - start_time,
 				op_ctx->queue_wait, status);
+		if (nfs_param.core_param.enable_client_histograms)
+			record_v4_lat_hist(&server_st->st, &client->lock,
+					   proto_op, stop_time - start_time);
 		(void)atomic_store_uint64_t(&client->last_update, stop_time);
 	}
 
+	record_lat_hist(&global_hist.v4[proto_op],
+			stop_time - start_time, &global_hist_lock);
+
 	if (op_ctx->nfs_minorvers == 0)
-		record_op(&global_st.nfsv40.compounds, stop_time - start_time,
+		record_op(&gst->nfsv40.compounds, stop_time - start_time,
 			  op_ctx->queue_wait, status == NFS4_OK, false);
 	else if (op_ctx->nfs_minorvers == 1)
-		record_op(&global_st.nfsv41.compounds, stop_time - start_time,
+		record_op(&gst->nfsv41.compounds, stop_time - start_time,
 			  op_ctx->queue_wait, status == NFS4_OK, false);
 	else if (op_ctx->nfs_minorvers == 2)
-		record_op(&global_st.nfsv42.compounds, stop_time - start_time,
+		record_op(&gst->nfsv42.compounds, stop_time - start_time,
 			  op_ctx->queue_wait, status == NFS4_OK, false);
 
 	if (op_ctx->ctx_export != NULL) {
@@ -1110,6 +1692,8 @@ void server_stats_nfsv4_op_done(int proto_op,
 				proto_op,
 				op_ctx->nfs_minorvers, stop_time - start_time,
 				op_ctx->queue_wait, status);
+		record_v4_lat_hist(&exp_st->st, &op_ctx->ctx_export->lock,
+				   proto_op, stop_time - start_time);
 		(void)atomic_store_uint64_t(&op_ctx->ctx_export->last_update,
 					    stop_time);
 	}
@@ -1127,6 +1711,8 @@ void server_stats_compound_done(int num_ops, int status)
 	struct timespec current_time;
 	nsecs_elapsed_t stop_time;
 
+	hh_record_request(NULL, 1, 0);
+
 	now(&current_time);
 	stop_time = timespec_diff(&ServerBootTime, &current_time);
 	if (client != NULL) {
@@ -1159,11 +1745,15 @@ void server_stats_compound_done(int num_ops, int status)
  *
  * Called from protocol operation/command handlers to record
  * transfers
+ *
+ * @param obj [IN] the file read or written, or NULL if not known
  */
 
-void server_stats_io_done(size_t requested,
+void server_stats_io_done(struct fsal_obj_handle *obj, size_t requested,
 			  size_t transferred, bool success, bool is_write)
 {
+	hh_record_request(obj, 0, transferred);
+
 	if (op_ctx->client != NULL) {
 		struct server_stats *server_st;
 
@@ -1249,6 +1839,448 @@ void inc_failed_recalls(struct gsh_client *client)
 		server_st->st.deleg->failed_recalls++;
 	}
 }
+void inc_deleg_declines(struct gsh_client *client)
+{
+	if (client != NULL) {
+		struct server_stats *server_st;
+
+		server_st = container_of(client, struct server_stats, client);
+		check_deleg_struct(&server_st->st, &client->lock);
+		server_st->st.deleg->num_declines++;
+	}
+}
+
+/* Stats snapshots
+ */
+
+#define STATS_AVAIL_COUNT 8
+
+static void server_stats_avail(struct gsh_stats *st, bool *avail)
+{
+	avail[0] = st->nfsv3 != 0;
+	avail[1] = st->mnt != 0;
+	avail[2] = st->nlm4 != 0;
+	avail[3] = st->rquota != 0;
+	avail[4] = st->nfsv40 != 0;
+	avail[5] = st->nfsv41 != 0;
+	avail[6] = st->nfsv42 != 0;
+	avail[7] = st->_9p != 0;
+}
+
+/* One protocol's I/O of an export, as copied into a stats snapshot */
+struct stats_snap_io {
+	uint16_t export_id;
+	const char *proto;
+	struct xfer_op read;
+	struct xfer_op write;
+};
+
+/**
+ * @brief Sum the I/O stats of an export per protocol
+ *
+ * @param[in]  export_statistics The export
+ * @param[out] io                Up to 4 entries, one per protocol seen
+ *
+ * @return The number of entries filled in.
+ */
+static int server_stats_export_io(struct export_stats *export_statistics,
+				  struct stats_snap_io *io)
+{
+	struct gsh_stats *st = &export_statistics->st;
+	int n = 0;
+
+	if (st->nfsv3 != NULL) {
+		struct nfsv3_stats sum;
+
+		stats_sum_v3(&sum, st);
+		io[n].proto = "NFSv3";
+		io[n].read = sum.read;
+		io[n++].write = sum.write;
+	}
+
+	if (st->nfsv40 != NULL) {
+		struct nfsv40_stats sum;
+
+		stats_sum_v40(&sum, st);
+		io[n].proto = "NFSv40";
+		io[n].read = sum.read;
+		io[n++].write = sum.write;
+	}
+
+	if (st->nfsv41 != NULL) {
+		struct nfsv41_stats sum;
+
+		stats_sum_v41(&sum, st, st->nfsv41);
+		io[n].proto = "NFSv41";
+		io[n].read = sum.read;
+		io[n++].write = sum.write;
+	}
+
+	if (st->nfsv42 != NULL) {
+		struct nfsv41_stats sum;
+
+		stats_sum_v41(&sum, st, st->nfsv42);
+		io[n].proto = "NFSv42";
+		io[n].read = sum.read;
+		io[n++].write = sum.write;
+	}
+
+	return n;
+}
+
+/* A client as copied into a stats snapshot */
+struct stats_snap_client {
+	char addr[INET6_ADDRSTRLEN];
+	bool avail[STATS_AVAIL_COUNT];
+	struct timespec last;
+};
+
+/**
+ * @brief Client and export stats as of one moment
+ *
+ * Built at most once per Dbus_Stats_Interval by whichever query or
+ * scrape finds the last one stale, then shared until the next.  The
+ * walks of the client and export tables only copy counters, so the
+ * table locks are held for far less time than marshalling takes, and
+ * no longer than once per interval however often they are polled.
+ */
+struct stats_snapshot {
+	int32_t refcnt;
+	struct timespec taken;
+	uint32_t nclients;
+	uint32_t clients_max;
+	struct stats_snap_client *clients;
+	uint32_t nio;
+	uint32_t io_max;
+	struct stats_snap_io *io;
+};
+
+/* Protects stats_snap; the data path never takes it */
+static pthread_mutex_t stats_snap_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct stats_snapshot *stats_snap;
+
+static void stats_snap_put(struct stats_snapshot *snap)
+{
+	if (atomic_dec_int32_t(&snap->refcnt) != 0)
+		return;
+
+	gsh_free(snap->clients);
+	gsh_free(snap->io);
+	gsh_free(snap);
+}
+
+static bool stats_snap_client(struct gsh_client *cl_node, void *state)
+{
+	struct stats_snapshot *snap = state;
+	struct server_stats *cl;
+	struct stats_snap_client *sc;
+	int addr_type;
+
+	if (snap->nclients == snap->clients_max) {
+		snap->clients_max = snap->clients_max * 2 + 64;
+		snap->clients = gsh_realloc(snap->clients,
+					    snap->clients_max *
+					    sizeof(*snap->clients));
+	}
+
+	cl = container_of(cl_node, struct server_stats, client);
+	sc = &snap->clients[snap->nclients++];
+
+	addr_type = (cl_node->addr.len == 4) ? AF_INET : AF_INET6;
+	if (inet_ntop(addr_type, cl_node->addr.addr, sc->addr,
+		      sizeof(sc->addr)) == NULL)
+		sc->addr[0] = '\0';
+
+	server_stats_avail(&cl->st, sc->avail);
+
+	sc->last = ServerBootTime;
+	timespec_add_nsecs(cl_node->last_update, &sc->last);
+
+	return true;
+}
+
+static bool stats_snap_export(struct gsh_export *export_node, void *state)
+{
+	struct stats_snapshot *snap = state;
+	struct export_stats *export_statistics;
+	int i, n;
+
+	if (snap->nio + 4 > snap->io_max) {
+		snap->io_max = snap->io_max * 2 + 64;
+		snap->io = gsh_realloc(snap->io,
+				       snap->io_max * sizeof(*snap->io));
+	}
+
+	export_statistics = container_of(export_node, struct export_stats,
+					 export);
+	n = server_stats_export_io(export_statistics, &snap->io[snap->nio]);
+
+	for (i = 0; i < n; i++)
+		snap->io[snap->nio++].export_id = export_node->export_id;
+
+	return true;
+}
+
+static struct stats_snapshot *stats_snap_build(struct timespec *ts)
+{
+	struct stats_snapshot *snap = gsh_calloc(1, sizeof(*snap));
+
+	snap->refcnt = 1;
+	snap->taken = *ts;
+	(void) foreach_gsh_client(stats_snap_client, snap);
+	(void) foreach_gsh_export(stats_snap_export, snap);
+
+	return snap;
+}
+
+/**
+ * @brief Get the current stats snapshot, rebuilding it if stale
+ *
+ * @param[in] always Build one just for the caller if snapshots are off
+ *
+ * @return A reference to the snapshot, or NULL if Dbus_Stats_Interval
+ *         is 0, always is false, and the caller walks the live tables.
+ */
+static struct stats_snapshot *stats_snap_get(bool always)
+{
+	uint32_t interval = nfs_param.core_param.dbus_stats_interval;
+	struct stats_snapshot *snap;
+	struct timespec ts;
+
+	now(&ts);
+
+	if (interval == 0)
+		return always ? stats_snap_build(&ts) : NULL;
+
+	PTHREAD_MUTEX_lock(&stats_snap_mtx);
+
+	snap = stats_snap;
+	if (snap == NULL || ts.tv_sec < snap->taken.tv_sec ||
+	    ts.tv_sec - snap->taken.tv_sec >= interval) {
+		/* Pollers queue here behind the one rebuilding it */
+		snap = stats_snap_build(&ts);
+
+		if (stats_snap != NULL)
+			stats_snap_put(stats_snap);
+		stats_snap = snap;
+	}
+	(void) atomic_inc_int32_t(&snap->refcnt);
+
+	PTHREAD_MUTEX_unlock(&stats_snap_mtx);
+
+	return snap;
+}
+
+/* OpenMetrics
+ */
+
+/* Counters of struct xfer_op reported per export */
+static const struct {
+	const char *name;
+	const char *help;
+	size_t off;		/*< of a uint64_t in struct xfer_op */
+	bool nsecs;		/*< reported in seconds */
+} metrics_io[] = {
+	{ "ganesha_export_ops", "READ and WRITE operations",
+	  offsetof(struct xfer_op, cmd.total), false },
+	{ "ganesha_export_errors", "READ and WRITE operations that failed",
+	  offsetof(struct xfer_op, cmd.errors), false },
+	{ "ganesha_export_requested_bytes", "Bytes asked to be transferred",
+	  offsetof(struct xfer_op, requested), false },
+	{ "ganesha_export_transferred_bytes", "Bytes transferred",
+	  offsetof(struct xfer_op, transferred), false },
+	{ "ganesha_export_latency_seconds", "Time spent executing",
+	  offsetof(struct xfer_op, cmd.latency.latency), true },
+	{ "ganesha_export_queue_seconds", "Time spent queued",
+	  offsetof(struct xfer_op, cmd.queue_latency.latency), true },
+};
+
+static void metrics_io_sample(FILE *out, size_t m, struct stats_snap_io *io,
+			      const char *op, struct xfer_op *xfer)
+{
+	uint64_t val = *(uint64_t *)((char *)xfer + metrics_io[m].off);
+
+	fprintf(out,
+		"%s_total{export_id=\"%" PRIu16 "\",proto=\"%s\",op=\"%s\"} ",
+		metrics_io[m].name, io->export_id, io->proto, op);
+	if (metrics_io[m].nsecs)
+		fprintf(out, "%.9f\n", (double) val / NS_PER_SEC);
+	else
+		fprintf(out, "%" PRIu64 "\n", val);
+}
+
+/**
+ * @brief Write a latency histogram
+ *
+ * Only the buckets with counts get an le, and the sum is taken from
+ * their lower bounds so it is short by up to an eighth.
+ */
+static void metrics_lat_hist(FILE *out, const char *name,
+			     const char *labels, struct lat_hist *hist)
+{
+	uint64_t n, count = 0, usecs = 0;
+	int i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		n = atomic_fetch_uint64_t(&hist->bucket[i]);
+		if (n == 0)
+			continue;
+
+		count += n;
+		usecs += n * lat_hist_lower(i);
+
+		/* The last bucket is open and only counts in +Inf */
+		if (i < LAT_HIST_BUCKETS - 1)
+			fprintf(out, "%s_bucket{%s,le=\"%g\"} %" PRIu64 "\n",
+				name, labels, lat_hist_lower(i + 1) / 1e6,
+				count);
+	}
+	fprintf(out, "%s_bucket{%s,le=\"+Inf\"} %" PRIu64 "\n",
+		name, labels, count);
+	fprintf(out, "%s_count{%s} %" PRIu64 "\n", name, labels, count);
+	fprintf(out, "%s_sum{%s} %g\n", name, labels, usecs / 1e6);
+}
+
+/**
+ * @brief Start a metric family
+ *
+ * @param[in] out  Stream being rendered
+ * @param[in] name Name without the _total of counters
+ * @param[in] type counter, gauge or histogram
+ * @param[in] help One line description
+ */
+void metrics_family(FILE *out, const char *name, const char *type,
+		    const char *help)
+{
+	fprintf(out, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+/**
+ * @brief Write the client, export, latency, DRC and worker stats
+ *
+ * The client and export stats come from the stats snapshot, so a
+ * scrape walks those tables at most once per Dbus_Stats_Interval.
+ *
+ * @param[in] out Stream being rendered
+ */
+void server_stats_metrics(FILE *out)
+{
+	struct stats_snapshot *snap = stats_snap_get(true);
+	struct worker_pool_stats wst;
+	struct mem_arena_stats ast[MEM_ARENA_COUNT];
+	struct dupreq_stats dst;
+	struct lat_hist *hist;
+	char labels[128];
+	uint32_t i;
+	size_t m;
+
+	metrics_family(out, "ganesha_clients", "gauge",
+		       "Clients that have sent requests");
+	fprintf(out, "ganesha_clients %" PRIu32 "\n", snap->nclients);
+
+	for (m = 0; m < sizeof(metrics_io) / sizeof(metrics_io[0]); m++) {
+		metrics_family(out, metrics_io[m].name, "counter",
+			       metrics_io[m].help);
+		for (i = 0; i < snap->nio; i++) {
+			metrics_io_sample(out, m, &snap->io[i], "read",
+					  &snap->io[i].read);
+			metrics_io_sample(out, m, &snap->io[i], "write",
+					  &snap->io[i].write);
+		}
+	}
+
+	stats_snap_put(snap);
+
+	/* Histograms are never freed once allocated */
+	metrics_family(out, "ganesha_op_latency_seconds", "histogram",
+		       "Latency of operations");
+	for (i = 0; i < NFS_V3_NB_COMMAND; i++) {
+		hist = atomic_fetch_voidptr((void **)&global_hist.v3[i]);
+		if (hist == NULL)
+			continue;
+		snprintf(labels, sizeof(labels), "proto=\"NFSv3\",op=\"%s\"",
+			 optabv3[i].name);
+		metrics_lat_hist(out, "ganesha_op_latency_seconds", labels,
+				 hist);
+	}
+	for (i = 0; i < NFS4_OP_LAST_ONE; i++) {
+		hist = atomic_fetch_voidptr((void **)&global_hist.v4[i]);
+		if (hist == NULL)
+			continue;
+		snprintf(labels, sizeof(labels), "proto=\"NFSv4\",op=\"%s\"",
+			 optabv4[i].name);
+		metrics_lat_hist(out, "ganesha_op_latency_seconds", labels,
+				 hist);
+	}
+
+	metrics_family(out, "ganesha_request_phase_seconds", "histogram",
+		       "Time requests spend in each phase");
+	for (i = 0; i < NFS_REQ_PHASE_COUNT; i++) {
+		hist = atomic_fetch_voidptr((void **)&phase_hist[i]);
+		if (hist == NULL)
+			continue;
+		snprintf(labels, sizeof(labels), "phase=\"%s\"",
+			 phase_names[i]);
+		metrics_lat_hist(out, "ganesha_request_phase_seconds", labels,
+				 hist);
+	}
+
+	dupreq2_get_stats(&dst);
+	metrics_family(out, "ganesha_drc_hits", "counter",
+		       "Retransmits answered from the duplicate request cache");
+	fprintf(out, "ganesha_drc_hits_total %" PRIu64 "\n", dst.hits);
+	metrics_family(out, "ganesha_drc_misses", "counter",
+		       "Requests entered in the duplicate request cache");
+	fprintf(out, "ganesha_drc_misses_total %" PRIu64 "\n", dst.misses);
+	metrics_family(out, "ganesha_drc_in_progress", "counter",
+		       "Retransmits of requests still running");
+	fprintf(out, "ganesha_drc_in_progress_total %" PRIu64 "\n",
+		dst.in_progress);
+	metrics_family(out, "ganesha_drc_retired", "counter",
+		       "Expired TCP duplicate request caches freed");
+	fprintf(out, "ganesha_drc_retired_total %" PRIu64 "\n", dst.retired);
+	metrics_family(out, "ganesha_drc_recycle_queued", "gauge",
+		       "TCP duplicate request caches of closed connections");
+	fprintf(out, "ganesha_drc_recycle_queued %" PRIu64 "\n",
+		dst.recycle_qlen);
+
+	worker_pool_get_stats(&wst);
+	metrics_family(out, "ganesha_workers", "gauge",
+		       "Worker threads running");
+	fprintf(out, "ganesha_workers %" PRIu32 "\n", wst.nthreads);
+	metrics_family(out, "ganesha_workers_busy", "gauge",
+		       "Worker threads not waiting for a request");
+	fprintf(out, "ganesha_workers_busy %" PRIu32 "\n", wst.busy);
+	metrics_family(out, "ganesha_workers_target", "gauge",
+		       "Worker pool size last decided on");
+	fprintf(out, "ganesha_workers_target %" PRIu32 "\n", wst.target);
+	metrics_family(out, "ganesha_workers_queue_wait_seconds", "gauge",
+		       "Average time requests waited for a worker last second");
+	fprintf(out, "ganesha_workers_queue_wait_seconds %.6f\n",
+		wst.queue_wait / 1e6);
+	metrics_family(out, "ganesha_workers_grown", "counter",
+		       "Times the worker pool grew");
+	fprintf(out, "ganesha_workers_grown_total %" PRIu64 "\n", wst.grown);
+	metrics_family(out, "ganesha_workers_shrunk", "counter",
+		       "Times the worker pool shrank");
+	fprintf(out, "ganesha_workers_shrunk_total %" PRIu64 "\n",
+		wst.shrunk);
+
+	mem_arena_get_stats(ast);
+	metrics_family(out, "ganesha_arena_allocated_bytes", "gauge",
+		       "Bytes handed out by each allocator arena");
+	for (i = 0; i < MEM_ARENA_COUNT; i++)
+		if (ast[i].enabled)
+			fprintf(out,
+				"ganesha_arena_allocated_bytes{arena=\"%s\"} %" PRIu64 "\n",
+				ast[i].name, ast[i].allocated);
+	metrics_family(out, "ganesha_arena_slab_bytes", "gauge",
+		       "Bytes of slab chunks in each allocator arena");
+	for (i = 0; i < MEM_ARENA_COUNT; i++)
+		fprintf(out,
+			"ganesha_arena_slab_bytes{arena=\"%s\"} %" PRIu64 "\n",
+			ast[i].name, ast[i].slab_bytes);
+}
 
 #ifdef USE_DBUS
 
@@ -1279,32 +2311,16 @@ void inc_failed_recalls(struct gsh_client *client)
 
 void server_stats_summary(DBusMessageIter *iter, struct gsh_stats *st)
 {
+	bool avail[STATS_AVAIL_COUNT];
 	dbus_bool_t stats_available;
+	int i;
 
-	stats_available = st->nfsv3 != 0;
-	dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN,
-				       &stats_available);
-	stats_available = st->mnt != 0;
-	dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN,
-				       &stats_available);
-	stats_available = st->nlm4 != 0;
-	dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN,
-				       &stats_available);
-	stats_available = st->rquota != 0;
-	dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN,
-				       &stats_available);
-	stats_available = st->nfsv40 != 0;
-	dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN,
-				       &stats_available);
-	stats_available = st->nfsv41 != 0;
-	dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN,
-				       &stats_available);
-	stats_available = st->nfsv42 != 0;
-	dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN,
-				       &stats_available);
-	stats_available = st->_9p != 0;
-	dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN,
-				       &stats_available);
+	server_stats_avail(st, avail);
+	for (i = 0; i < STATS_AVAIL_COUNT; i++) {
+		stats_available = avail[i];
+		dbus_message_iter_append_basic(iter, DBUS_TYPE_BOOLEAN,
+					       &stats_available);
+	}
 }
 
 #ifdef _USE_9P
@@ -1334,6 +2350,132 @@ static void server_dbus_op_stats(struct proto_op *op, DBusMessageIter *iter)
 }
 #endif
 
+/* Summing the shards of a block for reporting
+ */
+
+static void stats_sum_latency(struct op_latency *dst,
+			      const struct op_latency *src)
+{
+	dst->latency += src->latency;
+	if (src->min != 0 && (dst->min == 0 || src->min < dst->min))
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+static void stats_sum_op(struct proto_op *dst, const struct proto_op *src)
+{
+	dst->total += src->total;
+	dst->errors += src->errors;
+	dst->dups += src->dups;
+	stats_sum_latency(&dst->latency, &src->latency);
+	stats_sum_latency(&dst->dup_latency, &src->dup_latency);
+	stats_sum_latency(&dst->queue_latency, &src->queue_latency);
+}
+
+static void stats_sum_xfer(struct xfer_op *dst, const struct xfer_op *src)
+{
+	stats_sum_op(&dst->cmd, &src->cmd);
+	dst->requested += src->requested;
+	dst->transferred += src->transferred;
+}
+
+static void stats_sum_layout(struct layout_op *dst,
+			     const struct layout_op *src)
+{
+	dst->total += src->total;
+	dst->errors += src->errors;
+	dst->delays += src->delays;
+}
+
+static void stats_sum_ops(uint64_t *dst, const uint64_t *src, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		dst[i] += src[i];
+}
+
+static void stats_sum_v3(struct nfsv3_stats *dst, struct gsh_stats *st)
+{
+	uint32_t i;
+
+	memset(dst, 0, sizeof(*dst));
+	for (i = 0; i < stats_nshards(st); i++) {
+		const struct nfsv3_stats *src =
+			stats_block_shard(st->nfsv3, sizeof(*src), i);
+
+		stats_sum_op(&dst->cmds, &src->cmds);
+		stats_sum_xfer(&dst->read, &src->read);
+		stats_sum_xfer(&dst->write, &src->write);
+	}
+}
+
+static void stats_sum_v40(struct nfsv40_stats *dst, struct gsh_stats *st)
+{
+	uint32_t i;
+
+	memset(dst, 0, sizeof(*dst));
+	for (i = 0; i < stats_nshards(st); i++) {
+		const struct nfsv40_stats *src =
+			stats_block_shard(st->nfsv40, sizeof(*src), i);
+
+		stats_sum_op(&dst->compounds, &src->compounds);
+		dst->ops_per_compound += src->ops_per_compound;
+		stats_sum_xfer(&dst->read, &src->read);
+		stats_sum_xfer(&dst->write, &src->write);
+	}
+}
+
+/* Used for both NFSv4.1 and NFSv4.2 blocks */
+static void stats_sum_v41(struct nfsv41_stats *dst, struct gsh_stats *st,
+			  struct nfsv41_stats *block)
+{
+	uint32_t i;
+
+	memset(dst, 0, sizeof(*dst));
+	for (i = 0; i < stats_nshards(st); i++) {
+		const struct nfsv41_stats *src =
+			stats_block_shard(block, sizeof(*src), i);
+
+		stats_sum_op(&dst->compounds, &src->compounds);
+		dst->ops_per_compound += src->ops_per_compound;
+		stats_sum_xfer(&dst->read, &src->read);
+		stats_sum_xfer(&dst->write, &src->write);
+		stats_sum_layout(&dst->getdevinfo, &src->getdevinfo);
+		stats_sum_layout(&dst->layout_get, &src->layout_get);
+		stats_sum_layout(&dst->layout_commit, &src->layout_commit);
+		stats_sum_layout(&dst->layout_return, &src->layout_return);
+		stats_sum_layout(&dst->recall, &src->recall);
+	}
+}
+
+/* Only the global counters that are recorded are summed */
+static void global_stats_sum(struct global_stats *dst)
+{
+	uint32_t i;
+
+	memset(dst, 0, sizeof(*dst));
+	for (i = 0; i < GSH_STATS_SHARDS; i++) {
+		const struct global_stats *src = &global_st[i].st;
+
+		stats_sum_op(&dst->nfsv3.cmds, &src->nfsv3.cmds);
+		stats_sum_op(&dst->mnt.v1_ops, &src->mnt.v1_ops);
+		stats_sum_op(&dst->mnt.v3_ops, &src->mnt.v3_ops);
+		stats_sum_op(&dst->nlm4.ops, &src->nlm4.ops);
+		stats_sum_op(&dst->rquota.ops, &src->rquota.ops);
+		stats_sum_op(&dst->nfsv40.compounds, &src->nfsv40.compounds);
+		stats_sum_op(&dst->nfsv41.compounds, &src->nfsv41.compounds);
+		stats_sum_op(&dst->nfsv42.compounds, &src->nfsv42.compounds);
+		stats_sum_ops(dst->v3.op, src->v3.op, NFSPROC3_COMMIT + 1);
+		stats_sum_ops(dst->v4.op, src->v4.op, NFS4_OP_LAST_ONE);
+		stats_sum_ops(dst->lm.op, src->lm.op, NLMPROC4_FREE_ALL + 1);
+		stats_sum_ops(dst->mn.op, src->mn.op, MOUNTPROC3_EXPORT + 1);
+		stats_sum_ops(dst->qt.op, src->qt.op,
+			      RQUOTAPROC_SETACTIVEQUOTA + 1);
+	}
+}
+
 /**
  * @brief Report I/O statistics as a struct
  *
@@ -1400,6 +2542,9 @@ void server_dbus_total(struct export_stats *export_st, DBusMessageIter *iter)
 	DBusMessageIter struct_iter;
 	uint64_t total = 0;
 	char *version;
+	struct nfsv3_stats v3;
+	struct nfsv40_stats v40;
+	struct nfsv41_stats v41;
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
 					 &struct_iter);
@@ -1410,36 +2555,46 @@ void server_dbus_total(struct export_stats *export_st, DBusMessageIter *iter)
 	if (export_st->st.nfsv3 == NULL)
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 				&total);
-	else
+	else {
+		stats_sum_v3(&v3, &export_st->st);
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv3->cmds.total);
+				&v3.cmds.total);
+	}
 	version = "NFSv40";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	if (export_st->st.nfsv40 == NULL)
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 				&total);
-	else
+	else {
+		stats_sum_v40(&v40, &export_st->st);
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv40->compounds.total);
+				&v40.compounds.total);
+	}
 	version = "NFSv41";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	if (export_st->st.nfsv41 == NULL)
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 				&total);
-	else
+	else {
+		stats_sum_v41(&v41, &export_st->st,
+			      export_st->st.nfsv41);
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv41->compounds.total);
+				&v41.compounds.total);
+	}
 	version = "NFSv42";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	if (export_st->st.nfsv42 == NULL)
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 				&total);
-	else
+	else {
+		stats_sum_v41(&v41, &export_st->st,
+			      export_st->st.nfsv42);
 		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv42->compounds.total);
+				&v41.compounds.total);
+	}
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
@@ -1447,6 +2602,9 @@ void global_dbus_total(DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
 	char *version;
+	struct global_stats *gst = gsh_malloc(sizeof(*gst));
+
+	global_stats_sum(gst);
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
 					 &struct_iter);
@@ -1455,43 +2613,44 @@ void global_dbus_total(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv3.cmds.total);
+					&gst->nfsv3.cmds.total);
 	version = "NFSv40";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv40.compounds.total);
+					&gst->nfsv40.compounds.total);
 	version = "NFSv41";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv41.compounds.total);
+					&gst->nfsv41.compounds.total);
 	version = "NFSv42";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv42.compounds.total);
+					&gst->nfsv42.compounds.total);
 	version = "NLM4";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nlm4.ops.total);
+					&gst->nlm4.ops.total);
 	version = "MNTv1";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.mnt.v1_ops.total);
+					&gst->mnt.v1_ops.total);
 	version = "MNTv3";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.mnt.v3_ops.total);
+					&gst->mnt.v3_ops.total);
 	version = "RQUOTA";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.rquota.ops.total);
+					&gst->rquota.ops.total);
 	dbus_message_iter_close_container(iter, &struct_iter);
+	gsh_free(gst);
 }
 
 void global_dbus_fast(DBusMessageIter *iter)
@@ -1500,6 +2659,9 @@ void global_dbus_fast(DBusMessageIter *iter)
 	char *version;
 	char *op;
 	int i;
+	struct global_stats *gst = gsh_malloc(sizeof(*gst));
+
+	global_stats_sum(gst);
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
 					 &struct_iter);
@@ -1508,103 +2670,112 @@ void global_dbus_fast(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NFSPROC3_COMMIT; i++) {
-		if (global_st.v3.op[i] > 0) {
+		if (gst->v3.op[i] > 0) {
 			op = optabv3[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.v3.op[i]);
+					DBUS_TYPE_UINT64, &gst->v3.op[i]);
 		}
 	}
 	version = "\nNFSv4:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NFS4_OP_LAST_ONE; i++) {
-		if (global_st.v4.op[i] > 0) {
+		if (gst->v4.op[i] > 0) {
 			op = optabv4[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.v4.op[i]);
+					DBUS_TYPE_UINT64, &gst->v4.op[i]);
 		}
 	}
 	version = "\nNLM:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NLM4_FAILED; i++) {
-		if (global_st.lm.op[i] > 0) {
+		if (gst->lm.op[i] > 0) {
 			op = optnlm[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.lm.op[i]);
+					DBUS_TYPE_UINT64, &gst->lm.op[i]);
 		}
 	}
 	version = "\nMNT:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < MOUNTPROC3_EXPORT; i++) {
-		if (global_st.mn.op[i] > 0) {
+		if (gst->mn.op[i] > 0) {
 			op = optmnt[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.mn.op[i]);
+					DBUS_TYPE_UINT64, &gst->mn.op[i]);
 		}
 	}
 	version = "\nQUOTA:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < RQUOTAPROC_SETACTIVEQUOTA; i++) {
-		if (global_st.qt.op[i] > 0) {
+		if (gst->qt.op[i] > 0) {
 			op = optqta[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.qt.op[i]);
+					DBUS_TYPE_UINT64, &gst->qt.op[i]);
 		}
 	}
 	dbus_message_iter_close_container(iter, &struct_iter);
+	gsh_free(gst);
 }
 
-void server_dbus_v3_iostats(struct nfsv3_stats *v3p, DBusMessageIter *iter)
+void server_dbus_v3_iostats(struct gsh_stats *st, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv3_stats sum;
 
+	stats_sum_v3(&sum, st);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v3p->read, iter);
-	server_dbus_iostats(&v3p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
-void server_dbus_v40_iostats(struct nfsv40_stats *v40p, DBusMessageIter *iter)
+void server_dbus_v40_iostats(struct gsh_stats *st, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv40_stats sum;
 
+	stats_sum_v40(&sum, st);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v40p->read, iter);
-	server_dbus_iostats(&v40p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
-void server_dbus_v41_iostats(struct nfsv41_stats *v41p, DBusMessageIter *iter)
+void server_dbus_v41_iostats(struct gsh_stats *st, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	stats_sum_v41(&sum, st, st->nfsv41);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v41p->read, iter);
-	server_dbus_iostats(&v41p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
-void server_dbus_v42_iostats(struct nfsv41_stats *v42p, DBusMessageIter *iter)
+void server_dbus_v42_iostats(struct gsh_stats *st, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	stats_sum_v41(&sum, st, st->nfsv42);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v42p->read, iter);
-	server_dbus_iostats(&v42p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
 void server_dbus_fill_io(DBusMessageIter *array_iter, uint16_t *export_id,
@@ -1648,37 +2819,99 @@ void server_dbus_fill_io(DBusMessageIter *array_iter, uint16_t *export_id,
 void server_dbus_all_iostats(struct export_stats *export_statistics,
 			     DBusMessageIter *array_iter)
 {
-	if (export_statistics->st.nfsv3 != NULL) {
-		server_dbus_fill_io(array_iter,
-				    &(export_statistics->export.export_id),
-				    "NFSv3",
-				    &(export_statistics->st.nfsv3->read),
-				    &(export_statistics->st.nfsv3->write));
-	}
+	struct stats_snap_io io[4];
+	int i, n;
 
-	if (export_statistics->st.nfsv40 != NULL) {
-		server_dbus_fill_io(array_iter,
-				    &(export_statistics->export.export_id),
-				    "NFSv40",
-				    &(export_statistics->st.nfsv40->read),
-				    &(export_statistics->st.nfsv40->write));
-	}
+	n = server_stats_export_io(export_statistics, io);
 
-	if (export_statistics->st.nfsv41 != NULL) {
+	for (i = 0; i < n; i++)
 		server_dbus_fill_io(array_iter,
 				    &(export_statistics->export.export_id),
-				    "NFSv41",
-				    &(export_statistics->st.nfsv41->read),
-				    &(export_statistics->st.nfsv41->write));
-	}
+				    io[i].proto, &io[i].read, &io[i].write);
+}
 
-	if (export_statistics->st.nfsv42 != NULL) {
-		server_dbus_fill_io(array_iter,
-				    &(export_statistics->export.export_id),
-				    "NFSv42",
-				    &(export_statistics->st.nfsv42->read),
-				    &(export_statistics->st.nfsv42->write));
+/**
+ * @brief Report the clients from the stats snapshot
+ *
+ * Appends the timestamp and client array of ShowClients.
+ *
+ * @param iter [IN] iterator of the reply
+ *
+ * @return false if snapshots are off and the caller must walk the
+ *         clients itself.
+ */
+bool server_dbus_snapshot_clients(DBusMessageIter *iter)
+{
+	struct stats_snapshot *snap = stats_snap_get(false);
+	DBusMessageIter array_iter, struct_iter;
+	dbus_bool_t stats_available;
+	uint32_t i, j;
+
+	if (snap == NULL)
+		return false;
+
+	dbus_append_timestamp(iter, &snap->taken);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 "(sbbbbbbbb(tt))", &array_iter);
+
+	for (i = 0; i < snap->nclients; i++) {
+		struct stats_snap_client *sc = &snap->clients[i];
+		const char *addrp = sc->addr;
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &addrp);
+		for (j = 0; j < STATS_AVAIL_COUNT; j++) {
+			stats_available = sc->avail[j];
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_BOOLEAN,
+						       &stats_available);
+		}
+		dbus_append_timestamp(&struct_iter, &sc->last);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
 	}
+
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	stats_snap_put(snap);
+	return true;
+}
+
+/**
+ * @brief Report the I/O of every export from the stats snapshot
+ *
+ * Appends the timestamp and the array of GetNFSIO.
+ *
+ * @param iter [IN] iterator of the reply
+ *
+ * @return false if snapshots are off and the caller must walk the
+ *         exports itself.
+ */
+bool server_dbus_snapshot_iostats(DBusMessageIter *iter)
+{
+	struct stats_snapshot *snap = stats_snap_get(false);
+	DBusMessageIter array_iter;
+	uint32_t i;
+
+	if (snap == NULL)
+		return false;
+
+	dbus_append_timestamp(iter, &snap->taken);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 NFS_ALL_IO_REPLY_ARRAY_TYPE,
+					 &array_iter);
+
+	for (i = 0; i < snap->nio; i++)
+		server_dbus_fill_io(&array_iter, &snap->io[i].export_id,
+				    snap->io[i].proto, &snap->io[i].read,
+				    &snap->io[i].write);
+
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	stats_snap_put(snap);
+	return true;
 }
 
 void server_dbus_total_ops(struct export_stats *export_st,
@@ -1709,6 +2942,614 @@ void global_dbus_total_ops(DBusMessageIter *iter)
 	global_dbus_total(iter);
 }
 
+static void server_dbus_lat_hist(DBusMessageIter *array_iter,
+				 const char *proto, const char *op,
+				 struct lat_hist *hist)
+{
+	DBusMessageIter struct_iter, bucket_array, bucket_iter;
+	uint64_t upper;
+	int i;
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &proto);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &op);
+	dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY, "(tt)",
+					 &bucket_array);
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		if (hist->bucket[i] == 0)
+			continue;
+
+		/* The last bucket is open, report its lower bound */
+		upper = lat_hist_lower(i < LAT_HIST_BUCKETS - 1 ? i + 1 : i);
+		dbus_message_iter_open_container(&bucket_array,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &bucket_iter);
+		dbus_message_iter_append_basic(&bucket_iter, DBUS_TYPE_UINT64,
+					       &upper);
+		dbus_message_iter_append_basic(&bucket_iter, DBUS_TYPE_UINT64,
+					       &hist->bucket[i]);
+		dbus_message_iter_close_container(&bucket_array, &bucket_iter);
+	}
+	dbus_message_iter_close_container(&struct_iter, &bucket_array);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+
+static void lat_hists_dbus(struct lat_hists *hists,
+			   struct lat_hist **phases,
+			   DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter;
+	struct timespec timestamp;
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(ssa(tt))",
+					 &array_iter);
+	for (i = 0; hists != NULL && i < NFS_V3_NB_COMMAND; i++) {
+		if (hists->v3[i] != NULL)
+			server_dbus_lat_hist(&array_iter, "NFSv3",
+					     optabv3[i].name, hists->v3[i]);
+	}
+	for (i = 0; hists != NULL && i < NFS4_OP_LAST_ONE; i++) {
+		if (hists->v4[i] != NULL)
+			server_dbus_lat_hist(&array_iter, "NFSv4",
+					     optabv4[i].name, hists->v4[i]);
+	}
+	for (i = 0; phases != NULL && i < NFS_REQ_PHASE_COUNT; i++) {
+		if (phases[i] != NULL)
+			server_dbus_lat_hist(&array_iter, "RPC",
+					     phase_names[i], phases[i]);
+	}
+	/* The FSAL calls go with the server wide phases */
+	for (i = 0; phases != NULL && i < FSAL_HIST_MAX; i++) {
+		const char *fsal =
+			atomic_fetch_voidptr((void **)&fsal_hist[i].fsal);
+		int j;
+
+		if (fsal == NULL)
+			break;
+
+		for (j = 0; j < FSAL_CALL_COUNT; j++) {
+			struct lat_hist *hist = atomic_fetch_voidptr(
+					(void **)&fsal_hist[i].call[j]);
+
+			if (hist != NULL)
+				server_dbus_lat_hist(&array_iter, fsal,
+						     fsal_call_names[j], hist);
+		}
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+/**
+ * @brief Report the latency histograms of a client or export
+ *
+ * Histograms are only allocated, never freed while the stats live, so
+ * they can be read without the owner's lock.
+ */
+void server_dbus_lat_hists(struct gsh_stats *st, DBusMessageIter *iter)
+{
+	lat_hists_dbus(atomic_fetch_voidptr((void **)&st->hist), NULL, iter);
+}
+
+void global_dbus_lat_hists(DBusMessageIter *iter)
+{
+	lat_hists_dbus(&global_hist, phase_hist, iter);
+}
+
+static void stats_sum_cpu(struct cpu_stats *dst, struct gsh_stats *st)
+{
+	uint32_t i;
+
+	memset(dst, 0, sizeof(*dst));
+	for (i = 0; st->cpu != NULL && i < stats_nshards(st); i++) {
+		const struct cpu_stats *src =
+			stats_block_shard(st->cpu, sizeof(*src), i);
+
+		dst->requests += src->requests;
+		dst->nsecs += src->nsecs;
+		stats_sum_ops(dst->v4_ops, src->v4_ops, NFS4_OP_LAST_ONE);
+		stats_sum_ops(dst->v4_nsecs, src->v4_nsecs, NFS4_OP_LAST_ONE);
+	}
+}
+
+void server_dbus_cpu_stats(struct gsh_stats *st, DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter, array_iter;
+	struct timespec timestamp;
+	struct cpu_stats *sum = gsh_malloc(sizeof(*sum));
+	const char *name;
+	int i;
+
+	stats_sum_cpu(sum, st);
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &sum->requests);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &sum->nsecs);
+	dbus_message_iter_close_container(iter, &struct_iter);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(stt)",
+					 &array_iter);
+	for (i = 0; i < NFS4_OP_LAST_ONE; i++) {
+		if (sum->v4_ops[i] == 0)
+			continue;
+
+		name = optabv4[i].name;
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &sum->v4_ops[i]);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &sum->v4_nsecs[i]);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	gsh_free(sum);
+}
+
+static int hh_item_key_cmpf(const void *a, const void *b)
+{
+	const struct hh_key *ka = &((const struct hh_item *)a)->key;
+	const struct hh_key *kb = &((const struct hh_item *)b)->key;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (ka->w[i] != kb->w[i])
+			return ka->w[i] < kb->w[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+static int hh_item_count_cmpf(const void *a, const void *b)
+{
+	uint64_t ca = ((const struct hh_item *)a)->count;
+	uint64_t cb = ((const struct hh_item *)b)->count;
+
+	return ca == cb ? 0 : (ca > cb ? -1 : 1);
+}
+
+/**
+ * @brief Merge the shards of one heavy hitters table, largest first
+ *
+ * @param kind   [IN] what is counted
+ * @param metric [IN] ops or bytes
+ * @param items  [OUT] GSH_STATS_SHARDS * 2 * HH_SLOTS items
+ *
+ * @return The number of distinct keys.
+ */
+static uint32_t hh_collect(enum hh_kind kind, enum hh_metric metric,
+			   struct hh_item *items)
+{
+	uint32_t window = nfs_param.core_param.heavy_hitters_window;
+	time_t epoch = time(NULL) / window;
+	uint32_t n = 0, out = 0, i;
+	int s, w;
+
+	for (s = 0; s < GSH_STATS_SHARDS; s++) {
+		struct hh_shard *shard = &hh_shards[kind][s];
+
+		PTHREAD_MUTEX_lock(&shard->mtx);
+		hh_rotate(shard, epoch);
+		for (w = 0; w < 2; w++) {
+			struct hh_table *t = &shard->win[w][metric];
+
+			for (i = 0; i < t->used; i++) {
+				items[n].key = t->key[i];
+				items[n].count = t->count[i];
+				items[n].error = t->error[i];
+				n++;
+			}
+		}
+		PTHREAD_MUTEX_unlock(&shard->mtx);
+	}
+
+	if (n == 0)
+		return 0;
+
+	/* A key may be counted by several shards and both windows */
+	qsort(items, n, sizeof(*items), hh_item_key_cmpf);
+	for (i = 1; i < n; i++) {
+		if (hh_key_eq(&items[out].key, &items[i].key)) {
+			items[out].count += items[i].count;
+			items[out].error += items[i].error;
+		} else {
+			items[++out] = items[i];
+		}
+	}
+	n = out + 1;
+	qsort(items, n, sizeof(*items), hh_item_count_cmpf);
+
+	return n;
+}
+
+static void hh_key_name(enum hh_kind kind, const struct hh_key *key,
+			char *buf, size_t len)
+{
+	switch (kind) {
+	case HH_FILE:
+		snprintf(buf, len, "%" PRIx64 ".%" PRIx64 ":%" PRIu64,
+			 key->w[0], key->w[1], key->w[2]);
+		break;
+	case HH_CLIENT:
+		if (inet_ntop(key->w[2] == 16 ? AF_INET6 : AF_INET, key->w,
+			      buf, len) == NULL)
+			snprintf(buf, len, "<unknown>");
+		break;
+	default:
+		snprintf(buf, len, "%" PRIu64, key->w[0]);
+		break;
+	}
+}
+
+/**
+ * @brief Report the heavy hitters
+ *
+ * For each of file, client and export by ops and by bytes, the
+ * largest counts over the current and previous window.
+ *
+ * @param max  [IN] most entries to report per list
+ * @param iter [IN] reply iterator
+ */
+void server_dbus_heavy_hitters(uint32_t max, DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct hh_item *items;
+	struct timespec timestamp;
+	uint32_t window = nfs_param.core_param.heavy_hitters_window;
+	char namebuf[64];
+	char *name = namebuf;
+	uint32_t n, i;
+	int k, m;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT32, &window);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(ssstt)",
+					 &array_iter);
+	items = gsh_malloc(sizeof(*items) * GSH_STATS_SHARDS * 2 * HH_SLOTS);
+	for (k = 0; window != 0 && k < HH_KIND_COUNT; k++) {
+		for (m = 0; m < HH_METRIC_COUNT; m++) {
+			n = hh_collect(k, m, items);
+			for (i = 0; i < n && i < max; i++) {
+				hh_key_name(k, &items[i].key, namebuf,
+					    sizeof(namebuf));
+				dbus_message_iter_open_container(
+					&array_iter, DBUS_TYPE_STRUCT, NULL,
+					&struct_iter);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_STRING,
+					&hh_kind_names[k]);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_STRING,
+					&hh_metric_names[m]);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_STRING, &name);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_UINT64,
+					&items[i].count);
+				dbus_message_iter_append_basic(
+					&struct_iter, DBUS_TYPE_UINT64,
+					&items[i].error);
+				dbus_message_iter_close_container(
+					&array_iter, &struct_iter);
+			}
+		}
+	}
+	gsh_free(items);
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+/**
+ * @brief Report READ/WRITE buffer pool statistics
+ *
+ * One (size, tc_hits, depot_hits, misses, releases, depot_count)
+ * group is reported per size class that has seen any use.
+ */
+void iobuf_dbus_show(DBusMessageIter *iter)
+{
+	struct gsh_iobuf_stats st[IOBUF_NCLASS];
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	char *type;
+	int klass;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	gsh_iobuf_get_stats(st, IOBUF_NCLASS);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	for (klass = 0; klass < IOBUF_NCLASS; ++klass) {
+		uint64_t size = IOBUF_MIN_SIZE << klass;
+
+		if (st[klass].tc_hits == 0 && st[klass].depot_hits == 0 &&
+		    st[klass].misses == 0)
+			continue;
+
+		type = "size";
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &type);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &size);
+		type = "tc_hits";
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &type);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st[klass].tc_hits);
+		type = "depot_hits";
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &type);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st[klass].depot_hits);
+		type = "misses";
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &type);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st[klass].misses);
+		type = "releases";
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &type);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st[klass].releases);
+		type = "depot_count";
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &type);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &st[klass].depot_count);
+	}
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+/**
+ * @brief Report duplicate request cache statistics
+ */
+void drc_dbus_show(DBusMessageIter *iter)
+{
+	struct dupreq_stats st;
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	char *type;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dupreq2_get_stats(&st);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	type = "hits";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.hits);
+	type = "misses";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.misses);
+	type = "in_progress";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.in_progress);
+	type = "tcp_drc_retired";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.retired);
+	type = "tcp_drc_recycle_queued";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.recycle_qlen);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+/**
+ * @brief Report the worker pool size and what drives it
+ */
+void worker_pool_dbus_show(DBusMessageIter *iter)
+{
+	struct worker_pool_stats st;
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	uint64_t val;
+	char *type;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	worker_pool_get_stats(&st);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	type = "adaptive";
+	val = st.adaptive;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = "min";
+	val = st.min;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = "max";
+	val = st.max;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = "target";
+	val = st.target;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = "threads";
+	val = st.nthreads;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = "busy";
+	val = st.busy;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = "queue_wait_usecs";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.queue_wait);
+	type = "grown";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.grown);
+	type = "shrunk";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.shrunk);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+/**
+ * @brief Report the object counts of each slab cache
+ *
+ * @param[in,out] iter Reply to append the timestamp and array to
+ */
+void slab_dbus_show(DBusMessageIter *iter)
+{
+	struct gsh_slab_stats st[GSH_SLAB_MAX];
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	int n, ix;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	n = gsh_slab_get_stats(st, GSH_SLAB_MAX);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 SLABS_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	for (ix = 0; ix < n; ++ix) {
+		char *name = (char *) st[ix].name;
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &name);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &st[ix].size);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &st[ix].live);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &st[ix].depot_count);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &st[ix].bytes);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+/**
+ * @brief Report the usage of each allocator arena
+ *
+ * Arenas without a jemalloc arena of their own report only the slab
+ * chunks tagged to them.
+ *
+ * @param[in,out] iter Reply to append the timestamp and array to
+ */
+void mem_arena_dbus_show(DBusMessageIter *iter)
+{
+	struct mem_arena_stats st[MEM_ARENA_COUNT];
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	dbus_bool_t enabled;
+	int ix;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	mem_arena_get_stats(st);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 MEM_ARENAS_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	for (ix = 0; ix < MEM_ARENA_COUNT; ++ix) {
+		char *name = (char *) st[ix].name;
+
+		enabled = st[ix].enabled;
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &name);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_BOOLEAN, &enabled);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &st[ix].allocated);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &st[ix].resident);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &st[ix].slab_bytes);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+#ifdef _USE_NFS_RDMA
+/**
+ * @brief Report the counters of each NFS/RDMA connection
+ *
+ * @param[in,out] iter Reply to append the timestamp and array to
+ */
+void rdma_dbus_show(DBusMessageIter *iter)
+{
+	struct nfs_rdma_conn_stats *st;
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	uint32_t n, ix;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	n = nfs_rdma_get_conn_stats(&st);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 RDMA_CONNS_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	for (ix = 0; ix < n; ++ix) {
+		char *peer = st[ix].peer;
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &peer);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &st[ix].requests);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &st[ix].credit_stalls);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &st[ix].rdma_read_reqs);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64,
+					       &st[ix].rdma_write_reqs);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	gsh_free(st);
+}
+#endif				/* _USE_NFS_RDMA */
 
 #ifdef _USE_9P
 void server_dbus_9p_iostats(struct _9p_stats *_9pp, DBusMessageIter *iter)
@@ -1770,30 +3611,34 @@ static void server_dbus_layouts(struct layout_op *lop, DBusMessageIter *iter)
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
-void server_dbus_v41_layouts(struct nfsv41_stats *v41p, DBusMessageIter *iter)
+void server_dbus_v41_layouts(struct gsh_stats *st, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	stats_sum_v41(&sum, st, st->nfsv41);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_layouts(&v41p->getdevinfo, iter);
-	server_dbus_layouts(&v41p->layout_get, iter);
-	server_dbus_layouts(&v41p->layout_commit, iter);
-	server_dbus_layouts(&v41p->layout_return, iter);
-	server_dbus_layouts(&v41p->recall, iter);
+	server_dbus_layouts(&sum.getdevinfo, iter);
+	server_dbus_layouts(&sum.layout_get, iter);
+	server_dbus_layouts(&sum.layout_commit, iter);
+	server_dbus_layouts(&sum.layout_return, iter);
+	server_dbus_layouts(&sum.recall, iter);
 }
 
-void server_dbus_v42_layouts(struct nfsv41_stats *v42p, DBusMessageIter *iter)
+void server_dbus_v42_layouts(struct gsh_stats *st, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	stats_sum_v41(&sum, st, st->nfsv42);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_layouts(&v42p->getdevinfo, iter);
-	server_dbus_layouts(&v42p->layout_get, iter);
-	server_dbus_layouts(&v42p->layout_commit, iter);
-	server_dbus_layouts(&v42p->layout_return, iter);
-	server_dbus_layouts(&v42p->recall, iter);
+	server_dbus_layouts(&sum.getdevinfo, iter);
+	server_dbus_layouts(&sum.layout_get, iter);
+	server_dbus_layouts(&sum.layout_commit, iter);
+	server_dbus_layouts(&sum.layout_return, iter);
+	server_dbus_layouts(&sum.recall, iter);
 }
 
 /**
@@ -1819,6 +3664,8 @@ void server_dbus_delegations(struct deleg_stats *ds, DBusMessageIter *iter)
 				       &ds->failed_recalls);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
 				       &ds->num_revokes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &ds->num_declines);
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
@@ -1863,6 +3710,15 @@ void server_stats_free(struct gsh_stats *statsp)
 		gsh_free(statsp->nfsv42);
 		statsp->nfsv42 = NULL;
 	}
+	if (statsp->cpu != NULL) {
+		gsh_free(statsp->cpu);
+		statsp->cpu = NULL;
+	}
+	if (statsp->hist != NULL) {
+		lat_hists_free(statsp->hist);
+		gsh_free(statsp->hist);
+		statsp->hist = NULL;
+	}
 #ifdef _USE_9P
 	if (statsp->_9p != NULL) {
 		u8 opc;
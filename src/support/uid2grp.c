@@ -45,6 +45,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "common_utils.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
 #include "uid2grp.h"
 
 /* group_data has a reference counter. If it goes to zero, it implies
@@ -345,4 +347,381 @@ void uid2grp_unref(struct group_data *gdata)
 	uid2grp_release_group_data(gdata);
 }
 
+/**
+ * @brief Per-transport memo of the last few lookups
+ *
+ * A connection is mostly used by a handful of users, so remembering
+ * their group data on the transport keeps most requests away from the
+ * cache and its lock.  Each entry holds its own reference and is only
+ * trusted while it is not expired and no entry has left the cache
+ * since it was taken.  A failed lookup is remembered for a few seconds
+ * so that the requests parked on it fail without trying again on the
+ * worker.
+ */
+
+#define UID2GRP_MEMO_SIZE 4
+#define UID2GRP_NEGATIVE_TTL 5
+
+struct uid2grp_memo_entry {
+	uid_t uid;
+	uint32_t gen;		/*< uid2grp_gen when taken */
+	time_t epoch;		/*< When a failed lookup was taken */
+	struct group_data *gdata;	/*< NULL for a failed lookup */
+	bool valid;
+};
+
+struct uid2grp_memo {
+	pthread_mutex_t lock;
+	uint32_t next;		/*< Next entry to replace */
+	struct uid2grp_memo_entry entry[UID2GRP_MEMO_SIZE];
+};
+
+enum uid2grp_memo_result {
+	UID2GRP_MEMO_MISS,
+	UID2GRP_MEMO_HIT,
+	UID2GRP_MEMO_FAILED,	/*< The last lookup failed */
+};
+
+/** Set once Manage_Gids has been used, before that nothing is parked */
+static bool uid2grp_managed;
+
+/** Threads doing the lookups of parked requests */
+static struct fridgethr *uid2grp_fridge;
+
+/**
+ * @brief A lookup in progress, with the requests waiting for it
+ */
+struct uid2grp_lookup {
+	struct glist_head list;	/*< On uid2grp_lookups */
+	uid_t uid;
+	struct glist_head waiters;
+};
+
+static pthread_mutex_t uid2grp_lookup_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head uid2grp_lookups = GLIST_HEAD_INIT(uid2grp_lookups);
+
+static struct uid2grp_memo *uid2grp_memo_alloc(struct uid2grp_memo **memop)
+{
+	struct uid2grp_memo *memo = atomic_fetch_voidptr((void **)memop);
+
+	if (memo != NULL)
+		return memo;
+
+	memo = gsh_calloc(1, sizeof(*memo));
+	PTHREAD_MUTEX_init(&memo->lock, NULL);
+
+	if (!atomic_cas_voidptr((void **)memop, NULL, memo)) {
+		/* Another request on the transport got there first */
+		PTHREAD_MUTEX_destroy(&memo->lock);
+		gsh_free(memo);
+		memo = atomic_fetch_voidptr((void **)memop);
+	}
+
+	return memo;
+}
+
+/**
+ * @brief Release a transport's memo
+ *
+ * @param[in] memo The memo
+ */
+void uid2grp_memo_free(struct uid2grp_memo *memo)
+{
+	int i;
+
+	for (i = 0; i < UID2GRP_MEMO_SIZE; i++) {
+		if (memo->entry[i].valid && memo->entry[i].gdata != NULL)
+			uid2grp_unref(memo->entry[i].gdata);
+	}
+
+	PTHREAD_MUTEX_destroy(&memo->lock);
+	gsh_free(memo);
+}
+
+/**
+ * @brief Look a uid up in a memo
+ *
+ * @param[in]  memo  The memo
+ * @param[in]  uid   The uid
+ * @param[out] gdata Held group data on a hit, NULL not to take it
+ *
+ * @return Whether the uid was found, and how its lookup went.
+ */
+static enum uid2grp_memo_result uid2grp_memo_get(struct uid2grp_memo *memo,
+						 uid_t uid,
+						 struct group_data **gdata)
+{
+	enum uid2grp_memo_result res = UID2GRP_MEMO_MISS;
+	struct group_data *stale = NULL;
+	struct uid2grp_memo_entry *e;
+	uint32_t gen = atomic_fetch_uint32_t(&uid2grp_gen);
+	int i;
+
+	PTHREAD_MUTEX_lock(&memo->lock);
+
+	for (i = 0; i < UID2GRP_MEMO_SIZE; i++) {
+		e = &memo->entry[i];
+		if (!e->valid || e->uid != uid)
+			continue;
+
+		if (e->gdata == NULL
+		    ? time(NULL) - e->epoch > UID2GRP_NEGATIVE_TTL
+		    : e->gen != gen || uid2grp_expired(e->gdata)) {
+			stale = e->gdata;
+			e->valid = false;
+		} else if (e->gdata == NULL) {
+			res = UID2GRP_MEMO_FAILED;
+		} else {
+			if (gdata != NULL) {
+				uid2grp_hold_group_data(e->gdata);
+				*gdata = e->gdata;
+			}
+			res = UID2GRP_MEMO_HIT;
+		}
+		break;
+	}
+
+	PTHREAD_MUTEX_unlock(&memo->lock);
+
+	if (stale != NULL)
+		uid2grp_unref(stale);
+
+	return res;
+}
+
+/**
+ * @brief Remember a lookup in a memo
+ *
+ * @param[in] memo  The memo
+ * @param[in] uid   The uid looked up
+ * @param[in] gdata Its group data, NULL if the lookup failed
+ * @param[in] gen   uid2grp_gen from before the lookup
+ */
+static void uid2grp_memo_put(struct uid2grp_memo *memo, uid_t uid,
+			     struct group_data *gdata, uint32_t gen)
+{
+	struct group_data *old = NULL;
+	struct uid2grp_memo_entry *e = NULL;
+	int i;
+
+	if (gdata != NULL)
+		uid2grp_hold_group_data(gdata);
+
+	PTHREAD_MUTEX_lock(&memo->lock);
+
+	for (i = 0; i < UID2GRP_MEMO_SIZE; i++) {
+		if (memo->entry[i].valid && memo->entry[i].uid == uid) {
+			e = &memo->entry[i];
+			break;
+		}
+		if (!memo->entry[i].valid && e == NULL)
+			e = &memo->entry[i];
+	}
+
+	if (e == NULL)
+		e = &memo->entry[memo->next++ % UID2GRP_MEMO_SIZE];
+
+	if (e->valid)
+		old = e->gdata;
+
+	e->uid = uid;
+	e->gen = gen;
+	e->epoch = time(NULL);
+	e->gdata = gdata;
+	e->valid = true;
+
+	PTHREAD_MUTEX_unlock(&memo->lock);
+
+	if (old != NULL)
+		uid2grp_unref(old);
+}
+
+/**
+ * @brief Get supplementary groups given uid, through a transport's memo
+ *
+ * @param[in,out] memo  The transport's memo, NULL if it has none
+ * @param[in]     uid   The uid of the user
+ * @param[out]    gdata The group data, release with uid2grp_unref()
+ *
+ * @return true if successful, false otherwise
+ */
+bool uid2grp_xprt(struct uid2grp_memo **memo, uid_t uid,
+		  struct group_data **gdata)
+{
+	struct uid2grp_memo *m;
+	uint32_t gen;
+	bool success;
+
+	if (!uid2grp_managed)
+		uid2grp_managed = true;
+
+	if (memo == NULL)
+		return uid2grp(uid, gdata);
+
+	m = uid2grp_memo_alloc(memo);
+
+	switch (uid2grp_memo_get(m, uid, gdata)) {
+	case UID2GRP_MEMO_HIT:
+		return true;
+	case UID2GRP_MEMO_FAILED:
+		return false;
+	case UID2GRP_MEMO_MISS:
+		break;
+	}
+
+	gen = atomic_fetch_uint32_t(&uid2grp_gen);
+	success = uid2grp(uid, gdata);
+	uid2grp_memo_put(m, uid, success ? *gdata : NULL, gen);
+
+	return success;
+}
+
+/**
+ * @brief Look up the groups of a parked uid
+ *
+ * Runs on a uid2grp fridge thread, filling the cache and the memos of
+ * the waiting requests before handing them back.
+ *
+ * @param[in] ctx Thread context, the lookup is its argument
+ */
+static void uid2grp_lookup_job(struct fridgethr_context *ctx)
+{
+	struct uid2grp_lookup *lookup = ctx->arg;
+	struct uid2grp_waiter *waiter;
+	struct group_data *gdata = NULL;
+	uint32_t gen = atomic_fetch_uint32_t(&uid2grp_gen);
+	bool success;
+
+	success = uid2grp(lookup->uid, &gdata);
+	if (!success)
+		LogEvent(COMPONENT_IDMAPPER,
+			 "Could not get the groups of uid %u", lookup->uid);
+
+	/* Nothing joins the lookup once it is off the list */
+	PTHREAD_MUTEX_lock(&uid2grp_lookup_lock);
+	glist_del(&lookup->list);
+	PTHREAD_MUTEX_unlock(&uid2grp_lookup_lock);
+
+	while ((waiter = glist_first_entry(&lookup->waiters,
+					   struct uid2grp_waiter, list))) {
+		glist_del(&waiter->list);
+		uid2grp_memo_put(uid2grp_memo_alloc(waiter->memo),
+				 lookup->uid, success ? gdata : NULL, gen);
+		waiter->done(waiter);
+	}
+
+	if (success)
+		uid2grp_unref(gdata);
+
+	gsh_free(lookup);
+}
+
+/**
+ * @brief Put a request aside until its caller's groups are known
+ *
+ * Nothing is parked if the groups are already cached, if Manage_Gids
+ * has not been used yet, or if there are no lookup threads.  Otherwise
+ * the waiter joins the lookup of the uid, starting it if need be, and
+ * its done callback is called, possibly before this returns, once the
+ * result is in the transport's memo.
+ *
+ * @param[in,out] memo   The transport's memo
+ * @param[in]     uid    The uid of the caller
+ * @param[in,out] waiter The waiter, with its done callback set
+ *
+ * @retval true if the waiter has been parked, the caller must leave the
+ *         request alone.
+ * @retval false if the request can go ahead.
+ */
+bool uid2grp_park(struct uid2grp_memo **memo, uid_t uid,
+		  struct uid2grp_waiter *waiter)
+{
+	struct uid2grp_memo *m;
+	struct uid2grp_lookup *lookup = NULL;
+	struct glist_head *glist;
+	struct group_data *gdata;
+	uint32_t gen;
+	int rc;
+
+	if (!uid2grp_managed || uid2grp_fridge == NULL)
+		return false;
+
+	m = uid2grp_memo_alloc(memo);
+	if (uid2grp_memo_get(m, uid, NULL) != UID2GRP_MEMO_MISS)
+		return false;
+
+	/* Cached already, only the memo needs filling */
+	gen = atomic_fetch_uint32_t(&uid2grp_gen);
+	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
+	if (uid2grp_lookup_by_uid(uid, &gdata) && !uid2grp_expired(gdata)) {
+		uid2grp_memo_put(m, uid, gdata, gen);
+		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+		return false;
+	}
+	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+
+	waiter->memo = memo;
+	waiter->parked = true;
+
+	PTHREAD_MUTEX_lock(&uid2grp_lookup_lock);
+
+	glist_for_each(glist, &uid2grp_lookups) {
+		lookup = glist_entry(glist, struct uid2grp_lookup, list);
+		if (lookup->uid == uid)
+			break;
+		lookup = NULL;
+	}
+
+	if (lookup == NULL) {
+		lookup = gsh_malloc(sizeof(*lookup));
+		lookup->uid = uid;
+		glist_init(&lookup->waiters);
+
+		rc = fridgethr_submit(uid2grp_fridge, uid2grp_lookup_job,
+				      lookup);
+		if (rc != 0) {
+			PTHREAD_MUTEX_unlock(&uid2grp_lookup_lock);
+			LogMajor(COMPONENT_IDMAPPER,
+				 "Unable to schedule uid %u lookup: %d",
+				 uid, rc);
+			gsh_free(lookup);
+			waiter->parked = false;
+			return false;
+		}
+
+		glist_add_tail(&uid2grp_lookups, &lookup->list);
+	}
+
+	glist_add_tail(&lookup->waiters, &waiter->list);
+
+	PTHREAD_MUTEX_unlock(&uid2grp_lookup_lock);
+
+	return true;
+}
+
+/**
+ * @brief Start the threads looking up the groups of parked requests
+ */
+void uid2grp_async_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (nfs_param.core_param.manage_gids_lookup_threads == 0)
+		return;
+
+	memset(&frp, 0, sizeof(frp));
+	frp.thr_max = nfs_param.core_param.manage_gids_lookup_threads;
+	frp.thread_delay = 60;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&uid2grp_fridge, "uid2grp", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to initialize uid2grp thread fridge: %d",
+			 rc);
+		uid2grp_fridge = NULL;
+	}
+}
+
 /** @} */
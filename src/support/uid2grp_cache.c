@@ -78,6 +78,15 @@ static struct avltree_node *uid_grplist_cache[id_cache_size];
 
 pthread_rwlock_t uid2grp_user_lock = PTHREAD_RWLOCK_INITIALIZER;
 
+/**
+ * @brief Bumped whenever an entry leaves the cache
+ *
+ * The per-transport memos hold their own references, an entry there is
+ * only good while the generation it was taken in is current.
+ */
+
+uint32_t uid2grp_gen;
+
 /**
  * @brief Tree of users, by name
  */
@@ -193,6 +202,7 @@ void uid2grp_cache_init(void)
 static void uid2grp_remove_user(struct cache_info *info)
 {
 	uid_grplist_cache[info->uid % id_cache_size] = NULL;
+	(void) atomic_inc_uint32_t(&uid2grp_gen);
 	avltree_remove(&info->uid_node, &uid_tree);
 	avltree_remove(&info->uname_node, &uname_tree);
 	/* We decrement hold on group data when it is
@@ -830,6 +830,112 @@ void check_min_2(void)
  * Returns a CUE_SUCCESS on successful running, another
  * CUnit error code on failure.
  */
+/* A tree whose nodes also track the largest val in their subtree */
+typedef struct avl_aug_val {
+	struct avltree_node node_k;
+	unsigned long key;
+	unsigned long val;
+	unsigned long max_val;
+} avl_aug_val_t;
+
+int avl_aug_cmpf(const struct avltree_node *lhs,
+		 const struct avltree_node *rhs)
+{
+	avl_aug_val_t *lk, *rk;
+
+	lk = avltree_container_of(lhs, avl_aug_val_t, node_k);
+	rk = avltree_container_of(rhs, avl_aug_val_t, node_k);
+
+	if (lk->key < rk->key)
+		return -1;
+
+	if (lk->key == rk->key)
+		return 0;
+
+	return 1;
+}
+
+void avl_aug_fn(struct avltree_node *node)
+{
+	avl_aug_val_t *v = avltree_container_of(node, avl_aug_val_t, node_k);
+	avl_aug_val_t *c;
+
+	v->max_val = v->val;
+
+	if (node->left) {
+		c = avltree_container_of(node->left, avl_aug_val_t, node_k);
+		if (c->max_val > v->max_val)
+			v->max_val = c->max_val;
+	}
+
+	if (node->right) {
+		c = avltree_container_of(node->right, avl_aug_val_t, node_k);
+		if (c->max_val > v->max_val)
+			v->max_val = c->max_val;
+	}
+}
+
+/* Returns the subtree maximum, clears *ok on a stale node */
+unsigned long avl_aug_check(struct avltree_node *node, int *ok)
+{
+	avl_aug_val_t *v;
+	unsigned long max, sub;
+
+	if (node == NULL)
+		return 0;
+
+	v = avltree_container_of(node, avl_aug_val_t, node_k);
+	max = v->val;
+
+	sub = avl_aug_check(node->left, ok);
+	if (sub > max)
+		max = sub;
+
+	sub = avl_aug_check(node->right, ok);
+	if (sub > max)
+		max = sub;
+
+	if (max != v->max_val)
+		*ok = 0;
+
+	return max;
+}
+
+void check_augment_1(void)
+{
+	struct avltree t;
+	avl_aug_val_t *v;
+	int ix, ok = 1;
+
+	avltree_init(&t, avl_aug_cmpf, 0);
+	avltree_set_augment(&t, avl_aug_fn);
+
+	v = gsh_calloc(2000, sizeof(*v));
+
+	srand(2600);
+
+	for (ix = 0; ix < 2000; ++ix) {
+		v[ix].key = rand();
+		v[ix].val = rand();
+		if (avltree_insert(&v[ix].node_k, &t) != NULL)
+			v[ix].key = 0;
+		if (ix % 10 == 0)
+			avl_aug_check(t.root, &ok);
+	}
+	CU_ASSERT(ok);
+
+	/* remove every other node, leaves and inner nodes alike */
+	for (ix = 0; ix < 2000; ix += 2) {
+		if (v[ix].key == 0)
+			continue;
+		avltree_remove(&v[ix].node_k, &t);
+		avl_aug_check(t.root, &ok);
+	}
+	CU_ASSERT(ok);
+
+	gsh_free(v);
+}
+
 int main(int argc, char *argv[])
 {
 	/* initialize the CUnit test registry...  get this party started */
@@ -923,6 +1029,12 @@ int main(int argc, char *argv[])
 		CU_TEST_INFO_NULL,
 	};
 
+	CU_TestInfo avl_tree_unit_augment[] = {
+		{"Subtree max after inserts, deletes.", check_augment_1}
+		,
+		CU_TEST_INFO_NULL,
+	};
+
 	CU_SuiteInfo suites[] = {
 		{"Avl operations 1", init_suite1, clean_suite1,
 		 avl_tree_unit_1_arr}
@@ -945,6 +1057,9 @@ int main(int argc, char *argv[])
 		{"Check supremum", init_supremum, clean_supremum,
 		 avl_tree_unit_supremum}
 		,
+		{"Check augment", init_suite1, clean_suite1,
+		 avl_tree_unit_augment}
+		,
 		CU_SUITE_INFO_NULL,
 	};
 
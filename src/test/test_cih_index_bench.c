@@ -0,0 +1,235 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file test_cih_index_bench.c
+ * @brief Compare the AVL and open-addressing cih partition indexes
+ *
+ * Keys mimic mdcache keys: a 64-bit hash plus a file handle, compared
+ * the way mdcache_key_cmp() does.  Entries are allocated separately
+ * and the lookup order is random, so a large set misses in cache the
+ * way a big handle cache does.
+ *
+ * Usage: test_cih_index_bench [entries [lookups [partitions]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include "avltree.h"
+#include "gsh_oahash.h"
+
+#define FH_LEN 32
+
+struct bench_entry {
+	struct avltree_node node_k;
+	uint64_t hk;
+	size_t len;
+	unsigned char fh[FH_LEN];
+};
+
+struct bench_key {
+	uint64_t hk;
+	size_t len;
+	const unsigned char *fh;
+};
+
+static inline int bench_key_cmp(uint64_t hk1, size_t len1,
+				const unsigned char *fh1, uint64_t hk2,
+				size_t len2, const unsigned char *fh2)
+{
+	if (hk1 < hk2)
+		return -1;
+	if (hk1 > hk2)
+		return 1;
+	if (len1 < len2)
+		return -1;
+	if (len1 > len2)
+		return 1;
+	return memcmp(fh1, fh2, len1);
+}
+
+static int bench_avl_cmpf(const struct avltree_node *lhs,
+			  const struct avltree_node *rhs)
+{
+	struct bench_entry *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct bench_entry, node_k);
+	rk = avltree_container_of(rhs, struct bench_entry, node_k);
+
+	return bench_key_cmp(lk->hk, lk->len, lk->fh,
+			     rk->hk, rk->len, rk->fh);
+}
+
+static bool bench_oa_match(const void *item, const void *key)
+{
+	const struct bench_entry *e = item;
+	const struct bench_key *k = key;
+
+	return bench_key_cmp(e->hk, e->len, e->fh, k->hk, k->len, k->fh) == 0;
+}
+
+static uint64_t bench_oa_hash(const void *item)
+{
+	return ((const struct bench_entry *)item)->hk;
+}
+
+/* splitmix64 */
+static uint64_t bench_rand(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t nentries = argc > 1 ? strtoull(argv[1], NULL, 0) : 1000000;
+	uint64_t nlookups = argc > 2 ? strtoull(argv[2], NULL, 0) : 10000000;
+	uint32_t npart = argc > 3 ? strtoul(argv[3], NULL, 0) : 7;
+	struct bench_entry **entries;
+	uint64_t *order;
+	struct avltree *trees;
+	struct oahash *tables;
+	uint64_t seed = 8675309, i, found;
+	double t0, t_avl_ins, t_oa_ins, t_avl_get, t_oa_get;
+
+	if (nentries == 0 || npart == 0)
+		return 1;
+
+	entries = calloc(nentries, sizeof(*entries));
+	order = calloc(nlookups, sizeof(*order));
+	trees = calloc(npart, sizeof(*trees));
+	tables = calloc(npart, sizeof(*tables));
+
+	for (i = 0; i < nentries; ++i) {
+		struct bench_entry *e = calloc(1, sizeof(*e));
+		int j;
+
+		for (j = 0; j < FH_LEN; j += sizeof(uint64_t)) {
+			uint64_t r = bench_rand(&seed);
+
+			memcpy(e->fh + j, &r, sizeof(r));
+		}
+		e->len = FH_LEN;
+		e->hk = bench_rand(&seed);
+		entries[i] = e;
+	}
+
+	for (i = 0; i < nlookups; ++i)
+		order[i] = bench_rand(&seed) % nentries;
+
+	for (i = 0; i < npart; ++i) {
+		avltree_init(&trees[i], bench_avl_cmpf, 0);
+		oahash_init(&tables[i], 0, bench_oa_hash);
+	}
+
+	t0 = bench_now();
+	for (i = 0; i < nentries; ++i)
+		avltree_insert(&entries[i]->node_k,
+			       &trees[entries[i]->hk % npart]);
+	t_avl_ins = bench_now() - t0;
+
+	t0 = bench_now();
+	for (i = 0; i < nentries; ++i)
+		oahash_insert(&tables[entries[i]->hk % npart],
+			      entries[i]->hk, entries[i]);
+	t_oa_ins = bench_now() - t0;
+
+	found = 0;
+	t0 = bench_now();
+	for (i = 0; i < nlookups; ++i) {
+		struct bench_entry *e = entries[order[i]];
+		struct bench_entry k;
+
+		k.hk = e->hk;
+		k.len = e->len;
+		memcpy(k.fh, e->fh, FH_LEN);
+		if (avltree_inline_lookup(&k.node_k, &trees[k.hk % npart],
+					  bench_avl_cmpf))
+			++found;
+	}
+	t_avl_get = bench_now() - t0;
+	if (found != nlookups)
+		fprintf(stderr, "AVL found %" PRIu64 " of %" PRIu64 "\n",
+			found, nlookups);
+
+	found = 0;
+	t0 = bench_now();
+	for (i = 0; i < nlookups; ++i) {
+		struct bench_entry *e = entries[order[i]];
+		unsigned char fh[FH_LEN];
+		struct bench_key k = { e->hk, e->len, fh };
+
+		memcpy(fh, e->fh, FH_LEN);
+		if (oahash_lookup(&tables[k.hk % npart], k.hk,
+				  bench_oa_match, &k))
+			++found;
+	}
+	t_oa_get = bench_now() - t0;
+	if (found != nlookups)
+		fprintf(stderr, "OA found %" PRIu64 " of %" PRIu64 "\n",
+			found, nlookups);
+
+	printf("%" PRIu64 " entries, %" PRIu64 " lookups, %u partitions\n",
+	       nentries, nlookups, npart);
+	printf("%-16s %12s %12s\n", "", "insert ns", "lookup ns");
+	printf("%-16s %12.1f %12.1f\n", "AVL",
+	       t_avl_ins * 1e9 / nentries, t_avl_get * 1e9 / nlookups);
+	printf("%-16s %12.1f %12.1f\n", "Open_Addressing",
+	       t_oa_ins * 1e9 / nentries, t_oa_get * 1e9 / nlookups);
+
+	for (i = 0; i < nentries; ++i) {
+		if (!oahash_remove(&tables[entries[i]->hk % npart],
+				   entries[i]->hk, entries[i]))
+			fprintf(stderr, "OA remove failed\n");
+		avltree_remove(&entries[i]->node_k,
+			       &trees[entries[i]->hk % npart]);
+		free(entries[i]);
+	}
+	for (i = 0; i < npart; ++i) {
+		if (oahash_count(&tables[i]) != 0)
+			fprintf(stderr, "OA partition %" PRIu64 " not empty\n",
+				i);
+		oahash_destroy(&tables[i]);
+	}
+
+	free(tables);
+	free(trees);
+	free(order);
+	free(entries);
+
+	return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file test_hash_bench.c
+ * @brief Throughput and scaling of the hashtable and AVL tree
+ *
+ * Each table is loaded with the given number of entries, then 1, 2,
+ * 4... up to the given number of threads each run a mix of lookups,
+ * and of set and delete pairs on keys of their own, on the shared
+ * table.  The hashtable is measured with tree partitions and with
+ * HT_FLAG_OPEN partitions, the AVL tree with lookups only since it has
+ * no lock of its own.  Results are operations per second over all
+ * threads, so they can be compared between builds on the same host.
+ *
+ * Usage: test_hash_bench [entries [ops [threads [write_pct]]]]
+ *
+ * ops is per thread, write_pct the percentage of operations that are
+ * a set and delete pair, 10 by default.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "avltree.h"
+#include "hashtable.h"
+
+#define PARTITIONS 17
+
+struct bench_entry {
+	struct avltree_node node_k;
+	uint64_t key;
+};
+
+struct bench_thread {
+	pthread_t thread;
+	uint64_t seed;
+	uint64_t ops;
+	uint64_t found;
+	int id;
+};
+
+static struct bench_entry *entries;
+static uint64_t nentries;
+static uint64_t nops;
+static unsigned int write_pct = 10;
+static hash_table_t *bench_ht;
+static struct avltree bench_tree;
+static pthread_barrier_t bench_barrier;
+
+/* splitmix64 */
+static uint64_t bench_rand(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t bench_index(struct hash_param *hparam,
+			    struct gsh_buffdesc *key)
+{
+	return *(uint64_t *)key->addr % hparam->index_size;
+}
+
+static uint64_t bench_hash(struct hash_param *hparam,
+			   struct gsh_buffdesc *key)
+{
+	uint64_t k = *(uint64_t *)key->addr;
+
+	return bench_rand(&k);
+}
+
+static int bench_compare(struct gsh_buffdesc *lhs, struct gsh_buffdesc *rhs)
+{
+	return *(uint64_t *)lhs->addr != *(uint64_t *)rhs->addr;
+}
+
+static int bench_free(struct gsh_buffdesc key, struct gsh_buffdesc val)
+{
+	return 1;
+}
+
+static int bench_avl_cmpf(const struct avltree_node *lhs,
+			  const struct avltree_node *rhs)
+{
+	struct bench_entry *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct bench_entry, node_k);
+	rk = avltree_container_of(rhs, struct bench_entry, node_k);
+
+	if (lk->key < rk->key)
+		return -1;
+	return lk->key > rk->key;
+}
+
+static void *bench_ht_thread(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct gsh_buffdesc key, val;
+	struct hash_latch latch;
+	uint64_t i, k;
+
+	key.len = sizeof(uint64_t);
+	pthread_barrier_wait(&bench_barrier);
+
+	for (i = 0; i < nops; i++) {
+		uint64_t r = bench_rand(&bt->seed);
+
+		if (r % 100 < write_pct) {
+			/* Keys past nentries are private to the thread */
+			k = nentries + bt->id * nops + i;
+			key.addr = &k;
+			val.addr = &k;
+			val.len = sizeof(k);
+
+			if (hashtable_getlatch(bench_ht, &key, NULL, true,
+					       &latch)
+			    == HASHTABLE_ERROR_NO_SUCH_KEY)
+				hashtable_setlatched(bench_ht, &key, &val,
+						     &latch, false, NULL,
+						     NULL);
+
+			if (hashtable_getlatch(bench_ht, &key, NULL, true,
+					       &latch) == HASHTABLE_SUCCESS) {
+				hashtable_deletelatched(bench_ht, &key, &latch,
+							NULL, NULL);
+				hashtable_releaselatched(bench_ht, &latch);
+			}
+		} else {
+			key.addr = &entries[r % nentries].key;
+			if (HashTable_Get(bench_ht, &key, &val)
+			    == HASHTABLE_SUCCESS)
+				bt->found++;
+		}
+		bt->ops++;
+	}
+
+	return NULL;
+}
+
+static void *bench_avl_thread(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct bench_entry k;
+	uint64_t i;
+
+	pthread_barrier_wait(&bench_barrier);
+
+	for (i = 0; i < nops; i++) {
+		k.key = entries[bench_rand(&bt->seed) % nentries].key;
+		if (avltree_inline_lookup(&k.node_k, &bench_tree,
+					  bench_avl_cmpf))
+			bt->found++;
+		bt->ops++;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Run a workload on a number of threads
+ *
+ * @return Operations per second over all threads.
+ */
+static double bench_run(void *(*fn)(void *), int nthreads,
+			uint64_t *found)
+{
+	struct bench_thread *bt = calloc(nthreads, sizeof(*bt));
+	uint64_t ops = 0;
+	double t0;
+	int i;
+
+	pthread_barrier_init(&bench_barrier, NULL, nthreads + 1);
+
+	for (i = 0; i < nthreads; i++) {
+		bt[i].id = i;
+		bt[i].seed = 8675309 + i;
+		pthread_create(&bt[i].thread, NULL, fn, &bt[i]);
+	}
+
+	pthread_barrier_wait(&bench_barrier);
+	t0 = bench_now();
+
+	*found = 0;
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(bt[i].thread, NULL);
+		ops += bt[i].ops;
+		*found += bt[i].found;
+	}
+
+	t0 = bench_now() - t0;
+	pthread_barrier_destroy(&bench_barrier);
+	free(bt);
+
+	return ops / t0;
+}
+
+static void bench_hashtable(const char *name, uint32_t flags, int maxthreads)
+{
+	struct hash_param param = {
+		.flags = flags,
+		.index_size = PARTITIONS,
+		.hash_func_key = bench_index,
+		.hash_func_rbt = bench_hash,
+		.compare_key = bench_compare,
+		.ht_name = (char *)name,
+		.ht_log_component = COMPONENT_HASHTABLE,
+	};
+	struct gsh_buffdesc key, val;
+	uint64_t i, found, reads;
+	double t0, rate;
+	int n;
+
+	bench_ht = hashtable_init(&param);
+
+	key.len = sizeof(uint64_t);
+	val.len = sizeof(uint64_t);
+	t0 = bench_now();
+	for (i = 0; i < nentries; i++) {
+		key.addr = &entries[i].key;
+		val.addr = &entries[i].key;
+		HashTable_Set(bench_ht, &key, &val);
+	}
+	t0 = bench_now() - t0;
+	printf("%-16s load %10.1f ns/entry\n", name, t0 * 1e9 / nentries);
+
+	for (n = 1; n <= maxthreads; n *= 2) {
+		rate = bench_run(bench_ht_thread, n, &found);
+		reads = n * nops * (100 - write_pct) / 100;
+		printf("%-16s %3d threads %12.0f ops/s%s\n", name, n, rate,
+		       found < reads * 9 / 10 ? " (lookups missing)" : "");
+	}
+
+	hashtable_destroy(bench_ht, bench_free);
+}
+
+static void bench_avltree(int maxthreads)
+{
+	uint64_t i, found;
+	double t0, rate;
+	int n;
+
+	avltree_init(&bench_tree, bench_avl_cmpf, 0);
+
+	t0 = bench_now();
+	for (i = 0; i < nentries; i++)
+		avltree_insert(&entries[i].node_k, &bench_tree);
+	t0 = bench_now() - t0;
+	printf("%-16s load %10.1f ns/entry\n", "AVL", t0 * 1e9 / nentries);
+
+	for (n = 1; n <= maxthreads; n *= 2) {
+		rate = bench_run(bench_avl_thread, n, &found);
+		printf("%-16s %3d threads %12.0f ops/s%s\n", "AVL", n, rate,
+		       found != n * nops ? " (lookups missing)" : "");
+	}
+
+	for (i = 0; i < nentries; i++)
+		avltree_remove(&entries[i].node_k, &bench_tree);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t seed = 42, i;
+	int maxthreads;
+
+	nentries = argc > 1 ? strtoull(argv[1], NULL, 0) : 100000;
+	nops = argc > 2 ? strtoull(argv[2], NULL, 0) : 1000000;
+	maxthreads = argc > 3 ? atoi(argv[3]) : 8;
+	if (argc > 4)
+		write_pct = atoi(argv[4]);
+
+	if (nentries == 0 || maxthreads <= 0 || write_pct > 100)
+		return 1;
+
+	/* Entry keys are a shuffle of 0..nentries-1, thread keys follow */
+	entries = calloc(nentries, sizeof(*entries));
+	for (i = 0; i < nentries; i++)
+		entries[i].key = i;
+	for (i = nentries - 1; i > 0; i--) {
+		uint64_t j = bench_rand(&seed) % (i + 1);
+		uint64_t t = entries[i].key;
+
+		entries[i].key = entries[j].key;
+		entries[j].key = t;
+	}
+
+	printf("%" PRIu64 " entries, %" PRIu64 " ops per thread, %u%% writes\n",
+	       nentries, nops, write_pct);
+
+	bench_hashtable("Hash_Tree", HT_FLAG_CACHE, maxthreads);
+	bench_hashtable("Hash_Open", HT_FLAG_OPEN, maxthreads);
+	bench_avltree(maxthreads);
+
+	free(entries);
+
+	return 0;
+}
@@ -804,6 +804,92 @@ void do_unlock(struct response *resp)
 	resp->r_status = STATUS_GRANTED;
 }
 
+/*
+ * do_bench
+ *
+ * Take and release the lock r_count times, timing how long each
+ * lock takes to be granted.  A non-blocking lock that is denied is
+ * retried at once, so contention shows as latency either way.
+ */
+void do_bench(struct response *resp)
+{
+	int rc;
+	struct flock lock;
+	struct flock unlock;
+	uint64_t owner;
+	long long int *latency;
+	long long int start, t0;
+	long int i;
+
+	if (resp->r_fpos != 0 && filehandles[resp->r_fpos] == NULL) {
+		resp->r_status = STATUS_ERRNO;
+		resp->r_errno = EBADF;
+		array_strcpy(errdetail, "Invalid file number");
+		array_sprintf(badtoken, "%ld", resp->r_fpos);
+		return;
+	}
+
+	latency = calloc(resp->r_count, sizeof(*latency));
+
+	if (latency == NULL) {
+		resp->r_status = STATUS_ERRNO;
+		resp->r_errno = ENOMEM;
+		array_strcpy(errdetail, "Bench failed");
+		array_sprintf(badtoken, "%ld", resp->r_count);
+		return;
+	}
+
+	switch (lock_mode[resp->r_fpos]) {
+	case LOCK_MODE_POSIX:
+		owner = getpid();
+		break;
+
+	case LOCK_MODE_OFD:
+		owner = resp->r_fpos;
+		break;
+	}
+
+	lock.l_whence = SEEK_SET;
+	lock.l_type = resp->r_lock_type;
+	lock.l_start = resp->r_start;
+	lock.l_len = resp->r_length;
+	lock.l_pid = 0;
+
+	unlock = lock;
+	unlock.l_type = F_UNLCK;
+
+	start = bench_now();
+
+	for (i = 0; i < resp->r_count; i++) {
+		t0 = bench_now();
+
+		do {
+			rc = ceph_ll_setlk(cmount, filehandles[resp->r_fpos],
+					   &lock, owner, resp->r_wait);
+		} while (rc == -EAGAIN && !resp->r_wait);
+
+		latency[i] = bench_now() - t0;
+
+		if (rc == 0)
+			rc = ceph_ll_setlk(cmount, filehandles[resp->r_fpos],
+					   &unlock, owner, false);
+
+		if (rc < 0) {
+			resp->r_status = STATUS_ERRNO;
+			resp->r_errno = -rc;
+			array_strcpy(errdetail, "Bench failed");
+			array_sprintf(badtoken, "%s %lld %lld after %ld",
+				      str_lock_type(lock.l_type),
+				      resp->r_start, resp->r_length, i);
+			free(latency);
+			return;
+		}
+	}
+
+	bench_done(resp, latency, bench_now() - start);
+	free(latency);
+}
+
 void do_test(struct response *resp)
 {
 	int rc;
@@ -1373,6 +1459,9 @@ int main(int argc, char **argv)
 				case CMD_FORK:
 					complete = do_fork(&resp, oflags == 7);
 					break;
+				case CMD_BENCH:
+					do_bench(&resp);
+					break;
 
 				case CMD_HELLO:
 				case CMD_COMMENT:
@@ -418,6 +418,7 @@ enum master_cmd {
 	MCMD_SIMPLE_DEADLOCK,
 	MCMD_CLIENTS,
 	MCMD_FORK,
+	MCMD_BENCH,
 };
 
 struct token master_commands[] = {
@@ -435,6 +436,7 @@ struct token master_commands[] = {
 	{"DEADLOCK", 8, MCMD_SIMPLE_DEADLOCK},
 	{"CLIENTS", 7, MCMD_CLIENTS},
 	{"FORK", 4, MCMD_FORK},
+	{"BENCH", 5, MCMD_BENCH},
 	{"", 0, MCMD_CLIENT_CMD}
 };
 
@@ -851,6 +853,158 @@ void mcmd_fork(struct master_state *ms)
 	ms->count = 0;
 }
 
+enum bench_pattern {
+	BENCH_UNCONTENDED,
+	BENCH_SHARED,
+	BENCH_HOT,
+	BENCH_BLOCKING,
+};
+
+struct token bench_patterns[] = {
+	{"uncontended", 11, BENCH_UNCONTENDED},
+	{"shared", 6, BENCH_SHARED},
+	{"hot", 3, BENCH_HOT},
+	{"blocking", 8, BENCH_BLOCKING},
+	{"", 0, 0}
+};
+
+/*
+ * mcmd_bench
+ *
+ * Send a BENCH for the pattern to each named client, which all run
+ * it at once, then report the aggregate lock/unlock rate and the grant
+ * latency percentiles of the worst client.
+ */
+void mcmd_bench(struct master_state *ms)
+{
+	int pattern;
+	long int fpos, count, tag;
+	long long int length;
+	long long int elapsed = 0;
+	long long int latency[BENCH_NUM_LATENCY] = {0};
+	long long int ops = 0;
+	int clients = 0;
+	int i, j;
+	struct response *client_resp;
+
+	if (ms->inbrace) {
+		errno = 0;
+		array_strcpy(errdetail,
+			     "BENCH command not allowed inside brace");
+		ms->rest = NULL;
+		return;
+	}
+
+	ms->rest = get_token_value(ms->rest, &pattern, bench_patterns, false,
+				   REQUIRES_MORE, "Invalid bench pattern");
+
+	if (ms->rest == NULL)
+		return;
+
+	ms->rest = get_fpos(ms->rest, &fpos, REQUIRES_MORE);
+
+	if (ms->rest == NULL)
+		return;
+
+	ms->rest = get_longlong(ms->rest, &length, REQUIRES_MORE,
+				"Invalid lock len");
+
+	if (ms->rest == NULL)
+		return;
+
+	ms->rest = get_long(ms->rest, &count, REQUIRES_MORE,
+			    "Invalid bench count");
+
+	if (ms->rest == NULL)
+		return;
+
+	if (length <= 0 || count <= 0) {
+		errno = 0;
+		array_strcpy(errdetail,
+			     "BENCH length and count must be positive");
+		ms->rest = NULL;
+		return;
+	}
+
+	tag = get_global_tag(true);
+
+	while (ms->rest != NULL && ms->rest[0] != '\0'
+	       && ms->rest[0] != '#') {
+		ms->rest = get_client(ms->rest, &ms->client, syntax,
+				      REQUIRES_EITHER);
+
+		if (ms->rest == NULL)
+			return;
+
+		ms->client_cmd = alloc_resp(ms->client);
+		ms->client_cmd->r_cmd = CMD_BENCH;
+		ms->client_cmd->r_tag = tag;
+		ms->client_cmd->r_fpos = fpos;
+		ms->client_cmd->r_count = count;
+		ms->client_cmd->r_length = length;
+		ms->client_cmd->r_wait = pattern == BENCH_BLOCKING;
+		ms->client_cmd->r_lock_type =
+			pattern == BENCH_SHARED ? F_RDLCK : F_WRLCK;
+
+		/* Uncontended clients each lock their own record */
+		if (pattern == BENCH_UNCONTENDED)
+			ms->client_cmd->r_start = clients * length;
+
+		if (!syntax)
+			send_cmd(ms->client_cmd);
+
+		free_response(ms->client_cmd, NULL);
+		clients++;
+	}
+
+	if (clients == 0) {
+		errno = 0;
+		array_strcpy(errdetail, "Expected at least one client");
+		ms->rest = NULL;
+		return;
+	}
+
+	if (syntax)
+		return;
+
+	fprintf(output, "Waiting for %d BENCH responses...\n", clients);
+
+	for (i = 0; i < clients; i++) {
+		client_resp = receive_response(false, -1);
+
+		if (terminate || client_resp->r_cmd != CMD_BENCH ||
+		    client_resp->r_tag != tag ||
+		    client_resp->r_status != STATUS_OK) {
+			errno = 0;
+			array_sprintf(errdetail, "Unexpected response %s",
+				      client_resp->r_original);
+			free_response(client_resp, NULL);
+			ms->rest = NULL;
+			return;
+		}
+
+		/* Each iteration is a lock and an unlock */
+		ops += 2 * client_resp->r_count;
+		elapsed = MAX(elapsed, client_resp->r_elapsed);
+
+		for (j = 0; j < BENCH_NUM_LATENCY; j++)
+			latency[j] = MAX(latency[j],
+					 client_resp->r_latency[j]);
+
+		free_response(client_resp, NULL);
+	}
+
+	fprintf(output,
+		"BENCH %s: %d clients, %lld ops in %.3f secs, %.0f ops/sec\n",
+		bench_patterns[pattern].t_name, clients, ops, elapsed / 1e9,
+		elapsed > 0 ? ops * 1e9 / elapsed : 0.0);
+	fprintf(output,
+		"BENCH %s: grant usecs p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+		bench_patterns[pattern].t_name,
+		latency[BENCH_P50] / 1e3, latency[BENCH_P90] / 1e3,
+		latency[BENCH_P99] / 1e3, latency[BENCH_MAX] / 1e3);
+}
+
 void mcmd_expect(struct master_state *ms)
 {
 	ms->rest = get_client(ms->rest, &ms->client, true, REQUIRES_MORE);
@@ -993,6 +1147,13 @@ void mcmd_simple(struct master_state *ms)
 			     "FORK not compatible with a simple command");
 		break;
 
+	case CMD_BENCH:
+		array_strcpy(errdetail,
+			     "BENCH not compatible with a simple command");
+		errno = 0;
+		ms->rest = NULL;
+		break;
+
 	case NUM_COMMANDS:
 		array_strcpy(errdetail, "Invalid command");
 		errno = 0;
@@ -1096,6 +1257,10 @@ void master_command(void)
 				mcmd_fork(&ms);
 				break;
 
+			case MCMD_BENCH:
+				mcmd_bench(&ms);
+				break;
+
 			case MCMD_SIMPLE_OK:
 			case MCMD_SIMPLE_AVAILABLE:
 			case MCMD_SIMPLE_GRANTED:
@@ -43,6 +43,7 @@ struct command_def commands[NUM_COMMANDS + 1] = {
 	{"ALARM", 5},
 	{"HELLO", 5},
 	{"FORK", 4},
+	{"BENCH", 5},
 	{"QUIT", 4},
 	{"UNKNOWN", 0},
 };
@@ -157,6 +158,18 @@ void sprintf_lock_modes(char **rest, int *left, int mode)
 	}
 }
 
+struct token bench_waits[] = {
+	{"lock", 4, false},
+	{"lockw", 5, true},
+	{"", 0, 0}
+};
+
+char *get_bench_wait(char *line, int *wait)
+{
+	return get_token_value(line, wait, bench_waits, false, REQUIRES_MORE,
+			       "Invalid bench lock");
+}
+
 const char *str_lock_mode(int lock_mode)
 {
 	switch ((enum lock_mode) lock_mode) {
@@ -805,6 +818,17 @@ void sprintf_resp(char *line, int size, const char *lead,
 			sprint_left(rest, left, "\n");
 			break;
 
+		case CMD_BENCH:
+			sprint_left(rest, left,
+				    " %ld %ld %lld %lld %lld %lld %lld\n",
+				    resp->r_fpos, resp->r_count,
+				    resp->r_elapsed,
+				    resp->r_latency[BENCH_P50],
+				    resp->r_latency[BENCH_P90],
+				    resp->r_latency[BENCH_P99],
+				    resp->r_latency[BENCH_MAX]);
+			break;
+
 		case CMD_OPEN:
 			sprint_left(rest, left, " %ld %ld\n",
 				    resp->r_fpos, resp->r_fno);
@@ -910,6 +934,7 @@ char *parse_response(char *line, struct response *resp)
 {
 	char *rest;
 	long long int verify_len;
+	int i;
 
 	if (resp->r_original[0] == '\0')
 		array_strcpy(resp->r_original, line);
@@ -962,6 +987,32 @@ char *parse_response(char *line, struct response *resp)
 		case CMD_QUIT:
 			return rest;
 
+		case CMD_BENCH:
+			rest = get_fpos(rest, &resp->r_fpos, REQUIRES_MORE);
+
+			if (rest == NULL)
+				goto fail;
+
+			rest = get_long(rest, &resp->r_count, REQUIRES_MORE,
+					"Invalid bench count");
+
+			if (rest == NULL)
+				goto fail;
+
+			rest = get_longlong(rest, &resp->r_elapsed,
+					    REQUIRES_MORE,
+					    "Invalid bench time");
+
+			for (i = 0; rest != NULL && i < BENCH_NUM_LATENCY;
+			     i++) {
+				rest = get_longlong(rest, &resp->r_latency[i],
+						    i == BENCH_MAX
+							? REQUIRES_NO_MORE
+							: REQUIRES_MORE,
+						    "Invalid bench latency");
+			}
+			break;
+
 		case CMD_OPEN:
 			rest = get_fpos(rest, &resp->r_fpos, REQUIRES_MORE);
 
@@ -1229,6 +1280,13 @@ int compare_responses(struct response *expected, struct response *received)
 		case CMD_QUIT:
 			break;
 
+		case CMD_BENCH:
+			return_if_ne_long(expected->r_fpos, received->r_fpos,
+					  "Unexpected fpos");
+			return_if_ne_long(expected->r_count, received->r_count,
+					  "Unexpected count");
+			break;
+
 		case CMD_OPEN:
 			return_if_ne_long(expected->r_fpos, received->r_fpos,
 					  "Unexpected fpos");
@@ -1484,6 +1542,57 @@ char *parse_list(char *line, struct response *req)
 			    "Invalid lock len");
 }
 
+char *parse_bench(char *line, struct response *req)
+{
+	char *more;
+
+	more = get_fpos(line, &req->r_fpos, REQUIRES_MORE);
+
+	if (more == NULL)
+		return more;
+
+	more = get_bench_wait(more, &req->r_wait);
+
+	if (more == NULL)
+		return more;
+
+	more = get_lock_type(more, &req->r_lock_type);
+
+	if (more == NULL)
+		return more;
+
+	if (req->r_lock_type != F_RDLCK && req->r_lock_type != F_WRLCK) {
+		errno = EINVAL;
+		array_strcpy(errdetail, "Invalid lock type");
+		array_sprintf(badtoken, "%s", str_lock_type(req->r_lock_type));
+		return NULL;
+	}
+
+	more = get_longlong(more, &req->r_start, REQUIRES_MORE,
+			    "Invalid lock start");
+
+	if (more == NULL)
+		return more;
+
+	more = get_longlong(more, &req->r_length, REQUIRES_MORE,
+			    "Invalid lock len");
+
+	if (more == NULL)
+		return more;
+
+	more = get_long(more, &req->r_count, REQUIRES_NO_MORE,
+			"Invalid bench count");
+
+	if (more != NULL && req->r_count <= 0) {
+		errno = EINVAL;
+		array_strcpy(errdetail, "Invalid bench count");
+		array_sprintf(badtoken, "%ld", req->r_count);
+		return NULL;
+	}
+
+	return more;
+}
+
 char *parse_string(char *line, struct response *req)
 {
 	return get_rdata(line, req, MAXSTR, REQUIRES_NO_MORE);
@@ -1513,6 +1622,7 @@ parse_function_t parse_functions[NUM_COMMANDS] = {
 	parse_alarm,
 	parse_string,		/* hello */
 	parse_string,		/* fork */
+	parse_bench,
 	parse_empty,		/* quit */
 };
 
@@ -1553,6 +1663,7 @@ char *parse_request(char *line, struct response *req, int no_tag)
 	case CMD_FORK:
 	case CMD_COMMENT:
 	case CMD_ALARM:
+	case CMD_BENCH:
 	case CMD_QUIT:
 		rest = parse_functions[req->r_cmd] (rest, req);
 		break;
@@ -1564,6 +1675,44 @@ char *parse_request(char *line, struct response *req, int no_tag)
 	return rest;
 }
 
+long long int bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+	long long int la = *(const long long int *) a;
+	long long int lb = *(const long long int *) b;
+
+	return (la > lb) - (la < lb);
+}
+
+/*
+ * bench_done
+ *
+ * Fill in the response to a BENCH from the grant latencies of its
+ * r_count locks, which are sorted in place.
+ */
+void bench_done(struct response *resp, long long int *latency,
+		long long int elapsed)
+{
+	long int n = resp->r_count;
+
+	qsort(latency, n, sizeof(*latency), compare_latency);
+
+	resp->r_elapsed = elapsed;
+	resp->r_latency[BENCH_P50] = latency[(n - 1) * 50 / 100];
+	resp->r_latency[BENCH_P90] = latency[(n - 1) * 90 / 100];
+	resp->r_latency[BENCH_P99] = latency[(n - 1) * 99 / 100];
+	resp->r_latency[BENCH_MAX] = latency[n - 1];
+	resp->r_status = STATUS_OK;
+}
+
 void send_cmd(struct response *req)
 {
 	char line[MAXXFER];
@@ -1626,6 +1775,13 @@ void sprintf_req(char *line, int size, const char *lead, struct response *req)
 		sprint_left(rest, left, "\n");
 		break;
 
+	case CMD_BENCH:
+		sprint_left(rest, left, " %ld %s %s %lld %lld %ld\n",
+			    req->r_fpos, req->r_wait ? "lockw" : "lock",
+			    str_lock_type(req->r_lock_type), req->r_start,
+			    req->r_length, req->r_count);
+		break;
+
 	case CMD_OPEN:
 		sprint_left(rest, left, " %ld %s", req->r_fpos,
 			    str_read_write_flags(req->r_flags));
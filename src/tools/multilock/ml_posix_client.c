@@ -760,6 +760,93 @@ void do_unlock(struct response *resp)
 	resp->r_status = STATUS_GRANTED;
 }
 
+/*
+ * do_bench
+ *
+ * Take and release the lock r_count times, timing how long each
+ * lock takes to be granted.  A non-blocking lock that is denied is
+ * retried at once, so contention shows as latency either way.
+ */
+void do_bench(struct response *resp)
+{
+	int rc;
+	struct flock lock;
+	struct flock unlock;
+	int cmd = -1;
+	int ucmd = -1;
+	long long int *latency;
+	long long int start, t0;
+	long int i;
+
+	if (resp->r_fpos != 0 && fno[resp->r_fpos] == 0) {
+		resp->r_status = STATUS_ERRNO;
+		resp->r_errno = EBADF;
+		array_strcpy(errdetail, "Invalid file number");
+		array_sprintf(badtoken, "%ld", resp->r_fpos);
+		return;
+	}
+
+	latency = calloc(resp->r_count, sizeof(*latency));
+
+	if (latency == NULL) {
+		resp->r_status = STATUS_ERRNO;
+		resp->r_errno = ENOMEM;
+		array_strcpy(errdetail, "Bench failed");
+		array_sprintf(badtoken, "%ld", resp->r_count);
+		return;
+	}
+
+	switch (lock_mode[resp->r_fpos]) {
+	case LOCK_MODE_POSIX:
+		cmd = resp->r_wait ? F_SETLKW : F_SETLK;
+		ucmd = F_SETLK;
+		break;
+
+	case LOCK_MODE_OFD:
+		cmd = resp->r_wait ? F_OFD_SETLKW : F_OFD_SETLK;
+		ucmd = F_OFD_SETLK;
+		break;
+	}
+
+	lock.l_whence = SEEK_SET;
+	lock.l_type = resp->r_lock_type;
+	lock.l_start = resp->r_start;
+	lock.l_len = resp->r_length;
+	lock.l_pid = 0;
+
+	unlock = lock;
+	unlock.l_type = F_UNLCK;
+
+	start = bench_now();
+
+	for (i = 0; i < resp->r_count; i++) {
+		t0 = bench_now();
+
+		do {
+			rc = fcntl(fno[resp->r_fpos], cmd, &lock);
+		} while (rc == -1 && errno == EAGAIN && !resp->r_wait);
+
+		latency[i] = bench_now() - t0;
+
+		if (rc == 0)
+			rc = fcntl(fno[resp->r_fpos], ucmd, &unlock);
+
+		if (rc == -1) {
+			resp->r_status = STATUS_ERRNO;
+			resp->r_errno = errno;
+			array_strcpy(errdetail, "Bench failed");
+			array_sprintf(badtoken, "%s %lld %lld after %ld",
+				      str_lock_type(lock.l_type),
+				      resp->r_start, resp->r_length, i);
+			free(latency);
+			return;
+		}
+	}
+
+	bench_done(resp, latency, bench_now() - start);
+	free(latency);
+}
+
 void do_test(struct response *resp)
 {
 	int rc;
@@ -1304,6 +1391,9 @@ int main(int argc, char **argv)
 				case CMD_FORK:
 					complete = do_fork(&resp, oflags == 7);
 					break;
+				case CMD_BENCH:
+					do_bench(&resp);
+					break;
 
 				case CMD_HELLO:
 				case CMD_COMMENT:
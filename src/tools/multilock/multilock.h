@@ -102,10 +102,20 @@ enum commands {
 	CMD_ALARM,
 	CMD_HELLO,
 	CMD_FORK,
+	CMD_BENCH,
 	CMD_QUIT,
 	NUM_COMMANDS
 };
 
+/* Grant latency percentiles reported by BENCH */
+enum bench_latency {
+	BENCH_P50,
+	BENCH_P90,
+	BENCH_P99,
+	BENCH_MAX,
+	BENCH_NUM_LATENCY
+};
+
 enum requires_more {
 	REQUIRES_MORE,
 	REQUIRES_NO_MORE,
@@ -233,6 +243,7 @@ char *get_token_value(char *line, int *value, struct token *tokens,
 char *get_status(char *line, struct response *resp);
 char *get_open_opts(char *line, long int *fpos, int *flags, int *mode,
 		    int *lock_mode);
+char *get_bench_wait(char *line, int *wait);
 char *parse_response(char *line, struct response *resp);
 char *parse_request(char *line, struct response *req, int no_tag);
 char *get_on_off(char *line, bool *value);
@@ -250,6 +261,10 @@ const char *str_status(enum status status);
 
 const char *str_read_write_flags(int flags);
 
+long long int bench_now(void);
+void bench_done(struct response *resp, long long int *latency,
+		long long int elapsed);
+
 enum status parse_status(char *str, int len);
 
 void free_response(struct response *resp, struct response **list);
@@ -277,6 +292,10 @@ struct response {
 	int r_flags;
 	int r_mode;
 	long int r_errno;
+	long int r_count;	/* BENCH lock/unlock iterations */
+	int r_wait;		/* BENCH uses blocking locks */
+	long long int r_elapsed;	/* BENCH run time in nsecs */
+	long long int r_latency[BENCH_NUM_LATENCY];	/* nsecs */
 	/**
 	 * @brief complex data for a request/response
 	 *
@@ -310,6 +329,7 @@ extern struct command_def commands[NUM_COMMANDS + 1];
  * tag COMMENT "string"
  * tag ALARM   seconds
  * tag HELLO   "name" (command ignored, really just a response to server)
+ * tag BENCH   fpos {lock|lockw} type start length count
  * tag QUIT    (tag is optional, if not present, tag = -1)
  */
 
@@ -337,6 +357,7 @@ extern struct command_def commands[NUM_COMMANDS + 1];
  * tag ALARM   CANCELED remain
  * tag ALARM   COMPLETED
  * 0   HELLO   OK "name"
+ * tag BENCH   OK fpos count elapsed p50 p90 p99 max
  * tag QUIT    OK
  */
 